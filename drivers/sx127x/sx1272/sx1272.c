@@ -34,6 +34,7 @@ Maintainer: Miguel Luis and Gregory Cristian
 #include "sx1272-board.h"
 #include "esp_attr.h"
 #include "esp32_mphal.h"
+#include "mpenergy.h"
 
 /*
  * Local types definition
@@ -821,6 +822,9 @@ void SX1272Reset( void )
 IRAM_ATTR void SX1272SetOpMode( uint8_t opMode )
 {
     SX1272Write( REG_OPMODE, ( SX1272Read( REG_OPMODE ) & RF_OPMODE_MASK ) | opMode );
+    // the receive modes (continuous, single and CAD) are the last ones, the same in FSK and LoRa
+    mpenergy_set( MPENERGY_RAIL_LORA_TX, opMode == RF_OPMODE_TRANSMITTER );
+    mpenergy_set( MPENERGY_RAIL_LORA_RX, opMode >= RF_OPMODE_RECEIVER );
 }
 
 IRAM_ATTR void SX1272SetModem( RadioModems_t modem )
@@ -874,16 +878,12 @@ IRAM_ATTR uint8_t SX1272Read( uint8_t addr )
 
 IRAM_ATTR void SX1272WriteBuffer( uint8_t addr, uint8_t *buffer, uint8_t size )
 {
-    uint8_t i;
-
     //NSS = 0;
     GpioWrite( &SX1272.Spi.Nss, 0 );
 
     SpiInOut( &SX1272.Spi, addr | 0x80 );
-    for( i = 0; i < size; i++ )
-    {
-        SpiInOut( &SX1272.Spi, buffer[i] );
-    }
+    // the FIFO accesses go out in bursts of the SPI data buffer size
+    SpiInOutBuf( &SX1272.Spi, buffer, NULL, size );
 
     //NSS = 1;
     GpioWrite( &SX1272.Spi.Nss, 1 );
@@ -891,17 +891,11 @@ IRAM_ATTR void SX1272WriteBuffer( uint8_t addr, uint8_t *buffer, uint8_t size )
 
 IRAM_ATTR void SX1272ReadBuffer( uint8_t addr, uint8_t *buffer, uint8_t size )
 {
-    uint8_t i;
-
     //NSS = 0;
     GpioWrite( &SX1272.Spi.Nss, 0 );
 
     SpiInOut( &SX1272.Spi, addr & 0x7F );
-
-    for( i = 0; i < size; i++ )
-    {
-        buffer[i] = SpiInOut( &SX1272.Spi, 0 );
-    }
+    SpiInOutBuf( &SX1272.Spi, NULL, buffer, size );
 
     //NSS = 1;
     GpioWrite( &SX1272.Spi.Nss, 1 );
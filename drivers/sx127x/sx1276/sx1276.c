@@ -34,6 +34,7 @@ Maintainer: Miguel Luis, Gregory Cristian and Wael Guibene
 #include "sx1276-board.h"
 #include "esp_attr.h"
 #include "esp32_mphal.h"
+#include "mpenergy.h"
 
 /*
  * Local types definition
@@ -992,6 +993,9 @@ void SX1276Reset( void )
 IRAM_ATTR void SX1276SetOpMode( uint8_t opMode )
 {
     SX1276Write( REG_OPMODE, ( SX1276Read( REG_OPMODE ) & RF_OPMODE_MASK ) | opMode );
+    // the receive modes (continuous, single and CAD) are the last ones, the same in FSK and LoRa
+    mpenergy_set( MPENERGY_RAIL_LORA_TX, opMode == RF_OPMODE_TRANSMITTER );
+    mpenergy_set( MPENERGY_RAIL_LORA_RX, opMode >= RF_OPMODE_RECEIVER );
 }
 
 IRAM_ATTR void SX1276SetModem( RadioModems_t modem )
@@ -1045,16 +1049,12 @@ IRAM_ATTR uint8_t SX1276Read( uint8_t addr )
 
 IRAM_ATTR void SX1276WriteBuffer( uint8_t addr, uint8_t *buffer, uint8_t size )
 {
-    uint8_t i;
-
     //NSS = 0;
     GpioWrite( &SX1276.Spi.Nss, 0 );
 
     SpiInOut( &SX1276.Spi, addr | 0x80 );
-    for( i = 0; i < size; i++ )
-    {
-        SpiInOut( &SX1276.Spi, buffer[i] );
-    }
+    // the FIFO accesses go out in bursts of the SPI data buffer size
+    SpiInOutBuf( &SX1276.Spi, buffer, NULL, size );
 
     //NSS = 1;
     GpioWrite( &SX1276.Spi.Nss, 1 );
@@ -1062,17 +1062,11 @@ IRAM_ATTR void SX1276WriteBuffer( uint8_t addr, uint8_t *buffer, uint8_t size )
 
 IRAM_ATTR void SX1276ReadBuffer( uint8_t addr, uint8_t *buffer, uint8_t size )
 {
-    uint8_t i;
-
     //NSS = 0;
     GpioWrite( &SX1276.Spi.Nss, 0 );
 
     SpiInOut( &SX1276.Spi, addr & 0x7F );
-
-    for( i = 0; i < size; i++ )
-    {
-        buffer[i] = SpiInOut( &SX1276.Spi, 0 );
-    }
+    SpiInOutBuf( &SX1276.Spi, NULL, buffer, size );
 
     //NSS = 1;
     GpioWrite( &SX1276.Spi.Nss, 1 );
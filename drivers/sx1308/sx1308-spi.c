@@ -139,3 +139,58 @@ IRAM_ATTR uint16_t sx1308_SpiInOut(Spi_sx1308_t *obj, uint16_t outData) {
     // read data out
     return READ_PERI_REG(SPI_W0_REG(spiNum));
 }
+
+/*!
+ * \brief Sends outData and receives inData, up to 64 bytes per SPI transaction
+ *
+ * \remark The bytes go through the SPI data buffer (W0-W15) instead of being
+ *         clocked one by one, NSS must be driven by the caller.
+ *
+ * \param [IN]  obj     SPI object
+ * \param [IN]  outData Bytes to be sent, zeros are sent if NULL
+ * \param [OUT] inData  Received bytes, discarded if NULL
+ * \param [IN]  size    Number of bytes
+ */
+IRAM_ATTR void sx1308_SpiInOutBuf(Spi_sx1308_t *obj, const uint8_t *outData, uint8_t *inData, int size) {
+    uint32_t spiNum = obj->Spi;
+    uint32_t word;
+    int chunk, i, j;
+
+    while (size > 0) {
+        chunk = (size > SX1308_SPI_BUF_SIZE) ? SX1308_SPI_BUF_SIZE : size;
+
+        // set data send buffer length
+        SET_PERI_REG_BITS(SPI_MOSI_DLEN_REG(spiNum), SPI_USR_MOSI_DBITLEN, (chunk * 8) - 1, SPI_USR_MOSI_DBITLEN_S);
+        SET_PERI_REG_BITS(SPI_MISO_DLEN_REG(spiNum), SPI_USR_MISO_DBITLEN, (chunk * 8) - 1, SPI_USR_MISO_DBITLEN_S);
+
+        // load the send buffer, the first byte goes out from the lowest bits of W0
+        for (i = 0; i < chunk; i += 4) {
+            word = 0;
+            if (outData != NULL) {
+                for (j = 0; (j < 4) && ((i + j) < chunk); j++) {
+                    word |= (uint32_t)outData[i + j] << (j * 8);
+                }
+            }
+            WRITE_PERI_REG(SPI_W0_REG(spiNum) + i, word);
+        }
+        // start to send data
+        SET_PERI_REG_MASK(SPI_CMD_REG(spiNum), SPI_USR);
+
+        while (READ_PERI_REG(SPI_CMD_REG(spiNum)) & SPI_USR);
+
+        // read data out
+        if (inData != NULL) {
+            for (i = 0; i < chunk; i += 4) {
+                word = READ_PERI_REG(SPI_W0_REG(spiNum) + i);
+                for (j = 0; (j < 4) && ((i + j) < chunk); j++) {
+                    inData[i + j] = (uint8_t)(word >> (j * 8));
+                }
+            }
+            inData += chunk;
+        }
+        if (outData != NULL) {
+            outData += chunk;
+        }
+        size -= chunk;
+    }
+}
@@ -40,6 +40,7 @@ Maintainer: Miguel Luis and Gregory Cristian
 #include "py/runtime.h"
 #include "machpin.h"
 
+#define SX1308_SPI_BUF_SIZE         64  // size of the SPI data buffer (W0-W15)
 
 struct Spi_sx1308_s
 {
@@ -56,3 +57,5 @@ typedef struct Spi_sx1308_s Spi_sx1308_t;
 extern void sx1308_SpiInit( Spi_sx1308_t *obj);
 
 extern uint16_t sx1308_SpiInOut(Spi_sx1308_t *obj, uint16_t outData);
+
+extern void sx1308_SpiInOutBuf(Spi_sx1308_t *obj, const uint8_t *outData, uint8_t *inData, int size);
@@ -111,111 +111,76 @@ void sx1308_dig_reset(void) { //init modem for s2lp
 }
 
 void sx1308_spiWrite(uint8_t reg, uint8_t val) {
+    uint8_t buf[2] = { 0x80 | (reg & 0x7F), val };
+
     //NSS = 0;
     GpioWrite( SX1308.Spi.Nss, 0 );
-    sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, 0x80 | (reg & 0x7F) );
-    sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, val );
+    sx1308_SpiInOutBuf( (Spi_sx1308_t *)&SX1308.Spi, buf, NULL, sizeof(buf) );
     //NSS = 1;
     GpioWrite( SX1308.Spi.Nss, 1 );
 }
 
 void sx1308_spiWriteBurstF(uint8_t reg, uint8_t * val, int size) {
-    int i = 0;
-
     //NSS = 0;
     GpioWrite( SX1308.Spi.Nss, 0 );
 
     sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, 0x80 | (reg & 0x7F) );
-    for( i = 0; i < size; i++ )
-    {
-        sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, val[i] );
-    }
+    sx1308_SpiInOutBuf( (Spi_sx1308_t *)&SX1308.Spi, val, NULL, size );
 }
 
 void sx1308_spiWriteBurstM(uint8_t reg, uint8_t * val, int size) {
-    int i = 0;
-
-    for( i = 0; i < size; i++ )
-    {
-        sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, val[i] );
-    }
+    sx1308_SpiInOutBuf( (Spi_sx1308_t *)&SX1308.Spi, val, NULL, size );
 }
 
 void sx1308_spiWriteBurstE(uint8_t reg, uint8_t * val, int size) {
-    int i = 0;
-
-    for( i = 0; i < size; i++ )
-    {
-        sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, val[i] );
-    }
+    sx1308_SpiInOutBuf( (Spi_sx1308_t *)&SX1308.Spi, val, NULL, size );
 
     //NSS = 1;
     GpioWrite( SX1308.Spi.Nss, 1 );
 }
 
 void sx1308_spiWriteBurst(uint8_t reg, uint8_t * val, int size) {
-    int i = 0;
-
     //NSS = 0;
     GpioWrite( SX1308.Spi.Nss, 0 );
 
     sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, 0x80 | (reg & 0x7F) );
-    for( i = 0; i < size; i++ )
-    {
-        sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, val[i] );
-    }
+    sx1308_SpiInOutBuf( (Spi_sx1308_t *)&SX1308.Spi, val, NULL, size );
 
     //NSS = 1;
     GpioWrite( SX1308.Spi.Nss, 1 );
 }
 
 uint8_t sx1308_spiRead(uint8_t reg) {
-    uint8_t val = 0;
+    uint8_t buf[2] = { reg & 0x7F, 0 };
 
     //NSS = 0;
     GpioWrite( SX1308.Spi.Nss, 0 );
-    sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, reg & 0x7F );
-    val = sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, 0 );
+    sx1308_SpiInOutBuf( (Spi_sx1308_t *)&SX1308.Spi, buf, buf, sizeof(buf) );
     //NSS = 1;
     GpioWrite( SX1308.Spi.Nss, 1 );
 
-    return val;
+    return buf[1];
 }
 
 uint8_t sx1308_spiReadBurstF(uint8_t reg, uint8_t *data, int size) {
-    int i;
-
     //NSS = 0;
     GpioWrite( SX1308.Spi.Nss, 0 );
 
     sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, reg & 0x7F );
 
-    for( i = 0; i < size; i++ )
-    {
-        data[i] = sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, 0 );
-    }
+    sx1308_SpiInOutBuf( (Spi_sx1308_t *)&SX1308.Spi, NULL, data, size );
 
     return 0;
 }
 
 uint8_t sx1308_spiReadBurstM(uint8_t reg, uint8_t *data, int size) {
-    int i;
-
-    for( i = 0; i < size; i++ )
-    {
-        data[i] = sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, 0 );
-    }
+    sx1308_SpiInOutBuf( (Spi_sx1308_t *)&SX1308.Spi, NULL, data, size );
 
     return 0;
 }
 
 uint8_t sx1308_spiReadBurstE(uint8_t reg, uint8_t *data, int size) {
-    int i;
-
-    for( i = 0; i < size; i++ )
-    {
-        data[i] = sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, 0 );
-    }
+    sx1308_SpiInOutBuf( (Spi_sx1308_t *)&SX1308.Spi, NULL, data, size );
 
     //NSS = 1;
     GpioWrite( SX1308.Spi.Nss, 1 );
@@ -224,17 +189,12 @@ uint8_t sx1308_spiReadBurstE(uint8_t reg, uint8_t *data, int size) {
 }
 
 uint8_t sx1308_spiReadBurst(uint8_t reg, uint8_t *data, int size) {
-    int i;
-
     //NSS = 0;
     GpioWrite( SX1308.Spi.Nss, 0 );
 
     sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, reg & 0x7F );
 
-    for( i = 0; i < size; i++ )
-    {
-        data[i] = sx1308_SpiInOut( (Spi_sx1308_t *)&SX1308.Spi, 0 );
-    }
+    sx1308_SpiInOutBuf( (Spi_sx1308_t *)&SX1308.Spi, NULL, data, size );
 
     //NSS = 1;
     GpioWrite( SX1308.Spi.Nss, 1 );
@@ -163,6 +163,10 @@ APP_MODS_SRC_C = $(addprefix mods/,\
 	modwlan.c \
 	modutime.c \
 	modpycom.c \
+	modpycom_log.c \
+	modpycom_mmap.c \
+	modpycom_nvs.c \
+	modpycom_pktbuf.c \
 	moduqueue.c \
 	moduhashlib.c \
 	moducrypto.c \
@@ -178,9 +182,14 @@ APP_MODS_SRC_C = $(addprefix mods/,\
 	modled.c \
 	machwdt.c \
 	machrmt.c \
+	machledstrip.c \
+	machonewire.c \
+	machcounter.c \
+	machulp.c \
 	lwipsocket.c \
 	machtouch.c \
 	modmdns.c \
+	modmqtt.c \
 	)
 ifeq ($(MOD_COAP_ENABLED), 1)
 APP_INC += -Ibsdiff
@@ -224,7 +233,15 @@ APP_UTIL_SRC_C = $(addprefix util/,\
 	fifo.c \
 	socketfifo.c \
 	mpirq.c \
+	pktbuf.c \
+	mptrace.c \
+	mpenergy.c \
+	flashcache.c \
+	btreealloc.c \
 	mpsleep.c \
+	mpcpufreq.c \
+	mppoll.c \
+	nativecode.c \
 	timeutils.c \
 	esp32chipinfo.c \
 	pycom_general_util.c \
@@ -359,6 +376,7 @@ APP_SIGFOX_SPI_SRC_C = $(addprefix lora/,\
 
 APP_LTE_SRC_C = $(addprefix lte/,\
     lteppp.c \
+    sqnstp.c \
     )
 
 APP_MODS_LTE_SRC_C = $(addprefix mods/,\
@@ -485,6 +503,8 @@ APP_LDFLAGS += $(LDFLAGS_MOD)
 CFLAGS += $(APP_INC) -DMICROPY_NLR_SETJMP=1 -DMBEDTLS_CONFIG_FILE='"mbedtls/esp_config.h"' -DHAVE_CONFIG_H -DESP_PLATFORM -DFFCONF_H=\"lib/oofatfs/ffconf.h\" -DWITH_POSIX
 CFLAGS_SIGFOX += $(APP_INC) -DMICROPY_NLR_SETJMP=1 -DMBEDTLS_CONFIG_FILE='"mbedtls/esp_config.h"' -DHAVE_CONFIG_H -DESP_PLATFORM
 CFLAGS += -DREGION_AS923 -DREGION_AU915 -DREGION_EU868 -DREGION_US915 -DREGION_CN470 -DREGION_EU433 -DREGION_IN865 -DBASE=0 -DPYBYTES=1 
+# compute the LoRaMAC MIC and payload encryption with the AES peripheral
+CFLAGS += -DLORAMAC_CRYPTO_HW_AES
 
 # Specify if this is Firmware build has Pybytes enabled
 ifeq ($(PYBYTES_ENABLED), 1)
@@ -494,6 +514,17 @@ else
 CFLAGS += -DVARIANT=0
 endif
 
+# 8MB flash layout: default, or perf for 2.5MB app slots, an "mpy" partition and a 1.5MB /flash
+LAYOUT_8MB ?= default
+ifeq ($(LAYOUT_8MB), perf)
+    $(info 8MB Performance Flash Layout)
+    CFLAGS += -DPYCOM_LAYOUT_8MB_PERF=1
+else
+    ifneq ($(LAYOUT_8MB), default)
+        $(error Invalid LAYOUT_8MB specified)
+    endif
+endif
+
 # Give the possibility to use LittleFs on /flash, otherwise FatFs is used
 FS ?= ""
 ifeq ($(FS), LFS)
@@ -575,9 +606,15 @@ PART_BIN_ENCRYPT_4MB = $(PART_BIN_4MB)_enc
 PART_BIN_ENCRYPT_8MB = $(PART_BIN_8MB)_enc
 APP_BIN_ENCRYPT = $(APP_BIN)_enc
 APP_IMG  = $(BUILD)/appimg.bin
+ifeq ($(LAYOUT_8MB), perf)
+PART_CSV_8MB = lib/partitions_8MB_perf.csv
+APP_PART_2_8MB = 0x400000
+else
 PART_CSV_8MB = lib/partitions_8MB.csv
+APP_PART_2_8MB = 0x210000
+endif
 PART_CSV_4MB = lib/partitions_4MB.csv
-APP_BIN_ENCRYPT_2_8MB = $(APP_BIN)_enc_0x210000
+APP_BIN_ENCRYPT_2_8MB = $(APP_BIN)_enc_$(APP_PART_2_8MB)
 APP_BIN_ENCRYPT_2_4MB = $(APP_BIN)_enc_0x1C0000
 
 ESPPORT ?= /dev/ttyUSB0
@@ -617,7 +654,7 @@ SIGN_BINARY = $(ESPSECUREPY) sign_data --keyfile $(SECURE_KEY)
 # $(ENCRYPT_BINARY) $(ENCRYPT_0x10000) -o image_encrypt.bin image.bin
 ENCRYPT_BINARY = $(ESPSECUREPY) encrypt_flash_data --keyfile $(ENCRYPT_KEY)
 ENCRYPT_0x10000 = --address 0x10000
-ENCRYPT_APP_PART_2_8MB = --address 0x210000
+ENCRYPT_APP_PART_2_8MB = --address $(APP_PART_2_8MB)
 ENCRYPT_APP_PART_2_4MB = --address 0x1C0000
 
 GEN_ESP32PART := $(PYTHON) $(ESP_IDF_COMP_PATH)/partition_table/gen_esp32part.py -q
@@ -798,10 +835,10 @@ ifeq ($(SECURE), on)
 	$(Q) $(SIGN_BINARY) $@
 	$(ECHO) $(SEPARATOR)
 ifeq ($(BOARD), $(filter $(BOARD), FIPY GPY LOPY4))
-	$(ECHO) "Encrypt image into $(APP_BIN_ENCRYPT) (0x10000 offset) and $(APP_BIN_ENCRYPT_2_8MB) (0x210000 offset)"
+	$(ECHO) "Encrypt image into $(APP_BIN_ENCRYPT) (0x10000 offset) and $(APP_BIN_ENCRYPT_2_8MB) ($(APP_PART_2_8MB) offset)"
 else
 ifneq ($(BOARD), $(filter $(BOARD), SIPY))
-	$(ECHO) "Encrypt image into $(APP_BIN_ENCRYPT) (0x10000 offset) and $(APP_BIN_ENCRYPT_2_8MB) (0x210000 offset)"
+	$(ECHO) "Encrypt image into $(APP_BIN_ENCRYPT) (0x10000 offset) and $(APP_BIN_ENCRYPT_2_8MB) ($(APP_PART_2_8MB) offset)"
 	$(ECHO) "And"
 endif
 	$(ECHO) "Encrypt image into $(APP_BIN_ENCRYPT) (0x10000 offset) and $(APP_BIN_ENCRYPT_2_4MB) (0x1C0000 offset)"
@@ -854,16 +891,16 @@ endif #ifeq ($(TARGET), $(filter $(TARGET), app boot_app))
 
 release: $(APP_BIN) $(BOOT_BIN)
 	$(ECHO) "checking size of image"
-	$(Q) bash tools/size_check.sh $(BOARD) $(BTYPE) $(VARIANT)
+	$(Q) bash tools/size_check.sh $(BOARD) $(BTYPE) $(VARIANT) $(LAYOUT_8MB)
 ifeq ($(SECURE), on)
-	$(Q) tools/makepkg.sh $(BOARD) $(RELEASE_DIR) $(BUILD) 1
+	$(Q) LAYOUT_8MB=$(LAYOUT_8MB) tools/makepkg.sh $(BOARD) $(RELEASE_DIR) $(BUILD) 1
 else
-	$(Q) tools/makepkg.sh $(BOARD) $(RELEASE_DIR) $(BUILD)
+	$(Q) LAYOUT_8MB=$(LAYOUT_8MB) tools/makepkg.sh $(BOARD) $(RELEASE_DIR) $(BUILD)
 endif
 
 flash: release
 	$(ECHO) "checking size of image"
-	$(Q) bash tools/size_check.sh $(BOARD) $(BTYPE) $(VARIANT)
+	$(Q) bash tools/size_check.sh $(BOARD) $(BTYPE) $(VARIANT) $(LAYOUT_8MB)
 
 	$(ECHO) "Flashing project"
 ifeq ($(SECURE), on)
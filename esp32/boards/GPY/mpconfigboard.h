@@ -24,6 +24,9 @@
 #define MICROPY_LTE_UART_ID                                     2
 #define MICROPY_LTE_UART_BAUDRATE                               921600
 
+// typical currents of the radios in µA for machine.energy(), they can be adjusted with machine.energy_rail()
+#define MICROPY_HW_ENERGY_LTE_UA                                (60000)     // Sequans Monarch, average while attached
+
 extern uint32_t micropy_hw_flash_size;
 
 extern uint32_t micropy_hw_antenna_diversity_pin_num;
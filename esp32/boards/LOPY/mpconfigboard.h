@@ -18,6 +18,10 @@
 
 #define MICROPY_LPWAN_DIO_PIN
 
+// typical currents of the radios in µA for machine.energy(), they can be adjusted with machine.energy_rail()
+#define MICROPY_HW_ENERGY_LORA_TX_UA                            (28000)     // SX1272 at +13 dBm
+#define MICROPY_HW_ENERGY_LORA_RX_UA                            (11200)
+
 extern uint32_t micropy_hw_flash_size;
 
 extern uint32_t micropy_hw_antenna_diversity_pin_num;
@@ -18,6 +18,11 @@
 
 #define MICROPY_LPWAN_DIO_PIN
 
+// typical currents of the radios in µA for machine.energy(), they can be adjusted with machine.energy_rail()
+#define MICROPY_HW_ENERGY_LORA_TX_UA                            (44000)     // SX1276 at +14 dBm
+#define MICROPY_HW_ENERGY_LORA_RX_UA                            (10800)
+#define MICROPY_HW_ENERGY_SIGFOX_UA                             (44000)     // the uplink and its downlink window
+
 extern uint32_t micropy_hw_flash_size;
 
 extern uint32_t micropy_hw_antenna_diversity_pin_num;
@@ -18,6 +18,9 @@
 
 #define MICROPY_HW_FLASH_SIZE                                   (4 * 1024 * 1024)
 
+// typical currents of the radios in µA for machine.energy(), they can be adjusted with machine.energy_rail()
+#define MICROPY_HW_ENERGY_SIGFOX_UA                             (44000)     // the uplink and its downlink window
+
 extern uint32_t micropy_hw_flash_size;
 
 extern uint32_t micropy_hw_antenna_diversity_pin_num;
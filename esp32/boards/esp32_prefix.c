@@ -67,4 +67,6 @@
     .value          = (0), \
     .irq_trigger    = (0), \
     .hold           = (0), \
+    .hard           = (0), \
+    .filtered       = (0), \
 }
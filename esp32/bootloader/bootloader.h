@@ -41,8 +41,14 @@ typedef struct _boot_info_t
   uint32_t  crc;
 } boot_info_t;
 
+#if PYCOM_LAYOUT_8MB_PERF
+// lib/partitions_8MB_perf.csv
+#define IMG_SIZE_8MB                            (2560 * 1024)
+#define IMG_UPDATE1_OFFSET_8MB                  (4096 * 1024)  // taken from the partitions table
+#else
 #define IMG_SIZE_8MB                            (1980 * 1024)
 #define IMG_UPDATE1_OFFSET_8MB                  (2112 * 1024)  // taken from the partitions table
+#endif
 
 #define IMG_SIZE_4MB                            (1720 * 1024)
 #define IMG_UPDATE1_OFFSET_4MB                  (1792 * 1024)  // taken from the partitions table
@@ -65,7 +71,12 @@ typedef struct _boot_info_t
 #define BOOT_VERSION                        "V0.3"
 #define SPI_SEC_SIZE                        0x1000
 
+// the 8MB count must not exceed the 4MB one, the updater reads the table into an array of that size
+#if PYCOM_LAYOUT_8MB_PERF
+#define PARTITIONS_COUNT_8MB                    7
+#else
 #define PARTITIONS_COUNT_8MB                    5
+#endif
 #define PARTITIONS_COUNT_4MB                    7
 
 #define PART_TYPE_APP                       0x00
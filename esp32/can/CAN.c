@@ -35,6 +35,8 @@
 #include "esp_intr.h"
 #include "soc/dport_reg.h"
 #include <math.h>
+#include <string.h>
+#include <sys/param.h>
 
 #include "driver/gpio.h"
 
@@ -48,9 +50,21 @@ static void CAN_isr(void *arg_p);
 static bool isr_installed = false;
 static CAN_frame_format_t CAN_frame_format;
 static CAN_sw_filters_t *CAN_sw_filters;
+// only incremented by the ISR, each counter is read atomically
+static volatile CAN_stats_t CAN_stats;
+// the TX buffer can't be read back, the bits of the frame being sent are kept here
+static uint32_t CAN_tx_bits;
+
+// frame bits without stuffing: SOF, arbitration, control, CRC, ACK, EOF and IFS
+#define CAN_STD_FRAME_BITS          (47)
+#define CAN_EXT_FRAME_BITS          (67)
 
 extern void can_queue_interrupt(uint32_t events);
 
+static uint32_t CAN_frame_bits(CAN_FIR_t fir) {
+    return ((fir.B.FF == CAN_frame_std) ? CAN_STD_FRAME_BITS : CAN_EXT_FRAME_BITS) + (fir.B.RTR ? 0 : (MIN(fir.B.DLC, 8) * 8));
+}
+
 static void CAN_isr(void *arg_p){
 
     // Interrupt flag buffer
@@ -61,12 +75,29 @@ static void CAN_isr(void *arg_p){
 
     // Handle TX complete interrupt
     if ((interrupt & __CAN_IRQ_TX) != 0) {
-        /*handler*/
+        CAN_stats.tx_frames++;
+        CAN_stats.bus_bits += CAN_tx_bits;
     }
 
-    // Handle RX frame available interrupt
-    if ((interrupt & __CAN_IRQ_RX) != 0)
-        CAN_read_frame();
+    // Handle RX frame available interrupt, read all the frames of the FIFO at once
+    if ((interrupt & __CAN_IRQ_RX) != 0) {
+        while (MODULE_CAN->SR.B.RBS) {
+            CAN_read_frame();
+        }
+    }
+
+    if ((interrupt & __CAN_IRQ_DATA_OVERRUN) != 0) {
+        CAN_stats.rx_hw_overruns++;
+        MODULE_CAN->CMR.B.CDO = 1;
+    }
+    if ((interrupt & __CAN_IRQ_BUS_ERR) != 0) {
+        CAN_stats.bus_errors++;
+        (void)MODULE_CAN->ECC;
+    }
+    if ((interrupt & __CAN_IRQ_ARB_LOST) != 0) {
+        CAN_stats.arb_lost++;
+        (void)MODULE_CAN->ALC;
+    }
 
     // Handle error interrupts.
     if ((interrupt & (__CAN_IRQ_ERR                        //0x4
@@ -122,6 +153,9 @@ static void CAN_read_frame(void) {
     //get FIR
     __frame.FIR.U=MODULE_CAN->MBX_CTRL.FCTRL.FIR.U;
 
+    CAN_stats.rx_frames++;
+    CAN_stats.bus_bits += CAN_frame_bits(__frame.FIR);
+
     //check if this is a standard or extended CAN frame
     //standard frame
     if(__frame.FIR.B.FF==CAN_frame_std){
@@ -173,9 +207,15 @@ static void CAN_read_frame(void) {
     can_queue_interrupt(events);
 
     //send frame to input queue
-    xQueueSendFromISR(CAN_cfg.rx_queue,&__frame,0);
+    if (xQueueSendFromISR(CAN_cfg.rx_queue,&__frame,0) != pdTRUE) {
+        CAN_stats.rx_queue_overruns++;
+    }
+    goto release_frame;
 
 drop_frame:
+    CAN_stats.rx_filtered++;
+
+release_frame:
 
     //Let the hardware know the frame has been read.
     MODULE_CAN->CMR.B.RRB=1;
@@ -193,6 +233,8 @@ int CAN_write_frame(const CAN_frame_t* p_frame){
     //copy frame information record
     MODULE_CAN->MBX_CTRL.FCTRL.FIR.U=p_frame->FIR.U;
 
+    CAN_tx_bits = CAN_frame_bits(p_frame->FIR);
+
     //standard frame
     if(p_frame->FIR.B.FF==CAN_frame_std){
 
@@ -293,6 +335,8 @@ int CAN_init(CAN_mode_t mode, CAN_frame_format_t frame_format) {
     //no software filters
     CAN_sw_filters = NULL;
 
+    memset((void *)&CAN_stats, 0, sizeof(CAN_stats));
+
     //set to normal mode
     MODULE_CAN->OCR.B.OCMODE=__CAN_OC_NOM;
 
@@ -330,6 +374,40 @@ int CAN_stop(void) {
     return 0;
 }
 
+void CAN_get_stats(CAN_stats_t *stats, bool clear) {
+    *stats = CAN_stats;
+    if (clear) {
+        memset((void *)&CAN_stats, 0, sizeof(CAN_stats));
+    }
+}
+
+void CAN_setup_acceptance_filter(uint32_t code, uint32_t mask, uint8_t frame_format) {
+    uint32_t acr, amr;
+
+    if (frame_format == CAN_frame_std) {
+        // ID.10-0 are in ACR0 and the 3 upper bits of ACR1, the RTR bit and the first data bytes are not compared
+        acr = code << 21;
+        amr = (mask << 21) | 0x001FFFFF;
+    } else if (frame_format == CAN_frame_ext) {
+        // ID.28-0 are in ACR0 to the 5 upper bits of ACR3, the RTR bit is not compared
+        acr = code << 3;
+        amr = (mask << 3) | 0x7;
+    } else {
+        // the identifiers of both formats overlap in the same bits, accept all
+        acr = 0;
+        amr = 0xFFFFFFFF;
+    }
+
+    // the filter can only be changed in reset mode
+    MODULE_CAN->MOD.B.RM = 1;
+    MODULE_CAN->MOD.B.AFM = 1;
+    for (int i = 0; i < 4; i++) {
+        MODULE_CAN->MBX_CTRL.ACC.CODE[i] = (acr >> (24 - (i * 8))) & 0xFF;
+        MODULE_CAN->MBX_CTRL.ACC.MASK[i] = (amr >> (24 - (i * 8))) & 0xFF;
+    }
+    MODULE_CAN->MOD.B.RM = 0;
+}
+
 void CAN_setup_sw_filters(CAN_sw_filters_t *swfilters) {
     CAN_sw_filters = swfilters;
 }
@@ -30,6 +30,7 @@
 #define __DRIVERS_CAN_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "CAN_config.h"
 
 #define CAN_frame_both            2            /**< Support both frame types, only used for Rx filtering. */
@@ -97,6 +98,17 @@ typedef struct {
     uint8_t num_filters;
 }CAN_hw_filters_t;
 
+typedef struct {
+    uint32_t rx_frames;                     /**< \brief Frames accepted by the hardware filter */
+    uint32_t rx_filtered;                   /**< \brief Frames dropped by the software filters or the frame format */
+    uint32_t rx_queue_overruns;             /**< \brief Frames lost because the RX queue was full */
+    uint32_t rx_hw_overruns;                /**< \brief Data overruns of the controller's RX FIFO */
+    uint32_t tx_frames;                     /**< \brief Frames transmitted */
+    uint32_t bus_errors;                    /**< \brief Bus errors */
+    uint32_t arb_lost;                      /**< \brief Arbitrations lost */
+    uint32_t bus_bits;                      /**< \brief Estimated bits of the frames above, without stuffing */
+}CAN_stats_t;
+
 typedef enum {
     CAN_RX_FRAME_EVENT = 1,
     CAN_FIFO_NOT_EMPTY_EVENT = 2,
@@ -130,4 +142,15 @@ void CAN_setup_sw_filters(CAN_sw_filters_t *swfilters);
 
 void CAN_setup_hw_filters(CAN_hw_filters_t *hwfilters);
 
+/**
+ * \brief Programs the acceptance filter of the controller in single filter mode
+ *
+ * \param    code    Identifier to match
+ * \param    mask    Identifier bits that are not compared (1 = don't care)
+ * \param    frame_format    Format of the identifiers, all frames are accepted for #CAN_frame_both
+ */
+void CAN_setup_acceptance_filter(uint32_t code, uint32_t mask, uint8_t frame_format);
+
+void CAN_get_stats(CAN_stats_t *stats, bool clear);
+
 #endif
@@ -7,6 +7,7 @@
  * available at https://www.pycom.io/opensource/licensing
  */
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +17,7 @@
 #include "sdmmc_cmd.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "soc/soc_memory_layout.h"
 #include "lib/oofatfs/ff.h"
 #include "lib/oofatfs/diskio.h"
 #include "sd_diskio.h"
@@ -36,26 +38,34 @@
 #define CARD_VERSION_1              0
 #define CARD_VERSION_2              1
 
+#ifndef MIN
+#define MIN(a, b)                   (((a) < (b)) ? (a) : (b))
+#endif
+
 //*****************************************************************************
 // Disk Info for attached disk
 //*****************************************************************************
 sdmmc_card_t sdmmc_card_info;
 static DSTATUS sd_card_status = STA_NOINIT;
+// DMA capable buffer used for transfers from/to buffers the SDMMC DMA can't reach (PSRAM or unaligned)
+static BYTE *sd_bounce_buffer = NULL;
 
 //*****************************************************************************
 //
 //! Initializes physical drive
 //!
-//! This function initializes the physical drive
+//! This function initializes the physical drive with the given bus width
+//! (1 or 4 data lines) and maximum clock frequency, the card is switched to
+//! high speed mode when freq_khz allows it and the card supports it.
 //!
 //! \return Returns 0 on succeeded.
 //*****************************************************************************
-DSTATUS sd_disk_init (void) {
+DSTATUS sd_disk_init (uint8_t width, uint32_t freq_khz) {
     sdmmc_host_t config =
     {
-        .flags = SDMMC_HOST_FLAG_1BIT,
+        .flags = (width == 4) ? (SDMMC_HOST_FLAG_1BIT | SDMMC_HOST_FLAG_4BIT) : SDMMC_HOST_FLAG_1BIT,
         .slot = SDMMC_HOST_SLOT_1,
-        .max_freq_khz = SDMMC_FREQ_DEFAULT,
+        .max_freq_khz = freq_khz,
         .io_voltage = 3.3f,
         .init = &sdmmc_host_init,
         .set_bus_width = &sdmmc_host_set_bus_width,
@@ -69,9 +79,18 @@ DSTATUS sd_disk_init (void) {
     gpio_set_pull_mode(2, GPIO_PULLUP_ONLY);
     gpio_set_pull_mode(14, GPIO_PULLUP_ONLY);
     gpio_set_pull_mode(15, GPIO_PULLUP_ONLY);
+    if (width == 4) {
+        // DAT1, DAT2 and DAT3
+        gpio_set_pull_mode(4, GPIO_PULLUP_ONLY);
+        gpio_set_pull_mode(12, GPIO_PULLUP_ONLY);
+        gpio_set_pull_mode(13, GPIO_PULLUP_ONLY);
+    }
 
     if (ESP_OK == sdmmc_card_init(&config, &sdmmc_card_info)) {
         sd_card_status = 0;
+        if (sd_bounce_buffer == NULL) {
+            sd_bounce_buffer = heap_caps_malloc(SD_BOUNCE_SECTORS * SD_SECTOR_SIZE, MALLOC_CAP_DMA);
+        }
     } else {
         sd_card_status = STA_NOINIT;
     }
@@ -88,6 +107,15 @@ DSTATUS sd_disk_init (void) {
 void sd_disk_deinit (void) {
     sdmmc_card_info.csd.capacity = 0;
     sd_card_status = STA_NOINIT;
+    free(sd_bounce_buffer);
+    sd_bounce_buffer = NULL;
+}
+
+// The SDMMC DMA can only access word aligned internal RAM, for any other buffer the driver falls back
+// to one sector per command, so move the data through the bounce buffer several sectors at a time instead
+static bool sd_disk_use_bounce_buffer (const BYTE *pBuffer, UINT SectorCount) {
+    return (sd_bounce_buffer != NULL && SectorCount > 1 &&
+            (!esp_ptr_dma_capable(pBuffer) || ((uintptr_t)pBuffer & 3) != 0));
 }
 
 //*****************************************************************************
@@ -102,7 +130,19 @@ void sd_disk_deinit (void) {
 //*****************************************************************************
 DRESULT sd_disk_read (BYTE* pBuffer, DWORD ulSectorNumber, UINT SectorCount) {
     if (SectorCount > 0) {
-        if (ESP_OK == sdmmc_read_sectors(&sdmmc_card_info, pBuffer, ulSectorNumber, SectorCount)) {
+        if (sd_disk_use_bounce_buffer(pBuffer, SectorCount)) {
+            while (SectorCount > 0) {
+                UINT count = MIN(SectorCount, SD_BOUNCE_SECTORS);
+                if (ESP_OK != sdmmc_read_sectors(&sdmmc_card_info, sd_bounce_buffer, ulSectorNumber, count)) {
+                    return RES_ERROR;
+                }
+                memcpy(pBuffer, sd_bounce_buffer, count * SD_SECTOR_SIZE);
+                pBuffer += count * SD_SECTOR_SIZE;
+                ulSectorNumber += count;
+                SectorCount -= count;
+            }
+            return RES_OK;
+        } else if (ESP_OK == sdmmc_read_sectors(&sdmmc_card_info, pBuffer, ulSectorNumber, SectorCount)) {
             return RES_OK;
         }
     }
@@ -121,7 +161,19 @@ DRESULT sd_disk_read (BYTE* pBuffer, DWORD ulSectorNumber, UINT SectorCount) {
 //*****************************************************************************
 DRESULT sd_disk_write (const BYTE* pBuffer, DWORD ulSectorNumber, UINT SectorCount) {
     if (SectorCount > 0) {
-        if (ESP_OK == sdmmc_write_sectors(&sdmmc_card_info, pBuffer, ulSectorNumber, SectorCount)) {
+        if (sd_disk_use_bounce_buffer(pBuffer, SectorCount)) {
+            while (SectorCount > 0) {
+                UINT count = MIN(SectorCount, SD_BOUNCE_SECTORS);
+                memcpy(sd_bounce_buffer, pBuffer, count * SD_SECTOR_SIZE);
+                if (ESP_OK != sdmmc_write_sectors(&sdmmc_card_info, sd_bounce_buffer, ulSectorNumber, count)) {
+                    return RES_ERROR;
+                }
+                pBuffer += count * SD_SECTOR_SIZE;
+                ulSectorNumber += count;
+                SectorCount -= count;
+            }
+            return RES_OK;
+        } else if (ESP_OK == sdmmc_write_sectors(&sdmmc_card_info, pBuffer, ulSectorNumber, SectorCount)) {
             return RES_OK;
         }
     }
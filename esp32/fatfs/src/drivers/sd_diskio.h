@@ -11,6 +11,8 @@
 #define SD_DISKIO_H_
 
 #define SD_SECTOR_SIZE                          512
+// number of sectors moved per command when the caller's buffer isn't DMA capable
+#define SD_BOUNCE_SECTORS                       8
 
 //*****************************************************************************
 // Disk Info Structure definition
@@ -18,7 +20,7 @@
 
 extern sdmmc_card_t sdmmc_card_info;
 
-DSTATUS sd_disk_init (void);
+DSTATUS sd_disk_init (uint8_t width, uint32_t freq_khz);
 void sd_disk_deinit (void);
 DRESULT sd_disk_read (BYTE* pBuffer, DWORD ulSectorNumber, UINT bSectorCount);
 DRESULT sd_disk_write (const BYTE* pBuffer, DWORD ulSectorNumber, UINT bSectorCount);
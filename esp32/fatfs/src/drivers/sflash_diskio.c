@@ -17,6 +17,8 @@
 #include "esp_spi_flash.h"
 #include "esp_flash_encrypt.h"
 #include "esp32chipinfo.h"
+#include "flashcache.h"
+#include "mpenergy.h"
 
 static uint8_t *sflash_block_cache;
 static bool sflash_cache_is_dirty;
@@ -30,6 +32,8 @@ static uint32_t sflash_fs_sector_count;
 static bool sflash_write (void) {
     esp_err_t wr_result = ESP_FAIL;
 
+    flashcache_invalidate(sflash_prev_block_addr, SFLASH_BLOCK_SIZE);
+    mpenergy_set(MPENERGY_RAIL_FLASH, true);
     // erase the block first
     if (ESP_OK == spi_flash_erase_sector(sflash_prev_block_addr / SFLASH_BLOCK_SIZE)) {
             // then write it
@@ -40,6 +44,7 @@ static bool sflash_write (void) {
                 wr_result = spi_flash_write(sflash_prev_block_addr, (void *)sflash_block_cache, SFLASH_BLOCK_SIZE);
             }
     }
+    mpenergy_set(MPENERGY_RAIL_FLASH, false);
     return (wr_result == ESP_OK);
 }
 
@@ -55,6 +60,8 @@ DRESULT sflash_disk_init (void) {
             sflash_fs_sector_count = SFLASH_FS_SECTOR_COUNT_4MB;
         }
         sflash_block_cache = (uint8_t *)malloc(SFLASH_BLOCK_SIZE);
+        // the blocks switched in and out of sflash_block_cache (FAT, directories, data) are kept decrypted there
+        flashcache_init();
         sflash_prev_block_addr = UINT32_MAX;
         sflash_cache_is_dirty = false;
         sflash_init_done = true;
@@ -90,7 +97,7 @@ DRESULT sflash_disk_read(BYTE *buff, DWORD sector, UINT count) {
                 return RES_ERROR;
             }
             sflash_prev_block_addr = sflash_block_addr;
-            if (ESP_OK != spi_flash_read_encrypted(sflash_block_addr, (void *)sflash_block_cache, SFLASH_BLOCK_SIZE)) {
+            if (ESP_OK != flashcache_read(sflash_block_addr, (void *)sflash_block_cache, SFLASH_BLOCK_SIZE)) {
                 // TODO sl_LockObjUnlock (&flash_LockObj);
                 return RES_ERROR;
             }
@@ -126,7 +133,7 @@ DRESULT sflash_disk_write(const BYTE *buff, DWORD sector, UINT count) {
                 return RES_ERROR;
             }
             sflash_prev_block_addr = sflash_block_addr;
-            if (ESP_OK != spi_flash_read_encrypted(sflash_block_addr, (void *)sflash_block_cache, SFLASH_BLOCK_SIZE)) {
+            if (ESP_OK != flashcache_read(sflash_block_addr, (void *)sflash_block_cache, SFLASH_BLOCK_SIZE)) {
 //                // TODO sl_LockObjUnlock (&flash_LockObj);
                 return RES_ERROR;
             }
@@ -141,15 +148,15 @@ DRESULT sflash_disk_write(const BYTE *buff, DWORD sector, UINT count) {
     return RES_OK;
 }
 
-int sflash_disk_read_littlefs(const struct lfs_config *lfscfg, void* buff, uint32_t block, uint32_t size)
+int sflash_disk_read_littlefs(const struct lfs_config *lfscfg, void* buff, uint32_t block, uint32_t off, uint32_t size)
 {
     // TODO sl_LockObjLock (&flash_LockObj, SL_OS_WAIT_FOREVER);
     int ret = LFS_ERR_OK;
 
-    if(block >= lfscfg->block_count) {
+    if(block >= lfscfg->block_count || off + size > SFLASH_BLOCK_SIZE) {
         ret = LFS_ERR_IO;
     }
-    else if (ESP_OK != spi_flash_read(sflash_start_address + block*SFLASH_BLOCK_SIZE, buff, size)) {
+    else if (ESP_OK != spi_flash_read(sflash_start_address + block*SFLASH_BLOCK_SIZE + off, buff, size)) {
         ret = LFS_ERR_IO;
     }
 
@@ -165,23 +172,27 @@ int sflash_disk_erase_littlefs(const struct lfs_config *lfscfg, uint32_t block)
     if(block >= lfscfg->block_count) {
         ret = LFS_ERR_IO;
     }
-    else if(ESP_OK != spi_flash_erase_sector((sflash_start_address + block*SFLASH_BLOCK_SIZE)/SFLASH_BLOCK_SIZE)) {
-        ret = LFS_ERR_IO;
+    else {
+        // LittleFS reads the flash raw, the cache only holds what FatFS read before a mkfs
+        flashcache_invalidate(sflash_start_address + block*SFLASH_BLOCK_SIZE, SFLASH_BLOCK_SIZE);
+        if(ESP_OK != spi_flash_erase_sector((sflash_start_address + block*SFLASH_BLOCK_SIZE)/SFLASH_BLOCK_SIZE)) {
+            ret = LFS_ERR_IO;
+        }
     }
 
     // TODO sl_LockObjUnlock (&flash_LockObj);
     return ret;
 }
 
-int sflash_disk_write_littlefs(const struct lfs_config *lfscfg, const void *buff, uint32_t block, uint32_t size) {
+int sflash_disk_write_littlefs(const struct lfs_config *lfscfg, const void *buff, uint32_t block, uint32_t off, uint32_t size) {
 
     // TODO sl_LockObjLock (&flash_LockObj, SL_OS_WAIT_FOREVER);
     int ret = LFS_ERR_OK;
 
-    if(block >= lfscfg->block_count) {
+    if(block >= lfscfg->block_count || off + size > SFLASH_BLOCK_SIZE) {
         ret = LFS_ERR_IO;
     }
-    else if(ESP_OK != spi_flash_write((sflash_start_address + block*SFLASH_BLOCK_SIZE), buff, size)) {
+    else if(ESP_OK != spi_flash_write((sflash_start_address + block*SFLASH_BLOCK_SIZE + off), buff, size)) {
         ret = LFS_ERR_IO;
     }
 
@@ -203,3 +214,7 @@ DRESULT sflash_disk_flush (void) {
 uint32_t sflash_get_sector_count(void) {
     return sflash_fs_sector_count;
 }
+
+uint32_t sflash_get_start_address(void) {
+    return sflash_start_address;
+}
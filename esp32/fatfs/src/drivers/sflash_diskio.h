@@ -23,7 +23,11 @@
 
 #define SFLASH_BLOCK_COUNT_8MB          MICROPY_PORT_SFLASH_BLOCK_COUNT_8MB
 #define SFLASH_FS_SECTOR_COUNT_8MB      ((SFLASH_BLOCK_SIZE * SFLASH_BLOCK_COUNT_8MB) / SFLASH_FS_SECTOR_SIZE)
+#if PYCOM_LAYOUT_8MB_PERF
+#define SFLASH_START_ADDR_8MB           0x00680000
+#else
 #define SFLASH_START_ADDR_8MB           0x00400000
+#endif
 #define SFLASH_START_BLOCK_8MB          (SFLASH_START_ADDR_8MB / SFLASH_BLOCK_SIZE)
 #define SFLASH_END_BLOCK_8MB            (SFLASH_START_BLOCK_8MB + (SFLASH_BLOCK_COUNT - 1))
 
@@ -33,9 +37,10 @@ DRESULT sflash_disk_read(BYTE *buff, DWORD sector, UINT count);
 DRESULT sflash_disk_write(const BYTE *buff, DWORD sector, UINT count);
 DRESULT sflash_disk_flush(void);
 uint32_t sflash_get_sector_count(void);
+uint32_t sflash_get_start_address(void);
 
-extern int sflash_disk_read_littlefs(const struct lfs_config *lfscfg, void* buff, uint32_t block, uint32_t size);
-extern int sflash_disk_write_littlefs(const struct lfs_config *lfscfg, const void* buff, uint32_t block, uint32_t size);
+extern int sflash_disk_read_littlefs(const struct lfs_config *lfscfg, void* buff, uint32_t block, uint32_t off, uint32_t size);
+extern int sflash_disk_write_littlefs(const struct lfs_config *lfscfg, const void* buff, uint32_t block, uint32_t off, uint32_t size);
 extern int sflash_disk_erase_littlefs(const struct lfs_config *lfscfg, uint32_t block);
 
 #endif /* SFLASH_DISKIO_H_ */
@@ -65,6 +65,13 @@ def crc16(s):
         crc = ((crc<<8)&0xff00) ^ table[((crc>>8)&0xff)^ch]
     return crc
 
+# The native CRC module is much faster when the firmware has it
+try:
+    from ucrc import CRC
+    crc16 = CRC('crc16_xmodem').calc
+except ImportError:
+    pass
+
 def usleep(x):
     time.sleep(x/1000000.0)
 
@@ -374,9 +381,38 @@ class Master:
 class args(object):
     pass
 
+# The firmware can run the whole transfer natively, on the LTE UART
+try:
+    from network import LTE
+    modem_stp_send = LTE.modem_stp_send
+except (ImportError, AttributeError):
+    modem_stp_send = None
+
+def start_native(elf, elfsize, retry=None, debug=None):
+    what = "Sending %d bytes" % elfsize
+    def progress(downloaded, total, barLen=40):
+        percent = float(downloaded)/total
+        hashes = '#' * int(round(percent*barLen))
+        spaces = ' ' * (barLen - len(hashes))
+        print('\r%s: [%s%s] %3d%%' % (what, hashes, spaces, int(round(percent*100))), end='')
+
+    offset = 0
+    while True:
+        # picks up from where a failed attempt stopped
+        offset = modem_stp_send(elf, elfsize, offset=offset, progress=progress)
+        print()
+        if offset >= elfsize:
+            return True
+        if debug: print('Transfer stopped after %d bytes' % offset)
+        if not retry:
+            return False
+
 def start(elf, elfsize, serial, baud=3686400, retry=None, debug=None, AT=True, pkgdebug=False):
     dev = None
 
+    if modem_stp_send and not pkgdebug:
+        return start_native(elf, elfsize, retry=retry, debug=debug)
+
     try:
         # The base-two logarithm of the window size, which therefore ranges between 512 and 32768
         # 12 is 4096K
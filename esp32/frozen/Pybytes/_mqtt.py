@@ -21,7 +21,94 @@ try:
 except:
     from _pybytes_debug import print_debug
 
+try:
+    from network import MQTT as NativeMQTT
+except ImportError:
+    NativeMQTT = None
+
 import time
+import socket
+import _thread
+
+
+class NativeMQTTCore:
+    """MQTTCore on top of network.MQTT, which runs the protocol in its own task.
+
+    Only the socket is set up here, the framing, the acks and the pings
+    are handled natively and the messages come through the callbacks.
+    The same client is kept across the reconnections, what is published
+    meanwhile waits in its backlog, spilled to the flash past BACKLOG bytes.
+    """
+
+    BACKLOG = 8192
+    SPILL = '/flash/pybytes_backlog'
+
+    def __init__(self, clientID, keepalive=20, reconnectMethod=None):
+        self.client_id = clientID
+        self._user = ""
+        self._password = ""
+        self._keepalive = keepalive
+        self._reconnectMethod = reconnectMethod
+        self._host = ""
+        self._port = -1
+        self._mqtt = None
+
+    def configEndpoint(self, srcHost, srcPort):
+        self._host = srcHost
+        self._port = srcPort
+
+    def _client(self):
+        if self._mqtt is None:
+            self._mqtt = NativeMQTT(
+                self.client_id,
+                user=self._user if self._user else None,
+                password=self._password if self._password else None,
+                keepalive=self._keepalive,
+                backlog=self.BACKLOG,
+                spill=self.SPILL
+            )
+            self._mqtt.callback(self._connection_lost)
+        return self._mqtt
+
+    def connect(self):
+        mqtt = self._client()
+        sock = socket.socket()
+        try:
+            sock.settimeout(30)
+            sock.connect(socket.getaddrinfo(self._host, self._port)[0][-1])
+        except socket.error as err:
+            print_debug(2, "Socket create error: {0}".format(err))
+            sock.close()
+            return False
+
+        return mqtt.connect(sock)
+
+    def _connection_lost(self, mqtt):
+        # called from the interrupt handlers, reconnecting can take long
+        if self._reconnectMethod is not None:
+            _thread.start_new_thread(self._reconnectMethod, ())
+
+    def subscribe(self, topic, qos, callback):
+        if (topic is None or callback is None):
+            raise TypeError("Invalid subscribe values.")
+        return self._mqtt.subscribe(topic, qos, callback)
+
+    def publish(self, topic, payload, qos, retain, dup=False, priority=False):
+        # also while offline, sent once connected again
+        return self._client().publish(
+            topic, payload, qos, retain, dup=dup, priority=priority
+        )
+
+    def stats(self):
+        return self._client().stats()
+
+    def unsubscribe(self, topic):
+        return self._mqtt.unsubscribe(topic)
+
+    def disconnect(self, force=False):
+        if self._mqtt is not None:
+            self._mqtt.disconnect(force)
+        return True
 
 
 class MQTTClient:
@@ -45,16 +132,26 @@ class MQTTClient:
         self.__clientId = client_id
         self.__user = user
         self.__password = password
+        self.__mqtt = None
         self.init_mqtt_core()
 
     def init_mqtt_core(self):
-        self.__mqtt = mqtt_core(
-            self.__clientId,
-            True,
-            mqttConst.MQTTv3_1_1,
-            receive_timeout=500,
-            reconnectMethod=self.reconnect
-        )
+        if isinstance(self.__mqtt, NativeMQTTCore):
+            # its backlog is kept
+            return
+        if NativeMQTT is not None:
+            self.__mqtt = NativeMQTTCore(
+                self.__clientId,
+                reconnectMethod=self.reconnect
+            )
+        else:
+            self.__mqtt = mqtt_core(
+                self.__clientId,
+                True,
+                mqttConst.MQTTv3_1_1,
+                receive_timeout=500,
+                reconnectMethod=self.reconnect
+            )
         self.__mqtt.configEndpoint(self.__server, self.__port)
         self.__mqtt._user = self.__user
         self.__mqtt._password = self.__password
@@ -116,7 +213,17 @@ class MQTTClient:
             except OSError:
                 time.sleep(self.__reconnect_count)
 
+    def buffered(self):
+        """True if the messages published while offline are sent later"""
+        return isinstance(self.__mqtt, NativeMQTTCore)
+
+    def stats(self):
+        return self.__mqtt.stats() if self.buffered() else None
+
     def publish(self, topic, msg, retain=False, qos=0, priority=False):
+        if self.buffered():
+            # never waits for the reconnection
+            return self.__mqtt.publish(topic, msg, qos, False, priority=priority)
         while 1:
             if not self.__reconnecting:
                 try:
@@ -289,7 +289,7 @@ class Pybytes:
     def write_config(self, file='/flash/pybytes_config.json', silent=False):
         try:
             f = open(file, 'w')
-            f.write(json.dumps(self.__conf))
+            json.dump(self.__conf, f, chunk_size=256)
             f.close()
             if not silent:
                 print("Pybytes configuration written to {}".format(file))
@@ -387,7 +387,7 @@ class Pybytes:
         self.__check_init()
         try:
             f = open(file, 'w')
-            f.write(json.dumps(self.__conf))
+            json.dump(self.__conf, f, chunk_size=256)
             f.close()
             print("Pybytes configuration exported to {}".format(file))
         except Exception as e:
@@ -37,7 +37,7 @@ class PybytesConfig:
         print_debug(2, 'Writing configuration to {}'.format(filename))
         try:
             cf = open(filename, 'w')
-            cf.write(json.dumps(self.__pybytes_config))
+            json.dump(self.__pybytes_config, cf, chunk_size=256)
             cf.close()
             return True
         except Exception as e:
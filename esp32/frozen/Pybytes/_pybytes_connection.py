@@ -117,6 +117,8 @@ class PybytesConnection:
             attempt = 0
 
             print_debug(3, 'WLAN connected? {}'.format(self.wlan.isconnected()))
+            if not self.wlan.isconnected():
+                self.__connect_wifi_fast(known_nets[0])
 
             while not self.wlan.isconnected() and attempt < 3:
                 attempt += 1
@@ -165,6 +167,28 @@ class PybytesConnection:
             return False
 
     # Establish a connection through LTE before connecting to mqtt server
+    def __connect_wifi_fast(self, net):
+        # no scan, the access point of the last connection is joined
+        # directly and the driver only scans if that fails
+        ssid, pwd = net
+        wifi_timeout = self.__conf.get('wifi', {}).get('timeout', 10000)
+        try:
+            if pwd:
+                self.wlan.connect(ssid, (None, pwd), timeout=wifi_timeout, fast=True)
+            else:
+                self.wlan.connect(ssid, timeout=wifi_timeout, fast=True)
+            start_time = time.ticks_ms()
+            while not self.wlan.isconnected():
+                if time.ticks_diff(time.ticks_ms(), start_time) > wifi_timeout:
+                    self.wlan.disconnect()
+                    return False
+                time.sleep_ms(20)
+            print_debug(3, 'WLAN connect time: {}'.format(self.wlan.connect_time()))
+            return True
+        except Exception as e:
+            print_debug(3, 'WLAN fast connect failed: {}'.format(e))
+            return False
+
     def connect_lte(self, activation_info=False, start_mqtt=True):
         if activation_info:
             lte_cfg = activation_info
@@ -478,12 +478,21 @@ class PybytesProtocol:
                         return
                     self.__pybytes_connection.__sigfox_socket.send(message)
 
+                elif self.__mqtt_buffered():
+                    # kept by the MQTT client until the connection is back
+                    self.__pybytes_connection.__connection.publish(
+                        finalTopic, message, priority=priority
+                    )
                 else:
                     print_debug(2, "Warning: Sending without a connection")
                     pass
             except Exception as ex:
                 print(ex)
 
+    def __mqtt_buffered(self):
+        connection = self.__pybytes_connection.__connection
+        return hasattr(connection, 'buffered') and connection.buffered()
+
     def send_user_message(self, message_type, body):
         self.__send_message(
             self.__pybytes_library.pack_user_message(
@@ -53,6 +53,7 @@
 #include "mptask.h"
 
 #include "esp32_mphal.h"
+#include "esp32chipinfo.h"
 //#define MSG(fmt, ...) printf("[%u] ftp: " fmt, mp_hal_ticks_ms(), ##__VA_ARGS__)
 #define MSG(fmt, ...) (void)0
 
@@ -63,9 +64,19 @@
 #define FTP_ACTIVE_DATA_PORT                20
 #define FTP_PASIVE_DATA_PORT                2024
 #define FTP_BUFFER_SIZE                     512
+// file data is moved in blocks the size of the TCP send buffer, so that every
+// send() fills the window and every block costs a single file system access
+#ifndef FTP_XFER_BUFFER_SIZE
+#define FTP_XFER_BUFFER_SIZE                CONFIG_TCP_SND_BUF_DEFAULT
+#endif
+#ifndef FTP_XFER_BUFFER_SIZE_PSRAM
+#define FTP_XFER_BUFFER_SIZE_PSRAM          (32 * 1024)
+#endif
 #define FTP_TX_RETRIES_MAX                  50
 #define FTP_CMD_SIZE_MAX                    6
-#define FTP_CMD_CLIENTS_MAX                 1
+#ifndef FTP_CMD_CLIENTS_MAX
+#define FTP_CMD_CLIENTS_MAX                 2               // concurrent sessions, each with its own data port
+#endif
 #define FTP_DATA_CLIENTS_MAX                1
 #define FTP_MAX_PARAM_SIZE                  (MICROPY_ALLOC_PATH_MAX + 1)
 #define FTP_UNIX_TIME_20000101              946684800ll
@@ -73,7 +84,6 @@
 #define FTP_UNIX_SECONDS_180_DAYS           15552000ll
 #define FTP_DATA_TIMEOUT_MS                 10000            // 10 seconds
 #define FTP_SOCKETFIFO_ELEMENTS_MAX         5
-#define FTP_CYCLE_TIME_MS                   (SERVERS_CYCLE_TIME_MS * 2)
 
 /******************************************************************************
  DEFINE PRIVATE TYPES
@@ -138,19 +148,27 @@ typedef struct {
     } u;
 }ftp_fileinfo_t;
 
+// state of one control session, with its own data connection, working directory and send queue
 typedef struct {
     uint8_t             *dBuffer;
+    char                *path;
+    uint8_t             *xBuffer;                   // file transfer buffer, falls back to dBuffer
+    uint32_t            xBuffer_size;
+    uint32_t            xfer_bytes;
+    uint32_t            xfer_start;
     uint32_t            ctimeout;
     union {
         ftp_file_t fp;
         ftp_dir_t  dp;
     }u;
-    int32_t             lc_sd;
+    FIFO_t              socketfifo;
+    SocketFifoElement_t fifoelements[FTP_SOCKETFIFO_ELEMENTS_MAX];
     int32_t             ld_sd;
     int32_t             c_sd;
     int32_t             d_sd;
     int32_t             dtimeout;
     uint32_t            volcount;
+    uint32_t            last_dir_idx;
     uint32_t            ip_addr;
     uint8_t             state;
     uint8_t             substate;
@@ -159,7 +177,6 @@ typedef struct {
     ftp_loggin_t        loggin;
     uint8_t             e_open;
     bool                closechild;
-    bool                enabled;
     bool                special_file;
     bool                listroot;
 } ftp_data_t;
@@ -202,8 +219,12 @@ typedef enum {
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
-static ftp_data_t ftp_data;
-static char *ftp_path;
+static ftp_data_t ftp_sessions[FTP_CMD_CLIENTS_MAX];
+static ftp_data_t *ftp_data;                        // the session being served
+static int32_t ftp_lc_sd;
+static uint32_t ftp_last_run;
+static uint32_t ftp_cycle_ms;                       // time elapsed since the previous call to ftp_run()
+static bool ftp_enabled;
 static char *ftp_scratch_buffer;
 static char *ftp_cmd_buffer;
 static const ftp_cmd_t ftp_cmd_table[] = { { "FEAT" }, { "SYST" }, { "CDUP" }, { "CWD"  },
@@ -217,9 +238,6 @@ static const ftp_month_t ftp_month[] = { { "Jan" }, { "Feb" }, { "Mar" }, { "Apr
                                          { "May" }, { "Jun" }, { "Jul" }, { "Ago" },
                                          { "Sep" }, { "Oct" }, { "Nov" }, { "Dec" } };
 
-static SocketFifoElement_t ftp_fifoelements[FTP_SOCKETFIFO_ELEMENTS_MAX];
-static FIFO_t ftp_socketfifo;
-static uint32_t ftp_last_dir_idx;
 static const TCHAR *path_relative;
 
 /******************************************************************************
@@ -242,9 +260,12 @@ STATIC FRESULT f_open_helper(ftp_file_t *fp, const TCHAR *path, BYTE mode) {
             return FR_NO_PATH;
         }
 
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(littlefs);
             int lfs_ret = littlefs_open_common_helper(&littlefs->lfs, path_relative, &fp->u.fp_lfs.fp, fatFsModetoLittleFsMode(mode), &fp->u.fp_lfs.cfg, &fp->u.fp_lfs.timestamp_update);
-        xSemaphoreGive(littlefs->mutex);
+            if (mode & FA_CREATE_ALWAYS) {
+                littlefs_import_cache_invalidate(littlefs);
+            }
+        littlefs_unlock(littlefs);
 
         return lfsErrorToFatFsError(lfs_ret);
     }
@@ -260,22 +281,20 @@ STATIC FRESULT f_open_helper(ftp_file_t *fp, const TCHAR *path, BYTE mode) {
 
 STATIC FRESULT f_read_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize, uint32_t *actualsize ) {
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
+        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_data->path, &path_relative);
         if (littlefs == NULL) {
             return FR_NO_PATH;
         }
 
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-            *actualsize = lfs_file_read(&littlefs->lfs, &fp->u.fp_lfs.fp, buff, desiredsize);
-        xSemaphoreGive(littlefs->mutex);
+        *actualsize = littlefs_file_read_chunked(littlefs, &fp->u.fp_lfs.fp, buff, desiredsize, false);
 
         return lfsErrorToFatFsError(*actualsize);
     }
     else
     {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
+        FATFS *fs = lookup_path_fatfs(ftp_data->path, &path_relative);
         if (fs == NULL) {
             return FR_NO_PATH;
         }
@@ -285,26 +304,24 @@ STATIC FRESULT f_read_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize, u
 
 STATIC FRESULT f_write_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize, uint32_t *actualsize) {
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
+        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_data->path, &path_relative);
         if (littlefs == NULL) {
             return FR_NO_PATH;
         }
 
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
-            *actualsize = lfs_file_write(&littlefs->lfs, &fp->u.fp_lfs.fp, buff, desiredsize);
-            // Request timestamp update if file has been written successfully
-            if(*actualsize >= 0) {
-                fp->u.fp_lfs.timestamp_update = true;
-            }
-        xSemaphoreGive(littlefs->mutex);
+        *actualsize = littlefs_file_write_chunked(littlefs, &fp->u.fp_lfs.fp, buff, desiredsize, false);
+        // Request timestamp update if file has been written successfully
+        if(*actualsize >= 0) {
+            fp->u.fp_lfs.timestamp_update = true;
+        }
 
         return lfsErrorToFatFsError(*actualsize);
     }
     else
     {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
+        FATFS *fs = lookup_path_fatfs(ftp_data->path, &path_relative);
         if (fs == NULL) {
             return FR_NO_PATH;
         }
@@ -314,15 +331,15 @@ STATIC FRESULT f_write_helper(ftp_file_t *fp, void* buff, uint32_t desiredsize,
 
 STATIC FRESULT f_readdir_helper(ftp_dir_t *dp, ftp_fileinfo_t *fno ) {
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
 
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
+        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_data->path, &path_relative);
         if (littlefs == NULL) {
             return FR_NO_PATH;
         }
 
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(littlefs);
 
             int lfs_ret = lfs_dir_read(&littlefs->lfs, &dp->u.dp_lfs, &fno->u.fpinfo_lfs.info);
 
@@ -366,13 +383,13 @@ STATIC FRESULT f_readdir_helper(ftp_dir_t *dp, ftp_fileinfo_t *fno ) {
                 free(file_relative_path);
             }
 
-        xSemaphoreGive(littlefs->mutex);
+        littlefs_unlock(littlefs);
 
         return lfsErrorToFatFsError(lfs_ret);
     }
     else
     {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
+        FATFS *fs = lookup_path_fatfs(ftp_data->path, &path_relative);
         if (fs == NULL) {
             return FR_NO_PATH;
         }
@@ -390,9 +407,9 @@ STATIC FRESULT f_opendir_helper(ftp_dir_t *dp, const TCHAR *path) {
             return FR_NO_PATH;
         }
 
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(littlefs);
             int lfs_ret = lfs_dir_open(&littlefs->lfs, &dp->u.dp_lfs, path_relative);
-        xSemaphoreGive(littlefs->mutex);
+        littlefs_unlock(littlefs);
 
         return lfsErrorToFatFsError(lfs_ret);
     }
@@ -409,22 +426,22 @@ STATIC FRESULT f_opendir_helper(ftp_dir_t *dp, const TCHAR *path) {
 
 STATIC FRESULT f_closefile_helper(ftp_file_t *fp) {
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
+        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_data->path, &path_relative);
         if (littlefs == NULL) {
             return FR_NO_PATH;
         }
 
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(littlefs);
             int lfs_ret = littlefs_close_common_helper(&littlefs->lfs, &fp->u.fp_lfs.fp, &fp->u.fp_lfs.cfg, &fp->u.fp_lfs.timestamp_update);
-        xSemaphoreGive(littlefs->mutex);
+        littlefs_unlock(littlefs);
 
         return lfsErrorToFatFsError(lfs_ret);
     }
     else
     {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
+        FATFS *fs = lookup_path_fatfs(ftp_data->path, &path_relative);
         if (fs == NULL) {
             return FR_NO_PATH;
         }
@@ -434,22 +451,22 @@ STATIC FRESULT f_closefile_helper(ftp_file_t *fp) {
 
 STATIC FRESULT f_closedir_helper(ftp_dir_t *dp) {
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
-        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_path, &path_relative);
+        vfs_lfs_struct_t* littlefs = lookup_path_littlefs(ftp_data->path, &path_relative);
         if (littlefs == NULL) {
             return FR_NO_PATH;
         }
 
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(littlefs);
             int lfs_ret = lfs_dir_close(&littlefs->lfs, &dp->u.dp_lfs);
-        xSemaphoreGive(littlefs->mutex);
+        littlefs_unlock(littlefs);
 
         return lfsErrorToFatFsError(lfs_ret);
     }
     else
     {
-        FATFS *fs = lookup_path_fatfs(ftp_path, &path_relative);
+        FATFS *fs = lookup_path_fatfs(ftp_data->path, &path_relative);
         if (fs == NULL) {
             return FR_NO_PATH;
         }
@@ -466,9 +483,9 @@ STATIC FRESULT f_stat_helper(const TCHAR *path, ftp_fileinfo_t *fno) {
             return FR_NO_PATH;
         }
 
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(littlefs);
             int lfs_ret = littlefs_stat_common_helper(&littlefs->lfs, path_relative, &fno->u.fpinfo_lfs.info, &fno->u.fpinfo_lfs.timestamp);
-        xSemaphoreGive(littlefs->mutex);
+        littlefs_unlock(littlefs);
 
         return lfsErrorToFatFsError(lfs_ret);
     }
@@ -491,12 +508,13 @@ STATIC FRESULT f_mkdir_helper(const TCHAR *path) {
             return FR_NO_PATH;
         }
 
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(littlefs);
             int lfs_ret = lfs_mkdir(&littlefs->lfs, path_relative);
+            littlefs_import_cache_invalidate(littlefs);
             if(lfs_ret == LFS_ERR_OK) {
                 littlefs_update_timestamp(&littlefs->lfs, path_relative);
             }
-        xSemaphoreGive(littlefs->mutex);
+        littlefs_unlock(littlefs);
 
         return lfsErrorToFatFsError(lfs_ret);
     }
@@ -520,9 +538,10 @@ STATIC FRESULT f_unlink_helper(const TCHAR *path) {
             return FR_NO_PATH;
         }
 
-        xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(littlefs);
             int lfs_ret = lfs_remove(&littlefs->lfs, path_relative);
-        xSemaphoreGive(littlefs->mutex);
+            littlefs_import_cache_invalidate(littlefs);
+        littlefs_unlock(littlefs);
 
         return lfsErrorToFatFsError(lfs_ret);
     }
@@ -556,9 +575,10 @@ STATIC FRESULT f_rename_helper(const TCHAR *path_old, const TCHAR *path_new) {
             return FR_NO_PATH;
         }
 
-        xSemaphoreTake(littlefs_new->mutex, portMAX_DELAY);
+        littlefs_lock(littlefs_new);
             int lfs_ret = lfs_rename(&littlefs_new->lfs, path_relative_old, path_relative_new);
-        xSemaphoreGive(littlefs_new->mutex);
+            littlefs_import_cache_invalidate(littlefs_new);
+        littlefs_unlock(littlefs_new);
 
         return lfsErrorToFatFsError(lfs_ret);
     }
@@ -587,18 +607,27 @@ STATIC FRESULT f_rename_helper(const TCHAR *path_old, const TCHAR *path_new) {
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
+static void ftp_select_session (ftp_data_t *session);
+static void ftp_reset_session (void);
+static bool ftp_updater_busy (void);
+static void ftp_run_session (void);
+static uint32_t ftp_session_select_fds (fd_set *rfds, fd_set *wfds, int32_t *maxfd);
 static void ftp_wait_for_enabled (void);
 static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t backlog);
 static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd, uint32_t *ip_addr);
 static ftp_result_t ftp_send_non_blocking (int32_t sd, void *data, int32_t Len);
 static void ftp_send_reply (uint32_t status, char *message);
 static void ftp_send_data (uint32_t datasize);
+static void ftp_send_file_data (uint32_t datasize);
+static void ftp_send_transfer_complete (void);
 static void ftp_send_from_fifo (void);
 static ftp_result_t ftp_recv_non_blocking (int32_t sd, void *buff, int32_t Maxlen, int32_t *rxLen);
 static void ftp_process_cmd (void);
 static void ftp_close_files (void);
 static void ftp_close_filesystem_on_error (void);
 static void ftp_close_cmd_data (void);
+static void ftp_start_transfer (void);
+static void ftp_free_xfer_buffer (void);
 static ftp_cmd_index_t ftp_pop_command (char **str);
 static void ftp_pop_param (char **str, char *param, bool stop_on_space);
 static int ftp_print_eplf_item (char *dest, uint32_t destsize, ftp_fileinfo_t *fno);
@@ -617,51 +646,128 @@ static void ftp_return_to_previous_path (char *pwd, char *dir);
  DEFINE PUBLIC FUNCTIONS
  ******************************************************************************/
 void ftp_init (void) {
-    // allocate memory for the data buffer, and the file system structs (from the RTOS heap)
-    ftp_data.dBuffer = malloc(FTP_BUFFER_SIZE);
-    ftp_path = malloc(FTP_MAX_PARAM_SIZE);
+    // the scratch and command buffers are only used while a command is processed, so they are shared
     ftp_scratch_buffer = malloc(FTP_MAX_PARAM_SIZE);
     ftp_cmd_buffer = malloc(FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX);
-    SOCKETFIFO_Init (&ftp_socketfifo, (void *)ftp_fifoelements, FTP_SOCKETFIFO_ELEMENTS_MAX);
-    ftp_data.c_sd  = -1;
-    ftp_data.d_sd  = -1;
-    ftp_data.lc_sd = -1;
-    ftp_data.ld_sd = -1;
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
-    ftp_data.state = E_FTP_STE_DISABLED;
-    ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-    ftp_data.special_file = false;
-    ftp_data.volcount = 0;
-    ftp_last_dir_idx = 0;
+    ftp_lc_sd = -1;
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        // allocate memory for the data buffer, and the file system structs (from the RTOS heap)
+        ftp_data = &ftp_sessions[i];
+        ftp_data->dBuffer = malloc(FTP_BUFFER_SIZE);
+        ftp_data->xBuffer = NULL;
+        ftp_data->xBuffer_size = 0;
+        ftp_data->path = malloc(FTP_MAX_PARAM_SIZE);
+        SOCKETFIFO_Init (&ftp_data->socketfifo, (void *)ftp_data->fifoelements, FTP_SOCKETFIFO_ELEMENTS_MAX);
+        ftp_data->c_sd  = -1;
+        ftp_data->d_sd  = -1;
+        ftp_data->ld_sd = -1;
+        ftp_data->e_open = E_FTP_NOTHING_OPEN;
+        ftp_data->state = E_FTP_STE_DISABLED;
+        ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
+        ftp_data->special_file = false;
+        ftp_data->volcount = 0;
+        ftp_data->last_dir_idx = 0;
+    }
 }
 
 void ftp_run (void) {
-    switch (ftp_data.state) {
+    uint32_t now = mp_hal_ticks_ms();
+    ftp_cycle_ms = now - ftp_last_run;
+    ftp_last_run = now;
+
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        ftp_select_session(&ftp_sessions[i]);
+        ftp_run_session();
+    }
+}
+
+uint32_t ftp_select_fds (fd_set *rfds, fd_set *wfds, int32_t *maxfd) {
+    uint32_t timeout = SERVERS_IDLE_TIME_MS;
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        ftp_select_session(&ftp_sessions[i]);
+        timeout = MIN(timeout, ftp_session_select_fds(rfds, wfds, maxfd));
+    }
+    return timeout;
+}
+
+void ftp_enable (void) {
+    ftp_enabled = true;
+}
+
+void ftp_disable (void) {
+    ftp_reset();
+    ftp_enabled = false;
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        ftp_sessions[i].state = E_FTP_STE_DISABLED;
+    }
+}
+
+void ftp_reset (void) {
+    // close all connections and start all over again
+    ftp_data_t *current = ftp_data;
+    servers_close_socket(&ftp_lc_sd);
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        ftp_select_session(&ftp_sessions[i]);
+        ftp_reset_session();
+    }
+    ftp_select_session(current);
+}
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+static void ftp_select_session (ftp_data_t *session) {
+    ftp_data = session;
+    SOCKETFIFO_Select(&session->socketfifo);
+}
+
+static void ftp_reset_session (void) {
+    // close the connections of the session being served, the others are not affected
+    servers_close_socket(&ftp_data->ld_sd);
+    ftp_close_cmd_data();
+    ftp_data->state = E_FTP_STE_START;
+    ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
+    ftp_data->volcount = 0;
+    SOCKETFIFO_Flush();
+}
+
+static bool ftp_updater_busy (void) {
+    for (int i = 0; i < FTP_CMD_CLIENTS_MAX; i++) {
+        if (ftp_sessions[i].special_file) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void ftp_run_session (void) {
+    switch (ftp_data->state) {
         case E_FTP_STE_DISABLED:
             ftp_wait_for_enabled();
             break;
         case E_FTP_STE_START:
-            if (/*wlan_is_connected() && */ ftp_create_listening_socket(&ftp_data.lc_sd, FTP_CMD_PORT, FTP_CMD_CLIENTS_MAX - 1)) {
-                ftp_data.state = E_FTP_STE_READY;
+            // the listening socket is shared by all the sessions
+            if (ftp_lc_sd >= 0 || ftp_create_listening_socket(&ftp_lc_sd, FTP_CMD_PORT, FTP_CMD_CLIENTS_MAX - 1)) {
+                ftp_data->state = E_FTP_STE_READY;
             }
             break;
         case E_FTP_STE_READY:
-            if (ftp_data.c_sd < 0 && ftp_data.substate == E_FTP_STE_SUB_DISCONNECTED) {
-                if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data.lc_sd, &ftp_data.c_sd, &ftp_data.ip_addr)) {
-                    ftp_data.txRetries = 0;
-                    ftp_data.logginRetries = 0;
-                    ftp_data.ctimeout = 0;
-                    ftp_data.loggin.uservalid = false;
-                    ftp_data.loggin.passvalid = false;
-                    strcpy (ftp_path, "/");
+            if (ftp_data->c_sd < 0 && ftp_data->substate == E_FTP_STE_SUB_DISCONNECTED) {
+                if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_lc_sd, &ftp_data->c_sd, &ftp_data->ip_addr)) {
+                    ftp_data->txRetries = 0;
+                    ftp_data->logginRetries = 0;
+                    ftp_data->ctimeout = 0;
+                    ftp_data->loggin.uservalid = false;
+                    ftp_data->loggin.passvalid = false;
+                    strcpy (ftp_data->path, "/");
                     ftp_send_reply (220, "Micropython FTP Server");
                     break;
                 }
             }
             if (SOCKETFIFO_IsEmpty()) {
-                if (ftp_data.c_sd > 0 && ftp_data.substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) {
+                if (ftp_data->c_sd > 0 && ftp_data->substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) {
                     ftp_process_cmd();
-                    if (ftp_data.state != E_FTP_STE_READY) {
+                    if (ftp_data->state != E_FTP_STE_READY) {
                         break;
                     }
                 }
@@ -673,14 +779,14 @@ void ftp_run (void) {
             // go on with listing only if the transmit buffer is empty
             if (SOCKETFIFO_IsEmpty()) {
                 uint32_t listsize;
-                ftp_list_dir((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, &listsize);
+                ftp_list_dir((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, &listsize);
                 if (listsize > 0) {
                     ftp_send_data(listsize);
                 } else {
                     ftp_send_reply(226, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                 }
-                ftp_data.ctimeout = 0;
+                ftp_data->ctimeout = 0;
             }
             break;
         case E_FTP_STE_CONTINUE_FILE_TX:
@@ -688,18 +794,18 @@ void ftp_run (void) {
             if (SOCKETFIFO_IsEmpty()) {
                 uint32_t readsize;
                 ftp_result_t result;
-                ftp_data.ctimeout = 0;
-                result = ftp_read_file ((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, &readsize);
+                ftp_data->ctimeout = 0;
+                result = ftp_read_file ((char *)ftp_data->xBuffer, ftp_data->xBuffer_size, &readsize);
                 if (result == E_FTP_RESULT_FAILED) {
                     ftp_send_reply(451, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                 } else {
                     if (readsize > 0) {
-                        ftp_send_data(readsize);
+                        ftp_send_file_data(readsize);
                     }
                     if (result == E_FTP_RESULT_OK) {
-                        ftp_send_reply(226, NULL);
-                        ftp_data.state = E_FTP_STE_END_TRANSFER;
+                        ftp_send_transfer_complete();
+                        ftp_data->state = E_FTP_STE_END_TRANSFER;
                     }
                 }
             }
@@ -708,35 +814,41 @@ void ftp_run (void) {
             if (SOCKETFIFO_IsEmpty()) {
                 int32_t len;
                 ftp_result_t result;
-                if (E_FTP_RESULT_OK == (result = ftp_recv_non_blocking(ftp_data.d_sd, ftp_data.dBuffer, FTP_BUFFER_SIZE, &len))) {
-                    ftp_data.dtimeout = 0;
-                    ftp_data.ctimeout = 0;
+                uint32_t maxlen = ftp_data->xBuffer_size;
+                if (ftp_data->special_file) {
+                    // the updater only erases one sector ahead, so write at most one sector at a time
+                    maxlen = MIN(maxlen, SPI_FLASH_SEC_SIZE);
+                }
+                if (E_FTP_RESULT_OK == (result = ftp_recv_non_blocking(ftp_data->d_sd, ftp_data->xBuffer, maxlen, &len))) {
+                    ftp_data->dtimeout = 0;
+                    ftp_data->ctimeout = 0;
+                    ftp_data->xfer_bytes += len;
                     // its a software update
-                    if (ftp_data.special_file) {
-                        if (updater_write(ftp_data.dBuffer, len)) {
+                    if (ftp_data->special_file) {
+                        if (updater_write(ftp_data->xBuffer, len)) {
                             break;
                         }
                     }
                     // user file being received
-                    else if (E_FTP_RESULT_OK == ftp_write_file ((char *)ftp_data.dBuffer, len)) {
+                    else if (E_FTP_RESULT_OK == ftp_write_file ((char *)ftp_data->xBuffer, len)) {
                         break;
                     }
                     ftp_send_reply(451, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                 } else if (result == E_FTP_RESULT_CONTINUE) {
-                    if (ftp_data.dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
+                    if ((ftp_data->dtimeout += ftp_cycle_ms) > FTP_DATA_TIMEOUT_MS) {
                         ftp_close_files();
                         ftp_send_reply(426, NULL);
-                        ftp_data.state = E_FTP_STE_END_TRANSFER;
+                        ftp_data->state = E_FTP_STE_END_TRANSFER;
                     }
                 } else {
-                    if (ftp_data.special_file) {
-                        ftp_data.special_file = false;
+                    if (ftp_data->special_file) {
+                        ftp_data->special_file = false;
                         updater_finish();
                     }
                     ftp_close_files();
-                    ftp_send_reply(226, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_send_transfer_complete();
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                 }
             }
             break;
@@ -744,27 +856,27 @@ void ftp_run (void) {
             break;
     }
 
-    switch (ftp_data.substate) {
+    switch (ftp_data->substate) {
     case E_FTP_STE_SUB_DISCONNECTED:
         break;
     case E_FTP_STE_SUB_LISTEN_FOR_DATA:
-        if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data.ld_sd, &ftp_data.d_sd, NULL)) {
-            ftp_data.dtimeout = 0;
-            ftp_data.substate = E_FTP_STE_SUB_DATA_CONNECTED;
-        } else if (ftp_data.dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
-            ftp_data.dtimeout = 0;
+        if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data->ld_sd, &ftp_data->d_sd, NULL)) {
+            ftp_data->dtimeout = 0;
+            ftp_data->substate = E_FTP_STE_SUB_DATA_CONNECTED;
+        } else if ((ftp_data->dtimeout += ftp_cycle_ms) > FTP_DATA_TIMEOUT_MS) {
+            ftp_data->dtimeout = 0;
             // close the listening socket
-            servers_close_socket(&ftp_data.ld_sd);
-            ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+            servers_close_socket(&ftp_data->ld_sd);
+            ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
         }
         break;
     case E_FTP_STE_SUB_DATA_CONNECTED:
-        if (ftp_data.state == E_FTP_STE_READY && ftp_data.dtimeout++ > FTP_DATA_TIMEOUT_MS / FTP_CYCLE_TIME_MS) {
+        if (ftp_data->state == E_FTP_STE_READY && (ftp_data->dtimeout += ftp_cycle_ms) > FTP_DATA_TIMEOUT_MS) {
             // close the listening and the data socket
-            servers_close_socket(&ftp_data.ld_sd);
-            servers_close_socket(&ftp_data.d_sd);
+            servers_close_socket(&ftp_data->ld_sd);
+            servers_close_socket(&ftp_data->d_sd);
             ftp_close_filesystem_on_error ();
-            ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+            ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
         }
         break;
     default:
@@ -775,40 +887,49 @@ void ftp_run (void) {
     ftp_send_from_fifo();
 
     // check the state of the data sockets
-    if (ftp_data.d_sd < 0 && (ftp_data.state > E_FTP_STE_READY)) {
-        ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-        ftp_data.state = E_FTP_STE_READY;
+    if (ftp_data->d_sd < 0 && (ftp_data->state > E_FTP_STE_READY)) {
+        ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
+        ftp_data->state = E_FTP_STE_READY;
+        // blocks still queued for the closed data socket are dropped without being read
+        ftp_free_xfer_buffer();
     }
 }
 
-void ftp_enable (void) {
-    ftp_data.enabled = true;
-}
-
-void ftp_disable (void) {
-    ftp_reset();
-    ftp_data.enabled = false;
-    ftp_data.state = E_FTP_STE_DISABLED;
-}
-
-void ftp_reset (void) {
-    // close all connections and start all over again
-    servers_close_socket(&ftp_data.lc_sd);
-    servers_close_socket(&ftp_data.ld_sd);
-    ftp_close_cmd_data();
-    ftp_data.state = E_FTP_STE_START;
-    ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-    ftp_data.volcount = 0;
-    SOCKETFIFO_Flush();
+static uint32_t ftp_session_select_fds (fd_set *rfds, fd_set *wfds, int32_t *maxfd) {
+    if (!SOCKETFIFO_IsEmpty()) {
+        // ftp_send_from_fifo() sends in blocking mode
+        return 0;
+    }
+    switch (ftp_data->state) {
+        case E_FTP_STE_DISABLED:
+            return ftp_enabled ? 0 : SERVERS_IDLE_TIME_MS;
+        case E_FTP_STE_START:
+            // retry creating the listening socket
+            return SERVERS_CYCLE_TIME_MS;
+        case E_FTP_STE_READY:
+            if (ftp_data->c_sd < 0 && ftp_data->substate == E_FTP_STE_SUB_DISCONNECTED) {
+                servers_fd_set(ftp_lc_sd, rfds, maxfd);
+            } else if (ftp_data->substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) {
+                servers_fd_set(ftp_data->c_sd, rfds, maxfd);
+            }
+            break;
+        case E_FTP_STE_CONTINUE_FILE_RX:
+            servers_fd_set(ftp_data->d_sd, rfds, maxfd);
+            break;
+        default:
+            // the next block of a listing or a file is ready to be sent, or the transfer is to be closed
+            return 0;
+    }
+    if (ftp_data->substate == E_FTP_STE_SUB_LISTEN_FOR_DATA) {
+        servers_fd_set(ftp_data->ld_sd, rfds, maxfd);
+    }
+    return SERVERS_IDLE_TIME_MS;
 }
 
-/******************************************************************************
- DEFINE PRIVATE FUNCTIONS
- ******************************************************************************/
 static void ftp_wait_for_enabled (void) {
     // Check if the telnet service has been enabled
-    if (ftp_data.enabled) {
-        ftp_data.state = E_FTP_STE_START;
+    if (ftp_enabled) {
+        ftp_data->state = E_FTP_STE_START;
     }
 }
 
@@ -864,8 +985,12 @@ static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd, uint32
         if (errno == EAGAIN) {
             return E_FTP_RESULT_CONTINUE;
         }
-        // error
-        ftp_reset();
+        // error, only the shared listening socket takes the other sessions down
+        if (l_sd == ftp_lc_sd) {
+            ftp_reset();
+        } else {
+            ftp_reset_session();
+        }
         return E_FTP_RESULT_FAILED;
     }
 
@@ -918,13 +1043,13 @@ static ftp_result_t ftp_send_non_blocking (int32_t sd, void *data, int32_t Len)
     fcntl(sd, F_SETFL, option);
 
     if (result > 0) {
-        ftp_data.txRetries = 0;
+        ftp_data->txRetries = 0;
         return E_FTP_RESULT_OK;
-    } else if ((FTP_TX_RETRIES_MAX >= ++ftp_data.txRetries) && (errno == EAGAIN)) {
+    } else if ((FTP_TX_RETRIES_MAX >= ++ftp_data->txRetries) && (errno == EAGAIN)) {
         return E_FTP_RESULT_CONTINUE;
     } else {
         // error
-        ftp_reset();
+        ftp_reset_session();
         return E_FTP_RESULT_FAILED;
     }
 }
@@ -938,7 +1063,7 @@ static void ftp_send_reply (uint32_t status, char *message) {
     strcat ((char *)ftp_cmd_buffer, " ");
     strcat ((char *)ftp_cmd_buffer, message);
     strcat ((char *)ftp_cmd_buffer, "\r\n");
-    fifoelement.sd = &ftp_data.c_sd;
+    fifoelement.sd = &ftp_data->c_sd;
     fifoelement.datasize = strlen((char *)ftp_cmd_buffer);
     fifoelement.data = malloc(fifoelement.datasize);
     if (status == 221) {
@@ -960,14 +1085,36 @@ static void ftp_send_reply (uint32_t status, char *message) {
 static void ftp_send_data (uint32_t datasize) {
     SocketFifoElement_t fifoelement;
 
-    fifoelement.data = ftp_data.dBuffer;
+    fifoelement.data = ftp_data->dBuffer;
     fifoelement.datasize = datasize;
-    fifoelement.sd = &ftp_data.d_sd;
+    fifoelement.sd = &ftp_data->d_sd;
     fifoelement.closesockets = E_FTP_CLOSE_NONE;
     fifoelement.freedata = false;
     SOCKETFIFO_Push (&fifoelement);
 }
 
+static void ftp_send_file_data (uint32_t datasize) {
+    SocketFifoElement_t fifoelement;
+
+    fifoelement.data = ftp_data->xBuffer;
+    fifoelement.datasize = datasize;
+    fifoelement.sd = &ftp_data->d_sd;
+    fifoelement.closesockets = E_FTP_CLOSE_NONE;
+    fifoelement.freedata = false;
+    if (SOCKETFIFO_Push (&fifoelement)) {
+        ftp_data->xfer_bytes += datasize;
+    }
+}
+
+static void ftp_send_transfer_complete (void) {
+    char message[48];
+    uint32_t elapsed = MAX(mp_hal_ticks_ms() - ftp_data->xfer_start, 1);
+    snprintf(message, sizeof(message), "%u bytes in %u ms (%u B/s)", ftp_data->xfer_bytes, elapsed,
+             (uint32_t)(((uint64_t)ftp_data->xfer_bytes * 1000) / elapsed));
+    MSG("transfer complete, %s\n", message);
+    ftp_send_reply(226, message);
+}
+
 static void ftp_send_from_fifo (void) {
     SocketFifoElement_t fifoelement;
     if (SOCKETFIFO_Peek (&fifoelement)) {
@@ -976,12 +1123,12 @@ static void ftp_send_from_fifo (void) {
             if (E_FTP_RESULT_OK == ftp_send_non_blocking (_sd, fifoelement.data, fifoelement.datasize)) {
                 SOCKETFIFO_Pop (&fifoelement);
                 if (fifoelement.closesockets != E_FTP_CLOSE_NONE) {
-                    servers_close_socket(&ftp_data.d_sd);
+                    servers_close_socket(&ftp_data->d_sd);
                     if (fifoelement.closesockets == E_FTP_CLOSE_CMD_AND_DATA) {
-                        servers_close_socket(&ftp_data.ld_sd);
+                        servers_close_socket(&ftp_data->ld_sd);
                         // this one is the command socket
                         servers_close_socket(fifoelement.sd);
-                        ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+                        ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
                     }
                     ftp_close_filesystem_on_error();
                 }
@@ -995,12 +1142,12 @@ static void ftp_send_from_fifo (void) {
                 free(fifoelement.data);
             }
         }
-    } else if (ftp_data.state == E_FTP_STE_END_TRANSFER && (ftp_data.d_sd > 0)) {
+    } else if (ftp_data->state == E_FTP_STE_END_TRANSFER && (ftp_data->d_sd > 0)) {
         // close the listening and the data sockets
-        servers_close_socket(&ftp_data.ld_sd);
-        servers_close_socket(&ftp_data.d_sd);
-        if (ftp_data.special_file) {
-            ftp_data.special_file = false;
+        servers_close_socket(&ftp_data->ld_sd);
+        servers_close_socket(&ftp_data->d_sd);
+        if (ftp_data->special_file) {
+            ftp_data->special_file = false;
         }
     }
 }
@@ -1019,8 +1166,8 @@ static ftp_result_t ftp_recv_non_blocking (int32_t sd, void *buff, int32_t Maxle
 
 static void ftp_get_param_and_open_child (char **bufptr) {
     ftp_pop_param (bufptr, ftp_scratch_buffer, false);
-    ftp_open_child (ftp_path, ftp_scratch_buffer);
-    ftp_data.closechild = true;
+    ftp_open_child (ftp_data->path, ftp_scratch_buffer);
+    ftp_data->closechild = true;
 }
 
 static void ftp_process_cmd (void) {
@@ -1030,12 +1177,12 @@ static void ftp_process_cmd (void) {
     FRESULT fres;
     ftp_fileinfo_t fno;
 
-    ftp_data.closechild = false;
+    ftp_data->closechild = false;
     // also use the reply buffer to receive new commands
-    if (E_FTP_RESULT_OK == (result = ftp_recv_non_blocking(ftp_data.c_sd, ftp_cmd_buffer, FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX, &len))) {
+    if (E_FTP_RESULT_OK == (result = ftp_recv_non_blocking(ftp_data->c_sd, ftp_cmd_buffer, FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX, &len))) {
         // bufptr is moved as commands are being popped
         ftp_cmd_index_t cmd = ftp_pop_command(&bufptr);
-        if (!ftp_data.loggin.passvalid && (cmd != E_FTP_CMD_USER && cmd != E_FTP_CMD_PASS && cmd != E_FTP_CMD_QUIT)) {
+        if (!ftp_data->loggin.passvalid && (cmd != E_FTP_CMD_USER && cmd != E_FTP_CMD_PASS && cmd != E_FTP_CMD_QUIT)) {
             ftp_send_reply(332, NULL);
             return;
         }
@@ -1047,44 +1194,44 @@ static void ftp_process_cmd (void) {
             ftp_send_reply(215, "UNIX Type: L8");
             break;
         case E_FTP_CMD_CDUP:
-            ftp_close_child(ftp_path);
+            ftp_close_child(ftp_data->path);
             ftp_send_reply(250, NULL);
             break;
         case E_FTP_CMD_CWD:
             {
                 fres = FR_NO_PATH;
                 ftp_pop_param (&bufptr, ftp_scratch_buffer, false);
-                ftp_open_child (ftp_path, ftp_scratch_buffer);
-                if ((ftp_path[0] == '/' && ftp_path[1] == '\0') || ((fres = f_opendir_helper (&ftp_data.u.dp, ftp_path)) == FR_OK)) {
+                ftp_open_child (ftp_data->path, ftp_scratch_buffer);
+                if ((ftp_data->path[0] == '/' && ftp_data->path[1] == '\0') || ((fres = f_opendir_helper (&ftp_data->u.dp, ftp_data->path)) == FR_OK)) {
                     if (fres == FR_OK) {
-                        f_closedir_helper(&ftp_data.u.dp);
+                        f_closedir_helper(&ftp_data->u.dp);
                     }
                     ftp_send_reply(250, NULL);
                 } else {
-                    ftp_close_child (ftp_path);
+                    ftp_close_child (ftp_data->path);
                     ftp_send_reply(550, NULL);
                 }
             }
             break;
         case E_FTP_CMD_PWD:
         case E_FTP_CMD_XPWD:
-            ftp_send_reply(257, ftp_path);
+            ftp_send_reply(257, ftp_data->path);
             break;
         case E_FTP_CMD_SIZE:
             {
                 ftp_get_param_and_open_child (&bufptr);
-                if (FR_OK == f_stat_helper (ftp_path, &fno)) {
+                if (FR_OK == f_stat_helper (ftp_data->path, &fno)) {
                     // send the size
-                    if(isLittleFs(ftp_path))
+                    if(isLittleFs(ftp_data->path))
                     {
-                        snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u", (uint32_t)fno.u.fpinfo_lfs.info.size);
+                        snprintf((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, "%u", (uint32_t)fno.u.fpinfo_lfs.info.size);
                     }
                     else
                     {
-                        snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u", (uint32_t)fno.u.fpinfo_fat.fsize);
+                        snprintf((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, "%u", (uint32_t)fno.u.fpinfo_fat.fsize);
                     }
 
-                    ftp_send_reply(213, (char *)ftp_data.dBuffer);
+                    ftp_send_reply(213, (char *)ftp_data->dBuffer);
                 } else {
                     ftp_send_reply(550, NULL);
                 }
@@ -1092,24 +1239,24 @@ static void ftp_process_cmd (void) {
             break;
         case E_FTP_CMD_MDTM:
             ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_stat_helper (ftp_path, &fno)) {
+            if (FR_OK == f_stat_helper (ftp_data->path, &fno)) {
                 // send the last modified time
-                if(isLittleFs(ftp_path))
+                if(isLittleFs(ftp_data->path))
                 {
-                    snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u%02u%02u%02u%02u%02u",
+                    snprintf((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, "%u%02u%02u%02u%02u%02u",
                             1980 + ((fno.u.fpinfo_lfs.timestamp.fdate >> 9) & 0x7f), (fno.u.fpinfo_lfs.timestamp.fdate >> 5) & 0x0f,
                             fno.u.fpinfo_lfs.timestamp.fdate & 0x1f, (fno.u.fpinfo_lfs.timestamp.ftime >> 11) & 0x1f,
                             (fno.u.fpinfo_lfs.timestamp.ftime >> 5) & 0x3f, 2 * (fno.u.fpinfo_lfs.timestamp.ftime & 0x1f));
                 }
                 else
                 {
-                    snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "%u%02u%02u%02u%02u%02u",
+                    snprintf((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, "%u%02u%02u%02u%02u%02u",
                                              1980 + ((fno.u.fpinfo_fat.fdate >> 9) & 0x7f), (fno.u.fpinfo_fat.fdate >> 5) & 0x0f,
                                              fno.u.fpinfo_fat.fdate & 0x1f, (fno.u.fpinfo_fat.ftime >> 11) & 0x1f,
                                              (fno.u.fpinfo_fat.ftime >> 5) & 0x3f, 2 * (fno.u.fpinfo_fat.ftime & 0x1f));
                 }
 
-                ftp_send_reply(213, (char *)ftp_data.dBuffer);
+                ftp_send_reply(213, (char *)ftp_data->dBuffer);
             } else {
                 ftp_send_reply(550, NULL);
             }
@@ -1120,16 +1267,16 @@ static void ftp_process_cmd (void) {
         case E_FTP_CMD_USER:
             ftp_pop_param (&bufptr, ftp_scratch_buffer, true);
             if (!memcmp(ftp_scratch_buffer, servers_user, MAX(strlen(ftp_scratch_buffer), strlen(servers_user)))) {
-                ftp_data.loggin.uservalid = true && (strlen(servers_user) == strlen(ftp_scratch_buffer));
+                ftp_data->loggin.uservalid = true && (strlen(servers_user) == strlen(ftp_scratch_buffer));
             }
             ftp_send_reply(331, NULL);
             break;
         case E_FTP_CMD_PASS:
             ftp_pop_param (&bufptr, ftp_scratch_buffer, true);
             if (!memcmp(ftp_scratch_buffer, servers_pass, MAX(strlen(ftp_scratch_buffer), strlen(servers_pass))) &&
-                    ftp_data.loggin.uservalid) {
-                ftp_data.loggin.passvalid = true && (strlen(servers_pass) == strlen(ftp_scratch_buffer));
-                if (ftp_data.loggin.passvalid) {
+                    ftp_data->loggin.uservalid) {
+                ftp_data->loggin.passvalid = true && (strlen(servers_pass) == strlen(ftp_scratch_buffer));
+                if (ftp_data->loggin.passvalid) {
                     ftp_send_reply(230, NULL);
                     break;
                 }
@@ -1139,27 +1286,29 @@ static void ftp_process_cmd (void) {
         case E_FTP_CMD_PASV:
             {
                 // some servers (e.g. google chrome) send PASV several times very quickly
-                servers_close_socket(&ftp_data.d_sd);
-                ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+                servers_close_socket(&ftp_data->d_sd);
+                ftp_data->substate = E_FTP_STE_SUB_DISCONNECTED;
                 bool socketcreated = true;
-                if (ftp_data.ld_sd < 0) {
-                    socketcreated = ftp_create_listening_socket(&ftp_data.ld_sd, FTP_PASIVE_DATA_PORT, FTP_DATA_CLIENTS_MAX - 1);
+                // every session listens for its data connection on its own port
+                uint32_t dport = FTP_PASIVE_DATA_PORT + (ftp_data - ftp_sessions);
+                if (ftp_data->ld_sd < 0) {
+                    socketcreated = ftp_create_listening_socket(&ftp_data->ld_sd, dport, FTP_DATA_CLIENTS_MAX - 1);
                 }
                 if (socketcreated) {
-                    uint8_t *pip = (uint8_t *)&ftp_data.ip_addr;
-                    ftp_data.dtimeout = 0;
-                    snprintf((char *)ftp_data.dBuffer, FTP_BUFFER_SIZE, "(%u,%u,%u,%u,%u,%u)",
-                             pip[0], pip[1], pip[2], pip[3], (FTP_PASIVE_DATA_PORT >> 8), (FTP_PASIVE_DATA_PORT & 0xFF));
-                    ftp_data.substate = E_FTP_STE_SUB_LISTEN_FOR_DATA;
-                    ftp_send_reply(227, (char *)ftp_data.dBuffer);
+                    uint8_t *pip = (uint8_t *)&ftp_data->ip_addr;
+                    ftp_data->dtimeout = 0;
+                    snprintf((char *)ftp_data->dBuffer, FTP_BUFFER_SIZE, "(%u,%u,%u,%u,%u,%u)",
+                             pip[0], pip[1], pip[2], pip[3], (dport >> 8), (dport & 0xFF));
+                    ftp_data->substate = E_FTP_STE_SUB_LISTEN_FOR_DATA;
+                    ftp_send_reply(227, (char *)ftp_data->dBuffer);
                 } else {
                     ftp_send_reply(425, NULL);
                 }
             }
             break;
         case E_FTP_CMD_LIST:
-            if (ftp_open_dir_for_listing(ftp_path) == E_FTP_RESULT_CONTINUE) {
-                ftp_data.state = E_FTP_STE_CONTINUE_LISTING;
+            if (ftp_open_dir_for_listing(ftp_data->path) == E_FTP_RESULT_CONTINUE) {
+                ftp_data->state = E_FTP_STE_CONTINUE_LISTING;
                 ftp_send_reply(150, NULL);
             } else {
                 ftp_send_reply(550, NULL);
@@ -1167,34 +1316,41 @@ static void ftp_process_cmd (void) {
             break;
         case E_FTP_CMD_RETR:
             ftp_get_param_and_open_child (&bufptr);
-            if (ftp_open_file (ftp_path, FA_READ)) {
-                ftp_data.state = E_FTP_STE_CONTINUE_FILE_TX;
+            if (ftp_open_file (ftp_data->path, FA_READ)) {
+                ftp_start_transfer();
+                ftp_data->state = E_FTP_STE_CONTINUE_FILE_TX;
                 ftp_send_reply(150, NULL);
             } else {
-                ftp_data.state = E_FTP_STE_END_TRANSFER;
+                ftp_data->state = E_FTP_STE_END_TRANSFER;
                 ftp_send_reply(550, NULL);
             }
             break;
         case E_FTP_CMD_STOR:
             ftp_get_param_and_open_child (&bufptr);
             // first check if a software update is being requested
-            if (updater_check_path (ftp_path)) {
-                if (updater_start()) {
-                    ftp_data.special_file = true;
-                    ftp_data.state = E_FTP_STE_CONTINUE_FILE_RX;
+            if (updater_check_path (ftp_data->path)) {
+                if (ftp_updater_busy()) {
+                    // another session is already updating the firmware
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
+                    ftp_send_reply(550, NULL);
+                } else if (updater_start()) {
+                    ftp_start_transfer();
+                    ftp_data->special_file = true;
+                    ftp_data->state = E_FTP_STE_CONTINUE_FILE_RX;
                     ftp_send_reply(150, NULL);
                 } else {
                     // to unlock the updater
                     updater_finish();
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                     ftp_send_reply(550, NULL);
                 }
             } else {
-                if (ftp_open_file (ftp_path, FA_WRITE | FA_CREATE_ALWAYS)) {
-                    ftp_data.state = E_FTP_STE_CONTINUE_FILE_RX;
+                if (ftp_open_file (ftp_data->path, FA_WRITE | FA_CREATE_ALWAYS)) {
+                    ftp_start_transfer();
+                    ftp_data->state = E_FTP_STE_CONTINUE_FILE_RX;
                     ftp_send_reply(150, NULL);
                 } else {
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
+                    ftp_data->state = E_FTP_STE_END_TRANSFER;
                     ftp_send_reply(550, NULL);
                 }
             }
@@ -1202,7 +1358,7 @@ static void ftp_process_cmd (void) {
         case E_FTP_CMD_DELE:
         case E_FTP_CMD_RMD:
             ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_unlink_helper(ftp_path)) {
+            if (FR_OK == f_unlink_helper(ftp_data->path)) {
                 ftp_send_reply(250, NULL);
             } else {
                 ftp_send_reply(550, NULL);
@@ -1210,7 +1366,7 @@ static void ftp_process_cmd (void) {
             break;
         case E_FTP_CMD_MKD:
             ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_mkdir_helper(ftp_path)) {
+            if (FR_OK == f_mkdir_helper(ftp_data->path)) {
                 ftp_send_reply(250, NULL);
             } else {
                 ftp_send_reply(550, NULL);
@@ -1218,10 +1374,10 @@ static void ftp_process_cmd (void) {
             break;
         case E_FTP_CMD_RNFR:
             ftp_get_param_and_open_child (&bufptr);
-            if (FR_OK == f_stat_helper (ftp_path, &fno)) {
+            if (FR_OK == f_stat_helper (ftp_data->path, &fno)) {
                 ftp_send_reply(350, NULL);
                 // save the current path
-                strcpy ((char *)ftp_data.dBuffer, ftp_path);
+                strcpy ((char *)ftp_data->dBuffer, ftp_data->path);
             } else {
                 ftp_send_reply(550, NULL);
             }
@@ -1229,7 +1385,7 @@ static void ftp_process_cmd (void) {
         case E_FTP_CMD_RNTO:
             ftp_get_param_and_open_child (&bufptr);
             // old path was saved in the data buffer
-            if (FR_OK == (fres = f_rename_helper ((char *)ftp_data.dBuffer, ftp_path))) {
+            if (FR_OK == (fres = f_rename_helper ((char *)ftp_data->dBuffer, ftp_data->path))) {
                 ftp_send_reply(250, NULL);
             } else {
                 ftp_send_reply(550, NULL);
@@ -1248,11 +1404,11 @@ static void ftp_process_cmd (void) {
             break;
         }
 
-        if (ftp_data.closechild) {
-            ftp_return_to_previous_path(ftp_path, ftp_scratch_buffer);
+        if (ftp_data->closechild) {
+            ftp_return_to_previous_path(ftp_data->path, ftp_scratch_buffer);
         }
     } else if (result == E_FTP_RESULT_CONTINUE) {
-        if (ftp_data.ctimeout++ > (servers_get_timeout() / FTP_CYCLE_TIME_MS)) {
+        if ((ftp_data->ctimeout += ftp_cycle_ms) > servers_get_timeout()) {
             ftp_send_reply(221, NULL);
         }
     } else {
@@ -1261,26 +1417,57 @@ static void ftp_process_cmd (void) {
 }
 
 static void ftp_close_files (void) {
-    if (ftp_data.e_open == E_FTP_FILE_OPEN) {
-        f_closefile_helper(&ftp_data.u.fp);
-    } else if (ftp_data.e_open == E_FTP_DIR_OPEN) {
-        f_closedir_helper(&ftp_data.u.dp);
+    if (ftp_data->e_open == E_FTP_FILE_OPEN) {
+        f_closefile_helper(&ftp_data->u.fp);
+    } else if (ftp_data->e_open == E_FTP_DIR_OPEN) {
+        f_closedir_helper(&ftp_data->u.dp);
     }
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
+    ftp_data->e_open = E_FTP_NOTHING_OPEN;
 }
 
 static void ftp_close_filesystem_on_error (void) {
     ftp_close_files();
-    if (ftp_data.special_file) {
+    if (ftp_data->special_file) {
         updater_finish ();
-        ftp_data.special_file = false;
+        ftp_data->special_file = false;
     }
 }
 
 static void ftp_close_cmd_data (void) {
-    servers_close_socket(&ftp_data.c_sd);
-    servers_close_socket(&ftp_data.d_sd);
+    servers_close_socket(&ftp_data->c_sd);
+    servers_close_socket(&ftp_data->d_sd);
     ftp_close_filesystem_on_error ();
+    ftp_free_xfer_buffer();
+}
+
+static void ftp_start_transfer (void) {
+    if (!ftp_data->xBuffer) {
+        // use PSRAM when available (avoiding the cache issue of rev 0 chips), internal RAM otherwise
+        if (esp32_get_chip_rev() > 0 && heap_caps_get_free_size(MALLOC_CAP_SPIRAM) >= FTP_XFER_BUFFER_SIZE_PSRAM) {
+            ftp_data->xBuffer = heap_caps_malloc(FTP_XFER_BUFFER_SIZE_PSRAM, MALLOC_CAP_SPIRAM);
+            ftp_data->xBuffer_size = FTP_XFER_BUFFER_SIZE_PSRAM;
+        }
+        if (!ftp_data->xBuffer) {
+            ftp_data->xBuffer = heap_caps_malloc(FTP_XFER_BUFFER_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            ftp_data->xBuffer_size = FTP_XFER_BUFFER_SIZE;
+        }
+        if (!ftp_data->xBuffer) {
+            // not enough memory, go on with the small data buffer
+            ftp_data->xBuffer = ftp_data->dBuffer;
+            ftp_data->xBuffer_size = FTP_BUFFER_SIZE;
+        }
+        MSG("transfer buffer of %u bytes\n", ftp_data->xBuffer_size);
+    }
+    ftp_data->xfer_bytes = 0;
+    ftp_data->xfer_start = mp_hal_ticks_ms();
+}
+
+static void ftp_free_xfer_buffer (void) {
+    if (ftp_data->xBuffer && ftp_data->xBuffer != ftp_data->dBuffer) {
+        heap_caps_free(ftp_data->xBuffer);
+    }
+    ftp_data->xBuffer = NULL;
+    ftp_data->xBuffer_size = 0;
 }
 
 static ftp_cmd_index_t ftp_pop_command (char **str) {
@@ -1319,7 +1506,7 @@ static int ftp_print_eplf_item (char *dest, uint32_t destsize, ftp_fileinfo_t *f
     uint day = 1;
     uint64_t fseconds = 0;
 
-    if(isLittleFs(ftp_path))
+    if(isLittleFs(ftp_data->path))
     {
         type = (fno->u.fpinfo_lfs.info.type == LFS_TYPE_DIR) ? "d" : "-";
 
@@ -1399,11 +1586,11 @@ static int ftp_print_eplf_drive (char *dest, uint32_t destsize, const char *name
 }
 
 static bool ftp_open_file (const char *path, int mode) {
-    FRESULT res = f_open_helper(&ftp_data.u.fp, path, mode);
+    FRESULT res = f_open_helper(&ftp_data->u.fp, path, mode);
     if (res != FR_OK) {
         return false;
     }
-    ftp_data.e_open = E_FTP_FILE_OPEN;
+    ftp_data->e_open = E_FTP_FILE_OPEN;
     return true;
 }
 
@@ -1411,7 +1598,7 @@ static ftp_result_t ftp_read_file (char *filebuf, uint32_t desiredsize, uint32_t
     ftp_result_t result = E_FTP_RESULT_CONTINUE;
 
 
-    FRESULT res = f_read_helper(&ftp_data.u.fp, filebuf, desiredsize, (UINT *)actualsize);
+    FRESULT res = f_read_helper(&ftp_data->u.fp, filebuf, desiredsize, (UINT *)actualsize);
     if (res != FR_OK) {
         ftp_close_files();
         result = E_FTP_RESULT_FAILED;
@@ -1426,7 +1613,7 @@ static ftp_result_t ftp_read_file (char *filebuf, uint32_t desiredsize, uint32_t
 static ftp_result_t ftp_write_file (char *filebuf, uint32_t size) {
     ftp_result_t result = E_FTP_RESULT_FAILED;
     uint32_t actualsize;
-    FRESULT res = f_write_helper(&ftp_data.u.fp, filebuf, size, (UINT *)&actualsize);
+    FRESULT res = f_write_helper(&ftp_data->u.fp, filebuf, size, (UINT *)&actualsize);
     if ((actualsize == size) && (FR_OK == res)) {
         result = E_FTP_RESULT_OK;
     } else {
@@ -1439,15 +1626,15 @@ static ftp_result_t ftp_open_dir_for_listing (const char *path) {
 
     // "hack" to detect the root directory
     if (path[0] == '/' && path[1] == '\0') {
-        ftp_data.listroot = true;
+        ftp_data->listroot = true;
     } else {
         FRESULT res;
-        res = f_opendir_helper(&ftp_data.u.dp, path);                       /* Open the directory */
+        res = f_opendir_helper(&ftp_data->u.dp, path);                       /* Open the directory */
         if (res != FR_OK) {
             return E_FTP_RESULT_FAILED;
         }
-        ftp_data.e_open = E_FTP_DIR_OPEN;
-        ftp_data.listroot = false;
+        ftp_data->e_open = E_FTP_DIR_OPEN;
+        ftp_data->listroot = false;
     }
     return E_FTP_RESULT_CONTINUE;
 }
@@ -1460,18 +1647,18 @@ static ftp_result_t ftp_list_dir (char *list, uint32_t maxlistsize, uint32_t *li
     ftp_fileinfo_t fno;
 
     // if we are resuming an incomplete list operation, go back to the item we left behind
-    if (!ftp_data.listroot) {
-        for (int i = 0; i < ftp_last_dir_idx; i++) {
-            f_readdir_helper(&ftp_data.u.dp, &fno);
+    if (!ftp_data->listroot) {
+        for (int i = 0; i < ftp_data->last_dir_idx; i++) {
+            f_readdir_helper(&ftp_data->u.dp, &fno);
         }
     }
 
     // read until we get all items or there's no more space in the buffer
     while (true) {
-        if (ftp_data.listroot) {
+        if (ftp_data->listroot) {
             // root directory "hack"
             mp_vfs_mount_t *vfs = MP_STATE_VM(vfs_mount_table);
-            int i = ftp_data.volcount;
+            int i = ftp_data->volcount;
             while (vfs != NULL && i != 0) {
                 vfs = vfs->next;
                 i -= 1;
@@ -1479,17 +1666,17 @@ static ftp_result_t ftp_list_dir (char *list, uint32_t maxlistsize, uint32_t *li
             if (vfs == NULL) {
                 if (!next) {
                     // no volume found this time, we are done
-                    ftp_data.volcount = 0;
+                    ftp_data->volcount = 0;
                 }
                 break;
             } else {
                 next += ftp_print_eplf_drive((list + next), (maxlistsize - next), vfs->str + 1);
             }
-            ftp_data.volcount++;
+            ftp_data->volcount++;
         } else {
             // a "normal" directory
-            res = f_readdir_helper(&ftp_data.u.dp, &fno);                                                       /* Read a directory item */
-            if(isLittleFs(ftp_path))
+            res = f_readdir_helper(&ftp_data->u.dp, &fno);                                                       /* Read a directory item */
+            if(isLittleFs(ftp_data->path))
             {
                 if (res != FR_OK || fno.u.fpinfo_lfs.info.name[0] == 0) {
                     result = E_FTP_RESULT_OK;
@@ -1497,12 +1684,12 @@ static ftp_result_t ftp_list_dir (char *list, uint32_t maxlistsize, uint32_t *li
                 }
                 if (fno.u.fpinfo_lfs.info.name[0] == '.' && fno.u.fpinfo_lfs.info.name[1] == 0)
                 {
-                    ftp_last_dir_idx++;
+                    ftp_data->last_dir_idx++;
                     continue;            /* Ignore . entry, but need to count it as LittleFs does not filter it out opposed to FatFs */
                 }
                 if (fno.u.fpinfo_lfs.info.name[0] == '.' && fno.u.fpinfo_lfs.info.name[1] == '.' && fno.u.fpinfo_lfs.info.name[2] == 0)
                 {
-                    ftp_last_dir_idx++;
+                    ftp_data->last_dir_idx++;
                     continue;            /* Ignore .. entry, but need to count it as LittleFs does not filter it out opposed to FatFs */
                 }
             }
@@ -1521,17 +1708,17 @@ static ftp_result_t ftp_list_dir (char *list, uint32_t maxlistsize, uint32_t *li
             if (!_len) {
                 // close and open again, we will resume in the next iteration
                 ftp_close_files();
-                ftp_open_dir_for_listing(ftp_path);
+                ftp_open_dir_for_listing(ftp_data->path);
                 break;
             }
             next += _len;
-            ftp_last_dir_idx++;
+            ftp_data->last_dir_idx++;
         }
     }
 
     if (result == E_FTP_RESULT_OK) {
         ftp_close_files();
-        ftp_last_dir_idx = 0;
+        ftp_data->last_dir_idx = 0;
     }
     *listsize = next;
     return result;
@@ -10,6 +10,8 @@
 #ifndef FTP_H_
 #define FTP_H_
 
+#include "lwip/sockets.h"
+
 extern void stoupper (char *str);
 
 /******************************************************************************
@@ -17,6 +19,7 @@ extern void stoupper (char *str);
  ******************************************************************************/
 extern void ftp_init (void);
 extern void ftp_run (void);
+extern uint32_t ftp_select_fds (fd_set *rfds, fd_set *wfds, int32_t *maxfd);
 extern void ftp_enable (void);
 extern void ftp_disable (void);
 extern void ftp_reset (void);
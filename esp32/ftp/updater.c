@@ -22,10 +22,21 @@
 #include "esp_log.h"
 #include "rom/crc.h"
 #include "esp32chipinfo.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_secure_boot.h"
+#include "mbedtls/sha256.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "nvs.h"
+#include "mpcpufreq.h"
+#include "flashcache.h"
 
 #ifdef DIFF_UPDATE_ENABLED
 #include "bzlib.h"
 #include "bsdiff_api.h"
+#include "extmod/uzlib/tinf.h"
 #endif
 
 /******************************************************************************
@@ -37,6 +48,22 @@ static const char *TAG = "updater";
 /* if flash is encrypted, it requires the flash_write operation to be done in 16 Bytes chunks */
 #define ENCRYP_FLASH_MIN_CHUNK                            16
 
+/* The writer task programs one buffer while the other one is filled, one sector at a time so that
+ * updater_write() erases the next sector in the background too */
+#define UPDATER_ASYNC_BUF_SIZE                          SPI_FLASH_SEC_SIZE
+#define UPDATER_ASYNC_BUF_COUNT                         (2)
+#define UPDATER_ASYNC_TASK_STACK_SIZE                   (3072)
+#define UPDATER_ASYNC_TASK_PRIORITY                     (6)
+
+/* The progress of an OTA started with an id is saved in NVS every UPDATER_CHECKPOINT_INTERVAL bytes written,
+ * so that updater_resume() continues it after a reset. It must be a multiple of SPI_FLASH_SEC_SIZE */
+#define UPDATER_CHECKPOINT_INTERVAL                     (16 * SPI_FLASH_SEC_SIZE)
+#define UPDATER_CHECKPOINT_NVS_NAMESPACE                "PY_OTA"
+#define UPDATER_CHECKPOINT_NVS_KEY                      "progress"
+
+/* An application image ends with the SHA256 of all its previous bytes, see esp_image_header_t.hash_appended */
+#define UPDATER_IMG_HASH_LEN                            (32)
+
 /******************************************************************************
  DEFINE TYPES
  ******************************************************************************/
@@ -48,6 +75,40 @@ typedef struct {
     uint32_t current_chunk;
 } updater_data_t;
 
+typedef struct {
+    mbedtls_sha256_context ctx;
+    uint32_t len;                                       // Bytes hashed, the last UPDATER_IMG_HASH_LEN written are kept in tail
+    uint8_t tail[UPDATER_IMG_HASH_LEN];
+    uint8_t tail_len;
+    bool started;
+    int8_t result;                                      // Result of updater_hash_check(), -1 until known
+} updater_hash_t;
+
+typedef struct {
+    uint32_t slot;                                      // Address of the partition written
+    uint32_t size;                                      // Bytes written, always a multiple of SPI_FLASH_SEC_SIZE
+    uint32_t crc;                                       // CRC32 of the size bytes, to check them before resuming
+    uint8_t id_len;
+    uint8_t id[UPDATER_CHECKPOINT_ID_MAX_LEN];          // Identifies the image, given by the application
+} updater_checkpoint_t;
+
+typedef struct {
+    updater_checkpoint_t saved;
+    uint32_t crc;                                       // CRC32 of all the bytes written
+    bool enabled;
+    bool stored;                                        // A checkpoint was saved in NVS
+} updater_progress_t;
+
+typedef struct {
+    TaskHandle_t task;
+    QueueHandle_t full_queue;                           // Indexes of the buffers to be written to flash
+    QueueHandle_t free_queue;                           // Indexes of the buffers which can be filled
+    uint8_t *buf[UPDATER_ASYNC_BUF_COUNT];
+    uint32_t len[UPDATER_ASYNC_BUF_COUNT];
+    int8_t filling;                                     // Index of the buffer being filled, -1 if none
+    volatile bool error;
+} updater_async_t;
+
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
@@ -61,6 +122,9 @@ static updater_data_t updater_data = {
 //static OsiLockObj_t updater_LockObj;
 static boot_info_t boot_info;
 static uint32_t boot_info_offset;
+static updater_hash_t updater_hash;
+static updater_progress_t updater_progress;
+static updater_async_t updater_async = { .filling = -1 };
 
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
@@ -68,6 +132,9 @@ static uint32_t boot_info_offset;
 static esp_err_t updater_spi_flash_read(size_t src, void *dest, size_t size, bool allow_decrypt);
 static esp_err_t updater_spi_flash_write(size_t dest_addr, void *src, size_t size, bool write_encrypted);
 static bool updater_is_delta_file(void);
+static int updater_hash_check(void);
+static void updater_progress_update(const uint8_t *buf, uint32_t len);
+static void updater_progress_clear(void);
 
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
@@ -111,6 +178,8 @@ bool updater_start (void) {
 
     ESP_LOGD(TAG, "Updating image at offset = 0x%6X\n", updater_data.offset);
     updater_data.offset_start_upd = updater_data.offset;
+    // the slot is erased sector by sector below, nothing of it may stay cached
+    flashcache_invalidate(updater_data.offset, updater_data.size);
 
     // erase the first 2 sectors
     if (ESP_OK != spi_flash_erase_sector(updater_data.offset / SPI_FLASH_SEC_SIZE)) {
@@ -125,9 +194,146 @@ bool updater_start (void) {
     boot_info.size = 0;
     updater_data.current_chunk = 0;
 
+    if (updater_hash.started) {
+        mbedtls_sha256_free(&updater_hash.ctx);
+    }
+    mbedtls_sha256_init(&updater_hash.ctx);
+    mbedtls_sha256_starts_ret(&updater_hash.ctx, 0);
+    updater_hash.len = 0;
+    updater_hash.tail_len = 0;
+    updater_hash.started = true;
+    updater_hash.result = -1;
+
+    updater_progress.crc = 0;
+    updater_progress.enabled = false;
+
     return true;
 }
 
+void updater_set_id (const uint8_t *id, uint8_t id_len) {
+    updater_progress.saved.id_len = MIN(id_len, UPDATER_CHECKPOINT_ID_MAX_LEN);
+    memcpy(updater_progress.saved.id, id, updater_progress.saved.id_len);
+    updater_progress.saved.slot = updater_data.offset_start_upd;
+    updater_progress.enabled = true;
+}
+
+int32_t updater_resume (const uint8_t *id, uint8_t id_len) {
+    updater_checkpoint_t checkpoint;
+    size_t length = sizeof(checkpoint);
+    nvs_handle nvs;
+    bool found = false;
+
+    if (!updater_start()) {
+        return -1;
+    }
+    updater_set_id(id, id_len);
+
+    if (ESP_OK == nvs_open(UPDATER_CHECKPOINT_NVS_NAMESPACE, NVS_READONLY, &nvs)) {
+        found = (ESP_OK == nvs_get_blob(nvs, UPDATER_CHECKPOINT_NVS_KEY, &checkpoint, &length)) && length == sizeof(checkpoint);
+        nvs_close(nvs);
+    }
+    if (!found || checkpoint.slot != updater_data.offset_start_upd || checkpoint.id_len != updater_progress.saved.id_len ||
+        memcmp(checkpoint.id, updater_progress.saved.id, checkpoint.id_len) != 0 ||
+        checkpoint.size == 0 || checkpoint.size > updater_data.size || (checkpoint.size % SPI_FLASH_SEC_SIZE) != 0) {
+        ESP_LOGI(TAG, "No checkpoint to resume from\n");
+        return 0;
+    }
+
+    // the partial SHA256 and the CRC32 are computed again from what was written before the reset
+    uint8_t buf[512];
+    uint32_t crc = 0;
+    for (uint32_t pos = 0; pos < checkpoint.size; pos += sizeof(buf)) {
+        if (ESP_OK != updater_spi_flash_read(checkpoint.slot + pos, buf, sizeof(buf), false)) {
+            return -1;
+        }
+        crc = crc32_le(crc, buf, sizeof(buf));
+        updater_hash_update(buf, sizeof(buf));
+    }
+    if (crc != checkpoint.crc) {
+        ESP_LOGI(TAG, "The checkpoint doesn't match the flash, starting again\n");
+        updater_start();
+        updater_set_id(id, id_len);
+        return 0;
+    }
+
+    // bytes written after the checkpoint are discarded, the sector at the write pointer and the next one are erased
+    updater_data.offset = checkpoint.slot + checkpoint.size;
+    if (ESP_OK != spi_flash_erase_sector(updater_data.offset / SPI_FLASH_SEC_SIZE) ||
+        ESP_OK != spi_flash_erase_sector((updater_data.offset + SPI_FLASH_SEC_SIZE) / SPI_FLASH_SEC_SIZE)) {
+        ESP_LOGE(TAG, "Erasing the sectors to resume failed!\n");
+        return -1;
+    }
+    boot_info.size = checkpoint.size;
+    updater_progress.saved = checkpoint;
+    updater_progress.crc = crc;
+    ESP_LOGI(TAG, "Resuming the update from %d bytes\n", checkpoint.size);
+
+    return checkpoint.size;
+}
+
+/* Updates the CRC32 of the written bytes and saves a checkpoint every UPDATER_CHECKPOINT_INTERVAL bytes,
+ * only after they were written to the flash */
+static void updater_progress_update(const uint8_t *buf, uint32_t len) {
+    if (!updater_progress.enabled) {
+        return;
+    }
+    while (len > 0) {
+        // stop at the next sector boundary, that's where a checkpoint can be taken
+        uint32_t n = MIN(len, SPI_FLASH_SEC_SIZE - (boot_info.size % SPI_FLASH_SEC_SIZE));
+        updater_progress.crc = crc32_le(updater_progress.crc, buf, n);
+        boot_info.size += n;
+        buf += n;
+        len -= n;
+
+        if ((boot_info.size % UPDATER_CHECKPOINT_INTERVAL) == 0) {
+            nvs_handle nvs;
+            updater_progress.saved.size = boot_info.size;
+            updater_progress.saved.crc = updater_progress.crc;
+            if (ESP_OK == nvs_open(UPDATER_CHECKPOINT_NVS_NAMESPACE, NVS_READWRITE, &nvs)) {
+                if (ESP_OK == nvs_set_blob(nvs, UPDATER_CHECKPOINT_NVS_KEY, &updater_progress.saved, sizeof(updater_progress.saved)) &&
+                    ESP_OK == nvs_commit(nvs)) {
+                    updater_progress.stored = true;
+                }
+                nvs_close(nvs);
+            }
+        }
+    }
+}
+
+static void updater_progress_clear(void) {
+    nvs_handle nvs;
+
+    updater_progress.enabled = false;
+    if (updater_progress.stored && ESP_OK == nvs_open(UPDATER_CHECKPOINT_NVS_NAMESPACE, NVS_READWRITE, &nvs)) {
+        nvs_erase_key(nvs, UPDATER_CHECKPOINT_NVS_KEY);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+        updater_progress.stored = false;
+    }
+}
+
+/* Hashes the written bytes except the last UPDATER_IMG_HASH_LEN ones, which are the SHA256 appended to the image */
+static void updater_hash_update(const uint8_t *buf, uint32_t len) {
+    if (!updater_hash.started) {
+        return;
+    }
+    if (len >= UPDATER_IMG_HASH_LEN) {
+        mbedtls_sha256_update_ret(&updater_hash.ctx, updater_hash.tail, updater_hash.tail_len);
+        mbedtls_sha256_update_ret(&updater_hash.ctx, buf, len - UPDATER_IMG_HASH_LEN);
+        updater_hash.len += updater_hash.tail_len + len - UPDATER_IMG_HASH_LEN;
+        memcpy(updater_hash.tail, buf + len - UPDATER_IMG_HASH_LEN, UPDATER_IMG_HASH_LEN);
+        updater_hash.tail_len = UPDATER_IMG_HASH_LEN;
+    } else {
+        uint32_t excess = updater_hash.tail_len + len;
+        excess = (excess > UPDATER_IMG_HASH_LEN) ? excess - UPDATER_IMG_HASH_LEN : 0;
+        mbedtls_sha256_update_ret(&updater_hash.ctx, updater_hash.tail, excess);
+        updater_hash.len += excess;
+        memmove(updater_hash.tail, updater_hash.tail + excess, updater_hash.tail_len - excess);
+        memcpy(updater_hash.tail + updater_hash.tail_len - excess, buf, len);
+        updater_hash.tail_len += len - excess;
+    }
+}
+
 bool updater_write (uint8_t *buf, uint32_t len) {
 
     // the actual writing into flash, not-encrypted,
@@ -137,9 +343,15 @@ bool updater_write (uint8_t *buf, uint32_t len) {
         return false;
     }
 
+    updater_hash_update(buf, len);
     updater_data.offset += len;
     updater_data.current_chunk += len;
-    boot_info.size += len;
+    if (updater_progress.enabled) {
+        // also counts the size
+        updater_progress_update(buf, len);
+    } else {
+        boot_info.size += len;
+    }
 
     if (updater_data.current_chunk >= SPI_FLASH_SEC_SIZE) {
         updater_data.current_chunk -= SPI_FLASH_SEC_SIZE;
@@ -153,31 +365,418 @@ bool updater_write (uint8_t *buf, uint32_t len) {
     return true;
 }
 
+static void TASK_Updater_Write (void *pvParameters) {
+    uint8_t index;
+
+    for (;;) {
+        xQueueReceive(updater_async.full_queue, &index, portMAX_DELAY);
+        // once a write failed the rest of the image is dropped, the error is reported by the next call
+        if (!updater_async.error && !updater_write(updater_async.buf[index], updater_async.len[index])) {
+            updater_async.error = true;
+        }
+        updater_async.len[index] = 0;
+        xQueueSend(updater_async.free_queue, &index, portMAX_DELAY);
+    }
+}
+
+/* Waits until the writer task has written all the buffers given to it */
+static void updater_async_wait (void) {
+    uint8_t index[UPDATER_ASYNC_BUF_COUNT];
+
+    if (updater_async.filling >= 0) {
+        if (updater_async.len[updater_async.filling] > 0) {
+            xQueueSend(updater_async.full_queue, &updater_async.filling, portMAX_DELAY);
+        } else {
+            xQueueSend(updater_async.free_queue, &updater_async.filling, portMAX_DELAY);
+        }
+        updater_async.filling = -1;
+    }
+    for (int i = 0; i < UPDATER_ASYNC_BUF_COUNT; i++) {
+        xQueueReceive(updater_async.free_queue, &index[i], portMAX_DELAY);
+    }
+    for (int i = 0; i < UPDATER_ASYNC_BUF_COUNT; i++) {
+        xQueueSend(updater_async.free_queue, &index[i], portMAX_DELAY);
+    }
+}
+
+/* Creates the writer task the first time, or waits until it's idle */
+static bool updater_async_init (void) {
+    if (updater_async.task == NULL) {
+        updater_async.full_queue = xQueueCreate(UPDATER_ASYNC_BUF_COUNT, sizeof(uint8_t));
+        updater_async.free_queue = xQueueCreate(UPDATER_ASYNC_BUF_COUNT, sizeof(uint8_t));
+        if (updater_async.full_queue == NULL || updater_async.free_queue == NULL) {
+            ESP_LOGE(TAG, "Failed to create the writer queues\n");
+            return false;
+        }
+        for (uint8_t i = 0; i < UPDATER_ASYNC_BUF_COUNT; i++) {
+            updater_async.buf[i] = heap_caps_malloc(UPDATER_ASYNC_BUF_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            if (updater_async.buf[i] == NULL) {
+                ESP_LOGE(TAG, "Failed to allocate the writer buffers\n");
+                return false;
+            }
+            updater_async.len[i] = 0;
+            xQueueSend(updater_async.free_queue, &i, 0);
+        }
+        if (xTaskCreatePinnedToCore(TASK_Updater_Write, "Updater", UPDATER_ASYNC_TASK_STACK_SIZE / sizeof(StackType_t), NULL,
+                                    UPDATER_ASYNC_TASK_PRIORITY, &updater_async.task, 1) != pdPASS) {
+            updater_async.task = NULL;
+            ESP_LOGE(TAG, "Failed to create the writer task\n");
+            return false;
+        }
+    } else {
+        // drops what was left by an OTA which wasn't finished
+        updater_async_wait();
+    }
+    updater_async.error = false;
+    return true;
+}
+
+bool updater_async_start (void) {
+    return updater_async_init() && updater_start();
+}
+
+int32_t updater_async_resume (const uint8_t *id, uint8_t id_len) {
+    if (!updater_async_init()) {
+        return -1;
+    }
+    return updater_resume(id, id_len);
+}
+
+bool updater_async_write (const uint8_t *buf, uint32_t len) {
+    if (updater_async.task == NULL) {
+        return false;
+    }
+    while (len > 0 && !updater_async.error) {
+        if (updater_async.filling < 0) {
+            // both buffers are being written, wait for the first one
+            uint8_t index;
+            xQueueReceive(updater_async.free_queue, &index, portMAX_DELAY);
+            updater_async.filling = index;
+        }
+        uint8_t index = updater_async.filling;
+        uint32_t n = MIN(len, UPDATER_ASYNC_BUF_SIZE - updater_async.len[index]);
+        memcpy(updater_async.buf[index] + updater_async.len[index], buf, n);
+        updater_async.len[index] += n;
+        buf += n;
+        len -= n;
+        if (updater_async.len[index] == UPDATER_ASYNC_BUF_SIZE) {
+            xQueueSend(updater_async.full_queue, &index, portMAX_DELAY);
+            updater_async.filling = -1;
+        }
+    }
+    return !updater_async.error;
+}
+
+bool updater_async_flush (void) {
+    if (updater_async.task == NULL) {
+        // nothing was written through the writer task
+        return true;
+    }
+    updater_async_wait();
+    return !updater_async.error;
+}
+
 #ifdef DIFF_UPDATE_ENABLED
+/* The patch and the new image share the same partition. The patch is first moved to the end of the partition,
+ * so that the streams are read from the flash while the new image is written from the start.
+ * The bsdiff streams can be compressed with bzip2 ("BSDIFF40"), zlib ("BSDIFFZ0") or heatshrink ("BSDIFFH0").
+ * bzip2 needs several hundreds of KB per stream, only available in PSRAM, zlib needs its window (up to 32 KB)
+ * and heatshrink, a LZSS with a tiny window, needs 1 KB and is the fastest to decompress.*/
+#define UPDATER_PATCH_HEADER_LEN                        (32)
+#define UPDATER_PATCH_MAGIC_LEN                         (8)
+#define UPDATER_PATCH_MAGIC_BZIP2                       "BSDIFF40"
+#define UPDATER_PATCH_MAGIC_ZLIB                        "BSDIFFZ0"
+#define UPDATER_PATCH_MAGIC_HEATSHRINK                  "BSDIFFH0"
+#define UPDATER_PATCH_CHUNK_SIZE                        (512)   // Number of bytes read/written to flash at a time
+
+// Same as "heatshrink -w 10 -l 5", must match tools/bsdiff_convert.py
+#define UPDATER_HEATSHRINK_WINDOW_BITS                  (10)
+#define UPDATER_HEATSHRINK_LOOKAHEAD_BITS               (5)
+
+typedef enum {
+    UPDATER_PATCH_BZIP2 = 0,
+    UPDATER_PATCH_ZLIB,
+    UPDATER_PATCH_HEATSHRINK,
+} updater_patch_format_t;
+
+typedef struct {
+    unsigned char window[1 << UPDATER_HEATSHRINK_WINDOW_BITS];
+    uint16_t head;                                      // Next position written in the window
+    uint16_t match_index;                               // Distance of the back-reference being copied
+    uint16_t match_count;                               // Bytes left to copy from the back-reference
+    uint8_t bit_buf;
+    uint8_t bit_mask;                                   // Next bit to read in bit_buf, 0 when a new byte is needed
+    const unsigned char *source;
+    const unsigned char *source_limit;
+} updater_heatshrink_t;
+
+typedef struct {
+    TINF_DATA zlib;                                     // Must be the first member, see updater_patch_zlib_read_cb()
+    void *bzip2;
+    updater_heatshrink_t *heatshrink;
+    updater_patch_format_t format;
+    uint32_t flash_addr;                                // Address of the next compressed bytes in the flash
+    unsigned char *ram;                                 // Next compressed bytes when the patch was loaded in RAM
+    uint32_t remaining;                                 // Compressed bytes not given to the decompressor yet
+    unsigned char in[UPDATER_PATCH_CHUNK_SIZE];
+} updater_patch_stream_t;
+
+static bool updater_patch_stream_fill(updater_patch_stream_t *stream, const unsigned char **data, uint32_t *len) {
+    if (stream->remaining == 0) {
+        return false;
+    }
+    uint32_t n = MIN(stream->remaining, UPDATER_PATCH_CHUNK_SIZE);
+    if (stream->ram) {
+        *data = stream->ram;
+        stream->ram += n;
+    } else {
+        if (ESP_OK != updater_spi_flash_read(stream->flash_addr, stream->in, n, false)) {
+            printf("Error while reading the patch at: %u\n", stream->flash_addr);
+            return false;
+        }
+        *data = stream->in;
+        stream->flash_addr += n;
+    }
+    stream->remaining -= n;
+    *len = n;
+    return true;
+}
+
+static int updater_patch_zlib_read_cb(TINF_DATA *d) {
+    updater_patch_stream_t *stream = (updater_patch_stream_t *)d;
+    const unsigned char *data;
+    uint32_t len;
+    if (!updater_patch_stream_fill(stream, &data, &len)) {
+        return -1;
+    }
+    d->source = data + 1;
+    d->source_limit = data + len;
+    return data[0];
+}
+
+/* Returns the next bits_count bits of the heatshrink stream, MSB first, or -1 at the end of the stream */
+static int updater_heatshrink_get_bits(updater_patch_stream_t *stream, uint8_t bits_count) {
+    updater_heatshrink_t *hs = stream->heatshrink;
+    int value = 0;
+    uint32_t len;
+
+    for (uint8_t i = 0; i < bits_count; i++) {
+        if (hs->bit_mask == 0) {
+            if (hs->source >= hs->source_limit) {
+                if (!updater_patch_stream_fill(stream, &hs->source, &len)) {
+                    return -1;
+                }
+                hs->source_limit = hs->source + len;
+            }
+            hs->bit_buf = *hs->source++;
+            hs->bit_mask = 0x80;
+        }
+        value = (value << 1) | ((hs->bit_buf & hs->bit_mask) ? 1 : 0);
+        hs->bit_mask >>= 1;
+    }
+    return value;
+}
+
+static bool updater_heatshrink_read(updater_patch_stream_t *stream, unsigned char *dest, uint32_t len) {
+    updater_heatshrink_t *hs = stream->heatshrink;
+    const uint16_t mask = (1 << UPDATER_HEATSHRINK_WINDOW_BITS) - 1;
+
+    while (len > 0) {
+        unsigned char c;
+        if (hs->match_count > 0) {
+            c = hs->window[(hs->head - hs->match_index) & mask];
+            hs->match_count--;
+        } else {
+            int tag = updater_heatshrink_get_bits(stream, 1);
+            if (tag < 0) {
+                return false;
+            }
+            if (tag) {
+                int literal = updater_heatshrink_get_bits(stream, 8);
+                if (literal < 0) {
+                    return false;
+                }
+                c = literal;
+            } else {
+                int index = updater_heatshrink_get_bits(stream, UPDATER_HEATSHRINK_WINDOW_BITS);
+                int count = updater_heatshrink_get_bits(stream, UPDATER_HEATSHRINK_LOOKAHEAD_BITS);
+                if (index < 0 || count < 0) {
+                    return false;
+                }
+                hs->match_index = index + 1;
+                hs->match_count = count + 1;
+                continue;
+            }
+        }
+        hs->window[hs->head] = c;
+        hs->head = (hs->head + 1) & mask;
+        *dest++ = c;
+        len--;
+    }
+    return true;
+}
+
+static updater_patch_stream_t *updater_patch_stream_init(updater_patch_format_t format, uint32_t flash_addr, unsigned char *ram, uint32_t len) {
+    updater_patch_stream_t *stream = calloc(1, sizeof(updater_patch_stream_t));
+    if (stream == NULL) {
+        printf("Failed to allocate a patch stream\n");
+        return NULL;
+    }
+    stream->format = format;
+    stream->flash_addr = flash_addr;
+    stream->ram = ram;
+    stream->remaining = len;
+
+    if (format == UPDATER_PATCH_HEATSHRINK) {
+        // the window starts zeroed, as in the heatshrink encoder
+        stream->heatshrink = calloc(1, sizeof(updater_heatshrink_t));
+        if (stream->heatshrink == NULL) {
+            printf("Failed to allocate the heatshrink window\n");
+            free(stream);
+            return NULL;
+        }
+    } else if (format == UPDATER_PATCH_ZLIB) {
+        stream->zlib.source_read_cb = updater_patch_zlib_read_cb;
+        int bits = uzlib_zlib_parse_header(&stream->zlib);
+        if (bits < 0) {
+            printf("Invalid zlib header: %d\n", bits);
+            free(stream);
+            return NULL;
+        }
+        // the window is replicated in a ring, the diff and extra blocks are read in small chunks
+        uint32_t dict_size = 1 << (bits + 8);
+        void *dict = malloc(dict_size);
+        if (dict == NULL) {
+            printf("Failed to allocate the %d bytes zlib window\n", dict_size);
+            free(stream);
+            return NULL;
+        }
+        uzlib_uncompress_init(&stream->zlib, dict, dict_size);
+    } else {
+        int ret = BZ2_bzDecompressStreamInit(&stream->bzip2, (char *)stream->in, 0);
+        if (ret != BZ_OK) {
+            printf("Failed to init a bzip2 stream, error code: %d (bzip2 patches need PSRAM)\n", ret);
+            free(stream);
+            return NULL;
+        }
+    }
+    return stream;
+}
+
+static bool updater_patch_stream_read(updater_patch_stream_t *stream, unsigned char *dest, uint32_t len) {
+    const unsigned char *data;
+    uint32_t n;
+
+    if (stream->format == UPDATER_PATCH_HEATSHRINK) {
+        return updater_heatshrink_read(stream, dest, len);
+    }
+
+    if (stream->format == UPDATER_PATCH_ZLIB) {
+        stream->zlib.dest = dest;
+        stream->zlib.dest_limit = dest + len;
+        int st = uzlib_uncompress_chksum(&stream->zlib);
+        if (st < 0) {
+            printf("PATCHING: zlib error: %d\n", st);
+            return false;
+        }
+        return (stream->zlib.dest == (dest + len));
+    }
+
+    bz_stream *bzstrm = stream->bzip2;
+    bzstrm->next_out = (char *)dest;
+    bzstrm->avail_out = len;
+    while (bzstrm->avail_out > 0) {
+        bool no_input = false;
+        if (bzstrm->avail_in == 0) {
+            if (updater_patch_stream_fill(stream, &data, &n)) {
+                bzstrm->next_in = (char *)data;
+                bzstrm->avail_in = n;
+            } else {
+                no_input = true;
+            }
+        }
+        unsigned int avail_out = bzstrm->avail_out;
+        int ret = BZ2_bzDecompress(bzstrm);
+        if (ret == BZ_STREAM_END) {
+            break;
+        }
+        if (ret != BZ_OK || (no_input && avail_out == bzstrm->avail_out)) {
+            printf("PATCHING: bzip2 error: %d\n", ret);
+            return false;
+        }
+    }
+    return (bzstrm->avail_out == 0);
+}
+
+static void updater_patch_stream_end(updater_patch_stream_t *stream) {
+    if (stream) {
+        if (stream->format == UPDATER_PATCH_HEATSHRINK) {
+            free(stream->heatshrink);
+        } else if (stream->format == UPDATER_PATCH_ZLIB) {
+            free(stream->zlib.dict_ring);
+        } else {
+            BZ2_bzDecompressStreamEnd(stream->bzip2);
+        }
+        free(stream);
+    }
+}
+
+/* Copies the patch to the end of its partition, the areas don't overlap so the original remains valid until done */
+static bool updater_patch_relocate(uint32_t from, uint32_t to, uint32_t size) {
+    unsigned char buf[UPDATER_PATCH_CHUNK_SIZE];
+
+    for (uint32_t pos = 0; pos < size; pos += UPDATER_PATCH_CHUNK_SIZE) {
+        if ((pos % SPI_FLASH_SEC_SIZE) == 0) {
+            if (ESP_OK != spi_flash_erase_sector((to + pos) / SPI_FLASH_SEC_SIZE)) {
+                printf("Erasing the patch destination failed\n");
+                return false;
+            }
+        }
+        uint32_t n = MIN(size - pos, UPDATER_PATCH_CHUNK_SIZE);
+        if (ESP_OK != updater_spi_flash_read(from + pos, buf, n, false) ||
+            ESP_OK != updater_spi_flash_write(to + pos, buf, (n + ENCRYP_FLASH_MIN_CHUNK - 1) & ~(ENCRYP_FLASH_MIN_CHUNK - 1), false)) {
+            printf("Moving the patch failed\n");
+            return false;
+        }
+    }
+    return true;
+}
+
 bool updater_patch(void) {
 
-    const int HEADER_LEN            = 32;
-    const int MAGIC_BYTES_LEN       = 8;
     const int CTRLEN_OFFSET         = 8;
     const int DATALEN_OFFSET        = 16;
     const int NEWFILE_SIZE_OFFSET   = 24;
 
     bool status = false;                    // Status to be returned (true for success, false otherwise)
-    unsigned char header[HEADER_LEN], buf[8];
+    unsigned char header[UPDATER_PATCH_HEADER_LEN], buf[8];
 
     uint32_t patch_offset;                  // Offset of the patch file in the flash
     uint32_t patch_size;                    // Size of the patch file
+    uint32_t patch_addr;                    // Where the patch is read from during the patching
+    uint32_t tail_addr;                     // Where the patch is moved to, at the end of the partition
+    uint32_t slot_size;
     uint32_t old_bin_offset;                // Offset of the old/current binary image in the flash
     uint32_t newsize;
     uint32_t bzctrllen, bzdatalen, xtralen; // Lengths of various blocks in the patch file
+    updater_patch_format_t format;
+    int64_t start_time;                     // To report how long the patching takes with each format
+    size_t free_heap, min_free_heap;        // To report the peak RAM used with each format
 
     printf("Patching the binary...\n");
+    // the decompression is CPU bound, keep the high frequency when it scales
+    mpcpufreq_boost_acquire();
+    start_time = esp_timer_get_time();
+    free_heap = min_free_heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
     // Since we haven't switched the active partition, the next partition
     // returned by this function will be the one containing the downloaded patch
     // file NOTE: This also reads the BOOT INFO so we don't have to explicitly
     // read it
     patch_offset = updater_ota_next_slot_address();
     patch_size = boot_info.size;            // boot_info.patch_size;
+    slot_size = (esp32_get_chip_rev() > 0 ? IMG_SIZE_8MB : IMG_SIZE_4MB);
+    tail_addr = patch_offset + ((slot_size - patch_size) & ~(SPI_FLASH_SEC_SIZE - 1));
+    patch_addr = patch_offset;
 
     // Getting the offset of the current image in the flash
     if (boot_info.ActiveImg == IMG_ACT_FACTORY) {
@@ -192,28 +791,43 @@ bool updater_patch(void) {
              boot_info.size, boot_info.ActiveImg);
 
     // File format:
-    //     0   8   "BSDIFF40"
+    //     0   8   "BSDIFF40" (bzip2), "BSDIFFZ0" (zlib) or "BSDIFFH0" (heatshrink)
     //     8   8   X
     //     16  8   Y
     //     24  8   sizeof(newfile)
-    //     32  X   bzip2(control block)
-    //     32+X    Y   bzip2(diff block)
-    //     32+X+Y  ??? bzip2(extra block)
+    //     32  X   compressed(control block)
+    //     32+X    Y   compressed(diff block)
+    //     32+X+Y  ??? compressed(extra block)
     // with control block a set of triples (x,y,z) meaning "add x bytes
     // from oldfile to x bytes from the diff block; copy y bytes from the
     // extra block; seek forwards in oldfile by z bytes".
 
-    // Reading header of the patch file
-
-    if (ESP_OK != updater_spi_flash_read(patch_offset, header, HEADER_LEN, false)) {
-        printf("Error while reading patch file header\n");
+    if (patch_size < UPDATER_PATCH_HEADER_LEN || patch_size > slot_size) {
+        printf("Invalid patch size: %d\n", patch_size);
         goto return_status;
     }
 
-    // Check for the appropriate magic
-    if (memcmp(header, "BSDIFF40", MAGIC_BYTES_LEN) != 0) {
-        printf("Invalid header\n");
-        goto return_status;
+    // Reading header of the patch file, if a previous patching was interrupted it has already been moved
+    for (int i = 0; i < 2; i++) {
+        if (ESP_OK != updater_spi_flash_read(patch_addr, header, UPDATER_PATCH_HEADER_LEN, false)) {
+            printf("Error while reading patch file header\n");
+            goto return_status;
+        }
+        if (memcmp(header, UPDATER_PATCH_MAGIC_BZIP2, UPDATER_PATCH_MAGIC_LEN) == 0) {
+            format = UPDATER_PATCH_BZIP2;
+            break;
+        } else if (memcmp(header, UPDATER_PATCH_MAGIC_ZLIB, UPDATER_PATCH_MAGIC_LEN) == 0) {
+            format = UPDATER_PATCH_ZLIB;
+            break;
+        } else if (memcmp(header, UPDATER_PATCH_MAGIC_HEATSHRINK, UPDATER_PATCH_MAGIC_LEN) == 0) {
+            format = UPDATER_PATCH_HEATSHRINK;
+            break;
+        }
+        if (i == 1) {
+            printf("Invalid header\n");
+            goto return_status;
+        }
+        patch_addr = tail_addr;
     }
 
     ESP_LOGI(TAG,"Header Verified\n");
@@ -223,73 +837,58 @@ bool updater_patch(void) {
     bzdatalen = offtin(header + DATALEN_OFFSET);
     newsize = offtin(header + NEWFILE_SIZE_OFFSET);
 
-    xtralen = patch_size - (HEADER_LEN + bzctrllen + bzdatalen);
+    xtralen = patch_size - (UPDATER_PATCH_HEADER_LEN + bzctrllen + bzdatalen);
 
     ESP_LOGD(TAG, "CtrlLen: %d, DataLen: %d, NewSize: %d, ExtraLen: %d\n", bzctrllen, bzdatalen, newsize, xtralen);
 
-    if ((bzctrllen < 0) || (bzdatalen < 0) || (newsize < 0) || (xtralen < 0)) {
+    if ((int)bzctrllen < 0 || (int)bzdatalen < 0 || (int)newsize < 0 || (int)xtralen < 0 || newsize > slot_size) {
         printf("Invalid Block Sizes CtrlLen: %d, DataLen: %d, NewSize: %d, ExtraLen: %d\n", bzctrllen, bzdatalen, newsize, xtralen);
         goto return_status;
     }
 
-    // Header is valid, reading the contents of the patch file
+    // Header is valid, patching from the streams
     {
-        const int FLASH_READ_WRITE_SIZE = 512;              // Number of bytes read/written to flash at a time
-
         uint16_t i = 0;
-        unsigned char *out_buf = NULL;
-        unsigned char *diff_ptr = NULL;
-        unsigned char *xtra_ptr = NULL;
-        unsigned char old_bin_buf[FLASH_READ_WRITE_SIZE];   // Buffer to read parts of old binary
-
-        unsigned char *patch_buf;
+        unsigned char *patch_buf = NULL;
+        unsigned char new_bin_buf[UPDATER_PATCH_CHUNK_SIZE];    // Buffer for the decompressed bytes
+        unsigned char old_bin_buf[UPDATER_PATCH_CHUNK_SIZE];    // Buffer to read parts of old binary
 
-        void *ctrl_strm = NULL;
-        void *diff_strm = NULL;
-        void *xtra_strm = NULL;
+        updater_patch_stream_t *ctrl_strm = NULL;
+        updater_patch_stream_t *diff_strm = NULL;
+        updater_patch_stream_t *xtra_strm = NULL;
 
         int ctrl[3];                                        // Buffer to read control block values from the patch file (NOTE: Its value can be negative)
                                                             // Used to read (x,y,z) tuples from the Control Block
         int oldpos = 0;                                     // Read pointer for old binary
         int newpos = 0;                                     // Read pointer for the patched binary
 
-        unsigned int ctrl_len, diff_len, xtra_len;
-        int ret = 0;
-
-        // Reading the complete patch file
-        patch_buf = heap_caps_malloc(patch_size, MALLOC_CAP_SPIRAM);
-        if (patch_buf == NULL) {
-            printf("Failed to allocate %d bytes for the Patch File\n", patch_size);
-            goto free_mem_and_ret;
-        }
-
-        updater_spi_flash_read(patch_offset, patch_buf, patch_size, false);
-
-        // Creating BZLIB streams for decompression
-        ret = BZ2_bzDecompressStreamInit(&ctrl_strm, (char *)patch_buf + 32, bzctrllen);
-        if (ret != BZ_OK) {
-            printf("Failed to init stream for CTRL block. Error code: %d\n", ret);
-            goto free_mem_and_ret;
-        }
-        ret = BZ2_bzDecompressStreamInit(&diff_strm, (char *)patch_buf + 32 + bzctrllen, bzdatalen);
-        if (ret != BZ_OK) {
-            printf("Failed to init stream for DIFF block. Error code: %d\n", ret);
-            goto free_mem_and_ret;
-        }
-        ret = BZ2_bzDecompressStreamInit(&xtra_strm, (char *)patch_buf + 32 + bzctrllen + bzdatalen, xtralen);
-        if (ret != BZ_OK) {
-            printf("Failed to init stream for EXTRA block. Error code: %d\n", ret);
-            goto free_mem_and_ret;
+        if (patch_addr == patch_offset) {
+            // The new image must end before the moved patch, the sector after the last one written is erased too
+            if (patch_size <= (tail_addr - patch_offset) && (newsize + SPI_FLASH_SEC_SIZE) <= (tail_addr - patch_offset)) {
+                if (!updater_patch_relocate(patch_offset, tail_addr, patch_size)) {
+                    goto free_mem_and_ret;
+                }
+                patch_addr = tail_addr;
+            } else {
+                // Not enough room left in the partition, load the complete patch file in PSRAM
+                patch_buf = heap_caps_malloc(patch_size, MALLOC_CAP_SPIRAM);
+                if (patch_buf == NULL) {
+                    printf("Failed to allocate %d bytes for the Patch File\n", patch_size);
+                    goto free_mem_and_ret;
+                }
+                updater_spi_flash_read(patch_offset, patch_buf, patch_size, false);
+            }
         }
 
-        // Memory for the buffer to store the decompressed blocks
-        const int AVAIL_MEM = 100 * 1024;
-
-        ESP_LOGD(TAG, "Going to allocate memory for decompressed blocks buffer: %d\n", AVAIL_MEM);
-        out_buf = heap_caps_malloc(AVAIL_MEM, MALLOC_CAP_SPIRAM);
-
-        if (out_buf == NULL) {
-            printf("Failed to allocate the buffer memory of size %d\n", AVAIL_MEM);
+        // Creating the streams for decompression
+        ctrl_strm = updater_patch_stream_init(format, patch_addr + UPDATER_PATCH_HEADER_LEN,
+                                              patch_buf ? patch_buf + UPDATER_PATCH_HEADER_LEN : NULL, bzctrllen);
+        diff_strm = updater_patch_stream_init(format, patch_addr + UPDATER_PATCH_HEADER_LEN + bzctrllen,
+                                              patch_buf ? patch_buf + UPDATER_PATCH_HEADER_LEN + bzctrllen : NULL, bzdatalen);
+        xtra_strm = updater_patch_stream_init(format, patch_addr + UPDATER_PATCH_HEADER_LEN + bzctrllen + bzdatalen,
+                                              patch_buf ? patch_buf + UPDATER_PATCH_HEADER_LEN + bzctrllen + bzdatalen : NULL, xtralen);
+        if (ctrl_strm == NULL || diff_strm == NULL || xtra_strm == NULL) {
+            printf("Failed to init the CTRL, DIFF and EXTRA streams\n");
             goto free_mem_and_ret;
         }
 
@@ -305,74 +904,48 @@ bool updater_patch(void) {
         while (newpos < newsize) {
             // Reading the control data
             for (i = 0; i <= 2; i++) {
-                ctrl_len = 8;
-                ret = BZ2_bzDecompressRead(ctrl_strm, (char *)buf, &ctrl_len);
-                if (ret != BZ_OK || ctrl_len != 8) {
-                    printf("PATCHING: Unable to decompress required bytes. ret: %d, ctrl_len: %d, i: %d\n", ret, ctrl_len, i);
+                if (!updater_patch_stream_read(ctrl_strm, buf, 8)) {
+                    printf("PATCHING: Unable to decompress the control block. i: %d\n", i);
                     goto free_mem_and_ret;
                 }
 
                 ctrl[i] = offtin(buf);
             }
+            // the decompressors allocate their state when the first bytes are read
+            min_free_heap = MIN(min_free_heap, heap_caps_get_free_size(MALLOC_CAP_8BIT));
 
             // Sanity-check
-            if (newpos + ctrl[0] > newsize) {
+            if (ctrl[0] < 0 || ctrl[1] < 0 || newpos + ctrl[0] > newsize) {
                 printf("PATCHING: Corrupt Patch. Violated newsize: %d, ctrl[0]: %d\n", newsize, ctrl[0]);
                 goto free_mem_and_ret;
             }
 
-            // Decompressing ctrl[0] bytes of diff block
+            // Decompressing ctrl[0] bytes of diff block, combining them with the old binary
             while (ctrl[0] > 0) {
-                unsigned int byte_count = 0;
+                int len = MIN(ctrl[0], UPDATER_PATCH_CHUNK_SIZE);
 
-                if (ctrl[0] > AVAIL_MEM) {
-                    ctrl[0] -= AVAIL_MEM;
-                    diff_len = AVAIL_MEM;
+                if (!updater_patch_stream_read(diff_strm, new_bin_buf, len)) {
+                    printf("PATCHING: Unable to decompress required bytes. ctrl[0]: %d, len: %d\n", ctrl[0], len);
+                    goto free_mem_and_ret;
                 }
-                else {
-                    diff_len = ctrl[0];
-                    ctrl[0] = 0;
+
+                if (ESP_OK != updater_spi_flash_read(old_bin_offset + oldpos, old_bin_buf, len, false)) {
+                    printf("Error while reading old bin block. old_bin_offset: %u, oldpos: %u, bytes_to_read: %d\n", old_bin_offset, oldpos, len);
+                    goto free_mem_and_ret;
                 }
 
-                ret = BZ2_bzDecompressRead(diff_strm, (char *)out_buf, &diff_len);
+                for (i = 0; i < len; i++) {
+                    new_bin_buf[i] += old_bin_buf[i];
+                }
 
-                if (ret != BZ_OK) {
-                    printf("PATCHING: Unable to decompress required bytes. ret: %d, ctrl[0]: %d, diff_len: %d\n", ret, ctrl[0], diff_len);
+                if (!updater_write(new_bin_buf, len)) {
+                    printf("Failed to write %d bytes to the Flash\n", len);
                     goto free_mem_and_ret;
                 }
-                diff_ptr = out_buf;
-
-                // Reading old binary file in chunks combining it with the Diff
-                // bytes
-                do {
-                    int bytes_to_read = 0;
-
-                    if ((diff_len - byte_count) > FLASH_READ_WRITE_SIZE) {
-                        bytes_to_read = FLASH_READ_WRITE_SIZE;
-                    } else {
-                        bytes_to_read = diff_len - byte_count;
-                    }
-
-                    if (ESP_OK != updater_spi_flash_read(old_bin_offset + oldpos, old_bin_buf, bytes_to_read, false)) {
-                        printf("Error while reading old bin block. old_bin_offset: %u, oldpos: %u, bytes_to_read: %d\n", old_bin_offset, oldpos, bytes_to_read);
-                        goto free_mem_and_ret;
-                    }
-
-                    for (i = 0; i < bytes_to_read; i++) {
-                        *(diff_ptr + i) += old_bin_buf[i];
-                    }
-
-                    if (!updater_write(diff_ptr, bytes_to_read)) {
-                        printf("Failed to write %d bytes to the Flash\n", bytes_to_read);
-                        goto free_mem_and_ret;
-                    }
-
-                    diff_ptr += bytes_to_read;
-                    oldpos += bytes_to_read;
-                    newpos += bytes_to_read;
-                    byte_count += bytes_to_read;
-
-                } while (byte_count < diff_len);
+
+                ctrl[0] -= len;
+                oldpos += len;
+                newpos += len;
             }
 
             // Sanity-check
@@ -381,41 +954,22 @@ bool updater_patch(void) {
                 goto free_mem_and_ret;
             }
 
-            // Decompressing Extra Bytes of size ctrl[1]
+            // Writing the ctrl[1] bytes of the Extra Block
             while (ctrl[1] > 0) {
-                if (ctrl[1] > AVAIL_MEM) {
-                    ctrl[1] -= AVAIL_MEM;
-                    xtra_len = AVAIL_MEM;
-                } else {
-                    xtra_len = ctrl[1];
-                    ctrl[1] = 0;
-                }
+                int len = MIN(ctrl[1], UPDATER_PATCH_CHUNK_SIZE);
 
-                ret = BZ2_bzDecompressRead(xtra_strm, (char *)out_buf, &xtra_len);
-
-                if (ret != BZ_OK) {
-                    printf("PATCHING: Unable to decompress required bytes. ret: %d, ctrl[1]: %d, xtra_len: %d\n", ret, ctrl[1], xtra_len);
+                if (!updater_patch_stream_read(xtra_strm, new_bin_buf, len)) {
+                    printf("PATCHING: Unable to decompress required bytes. ctrl[1]: %d, len: %d\n", ctrl[1], len);
                     goto free_mem_and_ret;
                 }
-                xtra_ptr = out_buf;
-
-                // Writing the bytes from the Extra Block
-                int write_size = xtra_len;
-                while (write_size > FLASH_READ_WRITE_SIZE) {
-                    if (!updater_write(xtra_ptr + xtra_len - write_size, FLASH_READ_WRITE_SIZE)) {
-                        printf("Failed to write %d bytes from Extra Block to the Flash\n", FLASH_READ_WRITE_SIZE);
-                        goto free_mem_and_ret;
-                    }
-                    write_size -= FLASH_READ_WRITE_SIZE;
-                }
 
-                if (write_size) {
-                    if (!updater_write(xtra_ptr + xtra_len - write_size, write_size)) {
-                        printf("Failed to write %d bytes from Extra Block to the Flash\n", write_size);
-                        goto free_mem_and_ret;
-                    }
+                if (!updater_write(new_bin_buf, len)) {
+                    printf("Failed to write %d bytes from Extra Block to the Flash\n", len);
+                    goto free_mem_and_ret;
                 }
-                newpos += xtra_len;
+
+                ctrl[1] -= len;
+                newpos += len;
             }
 
             // Adjust the pointers
@@ -429,23 +983,19 @@ bool updater_patch(void) {
                  updater_data.chunk_size, updater_data.current_chunk);
 
         status = true;
-        printf("Patching SUCCESSFUL.\n");
+        printf("Patching SUCCESSFUL. Time: %d ms, peak RAM: %d bytes (%s)\n",
+               (int)((esp_timer_get_time() - start_time) / 1000), (int)(free_heap - min_free_heap),
+               (format == UPDATER_PATCH_HEATSHRINK) ? "heatshrink" : ((format == UPDATER_PATCH_ZLIB) ? "zlib" : "bzip2"));
 
     free_mem_and_ret:
         heap_caps_free(patch_buf);
-        heap_caps_free(out_buf);
-        if (ctrl_strm) {
-            BZ2_bzDecompressStreamEnd(ctrl_strm);
-        }
-        if (diff_strm) {
-            BZ2_bzDecompressStreamEnd(diff_strm);
-        }
-        if (xtra_strm) {
-            BZ2_bzDecompressStreamEnd(xtra_strm);
-        }
+        updater_patch_stream_end(ctrl_strm);
+        updater_patch_stream_end(diff_strm);
+        updater_patch_stream_end(xtra_strm);
     }
 
 return_status:
+    mpcpufreq_boost_release();
     if (status) {
         // Updating BOOT INFO
         boot_info.PrevImg = boot_info.ActiveImg;
@@ -472,6 +1022,8 @@ return_status:
 
 bool updater_finish (void) {
     if (updater_data.offset > 0) {
+        // the update can't be resumed anymore
+        updater_progress_clear();
         ESP_LOGI(TAG, "Updater finished, boot status: %d\n", boot_info.Status);
 //        sl_LockObjLock (&wlan_LockObj, SL_OS_WAIT_FOREVER);
         // if we still have an image pending for verification, leave the boot info as it is
@@ -488,7 +1040,12 @@ bool updater_finish (void) {
 
                 return false;
 #endif
-            }else {
+            } else if (updater_hash_check() == 0) {
+                printf("Full Update Image detected, but its SHA256 doesn't match. The boot partition is not changed.\n");
+                updater_data.offset = 0;
+
+                return false;
+            } else {
                 printf("Full Update Image detected. Restart the device to load the new firmware.\n");
                 ESP_LOGI(TAG, "Saving new boot info\n");
                 // save the new boot info
@@ -511,7 +1068,33 @@ bool updater_finish (void) {
     return true;
 }
 
-bool updater_verify (void) {
+/* Compares the SHA256 computed while writing the image with the one appended to it, without reading the image again.
+ * Returns 1 if they match, 0 otherwise and -1 if it isn't possible: the signature and the encrypted contents
+ * need esp_image_verify. The result is kept until the next updater_start(). */
+static int updater_hash_check (void) {
+    esp_image_header_t header;
+    uint8_t digest[UPDATER_IMG_HASH_LEN];
+
+    if (updater_hash.result >= 0 || !updater_hash.started) {
+        return updater_hash.result;
+    }
+    if ((updater_hash.len + updater_hash.tail_len) != boot_info.size || updater_hash.tail_len != UPDATER_IMG_HASH_LEN ||
+        esp_flash_encryption_enabled() || esp_secure_boot_enabled() ||
+        ESP_OK != updater_spi_flash_read(updater_data.offset_start_upd, &header, sizeof(header), false) ||
+        header.magic != ESP_IMAGE_HEADER_MAGIC || !header.hash_appended) {
+        return -1;
+    }
+
+    mbedtls_sha256_finish_ret(&updater_hash.ctx, digest);
+    mbedtls_sha256_free(&updater_hash.ctx);
+    updater_hash.started = false;
+    updater_hash.result = (memcmp(digest, updater_hash.tail, UPDATER_IMG_HASH_LEN) == 0) ? 1 : 0;
+    ESP_LOGI(TAG, "SHA256 of the written image matches: %d\n", updater_hash.result);
+
+    return updater_hash.result;
+}
+
+bool updater_verify (bool full) {
     // bootloader verifies anyway the image, but the user can check himself
     // so, the next code is adapted from bootloader/bootloader.c,
 
@@ -525,6 +1108,13 @@ bool updater_verify (void) {
       .size = boot_info.size,
     };
 
+    if (!full) {
+        int hash_ok = updater_hash_check();
+        if (hash_ok >= 0) {
+            return hash_ok;
+        }
+    }
+
     ret = esp_image_verify(ESP_IMAGE_VERIFY, &part_pos, &data);
 
     ESP_LOGI(TAG, "esp_image_verify: %d\n", ret);
@@ -538,6 +1128,7 @@ bool updater_write_boot_info(boot_info_t *boot_info, uint32_t boot_info_offset)
     boot_info->crc = crc32_le(UINT32_MAX, (uint8_t *)boot_info, sizeof(boot_info_t) - sizeof(boot_info->crc));
     ESP_LOGI(TAG, "Wr crc=0x%x\n", boot_info->crc);
 
+    flashcache_invalidate(boot_info_offset, SPI_FLASH_SEC_SIZE);
     if (ESP_OK != spi_flash_erase_sector(boot_info_offset / SPI_FLASH_SEC_SIZE)) {
         printf("Erasing boot info failed\n");
         return false;
@@ -624,7 +1215,8 @@ int updater_ota_next_slot_address() {
 static esp_err_t updater_spi_flash_read(size_t src, void *dest, size_t size, bool allow_decrypt)
 {
     if (allow_decrypt && esp_flash_encryption_enabled()) {
-        return spi_flash_read_encrypted(src, dest, size);
+        // the partition table and the boot info, read again and again by the update steps
+        return flashcache_read(src, dest, size);
     } else {
         return spi_flash_read(src, dest, size);
     }
@@ -637,6 +1229,7 @@ static esp_err_t updater_spi_flash_read(size_t src, void *dest, size_t size, boo
 static esp_err_t updater_spi_flash_write(size_t dest_addr, void *src, size_t size,
                                         bool write_encrypted)
 {
+    flashcache_invalidate(dest_addr, size);
     if (write_encrypted && esp_flash_encryption_enabled()) {
         return spi_flash_write_encrypted(dest_addr, src, size);
     } else {
@@ -686,8 +1279,9 @@ static bool updater_is_delta_file(void)
         return false;
     }
 
-    // Check for appropriate magic
-    if (memcmp(header, "BSDIFF40", MAGIC_BYTES_LEN) != 0)
+    // Check for appropriate magic, the blocks are compressed with bzip2, zlib or heatshrink
+    if (memcmp(header, "BSDIFF40", MAGIC_BYTES_LEN) != 0 && memcmp(header, "BSDIFFZ0", MAGIC_BYTES_LEN) != 0 &&
+        memcmp(header, "BSDIFFH0", MAGIC_BYTES_LEN) != 0)
     {
         return false;
     }
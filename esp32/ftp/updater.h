@@ -13,6 +13,9 @@
 
 #include "bootloader.h"
 
+// Maximum length of the id given to updater_set_id() and updater_resume()
+#define UPDATER_CHECKPOINT_ID_MAX_LEN       (32)
+
 /**
  * @brief  Checks the default path.
  *
@@ -31,6 +34,26 @@ extern bool updater_check_path(void *path);
 extern bool updater_start(void);
 
 
+/**
+ * @brief  Saves the progress of the OTA started with updater_start() in NVS, so it can be resumed after a reset.
+ *
+ * @param  id      identifies the image (version, digest...), only the same id resumes it
+ * @param  id_len  length of the id, up to UPDATER_CHECKPOINT_ID_MAX_LEN
+ */
+extern void updater_set_id(const uint8_t *id, uint8_t id_len);
+
+/**
+ * @brief  Initializes the OTA update process, continuing from the last checkpoint saved for the same id
+ *         if the flash still holds the bytes it covers. The progress keeps being saved.
+ *
+ * @param  id      identifies the image, as given to updater_set_id()
+ * @param  id_len  length of the id
+ *
+ * @return the number of bytes already written, where the next write continues (0 if the update starts
+ *         from the beginning) or -1 if the initialization failed.
+ */
+extern int32_t updater_resume(const uint8_t *id, uint8_t id_len);
+
 /**
  * @brief  OTA Write next chunk to Flash.
  *
@@ -45,8 +68,45 @@ extern bool updater_start(void);
  */
 extern bool updater_write(uint8_t *buf, uint32_t len);
 
+/**
+ * @brief  Initializes the OTA update process like updater_start(), the chunks given to updater_async_write()
+ *         are written to Flash by a background task.
+ *
+ * @return true if initialization succeeded; false otherwise.
+ */
+extern bool updater_async_start(void);
+
+/**
+ * @brief  Same as updater_resume(), the next chunks are given to updater_async_write().
+ *
+ * @return the number of bytes already written or -1 if the initialization failed.
+ */
+extern int32_t updater_async_resume(const uint8_t *id, uint8_t id_len);
+
+/**
+ * @brief  Copies the data-chunk to the buffer being filled, the full buffers are erased and written to Flash
+ *         by the background task while the next one is filled. Only blocks when both buffers are being written.
+ *
+ * @note The OTA process has to be previously initialized with updater_async_start().
+ *
+ * @param  buf  buffer with the data-chunk which needs to be written into Flash
+ * @param  len  length of the buf data.
+ *
+ * @return false if a previous write into Flash failed.
+ */
+extern bool updater_async_write(const uint8_t *buf, uint32_t len);
+
+/**
+ * @brief  Writes the last buffer and waits until the background task has written everything.
+ *         Must be called before updater_finish().
+ *
+ * @return true if all the writes into Flash succeeded.
+ */
+extern bool updater_async_flush(void);
+
 /**
  * @brief  Closing the OTA process. This provokes updating the boot info from the otadata partition.
+ *         A full image whose SHA256, computed while it was written, doesn't match is not activated.
  *
  * @return true if boot info was saved successful; false otherwise.
  */
@@ -56,11 +116,14 @@ extern bool updater_finish(void);
  * @brief  Verifies the newly written OTA image.
  *
  * @note If Secure Boot is enabled the signature is checked.
- *          Anyway the image integrity (SHA256) is checked.
+ *          Anyway the image integrity (SHA256) is checked. Without Secure Boot and Flash Encryption, the SHA256
+ *          computed while the image was written is compared with the one appended to the image, unless full is set.
  *
- * @return true if boot info was saved successful; false otherwise.
+ * @param  full  reads the image from Flash again and verifies it completely
+ *
+ * @return true if the image is valid; false otherwise.
  */
-extern bool updater_verify(void);
+extern bool updater_verify(bool full);
 
 /**
  * @brief  Reads the boot information, what partition is going to be booted from.
@@ -93,6 +156,8 @@ extern bool updater_write_boot_info(boot_info_t *boot_info, uint32_t boot_info_o
 /**
  * @brief  Patches the current image with the delta file and writes the final image to the free partition.
  *         The implementation is based on the bsdiff's patching algorithm.
+ *         The blocks are decompressed from the flash while patching, so zlib ("BSDIFFZ0") and heatshrink
+ *         ("BSDIFFH0") patches, see tools/bsdiff_convert.py, don't need PSRAM. bzip2 patches ("BSDIFF40") still need PSRAM.
  * 
  * @return true if patching was successful.
  */
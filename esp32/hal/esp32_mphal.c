@@ -15,6 +15,8 @@
 #include "py/mphal.h"
 #include "py/runtime.h"
 #include "py/objstr.h"
+#include "py/mperrno.h"
+#include "py/gc.h"
 #include "py/mpstate.h"
 
 #include "esp_heap_caps.h"
@@ -39,47 +41,74 @@
 #include "mpirq.h"
 
 #include "driver/timer.h"
+#include "esp_timer.h"
 
-typedef void (*HAL_tick_user_cb_t)(void);
+typedef void (*HAL_alarm_user_cb_t)(void);
 #if defined (LOPY) || defined(LOPY4) || defined(FIPY)
-DRAM_ATTR static HAL_tick_user_cb_t HAL_tick_user_cb;
+DRAM_ATTR static HAL_alarm_user_cb_t HAL_alarm_user_cb;
 
-#define TIMER1_ALARM_TIME_MS        1U
-#define TIMER1_DIVIDER              16U
-#define TIMER1_ALARM_COUNT          ((uint64_t)TIMER_BASE_CLK * (uint64_t)TIMER1_ALARM_TIME_MS) / ((uint64_t)TIMER1_DIVIDER * (uint64_t)1000)
+// the LoRa timer counts microseconds and only interrupts at the alarm programmed
+#define TIMER1_DIVIDER              (TIMER_BASE_CLK / 1000000U)
+// an alarm closer than this is moved to it, so that it isn't set in the past
+#define TIMER1_ALARM_MIN_US         10U
 
 #endif
 
+// number of GC blocks swept each time the VM waits, 64 KB of heap
+#define MP_HAL_GC_SWEEP_IDLE_BLOCKS         4096U
+
+#if MICROPY_PY_MICROPYTHON_PROFILE
+static esp_timer_handle_t mp_hal_profile_timer_handle;
+#endif
+
 
 #if defined (LOPY) || defined(LOPY4) || defined(FIPY)
 IRAM_ATTR static void HAL_TimerCallback (void* arg) {
+    // cleared first, the callback may program the next alarm
+    TIMERG0.int_clr_timers.t1 = 1;
 
-    if (HAL_tick_user_cb != NULL) {
-
-        HAL_tick_user_cb();
+    if (HAL_alarm_user_cb != NULL) {
+        HAL_alarm_user_cb();
     }
+}
 
-    TIMERG0.int_clr_timers.t1 = 1;
-    TIMERG0.hw_timer[1].update=1;
-    TIMERG0.hw_timer[1].config.alarm_en = 1;
+void HAL_set_alarm_cb (void *cb) {
+    HAL_alarm_user_cb = (HAL_alarm_user_cb_t)cb;
+}
 
+IRAM_ATTR uint64_t HAL_get_timer_us (void) {
+    TIMERG0.hw_timer[1].update = 1;
+    return ((uint64_t)TIMERG0.hw_timer[1].cnt_high << 32) | TIMERG0.hw_timer[1].cnt_low;
 }
 
-void HAL_set_tick_cb (void *cb) {
-    HAL_tick_user_cb = (HAL_tick_user_cb_t)cb;
+IRAM_ATTR void HAL_set_alarm_us (uint64_t when) {
+    uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
+    TIMERG0.hw_timer[1].config.alarm_en = 0;
+    uint64_t min = HAL_get_timer_us() + TIMER1_ALARM_MIN_US;
+    if (when < min) {
+        when = min;
+    }
+    TIMERG0.hw_timer[1].alarm_high = (uint32_t)(when >> 32);
+    TIMERG0.hw_timer[1].alarm_low = (uint32_t)when;
+    TIMERG0.hw_timer[1].config.alarm_en = 1;
+    MICROPY_END_ATOMIC_SECTION(ilevel);
+}
+
+IRAM_ATTR void HAL_clear_alarm (void) {
+    TIMERG0.hw_timer[1].config.alarm_en = 0;
 }
 #endif
 
 void mp_hal_init(bool soft_reset) {
     if (!soft_reset) {
     #if defined (LOPY) || defined(LOPY4) || defined(FIPY)
-        // setup the HAL timer for LoRa
-        HAL_tick_user_cb = NULL;
+        // setup the HAL timer for LoRa, free running, the alarm is set on demand
+        HAL_alarm_user_cb = NULL;
 
         timer_config_t config;
 
-        config.alarm_en = 1;
-        config.auto_reload = 1;
+        config.alarm_en = 0;
+        config.auto_reload = 0;
         config.counter_dir = TIMER_COUNT_UP;
         config.divider = TIMER1_DIVIDER;
         config.intr_type = TIMER_INTR_LEVEL;
@@ -90,8 +119,6 @@ void mp_hal_init(bool soft_reset) {
         timer_pause(TIMER_GROUP_0, TIMER_1);
         /*Load counter value */
         timer_set_counter_value(TIMER_GROUP_0, TIMER_1, 0x00000000ULL);
-        /*Set alarm value*/
-        timer_set_alarm_value(TIMER_GROUP_0, TIMER_1, (uint64_t)TIMER1_ALARM_COUNT);
         /*Enable timer interrupt*/
         timer_enable_intr(TIMER_GROUP_0, TIMER_1);
         /* Register Interrupt */
@@ -150,6 +177,19 @@ int mp_hal_stdin_rx_chr(void) {
     return -1;
 }
 
+// true if mp_hal_stdin_rx_chr() would not wait, always for a dupterm stream other than a UART
+bool mp_hal_stdin_rx_any(void) {
+    if (telnet_rx_any()) {
+        return true;
+    } else if (MP_STATE_PORT(mp_os_stream_o) != MP_OBJ_NULL) {
+        if (MP_OBJ_IS_TYPE(MP_STATE_PORT(mp_os_stream_o), &mach_uart_type)) {
+            return uart_rx_any(MP_STATE_PORT(mp_os_stream_o));
+        }
+        return true;
+    }
+    return false;
+}
+
 void mp_hal_stdout_tx_str(const char *str) {
     mp_hal_stdout_tx_strn(str, strlen(str));
 }
@@ -212,8 +252,38 @@ IRAM_ATTR uint64_t mp_hal_ticks_us_non_blocking(void) {
     return esp_timer_get_time();
 }
 
+#if MICROPY_PY_MICROPYTHON_PROFILE
+static void mp_hal_profile_timer_cb (void *arg) {
+    mp_profile_tick();
+}
+
+// the callback only flags the tick, so it can run in the esp_timer task whatever core the VM is on
+void mp_hal_profile_timer(mp_uint_t period_us) {
+    if (mp_hal_profile_timer_handle == NULL) {
+        esp_timer_create_args_t args = {
+            .callback = mp_hal_profile_timer_cb,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "profile"
+        };
+        if (esp_timer_create(&args, &mp_hal_profile_timer_handle) != ESP_OK) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    }
+    esp_timer_stop(mp_hal_profile_timer_handle);
+    if (period_us > 0) {
+        esp_timer_start_periodic(mp_hal_profile_timer_handle, period_us);
+    }
+}
+#endif
+
 void mp_hal_delay_ms(uint32_t delay) {
+#if MICROPY_GC_INCREMENTAL_SWEEP
+    // use the idle time to carry on with a pending GC sweep
+    gc_sweep_step(MP_HAL_GC_SWEEP_IDLE_BLOCKS);
+#endif
     MP_THREAD_GIL_EXIT();
+    delay = machine_auto_sleep(delay);
     vTaskDelay (delay / portTICK_PERIOD_MS);
     MP_THREAD_GIL_ENTER();
 }
@@ -11,12 +11,16 @@
 #define _INCLUDED_MPHAL_H_
 
 #if defined (LOPY) || defined(LOPY4) || defined(FIPY)
-void HAL_set_tick_cb (void *cb);
+void HAL_set_alarm_cb (void *cb);
+uint64_t HAL_get_timer_us (void);
+void HAL_set_alarm_us (uint64_t when);
+void HAL_clear_alarm (void);
 #endif
 void mp_hal_init(bool soft_reset);
 void mp_hal_feed_watchdog(void);
 void mp_hal_delay_us(uint32_t us);
 int mp_hal_stdin_rx_chr(void);
+bool mp_hal_stdin_rx_any(void);
 void mp_hal_stdout_tx_str(const char *str);
 void mp_hal_stdout_tx_strn(const char *str, uint32_t len);
 void mp_hal_stdout_tx_strn_cooked(const char *str, uint32_t len);
@@ -439,6 +439,7 @@ static int lfs_alloc_lookahead(void *p, lfs_block_t block) {
         lfs->free.buffer[off / 32] |= 1U << (off % 32);
     }
 
+    lfs->free.count += 1;
     return 0;
 }
 
@@ -452,6 +453,7 @@ static int lfs_alloc(lfs_t *lfs, lfs_block_t *block) {
             if (!(lfs->free.buffer[off / 32] & (1U << (off % 32)))) {
                 // found a free block
                 *block = (lfs->free.off + off) % lfs->cfg->block_count;
+                lfs->free.allocated += 1;
 
                 // eagerly find next off so an alloc ack can
                 // discredit old lookahead blocks
@@ -480,10 +482,15 @@ static int lfs_alloc(lfs_t *lfs, lfs_block_t *block) {
 
         // find mask of free blocks from tree
         memset(lfs->free.buffer, 0, lfs->cfg->lookahead_size);
+        lfs->free.count = 0;
         int err = lfs_fs_traverse(lfs, lfs_alloc_lookahead, lfs);
         if (err) {
             return err;
         }
+
+        // the traversal saw every block in use, resync the size bound
+        lfs->free.used = lfs->free.count;
+        lfs->free.allocated = 0;
     }
 }
 
@@ -3230,6 +3237,8 @@ static int lfs_init(lfs_t *lfs, const struct lfs_config *cfg) {
             goto cleanup;
         }
     }
+    lfs->free.used = (lfs_block_t)-1;
+    lfs->free.allocated = 0;
 
     // check that the size limits are sane
     LFS_ASSERT(lfs->cfg->name_max <= LFS_NAME_MAX);
@@ -3813,7 +3822,18 @@ lfs_ssize_t lfs_fs_size(lfs_t *lfs) {
         return err;
     }
 
-  return size;
+    lfs->free.used = size;
+    lfs->free.allocated = 0;
+    return size;
+}
+
+lfs_ssize_t lfs_fs_size_bound(lfs_t *lfs) {
+    lfs_block_t used = lfs->free.used;
+    if (used == (lfs_block_t)-1) {
+        return LFS_ERR_INVAL;
+    }
+
+    return lfs_min(used + lfs->free.allocated, lfs->cfg->block_count);
 }
 
 #ifdef LFS_MIGRATE
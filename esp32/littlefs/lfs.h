@@ -376,6 +376,9 @@ typedef struct lfs {
         lfs_block_t i;
         lfs_block_t ack;
         uint32_t *buffer;
+        lfs_block_t used;       // blocks found by the last full traversal, -1 before the first one
+        lfs_block_t allocated;  // blocks allocated since then
+        lfs_block_t count;      // blocks found so far by the running traversal
     } free;
 
     const struct lfs_config *cfg;
@@ -615,6 +618,17 @@ int lfs_dir_rewind(lfs_t *lfs, lfs_dir_t *dir);
 // Returns the number of allocated blocks, or a negative error code on failure.
 lfs_ssize_t lfs_fs_size(lfs_t *lfs);
 
+// Upper bound of the size of the filesystem, without traversing it
+//
+// This is the size found by the last traversal, from lfs_fs_size or from
+// the allocator refilling its lookahead, plus every block allocated since.
+// Blocks are freed implicitly so these are not subtracted until the next
+// traversal, the bound only grows in between.
+//
+// Returns the number of blocks, or LFS_ERR_INVAL if the filesystem was not
+// traversed since it was mounted.
+lfs_ssize_t lfs_fs_size_bound(lfs_t *lfs);
+
 // Traverse through all blocks in use by the filesystem
 //
 // The provided callback will be called with each block address that is
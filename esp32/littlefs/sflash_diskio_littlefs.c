@@ -1,32 +1,53 @@
+#include <string.h>
+
 #include "ff.h" /* Needed by diskio.h */
 #include "diskio.h"
 #include "sflash_diskio.h"
 #include "sflash_diskio_littlefs.h"
+#include "esp_heap_caps.h"
+#include "esp32chipinfo.h"
+#include "mpenergy.h"
 
 //TODO: figure out a proper value here
 #define PYCOM_CONTEXT ((void*)"pycom.io")
 
 
-char prog_buffer[SFLASH_BLOCK_SIZE] = {0};
-char read_buffer[SFLASH_BLOCK_SIZE] = {0};
+char prog_buffer[SFLASH_LITTLEFS_CACHE_SIZE] = {0};
+char read_buffer[SFLASH_LITTLEFS_CACHE_SIZE] = {0};
 // Must be on 64 bit aligned address, create it as array of 64 bit entries to achieve it
 uint64_t lookahead_buffer[SFLASH_BLOCK_COUNT_8MB/(8*8)] = {0};
 
+static sflash_littlefs_stats_t littlefs_stats;
+// Number of erases of each block since boot
+static uint32_t *littlefs_erase_counts = NULL;
+
 int littlefs_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size)
 {
-    return sflash_disk_read_littlefs(c, buffer, block, size);
+    littlefs_stats.bytes_read += size;
+    return sflash_disk_read_littlefs(c, buffer, block, off, size);
 }
 
 
 int littlefs_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size)
 {
-    return sflash_disk_write_littlefs(c, buffer, block, size);
+    littlefs_stats.bytes_programmed += size;
+    mpenergy_set(MPENERGY_RAIL_FLASH, true);
+    int ret = sflash_disk_write_littlefs(c, buffer, block, off, size);
+    mpenergy_set(MPENERGY_RAIL_FLASH, false);
+    return ret;
 }
 
 
 int littlefs_erase(const struct lfs_config *c, lfs_block_t block)
 {
-    return sflash_disk_erase_littlefs(c, block);
+    littlefs_stats.blocks_erased++;
+    if (littlefs_erase_counts != NULL && block < c->block_count) {
+        littlefs_erase_counts[block]++;
+    }
+    mpenergy_set(MPENERGY_RAIL_FLASH, true);
+    int ret = sflash_disk_erase_littlefs(c, block);
+    mpenergy_set(MPENERGY_RAIL_FLASH, false);
+    return ret;
 }
 
 int littlefs_sync(const struct lfs_config *c)
@@ -41,16 +62,14 @@ struct lfs_config lfscfg =
     .prog = &littlefs_prog,
     .erase = &littlefs_erase,
     .sync = &littlefs_sync,
-    .read_size = SFLASH_BLOCK_SIZE,
-    .prog_size = SFLASH_BLOCK_SIZE,
+    .read_size = SFLASH_LITTLEFS_READ_SIZE,
+    .prog_size = SFLASH_LITTLEFS_PROG_SIZE,
     .block_size = SFLASH_BLOCK_SIZE,
     .block_count = 0, // To be initialized according to the flash size of the chip
-    .block_cycles = 0, // No block-level wear-leveling
-    /* Current implementation of littlefs_read/prog/erase/sync() functions only operates with
-     * full blocks, always the starting address of the block is passed to the driver.
-     * This helps on the Power-loss resilient behavior of LittleFS, with this approach the File System will not be corrupted by corruption of a single file/block
-     * E.g.: it is not possible to only read/write a middle of a block, inline files will not work, set cache_size equal to read/prog size.*/
-    .cache_size = SFLASH_BLOCK_SIZE,
+    .block_cycles = SFLASH_LITTLEFS_BLOCK_CYCLES, // Can be overridden during startup, see mptask.c
+    /* See SFLASH_LITTLEFS_SUB_BLOCK_IO for the read/prog granularity, the cache holds a multiple of both.
+     * Changing these doesn't change the on-disk format, an existing File System can be mounted in both modes.*/
+    .cache_size = SFLASH_LITTLEFS_CACHE_SIZE,
     .lookahead_size = 0, // To be initialized according to the flash size of the chip
     .prog_buffer = prog_buffer,
     .read_buffer = read_buffer,
@@ -59,3 +78,28 @@ struct lfs_config lfscfg =
     .file_max = 0, // 0 means it is equal to LFS_FILE_MAX
     .attr_max = 0 // 0 means it is equal to LFS_ATTR_MAX
 };
+
+void littlefs_get_stats(sflash_littlefs_stats_t *stats, bool clear)
+{
+    *stats = littlefs_stats;
+    if (clear) {
+        memset(&littlefs_stats, 0, sizeof(littlefs_stats));
+    }
+}
+
+void littlefs_init_erase_counts(void)
+{
+    // Prefer PSRAM, the table is 4 KB on 8 MB boards
+    size_t size = lfscfg.block_count * sizeof(uint32_t);
+    if (esp32_get_chip_rev() > 0) {
+        littlefs_erase_counts = heap_caps_calloc(1, size, MALLOC_CAP_SPIRAM);
+    }
+    if (littlefs_erase_counts == NULL) {
+        littlefs_erase_counts = heap_caps_calloc(1, size, MALLOC_CAP_8BIT);
+    }
+}
+
+const uint32_t *littlefs_get_erase_counts(void)
+{
+    return littlefs_erase_counts;
+}
@@ -1,13 +1,51 @@
-
 #ifndef SFLASH_DISKIO_LITTLEFS_H
 #define SFLASH_DISKIO_LITTLEFS_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "lfs.h"
 
+/* When enabled littlefs reads at any offset and programs whole flash pages instead of always moving full 4 KB blocks,
+ * which makes inline files and small appends cheap.
+ * This keeps the Power-loss resilient behavior of LittleFS: it only programs erased areas and every metadata commit ends with a CRC,
+ * so a page program interrupted by a power loss is detected and the commit is discarded on the next mount.*/
+#ifndef SFLASH_LITTLEFS_SUB_BLOCK_IO
+#define SFLASH_LITTLEFS_SUB_BLOCK_IO    (1)
+#endif
+
+#if SFLASH_LITTLEFS_SUB_BLOCK_IO
+#define SFLASH_LITTLEFS_READ_SIZE       (64)
+#define SFLASH_LITTLEFS_PROG_SIZE       (256) // Size of a flash page
+#define SFLASH_LITTLEFS_CACHE_SIZE      (512)
+#else
+#define SFLASH_LITTLEFS_READ_SIZE       SFLASH_BLOCK_SIZE
+#define SFLASH_LITTLEFS_PROG_SIZE       SFLASH_BLOCK_SIZE
+#define SFLASH_LITTLEFS_CACHE_SIZE      SFLASH_BLOCK_SIZE
+#endif
+
+/* Number of erase cycles of a metadata block before LittleFS moves it to another block, 0 disables block-level wear-leveling.
+ * Changing it doesn't change the on-disk format.*/
+#ifndef SFLASH_LITTLEFS_BLOCK_CYCLES
+#define SFLASH_LITTLEFS_BLOCK_CYCLES    (500)
+#endif
+
+// NVS key (in the namespace of pycom.nvs_set()) overriding SFLASH_LITTLEFS_BLOCK_CYCLES from the next boot
+#define SFLASH_LITTLEFS_BLOCK_CYCLES_KEY    "lfs_cycles"
+
+typedef struct {
+    uint32_t bytes_read;
+    uint32_t bytes_programmed;
+    uint32_t blocks_erased;
+} sflash_littlefs_stats_t;
+
 extern int littlefs_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size);
 extern int littlefs_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size);
 extern int littlefs_erase(const struct lfs_config *c, lfs_block_t block);
 extern int littlefs_sync(const struct lfs_config *c);
+extern void littlefs_get_stats(sflash_littlefs_stats_t *stats, bool clear);
+extern void littlefs_init_erase_counts(void);
+extern const uint32_t *littlefs_get_erase_counts(void);
 extern struct lfs_config lfscfg;
 
 #endif
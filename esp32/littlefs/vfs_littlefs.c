@@ -4,11 +4,16 @@
 #include <string.h>
 #include "py/runtime.h"
 #include "py/mperrno.h"
+#include "py/mphal.h"
 #include "lib/oofatfs/ff.h"
 #include "extmod/vfs.h"
 #include "vfs_littlefs.h"
 #include "lib/timeutils/timeutils.h"
 #include "sflash_diskio_littlefs.h"
+#include "esp_heap_caps.h"
+#include "esp32chipinfo.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 
 int lfs_statvfs_count(void *p, lfs_block_t b)
@@ -67,27 +72,129 @@ static int is_valid_directory(vfs_lfs_struct_t* littlefs, const char* path)
     }
 }
 
+static void littlefs_import_cache_free(lfs_import_cache_dir_t* dir)
+{
+    free(dir->path);
+    free(dir->names);
+    memset(dir, 0, sizeof(*dir));
+}
+
+// Must be called with the lock held by everything creating or removing an entry
+void littlefs_import_cache_invalidate(vfs_lfs_struct_t* littlefs)
+{
+    for (int i = 0; i < LFS_IMPORT_CACHE_DIRS; i++) {
+        if (littlefs->import_cache[i].path != NULL) {
+            littlefs_import_cache_free(&littlefs->import_cache[i]);
+        }
+    }
+}
+
+// Returns the cached listing of the directory, reading it first if needed, or NULL if out of memory
+static lfs_import_cache_dir_t* littlefs_import_cache_list(vfs_lfs_struct_t* littlefs, const char* path, size_t path_len)
+{
+    for (int i = 0; i < LFS_IMPORT_CACHE_DIRS; i++) {
+        lfs_import_cache_dir_t* dir = &littlefs->import_cache[i];
+        if (dir->path != NULL && strlen(dir->path) == path_len && memcmp(dir->path, path, path_len) == 0) {
+            return dir;
+        }
+    }
+
+    // Replace the oldest listing
+    lfs_import_cache_dir_t* dir = &littlefs->import_cache[littlefs->import_cache_next];
+    littlefs->import_cache_next = (littlefs->import_cache_next + 1) % LFS_IMPORT_CACHE_DIRS;
+    littlefs_import_cache_free(dir);
+
+    dir->path = malloc(path_len + 1);
+    if (dir->path == NULL) {
+        return NULL;
+    }
+    memcpy(dir->path, path, path_len);
+    dir->path[path_len] = '\0';
+    littlefs->import_stats.dir_reads++;
+
+    lfs_dir_t lfs_dir;
+    if (lfs_dir_open(&littlefs->lfs, &lfs_dir, (path_len > 0) ? dir->path : "/") != LFS_ERR_OK) {
+        // Every import from a missing entry of sys.path ends here
+        dir->state = LFS_IMPORT_DIR_MISSING;
+        return dir;
+    }
+
+    dir->state = LFS_IMPORT_DIR_UNCACHED;
+    dir->names = malloc(LFS_IMPORT_CACHE_DIR_SIZE);
+    if (dir->names != NULL) {
+        struct lfs_info info;
+        int res;
+        dir->state = LFS_IMPORT_DIR_LISTED;
+        while ((res = lfs_dir_read(&littlefs->lfs, &lfs_dir, &info)) > 0) {
+            if (strcmp(info.name, ".") == 0 || strcmp(info.name, "..") == 0) {
+                continue;
+            }
+            size_t len = strlen(info.name) + 2;
+            if (dir->len + len > LFS_IMPORT_CACHE_DIR_SIZE) {
+                res = LFS_ERR_NOMEM;
+                break;
+            }
+            dir->names[dir->len] = (info.type == LFS_TYPE_DIR) ? 'd' : 'f';
+            memcpy(&dir->names[dir->len + 1], info.name, len - 1);
+            dir->len += len;
+        }
+        if (res < 0) {
+            dir->state = LFS_IMPORT_DIR_UNCACHED;
+        }
+    }
+    lfs_dir_close(&littlefs->lfs, &lfs_dir);
+
+    if (dir->state == LFS_IMPORT_DIR_UNCACHED) {
+        free(dir->names);
+        dir->names = NULL;
+        dir->len = 0;
+    }
+    return dir;
+}
+
+/* Importing a module stats every entry of sys.path for the package directory, the .py and the .mpy, most of them
+ * don't exist. These are answered from the cached listings of the directories, each one is read only once.*/
 static mp_import_stat_t lfs_vfs_import_stat(void *self, const char *path)
 {
-    struct lfs_info lfs_info_stat;
     fs_user_mount_t *vfs = (fs_user_mount_t*) self;
     assert(vfs != NULL);
-    /* check if path exists */
-    if((int)LFS_ERR_OK == lfs_stat(&(vfs->fs.littlefs.lfs), path, &lfs_info_stat))
-    {
-        if(lfs_info_stat.type == LFS_TYPE_DIR)
-        {
-            return MP_IMPORT_STAT_DIR;
+    vfs_lfs_struct_t* littlefs = &vfs->fs.littlefs;
+    mp_import_stat_t stat = MP_IMPORT_STAT_NO_EXIST;
+
+    // LittleFS paths always start from the root
+    while (*path == '/') {
+        path++;
+    }
+    const char* name = strrchr(path, '/');
+    size_t path_len = (name != NULL) ? (size_t)(name - path) : 0;
+    name = (name != NULL) ? name + 1 : path;
+
+    littlefs_lock(littlefs);
+        littlefs->import_stats.calls++;
+
+        lfs_import_cache_dir_t* dir = NULL;
+        if (*name != '\0') {
+            dir = littlefs_import_cache_list(littlefs, path, path_len);
         }
-        else
-        {
-            return MP_IMPORT_STAT_FILE;
+
+        if (dir != NULL && dir->state == LFS_IMPORT_DIR_LISTED) {
+            for (uint16_t i = 0; i < dir->len; i += strlen(&dir->names[i + 1]) + 2) {
+                if (strcmp(&dir->names[i + 1], name) == 0) {
+                    stat = (dir->names[i] == 'd') ? MP_IMPORT_STAT_DIR : MP_IMPORT_STAT_FILE;
+                    break;
+                }
+            }
+        } else if (dir == NULL || dir->state == LFS_IMPORT_DIR_UNCACHED) {
+            struct lfs_info lfs_info_stat;
+            littlefs->import_stats.lookups++;
+            /* check if path exists */
+            if ((int)LFS_ERR_OK == lfs_stat(&littlefs->lfs, path, &lfs_info_stat)) {
+                stat = (lfs_info_stat.type == LFS_TYPE_DIR) ? MP_IMPORT_STAT_DIR : MP_IMPORT_STAT_FILE;
+            }
         }
-    }
-    else
-    {
-        return MP_IMPORT_STAT_NO_EXIST;
-    }
+    littlefs_unlock(littlefs);
+
+    return stat;
 }
 
 static int change_cwd(vfs_lfs_struct_t* littlefs, const char* path_in)
@@ -280,6 +387,12 @@ int littlefs_open_common_helper(lfs_t *lfs, const char* file_path, lfs_file_t *f
     // Prepare the attributes
     littlefs_prepare_attributes(cfg);
 
+    // Keep the cache of the file in PSRAM if available, otherwise LittleFS allocates it from the internal heap
+    cfg->buffer = NULL;
+    if (esp32_get_chip_rev() > 0) {
+        cfg->buffer = heap_caps_malloc(lfs->cfg->cache_size, MALLOC_CAP_SPIRAM);
+    }
+
     bool new_file = false;
     struct lfs_info info;
     if(LFS_ERR_NOENT == lfs_stat(lfs, file_path, &info)) {
@@ -308,8 +421,9 @@ int littlefs_open_common_helper(lfs_t *lfs, const char* file_path, lfs_file_t *f
         }
     }
     else {
-        // Problem happened, free up the attributes
+        // Problem happened, free up the attributes and the cache
         littlefs_free_up_attributes(cfg);
+        free(cfg->buffer);
     }
 
     return res;
@@ -326,6 +440,7 @@ int littlefs_close_common_helper(lfs_t *lfs, lfs_file_t *fp, struct lfs_file_con
     int res = lfs_file_close(lfs, fp);
     if(res == LFS_ERR_OK) {
         littlefs_free_up_attributes(cfg);
+        free(cfg->buffer);
     }
 
     return res;
@@ -396,6 +511,169 @@ void littlefs_update_timestamp_cfg(struct lfs_file_config *cfg)
 }
 
 
+/* LittleFS is not reentrant (even reads go through the shared caches of lfs_t), so the lock stays exclusive.
+ * Instead long reads and writes are split into LFS_LOCK_CHUNK_SIZE pieces releasing the lock in between, and
+ * Python threads can give away the GIL while they work on a chunk, these don't touch any Python object.*/
+void littlefs_lock(vfs_lfs_struct_t* littlefs)
+{
+    if (xSemaphoreTake(littlefs->mutex, 0) == pdTRUE) {
+        return;
+    }
+
+    uint32_t start = mp_hal_ticks_us();
+    xSemaphoreTake(littlefs->mutex, portMAX_DELAY);
+    uint32_t wait_us = mp_hal_ticks_us() - start;
+
+    littlefs->lock_stats.contended++;
+    littlefs->lock_stats.wait_us += wait_us;
+    if (wait_us > littlefs->lock_stats.max_wait_us) {
+        littlefs->lock_stats.max_wait_us = wait_us;
+    }
+}
+
+void littlefs_unlock(vfs_lfs_struct_t* littlefs)
+{
+    xSemaphoreGive(littlefs->mutex);
+}
+
+lfs_ssize_t littlefs_file_read_chunked(vfs_lfs_struct_t* littlefs, lfs_file_t *fp, void *buffer, lfs_size_t size, bool release_gil)
+{
+    lfs_ssize_t total = 0;
+    while (size > 0) {
+        lfs_size_t chunk = MIN(size, LFS_LOCK_CHUNK_SIZE);
+        if (release_gil) {
+            MP_THREAD_GIL_EXIT();
+        }
+        littlefs_lock(littlefs);
+            lfs_ssize_t res = lfs_file_read(&littlefs->lfs, fp, (uint8_t*)buffer + total, chunk);
+        littlefs_unlock(littlefs);
+        if (release_gil) {
+            MP_THREAD_GIL_ENTER();
+        }
+        if (res < 0) {
+            // Report what has been read already, the error comes again with the next read
+            return (total > 0) ? total : res;
+        }
+        total += res;
+        size -= res;
+        if (res < chunk) {
+            // End of the file
+            break;
+        }
+    }
+    return total;
+}
+
+lfs_ssize_t littlefs_file_write_chunked(vfs_lfs_struct_t* littlefs, lfs_file_t *fp, const void *buffer, lfs_size_t size, bool release_gil)
+{
+    lfs_ssize_t total = 0;
+    while (size > 0) {
+        lfs_size_t chunk = MIN(size, LFS_LOCK_CHUNK_SIZE);
+        if (release_gil) {
+            MP_THREAD_GIL_EXIT();
+        }
+        littlefs_lock(littlefs);
+            lfs_ssize_t res = lfs_file_write(&littlefs->lfs, fp, (const uint8_t*)buffer + total, chunk);
+        littlefs_unlock(littlefs);
+        if (release_gil) {
+            MP_THREAD_GIL_ENTER();
+        }
+        if (res < 0) {
+            return res;
+        }
+        total += res;
+        size -= res;
+        if (res < chunk) {
+            break;
+        }
+    }
+    return total;
+}
+
+void littlefs_get_lock_stats(vfs_lfs_struct_t* littlefs, lfs_lock_stats_t *stats, bool clear)
+{
+    littlefs_lock(littlefs);
+        *stats = littlefs->lock_stats;
+        if (clear) {
+            memset(&littlefs->lock_stats, 0, sizeof(littlefs->lock_stats));
+        }
+    littlefs_unlock(littlefs);
+}
+
+void littlefs_get_import_stats(vfs_lfs_struct_t* littlefs, lfs_import_stats_t *stats, bool clear)
+{
+    littlefs_lock(littlefs);
+        *stats = littlefs->import_stats;
+        if (clear) {
+            memset(&littlefs->import_stats, 0, sizeof(littlefs->import_stats));
+        }
+    littlefs_unlock(littlefs);
+}
+
+/* The free space comes from the size bound of lfs.c: the blocks in use at the last traversal plus those allocated
+ * since. Blocks are freed implicitly by LittleFS, so the bound only grows until the next traversal. A low priority
+ * task redoes it at mount and whenever the bound drifted by a 1/LFS_RESYNC_DRIFT of the file system, statvfs
+ * never has to walk the file system itself. The running flag is protected by the lock.*/
+static bool littlefs_resync_running = false;
+
+static void TASK_LittleFS_Resync(void *pvParameters)
+{
+    vfs_lfs_struct_t* littlefs = pvParameters;
+    littlefs_lock(littlefs);
+        lfs_fs_size(&littlefs->lfs);
+        littlefs_resync_running = false;
+    littlefs_unlock(littlefs);
+    vTaskDelete(NULL);
+}
+
+// Must be called with the lock held, except at boot before anyone else can use the file system
+void littlefs_resync_size(vfs_lfs_struct_t* littlefs)
+{
+    if (!littlefs_resync_running) {
+        littlefs_resync_running = true;
+        if (xTaskCreatePinnedToCore(TASK_LittleFS_Resync, "LFS_Resync", LFS_RESYNC_STACK_SIZE / sizeof(StackType_t),
+                                    littlefs, LFS_RESYNC_TASK_PRIORITY, NULL, 1) != pdPASS) {
+            littlefs_resync_running = false;
+        }
+    }
+}
+
+// Returns the blocks in use, never less than the real number, or a negative error code
+lfs_ssize_t littlefs_size(vfs_lfs_struct_t* littlefs)
+{
+    lfs_t* lfs = &littlefs->lfs;
+    littlefs_lock(littlefs);
+        lfs_ssize_t in_use = lfs_fs_size_bound(lfs);
+        if (in_use < 0) {
+            // Not traversed since the mount, e.g. after a format
+            in_use = lfs_fs_size(lfs);
+        } else if (lfs->free.allocated > lfs->cfg->block_count / LFS_RESYNC_DRIFT) {
+            littlefs_resync_size(littlefs);
+        }
+    littlefs_unlock(littlefs);
+    return in_use;
+}
+
+// Returns 1 if a new file of nbytes fits in the free space, 0 if not, or a negative error code
+int littlefs_fits(vfs_lfs_struct_t* littlefs, lfs_size_t nbytes)
+{
+    lfs_t* lfs = &littlefs->lfs;
+    // The data rounded up to blocks, one more for the copy-on-write of the directory and the CTZ pointers
+    lfs_size_t needed = (nbytes + lfs->cfg->block_size - 1) / lfs->cfg->block_size + 1;
+    littlefs_lock(littlefs);
+        lfs_ssize_t in_use = lfs_fs_size_bound(lfs);
+        if (in_use < 0 || (lfs->free.allocated > 0 && lfs->cfg->block_count - in_use < needed)) {
+            // The bound may be too pessimistic, only walk the file system when the answer depends on it
+            in_use = lfs_fs_size(lfs);
+        }
+    littlefs_unlock(littlefs);
+    if (in_use < 0) {
+        return in_use;
+    }
+    return (lfs->cfg->block_count - in_use) >= needed;
+}
+
+
 typedef struct _mp_vfs_littlefs_ilistdir_it_t {
     mp_obj_base_t base;
     mp_fun_1_t iternext;
@@ -411,9 +689,9 @@ STATIC mp_obj_t mp_vfs_littlefs_ilistdir_it_iternext(mp_obj_t self_in) {
     for (;;) {
         struct lfs_info fno;
 
-        xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(self->littlefs);
             int res = lfs_dir_read(&self->littlefs->lfs, &self->dir, &fno);
-        xSemaphoreGive(self->littlefs->mutex);
+        littlefs_unlock(self->littlefs);
 
         char *fn = fno.name;
         if (res < LFS_ERR_OK || fn[0] == 0) {
@@ -446,9 +724,9 @@ STATIC mp_obj_t mp_vfs_littlefs_ilistdir_it_iternext(mp_obj_t self_in) {
     }
 
     // ignore error because we may be closing a second time
-    xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+    littlefs_lock(self->littlefs);
         lfs_dir_close(&self->littlefs->lfs, &self->dir);
-    xSemaphoreGive(self->littlefs->mutex);
+    littlefs_unlock(self->littlefs);
 
     return MP_OBJ_STOP_ITERATION;
 }
@@ -476,14 +754,14 @@ STATIC mp_obj_t littlefs_vfs_ilistdir_func(size_t n_args, const mp_obj_t *args)
     iter->iternext = mp_vfs_littlefs_ilistdir_it_iternext;
     iter->is_str = is_str_type;
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
         } else {
             res = lfs_dir_open(&self->fs.littlefs.lfs, &iter->dir, path);
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     free((void*)path);
 
@@ -501,17 +779,18 @@ STATIC mp_obj_t littlefs_vfs_mkdir(mp_obj_t vfs_in, mp_obj_t path_param) {
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
     const char *path_in = mp_obj_str_get_str(path_param);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
         } else {
             res = lfs_mkdir(&self->fs.littlefs.lfs, path);
+            littlefs_import_cache_invalidate(&self->fs.littlefs);
             if (res == LFS_ERR_OK) {
                 littlefs_update_timestamp(&self->fs.littlefs.lfs, path);
             }
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     free((void*)path);
 
@@ -530,14 +809,15 @@ STATIC mp_obj_t littlefs_vfs_remove(mp_obj_t vfs_in, mp_obj_t path_param) {
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
     const char *path_in = mp_obj_str_get_str(path_param);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
         } else {
             res = lfs_remove(&self->fs.littlefs.lfs, path);
+            littlefs_import_cache_invalidate(&self->fs.littlefs);
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     free((void*)path);
 
@@ -557,7 +837,7 @@ STATIC mp_obj_t littlefs_vfs_rename(mp_obj_t vfs_in, mp_obj_t path_param_in, mp_
     const char *path_in = mp_obj_str_get_str(path_param_in);
     const char *path_out = mp_obj_str_get_str(path_param_out);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         const char *old_path = concat_with_cwd(&self->fs.littlefs, path_in);
         const char *new_path = concat_with_cwd(&self->fs.littlefs, path_out);
 
@@ -565,8 +845,9 @@ STATIC mp_obj_t littlefs_vfs_rename(mp_obj_t vfs_in, mp_obj_t path_param_in, mp_
             res = LFS_ERR_NOMEM;
         } else {
             res = lfs_rename(&self->fs.littlefs.lfs, old_path, new_path);
+            littlefs_import_cache_invalidate(&self->fs.littlefs);
         }
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     free((void*)old_path);
     free((void*)new_path);
@@ -586,9 +867,9 @@ STATIC mp_obj_t littlefs_vfs_chdir(mp_obj_t vfs_in, mp_obj_t path_param) {
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
     const char *path_in = mp_obj_str_get_str(path_param);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         res = parse_and_append_to_cwd(&self->fs.littlefs, path_in);
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     if (res != LFS_ERR_OK) {
         mp_raise_OSError(littleFsErrorToErrno(res));
@@ -602,9 +883,9 @@ STATIC mp_obj_t littlefs_vfs_getcwd(mp_obj_t vfs_in) {
 
     fs_user_mount_t *self = MP_OBJ_TO_PTR(vfs_in);
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         mp_obj_t ret = mp_obj_new_str(self->fs.littlefs.cwd, strlen(self->fs.littlefs.cwd));
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     return ret;
 }
@@ -619,7 +900,7 @@ STATIC mp_obj_t littlefs_vfs_stat(mp_obj_t vfs_in, mp_obj_t path_param) {
     lfs_timestamp_attribute_t ts;
 
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&self->fs.littlefs);
         const char *path = concat_with_cwd(&self->fs.littlefs, path_in);
         if (path == NULL) {
             res = LFS_ERR_NOMEM;
@@ -631,7 +912,7 @@ STATIC mp_obj_t littlefs_vfs_stat(mp_obj_t vfs_in, mp_obj_t path_param) {
             res = littlefs_stat_common_helper(&self->fs.littlefs.lfs, path, &fno, &ts);
         }
 
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    littlefs_unlock(&self->fs.littlefs);
 
     free((void*)path);
 
@@ -687,9 +968,7 @@ STATIC mp_obj_t littlefs_vfs_statvfs(mp_obj_t vfs_in, mp_obj_t path_in) {
 
     mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(10, NULL));
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
-        lfs_ssize_t in_use = lfs_fs_size(lfs);
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    lfs_ssize_t in_use = littlefs_size(&self->fs.littlefs);
 
     if (in_use < 0) {
         mp_raise_OSError(littleFsErrorToErrno(in_use));
@@ -717,9 +996,7 @@ STATIC mp_obj_t littlefs_vfs_getfree(mp_obj_t vfs_in) {
 
     lfs_t* lfs = &self->fs.littlefs.lfs;
 
-    xSemaphoreTake(self->fs.littlefs.mutex, portMAX_DELAY);
-        lfs_ssize_t in_use = lfs_fs_size(lfs);
-    xSemaphoreGive(self->fs.littlefs.mutex);
+    lfs_ssize_t in_use = littlefs_size(&self->fs.littlefs);
 
     if (in_use < 0) {
         mp_raise_OSError(littleFsErrorToErrno(in_use));
@@ -742,7 +1019,10 @@ STATIC mp_obj_t littlefs_vfs_fsformat(mp_obj_t vfs_in)
 {
     fs_user_mount_t * vfs = MP_OBJ_TO_PTR(vfs_in);
 
-    lfs_format(&vfs->fs.littlefs.lfs, &lfscfg);
+    littlefs_lock(&vfs->fs.littlefs);
+        lfs_format(&vfs->fs.littlefs.lfs, &lfscfg);
+        littlefs_import_cache_invalidate(&vfs->fs.littlefs);
+    littlefs_unlock(&vfs->fs.littlefs);
 
     return mp_const_none;
 }
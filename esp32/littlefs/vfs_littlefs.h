@@ -15,11 +15,56 @@ typedef struct pycom_lfs_file_s {
     bool timestamp_update;  // For requesting timestamp update when closing the file
 } pycom_lfs_file_t;
 
+// Reads and writes hold the lock for at most this many bytes at a time, so other tasks can interleave their operations
+#define LFS_LOCK_CHUNK_SIZE         (4096)
+
+// The used size is traversed again in the background once the blocks allocated since the last time exceed 1/LFS_RESYNC_DRIFT
+#define LFS_RESYNC_DRIFT            (16)
+#define LFS_RESYNC_STACK_SIZE       (4096)
+#define LFS_RESYNC_TASK_PRIORITY    (1)
+
+typedef struct lfs_lock_stats_s
+{
+    uint32_t contended; // Number of times the lock was taken by another task
+    uint32_t wait_us;   // Total time spent waiting for the lock
+    uint32_t max_wait_us;
+}lfs_lock_stats_t;
+
+// Listings of the directories searched by the import statements, dropped whenever an entry is created or removed
+#define LFS_IMPORT_CACHE_DIRS       (4)
+#define LFS_IMPORT_CACHE_DIR_SIZE   (1024) // Longer listings are not cached, their entries are looked up one by one
+
+typedef enum
+{
+    LFS_IMPORT_DIR_LISTED = 0,
+    LFS_IMPORT_DIR_MISSING,
+    LFS_IMPORT_DIR_UNCACHED,
+}lfs_import_dir_state_t;
+
+typedef struct lfs_import_cache_dir_s
+{
+    char* path; // NULL if the slot is free
+    char* names; // The type ('d' or 'f') and the name of each entry, all ending with '\0'
+    uint16_t len;
+    uint8_t state;
+}lfs_import_cache_dir_t;
+
+typedef struct lfs_import_stats_s
+{
+    uint32_t calls; // Number of import stats
+    uint32_t dir_reads; // Directories listed into the cache
+    uint32_t lookups; // Paths looked up in the file system because their directory was not cached
+}lfs_import_stats_t;
+
 typedef struct vfs_lfs_struct_s
 {
     lfs_t lfs;
     char* cwd; // Needs to be initialized to point to: "/\0"
     SemaphoreHandle_t mutex; // Needs to be created
+    lfs_lock_stats_t lock_stats; // Protected by the mutex
+    lfs_import_cache_dir_t import_cache[LFS_IMPORT_CACHE_DIRS]; // Protected by the mutex
+    uint8_t import_cache_next;
+    lfs_import_stats_t import_stats; // Protected by the mutex
 }vfs_lfs_struct_t;
 
 typedef struct lfs_timestamp_attribute_s
@@ -47,6 +92,16 @@ extern void littlefs_free_up_attributes(struct lfs_file_config *cfg);
 extern int littlefs_update_timestamp(lfs_t* lfs, const char* file_relative_path);
 extern void littlefs_update_timestamp_cfg(struct lfs_file_config *cfg);
 extern lfs_timestamp_attribute_t littlefs_get_timestamp_fp(lfs_file_t* fp);
+extern void littlefs_lock(vfs_lfs_struct_t* littlefs);
+extern void littlefs_unlock(vfs_lfs_struct_t* littlefs);
+extern lfs_ssize_t littlefs_file_read_chunked(vfs_lfs_struct_t* littlefs, lfs_file_t *fp, void *buffer, lfs_size_t size, bool release_gil);
+extern lfs_ssize_t littlefs_file_write_chunked(vfs_lfs_struct_t* littlefs, lfs_file_t *fp, const void *buffer, lfs_size_t size, bool release_gil);
+extern void littlefs_get_lock_stats(vfs_lfs_struct_t* littlefs, lfs_lock_stats_t *stats, bool clear);
+extern void littlefs_resync_size(vfs_lfs_struct_t* littlefs);
+extern void littlefs_import_cache_invalidate(vfs_lfs_struct_t* littlefs);
+extern void littlefs_get_import_stats(vfs_lfs_struct_t* littlefs, lfs_import_stats_t *stats, bool clear);
+extern lfs_ssize_t littlefs_size(vfs_lfs_struct_t* littlefs);
+extern int littlefs_fits(vfs_lfs_struct_t* littlefs, lfs_size_t nbytes);
 
 
 extern const mp_obj_type_t mp_littlefs_vfs_type;
@@ -31,9 +31,7 @@ STATIC mp_uint_t file_obj_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
 
     pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
-        lfs_ssize_t sz_out = lfs_file_read(&self->littlefs->lfs ,&self->fp, buf, size);
-    xSemaphoreGive(self->littlefs->mutex);
+    lfs_ssize_t sz_out = littlefs_file_read_chunked(self->littlefs, &self->fp, buf, size, true);
 
     if (sz_out < 0) {
         *errcode = littleFsErrorToErrno(sz_out);
@@ -46,13 +44,11 @@ STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t siz
 
     pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
-        lfs_ssize_t sz_out = lfs_file_write(&self->littlefs->lfs, &self->fp, buf, size);
-        // Request timestamp update if file has been written successfully
-        if(sz_out > 0) {
-            self->timestamp_update = true;
-        }
-    xSemaphoreGive(self->littlefs->mutex);
+    lfs_ssize_t sz_out = littlefs_file_write_chunked(self->littlefs, &self->fp, buf, size, true);
+    // Request timestamp update if file has been written successfully
+    if(sz_out > 0) {
+        self->timestamp_update = true;
+    }
 
     if (sz_out < 0) {
         *errcode = littleFsErrorToErrno(sz_out);
@@ -80,18 +76,18 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
 
         struct mp_stream_seek_t *s = (struct mp_stream_seek_t*)(uintptr_t)arg;
 
-        xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(self->littlefs);
             lfs_file_seek(&self->littlefs->lfs, &self->fp, s->offset, s->whence);
             s->offset = lfs_file_tell(&self->littlefs->lfs, &self->fp);
-        xSemaphoreGive(self->littlefs->mutex);
+        littlefs_unlock(self->littlefs);
 
         return 0;
 
     } else if (request == MP_STREAM_FLUSH) {
 
-        xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(self->littlefs);
             int res = lfs_file_sync(&self->littlefs->lfs, &self->fp);
-        xSemaphoreGive(self->littlefs->mutex);
+        littlefs_unlock(self->littlefs);
 
         if (res < 0) {
             *errcode = littleFsErrorToErrno(res);
@@ -101,9 +97,9 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
 
     } else if (request == MP_STREAM_CLOSE) {
 
-        xSemaphoreTake(self->littlefs->mutex, portMAX_DELAY);
+        littlefs_lock(self->littlefs);
             int res = littlefs_close_common_helper(&self->littlefs->lfs, &self->fp, &self->cfg, &self->timestamp_update);
-        xSemaphoreGive(self->littlefs->mutex);
+        littlefs_unlock(self->littlefs);
         if (res < 0) {
             *errcode = littleFsErrorToErrno(res);
             return MP_STREAM_ERROR;
@@ -166,10 +162,13 @@ STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_ar
     o->base.type = type;
     o->timestamp_update = false;
 
-    xSemaphoreTake(vfs->fs.littlefs.mutex, portMAX_DELAY);
+    littlefs_lock(&vfs->fs.littlefs);
         const char *fname = concat_with_cwd(&vfs->fs.littlefs, mp_obj_str_get_str(args[0].u_obj));
         int res = littlefs_open_common_helper(&vfs->fs.littlefs.lfs, fname, &o->fp, mode, &o->cfg, &o->timestamp_update);
-    xSemaphoreGive(vfs->fs.littlefs.mutex);
+        if (mode & LFS_O_CREAT) {
+            littlefs_import_cache_invalidate(&vfs->fs.littlefs);
+        }
+    littlefs_unlock(&vfs->fs.littlefs);
 
     free((void*)fname);
     if (res < LFS_ERR_OK) {
@@ -17,6 +17,7 @@
 
 #include "esp32_mphal.h"
 #include "random.h"
+#include "mods/modmesh.h"
 #include "../lib/lora/system/timer.h"
 #include <openthread/platform/alarm-milli.h>
 #include <openthread/instance.h>
@@ -24,24 +25,38 @@
 #include <openthread/thread_ftd.h>
 
 static bool is_running = false;
+static volatile bool is_fired = false;
 static TimerEvent_t otPlatAlarm;
 static otInstance *otPtr = NULL;
 
 /**
- * Alarm callback
+ * Alarm callback, runs in the LoRa timer task: only wakes the Mesh task up
  *
  */
 void alarmCallback(void) {
     if (is_running) {
         is_running = false;
+        is_fired = true;
+        mesh_task_signal();
+    }
+}
+
+/**
+ * Reports the fired alarm to OpenThread, called by the Mesh task
+ *
+ * @param[in] aInstance  The OpenThread instance structure.
+ */
+void otPlatAlarmProcess(otInstance *aInstance) {
+    if (is_fired) {
+        is_fired = false;
 #if OPENTHREAD_ENABLE_DIAG
         if (otPlatDiagModeGet())
         {
-            otPlatDiagAlarmFired(otPtr);
+            otPlatDiagAlarmFired(aInstance);
         }
         else
 #endif
-        otPlatAlarmMilliFired(otPtr);
+        otPlatAlarmMilliFired(aInstance);
     }
 }
 
@@ -89,6 +104,7 @@ void otPlatAlarmMilliStartAt(otInstance *aInstance, uint32_t aT0, uint32_t aDt)
     }
     TimerStart(&otPlatAlarm);
 
+    is_fired = false;
     is_running = true;
     return;
 }
@@ -103,6 +119,7 @@ void otPlatAlarmMilliStop(otInstance *aInstance) {
     (void) aInstance;
     TimerStop(&otPlatAlarm);
     is_running = false;
+    is_fired = false;
 }
 
 /**
@@ -27,6 +27,8 @@ inline uint32_t HostSwap32(uint32_t v) {
 
 void otPlatAlarmInit(otInstance *aInstance);
 
+void otPlatAlarmProcess(otInstance *aInstance);
+
 void printSingleIpv6(otIp6Address *addr);
 
 #endif /* LORA_OTPLAT_ALARM_H_ */
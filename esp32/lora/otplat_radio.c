@@ -18,6 +18,7 @@
 #include <openthread/platform/alarm-milli.h>
 
 #include "esp_wifi.h"
+#include "esp32_mphal.h"
 #include "random.h"
 
 /******************************************************************************
@@ -66,6 +67,18 @@ enum {
 
 #define POSIX_MAX_SRC_MATCH_ENTRIES OPENTHREAD_CONFIG_MAX_CHILDREN
 
+// frames waiting for room in the LoRa task queue, acks included
+#define OT_RADIO_TX_QUEUE_SIZE      (4)
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+typedef struct {
+    uint8_t psdu[OT_RADIO_FRAME_MAX_SIZE];
+    uint8_t length;
+    uint8_t tag;                // non zero if the outcome is needed, see lora_ot_tx_result()
+} ot_radio_tx_slot_t;
+
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
@@ -85,6 +98,12 @@ static uint16_t sPanid;
 static bool sPromiscuous = false;
 static bool sAckWait = false;
 
+static ot_radio_tx_slot_t sTxQueue[OT_RADIO_TX_QUEUE_SIZE];
+static uint8_t sTxQueueHead = 0;
+static uint8_t sTxQueueCount = 0;
+static uint8_t sTxTag = 0;      // frame of sTransmitFrame waiting for its ack
+static uint8_t sTxNextTag = 0;
+
 static uint8_t sShortAddressMatchTableCount = 0;
 static uint8_t sExtAddressMatchTableCount = 0;
 static uint16_t sShortAddressMatchTable[POSIX_MAX_SRC_MATCH_ENTRIES];
@@ -96,7 +115,8 @@ static int8_t txPower = 14; //dBm
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
-static void radioTransmit(const struct otRadioFrame *pkt);
+static bool radioTransmit(const struct otRadioFrame *pkt, uint8_t tag);
+static void radioFlushQueue(void);
 static void radioSendMessage(otInstance *aInstance);
 static void radioSendAck(void);
 static void radioProcessFrame(otInstance *aInstance);
@@ -598,7 +618,8 @@ int8_t otPlatRadioGetRssi(otInstance *aInstance) {
 otRadioCaps otPlatRadioGetCaps(otInstance *aInstance) {
     (void) aInstance;
 
-    otRadioCaps caps = OT_RADIO_CAPS_NONE;
+    // listen-before-talk with a random backoff is done by the LoRa task
+    otRadioCaps caps = OT_RADIO_CAPS_CSMA_BACKOFF;
 //    OT_RADIO_CAPS_NONE             = 0, ///< None
 //    OT_RADIO_CAPS_ACK_TIMEOUT      = 1, ///< Radio supports AckTime event
 //    OT_RADIO_CAPS_ENERGY_SCAN      = 2, ///< Radio supports Energy Scans
@@ -745,15 +766,31 @@ int8_t otPlatRadioGetReceiveSensitivity(otInstance *aInstance) {
     return sensitivity;
 }
 
-// process function to be called from CPU scheduler periodically
+// a frame waits to be queued, otRadioProcess() has to run again without waiting for an event.
+// Frames already queued wait for the end of a transmission, which wakes the Mesh task up.
+bool otRadioIsPending(void) {
+    return sState == OT_RADIO_STATE_TRANSMIT && !sAckWait && sTxQueueCount < OT_RADIO_TX_QUEUE_SIZE;
+}
+
+// process function to be called by the Mesh task when woken up
 void otRadioProcess(otInstance *aInstance) {
     if (sState != OT_RADIO_STATE_DISABLED) {
 
         radioReceive(aInstance);
 
+        // listen-before-talk gave up on the frame, there's no point waiting for its ack
+        if (sAckWait && lora_ot_tx_result(sTxTag) == LORA_OT_TX_FAILED) {
+            otPlatLog(OT_LOG_LEVEL_DEBG, 0, "TX busy");
+            sAckWait = false;
+            sState = OT_RADIO_STATE_RECEIVE;
+            otPlatRadioTxDone(aInstance, &sTransmitFrame, NULL, OT_ERROR_CHANNEL_ACCESS_FAILURE);
+        }
+
         if (sState == OT_RADIO_STATE_TRANSMIT && !sAckWait) {
             radioSendMessage(aInstance);
         }
+
+        radioFlushQueue();
     }
 }
 
@@ -919,42 +956,43 @@ static inline void getExtAddress(const uint8_t *frame, otExtAddress *address) {
     }
 }
 
+// takes every frame received since the last call, the radio keeps them in order
 void radioReceive(otInstance *aInstance) {
-    bool    isAck;
-    ssize_t rval = lora_ot_recv(sReceiveFrame.mPsdu,
-            &(sReceiveFrame.mInfo.mRxInfo.mRssi));
-    if (rval <= 0)
-        return;
+    bool     isAck;
+    int      rval;
+    uint32_t timestamp;
 
-    if (otPlatRadioGetPromiscuous(aInstance)) {
-        // Timestamp
-        sReceiveFrame.mInfo.mRxInfo.mMsec = otPlatAlarmMilliGetNow();
-        sReceiveFrame.mInfo.mRxInfo.mUsec = 0; // Don't support microsecond timer for now.
-    }
+    while ((rval = lora_ot_recv(sReceiveFrame.mPsdu, &(sReceiveFrame.mInfo.mRxInfo.mRssi), &timestamp)) > 0) {
+
+        // the frame ended when DIO0 rose, not when the Mesh task got to it
+        uint32_t age_us = (uint32_t)mp_hal_ticks_us_non_blocking() - timestamp;
+        uint64_t rx_us = (uint64_t)otPlatAlarmMilliGetNow() * 1000 - age_us;
+        sReceiveFrame.mInfo.mRxInfo.mMsec = (uint32_t)(rx_us / 1000);
+        sReceiveFrame.mInfo.mRxInfo.mUsec = (uint16_t)(rx_us % 1000);
 
 #if OPENTHREAD_CONFIG_ENABLE_TIME_SYNC
-    sReceiveFrame.mIeInfo->mTimestamp = otPlatTimeGet();
+        sReceiveFrame.mIeInfo->mTimestamp = otPlatTimeGet() - age_us;
 #endif
 
-    sReceiveFrame.mLength = rval;
+        sReceiveFrame.mLength = rval;
 
-    isAck = isFrameTypeAck(sReceiveFrame.mPsdu);
+        isAck = isFrameTypeAck(sReceiveFrame.mPsdu);
 
-    if (sAckWait && sTransmitFrame.mChannel == sReceiveFrame.mChannel && isAck
-            && getDsn(sReceiveFrame.mPsdu) == getDsn(sTransmitFrame.mPsdu)) {
-        otPlatLog(OT_LOG_LEVEL_DEBG, 0, "ACK RX");
-        sState = OT_RADIO_STATE_RECEIVE;
-        sAckWait = false;
+        if (sAckWait && sTransmitFrame.mChannel == sReceiveFrame.mChannel && isAck
+                && getDsn(sReceiveFrame.mPsdu) == getDsn(sTransmitFrame.mPsdu)) {
+            otPlatLog(OT_LOG_LEVEL_DEBG, 0, "ACK RX");
+            sState = OT_RADIO_STATE_RECEIVE;
+            sAckWait = false;
 
-        otPlatRadioTxDone(aInstance, &sTransmitFrame, &sReceiveFrame,
-                OT_ERROR_NONE);
-    } else if ((sState == OT_RADIO_STATE_RECEIVE
-            || sState == OT_RADIO_STATE_TRANSMIT)
-            //&& (sReceiveFrame.mChannel == sReceiveMessage.mChannel)
-            && (!isAck || sPromiscuous)) {
-        radioProcessFrame(aInstance);
+            otPlatRadioTxDone(aInstance, &sTransmitFrame, &sReceiveFrame,
+                    OT_ERROR_NONE);
+        } else if ((sState == OT_RADIO_STATE_RECEIVE
+                || sState == OT_RADIO_STATE_TRANSMIT)
+                //&& (sReceiveFrame.mChannel == sReceiveMessage.mChannel)
+                && (!isAck || sPromiscuous)) {
+            radioProcessFrame(aInstance);
+        }
     }
-
 }
 
 void radioSendMessage(otInstance *aInstance) {
@@ -988,10 +1026,22 @@ void radioSendMessage(otInstance *aInstance) {
 
     //sTransmitMessage.mChannel = sTransmitFrame.mChannel;
 
+    // the outcome of the frame is only needed while waiting for its ack
+    uint8_t tag = 0;
+    if (isAckRequested(sTransmitFrame.mPsdu)) {
+        if (++sTxNextTag == 0) {
+            sTxNextTag = 1;
+        }
+        tag = sTxNextTag;
+    }
+    if (!radioTransmit(&sTransmitFrame, tag)) {
+        // the queue is full, tried again when a transmission ends
+        return;
+    }
     otPlatRadioTxStarted(aInstance, &sTransmitFrame);
-    radioTransmit(&sTransmitFrame);
 
-    sAckWait = isAckRequested(sTransmitFrame.mPsdu);
+    sTxTag = tag;
+    sAckWait = (tag != 0);
 
     if (!sAckWait) {
         otPlatLog(OT_LOG_LEVEL_DEBG, 0, "ACK no req");
@@ -1012,9 +1062,30 @@ void radioSendMessage(otInstance *aInstance) {
         otPlatLog(OT_LOG_LEVEL_DEBG, 0, "ACK req");
 }
 
-//void radioTransmit(struct RadioMessage *aMessage, const struct otRadioFrame *aFrame)
-void radioTransmit(const struct otRadioFrame *aFrame) {
-    lora_ot_send(aFrame->mPsdu, aFrame->mLength);
+// the frame is copied, so OpenThread can prepare the next one while this one waits for the channel
+bool radioTransmit(const struct otRadioFrame *aFrame, uint8_t tag) {
+    if (sTxQueueCount >= OT_RADIO_TX_QUEUE_SIZE) {
+        return false;
+    }
+    ot_radio_tx_slot_t *slot = &sTxQueue[(sTxQueueHead + sTxQueueCount) % OT_RADIO_TX_QUEUE_SIZE];
+    memcpy(slot->psdu, aFrame->mPsdu, aFrame->mLength);
+    slot->length = aFrame->mLength;
+    slot->tag = tag;
+    sTxQueueCount++;
+    radioFlushQueue();
+    return true;
+}
+
+// hands the queued frames to the LoRa task, as many as it has room for
+void radioFlushQueue(void) {
+    while (sTxQueueCount > 0) {
+        ot_radio_tx_slot_t *slot = &sTxQueue[sTxQueueHead];
+        if (!lora_ot_send(slot->psdu, slot->length, slot->tag)) {
+            break;
+        }
+        sTxQueueHead = (sTxQueueHead + 1) % OT_RADIO_TX_QUEUE_SIZE;
+        sTxQueueCount--;
+    }
 }
 
 void radioSendAck(void) {
@@ -1030,7 +1101,8 @@ void radioSendAck(void) {
 
     sAckFrame.mChannel = sReceiveFrame.mChannel;
 
-    radioTransmit(&sAckFrame);
+    // dropped if the queue is full, the sender will try again
+    radioTransmit(&sAckFrame, 0);
 }
 
 void radioProcessFrame(otInstance *aInstance) {
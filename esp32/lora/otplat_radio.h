@@ -55,4 +55,6 @@ void otPlatRadioInit(void);
 
 void otRadioProcess(otInstance *aInstance);
 
+bool otRadioIsPending(void);
+
 #endif /* LORA_OTPLAT_RADIO_H_ */
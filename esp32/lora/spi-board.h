@@ -31,6 +31,8 @@ Maintainer: Miguel Luis and Gregory Cristian
 
 #include "lora/system/gpio.h"
 
+#define SPI_BOARD_BUF_SIZE          64  // size of the SPI data buffer (W0-W15)
+
 /*!
  * SPI driver structure definition
  */
@@ -43,36 +43,20 @@ Maintainer: Miguel Luis and Gregory Cristian
 #define HW_TIMER_TIME_BASE                              1 // ms
 
 /*!
- * Hardware Timer tick counter
+ * Saved value of the hardware counter at the start of the next event
  */
-DRAM_ATTR volatile TimerTime_t TimerTickCounter = 1;
-
-/*!
- * Saved value of the Tick counter at the start of the next event
- */
-static TimerTime_t TimerTickCounterContext = 0;
-
-/*!
- * Value trigging the IRQ
- */
-DRAM_ATTR volatile TimerTime_t TimeoutCntValue = 0;
-
-static IRAM_ATTR void TimerCallback (void) {
-    TimerTickCounter++;
-    if (TimeoutCntValue > 0 && TimerTickCounter == TimeoutCntValue) {
-        TimerIrqHandler();
-    }
-}
+static uint64_t TimerTimeContextUs = 0;
 
 void TimerHwInit( void ) {
     uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
-    HAL_set_tick_cb(TimerCallback);
+    HAL_set_alarm_cb(TimerIrqHandler);
     MICROPY_END_ATOMIC_SECTION(ilevel);
 }
 
 void TimerHwDeInit( void ) {
     uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
-    HAL_set_tick_cb(NULL);
+    HAL_clear_alarm();
+    HAL_set_alarm_cb(NULL);
     MICROPY_END_ATOMIC_SECTION(ilevel);
 }
 
@@ -80,19 +64,23 @@ IRAM_ATTR uint32_t TimerHwGetMinimumTimeout( void ) {
     return HW_TIMER_TIME_BASE;
 }
 
-IRAM_ATTR void TimerHwStart (uint32_t val) {
+IRAM_ATTR uint64_t TimerHwGetTimeUs( void ) {
+    return HAL_get_timer_us();
+}
+
+IRAM_ATTR void TimerHwStartAt( uint64_t deadline ) {
     uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
-    TimerTickCounterContext = TimerHwGetTimerValue();
-    if (val <= HW_TIMER_TIME_BASE) {
-        TimeoutCntValue = TimerTickCounterContext + (HW_TIMER_TIME_BASE * 2);
-    } else {
-        TimeoutCntValue = TimerTickCounterContext + val;
-    }
+    TimerTimeContextUs = HAL_get_timer_us();
+    HAL_set_alarm_us(deadline);
     MICROPY_END_ATOMIC_SECTION(ilevel);
 }
 
-void IRAM_ATTR TimerHwStop( void ) {
+IRAM_ATTR void TimerHwStart (uint32_t val) {
+    TimerHwStartAt(HAL_get_timer_us() + ((uint64_t)val * 1000));
+}
 
+void IRAM_ATTR TimerHwStop( void ) {
+    HAL_clear_alarm();
 }
 
 void TimerHwDelayMs( uint32_t delay ) {
@@ -100,10 +88,7 @@ void TimerHwDelayMs( uint32_t delay ) {
 }
 
 IRAM_ATTR TimerTime_t TimerHwGetTimerValue (void) {
-    uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
-    TimerTime_t val = TimerTickCounter;
-    MICROPY_END_ATOMIC_SECTION(ilevel);
-    return (val);
+    return (TimerTime_t)(HAL_get_timer_us() / 1000);
 }
 
 IRAM_ATTR TimerTime_t TimerHwGetTime( void ) {
@@ -111,18 +96,12 @@ IRAM_ATTR TimerTime_t TimerHwGetTime( void ) {
 }
 
 IRAM_ATTR TimerTime_t TimerHwGetElapsedTime (void) {
-     return (((TimerHwGetTimerValue() - TimerTickCounterContext) + 1) * HW_TIMER_TIME_BASE);
+     return (TimerTime_t)((HAL_get_timer_us() - TimerTimeContextUs) / 1000);
 }
 
 IRAM_ATTR TimerTime_t TimerHwComputeTimeDifference( TimerTime_t eventInTime ) {
-    TimerTime_t currTime = TimerHwGetTime();
-
-    if (eventInTime <= currTime) {
-        return currTime - eventInTime;
-    } else {
-        // roll over of the counter
-        return( currTime + (0xFFFFFFFF - eventInTime));
-    }
+    // unsigned arithmetic also covers the roll over of the counter
+    return TimerHwGetTime() - eventInTime;
 }
 
 void TimerHwEnterLowPowerStopMode( void ) {
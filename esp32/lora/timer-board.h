@@ -63,6 +63,18 @@ uint32_t TimerHwGetMinimumTimeout( void );
  */
 void TimerHwStart( uint32_t val );
 
+/*!
+ * \brief Return the free running hardware counter in microseconds
+ */
+uint64_t TimerHwGetTimeUs( void );
+
+/*!
+ * \brief Program the hardware alarm at an absolute time
+ *
+ * \param [IN] deadline Counter value in microseconds, see TimerHwGetTimeUs
+ */
+void TimerHwStartAt( uint64_t deadline );
+
 /*!
  * \brief Stop the the Standard Timer counter
  */
@@ -10,6 +10,7 @@
 #include <string.h>
 #include "py/mpconfig.h"
 #include "py/obj.h"
+#include "py/mpthread.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_system.h"
@@ -21,6 +22,8 @@
 #include "netif/ppp/pppos.h"
 #include "netif/ppp/ppp.h"
 #include "netif/ppp/pppapi.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcpip.h"
 
 #include "machpin.h"
 #include "lteppp.h"
@@ -30,13 +33,16 @@
 #include "lwip/dns.h"
 #include "modlte.h"
 #include "str_utils.h"
+#include "mptrace.h"
+#include "mpenergy.h"
 
 /******************************************************************************
  DEFINE CONSTANTS
  ******************************************************************************/
 
-#define LTE_TRX_WAIT_MS(len)                                    (((len + 1) * 12 * 1000) / MICROPY_LTE_UART_BAUDRATE)
+#define LTE_TRX_WAIT_MS(len)                                    (((len + 1) * 12 * 1000) / lteppp_uart_baudrate)
 #define LTE_TASK_PERIOD_MS                                      (2)
+#define LTE_TASK_PPP_IDLE_MS                                    (20)
 #define LTE_AT_CMD_TRIALS                                       (5)
 
 /******************************************************************************
@@ -58,6 +64,9 @@ SemaphoreHandle_t xLTE_modem_Conn_Sem;
  DECLARE PRIVATE DATA
  ******************************************************************************/
 static char lteppp_trx_buffer[LTE_UART_BUFFER_SIZE + 1];
+static uint32_t lteppp_uart_baudrate = MICROPY_LTE_UART_BAUDRATE;
+// rates the modem UART can be switched to with AT+IPR, probed in this order
+static const uint32_t lteppp_uart_baudrates[] = { 3686400, 3000000, 1843200, 2000000, 1000000, 460800 };
 #ifdef LTE_DEBUG_BUFF
 static lte_log_t lteppp_log;
 #endif
@@ -99,6 +108,10 @@ static QueueHandle_t uart0_queue = NULL;
 
 static bool lte_uart_break_evt = false;
 
+// given by the UART event task when data arrives and by the command path, so
+// TASK_LTE doesn't have to poll the UART while in PPP mode
+static SemaphoreHandle_t xLTEWakeSem = NULL;
+
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
@@ -109,6 +122,12 @@ static bool lteppp_send_at_cmd(const char *cmd, uint32_t timeout);
 static bool lteppp_check_sim_present(void);
 static void lteppp_status_cb (ppp_pcb *pcb, int err_code, void *ctx);
 static uint32_t lteppp_output_callback(ppp_pcb *pcb, u8_t *data, u32_t len, void *ctx);
+static void lteppp_ppp_input(void);
+static bool lteppp_probe_uart_baudrate(void);
+static int lteppp_uart_read(uint8_t *buf, uint32_t len, TickType_t wait, bool from_mp);
+static bool lteppp_line_is(const char *line, uint32_t len, const char *str);
+static bool lteppp_parse_rsp_lines(uint32_t *line_start, uint32_t len_count);
+static uint32_t lteppp_trace_tag(const char *cmd, size_t len);
 #ifdef LTEPPP_DEBUG
 static void lteppp_print_states();
 #endif
@@ -127,7 +146,7 @@ void connect_lte_uart (void) {
     config.parity = UART_PARITY_DISABLE;
     config.stop_bits = UART_STOP_BITS_1;
     config.flow_ctrl = UART_HW_FLOWCTRL_CTS_RTS;
-    config.rx_flow_ctrl_thresh = 64;
+    config.rx_flow_ctrl_thresh = LTE_UART_FLOW_CTRL_THRESH;
     config.use_ref_tick = false;
     uart_param_config(LTE_UART_ID, &config);
 
@@ -142,7 +161,7 @@ void connect_lte_uart (void) {
     uart_set_hw_flow_ctrl(LTE_UART_ID, UART_HW_FLOWCTRL_DISABLE, 0);
 
     // install the UART driver
-    uart_driver_install(LTE_UART_ID, LTE_UART_BUFFER_SIZE, LTE_UART_BUFFER_SIZE, 1, &uart0_queue, 0, NULL);
+    uart_driver_install(LTE_UART_ID, LTE_UART_RX_BUFFER_SIZE, LTE_UART_TX_BUFFER_SIZE, LTE_UART_EVT_QUEUE_SIZE, &uart0_queue, 0, NULL);
     lteppp_uart_reg = &UART2;
 
     // disable the delay between transfers
@@ -169,6 +188,7 @@ void lteppp_init(void) {
         xRxQueue = xQueueCreate(LTE_RSP_QUEUE_SIZE_MAX, LTE_AT_RSP_SIZE_MAX + 1);
 
         xLTESem = xSemaphoreCreateMutex();
+        xLTEWakeSem = xSemaphoreCreateBinary();
         xLTE_modem_Conn_Sem = xSemaphoreCreateMutex();
 
         lteppp_pcb = pppapi_pppos_create(&lteppp_netif, lteppp_output_callback, lteppp_status_cb, NULL);
@@ -187,7 +207,7 @@ void lteppp_init(void) {
 }
 
 void lteppp_start (void) {
-    uart_set_hw_flow_ctrl(LTE_UART_ID, UART_HW_FLOWCTRL_CTS_RTS, 64);
+    uart_set_hw_flow_ctrl(LTE_UART_ID, UART_HW_FLOWCTRL_CTS_RTS, LTE_UART_FLOW_CTRL_THRESH);
     vTaskDelay(5);
 }
 
@@ -235,6 +255,8 @@ void lteppp_set_state(lte_state_t state) {
     xSemaphoreTake(xLTESem, portMAX_DELAY);
     lteppp_lte_state = state;
     xSemaphoreGive(xLTESem);
+    // the radio of the modem is on from the attach to the detach, suspended PPP included
+    mpenergy_set(MPENERGY_RAIL_LTE, state >= E_LTE_ATTACHING);
 }
 
 void lteppp_set_default_inf(void)
@@ -253,6 +275,9 @@ void lteppp_set_legacy(lte_legacy_t legacy) {
 
 void lteppp_connect (void) {
     MSG("\n");
+    // the address of a suspended session is stale, lteppp_status_cb() sets it again once PPP is up
+    lte_ipv4addr = 0;
+    memset(lte_ipv6addr.addr, 0, sizeof(lte_ipv6addr.addr));
     uart_flush(LTE_UART_ID);
     vTaskDelay(25);
     pppapi_set_default(lteppp_pcb);
@@ -273,6 +298,7 @@ void lteppp_disconnect(void) {
 
 void lteppp_send_at_command (lte_task_cmd_data_t *cmd, lte_task_rsp_data_t *rsp) {
     xQueueSend(xCmdQueue, (void *)cmd, (TickType_t)portMAX_DELAY);
+    xSemaphoreGive(xLTEWakeSem);
 
     if(!cmd->expect_continuation)
         xQueueReceive(xRxQueue, rsp, (TickType_t)portMAX_DELAY);
@@ -280,113 +306,64 @@ void lteppp_send_at_command (lte_task_cmd_data_t *cmd, lte_task_rsp_data_t *rsp)
 
 bool lteppp_wait_at_rsp (const char *expected_rsp, uint32_t timeout, bool from_mp, void* data_rem) {
 
-    uint32_t rx_len = 0;
-    uint32_t timeout_cnt = timeout;
-    // wait until characters start arriving
-    do {
-        // being called from the MicroPython interpreter
-        if (from_mp) {
-            mp_hal_delay_ms(1);
-        }
-        else {
-            vTaskDelay(1 / portTICK_RATE_MS);
-        }
-        uart_get_buffered_data_len(LTE_UART_ID, &rx_len);
-        if (timeout_cnt > 0) {
-            timeout_cnt--;
-        }
-    } while ((timeout_cnt > 0 || timeout == 0) && 0 == rx_len);
+    uint32_t rx_len;
+    uint32_t len_count = 0;
+    uint32_t line_start = 0;
+    bool final_rsp = false;
+    // wait until characters start arriving, then only for the rest of the response
+    TickType_t wait = (timeout > 0) ? (timeout / portTICK_RATE_MS) : portMAX_DELAY;
 
     memset(lteppp_trx_buffer, 0, LTE_UART_BUFFER_SIZE);
-    uint16_t len_count = 0;
 
-    while (rx_len > 0) {
-        if (len_count == 0) {
-            // try to read up to the size of the buffer minus null terminator (minus 2 because we store the OK status in the last byte)
-            rx_len = uart_read_bytes(LTE_UART_ID, (uint8_t *)lteppp_trx_buffer, LTE_UART_BUFFER_SIZE - 2, LTE_TRX_WAIT_MS(LTE_UART_BUFFER_SIZE) / portTICK_RATE_MS);
+    // read up to the size of the buffer minus null terminator (minus 2 because we store the OK status in the last byte)
+    while (!final_rsp && len_count < LTE_UART_BUFFER_SIZE - 2) {
+        uart_get_buffered_data_len(LTE_UART_ID, &rx_len);
+        if (rx_len > 0) {
+            rx_len = MIN(rx_len, LTE_UART_BUFFER_SIZE - 2 - len_count);
+            rx_len = lteppp_uart_read((uint8_t *)&lteppp_trx_buffer[len_count], rx_len, 0, from_mp);
+        } else {
+            rx_len = lteppp_uart_read((uint8_t *)&lteppp_trx_buffer[len_count], 1, wait, from_mp);
         }
-        else
-        {
-            // try to read up to the size of the buffer minus null terminator (minus 2 because we store the OK status in the last byte)
-            rx_len = uart_read_bytes(LTE_UART_ID, (uint8_t *)(&(lteppp_trx_buffer[len_count])), LTE_UART_BUFFER_SIZE - len_count - 2, LTE_TRX_WAIT_MS(LTE_UART_BUFFER_SIZE) / portTICK_RATE_MS);
+        if ((int)rx_len <= 0) {
+            break;
         }
-        len_count += rx_len;
-
-        if (rx_len > 0) {
-            // NULL terminate the string
-            lteppp_trx_buffer[len_count] = '\0';
 #ifdef LTE_DEBUG_BUFF
-            if (lteppp_log.ptr < LTE_LOG_BUFF_SIZE - rx_len) {
-                if (len_count == rx_len) {
-                    memcpy(&(lteppp_log.log[lteppp_log.ptr]), "[RSP]: ", strlen("[RSP]: "));
-                    lteppp_log.ptr += strlen("[RSP]: ");
-                }
-                memcpy(&(lteppp_log.log[lteppp_log.ptr]), lteppp_trx_buffer, rx_len);
-                lteppp_log.ptr += rx_len;
-                lteppp_log.log[lteppp_log.ptr] = '\n';
-                lteppp_log.ptr++;
-            }
-            else
-            {
-                lteppp_log.ptr = 0;
-                lteppp_log.truncated = true;
-            }
-#endif
-
-            if (expected_rsp != NULL) {
-                if (strstr(lteppp_trx_buffer, expected_rsp) != NULL) {
-                    //printf("RESP: %s\n", lteppp_trx_buffer);
-                    return true;
-                }
-            }
-
-            uart_get_buffered_data_len(LTE_UART_ID, &rx_len);
-
-            if((len_count + rx_len) >= (LTE_UART_BUFFER_SIZE - 2))
-            {
-                if (data_rem != NULL) {
-                    *((bool *)data_rem) = true;
-                    return true;
-                }
-            }
-            else if(rx_len == 0)
-            {
-                uint8_t timeout_buff = 10;
-                while((!strstr(lteppp_trx_buffer,"\r\nOK\r\n")) && (!strstr(lteppp_trx_buffer,"\r\nERROR\r\n")) && (!strstr(lteppp_trx_buffer,"+SYSSTART")) && (!strstr(lteppp_trx_buffer,"\r\nCONNECT\r\n")) &&
-                        rx_len == 0 && timeout_buff > 0)
-                {
-#ifdef LTE_DEBUG_BUFF
-                    memcpy(&(lteppp_log.log[lteppp_log.ptr]), "[Waiting]:\n", strlen("[Waiting]:\n"));
-                    lteppp_log.ptr += strlen("[Waiting]:\n");
-#endif
-
-                    uart_get_buffered_data_len(LTE_UART_ID, &rx_len);
-
-                    if (from_mp) {
-                        mp_hal_delay_ms(100);
-                    }
-                    else {
-                        vTaskDelay(100 / portTICK_RATE_MS);
-                    }
-                    timeout_buff--;
-                }
-                //check size again
-                if((len_count + rx_len) >= (LTE_UART_BUFFER_SIZE - 2))
-                {
-                    if (data_rem != NULL) {
-                        *((bool *)data_rem) = true;
-                        return true;
-                    }
-                }
+        if (lteppp_log.ptr < LTE_LOG_BUFF_SIZE - rx_len - strlen("[RSP]: ") - 1) {
+            if (len_count == 0) {
+                memcpy(&(lteppp_log.log[lteppp_log.ptr]), "[RSP]: ", strlen("[RSP]: "));
+                lteppp_log.ptr += strlen("[RSP]: ");
             }
+            memcpy(&(lteppp_log.log[lteppp_log.ptr]), &lteppp_trx_buffer[len_count], rx_len);
+            lteppp_log.ptr += rx_len;
+            lteppp_log.log[lteppp_log.ptr] = '\n';
+            lteppp_log.ptr++;
         }
         else
         {
-            // Do Nothing
+            lteppp_log.ptr = 0;
+            lteppp_log.truncated = true;
+        }
+#endif
+        len_count += rx_len;
+        // NULL terminate the string
+        lteppp_trx_buffer[len_count] = '\0';
+        wait = LTE_AT_RSP_IDLE_MS / portTICK_RATE_MS;
+
+        if (expected_rsp != NULL && strstr(lteppp_trx_buffer, expected_rsp) != NULL) {
+            MPTRACE(MPTRACE_LTE_AT_RSP, len_count, true);
+            return true;
+        }
+        final_rsp = lteppp_parse_rsp_lines(&line_start, len_count);
+        // the data prompt of AT+SQNSSENDEXT has no line end, don't wait for the idle time after it
+        if (!final_rsp && len_count - line_start == 2 && lteppp_line_is(&lteppp_trx_buffer[line_start], 2, "> ")) {
+            final_rsp = true;
         }
     }
+    MPTRACE(MPTRACE_LTE_AT_RSP, len_count, final_rsp);
     if (data_rem != NULL) {
-        *((bool *)data_rem) = false;
+        // the caller fetches the rest with the next command
+        *((bool *)data_rem) = !final_rsp && len_count >= LTE_UART_BUFFER_SIZE - 2;
+        return *((bool *)data_rem);
     }
     return false;
 }
@@ -419,9 +396,32 @@ void lteppp_deinit (void) {
     lteppp_lte_state = E_LTE_INIT;
     lteppp_modem_conn_state = E_LTE_MODEM_DISCONNECTED;
 	xSemaphoreGive(xLTESem);
+    mpenergy_set(MPENERGY_RAIL_LTE, false);
     MSG("done\n");
 }
 
+void lteppp_set_uart_baudrate(uint32_t baudrate) {
+    uart_wait_tx_done(LTE_UART_ID, LTE_TRX_WAIT_MS(LTE_UART_BUFFER_SIZE) / portTICK_RATE_MS);
+    uart_set_baudrate(LTE_UART_ID, baudrate);
+    lteppp_uart_baudrate = baudrate;
+}
+
+uint32_t lteppp_get_uart_baudrate(void) {
+    return lteppp_uart_baudrate;
+}
+
+bool lteppp_uart_baudrate_supported(uint32_t baudrate) {
+    if (baudrate == MICROPY_LTE_UART_BAUDRATE) {
+        return true;
+    }
+    for (size_t i = 0; i < MP_ARRAY_SIZE(lteppp_uart_baudrates); i++) {
+        if (lteppp_uart_baudrates[i] == baudrate) {
+            return true;
+        }
+    }
+    return false;
+}
+
 uint32_t lteppp_ipv4(void) {
     return lte_ipv4addr;
 }
@@ -455,12 +455,74 @@ bool trx_is_ok_or_error(){
     return false;
 }
 
+// blocking UART read which gives the GIL away when called from the interpreter
+static int lteppp_uart_read(uint8_t *buf, uint32_t len, TickType_t wait, bool from_mp) {
+    int rx_len;
+    if (from_mp) {
+        MP_THREAD_GIL_EXIT();
+    }
+    rx_len = uart_read_bytes(LTE_UART_ID, buf, len, wait);
+    if (from_mp) {
+        MP_THREAD_GIL_ENTER();
+    }
+    return rx_len;
+}
+
+// the first characters after "AT", enough to tell the commands apart in the trace
+static uint32_t lteppp_trace_tag(const char *cmd, size_t len) {
+    uint32_t tag = 0;
+    if (len >= 2 && cmd[0] == 'A' && cmd[1] == 'T') {
+        cmd += 2;
+        len -= 2;
+    }
+    memcpy(&tag, cmd, MIN(len, sizeof(tag)));
+    return tag;
+}
+
+static bool lteppp_line_is(const char *line, uint32_t len, const char *str) {
+    size_t str_len = strlen(str);
+    return len >= str_len && !memcmp(line, str, str_len);
+}
+
+/** go through the response lines completed since the last call, report the URCs
+ * and return true once a final result code has been received
+ */
+static bool lteppp_parse_rsp_lines(uint32_t *line_start, uint32_t len_count) {
+    bool final_rsp = false;
+    for (uint32_t i = *line_start; i < len_count; i++) {
+        if (lteppp_trx_buffer[i] != '\n') {
+            continue;
+        }
+        const char *line = &lteppp_trx_buffer[*line_start];
+        uint32_t len = i - *line_start;
+        if (len > 0 && line[len - 1] == '\r') {
+            len--;
+        }
+        *line_start = i + 1;
+
+        if ((len == 2 && lteppp_line_is(line, len, "OK")) ||
+            (len == 5 && lteppp_line_is(line, len, "ERROR")) ||
+            lteppp_line_is(line, len, "+CME ERROR") ||
+            lteppp_line_is(line, len, "+CMS ERROR") ||
+            lteppp_line_is(line, len, "CONNECT") ||
+            lteppp_line_is(line, len, "NO CARRIER") ||
+            lteppp_line_is(line, len, "+SYSSTART")) {
+            final_rsp = true;
+        } else if (len == strlen("+CEREG: 4") && lteppp_line_is(line, len, "+CEREG: 4")) {
+            // the URC only carries <stat>, the reply to AT+CEREG? has <n>,<stat>
+            MSG("CEREG 4, trigger callback\n");
+            modlte_urc_events(LTE_EVENT_COVERAGE_LOST);
+        }
+    }
+    return final_rsp;
+}
+
 /** check whether modem is responding at 115200
  * this means it is in FFH or RECOVYER mode
  */
 bool lteppp_check_ffh_mode(){
-    uart_set_baudrate(LTE_UART_ID, 115200);
-    uart_set_hw_flow_ctrl(LTE_UART_ID, UART_HW_FLOWCTRL_CTS_RTS, 64);
+    lteppp_set_uart_baudrate(115200);
+    uart_set_hw_flow_ctrl(LTE_UART_ID, UART_HW_FLOWCTRL_CTS_RTS, LTE_UART_FLOW_CTRL_THRESH);
     uart_set_rts(LTE_UART_ID, true);
 
     for ( uint8_t attempt = 0 ; attempt < 3 ; attempt++ ){
@@ -473,12 +535,36 @@ bool lteppp_check_ffh_mode(){
     return false;
 }
 
+/** check whether the modem was left at one of the higher rates negotiated with
+ * LTE(uart_baudrate=...), and if so switch it back to the default one
+ */
+static bool lteppp_probe_uart_baudrate(void) {
+    char at_cmd[20];
+    for (size_t i = 0; i < MP_ARRAY_SIZE(lteppp_uart_baudrates); i++) {
+        if (lteppp_uart_baudrates[i] == MICROPY_LTE_UART_BAUDRATE) {
+            continue;
+        }
+        lteppp_set_uart_baudrate(lteppp_uart_baudrates[i]);
+        if (lteppp_send_at_cmd("AT", LTE_RX_TIMEOUT_MIN_MS)) {
+            MSG("modem found at %u\n", lteppp_uart_baudrates[i]);
+            snprintf(at_cmd, sizeof(at_cmd), "AT+IPR=%u", MICROPY_LTE_UART_BAUDRATE);
+            lteppp_send_at_cmd(at_cmd, LTE_RX_TIMEOUT_MIN_MS);
+            lteppp_set_uart_baudrate(MICROPY_LTE_UART_BAUDRATE);
+            vTaskDelay(LTE_UART_BAUDRATE_SETTLE_MS / portTICK_RATE_MS);
+            return true;
+        }
+    }
+    lteppp_set_uart_baudrate(MICROPY_LTE_UART_BAUDRATE);
+    return false;
+}
+
 static void TASK_LTE (void *pvParameters) {
     MSG("\n");
     bool sim_present;
     lte_task_cmd_data_t *lte_task_cmd = (lte_task_cmd_data_t *)lteppp_trx_buffer;
     lte_task_rsp_data_t *lte_task_rsp = (lte_task_rsp_data_t *)lteppp_trx_buffer;
     uint8_t at_trials = 0;
+    bool baudrate_probed;
     static uint32_t thread_notification;
 
     connect_lte_uart();
@@ -492,9 +578,12 @@ modem_init:
         MSG("notif\n");
         xSemaphoreTake(xLTE_modem_Conn_Sem, portMAX_DELAY);
         lteppp_set_modem_conn_state(E_LTE_MODEM_CONNECTING);
+        // always start at the default rate, the modem is probed for others if it doesn't answer
+        lteppp_set_uart_baudrate(MICROPY_LTE_UART_BAUDRATE);
+        baudrate_probed = false;
         uart_set_rts(LTE_UART_ID, true);
         vTaskDelay(500/portTICK_PERIOD_MS);
-        uart_set_hw_flow_ctrl(LTE_UART_ID, UART_HW_FLOWCTRL_CTS_RTS, 64);
+        uart_set_hw_flow_ctrl(LTE_UART_ID, UART_HW_FLOWCTRL_CTS_RTS, LTE_UART_FLOW_CTRL_THRESH);
         // exit PPP session if applicable
         if(lteppp_send_at_cmd("+++", LTE_PPP_BACK_OFF_TIME_MS))
         {
@@ -539,10 +628,17 @@ modem_init:
                     while(!lteppp_send_at_cmd("AT", LTE_RX_TIMEOUT_MIN_MS))
                     {
                         if (at_trials >= LTE_AT_CMD_TRIALS) {
+                            if (!baudrate_probed) {
+                                baudrate_probed = true;
+                                if (lteppp_probe_uart_baudrate()) {
+                                    at_trials = 0;
+                                    continue;
+                                }
+                            }
                             if ( lteppp_check_ffh_mode() ){
                                 lteppp_set_modem_conn_state(E_LTE_MODEM_RECOVERY);
                             } else {
-                                uart_set_baudrate(LTE_UART_ID, MICROPY_LTE_UART_BAUDRATE);
+                                lteppp_set_uart_baudrate(MICROPY_LTE_UART_BAUDRATE);
                                 uart_set_hw_flow_ctrl(LTE_UART_ID, UART_HW_FLOWCTRL_DISABLE, 0);
                                 uart_set_rts(LTE_UART_ID, false);
                                 lteppp_set_modem_conn_state(E_LTE_MODEM_DISCONNECTED);
@@ -593,7 +689,12 @@ modem_init:
         MSG("forever\n");
         lte_state_t state;
         for (;;) {
-            vTaskDelay(LTE_TASK_PERIOD_MS);
+            if (lteppp_get_state() == E_LTE_PPP) {
+                // woken up as soon as data or a command arrives
+                xSemaphoreTake(xLTEWakeSem, LTE_TASK_PPP_IDLE_MS / portTICK_RATE_MS);
+            } else {
+                vTaskDelay(LTE_TASK_PERIOD_MS);
+            }
             if(lteppp_get_modem_conn_state() == E_LTE_MODEM_DISCONNECTED ){
                 // restart the task
                 goto modem_init;
@@ -614,7 +715,6 @@ modem_init:
             else
             {
                 if (state == E_LTE_PPP) {
-                    uint32_t rx_len;
                     // check for IP connection
                     if(lteppp_ipv4() > 0)
                     {
@@ -632,16 +732,7 @@ modem_init:
                         }
                         MSG("else, ppp, no ipv4 done\n");
                     }
-                    // wait for characters received
-                    uart_get_buffered_data_len(LTE_UART_ID, &rx_len);
-                    if (rx_len > 0) {
-                        // try to read up to the size of the buffer
-                        rx_len = uart_read_bytes(LTE_UART_ID, (uint8_t *)lteppp_trx_buffer, LTE_UART_BUFFER_SIZE,
-                                                 LTE_TRX_WAIT_MS(LTE_UART_BUFFER_SIZE) / portTICK_RATE_MS);
-                        if (rx_len > 0) {
-                            pppos_input_tcpip(lteppp_pcb, (uint8_t *)lteppp_trx_buffer, rx_len);
-                        }
-                    }
+                    lteppp_ppp_input();
                 }
                 else
                 {
@@ -664,7 +755,14 @@ static void TASK_UART_EVT (void *pvParameters) {
         if(xQueueReceive(uart0_queue, (void * )&event, (portTickType)portMAX_DELAY)) {
 
             switch(event.type) {
+                case UART_BUFFER_FULL:
+                case UART_FIFO_OVF:
+                    MSG("evt %u %u\n", event.type, event.size);
+                    // fall through, the ring has to be drained
                 case UART_DATA:
+                    if (E_LTE_PPP == lteppp_get_state()) {
+                        xSemaphoreGive(xLTEWakeSem);
+                    }
                 //     if (lte_uart_break_evt) {
 
                 //         uint32_t rx_len = uart_read_bytes(LTE_UART_ID, buff, LTE_UART_BUFFER_SIZE,
@@ -747,10 +845,13 @@ static bool lteppp_send_at_cmd_exp (const char *cmd, uint32_t timeout, const cha
         // flush the rx buffer first
         if(!expect_continuation || (len >= 2 && cmd[0] == 'A' && cmd[1] == 'T')) // starts with AT
         {
+            // the PPP frames still in the TX ring go first, "+++" also needs the line quiet before it
+            uart_wait_tx_done(LTE_UART_ID, LTE_TRX_WAIT_MS(LTE_UART_TX_BUFFER_SIZE) / portTICK_RATE_MS);
             uart_flush(LTE_UART_ID);
         }
         // uart_read_bytes(LTE_UART_ID, (uint8_t *)tmp_buf, sizeof(tmp_buf), 5 / portTICK_RATE_MS);
         // then send the command
+        MPTRACE(MPTRACE_LTE_AT_CMD, cmd_len, lteppp_trace_tag(cmd, cmd_len));
         uart_write_bytes(LTE_UART_ID, cmd, cmd_len);
 
         if(expect_continuation)
@@ -784,20 +885,61 @@ static bool lteppp_check_sim_present(void) {
     }
 }
 
+// runs in the tcpip thread, like pppos_input_tcpip() does with its own copy
+static void lteppp_ppp_input_cb (void *ctx) {
+    struct pbuf *p = (struct pbuf *)ctx;
+    pppos_input(lteppp_pcb, (u8_t *)p->payload, p->len);
+    pbuf_free(p);
+}
+
+static void lteppp_ppp_input(void) {
+    uint32_t rx_len;
+    uart_get_buffered_data_len(LTE_UART_ID, &rx_len);
+    if (rx_len == 0) {
+        return;
+    }
+    if (rx_len > LTE_PPP_RX_BATCH_SIZE_MAX) {
+        rx_len = LTE_PPP_RX_BATCH_SIZE_MAX;
+    }
+    // read straight from the UART ring into the pbuf handed to lwIP
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, rx_len, PBUF_RAM);
+    if (p == NULL) {
+        // leave the data in the ring, RTS holds the modem back until lwIP frees memory
+        return;
+    }
+    int len = uart_read_bytes(LTE_UART_ID, (uint8_t *)p->payload, rx_len, 0);
+    if (len <= 0) {
+        pbuf_free(p);
+        return;
+    }
+    pbuf_realloc(p, len);
+    MPTRACE(MPTRACE_LTE_PPP_IN, len, 0);
+    if (tcpip_callback_with_block(lteppp_ppp_input_cb, p, 0) != ERR_OK) {
+        MSG("tcpip mbox full, %d bytes dropped\n", len);
+        pbuf_free(p);
+    }
+    uart_get_buffered_data_len(LTE_UART_ID, &rx_len);
+    if (rx_len > 0) {
+        // more than one batch was pending, don't wait for the next event
+        xSemaphoreGive(xLTEWakeSem);
+    }
+}
+
 // PPP output callback
+// the frames are only copied into the TX ring of the UART driver, which sends them back to back under
+// the CTS flow control, so the tcpip thread waits only when the ring is full rather than for every frame
 static uint32_t lteppp_output_callback(ppp_pcb *pcb, u8_t *data, u32_t len, void *ctx) {
     LWIP_UNUSED_ARG(ctx);
     uint32_t tx_bytes;
+    MPTRACE(MPTRACE_LTE_PPP_OUT, len, 0);
     static uint32_t top =0;
     if (lteppp_connstatus == LTE_PPP_IDLE || lteppp_connstatus == LTE_PPP_RESUMED) {
         if(top > 0 && lteppp_connstatus == LTE_PPP_RESUMED)
         {
-            uart_write_bytes(LTE_UART_ID, (const char*)lteppp_queue_buffer, top+1);
-            uart_wait_tx_done(LTE_UART_ID, LTE_TRX_WAIT_MS(top+1) / portTICK_RATE_MS);
+            uart_write_bytes(LTE_UART_ID, (const char*)lteppp_queue_buffer, top);
         }
         top = 0;
         tx_bytes = uart_write_bytes(LTE_UART_ID, (const char*)data, len);
-        uart_wait_tx_done(LTE_UART_ID, LTE_TRX_WAIT_MS(len) / portTICK_RATE_MS);
     }
     else
     {
@@ -16,6 +16,21 @@
 #define LTE_UART_ID                                                     (2)
 
 #define LTE_UART_BUFFER_SIZE                                            (2048)
+// the RX ring of the UART driver holds the PPP stream while lwIP catches up,
+// RTS is only asserted once it is full
+#ifndef LTE_UART_RX_BUFFER_SIZE
+#define LTE_UART_RX_BUFFER_SIZE                                         (8192)
+#endif
+// the PPP frames are queued in the TX ring of the UART driver, it holds a couple of full sized ones
+#ifndef LTE_UART_TX_BUFFER_SIZE
+#define LTE_UART_TX_BUFFER_SIZE                                         (4096)
+#endif
+#define LTE_UART_EVT_QUEUE_SIZE                                         (16)
+// RTS is raised when this many bytes sit in the 128 byte hardware FIFO
+#define LTE_UART_FLOW_CTRL_THRESH                                       (100)
+#define LTE_PPP_RX_BATCH_SIZE_MAX                                       (4096)
+#define LTE_UART_BAUDRATE_SETTLE_MS                                     (50)
+#define LTE_UART_BAUDRATE_CHECK_TRIALS                                  (3)
 #define LTE_CMD_QUEUE_SIZE_MAX                                          (1)
 #define LTE_RSP_QUEUE_SIZE_MAX                                          (1)
 #define LTE_AT_CMD_SIZE_MAX                                             (128)
@@ -27,6 +42,8 @@
 #define LTE_RX_TIMEOUT_MAX_MS                                           (9500)
 #define LTE_RX_TIMEOUT_MIN_MS                                           (300)
 #define LTE_PPP_BACK_OFF_TIME_MS                                        (1150)
+// how long a response may pause before it is considered complete
+#define LTE_AT_RSP_IDLE_MS                                              (1000)
 
 #define LTE_MUTEX_TIMEOUT                                               (5050 / portTICK_RATE_MS)
 #define LTE_TASK_STACK_SIZE                                             (3072)
@@ -120,6 +137,12 @@ extern void lteppp_send_at_command (lte_task_cmd_data_t *cmd, lte_task_rsp_data_
 
 extern bool lteppp_wait_at_rsp (const char *expected_rsp, uint32_t timeout, bool from_mp, void* data_rem);
 
+extern void lteppp_set_uart_baudrate(uint32_t baudrate);
+
+extern uint32_t lteppp_get_uart_baudrate(void);
+
+extern bool lteppp_uart_baudrate_supported(uint32_t baudrate);
+
 lte_modem_conn_state_t lteppp_get_modem_conn_state(void);
 void lteppp_set_modem_conn_state(lte_modem_conn_state_t state);
 
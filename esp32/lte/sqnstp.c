@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <string.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "driver/uart.h"
+
+#include "sqnstp.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define SQNSTP_MREQ_SIGNATURE                               (0x66617374)
+#define SQNSTP_SRSP_SIGNATURE                               (0x74736166)
+
+#define SQNSTP_OP_RESET                                     (0)
+#define SQNSTP_OP_SESSION_OPEN                              (1)
+#define SQNSTP_OP_TRANSFER_BLOCK_CMD                        (2)
+#define SQNSTP_OP_TRANSFER_BLOCK                            (3)
+#define SQNSTP_OP_ACK(op)                                   ((op) | 0x80)
+
+#define SQNSTP_SESSION_OPEN_RSP_SIZE                        (4)
+#define SQNSTP_TRANSFER_BLOCK_RSP_SIZE                      (2)
+#define SQNSTP_RETRY_DELAY_MS                               (10)
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// big endian ">IBBHIHH" on the wire
+typedef struct {
+    uint32_t magic;
+    uint8_t op;
+    uint8_t sid;
+    uint16_t plen;
+    uint32_t tid;
+    uint16_t hcrc;
+    uint16_t pcrc;
+} sqnstp_header_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+static const char *TAG = "sqnstp";
+
+// CRC-16/XMODEM, a nibble at a time
+static const uint16_t sqnstp_crc_table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+static uint16_t sqnstp_crc16 (const uint8_t *buf, uint32_t len) {
+    uint16_t crc = 0;
+    while (len--) {
+        crc = (crc << 4) ^ sqnstp_crc_table[(crc >> 12) ^ (*buf >> 4)];
+        crc = (crc << 4) ^ sqnstp_crc_table[(crc >> 12) ^ (*buf & 0x0f)];
+        buf++;
+    }
+    return crc;
+}
+
+static void sqnstp_put_be16 (uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void sqnstp_put_be32 (uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint16_t sqnstp_get_be16 (const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t sqnstp_get_be32 (const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void sqnstp_pack_header (uint8_t *buf, const sqnstp_header_t *h) {
+    sqnstp_put_be32(&buf[0], h->magic);
+    buf[4] = h->op;
+    buf[5] = h->sid;
+    sqnstp_put_be16(&buf[6], h->plen);
+    sqnstp_put_be32(&buf[8], h->tid);
+    sqnstp_put_be16(&buf[12], h->hcrc);
+    sqnstp_put_be16(&buf[14], h->pcrc);
+}
+
+static void sqnstp_write_mreq (sqnstp_t *stp, uint8_t op, const uint8_t *pld, uint16_t plen) {
+    uint8_t buf[SQNSTP_HEADER_SIZE];
+    sqnstp_header_t h = {
+        .magic = SQNSTP_MREQ_SIGNATURE,
+        .op = op,
+        .sid = stp->sid,
+        .plen = plen,
+        .tid = stp->tid,
+        .hcrc = 0,
+        .pcrc = (plen != 0) ? sqnstp_crc16(pld, plen) : 0,
+    };
+    // the header CRC is computed with the CRC field itself set to 0
+    sqnstp_pack_header(buf, &h);
+    h.hcrc = sqnstp_crc16(buf, sizeof(buf));
+    sqnstp_put_be16(&buf[12], h.hcrc);
+
+    uart_write_bytes(stp->uart, (const char *)buf, sizeof(buf));
+    if (plen != 0) {
+        uart_write_bytes(stp->uart, (const char *)pld, plen);
+    }
+}
+
+static bool sqnstp_read (sqnstp_t *stp, uint8_t *buf, uint32_t len) {
+    int n = uart_read_bytes(stp->uart, buf, len, stp->timeout_ms / portTICK_RATE_MS);
+    return (n == len);
+}
+
+static sqnstp_err_t sqnstp_read_srsp (sqnstp_t *stp, sqnstp_header_t *h) {
+    uint8_t buf[SQNSTP_HEADER_SIZE];
+    if (!sqnstp_read(stp, buf, sizeof(buf))) {
+        return E_SQNSTP_TIMEOUT;
+    }
+    h->magic = sqnstp_get_be32(&buf[0]);
+    h->op = buf[4];
+    h->sid = buf[5];
+    h->plen = sqnstp_get_be16(&buf[6]);
+    h->tid = sqnstp_get_be32(&buf[8]);
+    h->hcrc = sqnstp_get_be16(&buf[12]);
+    h->pcrc = sqnstp_get_be16(&buf[14]);
+
+    // a wrong signature has always been tolerated, only the CRC counts
+    if (h->magic != SQNSTP_SRSP_SIGNATURE) {
+        ESP_LOGW(TAG, "Wrong SRSP signature: 0x%08X", h->magic);
+    }
+    if (h->hcrc != 0) {
+        sqnstp_put_be32(&buf[0], SQNSTP_SRSP_SIGNATURE);
+        sqnstp_put_be16(&buf[12], 0);
+        if (sqnstp_crc16(buf, sizeof(buf)) != h->hcrc) {
+            return E_SQNSTP_HEADER_CRC;
+        }
+    }
+    return E_SQNSTP_OK;
+}
+
+static sqnstp_err_t sqnstp_verify_session (sqnstp_t *stp, const sqnstp_header_t *h, uint8_t op) {
+    if (h->op != SQNSTP_OP_ACK(op) || h->sid != stp->sid || h->tid != stp->tid) {
+        return E_SQNSTP_SESSION;
+    }
+    return E_SQNSTP_OK;
+}
+
+static sqnstp_err_t sqnstp_read_srsp_data (sqnstp_t *stp, const sqnstp_header_t *h, uint8_t *buf, uint32_t len) {
+    if (!sqnstp_read(stp, buf, len)) {
+        return E_SQNSTP_TIMEOUT;
+    }
+    if (h->plen != len || (h->pcrc != 0 && h->pcrc != sqnstp_crc16(buf, len))) {
+        return E_SQNSTP_PAYLOAD;
+    }
+    return E_SQNSTP_OK;
+}
+
+// sends a request and reads the response header, retrying on a lost or a
+// corrupted header
+static sqnstp_err_t sqnstp_transact (sqnstp_t *stp, uint8_t op, const uint8_t *pld, uint16_t plen, sqnstp_header_t *h) {
+    sqnstp_err_t err;
+    for (int i = 0; i < SQNSTP_TRIALS; i++) {
+        if (i > 0) {
+            // drop the rest of the bad response, or we'd read out of step
+            vTaskDelay(SQNSTP_RETRY_DELAY_MS / portTICK_RATE_MS);
+            uart_flush_input(stp->uart);
+        }
+        sqnstp_write_mreq(stp, op, pld, plen);
+        if ((err = sqnstp_read_srsp(stp, h)) == E_SQNSTP_OK) {
+            break;
+        }
+    }
+    return err;
+}
+
+// the session checks share one retry budget for the whole transfer
+static bool sqnstp_need_retry (sqnstp_t *stp, sqnstp_err_t err) {
+    if (err != E_SQNSTP_OK && --stp->trials > 0) {
+        ESP_LOGW(TAG, "%s, retrying", sqnstp_strerror(err));
+        return true;
+    }
+    return false;
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void sqnstp_init (sqnstp_t *stp, uart_port_t uart, uint32_t timeout_ms) {
+    memset(stp, 0, sizeof(*stp));
+    stp->uart = uart;
+    stp->timeout_ms = timeout_ms;
+    stp->max_transfer = SQNSTP_HEADER_SIZE;
+    stp->version = 1;
+    stp->trials = SQNSTP_TRIALS;
+}
+
+sqnstp_err_t sqnstp_reset (sqnstp_t *stp, bool closing) {
+    sqnstp_header_t h;
+    sqnstp_err_t err;
+
+    if (!closing) {
+        // drop whatever the modem sent before
+        uart_flush_input(stp->uart);
+    }
+    sqnstp_write_mreq(stp, SQNSTP_OP_RESET, NULL, 0);
+    err = sqnstp_read_srsp(stp, &h);
+    if (closing) {
+        return E_SQNSTP_OK;
+    }
+    if (err != E_SQNSTP_OK) {
+        return err;
+    }
+    if (h.op != SQNSTP_OP_ACK(SQNSTP_OP_RESET)) {
+        return E_SQNSTP_SESSION;
+    }
+    stp->sid = 0;
+    stp->tid = 0;
+    return E_SQNSTP_OK;
+}
+
+sqnstp_err_t sqnstp_open_session (sqnstp_t *stp) {
+    sqnstp_header_t h;
+    uint8_t rsp[SQNSTP_SESSION_OPEN_RSP_SIZE];
+    sqnstp_err_t err;
+
+    stp->sid = 1;
+    stp->tid = 1;
+    sqnstp_write_mreq(stp, SQNSTP_OP_SESSION_OPEN, NULL, 0);
+    if ((err = sqnstp_read_srsp(stp, &h)) != E_SQNSTP_OK ||
+        (err = sqnstp_verify_session(stp, &h, SQNSTP_OP_SESSION_OPEN)) != E_SQNSTP_OK ||
+        (err = sqnstp_read_srsp_data(stp, &h, rsp, sizeof(rsp))) != E_SQNSTP_OK) {
+        return err;
+    }
+    // ">BBH": ok, version, max transfer size
+    if (!rsp[0]) {
+        return E_SQNSTP_OPEN_FAILED;
+    }
+    stp->version = rsp[1];
+    stp->max_transfer = sqnstp_get_be16(&rsp[2]);
+    if (stp->max_transfer <= SQNSTP_HEADER_SIZE) {
+        return E_SQNSTP_OPEN_FAILED;
+    }
+    ESP_LOGI(TAG, "Session opened: version %d, max transfer %d bytes", stp->version, stp->max_transfer);
+    stp->tid++;
+    return E_SQNSTP_OK;
+}
+
+sqnstp_err_t sqnstp_send (sqnstp_t *stp, const uint8_t *data, uint32_t len, uint32_t *sent) {
+    sqnstp_header_t h;
+    uint8_t rsp[SQNSTP_TRANSFER_BLOCK_RSP_SIZE];
+    sqnstp_err_t err;
+
+    *sent = 0;
+    while (len > 0) {
+        uint16_t l = MIN(len, stp->max_transfer - SQNSTP_HEADER_SIZE);
+        l = MIN(l, SQNSTP_BLOCK_SIZE_MAX);
+
+        // announce the block
+        uint8_t cmd[2];
+        sqnstp_put_be16(cmd, l);
+        if ((err = sqnstp_transact(stp, SQNSTP_OP_TRANSFER_BLOCK_CMD, cmd, sizeof(cmd), &h)) != E_SQNSTP_OK) {
+            return err;
+        }
+        err = sqnstp_verify_session(stp, &h, SQNSTP_OP_TRANSFER_BLOCK_CMD);
+        if (sqnstp_need_retry(stp, err)) {
+            continue;
+        } else if (err != E_SQNSTP_OK) {
+            return err;
+        }
+        stp->tid++;
+
+        // then send it, the response tells how much was left over
+        for (;;) {
+            if ((err = sqnstp_transact(stp, SQNSTP_OP_TRANSFER_BLOCK, data, l, &h)) != E_SQNSTP_OK) {
+                return err;
+            }
+            err = sqnstp_verify_session(stp, &h, SQNSTP_OP_TRANSFER_BLOCK);
+            if (sqnstp_need_retry(stp, err)) {
+                continue;
+            } else if (err != E_SQNSTP_OK) {
+                return err;
+            }
+            break;
+        }
+        err = sqnstp_read_srsp_data(stp, &h, rsp, sizeof(rsp));
+        if (sqnstp_need_retry(stp, err)) {
+            continue;
+        } else if (err != E_SQNSTP_OK) {
+            return err;
+        }
+        stp->tid++;
+
+        uint16_t residue = sqnstp_get_be16(rsp);
+        if (residue > 0) {
+            ESP_LOGW(TAG, "Slave didn't consume %d bytes", residue);
+            l -= MIN(residue, l);
+        }
+        data += l;
+        len -= l;
+        *sent += l;
+    }
+    return E_SQNSTP_OK;
+}
+
+const char *sqnstp_strerror (sqnstp_err_t err) {
+    switch (err) {
+        case E_SQNSTP_OK:           return "OK";
+        case E_SQNSTP_TIMEOUT:      return "Timeout waiting for the modem";
+        case E_SQNSTP_HEADER_CRC:   return "Wrong header CRC";
+        case E_SQNSTP_PAYLOAD:      return "Wrong payload size or CRC";
+        case E_SQNSTP_SESSION:      return "Invalid op, sid or tid";
+        case E_SQNSTP_OPEN_FAILED:  return "OpenSession: failed to open";
+        default:                    return "Unknown error";
+    }
+}
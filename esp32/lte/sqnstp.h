@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef _SQNSTP_H_
+#define _SQNSTP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "driver/uart.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+// the Sequans transfer protocol (STP) used to push a modem firmware image,
+// serves the same as frozen/LTE/sqnstp.py, see there for the Python version
+#define SQNSTP_HEADER_SIZE                                  (16)
+// the 31x0 MII can't take more than this in one block
+#define SQNSTP_BLOCK_SIZE_MAX                               (2048 - 32)
+#define SQNSTP_TIMEOUT_MS                                   (90000)
+#define SQNSTP_CLOSE_TIMEOUT_MS                             (2000)
+#define SQNSTP_TRIALS                                       (4)
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+typedef enum {
+    E_SQNSTP_OK = 0,
+    E_SQNSTP_TIMEOUT,
+    E_SQNSTP_HEADER_CRC,
+    E_SQNSTP_PAYLOAD,
+    E_SQNSTP_SESSION,
+    E_SQNSTP_OPEN_FAILED,
+} sqnstp_err_t;
+
+typedef struct {
+    uart_port_t uart;
+    uint32_t timeout_ms;
+    uint32_t tid;
+    uint16_t max_transfer;
+    uint8_t sid;
+    uint8_t version;
+    // left over retries of the session checks, for the whole transfer
+    uint8_t trials;
+} sqnstp_t;
+
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+extern void sqnstp_init (sqnstp_t *stp, uart_port_t uart, uint32_t timeout_ms);
+extern sqnstp_err_t sqnstp_reset (sqnstp_t *stp, bool closing);
+extern sqnstp_err_t sqnstp_open_session (sqnstp_t *stp);
+// blocks until all of data is consumed by the modem or an error, sent is
+// the amount consumed in any case
+extern sqnstp_err_t sqnstp_send (sqnstp_t *stp, const uint8_t *data, uint32_t len, uint32_t *sent);
+extern const char *sqnstp_strerror (sqnstp_err_t err);
+
+#endif  // _SQNSTP_H_
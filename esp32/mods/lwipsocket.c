@@ -35,9 +35,13 @@
 #include "lwip/netdb.h"
 #include "lwipsocket.h"
 
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+
 
 #define WLAN_MAX_RX_SIZE                    2048
 #define WLAN_MAX_TX_SIZE                    1476
+#define SSL_SENDMSG_GATHER_SIZE             512 // buffers smaller than this share a TLS record
 
 #define MAKE_SOCKADDR(addr, ip, port)       struct sockaddr addr; \
                                             addr.sa_family = AF_INET; \
@@ -54,6 +58,135 @@
                                             ip[2] = addr.sa_data[3]; \
                                             ip[3] = addr.sa_data[2];
 
+#ifdef LWIP_SOCKET_OFFSET
+#define LWIPSOCKET_SD_INDEX(sd)             ((sd) - LWIP_SOCKET_OFFSET)
+#else
+#define LWIPSOCKET_SD_INDEX(sd)             (sd)
+#endif
+
+STATIC const lwipsocket_profile_t lwipsocket_profiles[LWIPSOCKET_PROFILE_COUNT] = {
+    // a sensor node, a couple of segments per socket and a few sockets
+    [LWIPSOCKET_PROFILE_SMALL] = {.rcvbuf = 2 * CONFIG_TCP_MSS, .sndbuf = 2 * CONFIG_TCP_MSS, .tcp_wnd = 2 * CONFIG_TCP_MSS, .max_sockets = 4},
+    [LWIPSOCKET_PROFILE_DEFAULT] = {.rcvbuf = 0, .sndbuf = CONFIG_TCP_SND_BUF_DEFAULT, .tcp_wnd = CONFIG_TCP_WND_DEFAULT, .max_sockets = CONFIG_LWIP_MAX_SOCKETS},
+    // a gateway, enough in flight to fill a fast link
+    [LWIPSOCKET_PROFILE_LARGE] = {.rcvbuf = 16 * CONFIG_TCP_MSS, .sndbuf = 16 * CONFIG_TCP_MSS, .tcp_wnd = 16 * CONFIG_TCP_MSS, .max_sockets = CONFIG_LWIP_MAX_SOCKETS},
+};
+
+STATIC lwipsocket_profile_t lwipsocket_profile = {.rcvbuf = 0, .sndbuf = CONFIG_TCP_SND_BUF_DEFAULT, .tcp_wnd = CONFIG_TCP_WND_DEFAULT, .max_sockets = CONFIG_LWIP_MAX_SOCKETS};
+STATIC lwipsocket_stats_t lwipsocket_stats;
+// the descriptors counted as open, an ssl socket shares its descriptor with the one it wraps
+// and both may be closed
+STATIC uint32_t lwipsocket_open_mask;
+// the socket calls run with the GIL released, the counters are shared by all the threads
+STATIC portMUX_TYPE lwipsocket_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+STATIC void lwipsocket_stats_bytes(uint64_t *counter, int ret, int err) {
+    portENTER_CRITICAL(&lwipsocket_stats_mux);
+    if (ret > 0) {
+        *counter += ret;
+    } else if (ret < 0 && err == ENOMEM) {
+        lwipsocket_stats.mem_errors++;
+    }
+    portEXIT_CRITICAL(&lwipsocket_stats_mux);
+}
+
+// false if the profile allows no more sockets
+STATIC bool lwipsocket_stats_allowed(void) {
+    portENTER_CRITICAL(&lwipsocket_stats_mux);
+    bool allowed = lwipsocket_stats.open < lwipsocket_profile.max_sockets;
+    if (!allowed) {
+        lwipsocket_stats.refused++;
+    }
+    portEXIT_CRITICAL(&lwipsocket_stats_mux);
+    return allowed;
+}
+
+STATIC void lwipsocket_stats_open(int32_t sd) {
+    uint32_t index = LWIPSOCKET_SD_INDEX(sd);
+    portENTER_CRITICAL(&lwipsocket_stats_mux);
+    if (sd < 0) {
+        // lwIP is out of descriptors or of memory
+        lwipsocket_stats.refused++;
+    } else {
+        lwipsocket_stats.created++;
+        if (index < 32 && !(lwipsocket_open_mask & (1 << index))) {
+            lwipsocket_open_mask |= 1 << index;
+            lwipsocket_stats.open++;
+            lwipsocket_stats.peak = MAX(lwipsocket_stats.peak, lwipsocket_stats.open);
+        }
+    }
+    portEXIT_CRITICAL(&lwipsocket_stats_mux);
+}
+
+STATIC void lwipsocket_stats_close(int32_t sd) {
+    uint32_t index = LWIPSOCKET_SD_INDEX(sd);
+    portENTER_CRITICAL(&lwipsocket_stats_mux);
+    if (index < 32 && (lwipsocket_open_mask & (1 << index))) {
+        lwipsocket_open_mask &= ~(1 << index);
+        lwipsocket_stats.open--;
+    }
+    portEXIT_CRITICAL(&lwipsocket_stats_mux);
+}
+
+STATIC void lwipsocket_apply_profile(int32_t sd, bool tcp) {
+    if (lwipsocket_profile.rcvbuf > 0) {
+        int value = lwipsocket_profile.rcvbuf;
+        lwip_setsockopt_r(sd, SOL_SOCKET, SO_RCVBUF, &value, sizeof(value));
+    }
+#if LWIPSOCKET_PER_SOCKET_TCP
+    if (tcp) {
+        // lwIP takes them as a number of segments
+        int value = lwipsocket_profile.tcp_wnd / TCP_MSS;
+        lwip_setsockopt_r(sd, IPPROTO_TCP, TCP_WINDOW, &value, sizeof(value));
+        value = lwipsocket_profile.sndbuf / TCP_MSS;
+        lwip_setsockopt_r(sd, IPPROTO_TCP, TCP_SNDBUF, &value, sizeof(value));
+    }
+#endif
+}
+
+/******************************************************************************/
+// Buffer profiles and statistics
+
+bool lwipsocket_get_profile_preset(uint32_t index, lwipsocket_profile_t *profile) {
+    if (index >= LWIPSOCKET_PROFILE_COUNT) {
+        return false;
+    }
+    *profile = lwipsocket_profiles[index];
+    return true;
+}
+
+void lwipsocket_get_profile(lwipsocket_profile_t *profile) {
+    *profile = lwipsocket_profile;
+}
+
+bool lwipsocket_set_profile(const lwipsocket_profile_t *profile) {
+    if (profile->rcvbuf < 0 || profile->max_sockets < 1 || profile->max_sockets > CONFIG_LWIP_MAX_SOCKETS ||
+        profile->tcp_wnd < CONFIG_TCP_MSS || profile->tcp_wnd > UINT16_MAX || profile->sndbuf < 2 * CONFIG_TCP_MSS) {
+        return false;
+    }
+    lwipsocket_profile_t applied = *profile;
+#if !LWIPSOCKET_PER_SOCKET_TCP
+    applied.tcp_wnd = CONFIG_TCP_WND_DEFAULT;
+    applied.sndbuf = CONFIG_TCP_SND_BUF_DEFAULT;
+#endif
+    portENTER_CRITICAL(&lwipsocket_stats_mux);
+    lwipsocket_profile = applied;
+    portEXIT_CRITICAL(&lwipsocket_stats_mux);
+    return true;
+}
+
+void lwipsocket_get_stats(lwipsocket_stats_t *stats, bool reset) {
+    portENTER_CRITICAL(&lwipsocket_stats_mux);
+    *stats = lwipsocket_stats;
+    if (reset) {
+        uint32_t open = lwipsocket_stats.open;
+        memset(&lwipsocket_stats, 0, sizeof(lwipsocket_stats));
+        lwipsocket_stats.open = open;
+        lwipsocket_stats.peak = open;
+    }
+    portEXIT_CRITICAL(&lwipsocket_stats_mux);
+}
+
 //
 ///******************************************************************************/
 //// Micro Python bindings; LWIP socket
@@ -74,7 +207,12 @@ int lwipsocket_gethostbyname(const char *name, mp_uint_t len, uint8_t *out_ip, m
 }
 
 int lwipsocket_socket_socket(mod_network_socket_obj_t *s, int *_errno) {
+    if (!lwipsocket_stats_allowed()) {
+        *_errno = MP_ENFILE;
+        return -1;
+    }
     int32_t sd = socket(s->sock_base.u.u_param.domain, s->sock_base.u.u_param.type, s->sock_base.u.u_param.proto);
+    lwipsocket_stats_open(sd);
     if (sd < 0) {
         *_errno = errno;
         return -1;
@@ -83,6 +221,7 @@ int lwipsocket_socket_socket(mod_network_socket_obj_t *s, int *_errno) {
     // enable address reusing
     uint32_t option = 1;
     lwip_setsockopt_r(sd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+    lwipsocket_apply_profile(sd, s->sock_base.u.u_param.type == SOCK_STREAM);
 
     s->sock_base.u.sd = sd;
     return 0;
@@ -103,9 +242,11 @@ void lwipsocket_socket_close(mod_network_socket_obj_t *s) {
         mbedtls_ssl_config_free(&ss->conf);
         mbedtls_ctr_drbg_free(&ss->ctr_drbg);
         mbedtls_entropy_free(&ss->entropy);
+        mod_ssl_release(ss);
     } else {
         lwip_close_r(s->sock_base.u.sd);
     }
+    lwipsocket_stats_close(s->sock_base.u.sd);
     modusocket_socket_delete(s->sock_base.u.sd);
     s->sock_base.connected = false;
 }
@@ -136,12 +277,21 @@ int lwipsocket_socket_accept(mod_network_socket_obj_t *s, mod_network_socket_obj
     socklen_t addr_len = sizeof(addr);
 
     sd = lwip_accept_r(s->sock_base.u.sd, &addr, &addr_len);
+    if (sd >= 0 && !lwipsocket_stats_allowed()) {
+        // over the limit of the profile, the peer sees the connection reset
+        lwip_close_r(sd);
+        sd = -1;
+        errno = MP_ENFILE;
+    } else if (sd >= 0) {
+        lwipsocket_stats_open(sd);
+    }
     // save the socket descriptor
     s2->sock_base.u.sd = sd;
     if (sd < 0) {
         *_errno = errno;
         return -1;
     }
+    lwipsocket_apply_profile(sd, true);
 
     s2->sock_base.connected = true;
 
@@ -189,6 +339,7 @@ int lwipsocket_socket_send(mod_network_socket_obj_t *s, const byte *buf, mp_uint
             bytes = lwip_send_r(s->sock_base.u.sd, (const void *)buf, len, 0);
         }
     }
+    lwipsocket_stats_bytes(&lwipsocket_stats.tx_bytes, bytes, errno);
     if (bytes <= 0) {
         *_errno = errno;
         return -1;
@@ -237,12 +388,14 @@ int lwipsocket_socket_recv(mod_network_socket_obj_t *s, byte *buf, mp_uint_t len
             return -1;
         }
     } else {
-        ret = lwip_recv_r(s->sock_base.u.sd, buf, MIN(len, WLAN_MAX_RX_SIZE), 0);
+        // a stream can fill the whole buffer, lwIP returns what is already queued
+        ret = lwip_recv_r(s->sock_base.u.sd, buf, len, 0);
         if (ret < 0) {
             *_errno = errno;
             return -1;
         }
     }
+    lwipsocket_stats_bytes(&lwipsocket_stats.rx_bytes, ret, 0);
     return ret;
 }
 
@@ -250,6 +403,7 @@ int lwipsocket_socket_sendto( mod_network_socket_obj_t *s, const byte *buf, mp_u
     if (len > 0) {
         MAKE_SOCKADDR(addr, ip, port)
         int ret = lwip_sendto_r(s->sock_base.u.sd, (byte*)buf, len, 0, (struct sockaddr*)&addr, sizeof(addr));
+        lwipsocket_stats_bytes(&lwipsocket_stats.tx_bytes, ret, errno);
         if (ret < 0) {
             *_errno = errno;
             return -1;
@@ -263,6 +417,7 @@ int lwipsocket_socket_recvfrom(mod_network_socket_obj_t *s, byte *buf, mp_uint_t
     struct sockaddr addr;
     socklen_t addr_len = sizeof(addr);
     mp_int_t ret = lwip_recvfrom_r(s->sock_base.u.sd, buf, MIN(len, WLAN_MAX_RX_SIZE), 0, &addr, &addr_len);
+    lwipsocket_stats_bytes(&lwipsocket_stats.rx_bytes, ret, 0);
     if (ret < 0) {
         *_errno = errno;
         return -1;
@@ -271,7 +426,103 @@ int lwipsocket_socket_recvfrom(mod_network_socket_obj_t *s, byte *buf, mp_uint_t
     return ret;
 }
 
+// writes all of buf as TLS records, returns the bytes written before an error or -1
+STATIC int lwipsocket_ssl_write_all(mp_obj_ssl_socket_t *ss, const byte *buf, mp_uint_t len, int *_errno) {
+    mp_uint_t done = 0;
+    while (done < len) {
+        int bytes = mbedtls_ssl_write(&ss->ssl, (const unsigned char *)buf + done, len - done);
+        if (bytes <= 0) {
+            if (done > 0) {
+                break;
+            }
+            *_errno = (bytes == MBEDTLS_ERR_SSL_WANT_READ || bytes == MBEDTLS_ERR_SSL_WANT_WRITE) ? MP_EAGAIN : errno;
+            return -1;
+        }
+        done += bytes;
+    }
+    return done;
+}
+
+int lwipsocket_socket_sendmsg(mod_network_socket_obj_t *s, const mp_buffer_info_t *bufs, mp_uint_t count, byte *ip, mp_uint_t port, int *_errno) {
+    int ret;
+
+    if (s->sock_base.is_ssl) {
+        // small buffers, like a header and its payload, are packed so that they go out in one record
+        mp_obj_ssl_socket_t *ss = (mp_obj_ssl_socket_t *)s;
+        byte gather[SSL_SENDMSG_GATHER_SIZE];
+        mp_uint_t used = 0;
+        mp_uint_t total = 0;
+        for (mp_uint_t i = 0; i <= count; i++) {
+            bool last = (i == count);
+            // flush the packed buffers before one that doesn't fit and at the end
+            if (used > 0 && (last || used + bufs[i].len > sizeof(gather))) {
+                if ((ret = lwipsocket_ssl_write_all(ss, gather, used, _errno)) < 0) {
+                    return (total > 0) ? total : -1;
+                }
+                total += ret;
+                if (ret < used) {
+                    return total;
+                }
+                used = 0;
+            }
+            if (last) {
+                break;
+            }
+            if (bufs[i].len <= sizeof(gather)) {
+                memcpy(gather + used, bufs[i].buf, bufs[i].len);
+                used += bufs[i].len;
+            } else {
+                if ((ret = lwipsocket_ssl_write_all(ss, bufs[i].buf, bufs[i].len, _errno)) < 0) {
+                    return (total > 0) ? total : -1;
+                }
+                total += ret;
+                if (ret < bufs[i].len) {
+                    return total;
+                }
+            }
+        }
+        lwipsocket_stats_bytes(&lwipsocket_stats.tx_bytes, total, 0);
+        return total;
+    }
+
+    // lwIP chains the buffers, there is no copy into a joined one
+    struct iovec iov[MOD_NETWORK_SENDMSG_MAX_BUFS];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    for (mp_uint_t i = 0; i < count; i++) {
+        iov[i].iov_base = bufs[i].buf;
+        iov[i].iov_len = bufs[i].len;
+    }
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    byte any_ip[MOD_NETWORK_IPV4ADDR_BUF_SIZE] = {0};
+    byte *to = (ip != NULL) ? ip : any_ip;
+    MAKE_SOCKADDR(addr, to, port)
+    if (ip != NULL) {
+        msg.msg_name = &addr;
+        msg.msg_namelen = sizeof(addr);
+    }
+    ret = lwip_sendmsg_r(s->sock_base.u.sd, &msg, 0);
+    lwipsocket_stats_bytes(&lwipsocket_stats.tx_bytes, ret, errno);
+    if (ret < 0) {
+        *_errno = errno;
+        return -1;
+    }
+    return ret;
+}
+
 int lwipsocket_socket_setsockopt(mod_network_socket_obj_t *s, mp_uint_t level, mp_uint_t opt, const void *optval, mp_uint_t optlen, int *_errno) {
+#if LWIPSOCKET_PER_SOCKET_TCP
+    // lwIP has no SO_SNDBUF, a TCP socket gets its send buffer in segments instead
+    int segments;
+    if (level == SOL_SOCKET && opt == SO_SNDBUF && optlen >= sizeof(int)) {
+        segments = MAX(*(const int *)optval / TCP_MSS, 2);
+        level = IPPROTO_TCP;
+        opt = TCP_SNDBUF;
+        optval = &segments;
+        optlen = sizeof(segments);
+    }
+#endif
     int ret = lwip_setsockopt_r(s->sock_base.u.sd, level, opt, optval, optlen);
     if (ret < 0) {
         *_errno = errno;
@@ -379,7 +630,6 @@ int lwipsocket_socket_ioctl (mod_network_socket_obj_t *s, mp_uint_t request, mp_
 int lwipsocket_socket_setup_ssl(mod_network_socket_obj_t *s, int *_errno)
 {
     int ret;
-    uint32_t count = 0;
     mp_obj_ssl_socket_t *ss = (mp_obj_ssl_socket_t *)s;
 
     if ((ret = mbedtls_net_set_block(&ss->context_fd)) != 0) {
@@ -392,18 +642,11 @@ int lwipsocket_socket_setup_ssl(mod_network_socket_obj_t *s, int *_errno)
 
     // printf("Performing the SSL/TLS handshake...\n");
 
-    while ((ret = mbedtls_ssl_handshake(&ss->ssl)) != 0)
+    if ((ret = mod_ssl_handshake(ss)) != 0)
     {
-        if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_TIMEOUT ) || count >= ss->read_timeout)
-        {
-            // printf("mbedtls_ssl_handshake returned -0x%x\n", -ret);
-            *_errno = ret;
-            return -1;
-        }
-        if(ret == MBEDTLS_ERR_SSL_TIMEOUT)
-        {
-            count++;
-        }
+        // printf("mbedtls_ssl_handshake returned -0x%x\n", -ret);
+        *_errno = ret;
+        return -1;
     }
 
     // printf("Verifying peer X.509 certificate...\n");
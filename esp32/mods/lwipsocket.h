@@ -11,6 +11,46 @@
 #define LWIPSOCKET_H_
 
 #include "modnetwork.h"
+#include "lwip/opt.h"
+
+// the per socket TCP window and send buffer are only in an lwIP built with ESP_PER_SOC_TCP_WND,
+// otherwise they stay at their build time values
+#if defined(ESP_PER_SOC_TCP_WND) && ESP_PER_SOC_TCP_WND
+#define LWIPSOCKET_PER_SOCKET_TCP           (1)
+#else
+#define LWIPSOCKET_PER_SOCKET_TCP           (0)
+#endif
+
+#define LWIPSOCKET_PROFILE_SMALL            (0)
+#define LWIPSOCKET_PROFILE_DEFAULT          (1)
+#define LWIPSOCKET_PROFILE_LARGE            (2)
+#define LWIPSOCKET_PROFILE_COUNT            (3)
+
+// applied to the sockets created afterwards, the sizes are in bytes and rcvbuf 0 is unlimited
+typedef struct {
+    int32_t     rcvbuf;
+    int32_t     sndbuf;
+    int32_t     tcp_wnd;
+    int32_t     max_sockets;
+} lwipsocket_profile_t;
+
+typedef struct {
+    uint32_t    open;
+    uint32_t    peak;
+    uint32_t    created;
+    uint32_t    refused;            // over max_sockets or out of lwIP descriptors
+    uint32_t    mem_errors;         // the sends that failed with ENOMEM
+    uint64_t    tx_bytes;
+    uint64_t    rx_bytes;
+} lwipsocket_stats_t;
+
+extern bool lwipsocket_get_profile_preset(uint32_t index, lwipsocket_profile_t *profile);
+
+extern void lwipsocket_get_profile(lwipsocket_profile_t *profile);
+
+extern bool lwipsocket_set_profile(const lwipsocket_profile_t *profile);
+
+extern void lwipsocket_get_stats(lwipsocket_stats_t *stats, bool reset);
 
 extern int lwipsocket_gethostbyname(const char *name, mp_uint_t len, uint8_t *out_ip, mp_uint_t family);
 
@@ -34,6 +74,8 @@ extern int lwipsocket_socket_sendto( mod_network_socket_obj_t *s, const byte *bu
 
 extern int lwipsocket_socket_recvfrom(mod_network_socket_obj_t *s, byte *buf, mp_uint_t len, byte *ip, mp_uint_t *port, int *_errno);
 
+extern int lwipsocket_socket_sendmsg(mod_network_socket_obj_t *s, const mp_buffer_info_t *bufs, mp_uint_t count, byte *ip, mp_uint_t port, int *_errno);
+
 extern int lwipsocket_socket_setsockopt(mod_network_socket_obj_t *s, mp_uint_t level, mp_uint_t opt, const void *optval, mp_uint_t optlen, int *_errno);
 
 extern int lwipsocket_socket_settimeout(mod_network_socket_obj_t *s, mp_int_t timeout_ms, int *_errno);
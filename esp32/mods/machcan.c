@@ -12,10 +12,12 @@
 
 #include "py/mpstate.h"
 #include "py/runtime.h"
+#include "py/gc.h"
 #include "py/mperrno.h"
 #include "bufhelper.h"
 
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "sdkconfig.h"
 #include "esp_system.h"
 #include "esp_spi_flash.h"
@@ -52,6 +54,14 @@ CAN_device_t CAN_cfg = { .rx_queue = NULL };
 
 #define MACH_CAN_DEF_RX_QUEUE_LEN                   (128)
 
+// frames stored by recv_into(): id (bit 31 extended, bit 30 RTR), dlc, 3 reserved bytes and 8 data bytes
+#define MACH_CAN_FRAME_SIZE                         (16)
+#define MACH_CAN_FRAME_ID_EXT                       (1 << 31)
+#define MACH_CAN_FRAME_ID_RTR                       (1 << 30)
+
+#define MACH_CAN_STD_ID_MASK                        (0x7FF)
+#define MACH_CAN_EXT_ID_MASK                        (0x1FFFFFFF)
+
 /******************************************************************************
  DEFINE TYPES
  ******************************************************************************/
@@ -69,6 +79,7 @@ typedef struct {
     uint8_t frame_format;
     uint8_t trigger;
     uint8_t events;
+    int64_t stats_start;
 } mach_can_obj_t;
 
 /******************************************************************************
@@ -105,6 +116,58 @@ STATIC void can_deassign_pins_af (mach_can_obj_t *self) {
     }
 }
 
+// programs the hardware acceptance filter with the smallest code/mask accepting all the software filters,
+// the frames that can't match are then dropped by the controller and don't reach the ISR
+STATIC void can_setup_hw_filter (mach_can_obj_t *self) {
+    uint32_t code = 0;
+    uint32_t dont_care = 0xFFFFFFFF;
+
+    if (self->swfilters.num_filters > 0 && self->frame_format != MACH_CAN_FORMAT_BOTH) {
+        dont_care = 0;
+        for (int i = 0; i < self->swfilters.num_filters; i++) {
+            uint32_t from = self->swfilters.fromto[i][0];
+            uint32_t to = self->swfilters.fromto[i][1];
+            uint32_t id, bits;
+            if (self->swfilters.mode == CAN_FILTER_MASK) {
+                id = from & to;
+                bits = ~to;
+            } else {
+                // all the bits below the highest one differing between both ends of the range
+                id = from;
+                bits = from ^ to;
+                bits |= bits >> 1;
+                bits |= bits >> 2;
+                bits |= bits >> 4;
+                bits |= bits >> 8;
+                bits |= bits >> 16;
+            }
+            if (i == 0) {
+                code = id;
+            }
+            dont_care |= bits | (id ^ code);
+        }
+        dont_care &= (self->frame_format == MACH_CAN_FORMAT_STD) ? MACH_CAN_STD_ID_MASK : MACH_CAN_EXT_ID_MASK;
+        code &= ~dont_care;
+    }
+
+    CAN_setup_acceptance_filter(code, dont_care, self->frame_format - 1);
+}
+
+STATIC TickType_t can_get_timeout (mp_obj_t timeout_o) {
+    uint64_t timeout = 0;
+    if (timeout_o == mp_const_none) {
+        timeout = portMAX_DELAY;
+    } else {
+        if (timeout_o != MP_OBJ_NULL) {
+            timeout = mp_obj_get_float(timeout_o) * 1000;
+            if (timeout < 0 || timeout > portMAX_DELAY) {
+                timeout = portMAX_DELAY;
+            }
+        }
+    }
+    return (uint32_t)timeout * portTICK_PERIOD_MS;
+}
+
 STATIC void can_callback_handler(void *arg) {
     mach_can_obj_t *self = arg;
     if (self->handler && self->handler != mp_const_none) {
@@ -204,6 +267,8 @@ STATIC mp_obj_t mach_can_init_helper(mach_can_obj_t *self, const mp_arg_val_t *a
     self->swfilters.num_filters = 0;
     CAN_setup_sw_filters(&self->swfilters);
 
+    self->stats_start = esp_timer_get_time();
+
     // set the af values, so that deassign works later on
     if (self->tx && self->rx) {
         self->tx->af_out = CAN_TX_IDX;
@@ -338,41 +403,130 @@ STATIC mp_obj_t mach_can_recv(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
 
-    uint64_t timeout = 0;
-    if (args[0].u_obj == mp_const_none) {
-        timeout = portMAX_DELAY;
-    } else {
-        if (args[0].u_obj != MP_OBJ_NULL) {
-            timeout = mp_obj_get_float(args[0].u_obj) * 1000;
-            if (timeout < 0 || timeout > portMAX_DELAY) {
-                timeout = portMAX_DELAY;
-            }
-        }
-    }
+    TickType_t timeout = can_get_timeout(args[0].u_obj);
 
     CAN_frame_t rx_frame;
     MP_THREAD_GIL_EXIT();
-    if (xQueueReceive(CAN_cfg.rx_queue, &rx_frame, (uint32_t)timeout * portTICK_PERIOD_MS) == pdTRUE) {
+    if (xQueueReceive(CAN_cfg.rx_queue, &rx_frame, timeout) == pdTRUE) {
         MP_THREAD_GIL_ENTER();
-        mp_obj_t tuple[4];
-        tuple[0] = mp_obj_new_int(rx_frame.MsgID);
-        if (rx_frame.FIR.B.RTR == CAN_RTR) {
-            tuple[1] = mp_const_empty_bytes;
-            tuple[2] = mp_const_true;
+        // a frame taken from the queue is delivered even if the heap is full at that moment
+        nlr_buf_t nlr;
+        mp_obj_t info;
+        gc_reserve_begin();
+        if (nlr_push(&nlr) == 0) {
+            mp_obj_t tuple[4];
+            tuple[0] = mp_obj_new_int(rx_frame.MsgID);
+            if (rx_frame.FIR.B.RTR == CAN_RTR) {
+                tuple[1] = mp_const_empty_bytes;
+                tuple[2] = mp_const_true;
+            } else {
+                tuple[1] = mp_obj_new_bytes((const byte *)rx_frame.data.u8, rx_frame.FIR.B.DLC);
+                tuple[2] = mp_const_false;
+            }
+            tuple[3] = rx_frame.FIR.B.FF ? mp_const_true : mp_const_false;
+            info = mp_obj_new_attrtuple(can_recv_info_fields, 4, tuple);
+            nlr_pop();
         } else {
-            tuple[1] = mp_obj_new_bytes((const byte *)rx_frame.data.u8, rx_frame.FIR.B.DLC);
-            tuple[2] = mp_const_false;
+            // the reserve would stay in use if the MemoryError went past it
+            gc_reserve_end();
+            nlr_jump(nlr.ret_val);
         }
-        tuple[3] = rx_frame.FIR.B.FF ? mp_const_true : mp_const_false;
+        gc_reserve_end();
 
         // return the attribute tuple
-        return mp_obj_new_attrtuple(can_recv_info_fields, 4, tuple);
+        return info;
     }
     MP_THREAD_GIL_ENTER();
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_can_recv_obj, 1, mach_can_recv);
 
+/// \method recv_into(buf, timeout=0)
+/// Moves as many received frames as fit into buf, MACH_CAN_FRAME_SIZE bytes each,
+/// waiting up to timeout for the first one. Returns the number of frames.
+STATIC mp_obj_t mach_can_recv_into(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_buf,          MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_timeout,      MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_WRITE);
+    uint32_t max_frames = bufinfo.len / MACH_CAN_FRAME_SIZE;
+    if (max_frames == 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+
+    TickType_t timeout = can_get_timeout(args[1].u_obj);
+
+    uint8_t *dest = bufinfo.buf;
+    uint32_t n_frames = 0;
+    CAN_frame_t rx_frame;
+    MP_THREAD_GIL_EXIT();
+    while (n_frames < max_frames && xQueueReceive(CAN_cfg.rx_queue, &rx_frame, (n_frames == 0) ? timeout : 0) == pdTRUE) {
+        uint32_t id = rx_frame.MsgID;
+        uint8_t dlc = MIN(rx_frame.FIR.B.DLC, 8);
+        if (rx_frame.FIR.B.FF) {
+            id |= MACH_CAN_FRAME_ID_EXT;
+        }
+        if (rx_frame.FIR.B.RTR == CAN_RTR) {
+            id |= MACH_CAN_FRAME_ID_RTR;
+            dlc = 0;
+        }
+        memset(dest, 0, MACH_CAN_FRAME_SIZE);
+        memcpy(dest, &id, sizeof(id));
+        dest[4] = dlc;
+        memcpy(&dest[8], rx_frame.data.u8, dlc);
+        dest += MACH_CAN_FRAME_SIZE;
+        n_frames++;
+    }
+    MP_THREAD_GIL_ENTER();
+
+    return mp_obj_new_int_from_uint(n_frames);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_can_recv_into_obj, 1, mach_can_recv_into);
+
+/// \method stats(clear=False)
+STATIC mp_obj_t mach_can_stats(mp_uint_t n_args, const mp_obj_t *args) {
+    mach_can_obj_t *self = args[0];
+
+    static const qstr can_stats_info_fields[] = {
+        MP_QSTR_rx_frames, MP_QSTR_rx_filtered, MP_QSTR_rx_queue_overruns, MP_QSTR_rx_hw_overruns,
+        MP_QSTR_tx_frames, MP_QSTR_bus_errors, MP_QSTR_arb_lost, MP_QSTR_bus_load
+    };
+
+    bool clear = n_args > 1 && mp_obj_is_true(args[1]);
+    CAN_stats_t stats;
+    CAN_get_stats(&stats, clear);
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed_us = now - self->stats_start;
+    if (clear) {
+        self->stats_start = now;
+    }
+
+    mp_obj_t tuple[8];
+    tuple[0] = mp_obj_new_int_from_uint(stats.rx_frames);
+    tuple[1] = mp_obj_new_int_from_uint(stats.rx_filtered);
+    tuple[2] = mp_obj_new_int_from_uint(stats.rx_queue_overruns);
+    tuple[3] = mp_obj_new_int_from_uint(stats.rx_hw_overruns);
+    tuple[4] = mp_obj_new_int_from_uint(stats.tx_frames);
+    tuple[5] = mp_obj_new_int_from_uint(stats.bus_errors);
+    tuple[6] = mp_obj_new_int_from_uint(stats.arb_lost);
+    // percentage of the bus time used by the frames seen since the last clear
+    float load = 0;
+    if (elapsed_us > 0 && self->baudrate > 0) {
+        load = ((float)stats.bus_bits * 100.0f * 1000000.0f) / ((float)elapsed_us * self->baudrate);
+    }
+    tuple[7] = mp_obj_new_float(load);
+
+    return mp_obj_new_attrtuple(can_stats_info_fields, 8, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mach_can_stats_obj, 1, 2, mach_can_stats);
+
 STATIC mp_obj_t mach_can_soft_filter(mp_obj_t self_in, mp_obj_t mode_o, mp_obj_t filters_l) {
     mach_can_obj_t *self = self_in;
 
@@ -409,6 +563,7 @@ STATIC mp_obj_t mach_can_soft_filter(mp_obj_t self_in, mp_obj_t mode_o, mp_obj_t
     }
 
     CAN_setup_sw_filters(&self->swfilters);
+    can_setup_hw_filter(self);
 
     return mp_const_none;
 }
@@ -488,11 +643,13 @@ STATIC const mp_map_elem_t mach_can_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),              (mp_obj_t)&mach_can_deinit_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_send),                (mp_obj_t)&mach_can_send_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv),                (mp_obj_t)&mach_can_recv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_into),           (mp_obj_t)&mach_can_recv_into_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_soft_filter),         (mp_obj_t)&mach_can_soft_filter_obj },
     // { MP_OBJ_NEW_QSTR(MP_QSTR_hard_filter),         (mp_obj_t)&mach_can_hard_filter_obj },
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_callback),            (mp_obj_t)&mach_can_callback_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_events),              (mp_obj_t)&mach_can_events_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stats),               (mp_obj_t)&mach_can_stats_obj },
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_NORMAL),              MP_OBJ_NEW_SMALL_INT(CAN_mode_normal) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_SILENT),              MP_OBJ_NEW_SMALL_INT(CAN_mode_listen_only) },
@@ -508,6 +665,8 @@ STATIC const mp_map_elem_t mach_can_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_FILTER_LIST),         MP_OBJ_NEW_SMALL_INT(CAN_FILTER_LIST) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_FILTER_RANGE),        MP_OBJ_NEW_SMALL_INT(CAN_FILTER_RANGE) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_FILTER_MASK),         MP_OBJ_NEW_SMALL_INT(CAN_FILTER_MASK) },
+
+    { MP_OBJ_NEW_QSTR(MP_QSTR_FRAME_SIZE),          MP_OBJ_NEW_SMALL_INT(MACH_CAN_FRAME_SIZE) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mach_can_locals_dict, mach_can_locals_dict_table);
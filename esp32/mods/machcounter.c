@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <string.h>
+
+#include "py/mpstate.h"
+#include "py/runtime.h"
+#include "py/obj.h"
+#include "py/mperrno.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "driver/pcnt.h"
+#include "soc/pcnt_struct.h"
+#include "machpin.h"
+#include "machcounter.h"
+#include "mpexception.h"
+#include "util/mpirq.h"
+
+/******************************************************************************
+ DEFINE PRIVATE CONSTANTS
+ ******************************************************************************/
+#define COUNTER_MODE_PULSES                 (0)
+#define COUNTER_MODE_QUADRATURE             (1)
+#define COUNTER_MODE_CAPTURE                (2)
+
+#define COUNTER_EDGE_RISING                 (0x01)
+#define COUNTER_EDGE_FALLING                (0x02)
+
+#define COUNTER_EVENT_THRESHOLD0            (0x01)
+#define COUNTER_EVENT_THRESHOLD1            (0x02)
+#define COUNTER_EVENT_ZERO                  (0x04)
+
+/* Latched events in PCNT_Un_STATUS_REG */
+#define COUNTER_STATUS_THRES1               (BIT(2))
+#define COUNTER_STATUS_THRES0               (BIT(3))
+#define COUNTER_STATUS_L_LIM                (BIT(4))
+#define COUNTER_STATUS_H_LIM                (BIT(5))
+#define COUNTER_STATUS_ZERO                 (BIT(6))
+
+/* The hardware counts on 16 bits, it's extended in software each time it reaches a limit and restarts from 0 */
+#define COUNTER_H_LIM                       (32767)
+#define COUNTER_L_LIM                       (-32768)
+
+#define COUNTER_FILTER_MAX_CYCLES           (1023)
+#define COUNTER_APB_CLK_MHZ                 (80)
+#define COUNTER_CAPTURE_BUFFER_DEF          (256)
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+/* State used by the ISR, outside of the MicroPython heap which can be in the PSRAM */
+typedef struct {
+    mp_obj_t obj;                           // Given to the interrupt task, not used by the ISR
+    volatile int32_t accum;                 // Counts not in the hardware counter anymore
+    int16_t h_lim;
+    int16_t l_lim;
+    volatile uint8_t events;                // COUNTER_EVENT_* raised since the last events() call
+    bool irq;
+    // timestamps in us of the edges in the capture mode
+    uint32_t *ring;
+    uint32_t ring_size;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t overruns;
+} mach_counter_unit_t;
+
+typedef struct {
+    mp_obj_base_t base;
+    mp_obj_t handler;
+    mp_obj_t handler_arg;
+    pcnt_unit_t unit;
+    uint8_t mode;
+    bool active;
+} mach_counter_obj_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+STATIC DRAM_ATTR mach_counter_unit_t mach_counter_units[PCNT_UNIT_MAX];
+STATIC pcnt_isr_handle_t mach_counter_isr_handle = NULL;
+
+/******************************************************************************
+ DECLARE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC void mach_counter_release(mach_counter_obj_t *self);
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void machcounter_deinit_all (void) {
+    // the capture buffers are outside of the heap of the previous session, they must be freed
+    for (int i = 0; i < PCNT_UNIT_MAX; i++) {
+        if (MP_STATE_PORT(mach_counter_obj)[i] != MP_OBJ_NULL) {
+            mach_counter_release(MP_STATE_PORT(mach_counter_obj)[i]);
+        }
+    }
+}
+
+bool machcounter_any_active (void) {
+    // the PCNT is clocked by the APB, it would miss the edges in light sleep
+    for (int i = 0; i < PCNT_UNIT_MAX; i++) {
+        if (MP_STATE_PORT(mach_counter_obj)[i] != MP_OBJ_NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC void mach_counter_irq_handler(void *arg) {
+    // this function will be called by the interrupt thread
+    mach_counter_obj_t *self = arg;
+    if (self->handler != mp_const_none) {
+        mp_call_function_1(self->handler, self->handler_arg);
+    }
+}
+
+STATIC IRAM_ATTR void mach_counter_process_unit(pcnt_unit_t unit) {
+    mach_counter_unit_t *u = &mach_counter_units[unit];
+    uint32_t status = PCNT.status_unit[unit].val;
+    uint8_t events = 0;
+
+    PCNT.int_clr.val = BIT(unit);
+
+    if (status & COUNTER_STATUS_H_LIM) {
+        u->accum += u->h_lim;
+        if (u->ring != NULL) {
+            uint32_t next = (u->head + 1) % u->ring_size;
+            if (next == u->tail) {
+                u->overruns++;
+            } else {
+                u->ring[u->head] = (uint32_t)esp_timer_get_time();
+                u->head = next;
+            }
+        }
+    }
+    if (status & COUNTER_STATUS_L_LIM) {
+        u->accum += u->l_lim;
+    }
+    if (status & COUNTER_STATUS_THRES0) {
+        events |= COUNTER_EVENT_THRESHOLD0;
+    }
+    if (status & COUNTER_STATUS_THRES1) {
+        events |= COUNTER_EVENT_THRESHOLD1;
+    }
+    if (status & COUNTER_STATUS_ZERO) {
+        events |= COUNTER_EVENT_ZERO;
+    }
+    if (events && u->irq) {
+        u->events |= events;
+        mp_irq_queue_interrupt(mach_counter_irq_handler, u->obj);
+    }
+}
+
+STATIC IRAM_ATTR void mach_counter_isr(void *arg) {
+    uint32_t status = PCNT.int_st.val;
+
+    for (int unit = 0; unit < PCNT_UNIT_MAX; unit++) {
+        if (status & BIT(unit)) {
+            mach_counter_process_unit(unit);
+        }
+    }
+}
+
+STATIC void mach_counter_release(mach_counter_obj_t *self) {
+    mach_counter_unit_t *u = &mach_counter_units[self->unit];
+
+    pcnt_intr_disable(self->unit);
+    pcnt_counter_pause(self->unit);
+    uint32_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    uint32_t *ring = u->ring;
+    u->ring = NULL;
+    u->irq = false;
+    u->obj = MP_OBJ_NULL;
+    MICROPY_END_ATOMIC_SECTION(state);
+    if (ring != NULL) {
+        heap_caps_free(ring);
+    }
+    if (self->handler != mp_const_none) {
+        mp_irq_remove(self);
+        INTERRUPT_OBJ_CLEAN(self);
+        self->handler = mp_const_none;
+    }
+    MP_STATE_PORT(mach_counter_obj)[self->unit] = MP_OBJ_NULL;
+    self->active = false;
+}
+
+STATIC mach_counter_obj_t *mach_counter_get(mp_obj_t self_in) {
+    mach_counter_obj_t *self = self_in;
+    if (!self->active) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+    return self;
+}
+
+// the total count, the hardware counter restarting from 0 at the limits
+STATIC int32_t mach_counter_read(mach_counter_obj_t *self) {
+    int16_t count;
+    uint32_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    pcnt_get_counter_value(self->unit, &count);
+    if (PCNT.int_st.val & BIT(self->unit)) {
+        // a limit was reached but its interrupt is masked by the atomic section, it's processed here
+        mach_counter_process_unit(self->unit);
+        pcnt_get_counter_value(self->unit, &count);
+    }
+    int32_t value = mach_counter_units[self->unit].accum + count;
+    MICROPY_END_ATOMIC_SECTION(state);
+    return value;
+}
+
+STATIC bool mach_counter_config_channel(pcnt_unit_t unit, pcnt_channel_t channel, int pulse, int ctrl, pcnt_count_mode_t pos,
+                                        pcnt_count_mode_t neg, pcnt_ctrl_mode_t lctrl, pcnt_ctrl_mode_t hctrl) {
+    mach_counter_unit_t *u = &mach_counter_units[unit];
+    pcnt_config_t config = {
+        .pulse_gpio_num = pulse,
+        .ctrl_gpio_num = ctrl,
+        .lctrl_mode = lctrl,
+        .hctrl_mode = hctrl,
+        .pos_mode = pos,
+        .neg_mode = neg,
+        .counter_h_lim = u->h_lim,
+        .counter_l_lim = u->l_lim,
+        .unit = unit,
+        .channel = channel,
+    };
+    return (pcnt_unit_config(&config) == ESP_OK);
+}
+
+/******************************************************************************/
+// Micro Python bindings
+
+STATIC const mp_arg_t mach_counter_init_args[] = {
+    { MP_QSTR_id,                       MP_ARG_REQUIRED | MP_ARG_INT, },
+    { MP_QSTR_pin,                      MP_ARG_REQUIRED | MP_ARG_OBJ, },
+    { MP_QSTR_mode,                     MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = COUNTER_MODE_PULSES} },
+    { MP_QSTR_edge,                     MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = COUNTER_EDGE_RISING} },
+    { MP_QSTR_pin_b,                    MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    { MP_QSTR_filter_ns,                MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0} },
+    { MP_QSTR_buffer_size,              MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = COUNTER_CAPTURE_BUFFER_DEF} },
+};
+
+STATIC mp_obj_t mach_counter_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args) {
+    // parse args
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, all_args + n_args);
+    mp_arg_val_t args[MP_ARRAY_SIZE(mach_counter_init_args)];
+    mp_arg_parse_all(n_args, all_args, &kw_args, MP_ARRAY_SIZE(args), mach_counter_init_args, args);
+
+    mp_int_t unit = args[0].u_int;
+    mp_int_t mode = args[2].u_int;
+    mp_int_t edge = args[3].u_int;
+    mp_int_t filter = (args[5].u_int * COUNTER_APB_CLK_MHZ) / 1000;
+    if (unit < 0 || unit >= PCNT_UNIT_MAX || mode < COUNTER_MODE_PULSES || mode > COUNTER_MODE_CAPTURE ||
+        edge < COUNTER_EDGE_RISING || edge > (COUNTER_EDGE_RISING | COUNTER_EDGE_FALLING) ||
+        filter < 0 || filter > COUNTER_FILTER_MAX_CYCLES || args[6].u_int < 2) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    if ((mode == COUNTER_MODE_QUADRATURE) != (args[4].u_obj != mp_const_none)) {
+        // pin_b is the second phase of a quadrature encoder, and only that
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    pin_obj_t *pin = pin_find(args[1].u_obj);
+    pin_obj_t *pin_b = (args[4].u_obj != mp_const_none) ? pin_find(args[4].u_obj) : NULL;
+
+    // a previous counter on the same unit stops counting
+    if (MP_STATE_PORT(mach_counter_obj)[unit] != MP_OBJ_NULL) {
+        mach_counter_release(MP_STATE_PORT(mach_counter_obj)[unit]);
+    }
+
+    mach_counter_obj_t *self = m_new_obj(mach_counter_obj_t);
+    self->base.type = &mach_counter_type;
+    self->handler = mp_const_none;
+    self->handler_arg = mp_const_none;
+    self->unit = unit;
+    self->mode = mode;
+
+    mach_counter_unit_t *u = &mach_counter_units[unit];
+    memset(u, 0, sizeof(*u));
+    // keep the counter alive while its unit is used, so that the capture buffer is freed
+    u->obj = self;
+    MP_STATE_PORT(mach_counter_obj)[unit] = self;
+    if (mode == COUNTER_MODE_CAPTURE) {
+        // every edge reaches the high limit, its interrupt takes the timestamp
+        u->h_lim = 1;
+        u->l_lim = -1;
+        u->ring_size = args[6].u_int;
+        u->ring = heap_caps_malloc(u->ring_size * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_32BIT);
+        if (u->ring == NULL) {
+            mach_counter_release(self);
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    } else {
+        u->h_lim = COUNTER_H_LIM;
+        u->l_lim = COUNTER_L_LIM;
+    }
+
+    bool configured;
+    if (mode == COUNTER_MODE_QUADRATURE) {
+        // x4 decoding: both edges of both phases are counted, the other phase gives the direction
+        configured = mach_counter_config_channel(unit, PCNT_CHANNEL_0, pin->pin_number, pin_b->pin_number,
+                                                 PCNT_COUNT_DEC, PCNT_COUNT_INC, PCNT_MODE_REVERSE, PCNT_MODE_KEEP) &&
+                     mach_counter_config_channel(unit, PCNT_CHANNEL_1, pin_b->pin_number, pin->pin_number,
+                                                 PCNT_COUNT_INC, PCNT_COUNT_DEC, PCNT_MODE_REVERSE, PCNT_MODE_KEEP);
+    } else {
+        configured = mach_counter_config_channel(unit, PCNT_CHANNEL_0, pin->pin_number, PCNT_PIN_NOT_USED,
+                                                 (edge & COUNTER_EDGE_RISING) ? PCNT_COUNT_INC : PCNT_COUNT_DIS,
+                                                 (edge & COUNTER_EDGE_FALLING) ? PCNT_COUNT_INC : PCNT_COUNT_DIS,
+                                                 PCNT_MODE_KEEP, PCNT_MODE_KEEP) &&
+                     mach_counter_config_channel(unit, PCNT_CHANNEL_1, PCNT_PIN_NOT_USED, PCNT_PIN_NOT_USED,
+                                                 PCNT_COUNT_DIS, PCNT_COUNT_DIS, PCNT_MODE_KEEP, PCNT_MODE_KEEP);
+    }
+    if (!configured) {
+        mach_counter_release(self);
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+
+    // the glitches shorter than the filter are ignored
+    if (filter > 0) {
+        pcnt_set_filter_value(unit, filter);
+        pcnt_filter_enable(unit);
+    } else {
+        pcnt_filter_disable(unit);
+    }
+
+    if (mach_counter_isr_handle == NULL) {
+        if (pcnt_isr_register(mach_counter_isr, NULL, ESP_INTR_FLAG_IRAM, &mach_counter_isr_handle) != ESP_OK) {
+            mach_counter_release(self);
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_resource_not_avaliable));
+        }
+    }
+
+    pcnt_counter_pause(unit);
+    pcnt_counter_clear(unit);
+    pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+    pcnt_event_enable(unit, PCNT_EVT_L_LIM);
+    pcnt_intr_enable(unit);
+    pcnt_counter_resume(unit);
+    self->active = true;
+
+    return self;
+}
+
+STATIC mp_obj_t mach_counter_deinit(mp_obj_t self_in) {
+    mach_counter_obj_t *self = self_in;
+    if (self->active) {
+        mach_counter_release(self);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_counter_deinit_obj, mach_counter_deinit);
+
+STATIC mp_obj_t mach_counter_value(mp_uint_t n_args, const mp_obj_t *args) {
+    mach_counter_obj_t *self = mach_counter_get(args[0]);
+    if (n_args == 1) {
+        return mp_obj_new_int(mach_counter_read(self));
+    }
+    // the hardware counter can only be cleared, the value given is kept in the software part
+    int32_t value = mp_obj_get_int(args[1]);
+    uint32_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    pcnt_counter_clear(self->unit);
+    PCNT.int_clr.val = BIT(self->unit);
+    mach_counter_units[self->unit].accum = value;
+    MICROPY_END_ATOMIC_SECTION(state);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mach_counter_value_obj, 1, 2, mach_counter_value);
+
+STATIC mp_obj_t mach_counter_pause(mp_obj_t self_in) {
+    mach_counter_obj_t *self = mach_counter_get(self_in);
+    pcnt_counter_pause(self->unit);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_counter_pause_obj, mach_counter_pause);
+
+STATIC mp_obj_t mach_counter_resume(mp_obj_t self_in) {
+    mach_counter_obj_t *self = mach_counter_get(self_in);
+    pcnt_counter_resume(self->unit);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_counter_resume_obj, mach_counter_resume);
+
+// called when the hardware counter reaches a threshold or 0, the thresholds are compared with the 16-bit
+// hardware counter which restarts from 0 at +32767 and -32768
+STATIC mp_obj_t mach_counter_callback(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t mach_counter_callback_args[] = {
+        { MP_QSTR_handler,                  MP_ARG_OBJ,                   {.u_obj = mp_const_none} },
+        { MP_QSTR_threshold0,               MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_threshold1,               MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_zero,                     MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_arg,                      MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(mach_counter_callback_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), mach_counter_callback_args, args);
+
+    mach_counter_obj_t *self = mach_counter_get(pos_args[0]);
+    mach_counter_unit_t *u = &mach_counter_units[self->unit];
+    mp_int_t thresholds[2] = { 0, 0 };
+    for (int i = 0; i < 2; i++) {
+        if (args[1 + i].u_obj != mp_const_none) {
+            thresholds[i] = mp_obj_get_int(args[1 + i].u_obj);
+            if (thresholds[i] <= u->l_lim || thresholds[i] >= u->h_lim) {
+                mp_raise_ValueError(mpexception_value_invalid_arguments);
+            }
+        }
+    }
+
+    pcnt_event_disable(self->unit, PCNT_EVT_THRES_0);
+    pcnt_event_disable(self->unit, PCNT_EVT_THRES_1);
+    pcnt_event_disable(self->unit, PCNT_EVT_ZERO);
+    u->irq = false;
+    u->events = 0;
+    if (self->handler != mp_const_none) {
+        mp_irq_remove(self);
+    }
+    self->handler = args[0].u_obj;
+    self->handler_arg = (args[4].u_obj == mp_const_none) ? self : args[4].u_obj;
+
+    if (self->handler != mp_const_none) {
+        mp_irq_add(self, self->handler);
+        u->irq = true;
+        if (args[1].u_obj != mp_const_none) {
+            pcnt_set_event_value(self->unit, PCNT_EVT_THRES_0, thresholds[0]);
+            pcnt_event_enable(self->unit, PCNT_EVT_THRES_0);
+        }
+        if (args[2].u_obj != mp_const_none) {
+            pcnt_set_event_value(self->unit, PCNT_EVT_THRES_1, thresholds[1]);
+            pcnt_event_enable(self->unit, PCNT_EVT_THRES_1);
+        }
+        if (args[3].u_bool) {
+            pcnt_event_enable(self->unit, PCNT_EVT_ZERO);
+        }
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_counter_callback_obj, 1, mach_counter_callback);
+
+// the COUNTER_EVENT_* raised since the previous call
+STATIC mp_obj_t mach_counter_events(mp_obj_t self_in) {
+    mach_counter_obj_t *self = mach_counter_get(self_in);
+    uint32_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    uint8_t events = mach_counter_units[self->unit].events;
+    mach_counter_units[self->unit].events = 0;
+    MICROPY_END_ATOMIC_SECTION(state);
+    return MP_OBJ_NEW_SMALL_INT(events);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_counter_events_obj, mach_counter_events);
+
+// copies the captured timestamps (us, from esp_timer) into buf, array('I') or 4 bytes each, returns how many
+STATIC mp_obj_t mach_counter_read_timestamps(mp_obj_t self_in, mp_obj_t buf_in) {
+    mach_counter_obj_t *self = mach_counter_get(self_in);
+    mach_counter_unit_t *u = &mach_counter_units[self->unit];
+    if (self->mode != COUNTER_MODE_CAPTURE) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_WRITE);
+
+    uint32_t *dest = bufinfo.buf;
+    mp_uint_t max = bufinfo.len / sizeof(uint32_t);
+    mp_uint_t n = 0;
+    uint32_t tail = u->tail;
+    while (n < max && tail != u->head) {
+        memcpy(&dest[n++], &u->ring[tail], sizeof(uint32_t));
+        tail = (tail + 1) % u->ring_size;
+    }
+    u->tail = tail;
+    return mp_obj_new_int(n);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_counter_read_timestamps_obj, mach_counter_read_timestamps);
+
+// returns and clears the number of timestamps lost because the buffer was full
+STATIC mp_obj_t mach_counter_overruns(mp_obj_t self_in) {
+    mach_counter_obj_t *self = mach_counter_get(self_in);
+    uint32_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    uint32_t overruns = mach_counter_units[self->unit].overruns;
+    mach_counter_units[self->unit].overruns = 0;
+    MICROPY_END_ATOMIC_SECTION(state);
+    return mp_obj_new_int_from_uint(overruns);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_counter_overruns_obj, mach_counter_overruns);
+
+STATIC void mach_counter_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    mach_counter_obj_t *self = self_in;
+    static const char *modes[] = { "PULSES", "QUADRATURE", "CAPTURE" };
+    mp_printf(print, "Counter(%u, mode=Counter.%s)", self->unit, modes[self->mode]);
+}
+
+STATIC const mp_map_elem_t mach_counter_locals_dict_table[] = {
+    // instance methods
+    { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),              (mp_obj_t)&mach_counter_deinit_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_value),               (mp_obj_t)&mach_counter_value_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_pause),               (mp_obj_t)&mach_counter_pause_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_resume),              (mp_obj_t)&mach_counter_resume_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_callback),            (mp_obj_t)&mach_counter_callback_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_events),              (mp_obj_t)&mach_counter_events_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_read_timestamps),     (mp_obj_t)&mach_counter_read_timestamps_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_overruns),            (mp_obj_t)&mach_counter_overruns_obj },
+
+    // class constants
+    { MP_OBJ_NEW_QSTR(MP_QSTR_PULSES),              MP_OBJ_NEW_SMALL_INT(COUNTER_MODE_PULSES) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_QUADRATURE),          MP_OBJ_NEW_SMALL_INT(COUNTER_MODE_QUADRATURE) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_CAPTURE),             MP_OBJ_NEW_SMALL_INT(COUNTER_MODE_CAPTURE) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_RISING),              MP_OBJ_NEW_SMALL_INT(COUNTER_EDGE_RISING) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_FALLING),             MP_OBJ_NEW_SMALL_INT(COUNTER_EDGE_FALLING) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_EVENT_THRESHOLD0),    MP_OBJ_NEW_SMALL_INT(COUNTER_EVENT_THRESHOLD0) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_EVENT_THRESHOLD1),    MP_OBJ_NEW_SMALL_INT(COUNTER_EVENT_THRESHOLD1) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_EVENT_ZERO),          MP_OBJ_NEW_SMALL_INT(COUNTER_EVENT_ZERO) },
+};
+STATIC MP_DEFINE_CONST_DICT(mach_counter_locals_dict, mach_counter_locals_dict_table);
+
+const mp_obj_type_t mach_counter_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Counter,
+    .print = mach_counter_print,
+    .make_new = mach_counter_make_new,
+    .locals_dict = (mp_obj_t)&mach_counter_locals_dict,
+};
@@ -40,6 +40,7 @@
 
 #include "py/mpstate.h"
 #include "py/runtime.h"
+#include "py/mperrno.h"
 #include "bufhelper.h"
 
 #include "esp_heap_caps.h"
@@ -56,6 +57,7 @@
 #include "machpin.h"
 #include "pins.h"
 #include "mpexception.h"
+#include "mpirq.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -71,13 +73,45 @@ typedef struct _machine_i2c_obj_t {
     pin_obj_t *scl;
     pin_obj_t *sda;
     uint8_t bus_id;
+    uint8_t mode;
+    uint16_t slave_addr;
+    // slave mode, a task moves what the master writes from the driver into the ring
+    uint8_t *rx_ring;
+    uint32_t rx_size;
+    volatile uint32_t rx_head;
+    volatile uint32_t rx_tail;
+    uint32_t rx_dropped;
+    TaskHandle_t slave_task;
+    volatile bool slave_running;
+    mp_obj_t handler;
 } machine_i2c_obj_t;
 
 #define MACHI2C_MASTER                          (0)
+#define MACHI2C_SLAVE                           (1)
+
+#define MACHI2C_SLAVE_BUF_DEF                   (256)
+#define MACHI2C_SLAVE_CHUNK                     (64)
+#define MACHI2C_SLAVE_TASK_STACK                (2048)
+#define MACHI2C_SLAVE_TASK_PRIORITY             (6)
+// while idle, how often the task checks that it must keep running
+#define MACHI2C_SLAVE_POLL_MS                   (20)
+// a write of the master is over once nothing has come for this long
+#define MACHI2C_SLAVE_GAP_MS                    (2)
 #define I2C_ACK_CHECK_EN                        (1)
 #define I2C_ACK_VAL                             (0)
 #define I2C_NACK_VAL                            (1)
 
+// transaction operations
+#define MACHI2C_OP_WRITE                        (0)
+#define MACHI2C_OP_READ                         (1)
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    uint16_t addr;
+    bool read;
+} machine_i2c_op_t;
+
 
 STATIC void mp_hal_i2c_stop(machine_i2c_obj_t *self);
 
@@ -349,6 +383,121 @@ STATIC void hw_i2c_initialise_master (machine_i2c_obj_t *i2c_obj) {
     i2c_driver_install(i2c_obj->bus_id, I2C_MODE_MASTER, 0, 0, 0);
 }
 
+STATIC void hw_i2c_slave_handler (void *arg) {
+    // this function will be called by the interrupt thread
+    machine_i2c_obj_t *self = arg;
+    if (self->handler != mp_const_none) {
+        mp_call_function_1(self->handler, self);
+    }
+}
+
+STATIC void hw_i2c_slave_push (machine_i2c_obj_t *self, const uint8_t *data, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        uint32_t next = (self->rx_head + 1) % self->rx_size;
+        if (next == self->rx_tail) {
+            // not read fast enough
+            self->rx_dropped += len - i;
+            return;
+        }
+        self->rx_ring[self->rx_head] = data[i];
+        self->rx_head = next;
+    }
+}
+
+// the driver's ISR fills its own ring buffer from the FIFO, this task splits it in the messages of the master
+STATIC void TASK_I2C_Slave (void *pvParameters) {
+    machine_i2c_obj_t *self = pvParameters;
+    uint8_t chunk[MACHI2C_SLAVE_CHUNK];
+    bool receiving = false;
+    while (self->slave_running) {
+        int n;
+        if (receiving) {
+            n = i2c_slave_read_buffer(self->bus_id, chunk, sizeof(chunk), MAX(MACHI2C_SLAVE_GAP_MS / portTICK_PERIOD_MS, 1));
+        } else {
+            // returns as soon as the first byte of a message comes
+            n = i2c_slave_read_buffer(self->bus_id, chunk, 1, MACHI2C_SLAVE_POLL_MS / portTICK_PERIOD_MS);
+        }
+        if (n > 0) {
+            hw_i2c_slave_push(self, chunk, n);
+        }
+        if (n > 0 && (!receiving || n == sizeof(chunk))) {
+            receiving = true;
+        } else if (receiving) {
+            receiving = false;
+            if (self->handler != mp_const_none) {
+                mp_irq_queue_interrupt_non_ISR(hw_i2c_slave_handler, self);
+            }
+        }
+    }
+    self->slave_task = NULL;
+    vTaskDelete(NULL);
+}
+
+STATIC bool hw_i2c_initialise_slave (machine_i2c_obj_t *i2c_obj, uint32_t rx_buf_len, uint32_t tx_buf_len) {
+
+    i2c_config_t conf;
+
+    conf.mode = I2C_MODE_SLAVE;
+    conf.sda_io_num = i2c_obj->sda->pin_number;
+    conf.scl_io_num = i2c_obj->scl->pin_number;
+    conf.sda_pullup_en = GPIO_PULLUP_ENABLE;
+    conf.scl_pullup_en = GPIO_PULLUP_ENABLE;
+    conf.slave.addr_10bit_en = 0;
+    conf.slave.slave_addr = i2c_obj->slave_addr;
+
+    i2c_obj->rx_ring = heap_caps_malloc(rx_buf_len, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (i2c_obj->rx_ring == NULL) {
+        return false;
+    }
+    i2c_obj->rx_size = rx_buf_len;
+    i2c_obj->rx_head = i2c_obj->rx_tail = 0;
+    i2c_obj->rx_dropped = 0;
+
+    i2c_param_config(i2c_obj->bus_id, &conf);
+    if (i2c_driver_install(i2c_obj->bus_id, I2C_MODE_SLAVE, rx_buf_len, tx_buf_len, 0) != ESP_OK) {
+        heap_caps_free(i2c_obj->rx_ring);
+        i2c_obj->rx_ring = NULL;
+        return false;
+    }
+    i2c_obj->slave_running = true;
+    if (xTaskCreatePinnedToCore(TASK_I2C_Slave, "I2C_Slave", MACHI2C_SLAVE_TASK_STACK / sizeof(StackType_t), i2c_obj,
+                                MACHI2C_SLAVE_TASK_PRIORITY, &i2c_obj->slave_task, 1) != pdPASS) {
+        i2c_obj->slave_running = false;
+        i2c_obj->slave_task = NULL;
+        i2c_driver_delete(i2c_obj->bus_id);
+        heap_caps_free(i2c_obj->rx_ring);
+        i2c_obj->rx_ring = NULL;
+        return false;
+    }
+    return true;
+}
+
+// stops the task and the driver, the caller deletes the driver in master mode
+STATIC void hw_i2c_slave_stop (machine_i2c_obj_t *i2c_obj) {
+    if (i2c_obj->slave_task != NULL) {
+        i2c_obj->slave_running = false;
+        MP_THREAD_GIL_EXIT();
+        while (i2c_obj->slave_task != NULL) {
+            vTaskDelay(1);
+        }
+        MP_THREAD_GIL_ENTER();
+    }
+    if (i2c_obj->rx_ring != NULL) {
+        heap_caps_free(i2c_obj->rx_ring);
+        i2c_obj->rx_ring = NULL;
+    }
+    mp_irq_remove(i2c_obj);
+    i2c_obj->handler = mp_const_none;
+}
+
+// runs the queued commands, letting the other threads run until the transfer is done
+STATIC esp_err_t hw_i2c_master_cmd_begin(machine_i2c_obj_t *i2c_obj, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait) {
+    MP_THREAD_GIL_EXIT();
+    esp_err_t ret = i2c_master_cmd_begin(i2c_obj->bus_id, cmd, ticks_to_wait);
+    MP_THREAD_GIL_ENTER();
+    return ret;
+}
+
 STATIC void hw_i2c_master_writeto(machine_i2c_obj_t *i2c_obj, uint16_t slave_addr, uint32_t memaddr, uint8_t addr_size, uint8_t *data, uint16_t len, bool stop) {
 
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
@@ -368,7 +517,7 @@ STATIC void hw_i2c_master_writeto(machine_i2c_obj_t *i2c_obj, uint16_t slave_add
         ESP_ERROR_CHECK(i2c_master_stop(cmd));
     }
 
-    esp_err_t ret = i2c_master_cmd_begin(i2c_obj->bus_id, cmd, (5000 + (1000 * len)) / portTICK_RATE_MS);
+    esp_err_t ret = hw_i2c_master_cmd_begin(i2c_obj, cmd, (5000 + (1000 * len)) / portTICK_RATE_MS);
     i2c_cmd_link_delete(cmd);
 
     if (ret != ESP_OK) {
@@ -402,7 +551,7 @@ STATIC void hw_i2c_master_readfrom(machine_i2c_obj_t *i2c_obj, uint16_t slave_ad
     ESP_ERROR_CHECK(i2c_master_read_byte(cmd, data + len - 1, I2C_NACK_VAL));
     ESP_ERROR_CHECK(i2c_master_stop(cmd));
 
-    esp_err_t ret = i2c_master_cmd_begin(i2c_obj->bus_id, cmd, (5000 + (1000 * len)) / portTICK_RATE_MS);
+    esp_err_t ret = hw_i2c_master_cmd_begin(i2c_obj, cmd, (5000 + (1000 * len)) / portTICK_RATE_MS);
     i2c_cmd_link_delete(cmd);
 
     if (ret != ESP_OK) {
@@ -415,12 +564,74 @@ STATIC bool hw_i2c_slave_ping (machine_i2c_obj_t *i2c_obj, uint16_t slave_addr)
     ESP_ERROR_CHECK(i2c_master_start(cmd));
     ESP_ERROR_CHECK(i2c_master_write_byte(cmd, (slave_addr << 1) | I2C_MASTER_WRITE, I2C_ACK_CHECK_EN));
     ESP_ERROR_CHECK(i2c_master_stop(cmd));
-    esp_err_t ret = i2c_master_cmd_begin(i2c_obj->bus_id, cmd, 5000 / portTICK_RATE_MS);
+    esp_err_t ret = hw_i2c_master_cmd_begin(i2c_obj, cmd, 5000 / portTICK_RATE_MS);
     i2c_cmd_link_delete(cmd);
 
     return (ret == ESP_OK) ? true : false;
 }
 
+// all the operations go in a single command link, each one starts with a (repeated) start
+STATIC void hw_i2c_master_transaction(machine_i2c_obj_t *i2c_obj, machine_i2c_op_t *ops, size_t n_ops, bool stop) {
+
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    size_t total_len = 0;
+
+    for (size_t i = 0; i < n_ops; i++) {
+        machine_i2c_op_t *op = &ops[i];
+        ESP_ERROR_CHECK(i2c_master_start(cmd));
+        ESP_ERROR_CHECK(i2c_master_write_byte(cmd, (op->addr << 1) | (op->read ? I2C_MASTER_READ : I2C_MASTER_WRITE), I2C_ACK_CHECK_EN));
+        if (op->read) {
+            // the last byte of every read is NACKed as a start or the stop comes next
+            if (op->len > 1) {
+                ESP_ERROR_CHECK(i2c_master_read(cmd, op->data, op->len - 1, I2C_ACK_VAL));
+            }
+            ESP_ERROR_CHECK(i2c_master_read_byte(cmd, op->data + op->len - 1, I2C_NACK_VAL));
+        } else if (op->len > 0) {
+            ESP_ERROR_CHECK(i2c_master_write(cmd, op->data, op->len, I2C_ACK_CHECK_EN));
+        }
+        total_len += op->len;
+    }
+    if (stop) {
+        ESP_ERROR_CHECK(i2c_master_stop(cmd));
+    }
+
+    esp_err_t ret = hw_i2c_master_cmd_begin(i2c_obj, cmd, (5000 + (1000 * total_len)) / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+
+    if (ret != ESP_OK) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "I2C bus error"));
+    }
+}
+
+STATIC void mp_hal_i2c_transaction(machine_i2c_obj_t *self, machine_i2c_op_t *ops, size_t n_ops, bool stop) {
+    for (size_t i = 0; i < n_ops; i++) {
+        machine_i2c_op_t *op = &ops[i];
+        uint8_t *data = op->data;
+        size_t len = op->len;
+        mp_hal_i2c_start(self);
+        if (!mp_hal_i2c_write_byte(self, (op->addr << 1) | op->read)) {
+            goto er;
+        }
+        while (len--) {
+            if (op->read) {
+                if (!mp_hal_i2c_read_byte(self, data++, len == 0)) {
+                    goto er;
+                }
+            } else if (!mp_hal_i2c_write_byte(self, *data++)) {
+                goto er;
+            }
+        }
+    }
+    if (stop) {
+        mp_hal_i2c_stop(self);
+    }
+    return;
+
+er:
+    mp_hal_i2c_stop(self);
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "I2C bus error"));
+}
+
 STATIC void i2c_deassign_pins_af (machine_i2c_obj_t *self) {
     if (self->sda && self->scl) {
         // we must set the value to 1 so that when Rx pins are deassigned, their are hardwired to 1
@@ -446,7 +657,9 @@ STATIC void i2c_validate_address_size(uint8_t addr_size) {
 
 STATIC void machine_i2c_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
     machine_i2c_obj_t *self = self_in;
-    if (self->baudrate > 0) {
+    if (self->baudrate > 0 && self->mode == MACHI2C_SLAVE) {
+        mp_printf(print, "I2C(%u, I2C.SLAVE, addr=0x%02x)", self->bus_id, self->slave_addr);
+    } else if (self->baudrate > 0) {
         mp_printf(print, "I2C(%u, I2C.MASTER, baudrate=%u)", self->bus_id, self->baudrate);
     } else {
         mp_printf(print, "I2C(%u)", self->bus_id);
@@ -454,15 +667,21 @@ STATIC void machine_i2c_print(const mp_print_t *print, mp_obj_t self_in, mp_prin
 }
 
 STATIC mp_obj_t machine_i2c_init_helper(machine_i2c_obj_t *self, const mp_arg_val_t *args) {
-    // verify that mode is master
-    if (args[0].u_int != MACHI2C_MASTER) {
+    // only the hardware buses can be slaves
+    if (args[0].u_int != MACHI2C_MASTER && (args[0].u_int != MACHI2C_SLAVE || self->bus_id >= 2)) {
+        goto invalid_args;
+    }
+    if (args[0].u_int == MACHI2C_SLAVE && (args[3].u_int < 0x08 || args[3].u_int > 0x77 ||
+                                           args[4].u_int < MACHI2C_SLAVE_CHUNK || args[5].u_int < MACHI2C_SLAVE_CHUNK)) {
         goto invalid_args;
     }
 
     // before assigning the baudrate
     if (self->bus_id < 2) {
         if (self->baudrate > 0) {
+            hw_i2c_slave_stop(self);
             i2c_driver_delete(self->bus_id);
+            self->baudrate = 0;
         }
         i2c_deassign_pins_af(self);
     }
@@ -488,8 +707,17 @@ STATIC mp_obj_t machine_i2c_init_helper(machine_i2c_obj_t *self, const mp_arg_va
         goto invalid_args;
     }
 
-    if (self->bus_id < 2) {
+    self->mode = args[0].u_int;
+    if (self->mode == MACHI2C_SLAVE) {
+        self->slave_addr = args[3].u_int;
+        if (!hw_i2c_initialise_slave(self, args[4].u_int, args[5].u_int)) {
+            self->baudrate = 0;
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    } else if (self->bus_id < 2) {
         hw_i2c_initialise_master(self);
+    }
+    if (self->bus_id < 2) {
         // set the af values, so that deassign works later on
         if (self->sda && self->scl) {
             self->sda->af_out = mach_i2c_pin_af[self->bus_id][0];
@@ -512,6 +740,9 @@ STATIC const mp_arg_t machine_i2c_init_args[] = {
     { MP_QSTR_mode,                        MP_ARG_INT, {.u_int = MACHI2C_MASTER} },
     { MP_QSTR_baudrate,  MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 100000} },
     { MP_QSTR_pins,      MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+    { MP_QSTR_addr,      MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0x42} },
+    { MP_QSTR_rx_buf,    MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = MACHI2C_SLAVE_BUF_DEF} },
+    { MP_QSTR_tx_buf,    MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = MACHI2C_SLAVE_BUF_DEF} },
 };
 STATIC mp_obj_t machine_i2c_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args) {
     // parse args
@@ -531,6 +762,9 @@ STATIC mp_obj_t machine_i2c_make_new(const mp_obj_type_t *type, mp_uint_t n_args
     machine_i2c_obj_t *self = &mach_i2c_obj[bus_id];
     self->base.type = &machine_i2c_type;
     self->bus_id = bus_id;
+    if (self->handler == MP_OBJ_NULL) {
+        self->handler = mp_const_none;
+    }
 
     // start the peripheral
     machine_i2c_init_helper(self, &args[1]);
@@ -735,12 +969,81 @@ STATIC mp_obj_t machine_i2c_writeto_mem(size_t n_args, const mp_obj_t *pos_args,
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(machine_i2c_writeto_mem_obj, 1, machine_i2c_writeto_mem);
 
+// runs a sequence of (I2C.WRITE, addr, buf) and (I2C.READ, addr, buf or nbytes) operations as a single
+// bus transaction, returns the list of the read buffers in the order of the reads
+STATIC mp_obj_t machine_i2c_transaction(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_ops, ARG_stop };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_ops,      MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_stop,     MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = true} },
+    };
+    machine_i2c_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    size_t n_ops;
+    mp_obj_t *items;
+    mp_obj_get_array(args[ARG_ops].u_obj, &n_ops, &items);
+    if (n_ops == 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+
+    machine_i2c_op_t *ops = m_new(machine_i2c_op_t, n_ops);
+    mp_obj_t results = mp_obj_new_list(0, NULL);
+
+    for (size_t i = 0; i < n_ops; i++) {
+        mp_obj_t *op_items;
+        mp_obj_get_array_fixed_n(items[i], 3, &op_items);
+        mp_int_t type = mp_obj_get_int(op_items[0]);
+        ops[i].addr = mp_obj_get_int(op_items[1]);
+        if (type == MACHI2C_OP_WRITE) {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(op_items[2], &bufinfo, MP_BUFFER_READ);
+            ops[i].data = bufinfo.buf;
+            ops[i].len = bufinfo.len;
+            ops[i].read = false;
+        } else if (type == MACHI2C_OP_READ) {
+            mp_obj_t buf = op_items[2];
+            if (MP_OBJ_IS_SMALL_INT(buf)) {
+                // no buffer given, a new one is returned
+                mp_int_t len = MP_OBJ_SMALL_INT_VALUE(buf);
+                if (len < 0) {
+                    len = 0;
+                }
+                buf = mp_obj_new_bytearray_by_ref(len, m_new(uint8_t, len));
+            }
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(buf, &bufinfo, MP_BUFFER_WRITE);
+            if (bufinfo.len == 0) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+            }
+            ops[i].data = bufinfo.buf;
+            ops[i].len = bufinfo.len;
+            ops[i].read = true;
+            mp_obj_list_append(results, buf);
+        } else {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+        }
+    }
+
+    if (self->bus_id < 2) {
+        hw_i2c_master_transaction(self, ops, n_ops, args[ARG_stop].u_bool);
+    } else {
+        mp_hal_i2c_transaction(self, ops, n_ops, args[ARG_stop].u_bool);
+    }
+    m_del(machine_i2c_op_t, ops, n_ops);
+
+    return results;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(machine_i2c_transaction_obj, 1, machine_i2c_transaction);
+
 STATIC mp_obj_t machine_i2c_deinit(mp_obj_t self_in) {
     machine_i2c_obj_t *self = self_in;
 
     if (self->baudrate > 0) {
         // before assigning the baudrate
         if (self->bus_id < 2) {
+            hw_i2c_slave_stop(self);
             i2c_driver_delete(self->bus_id);
             i2c_deassign_pins_af(self);
         }
@@ -752,6 +1055,99 @@ STATIC mp_obj_t machine_i2c_deinit(mp_obj_t self_in) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(machine_i2c_deinit_obj, machine_i2c_deinit);
 
+STATIC machine_i2c_obj_t *machine_i2c_get_slave(mp_obj_t self_in) {
+    machine_i2c_obj_t *self = self_in;
+    if (self->baudrate == 0 || self->mode != MACHI2C_SLAVE) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+    return self;
+}
+
+/// \method any()
+/// Slave mode, returns the number of bytes written by the master not read yet.
+STATIC mp_obj_t machine_i2c_any(mp_obj_t self_in) {
+    machine_i2c_obj_t *self = machine_i2c_get_slave(self_in);
+    return MP_OBJ_NEW_SMALL_INT((self->rx_head + self->rx_size - self->rx_tail) % self->rx_size);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(machine_i2c_any_obj, machine_i2c_any);
+
+/// \method readinto(buf, *, timeout=0)
+/// Slave mode, reads what the master wrote, waiting up to timeout ms for the first bytes.
+/// Returns the number of bytes read.
+STATIC mp_obj_t machine_i2c_readinto(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t machine_i2c_readinto_args[] = {
+        { MP_QSTR_buf,      MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_timeout,  MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(machine_i2c_readinto_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), machine_i2c_readinto_args, args);
+
+    machine_i2c_obj_t *self = machine_i2c_get_slave(pos_args[0]);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_WRITE);
+
+    if (self->rx_head == self->rx_tail && args[1].u_int > 0) {
+        TickType_t start = xTaskGetTickCount();
+        MP_THREAD_GIL_EXIT();
+        while (self->rx_head == self->rx_tail && (xTaskGetTickCount() - start) < (args[1].u_int / portTICK_PERIOD_MS)) {
+            vTaskDelay(1);
+        }
+        MP_THREAD_GIL_ENTER();
+    }
+
+    uint8_t *buf = bufinfo.buf;
+    mp_uint_t n = 0;
+    while (n < bufinfo.len && self->rx_tail != self->rx_head) {
+        buf[n++] = self->rx_ring[self->rx_tail];
+        self->rx_tail = (self->rx_tail + 1) % self->rx_size;
+    }
+    return mp_obj_new_int_from_uint(n);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(machine_i2c_readinto_obj, 1, machine_i2c_readinto);
+
+/// \method write(buf, *, timeout=0)
+/// Slave mode, queues the bytes for the next reads of the master, waiting up to timeout ms
+/// for room in the TX buffer. Returns the number of bytes queued.
+STATIC mp_obj_t machine_i2c_write(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t machine_i2c_write_args[] = {
+        { MP_QSTR_buf,      MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_timeout,  MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(machine_i2c_write_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), machine_i2c_write_args, args);
+
+    machine_i2c_obj_t *self = machine_i2c_get_slave(pos_args[0]);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
+
+    MP_THREAD_GIL_EXIT();
+    int n = i2c_slave_write_buffer(self->bus_id, bufinfo.buf, bufinfo.len, MAX(args[1].u_int, 0) / portTICK_PERIOD_MS);
+    MP_THREAD_GIL_ENTER();
+    if (n < 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+    return mp_obj_new_int(n);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(machine_i2c_write_obj, 1, machine_i2c_write);
+
+/// \method callback(handler=None)
+/// Slave mode, the handler is called with the I2C object each time the master has finished a write to this address.
+STATIC mp_obj_t machine_i2c_callback(mp_uint_t n_args, const mp_obj_t *args) {
+    machine_i2c_obj_t *self = machine_i2c_get_slave(args[0]);
+    mp_obj_t handler = (n_args > 1) ? args[1] : mp_const_none;
+    if (handler != mp_const_none) {
+        if (!mp_obj_is_callable(handler)) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+        }
+        mp_irq_add(self, handler);
+    } else {
+        mp_irq_remove(self);
+    }
+    self->handler = handler;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_i2c_callback_obj, 1, 2, machine_i2c_callback);
+
 STATIC const mp_rom_map_elem_t machine_i2c_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_init),                (mp_obj_t)&machine_i2c_init_obj },
     { MP_ROM_QSTR(MP_QSTR_deinit),              (mp_obj_t)&machine_i2c_deinit_obj },
@@ -767,7 +1163,19 @@ STATIC const mp_rom_map_elem_t machine_i2c_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_readfrom_mem_into),   (mp_obj_t)&machine_i2c_readfrom_mem_into_obj },
     { MP_ROM_QSTR(MP_QSTR_writeto_mem),         (mp_obj_t)&machine_i2c_writeto_mem_obj },
 
+    // batched operations
+    { MP_ROM_QSTR(MP_QSTR_transaction),         (mp_obj_t)&machine_i2c_transaction_obj },
+
+    // slave operations
+    { MP_ROM_QSTR(MP_QSTR_any),                 (mp_obj_t)&machine_i2c_any_obj },
+    { MP_ROM_QSTR(MP_QSTR_readinto),            (mp_obj_t)&machine_i2c_readinto_obj },
+    { MP_ROM_QSTR(MP_QSTR_write),               (mp_obj_t)&machine_i2c_write_obj },
+    { MP_ROM_QSTR(MP_QSTR_callback),            (mp_obj_t)&machine_i2c_callback_obj },
+
     { MP_OBJ_NEW_QSTR(MP_QSTR_MASTER),          MP_OBJ_NEW_SMALL_INT(MACHI2C_MASTER) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SLAVE),           MP_OBJ_NEW_SMALL_INT(MACHI2C_SLAVE) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_WRITE),           MP_OBJ_NEW_SMALL_INT(MACHI2C_OP_WRITE) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_READ),            MP_OBJ_NEW_SMALL_INT(MACHI2C_OP_READ) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(machine_i2c_locals_dict, machine_i2c_locals_dict_table);
@@ -779,3 +1187,12 @@ const mp_obj_type_t machine_i2c_type = {
     .make_new = machine_i2c_make_new,
     .locals_dict = (mp_obj_dict_t*)&machine_i2c_locals_dict,
 };
+
+// the slave tasks call the handlers of the heap being released
+void machine_i2c_deinit_all (void) {
+    for (int i = 0; i < 2; i++) {
+        if (mach_i2c_obj[i].baudrate > 0 && mach_i2c_obj[i].mode == MACHI2C_SLAVE) {
+            machine_i2c_deinit(&mach_i2c_obj[i]);
+        }
+    }
+}
@@ -42,4 +42,6 @@
 
 extern const mp_obj_type_t machine_i2c_type;
 
+extern void machine_i2c_deinit_all (void);
+
 #endif // __MICROPY_INCLUDED_EXTMOD_MACHINE_I2C_H__
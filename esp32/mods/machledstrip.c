@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "py/mpstate.h"
+#include "py/runtime.h"
+#include "py/obj.h"
+#include "py/mperrno.h"
+#include "esp_heap_caps.h"
+#include "driver/rmt.h"
+#include "machrmt.h"
+#include "machledstrip.h"
+#include "mpexception.h"
+
+/******************************************************************************
+ DEFINE PRIVATE CONSTANTS
+ ******************************************************************************/
+#define LEDSTRIP_BYTES_PER_PIXEL            (3)
+#define LEDSTRIP_BITS_PER_PIXEL             (LEDSTRIP_BYTES_PER_PIXEL * 8)
+#define LEDSTRIP_MAX_PIXELS                 (1024)
+/* WS2812B timings in ns: T0H, T0L, T1H, T1L, and the low time latching the frame */
+#define LEDSTRIP_T0H_NS_DEF                 (400)
+#define LEDSTRIP_T0L_NS_DEF                 (850)
+#define LEDSTRIP_T1H_NS_DEF                 (800)
+#define LEDSTRIP_T1L_NS_DEF                 (450)
+#define LEDSTRIP_RESET_NS                   (300000)
+#define LEDSTRIP_DURATION_MAX               (0x7FFF)
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+typedef struct {
+    mp_obj_base_t base;
+    mp_obj_t rmt;
+    rmt_channel_t channel;
+    uint16_t n_pixels;
+    uint8_t order[LEDSTRIP_BYTES_PER_PIXEL];  // index of R, G and B in the order they are sent
+    uint8_t brightness;
+    float gamma;
+    uint8_t lut[256];       // gamma and brightness applied to each color value
+    rmt_item32_t bits[2];   // the items of a 0 and of a 1 bit
+    rmt_item32_t reset;
+    uint8_t *pixels;        // RGB values as set from Python
+    // the encoded frames, one is being sent while the next one is encoded
+    rmt_item32_t *frames[2];
+    uint8_t back;
+    bool sending;
+} mach_ledstrip_obj_t;
+
+/******************************************************************************
+ DECLARE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC void mach_ledstrip_release(mach_ledstrip_obj_t *self);
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void machledstrip_deinit_all (void) {
+    // the frames are outside of the heap of the previous session, they must be freed
+    for (int i = 0; i < MP_ARRAY_SIZE(MP_STATE_PORT(mach_ledstrip_obj)); i++) {
+        if (MP_STATE_PORT(mach_ledstrip_obj)[i] != MP_OBJ_NULL) {
+            mach_ledstrip_release(MP_STATE_PORT(mach_ledstrip_obj)[i]);
+        }
+    }
+}
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC void mach_ledstrip_wait(mach_ledstrip_obj_t *self) {
+    if (self->sending) {
+        rmt_wait_tx_done(self->channel, portMAX_DELAY);
+        self->sending = false;
+    }
+}
+
+STATIC void mach_ledstrip_release(mach_ledstrip_obj_t *self) {
+    mach_ledstrip_wait(self);
+    for (int i = 0; i < 2; i++) {
+        if (self->frames[i] != NULL) {
+            heap_caps_free(self->frames[i]);
+            self->frames[i] = NULL;
+        }
+    }
+    MP_STATE_PORT(mach_ledstrip_obj)[self->channel] = MP_OBJ_NULL;
+}
+
+STATIC void mach_ledstrip_build_lut(mach_ledstrip_obj_t *self) {
+    for (int i = 0; i < 256; i++) {
+        float value = (self->gamma == 1.0f) ? (float)i : powf((float)i / 255.0f, self->gamma) * 255.0f;
+        self->lut[i] = (uint8_t)(((value * self->brightness) / 255.0f) + 0.5f);
+    }
+}
+
+STATIC uint16_t mach_ledstrip_ticks(mp_int_t ns, uint32_t resolution_ns) {
+    mp_int_t ticks = (ns + (resolution_ns / 2)) / resolution_ns;
+    if (ticks < 1 || ticks > LEDSTRIP_DURATION_MAX) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "The timing is not possible with the resolution of this RMT channel"));
+    }
+    return ticks;
+}
+
+STATIC void mach_ledstrip_encode(mach_ledstrip_obj_t *self, rmt_item32_t *frame) {
+    const uint8_t *pixel = self->pixels;
+    rmt_item32_t *item = frame;
+    for (mp_uint_t i = 0; i < self->n_pixels; i++, pixel += LEDSTRIP_BYTES_PER_PIXEL) {
+        for (int c = 0; c < LEDSTRIP_BYTES_PER_PIXEL; c++) {
+            uint8_t value = self->lut[pixel[self->order[c]]];
+            for (int bit = 7; bit >= 0; bit--) {
+                *item++ = self->bits[(value >> bit) & 1];
+            }
+        }
+    }
+    // keeps the line low long enough to latch the frame before the next one starts
+    *item = self->reset;
+}
+
+STATIC void mach_ledstrip_set_pixel(mach_ledstrip_obj_t *self, mp_uint_t index, mp_obj_t color_in) {
+    uint8_t *pixel = &self->pixels[index * LEDSTRIP_BYTES_PER_PIXEL];
+    if (MP_OBJ_IS_INT(color_in)) {
+        // 0xRRGGBB
+        mp_uint_t color = mp_obj_get_int(color_in);
+        pixel[0] = color >> 16;
+        pixel[1] = color >> 8;
+        pixel[2] = color;
+    } else {
+        mp_obj_t *rgb;
+        mp_obj_get_array_fixed_n(color_in, LEDSTRIP_BYTES_PER_PIXEL, &rgb);
+        for (int c = 0; c < LEDSTRIP_BYTES_PER_PIXEL; c++) {
+            pixel[c] = mp_obj_get_int(rgb[c]);
+        }
+    }
+}
+
+STATIC mach_ledstrip_obj_t *mach_ledstrip_get(mp_obj_t self_in) {
+    mach_ledstrip_obj_t *self = self_in;
+    if (self->frames[0] == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+    return self;
+}
+
+/******************************************************************************/
+// Micro Python bindings
+
+STATIC const mp_arg_t mach_ledstrip_init_args[] = {
+    { MP_QSTR_rmt,                      MP_ARG_REQUIRED | MP_ARG_OBJ, },
+    { MP_QSTR_n,                        MP_ARG_REQUIRED | MP_ARG_INT, },
+    { MP_QSTR_order,                    MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+    { MP_QSTR_brightness,               MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 255} },
+    { MP_QSTR_gamma,                    MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+    { MP_QSTR_timing,                   MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+};
+
+STATIC mp_obj_t mach_ledstrip_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args) {
+    // parse args
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, all_args + n_args);
+    mp_arg_val_t args[MP_ARRAY_SIZE(mach_ledstrip_init_args)];
+    mp_arg_parse_all(n_args, all_args, &kw_args, MP_ARRAY_SIZE(args), mach_ledstrip_init_args, args);
+
+    if (args[1].u_int <= 0 || args[1].u_int > LEDSTRIP_MAX_PIXELS || args[3].u_int < 0 || args[3].u_int > 255) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+
+    // the color order of the strip, GRB for the WS2812
+    const char *order = "GRB";
+    if (args[2].u_obj != MP_OBJ_NULL) {
+        size_t len;
+        order = mp_obj_str_get_data(args[2].u_obj, &len);
+        if (len != LEDSTRIP_BYTES_PER_PIXEL) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+    }
+
+    mp_int_t timing[4] = { LEDSTRIP_T0H_NS_DEF, LEDSTRIP_T0L_NS_DEF, LEDSTRIP_T1H_NS_DEF, LEDSTRIP_T1L_NS_DEF };
+    if (args[5].u_obj != MP_OBJ_NULL) {
+        mp_obj_t *items;
+        mp_obj_get_array_fixed_n(args[5].u_obj, 4, &items);
+        for (int i = 0; i < 4; i++) {
+            timing[i] = mp_obj_get_int(items[i]);
+        }
+    }
+
+    mach_ledstrip_obj_t *self = m_new0(mach_ledstrip_obj_t, 1);
+    self->base.type = &mach_ledstrip_type;
+    for (int c = 0; c < LEDSTRIP_BYTES_PER_PIXEL; c++) {
+        const char *pos = strchr("RGB", order[c]);
+        if (pos == NULL || order[c] == '\0') {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        self->order[c] = pos - "RGB";
+    }
+    self->gamma = (args[4].u_obj != MP_OBJ_NULL) ? mp_obj_get_float(args[4].u_obj) : 1.0f;
+    if (self->gamma <= 0.0f) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    self->brightness = args[3].u_int;
+    mach_ledstrip_build_lut(self);
+
+    uint32_t resolution_ns;
+    self->channel = mach_rmt_get_tx_channel(args[0].u_obj, &resolution_ns);
+    self->rmt = args[0].u_obj;
+    for (int i = 0; i < 2; i++) {
+        self->bits[i].level0 = 1;
+        self->bits[i].duration0 = mach_ledstrip_ticks(timing[i * 2], resolution_ns);
+        self->bits[i].level1 = 0;
+        self->bits[i].duration1 = mach_ledstrip_ticks(timing[(i * 2) + 1], resolution_ns);
+    }
+    // a zero duration ends the transmission
+    self->reset.level0 = 0;
+    self->reset.duration0 = MIN(LEDSTRIP_RESET_NS / resolution_ns, LEDSTRIP_DURATION_MAX);
+    self->reset.level1 = 0;
+    self->reset.duration1 = 0;
+
+    self->n_pixels = args[1].u_int;
+    self->pixels = m_new0(uint8_t, self->n_pixels * LEDSTRIP_BYTES_PER_PIXEL);
+
+    // a previous strip on the same channel stops driving it
+    if (MP_STATE_PORT(mach_ledstrip_obj)[self->channel] != MP_OBJ_NULL) {
+        mach_ledstrip_release(MP_STATE_PORT(mach_ledstrip_obj)[self->channel]);
+    }
+
+    // the RMT driver reads the frame from its ISR, it must stay in the internal RAM
+    size_t frame_size = ((self->n_pixels * LEDSTRIP_BITS_PER_PIXEL) + 1) * sizeof(rmt_item32_t);
+    for (int i = 0; i < 2; i++) {
+        self->frames[i] = heap_caps_malloc(frame_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_32BIT);
+        if (self->frames[i] == NULL) {
+            mach_ledstrip_release(self);
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    }
+    // keep the strip alive while its frames are being sent
+    MP_STATE_PORT(mach_ledstrip_obj)[self->channel] = self;
+
+    return self;
+}
+
+STATIC mp_obj_t mach_ledstrip_deinit(mp_obj_t self_in) {
+    mach_ledstrip_obj_t *self = self_in;
+    if (self->frames[0] != NULL) {
+        MP_THREAD_GIL_EXIT();
+        mach_ledstrip_wait(self);
+        MP_THREAD_GIL_ENTER();
+        mach_ledstrip_release(self);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_ledstrip_deinit_obj, mach_ledstrip_deinit);
+
+// encodes the pixels into the idle frame and sends it as soon as the previous one is out
+STATIC mp_obj_t mach_ledstrip_show(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t mach_ledstrip_show_args[] = {
+        { MP_QSTR_wait,                     MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(mach_ledstrip_show_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), mach_ledstrip_show_args, args);
+
+    mach_ledstrip_obj_t *self = mach_ledstrip_get(pos_args[0]);
+
+    rmt_item32_t *frame = self->frames[self->back];
+    mach_ledstrip_encode(self, frame);
+
+    MP_THREAD_GIL_EXIT();
+    mach_ledstrip_wait(self);
+    esp_err_t ret = rmt_write_items(self->channel, frame, (self->n_pixels * LEDSTRIP_BITS_PER_PIXEL) + 1, false);
+    if (ret == ESP_OK) {
+        self->sending = true;
+        if (args[0].u_bool) {
+            mach_ledstrip_wait(self);
+        }
+    }
+    MP_THREAD_GIL_ENTER();
+
+    if (ret != ESP_OK) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+    // the pixels can be changed right away, the next frame is encoded in the other buffer
+    self->back ^= 1;
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_ledstrip_show_obj, 1, mach_ledstrip_show);
+
+STATIC mp_obj_t mach_ledstrip_wait_done(mp_obj_t self_in) {
+    mach_ledstrip_obj_t *self = mach_ledstrip_get(self_in);
+    MP_THREAD_GIL_EXIT();
+    mach_ledstrip_wait(self);
+    MP_THREAD_GIL_ENTER();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_ledstrip_wait_obj, mach_ledstrip_wait_done);
+
+STATIC mp_obj_t mach_ledstrip_fill(mp_obj_t self_in, mp_obj_t color_in) {
+    mach_ledstrip_obj_t *self = self_in;
+    mach_ledstrip_set_pixel(self, 0, color_in);
+    for (mp_uint_t i = 1; i < self->n_pixels; i++) {
+        memcpy(&self->pixels[i * LEDSTRIP_BYTES_PER_PIXEL], self->pixels, LEDSTRIP_BYTES_PER_PIXEL);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_ledstrip_fill_obj, mach_ledstrip_fill);
+
+STATIC mp_obj_t mach_ledstrip_brightness(mp_uint_t n_args, const mp_obj_t *args) {
+    mach_ledstrip_obj_t *self = args[0];
+    if (n_args == 1) {
+        return mp_obj_new_int(self->brightness);
+    }
+    mp_int_t brightness = mp_obj_get_int(args[1]);
+    if (brightness < 0 || brightness > 255) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    // applied by the next show()
+    self->brightness = brightness;
+    mach_ledstrip_build_lut(self);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mach_ledstrip_brightness_obj, 1, 2, mach_ledstrip_brightness);
+
+STATIC mp_obj_t mach_ledstrip_subscr(mp_obj_t self_in, mp_obj_t index_in, mp_obj_t value) {
+    mach_ledstrip_obj_t *self = self_in;
+    if (value == MP_OBJ_NULL) {
+        // delete
+        return MP_OBJ_NULL;
+    }
+    mp_uint_t index = mp_get_index(self->base.type, self->n_pixels, index_in, false);
+    if (value == MP_OBJ_SENTINEL) {
+        // load
+        uint8_t *pixel = &self->pixels[index * LEDSTRIP_BYTES_PER_PIXEL];
+        mp_obj_t rgb[LEDSTRIP_BYTES_PER_PIXEL] = {
+            MP_OBJ_NEW_SMALL_INT(pixel[0]), MP_OBJ_NEW_SMALL_INT(pixel[1]), MP_OBJ_NEW_SMALL_INT(pixel[2])
+        };
+        return mp_obj_new_tuple(LEDSTRIP_BYTES_PER_PIXEL, rgb);
+    }
+    // store
+    mach_ledstrip_set_pixel(self, index, value);
+    return mp_const_none;
+}
+
+STATIC mp_obj_t mach_ledstrip_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
+    mach_ledstrip_obj_t *self = self_in;
+    switch (op) {
+        case MP_UNARY_OP_LEN: return MP_OBJ_NEW_SMALL_INT(self->n_pixels);
+        default: return MP_OBJ_NULL; // op not supported
+    }
+}
+
+// the RGB bytes of all the pixels, to be filled in bulk through a memoryview
+STATIC mp_int_t mach_ledstrip_get_buffer(mp_obj_t self_in, mp_buffer_info_t *bufinfo, mp_uint_t flags) {
+    mach_ledstrip_obj_t *self = self_in;
+    bufinfo->buf = self->pixels;
+    bufinfo->len = self->n_pixels * LEDSTRIP_BYTES_PER_PIXEL;
+    bufinfo->typecode = 'B';
+    return 0;
+}
+
+STATIC void mach_ledstrip_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    mach_ledstrip_obj_t *self = self_in;
+    mp_printf(print, "LEDStrip(channel=%u, n=%u, brightness=%u)", self->channel, self->n_pixels, self->brightness);
+}
+
+STATIC const mp_map_elem_t mach_ledstrip_locals_dict_table[] = {
+    // instance methods
+    { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),              (mp_obj_t)&mach_ledstrip_deinit_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_show),                (mp_obj_t)&mach_ledstrip_show_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_wait),                (mp_obj_t)&mach_ledstrip_wait_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_fill),                (mp_obj_t)&mach_ledstrip_fill_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_brightness),          (mp_obj_t)&mach_ledstrip_brightness_obj },
+};
+STATIC MP_DEFINE_CONST_DICT(mach_ledstrip_locals_dict, mach_ledstrip_locals_dict_table);
+
+const mp_obj_type_t mach_ledstrip_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_LEDStrip,
+    .print = mach_ledstrip_print,
+    .make_new = mach_ledstrip_make_new,
+    .unary_op = mach_ledstrip_unary_op,
+    .subscr = mach_ledstrip_subscr,
+    .buffer_p = { .get_buffer = mach_ledstrip_get_buffer },
+    .locals_dict = (mp_obj_t)&mach_ledstrip_locals_dict,
+};
@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef MACHLEDSTRIP_H_
+#define MACHLEDSTRIP_H_
+
+extern const mp_obj_type_t mach_ledstrip_type;
+
+extern void machledstrip_deinit_all (void);
+
+#endif  // MACHLEDSTRIP_H_
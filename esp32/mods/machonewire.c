@@ -0,0 +1,640 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <string.h>
+
+#include "py/mpstate.h"
+#include "py/runtime.h"
+#include "py/obj.h"
+#include "py/mperrno.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "driver/rmt.h"
+#include "soc/gpio_sig_map.h"
+#include "machpin.h"
+#include "machrmt.h"
+#include "machonewire.h"
+#include "mpexception.h"
+
+/******************************************************************************
+ DEFINE PRIVATE CONSTANTS
+ ******************************************************************************/
+// 80 MHz / 80, all the durations are in µs
+#define ONEWIRE_CLK_DIV                     (80)
+#define ONEWIRE_TX_CHANNEL_DEF              (RMT_CHANNEL_2)
+#define ONEWIRE_RX_CHANNEL_DEF              (RMT_CHANNEL_3)
+
+#define ONEWIRE_RESET_LOW                   (480)
+#define ONEWIRE_RESET_HIGH                  (480)
+#define ONEWIRE_WRITE0_LOW                  (60)
+#define ONEWIRE_WRITE0_HIGH                 (10)
+#define ONEWIRE_WRITE1_LOW                  (6)
+#define ONEWIRE_WRITE1_HIGH                 (64)
+// a read slot is a write 1 slot, a device sending a 0 holds the line low for longer than this
+#define ONEWIRE_READ_LOW_MAX                (15)
+// the reception ends when the line stays high longer than any slot keeps it
+#define ONEWIRE_RX_IDLE                     (100)
+// in APB clock periods, glitches shorter than 0.4 µs are ignored
+#define ONEWIRE_RX_FILTER                   (32)
+#define ONEWIRE_RX_TIMEOUT_MS               (10)
+
+// the reception of a burst must fit in the 64 items of the RMT memory block of the channel, with its end marker
+#define ONEWIRE_SLOTS_MAX                   (32)
+#define ONEWIRE_SEARCH_MAX                  (64)
+
+#define ONEWIRE_ROM_LEN                     (8)
+#define ONEWIRE_SCRATCH_LEN                 (9)
+
+#define ONEWIRE_SEARCH_ROM                  (0xF0)
+#define ONEWIRE_MATCH_ROM                   (0x55)
+#define ONEWIRE_SKIP_ROM                    (0xCC)
+#define ONEWIRE_CONVERT_T                   (0x44)
+#define ONEWIRE_READ_SCRATCH                (0xBE)
+
+#define ONEWIRE_FAMILY_DS18S20              (0x10)
+#define ONEWIRE_CONVERT_MS                  (750)
+#define ONEWIRE_CONVERT_POLL_MS             (10)
+#define ONEWIRE_CONVERT_TIMEOUT_MS          (1000)
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+typedef struct {
+    mp_obj_base_t base;
+    pin_obj_t *pin;
+    rmt_channel_t tx_channel;
+    rmt_channel_t rx_channel;
+    RingbufHandle_t ringbuf;
+    TickType_t convert_start;
+    bool converting;
+    bool enabled;
+    // the GIL is released during the transfers, another thread must not use the bus meanwhile
+    volatile bool busy;
+} mach_onewire_obj_t;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+// all the functions below run without the GIL, they must not touch any Python object
+
+STATIC bool mach_onewire_burst(mach_onewire_obj_t *self, const rmt_item32_t *items, uint32_t count, rmt_item32_t *seen) {
+    size_t len = 0;
+    rmt_rx_start(self->rx_channel, true);
+    // at most ONEWIRE_SLOTS_MAX items, the driver copies them all in the RMT memory before starting
+    esp_err_t ret = rmt_write_items(self->tx_channel, items, count, true);
+    rmt_item32_t *received = NULL;
+    if (ret == ESP_OK) {
+        received = (rmt_item32_t *)xRingbufferReceive(self->ringbuf, &len, ONEWIRE_RX_TIMEOUT_MS / portTICK_PERIOD_MS);
+    }
+    rmt_rx_stop(self->rx_channel);
+    if (received == NULL) {
+        return false;
+    }
+    len /= sizeof(rmt_item32_t);
+    for (uint32_t i = 0; i < count; i++) {
+        seen[i] = (i < len) ? received[i] : (rmt_item32_t){ .val = 0 };
+    }
+    vRingbufferReturnItem(self->ringbuf, received);
+    return true;
+}
+
+STATIC bool mach_onewire_reset(mach_onewire_obj_t *self, bool *present) {
+    rmt_item32_t item = { .level0 = 0, .duration0 = ONEWIRE_RESET_LOW, .level1 = 1, .duration1 = ONEWIRE_RESET_HIGH };
+    rmt_item32_t seen[2];
+    // the reset pulse itself comes first, the presence pulse of the devices follows it
+    rmt_item32_t items[2] = { item, { .val = 0 } };
+    if (!mach_onewire_burst(self, items, 2, seen)) {
+        return false;
+    }
+    *present = seen[1].level0 == 0 && seen[1].duration0 > 0;
+    return true;
+}
+
+// the bits are sent LSB first, tx NULL sends 1s, which is also how the bits are read into rx
+STATIC bool mach_onewire_transfer(mach_onewire_obj_t *self, const uint8_t *tx, uint8_t *rx, uint32_t nbits) {
+    rmt_item32_t items[ONEWIRE_SLOTS_MAX];
+    rmt_item32_t seen[ONEWIRE_SLOTS_MAX];
+    if (rx != NULL) {
+        memset(rx, 0, (nbits + 7) / 8);
+    }
+    for (uint32_t start = 0; start < nbits; start += ONEWIRE_SLOTS_MAX) {
+        uint32_t count = MIN(nbits - start, ONEWIRE_SLOTS_MAX);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t bit = start + i;
+            bool one = (tx == NULL) || (tx[bit / 8] & (1 << (bit % 8)));
+            items[i].level0 = 0;
+            items[i].duration0 = one ? ONEWIRE_WRITE1_LOW : ONEWIRE_WRITE0_LOW;
+            items[i].level1 = 1;
+            items[i].duration1 = one ? ONEWIRE_WRITE1_HIGH : ONEWIRE_WRITE0_HIGH;
+        }
+        if (!mach_onewire_burst(self, items, count, seen)) {
+            return false;
+        }
+        if (rx != NULL) {
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t bit = start + i;
+                if (seen[i].level0 == 0 && seen[i].duration0 <= ONEWIRE_READ_LOW_MAX) {
+                    rx[bit / 8] |= 1 << (bit % 8);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+STATIC bool mach_onewire_write_byte(mach_onewire_obj_t *self, uint8_t value) {
+    return mach_onewire_transfer(self, &value, NULL, 8);
+}
+
+STATIC uint8_t mach_onewire_crc8(const uint8_t *data, size_t len) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t byte = data[i];
+        for (int b = 0; b < 8; b++) {
+            uint8_t mix = (crc ^ byte) & 0x01;
+            crc >>= 1;
+            if (mix) {
+                crc ^= 0x8C;
+            }
+            byte >>= 1;
+        }
+    }
+    return crc;
+}
+
+// resets the bus and addresses one device, or all of them when rom is NULL
+STATIC bool mach_onewire_select(mach_onewire_obj_t *self, const uint8_t *rom, bool *present) {
+    if (!mach_onewire_reset(self, present)) {
+        return false;
+    }
+    if (!*present) {
+        return true;
+    }
+    if (rom == NULL) {
+        return mach_onewire_write_byte(self, ONEWIRE_SKIP_ROM);
+    }
+    return mach_onewire_write_byte(self, ONEWIRE_MATCH_ROM) && mach_onewire_transfer(self, rom, NULL, ONEWIRE_ROM_LEN * 8);
+}
+
+// one pass of the ROM search, rom holds the previous result and gets the next one,
+// returns the new last discrepancy (0 after the last device) or -1 when no device answered
+STATIC int mach_onewire_search(mach_onewire_obj_t *self, uint8_t *rom, int last_discrepancy) {
+    bool present;
+    if (!mach_onewire_reset(self, &present) || !present || !mach_onewire_write_byte(self, ONEWIRE_SEARCH_ROM)) {
+        return -1;
+    }
+    int last_zero = 0;
+    for (int id = 1; id <= ONEWIRE_ROM_LEN * 8; id++) {
+        // the bit of the devices still in the search, then its complement
+        uint8_t bits;
+        if (!mach_onewire_transfer(self, NULL, &bits, 2)) {
+            return -1;
+        }
+        uint8_t *byte = &rom[(id - 1) / 8];
+        uint8_t mask = 1 << ((id - 1) % 8);
+        bool dir;
+        if (bits == 0x03) {
+            return -1;
+        } else if (bits != 0x00) {
+            dir = bits & 0x01;
+        } else {
+            // devices with both values, take the 1 branch once the 0 one has been done
+            dir = (id < last_discrepancy) ? (*byte & mask) != 0 : (id == last_discrepancy);
+            if (!dir) {
+                last_zero = id;
+            }
+        }
+        if (dir) {
+            *byte |= mask;
+        } else {
+            *byte &= ~mask;
+        }
+        uint8_t out = dir;
+        if (!mach_onewire_transfer(self, &out, NULL, 1)) {
+            return -1;
+        }
+    }
+    return last_zero;
+}
+
+STATIC bool mach_onewire_convert(mach_onewire_obj_t *self, const uint8_t *rom, bool *present) {
+    if (!mach_onewire_select(self, rom, present)) {
+        return false;
+    }
+    if (*present) {
+        if (!mach_onewire_write_byte(self, ONEWIRE_CONVERT_T)) {
+            return false;
+        }
+        self->convert_start = xTaskGetTickCount();
+        self->converting = true;
+    }
+    return true;
+}
+
+// the devices answer 1s to the read slots once their conversion is done
+STATIC bool mach_onewire_convert_wait(mach_onewire_obj_t *self) {
+    TickType_t start = xTaskGetTickCount();
+    for (;;) {
+        uint8_t done;
+        if (!mach_onewire_transfer(self, NULL, &done, 1)) {
+            return false;
+        }
+        if (done || (xTaskGetTickCount() - start) > (ONEWIRE_CONVERT_TIMEOUT_MS / portTICK_PERIOD_MS)) {
+            break;
+        }
+        vTaskDelay(ONEWIRE_CONVERT_POLL_MS / portTICK_PERIOD_MS);
+    }
+    self->converting = false;
+    return true;
+}
+
+STATIC mach_onewire_obj_t *mach_onewire_get(mp_obj_t self_in) {
+    mach_onewire_obj_t *self = self_in;
+    if (!self->enabled) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+    if (self->busy) {
+        mp_raise_OSError(MP_EBUSY);
+    }
+    return self;
+}
+
+STATIC void mach_onewire_begin(mach_onewire_obj_t *self) {
+    self->busy = true;
+    MP_THREAD_GIL_EXIT();
+}
+
+STATIC void mach_onewire_end(mach_onewire_obj_t *self, bool ok) {
+    MP_THREAD_GIL_ENTER();
+    self->busy = false;
+    if (!ok) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+}
+
+STATIC void mach_onewire_release(mach_onewire_obj_t *self) {
+    if (self->enabled) {
+        mach_rmt_free_channel(self->tx_channel);
+        mach_rmt_free_channel(self->rx_channel);
+        self->enabled = false;
+    }
+}
+
+/******************************************************************************/
+// Micro Python bindings
+
+STATIC const mp_arg_t mach_onewire_init_args[] = {
+    { MP_QSTR_pin,                      MP_ARG_REQUIRED | MP_ARG_OBJ, },
+    { MP_QSTR_tx_channel,               MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = ONEWIRE_TX_CHANNEL_DEF} },
+    { MP_QSTR_rx_channel,               MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = ONEWIRE_RX_CHANNEL_DEF} },
+};
+
+STATIC mp_obj_t mach_onewire_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args) {
+    // parse args
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, all_args + n_args);
+    mp_arg_val_t args[MP_ARRAY_SIZE(mach_onewire_init_args)];
+    mp_arg_parse_all(n_args, all_args, &kw_args, MP_ARRAY_SIZE(args), mach_onewire_init_args, args);
+
+    pin_obj_t *pin = pin_find(args[0].u_obj);
+    rmt_channel_t tx_channel = args[1].u_int;
+    rmt_channel_t rx_channel = args[2].u_int;
+    if (tx_channel == rx_channel) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    if (!mach_rmt_alloc_channel(tx_channel, pin->pin_number)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "The TX RMT channel is invalid or already used!"));
+    }
+    if (!mach_rmt_alloc_channel(rx_channel, pin->pin_number)) {
+        mach_rmt_free_channel(tx_channel);
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "The RX RMT channel is invalid or already used!"));
+    }
+
+    mach_onewire_obj_t *self = m_new0(mach_onewire_obj_t, 1);
+    self->base.type = &mach_onewire_type;
+    self->pin = pin;
+    self->tx_channel = tx_channel;
+    self->rx_channel = rx_channel;
+    self->enabled = true;
+
+    rmt_config_t tx_config = {
+        .rmt_mode = RMT_MODE_TX,
+        .channel = tx_channel,
+        .gpio_num = pin->pin_number,
+        .mem_block_num = 1,
+        .clk_div = ONEWIRE_CLK_DIV,
+        .tx_config = { .idle_level = RMT_IDLE_LEVEL_HIGH, .idle_output_en = true },
+    };
+    rmt_config_t rx_config = {
+        .rmt_mode = RMT_MODE_RX,
+        .channel = rx_channel,
+        .gpio_num = pin->pin_number,
+        .mem_block_num = 1,
+        .clk_div = ONEWIRE_CLK_DIV,
+        .rx_config = { .filter_en = true, .filter_ticks_thresh = ONEWIRE_RX_FILTER, .idle_threshold = ONEWIRE_RX_IDLE },
+    };
+    // the same ringbuffer size as the RX channels of machine.RMT, see there
+    if (rmt_config(&tx_config) != ESP_OK || rmt_driver_install(tx_channel, 0, 0) != ESP_OK ||
+        rmt_config(&rx_config) != ESP_OK ||
+        rmt_driver_install(rx_channel, 130 * sizeof(rmt_item32_t) + sizeof(size_t) + sizeof(int), 0) != ESP_OK ||
+        rmt_get_ringbuf_handle(rx_channel, &self->ringbuf) != ESP_OK) {
+        mach_onewire_release(self);
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+    // the TX channel drives the open drain output and the RX channel watches the same line
+    pin_config(pin, RMT_SIG_IN0_IDX + rx_channel, RMT_SIG_OUT0_IDX + tx_channel, GPIO_MODE_INPUT_OUTPUT_OD, MACHPIN_PULL_UP, 1);
+
+    return self;
+}
+
+STATIC mp_obj_t mach_onewire_deinit(mp_obj_t self_in) {
+    mach_onewire_obj_t *self = self_in;
+    if (self->busy) {
+        mp_raise_OSError(MP_EBUSY);
+    }
+    mach_onewire_release(self);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_onewire_deinit_obj, mach_onewire_deinit);
+
+/// \method reset(required=False)
+/// Resets the bus, returns whether any device answered.
+STATIC mp_obj_t mach_onewire_reset_bus(mp_uint_t n_args, const mp_obj_t *args) {
+    mach_onewire_obj_t *self = mach_onewire_get(args[0]);
+    bool present = false;
+    mach_onewire_begin(self);
+    bool ok = mach_onewire_reset(self, &present);
+    mach_onewire_end(self, ok);
+    if (n_args > 1 && mp_obj_is_true(args[1]) && !present) {
+        mp_raise_OSError(MP_ENODEV);
+    }
+    return mp_obj_new_bool(present);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mach_onewire_reset_obj, 1, 2, mach_onewire_reset_bus);
+
+STATIC mp_obj_t mach_onewire_readbit(mp_obj_t self_in) {
+    mach_onewire_obj_t *self = mach_onewire_get(self_in);
+    uint8_t value;
+    mach_onewire_begin(self);
+    bool ok = mach_onewire_transfer(self, NULL, &value, 1);
+    mach_onewire_end(self, ok);
+    return MP_OBJ_NEW_SMALL_INT(value);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_onewire_readbit_obj, mach_onewire_readbit);
+
+STATIC mp_obj_t mach_onewire_readbyte(mp_obj_t self_in) {
+    mach_onewire_obj_t *self = mach_onewire_get(self_in);
+    uint8_t value;
+    mach_onewire_begin(self);
+    bool ok = mach_onewire_transfer(self, NULL, &value, 8);
+    mach_onewire_end(self, ok);
+    return MP_OBJ_NEW_SMALL_INT(value);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_onewire_readbyte_obj, mach_onewire_readbyte);
+
+STATIC mp_obj_t mach_onewire_readinto(mp_obj_t self_in, mp_obj_t buf_in) {
+    mach_onewire_obj_t *self = mach_onewire_get(self_in);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_WRITE);
+    mach_onewire_begin(self);
+    bool ok = mach_onewire_transfer(self, NULL, bufinfo.buf, bufinfo.len * 8);
+    mach_onewire_end(self, ok);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_onewire_readinto_obj, mach_onewire_readinto);
+
+STATIC mp_obj_t mach_onewire_writebit(mp_obj_t self_in, mp_obj_t value_in) {
+    mach_onewire_obj_t *self = mach_onewire_get(self_in);
+    uint8_t value = mp_obj_is_true(value_in);
+    mach_onewire_begin(self);
+    bool ok = mach_onewire_transfer(self, &value, NULL, 1);
+    mach_onewire_end(self, ok);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_onewire_writebit_obj, mach_onewire_writebit);
+
+STATIC mp_obj_t mach_onewire_writebyte(mp_obj_t self_in, mp_obj_t value_in) {
+    mach_onewire_obj_t *self = mach_onewire_get(self_in);
+    uint8_t value = mp_obj_get_int(value_in);
+    mach_onewire_begin(self);
+    bool ok = mach_onewire_write_byte(self, value);
+    mach_onewire_end(self, ok);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_onewire_writebyte_obj, mach_onewire_writebyte);
+
+STATIC mp_obj_t mach_onewire_write(mp_obj_t self_in, mp_obj_t buf_in) {
+    mach_onewire_obj_t *self = mach_onewire_get(self_in);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+    mach_onewire_begin(self);
+    bool ok = mach_onewire_transfer(self, bufinfo.buf, NULL, bufinfo.len * 8);
+    mach_onewire_end(self, ok);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_onewire_write_obj, mach_onewire_write);
+
+STATIC mp_obj_t mach_onewire_select_rom(mp_obj_t self_in, mp_obj_t rom_in) {
+    mach_onewire_obj_t *self = mach_onewire_get(self_in);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(rom_in, &bufinfo, MP_BUFFER_READ);
+    if (bufinfo.len != ONEWIRE_ROM_LEN) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    bool present;
+    mach_onewire_begin(self);
+    bool ok = mach_onewire_select(self, bufinfo.buf, &present);
+    mach_onewire_end(self, ok);
+    return mp_obj_new_bool(present);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_onewire_select_rom_obj, mach_onewire_select_rom);
+
+/// \method scan()
+/// Searches the bus, returns the ROMs of the devices found as bytearrays of 8 bytes.
+STATIC mp_obj_t mach_onewire_scan(mp_obj_t self_in) {
+    mach_onewire_obj_t *self = mach_onewire_get(self_in);
+    uint8_t *roms = m_new(uint8_t, ONEWIRE_SEARCH_MAX * ONEWIRE_ROM_LEN);
+    uint8_t rom[ONEWIRE_ROM_LEN] = { 0 };
+    mp_uint_t found = 0;
+
+    mach_onewire_begin(self);
+    int last_discrepancy = 0;
+    do {
+        last_discrepancy = mach_onewire_search(self, rom, last_discrepancy);
+        if (last_discrepancy < 0) {
+            break;
+        }
+        // a device disturbed during the search gives a wrong ROM
+        if (mach_onewire_crc8(rom, ONEWIRE_ROM_LEN) == 0) {
+            memcpy(&roms[found++ * ONEWIRE_ROM_LEN], rom, ONEWIRE_ROM_LEN);
+        }
+    } while (last_discrepancy > 0 && found < ONEWIRE_SEARCH_MAX);
+    mach_onewire_end(self, true);
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (mp_uint_t i = 0; i < found; i++) {
+        mp_obj_list_append(list, mp_obj_new_bytearray(ONEWIRE_ROM_LEN, &roms[i * ONEWIRE_ROM_LEN]));
+    }
+    m_del(uint8_t, roms, ONEWIRE_SEARCH_MAX * ONEWIRE_ROM_LEN);
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_onewire_scan_obj, mach_onewire_scan);
+
+/// \method convert(rom=None)
+/// Starts a temperature conversion on one device or on all of them and returns right away,
+/// temperatures(convert=False) reads the results once the conversion time has passed.
+STATIC mp_obj_t mach_onewire_convert_temp(mp_uint_t n_args, const mp_obj_t *args) {
+    mach_onewire_obj_t *self = mach_onewire_get(args[0]);
+    const uint8_t *rom = NULL;
+    if (n_args > 1 && args[1] != mp_const_none) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(args[1], &bufinfo, MP_BUFFER_READ);
+        if (bufinfo.len != ONEWIRE_ROM_LEN) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        rom = bufinfo.buf;
+    }
+    bool present;
+    mach_onewire_begin(self);
+    bool ok = mach_onewire_convert(self, rom, &present);
+    mach_onewire_end(self, ok);
+    return mp_obj_new_bool(present);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mach_onewire_convert_obj, 1, 2, mach_onewire_convert_temp);
+
+/// \method temperatures(roms, *, convert=True)
+/// Reads the temperature of each DS18x20 of the list, None for the ones which didn't answer
+/// correctly. The whole conversion and the reading of all the devices run without the GIL.
+STATIC mp_obj_t mach_onewire_temperatures(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t mach_onewire_temperatures_args[] = {
+        { MP_QSTR_roms,                     MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_convert,                  MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = true} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(mach_onewire_temperatures_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), mach_onewire_temperatures_args, args);
+
+    mach_onewire_obj_t *self = mach_onewire_get(pos_args[0]);
+
+    // the ROMs are copied as the Python objects can't be used without the GIL
+    size_t n_roms;
+    mp_obj_t *rom_objs;
+    mp_obj_get_array(args[0].u_obj, &n_roms, &rom_objs);
+    size_t entry_len = ONEWIRE_ROM_LEN + ONEWIRE_SCRATCH_LEN;
+    uint8_t *data = m_new(uint8_t, n_roms * entry_len);
+    for (size_t i = 0; i < n_roms; i++) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(rom_objs[i], &bufinfo, MP_BUFFER_READ);
+        if (bufinfo.len != ONEWIRE_ROM_LEN) {
+            m_del(uint8_t, data, n_roms * entry_len);
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        memcpy(&data[i * entry_len], bufinfo.buf, ONEWIRE_ROM_LEN);
+    }
+
+    mach_onewire_begin(self);
+    bool ok = true;
+    bool present = true;
+    if (args[1].u_bool) {
+        ok = mach_onewire_convert(self, NULL, &present);
+        if (ok && present) {
+            ok = mach_onewire_convert_wait(self);
+        }
+    } else if (self->converting) {
+        // the devices can't be polled after a convert() as the bus has been used since
+        TickType_t elapsed = xTaskGetTickCount() - self->convert_start;
+        if (elapsed < (ONEWIRE_CONVERT_MS / portTICK_PERIOD_MS)) {
+            vTaskDelay((ONEWIRE_CONVERT_MS / portTICK_PERIOD_MS) - elapsed);
+        }
+        self->converting = false;
+    }
+    for (size_t i = 0; ok && i < n_roms; i++) {
+        uint8_t *scratch = &data[(i * entry_len) + ONEWIRE_ROM_LEN];
+        ok = mach_onewire_select(self, &data[i * entry_len], &present);
+        if (ok && present) {
+            ok = mach_onewire_write_byte(self, ONEWIRE_READ_SCRATCH) &&
+                 mach_onewire_transfer(self, NULL, scratch, ONEWIRE_SCRATCH_LEN * 8);
+        }
+        if (!present) {
+            // a CRC error too
+            memset(scratch, 0xFF, ONEWIRE_SCRATCH_LEN);
+        }
+    }
+    mach_onewire_end(self, ok);
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (size_t i = 0; i < n_roms; i++) {
+        const uint8_t *rom = &data[i * entry_len];
+        const uint8_t *scratch = rom + ONEWIRE_ROM_LEN;
+        mp_obj_t temp = mp_const_none;
+        if (mach_onewire_crc8(scratch, ONEWIRE_SCRATCH_LEN) == 0) {
+            int16_t raw = scratch[0] | (scratch[1] << 8);
+            if (rom[0] == ONEWIRE_FAMILY_DS18S20) {
+                // 0.5 °C steps, the count remain gives the extra resolution
+                float t = (raw >> 1) - 0.25f;
+                if (scratch[7] != 0) {
+                    t += (float)(scratch[7] - scratch[6]) / scratch[7];
+                }
+                temp = mp_obj_new_float(t);
+            } else {
+                temp = mp_obj_new_float(raw / 16.0f);
+            }
+        }
+        mp_obj_list_append(list, temp);
+    }
+    m_del(uint8_t, data, n_roms * entry_len);
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_onewire_temperatures_obj, 1, mach_onewire_temperatures);
+
+STATIC mp_obj_t mach_onewire_crc8_obj_fun(mp_obj_t data_in) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data_in, &bufinfo, MP_BUFFER_READ);
+    return MP_OBJ_NEW_SMALL_INT(mach_onewire_crc8(bufinfo.buf, bufinfo.len));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_onewire_crc8_fun_obj, mach_onewire_crc8_obj_fun);
+STATIC MP_DEFINE_CONST_STATICMETHOD_OBJ(mach_onewire_crc8_obj, (mp_obj_t)&mach_onewire_crc8_fun_obj);
+
+STATIC void mach_onewire_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    mach_onewire_obj_t *self = self_in;
+    mp_printf(print, "OneWire(pin=%q, tx_channel=%u, rx_channel=%u)", self->pin->name, self->tx_channel, self->rx_channel);
+}
+
+STATIC const mp_map_elem_t mach_onewire_locals_dict_table[] = {
+    // instance methods
+    { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),              (mp_obj_t)&mach_onewire_deinit_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_reset),               (mp_obj_t)&mach_onewire_reset_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_readbit),             (mp_obj_t)&mach_onewire_readbit_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_readbyte),            (mp_obj_t)&mach_onewire_readbyte_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_readinto),            (mp_obj_t)&mach_onewire_readinto_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_writebit),            (mp_obj_t)&mach_onewire_writebit_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_writebyte),           (mp_obj_t)&mach_onewire_writebyte_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_write),               (mp_obj_t)&mach_onewire_write_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_select_rom),          (mp_obj_t)&mach_onewire_select_rom_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_scan),                (mp_obj_t)&mach_onewire_scan_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_convert),             (mp_obj_t)&mach_onewire_convert_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_temperatures),        (mp_obj_t)&mach_onewire_temperatures_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_crc8),                (mp_obj_t)&mach_onewire_crc8_obj },
+
+    // class constants
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SEARCH_ROM),          MP_OBJ_NEW_SMALL_INT(ONEWIRE_SEARCH_ROM) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_MATCH_ROM),           MP_OBJ_NEW_SMALL_INT(ONEWIRE_MATCH_ROM) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SKIP_ROM),            MP_OBJ_NEW_SMALL_INT(ONEWIRE_SKIP_ROM) },
+};
+STATIC MP_DEFINE_CONST_DICT(mach_onewire_locals_dict, mach_onewire_locals_dict_table);
+
+const mp_obj_type_t mach_onewire_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_OneWire,
+    .print = mach_onewire_print,
+    .make_new = mach_onewire_make_new,
+    .locals_dict = (mp_obj_t)&mach_onewire_locals_dict,
+};
@@ -45,6 +45,7 @@
 #include "py/runtime.h"
 #include "py/gc.h"
 #include "py/mpstate.h"
+#include "py/mperrno.h"
 
 #include "esp_heap_caps.h"
 #include "sdkconfig.h"
@@ -52,6 +53,7 @@
 #include "esp_spi_flash.h"
 #include "nvs_flash.h"
 #include "esp_intr.h"
+#include "esp_timer.h"
 #include "driver/rtc_io.h"
 
 #include "gpio.h"
@@ -65,6 +67,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/timers.h"
 #include "freertos/xtensa_api.h"
 
 /******************************************************************************
@@ -75,6 +78,7 @@ STATIC void pin_obj_configure (const pin_obj_t *self);
 STATIC void pin_validate_mode (uint mode);
 STATIC void pin_validate_pull (uint pull);
 STATIC void machpin_intr_process (void* arg);
+STATIC void machpin_irq_flush_timer_cb (TimerHandle_t timer);
 
 /******************************************************************************
 DEFINE CONSTANTS
@@ -83,10 +87,21 @@ DEFINE CONSTANTS
 #define MACHPIN_SIMPLE_IN_LOW               0x30
 #define MACHPIN_SIMPLE_IN_HIGH              0x38
 #define ETS_GPIO_INUM                       13
+#define MACHPIN_IRQ_FLUSH_SLACK_US          (portTICK_PERIOD_MS * 1000)
 
 /******************************************************************************
 DEFINE TYPES
 ******************************************************************************/
+typedef struct {
+    uint64_t    last_edge;          // the last accepted edge, the bounces are measured from it
+    uint64_t    last_call;          // the last time the handler was queued, 0 if never
+    uint32_t    debounce_us;
+    uint32_t    rate_us;            // minimum time between two handler calls
+    uint32_t    count;              // accepted edges not handed to the handler yet
+    bool        started;
+    bool        deferred;           // the handler waits for the flush timer
+} machpin_irq_filter_t;
+
 //typedef struct {
 //    bool       active;
 //    int8_t     lpds;
@@ -103,6 +118,12 @@ DECLARE PRIVATE DATA
 //                                      {.active = false, .lpds = PYBPIN_WAKES_NOT, .hib = PYBPIN_WAKES_NOT},
 //                                      {.active = false, .lpds = PYBPIN_WAKES_NOT, .hib = PYBPIN_WAKES_NOT},
 //                                      {.active = false, .lpds = PYBPIN_WAKES_NOT, .hib = PYBPIN_WAKES_NOT} } ;
+// indexed by GPIO number, read by the interrupt so it must stay in DRAM
+STATIC machpin_irq_filter_t machpin_irq_filter[GPIO_PIN_COUNT];
+STATIC portMUX_TYPE machpin_irq_filter_mux = portMUX_INITIALIZER_UNLOCKED;
+STATIC TimerHandle_t machpin_irq_flush_timer;
+STATIC uint64_t machpin_irq_flush_at;  // when the flush timer expires, 0 if it's not running
+
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
  ******************************************************************************/
@@ -308,16 +329,127 @@ STATIC void pin_interrupt_queue_handler(void *arg) {
     // this function will be called by the interrupt thread
     pin_obj_t *pin = arg;
     if (pin->handler && pin->handler != mp_const_none) {
-        mp_call_function_1(pin->handler, pin->handler_arg);
+        if (pin->filtered) {
+            machpin_irq_filter_t *filter = &machpin_irq_filter[pin->pin_number];
+            portENTER_CRITICAL(&machpin_irq_filter_mux);
+            uint32_t count = filter->count;
+            uint64_t stamp = filter->last_edge;
+            filter->count = 0;
+            portEXIT_CRITICAL(&machpin_irq_filter_mux);
+            // a deferred flush and a new edge may both have queued us, the second call has nothing left
+            if (count > 0) {
+                mp_obj_t args[3] = {pin->handler_arg, mp_obj_new_int_from_uint(count), mp_obj_new_int_from_ull(stamp)};
+                mp_call_function_n_kw(pin->handler, 3, 0, args);
+            }
+        } else {
+            mp_call_function_1(pin->handler, pin->handler_arg);
+        }
     }
 }
 
+STATIC uint32_t machpin_irq_flush_ticks (uint64_t delay_us) {
+    uint32_t ticks = (delay_us + (portTICK_PERIOD_MS * 1000) - 1) / (portTICK_PERIOD_MS * 1000);
+    return (ticks > 0) ? ticks : 1;
+}
+
+STATIC void machpin_irq_flush_timer_cb (TimerHandle_t timer) {
+    uint64_t flush = 0;
+    uint64_t next = UINT64_MAX;
+    uint64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&machpin_irq_filter_mux);
+    for (int i = 0; i < GPIO_PIN_COUNT; i++) {
+        machpin_irq_filter_t *filter = &machpin_irq_filter[i];
+        if (filter->deferred) {
+            // the timer counts in ticks, so it can expire up to one tick early
+            uint64_t due = filter->last_call + filter->rate_us;
+            if (due <= now + MACHPIN_IRQ_FLUSH_SLACK_US) {
+                filter->deferred = false;
+                filter->last_call = now;
+                flush |= 1ull << i;
+            } else if (due < next) {
+                next = due;
+            }
+        }
+    }
+    machpin_irq_flush_at = (next != UINT64_MAX) ? next : 0;
+    portEXIT_CRITICAL(&machpin_irq_filter_mux);
+
+    for (int i = 0; flush != 0; i++, flush >>= 1) {
+        if (flush & 1) {
+            pin_obj_t *pin = pin_find_pin_by_num(&pin_cpu_pins_locals_dict, i);
+            if (pin != NULL && pin->filtered) {
+                mp_irq_queue_interrupt_non_ISR(pin_interrupt_queue_handler, pin);
+            }
+        }
+    }
+    if (next != UINT64_MAX) {
+        xTimerChangePeriod(timer, machpin_irq_flush_ticks(next - now), 0);
+    }
+}
+
+// the debounce and the rate limit, evaluated in the interrupt so the bounces never reach the interrupt task
+STATIC IRAM_ATTR bool machpin_irq_filter_edge (pin_obj_t *pin) {
+    machpin_irq_filter_t *filter = &machpin_irq_filter[pin->pin_number];
+    uint64_t now = esp_timer_get_time();
+    uint64_t arm = 0;
+    bool call = false;
+
+    portENTER_CRITICAL_ISR(&machpin_irq_filter_mux);
+    // measured from the last accepted edge, so a contact that keeps chattering still reports once per window
+    if (!filter->started || (now - filter->last_edge) >= filter->debounce_us) {
+        filter->started = true;
+        filter->last_edge = now;
+        filter->count++;
+        if (!filter->deferred) {
+            if (filter->last_call == 0 || (now - filter->last_call) >= filter->rate_us) {
+                filter->last_call = now;
+                call = true;
+            } else {
+                // hand the edges over once the rate limit expires, even if no other edge comes
+                filter->deferred = true;
+                uint64_t due = filter->last_call + filter->rate_us;
+                if (machpin_irq_flush_at == 0 || due < machpin_irq_flush_at) {
+                    machpin_irq_flush_at = due;
+                    arm = due - now;
+                }
+            }
+        }
+    }
+    portEXIT_CRITICAL_ISR(&machpin_irq_filter_mux);
+
+    if (arm > 0) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        xTimerChangePeriodFromISR(machpin_irq_flush_timer, machpin_irq_flush_ticks(arm), &xHigherPriorityTaskWoken);
+        if (xHigherPriorityTaskWoken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+    return call;
+}
+
+STATIC void machpin_irq_filter_setup (pin_obj_t *self, uint32_t debounce_us, uint32_t rate_us) {
+    if (rate_us > 0 && machpin_irq_flush_timer == NULL) {
+        machpin_irq_flush_timer = xTimerCreate("Pin_Flush", 1, pdFALSE, NULL, machpin_irq_flush_timer_cb);
+        if (machpin_irq_flush_timer == NULL) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    }
+    portENTER_CRITICAL(&machpin_irq_filter_mux);
+    machpin_irq_filter[self->pin_number] = (machpin_irq_filter_t) {.debounce_us = debounce_us, .rate_us = rate_us};
+    portEXIT_CRITICAL(&machpin_irq_filter_mux);
+}
+
 STATIC IRAM_ATTR void call_interrupt_handler (pin_obj_t *pin) {
     if (pin->handler) {
         if (pin->handler_arg == NULL) {
             // do a direct call (this means the pin has a C interupt handler)
             ((void(*)(void))pin->handler)();
-        } else {
+        } else if (pin->filtered) {
+            if (machpin_irq_filter_edge(pin)) {
+                mp_irq_queue_interrupt(pin_interrupt_queue_handler, pin);
+            }
+        } else if (!pin->hard || !mp_irq_call_hard(pin->handler, pin->handler_arg)) {
             // pass it to the queue
             mp_irq_queue_interrupt(pin_interrupt_queue_handler, pin);
         }
@@ -615,23 +747,44 @@ STATIC void set_pin_callback_helper(mp_obj_t self_in, mp_obj_t handler, mp_obj_t
     self->handler_arg = handler_arg;
 }
 
-/// \method callback(trigger, handler, arg)
+/// \method callback(trigger, handler, arg, *, hard=False, debounce_ms=0, rate_ms=0)
+/// With debounce_ms or rate_ms the handler is called as handler(arg, count, stamp_us), count being the
+/// accepted edges since the previous call and stamp_us the time since boot of the last one.
 STATIC mp_obj_t pin_callback(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     STATIC const mp_arg_t allowed_args[] = {
         { MP_QSTR_trigger,      MP_ARG_INT,                  {.u_int = GPIO_INTR_DISABLE} },
         { MP_QSTR_handler,      MP_ARG_OBJ,                  {.u_obj = mp_const_none} },
         { MP_QSTR_arg,          MP_ARG_OBJ,                  {.u_obj = mp_const_none} },
+        { MP_QSTR_hard,         MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_debounce_ms,  MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_rate_ms,      MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
     };
 
     // parse arguments
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
     pin_obj_t *self = pos_args[0];
+    bool enable = args[0].u_int != GPIO_INTR_DISABLE && args[1].u_obj != mp_const_none;
+
+    mp_int_t debounce_ms = args[4].u_int;
+    mp_int_t rate_ms = args[5].u_int;
+    bool filtered = enable && (debounce_ms > 0 || rate_ms > 0);
+
+    // the hard handlers keep their single argument, they can't be told the edge count
+    if (debounce_ms < 0 || debounce_ms > 60000 || rate_ms < 0 || rate_ms > 60000 || (filtered && args[3].u_bool)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    if (enable && args[3].u_bool) {
+        mp_irq_check_hard_handler(args[1].u_obj);
+    }
 
     pin_irq_disable(self);
+    self->hard = enable && args[3].u_bool;
+    machpin_irq_filter_setup(self, debounce_ms * 1000, filtered ? (rate_ms * 1000) : 0);
+    self->filtered = filtered;
 
     // enable the interrupt just before leaving
-    if (args[0].u_int != GPIO_INTR_DISABLE && args[1].u_obj != mp_const_none) {
+    if (enable) {
         set_pin_callback_helper(self, args[1].u_obj, args[2].u_obj);
         pin_extint_register(self, args[0].u_int, 0);
         mp_irq_add(self, args[1].u_obj);
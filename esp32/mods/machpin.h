@@ -74,6 +74,8 @@ typedef struct {
     unsigned int        irq_trigger : 3;
     unsigned int        value : 1;
     unsigned int        hold : 1;
+    unsigned int        hard : 1;       // the handler runs straight from the interrupt
+    unsigned int        filtered : 1;   // the edges go through the debounce and rate limit first
 } pin_obj_t;
 
 extern const mp_obj_type_t pin_type;
@@ -11,10 +11,16 @@
 #include "py/runtime.h"
 #include "py/obj.h"
 #include "py/objtuple.h"
+#include "py/objarray.h"
+#include "py/mperrno.h"
 #include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "machpin.h"
 #include "rmt.h"
 #include "machrmt.h"
+#include "mpirq.h"
 
 /******************************************************************************
  DEFINE CONSTANTS
@@ -25,13 +31,36 @@
 #define RMT_RESOLUTION_1000NS  ((uint8_t)80)   /* Maximum measured pulse-width: ~32.768 ms */
 #define RMT_RESOLUTION_3125NS  ((uint8_t)250)  /* Maximum measured pulse-width: ~102.4  ms */
 
+#define RMT_DURATION_MAX                ((uint16_t)0x7FFF)      /* 15 bit duration field of an rmt_item32_t half */
+#define RMT_ITEMS_PER_MEM_BLOCK         (64)
+/* Continuous RX: the received pulses are kept as uint16 values, level in bit 15 and duration in the lower 15 bits */
+#define RMT_RX_STREAM_LEN_DEF           (1024)
+#define RMT_RX_STREAM_TASK_STACK        (2048)
+#define RMT_RX_STREAM_TASK_PRIORITY     (6)
+#define RMT_RX_STREAM_POLL_MS           (10)
+
 /******************************************************************************
  DEFINE PRIVATE TYPES
  ******************************************************************************/
+typedef struct {
+    uint16_t *ring;
+    uint32_t size;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t overruns;
+    mp_obj_t handler;
+    volatile bool running;
+    TaskHandle_t task;
+} mach_rmt_rx_stream_t;
+
 struct _mach_rmt_obj_t {
     mp_obj_base_t base;
     rmt_config_t config;
     bool is_used;
+    bool tx_loop;
+    /* Items given to the driver, it keeps reading them from the ISR after rmt_write_items() returns */
+    rmt_item32_t *tx_items;
+    mach_rmt_rx_stream_t rx_stream;
 };
 
 /******************************************************************************
@@ -49,6 +78,222 @@ static mach_rmt_obj_t mach_rmt_obj[RMT_CHANNEL_MAX] = {
     { .config = {.channel = 7, .mem_block_num = 1, .clk_div = RMT_RESOLUTION_3125NS}, .is_used = false }
 };
 
+/******************************************************************************
+ DECLARE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC void mach_rmt_channel_deinit(mach_rmt_obj_t *self);
+STATIC void mach_rmt_tx_release(mach_rmt_obj_t *self);
+STATIC void mach_rmt_check_tx(mach_rmt_obj_t *self);
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void rmt_deinit_all (void) {
+    /* Channel 0 and 1 belong to the RGB LED */
+    for(int i = RMT_CHANNEL_2; i < RMT_CHANNEL_MAX; i++) {
+        mach_rmt_channel_deinit(&mach_rmt_obj[i]);
+    }
+}
+
+/* Hands over an initialized TX channel to another driver (LEDStrip), any transmission of the RMT object is completed first */
+rmt_channel_t mach_rmt_get_tx_channel (mp_obj_t rmt_in, uint32_t *resolution_ns) {
+    if(!MP_OBJ_IS_TYPE(rmt_in, &mach_rmt_type)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_TypeError, "An RMT object is expected!"));
+    }
+    mach_rmt_obj_t *self = rmt_in;
+    mach_rmt_check_tx(self);
+
+    MP_THREAD_GIL_EXIT();
+    mach_rmt_tx_release(self);
+    MP_THREAD_GIL_ENTER();
+
+    /* The RMT source clock is the 80 MHz APB clock */
+    *resolution_ns = (self->config.clk_div * 1000) / 80;
+    return self->config.channel;
+}
+
+/* Reserves a free channel for another driver (OneWire) which configures it, released by mach_rmt_free_channel() or rmt_deinit_all() */
+bool mach_rmt_alloc_channel (rmt_channel_t channel, gpio_num_t gpio) {
+    if(channel <= RMT_CHANNEL_1 || channel >= RMT_CHANNEL_MAX || mach_rmt_obj[channel].is_used == true) {
+        return false;
+    }
+    mach_rmt_obj[channel].config.gpio_num = gpio;
+    mach_rmt_obj[channel].is_used = true;
+    return true;
+}
+
+void mach_rmt_free_channel (rmt_channel_t channel) {
+    mach_rmt_channel_deinit(&mach_rmt_obj[channel]);
+}
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC void mach_rmt_tx_release(mach_rmt_obj_t *self) {
+    if(self->tx_loop == true) {
+        rmt_tx_stop(self->config.channel);
+        rmt_set_tx_loop_mode(self->config.channel, false);
+        self->tx_loop = false;
+    }
+    if(self->tx_items != NULL) {
+        rmt_wait_tx_done(self->config.channel, portMAX_DELAY);
+        heap_caps_free(self->tx_items);
+        self->tx_items = NULL;
+    }
+}
+
+/* Sends the items, the previous transmission is completed first as its items are released */
+STATIC void mach_rmt_write_items(mach_rmt_obj_t *self, const rmt_item32_t *items, mp_uint_t count, bool wait_tx_done, bool loop) {
+
+    if(loop == true && count >= (self->config.mem_block_num * RMT_ITEMS_PER_MEM_BLOCK)) {
+        /* Only the content of the channel's memory is repeated, one item is needed for the end marker */
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Too many items to send in loop!"));
+    }
+
+    MP_THREAD_GIL_EXIT();
+    mach_rmt_tx_release(self);
+    MP_THREAD_GIL_ENTER();
+
+    self->tx_items = heap_caps_malloc(count * sizeof(rmt_item32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_32BIT);
+    if(self->tx_items == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Not enough memory to send the data!"));
+    }
+    memcpy(self->tx_items, items, count * sizeof(rmt_item32_t));
+
+    if(loop == true) {
+        rmt_set_tx_loop_mode(self->config.channel, true);
+        self->tx_loop = true;
+        wait_tx_done = false;
+    }
+
+    MP_THREAD_GIL_EXIT();
+    esp_err_t retval = rmt_write_items(self->config.channel, self->tx_items, count, wait_tx_done);
+    MP_THREAD_GIL_ENTER();
+
+    if(retval != ESP_OK) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Could not send data!"));
+    }
+}
+
+/* Encodes alternating levels from uint16 durations, returns the number of items written */
+STATIC mp_uint_t mach_rmt_encode_durations(rmt_item32_t *items, const uint16_t *durations, mp_uint_t count, mp_uint_t level) {
+    mp_uint_t n_items = (count / 2) + (count % 2);
+    for(mp_uint_t i = 0, j = 0; i < n_items; i++) {
+        items[i].level0 = level;
+        items[i].duration0 = durations[j++] & RMT_DURATION_MAX;
+        if(j < count) {
+            items[i].level1 = !level;
+            items[i].duration1 = durations[j++] & RMT_DURATION_MAX;
+        }
+        else {
+            items[i].level1 = 0;
+            items[i].duration1 = 0;
+        }
+    }
+    return n_items;
+}
+
+STATIC void mach_rmt_get_durations(mp_obj_t obj, mp_buffer_info_t *bufinfo) {
+    mp_get_buffer_raise(obj, bufinfo, MP_BUFFER_READ);
+    if(bufinfo->typecode != 'H' || bufinfo->len == 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Durations must be given as a non empty array of 'H'!"));
+    }
+}
+
+STATIC void mach_rmt_check_tx(mach_rmt_obj_t *self) {
+    if(self->is_used == false){
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "RMT channel is not initialized!"));
+    }
+    if(self->config.rmt_mode != RMT_MODE_TX) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "RMT channel is configured for RX!"));
+    }
+}
+
+STATIC void mach_rmt_check_rx(mach_rmt_obj_t *self) {
+    if(self->is_used == false){
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "RMT channel is not initialized!"));
+    }
+    if(self->config.rmt_mode != RMT_MODE_RX) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "RMT channel is configured for TX!"));
+    }
+}
+
+STATIC void mach_rmt_rx_stream_push(mach_rmt_rx_stream_t *stream, uint32_t level, uint32_t duration) {
+    uint32_t next = (stream->head + 1) % stream->size;
+    if(next == stream->tail) {
+        /* Not read fast enough, the newest pulses are dropped */
+        stream->overruns++;
+    }
+    else {
+        stream->ring[stream->head] = (level << 15) | (duration & RMT_DURATION_MAX);
+        stream->head = next;
+    }
+}
+
+STATIC void mach_rmt_rx_stream_handler(void *arg) {
+    /* This function will be called by the interrupt thread */
+    mach_rmt_obj_t *self = arg;
+    if(self->rx_stream.handler != mp_const_none) {
+        mp_call_function_1(self->rx_stream.handler, self);
+    }
+}
+
+STATIC void TASK_RMT_RX(void *pvParameters) {
+    mach_rmt_obj_t *self = pvParameters;
+    mach_rmt_rx_stream_t *stream = &self->rx_stream;
+    RingbufHandle_t ringbuf = NULL;
+    size_t received = 0;
+
+    rmt_get_ringbuf_handle(self->config.channel, &ringbuf);
+    while(stream->running) {
+        /* A block of items is delivered each time the line stays idle for the configured threshold */
+        rmt_item32_t* items = (rmt_item32_t*)xRingbufferReceive(ringbuf, &received, RMT_RX_STREAM_POLL_MS / portTICK_PERIOD_MS);
+        if(items != NULL) {
+            for(mp_uint_t i = 0; i < received / sizeof(rmt_item32_t); i++) {
+                if(items[i].duration0 != 0) {
+                    mach_rmt_rx_stream_push(stream, items[i].level0, items[i].duration0);
+                }
+                if(items[i].duration1 != 0) {
+                    mach_rmt_rx_stream_push(stream, items[i].level1, items[i].duration1);
+                }
+            }
+            vRingbufferReturnItem(ringbuf, (void*)items);
+            if(stream->handler != mp_const_none) {
+                mp_irq_queue_interrupt_non_ISR(mach_rmt_rx_stream_handler, self);
+            }
+        }
+    }
+    stream->task = NULL;
+    vTaskDelete(NULL);
+}
+
+/* Does not touch the GIL nor the Python heap, it is also called at soft reset */
+STATIC void mach_rmt_rx_stream_stop(mach_rmt_obj_t *self) {
+    mach_rmt_rx_stream_t *stream = &self->rx_stream;
+    if(stream->task != NULL) {
+        stream->running = false;
+        /* The task exits at its next poll of the driver's ringbuffer */
+        while(stream->task != NULL) {
+            vTaskDelay(1);
+        }
+        rmt_rx_stop(self->config.channel);
+    }
+    if(stream->ring != NULL) {
+        heap_caps_free(stream->ring);
+        stream->ring = NULL;
+    }
+    stream->handler = mp_const_none;
+}
+
+STATIC void mach_rmt_channel_deinit(mach_rmt_obj_t *self) {
+    if(self->is_used == true){
+        mach_rmt_rx_stream_stop(self);
+        mach_rmt_tx_release(self);
+        gpio_matrix_out(mach_rmt_obj[self->config.channel].config.gpio_num, SIG_GPIO_OUT_IDX, 0, 0);
+        rmt_driver_uninstall(self->config.channel);
+        self->is_used = false;
+    }
+}
 
 STATIC mp_obj_t mach_rmt_init_helper(mach_rmt_obj_t *self, const mp_arg_val_t *args) {
 
@@ -68,13 +313,9 @@ STATIC mp_obj_t mach_rmt_init_helper(mach_rmt_obj_t *self, const mp_arg_val_t *a
         }
     }
 
-    /* After it is checked that the given GPIO is correct uninstall the driver if needed */
-    if(self->is_used == true) {
-        /* Deregister the previously registered GPIO */
-        gpio_matrix_out(mach_rmt_obj[self->config.channel].config.gpio_num, SIG_GPIO_OUT_IDX, 0, 0);
-        rmt_driver_uninstall(self->config.channel);
-        self->is_used = false;
-    }
+    /* After it is checked that the given GPIO is correct uninstall the driver if needed, the previously registered GPIO is deregistered */
+    mp_irq_remove(self);
+    mach_rmt_channel_deinit(self);
 
     mach_rmt_obj[self->config.channel].config.gpio_num = gpio;
 
@@ -230,11 +471,8 @@ STATIC mp_obj_t mach_rmt_deinit(mp_obj_t self_in) {
 
     mach_rmt_obj_t *self = self_in;
 
-    if(self->is_used == true){
-        gpio_matrix_out(mach_rmt_obj[self->config.channel].config.gpio_num, SIG_GPIO_OUT_IDX, 0, 0);
-        rmt_driver_uninstall(self->config.channel);
-        self->is_used = false;
-    }
+    mp_irq_remove(self);
+    mach_rmt_channel_deinit(self);
 
     return mp_const_none;
 }
@@ -273,6 +511,22 @@ STATIC mp_obj_t mach_rmt_pulses_send(mp_uint_t n_args, const mp_obj_t *pos_args,
     mp_obj_t* duration_ptr = NULL;
     bool wait_tx_done = args[4].u_bool;
 
+    /* Durations given in an array('H') with alternating levels, encoded without creating any tuple */
+    mp_buffer_info_t bufinfo;
+    if(args[2].u_obj == MP_OBJ_NULL && mp_get_buffer(args[1].u_obj, &bufinfo, MP_BUFFER_READ)) {
+        mach_rmt_get_durations(args[1].u_obj, &bufinfo);
+        if(args[3].u_obj == MP_OBJ_NULL || !MP_OBJ_IS_INT(args[3].u_obj) || mp_obj_get_int(args[3].u_obj) < 0 || mp_obj_get_int(args[3].u_obj) > 1) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "\"start_level\" can be 0 or 1"));
+        }
+        mp_uint_t count = bufinfo.len / sizeof(uint16_t);
+        mp_uint_t n_items = (count / 2) + (count % 2);
+        rmt_item32_t *items = m_new(rmt_item32_t, n_items);
+        mach_rmt_encode_durations(items, bufinfo.buf, count, mp_obj_get_int(args[3].u_obj));
+        mach_rmt_write_items(self, items, n_items, wait_tx_done, false);
+        m_del(rmt_item32_t, items, n_items);
+        return mp_const_none;
+    }
+
     /* Get the "duration" mandatory parameter */
     if(MP_OBJ_IS_SMALL_INT(args[1].u_obj) == true) {
         /* Duration is given as a single number */
@@ -392,15 +646,17 @@ STATIC mp_obj_t mach_rmt_pulses_send(mp_uint_t n_args, const mp_obj_t *pos_args,
         }
     }
 
-    MP_THREAD_GIL_EXIT();
-    esp_err_t retval = rmt_write_items(self->config.channel, items_to_send, items_to_send_count, wait_tx_done);
-    MP_THREAD_GIL_ENTER();
-
-    free(items_to_send);
-
-    if (retval != ESP_OK) {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Could not send data!"));
+    /* The items are copied, so they stay valid while the driver sends them without waiting */
+    nlr_buf_t nlr;
+    if(nlr_push(&nlr) == 0) {
+        mach_rmt_write_items(self, items_to_send, items_to_send_count, wait_tx_done, false);
+        nlr_pop();
     }
+    else {
+        free(items_to_send);
+        nlr_jump(nlr.ret_val);
+    }
+    free(items_to_send);
 
     return mp_const_none;
 }
@@ -467,6 +723,10 @@ STATIC mp_obj_t mach_rmt_pulses_get(mp_uint_t n_args, const mp_obj_t *pos_args,
     mp_uint_t number_of_rmt_item_to_receive =  pulses / 2 + (pulses % 2);
     mp_obj_t* ret_items = mp_obj_new_list(0, NULL);
 
+    if(self->rx_stream.task != NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "RMT channel is streaming!"));
+    }
+
     rmt_wait_tx_done(self->config.channel, portMAX_DELAY);
     rmt_get_ringbuf_handle(self->config.channel, &ringbuf);
     rmt_rx_start(self->config.channel, true);
@@ -518,11 +778,223 @@ STATIC mp_obj_t mach_rmt_pulses_get(mp_uint_t n_args, const mp_obj_t *pos_args,
 }
 MP_DEFINE_CONST_FUN_OBJ_KW(mach_rmt_pulses_get_obj, 0, mach_rmt_pulses_get);
 
+/* Encodes durations (array of 'H') with alternating levels into items for items_send() */
+STATIC mp_obj_t mach_rmt_encode_pulses(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    STATIC const mp_arg_t mach_rmt_encode_pulses_args[] = {
+        { MP_QSTR_duration,               MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_start_level,            MP_ARG_INT | MP_ARG_KW_ONLY,  {.u_int = 0} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(mach_rmt_encode_pulses_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(mach_rmt_encode_pulses_args), mach_rmt_encode_pulses_args, args);
+
+    mp_buffer_info_t bufinfo;
+    mach_rmt_get_durations(args[0].u_obj, &bufinfo);
+    if(args[1].u_int < 0 || args[1].u_int > 1) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "\"start_level\" can be 0 or 1"));
+    }
+
+    mp_uint_t count = bufinfo.len / sizeof(uint16_t);
+    mp_uint_t n_items = (count / 2) + (count % 2);
+    mp_obj_array_t *items = MP_OBJ_TO_PTR(mp_obj_new_bytearray_by_ref(n_items * sizeof(rmt_item32_t), m_new(rmt_item32_t, n_items)));
+    mach_rmt_encode_durations(items->items, bufinfo.buf, count, args[1].u_int);
+    return items;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_rmt_encode_pulses_obj, 1, mach_rmt_encode_pulses);
+
+/* Encodes data MSB first, each bit as a (high, low) pair of durations like the WS2812 LEDs or the IR protocols use */
+STATIC mp_obj_t mach_rmt_encode_bits(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    STATIC const mp_arg_t mach_rmt_encode_bits_args[] = {
+        { MP_QSTR_data,                   MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_zero,                   MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_one,                    MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_level,                  MP_ARG_INT | MP_ARG_KW_ONLY,  {.u_int = 1} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(mach_rmt_encode_bits_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(mach_rmt_encode_bits_args), mach_rmt_encode_bits_args, args);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
+
+    /* The item sent for a 0 and for a 1 bit */
+    rmt_item32_t symbols[2];
+    for(int i = 0; i < 2; i++) {
+        mp_obj_t *pair;
+        mp_obj_get_array_fixed_n(args[1 + i].u_obj, 2, &pair);
+        mp_int_t first = mp_obj_get_int(pair[0]);
+        mp_int_t second = mp_obj_get_int(pair[1]);
+        if(first <= 0 || first > RMT_DURATION_MAX || second <= 0 || second > RMT_DURATION_MAX) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Durations must be between 1 and 32767!"));
+        }
+        symbols[i].level0 = args[3].u_int ? 1 : 0;
+        symbols[i].duration0 = first;
+        symbols[i].level1 = args[3].u_int ? 0 : 1;
+        symbols[i].duration1 = second;
+    }
+
+    mp_uint_t n_items = bufinfo.len * 8;
+    rmt_item32_t *item = m_new(rmt_item32_t, n_items);
+    mp_obj_t items = mp_obj_new_bytearray_by_ref(n_items * sizeof(rmt_item32_t), item);
+    for(mp_uint_t i = 0; i < bufinfo.len; i++) {
+        uint8_t byte = ((uint8_t *)bufinfo.buf)[i];
+        for(int bit = 7; bit >= 0; bit--) {
+            *item++ = symbols[(byte >> bit) & 1];
+        }
+    }
+    return items;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_rmt_encode_bits_obj, 1, mach_rmt_encode_bits);
+
+/* Sends items made by encode_pulses() or encode_bits(), once or repeated until send_stop() */
+STATIC mp_obj_t mach_rmt_items_send(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    STATIC const mp_arg_t mach_rmt_items_send_args[] = {
+        { MP_QSTR_items,                  MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_wait_tx_done,           MP_ARG_BOOL | MP_ARG_KW_ONLY, {.u_bool = true} },
+        { MP_QSTR_loop,                   MP_ARG_BOOL | MP_ARG_KW_ONLY, {.u_bool = false} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(mach_rmt_items_send_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(mach_rmt_items_send_args), mach_rmt_items_send_args, args);
+
+    mach_rmt_obj_t *self = pos_args[0];
+    mach_rmt_check_tx(self);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
+    if(bufinfo.len == 0 || (bufinfo.len % sizeof(rmt_item32_t)) != 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Items must be a buffer of 32 bit RMT items!"));
+    }
+
+    mach_rmt_write_items(self, bufinfo.buf, bufinfo.len / sizeof(rmt_item32_t), args[1].u_bool, args[2].u_bool);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_rmt_items_send_obj, 1, mach_rmt_items_send);
+
+STATIC mp_obj_t mach_rmt_send_stop(mp_obj_t self_in) {
+    mach_rmt_obj_t *self = self_in;
+    mach_rmt_check_tx(self);
+
+    MP_THREAD_GIL_EXIT();
+    mach_rmt_tx_release(self);
+    MP_THREAD_GIL_ENTER();
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_rmt_send_stop_obj, mach_rmt_send_stop);
+
+/* Receives continuously into a ring of pulses, the handler is called after each received block */
+STATIC mp_obj_t mach_rmt_recv_start(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    STATIC const mp_arg_t mach_rmt_recv_start_args[] = {
+        { MP_QSTR_handler,                MP_ARG_OBJ | MP_ARG_KW_ONLY,  {.u_obj = mp_const_none} },
+        { MP_QSTR_buffer_size,            MP_ARG_INT | MP_ARG_KW_ONLY,  {.u_int = RMT_RX_STREAM_LEN_DEF} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(mach_rmt_recv_start_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(mach_rmt_recv_start_args), mach_rmt_recv_start_args, args);
+
+    mach_rmt_obj_t *self = pos_args[0];
+    mach_rmt_check_rx(self);
+
+    if(args[0].u_obj != mp_const_none && !mp_obj_is_callable(args[0].u_obj)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "The handler must be callable!"));
+    }
+    if(args[1].u_int < 2) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "The buffer must hold at least 2 pulses!"));
+    }
+
+    mp_irq_remove(self);
+    mach_rmt_rx_stream_stop(self);
+
+    mach_rmt_rx_stream_t *stream = &self->rx_stream;
+    stream->ring = heap_caps_malloc(args[1].u_int * sizeof(uint16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if(stream->ring == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Not enough memory to receive the data!"));
+    }
+    stream->size = args[1].u_int;
+    stream->head = 0;
+    stream->tail = 0;
+    stream->overruns = 0;
+    stream->handler = args[0].u_obj;
+    if(stream->handler != mp_const_none) {
+        mp_irq_add(self, stream->handler);
+    }
+
+    rmt_rx_start(self->config.channel, true);
+    stream->running = true;
+    if(xTaskCreatePinnedToCore(TASK_RMT_RX, "RMT_RX", RMT_RX_STREAM_TASK_STACK / sizeof(StackType_t), self,
+                               RMT_RX_STREAM_TASK_PRIORITY, &stream->task, 1) != pdPASS) {
+        stream->task = NULL;
+        rmt_rx_stop(self->config.channel);
+        mp_irq_remove(self);
+        mach_rmt_rx_stream_stop(self);
+        mp_raise_OSError(MP_ENOMEM);
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_rmt_recv_start_obj, 1, mach_rmt_recv_start);
+
+/* Moves the received pulses into an array of 'H' (level in bit 15), returns how many were copied */
+STATIC mp_obj_t mach_rmt_recv_into(mp_obj_t self_in, mp_obj_t buf_in) {
+    mach_rmt_obj_t *self = self_in;
+    mach_rmt_check_rx(self);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_WRITE);
+    if(bufinfo.typecode != 'H') {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "The buffer must be an array of 'H'!"));
+    }
+
+    mach_rmt_rx_stream_t *stream = &self->rx_stream;
+    uint16_t *dest = bufinfo.buf;
+    mp_uint_t max = bufinfo.len / sizeof(uint16_t);
+    mp_uint_t count = 0;
+    if(stream->ring != NULL) {
+        while(count < max && stream->tail != stream->head) {
+            dest[count++] = stream->ring[stream->tail];
+            stream->tail = (stream->tail + 1) % stream->size;
+        }
+    }
+
+    return mp_obj_new_int_from_uint(count);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_rmt_recv_into_obj, mach_rmt_recv_into);
+
+/* Returns the number of pulses dropped because the ring was full */
+STATIC mp_obj_t mach_rmt_recv_stop(mp_obj_t self_in) {
+    mach_rmt_obj_t *self = self_in;
+    mach_rmt_check_rx(self);
+
+    uint32_t overruns = self->rx_stream.overruns;
+    mp_irq_remove(self);
+    mach_rmt_rx_stream_stop(self);
+
+    return mp_obj_new_int_from_uint(overruns);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_rmt_recv_stop_obj, mach_rmt_recv_stop);
+
 STATIC const mp_map_elem_t mach_rmt_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_init),                (mp_obj_t)&mach_rmt_init_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),              (mp_obj_t)&mach_rmt_deinit_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_pulses_send),         (mp_obj_t)&mach_rmt_pulses_send_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_pulses_get),          (mp_obj_t)&mach_rmt_pulses_get_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_encode_pulses),       (mp_obj_t)&mach_rmt_encode_pulses_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_encode_bits),         (mp_obj_t)&mach_rmt_encode_bits_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_items_send),          (mp_obj_t)&mach_rmt_items_send_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_send_stop),           (mp_obj_t)&mach_rmt_send_stop_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_start),          (mp_obj_t)&mach_rmt_recv_start_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_into),           (mp_obj_t)&mach_rmt_recv_into_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_stop),           (mp_obj_t)&mach_rmt_recv_stop_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_LOW),                 MP_OBJ_NEW_SMALL_INT(RMT_CARRIER_LEVEL_LOW) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_HIGH),                MP_OBJ_NEW_SMALL_INT(RMT_CARRIER_LEVEL_HIGH) },
 };
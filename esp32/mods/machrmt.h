@@ -10,7 +10,14 @@
 #ifndef MACHRMT_H_
 #define MACHRMT_H_
 
+#include "driver/rmt.h"
+
 extern const mp_obj_type_t mach_rmt_type;
 typedef struct _mach_rmt_obj_t mach_rmt_obj_t;
 
+extern void rmt_deinit_all (void);
+extern rmt_channel_t mach_rmt_get_tx_channel (mp_obj_t rmt_in, uint32_t *resolution_ns);
+extern bool mach_rmt_alloc_channel (rmt_channel_t channel, gpio_num_t gpio);
+extern void mach_rmt_free_channel (rmt_channel_t channel);
+
 #endif  // MACHRMT_H_
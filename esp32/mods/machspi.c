@@ -54,6 +54,7 @@
 #include "esp_intr.h"
 #include "soc/dport_reg.h"
 #include "soc/gpio_sig_map.h"
+#include "driver/spi_master.h"
 
 #include "spi.h"
 #include "machspi.h"
@@ -65,9 +66,26 @@
 /// \moduleref pyb
 /// \class SPI - a master-driven serial protocol
 
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define MACH_SPI_FIRST_BIT_MSB                    0
+
+// DMA mode, driven by the ESP-IDF spi_master driver
+#define MACH_SPI_DMA_MAX_DEVICES                  3         // the default one without CS plus 2 with a CS pin
+#define MACH_SPI_DMA_QUEUE_LEN                    8         // queued transactions per device
+#define MACH_SPI_DMA_MAX_TRANSFER                 8192      // bytes per transaction, longer transfers are split
+
 /******************************************************************************
  DEFINE TYPES
  ******************************************************************************/
+typedef struct {
+    spi_device_handle_t handle;
+    spi_transaction_t trans[MACH_SPI_DMA_QUEUE_LEN];
+    uint8_t next;
+    uint8_t inflight;
+} mach_spi_dma_dev_t;
+
 typedef struct _mach_spi_obj_t {
     mp_obj_base_t base;
     pin_obj_t *pins[3];
@@ -79,12 +97,9 @@ typedef struct _mach_spi_obj_t {
     byte phase;
     byte submode;
     byte wlen;
+    bool dma;
+    mach_spi_dma_dev_t dma_dev[MACH_SPI_DMA_MAX_DEVICES];
 } mach_spi_obj_t;
-
-/******************************************************************************
- DEFINE CONSTANTS
- ******************************************************************************/
-#define MACH_SPI_FIRST_BIT_MSB                    0
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
@@ -100,6 +115,21 @@ STATIC const mp_obj_t mach_spi_def_pin[1][3] = { {&PIN_MODULE_P10, &PIN_MODULE_P
 static const uint32_t mach_spi_pin_af[1][3] = { {HSPICLK_OUT_IDX, HSPID_OUT_IDX, HSPIQ_IN_IDX} };
 #endif
 
+/******************************************************************************
+ DECLARE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC void machspi_dma_deinit (mach_spi_obj_t *self);
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void machspi_deinit_all (void) {
+    // the queued buffers belong to the heap of the previous session
+    for (int i = 0; i < MP_ARRAY_SIZE(mach_spi_obj); i++) {
+        machspi_dma_deinit(&mach_spi_obj[i]);
+    }
+}
+
 /******************************************************************************
  DEFINE PRIVATE FUNCTIONS
  ******************************************************************************/
@@ -190,7 +220,12 @@ STATIC void pybspi_transfer (mach_spi_obj_t *self, const char *txdata, char *rxd
     if (!self->baudrate) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
     }
-    // send and receive the data
+    if (self->dma) {
+        machspi_dma_transfer(self, txdata, rxdata, len, txchar);
+        return;
+    }
+    // send and receive the data, the other threads can run meanwhile
+    MP_THREAD_GIL_EXIT();
     for (int i = 0; i < len; i += self->wlen) {
         uint32_t _rxdata = 0;
         uint32_t _txdata;
@@ -212,6 +247,174 @@ STATIC void pybspi_transfer (mach_spi_obj_t *self, const char *txdata, char *rxd
             memcpy(&rxdata[i], &_rxdata, self->wlen);
         }
     }
+    MP_THREAD_GIL_ENTER();
+}
+
+STATIC spi_host_device_t machspi_dma_host (const mach_spi_obj_t *self) {
+    // SPI2 is the HSPI host and SPI3 the VSPI one
+    return (self->spi_num == SpiNum_SPI2) ? HSPI_HOST : VSPI_HOST;
+}
+
+STATIC esp_err_t machspi_dma_add_device (mach_spi_obj_t *self, uint32_t dev_id, int cs, uint32_t baudrate, uint8_t polarity, uint8_t phase) {
+    spi_device_interface_config_t devcfg = {
+        .mode = (polarity << 1) | phase,
+        .clock_speed_hz = baudrate,
+        .spics_io_num = cs,
+        .flags = (self->bitorder == SpiBitOrder_LSBFirst) ? (SPI_DEVICE_TXBIT_LSBFIRST | SPI_DEVICE_RXBIT_LSBFIRST) : 0,
+        .queue_size = MACH_SPI_DMA_QUEUE_LEN,
+    };
+    mach_spi_dma_dev_t *dev = &self->dma_dev[dev_id];
+    dev->next = 0;
+    dev->inflight = 0;
+    esp_err_t ret = spi_bus_add_device(machspi_dma_host(self), &devcfg, &dev->handle);
+    if (ret != ESP_OK) {
+        dev->handle = NULL;
+    }
+    return ret;
+}
+
+// waits for the transactions queued to a device, the other threads can run meanwhile
+STATIC uint32_t machspi_dma_wait_device (mach_spi_dma_dev_t *dev) {
+    uint32_t done = 0;
+    spi_transaction_t *trans;
+    MP_THREAD_GIL_EXIT();
+    while (dev->inflight > 0) {
+        spi_device_get_trans_result(dev->handle, &trans, portMAX_DELAY);
+        dev->inflight--;
+        done++;
+    }
+    MP_THREAD_GIL_ENTER();
+    return done;
+}
+
+STATIC uint32_t machspi_dma_wait_all (mach_spi_obj_t *self) {
+    uint32_t done = 0;
+    for (int i = 0; i < MACH_SPI_DMA_MAX_DEVICES; i++) {
+        if (self->dma_dev[i].handle) {
+            done += machspi_dma_wait_device(&self->dma_dev[i]);
+        }
+    }
+    // the buffers of the finished transactions can be collected now
+    MP_STATE_PORT(mach_spi_dma_pending)[self->spi_num - 2] = MP_OBJ_NULL;
+    return done;
+}
+
+// queues the transfer, split in transactions of at most MACH_SPI_DMA_MAX_TRANSFER bytes, so that a whole
+// frame can be handed at once; the buffers must stay untouched until SPI.wait() returns
+STATIC void machspi_dma_queue (mach_spi_obj_t *self, uint32_t dev_id, mp_obj_t txbuf_o, const void *txbuf, mp_obj_t rxbuf_o, void *rxbuf, uint32_t len) {
+    if (!self->baudrate || !self->dma) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+    if (dev_id >= MACH_SPI_DMA_MAX_DEVICES || !self->dma_dev[dev_id].handle) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    if (len == 0) {
+        return;
+    }
+    mach_spi_dma_dev_t *dev = &self->dma_dev[dev_id];
+
+    // keep the buffers alive while the DMA uses them
+    mp_obj_t *pending = &MP_STATE_PORT(mach_spi_dma_pending)[self->spi_num - 2];
+    if (*pending == MP_OBJ_NULL) {
+        *pending = mp_obj_new_list(0, NULL);
+    }
+    mp_obj_list_append(*pending, txbuf_o);
+    if (rxbuf_o != MP_OBJ_NULL) {
+        mp_obj_list_append(*pending, rxbuf_o);
+    }
+
+    for (uint32_t offset = 0; offset < len; offset += MACH_SPI_DMA_MAX_TRANSFER) {
+        if (dev->inflight == MACH_SPI_DMA_QUEUE_LEN) {
+            // the queue is full, wait for the oldest one to finish
+            spi_transaction_t *trans;
+            MP_THREAD_GIL_EXIT();
+            spi_device_get_trans_result(dev->handle, &trans, portMAX_DELAY);
+            MP_THREAD_GIL_ENTER();
+            dev->inflight--;
+        }
+
+        spi_transaction_t *trans = &dev->trans[dev->next];
+        memset(trans, 0, sizeof(*trans));
+        trans->length = MIN(len - offset, MACH_SPI_DMA_MAX_TRANSFER) * 8;
+        trans->tx_buffer = (const uint8_t *)txbuf + offset;
+        trans->rx_buffer = rxbuf ? (uint8_t *)rxbuf + offset : NULL;
+        if (spi_device_queue_trans(dev->handle, trans, portMAX_DELAY) != ESP_OK) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+        }
+        dev->next = (dev->next + 1) % MACH_SPI_DMA_QUEUE_LEN;
+        dev->inflight++;
+    }
+}
+
+// blocking transfer on the default device, split in chunks the DMA descriptors can hold
+STATIC void machspi_dma_transfer (mach_spi_obj_t *self, const char *txdata, char *rxdata, uint32_t len, uint32_t *txchar) {
+    uint8_t *fill = NULL;
+    uint32_t fill_len = 0;
+
+    machspi_dma_wait_all(self);
+    if (!txdata) {
+        // repeat the write value, a word at a time like the polled mode does
+        fill_len = MIN(len, MACH_SPI_DMA_MAX_TRANSFER);
+        fill = m_new(uint8_t, fill_len);
+        uint32_t value = txchar ? *txchar : 0x55555555;
+        for (uint32_t i = 0; i < fill_len; i++) {
+            fill[i] = ((uint8_t *)&value)[i % self->wlen];
+        }
+    }
+
+    esp_err_t ret = ESP_OK;
+    MP_THREAD_GIL_EXIT();
+    for (uint32_t i = 0; i < len && ret == ESP_OK; i += MACH_SPI_DMA_MAX_TRANSFER) {
+        spi_transaction_t trans = {
+            .length = MIN(len - i, MACH_SPI_DMA_MAX_TRANSFER) * 8,
+            .tx_buffer = txdata ? (const void *)&txdata[i] : (const void *)fill,
+            .rx_buffer = rxdata ? (void *)&rxdata[i] : NULL,
+        };
+        ret = spi_device_transmit(self->dma_dev[0].handle, &trans);
+    }
+    MP_THREAD_GIL_ENTER();
+
+    if (fill) {
+        m_del(uint8_t, fill, fill_len);
+    }
+    if (ret != ESP_OK) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+}
+
+STATIC void machspi_dma_deinit (mach_spi_obj_t *self) {
+    if (self->dma) {
+        machspi_dma_wait_all(self);
+        for (int i = 0; i < MACH_SPI_DMA_MAX_DEVICES; i++) {
+            if (self->dma_dev[i].handle) {
+                spi_bus_remove_device(self->dma_dev[i].handle);
+                self->dma_dev[i].handle = NULL;
+            }
+        }
+        spi_bus_free(machspi_dma_host(self));
+        self->dma = false;
+    }
+}
+
+STATIC void machspi_dma_init (mach_spi_obj_t *self) {
+    spi_bus_config_t buscfg = {
+        .sclk_io_num = self->pins[PIN_TYPE_SPI_CLK] ? self->pins[PIN_TYPE_SPI_CLK]->pin_number : -1,
+        .mosi_io_num = self->pins[PIN_TYPE_SPI_MOSI] ? self->pins[PIN_TYPE_SPI_MOSI]->pin_number : -1,
+        .miso_io_num = self->pins[PIN_TYPE_SPI_MISO] ? self->pins[PIN_TYPE_SPI_MISO]->pin_number : -1,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = MACH_SPI_DMA_MAX_TRANSFER,
+    };
+    // each host gets its own DMA channel
+    if (spi_bus_initialize(machspi_dma_host(self), &buscfg, machspi_dma_host(self)) != ESP_OK) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_resource_not_avaliable));
+    }
+    self->dma = true;
+    // the default device has no CS pin, the application drives it if needed
+    if (machspi_dma_add_device(self, 0, -1, self->baudrate, self->polarity, self->phase) != ESP_OK) {
+        machspi_dma_deinit(self);
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_resource_not_avaliable));
+    }
 }
 
 static void spi_assign_pins_af (mach_spi_obj_t *self, mp_obj_t *pins) {
@@ -305,6 +508,7 @@ STATIC mp_obj_t pyb_spi_init_helper(mach_spi_obj_t *self, const mp_arg_val_t *ar
         goto invalid_args;
     }
 
+    machspi_dma_deinit(self);
     spi_deassign_pins_af(self);
     // assign the pins
     mp_obj_t pins_o = args[6].u_obj;
@@ -320,7 +524,11 @@ STATIC mp_obj_t pyb_spi_init_helper(mach_spi_obj_t *self, const mp_arg_val_t *ar
     }
 
     // init the bus
-    machspi_init((const mach_spi_obj_t *)self);
+    if (args[7].u_bool) {
+        machspi_dma_init(self);
+    } else {
+        machspi_init((const mach_spi_obj_t *)self);
+    }
 
     return mp_const_none;
 
@@ -337,6 +545,7 @@ static const mp_arg_t pyb_spi_init_args[] = {
     { MP_QSTR_phase,        MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 0} },
     { MP_QSTR_firstbit,     MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = SpiBitOrder_MSBFirst} },
     { MP_QSTR_pins,         MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = MP_OBJ_NULL} },
+    { MP_QSTR_dma,          MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
 };
 STATIC mp_obj_t pyb_spi_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args) {
     // parse args
@@ -378,6 +587,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(pyb_spi_init_obj, 1, pyb_spi_init);
 STATIC mp_obj_t pyb_spi_deinit(mp_obj_t self_in) {
     mach_spi_obj_t *self = self_in;
     if (self->baudrate > 0) {
+        machspi_dma_deinit(self);
         self->baudrate = 0;
         spi_deassign_pins_af(self);
     }
@@ -479,6 +689,98 @@ STATIC mp_obj_t pyb_spi_write_readinto (mp_obj_t self, mp_obj_t writebuf, mp_obj
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(pyb_spi_write_readinto_obj, pyb_spi_write_readinto);
 
+/// \method add_device(cs, *, baudrate, polarity, phase)
+/// Adds a device with its own CS pin to a bus in DMA mode, returns its id for the asynchronous transfers.
+STATIC mp_obj_t pyb_spi_add_device(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_cs,           MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_baudrate,     MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_polarity,     MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = -1} },
+        { MP_QSTR_phase,        MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = -1} },
+    };
+
+    mach_spi_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    if (!self->baudrate || !self->dma) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+    pin_obj_t *cs = pin_find(args[0].u_obj);
+    uint32_t baudrate = args[1].u_int > 0 ? args[1].u_int : self->baudrate;
+    int polarity = args[2].u_int >= 0 ? args[2].u_int : self->polarity;
+    int phase = args[3].u_int >= 0 ? args[3].u_int : self->phase;
+    if (polarity > 1 || phase > 1) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+
+    for (int i = 1; i < MACH_SPI_DMA_MAX_DEVICES; i++) {
+        if (!self->dma_dev[i].handle) {
+            if (machspi_dma_add_device(self, i, cs->pin_number, baudrate, polarity, phase) != ESP_OK) {
+                break;
+            }
+            return MP_OBJ_NEW_SMALL_INT(i);
+        }
+    }
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_resource_not_avaliable));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(pyb_spi_add_device_obj, 1, pyb_spi_add_device);
+
+/// \method write_async(buf, *, device=0)
+/// Queues a write, it runs while Python continues.
+STATIC mp_obj_t pyb_spi_write_async(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_buf,          MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_device,       MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0} },
+    };
+
+    mach_spi_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
+    machspi_dma_queue(self, args[1].u_int, args[0].u_obj, bufinfo.buf, MP_OBJ_NULL, NULL, bufinfo.len);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(pyb_spi_write_async_obj, 1, pyb_spi_write_async);
+
+/// \method write_readinto_async(write_buf, read_buf, *, device=0)
+/// Queues a full duplex transfer, read_buf is valid once SPI.wait() returns.
+STATIC mp_obj_t pyb_spi_write_readinto_async(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_write_buf,    MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_read_buf,     MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_device,       MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0} },
+    };
+
+    mach_spi_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    mp_buffer_info_t bufinfo_write;
+    mp_buffer_info_t bufinfo_read;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo_write, MP_BUFFER_READ);
+    mp_get_buffer_raise(args[1].u_obj, &bufinfo_read, MP_BUFFER_WRITE);
+    if (bufinfo_read.len != bufinfo_write.len) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    machspi_dma_queue(self, args[2].u_int, args[0].u_obj, bufinfo_write.buf, args[1].u_obj, bufinfo_read.buf, bufinfo_write.len);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(pyb_spi_write_readinto_async_obj, 1, pyb_spi_write_readinto_async);
+
+/// \method wait()
+/// Waits for all the queued transfers, returns how many finished.
+STATIC mp_obj_t pyb_spi_wait(mp_obj_t self_in) {
+    mach_spi_obj_t *self = self_in;
+    if (!self->dma) {
+        return MP_OBJ_NEW_SMALL_INT(0);
+    }
+    return mp_obj_new_int_from_uint(machspi_dma_wait_all(self));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(pyb_spi_wait_obj, pyb_spi_wait);
+
 STATIC const mp_map_elem_t pyb_spi_locals_dict_table[] = {
     // instance methods
     { MP_OBJ_NEW_QSTR(MP_QSTR_init),                (mp_obj_t)&pyb_spi_init_obj },
@@ -487,6 +789,10 @@ STATIC const mp_map_elem_t pyb_spi_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_read),                (mp_obj_t)&pyb_spi_read_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_readinto),            (mp_obj_t)&pyb_spi_readinto_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_write_readinto),      (mp_obj_t)&pyb_spi_write_readinto_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_add_device),          (mp_obj_t)&pyb_spi_add_device_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_write_async),         (mp_obj_t)&pyb_spi_write_async_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_write_readinto_async),(mp_obj_t)&pyb_spi_write_readinto_async_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_wait),                (mp_obj_t)&pyb_spi_wait_obj },
 
     // class constants
     { MP_OBJ_NEW_QSTR(MP_QSTR_MASTER),              MP_OBJ_NEW_SMALL_INT(SpiMode_Master) },
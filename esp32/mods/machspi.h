@@ -39,4 +39,6 @@
 
 extern const mp_obj_type_t mach_spi_type;
 
+extern void machspi_deinit_all (void);
+
 #endif  // MACHSPI_H_
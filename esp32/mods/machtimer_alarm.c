@@ -27,10 +27,14 @@ typedef struct {
     mp_obj_base_t base;
     uint64_t when;
     uint64_t interval;
+    uint64_t slack;                 // The alarm may fire this much later, to expire together with other alarms
     uint32_t heap_index;
     mp_obj_t handler;
     mp_obj_t handler_arg;
+    uint16_t fired;                 // Expiries not dispatched yet
+    bool batched;                   // In alarm_batch, waiting for alarm_dispatch()
     bool periodic;
+    bool hard;
 } mp_obj_alarm_t;
 
 struct {
@@ -38,13 +42,19 @@ struct {
     mp_obj_alarm_t **data;
 } alarm_heap;
 
+// The alarms expired in the ISR, all dispatched by a single call of alarm_dispatch() in the interrupt task
+STATIC struct {
+    uint32_t count;
+    mp_obj_alarm_t *data[ALARM_HEAP_MAX_ELEMENTS];
+} alarm_batch;
+
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
 IRAM_ATTR void timer_alarm_isr(void *arg);
 STATIC void load_next_alarm(void);
 STATIC mp_obj_t alarm_delete(mp_obj_t self_in);
-STATIC void alarm_set_callback_helper(mp_obj_t self_in, mp_obj_t handler, mp_obj_t handler_arg);
+STATIC void alarm_set_callback_helper(mp_obj_t self_in, mp_obj_t handler, mp_obj_t handler_arg, bool hard);
 
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
@@ -55,6 +65,7 @@ void mach_timer_alarm_preinit(void) {
 
 void mach_timer_alarm_init_heap(void) {
     alarm_heap.count = 0;
+    alarm_batch.count = 0;
     MP_STATE_PORT(mp_alarm_heap) = m_malloc(ALARM_HEAP_MAX_ELEMENTS * sizeof(mp_obj_alarm_t *));
     alarm_heap.data = MP_STATE_PORT(mp_alarm_heap);
     if (alarm_heap.data == NULL) {
@@ -63,6 +74,11 @@ void mach_timer_alarm_init_heap(void) {
     }
 }
 
+bool mach_timer_alarm_pending(void) {
+    // the alarms run from a timer group, which is stopped in light sleep
+    return alarm_heap.count > 0;
+}
+
 // Insert a new alarm into the heap
 // Note: It has already been checked that there is at least 1 free space on the heap
 // Note: The heap will remain ordered after the operation.
@@ -131,52 +147,118 @@ STATIC IRAM_ATTR void load_next_alarm(void) {
     TIMERG0.hw_timer[0].config.alarm_en = 0; // disable the alarm system
     // everything here done without calling any timers function, so it works inside the interrupts
     if (alarm_heap.count > 0) {
-        uint64_t when;
-        when = alarm_heap.data[0]->when;
+        // the timer fires at the first deadline (when + slack), the ISR then expires all the alarms already due
+        uint64_t when = alarm_heap.data[0]->when + alarm_heap.data[0]->slack;
+        for (uint32_t index = 1; index < alarm_heap.count && alarm_heap.data[index]->when < when; index++) {
+            if (alarm_heap.data[index]->when + alarm_heap.data[index]->slack < when) {
+                when = alarm_heap.data[index]->when + alarm_heap.data[index]->slack;
+            }
+        }
         TIMERG0.hw_timer[0].alarm_high = (uint32_t) (when >> 32);
         TIMERG0.hw_timer[0].alarm_low = (uint32_t) when;
         TIMERG0.hw_timer[0].config.alarm_en = 1; // enable the alarm system
     }
 }
 
-STATIC IRAM_ATTR void set_alarm_when(mp_obj_alarm_t *alarm, uint64_t delta) {
+STATIC IRAM_ATTR uint64_t get_timer_counter(void) {
     TIMERG0.hw_timer[0].update = 1;
-    alarm->when = ((uint64_t) TIMERG0.hw_timer[0].cnt_high << 32)
+    return ((uint64_t) TIMERG0.hw_timer[0].cnt_high << 32)
         | (TIMERG0.hw_timer[0].cnt_low);
-    alarm->when += delta;
 }
 
-STATIC void alarm_handler(void *arg) {
+STATIC IRAM_ATTR void set_alarm_when(mp_obj_alarm_t *alarm, uint64_t delta) {
+    alarm->when = get_timer_counter() + delta;
+}
+
+STATIC void alarm_done(void *arg) {
     // this function will be called by the interrupt thread
     mp_obj_alarm_t *alarm = arg;
 
-    if (alarm->handler && alarm->handler != mp_const_none) {
-        mp_call_function_1(alarm->handler, alarm->handler_arg);
-    }
     if (!alarm->periodic) {
         mp_irq_remove(alarm);
         INTERRUPT_OBJ_CLEAN(alarm);
     }
 }
 
+STATIC void alarm_dispatch(void *arg) {
+    // this function will be called by the interrupt thread
+    mp_obj_alarm_t *batch[ALARM_HEAP_MAX_ELEMENTS];
+    uint16_t fired[ALARM_HEAP_MAX_ELEMENTS];
+    mp_obj_t exc = MP_OBJ_NULL;
+
+    // take the whole batch, the alarms expiring from now on start a new one
+    uint32_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    uint32_t count = alarm_batch.count;
+    for (uint32_t i = 0; i < count; i++) {
+        batch[i] = alarm_batch.data[i];
+        fired[i] = batch[i]->fired;
+        batch[i]->fired = 0;
+        batch[i]->batched = false;
+    }
+    alarm_batch.count = 0;
+    MICROPY_END_ATOMIC_SECTION(state);
+
+    for (uint32_t i = 0; i < count; i++) {
+        mp_obj_alarm_t *alarm = batch[i];
+        for (; fired[i] > 0 && exc == MP_OBJ_NULL && alarm->handler && alarm->handler != mp_const_none; fired[i]--) {
+            // an exception doesn't stop the other alarms of the batch, it's raised once they're done
+            nlr_buf_t nlr;
+            if (nlr_push(&nlr) == 0) {
+                mp_call_function_1(alarm->handler, alarm->handler_arg);
+                nlr_pop();
+            } else {
+                exc = MP_OBJ_FROM_PTR(nlr.ret_val);
+            }
+        }
+        alarm_done(alarm);
+    }
+
+    if (exc != MP_OBJ_NULL) {
+        nlr_raise(exc);
+    }
+}
+
 IRAM_ATTR void timer_alarm_isr(void *arg) {
     TIMERG0.int_clr_timers.t0 = 1; // acknowledge the interrupt
 
+    uint64_t now = get_timer_counter();
+    bool dispatch = false;
+
     // need to check whether all the alarms have been removed from the list
     // or not since the last time the HW timer was set up
-    if (alarm_heap.count > 0) {
+    // all the alarms due are expired together, the ones with a slack may be a bit late
+    while (alarm_heap.count > 0 && alarm_heap.data[0]->when <= now) {
         mp_obj_alarm_t *alarm = alarm_heap.data[0];
 
-        // This will automatically load the next alarm in the queue
         remove_alarm(0);
 
         if (alarm->periodic) {
-            set_alarm_when(alarm, alarm->interval);
-            // If this alarm is inserted back to the 0th place, load again
+            // keeps the period, even when fired late because of the slack
+            alarm->when += alarm->interval;
+            if (alarm->when <= now) {
+                alarm->when = now + alarm->interval;
+            }
             insert_alarm(alarm);
         }
 
-        mp_irq_queue_interrupt(alarm_handler, alarm);
+        // releasing a one-shot alarm needs the GIL even if the hard handler was called
+        bool handled = alarm->hard && mp_irq_call_hard(alarm->handler, alarm->handler_arg);
+        if (!handled || !alarm->periodic) {
+            if (!handled && alarm->fired < UINT16_MAX) {
+                alarm->fired++;
+            }
+            if (!alarm->batched && alarm_batch.count < ALARM_HEAP_MAX_ELEMENTS) {
+                alarm->batched = true;
+                alarm_batch.data[alarm_batch.count++] = alarm;
+            }
+            dispatch = true;
+        }
+    }
+
+    load_next_alarm();
+
+    if (dispatch) {
+        mp_irq_queue_interrupt(alarm_dispatch, NULL);
     }
 }
 
@@ -189,6 +271,8 @@ STATIC mp_obj_t alarm_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_u
         { MP_QSTR_us,           MP_ARG_INT  | MP_ARG_KW_ONLY,    {.u_int = 0} },
         { MP_QSTR_arg,          MP_ARG_OBJ  | MP_ARG_KW_ONLY,    {.u_obj = mp_const_none} },
         { MP_QSTR_periodic,     MP_ARG_BOOL | MP_ARG_KW_ONLY,    {.u_bool = false} },
+        { MP_QSTR_hard,         MP_ARG_BOOL | MP_ARG_KW_ONLY,    {.u_bool = false} },
+        { MP_QSTR_slack_us,     MP_ARG_INT  | MP_ARG_KW_ONLY,    {.u_int = 0} },
     };
 
     // parse arguments
@@ -208,7 +292,7 @@ STATIC mp_obj_t alarm_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_u
         mp_raise_ValueError("please provide a single duration");
     }
 
-    if (s < 0.0 || ms < 0 || us < 0) {
+    if (s < 0.0 || ms < 0 || us < 0 || args[7].u_int < 0) {
         mp_raise_ValueError("please provide a positive number");
     }
 
@@ -218,17 +302,24 @@ STATIC mp_obj_t alarm_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_u
 
     self->base.type = type;
     self->interval = clocks;
+    self->slack = (uint64_t)args[7].u_int * (CLK_FREQ / 1000000);
     self->periodic = args[5].u_bool;
+    self->fired = 0;
+    self->batched = false;
 
     self->heap_index = -1;
-    alarm_set_callback_helper(self, args[0].u_obj, args[4].u_obj);
+    alarm_set_callback_helper(self, args[0].u_obj, args[4].u_obj, args[6].u_bool);
     return self;
 }
 
-STATIC void alarm_set_callback_helper(mp_obj_t self_in, mp_obj_t handler, mp_obj_t handler_arg) {
+STATIC void alarm_set_callback_helper(mp_obj_t self_in, mp_obj_t handler, mp_obj_t handler_arg, bool hard) {
     bool error = false;
     mp_obj_alarm_t *self = self_in;
 
+    if (hard && handler != mp_const_none) {
+        mp_irq_check_hard_handler(handler);
+    }
+
     // do as much as possible outside the atomic section
     // handler is given by the user for sure
     self->handler = handler;
@@ -252,6 +343,7 @@ STATIC void alarm_set_callback_helper(mp_obj_t self_in, mp_obj_t handler, mp_obj
         mp_irq_remove(self);
         INTERRUPT_OBJ_CLEAN(self);
     }
+    self->hard = hard;
 
     if (alarm_heap.count == ALARM_HEAP_MAX_ELEMENTS) {
         error = true;
@@ -272,13 +364,14 @@ STATIC mp_obj_t alarm_callback(size_t n_args, const mp_obj_t *pos_args, mp_map_t
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_handler,  MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = mp_const_none} },
         { MP_QSTR_arg,      MP_ARG_OBJ | MP_ARG_KW_ONLY,  {.u_obj = mp_const_none} },
+        { MP_QSTR_hard,     MP_ARG_BOOL | MP_ARG_KW_ONLY, {.u_bool = false} },
     };
 
     mp_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
 
-    alarm_set_callback_helper(self, args[0].u_obj, args[1].u_obj);
+    alarm_set_callback_helper(self, args[0].u_obj, args[1].u_obj, args[2].u_bool);
 
     return mp_const_none;
 }
@@ -298,6 +391,17 @@ STATIC mp_obj_t alarm_delete(mp_obj_t self_in) {
     if (self->heap_index != -1) {
         remove_alarm(self->heap_index);
     }
+    // the expiries not dispatched yet are dropped
+    if (self->batched) {
+        for (uint32_t i = 0; i < alarm_batch.count; i++) {
+            if (alarm_batch.data[i] == self) {
+                alarm_batch.data[i] = alarm_batch.data[--alarm_batch.count];
+                break;
+            }
+        }
+        self->batched = false;
+        self->fired = 0;
+    }
     mp_irq_remove(self);
     INTERRUPT_OBJ_CLEAN(self);
     MICROPY_END_ATOMIC_SECTION(state);
@@ -4,5 +4,6 @@
 extern const mp_obj_type_t mach_timer_alarm_type;
 extern void mach_timer_alarm_preinit(void);
 extern void mach_timer_alarm_init_heap(void);
+extern bool mach_timer_alarm_pending(void);
 
 #endif  // MACHTIMER_ALARM_H_
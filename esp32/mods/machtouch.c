@@ -28,6 +28,7 @@
 #include <stdio.h>
 
 #include "esp_log.h"
+#include "esp_sleep.h"
 
 #include "driver/gpio.h"
 #include "driver/touch_pad.h"
@@ -36,12 +37,15 @@
 #include "py/mphal.h"
 #include "machtouch.h"
 #include "machpin.h"
+#include "mpirq.h"
+#include "mpexception.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 
 #define TOUCHPAD_FILTER_TOUCH_PERIOD_MS         (10)
+#define TOUCHPAD_FILTER_PERIOD_MAX_MS           (1000)
 
 
 typedef struct _mtp_obj_t {
@@ -49,6 +53,11 @@ typedef struct _mtp_obj_t {
     gpio_num_t gpio_id;
     touch_pad_t touchpad_id;
     uint16_t init_value;
+    uint16_t threshold;
+    bool configured;
+    bool wake;
+    mp_obj_t handler;
+    mp_obj_t handler_arg;
 } mtp_obj_t;
 
 STATIC mtp_obj_t touchpad_obj[] = {
@@ -64,19 +73,13 @@ STATIC mtp_obj_t touchpad_obj[] = {
     {{&machine_touchpad_type}, GPIO_NUM_32, TOUCH_PAD_NUM9},
 };
 
-STATIC mp_obj_t mtp_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw,
-        const mp_obj_t *args) {
-
-    mp_arg_check_num(n_args, n_kw, 1, 1, true);
-    pin_obj_t *pin = pin_find(args[0]);
-    mtp_obj_t *self = NULL;
-    for (int i = 0; i < MP_ARRAY_SIZE(touchpad_obj); i++) {
-        if (pin->pin_number == touchpad_obj[i].gpio_id) { self = &touchpad_obj[i]; break; }
-    }
-    if (!self) mp_raise_ValueError("invalid pin for touchpad");
+// 0 when the IIR filter is stopped and the pads are read raw
+STATIC uint32_t mtp_filter_period = TOUCHPAD_FILTER_TOUCH_PERIOD_MS;
+STATIC bool mtp_initialized;
+STATIC bool mtp_isr_registered;
 
-    static int initialized = 0;
-    if (!initialized) {
+STATIC void mtp_init(void) {
+    if (!mtp_initialized) {
         touch_pad_init();
         // If use interrupt trigger mode, should set touch sensor FSM mode at 'TOUCH_FSM_MODE_TIMER'.
         touch_pad_set_fsm_mode(TOUCH_FSM_MODE_TIMER);
@@ -85,14 +88,82 @@ STATIC mp_obj_t mtp_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_
         // the high reference valtage will be 2.7V - 1V = 1.7V, The low reference voltage will be 0.5V.
         touch_pad_set_voltage(TOUCH_HVOLT_2V7, TOUCH_LVOLT_0V5, TOUCH_HVOLT_ATTEN_1V);
         // initialize and start a software filter to detect slight changes in capacitance
-        touch_pad_filter_start(TOUCHPAD_FILTER_TOUCH_PERIOD_MS);
+        if (mtp_filter_period > 0) {
+            touch_pad_filter_start(mtp_filter_period);
+        }
         touch_pad_intr_disable();
         touch_pad_clear_status();
-        initialized = 1;
+        mtp_initialized = true;
+    }
+}
+
+STATIC esp_err_t mtp_read_value(touch_pad_t pad, uint16_t *value) {
+    if (mtp_filter_period > 0) {
+        return touch_pad_read_filtered(pad, value);
+    }
+    return touch_pad_read(pad, value);
+}
+
+STATIC void mtp_irq_handler(void *arg) {
+    // this function will be called by the interrupt thread
+    mtp_obj_t *self = arg;
+    if (self->handler != NULL && self->handler != mp_const_none) {
+        mp_call_function_1(self->handler, self->handler_arg);
+    }
+}
+
+// the FSM measures the pads on its own timer and raises this while a pad reads below its threshold,
+// each measurement cycle raises it again so the queued callbacks of a held pad are coalesced
+STATIC void mtp_isr(void *arg) {
+    uint32_t status = touch_pad_get_status();
+    touch_pad_clear_status();
+    for (int i = 0; i < MP_ARRAY_SIZE(touchpad_obj); i++) {
+        if ((status & BIT(touchpad_obj[i].touchpad_id)) && touchpad_obj[i].handler != NULL) {
+            mp_irq_queue_interrupt(mtp_irq_handler, &touchpad_obj[i]);
+        }
+    }
+}
+
+// the wake up on touch covers all the pads with a threshold, it stays enabled while one of them asks for it
+STATIC void mtp_update_wake(void) {
+    for (int i = 0; i < MP_ARRAY_SIZE(touchpad_obj); i++) {
+        if (touchpad_obj[i].wake) {
+            esp_sleep_enable_touchpad_wakeup();
+            return;
+        }
+    }
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TOUCHPAD);
+}
+
+void machtouch_deinit_all(void) {
+    // the handlers belong to the heap of the previous session
+    if (mtp_initialized) {
+        touch_pad_intr_disable();
+    }
+    for (int i = 0; i < MP_ARRAY_SIZE(touchpad_obj); i++) {
+        touchpad_obj[i].handler = NULL;
+        touchpad_obj[i].handler_arg = NULL;
+        touchpad_obj[i].wake = false;
+    }
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TOUCHPAD);
+}
+
+STATIC mp_obj_t mtp_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw,
+        const mp_obj_t *args) {
+
+    mp_arg_check_num(n_args, n_kw, 1, 1, true);
+    pin_obj_t *pin = pin_find(args[0]);
+    mtp_obj_t *self = NULL;
+    for (int i = 0; i < MP_ARRAY_SIZE(touchpad_obj); i++) {
+        if (pin->pin_number == touchpad_obj[i].gpio_id) { self = &touchpad_obj[i]; break; }
     }
-    esp_err_t err = touch_pad_config(self->touchpad_id, 0);
+    if (!self) mp_raise_ValueError("invalid pin for touchpad");
+
+    mtp_init();
+    esp_err_t err = touch_pad_config(self->touchpad_id, self->threshold);
     mp_hal_delay_ms(TOUCHPAD_FILTER_TOUCH_PERIOD_MS * 2);
-    touch_pad_read_filtered(self->touchpad_id, &self->init_value);
+    mtp_read_value(self->touchpad_id, &self->init_value);
+    self->configured = (err == ESP_OK);
 
     if (err == ESP_OK) return MP_OBJ_FROM_PTR(self);
     mp_raise_ValueError("Touch pad error");
@@ -102,7 +173,10 @@ STATIC mp_obj_t mtp_config(mp_obj_t self_in, mp_obj_t value_in) {
     mtp_obj_t *self = self_in;
     uint16_t value = mp_obj_get_int(value_in);
     esp_err_t err = touch_pad_config(self->touchpad_id, value);
-    if (err == ESP_OK) return mp_const_none;
+    if (err == ESP_OK) {
+        self->threshold = value;
+        return mp_const_none;
+    }
     mp_raise_ValueError("Touch pad error");
 }
 MP_DEFINE_CONST_FUN_OBJ_2(mtp_config_obj, mtp_config);
@@ -110,12 +184,116 @@ MP_DEFINE_CONST_FUN_OBJ_2(mtp_config_obj, mtp_config);
 STATIC mp_obj_t mtp_read(mp_obj_t self_in) {
     mtp_obj_t *self = self_in;
     uint16_t value;
-    esp_err_t err = touch_pad_read_filtered(self->touchpad_id, &value);
+    esp_err_t err = mtp_read_value(self->touchpad_id, &value);
     if (err == ESP_OK) return MP_OBJ_NEW_SMALL_INT(value);
     mp_raise_ValueError("Touch pad error");
 }
 MP_DEFINE_CONST_FUN_OBJ_1(mtp_read_obj, mtp_read);
 
+// fills buf (an array('H') or a bytearray) with the pads created so far, in pad order,
+// and returns how many there were
+STATIC mp_obj_t mtp_read_all(mp_obj_t buf_in) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_WRITE);
+    uint16_t *values = bufinfo.buf;
+    size_t len = bufinfo.len / sizeof(uint16_t);
+    size_t count = 0;
+
+    for (int i = 0; i < MP_ARRAY_SIZE(touchpad_obj); i++) {
+        if (touchpad_obj[i].configured) {
+            if (count >= len) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+            }
+            uint16_t value;
+            if (mtp_read_value(touchpad_obj[i].touchpad_id, &value) != ESP_OK) {
+                mp_raise_ValueError("Touch pad error");
+            }
+            values[count++] = value;
+        }
+    }
+    return MP_OBJ_NEW_SMALL_INT(count);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mtp_read_all_fun_obj, mtp_read_all);
+STATIC MP_DEFINE_CONST_STATICMETHOD_OBJ(mtp_read_all_obj, (mp_obj_t)&mtp_read_all_fun_obj);
+
+// the period of the IIR filter shared by all the pads, 0 stops it and the reads return the raw values
+STATIC mp_obj_t mtp_filter(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        return MP_OBJ_NEW_SMALL_INT(mtp_filter_period);
+    }
+    mp_int_t period = mp_obj_get_int(args[0]);
+    if (period < 0 || period > TOUCHPAD_FILTER_PERIOD_MAX_MS) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    mtp_init();
+    if (mtp_filter_period > 0) {
+        touch_pad_filter_stop();
+        touch_pad_filter_delete();
+    }
+    if (period > 0 && touch_pad_filter_start(period) != ESP_OK) {
+        mtp_filter_period = 0;
+        mp_raise_ValueError("Touch pad error");
+    }
+    mtp_filter_period = period;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mtp_filter_fun_obj, 0, 1, mtp_filter);
+STATIC MP_DEFINE_CONST_STATICMETHOD_OBJ(mtp_filter_obj, (mp_obj_t)&mtp_filter_fun_obj);
+
+/// \method callback(handler, *, threshold=None, arg=None, wake=False)
+/// The handler runs while the pad reads below threshold, by default two thirds of init_value.
+STATIC mp_obj_t mtp_callback(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_handler,      MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_threshold,    MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+        { MP_QSTR_arg,          MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+        { MP_QSTR_wake,         MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+    mtp_obj_t *self = pos_args[0];
+
+    if (args[0].u_obj == mp_const_none) {
+        uint32_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+        self->handler = NULL;
+        MICROPY_END_ATOMIC_SECTION(state);
+        mp_irq_remove(self);
+        self->handler_arg = NULL;
+        self->wake = false;
+        mtp_update_wake();
+        return mp_const_none;
+    }
+
+    mp_int_t threshold = (self->init_value * 2) / 3;
+    if (args[1].u_obj != mp_const_none) {
+        threshold = mp_obj_get_int(args[1].u_obj);
+    }
+    if (threshold <= 0 || threshold > UINT16_MAX) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    if (touch_pad_config(self->touchpad_id, threshold) != ESP_OK) {
+        mp_raise_ValueError("Touch pad error");
+    }
+    self->threshold = threshold;
+
+    if (!mtp_isr_registered) {
+        if (touch_pad_isr_register(mtp_isr, NULL) != ESP_OK) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+        }
+        mtp_isr_registered = true;
+    }
+
+    mp_irq_add(self, args[0].u_obj);
+    self->handler_arg = (args[2].u_obj == mp_const_none) ? self : args[2].u_obj;
+    self->handler = args[0].u_obj;
+    self->wake = args[3].u_bool;
+    mtp_update_wake();
+    touch_pad_intr_enable();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mtp_callback_obj, 1, mtp_callback);
+
 STATIC mp_obj_t mtp_init_value(uint n_args, const mp_obj_t *arg) {
     mtp_obj_t *self = arg[0];
     if (n_args > 1) {
@@ -132,6 +310,11 @@ STATIC const mp_rom_map_elem_t mtp_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_config), MP_ROM_PTR(&mtp_config_obj) },
     { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mtp_read_obj) },
     { MP_ROM_QSTR(MP_QSTR_init_value), MP_ROM_PTR(&mtp_init_value_obj) },
+    { MP_ROM_QSTR(MP_QSTR_callback), MP_ROM_PTR(&mtp_callback_obj) },
+
+    // static methods
+    { MP_ROM_QSTR(MP_QSTR_read_all), MP_ROM_PTR(&mtp_read_all_obj) },
+    { MP_ROM_QSTR(MP_QSTR_filter), MP_ROM_PTR(&mtp_filter_obj) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mtp_locals_dict, mtp_locals_dict_table);
@@ -12,4 +12,6 @@
 
 extern const mp_obj_type_t machine_touchpad_type;
 
+extern void machtouch_deinit_all(void);
+
 #endif  // MACHTOUCH_H_
@@ -38,6 +38,8 @@
 #include "uart.h"
 #include "machuart.h"
 #include "mpexception.h"
+#include "mppoll.h"
+#include "mpirq.h"
 #include "utils/interrupt_char.h"
 #include "moduos.h"
 #include "machpin.h"
@@ -47,6 +49,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/timers.h"
 #include "freertos/xtensa_api.h"
 
 /// \moduleref machine
@@ -62,6 +65,13 @@ extern void IRAM_ATTR mp_hal_trig_term_sig(void);
 #define MACHUART_TX_MAX_TIMEOUT_MS              (5)
 
 #define MACHUART_RX_BUFFER_LEN                  (4096)
+#define MACHUART_FRAME_QUEUE_LEN                (16)        // complete frames waiting to be read
+#define MACHUART_FRAME_READ_TIMEOUT_MS          (10)
+
+// background transmission from the TX ring
+#define MACHUART_TX_TASK_STACK_SIZE             (2048)
+#define MACHUART_TX_TASK_PRIORITY               (6)
+#define MACHUART_TX_CHUNK_LEN                   (256)
 #define MACHUART_TX_FIFO_LEN                    (UART_FIFO_LEN)
 
 // interrupt triggers
@@ -92,12 +102,35 @@ struct _mach_uart_obj_t {
     uint8_t rx_timeout;
     uint8_t n_pins;
     bool init;
+    // framing, the ends of the complete frames are kept as counts of received bytes
+    volatile uint32_t rx_count;
+    uint32_t rx_read;
+    volatile uint32_t frame_end[MACHUART_FRAME_QUEUE_LEN];
+    volatile uint32_t frame_last;
+    volatile uint8_t frame_head;
+    uint8_t frame_tail;
+    int16_t terminator;
+    uint16_t idle_chars;
+    uint32_t frames_dropped;
+    TimerHandle_t idle_timer;
+    mp_obj_t frame_handler;
+    // TX ring drained by the TX task, one byte is always kept free
+    uint8_t *tx_ring;
+    uint32_t tx_size;
+    volatile uint32_t tx_head;
+    volatile uint32_t tx_tail;
+    volatile bool tx_busy;
+    volatile bool tx_stop;
+    TaskHandle_t tx_task;
+    mp_obj_t tx_handler;
 };
 
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
-static mach_uart_obj_t mach_uart_obj[MACH_NUM_UARTS] = { {.uart_reg = &UART0}, {.uart_reg = &UART1}, {.uart_reg = &UART2} };
+static mach_uart_obj_t mach_uart_obj[MACH_NUM_UARTS] = { {.uart_reg = &UART0, .terminator = -1, .tx_handler = mp_const_none},
+                                                          {.uart_reg = &UART1, .terminator = -1, .tx_handler = mp_const_none},
+                                                          {.uart_reg = &UART2, .terminator = -1, .tx_handler = mp_const_none} };
 static const mp_obj_t mach_uart_def_pin[MACH_NUM_UARTS][2] = { { &PIN_MODULE_P1,  &PIN_MODULE_P0 },
                                                                { &PIN_MODULE_P3,  &PIN_MODULE_P4 },
                                                                { &PIN_MODULE_P8,  &PIN_MODULE_P9 } };
@@ -133,11 +166,114 @@ int uart_rx_char(mach_uart_obj_t *self) {
     uint8_t rx_byte;
     int32_t len = uart_read_bytes(self->uart_id, &rx_byte, 1, 0);
     if (len > 0) {
+        self->rx_read++;
         return rx_byte;
     }
     return -1;
 }
 
+STATIC uint32_t uart_tx_ring_free (mach_uart_obj_t *self) {
+    return self->tx_size - 1 - ((self->tx_head + self->tx_size - self->tx_tail) % self->tx_size);
+}
+
+// copies as much as fits in the TX ring and wakes up the TX task, returns the number of bytes queued
+STATIC uint32_t uart_tx_ring_put (mach_uart_obj_t *self, const char *str, uint32_t len) {
+    uint32_t n = MIN(len, uart_tx_ring_free(self));
+    uint32_t head = self->tx_head;
+    for (uint32_t i = 0; i < n; ) {
+        uint32_t chunk = MIN(n - i, self->tx_size - head);
+        memcpy(&self->tx_ring[head], &str[i], chunk);
+        head = (head + chunk) % self->tx_size;
+        i += chunk;
+    }
+    if (n > 0) {
+        self->tx_busy = true;
+        self->tx_head = head;
+        xTaskNotifyGive(self->tx_task);
+    }
+    return n;
+}
+
+STATIC void uart_tx_done_handler (void *arg) {
+    // this function will be called by the interrupt thread
+    mach_uart_obj_t *self = arg;
+    if (self->tx_handler != mp_const_none) {
+        mp_call_function_1(self->tx_handler, self);
+    }
+}
+
+STATIC void TASK_UART_TX (void *pvParameters) {
+    mach_uart_obj_t *self = pvParameters;
+
+    while (!self->tx_stop) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        bool sent = false;
+        while (!self->tx_stop && self->tx_tail != self->tx_head) {
+            // the contiguous part of the ring, the driver waits for the FIFO space with its interrupt
+            uint32_t tail = self->tx_tail;
+            uint32_t head = self->tx_head;
+            uint32_t len = MIN((head >= tail) ? (head - tail) : (self->tx_size - tail), MACHUART_TX_CHUNK_LEN);
+            uart_write_bytes(self->uart_id, (const char *)&self->tx_ring[tail], len);
+            self->tx_tail = (tail + len) % self->tx_size;
+            sent = true;
+            mp_poll_wake();
+        }
+        if (sent && !self->tx_stop) {
+            uart_wait_tx_done(self->uart_id, portMAX_DELAY);
+            self->tx_busy = false;
+            if (self->tx_tail != self->tx_head) {
+                // more was queued meanwhile, the notification is pending
+                self->tx_busy = true;
+            } else {
+                if (self->tx_handler != mp_const_none) {
+                    mp_irq_queue_interrupt_non_ISR(uart_tx_done_handler, self);
+                }
+                mp_poll_wake();
+            }
+        }
+    }
+    self->tx_task = NULL;
+    vTaskDelete(NULL);
+}
+
+STATIC void uart_tx_ring_deinit (mach_uart_obj_t *self) {
+    if (self->tx_task) {
+        self->tx_stop = true;
+        xTaskNotifyGive(self->tx_task);
+        // the task never takes the GIL, at most the chunk being sent is waited for
+        while (self->tx_task) {
+            vTaskDelay(1);
+        }
+    }
+    if (self->tx_ring) {
+        heap_caps_free(self->tx_ring);
+        self->tx_ring = NULL;
+    }
+    if (self->tx_handler != mp_const_none) {
+        mp_irq_remove(&self->tx_handler);
+        self->tx_handler = mp_const_none;
+    }
+    self->tx_size = 0;
+    self->tx_head = self->tx_tail = 0;
+    self->tx_busy = false;
+}
+
+STATIC void uart_tx_ring_init (mach_uart_obj_t *self, uint32_t size) {
+    self->tx_ring = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!self->tx_ring) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    self->tx_size = size;
+    self->tx_head = self->tx_tail = 0;
+    self->tx_stop = false;
+    if (xTaskCreatePinnedToCore(TASK_UART_TX, "UART_TX", MACHUART_TX_TASK_STACK_SIZE / sizeof(StackType_t), self,
+                                MACHUART_TX_TASK_PRIORITY, &self->tx_task, 1) != pdPASS) {
+        self->tx_task = NULL;
+        uart_tx_ring_deinit(self);
+        mp_raise_OSError(MP_ENOMEM);
+    }
+}
+
 bool uart_tx_char(mach_uart_obj_t *self, int c) {
     uint32_t timeout = 0;
     char chr = c;
@@ -157,6 +293,19 @@ bool uart_tx_strn(mach_uart_obj_t *self, const char *str, uint len) {
     uint32_t isrmask = 0;
     pin_obj_t * pin = (pin_obj_t *)((mp_obj_t *)self->pins)[0];
 
+    if (self->tx_ring) {
+        // keep the order with what is being sent in the background
+        while (len > 0) {
+            uint32_t n = uart_tx_ring_put(self, str, len);
+            str += n;
+            len -= n;
+            if (len > 0) {
+                vTaskDelay(1);
+            }
+        }
+        return true;
+    }
+
     if (self->n_pins == 1) {
         // make it UART Tx
         pin->value = 1;
@@ -266,6 +415,89 @@ STATIC bool uart_rx_wait (mach_uart_obj_t *self) {
     }
 }
 
+// reads up to len bytes straight into buf, returns how many
+STATIC uint32_t uart_rx_bytes (mach_uart_obj_t *self, uint8_t *buf, uint32_t len, TickType_t ticks_to_wait) {
+    int32_t n = uart_read_bytes(self->uart_id, buf, len, ticks_to_wait);
+    if (n > 0) {
+        self->rx_read += n;
+        return n;
+    }
+    return 0;
+}
+
+STATIC void uart_frame_handler (void *arg) {
+    // this function will be called by the interrupt thread
+    mach_uart_obj_t *self = arg;
+    if (self->frame_handler != mp_const_none) {
+        mp_call_function_1(self->frame_handler, self);
+    }
+}
+
+STATIC IRAM_ATTR void uart_frame_push (mach_uart_obj_t *self, bool from_isr) {
+    uint32_t end = self->rx_count;
+    if (end == self->frame_last) {
+        return;
+    }
+    uint8_t next = (self->frame_head + 1) % MACHUART_FRAME_QUEUE_LEN;
+    if (next == self->frame_tail) {
+        // not read fast enough, the bytes are merged with the next frame
+        self->frames_dropped++;
+        return;
+    }
+    self->frame_end[self->frame_head] = end;
+    self->frame_last = end;
+    self->frame_head = next;
+    if (self->frame_handler && self->frame_handler != mp_const_none) {
+        if (from_isr) {
+            mp_irq_queue_interrupt(uart_frame_handler, self);
+        } else {
+            mp_irq_queue_interrupt_non_ISR(uart_frame_handler, self);
+        }
+    }
+    mp_poll_wake_from_isr();
+}
+
+// the line has been idle for idle_chars since the last byte
+STATIC void uart_idle_timer_cb (TimerHandle_t timer) {
+    uart_frame_push((mach_uart_obj_t *)pvTimerGetTimerID(timer), false);
+}
+
+// returns the length of the next complete frame, 0 if there's none
+STATIC uint32_t uart_frame_peek (mach_uart_obj_t *self) {
+    while (self->frame_tail != self->frame_head) {
+        uint32_t end = self->frame_end[self->frame_tail];
+        // skip the frames already consumed by plain reads
+        if ((int32_t)(end - self->rx_read) > 0) {
+            return end - self->rx_read;
+        }
+        self->frame_tail = (self->frame_tail + 1) % MACHUART_FRAME_QUEUE_LEN;
+    }
+    return 0;
+}
+
+STATIC uint32_t uart_frame_pop (mach_uart_obj_t *self) {
+    uint32_t frame_len = uart_frame_peek(self);
+    if (frame_len > 0) {
+        self->frame_tail = (self->frame_tail + 1) % MACHUART_FRAME_QUEUE_LEN;
+    }
+    return frame_len;
+}
+
+STATIC void uart_framing_disable (mach_uart_obj_t *self) {
+    self->terminator = -1;
+    self->idle_chars = 0;
+    if (self->idle_timer) {
+        xTimerDelete(self->idle_timer, portMAX_DELAY);
+        self->idle_timer = NULL;
+    }
+    if (self->frame_handler && self->frame_handler != mp_const_none) {
+        mp_irq_remove(self);
+    }
+    self->frame_handler = mp_const_none;
+    self->frame_tail = self->frame_head;
+    self->frame_last = self->rx_count;
+}
+
 STATIC void mach_uart_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
     mach_uart_obj_t *self = self_in;
     MACH_UART_CHECK_INIT(self)
@@ -303,6 +535,20 @@ STATIC void mach_uart_print(const mp_print_t *print, mp_obj_t self_in, mp_print_
 }
 
 STATIC IRAM_ATTR void UARTRxCallback(int uart_id, int rx_byte) {
+    mach_uart_obj_t *self = &mach_uart_obj[uart_id];
+    self->rx_count++;
+    if (self->terminator == rx_byte) {
+        uart_frame_push(self, true);
+    } else if (self->idle_timer) {
+        // (re)start the idle gap detection
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        xTimerResetFromISR(self->idle_timer, &xHigherPriorityTaskWoken);
+        if (xHigherPriorityTaskWoken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+    // a UART waited for by select() or poll() may be readable now
+    mp_poll_wake_from_isr();
     if (MP_STATE_PORT(mp_os_stream_o) && MP_STATE_PORT(mp_os_stream_o) == &mach_uart_obj[uart_id]) {
         if (mp_interrupt_char == rx_byte) {
             // raise an exception when interrupts are finished
@@ -386,10 +632,22 @@ STATIC mp_obj_t mach_uart_init_helper(mach_uart_obj_t *self, const mp_arg_val_t
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "invalid RX buffer size, should be > 128 bytes"));
     }
 
+    // Get the size of the TX ring, 0 keeps the blocking writes
+    int tx_buffer_size = args[7].u_int;
+    if (tx_buffer_size != 0 && tx_buffer_size <= UART_FIFO_LEN) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "invalid TX buffer size, should be 0 or > 128 bytes"));
+    }
+
     if (self->config.baud_rate > 0) {
-        // uninstall the driver
+        // stop the background transmission and uninstall the driver
+        uart_tx_ring_deinit(self);
         uart_driver_delete(self->uart_id);
     }
+    // the frame boundaries depend on the bus settings
+    uart_framing_disable(self);
+    self->rx_count = 0;
+    self->rx_read = 0;
+    self->frame_last = 0;
 
     // de-assign the pins
     uart_deassign_pins_af (self);
@@ -446,6 +704,14 @@ STATIC mp_obj_t mach_uart_init_helper(mach_uart_obj_t *self, const mp_arg_val_t
     // configure the rx timeout threshold
     self->uart_reg->conf1.rx_tout_thrhd = self->rx_timeout & UART_RX_TOUT_THRHD_V;
 
+    if (tx_buffer_size > 0) {
+        if (self->n_pins == 1) {
+            // the single wire mode turns the pin around for each write
+            goto error;
+        }
+        uart_tx_ring_init(self, tx_buffer_size);
+    }
+
     // Init Done
     self->init = true;
 
@@ -463,7 +729,8 @@ STATIC const mp_arg_t mach_uart_init_args[] = {
     { MP_QSTR_stop,                            MP_ARG_OBJ,  {.u_obj = mp_const_none} },
     { MP_QSTR_pins,           MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = MP_OBJ_NULL} },
     { MP_QSTR_timeout_chars,  MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = 2} },
-    { MP_QSTR_rx_buffer_size, MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = MACHUART_RX_BUFFER_LEN} }
+    { MP_QSTR_rx_buffer_size, MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = MACHUART_RX_BUFFER_LEN} },
+    { MP_QSTR_tx_buffer_size, MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = 0} },
 };
 STATIC mp_obj_t mach_uart_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args) {
     // parse args
@@ -506,6 +773,8 @@ STATIC mp_obj_t mach_uart_deinit(mp_obj_t self_in) {
     mach_uart_obj_t *self = self_in;
 
     if (self->config.baud_rate > 0) {
+        uart_framing_disable(self);
+        uart_tx_ring_deinit(self);
         // invalidate the baudrate
         self->config.baud_rate = 0;
         // detach the pins
@@ -531,10 +800,49 @@ STATIC mp_obj_t mach_uart_wait_tx_done(mp_obj_t self_in, mp_obj_t timeout_ms) {
     mach_uart_obj_t *self = self_in;
     MACH_UART_CHECK_INIT(self)
     TickType_t timeout_ticks = mp_obj_get_int_truncated(timeout_ms) / portTICK_PERIOD_MS;
-    return uart_wait_tx_done(self->uart_id, timeout_ticks) == ESP_OK ? mp_const_true : mp_const_false;
+    esp_err_t err = ESP_OK;
+    MP_THREAD_GIL_EXIT();
+    if (self->tx_ring) {
+        // the TX task waits for the last bit before clearing the busy flag
+        TickType_t start = xTaskGetTickCount();
+        while (self->tx_busy) {
+            if ((xTaskGetTickCount() - start) >= timeout_ticks) {
+                err = ESP_ERR_TIMEOUT;
+                break;
+            }
+            vTaskDelay(1);
+        }
+    } else {
+        err = uart_wait_tx_done(self->uart_id, timeout_ticks);
+    }
+    MP_THREAD_GIL_ENTER();
+    return err == ESP_OK ? mp_const_true : mp_const_false;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_uart_wait_tx_done_obj, mach_uart_wait_tx_done);
 
+/// \method tx_done_handler(handler)
+/// With a TX ring, the handler is called with the UART each time all the queued data has been sent.
+STATIC mp_obj_t mach_uart_tx_done_handler(mp_obj_t self_in, mp_obj_t handler) {
+    mach_uart_obj_t *self = self_in;
+    MACH_UART_CHECK_INIT(self)
+    if (!self->tx_ring) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+    if (handler != mp_const_none && !mp_obj_is_callable(handler)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    // rooted apart from the frame handler, which uses the UART itself as the key
+    if (self->tx_handler != mp_const_none) {
+        mp_irq_remove(&self->tx_handler);
+    }
+    if (handler != mp_const_none) {
+        mp_irq_add(&self->tx_handler, handler);
+    }
+    self->tx_handler = handler;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_uart_tx_done_handler_obj, mach_uart_tx_done_handler);
+
 STATIC mp_obj_t mach_uart_sendbreak(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
 
     STATIC const mp_arg_t mach_uart_sendbreak_args[] = {
@@ -583,17 +891,148 @@ STATIC mp_obj_t mach_uart_sendbreak(mp_uint_t n_args, const mp_obj_t *pos_args,
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_uart_sendbreak_obj, 1, mach_uart_sendbreak);
 
+/// \method framing(terminator=None, *, idle=0, handler=None)
+/// Splits the received data in frames ended by the terminator byte, or by a silence of idle characters
+/// (e.g. 4 for Modbus RTU). The handler is called with the UART each time a frame is complete.
+STATIC mp_obj_t mach_uart_framing(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t mach_uart_framing_args[] = {
+        { MP_QSTR_terminator,                      MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+        { MP_QSTR_idle,           MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = 0} },
+        { MP_QSTR_handler,        MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(mach_uart_framing_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), mach_uart_framing_args, args);
+
+    mach_uart_obj_t *self = pos_args[0];
+    MACH_UART_CHECK_INIT(self)
+
+    int terminator = -1;
+    if (args[0].u_obj != mp_const_none) {
+        if (MP_OBJ_IS_INT(args[0].u_obj)) {
+            terminator = mp_obj_get_int(args[0].u_obj);
+        } else {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
+            if (bufinfo.len != 1) {
+                goto error;
+            }
+            terminator = ((uint8_t *)bufinfo.buf)[0];
+        }
+        if (terminator < 0 || terminator > 0xFF) {
+            goto error;
+        }
+    }
+    mp_int_t idle = args[1].u_int;
+    if (idle < 0 || idle > 0xFFFF || (idle > 0 && terminator >= 0)) {
+        goto error;
+    }
+    if (args[2].u_obj != mp_const_none && !mp_obj_is_callable(args[2].u_obj)) {
+        goto error;
+    }
+
+    uart_framing_disable(self);
+    if (idle > 0) {
+        // round the gap up to the next tick, the bytes come in bursts anyway
+        uint32_t idle_ms = ((MACHUART_FRAME_TIME_US(self->config.baud_rate) * idle) + 999) / 1000;
+        TickType_t ticks = (idle_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+        self->idle_timer = xTimerCreate("UART_Idle", (ticks > 0) ? ticks : 1, pdFALSE, self, uart_idle_timer_cb);
+        if (!self->idle_timer) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+        self->idle_chars = idle;
+    }
+    if (args[2].u_obj != mp_const_none) {
+        mp_irq_add(self, args[2].u_obj);
+    }
+    self->frame_handler = args[2].u_obj;
+    self->terminator = terminator;
+    return mp_const_none;
+
+error:
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mach_uart_framing_obj, 1, mach_uart_framing);
+
+// reads the next complete frame into buf, the part that doesn't fit is dropped
+STATIC uint32_t uart_read_frame (mach_uart_obj_t *self, uint8_t *buf, uint32_t len, uint32_t frame_len) {
+    uint32_t n;
+    MP_THREAD_GIL_EXIT();
+    n = uart_rx_bytes(self, buf, MIN(len, frame_len), MACHUART_FRAME_READ_TIMEOUT_MS / portTICK_PERIOD_MS);
+    for (uint32_t rest = frame_len - MIN(len, frame_len); rest > 0; ) {
+        uint8_t discard[32];
+        uint32_t got = uart_rx_bytes(self, discard, MIN(rest, sizeof(discard)), MACHUART_FRAME_READ_TIMEOUT_MS / portTICK_PERIOD_MS);
+        if (got == 0) {
+            break;
+        }
+        rest -= got;
+    }
+    MP_THREAD_GIL_ENTER();
+    return n;
+}
+
+/// \method readframe([buf])
+/// Returns the next complete frame, None if there's none yet. With buf it's read in place and its length returned.
+STATIC mp_obj_t mach_uart_readframe(mp_uint_t n_args, const mp_obj_t *args) {
+    mach_uart_obj_t *self = args[0];
+    MACH_UART_CHECK_INIT(self)
+    if (self->terminator < 0 && !self->idle_timer) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+
+    uint32_t frame_len = uart_frame_pop(self);
+    if (n_args > 1) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(args[1], &bufinfo, MP_BUFFER_WRITE);
+        if (frame_len == 0) {
+            return mp_const_none;
+        }
+        return mp_obj_new_int_from_uint(uart_read_frame(self, bufinfo.buf, bufinfo.len, frame_len));
+    }
+    if (frame_len == 0) {
+        return mp_const_none;
+    }
+    vstr_t vstr;
+    vstr_init_len(&vstr, frame_len);
+    vstr.len = uart_read_frame(self, (uint8_t *)vstr.buf, frame_len, frame_len);
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mach_uart_readframe_obj, 1, 2, mach_uart_readframe);
+
+/// \method readline([size])
+/// Returns the next line ended by the framing terminator in a single read, otherwise reads byte by byte.
+STATIC mp_obj_t mach_uart_readline(mp_uint_t n_args, const mp_obj_t *args) {
+    mach_uart_obj_t *self = args[0];
+    MACH_UART_CHECK_INIT(self)
+    if (self->terminator == '\n') {
+        uint32_t frame_len = uart_frame_peek(self);
+        // a size limit shorter than the line reads it in pieces
+        if (frame_len > 0 && (n_args == 1 || mp_obj_get_int(args[1]) < 0 || mp_obj_get_int(args[1]) >= frame_len)) {
+            uart_frame_pop(self);
+            vstr_t vstr;
+            vstr_init_len(&vstr, frame_len);
+            vstr.len = uart_read_frame(self, (uint8_t *)vstr.buf, frame_len, frame_len);
+            return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+        }
+    }
+    return mp_call_function_n_kw(MP_OBJ_FROM_PTR(&mp_stream_unbuffered_readline_obj), n_args, 0, args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mach_uart_readline_obj, 1, 2, mach_uart_readline);
+
 STATIC const mp_map_elem_t mach_uart_locals_dict_table[] = {
     // instance methods
     { MP_OBJ_NEW_QSTR(MP_QSTR_init),            (mp_obj_t)&mach_uart_init_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),          (mp_obj_t)&mach_uart_deinit_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_any),             (mp_obj_t)&mach_uart_any_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_wait_tx_done),    (mp_obj_t)&mach_uart_wait_tx_done_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_tx_done_handler), (mp_obj_t)&mach_uart_tx_done_handler_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_sendbreak),       (mp_obj_t)&mach_uart_sendbreak_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_framing),         (mp_obj_t)&mach_uart_framing_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_readframe),       (mp_obj_t)&mach_uart_readframe_obj },
 //    { MP_OBJ_NEW_QSTR(MP_QSTR_irq),         (mp_obj_t)&pyb_uart_irq_obj },
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_read),            (mp_obj_t)&mp_stream_read_obj },
-    { MP_OBJ_NEW_QSTR(MP_QSTR_readline),        (mp_obj_t)&mp_stream_unbuffered_readline_obj},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_readline),        (mp_obj_t)&mach_uart_readline_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_readinto),        (mp_obj_t)&mp_stream_readinto_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_write),           (mp_obj_t)&mp_stream_write_obj },
 
@@ -614,18 +1053,25 @@ STATIC mp_uint_t mach_uart_read(mp_obj_t self_in, void *buf_in, mp_uint_t size,
         return 0;
     }
 
+    // let the other threads run while waiting for the characters
+    MP_THREAD_GIL_EXIT();
+
     // wait for first char to become available
     if (!uart_rx_wait(self)) {
+        MP_THREAD_GIL_ENTER();
         // return EAGAIN error to indicate non-blocking (then read() method returns None)
         *errcode = MP_EAGAIN;
         return MP_STREAM_ERROR;
     }
 
-    // read the data
+    // read the data, all the buffered bytes at once straight into the destination
     byte *orig_buf = buf;
     for ( ; ; ) {
-        *buf++ = uart_rx_char(self);
-        if (--size == 0 || !uart_rx_wait(self)) {
+        uint32_t n = uart_rx_bytes(self, buf, MIN(size, uart_rx_any(self)), 0);
+        buf += n;
+        size -= n;
+        if (size == 0 || !uart_rx_wait(self)) {
+            MP_THREAD_GIL_ENTER();
             // return number of bytes read
             return buf - orig_buf;
         }
@@ -637,8 +1083,21 @@ STATIC mp_uint_t mach_uart_write(mp_obj_t self_in, const void *buf_in, mp_uint_t
     MACH_UART_CHECK_INIT(self)
     const char *buf = buf_in;
 
-    // write the data
-    if (!uart_tx_strn(self, buf, size)) {
+    if (self->tx_ring) {
+        // queue what fits and return, the TX task sends it in the background
+        uint32_t n = uart_tx_ring_put(self, buf, size);
+        if (n == 0 && size > 0) {
+            *errcode = MP_EAGAIN;
+            return MP_STREAM_ERROR;
+        }
+        return n;
+    }
+
+    // write the data, letting the other threads run while waiting for room in the FIFO
+    MP_THREAD_GIL_EXIT();
+    bool sent = uart_tx_strn(self, buf, size);
+    MP_THREAD_GIL_ENTER();
+    if (!sent) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
     }
     return size;
@@ -655,7 +1114,7 @@ STATIC mp_uint_t mach_uart_ioctl(mp_obj_t self_in, mp_uint_t request, mp_uint_t
         if ((flags & MP_STREAM_POLL_RD) && uart_rx_any(self)) {
             ret |= MP_STREAM_POLL_RD;
         }
-        if ((flags & MP_STREAM_POLL_WR) && uart_tx_fifo_space(self)) {
+        if ((flags & MP_STREAM_POLL_WR) && (self->tx_ring ? (uart_tx_ring_free(self) > 0) : uart_tx_fifo_space(self))) {
             ret |= MP_STREAM_POLL_WR;
         }
     } else {
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <string.h>
+
+#include "py/mpstate.h"
+#include "py/runtime.h"
+#include "py/obj.h"
+#include "sdkconfig.h"
+#include "esp_sleep.h"
+#include "esp_clk.h"
+#include "soc/soc.h"
+#include "soc/rtc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "soc/sens_reg.h"
+#include "rom/ets_sys.h"
+#include "driver/adc.h"
+#include "driver/rtc_io.h"
+#include "machpin.h"
+#include "machulp.h"
+#include "mpexception.h"
+
+/******************************************************************************
+ DEFINE PRIVATE CONSTANTS
+ ******************************************************************************/
+/* The programs are loaded at the start of the RTC slow memory, reserved for them by the linker script.
+   The RTC_DATA_ATTR variables come after, they stay untouched */
+#define ULP_MEM                             ((volatile uint32_t *)SOC_RTC_DATA_LOW)
+#define ULP_MEM_WORDS                       (CONFIG_ULP_COPROC_RESERVE_MEM / sizeof(uint32_t))
+
+/* Header of the binaries produced by the ULP toolchain (esp32ulp-elf-as, ld and esp32ulp_mapgen) */
+#define ULP_BIN_MAGIC                       (0x00706c75)    // "ulp\0"
+#define ULP_BIN_HEADER_LEN                  (12)
+
+#define ULP_WAKEUP_PERIODS                  (5)
+
+#ifndef RTC_CNTL_MIN_SLP_VAL_MIN
+#define RTC_CNTL_MIN_SLP_VAL_MIN            (2)
+#endif
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+typedef struct {
+    uint32_t magic;
+    uint16_t text_offset;
+    uint16_t text_size;
+    uint16_t data_size;
+    uint16_t bss_size;
+} ulp_bin_header_t;
+
+typedef struct {
+    mp_obj_base_t base;
+} mach_ulp_obj_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+STATIC const mach_ulp_obj_t mach_ulp_obj = {{&mach_ulp_type}};
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC uint32_t mach_ulp_get_addr(mp_obj_t addr_in, uint32_t len) {
+    mp_int_t addr = mp_obj_get_int(addr_in);
+    if (addr < 0 || len > ULP_MEM_WORDS || (uint32_t)addr > ULP_MEM_WORDS - len) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    return addr;
+}
+
+/******************************************************************************/
+// MicroPython bindings for ULP
+
+STATIC mp_obj_t mach_ulp_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args) {
+    mp_arg_check_num(n_args, n_kw, 0, 0, false);
+    // the coprocessor keeps running across the soft resets and the deep sleep, there's a single instance
+    return (mp_obj_t)&mach_ulp_obj;
+}
+
+// load_binary(load_addr, program), load_addr is given in 32-bit words
+STATIC mp_obj_t mach_ulp_load_binary(mp_obj_t self_in, mp_obj_t load_addr_in, mp_obj_t program_in) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(program_in, &bufinfo, MP_BUFFER_READ);
+
+    ulp_bin_header_t header;
+    if (bufinfo.len < ULP_BIN_HEADER_LEN) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    memcpy(&header, bufinfo.buf, sizeof(header));
+    if (header.magic != ULP_BIN_MAGIC || header.text_offset < ULP_BIN_HEADER_LEN ||
+        (header.text_size % sizeof(uint32_t)) != 0 || (header.data_size % sizeof(uint32_t)) != 0 ||
+        (header.bss_size % sizeof(uint32_t)) != 0 ||
+        bufinfo.len < header.text_offset + header.text_size + header.data_size) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid ULP binary"));
+    }
+
+    uint32_t words = (header.text_size + header.data_size + header.bss_size) / sizeof(uint32_t);
+    uint32_t load_addr = mach_ulp_get_addr(load_addr_in, words);
+
+    // the RTC memory is only accessed by words
+    const uint8_t *src = (const uint8_t *)bufinfo.buf + header.text_offset;
+    uint32_t i = 0;
+    for (; i < (header.text_size + header.data_size) / sizeof(uint32_t); i++) {
+        uint32_t word;
+        memcpy(&word, src + i * sizeof(uint32_t), sizeof(word));
+        ULP_MEM[load_addr + i] = word;
+    }
+    for (; i < words; i++) {
+        ULP_MEM[load_addr + i] = 0;
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(mach_ulp_load_binary_obj, mach_ulp_load_binary);
+
+STATIC mp_obj_t mach_ulp_set_wakeup_period(mp_obj_t self_in, mp_obj_t index_in, mp_obj_t period_in) {
+    mp_int_t index = mp_obj_get_int(index_in);
+    mp_int_t period_us = mp_obj_get_int(period_in);
+    if (index < 0 || index >= ULP_WAKEUP_PERIODS || period_us <= 0) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    uint64_t cycles = rtc_time_us_to_slowclk(period_us, esp_clk_slowclk_cal_get());
+    if (cycles > SENS_SLEEP_CYCLES_S0) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    REG_SET_FIELD(SENS_ULP_CP_SLEEP_CYC0_REG + index * sizeof(uint32_t), SENS_SLEEP_CYCLES_S0, (uint32_t)cycles);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(mach_ulp_set_wakeup_period_obj, mach_ulp_set_wakeup_period);
+
+// run(entry_point), the program restarts at entry_point each wakeup period after it halts
+STATIC mp_obj_t mach_ulp_run(mp_obj_t self_in, mp_obj_t entry_in) {
+    uint32_t entry = mach_ulp_get_addr(entry_in, 1);
+
+    // the same sequence as ulp_run() of the IDF
+    CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+    // at least one cycle of the RTC slow clock
+    ets_delay_us(10);
+    REG_SET_FIELD(SENS_SAR_START_FORCE_REG, SENS_PC_INIT, entry);
+    CLEAR_PERI_REG_MASK(SENS_SAR_START_FORCE_REG, SENS_ULP_CP_FORCE_START_TOP_M);
+    REG_SET_FIELD(RTC_CNTL_TIMER5_REG, RTC_CNTL_MIN_SLP_VAL, RTC_CNTL_MIN_SLP_VAL_MIN);
+    // the voltage must follow the RTC 8M clock when it runs
+    SET_PERI_REG_MASK(RTC_CNTL_OPTIONS0_REG, RTC_CNTL_BIAS_I2C_FOLW_8M);
+    SET_PERI_REG_MASK(RTC_CNTL_OPTIONS0_REG, RTC_CNTL_BIAS_CORE_FOLW_8M);
+    SET_PERI_REG_MASK(RTC_CNTL_OPTIONS0_REG, RTC_CNTL_BIAS_SLEEP_FOLW_8M);
+    SET_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_ulp_run_obj, mach_ulp_run);
+
+// stop(), the current run completes up to its HALT and the timer doesn't start it again
+STATIC mp_obj_t mach_ulp_stop(mp_obj_t self_in) {
+    CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mach_ulp_stop_obj, mach_ulp_stop);
+
+// read(addr, [n]), the ULP stores 16-bit values in the lower half of the words
+STATIC mp_obj_t mach_ulp_read(mp_uint_t n_args, const mp_obj_t *args) {
+    if (n_args == 2) {
+        return mp_obj_new_int(ULP_MEM[mach_ulp_get_addr(args[1], 1)] & 0xFFFF);
+    }
+    mp_int_t n = mp_obj_get_int(args[2]);
+    if (n < 0) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    uint32_t addr = mach_ulp_get_addr(args[1], n);
+    mp_obj_t list = mp_obj_new_list(n, NULL);
+    mp_obj_t *items = ((mp_obj_list_t *)MP_OBJ_TO_PTR(list))->items;
+    for (mp_int_t i = 0; i < n; i++) {
+        items[i] = MP_OBJ_NEW_SMALL_INT(ULP_MEM[addr + i] & 0xFFFF);
+    }
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mach_ulp_read_obj, 2, 3, mach_ulp_read);
+
+// write(addr, value), e.g. to give the thresholds to the program
+STATIC mp_obj_t mach_ulp_write(mp_obj_t self_in, mp_obj_t addr_in, mp_obj_t value_in) {
+    ULP_MEM[mach_ulp_get_addr(addr_in, 1)] = mp_obj_get_int(value_in) & 0xFFFF;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(mach_ulp_write_obj, mach_ulp_write);
+
+// wakeup(enable), the WAKE instruction of the program ends the deep sleep
+STATIC mp_obj_t mach_ulp_wakeup(mp_obj_t self_in, mp_obj_t enable_in) {
+    if (mp_obj_is_true(enable_in)) {
+        if (ESP_OK != esp_sleep_enable_ulp_wakeup()) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+        }
+    } else {
+        esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ULP);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_ulp_wakeup_obj, mach_ulp_wakeup);
+
+// adc(channel, attn), gives an ADC1 channel to the ULP, for its ADC instruction
+STATIC mp_obj_t mach_ulp_adc(mp_obj_t self_in, mp_obj_t channel_in, mp_obj_t attn_in) {
+    mp_int_t channel = mp_obj_get_int(channel_in);
+    mp_int_t attn = mp_obj_get_int(attn_in);
+    if (channel < 0 || channel >= ADC1_CHANNEL_MAX || attn < ADC_ATTEN_DB_0 || attn > ADC_ATTEN_DB_11) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten(channel, attn);
+    adc1_ulp_enable();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(mach_ulp_adc_obj, mach_ulp_adc);
+
+// gpio(pin), makes the pin an RTC input, returns its RTC number to read it from RTC_GPIO_IN_REG
+STATIC mp_obj_t mach_ulp_gpio(mp_obj_t self_in, mp_obj_t pin_in) {
+    pin_obj_t *pin = pin_find(pin_in);
+    if (!rtc_gpio_is_valid_gpio(pin->pin_number)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "the pin is not an RTC GPIO"));
+    }
+    rtc_gpio_init(pin->pin_number);
+    rtc_gpio_set_direction(pin->pin_number, RTC_GPIO_MODE_INPUT_ONLY);
+    // the pad must stay configured in deep sleep
+    esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+    return mp_obj_new_int(rtc_gpio_desc[pin->pin_number].rtc_num);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mach_ulp_gpio_obj, mach_ulp_gpio);
+
+STATIC const mp_map_elem_t mach_ulp_locals_dict_table[] = {
+    // instance methods
+    { MP_OBJ_NEW_QSTR(MP_QSTR_load_binary),         (mp_obj_t)&mach_ulp_load_binary_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_wakeup_period),   (mp_obj_t)&mach_ulp_set_wakeup_period_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_run),                 (mp_obj_t)&mach_ulp_run_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stop),                (mp_obj_t)&mach_ulp_stop_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_read),                (mp_obj_t)&mach_ulp_read_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_write),               (mp_obj_t)&mach_ulp_write_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_wakeup),              (mp_obj_t)&mach_ulp_wakeup_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_adc),                 (mp_obj_t)&mach_ulp_adc_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_gpio),                (mp_obj_t)&mach_ulp_gpio_obj },
+
+    // class constants
+    { MP_OBJ_NEW_QSTR(MP_QSTR_MEM_WORDS),           MP_OBJ_NEW_SMALL_INT(ULP_MEM_WORDS) },
+};
+STATIC MP_DEFINE_CONST_DICT(mach_ulp_locals_dict, mach_ulp_locals_dict_table);
+
+const mp_obj_type_t mach_ulp_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_ULP,
+    .make_new = mach_ulp_make_new,
+    .locals_dict = (mp_obj_t)&mach_ulp_locals_dict,
+};
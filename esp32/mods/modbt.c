@@ -20,6 +20,7 @@
 #include "py/objstr.h"
 #include "py/nlr.h"
 #include "py/runtime.h"
+#include "py/gc.h"
 #include "py/mphal.h"
 #include "py/stream.h"
 #include "bufhelper.h"
@@ -48,6 +49,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/event_groups.h"
 
 #include "lwip/opt.h"
@@ -60,6 +62,17 @@
  DEFINE PRIVATE CONSTANTS
  ******************************************************************************/
 #define BT_SCAN_QUEUE_SIZE_MAX                              (16)
+#define BT_SCAN_RING_SIZE_DEF                               (16)
+#define BT_SCAN_RING_SIZE_MAX                               (256)
+#define BT_SCAN_FILTER_ADDR_MAX                             (8)
+#define BT_SCAN_FILTER_RSSI_NONE                            (-128)
+#define BT_BULK_WRITE_TIMEOUT_MS                            (2000)
+#define BT_NOTIFY_BUFFER_SIZE_MAX                           (32 * 1024)
+#define BT_ATT_DEFAULT_MTU                                  (23)
+#define BT_NOTIFY_STREAM_SIZE_MAX                           (64 * 1024)
+#define BT_NOTIFY_STREAM_IN_FLIGHT_MAX                      (8)
+#define BT_CONN_QUEUE_SIZE_MAX                              (4)
+#define BT_CONN_MTU_TIMEOUT_MS                              (1000)
 #define BT_GATTS_QUEUE_SIZE_MAX                             (2)
 #define BT_MTU_SIZE_MAX                                     (200)
 #define BT_CHAR_VALUE_SIZE_MAX                              (BT_MTU_SIZE_MAX - 3)
@@ -75,7 +88,6 @@
 #define MOD_BT_GATTC_NOTIFY_EVT                             (0x0020)
 #define MOD_BT_GATTC_INDICATE_EVT                           (0x0040)
 #define MOD_BT_GATTS_SUBSCRIBE_EVT                          (0x0080)
-#define MOD_BT_GATTC_MTU_EVT                                (0x0100)
 #define MOD_BT_GATTS_MTU_EVT                                (0x0200)
 #define MOD_BT_GATTS_CLOSE_EVT                              (0x0400)
 #define MOD_BT_NVS_NAMESPACE                                "BT_NVS"
@@ -97,7 +109,6 @@ typedef struct {
     uint16_t              gatts_if;
     uint16_t              gattc_if;
     bool                  init;
-    bool                  busy;
     bool                  scanning;
     bool                  advertising;
     bool                  controller_active;
@@ -106,6 +117,16 @@ typedef struct {
     bool                  privacy;
 } bt_obj_t;
 
+typedef struct {
+    uint8_t     value[BT_CHAR_VALUE_SIZE_MAX];
+    uint16_t    value_len;
+} bt_read_value_t;
+
+typedef struct {
+    esp_gattc_cb_event_t    event;
+    esp_gatt_status_t       status;
+} bt_conn_event_t;
+
 typedef struct {
     mp_obj_base_t         base;
     mp_obj_list_t         srv_list;
@@ -114,6 +135,18 @@ typedef struct {
     uint16_t              mtu;
     esp_gatt_if_t         gatt_if;
     esp_ble_addr_type_t   addr_type;
+    volatile bool         congested;
+    // ATT allows only one request in progress per connection, its completion is posted to the queue
+    QueueHandle_t         queue;
+    volatile bool         connecting;
+    volatile bool         busy;
+    esp_gattc_cb_event_t  op;               // the event that completes the request in progress
+    struct _bt_char_obj_t *read_char;       // the characteristic the read in progress is for
+    bt_read_value_t       read;
+    // the services found by the last discovery, filled by the BT task
+    struct _bt_srv_t      *srv_found;
+    uint16_t              srv_count;
+    volatile bool         srv_ready;
 } bt_connection_obj_t;
 
 typedef struct {
@@ -125,7 +158,7 @@ typedef struct {
     uint16_t              end_handle;
 } bt_srv_obj_t;
 
-typedef struct {
+typedef struct _bt_srv_t {
     esp_gatt_id_t          srv_id;
     uint16_t               start_handle;
     uint16_t               end_handle;
@@ -136,7 +169,7 @@ typedef struct {
     esp_gatt_char_prop_t    char_prop;
 } bt_char_t;
 
-typedef struct {
+typedef struct _bt_char_obj_t {
     mp_obj_base_t           base;
     bt_srv_obj_t            *service;
     esp_gattc_char_elem_t   characteristic;
@@ -146,39 +179,57 @@ typedef struct {
     uint32_t                events;
     uint16_t                value_len;
     uint8_t                 value[BT_CHAR_VALUE_SIZE_MAX];
+    // the data of the notifications, in the order received
+    uint8_t                 *rx_buf;
+    uint32_t                rx_size;
+    uint32_t                rx_head;
+    volatile uint32_t       rx_used;
+    uint32_t                rx_dropped;
     // mp_obj_list_t         desc_list;
 } bt_char_obj_t;
 
-typedef struct {
-    uint8_t     value[BT_CHAR_VALUE_SIZE_MAX];
-    uint16_t    value_len;
-} bt_read_value_t;
-
-typedef struct {
-    esp_gatt_status_t status;
-} bt_write_value_t;
-
 typedef enum {
     E_BT_STACK_MODE_BLE = 0,
     E_BT_STACK_MODE_BT
 } bt_mode_t;
 
-typedef struct {
-    int32_t         conn_id;
-    esp_bd_addr_t   srv_bda;
-    esp_gatt_if_t   gatt_if;
-} bt_connection_event_t;
-
 typedef struct {
     esp_gatt_status_t status;
 } bt_register_for_notify_event_t;
 
+typedef struct {
+    esp_bd_addr_t           bda;
+    uint8_t                 addr_type;
+    uint8_t                 evt_type;
+    int8_t                  rssi;
+    uint8_t                 ble_adv[ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX];
+} bt_adv_t;
+
+// the advertisements in the order they are received, the oldest one is overwritten when it's full
+typedef struct {
+    bt_adv_t                *buf;
+    uint32_t                size;
+    uint32_t                head;
+    volatile uint32_t       used;
+    uint32_t                received;
+    uint32_t                filtered;
+    uint32_t                merged;
+    uint32_t                dropped;
+} bt_scan_ring_t;
+
+// only the advertisements matching all of the filters set are stored
+typedef struct {
+    esp_bd_addr_t           addrs[BT_SCAN_FILTER_ADDR_MAX];
+    uint8_t                 addr_count;
+    uint8_t                 uuid[ESP_UUID_LEN_128];
+    uint8_t                 uuid_len;
+    int8_t                  min_rssi;
+    int32_t                 manufacturer_id;    // -1 if not filtered
+    bool                    dedup;              // only keep the last advertisement received of an address not read yet
+} bt_scan_filter_t;
+
 typedef union {
     esp_ble_gap_cb_param_t          scan;
-    bt_srv_t                        service;
-    bt_read_value_t                 read;
-    bt_write_value_t                write;
-    bt_connection_event_t           connection;
     bt_register_for_notify_event_t  register_for_notify;
 } bt_event_result_t;
 
@@ -222,6 +273,22 @@ typedef union {
     uint8_t value[4];
 } bt_hash_obj_t;
 
+// the data queued by GATTSCharacteristic.notify_stream(), sent from the BT task
+typedef struct {
+    bt_gatts_char_obj_t     *chr;
+    uint8_t                 *buf;
+    uint32_t                len;
+    uint32_t                offset;
+    uint32_t                in_flight;
+    uint32_t                start_ms;
+    uint32_t                last_ms;
+    uint32_t                bytes_sent;
+    uint32_t                notifications;
+    uint32_t                congestions;
+    uint32_t                errors;
+    bool                    congested;
+} bt_notify_stream_t;
+
 typedef struct {
     bt_gatts_char_obj_t *chr;
     uint32_t event;
@@ -242,6 +309,12 @@ typedef struct {
  ******************************************************************************/
 static volatile bt_obj_t bt_obj;
 static QueueHandle_t xScanQueue;
+static bt_scan_ring_t bt_scan_ring;
+static bt_scan_filter_t bt_scan_filter = { .min_rssi = BT_SCAN_FILTER_RSSI_NONE, .manufacturer_id = -1 };
+static portMUX_TYPE bt_scan_ring_mux = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE bt_char_rx_mux = portMUX_INITIALIZER_UNLOCKED;
+static bt_notify_stream_t bt_notify_stream;
+static SemaphoreHandle_t bt_notify_stream_mutex;
 static QueueHandle_t xGattsQueue;
 
 static esp_ble_adv_data_t adv_data;
@@ -270,7 +343,6 @@ static uint16_t mod_bt_gatts_mtu_restore = 0;
 static nvs_handle modbt_nvs_handle;
 static uint8_t tx_pwr_level_to_dbm[] = {-12, -9, -6, -3, 0, 3, 6, 9};
 static EventGroupHandle_t bt_event_group;
-static uint16_t bt_conn_mtu = 0;
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
@@ -278,14 +350,25 @@ static void gap_events_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_para
 static void gattc_events_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
 static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
 static void close_connection(int32_t conn_id);
+static bt_connection_obj_t *find_connection(int32_t conn_id);
+static void bt_char_rx_push(bt_char_obj_t *chr, const uint8_t *data, uint32_t len);
+static void bt_char_register_for_notify(bt_char_obj_t *self);
+static void bt_notify_stream_pump(void);
+static void bt_notify_stream_reset(void);
 static esp_err_t modem_sleep(bool enable);
 
 STATIC void bluetooth_callback_handler(void *arg);
 STATIC void gattc_char_callback_handler(void *arg);
 STATIC void gatts_char_callback_handler(void *arg);
 static mp_obj_t modbt_start_scan(mp_obj_t timeout);
+static bool bt_scan_filter_match (const struct ble_scan_result_evt_param *scan_rst);
+static bool bt_scan_ring_push (const struct ble_scan_result_evt_param *scan_rst);
+static bool bt_scan_ring_pop (bt_adv_t *adv);
+static void bt_scan_ring_flush (void);
+static mp_obj_t bt_scan_adv_to_obj (const bt_adv_t *adv);
 static mp_obj_t modbt_conn_disconnect(mp_obj_t self_in);
 static mp_obj_t modbt_connect(mp_obj_t addr, esp_ble_addr_type_t addr_type);
+STATIC mp_obj_t bt_conn_del(mp_obj_t self_in);
 
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
@@ -308,10 +391,15 @@ void modbt_init0(void) {
     else
     {
         //Using only specific events in group for now
-        xEventGroupClearBits(bt_event_group, MOD_BT_GATTC_MTU_EVT | MOD_BT_GATTS_MTU_EVT | MOD_BT_GATTS_DISCONN_EVT | MOD_BT_GATTS_CLOSE_EVT);
+        xEventGroupClearBits(bt_event_group, MOD_BT_GATTS_MTU_EVT | MOD_BT_GATTS_DISCONN_EVT | MOD_BT_GATTS_CLOSE_EVT);
     }
     bt_event_group = xEventGroupCreate();
 
+    if (!bt_notify_stream_mutex) {
+        bt_notify_stream_mutex = xSemaphoreCreateMutex();
+    }
+    bt_notify_stream_reset();
+
     if (bt_obj.init) {
         esp_ble_gattc_app_unregister(MOD_BT_CLIENT_APP_ID);
         esp_ble_gatts_app_unregister(MOD_BT_SERVER_APP_ID);
@@ -370,7 +458,7 @@ void modbt_deinit(bool allow_reconnect)
         esp_bt_controller_disable();
         esp_bt_controller_deinit();
         bt_obj.init = false;
-        xEventGroupClearBits(bt_event_group, MOD_BT_GATTC_MTU_EVT | MOD_BT_GATTS_MTU_EVT | MOD_BT_GATTS_DISCONN_EVT | MOD_BT_GATTS_CLOSE_EVT);
+        xEventGroupClearBits(bt_event_group, MOD_BT_GATTS_MTU_EVT | MOD_BT_GATTS_DISCONN_EVT | MOD_BT_GATTS_CLOSE_EVT);
     }
 }
 
@@ -425,7 +513,11 @@ void bt_resume(bool reconnect)
                 bt_connection_obj_t *new_connection_obj = modbt_connect(mp_obj_new_bytes((const byte *)connection_obj->srv_bda, 6), connection_obj->addr_type);
                 // If new connection object has been created then overwrite the original one so from the MicroPython code the same reference can be used
                 if(new_connection_obj != mp_const_none) {
+                    bt_conn_del(connection_obj);
                     memcpy(connection_obj, new_connection_obj, sizeof(bt_connection_obj_t));
+                    // the original object owns the queue from now on
+                    new_connection_obj->queue = NULL;
+                    new_connection_obj->srv_found = NULL;
                     // As modbt_connect appends the new connection to the original list, it needs to be removed because it is not needed
                     mp_obj_list_remove((void *)&MP_STATE_PORT(btc_conn_list), new_connection_obj);
                 }
@@ -566,16 +658,107 @@ static void set_pin(uint32_t new_pin)
     set_secure_parameters(bt_obj.secure_connections);
 }
 
+// called from the BT task, completes the request in progress on the connection
+static void bt_conn_post (bt_connection_obj_t *conn, esp_gattc_cb_event_t event, esp_gatt_status_t status) {
+    bt_conn_event_t conn_event = { .event = event, .status = status };
+    if (conn->busy && (conn->op == event || event == ESP_GATTC_DISCONNECT_EVT)) {
+        conn->read_char = NULL;
+        conn->busy = false;
+    }
+    xQueueSend(conn->queue, (void *)&conn_event, (TickType_t)0);
+}
+
 static void close_connection (int32_t conn_id) {
     for (mp_uint_t i = 0; i < MP_STATE_PORT(btc_conn_list).len; i++) {
         bt_connection_obj_t *connection_obj = ((bt_connection_obj_t *)(MP_STATE_PORT(btc_conn_list).items[i]));
         if (connection_obj->conn_id == conn_id) {
             connection_obj->conn_id = -1;
+            // wake up whoever waits for a request of this connection
+            bt_conn_post(connection_obj, ESP_GATTC_DISCONNECT_EVT, ESP_GATT_ERROR);
             mp_obj_list_remove((void *)&MP_STATE_PORT(btc_conn_list), connection_obj);
         }
     }
 }
 
+// the connection being opened with this device
+static bt_connection_obj_t *find_pending_connection (const uint8_t *bda) {
+    for (mp_uint_t i = 0; i < MP_STATE_PORT(btc_conn_list).len; i++) {
+        bt_connection_obj_t *connection_obj = ((bt_connection_obj_t *)(MP_STATE_PORT(btc_conn_list).items[i]));
+        if (connection_obj->connecting && !memcmp(connection_obj->srv_bda, bda, ESP_BD_ADDR_LEN)) {
+            return connection_obj;
+        }
+    }
+    return NULL;
+}
+
+static bt_connection_obj_t *find_connection (int32_t conn_id) {
+    for (mp_uint_t i = 0; i < MP_STATE_PORT(btc_conn_list).len; i++) {
+        bt_connection_obj_t *connection_obj = ((bt_connection_obj_t *)(MP_STATE_PORT(btc_conn_list).items[i]));
+        if (connection_obj->conn_id == conn_id) {
+            return connection_obj;
+        }
+    }
+    return NULL;
+}
+
+// called from the BT task, a notification that doesn't fit is dropped as a whole
+static void bt_char_rx_push (bt_char_obj_t *chr, const uint8_t *data, uint32_t len) {
+    portENTER_CRITICAL(&bt_char_rx_mux);
+    if (chr->rx_buf) {
+        if (chr->rx_size - chr->rx_used < len) {
+            chr->rx_dropped += len;
+        } else {
+            uint32_t tail = (chr->rx_head + chr->rx_used) % chr->rx_size;
+            uint32_t first = MIN(len, chr->rx_size - tail);
+            memcpy(&chr->rx_buf[tail], data, first);
+            memcpy(chr->rx_buf, &data[first], len - first);
+            chr->rx_used += len;
+        }
+    }
+    portEXIT_CRITICAL(&bt_char_rx_mux);
+}
+
+// sends notifications until the data ends or the stack has no room for them
+static void bt_notify_stream_pump (void) {
+    xSemaphoreTake(bt_notify_stream_mutex, portMAX_DELAY);
+    bt_notify_stream_t *stream = &bt_notify_stream;
+    uint32_t chunk_max = (bt_obj.gatts_mtu >= BT_ATT_DEFAULT_MTU ? bt_obj.gatts_mtu : BT_ATT_DEFAULT_MTU) - 3;
+
+    while (stream->offset < stream->len && stream->in_flight < BT_NOTIFY_STREAM_IN_FLIGHT_MAX &&
+           !stream->congested && bt_obj.gatts_conn_id >= 0) {
+        uint32_t chunk = MIN(chunk_max, stream->len - stream->offset);
+        // the stack copies the value, the buffer can be reused right away
+        if (ESP_OK != esp_ble_gatts_send_indicate(bt_obj.gatts_if, bt_obj.gatts_conn_id, stream->chr->attr_obj.handle,
+                                                  chunk, &stream->buf[stream->offset], false)) {
+            // tried again with the next confirmation or notify_stream()
+            stream->errors++;
+            break;
+        }
+        stream->offset += chunk;
+        stream->in_flight++;
+    }
+
+    if (stream->len > 0 && stream->offset == stream->len) {
+        free(stream->buf);
+        stream->buf = NULL;
+        stream->len = 0;
+        stream->offset = 0;
+    }
+    xSemaphoreGive(bt_notify_stream_mutex);
+}
+
+// drops the data not sent yet, keeps the counters
+static void bt_notify_stream_reset (void) {
+    xSemaphoreTake(bt_notify_stream_mutex, portMAX_DELAY);
+    free(bt_notify_stream.buf);
+    bt_notify_stream.buf = NULL;
+    bt_notify_stream.len = 0;
+    bt_notify_stream.offset = 0;
+    bt_notify_stream.in_flight = 0;
+    bt_notify_stream.congested = false;
+    xSemaphoreGive(bt_notify_stream_mutex);
+}
+
 static esp_err_t modem_sleep(bool enable)
 {
     esp_err_t err = esp_bt_controller_get_status();
@@ -630,6 +813,153 @@ static bt_gatts_attr_obj_t *find_gatts_attr_by_handle (uint16_t handle) {
     return NULL;
 }
 
+static bool bt_scan_uuid_match (const uint8_t *adv, uint8_t type, uint8_t uuid_len) {
+    uint8_t len;
+    uint8_t *data = esp_ble_resolve_adv_data((uint8_t *)adv, type, &len);
+    if (data) {
+        for (uint8_t i = 0; i + uuid_len <= len; i += uuid_len) {
+            if (!memcmp(&data[i], bt_scan_filter.uuid, uuid_len)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// called from the BT task, the filter is only changed while not scanning
+static bool bt_scan_filter_match (const struct ble_scan_result_evt_param *scan_rst) {
+    if (scan_rst->rssi < bt_scan_filter.min_rssi) {
+        return false;
+    }
+
+    if (bt_scan_filter.addr_count > 0) {
+        uint32_t i;
+        for (i = 0; i < bt_scan_filter.addr_count; i++) {
+            if (!memcmp(bt_scan_filter.addrs[i], scan_rst->bda, ESP_BD_ADDR_LEN)) {
+                break;
+            }
+        }
+        if (i == bt_scan_filter.addr_count) {
+            return false;
+        }
+    }
+
+    if (bt_scan_filter.manufacturer_id >= 0) {
+        uint8_t len;
+        uint8_t *data = esp_ble_resolve_adv_data((uint8_t *)scan_rst->ble_adv, ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE, &len);
+        // the company identifier comes first, little endian
+        if (!data || len < 2 || (data[0] | (data[1] << 8)) != bt_scan_filter.manufacturer_id) {
+            return false;
+        }
+    }
+
+    switch (bt_scan_filter.uuid_len) {
+    case ESP_UUID_LEN_16:
+        return bt_scan_uuid_match(scan_rst->ble_adv, ESP_BLE_AD_TYPE_16SRV_CMPL, ESP_UUID_LEN_16) ||
+               bt_scan_uuid_match(scan_rst->ble_adv, ESP_BLE_AD_TYPE_16SRV_PART, ESP_UUID_LEN_16);
+    case ESP_UUID_LEN_32:
+        return bt_scan_uuid_match(scan_rst->ble_adv, ESP_BLE_AD_TYPE_32SRV_CMPL, ESP_UUID_LEN_32) ||
+               bt_scan_uuid_match(scan_rst->ble_adv, ESP_BLE_AD_TYPE_32SRV_PART, ESP_UUID_LEN_32);
+    case ESP_UUID_LEN_128:
+        return bt_scan_uuid_match(scan_rst->ble_adv, ESP_BLE_AD_TYPE_128SRV_CMPL, ESP_UUID_LEN_128) ||
+               bt_scan_uuid_match(scan_rst->ble_adv, ESP_BLE_AD_TYPE_128SRV_PART, ESP_UUID_LEN_128);
+    default:
+        return true;
+    }
+}
+
+// returns true if the advertisement was stored
+static bool bt_scan_ring_push (const struct ble_scan_result_evt_param *scan_rst) {
+    bt_scan_ring.received++;
+    if (!bt_scan_ring.buf || !bt_scan_filter_match(scan_rst)) {
+        bt_scan_ring.filtered++;
+        return false;
+    }
+
+    portENTER_CRITICAL(&bt_scan_ring_mux);
+    bt_adv_t *adv = NULL;
+    if (bt_scan_filter.dedup) {
+        // the same address waiting to be read is updated in place
+        for (uint32_t i = 0; i < bt_scan_ring.used; i++) {
+            bt_adv_t *stored = &bt_scan_ring.buf[(bt_scan_ring.head + i) % bt_scan_ring.size];
+            if (!memcmp(stored->bda, scan_rst->bda, ESP_BD_ADDR_LEN)) {
+                adv = stored;
+                bt_scan_ring.merged++;
+                break;
+            }
+        }
+    }
+    if (!adv) {
+        if (bt_scan_ring.used == bt_scan_ring.size) {
+            // drop the oldest one
+            bt_scan_ring.head = (bt_scan_ring.head + 1) % bt_scan_ring.size;
+            bt_scan_ring.used--;
+            bt_scan_ring.dropped++;
+        }
+        adv = &bt_scan_ring.buf[(bt_scan_ring.head + bt_scan_ring.used) % bt_scan_ring.size];
+        bt_scan_ring.used++;
+    }
+    memcpy(adv->bda, scan_rst->bda, ESP_BD_ADDR_LEN);
+    adv->addr_type = scan_rst->ble_addr_type;
+    adv->evt_type = scan_rst->ble_evt_type;
+    adv->rssi = scan_rst->rssi;
+    memcpy(adv->ble_adv, scan_rst->ble_adv, sizeof(adv->ble_adv));
+    portEXIT_CRITICAL(&bt_scan_ring_mux);
+    return true;
+}
+
+static bool bt_scan_ring_pop (bt_adv_t *adv) {
+    bool popped = false;
+    portENTER_CRITICAL(&bt_scan_ring_mux);
+    if (bt_scan_ring.used > 0) {
+        memcpy(adv, &bt_scan_ring.buf[bt_scan_ring.head], sizeof(bt_adv_t));
+        bt_scan_ring.head = (bt_scan_ring.head + 1) % bt_scan_ring.size;
+        bt_scan_ring.used--;
+        popped = true;
+    }
+    portEXIT_CRITICAL(&bt_scan_ring_mux);
+    return popped;
+}
+
+static void bt_scan_ring_flush (void) {
+    portENTER_CRITICAL(&bt_scan_ring_mux);
+    bt_scan_ring.head = 0;
+    bt_scan_ring.used = 0;
+    bt_scan_ring.received = 0;
+    bt_scan_ring.filtered = 0;
+    bt_scan_ring.merged = 0;
+    bt_scan_ring.dropped = 0;
+    portEXIT_CRITICAL(&bt_scan_ring_mux);
+}
+
+static mp_obj_t bt_scan_adv_to_obj (const bt_adv_t *adv) {
+    STATIC const qstr bt_scan_info_fields[] = {
+        MP_QSTR_mac, MP_QSTR_addr_type, MP_QSTR_adv_type, MP_QSTR_rssi, MP_QSTR_data,
+    };
+
+    // an advertisement is delivered even if the heap is full at that moment
+    nlr_buf_t nlr;
+    mp_obj_t info;
+    gc_reserve_begin();
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t tuple[5];
+        tuple[0] = mp_obj_new_bytes((const byte *)adv->bda, 6);
+        tuple[1] = mp_obj_new_int(adv->addr_type);
+        tuple[2] = mp_obj_new_int(adv->evt_type & 0x03);    // FIXME
+        tuple[3] = mp_obj_new_int(adv->rssi);
+        tuple[4] = mp_obj_new_bytes((const byte *)adv->ble_adv, sizeof(adv->ble_adv));
+        info = mp_obj_new_attrtuple(bt_scan_info_fields, 5, tuple);
+        nlr_pop();
+    } else {
+        // the reserve would stay in use if the MemoryError went past it
+        gc_reserve_end();
+        nlr_jump(nlr.ret_val);
+    }
+    gc_reserve_end();
+
+    return info;
+}
+
 static void gap_events_handler (esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
     switch (event) {
     case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT: {
@@ -658,15 +988,14 @@ static void gap_events_handler (esp_gap_ble_cb_event_t event, esp_ble_gap_cb_par
         }
     }
     case ESP_GAP_BLE_SCAN_RESULT_EVT: {
-        bt_event_result_t bt_event_result;
         esp_ble_gap_cb_param_t *scan_result = (esp_ble_gap_cb_param_t *)param;
-        memcpy(&bt_event_result.scan, scan_result, sizeof(esp_ble_gap_cb_param_t));
         switch (scan_result->scan_rst.search_evt) {
         case ESP_GAP_SEARCH_INQ_RES_EVT:
-            xQueueSend(xScanQueue, (void *)&bt_event_result, (TickType_t)0);
-            bt_obj.events |= MOD_BT_GATTC_ADV_EVT;
-            if (bt_obj.trigger & MOD_BT_GATTC_ADV_EVT) {
-                mp_irq_queue_interrupt_non_ISR(bluetooth_callback_handler, (void *)&bt_obj);
+            if (bt_scan_ring_push(&scan_result->scan_rst)) {
+                bt_obj.events |= MOD_BT_GATTC_ADV_EVT;
+                if (bt_obj.trigger & MOD_BT_GATTC_ADV_EVT) {
+                    mp_irq_queue_interrupt_non_ISR(bluetooth_callback_handler, (void *)&bt_obj);
+                }
             }
             break;
         case ESP_GAP_SEARCH_DISC_RES_EVT:
@@ -689,7 +1018,6 @@ static void gap_events_handler (esp_gap_ble_cb_event_t event, esp_ble_gap_cb_par
 }
 
 static void gattc_events_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param) {
-    int32_t conn_id = 0;
     esp_ble_gattc_cb_param_t *p_data = (esp_ble_gattc_cb_param_t *)param;
     bt_event_result_t bt_event_result;
 
@@ -703,56 +1031,81 @@ static void gattc_events_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc
         break;
     case ESP_GATTC_OPEN_EVT:
         if (p_data->open.status != ESP_GATT_OK) {
-            bt_event_result.connection.conn_id = -1;
-            xQueueSend(xScanQueue, (void *)&bt_event_result, (TickType_t)0);
-            bt_obj.busy = false;
+            bt_connection_obj_t *connection_obj = find_pending_connection(p_data->open.remote_bda);
+            if (connection_obj != NULL) {
+                connection_obj->connecting = false;
+                bt_conn_post(connection_obj, ESP_GATTC_CONNECT_EVT, p_data->open.status);
+                mp_obj_list_remove((void *)&MP_STATE_PORT(btc_conn_list), connection_obj);
+            }
         }
         break;
-    case ESP_GATTC_CONNECT_EVT:
-        conn_id = p_data->connect.conn_id;
-        bt_event_result.connection.conn_id = conn_id;
-        bt_event_result.connection.gatt_if = gattc_if;
-        memcpy(bt_event_result.connection.srv_bda, p_data->connect.remote_bda, ESP_BD_ADDR_LEN);
-        esp_ble_gattc_send_mtu_req (gattc_if, p_data->connect.conn_id);
-        xQueueSend(xScanQueue, (void *)&bt_event_result, (TickType_t)0);
+    case ESP_GATTC_CONNECT_EVT: {
+        // links opened by the peer are reported too, only the ones connect() is waiting for are used
+        bt_connection_obj_t *connection_obj = find_pending_connection(p_data->connect.remote_bda);
+        if (connection_obj != NULL) {
+            connection_obj->conn_id = p_data->connect.conn_id;
+            connection_obj->gatt_if = gattc_if;
+            connection_obj->connecting = false;
+            esp_ble_gattc_send_mtu_req (gattc_if, p_data->connect.conn_id);
+            bt_conn_post(connection_obj, ESP_GATTC_CONNECT_EVT, ESP_GATT_OK);
+        }
         break;
-    case ESP_GATTC_CFG_MTU_EVT:
+    }
+    case ESP_GATTC_CFG_MTU_EVT: {
         // connection process and MTU request complete
-        bt_obj.busy = false;
-        bt_conn_mtu = p_data->cfg_mtu.mtu;
-        xEventGroupSetBits(bt_event_group, MOD_BT_GATTC_MTU_EVT);
+        bt_connection_obj_t *connection_obj = find_connection(p_data->cfg_mtu.conn_id);
+        if (connection_obj != NULL) {
+            connection_obj->mtu = p_data->cfg_mtu.mtu;
+            bt_conn_post(connection_obj, ESP_GATTC_CFG_MTU_EVT, p_data->cfg_mtu.status);
+        }
         break;
+    }
     case ESP_GATTC_READ_CHAR_EVT:
-        if (p_data->read.status == ESP_GATT_OK) {
-            uint16_t read_len = p_data->read.value_len > BT_CHAR_VALUE_SIZE_MAX ? BT_CHAR_VALUE_SIZE_MAX : p_data->read.value_len;
-            memcpy(&bt_event_result.read.value, p_data->read.value, read_len);
-            bt_event_result.read.value_len = read_len;
-            xQueueSend(xScanQueue, (void *)&bt_event_result, (TickType_t)0);
+    case ESP_GATTC_READ_DESCR_EVT: {
+        bt_connection_obj_t *connection_obj = find_connection(p_data->read.conn_id);
+        if (connection_obj != NULL) {
+            if (p_data->read.status == ESP_GATT_OK) {
+                uint16_t read_len = p_data->read.value_len > BT_CHAR_VALUE_SIZE_MAX ? BT_CHAR_VALUE_SIZE_MAX : p_data->read.value_len;
+                memcpy(connection_obj->read.value, p_data->read.value, read_len);
+                connection_obj->read.value_len = read_len;
+                if (event == ESP_GATTC_READ_CHAR_EVT && connection_obj->read_char != NULL) {
+                    memcpy(connection_obj->read_char->value, p_data->read.value, read_len);
+                    connection_obj->read_char->value_len = read_len;
+                }
+            }
+            bt_conn_post(connection_obj, event, p_data->read.status);
         }
-        bt_obj.busy = false;
         break;
-    case ESP_GATTC_WRITE_CHAR_EVT:
-        bt_event_result.write.status = p_data->write.status;
-        xQueueSend(xScanQueue, (void *)&bt_event_result, (TickType_t)0);
-        bt_obj.busy = false;
+    }
+    case ESP_GATTC_WRITE_CHAR_EVT: {
+        bt_connection_obj_t *connection_obj = find_connection(p_data->write.conn_id);
+        if (connection_obj != NULL) {
+            bt_conn_post(connection_obj, ESP_GATTC_WRITE_CHAR_EVT, p_data->write.status);
+        }
         break;
+    }
     case ESP_GATTC_SEARCH_RES_EVT: {
-        esp_gatt_id_t *srvc_id = (esp_gatt_id_t *)&p_data->search_res.srvc_id;
-        memcpy(&bt_event_result.service.srv_id, srvc_id, sizeof(esp_gatt_id_t));
-        bt_event_result.service.start_handle = p_data->search_res.start_handle;
-        bt_event_result.service.end_handle = p_data->search_res.end_handle;
-        xQueueSend(xScanQueue, (void *)&bt_event_result, (TickType_t)0);
+        bt_connection_obj_t *connection_obj = find_connection(p_data->search_res.conn_id);
+        if (connection_obj != NULL && connection_obj->busy) {
+            bt_srv_t *srv_found = realloc(connection_obj->srv_found, (connection_obj->srv_count + 1) * sizeof(bt_srv_t));
+            if (srv_found != NULL) {
+                bt_srv_t *srv = &srv_found[connection_obj->srv_count++];
+                memcpy(&srv->srv_id, &p_data->search_res.srvc_id, sizeof(esp_gatt_id_t));
+                srv->start_handle = p_data->search_res.start_handle;
+                srv->end_handle = p_data->search_res.end_handle;
+                connection_obj->srv_found = srv_found;
+            }
+        }
+        break;
+    }
+    case ESP_GATTC_SEARCH_CMPL_EVT: {
+        bt_connection_obj_t *connection_obj = find_connection(p_data->search_cmpl.conn_id);
+        if (connection_obj != NULL) {
+            connection_obj->srv_ready = true;
+            bt_conn_post(connection_obj, ESP_GATTC_SEARCH_CMPL_EVT, p_data->search_cmpl.status);
+        }
         break;
     }
-    case ESP_GATTC_READ_DESCR_EVT:
-      if (p_data->read.status == ESP_GATT_OK) {
-          uint16_t read_len = p_data->read.value_len > BT_CHAR_VALUE_SIZE_MAX ? BT_CHAR_VALUE_SIZE_MAX : p_data->read.value_len;
-          memcpy(&bt_event_result.read.value, p_data->read.value, read_len);
-          bt_event_result.read.value_len = read_len;
-          xQueueSend(xScanQueue, (void *)&bt_event_result, (TickType_t)0);
-      }
-      bt_obj.busy = false;
-      break;
     case ESP_GATTC_REG_FOR_NOTIFY_EVT:
         bt_event_result.register_for_notify.status = p_data->reg_for_notify.status;
         xQueueSend(xScanQueue, (void *)&bt_event_result, (TickType_t)0);
@@ -762,8 +1115,10 @@ static void gattc_events_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc
         char_obj = find_gattc_char (p_data->notify.conn_id, p_data->notify.handle);
         if (char_obj != NULL) {
             // copy the new value into the characteristic
-            memcpy(&char_obj->value, p_data->notify.value, p_data->notify.value_len);
-            char_obj->value_len = p_data->notify.value_len;
+            uint16_t value_len = MIN(p_data->notify.value_len, BT_CHAR_VALUE_SIZE_MAX);
+            memcpy(&char_obj->value, p_data->notify.value, value_len);
+            char_obj->value_len = value_len;
+            bt_char_rx_push(char_obj, p_data->notify.value, p_data->notify.value_len);
 
             // register the event
             if (p_data->notify.is_notify) {
@@ -791,15 +1146,16 @@ static void gattc_events_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc
         }
         break;
     }
-    case ESP_GATTC_SEARCH_CMPL_EVT:
-    case ESP_GATTC_CANCEL_OPEN_EVT:
-        bt_obj.busy = false;
+    case ESP_GATTC_CONGEST_EVT: {
+        bt_connection_obj_t *connection_obj = find_connection(p_data->congest.conn_id);
+        if (connection_obj != NULL) {
+            connection_obj->congested = p_data->congest.congested;
+        }
         break;
-        // intentional fall through
+    }
     case ESP_GATTC_CLOSE_EVT:
     case ESP_GATTC_DISCONNECT_EVT:
         close_connection(p_data->close.conn_id);
-        bt_obj.busy = false;
         break;
     default:
         break;
@@ -821,15 +1177,26 @@ STATIC void gattc_char_callback_handler(void *arg) {
 
     if (chr->handler && chr->handler != mp_const_none) {
 
-        mp_obj_t tuple[2];
-        tuple[0] = mp_obj_new_int(((gattc_char_cbk_arg_t*)arg)->event);
-        tuple[1] = mp_const_none;
-        if(((gattc_char_cbk_arg_t*)arg)->data_length > 0) {
-            tuple[1] = mp_obj_new_bytes(((gattc_char_cbk_arg_t*)arg)->data, ((gattc_char_cbk_arg_t*)arg)->data_length);
-            free(((gattc_char_cbk_arg_t*)arg)->data);
+        nlr_buf_t nlr;
+        mp_obj_t event;
+        gc_reserve_begin();
+        if (nlr_push(&nlr) == 0) {
+            mp_obj_t tuple[2];
+            tuple[0] = mp_obj_new_int(((gattc_char_cbk_arg_t*)arg)->event);
+            tuple[1] = mp_const_none;
+            if(((gattc_char_cbk_arg_t*)arg)->data_length > 0) {
+                tuple[1] = mp_obj_new_bytes(((gattc_char_cbk_arg_t*)arg)->data, ((gattc_char_cbk_arg_t*)arg)->data_length);
+                free(((gattc_char_cbk_arg_t*)arg)->data);
+            }
+            event = mp_obj_new_tuple(2, tuple);
+            nlr_pop();
+        } else {
+            gc_reserve_end();
+            nlr_jump(nlr.ret_val);
         }
+        gc_reserve_end();
 
-        mp_call_function_2(chr->handler, chr->handler_arg, mp_obj_new_tuple(2, tuple));
+        mp_call_function_2(chr->handler, chr->handler_arg, event);
     }
     free((gattc_char_cbk_arg_t*)arg);
 }
@@ -841,15 +1208,26 @@ STATIC void gatts_char_callback_handler(void *arg) {
 
     if (chr->handler && chr->handler != mp_const_none) {
 
-        mp_obj_t tuple[2];
-        tuple[0] = mp_obj_new_int(((gatts_char_cbk_arg_t*)arg)->event);
-        tuple[1] = mp_const_none;
-        if(((gatts_char_cbk_arg_t*)arg)->data_length > 0) {
-            tuple[1] = mp_obj_new_bytes(((gatts_char_cbk_arg_t*)arg)->data, ((gatts_char_cbk_arg_t*)arg)->data_length);
-            free(((gatts_char_cbk_arg_t*)arg)->data);
+        nlr_buf_t nlr;
+        mp_obj_t event;
+        gc_reserve_begin();
+        if (nlr_push(&nlr) == 0) {
+            mp_obj_t tuple[2];
+            tuple[0] = mp_obj_new_int(((gatts_char_cbk_arg_t*)arg)->event);
+            tuple[1] = mp_const_none;
+            if(((gatts_char_cbk_arg_t*)arg)->data_length > 0) {
+                tuple[1] = mp_obj_new_bytes(((gatts_char_cbk_arg_t*)arg)->data, ((gatts_char_cbk_arg_t*)arg)->data_length);
+                free(((gatts_char_cbk_arg_t*)arg)->data);
+            }
+            event = mp_obj_new_tuple(2, tuple);
+            nlr_pop();
+        } else {
+            gc_reserve_end();
+            nlr_jump(nlr.ret_val);
         }
+        gc_reserve_end();
 
-        mp_obj_t r_value = mp_call_function_2(chr->handler, chr->handler_arg, mp_obj_new_tuple(2, tuple));
+        mp_obj_t r_value = mp_call_function_2(chr->handler, chr->handler_arg, event);
 
         if (chr->read_request) {
             uint32_t u_value;
@@ -989,8 +1367,29 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
         bt_obj.gatts_mtu = p->mtu.mtu;
         xEventGroupSetBits(bt_event_group, MOD_BT_GATTS_MTU_EVT);
         break;
-    case ESP_GATTS_EXEC_WRITE_EVT:
     case ESP_GATTS_CONF_EVT:
+        // a notification of the stream has been sent
+        if (bt_notify_stream.in_flight > 0) {
+            bt_notify_stream.in_flight--;
+            if (p->conf.status == ESP_GATT_OK) {
+                bt_notify_stream.notifications++;
+                bt_notify_stream.bytes_sent += p->conf.len;
+                bt_notify_stream.last_ms = mp_hal_ticks_ms();
+            } else {
+                bt_notify_stream.errors++;
+            }
+            bt_notify_stream_pump();
+        }
+        break;
+    case ESP_GATTS_CONGEST_EVT:
+        bt_notify_stream.congested = p->congest.congested;
+        if (p->congest.congested) {
+            bt_notify_stream.congestions++;
+        } else {
+            bt_notify_stream_pump();
+        }
+        break;
+    case ESP_GATTS_EXEC_WRITE_EVT:
     case ESP_GATTS_UNREG_EVT:
         break;
     case ESP_GATTS_CREATE_EVT: {
@@ -1034,6 +1433,7 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
         break;
     case ESP_GATTS_DISCONNECT_EVT:
         bt_obj.gatts_conn_id = -1;
+        bt_notify_stream_reset();
         xEventGroupClearBits(bt_event_group, MOD_BT_GATTS_MTU_EVT);
         if (bt_obj.advertising) {
             esp_ble_gap_start_advertising(&bt_adv_params);
@@ -1050,7 +1450,6 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
     case ESP_GATTS_OPEN_EVT:
     case ESP_GATTS_CANCEL_OPEN_EVT:
     case ESP_GATTS_LISTEN_EVT:
-    case ESP_GATTS_CONGEST_EVT:
     default:
         break;
     }
@@ -1209,8 +1608,9 @@ mp_obj_t bt_deinit(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_deinit_obj, bt_deinit);
 
-STATIC mp_obj_t bt_start_scan(mp_obj_t self_in, mp_obj_t timeout) {
-    if (bt_obj.scanning || bt_obj.busy) {
+static mp_obj_t modbt_start_scan(mp_obj_t timeout)
+{
+    if (bt_obj.scanning) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "operation already in progress"));
     }
 
@@ -1219,21 +1619,129 @@ STATIC mp_obj_t bt_start_scan(mp_obj_t self_in, mp_obj_t timeout) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid scan time"));
     }
 
+    if (!bt_scan_ring.buf) {
+        bt_scan_ring.buf = malloc(BT_SCAN_RING_SIZE_DEF * sizeof(bt_adv_t));
+        if (!bt_scan_ring.buf) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_MemoryError, "no memory for the advertisements"));
+        }
+        bt_scan_ring.size = BT_SCAN_RING_SIZE_DEF;
+    }
+
     bt_obj.scan_duration = duration;
     bt_obj.scanning = true;
-    xQueueReset(xScanQueue);
+    bt_scan_ring_flush();
     if (ESP_OK != esp_ble_gap_set_scan_params(&ble_scan_params)) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
     }
 
     return mp_const_none;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_2(bt_start_scan_obj, bt_start_scan);
 
-static mp_obj_t modbt_start_scan(mp_obj_t timeout)
-{
-    return bt_start_scan(NULL, timeout);
+STATIC mp_obj_t bt_start_scan(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_timeout,              MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_queue_size,           MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = BT_SCAN_RING_SIZE_DEF} },
+        { MP_QSTR_dedup,                MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_addresses,            MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_manufacturer_id,      MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_service_uuid,         MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_min_rssi,             MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    if (bt_obj.scanning) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "operation already in progress"));
+    }
+
+    mp_int_t queue_size = args[1].u_int;
+    if (queue_size < 1 || queue_size > BT_SCAN_RING_SIZE_MAX) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid queue size"));
+    }
+
+    bt_scan_filter_t filter = { .min_rssi = BT_SCAN_FILTER_RSSI_NONE, .manufacturer_id = -1 };
+    filter.dedup = args[2].u_bool;
+
+    if (args[3].u_obj != mp_const_none) {
+        mp_obj_t *addrs;
+        mp_uint_t addr_count;
+        mp_obj_get_array(args[3].u_obj, &addr_count, &addrs);
+        if (addr_count > BT_SCAN_FILTER_ADDR_MAX) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        for (mp_uint_t i = 0; i < addr_count; i++) {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(addrs[i], &bufinfo, MP_BUFFER_READ);
+            if (bufinfo.len != ESP_BD_ADDR_LEN) {
+                mp_raise_ValueError(mpexception_value_invalid_arguments);
+            }
+            memcpy(filter.addrs[i], bufinfo.buf, ESP_BD_ADDR_LEN);
+        }
+        filter.addr_count = addr_count;
+    }
+
+    if (args[4].u_obj != mp_const_none) {
+        filter.manufacturer_id = mp_obj_get_int(args[4].u_obj);
+        if (filter.manufacturer_id < 0 || filter.manufacturer_id > UINT16_MAX) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+    }
+
+    // same formats as the uuid of a service
+    if (args[5].u_obj != mp_const_none) {
+        if (mp_obj_is_integer(args[5].u_obj)) {
+            uint32_t srv_uuid = mp_obj_get_int_truncated(args[5].u_obj);
+            filter.uuid_len = srv_uuid > UINT16_MAX ? ESP_UUID_LEN_32 : ESP_UUID_LEN_16;
+            // little endian, as in the advertisements
+            memcpy(filter.uuid, &srv_uuid, filter.uuid_len);
+        } else {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(args[5].u_obj, &bufinfo, MP_BUFFER_READ);
+            if (bufinfo.len != ESP_UUID_LEN_128) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid UUID"));
+            }
+            filter.uuid_len = ESP_UUID_LEN_128;
+            memcpy(filter.uuid, bufinfo.buf, ESP_UUID_LEN_128);
+        }
+    }
+
+    if (args[6].u_obj != mp_const_none) {
+        filter.min_rssi = MIN(MAX(mp_obj_get_int(args[6].u_obj), BT_SCAN_FILTER_RSSI_NONE), INT8_MAX);
+    }
+
+    if (queue_size != bt_scan_ring.size) {
+        bt_adv_t *buf = malloc(queue_size * sizeof(bt_adv_t));
+        if (!buf) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_MemoryError, "no memory for the advertisements"));
+        }
+        portENTER_CRITICAL(&bt_scan_ring_mux);
+        bt_adv_t *old = bt_scan_ring.buf;
+        bt_scan_ring.buf = buf;
+        bt_scan_ring.size = queue_size;
+        bt_scan_ring.head = 0;
+        bt_scan_ring.used = 0;
+        portEXIT_CRITICAL(&bt_scan_ring_mux);
+        free(old);
+    }
+
+    // not scanning, so the BT task doesn't read it
+    memcpy(&bt_scan_filter, &filter, sizeof(bt_scan_filter));
+
+    return modbt_start_scan(args[0].u_obj);
 }
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(bt_start_scan_obj, 2, bt_start_scan);
+
+STATIC mp_obj_t bt_scan_stats(mp_obj_t self_in) {
+    mp_obj_t tuple[4];
+    tuple[0] = mp_obj_new_int_from_uint(bt_scan_ring.received);
+    tuple[1] = mp_obj_new_int_from_uint(bt_scan_ring.filtered);
+    tuple[2] = mp_obj_new_int_from_uint(bt_scan_ring.merged);
+    tuple[3] = mp_obj_new_int_from_uint(bt_scan_ring.dropped);
+    return mp_obj_new_tuple(4, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_scan_stats_obj, bt_scan_stats);
 
 STATIC mp_obj_t bt_isscanning(mp_obj_t self_in) {
     if (bt_obj.scanning) {
@@ -1281,43 +1789,21 @@ STATIC mp_obj_t bt_stop_scan(mp_obj_t self_in) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_stop_scan_obj, bt_stop_scan);
 
 STATIC mp_obj_t bt_read_scan(mp_obj_t self_in) {
-    bt_event_result_t bt_event;
+    bt_adv_t adv;
 
-    STATIC const qstr bt_scan_info_fields[] = {
-        MP_QSTR_mac, MP_QSTR_addr_type, MP_QSTR_adv_type, MP_QSTR_rssi, MP_QSTR_data,
-    };
-
-    if (xQueueReceive(xScanQueue, &bt_event, (TickType_t)0)) {
-        mp_obj_t tuple[5];
-        tuple[0] = mp_obj_new_bytes((const byte *)bt_event.scan.scan_rst.bda, 6);
-        tuple[1] = mp_obj_new_int(bt_event.scan.scan_rst.ble_addr_type);
-        tuple[2] = mp_obj_new_int(bt_event.scan.scan_rst.ble_evt_type & 0x03);    // FIXME
-        tuple[3] = mp_obj_new_int(bt_event.scan.scan_rst.rssi);
-        tuple[4] = mp_obj_new_bytes((const byte *)bt_event.scan.scan_rst.ble_adv, sizeof(bt_event.scan.scan_rst.ble_adv));
-
-        return mp_obj_new_attrtuple(bt_scan_info_fields, 5, tuple);
+    if (bt_scan_ring_pop(&adv)) {
+        return bt_scan_adv_to_obj(&adv);
     }
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_read_scan_obj, bt_read_scan);
 
 STATIC mp_obj_t bt_get_advertisements(mp_obj_t self_in) {
-    bt_event_result_t bt_event;
-
-    STATIC const qstr bt_scan_info_fields[] = {
-        MP_QSTR_mac, MP_QSTR_addr_type, MP_QSTR_adv_type, MP_QSTR_rssi, MP_QSTR_data,
-    };
+    bt_adv_t adv;
 
     mp_obj_t advs = mp_obj_new_list(0, NULL);
-    while (xQueueReceive(xScanQueue, &bt_event, (TickType_t)0)) {
-        mp_obj_t tuple[5];
-        tuple[0] = mp_obj_new_bytes((const byte *)bt_event.scan.scan_rst.bda, 6);
-        tuple[1] = mp_obj_new_int(bt_event.scan.scan_rst.ble_addr_type);
-        tuple[2] = mp_obj_new_int(bt_event.scan.scan_rst.ble_evt_type & 0x03);    // FIXME
-        tuple[3] = mp_obj_new_int(bt_event.scan.scan_rst.rssi);
-        tuple[4] = mp_obj_new_bytes((const byte *)bt_event.scan.scan_rst.ble_adv, sizeof(bt_event.scan.scan_rst.ble_adv));
-
-        mp_obj_list_append(advs, mp_obj_new_attrtuple(bt_scan_info_fields, 5, tuple));
+    while (bt_scan_ring_pop(&adv)) {
+        mp_obj_list_append(advs, bt_scan_adv_to_obj(&adv));
     }
     return advs;
 }
@@ -1413,92 +1899,136 @@ STATIC mp_obj_t bt_events(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_events_obj, bt_events);
 
-static mp_obj_t bt_connect_helper(mp_obj_t addr, TickType_t timeout, esp_ble_addr_type_t addr_type){
+// removes the connection from the list of the connections, if it's still there
+static void bt_conn_forget (bt_connection_obj_t *conn) {
+    for (mp_uint_t i = 0; i < MP_STATE_PORT(btc_conn_list).len; i++) {
+        if (MP_STATE_PORT(btc_conn_list).items[i] == conn) {
+            mp_obj_list_remove((void *)&MP_STATE_PORT(btc_conn_list), conn);
+            break;
+        }
+    }
+}
 
-    bt_event_result_t bt_event;
-    EventBits_t uxBits;
+// waits with the GIL released for the request in progress on the connection to complete
+static bool bt_conn_wait (bt_connection_obj_t *conn, esp_gattc_cb_event_t event, TickType_t timeout, esp_gatt_status_t *status) {
+    bt_conn_event_t conn_event;
+    bool completed = false;
 
-    if (bt_obj.busy) {
-        // Only drop exception if not called from bt_resume() API, otherwise return with mp_const_none on error
-        if(mod_bt_allow_resume_deinit == false) {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "operation already in progress"));
-        }
-        else {
-            return mp_const_none;
+    MP_THREAD_GIL_EXIT();
+    while (xQueueReceive(conn->queue, &conn_event, timeout) == pdTRUE) {
+        if (conn_event.event == event || conn_event.event == ESP_GATTC_DISCONNECT_EVT) {
+            *status = conn_event.status;
+            completed = true;
+            break;
         }
     }
+    MP_THREAD_GIL_ENTER();
+    return completed;
+}
 
-    if (bt_obj.scanning) {
-        esp_ble_gap_stop_scanning();
-        mp_hal_delay_ms(50);
-        bt_obj.scanning = false;
+// starts a request on the connection, the other connections keep running their own ones
+static void bt_conn_start (bt_connection_obj_t *conn, esp_gattc_cb_event_t op, bt_char_obj_t *read_char) {
+    if (conn->conn_id < 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "connection already closed"));
+    }
+    if (conn->busy) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "operation already in progress"));
     }
+    xQueueReset(conn->queue);
+    conn->op = op;
+    conn->read_char = read_char;
+    conn->busy = true;
+}
 
-    mp_buffer_info_t bufinfo;
-    mp_get_buffer_raise(addr, &bufinfo, MP_BUFFER_READ);
+static void bt_conn_start_failed (bt_connection_obj_t *conn) {
+    conn->read_char = NULL;
+    conn->busy = false;
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+}
 
-    xQueueReset(xScanQueue);
-    bt_obj.busy = true;
+static mp_obj_t bt_connect_helper(mp_obj_t addr, TickType_t timeout, esp_ble_addr_type_t addr_type, bool nonblocking){
 
-    /* Initiate a background connection, esp_ble_gattc_open returns immediately */
-    if (ESP_OK != esp_ble_gattc_open(bt_obj.gattc_if, bufinfo.buf, addr_type, true)) {
-        // Only drop exception if not called from bt_resume() API, otherwise return with mp_const_none on error
-        if(mod_bt_allow_resume_deinit == false) {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
-        }
-        else {
-            return mp_const_none;
-        }
-    }
+    const mp_obj_type_t *error_type = &mp_type_OSError;
+    const char *error_msg;
+    esp_gatt_status_t status;
 
-    MP_THREAD_GIL_EXIT();
-    if (xQueueReceive(xScanQueue, &bt_event, timeout) == pdTRUE)
-    {
-        MP_THREAD_GIL_ENTER();
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(addr, &bufinfo, MP_BUFFER_READ);
+    if (bufinfo.len != ESP_BD_ADDR_LEN) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
 
-        if (bt_event.connection.conn_id < 0) {
-            // Only drop exception if not called from bt_resume() API, otherwise return with mp_const_none on error
-            if(mod_bt_allow_resume_deinit == false) {
-                nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "connection refused"));
-            }
-            else {
-                return mp_const_none;
-            }
-        }
+    if (find_pending_connection(bufinfo.buf) != NULL) {
+        error_msg = "operation already in progress";
+        goto error;
+    }
 
-        // setup the object
-        bt_connection_obj_t *conn = m_new_obj(bt_connection_obj_t);
-        conn->base.type = (mp_obj_t)&mod_bt_connection_type;
-        conn->conn_id = bt_event.connection.conn_id;
-        conn->gatt_if = bt_event.connection.gatt_if;
-        conn->addr_type = addr_type;
+    if (bt_obj.scanning) {
+        esp_ble_gap_stop_scanning();
+        mp_hal_delay_ms(50);
+        bt_obj.scanning = false;
+    }
 
-        MP_THREAD_GIL_EXIT();
-        uxBits = xEventGroupWaitBits(bt_event_group, MOD_BT_GATTC_MTU_EVT, true, true, 1000/portTICK_PERIOD_MS);
-        MP_THREAD_GIL_ENTER();
+    // setup the object, the BT task fills in the rest when the connection is established
+    bt_connection_obj_t *conn = m_new_obj_with_finaliser(bt_connection_obj_t);
+    conn->base.type = (mp_obj_t)&mod_bt_connection_type;
+    mp_obj_list_init(&conn->srv_list, 0);
+    memcpy(conn->srv_bda, bufinfo.buf, ESP_BD_ADDR_LEN);
+    conn->conn_id = -1;
+    conn->mtu = 0;
+    conn->gatt_if = bt_obj.gattc_if;
+    conn->addr_type = addr_type;
+    conn->congested = false;
+    conn->read_char = NULL;
+    conn->srv_found = NULL;
+    conn->srv_count = 0;
+    conn->srv_ready = false;
+    conn->queue = xQueueCreate(BT_CONN_QUEUE_SIZE_MAX, sizeof(bt_conn_event_t));
+    if (!conn->queue) {
+        error_msg = mpexception_os_resource_not_avaliable;
+        goto error;
+    }
+    conn->op = ESP_GATTC_CONNECT_EVT;
+    conn->busy = true;
+    conn->connecting = true;
+    mp_obj_list_append((void *)&MP_STATE_PORT(btc_conn_list), conn);
 
-        if(uxBits & MOD_BT_GATTC_MTU_EVT)
-        {
-            conn->mtu = bt_conn_mtu;
-        }
-        memcpy(conn->srv_bda, bt_event.connection.srv_bda, 6);
-        mp_obj_list_append((void *)&MP_STATE_PORT(btc_conn_list), conn);
+    /* Initiate a background connection, esp_ble_gattc_open returns immediately */
+    if (ESP_OK != esp_ble_gattc_open(bt_obj.gattc_if, conn->srv_bda, addr_type, true)) {
+        conn->connecting = false;
+        conn->busy = false;
+        bt_conn_forget(conn);
+        error_msg = mpexception_os_operation_failed;
+        goto error;
+    }
 
+    if (nonblocking) {
+        // isconnected() tells when it's done, requests can be started on the other connections meanwhile
         return conn;
     }
-    else
-    {
-        MP_THREAD_GIL_ENTER();
 
-        (void)esp_ble_gap_disconnect(bufinfo.buf);
+    if (!bt_conn_wait(conn, ESP_GATTC_CONNECT_EVT, timeout, &status)) {
+        conn->connecting = false;
+        conn->busy = false;
+        bt_conn_forget(conn);
+        (void)esp_ble_gap_disconnect(conn->srv_bda);
+        error_type = &mp_type_TimeoutError;
+        error_msg = "timed out";
+        goto error;
+    }
+    if (status != ESP_GATT_OK || conn->conn_id < 0) {
+        error_msg = "connection refused";
+        goto error;
+    }
 
-        // Only drop exception if not called from bt_resume() API, otherwise return with mp_const_none on error
-        if(mod_bt_allow_resume_deinit == false) {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_TimeoutError, "timed out"));
-        }
-        else {
-            return mp_const_none;
-        }
+    // the MTU exchange completes the connection process
+    (void)bt_conn_wait(conn, ESP_GATTC_CFG_MTU_EVT, BT_CONN_MTU_TIMEOUT_MS / portTICK_PERIOD_MS, &status);
+    return conn;
+
+error:
+    // Only drop exception if not called from bt_resume() API, otherwise return with mp_const_none on error
+    if (mod_bt_allow_resume_deinit == false) {
+        nlr_raise(mp_obj_new_exception_msg(error_type, error_msg));
     }
     return mp_const_none;
 }
@@ -1510,6 +2040,7 @@ STATIC mp_obj_t bt_connect(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
             { MP_QSTR_addr,         MP_ARG_REQUIRED | MP_ARG_OBJ,   },
             { MP_QSTR_timeout,      MP_ARG_KW_ONLY  | MP_ARG_OBJ,   {.u_obj = MP_OBJ_NULL} },
             { MP_QSTR_addr_type,    MP_ARG_KW_ONLY  | MP_ARG_OBJ,   {.u_obj = MP_OBJ_NULL}},
+            { MP_QSTR_nonblocking,  MP_ARG_KW_ONLY  | MP_ARG_BOOL,  {.u_bool = false} },
     };
 
     // parse arguments
@@ -1551,13 +2082,13 @@ STATIC mp_obj_t bt_connect(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
     }
 
 
-    return bt_connect_helper(addr, timeout, addr_type);
+    return bt_connect_helper(addr, timeout, addr_type, args[3].u_bool);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(bt_connect_obj, 1, bt_connect);
 
 static mp_obj_t modbt_connect(mp_obj_t addr, esp_ble_addr_type_t addr_type)
 {
-    return bt_connect_helper(addr, portMAX_DELAY, addr_type);
+    return bt_connect_helper(addr, portMAX_DELAY, addr_type, false);
 }
 
 
@@ -2012,6 +2543,87 @@ STATIC mp_obj_t bt_characteristic_value (mp_uint_t n_args, const mp_obj_t *args)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(bt_characteristic_value_obj, 1, 2, bt_characteristic_value);
 
+/// \method notify_stream(data)
+/// Queues data to be sent to the client with notifications as long as the MTU allows, one after the other
+/// as the stack has room for them. Returns the number of bytes still queued.
+STATIC mp_obj_t bt_characteristic_notify_stream (mp_obj_t self_in, mp_obj_t data) {
+    bt_gatts_char_obj_t *self = self_in;
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+
+    if (bt_obj.gatts_conn_id < 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "no client connected"));
+    }
+
+    xSemaphoreTake(bt_notify_stream_mutex, portMAX_DELAY);
+    bt_notify_stream_t *stream = &bt_notify_stream;
+    uint32_t left = stream->len - stream->offset;
+
+    if (left > 0 && stream->chr != self) {
+        xSemaphoreGive(bt_notify_stream_mutex);
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "operation already in progress"));
+    }
+    if (left + bufinfo.len > BT_NOTIFY_STREAM_SIZE_MAX) {
+        xSemaphoreGive(bt_notify_stream_mutex);
+        mp_raise_OSError(MP_ENOBUFS);
+    }
+
+    // keep only the data not sent yet
+    uint8_t *buf = malloc(left + bufinfo.len);
+    if (!buf) {
+        xSemaphoreGive(bt_notify_stream_mutex);
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    if (left > 0) {
+        memcpy(buf, &stream->buf[stream->offset], left);
+    } else {
+        // a new stream, restart the counters
+        stream->chr = self;
+        stream->start_ms = mp_hal_ticks_ms();
+        stream->last_ms = stream->start_ms;
+        stream->bytes_sent = 0;
+        stream->notifications = 0;
+        stream->congestions = 0;
+        stream->errors = 0;
+    }
+    memcpy(&buf[left], bufinfo.buf, bufinfo.len);
+    free(stream->buf);
+    stream->buf = buf;
+    stream->len = left + bufinfo.len;
+    stream->offset = 0;
+    xSemaphoreGive(bt_notify_stream_mutex);
+
+    bt_notify_stream_pump();
+
+    return mp_obj_new_int_from_uint(stream->len - stream->offset);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(bt_characteristic_notify_stream_obj, bt_characteristic_notify_stream);
+
+/// \method notify_stats()
+/// Returns (queued, bytes_sent, notifications, congestions, errors, bytes_per_second) of the last stream of the characteristic.
+STATIC mp_obj_t bt_characteristic_notify_stats (mp_obj_t self_in) {
+    bt_gatts_char_obj_t *self = self_in;
+    bt_notify_stream_t stream = { 0 };
+
+    xSemaphoreTake(bt_notify_stream_mutex, portMAX_DELAY);
+    if (bt_notify_stream.chr == self) {
+        memcpy(&stream, &bt_notify_stream, sizeof(stream));
+    }
+    xSemaphoreGive(bt_notify_stream_mutex);
+
+    uint32_t elapsed = stream.last_ms - stream.start_ms;
+    mp_obj_t tuple[6];
+    tuple[0] = mp_obj_new_int_from_uint(stream.len - stream.offset);
+    tuple[1] = mp_obj_new_int_from_uint(stream.bytes_sent);
+    tuple[2] = mp_obj_new_int_from_uint(stream.notifications);
+    tuple[3] = mp_obj_new_int_from_uint(stream.congestions);
+    tuple[4] = mp_obj_new_int_from_uint(stream.errors);
+    tuple[5] = mp_obj_new_int_from_uint(elapsed > 0 ? (uint64_t)stream.bytes_sent * 1000 / elapsed : 0);
+    return mp_obj_new_tuple(6, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_characteristic_notify_stats_obj, bt_characteristic_notify_stats);
+
 /// \method callback(trigger, handler, arg)
 STATIC mp_obj_t bt_characteristic_callback(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     STATIC const mp_arg_t allowed_args[] = {
@@ -2064,6 +2676,8 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_characteristic_config_obj, bt_characteristic
 STATIC const mp_map_elem_t bt_gatts_char_locals_dict_table[] = {
     // instance methods
     { MP_OBJ_NEW_QSTR(MP_QSTR_value),          (mp_obj_t)&bt_characteristic_value_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_notify_stream),  (mp_obj_t)&bt_characteristic_notify_stream_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_notify_stats),   (mp_obj_t)&bt_characteristic_notify_stats_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_callback),       (mp_obj_t)&bt_characteristic_callback_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_events),         (mp_obj_t)&bt_characteristic_events_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_config),         (mp_obj_t)&bt_characteristic_config_obj },
@@ -2184,6 +2798,7 @@ STATIC const mp_map_elem_t bt_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_stop_scan),               (mp_obj_t)&bt_stop_scan_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_adv),                 (mp_obj_t)&bt_read_scan_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_advertisements),      (mp_obj_t)&bt_get_advertisements_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_scan_stats),              (mp_obj_t)&bt_scan_stats_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_resolve_adv_data),        (mp_obj_t)&bt_resolve_adv_data_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_connect),                 (mp_obj_t)&bt_connect_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_advertisement_params),(mp_obj_t)&bt_set_advertisement_params_obj },
@@ -2336,6 +2951,12 @@ STATIC mp_obj_t bt_conn_disconnect(mp_obj_t self_in) {
         {
             self->conn_id = -1;
         }
+    } else if (self->connecting) {
+        // gives up on a connection started with nonblocking=True
+        self->connecting = false;
+        self->busy = false;
+        bt_conn_forget(self);
+        esp_ble_gap_disconnect(self->srv_bda);
     }
     return mp_const_none;
 }
@@ -2346,36 +2967,75 @@ static mp_obj_t modbt_conn_disconnect(mp_obj_t self_in)
     return bt_conn_disconnect(self_in);
 }
 
-STATIC mp_obj_t bt_conn_services (mp_obj_t self_in) {
-    bt_connection_obj_t *self = self_in;
-    bt_event_result_t bt_event;
+/// \method services(*, nonblocking=False)
+/// Discovers the services of the peer. With nonblocking=True it returns None until the discovery is
+/// completed, each call after it's started only polls it, the one after it completes returns the list.
+STATIC mp_obj_t bt_conn_services (mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_nonblocking,  MP_ARG_KW_ONLY  | MP_ARG_BOOL,  {.u_bool = false} },
+    };
 
-    if (self->conn_id >= 0) {
-        xQueueReset(xScanQueue);
-        bt_obj.busy = true;
-        mp_obj_list_init(&self->srv_list, 0);
+    // parse arguments
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+    bt_connection_obj_t *self = pos_args[0];
+    esp_gatt_status_t status;
 
+    if (!self->srv_ready && !(self->busy && self->op == ESP_GATTC_SEARCH_CMPL_EVT)) {
+        bt_conn_start(self, ESP_GATTC_SEARCH_CMPL_EVT, NULL);
+        free(self->srv_found);
+        self->srv_found = NULL;
+        self->srv_count = 0;
         if (ESP_OK != esp_ble_gattc_search_service(bt_obj.gattc_if, self->conn_id, NULL)) {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+            bt_conn_start_failed(self);
         }
+    }
 
-        while (bt_obj.busy) {
-            while (xQueueReceive(xScanQueue, &bt_event, (TickType_t)0)) {
-                bt_srv_obj_t *srv = m_new_obj(bt_srv_obj_t);
-                srv->base.type = (mp_obj_t)&mod_bt_service_type;
-                srv->connection = self;
-                memcpy(&srv->srv_id, &bt_event.service.srv_id, sizeof(esp_gatt_id_t));
-                srv->start_handle = bt_event.service.start_handle;
-                srv->end_handle = bt_event.service.end_handle;
-                mp_obj_list_append(&self->srv_list, srv);
-            }
+    if (!self->srv_ready) {
+        if (args[0].u_bool) {
+            return mp_const_none;
+        }
+        if (!bt_conn_wait(self, ESP_GATTC_SEARCH_CMPL_EVT, portMAX_DELAY, &status) || !self->srv_ready) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "connection already closed"));
         }
-        return &self->srv_list;
-    } else {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "connection already closed"));
     }
+
+    self->srv_ready = false;
+    mp_obj_list_init(&self->srv_list, 0);
+    for (mp_uint_t i = 0; i < self->srv_count; i++) {
+        bt_srv_obj_t *srv = m_new_obj(bt_srv_obj_t);
+        srv->base.type = (mp_obj_t)&mod_bt_service_type;
+        srv->connection = self;
+        memcpy(&srv->srv_id, &self->srv_found[i].srv_id, sizeof(esp_gatt_id_t));
+        srv->start_handle = self->srv_found[i].start_handle;
+        srv->end_handle = self->srv_found[i].end_handle;
+        mp_obj_list_append(&self->srv_list, srv);
+    }
+    return &self->srv_list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(bt_conn_services_obj, 1, bt_conn_services);
+
+/// \method busy()
+/// Tells if a request started on this connection (connect, services, read or write) is still in progress.
+STATIC mp_obj_t bt_conn_busy(mp_obj_t self_in) {
+    bt_connection_obj_t *self = self_in;
+    return mp_obj_new_bool(self->busy);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_conn_busy_obj, bt_conn_busy);
+
+STATIC mp_obj_t bt_conn_del(mp_obj_t self_in) {
+    bt_connection_obj_t *self = self_in;
+
+    // not in the list of the connections anymore, the BT task can't reach it
+    if (self->queue) {
+        vQueueDelete(self->queue);
+        self->queue = NULL;
+    }
+    free(self->srv_found);
+    self->srv_found = NULL;
+    return mp_const_none;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_conn_services_obj, bt_conn_services);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_conn_del_obj, bt_conn_del);
 
 STATIC const mp_map_elem_t bt_connection_locals_dict_table[] = {
     // instance methods
@@ -2383,6 +3043,8 @@ STATIC const mp_map_elem_t bt_connection_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_disconnect),              (mp_obj_t)&bt_conn_disconnect_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_services),                (mp_obj_t)&bt_conn_services_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_mtu),                 (mp_obj_t)&bt_conn_get_mtu_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_busy),                    (mp_obj_t)&bt_conn_busy_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR___del__),                 (mp_obj_t)&bt_conn_del_obj },
 
 };
 STATIC MP_DEFINE_CONST_DICT(bt_connection_locals_dict, bt_connection_locals_dict_table);
@@ -2453,6 +3115,11 @@ STATIC mp_obj_t bt_srv_characteristics(mp_obj_t self_in) {
                         memcpy(&chr->characteristic, &char_elems[i], sizeof(esp_gattc_char_elem_t));
                         chr->value[0] = 0;
                         chr->value_len = 1;
+                        chr->rx_buf = NULL;
+                        chr->rx_size = 0;
+                        chr->rx_head = 0;
+                        chr->rx_used = 0;
+                        chr->rx_dropped = 0;
                         mp_obj_list_append(&self->char_list, chr);
                     }
                 }
@@ -2505,49 +3172,51 @@ STATIC mp_obj_t bt_char_properties(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_char_properties_obj, bt_char_properties);
 
-STATIC mp_obj_t bt_char_read(mp_obj_t self_in) {
-    bt_char_obj_t *self = self_in;
-    bt_event_result_t bt_event;
+/// \method read(*, nonblocking=False)
+/// With nonblocking=True the read is only started and None is returned, value() has the new value
+/// once the busy() of the connection is False again.
+STATIC mp_obj_t bt_char_read(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_nonblocking,  MP_ARG_KW_ONLY  | MP_ARG_BOOL,  {.u_bool = false} },
+    };
 
-    if (self->service->connection->conn_id >= 0) {
-        xQueueReset(xScanQueue);
-        bt_obj.busy = true;
+    // parse arguments
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+    bt_char_obj_t *self = pos_args[0];
+    bt_connection_obj_t *conn = self->service->connection;
+    esp_gatt_status_t status;
 
-        if (ESP_OK != esp_ble_gattc_read_char (bt_obj.gattc_if, self->service->connection->conn_id,
-                                               self->characteristic.char_handle,
-                                               ESP_GATT_AUTH_REQ_NONE)) {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
-        }
-        while (bt_obj.busy) {
-            mp_hal_delay_ms(5);
-        }
-        if (xQueueReceive(xScanQueue, &bt_event, (TickType_t)5)) {
-            memcpy(self->value, bt_event.read.value, bt_event.read.value_len);
-            self->value_len = bt_event.read.value_len;
-            return mp_obj_new_bytes(bt_event.read.value, bt_event.read.value_len);
-        } else {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
-        }
-    } else {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "connection already closed"));
+    bt_conn_start(conn, ESP_GATTC_READ_CHAR_EVT, self);
+    if (ESP_OK != esp_ble_gattc_read_char (bt_obj.gattc_if, conn->conn_id,
+                                           self->characteristic.char_handle,
+                                           ESP_GATT_AUTH_REQ_NONE)) {
+        bt_conn_start_failed(conn);
     }
+    if (args[0].u_bool) {
+        return mp_const_none;
+    }
+    // the BT task has already copied the value into the characteristic
+    if (bt_conn_wait(conn, ESP_GATTC_READ_CHAR_EVT, portMAX_DELAY, &status) && status == ESP_GATT_OK) {
+        return mp_obj_new_bytes(self->value, self->value_len);
+    }
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(bt_char_read_obj, bt_char_read);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(bt_char_read_obj, 1, bt_char_read);
 
 STATIC mp_obj_t bt_char_read_descriptor(mp_obj_t self_in, mp_obj_t uuid) {
     bt_char_obj_t *self = self_in;
-    bt_event_result_t bt_event;
+    bt_connection_obj_t *conn = self->service->connection;
+    esp_gatt_status_t status;
 
     uint16_t descr_uuid_value = mp_obj_get_int(uuid);
 
-    if (self->service->connection->conn_id >= 0) {
-        xQueueReset(xScanQueue);
-
+    if (conn->conn_id >= 0) {
         esp_gattc_descr_elem_t format_descriptor;
         uint16_t count = 1;
         esp_bt_uuid_t descr_uuid = {.len = ESP_UUID_LEN_16, .uuid.uuid16 = descr_uuid_value};
         esp_gatt_status_t ret_val = esp_ble_gattc_get_descr_by_uuid(bt_obj.gattc_if,
-                                                                    self->service->connection->conn_id,
+                                                                    conn->conn_id,
                                                                     self->service->start_handle,
                                                                     self->service->end_handle,
                                                                     self->characteristic.uuid,
@@ -2555,21 +3224,17 @@ STATIC mp_obj_t bt_char_read_descriptor(mp_obj_t self_in, mp_obj_t uuid) {
                                                                     &format_descriptor,
                                                                     &count);
         if(ret_val == ESP_OK && count == 1) {
-            bt_obj.busy = true;
+            bt_conn_start(conn, ESP_GATTC_READ_DESCR_EVT, NULL);
 
             if (ESP_OK != esp_ble_gattc_read_char_descr(bt_obj.gattc_if,
-                                                        self->service->connection->conn_id,
+                                                        conn->conn_id,
                                                         format_descriptor.handle,
                                                         ESP_GATT_AUTH_REQ_NONE)) {
-                nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+                bt_conn_start_failed(conn);
             }
 
-            while (bt_obj.busy) {
-                mp_hal_delay_ms(5);
-            }
-
-            if (xQueueReceive(xScanQueue, &bt_event, (TickType_t)5)) {
-                return mp_obj_new_bytes(bt_event.read.value, bt_event.read.value_len);
+            if (bt_conn_wait(conn, ESP_GATTC_READ_DESCR_EVT, portMAX_DELAY, &status) && status == ESP_GATT_OK) {
+                return mp_obj_new_bytes(conn->read.value, conn->read.value_len);
             } else {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
             }
@@ -2582,45 +3247,100 @@ STATIC mp_obj_t bt_char_read_descriptor(mp_obj_t self_in, mp_obj_t uuid) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(bt_char_read_descriptor_obj, bt_char_read_descriptor);
 
-STATIC mp_obj_t bt_char_write(mp_obj_t self_in, mp_obj_t value) {
-    bt_char_obj_t *self = self_in;
-    bt_event_result_t bt_event;
+/// \method write(value, *, nonblocking=False)
+/// With nonblocking=True the write is only started, the busy() of the connection tells when it's acknowledged.
+STATIC mp_obj_t bt_char_write(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_value,        MP_ARG_REQUIRED | MP_ARG_OBJ,   },
+        { MP_QSTR_nonblocking,  MP_ARG_KW_ONLY  | MP_ARG_BOOL,  {.u_bool = false} },
+    };
+
+    // parse arguments
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+    bt_char_obj_t *self = pos_args[0];
+    bt_connection_obj_t *conn = self->service->connection;
+    esp_gatt_status_t status;
 
     mp_buffer_info_t bufinfo;
-    mp_get_buffer_raise(value, &bufinfo, MP_BUFFER_READ);
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
+
+    bt_conn_start(conn, ESP_GATTC_WRITE_CHAR_EVT, NULL);
+    if (ESP_OK != esp_ble_gattc_write_char (bt_obj.gattc_if, conn->conn_id,
+                                            self->characteristic.char_handle,
+                                            bufinfo.len,
+                                            bufinfo.buf,
+                                            ESP_GATT_WRITE_TYPE_RSP,
+                                            ESP_GATT_AUTH_REQ_NONE)) {
+        bt_conn_start_failed(conn);
+    }
+    if (args[1].u_bool) {
+        return mp_const_none;
+    }
+    if (!bt_conn_wait(conn, ESP_GATTC_WRITE_CHAR_EVT, portMAX_DELAY, &status) || status != ESP_GATT_OK) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(bt_char_write_obj, 2, bt_char_write);
 
-    if (self->service->connection->conn_id >= 0) {
-        xQueueReset(xScanQueue);
-        bt_obj.busy = true;
+/// \method write_bulk(data, *, timeout)
+/// Writes data with as many write without response as needed, each one as long as the MTU allows.
+/// The writes are queued without waiting for each other, only when the stack is congested it waits
+/// for it to have room again.
+STATIC mp_obj_t bt_char_write_bulk(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_data,         MP_ARG_REQUIRED | MP_ARG_OBJ,   },
+        { MP_QSTR_timeout,      MP_ARG_KW_ONLY  | MP_ARG_INT,   {.u_int = BT_BULK_WRITE_TIMEOUT_MS} },
+    };
 
-        if (ESP_OK != esp_ble_gattc_write_char (bt_obj.gattc_if, self->service->connection->conn_id,
-                                                self->characteristic.char_handle,
-                                                bufinfo.len,
-                                                bufinfo.buf,
-                                                ESP_GATT_WRITE_TYPE_RSP,
-                                                ESP_GATT_AUTH_REQ_NONE)) {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
-        }
+    // parse arguments
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+    bt_char_obj_t *self = pos_args[0];
+    bt_connection_obj_t *conn = self->service->connection;
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
 
-        while (bt_obj.busy) {
-            mp_hal_delay_ms(5);
+    // its completions would be taken for the one of the request in progress
+    if (conn->busy) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "operation already in progress"));
+    }
+
+    // the ATT header of a write takes 3 bytes
+    uint32_t chunk_max = (conn->mtu >= BT_ATT_DEFAULT_MTU ? conn->mtu : BT_ATT_DEFAULT_MTU) - 3;
+    uint32_t offset = 0;
+    uint32_t waited = 0;
+
+    while (offset < bufinfo.len) {
+        if (conn->conn_id < 0) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "connection already closed"));
         }
-        if (xQueueReceive(xScanQueue, &bt_event, (TickType_t)5)) {
-            if (bt_event.write.status != ESP_GATT_OK) {
-                goto error;
-            }
+
+        uint32_t chunk = MIN(chunk_max, bufinfo.len - offset);
+        if (!conn->congested &&
+            ESP_OK == esp_ble_gattc_write_char (bt_obj.gattc_if, conn->conn_id,
+                                                self->characteristic.char_handle,
+                                                chunk,
+                                                (uint8_t *)bufinfo.buf + offset,
+                                                ESP_GATT_WRITE_TYPE_NO_RSP,
+                                                ESP_GATT_AUTH_REQ_NONE)) {
+            offset += chunk;
+            waited = 0;
         } else {
-            goto error;
+            // no room in the queues of the stack, give it time to send the data
+            if (waited >= args[1].u_int) {
+                mp_raise_OSError(MP_ETIMEDOUT);
+            }
+            mp_hal_delay_ms(1);
+            waited++;
         }
-    } else {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "connection already closed"));
     }
-    return mp_const_none;
 
-error:
-    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    return mp_obj_new_int_from_uint(offset);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_2(bt_char_write_obj, bt_char_write);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(bt_char_write_bulk_obj, 2, bt_char_write_bulk);
 
 /// \method callback(trigger, handler, arg)
 STATIC mp_obj_t bt_char_callback(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
@@ -2634,7 +3354,6 @@ STATIC mp_obj_t bt_char_callback(mp_uint_t n_args, const mp_obj_t *pos_args, mp_
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
     bt_char_obj_t *self = pos_args[0];
-    bt_event_result_t bt_event;
 
     // enable the callback
     if (args[0].u_obj != mp_const_none && args[1].u_obj != mp_const_none) {
@@ -2650,74 +3369,154 @@ STATIC mp_obj_t bt_char_callback(mp_uint_t n_args, const mp_obj_t *pos_args, mp_
             self->handler_arg = args[2].u_obj;
         }
 
-        if (self->service->connection->conn_id >= 0) {
-            if (ESP_OK != esp_ble_gattc_register_for_notify (self->service->connection->gatt_if,
-                                                             self->service->connection->srv_bda,
-                                                             self->characteristic.char_handle)) {
-                nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
-            }
+        bt_char_register_for_notify(self);
+    } else {
+        self->trigger = 0;
+        mp_irq_remove(self);
+        INTERRUPT_OBJ_CLEAN(self);
+    }
 
-            if (xQueueReceive(xScanQueue, &bt_event, (TickType_t)(2500 / portTICK_RATE_MS))) {
-                if (bt_event.register_for_notify.status != ESP_GATT_OK) {
-                    goto error;
-                }
-            } else {
+    mp_irq_add(self, args[1].u_obj);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(bt_char_callback_obj, 1, bt_char_callback);
+
+/// \method notify_buffer([size])
+/// Stores the data of all of the notifications in a buffer of size bytes, read with read_buffer().
+/// Size 0 removes the buffer. Without arguments returns the number of bytes stored and dropped.
+STATIC mp_obj_t bt_char_notify_buffer(mp_uint_t n_args, const mp_obj_t *args) {
+    bt_char_obj_t *self = args[0];
+
+    if (n_args == 1) {
+        mp_obj_t tuple[2];
+        tuple[0] = mp_obj_new_int_from_uint(self->rx_used);
+        tuple[1] = mp_obj_new_int_from_uint(self->rx_dropped);
+        return mp_obj_new_tuple(2, tuple);
+    }
+
+    mp_int_t size = mp_obj_get_int(args[1]);
+    if (size < 0 || size > BT_NOTIFY_BUFFER_SIZE_MAX) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+
+    uint8_t *buf = NULL;
+    if (size > 0) {
+        buf = m_new(uint8_t, size);
+    }
+    portENTER_CRITICAL(&bt_char_rx_mux);
+    uint8_t *old_buf = self->rx_buf;
+    uint32_t old_size = self->rx_size;
+    self->rx_buf = buf;
+    self->rx_size = size;
+    self->rx_head = 0;
+    self->rx_used = 0;
+    self->rx_dropped = 0;
+    portEXIT_CRITICAL(&bt_char_rx_mux);
+    if (old_buf) {
+        m_del(uint8_t, old_buf, old_size);
+    }
+
+    if (buf && !(self->trigger & MOD_BT_GATTC_NOTIFY_EVT)) {
+        bt_char_register_for_notify(self);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(bt_char_notify_buffer_obj, 1, 2, bt_char_notify_buffer);
+
+/// \method read_buffer([nbytes])
+STATIC mp_obj_t bt_char_read_buffer(mp_uint_t n_args, const mp_obj_t *args) {
+    bt_char_obj_t *self = args[0];
+
+    mp_uint_t len = self->rx_used;
+    if (n_args > 1) {
+        len = MIN(len, mp_obj_get_int(args[1]));
+    }
+
+    vstr_t vstr;
+    vstr_init_len(&vstr, len);
+    portENTER_CRITICAL(&bt_char_rx_mux);
+    if (self->rx_buf) {
+        // the buffer could have been replaced before taking the lock
+        len = MIN(len, self->rx_used);
+        uint32_t first = MIN(len, self->rx_size - self->rx_head);
+        memcpy(vstr.buf, &self->rx_buf[self->rx_head], first);
+        memcpy(&vstr.buf[first], self->rx_buf, len - first);
+        self->rx_head = (self->rx_head + len) % self->rx_size;
+        self->rx_used -= len;
+    } else {
+        len = 0;
+    }
+    portEXIT_CRITICAL(&bt_char_rx_mux);
+    vstr.len = len;
+
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(bt_char_read_buffer_obj, 1, 2, bt_char_read_buffer);
+
+// registers for the notifications and enables them in the peripheral
+static void bt_char_register_for_notify(bt_char_obj_t *self) {
+    bt_event_result_t bt_event;
+
+    if (self->service->connection->conn_id >= 0) {
+        if (ESP_OK != esp_ble_gattc_register_for_notify (self->service->connection->gatt_if,
+                                                         self->service->connection->srv_bda,
+                                                         self->characteristic.char_handle)) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+        }
+
+        if (xQueueReceive(xScanQueue, &bt_event, (TickType_t)(2500 / portTICK_RATE_MS))) {
+            if (bt_event.register_for_notify.status != ESP_GATT_OK) {
                 goto error;
             }
+        } else {
+            goto error;
+        }
 
-            uint16_t attr_count = 0;
-            uint16_t notify_en = 1;
-            esp_ble_gattc_get_attr_count(bt_obj.gattc_if,
-                                         self->service->connection->conn_id,
-                                         ESP_GATT_DB_DESCRIPTOR,
-                                         self->service->start_handle,
-                                         self->service->end_handle,
-                                         self->characteristic.char_handle,
-                                         &attr_count);
-            if (attr_count > 0) {
-                esp_gattc_descr_elem_t *descr_elems = (esp_gattc_descr_elem_t *)malloc(sizeof(esp_gattc_descr_elem_t) * attr_count);
-                if (!descr_elems) {
-                    mp_raise_OSError(MP_ENOMEM);
-                } else {
-                    esp_ble_gattc_get_all_descr(bt_obj.gattc_if,
-                                                self->service->connection->conn_id,
-                                                self->characteristic.char_handle,
-                                                descr_elems,
-                                                &attr_count,
-                                                0);
-                    for (int i = 0; i < attr_count; ++i) {
-                        if (descr_elems[i].uuid.len == ESP_UUID_LEN_16 && descr_elems[i].uuid.uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG) {
-                            esp_ble_gattc_write_char_descr (bt_obj.gattc_if,
-                                                            self->service->connection->conn_id,
-                                                            descr_elems[i].handle,
-                                                            sizeof(notify_en),
-                                                            (uint8_t *)&notify_en,
-                                                            ESP_GATT_WRITE_TYPE_RSP,
-                                                            ESP_GATT_AUTH_REQ_NONE);
-
-                            break;
-                        }
+        uint16_t attr_count = 0;
+        uint16_t notify_en = 1;
+        esp_ble_gattc_get_attr_count(bt_obj.gattc_if,
+                                     self->service->connection->conn_id,
+                                     ESP_GATT_DB_DESCRIPTOR,
+                                     self->service->start_handle,
+                                     self->service->end_handle,
+                                     self->characteristic.char_handle,
+                                     &attr_count);
+        if (attr_count > 0) {
+            esp_gattc_descr_elem_t *descr_elems = (esp_gattc_descr_elem_t *)malloc(sizeof(esp_gattc_descr_elem_t) * attr_count);
+            if (!descr_elems) {
+                mp_raise_OSError(MP_ENOMEM);
+            } else {
+                esp_ble_gattc_get_all_descr(bt_obj.gattc_if,
+                                            self->service->connection->conn_id,
+                                            self->characteristic.char_handle,
+                                            descr_elems,
+                                            &attr_count,
+                                            0);
+                for (int i = 0; i < attr_count; ++i) {
+                    if (descr_elems[i].uuid.len == ESP_UUID_LEN_16 && descr_elems[i].uuid.uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG) {
+                        esp_ble_gattc_write_char_descr (bt_obj.gattc_if,
+                                                        self->service->connection->conn_id,
+                                                        descr_elems[i].handle,
+                                                        sizeof(notify_en),
+                                                        (uint8_t *)&notify_en,
+                                                        ESP_GATT_WRITE_TYPE_RSP,
+                                                        ESP_GATT_AUTH_REQ_NONE);
+
+                        break;
                     }
-                    free(descr_elems);
                 }
+                free(descr_elems);
             }
-        } else {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "connection already closed"));
         }
     } else {
-        self->trigger = 0;
-        mp_irq_remove(self);
-        INTERRUPT_OBJ_CLEAN(self);
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "connection already closed"));
     }
-
-    mp_irq_add(self, args[1].u_obj);
-
-    return mp_const_none;
+    return;
 
 error:
     nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(bt_char_callback_obj, 1, bt_char_callback);
 
 STATIC mp_obj_t bt_char_value(mp_obj_t self_in) {
     bt_char_obj_t *self = self_in;
@@ -2733,7 +3532,10 @@ STATIC const mp_map_elem_t bt_characteristic_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_read),                    (mp_obj_t)&bt_char_read_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_read_descriptor),         (mp_obj_t)&bt_char_read_descriptor_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_write),                   (mp_obj_t)&bt_char_write_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_write_bulk),              (mp_obj_t)&bt_char_write_bulk_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_callback),                (mp_obj_t)&bt_char_callback_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_notify_buffer),           (mp_obj_t)&bt_char_notify_buffer_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_read_buffer),             (mp_obj_t)&bt_char_read_buffer_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_value),                   (mp_obj_t)&bt_char_value_obj },
     // { MP_OBJ_NEW_QSTR(MP_QSTR_descriptors),             (mp_obj_t)&bt_char_descriptors_obj },
 };
@@ -11,6 +11,9 @@
 #include "py/mpconfig.h"
 #include "py/obj.h"
 #include "py/runtime.h"
+#include "py/mphal.h"
+#include "py/stream.h"
+#include "py/mperrno.h"
 
 #include "coap.h"
 #include "coap_list.h"
@@ -20,6 +23,7 @@
 #include "modusocket.h"
 #include "lwipsocket.h"
 #include "netutils.h"
+#include "mpexception.h"
 
 #include "freertos/semphr.h"
 
@@ -34,6 +38,20 @@
 #define MODCOAP_REQUEST_PUT     (0x02)
 #define MODCOAP_REQUEST_POST    (0x04)
 #define MODCOAP_REQUEST_DELETE  (0x08)
+#define MODCOAP_INDEX_SIZE      (16)    // buckets of the resource index, must be a power of 2
+#define MODCOAP_VALUE_SIZE_MIN  (16)    // smallest value buffer of a resource
+#define MODCOAP_OBSERVE_REGISTER    (0)
+#define MODCOAP_OBSERVE_DEREGISTER  (1)
+#define MODCOAP_BLOCK_SIZE_DEFAULT  (512)   // of the block-wise transfers (RFC 7959), 16 to 1024
+#define MODCOAP_BLOCK_SZX_MAX       (6)     // 1024 bytes
+#define MODCOAP_TRANSFER_TIMEOUT_MS (93000) // MAX_TRANSMIT_WAIT of RFC 7252, a transfer not answered since is dropped
+
+// The value of the Block1 and Block2 options
+#define MODCOAP_BLOCK_VALUE(num, m, szx)    (((num) << 4) | ((m) << 3) | (szx))
+#define MODCOAP_BLOCK_NUM(value)            ((value) >> 4)
+#define MODCOAP_BLOCK_M(value)              (((value) >> 3) & 1)
+#define MODCOAP_BLOCK_SZX(value)            ((value) & 7)
+#define MODCOAP_BLOCK_SIZE(szx)             (1 << ((szx) + 4))
 
 /******************************************************************************
  DEFINE PRIVATE TYPES
@@ -41,25 +59,60 @@
 typedef struct mod_coap_resource_obj_s {
     mp_obj_base_t base;
     coap_resource_t* coap_resource;
-    struct mod_coap_resource_obj_s* next;
+    struct mod_coap_resource_obj_s* next;   // next resource in the same bucket of the index
     uint8_t* value;
+    mp_obj_t getter;
     uint32_t max_age;
+    uint32_t updated_ms;
+    uint32_t notified_ms;
+    uint32_t notify_interval;               // shortest time between 2 notifications in ms
     uint16_t etag_value;
     uint16_t value_len;
+    uint16_t value_size;                    // of the value buffer, kept between updates
     uint8_t mediatype;
+    int8_t notify_type;                     // -1 follows the type of the registering request
     bool etag;
+    bool notify_pending;
+    mp_obj_t source;                        // GET is served from it block by block instead of the value
+    mp_obj_t sink;                          // the payload of PUT and POST is written to it instead of the value
+    uint32_t block1_next;                   // number of the next Block1 expected by the sink
+    uint8_t szx;                            // of the blocks served from the source
 }mod_coap_resource_obj_t;
 
+// A block-wise request of the client, its blocks are sent from the response handler
+typedef struct mod_coap_transfer_s {
+    mp_obj_t source;                        // the payload of a PUT or POST, sent with Block1
+    mp_obj_t sink;                          // the payload of the response to a GET, asked with Block2
+    coap_list_t *optlist;                   // the options of the request, repeated in every block
+    coap_address_t address;
+    uint32_t num;                           // of the last block sent or asked
+    uint32_t activity_ms;
+    uint8_t token[8];
+    uint8_t token_length;
+    uint8_t method;
+    uint8_t szx;
+    bool active;
+}mod_coap_transfer_t;
+
 typedef struct mod_coap_obj_s {
     mp_obj_base_t base;
     coap_context_t* context;
     mod_network_socket_obj_t* socket;
-    mod_coap_resource_obj_t* resources;
+    mod_coap_resource_obj_t* index[MODCOAP_INDEX_SIZE];
     SemaphoreHandle_t semphr;
     mp_obj_t callback;
     coap_list_t *optlist;
+    mod_coap_transfer_t transfer;           // only 1 block-wise request at a time
 }mod_coap_obj_t;
 
+// What the response handler does with a response after the transfer has seen it
+typedef enum {
+    MODCOAP_TRANSFER_NONE = 0,              // not part of the transfer
+    MODCOAP_TRANSFER_MORE,                  // the next block was requested, the callback is not called
+    MODCOAP_TRANSFER_DATA,                  // a block of a GET without sink, passed to the callback
+    MODCOAP_TRANSFER_END,                   // the last response, passed to the callback
+}mod_coap_transfer_result_t;
+
 
 
 /******************************************************************************
@@ -67,10 +120,14 @@ typedef struct mod_coap_obj_s {
  ******************************************************************************/
 STATIC mod_coap_resource_obj_t* find_resource(coap_resource_t* resource);
 STATIC mod_coap_resource_obj_t* find_resource_by_key(coap_key_t key);
-STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype, uint8_t max_age, mp_obj_t value, bool etag);
+STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype, uint8_t max_age, mp_obj_t value, bool etag, mp_obj_t getter,
+                                             bool observable, int8_t notify_type, uint32_t notify_interval);
 STATIC void remove_resource_by_key(coap_key_t key);
 STATIC void remove_resource(const char* uri);
+STATIC void resource_set_value(mod_coap_resource_obj_t* resource, const uint8_t* data, size_t len);
 STATIC void resource_update_value(mod_coap_resource_obj_t* resource, mp_obj_t new_value);
+STATIC bool resource_refresh_value(mod_coap_resource_obj_t* resource);
+STATIC void resource_check_notify(void);
 
 STATIC void coap_resource_callback_get(coap_context_t * context,
                                        struct coap_resource_t * resource,
@@ -127,6 +184,17 @@ STATIC coap_pdu_t * modcoap_new_request(coap_context_t *ctx,
                                         const char *data,
                                         size_t length);
 STATIC coap_list_t * modcoap_new_option_node(unsigned short key, unsigned int length, unsigned char *data);
+STATIC void modcoap_stream_seek(mp_obj_t stream, uint32_t offset);
+STATIC size_t modcoap_stream_read(mp_obj_t stream, uint8_t* buf, size_t len);
+STATIC void modcoap_stream_write(mp_obj_t stream, const uint8_t* buf, size_t len);
+STATIC void modcoap_stream_flush(mp_obj_t stream);
+STATIC uint8_t* modcoap_read_block(mp_obj_t source, uint32_t num, uint8_t szx, size_t* len, bool* more);
+STATIC bool modcoap_get_block_opt(coap_pdu_t* pdu, unsigned short type, uint32_t* value);
+STATIC void resource_sink_data(mod_coap_resource_obj_t* resource, coap_pdu_t* request, coap_pdu_t* response);
+STATIC uint8_t modcoap_block_szx(mp_int_t size);
+STATIC void modcoap_transfer_end(void);
+STATIC coap_tid_t modcoap_transfer_send(void);
+STATIC mod_coap_transfer_result_t modcoap_transfer_next(coap_pdu_t* received, const uint8_t* data, size_t* len);
 /******************************************************************************
  DEFINE PRIVATE VARIABLES
  ******************************************************************************/
@@ -138,39 +206,46 @@ STATIC bool initialized = false;
 /******************************************************************************
  DEFINE PRIVATE FUNCTIONS
  ******************************************************************************/
-// Get the resource if exists
-STATIC mod_coap_resource_obj_t* find_resource(coap_resource_t* resource) {
+// The bucket of the index holding the resources with this key
+STATIC mod_coap_resource_obj_t** index_bucket(const coap_key_t key) {
+    uint32_t hash;
+    // The key is already a hash of the Uri
+    memcpy(&hash, key, sizeof(hash));
+    return &coap_obj_ptr->index[hash & (MODCOAP_INDEX_SIZE - 1)];
+}
 
-    if(coap_obj_ptr->resources != NULL) {
-        mod_coap_resource_obj_t* current = coap_obj_ptr->resources;
-        for(; current != NULL; current = current->next) {
-            // The hash key is generated from Uri
-            if(memcmp(current->coap_resource->key, resource->key, sizeof(current->coap_resource->key)) == 0) {
-                return current;
-            }
+// Get the resource if exists by its key, NULL if not
+STATIC mod_coap_resource_obj_t* index_lookup(const coap_key_t key) {
+
+    mod_coap_resource_obj_t* current = *index_bucket(key);
+    for(; current != NULL; current = current->next) {
+        // The hash key is generated from Uri
+        if(memcmp(current->coap_resource->key, key, sizeof(coap_key_t)) == 0) {
+            return current;
         }
     }
     return NULL;
 }
 
+// Get the resource if exists
+STATIC mod_coap_resource_obj_t* find_resource(coap_resource_t* resource) {
+    return index_lookup(resource->key);
+}
+
 // Get the resource if exists by its key
 STATIC mod_coap_resource_obj_t* find_resource_by_key(coap_key_t key) {
 
-    if(coap_obj_ptr->resources != NULL) {
-        mod_coap_resource_obj_t* current = coap_obj_ptr->resources;
-        for(; current != NULL; current = current->next) {
-            // The hash key is generated from Uri
-            if(memcmp(current->coap_resource->key, key, sizeof(current->coap_resource->key)) == 0) {
-                return current;
-            }
-        }
+    mod_coap_resource_obj_t* resource = index_lookup(key);
+    if(resource != NULL) {
+        return resource;
     }
     return mp_const_none;
 }
 
 
 // Create a new resource in the scope of the only context
-STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype, uint8_t max_age, mp_obj_t value, bool etag) {
+STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype, uint8_t max_age, mp_obj_t value, bool etag, mp_obj_t getter,
+                                             bool observable, int8_t notify_type, uint32_t notify_interval) {
 
     // Currently only 1 context is supported
     mod_coap_obj_t* context = coap_obj_ptr;
@@ -178,17 +253,10 @@ STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype,
     coap_key_t key;
     (void)coap_hash_path((const unsigned char*)uri, strlen(uri), key);
 
-    // Check if there is at least 1 resource
-    if(context->resources != NULL) {
-        mod_coap_resource_obj_t* current = context->resources;
-        // Iterate through the resources and check whether the new one exists
-        for(; current != NULL; current = current->next) {
-            // The hash key is generated from Uri
-            if(memcmp(key, current->coap_resource->key, sizeof(key)) == 0) {
-                // Resource already exists
-                return NULL;
-            }
-        }
+    // Check whether the new one exists
+    if(index_lookup(key) != NULL) {
+        // Resource already exists
+        return NULL;
     }
 
     // Resource does not exist, create a new resource object
@@ -202,6 +270,23 @@ STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype,
     // Get ETAG
     resource->etag = etag; // by default it is false
     resource->etag_value = 0; // start with 0, resource_update_value() will update it (0 is incorrect for E-Tag value)
+    // Called by GET requests when the cached value is older than max_age
+    resource->getter = getter;
+    // Notifications to the observers
+    resource->notify_type = notify_type;
+    resource->notify_interval = notify_interval;
+    resource->notify_pending = false;
+
+    // The value buffer is allocated by the first update
+    resource->value = NULL;
+    resource->value_len = 0;
+    resource->value_size = 0;
+
+    // No streaming of the payload by default
+    resource->source = mp_const_none;
+    resource->sink = mp_const_none;
+    resource->block1_next = 0;
+    resource->szx = modcoap_block_szx(MODCOAP_BLOCK_SIZE_DEFAULT);
 
     // No next elem
     resource->next = NULL;
@@ -212,6 +297,8 @@ STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype,
     // Pass COAP_RESOURCE_FLAGS_RELEASE_URI so Coap Library will free up the memory allocated to store the URI when the Resource is deleted
     resource->coap_resource = coap_resource_init(uri_ptr, strlen(uri), COAP_RESOURCE_FLAGS_RELEASE_URI);
     if(resource->coap_resource != NULL) {
+        // Observers can only register to observable resources
+        resource->coap_resource->observable = observable;
         // Add the resource to the Coap context
         coap_add_resource(context->context, resource->coap_resource);
 
@@ -221,20 +308,16 @@ STATIC mod_coap_resource_obj_t* add_resource(const char* uri, uint8_t mediatype,
         }
         // Initialize default value
         resource_update_value(resource, value);
-
-        // Add the resource to our context
-        if(context->resources == NULL) {
-            // No resource exists, add as first element
-            context->resources = resource;
-        }
-        else {
-            mod_coap_resource_obj_t* current = context->resources;
-            // Find the last resource
-            for(; current->next != NULL; current = current->next) {}
-            // Append the new resource to the end of the list
-            current->next = resource;
+        // A resource with a getter fetches its first value on the first GET
+        if(getter != mp_const_none) {
+            resource->updated_ms = mp_hal_ticks_ms() - (resource->max_age + 1) * 1000;
         }
 
+        // Add the resource to our index
+        mod_coap_resource_obj_t** bucket = index_bucket(key);
+        resource->next = *bucket;
+        *bucket = resource;
+
         return resource;
     }
     else {
@@ -254,42 +337,23 @@ STATIC void remove_resource_by_key(coap_key_t key) {
     // Currently only 1 context is supported
     mod_coap_obj_t* context = coap_obj_ptr;
 
-    if(context->resources != NULL) {
-        mod_coap_resource_obj_t* current = context->resources;
-        mod_coap_resource_obj_t* previous = context->resources;
-        for(; current != NULL; current = current->next) {
-
-            // The hash key is generated from Uri
-            if(memcmp(current->coap_resource->key, key, sizeof(coap_key_t)) == 0) {
-                // Resource found, remove from the list
-                // Check if it is the first element in the list
-                if(context->resources == current) {
-                    // If no more element in the list then invalidate the list
-                    if(current->next == NULL) {
-                        context->resources = NULL;
-                    }
-                    // Other elements are in the list
-                    else {
-                        context->resources = current->next;
-                    }
-                }
-                else {
-                    // It is not the first element
-                    previous->next = current->next;
-                }
+    mod_coap_resource_obj_t** link = index_bucket(key);
+    for(; *link != NULL; link = &(*link)->next) {
+        mod_coap_resource_obj_t* current = *link;
 
-                // Free the resource in coap's scope
-                coap_delete_resource(context->context, key);
-                // Free the element in MP scope
-                free(current->value);
-                // Free the resource itself
-                m_del_obj(mod_coap_resource_obj_t, current);
+        // The hash key is generated from Uri
+        if(memcmp(current->coap_resource->key, key, sizeof(coap_key_t)) == 0) {
+            // Resource found, remove from the index
+            *link = current->next;
 
-                return;
-            }
+            // Free the resource in coap's scope
+            coap_delete_resource(context->context, key);
+            // Free the element in MP scope
+            free(current->value);
+            // Free the resource itself
+            m_del_obj(mod_coap_resource_obj_t, current);
 
-            // Mark the current element as previous, needed when removing the actual current element from the list
-            previous = current;
+            return;
         }
     }
 }
@@ -304,8 +368,8 @@ STATIC void remove_resource(const char* uri) {
     remove_resource_by_key(key);
 }
 
-// Update the value of a resource
-STATIC void resource_update_value(mod_coap_resource_obj_t* resource, mp_obj_t new_value) {
+// Store a new value of a resource, its buffer is reused unless the value does not fit
+STATIC void resource_set_value(mod_coap_resource_obj_t* resource, const uint8_t* data, size_t len) {
 
     // If ETAG value is needed then update it
     if(resource->etag == true) {
@@ -318,32 +382,237 @@ STATIC void resource_update_value(mod_coap_resource_obj_t* resource, mp_obj_t ne
 
     // Invalidate current data first
     resource->value_len = 0;
-    free(resource->value);
+
+    if(len > resource->value_size) {
+        size_t size = MAX(len, MODCOAP_VALUE_SIZE_MIN);
+        uint8_t* buf = realloc(resource->value, size);
+        if(buf == NULL) {
+            return;
+        }
+        resource->value = buf;
+        resource->value_size = size;
+    }
+    memcpy(resource->value, data, len);
+    resource->value_len = len;
+    resource->updated_ms = mp_hal_ticks_ms();
+
+    // The observers are notified by resource_check_notify()
+    if(resource->coap_resource->observable) {
+        resource->notify_pending = true;
+    }
+}
+
+// Update the value of a resource
+STATIC void resource_update_value(mod_coap_resource_obj_t* resource, mp_obj_t new_value) {
 
     if (mp_obj_is_integer(new_value)) {
 
         uint32_t value = mp_obj_get_int_truncated(new_value);
-        if (value > 0xFF) {
-            resource->value_len = 2;
-        } else if (value > 0xFFFF) {
-            resource->value_len = 4;
+        size_t len;
+        if (value > 0xFFFF) {
+            len = 4;
+        } else if (value > 0xFF) {
+            len = 2;
         } else {
-            resource->value_len = 1;
+            len = 1;
         }
-
-        // Allocate memory for the new data
-        resource->value = malloc(resource->value_len);
-        memcpy(resource->value, &value, sizeof(value));
+        // Stored in little endian
+        resource_set_value(resource, (const uint8_t*)&value, len);
 
     } else {
 
         mp_buffer_info_t value_bufinfo;
         mp_get_buffer_raise(new_value, &value_bufinfo, MP_BUFFER_READ);
-        resource->value_len = value_bufinfo.len;
+        resource_set_value(resource, value_bufinfo.buf, value_bufinfo.len);
+    }
+}
+
+// Call the getter of the resource if its value is older than max_age, return false if the getter failed
+STATIC bool resource_refresh_value(mod_coap_resource_obj_t* resource) {
+
+    if(resource->getter == mp_const_none || mp_hal_ticks_ms() - resource->updated_ms <= resource->max_age * 1000) {
+        return true;
+    }
+
+    // The getter runs with the semaphore of the context taken, it should only return the new value
+    nlr_buf_t nlr;
+    if(nlr_push(&nlr) == 0) {
+        resource_update_value(resource, mp_call_function_1(resource->getter, resource));
+        nlr_pop();
+        return true;
+    }
+    mp_obj_print_exception(&mp_plat_print, (mp_obj_t)nlr.ret_val);
+    return false;
+}
+
+// Send the notifications of the resources changed, unless one was sent less than notify_interval ago
+// libcoap builds each of them with the GET handler, the semaphore of the context must be taken
+STATIC void resource_check_notify(void) {
+
+    uint32_t now = mp_hal_ticks_ms();
+    bool dirty = false;
+
+    for(int i = 0; i < MODCOAP_INDEX_SIZE; i++) {
+        for(mod_coap_resource_obj_t* current = coap_obj_ptr->index[i]; current != NULL; current = current->next) {
+            if(current->notify_pending && now - current->notified_ms >= current->notify_interval) {
+                current->notify_pending = false;
+                current->notified_ms = now;
+                current->coap_resource->dirty = 1;
+                dirty = true;
+            }
+        }
+    }
+
+    if(dirty) {
+        coap_check_notify(coap_obj_ptr->context);
+    }
+}
+
+// The source may be a file or any object with seek() and read() methods
+STATIC void modcoap_stream_seek(mp_obj_t stream, uint32_t offset) {
+
+    const mp_stream_p_t *stream_p = mp_get_stream(stream);
+    if(stream_p != NULL && stream_p->ioctl != NULL) {
+        int errcode;
+        struct mp_stream_seek_t seek = { .offset = offset, .whence = MP_SEEK_SET };
+        if(stream_p->ioctl(stream, MP_STREAM_SEEK, (uintptr_t)&seek, &errcode) == MP_STREAM_ERROR) {
+            mp_raise_OSError(errcode);
+        }
+    }
+    else {
+        mp_obj_t dest[3];
+        mp_load_method(stream, MP_QSTR_seek, dest);
+        dest[2] = mp_obj_new_int_from_uint(offset);
+        mp_call_method_n_kw(1, 0, dest);
+    }
+}
+
+STATIC size_t modcoap_stream_read(mp_obj_t stream, uint8_t* buf, size_t len) {
+
+    const mp_stream_p_t *stream_p = mp_get_stream(stream);
+    if(stream_p != NULL && stream_p->read != NULL) {
+        int errcode;
+        mp_uint_t n = mp_stream_read_exactly(stream, buf, len, &errcode);
+        if(errcode != 0) {
+            mp_raise_OSError(errcode);
+        }
+        return n;
+    }
+    mp_obj_t dest[3];
+    mp_load_method(stream, MP_QSTR_read, dest);
+    dest[2] = mp_obj_new_int_from_uint(len);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(mp_call_method_n_kw(1, 0, dest), &bufinfo, MP_BUFFER_READ);
+    len = MIN(len, bufinfo.len);
+    memcpy(buf, bufinfo.buf, len);
+    return len;
+}
 
-        // Allocate memory for the new data
-        resource->value = malloc(resource->value_len);
-        memcpy(resource->value, value_bufinfo.buf, resource->value_len);
+// The sink may be a file or any object with a write() method, e.g. one passing the blocks to pycom.ota_write()
+STATIC void modcoap_stream_write(mp_obj_t stream, const uint8_t* buf, size_t len) {
+
+    const mp_stream_p_t *stream_p = mp_get_stream(stream);
+    if(stream_p != NULL && stream_p->write != NULL) {
+        int errcode;
+        mp_stream_write_exactly(stream, buf, len, &errcode);
+        if(errcode != 0) {
+            mp_raise_OSError(errcode);
+        }
+    }
+    else {
+        mp_obj_t dest[3];
+        mp_load_method(stream, MP_QSTR_write, dest);
+        dest[2] = mp_obj_new_bytes(buf, len);
+        mp_call_method_n_kw(1, 0, dest);
+    }
+}
+
+// Called after the last block if the sink has a flush() method, e.g. to finish the update written to it
+STATIC void modcoap_stream_flush(mp_obj_t stream) {
+
+    mp_obj_t dest[2];
+    mp_load_method_maybe(stream, MP_QSTR_flush, dest);
+    if(dest[0] != MP_OBJ_NULL) {
+        mp_call_method_n_kw(0, 0, dest);
+    }
+}
+
+// Read the block num of the source and 1 byte more to find out whether it is the last one
+// The buffer is allocated from the MicroPython heap, the exceptions of the source are raised
+STATIC uint8_t* modcoap_read_block(mp_obj_t source, uint32_t num, uint8_t szx, size_t* len, bool* more) {
+
+    size_t size = MODCOAP_BLOCK_SIZE(szx);
+    uint8_t* buf = m_new(uint8_t, size + 1);
+    modcoap_stream_seek(source, num * size);
+    *len = modcoap_stream_read(source, buf, size + 1);
+    *more = *len > size;
+    *len = MIN(*len, size);
+    return buf;
+}
+
+// Get the value of the Block1 or Block2 option of a message, false if it has none
+STATIC bool modcoap_get_block_opt(coap_pdu_t* pdu, unsigned short type, uint32_t* value) {
+
+    coap_opt_iterator_t opt_it;
+    coap_opt_t *opt = coap_check_option(pdu, type, &opt_it);
+    if(opt == NULL) {
+        return false;
+    }
+    *value = coap_decode_var_bytes(coap_opt_value(opt), coap_opt_length(opt));
+    return true;
+}
+
+// Write the payload of a PUT or POST to the sink of the resource, block by block if it comes with the Block1 option
+// The blocks are written as they arrive, so the whole payload is never held in memory
+STATIC void resource_sink_data(mod_coap_resource_obj_t* resource, coap_pdu_t* request, coap_pdu_t* response) {
+
+    size_t size = 0;
+    unsigned char *data = NULL;
+    if(coap_get_data(request, &size, &data) != 1) {
+        size = 0;
+    }
+
+    uint32_t block1 = 0;
+    bool blockwise = modcoap_get_block_opt(request, COAP_OPTION_BLOCK1, &block1);
+    uint32_t num = MODCOAP_BLOCK_NUM(block1);
+    bool more = blockwise && MODCOAP_BLOCK_M(block1);
+
+    if(blockwise && num + 1 == resource->block1_next) {
+        // The block was already written, this is a retransmission which is acknowledged again
+    }
+    else if(blockwise && num != 0 && num != resource->block1_next) {
+        // 4.08 Request Entity Incomplete: a block is missing, the client has to start again
+        response->hdr->code = COAP_RESPONSE_CODE(408);
+        const char* error_message = coap_response_phrase(response->hdr->code);
+        coap_add_data(response, strlen(error_message), (unsigned char *)error_message);
+        return;
+    }
+    else {
+        nlr_buf_t nlr;
+        if(nlr_push(&nlr) == 0) {
+            modcoap_stream_write(resource->sink, data, size);
+            if(more == false) {
+                modcoap_stream_flush(resource->sink);
+            }
+            nlr_pop();
+        }
+        else {
+            mp_obj_print_exception(&mp_plat_print, (mp_obj_t)nlr.ret_val);
+            resource->block1_next = 0;
+            // 5.00 Internal Server error occurred
+            response->hdr->code = COAP_RESPONSE_CODE(500);
+            const char* error_message = coap_response_phrase(response->hdr->code);
+            coap_add_data(response, strlen(error_message), (unsigned char *)error_message);
+            return;
+        }
+        resource->block1_next = more ? num + 1 : 0;
+    }
+
+    // 2.31 Continue asks for the next block, the sizes of the blocks of the client are accepted as they are
+    response->hdr->code = more ? COAP_RESPONSE_CODE(231) : COAP_RESPONSE_CODE(204);
+    if(blockwise) {
+        unsigned char buf[3];
+        coap_add_option(response, COAP_OPTION_BLOCK1, coap_encode_var_bytes(buf, block1), buf);
     }
 }
 
@@ -363,8 +632,22 @@ STATIC void coap_resource_callback_get(coap_context_t * context,
     // Check if the resource exists. (e.g.: has not been removed in the background before we got the semaphore in mod_coap_read())
     if(resource_obj != NULL) {
 
+        // Notifications to the observers are built without request
+        if(request == NULL) {
+            response->hdr->code = COAP_RESPONSE_CODE(205);
+        }
+
+        // Only a cached value that expired is fetched again
+        if(resource_refresh_value(resource_obj) == false) {
+            // 5.00 Internal Server error occurred
+            response->hdr->code = COAP_RESPONSE_CODE(500);
+            const char* error_message = coap_response_phrase(response->hdr->code);
+            coap_add_data(response, strlen(error_message), (unsigned char *)error_message);
+            return;
+        }
+
         // Check if media type of the resource is given
-        if(resource_obj->mediatype != -1) {
+        if(resource_obj->mediatype != -1 && request != NULL) {
             coap_opt_iterator_t opt_it;
             // Need to check if ACCEPT option is specified and we can serve it
             coap_opt_t *opt = coap_check_option(request, COAP_OPTION_ACCEPT, &opt_it);
@@ -388,11 +671,44 @@ STATIC void coap_resource_callback_get(coap_context_t * context,
             }
         }
 
+        // A resource with a source serves the block asked by the Block2 option, the first one without it
+        // The block is read before anything is added to the response
+        uint8_t* block = NULL;
+        size_t block_len = 0;
+        uint32_t block2 = 0;
+        bool add_block2 = false;
+        uint8_t szx = resource_obj->szx;
+        if(resource_obj->source != mp_const_none) {
+            if(request != NULL && modcoap_get_block_opt(request, COAP_OPTION_BLOCK2, &block2)) {
+                add_block2 = true;
+                // The smaller of the 2 sizes is used
+                szx = MIN(szx, MODCOAP_BLOCK_SZX(block2));
+            }
+            uint32_t num = MODCOAP_BLOCK_NUM(block2);
+            bool more = false;
+
+            nlr_buf_t nlr;
+            if(nlr_push(&nlr) == 0) {
+                block = modcoap_read_block(resource_obj->source, num, szx, &block_len, &more);
+                nlr_pop();
+            }
+            else {
+                mp_obj_print_exception(&mp_plat_print, (mp_obj_t)nlr.ret_val);
+                // 5.00 Internal Server error occurred
+                response->hdr->code = COAP_RESPONSE_CODE(500);
+                const char* error_message = coap_response_phrase(response->hdr->code);
+                coap_add_data(response, strlen(error_message), (unsigned char *)error_message);
+                return;
+            }
+            block2 = MODCOAP_BLOCK_VALUE(num, more, szx);
+            add_block2 |= more;
+        }
+
         // If no ETAG option is specified in the request than the response code will be 205
         response->hdr->code = COAP_RESPONSE_CODE(205);
 
         // Check if ETAG value is maintained for the resource
-        if(resource_obj->etag == true) {
+        if(resource_obj->etag == true && request != NULL) {
 
             coap_opt_iterator_t opt_it;
             // Need to check if E-TAG option is specified and we can serve it
@@ -415,13 +731,46 @@ STATIC void coap_resource_callback_get(coap_context_t * context,
             }
         }
 
-        // Add the options if configured
+        // Register or deregister the observer, the observer is then notified with calls of this handler without request
+        bool observe = false;
+        if(resource->observable && request != NULL) {
+            coap_opt_iterator_t opt_it;
+            coap_opt_t *opt = coap_check_option(request, COAP_OPTION_OBSERVE, &opt_it);
+            if(opt != NULL) {
+                if(coap_decode_var_bytes(coap_opt_value(opt), coap_opt_length(opt)) == MODCOAP_OBSERVE_REGISTER) {
+                    coap_subscription_t* subscription = coap_add_observer(resource, endpoint, address, token);
+                    if(subscription != NULL) {
+                        if(resource_obj->notify_type == -1) {
+                            subscription->non = request->hdr->type == COAP_MESSAGE_NON;
+                        }
+                        else {
+                            // libcoap still sends every COAP_OBS_MAX_NON-th notification as confirmable to find out whether the observer is alive
+                            subscription->non = resource_obj->notify_type == COAP_MESSAGE_NON;
+                        }
+                        observe = true;
+                    }
+                }
+                else {
+                    coap_delete_observer(resource, address, token);
+                }
+            }
+        }
+        else if(request == NULL) {
+            observe = true;
+        }
+
+        // Add the options if configured, in the order of their numbers
         unsigned char buf[3];
 
         if(resource_obj->etag == true) {
             coap_add_option(response, COAP_OPTION_ETAG, coap_encode_var_bytes(buf, resource_obj->etag_value), buf);
         }
 
+        if(observe == true) {
+            // The sequence number of the notifications is maintained by libcoap
+            coap_add_option(response, COAP_OPTION_OBSERVE, coap_encode_var_bytes(buf, context->observe), buf);
+        }
+
         if(resource_obj->mediatype != -1) {
             coap_add_option(response, COAP_OPTION_CONTENT_TYPE, coap_encode_var_bytes(buf, resource_obj->mediatype), buf);
         }
@@ -430,9 +779,22 @@ STATIC void coap_resource_callback_get(coap_context_t * context,
             coap_add_option(response, COAP_OPTION_MAXAGE, coap_encode_var_bytes(buf, resource_obj->max_age), buf);
         }
 
+        if(add_block2 == true) {
+            coap_add_option(response, COAP_OPTION_BLOCK2, coap_encode_var_bytes(buf, block2), buf);
+        }
+
         // Add the data itself if updated
         if(response->hdr->code == COAP_RESPONSE_CODE(205)) {
-            coap_add_data(response, resource_obj->value_len, (unsigned char *)resource_obj->value);
+            if(block != NULL) {
+                coap_add_data(response, block_len, block);
+            }
+            else {
+                coap_add_data(response, resource_obj->value_len, (unsigned char *)resource_obj->value);
+            }
+        }
+
+        if(block != NULL) {
+            m_del(uint8_t, block, MODCOAP_BLOCK_SIZE(szx) + 1);
         }
     }
     else {
@@ -518,13 +880,16 @@ STATIC void coap_resource_callback_put(coap_context_t * context,
                 resource_obj->mediatype = -1;
             }
 
-            // Update the data and set response code and add E-Tag option if needed
+            // The payload of a resource with a sink is streamed into it
             size_t size;
             unsigned char *data;
             int ret = coap_get_data(request, &size, &data);
-            if(ret == 1) {
-                mp_obj_t new_value = mp_obj_new_str((const char*)data, size);
-                resource_update_value(resource_obj, new_value);
+            if(resource_obj->sink != mp_const_none) {
+                resource_sink_data(resource_obj, request, response);
+            }
+            // Update the data and set response code and add E-Tag option if needed
+            else if(ret == 1) {
+                resource_set_value(resource_obj, data, size);
 
                 // Value is updated
                 response->hdr->code = COAP_RESPONSE_CODE(204);
@@ -600,13 +965,16 @@ STATIC void coap_resource_callback_post(coap_context_t * context,
             resource_obj->mediatype = -1;
         }
 
-        // Update the data and set response code and add E-Tag option if needed
+        // The payload of a resource with a sink is streamed into it
         size_t size;
         unsigned char *data;
         int ret = coap_get_data(request, &size, &data);
-        if(ret == 1) {
-            mp_obj_t new_value = mp_obj_new_str((const char*)data, size);
-            resource_update_value(resource_obj, new_value);
+        if(resource_obj->sink != mp_const_none) {
+            resource_sink_data(resource_obj, request, response);
+        }
+        // Update the data and set response code and add E-Tag option if needed
+        else if(ret == 1) {
+            resource_set_value(resource_obj, data, size);
 
             // Value is updated
             response->hdr->code = COAP_RESPONSE_CODE(204);
@@ -663,11 +1031,20 @@ STATIC void coap_response_handler(struct coap_context_t * context,
                                     const coap_tid_t id)
 {
 
-    size_t len;
-    unsigned char *databuf;
+    size_t len = 0;
+    unsigned char *databuf = NULL;
     int ret = coap_get_data(received, &len, &databuf);
+    if(ret != 1) {
+        len = 0;
+    }
+
+    // The responses of a block-wise request are consumed by its transfer until the last one
+    mod_coap_transfer_result_t result = modcoap_transfer_next(received, databuf, &len);
+    if(result == MODCOAP_TRANSFER_MORE) {
+        return;
+    }
 
-    if(ret == 1){
+    if((ret == 1 || result != MODCOAP_TRANSFER_NONE) && coap_obj_ptr->callback != mp_const_none){
 
         mp_obj_t args[5];
         args[0] = mp_obj_new_int(received->hdr->code);
@@ -758,6 +1135,135 @@ STATIC coap_list_t * modcoap_new_option_node(unsigned short key, unsigned int le
     return node;
 }
 
+// Get the szx of a block size given from MicroPython
+STATIC uint8_t modcoap_block_szx(mp_int_t size) {
+
+    for(uint8_t szx = 0; szx <= MODCOAP_BLOCK_SZX_MAX; szx++) {
+        if(MODCOAP_BLOCK_SIZE(szx) == size) {
+            return szx;
+        }
+    }
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid \"block_size\" parameter value!"));
+}
+
+// Drop the block-wise request of the client
+STATIC void modcoap_transfer_end(void) {
+
+    mod_coap_transfer_t* transfer = &coap_obj_ptr->transfer;
+
+    struct coap_list_t *next;
+    while(transfer->optlist != NULL) {
+        next = transfer->optlist->next;
+        free(transfer->optlist);
+        transfer->optlist = next;
+    }
+    transfer->source = MP_OBJ_NULL;
+    transfer->sink = MP_OBJ_NULL;
+    transfer->active = false;
+}
+
+// Send the current block of the transfer: the block of the source with Block1, or a GET asking for it with Block2
+// The exceptions of the source are raised
+STATIC coap_tid_t modcoap_transfer_send(void) {
+
+    mod_coap_transfer_t* transfer = &coap_obj_ptr->transfer;
+
+    uint8_t* block = NULL;
+    size_t len = 0;
+    bool more = false;
+    unsigned short type = COAP_OPTION_BLOCK2;
+    if(transfer->source != MP_OBJ_NULL) {
+        block = modcoap_read_block(transfer->source, transfer->num, transfer->szx, &len, &more);
+        type = COAP_OPTION_BLOCK1;
+    }
+
+    // The options of the request are sent again with the block option of this block
+    unsigned char buf[3];
+    coap_pdu_t *pdu = NULL;
+    coap_list_t *node = modcoap_new_option_node(type, coap_encode_var_bytes(buf, MODCOAP_BLOCK_VALUE(transfer->num, more, transfer->szx)), buf);
+    if(node != NULL) {
+        LL_APPEND(transfer->optlist, node);
+        pdu = modcoap_new_request(coap_obj_ptr->context, transfer->method, &transfer->optlist,
+                                  (const char*)transfer->token, transfer->token_length, (const char*)block, len);
+        LL_DELETE(transfer->optlist, node);
+        free(node);
+    }
+
+    if(block != NULL) {
+        m_del(uint8_t, block, MODCOAP_BLOCK_SIZE(transfer->szx) + 1);
+    }
+
+    if(pdu == NULL) {
+        return COAP_INVALID_TID;
+    }
+
+    transfer->activity_ms = mp_hal_ticks_ms();
+    return coap_send_confirmed(coap_obj_ptr->context, coap_obj_ptr->context->endpoint, &transfer->address, pdu);
+}
+
+// Continue the transfer with the response if it belongs to it
+// The payload written to the sink is not passed to the callback, *len is set to 0 then
+STATIC mod_coap_transfer_result_t modcoap_transfer_next(coap_pdu_t* received, const uint8_t* data, size_t* len) {
+
+    mod_coap_transfer_t* transfer = &coap_obj_ptr->transfer;
+
+    // The responses are matched by the token
+    if(transfer->active == false || received->hdr->token_length != transfer->token_length ||
+       memcmp(received->hdr->token, transfer->token, transfer->token_length) != 0) {
+        return MODCOAP_TRANSFER_NONE;
+    }
+
+    bool next = false;
+    uint32_t block = 0;
+    mod_coap_transfer_result_t result = MODCOAP_TRANSFER_END;
+
+    nlr_buf_t nlr;
+    if(nlr_push(&nlr) == 0) {
+        if(transfer->source != MP_OBJ_NULL) {
+            // 2.31 Continue asks for the next block, in the size of the server if it is smaller
+            if(received->hdr->code == COAP_RESPONSE_CODE(231) && modcoap_get_block_opt(received, COAP_OPTION_BLOCK1, &block)) {
+                uint32_t offset = (transfer->num + 1) * MODCOAP_BLOCK_SIZE(transfer->szx);
+                transfer->szx = MIN(transfer->szx, MODCOAP_BLOCK_SZX(block));
+                transfer->num = offset / MODCOAP_BLOCK_SIZE(transfer->szx);
+                next = true;
+            }
+        }
+        else if(COAP_RESPONSE_CLASS(received->hdr->code) == 2) {
+            // Without Block2 option the server sent the whole payload at once
+            if(modcoap_get_block_opt(received, COAP_OPTION_BLOCK2, &block)) {
+                next = MODCOAP_BLOCK_M(block);
+                // The server may send smaller blocks than asked, the next ones are asked in its size
+                transfer->szx = MIN(MODCOAP_BLOCK_SZX(block), MODCOAP_BLOCK_SZX_MAX);
+                transfer->num = MODCOAP_BLOCK_NUM(block) + 1;
+            }
+            if(transfer->sink != MP_OBJ_NULL) {
+                modcoap_stream_write(transfer->sink, data, *len);
+                *len = 0;
+                if(next == false) {
+                    modcoap_stream_flush(transfer->sink);
+                }
+            }
+        }
+
+        if(next == true) {
+            if(modcoap_transfer_send() != COAP_INVALID_TID) {
+                // Without sink the blocks are passed to the callback as they arrive
+                result = (transfer->sink != MP_OBJ_NULL || transfer->source != MP_OBJ_NULL) ? MODCOAP_TRANSFER_MORE : MODCOAP_TRANSFER_DATA;
+            }
+        }
+        nlr_pop();
+    }
+    else {
+        mp_obj_print_exception(&mp_plat_print, (mp_obj_t)nlr.ret_val);
+        *len = 0;
+    }
+
+    if(result == MODCOAP_TRANSFER_END) {
+        modcoap_transfer_end();
+    }
+    return result;
+}
+
 /******************************************************************************
  DEFINE COAP RESOURCE CLASS FUNCTIONS
  ******************************************************************************/
@@ -801,6 +1307,8 @@ STATIC mp_obj_t mod_coap_resource_value(mp_uint_t n_args, const mp_obj_t *args)
         } else {
             // set
             resource_update_value(self, (mp_obj_t)args[1]);
+            // The observers are notified right away
+            resource_check_notify();
         }
     }
     xSemaphoreGive(coap_obj_ptr->semphr);
@@ -935,9 +1443,14 @@ STATIC mp_obj_t mod_coap_init(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map
         MP_STATE_PORT(coap_ptr) = m_new_obj(mod_coap_obj_t);
         coap_obj_ptr = MP_STATE_PORT(coap_ptr);
         coap_obj_ptr->context = NULL;
-        coap_obj_ptr->resources = NULL;
+        memset(coap_obj_ptr->index, 0, sizeof(coap_obj_ptr->index));
         coap_obj_ptr->socket = NULL;
         coap_obj_ptr->semphr = NULL;
+        coap_obj_ptr->callback = mp_const_none;
+        coap_obj_ptr->optlist = NULL;
+        memset(&coap_obj_ptr->transfer, 0, sizeof(coap_obj_ptr->transfer));
+        coap_obj_ptr->transfer.source = MP_OBJ_NULL;
+        coap_obj_ptr->transfer.sink = MP_OBJ_NULL;
 
         mp_arg_val_t args[MP_ARRAY_SIZE(mod_coap_init_args)];
         mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(args), mod_coap_init_args, args);
@@ -952,6 +1465,9 @@ STATIC mp_obj_t mod_coap_init(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map
 
         mod_coap_init_helper(list, service_discovery);
 
+        // The blocks of the block-wise requests are handled even without callback
+        coap_register_response_handler(coap_obj_ptr->context, coap_response_handler);
+
         coap_obj_ptr->semphr = xSemaphoreCreateBinary();
         xSemaphoreGive(coap_obj_ptr->semphr);
 
@@ -988,6 +1504,13 @@ STATIC const mp_arg_t mod_coap_add_resource_args[] = {
         { MP_QSTR_max_age,                  MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = -1}},
         { MP_QSTR_value,                    MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
         { MP_QSTR_etag,                     MP_ARG_KW_ONLY  | MP_ARG_BOOL,{.u_bool = false}},
+        { MP_QSTR_getter,                   MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        { MP_QSTR_observable,               MP_ARG_KW_ONLY  | MP_ARG_BOOL,{.u_bool = false}},
+        { MP_QSTR_notify_type,              MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        { MP_QSTR_notify_interval,          MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0}},
+        { MP_QSTR_source,                   MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        { MP_QSTR_sink,                     MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        { MP_QSTR_block_size,               MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = MODCOAP_BLOCK_SIZE_DEFAULT}},
 };
 
 // Add a new resource to the context if not exists
@@ -996,12 +1519,31 @@ STATIC mp_obj_t mod_coap_add_resource(mp_uint_t n_args, const mp_obj_t *pos_args
     // The Coap module should have been already initialized
     if(initialized == true) {
 
-        xSemaphoreTake(coap_obj_ptr->semphr, portMAX_DELAY);
-
         mp_arg_val_t args[MP_ARRAY_SIZE(mod_coap_add_resource_args)];
         mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(args), mod_coap_add_resource_args, args);
 
-        mod_coap_resource_obj_t* res = add_resource(mp_obj_str_get_str(args[0].u_obj), args[1].u_int, args[2].u_int, args[3].u_obj, args[4].u_bool);
+        int8_t notify_type = -1;
+        if(args[7].u_obj != mp_const_none) {
+            notify_type = mp_obj_get_int(args[7].u_obj);
+            if(notify_type != COAP_MESSAGE_CON && notify_type != COAP_MESSAGE_NON) {
+                mp_raise_ValueError(mpexception_value_invalid_arguments);
+            }
+        }
+        if(args[8].u_int < 0) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        uint8_t szx = modcoap_block_szx(args[11].u_int);
+
+        xSemaphoreTake(coap_obj_ptr->semphr, portMAX_DELAY);
+
+        mod_coap_resource_obj_t* res = add_resource(mp_obj_str_get_str(args[0].u_obj), args[1].u_int, args[2].u_int, args[3].u_obj, args[4].u_bool, args[5].u_obj,
+                                                    args[6].u_bool, notify_type, args[8].u_int);
+        // GET is served from the source and PUT and POST are written to the sink in blocks of block_size
+        if(res != NULL) {
+            res->source = args[9].u_obj;
+            res->sink = args[10].u_obj;
+            res->szx = szx;
+        }
 
         xSemaphoreGive(coap_obj_ptr->semphr);
 
@@ -1069,6 +1611,8 @@ STATIC mp_obj_t mod_coap_read(void) {
         // Take the context's semaphore to avoid concurrent access, this will guard the handler functions too
         xSemaphoreTake(coap_obj_ptr->semphr, portMAX_DELAY);
         coap_read(coap_obj_ptr->context);
+        // Notify the observers of the resources changed by the requests or rate limited before
+        resource_check_notify();
         xSemaphoreGive(coap_obj_ptr->semphr);
     }
     else {
@@ -1107,7 +1651,11 @@ STATIC const mp_arg_t mod_coap_send_request_args[] = {
         { MP_QSTR_content_format,           MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = -1}},
         { MP_QSTR_payload,                  MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
         { MP_QSTR_token,                    MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
-        { MP_QSTR_include_options,          MP_ARG_KW_ONLY  | MP_ARG_BOOL,{.u_bool = true}}
+        { MP_QSTR_include_options,          MP_ARG_KW_ONLY  | MP_ARG_BOOL,{.u_bool = true}},
+        { MP_QSTR_observe,                  MP_ARG_KW_ONLY  | MP_ARG_BOOL,{.u_bool = false}},
+        { MP_QSTR_block_size,               MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        { MP_QSTR_source,                   MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        { MP_QSTR_sink,                     MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none}},
 };
 
 
@@ -1190,6 +1738,33 @@ STATIC mp_obj_t mod_coap_send_request(mp_uint_t n_args, const mp_obj_t *pos_args
         // Get the include_options parameter
         bool include_options = args[7].u_bool;
 
+        // Get the observe parameter
+        bool observe = args[8].u_bool;
+
+        // A PUT or POST with a source is sent with Block1, a GET with a block size or a sink is received with Block2
+        mp_obj_t source = args[10].u_obj;
+        mp_obj_t sink = args[11].u_obj;
+        bool blockwise = (args[9].u_obj != mp_const_none || source != mp_const_none || sink != mp_const_none);
+        uint8_t szx = modcoap_block_szx(args[9].u_obj != mp_const_none ? mp_obj_get_int(args[9].u_obj) : MODCOAP_BLOCK_SIZE_DEFAULT);
+        if(blockwise == true) {
+            if(method == COAP_REQUEST_GET) {
+                if(source != mp_const_none) {
+                    nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid \"source\" parameter value!"));
+                }
+            }
+            else if(method == COAP_REQUEST_PUT || method == COAP_REQUEST_POST) {
+                if(source == mp_const_none || payload != NULL || sink != mp_const_none) {
+                    nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid \"source\" parameter value!"));
+                }
+            }
+            else {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid \"method\" parameter value!"));
+            }
+            if(token_length > sizeof(coap_obj_ptr->transfer.token)) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid \"token\" parameter value!"));
+            }
+        }
+
         mp_obj_t address = mp_obj_new_list(0, NULL);
         // Get the address as a string
         mp_obj_list_append(address, mp_obj_new_str((const char*)coap_uri.host.s, coap_uri.host.length));
@@ -1208,6 +1783,15 @@ STATIC mp_obj_t mod_coap_send_request(mp_uint_t n_args, const mp_obj_t *pos_args
         // Take the context's semaphore to avoid concurrent access
         xSemaphoreTake(coap_obj_ptr->semphr, portMAX_DELAY);
 
+        // Only 1 block-wise request at a time, one not answered for long is dropped
+        if(blockwise == true && coap_obj_ptr->transfer.active == true) {
+            if(mp_hal_ticks_ms() - coap_obj_ptr->transfer.activity_ms < MODCOAP_TRANSFER_TIMEOUT_MS) {
+                xSemaphoreGive(coap_obj_ptr->semphr);
+                mp_raise_OSError(MP_EBUSY);
+            }
+            modcoap_transfer_end();
+        }
+
         if(include_options == true) {
 
             // Put the URI-HOST as an option
@@ -1260,6 +1844,67 @@ STATIC mp_obj_t mod_coap_send_request(mp_uint_t n_args, const mp_obj_t *pos_args
             }
         }
 
+        // Register to the notifications of the resource
+        if(observe == true) {
+            unsigned char observe_buf[1];
+            // The value 0 (register) is encoded with length 0
+            coap_list_t * node = modcoap_new_option_node(COAP_OPTION_OBSERVE, 0, observe_buf);
+            if(node != NULL) {
+                LL_APPEND(coap_obj_ptr->optlist, node);
+            }
+        }
+
+        if(blockwise == true) {
+            mod_coap_transfer_t* transfer = &coap_obj_ptr->transfer;
+
+            // The options are kept to be sent with every block
+            transfer->optlist = coap_obj_ptr->optlist;
+            coap_obj_ptr->optlist = NULL;
+            transfer->source = (source != mp_const_none) ? source : MP_OBJ_NULL;
+            transfer->sink = (sink != mp_const_none) ? sink : MP_OBJ_NULL;
+            transfer->address = dst_address;
+            transfer->method = method;
+            transfer->num = 0;
+            transfer->szx = szx;
+            // The responses are matched by the token, a request without one gets the message id as token
+            if(token_length > 0) {
+                memcpy(transfer->token, token, token_length);
+                transfer->token_length = token_length;
+            }
+            else {
+                uint16_t message_id = coap_obj_ptr->context->message_id + 1;
+                memcpy(transfer->token, &message_id, sizeof(message_id));
+                transfer->token_length = sizeof(message_id);
+            }
+            transfer->active = true;
+
+            coap_tid_t ret = COAP_INVALID_TID;
+            nlr_buf_t nlr;
+            if(nlr_push(&nlr) == 0) {
+                ret = modcoap_transfer_send();
+                nlr_pop();
+            }
+            else {
+                // The source could not be read
+                modcoap_transfer_end();
+                xSemaphoreGive(coap_obj_ptr->semphr);
+                nlr_jump(nlr.ret_val);
+            }
+
+            if(ret == COAP_INVALID_TID) {
+                modcoap_transfer_end();
+                xSemaphoreGive(coap_obj_ptr->semphr);
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Sending message failed!"));
+            }
+
+            // The message ID of the first block, as it is in the header
+            mp_obj_t id = mp_obj_new_int(htons(coap_obj_ptr->context->message_id));
+
+            xSemaphoreGive(coap_obj_ptr->semphr);
+
+            return id;
+        }
+
         // Create new request
         coap_pdu_t *pdu = modcoap_new_request(coap_obj_ptr->context, method, &coap_obj_ptr->optlist, token, token_length, payload, payload_length);
 
@@ -1331,6 +1976,8 @@ STATIC const mp_map_elem_t mod_coap_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_REQUEST_PUT),                     MP_OBJ_NEW_SMALL_INT(MODCOAP_REQUEST_PUT) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_REQUEST_POST),                    MP_OBJ_NEW_SMALL_INT(MODCOAP_REQUEST_POST) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_REQUEST_DELETE),                  MP_OBJ_NEW_SMALL_INT(MODCOAP_REQUEST_DELETE) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_MESSAGE_CON),                     MP_OBJ_NEW_SMALL_INT(COAP_MESSAGE_CON) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_MESSAGE_NON),                     MP_OBJ_NEW_SMALL_INT(COAP_MESSAGE_NON) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_MEDIATYPE_TEXT_PLAIN),            MP_OBJ_NEW_SMALL_INT(COAP_MEDIATYPE_TEXT_PLAIN) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_MEDIATYPE_APP_LINK_FORMAT),       MP_OBJ_NEW_SMALL_INT(COAP_MEDIATYPE_APPLICATION_LINK_FORMAT) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_MEDIATYPE_APP_XML),               MP_OBJ_NEW_SMALL_INT(COAP_MEDIATYPE_APPLICATION_XML) },
@@ -48,6 +48,9 @@
 #include "esp32chipinfo.h"
 #include "app_sys_evt.h"
 
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+
 /*****************************************************************************
 * DEFINE CONSTANTS
 *****************************************************************************/
@@ -55,6 +58,7 @@
 #define ETHERNET_TASK_PRIORITY          24 // 12
 #define ETHERNET_CHECK_LINK_PERIOD_MS   2000
 #define ETHERNET_CMD_QUEUE_SIZE         100
+#define ETHERNET_RX_BATCH_SIZE          16 // frames read from the chip per locked section
 
 //EVENT bits
 #define ETHERNET_EVT_CONNECTED        0x0001
@@ -89,7 +93,16 @@ eth_obj_t DRAM_ATTR eth_obj = {
         .handler_arg = NULL
 };
 
+// only the frames there is no pbuf for are read into it, to be dropped
 static uint8_t* modeth_rxBuff = NULL;
+static struct {
+    uint32_t rx_frames;
+    uint32_t rx_bytes;
+    uint32_t rx_dropped;
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    uint32_t tx_dropped;
+} modeth_stats;
 #if defined(FIPY) || defined(GPY)
 // Variable saving DNS info
 static tcpip_adapter_dns_info_t eth_sta_inf_dns_info;
@@ -220,6 +233,10 @@ static void process_tx(uint8_t* buff, uint16_t len)
         ksz8851BeginPacketSend(len);
         ksz8851SendPacketData(buff, len);
         ksz8851EndPacketSend();
+        modeth_stats.tx_frames++;
+        modeth_stats.tx_bytes += len;
+    } else {
+        modeth_stats.tx_dropped++;
     }
 
     // re-enable int
@@ -230,40 +247,68 @@ static void process_tx(uint8_t* buff, uint16_t len)
 
 static uint32_t process_rx(void)
 {
-    uint32_t len, frameCnt;
+    struct pbuf *batch[ETHERNET_RX_BATCH_SIZE];
+    uint32_t batchLen[ETHERNET_RX_BATCH_SIZE];
+    struct netif *netif = NULL;
+    uint32_t len = 0, frameCnt;
     uint32_t totalLen = 0;
 
+    if (ESP_OK != tcpip_adapter_get_netif(TCPIP_ADAPTER_IF_ETH, (void **)&netif) || netif == NULL || !netif_is_up(netif)) {
+        netif = NULL;
+    }
+
     // disable int before reading buffer
     portDISABLE_INTERRUPTS();
-    //ksz8851_regwr(REG_INT_MASK, 0);
-
     frameCnt = (ksz8851_regrd(REG_RX_FRAME_CNT_THRES) & RX_FRAME_CNT_MASK) >> 8;
+    portENABLE_INTERRUPTS();
+
     uint32_t frameCntTotal = frameCnt;
     uint32_t frameCntZeroLen = 0;
     while (frameCnt > 0)
     {
-        ksz8851RetrievePacketData(modeth_rxBuff, &len, frameCnt, frameCntTotal);
-        if(len)
-        {
-            totalLen += len;
-            tcpip_adapter_eth_input(modeth_rxBuff, len, NULL);
-        } else {
-            frameCntZeroLen++;
+        uint32_t batchCnt = MIN(frameCnt, ETHERNET_RX_BATCH_SIZE);
+
+        // the frames are read straight into the pbufs passed to lwIP, allocate them before locking
+        for (uint32_t i = 0; i < batchCnt; i++) {
+            batch[i] = netif ? pbuf_alloc(PBUF_RAW, ETHERNET_RX_PACKET_BUFF_SIZE, PBUF_RAM) : NULL;
         }
-        frameCnt--;
-    }
 
-    // re-enable int
-    //ksz8851_regwr(REG_INT_MASK, INT_MASK);
-    portENABLE_INTERRUPTS();
+        portDISABLE_INTERRUPTS();
+        for (uint32_t i = 0; i < batchCnt; i++) {
+            // a frame without pbuf still has to be read out of the chip
+            ksz8851RetrievePacketData(batch[i] ? batch[i]->payload : modeth_rxBuff, &batchLen[i], frameCnt, frameCntTotal);
+            frameCnt--;
+        }
+        portENABLE_INTERRUPTS();
 
-    MSG("process_rx frames=%u (zero=%u) totalLen=%u last: len=%u \n", frameCntTotal, frameCntZeroLen, totalLen, len);
+        for (uint32_t i = 0; i < batchCnt; i++) {
+            len = batchLen[i];
+            if (!len) {
+                frameCntZeroLen++;
+            } else if (batch[i]) {
 #ifdef DEBUG_MODETH
-    if (frameCntTotal){
-        // print last frame
-        print_frame(modeth_rxBuff, len);
-    }
+                print_frame(batch[i]->payload, len);
 #endif
+                pbuf_realloc(batch[i], len);
+                // from here on lwIP owns the pbuf
+                if (netif->input(batch[i], netif) == ERR_OK) {
+                    batch[i] = NULL;
+                    totalLen += len;
+                    modeth_stats.rx_frames++;
+                    modeth_stats.rx_bytes += len;
+                } else {
+                    modeth_stats.rx_dropped++;
+                }
+            } else {
+                modeth_stats.rx_dropped++;
+            }
+            if (batch[i]) {
+                pbuf_free(batch[i]);
+            }
+        }
+    }
+
+    MSG("process_rx frames=%u (zero=%u) totalLen=%u last: len=%u \n", frameCntTotal, frameCntZeroLen, totalLen, len);
 
     return totalLen;
 }
@@ -744,6 +789,20 @@ STATIC mp_obj_t modeth_isconnected(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(modeth_isconnected_obj, modeth_isconnected);
 
+/// \method stats()
+/// Returns (rx_frames, rx_bytes, rx_dropped, tx_frames, tx_bytes, tx_dropped).
+STATIC mp_obj_t modeth_stats_get(mp_obj_t self_in) {
+    mp_obj_t tuple[6];
+    tuple[0] = mp_obj_new_int_from_uint(modeth_stats.rx_frames);
+    tuple[1] = mp_obj_new_int_from_uint(modeth_stats.rx_bytes);
+    tuple[2] = mp_obj_new_int_from_uint(modeth_stats.rx_dropped);
+    tuple[3] = mp_obj_new_int_from_uint(modeth_stats.tx_frames);
+    tuple[4] = mp_obj_new_int_from_uint(modeth_stats.tx_bytes);
+    tuple[5] = mp_obj_new_int_from_uint(modeth_stats.tx_dropped);
+    return mp_obj_new_tuple(6, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(modeth_stats_obj, modeth_stats_get);
+
 STATIC const mp_map_elem_t eth_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_init),                (mp_obj_t)&modeth_init_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ifconfig),            (mp_obj_t)&eth_ifconfig_obj },
@@ -751,6 +810,7 @@ STATIC const mp_map_elem_t eth_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_mac),                 (mp_obj_t)&modeth_mac_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),              (mp_obj_t)&modeth_deinit_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_isconnected),         (mp_obj_t)&modeth_isconnected_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stats),               (mp_obj_t)&modeth_stats_obj },
 #ifdef DEBUG_MODETH
     { MP_OBJ_NEW_QSTR(MP_QSTR_register),            (mp_obj_t)&modeth_ksz8851_reg_wr_obj },
 #endif
@@ -776,6 +836,7 @@ const mod_network_nic_type_t mod_network_nic_type_eth = {
     .n_recv = lwipsocket_socket_recv,
     .n_sendto = lwipsocket_socket_sendto,
     .n_recvfrom = lwipsocket_socket_recvfrom,
+    .n_sendmsg = lwipsocket_socket_sendmsg,
     .n_setsockopt = lwipsocket_socket_setsockopt,
     .n_settimeout = lwipsocket_socket_settimeout,
     .n_ioctl = lwipsocket_socket_ioctl,
@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "py/mpconfig.h"
@@ -28,7 +29,9 @@
 #include "modusocket.h"
 #include "pycom_config.h"
 #include "mpirq.h"
+#include "mppoll.h"
 #include "modlora.h"
+#include "mpsleep.h"
 
 #include "esp_heap_caps.h"
 #include "sdkconfig.h"
@@ -36,12 +39,16 @@
 #include "esp_spi_flash.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include "esp_attr.h"
+#include "rom/crc.h"
 
 #include "lwip/sockets.h"       // for the socket error codes
+#include "updater.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/event_groups.h"
 
 #include "lora/mac/LoRaMacTest.h"
@@ -62,6 +69,10 @@
 #endif  // #ifdef LORA_OPENTHREAD_ENABLED
 
 #include "random.h"
+#include "mptrace.h"
+#include "mpenergy.h"
+#include "pktbuf.h"
+#include "modpycom_pktbuf.h"
 /******************************************************************************
  DEFINE PRIVATE CONSTANTS
  ******************************************************************************/
@@ -73,6 +84,18 @@
 #define LORA_TX_TIMEOUT_MAX                         (9000)      // 9 seconds
 #define LORA_RX_TIMEOUT                             (0)         // No timeout
 
+// longest a CAD can take (2 symbols at SF12/125KHz take 66 ms), the radio is put back to sleep after it
+#define LORA_SNIFF_CAD_TIMEOUT_MS                   (500)
+// supply current of the SX127x while it listens or runs a CAD, and while it sleeps
+#define LORA_SNIFF_RX_CURRENT_UA                    (10800)
+#define LORA_SNIFF_SLEEP_CURRENT_UA                 (1)
+
+// listen-before-talk of the raw LoRa mode
+#define LORA_LBT_RSSI_THRESHOLD_DEF                 (-85)       // dBm
+#define LORA_LBT_BACKOFF_MS_DEF                     (10)
+#define LORA_LBT_BACKOFF_EXP_MAX                    (6)         // the backoff window grows up to 64 times
+#define LORA_LBT_SENSE_US                           (1000)
+
 // [SF6..SF12]
 #define LORA_SPREADING_FACTOR_MIN                   (6)
 #define LORA_SPREADING_FACTOR_MAX                   (12)
@@ -106,13 +129,46 @@
 
 #define LORAWAN_SOCKET_GET_DR(sd)                   ((sd >> 16) & 0xFF)
 
+#define LORAWAN_SOCKET_SET_PRIORITY(sd, prio)       (sd &= 0xF0FFFFFF); \
+                                                    (sd |= (prio << 24))
+
+#define LORAWAN_SOCKET_GET_PRIORITY(sd)             ((sd >> 24) & 0x0F)
+
+#define LORAWAN_SOCKET_DEADLINE(s)                  ((s)->sock_base.lora_deadline)
+
+#define LORAWAN_UPLINK_RESULTS                      (2 * LORAWAN_UPLINK_QUEUE_SIZE)
+#define LORAWAN_UPLINK_POLL_MS                      (10)
+
 
 // callback events
 #define MODLORA_RX_EVENT                            (0x01)
 #define MODLORA_TX_EVENT                            (0x02)
 #define MODLORA_TX_FAILED_EVENT                     (0x04)
+#define MODLORA_FRAG_DONE_EVENT                     (0x08)
+
+#define MODLORA_LINK_DOWNLINK                       (0x01)
+#define MODLORA_LINK_CONFIRMED                      (0x02)
+#define MODLORA_LINK_ACK                            (0x04)
+#define MODLORA_LINK_FAILED                         (0x08)
+#define LORA_LINK_RSSI_MIN                          (-160)
+#define LORA_LINK_RSSI_BINS                         (161)
 
 #define MODLORA_NVS_NAMESPACE                       "LORA_NVM"
+#define MODLORA_NVS_CACHE_MAGIC                     (0x4C4E5643)    // "LNVC"
+// flash writes of the persistent counters are batched in steps of this size
+#define MODLORA_NVS_COUNTER_STEP                    (16)
+// enough for the session blobs of the regions with the largest channel lists
+#define MODLORA_NVS_CACHE_BLOB_SIZE                 (2048)
+
+// offset, length, port, rssi, snr, sf, timestamp
+#define LORA_RX_FRAME_INFO_FIELDS                   (7)
+
+// FragDataBlock of the fragmented data block transport: CID, then FragIndex (2 bits) and N (14 bits)
+#define LORAWAN_FRAG_DATA_BLOCK_CID                 (0x08)
+#define LORAWAN_FRAG_HDR_SIZE                       (3)
+#define LORAWAN_FRAG_SIZE_MAX                       (LORA_PAYLOAD_SIZE_MAX - LORAWAN_FRAG_HDR_SIZE)
+#define LORAWAN_FRAG_INDEX_MAX                      (3)
+#define LORAWAN_FRAG_NB_MAX                         (0x3FFF)
 
 #define MESH_CLI_OUTPUT_SIZE                            (1024)
 
@@ -137,7 +193,11 @@ typedef enum {
     E_LORA_STATE_TX_DONE,
     E_LORA_STATE_TX_TIMEOUT,
     E_LORA_STATE_SLEEP,
-    E_LORA_STATE_RESET
+    E_LORA_STATE_RESET,
+    E_LORA_STATE_SNIFF,             // radio asleep until the next CAD window
+    E_LORA_STATE_CAD,
+    E_LORA_STATE_CAD_DONE,
+    E_LORA_STATE_CAD_DETECTED
 } lora_state_t;
 
 typedef enum {
@@ -231,20 +291,165 @@ typedef struct {
     uint8_t           tx_trials;
 } lora_obj_t;
 
+// one per frame sent or received by the LoRaWAN stack, copied as is by link_history()
+typedef struct {
+    uint32_t          timestamp;                        // ms
+    int16_t           rssi;                             // 0 for the uplinks
+    int8_t            snr;                              // in 0.25 dB steps, 0 for the uplinks
+    uint8_t           dr;
+    int8_t            tx_power;                         // 0 for the downlinks
+    uint8_t           channel;                          // 0xFF for the downlinks
+    uint8_t           flags;
+    uint8_t           retries;
+} lora_link_record_t;
+
+typedef struct {
+    lora_link_record_t *records;
+    uint32_t          depth;
+    uint32_t          head;                             // where the next record goes
+    uint32_t          count;
+    uint32_t          uplinks;
+    uint32_t          downlinks;
+    uint32_t          confirmed;
+    uint32_t          acked;
+    uint32_t          failed;
+    uint32_t          retries;
+    int32_t           rssi_ewma;                        // in 1/16 dB
+    int32_t           snr_ewma;                         // in 1/64 dB
+} lora_link_history_t;
+
+// low-power listening of the raw LoRa mode, owned by the LoRa task
+typedef struct {
+    uint32_t          interval_ms;                      // 0 when listening continuously
+    uint32_t          rx_window_ms;                     // 0 to derive it from the interval and the radio settings
+    TickType_t        next_cad;
+    TickType_t        cad_start;
+    TickType_t        rx_start;
+    TickType_t        sleep_start;
+    bool              rx_open;
+    bool              rx_done;
+    bool              sleeping;
+    uint32_t          cad_count;
+    uint32_t          detections;
+    uint32_t          packets;
+    uint32_t          false_wakeups;
+    uint32_t          cad_ms;
+    uint32_t          rx_ms;
+    uint32_t          sleep_ms;
+} lora_sniff_t;
+
+// receiver hopping of the raw LoRa mode, owned by the LoRa task
+typedef struct {
+    lora_scan_entry_t entries[LORA_SCAN_ENTRIES_MAX];
+    struct {
+        uint32_t      cads;
+        uint32_t      detections;
+        uint32_t      packets;
+    } stats[LORA_SCAN_ENTRIES_MAX];
+    TickType_t        dwell_end;
+    uint8_t           count;                            // 0 when not scanning
+    uint8_t           index;                            // entry being listened to
+    uint8_t           tuned;                            // entry the radio is set up for, 0xFF for the configured channel
+} lora_scan_t;
+
+// raw frame waiting for its transmission time, owned by the LoRa task
+typedef struct {
+    lora_tx_at_cmd_data_t frame;
+    bool              pending;
+    int32_t           latency_us;                       // EWMA of the time Radio.Send() takes to start the transmission
+    uint32_t          sent;
+    uint32_t          missed;
+    int64_t           error_sum_us;
+    int32_t           error_max_us;                     // absolute value
+    int32_t           error_last_us;
+} lora_tx_at_t;
+
+// raw frame waiting for a free channel, owned by the LoRa task
+typedef struct {
+    lora_tx_cmd_data_t tx;
+    TickType_t        next_try;
+    bool              pending;
+    uint16_t          attempts;
+    int16_t           threshold;
+    uint16_t          max_attempts;                     // 0 to retry until the channel is free
+    uint16_t          backoff_ms;
+    uint32_t          busy;
+    uint32_t          failed;
+} lora_lbt_t;
+
+// outcome of the last tagged raw frame, written by the LoRa task and its interrupts, read by the Mesh task
+typedef struct {
+    volatile uint8_t  on_air;                           // tag of the frame being sent, 0 if untagged
+    volatile uint8_t  tag;                              // last frame reported
+    volatile int8_t   status;
+} lora_ot_tx_t;
+
+// uplinks waiting for the MAC, sorted by priority and FIFO within a priority
+typedef struct {
+    lorawan_uplink_t  uplinks[LORAWAN_UPLINK_QUEUE_SIZE + 1];   // one extra for a requeued uplink
+    uint32_t          count;
+    uint32_t          next_seq;
+    volatile uint32_t active_seq;
+    volatile uint32_t result_seq[LORAWAN_UPLINK_RESULTS];
+    uint32_t          result[LORAWAN_UPLINK_RESULTS];
+} lorawan_uplink_sched_t;
+
+typedef enum {
+    E_LORAWAN_FRAG_IDLE = 0,
+    E_LORAWAN_FRAG_RECEIVING,
+    E_LORAWAN_FRAG_DONE,
+    E_LORAWAN_FRAG_FAILED
+} lorawan_frag_state_t;
+
+// the MAC keeps pointers to the multicast groups, so they can't live in the MicroPython heap
+typedef struct {
+    MulticastParams_t params;
+    bool              used;
+} lorawan_mc_group_t;
+
+// fragmentation session, the uncoded fragments go from the MAC to the updater without Python.
+// Those ahead of the next one to be written wait in a window indexed by fragment number.
+typedef struct {
+    uint8_t           *window;                          // LORAWAN_FRAG_WINDOW_SLOTS * LORAWAN_FRAG_SIZE_MAX
+    uint64_t          present;                          // window slots holding a fragment
+    volatile lorawan_frag_state_t state;
+    uint16_t          nb_frag;
+    uint16_t          next;                             // fragments written so far
+    uint8_t           port;
+    uint8_t           index;
+    uint8_t           frag_size;
+    uint8_t           padding;
+    uint32_t          received;
+    uint32_t          duplicates;
+    uint32_t          dropped;                          // outside the window or malformed
+    uint32_t          coded;                            // parity fragments, not decoded
+} lorawan_frag_t;
+
+// what the LoRa NVS namespace holds, kept in RTC memory so that it survives deep sleep
+// and the session can be restored on wake up without reading the flash
 typedef struct {
-    uint32_t    index;
-    uint32_t    size;
-    uint8_t     data[LORA_PAYLOAD_SIZE_MAX];
-    uint8_t     port;
-} lora_partial_rx_packet_t;
+    uint32_t          magic;
+    uint32_t          stored;                           // keys with a valid digest
+    uint32_t          cached;                           // counters with a valid exact value
+    uint32_t          blobs;                            // keys whose content is in blob[]
+    uint32_t          digest[E_LORA_NVS_NUM_KEYS];      // the value of uints, CRC32 of blobs
+    uint32_t          counter[E_LORA_NVS_NUM_KEYS];
+    uint16_t          blob_offset[E_LORA_NVS_NUM_KEYS];
+    uint16_t          blob_length[E_LORA_NVS_NUM_KEYS];
+    uint32_t          blob_used;
+    uint8_t           blob[MODLORA_NVS_CACHE_BLOB_SIZE];
+} modlora_nvs_cache_t;
 
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
 static QueueHandle_t xCmdQueue;
-static QueueHandle_t xRxQueue;
+static QueueHandle_t xCmdQueueNext;
+static SemaphoreHandle_t xRxSem;
 static QueueHandle_t xCbQueue;
+static QueueHandle_t xCbQueueNext;
 static EventGroupHandle_t LoRaEvents;
+static SemaphoreHandle_t xUplinkMutex;
 
 static RadioEvents_t RadioEvents;
 static lora_cmd_data_t task_cmd_data;
@@ -252,12 +457,32 @@ static LoRaMacPrimitives_t LoRaMacPrimitives;
 static LoRaMacCallback_t LoRaMacCallbacks;
 
 static lora_obj_t lora_obj;
-static lora_partial_rx_packet_t lora_partial_rx_packet;
-static lora_rx_data_t rx_data_isr;
+// each frame is in a block of the packet buffer pool, its lora_rx_frame_hdr_t in the metadata of the block
+static pktbuf_queue_t lora_rx_queue;
+static lora_link_history_t lora_link_history;
+static portMUX_TYPE lora_link_history_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t lora_cmd_queue_size;
+static uint32_t lora_cmd_queue_hwm;
+static uint32_t lora_cb_queue_size;
+static volatile uint32_t lora_cb_queue_hwm;
+static lorawan_uplink_sched_t lorawan_sched;
+static lorawan_uplink_t lorawan_uplink_active;
+static lora_sniff_t lora_sniff_data;
+static lora_scan_t lora_scan_data = { .tuned = 0xFF };
+static lora_tx_at_t lora_tx_at_data;
+static lora_lbt_t lora_lbt_data = { .threshold = LORA_LBT_RSSI_THRESHOLD_DEF, .backoff_ms = LORA_LBT_BACKOFF_MS_DEF };
+static lora_ot_tx_t lora_ot_tx;
+
+static lorawan_mc_group_t lorawan_mc_groups[LORAWAN_MC_GROUPS_MAX];
+static lorawan_frag_t lorawan_frag;
+static portMUX_TYPE lorawan_frag_mux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t lorawan_frag_lock;
+static TaskHandle_t xLoRaFragTaskHndl;
 
 static TimerEvent_t TxNextActReqTimer;
 
 static nvs_handle modlora_nvs_handle;
+static RTC_DATA_ATTR modlora_nvs_cache_t modlora_nvs_cache;
 static const char *modlora_nvs_data_key[E_LORA_NVS_NUM_KEYS] = { "JOINED", "UPLNK", "DWLNK", "DEVADDR",
                                                                  "NWSKEY", "APPSKEY", "NETID", "ADRACK",
                                                                  "MACPARAMS", "CHANNELS", "SRVACK", "MACNXTTX",
@@ -273,11 +498,20 @@ extern TaskHandle_t xLoRaTaskHndl;
  ******************************************************************************/
 static void TASK_LoRa (void *pvParameters);
 static void TASK_LoRa_Timer (void *pvParameters);
+static void TASK_LoRa_Frag (void *pvParameters);
 static void OnTxDone (void);
 static void OnRxDone (uint8_t *payload, uint32_t timestamp, uint16_t size, int16_t rssi, int8_t snr, uint8_t sf);
+static void lora_ot_tx_report (uint8_t tag, int8_t status);
 static void OnTxTimeout (void);
 static void OnRxTimeout (void);
 static void OnRxError (void);
+static void OnCadDone (bool channelActivityDetected);
+static void lora_rx_resume (void);
+static void lora_sniff_setup (uint32_t interval_ms, uint32_t rx_window_ms);
+static void lora_sniff_sleep_end (void);
+static void lora_scan_setup (lora_scan_cmd_data_t *scan);
+static void lora_scan_hop (void);
+static void lora_scan_restore (void);
 static void lora_radio_setup (lora_init_cmd_data_t *init_data);
 static void lora_validate_mode (uint32_t mode);
 static void lora_validate_frequency (uint32_t frequency);
@@ -290,10 +524,32 @@ static void lora_get_config (lora_cmd_data_t *cmd_data);
 static void lora_send_cmd (lora_cmd_data_t *cmd_data);
 static int32_t lora_send (const byte *buf, uint32_t len, uint32_t timeout_ms);
 static int32_t lora_recv (byte *buf, uint32_t len, int32_t timeout_ms, uint32_t *port);
+static int32_t lora_recv_many (byte *buf, uint32_t len, int32_t *info, uint32_t max_frames, int32_t timeout_ms);
 static bool lora_rx_any (void);
+static bool lora_rx_queue_push (const uint8_t *data, uint8_t len, uint8_t port, uint32_t timestamp, int16_t rssi, int8_t snr, uint8_t sf);
+static void lora_rx_queue_flush (void);
+static void lora_rx_queue_consume (pktbuf_t *pb, uint32_t len);
+static bool lora_link_history_alloc (uint32_t depth);
+static void lora_link_history_push (const lora_link_record_t *record);
+static bool lora_cmd_queue_resize (uint32_t size);
+static void lora_cmd_queue_switch (void);
+static void lora_cmd_queue_update_hwm (void);
+static bool lora_cb_queue_resize (uint32_t size);
+static void lora_cb_queue_switch (void);
 static bool lora_tx_space (void);
+static uint32_t lorawan_uplink_enqueue (lorawan_uplink_t *uplink, TickType_t timeout);
+static uint32_t lorawan_uplink_wait (uint32_t seq);
+static void lorawan_uplink_done (uint32_t seq, uint32_t status);
+static void lorawan_uplink_flush (void);
+static void lorawan_uplink_schedule (void);
 static void lora_callback_handler (void *arg);
+static bool lorawan_frag_push (const uint8_t *data, uint8_t len);
+static void lorawan_frag_end (lorawan_frag_state_t state);
 static bool lorawan_nvs_open (void);
+static bool modlora_nvs_is_stored (uint32_t key_idx, uint32_t digest);
+static void modlora_nvs_set_stored (uint32_t key_idx, uint32_t digest);
+static void modlora_nvs_cache_blob (uint32_t key_idx, const void *value, uint32_t length);
+static void modlora_nvs_cache_reset (void);
 
 static int lora_socket_socket (mod_network_socket_obj_t *s, int *_errno);
 static void lora_socket_close (mod_network_socket_obj_t *s);
@@ -307,6 +563,8 @@ static int lora_socket_ioctl (mod_network_socket_obj_t *s, mp_uint_t request, mp
 static int lora_socket_sendto (struct _mod_network_socket_obj_t *s, const byte *buf, mp_uint_t len, byte *ip, mp_uint_t port, int *_errno);
 
 static bool lora_lbt_is_free(void);
+static void lora_lbt_process(void);
+static void lora_tx_at_process(void);
 STATIC mp_obj_t lora_nvram_erase (mp_obj_t self_in);
 
 /******************************************************************************
@@ -320,10 +578,21 @@ SemaphoreHandle_t xLoRaSigfoxSem;
  DEFINE PUBLIC FUNCTIONS
  ******************************************************************************/
 void modlora_init0(void) {
-    xCmdQueue = xQueueCreate(LORA_CMD_QUEUE_SIZE_MAX, sizeof(lora_cmd_data_t));
-    xRxQueue = xQueueCreate(LORA_DATA_QUEUE_SIZE_MAX, sizeof(lora_rx_data_t));
-    xCbQueue = xQueueCreate(LORA_CB_QUEUE_SIZE_MAX, sizeof(modlora_timerCallback));
+    // with the lazy boot profile this is done by the first LoRa() or machine.sleep()
+    static bool initialised = false;
+    if (initialised) {
+        return;
+    }
+    initialised = true;
+
+    lora_cmd_queue_size = LORA_CMD_QUEUE_SIZE_DEFAULT;
+    xCmdQueue = xQueueCreate(lora_cmd_queue_size, sizeof(lora_cmd_data_t));
+    xRxSem = xSemaphoreCreateBinary();
+    lora_link_history_alloc(LORA_LINK_HISTORY_DEPTH_DEFAULT);
+    lora_cb_queue_size = LORA_CB_QUEUE_SIZE_DEFAULT;
+    xCbQueue = xQueueCreate(lora_cb_queue_size, sizeof(modlora_timerCallback));
     LoRaEvents = xEventGroupCreate();
+    xUplinkMutex = xSemaphoreCreateMutex();
 #if defined(FIPY) || defined(LOPY4)
     xLoRaSigfoxSem = xSemaphoreCreateMutex();
 #endif
@@ -340,15 +609,41 @@ void modlora_init0(void) {
     xTaskCreatePinnedToCore(TASK_LoRa_Timer, "LoRa_Timer_callback", LORA_TIMER_STACK_SIZE / sizeof(StackType_t), NULL, LORA_TIMER_TASK_PRIORITY, &xLoRaTimerTaskHndl, 1);
 }
 
+// the window and the task are only created by the first fragmentation session
+static bool lorawan_frag_init (void) {
+    if (lorawan_frag_lock == NULL) {
+        lorawan_frag_lock = xSemaphoreCreateMutex();
+    }
+    if (lorawan_frag.window == NULL) {
+        lorawan_frag.window = heap_caps_malloc(LORAWAN_FRAG_WINDOW_SLOTS * LORAWAN_FRAG_SIZE_MAX, MALLOC_CAP_8BIT);
+    }
+    if (xLoRaFragTaskHndl == NULL) {
+        xTaskCreatePinnedToCore(TASK_LoRa_Frag, "LoRa_Frag", LORAWAN_FRAG_STACK_SIZE / sizeof(StackType_t), NULL,
+                                LORAWAN_FRAG_TASK_PRIORITY, &xLoRaFragTaskHndl, 1);
+    }
+    return lorawan_frag_lock != NULL && lorawan_frag.window != NULL && xLoRaFragTaskHndl != NULL;
+}
+
 bool modlora_nvs_set_uint(uint32_t key_idx, uint32_t value) {
+    // only write the values that have changed since the last save
+    if (modlora_nvs_is_stored(key_idx, value)) {
+        return true;
+    }
     if (ESP_OK == nvs_set_u32(modlora_nvs_handle, modlora_nvs_data_key[key_idx], value)) {
+        modlora_nvs_set_stored(key_idx, value);
         return true;
     }
     return false;
 }
 
 bool modlora_nvs_set_blob(uint32_t key_idx, const void *value, uint32_t length) {
+    uint32_t digest = crc32_le(length, value, length);
+    modlora_nvs_cache_blob(key_idx, value, length);
+    if (modlora_nvs_is_stored(key_idx, digest)) {
+        return true;
+    }
     if (ESP_OK == nvs_set_blob(modlora_nvs_handle, modlora_nvs_data_key[key_idx], value, length)) {
+        modlora_nvs_set_stored(key_idx, digest);
         return true;
     }
     return false;
@@ -356,7 +651,13 @@ bool modlora_nvs_set_blob(uint32_t key_idx, const void *value, uint32_t length)
 
 bool modlora_nvs_get_uint(uint32_t key_idx, uint32_t *value) {
     esp_err_t err;
+    // the digest of a uint is the value itself
+    if (modlora_nvs_cache.stored & (1 << key_idx)) {
+        *value = modlora_nvs_cache.digest[key_idx];
+        return true;
+    }
     if (ESP_OK == (err = nvs_get_u32(modlora_nvs_handle, modlora_nvs_data_key[key_idx], value))) {
+        modlora_nvs_set_stored(key_idx, *value);
         return true;
     }
     return false;
@@ -364,15 +665,53 @@ bool modlora_nvs_get_uint(uint32_t key_idx, uint32_t *value) {
 
 bool modlora_nvs_get_blob(uint32_t key_idx, void *value, uint32_t *length) {
     esp_err_t err;
+    if ((modlora_nvs_cache.blobs & (1 << key_idx)) && *length >= modlora_nvs_cache.blob_length[key_idx]) {
+        *length = modlora_nvs_cache.blob_length[key_idx];
+        memcpy(value, &modlora_nvs_cache.blob[modlora_nvs_cache.blob_offset[key_idx]], *length);
+        return true;
+    }
     if (ESP_OK == (err = nvs_get_blob(modlora_nvs_handle, modlora_nvs_data_key[key_idx], value, length))) {
+        modlora_nvs_set_stored(key_idx, crc32_le(*length, value, *length));
+        modlora_nvs_cache_blob(key_idx, value, *length);
         return true;
     }
     return false;
 }
 
+// Counters that change on every uplink. The exact value is kept in RTC memory and
+// the flash is only written once every MODLORA_NVS_COUNTER_STEP changes. With reserve
+// set the flash holds a value that is always ahead of the real one (frame counters
+// must never be reused), otherwise it may lag behind by up to a step.
+bool modlora_nvs_set_counter(uint32_t key_idx, uint32_t value, bool reserve) {
+    uint32_t mask = 1 << key_idx;
+    modlora_nvs_cache.counter[key_idx] = value;
+    modlora_nvs_cache.cached |= mask;
+    if (modlora_nvs_cache.stored & mask) {
+        uint32_t stored = modlora_nvs_cache.digest[key_idx];
+        if (reserve) {
+            if (value < stored) {
+                return true;
+            }
+        } else if (value >= stored && (value - stored) < MODLORA_NVS_COUNTER_STEP) {
+            return true;
+        }
+    }
+    return modlora_nvs_set_uint(key_idx, reserve ? (value + MODLORA_NVS_COUNTER_STEP) : value);
+}
+
+bool modlora_nvs_get_counter(uint32_t key_idx, uint32_t *value) {
+    if (modlora_nvs_cache.cached & (1 << key_idx)) {
+        *value = modlora_nvs_cache.counter[key_idx];
+        return true;
+    }
+    return modlora_nvs_get_uint(key_idx, value);
+}
+
 void modlora_sleep_module(void)
 {
     lora_cmd_data_t cmd_data;
+    // the state of the radio isn't known if the stack hasn't been started yet
+    modlora_init0();
     /* Set Modem mode to LORA in order to got to Sleep Mode */
     Radio.SetModem(MODEM_LORA);
     cmd_data.cmd = E_LORA_CMD_SLEEP;
@@ -397,8 +736,13 @@ IRAM_ATTR void modlora_set_timer_callback(modlora_timerCallback cb)
     if(cb != NULL)
     {
         BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        QueueHandle_t queue = xCbQueue;
 
-        xQueueSendFromISR(xCbQueue, &cb, &xHigherPriorityTaskWoken);
+        xQueueSendFromISR(queue, &cb, &xHigherPriorityTaskWoken);
+        uint32_t used = uxQueueMessagesWaitingFromISR(queue);
+        if (used > lora_cb_queue_hwm) {
+            lora_cb_queue_hwm = used;
+        }
 
         if( xHigherPriorityTaskWoken)
         {
@@ -408,32 +752,55 @@ IRAM_ATTR void modlora_set_timer_callback(modlora_timerCallback cb)
 }
 
 #ifdef LORA_OPENTHREAD_ENABLED
-int lora_ot_recv(uint8_t *buf, int8_t *rssi) {
-
-    // put Lora into RX mode
-    int len = lora_recv (buf, OT_RADIO_FRAME_MAX_SIZE, 0, NULL);
+// takes the next received frame out of the ring, along with the time its DIO0 interrupt was raised
+int lora_ot_recv(uint8_t *buf, int8_t *rssi, uint32_t *timestamp) {
+    pktbuf_t *pb = pktbuf_queue_peek(&lora_rx_queue);
+    if (pb == NULL) {
+        return 0;
+    }
 
-    if (len > 0) {
+    lora_rx_frame_hdr_t *hdr = (lora_rx_frame_hdr_t *)pb->meta;
+    uint32_t available_len = hdr->len - hdr->index;
+    uint32_t len = (available_len < OT_RADIO_FRAME_MAX_SIZE) ? available_len : OT_RADIO_FRAME_MAX_SIZE;
+    memcpy(buf, &pb->data[hdr->index], len);
 
-        // put rssi on signed 8bit, saturate at -128dB
-        if (lora_obj.rssi < INT8_MIN)
-            *rssi = INT8_MIN;
-        else
-            *rssi = lora_obj.rssi;
+    // put rssi on signed 8bit, saturate at -128dB
+    *rssi = (hdr->rssi < INT8_MIN) ? INT8_MIN : hdr->rssi;
+    *timestamp = hdr->timestamp;
+    // a frame too long for 802.15.4 is dropped as a whole
+    lora_rx_queue_consume(pb, available_len);
 
-        otPlatLog(OT_LOG_LEVEL_INFO, 0, "radio rcv: %d, %d", len, *rssi);
-    }
+    otPlatLog(OT_LOG_LEVEL_INFO, 0, "radio rcv: %d, %d", len, *rssi);
     return len;
 }
 
-void lora_ot_send(const uint8_t *buf, uint16_t len) {
+// queues the frame behind listen-before-talk without waiting, false if the LoRa task has no room for it
+bool lora_ot_send(const uint8_t *buf, uint16_t len, uint8_t tag) {
+    lora_cmd_data_t cmd_data;
 
     // send max 255 bytes
     len = LORA_PAYLOAD_SIZE_MAX < len ? LORA_PAYLOAD_SIZE_MAX : len;
 
-    lora_send(buf, len, 0);
+    cmd_data.cmd = E_LORA_CMD_TX;
+    memcpy(cmd_data.info.tx.data, buf, len);
+    cmd_data.info.tx.len = len;
+    cmd_data.info.tx.tag = tag;
+    if (!xQueueSend(xCmdQueue, (void *)&cmd_data, 0)) {
+        return false;
+    }
+    lora_cmd_queue_update_hwm();
+    lora_obj.sftx = lora_obj.sf;
+    lora_obj.tx_time_on_air = Radio.TimeOnAir(MODEM_LORA, len);
+    lora_obj.tx_counter += 1;
+    lora_obj.tx_frequency = lora_obj.frequency;
+    return true;
+}
 
-    //otPlatLog(OT_LOG_LEVEL_INFO, 0, "radio TX: %d", len);
+int lora_ot_tx_result(uint8_t tag) {
+    if (lora_ot_tx.tag != tag) {
+        return LORA_OT_TX_PENDING;
+    }
+    return lora_ot_tx.status;
 }
 #endif  // #ifdef LORA_OPENTHREAD_ENABLED
 
@@ -441,13 +808,52 @@ void lora_ot_send(const uint8_t *buf, uint16_t len) {
  DEFINE PRIVATE FUNCTIONS
  ******************************************************************************/
 
+static bool modlora_nvs_is_stored (uint32_t key_idx, uint32_t digest) {
+    return (modlora_nvs_cache.stored & (1 << key_idx)) && modlora_nvs_cache.digest[key_idx] == digest;
+}
+
+static void modlora_nvs_set_stored (uint32_t key_idx, uint32_t digest) {
+    modlora_nvs_cache.digest[key_idx] = digest;
+    modlora_nvs_cache.stored |= (1 << key_idx);
+}
+
+static void modlora_nvs_cache_blob (uint32_t key_idx, const void *value, uint32_t length) {
+    uint32_t mask = 1 << key_idx;
+    if (!(modlora_nvs_cache.blobs & mask)) {
+        if (modlora_nvs_cache.blob_used + length > MODLORA_NVS_CACHE_BLOB_SIZE) {
+            // doesn't fit, it will be read from the flash
+            return;
+        }
+        modlora_nvs_cache.blob_offset[key_idx] = modlora_nvs_cache.blob_used;
+        modlora_nvs_cache.blob_length[key_idx] = length;
+        modlora_nvs_cache.blob_used += length;
+        modlora_nvs_cache.blobs |= mask;
+    } else if (length != modlora_nvs_cache.blob_length[key_idx]) {
+        // the space is never given back, so the blob won't be cached anymore
+        modlora_nvs_cache.blobs &= ~mask;
+        return;
+    }
+    memcpy(&modlora_nvs_cache.blob[modlora_nvs_cache.blob_offset[key_idx]], value, length);
+}
+
+static void modlora_nvs_cache_reset (void) {
+    memset(&modlora_nvs_cache, 0, sizeof(modlora_nvs_cache));
+    modlora_nvs_cache.magic = MODLORA_NVS_CACHE_MAGIC;
+}
+
 static bool lorawan_nvs_open (void) {
+    // the cache is only valid when waking up from deep sleep
+    if (modlora_nvs_cache.magic != MODLORA_NVS_CACHE_MAGIC || mpsleep_get_reset_cause() != MPSLEEP_DEEPSLEEP_RESET) {
+        modlora_nvs_cache_reset();
+    }
+
     if (nvs_open(MODLORA_NVS_NAMESPACE, NVS_READWRITE, &modlora_nvs_handle) != ESP_OK) {
         return false;
     }
 
     uint32_t data;
-    if (ESP_ERR_NVS_NOT_FOUND == nvs_get_u32(modlora_nvs_handle, "JOINED", &data)) {
+    if (!(modlora_nvs_cache.stored & (1 << E_LORA_NVS_ELE_JOINED)) &&
+        ESP_ERR_NVS_NOT_FOUND == nvs_get_u32(modlora_nvs_handle, "JOINED", &data)) {
         // initialize the value to 0
         nvs_set_u32(modlora_nvs_handle, "JOINED", false);
         if (ESP_OK != nvs_commit(modlora_nvs_handle)) {
@@ -457,50 +863,47 @@ static bool lorawan_nvs_open (void) {
     return true;
 }
 
-static int32_t lorawan_send (const byte *buf, uint32_t len, uint32_t timeout_ms, bool confirmed, uint32_t dr, uint32_t port) {
-    lora_cmd_data_t cmd_data;
+static int32_t lorawan_send (const byte *buf, uint32_t len, int32_t timeout_ms, bool confirmed, uint32_t dr, uint32_t port,
+                             uint8_t priority, uint32_t deadline_ms) {
+    lorawan_uplink_t uplink;
 
-    cmd_data.cmd = E_LORA_CMD_LORAWAN_TX;
-    memcpy (cmd_data.info.tx.data, buf, len);
-    cmd_data.info.tx.len = len;
-    cmd_data.info.tx.dr = dr;
+    // validate the message size with the requested data rate
+    if (false == ValidatePayloadLength(len, dr, 0)) {
+        // message too long
+        return -1;
+    }
+
+    memcpy (uplink.tx.data, buf, len);
+    uplink.tx.len = len;
+    uplink.tx.dr = dr;
     if (lora_obj.ComplianceTest.Enabled && lora_obj.ComplianceTest.Running) {
-        cmd_data.info.tx.port = 224;  // MAC commands port
+        uplink.tx.port = 224;  // MAC commands port
         if (lora_obj.ComplianceTest.IsTxConfirmed) {
-            cmd_data.info.tx.confirmed = true;
+            uplink.tx.confirmed = true;
         } else {
-            cmd_data.info.tx.confirmed = false;
+            uplink.tx.confirmed = false;
         }
     } else {
-        cmd_data.info.tx.confirmed = confirmed;
-        cmd_data.info.tx.port = port;    // data port
+        uplink.tx.confirmed = confirmed;
+        uplink.tx.port = port;    // data port
     }
-
-    if (timeout_ms < 0) {
-        // blocking mode
-        timeout_ms = portMAX_DELAY;
+    uplink.priority = priority;
+    uplink.deadline = 0;
+    if (deadline_ms > 0) {
+        uplink.deadline = xTaskGetTickCount() + (deadline_ms / portTICK_PERIOD_MS);
+        if (uplink.deadline == 0) {
+            uplink.deadline = 1;
+        }
     }
 
-    xEventGroupClearBits(LoRaEvents, LORA_STATUS_COMPLETED | LORA_STATUS_ERROR | LORA_STATUS_MSG_SIZE);
-
-    // just pass to the LoRa queue
-    if (!xQueueSend(xCmdQueue, (void *)&cmd_data, (TickType_t)(timeout_ms / portTICK_PERIOD_MS))) {
+    // hand it over to the uplink scheduler, waiting for a free slot if blocking
+    uint32_t seq = lorawan_uplink_enqueue(&uplink, (timeout_ms < 0) ? portMAX_DELAY : (TickType_t)(timeout_ms / portTICK_PERIOD_MS));
+    if (seq == 0) {
         return 0;
     }
 
-    // validate the message size with the requested data rate
-    if (false == ValidatePayloadLength(len, dr, 0)) {
-        // message too long
-        return -1;
-    }
-
     if (timeout_ms != 0) {
-        uint32_t result = xEventGroupWaitBits(LoRaEvents,
-                                              LORA_STATUS_COMPLETED | LORA_STATUS_ERROR | LORA_STATUS_MSG_SIZE,
-                                              pdTRUE,   // clear on exit
-                                              pdFALSE,  // do not wait for all bits
-                                              (TickType_t)portMAX_DELAY);
-
+        uint32_t result = lorawan_uplink_wait(seq);
         if (result & LORA_STATUS_MSG_SIZE) {
             return -1;
         } else if (result & LORA_STATUS_ERROR) {
@@ -513,6 +916,27 @@ static int32_t lorawan_send (const byte *buf, uint32_t len, uint32_t timeout_ms,
 
 static void McpsConfirm (McpsConfirm_t *McpsConfirm) {
     uint32_t status = LORA_STATUS_COMPLETED;
+    lora_link_record_t record = { .timestamp = mp_hal_ticks_ms_non_blocking(), .dr = McpsConfirm->Datarate,
+                                  .tx_power = McpsConfirm->TxPower, .channel = McpsConfirm->Channel,
+                                  .retries = McpsConfirm->NbRetries };
+
+    MPTRACE(MPTRACE_LORA_CONFIRM, McpsConfirm->Status, McpsConfirm->AckReceived);
+    if (McpsConfirm->McpsRequest == MCPS_CONFIRMED) {
+        record.flags |= MODLORA_LINK_CONFIRMED;
+        if (McpsConfirm->AckReceived) {
+            record.flags |= MODLORA_LINK_ACK;
+        }
+    }
+    if (McpsConfirm->Status != LORAMAC_EVENT_INFO_STATUS_OK) {
+        record.flags |= MODLORA_LINK_FAILED;
+    }
+    lora_link_history_push(&record);
+    // a confirmed uplink is only delivered once acknowledged
+    if (McpsConfirm->Status == LORAMAC_EVENT_INFO_STATUS_OK &&
+        (McpsConfirm->McpsRequest != MCPS_CONFIRMED || McpsConfirm->AckReceived)) {
+        mpenergy_message(MPENERGY_LINK_LORA, 1);
+    }
+
     if (McpsConfirm->Status == LORAMAC_EVENT_INFO_STATUS_OK) {
         // save the values before calling the event handler
         lora_obj.sftx = McpsConfirm->Datarate;
@@ -529,7 +953,7 @@ static void McpsConfirm (McpsConfirm_t *McpsConfirm) {
                     mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
                 }
                 lora_obj.state = E_LORA_STATE_IDLE;
-                xEventGroupSetBits(LoRaEvents, status);
+                lorawan_uplink_done(lorawan_sched.active_seq, status);
                 break;
             }
             case MCPS_CONFIRMED:
@@ -540,7 +964,7 @@ static void McpsConfirm (McpsConfirm_t *McpsConfirm) {
                         mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
                     }
                     lora_obj.state = E_LORA_STATE_IDLE;
-                    xEventGroupSetBits(LoRaEvents, status);
+                    lorawan_uplink_done(lorawan_sched.active_seq, status);
                 } else {
                     // the ack wasn't received, so the stack will re-transmit
                 }
@@ -557,7 +981,7 @@ static void McpsConfirm (McpsConfirm_t *McpsConfirm) {
         }
         lora_obj.state = E_LORA_STATE_IDLE;
         status |= LORA_STATUS_ERROR;
-        xEventGroupSetBits(LoRaEvents, status);
+        lorawan_uplink_done(lorawan_sched.active_seq, status);
     }
 #if defined(FIPY) || defined(LOPY4)
     xSemaphoreGive(xLoRaSigfoxSem);
@@ -599,6 +1023,17 @@ static void McpsIndication (McpsIndication_t *mcpsIndication) {
     lora_obj.snr = mcpsIndication->Snr;
     lora_obj.sfrx = mcpsIndication->RxDatarate;
 
+    lora_link_record_t record = { .timestamp = mp_hal_ticks_ms_non_blocking(), .rssi = mcpsIndication->Rssi,
+                                  .snr = mcpsIndication->Snr, .dr = mcpsIndication->RxDatarate, .channel = 0xFF,
+                                  .flags = MODLORA_LINK_DOWNLINK };
+    if (mcpsIndication->McpsIndication == MCPS_CONFIRMED) {
+        record.flags |= MODLORA_LINK_CONFIRMED;
+    }
+    if (mcpsIndication->AckReceived) {
+        record.flags |= MODLORA_LINK_ACK;
+    }
+    lora_link_history_push(&record);
+
     if ((mcpsIndication->Port == 224) && (lora_obj.ComplianceTest.Enabled == true)
         && (lora_obj.ComplianceTest.Running == true)) {
        MibRequestConfirm_t mibReq;
@@ -621,11 +1056,12 @@ static void McpsIndication (McpsIndication_t *mcpsIndication) {
 
     if (mcpsIndication->RxData && mcpsIndication->BufferSize > 0) {
         if (mcpsIndication->Port > 0 && mcpsIndication->Port < 224) {
-            if (mcpsIndication->BufferSize <= LORA_PAYLOAD_SIZE_MAX) {
-                memcpy((void *)rx_data_isr.data, mcpsIndication->Buffer, mcpsIndication->BufferSize);
-                rx_data_isr.len = mcpsIndication->BufferSize;
-                rx_data_isr.port = mcpsIndication->Port;
-                xQueueSend(xRxQueue, (void *)&rx_data_isr, 0);
+            if (mcpsIndication->Port == lorawan_frag.port && lorawan_frag_push(mcpsIndication->Buffer, mcpsIndication->BufferSize)) {
+                // the fragmentation session took it, the other commands of its port go to Python
+            } else if (mcpsIndication->BufferSize <= LORA_PAYLOAD_SIZE_MAX) {
+                lora_rx_queue_push(mcpsIndication->Buffer, mcpsIndication->BufferSize, mcpsIndication->Port,
+                                  mcpsIndication->TimeStamp, mcpsIndication->Rssi, mcpsIndication->Snr,
+                                  mcpsIndication->RxDatarate);
                 lora_obj.events |= MODLORA_RX_EVENT;
                 if (lora_obj.trigger & MODLORA_RX_EVENT) {
                     mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
@@ -652,7 +1088,7 @@ static void McpsIndication (McpsIndication_t *mcpsIndication) {
                         lora_obj.ComplianceTest.State = 1;
 
                         // flush the rx queue
-                        xQueueReset(xRxQueue);
+                        lora_rx_queue_flush();
 
                         // enable ADR during test mode
                         MibRequestConfirm_t mibReq;
@@ -699,9 +1135,9 @@ static void McpsIndication (McpsIndication_t *mcpsIndication) {
                         // return the payload
                         if (bDoEcho) {
                             if (mcpsIndication->BufferSize <= LORA_PAYLOAD_SIZE_MAX) {
-                                memcpy((void *)rx_data_isr.data, mcpsIndication->Buffer, mcpsIndication->BufferSize);
-                                rx_data_isr.len = mcpsIndication->BufferSize;
-                                xQueueSend(xRxQueue, (void *)&rx_data_isr, 0);
+                                lora_rx_queue_push(mcpsIndication->Buffer, mcpsIndication->BufferSize, mcpsIndication->Port,
+                                                  mcpsIndication->TimeStamp, mcpsIndication->Rssi, mcpsIndication->Snr,
+                                                  mcpsIndication->RxDatarate);
                             }
                         } else {
                             // set the state back to 1
@@ -816,14 +1252,30 @@ static void TASK_LoRa (void *pvParameters) {
         case E_LORA_STATE_RX:
         case E_LORA_STATE_SLEEP:
         case E_LORA_STATE_RESET:
+        case E_LORA_STATE_SNIFF:
+            // a raw frame waiting for its time or for the channel goes before the next commands
+            if (lora_tx_at_data.pending) {
+                lora_tx_at_process();
+            } else if (lora_lbt_data.pending) {
+                lora_lbt_process();
+            // a resized command queue is taken over once the commands of the old one are done
+            } else if (xCmdQueueNext != NULL && uxQueueMessagesWaiting(xCmdQueue) == 0) {
+                lora_cmd_queue_switch();
             // receive from the command queue and act accordingly
-            if (xQueueReceive(xCmdQueue, &task_cmd_data, 0)) {
+            } else if (xQueueReceive(xCmdQueue, &task_cmd_data, 0)) {
+                mp_poll_wake();
                 switch (task_cmd_data.cmd) {
                 case E_LORA_CMD_INIT:
                     isReset = lora_obj.state == E_LORA_STATE_RESET? true:false;
                     // save the new configuration first
                     lora_set_config(&task_cmd_data);
+                    // uplinks queued with the previous configuration are dropped
+                    lorawan_uplink_flush();
+                    lora_sniff_sleep_end();
                     if (task_cmd_data.info.init.stack_mode == E_LORA_STACK_MODE_LORAWAN) {
+                        // the MAC schedules the receive windows itself
+                        lora_sniff_data.interval_ms = 0;
+                        lora_scan_data.count = 0;
                         LoRaMacPrimitives.MacMcpsConfirm = McpsConfirm;
                         LoRaMacPrimitives.MacMcpsIndication = McpsIndication;
                         LoRaMacPrimitives.MacMlmeConfirm = MlmeConfirm;
@@ -861,9 +1313,9 @@ static void TASK_LoRa (void *pvParameters) {
                             result &= modlora_nvs_get_blob(E_LORA_NVS_ELE_APPSKEY, (void *)lora_obj.u.abp.AppSKey, &length);
 
                             uint32_t uplinks, downlinks;
-                            result &= modlora_nvs_get_uint(E_LORA_NVS_ELE_UPLINK, &uplinks);
+                            result &= modlora_nvs_get_counter(E_LORA_NVS_ELE_UPLINK, &uplinks);
                             result &= modlora_nvs_get_uint(E_LORA_NVS_ELE_DWLINK, &downlinks);
-                            result &= modlora_nvs_get_uint(E_LORA_NVS_ELE_ADR_ACKS, LoRaMacGetAdrAckCounter());
+                            result &= modlora_nvs_get_counter(E_LORA_NVS_ELE_ADR_ACKS, LoRaMacGetAdrAckCounter());
 
                             if (result) {
                                 mibReq.Type = MIB_UPLINK_COUNTER;
@@ -912,22 +1364,27 @@ static void TASK_LoRa (void *pvParameters) {
                                     *next_tx = false;
                                 }
 
-                                uint32_t mac_cmd_buffer_idx;
+                                uint32_t mac_cmd_buffer_idx = 0;
                                 modlora_nvs_get_uint(E_LORA_NVS_MAC_CMD_BUF_IDX, (uint32_t *)&mac_cmd_buffer_idx);
                                 uint8_t *buffer_idx = LoRaMacGetMacCmdBufferIndex();
                                 *buffer_idx = mac_cmd_buffer_idx;
 
+                                // write the buffered MAC commads directly from NVRAM, only if there are any
+                                if (mac_cmd_buffer_idx > 0) {
+                                    length = 128;
+                                    modlora_nvs_get_blob(E_LORA_NVS_ELE_MAC_BUF, (void *)LoRaMacGetMacCmdBuffer(), &length);
+                                }
+
+                                mac_cmd_buffer_idx = 0;
                                 modlora_nvs_get_uint(E_LORA_NVS_MAC_CMD_BUF_RPT_IDX, (uint32_t *)&mac_cmd_buffer_idx);
                                 buffer_idx = LoRaMacGetMacCmdBufferRepeatIndex();
                                 *buffer_idx = mac_cmd_buffer_idx;
 
-                                // write the buffered MAC commads directly from NVRAM
-                                length = 128;
-                                modlora_nvs_get_blob(E_LORA_NVS_ELE_MAC_BUF, (void *)LoRaMacGetMacCmdBuffer(), &length);
-
                                 // write the buffered MAC commads to repeat directly from NVRAM
-                                length = 128;
-                                modlora_nvs_get_blob(E_LORA_NVS_ELE_MAC_RPT_BUF, (void *)LoRaMacGetMacCmdBufferRepeat(), &length);
+                                if (mac_cmd_buffer_idx > 0) {
+                                    length = 128;
+                                    modlora_nvs_get_blob(E_LORA_NVS_ELE_MAC_RPT_BUF, (void *)LoRaMacGetMacCmdBufferRepeat(), &length);
+                                }
 
                                 lora_obj.activation = E_LORA_ACTIVATION_ABP;
                                 lora_obj.state = E_LORA_STATE_JOIN;
@@ -946,6 +1403,7 @@ static void TASK_LoRa (void *pvParameters) {
                         RadioEvents.TxTimeout = OnTxTimeout;
                         RadioEvents.RxTimeout = OnRxTimeout;
                         RadioEvents.RxError = OnRxError;
+                        RadioEvents.CadDone = OnCadDone;
                         Radio.Init(&RadioEvents);
 
                         // radio configuration
@@ -978,21 +1436,17 @@ static void TASK_LoRa (void *pvParameters) {
                     break;
                 case E_LORA_CMD_TX:
                     // implement Listen-before-Talk LBT, only for LoRa RAW (not LoRaWAN)
-                    if (lora_lbt_is_free()) {
-                        // no activity detected on Lora, so send the pack now
-
-                        // taking sigfox semaphore blocks ?!?!?
-                        // maybe, in the end of TX sempahore has to be released sooner
-//                        #if defined(FIPY) || defined(LOPY4)
-//                            xSemaphoreTake(xLoRaSigfoxSem, portMAX_DELAY);
-//                        #endif
-                        Radio.Send(task_cmd_data.info.tx.data, task_cmd_data.info.tx.len);
-                        lora_obj.state = E_LORA_STATE_TX;
-                    } else {
-                        // activity detected on Lora, so put the TX command back on queue on Front
-                        // to be executed on next Lora task
-                        xQueueSendToFront(xCmdQueue, (void *)&task_cmd_data, (TickType_t)portMAX_DELAY);
-                    }
+                    memcpy(&lora_lbt_data.tx, &task_cmd_data.info.tx, sizeof(lora_lbt_data.tx));
+                    lora_lbt_data.attempts = 0;
+                    lora_lbt_data.next_try = xTaskGetTickCount();
+                    lora_lbt_data.pending = true;
+                    lora_lbt_process();
+                    break;
+                case E_LORA_CMD_TX_AT:
+                    // the channel isn't sensed, the slot is owned by the sender
+                    memcpy(&lora_tx_at_data.frame, &task_cmd_data.info.tx_at, sizeof(lora_tx_at_data.frame));
+                    lora_tx_at_data.pending = true;
+                    lora_tx_at_process();
                     break;
                 case E_LORA_CMD_CONFIG_CHANNEL:
                     if (task_cmd_data.info.channel.add) {
@@ -1006,69 +1460,8 @@ static void TASK_LoRa (void *pvParameters) {
                     }
                     xEventGroupSetBits(LoRaEvents, LORA_STATUS_COMPLETED);
                     break;
-                case E_LORA_CMD_LORAWAN_TX: {
-                        LoRaMacTxInfo_t txInfo;
-                        EventBits_t status = 0;
-                        bool empty_frame = false;
-                        int8_t mac_datarate = 0;
-
-                        // set the new data rate before checking if Tx is possible, but store the current one
-                        if (!lora_obj.adr) {
-                            mibReq.Type = MIB_CHANNELS_DATARATE;
-                            LoRaMacMibGetRequestConfirm( &mibReq );
-                            mac_datarate = mibReq.Param.ChannelsDatarate;
-                            mibReq.Param.ChannelsDatarate = task_cmd_data.info.tx.dr;
-                            LoRaMacMibSetRequestConfirm( &mibReq );
-                        }
-
-                        if (LoRaMacQueryTxPossible (task_cmd_data.info.tx.len, &txInfo) != LORAMAC_STATUS_OK) {
-                            // send an empty frame in order to flush MAC commands
-                            mcpsReq.Type = MCPS_UNCONFIRMED;
-                            mcpsReq.Req.Unconfirmed.fBuffer = NULL;
-                            mcpsReq.Req.Unconfirmed.fBufferSize = 0;
-                            mcpsReq.Req.Unconfirmed.Datarate = task_cmd_data.info.tx.dr;
-                            empty_frame = true;
-                            status |= LORA_STATUS_MSG_SIZE;
-                        } else {
-                            if (task_cmd_data.info.tx.confirmed) {
-                                mcpsReq.Type = MCPS_CONFIRMED;
-                                mcpsReq.Req.Confirmed.fPort = task_cmd_data.info.tx.port;
-                                mcpsReq.Req.Confirmed.fBuffer = task_cmd_data.info.tx.data;
-                                mcpsReq.Req.Confirmed.fBufferSize = task_cmd_data.info.tx.len;
-                                mcpsReq.Req.Confirmed.NbTrials = lora_obj.tx_retries + 1;
-                                mcpsReq.Req.Confirmed.Datarate = task_cmd_data.info.tx.dr;
-                            } else {
-                                mcpsReq.Type = MCPS_UNCONFIRMED;
-                                mcpsReq.Req.Unconfirmed.fPort = task_cmd_data.info.tx.port;
-                                mcpsReq.Req.Unconfirmed.fBuffer = task_cmd_data.info.tx.data;
-                                mcpsReq.Req.Unconfirmed.fBufferSize = task_cmd_data.info.tx.len;
-                                mcpsReq.Req.Unconfirmed.Datarate = task_cmd_data.info.tx.dr;
-                            }
-                        }
-                    #if defined(FIPY) || defined(LOPY4)
-                        xSemaphoreTake(xLoRaSigfoxSem, portMAX_DELAY);
-                    #endif
-
-                        // set back the original datarate
-                        if (!lora_obj.adr) {
-                            mibReq.Param.ChannelsDatarate = mac_datarate;
-                            LoRaMacMibSetRequestConfirm( &mibReq );
-                        }
-
-                        if (LoRaMacMcpsRequest(&mcpsReq) != LORAMAC_STATUS_OK || empty_frame) {
-                            // the command has failed, send the response now
-                            lora_obj.state = E_LORA_STATE_IDLE;
-                            status |= LORA_STATUS_ERROR;
-                            xEventGroupSetBits(LoRaEvents, status);
-                        #if defined(FIPY) || defined(LOPY4)
-                            xSemaphoreGive(xLoRaSigfoxSem);
-                        #endif
-                        } else {
-                            lora_obj.state = E_LORA_STATE_TX;
-                        }
-                    }
-                    break;
                 case E_LORA_CMD_SLEEP:
+                    lora_sniff_sleep_end();
                     Radio.Sleep();
                     lora_obj.state = E_LORA_STATE_SLEEP;
                     xEventGroupSetBits(LoRaEvents, LORA_STATUS_COMPLETED);
@@ -1078,16 +1471,34 @@ static void TASK_LoRa (void *pvParameters) {
                     break;
                 case E_LORA_CMD_WAKE_UP:
                     // just enable the receiver again
-                    Radio.Rx(LORA_RX_TIMEOUT);
-                    lora_obj.state = E_LORA_STATE_RX;
+                    lora_rx_resume();
                     xEventGroupSetBits(LoRaEvents, LORA_STATUS_COMPLETED);
                 #if defined(FIPY) || defined(LOPY4)
                     xSemaphoreGive(xLoRaSigfoxSem);
                 #endif
                     break;
+                case E_LORA_CMD_SNIFF:
+                    lora_sniff_setup(task_cmd_data.info.sniff.interval_ms, task_cmd_data.info.sniff.rx_window_ms);
+                    xEventGroupSetBits(LoRaEvents, LORA_STATUS_COMPLETED);
+                    break;
+                case E_LORA_CMD_SCAN:
+                    lora_scan_setup(&task_cmd_data.info.scan);
+                    xEventGroupSetBits(LoRaEvents, LORA_STATUS_COMPLETED);
+                    break;
                 default:
                     break;
                 }
+            } else if (lora_obj.state == E_LORA_STATE_IDLE || lora_obj.state == E_LORA_STATE_RX) {
+                // no command pending, so give the MAC the next uplink (if any)
+                lorawan_uplink_schedule();
+            } else if (lora_obj.state == E_LORA_STATE_SNIFF && (int32_t)(xTaskGetTickCount() - lora_sniff_data.next_cad) >= 0) {
+                // time to look for a preamble
+                lora_sniff_sleep_end();
+                lora_scan_hop();
+                lora_sniff_data.cad_start = xTaskGetTickCount();
+                lora_sniff_data.cad_count++;
+                lora_obj.state = E_LORA_STATE_CAD;
+                Radio.StartCad();
 //            } else if (lora_obj.state == E_LORA_STATE_IDLE && lora_obj.stack_mode == E_LORA_STACK_MODE_LORA) {
 //                Radio.Rx(LORA_RX_TIMEOUT);
 //                lora_obj.state = E_LORA_STATE_RX;
@@ -1151,11 +1562,39 @@ static void TASK_LoRa (void *pvParameters) {
         case E_LORA_STATE_RX_DONE:
         case E_LORA_STATE_RX_TIMEOUT:
         case E_LORA_STATE_RX_ERROR:
+            lora_sniff_data.rx_done = (lora_obj.state == E_LORA_STATE_RX_DONE);
             // we need to perform a mode transition in order to clear the TxRx FIFO
             Radio.Sleep();
             //lora_obj.state = E_LORA_STATE_IDLE;
+            lora_rx_resume();
+            break;
+        case E_LORA_STATE_CAD:
+            if ((xTaskGetTickCount() - lora_sniff_data.cad_start) * portTICK_PERIOD_MS < LORA_SNIFF_CAD_TIMEOUT_MS) {
+                break;
+            }
+            // no CAD done interrupt, give up on this window
+            // fall through
+        case E_LORA_STATE_CAD_DONE:
+            lora_sniff_data.cad_ms += (xTaskGetTickCount() - lora_sniff_data.cad_start) * portTICK_PERIOD_MS;
+            Radio.Sleep();
+            lora_rx_resume();
+            break;
+        case E_LORA_STATE_CAD_DETECTED:
+            // a preamble is on the air, listen until its packet is received or the window ends
+            lora_sniff_data.rx_start = xTaskGetTickCount();
+            lora_sniff_data.cad_ms += (lora_sniff_data.rx_start - lora_sniff_data.cad_start) * portTICK_PERIOD_MS;
+            lora_sniff_data.detections++;
+            lora_sniff_data.rx_open = true;
+            if (lora_scan_data.count > 0) {
+                lora_scan_data.stats[lora_scan_data.index].detections++;
+            }
             lora_obj.state = E_LORA_STATE_RX;
-            Radio.Rx(LORA_RX_TIMEOUT);
+            if (lora_sniff_data.rx_window_ms > 0) {
+                Radio.Rx(lora_sniff_data.rx_window_ms);
+            } else {
+                // the preamble of the sender lasts an interval, so listen for an interval plus a packet
+                Radio.Rx(lora_sniff_data.interval_ms + Radio.TimeOnAir(MODEM_LORA, LORA_PAYLOAD_SIZE_MAX));
+            }
             break;
         case E_LORA_STATE_TX:
             break;
@@ -1164,19 +1603,18 @@ static void TASK_LoRa (void *pvParameters) {
             Radio.Sleep();
             xEventGroupSetBits(LoRaEvents, LORA_STATUS_COMPLETED);
             //lora_obj.state = E_LORA_STATE_IDLE;
-            lora_obj.state = E_LORA_STATE_RX;
-            Radio.Rx(LORA_RX_TIMEOUT);
+            lora_rx_resume();
         #if defined(FIPY) || defined(LOPY4)
             xSemaphoreGive(xLoRaSigfoxSem);
         #endif
             break;
         case E_LORA_STATE_TX_TIMEOUT:
+            lora_ot_tx_report(lora_ot_tx.on_air, LORA_OT_TX_FAILED);
             // we need to perform a mode transition in order to clear the TxRx FIFO
             Radio.Sleep();
             xEventGroupSetBits(LoRaEvents, LORA_STATUS_ERROR);
             //lora_obj.state = E_LORA_STATE_IDLE;
-            lora_obj.state = E_LORA_STATE_RX;
-            Radio.Rx(LORA_RX_TIMEOUT);
+            lora_rx_resume();
         #if defined(FIPY) || defined(LOPY4)
             xSemaphoreGive(xLoRaSigfoxSem);
         #endif
@@ -1200,6 +1638,10 @@ static void TASK_LoRa_Timer (void *pvParameters) {
             {
                 cb();
             }
+            else if (xCbQueueNext != NULL)
+            {
+                lora_cb_queue_switch();
+            }
         }
     }
 }
@@ -1213,8 +1655,8 @@ static void TASK_LoRa_Timer (void *pvParameters) {
 
 static bool lora_lbt_is_free(void)
 {
-    int16_t rssi_th = -85;
-    int timeout_us = 1000; //[microsec]
+    int16_t rssi_th = lora_lbt_data.threshold;
+    int timeout_us = LORA_LBT_SENSE_US; //[microsec]
     bool is_free = true;
 
     int rssi = -1000;
@@ -1238,6 +1680,173 @@ static bool lora_lbt_is_free(void)
     return is_free;
 }
 
+// sends the pending raw frame if the channel is free, otherwise retries after a random backoff
+// whose window doubles on every busy attempt
+static void lora_lbt_process(void)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    if ((int32_t)(now - lora_lbt_data.next_try) < 0) {
+        return;
+    }
+
+    if (lora_lbt_is_free()) {
+        // no activity detected on Lora, so send the pack now
+
+        // taking sigfox semaphore blocks ?!?!?
+        // maybe, in the end of TX sempahore has to be released sooner
+//        #if defined(FIPY) || defined(LOPY4)
+//            xSemaphoreTake(xLoRaSigfoxSem, portMAX_DELAY);
+//        #endif
+        lora_lbt_data.pending = false;
+        lora_sniff_sleep_end();
+        lora_scan_restore();
+        MPTRACE(MPTRACE_LORA_TX_START, lora_lbt_data.tx.len, 0);
+        lora_ot_tx.on_air = lora_lbt_data.tx.tag;
+        Radio.Send(lora_lbt_data.tx.data, lora_lbt_data.tx.len);
+        lora_obj.state = E_LORA_STATE_TX;
+        return;
+    }
+
+    lora_lbt_data.busy++;
+    lora_lbt_data.attempts++;
+    if (lora_lbt_data.max_attempts > 0 && lora_lbt_data.attempts >= lora_lbt_data.max_attempts) {
+        // give up on this frame
+        lora_lbt_data.pending = false;
+        lora_lbt_data.failed++;
+        lora_ot_tx_report(lora_lbt_data.tx.tag, LORA_OT_TX_FAILED);
+        lora_obj.events |= MODLORA_TX_FAILED_EVENT;
+        if (lora_obj.trigger & MODLORA_TX_FAILED_EVENT) {
+            mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
+        }
+        xEventGroupSetBits(LoRaEvents, LORA_STATUS_ERROR | LORA_STATUS_CHANNEL_BUSY);
+        return;
+    }
+
+    uint32_t exp = (lora_lbt_data.attempts - 1) < LORA_LBT_BACKOFF_EXP_MAX ? (lora_lbt_data.attempts - 1) : LORA_LBT_BACKOFF_EXP_MAX;
+    uint32_t window_ms = (uint32_t)lora_lbt_data.backoff_ms << exp;
+    lora_lbt_data.next_try = now + (1 + (rng_get() % window_ms)) / portTICK_PERIOD_MS;
+}
+
+// the LoRa task polls every 2 ms, so the frame is picked up less than LORA_TX_AT_SPIN_US ahead
+// and the rest is spent spinning, Radio.Send() is started its own latency before the time
+static void lora_tx_at_process(void)
+{
+    uint32_t at_us = lora_tx_at_data.frame.at_us;
+    int32_t remaining = (int32_t)(at_us - lora_tx_at_data.latency_us - (uint32_t)mp_hal_ticks_us_non_blocking());
+
+    if (remaining > LORA_TX_AT_SPIN_US) {
+        return;
+    }
+
+    lora_tx_at_data.pending = false;
+    if (remaining < -LORA_TX_AT_LATE_US) {
+        // the slot is gone, sending now would only collide
+        lora_tx_at_data.missed++;
+        lora_obj.events |= MODLORA_TX_FAILED_EVENT;
+        if (lora_obj.trigger & MODLORA_TX_FAILED_EVENT) {
+            mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
+        }
+        xEventGroupSetBits(LoRaEvents, LORA_STATUS_ERROR);
+        return;
+    }
+
+    lora_sniff_sleep_end();
+    lora_scan_restore();
+    while ((int32_t)(at_us - lora_tx_at_data.latency_us - (uint32_t)mp_hal_ticks_us_non_blocking()) > 0);
+
+    uint32_t start = mp_hal_ticks_us_non_blocking();
+    MPTRACE(MPTRACE_LORA_TX_START, lora_tx_at_data.frame.tx.len, 0);
+    lora_ot_tx.on_air = 0;
+    Radio.Send(lora_tx_at_data.frame.tx.data, lora_tx_at_data.frame.tx.len);
+    uint32_t end = mp_hal_ticks_us_non_blocking();
+    lora_obj.state = E_LORA_STATE_TX;
+
+    int32_t error = (int32_t)(end - at_us);
+    if (lora_tx_at_data.sent++ == 0) {
+        lora_tx_at_data.latency_us = end - start;
+    } else {
+        lora_tx_at_data.latency_us += ((int32_t)(end - start) - lora_tx_at_data.latency_us) / 4;
+    }
+    lora_tx_at_data.error_sum_us += error;
+    lora_tx_at_data.error_last_us = error;
+    if (abs(error) > lora_tx_at_data.error_max_us) {
+        lora_tx_at_data.error_max_us = abs(error);
+    }
+}
+
+// called by the MAC with every frame of the session port, false if it isn't a fragment of the session
+static bool lorawan_frag_push (const uint8_t *data, uint8_t len) {
+    if (lorawan_frag.state != E_LORAWAN_FRAG_RECEIVING || len < LORAWAN_FRAG_HDR_SIZE || data[0] != LORAWAN_FRAG_DATA_BLOCK_CID) {
+        return false;
+    }
+    uint16_t index_n = data[1] | (data[2] << 8);
+    if ((index_n >> 14) != lorawan_frag.index) {
+        return false;
+    }
+    uint32_t n = index_n & LORAWAN_FRAG_NB_MAX;
+    len -= LORAWAN_FRAG_HDR_SIZE;
+
+    portENTER_CRITICAL(&lorawan_frag_mux);
+    if (n > lorawan_frag.nb_frag) {
+        lorawan_frag.coded++;
+    } else if (n == 0 || len != lorawan_frag.frag_size || n > lorawan_frag.next + LORAWAN_FRAG_WINDOW_SLOTS) {
+        lorawan_frag.dropped++;
+    } else {
+        uint32_t slot = (n - 1) % LORAWAN_FRAG_WINDOW_SLOTS;
+        if (n <= lorawan_frag.next || (lorawan_frag.present & (1ULL << slot))) {
+            lorawan_frag.duplicates++;
+        } else {
+            // the task doesn't touch a slot until it's present
+            memcpy(&lorawan_frag.window[slot * LORAWAN_FRAG_SIZE_MAX], &data[LORAWAN_FRAG_HDR_SIZE], len);
+            lorawan_frag.present |= (1ULL << slot);
+            lorawan_frag.received++;
+        }
+    }
+    portEXIT_CRITICAL(&lorawan_frag_mux);
+    xTaskNotifyGive(xLoRaFragTaskHndl);
+    return true;
+}
+
+static void lorawan_frag_end (lorawan_frag_state_t state) {
+    lorawan_frag.state = state;
+    lora_obj.events |= MODLORA_FRAG_DONE_EVENT;
+    if (lora_obj.trigger & MODLORA_FRAG_DONE_EVENT) {
+        mp_irq_queue_interrupt_non_ISR(lora_callback_handler, (void *)&lora_obj);
+    }
+}
+
+// writes the fragments in order, the flash writes never delay the MAC
+static void TASK_LoRa_Frag (void *pvParameters) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xSemaphoreTake(lorawan_frag_lock, portMAX_DELAY);
+        while (lorawan_frag.state == E_LORAWAN_FRAG_RECEIVING) {
+            uint32_t slot = lorawan_frag.next % LORAWAN_FRAG_WINDOW_SLOTS;
+            if (!(lorawan_frag.present & (1ULL << slot))) {
+                break;
+            }
+            uint32_t len = lorawan_frag.frag_size;
+            if (lorawan_frag.next + 1 == lorawan_frag.nb_frag) {
+                len -= lorawan_frag.padding;
+            }
+            bool written = updater_async_write(&lorawan_frag.window[slot * LORAWAN_FRAG_SIZE_MAX], len);
+            portENTER_CRITICAL(&lorawan_frag_mux);
+            lorawan_frag.present &= ~(1ULL << slot);
+            lorawan_frag.next++;
+            portEXIT_CRITICAL(&lorawan_frag_mux);
+            if (!written) {
+                lorawan_frag_end(E_LORAWAN_FRAG_FAILED);
+            } else if (lorawan_frag.next == lorawan_frag.nb_frag) {
+                // the image is activated only if its digest matches
+                written = updater_async_flush() && updater_finish();
+                lorawan_frag_end(written ? E_LORAWAN_FRAG_DONE : E_LORAWAN_FRAG_FAILED);
+            }
+        }
+        xSemaphoreGive(lorawan_frag_lock);
+    }
+}
+
 static void lora_callback_handler(void *arg) {
     lora_obj_t *self = arg;
 
@@ -1247,6 +1856,9 @@ static void lora_callback_handler(void *arg) {
 }
 
 static IRAM_ATTR void OnTxDone (void) {
+    MPTRACE(MPTRACE_LORA_TX_DONE, 0, 0);
+    mpenergy_message(MPENERGY_LINK_LORA, 1);
+    lora_ot_tx_report(lora_ot_tx.on_air, LORA_OT_TX_DONE);
     lora_obj.events |= MODLORA_TX_EVENT;
     if (lora_obj.trigger & MODLORA_TX_EVENT) {
         mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
@@ -1254,15 +1866,39 @@ static IRAM_ATTR void OnTxDone (void) {
     lora_obj.state = E_LORA_STATE_TX_DONE;
 }
 
+// the Mesh task is woken up by every raw transmission that ends, its queued frames go next
+static IRAM_ATTR void lora_ot_tx_report (uint8_t tag, int8_t status) {
+    lora_ot_tx.on_air = 0;
+    if (tag != 0) {
+        lora_ot_tx.status = status;
+        lora_ot_tx.tag = tag;
+    }
+#ifdef LORA_OPENTHREAD_ENABLED
+    if (xPortInIsrContext()) {
+        mesh_task_signal_from_isr();
+    } else {
+        mesh_task_signal();
+    }
+#endif
+}
+
 static IRAM_ATTR void OnRxDone (uint8_t *payload, uint32_t timestamp, uint16_t size, int16_t rssi, int8_t snr, uint8_t sf) {
+    MPTRACE(MPTRACE_LORA_RX_DONE, size, rssi);
     lora_obj.rx_timestamp = timestamp;
     lora_obj.rssi = rssi;
     lora_obj.snr = snr;
     lora_obj.sfrx = sf;
     if (size <= LORA_PAYLOAD_SIZE_MAX) {
-        memcpy((void *)rx_data_isr.data, payload, size);
-        rx_data_isr.len = size;
-        xQueueSendFromISR(xRxQueue, (void *)&rx_data_isr, NULL);
+        // while scanning the port tells the entry the frame came in on, starting at 1
+        uint8_t port = 0;
+        if (lora_scan_data.count > 0) {
+            port = lora_scan_data.index + 1;
+            lora_scan_data.stats[lora_scan_data.index].packets++;
+        }
+        lora_rx_queue_push(payload, size, port, timestamp, rssi, snr, sf);
+#ifdef LORA_OPENTHREAD_ENABLED
+        mesh_task_signal_from_isr();
+#endif
     }
 
     lora_obj.events |= MODLORA_RX_EVENT;
@@ -1278,49 +1914,184 @@ static IRAM_ATTR void OnTxTimeout (void) {
 }
 
 static IRAM_ATTR void OnRxTimeout (void) {
+    MPTRACE(MPTRACE_LORA_RX_TIMEOUT, 0, 0);
     lora_obj.state = E_LORA_STATE_RX_TIMEOUT;
 }
 
 static IRAM_ATTR void OnRxError (void) {
+    MPTRACE(MPTRACE_LORA_RX_ERROR, 0, 0);
     lora_obj.state = E_LORA_STATE_RX_ERROR;
 }
 
-static void lora_radio_setup (lora_init_cmd_data_t *init_data) {
-    uint16_t symbol_to = 8;
-
-    Radio.SetModem(MODEM_LORA);
+static IRAM_ATTR void OnCadDone (bool channelActivityDetected) {
+    lora_obj.state = channelActivityDetected ? E_LORA_STATE_CAD_DETECTED : E_LORA_STATE_CAD_DONE;
+}
 
-    if (init_data->public) {
-        Radio.Write(REG_LR_SYNCWORD, LORA_MAC_PUBLIC_SYNCWORD);
-    } else {
-        Radio.Write(REG_LR_SYNCWORD, LORA_MAC_PRIVATE_SYNCWORD);
+static void lora_sniff_sleep_end (void) {
+    if (lora_sniff_data.sleeping) {
+        lora_sniff_data.sleeping = false;
+        lora_sniff_data.sleep_ms += (xTaskGetTickCount() - lora_sniff_data.sleep_start) * portTICK_PERIOD_MS;
     }
+}
 
-    Radio.SetChannel(init_data->frequency);
-
-    Radio.SetTxConfig(MODEM_LORA, init_data->tx_power, 0, init_data->bandwidth,
-                                  init_data->sf, init_data->coding_rate,
-                                  init_data->preamble, LORA_FIX_LENGTH_PAYLOAD_OFF,
-                                  true, 0, 0, init_data->txiq, LORA_TX_TIMEOUT_MAX);
-
-    Radio.SetRxConfig(MODEM_LORA, init_data->bandwidth, init_data->sf,
-                                  init_data->coding_rate, 0, init_data->preamble,
-                                  symbol_to, LORA_FIX_LENGTH_PAYLOAD_OFF,
-                                  0, true, 0, 0, init_data->rxiq, true);
+// goes back to listening once the radio is done with a packet, either continuously or in CAD windows
+static void lora_rx_resume (void) {
+    TickType_t now = xTaskGetTickCount();
 
-    Radio.SetMaxPayloadLength(MODEM_LORA, LORA_PAYLOAD_SIZE_MAX);
+    if (lora_sniff_data.rx_open) {
+        lora_sniff_data.rx_open = false;
+        lora_sniff_data.rx_ms += (now - lora_sniff_data.rx_start) * portTICK_PERIOD_MS;
+        if (lora_sniff_data.rx_done) {
+            lora_sniff_data.packets++;
+        } else {
+            lora_sniff_data.false_wakeups++;
+        }
+    }
+    lora_sniff_data.rx_done = false;
 
-    if (init_data->power_mode == E_LORA_MODE_ALWAYS_ON) {
-        // start listening
-        Radio.Rx(LORA_RX_TIMEOUT);
-        lora_obj.state = E_LORA_STATE_RX;
-    } else {
+    if (lora_sniff_data.interval_ms > 0) {
         Radio.Sleep();
-        lora_obj.state = E_LORA_STATE_SLEEP;
+        if (!lora_sniff_data.sleeping) {
+            lora_sniff_data.sleeping = true;
+            lora_sniff_data.sleep_start = now;
+        }
+        // keep the CAD windows on their period, unless a packet made us miss one
+        lora_sniff_data.next_cad = lora_sniff_data.cad_start + (lora_sniff_data.interval_ms / portTICK_PERIOD_MS);
+        if ((int32_t)(now - lora_sniff_data.next_cad) > 0) {
+            lora_sniff_data.next_cad = now;
+        }
+        lora_obj.state = E_LORA_STATE_SNIFF;
+    } else if (lora_scan_data.count > 0) {
+        // the next CAD right away, maybe on the next entry
+        Radio.Standby();
+        lora_sniff_data.next_cad = now;
+        lora_obj.state = E_LORA_STATE_SNIFF;
+    } else {
+        lora_obj.state = E_LORA_STATE_RX;
+        Radio.Rx(LORA_RX_TIMEOUT);
     }
 }
 
-static void lora_validate_mode (uint32_t mode) {
+static void lora_sniff_setup (uint32_t interval_ms, uint32_t rx_window_ms) {
+    lora_sniff_sleep_end();
+    lora_sniff_data.interval_ms = interval_ms;
+    if (interval_ms > 0) {
+        // a single channel is sniffed
+        lora_scan_data.count = 0;
+        lora_scan_restore();
+        lora_sniff_data.rx_window_ms = rx_window_ms;
+        lora_sniff_data.cad_count = 0;
+        lora_sniff_data.detections = 0;
+        lora_sniff_data.packets = 0;
+        lora_sniff_data.false_wakeups = 0;
+        lora_sniff_data.cad_ms = 0;
+        lora_sniff_data.rx_ms = 0;
+        lora_sniff_data.sleep_ms = 0;
+        // first CAD right away
+        lora_sniff_data.cad_start = xTaskGetTickCount() - (interval_ms / portTICK_PERIOD_MS);
+    }
+    if (lora_obj.pwr_mode == E_LORA_MODE_ALWAYS_ON &&
+        (lora_obj.state == E_LORA_STATE_RX || lora_obj.state == E_LORA_STATE_SNIFF)) {
+        Radio.Sleep();
+        lora_rx_resume();
+    }
+}
+
+static void lora_scan_setup (lora_scan_cmd_data_t *scan) {
+    lora_sniff_sleep_end();
+    memcpy(lora_scan_data.entries, scan->entries, sizeof(lora_scan_data.entries));
+    memset(lora_scan_data.stats, 0, sizeof(lora_scan_data.stats));
+    lora_scan_data.count = scan->count;
+    if (scan->count > 0) {
+        // listens continuously, hopping from the first entry on the next CAD
+        lora_sniff_data.interval_ms = 0;
+        lora_scan_data.index = scan->count - 1;
+        lora_scan_data.dwell_end = xTaskGetTickCount();
+    } else {
+        lora_scan_restore();
+    }
+    if (lora_obj.pwr_mode == E_LORA_MODE_ALWAYS_ON &&
+        (lora_obj.state == E_LORA_STATE_RX || lora_obj.state == E_LORA_STATE_SNIFF)) {
+        Radio.Sleep();
+        lora_rx_resume();
+    }
+}
+
+// picks the entry of the next CAD, the radio is only set up again when it changes
+static void lora_scan_hop (void) {
+    if (lora_scan_data.count == 0) {
+        return;
+    }
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(now - lora_scan_data.dwell_end) >= 0) {
+        lora_scan_data.index = (lora_scan_data.index + 1) % lora_scan_data.count;
+        lora_scan_data.dwell_end = now + lora_scan_data.entries[lora_scan_data.index].dwell_ms / portTICK_PERIOD_MS;
+    }
+    if (lora_scan_data.tuned != lora_scan_data.index) {
+        lora_scan_entry_t *entry = &lora_scan_data.entries[lora_scan_data.index];
+        Radio.SetChannel(entry->frequency);
+        Radio.SetRxConfig(MODEM_LORA, entry->bandwidth, entry->sf,
+                                      lora_obj.coding_rate, 0, lora_obj.preamble,
+                                      8, LORA_FIX_LENGTH_PAYLOAD_OFF,
+                                      0, true, 0, 0, lora_obj.rxiq, true);
+        lora_scan_data.tuned = lora_scan_data.index;
+    }
+    lora_scan_data.stats[lora_scan_data.index].cads++;
+}
+
+// back to the configured channel, before sending or once the scan is over
+static void lora_scan_restore (void) {
+    if (lora_scan_data.tuned == 0xFF) {
+        return;
+    }
+    Radio.SetChannel(lora_obj.frequency);
+    Radio.SetTxConfig(MODEM_LORA, lora_obj.tx_power, 0, lora_obj.bandwidth,
+                                  lora_obj.sf, lora_obj.coding_rate,
+                                  lora_obj.preamble, LORA_FIX_LENGTH_PAYLOAD_OFF,
+                                  true, 0, 0, lora_obj.txiq, LORA_TX_TIMEOUT_MAX);
+    Radio.SetRxConfig(MODEM_LORA, lora_obj.bandwidth, lora_obj.sf,
+                                  lora_obj.coding_rate, 0, lora_obj.preamble,
+                                  8, LORA_FIX_LENGTH_PAYLOAD_OFF,
+                                  0, true, 0, 0, lora_obj.rxiq, true);
+    lora_scan_data.tuned = 0xFF;
+}
+
+static void lora_radio_setup (lora_init_cmd_data_t *init_data) {
+    uint16_t symbol_to = 8;
+
+    Radio.SetModem(MODEM_LORA);
+
+    if (init_data->public) {
+        Radio.Write(REG_LR_SYNCWORD, LORA_MAC_PUBLIC_SYNCWORD);
+    } else {
+        Radio.Write(REG_LR_SYNCWORD, LORA_MAC_PRIVATE_SYNCWORD);
+    }
+
+    Radio.SetChannel(init_data->frequency);
+    lora_scan_data.tuned = 0xFF;
+
+    Radio.SetTxConfig(MODEM_LORA, init_data->tx_power, 0, init_data->bandwidth,
+                                  init_data->sf, init_data->coding_rate,
+                                  init_data->preamble, LORA_FIX_LENGTH_PAYLOAD_OFF,
+                                  true, 0, 0, init_data->txiq, LORA_TX_TIMEOUT_MAX);
+
+    Radio.SetRxConfig(MODEM_LORA, init_data->bandwidth, init_data->sf,
+                                  init_data->coding_rate, 0, init_data->preamble,
+                                  symbol_to, LORA_FIX_LENGTH_PAYLOAD_OFF,
+                                  0, true, 0, 0, init_data->rxiq, true);
+
+    Radio.SetMaxPayloadLength(MODEM_LORA, LORA_PAYLOAD_SIZE_MAX);
+
+    if (init_data->power_mode == E_LORA_MODE_ALWAYS_ON) {
+        // start listening
+        lora_rx_resume();
+    } else {
+        Radio.Sleep();
+        lora_obj.state = E_LORA_STATE_SLEEP;
+    }
+}
+
+static void lora_validate_mode (uint32_t mode) {
     if (mode > E_LORA_STACK_MODE_LORAWAN) {
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "invalid mode %d", mode));
     }
@@ -1505,6 +2276,14 @@ static void lora_validate_region (LoRaMacRegion_t region) {
     }
 }
 
+static uint32_t lora_validate_queue_size (mp_obj_t size_in) {
+    mp_int_t size = mp_obj_get_int(size_in);
+    if (size < 1 || size > LORA_QUEUE_SIZE_MAX) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "queue size %d out of range", size));
+    }
+    return size;
+}
+
 
 static void lora_set_config (lora_cmd_data_t *cmd_data) {
     lora_obj.stack_mode = cmd_data->info.init.stack_mode;
@@ -1546,6 +2325,7 @@ static void lora_send_cmd (lora_cmd_data_t *cmd_data) {
     xEventGroupClearBits(LoRaEvents, LORA_STATUS_COMPLETED | LORA_STATUS_ERROR | LORA_STATUS_MSG_SIZE);
 
     xQueueSend(xCmdQueue, (void *)cmd_data, (TickType_t)portMAX_DELAY);
+    lora_cmd_queue_update_hwm();
 
     uint32_t result = xEventGroupWaitBits(LoRaEvents,
                                           LORA_STATUS_COMPLETED | LORA_STATUS_ERROR,
@@ -1573,30 +2353,36 @@ static int32_t lora_send (const byte *buf, uint32_t len, uint32_t timeout_ms) {
     cmd_data.cmd = E_LORA_CMD_TX;
     memcpy (cmd_data.info.tx.data, buf, len);
     cmd_data.info.tx.len = len;
+    cmd_data.info.tx.tag = 0;
 
     if (timeout_ms < 0) {
         // blocking mode
         timeout_ms = portMAX_DELAY;
     }
 
-    xEventGroupClearBits(LoRaEvents, LORA_STATUS_COMPLETED | LORA_STATUS_ERROR | LORA_STATUS_MSG_SIZE);
+    xEventGroupClearBits(LoRaEvents, LORA_STATUS_COMPLETED | LORA_STATUS_ERROR | LORA_STATUS_MSG_SIZE | LORA_STATUS_CHANNEL_BUSY);
 
     // just pass to the LoRa queue
     if (!xQueueSend(xCmdQueue, (void *)&cmd_data, (TickType_t)(timeout_ms / portTICK_PERIOD_MS))) {
         //printf("Q full\n");
         return 0;
     }
+    lora_cmd_queue_update_hwm();
 
     lora_obj.sftx = lora_obj.sf;
 
     if (timeout_ms != 0) {
         //printf("timeout_ms %d\n", timeout_ms);
 
-        xEventGroupWaitBits(LoRaEvents,
-                            LORA_STATUS_COMPLETED | LORA_STATUS_ERROR | LORA_STATUS_MSG_SIZE,
-                            pdTRUE,   // clear on exit
-                            pdFALSE,  // do not wait for all bits
-                            (TickType_t)portMAX_DELAY);
+        uint32_t result = xEventGroupWaitBits(LoRaEvents,
+                                              LORA_STATUS_COMPLETED | LORA_STATUS_ERROR | LORA_STATUS_MSG_SIZE | LORA_STATUS_CHANNEL_BUSY,
+                                              pdTRUE,   // clear on exit
+                                              pdFALSE,  // do not wait for all bits
+                                              (TickType_t)portMAX_DELAY);
+        if (result & LORA_STATUS_CHANNEL_BUSY) {
+            // listen-before-talk gave up
+            return -1;
+        }
     }
 
     // calculate the time on air
@@ -1608,84 +2394,488 @@ static int32_t lora_send (const byte *buf, uint32_t len, uint32_t timeout_ms) {
     return len;
 }
 
-static int32_t lora_recv (byte *buf, uint32_t len, int32_t timeout_ms, uint32_t *port) {
-    lora_rx_data_t rx_data;
-
-    if (timeout_ms < 0) {
-        // blocking mode
-        timeout_ms = portMAX_DELAY;
+// called by the radio and the LoRaWAN stack, this is the only copy made until the frame is read
+static IRAM_ATTR bool lora_rx_queue_push (const uint8_t *data, uint8_t len, uint8_t port, uint32_t timestamp, int16_t rssi, int8_t snr, uint8_t sf) {
+    pktbuf_t *pb = pktbuf_alloc(PKTBUF_OWNER_LORA);
+    if (pb == NULL) {
+        // the pool or the quota of LoRa is exhausted, counted as refused by the pool
+        return false;
     }
+    lora_rx_frame_hdr_t *hdr = (lora_rx_frame_hdr_t *)pb->meta;
+    hdr->timestamp = timestamp;
+    hdr->rssi = rssi;
+    hdr->snr = snr;
+    hdr->sf = sf;
+    hdr->port = port;
+    hdr->len = len;
+    hdr->index = 0;
+    memcpy(pb->data, data, len);
+    pb->len = len;
+    pktbuf_queue_push(&lora_rx_queue, pb);
+
+    if (xPortInIsrContext()) {
+        xSemaphoreGiveFromISR(xRxSem, NULL);
+        mp_poll_wake_from_isr();
+    } else {
+        xSemaphoreGive(xRxSem);
+        mp_poll_wake();
+    }
+    return true;
+}
 
-    // if there's a partial packet pending
-    if (lora_partial_rx_packet.size > 0) {
-        // adjust the len
-        uint32_t available_len = lora_partial_rx_packet.size - lora_partial_rx_packet.index;
-        if (available_len < len) {
-            len = available_len;
+static bool lora_link_history_alloc (uint32_t depth) {
+    lora_link_record_t *records = NULL;
+    if (depth > 0) {
+        records = heap_caps_malloc(depth * sizeof(lora_link_record_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (records == NULL) {
+            return false;
         }
+    }
+    portENTER_CRITICAL(&lora_link_history_mux);
+    lora_link_record_t *old_records = lora_link_history.records;
+    memset(&lora_link_history, 0, sizeof(lora_link_history));
+    lora_link_history.records = records;
+    lora_link_history.depth = depth;
+    portEXIT_CRITICAL(&lora_link_history_mux);
+    if (old_records != NULL) {
+        heap_caps_free(old_records);
+    }
+    return true;
+}
 
-        // get the available data
-        memcpy(buf, (void *)&lora_partial_rx_packet.data[lora_partial_rx_packet.index], len);
-        if (port != NULL) {
-            *port = rx_data.port;
+// the aggregates cover all frames since the last reset, the percentiles only the ones in the ring
+static IRAM_ATTR void lora_link_history_push (const lora_link_record_t *record) {
+    portENTER_CRITICAL(&lora_link_history_mux);
+    if (lora_link_history.depth > 0) {
+        lora_link_history.records[lora_link_history.head] = *record;
+        lora_link_history.head = (lora_link_history.head + 1) % lora_link_history.depth;
+        if (lora_link_history.count < lora_link_history.depth) {
+            lora_link_history.count++;
         }
-
-        // update the index and size values
-        lora_partial_rx_packet.index += len;
-        if (lora_partial_rx_packet.index == lora_partial_rx_packet.size) {
-            // there's no more data left
-            lora_partial_rx_packet.size = 0;
+    }
+    if (record->flags & MODLORA_LINK_DOWNLINK) {
+        // EWMA with a weight of 1/8 for the new sample, seeded by the first one
+        if (lora_link_history.downlinks++ == 0) {
+            lora_link_history.rssi_ewma = record->rssi * 16;
+            lora_link_history.snr_ewma = record->snr * 16;
+        } else {
+            lora_link_history.rssi_ewma += (record->rssi * 16 - lora_link_history.rssi_ewma) / 8;
+            lora_link_history.snr_ewma += (record->snr * 16 - lora_link_history.snr_ewma) / 8;
         }
-        // return the number of bytes received
-        return len;
-    } else if (xQueueReceive(xRxQueue, &rx_data, (TickType_t)(timeout_ms / portTICK_PERIOD_MS))) {
-        // adjust the len
-        if (rx_data.len < len) {
-            len = rx_data.len;
+    } else {
+        lora_link_history.uplinks++;
+        lora_link_history.retries += record->retries;
+        if (record->flags & MODLORA_LINK_CONFIRMED) {
+            lora_link_history.confirmed++;
+            if (record->flags & MODLORA_LINK_ACK) {
+                lora_link_history.acked++;
+            }
         }
+        if (record->flags & MODLORA_LINK_FAILED) {
+            lora_link_history.failed++;
+        }
+    }
+    portEXIT_CRITICAL(&lora_link_history_mux);
+}
+
+static void lora_rx_queue_flush (void) {
+    pktbuf_queue_flush(&lora_rx_queue);
+}
+
+// pb comes from pktbuf_queue_peek(), its reference keeps it valid even if the queue is flushed meanwhile.
+// The frame leaves the queue once it has been read entirely, or else the rest is kept for the next call.
+static void lora_rx_queue_consume (pktbuf_t *pb, uint32_t len) {
+    lora_rx_frame_hdr_t *hdr = (lora_rx_frame_hdr_t *)pb->meta;
+    hdr->index += len;
+    if (hdr->index >= hdr->len) {
+        pktbuf_queue_remove(&lora_rx_queue, pb);
+    }
+    pktbuf_unref(pb);
+}
+
+static bool lora_rx_wait (int32_t timeout_ms) {
+    TickType_t timeout;
 
-        // get the available data
-        memcpy(buf, rx_data.data, len);
-        if (port != NULL) {
-            *port = rx_data.port;
+    if (timeout_ms < 0) {
+        // blocking mode
+        timeout = portMAX_DELAY;
+    } else {
+        timeout = (TickType_t)(timeout_ms / portTICK_PERIOD_MS);
+    }
+
+    while (lora_rx_queue.count == 0) {
+        if (!xSemaphoreTake(xRxSem, timeout)) {
+            return false;
         }
+    }
+    return true;
+}
 
-        // copy the remainder to the partial data buffer
-        int32_t r_len = rx_data.len - len;
-        if (r_len > 0) {
-            memcpy((void *)lora_partial_rx_packet.data, &rx_data.data[len], r_len);
-            lora_partial_rx_packet.size = r_len;
-            lora_partial_rx_packet.index = 0;
-            lora_partial_rx_packet.port = rx_data.port;
+static int32_t lora_recv (byte *buf, uint32_t len, int32_t timeout_ms, uint32_t *port) {
+    if (!lora_rx_wait(timeout_ms)) {
+        // non-blocking sockects do not thrown timeout errors
+        if (timeout_ms == 0) {
+            return 0;
         }
-        // return the number of bytes received
-        return len;
+        // there's no data available
+        return -1;
+    }
+
+    pktbuf_t *pb = pktbuf_queue_peek(&lora_rx_queue);
+    if (pb == NULL) {
+        // flushed in the meantime
+        return 0;
+    }
+    lora_rx_frame_hdr_t *hdr = (lora_rx_frame_hdr_t *)pb->meta;
+
+    // adjust the len
+    uint32_t available_len = hdr->len - hdr->index;
+    if (available_len < len) {
+        len = available_len;
     }
-    // non-blocking sockects do not thrown timeout errors
-    if (timeout_ms == 0) {
+
+    // copy the data straight into the caller's buffer
+    memcpy(buf, &pb->data[hdr->index], len);
+    if (port != NULL) {
+        *port = hdr->port;
+    }
+    lora_rx_queue_consume(pb, len);
+
+    // return the number of bytes received
+    return len;
+}
+
+// drain as many whole frames as fit in buf, describing each one with a row of the info table
+static int32_t lora_recv_many (byte *buf, uint32_t len, int32_t *info, uint32_t max_frames, int32_t timeout_ms) {
+    uint32_t offset = 0;
+    uint32_t n_frames = 0;
+
+    if (max_frames == 0 || len == 0 || !lora_rx_wait(timeout_ms)) {
         return 0;
     }
-    // there's no data available
-    return -1;
+
+    pktbuf_t *pb;
+    while (n_frames < max_frames && (pb = pktbuf_queue_peek(&lora_rx_queue)) != NULL) {
+        lora_rx_frame_hdr_t *hdr = (lora_rx_frame_hdr_t *)pb->meta;
+        uint32_t frame_len = hdr->len - hdr->index;
+        if (frame_len > len - offset) {
+            if (n_frames > 0) {
+                // leave it for the next call
+                pktbuf_unref(pb);
+                break;
+            }
+            // not even the first frame fits, truncate it like recv() does
+            frame_len = len;
+        }
+        memcpy(&buf[offset], &pb->data[hdr->index], frame_len);
+
+        int32_t *row = &info[n_frames * LORA_RX_FRAME_INFO_FIELDS];
+        row[0] = offset;
+        row[1] = frame_len;
+        row[2] = hdr->port;
+        row[3] = hdr->rssi;
+        row[4] = hdr->snr;
+        row[5] = hdr->sf;
+        row[6] = hdr->timestamp;
+        lora_rx_queue_consume(pb, frame_len);
+        offset += frame_len;
+        n_frames++;
+    }
+    return n_frames;
 }
 
 static bool lora_rx_any (void) {
-    lora_rx_data_t rx_data;
-    if (lora_partial_rx_packet.size > 0) {
-        return true;
-    } else if (xQueuePeek(xRxQueue, &rx_data, (TickType_t)0)) {
-        return true;
+    return lora_rx_queue.count > 0;
+}
+
+static bool lora_cmd_queue_resize (uint32_t size) {
+    QueueHandle_t queue = xQueueCreate(size, sizeof(lora_cmd_data_t));
+    if (queue == NULL) {
+        return false;
     }
-    return false;
+    // the LoRa task may be receiving from the old queue, so hand it the new one
+    // and let it do the switch once it has consumed the pending commands
+    xCmdQueueNext = queue;
+    MP_THREAD_GIL_EXIT();
+    while (xCmdQueueNext != NULL) {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+    MP_THREAD_GIL_ENTER();
+    lora_cmd_queue_size = size;
+    lora_cmd_queue_hwm = 0;
+    return true;
+}
+
+// called from the LoRa task only, with the old queue empty
+static void lora_cmd_queue_switch (void) {
+    QueueHandle_t old_queue = xCmdQueue;
+
+    xCmdQueue = xCmdQueueNext;
+    xCmdQueueNext = NULL;
+    vQueueDelete(old_queue);
+}
+
+static void lora_cmd_queue_update_hwm (void) {
+    uint32_t used = lora_cmd_queue_size - uxQueueSpacesAvailable(xCmdQueue);
+    if (used > lora_cmd_queue_hwm) {
+        lora_cmd_queue_hwm = used;
+    }
+}
+
+static bool lora_cb_queue_resize (uint32_t size) {
+    QueueHandle_t queue = xQueueCreate(size, sizeof(modlora_timerCallback));
+    if (queue == NULL) {
+        return false;
+    }
+    // the timer task is always blocked on the callback queue, so hand it the new
+    // one and let it do the switch when it receives the NULL callback
+    modlora_timerCallback cb = NULL;
+    xCbQueueNext = queue;
+    lora_cb_queue_size = size;
+    lora_cb_queue_hwm = 0;
+    xQueueSend(xCbQueue, &cb, portMAX_DELAY);
+    return true;
+}
+
+// called from the timer task only
+static void lora_cb_queue_switch (void) {
+    QueueHandle_t old_queue = xCbQueue;
+    modlora_timerCallback cb;
+
+    xCbQueue = xCbQueueNext;
+    xCbQueueNext = NULL;
+    // run the callbacks that were queued behind the switch request
+    while (xQueueReceive(old_queue, &cb, 0)) {
+        if (cb != NULL) {
+            cb();
+        }
+    }
+    vQueueDelete(old_queue);
 }
 
 static bool lora_tx_space (void) {
+    if (lora_obj.stack_mode == E_LORA_STACK_MODE_LORAWAN) {
+        return lorawan_sched.count < LORAWAN_UPLINK_QUEUE_SIZE;
+    }
     if (uxQueueSpacesAvailable(xCmdQueue) > 0) {
         return true;
     }
     return false;
 }
 
+// must be called with xUplinkMutex taken
+static void lorawan_uplink_insert (const lorawan_uplink_t *uplink, bool front) {
+    uint32_t i = 0;
+    // new uplinks go behind the ones with the same priority, requeued ones in front of them
+    while (i < lorawan_sched.count && (lorawan_sched.uplinks[i].priority > uplink->priority ||
+           (!front && lorawan_sched.uplinks[i].priority == uplink->priority))) {
+        i++;
+    }
+    memmove(&lorawan_sched.uplinks[i + 1], &lorawan_sched.uplinks[i], (lorawan_sched.count - i) * sizeof(lorawan_uplink_t));
+    lorawan_sched.uplinks[i] = *uplink;
+    lorawan_sched.count++;
+}
+
+// must be called with xUplinkMutex taken
+static void lorawan_uplink_remove (uint32_t index) {
+    lorawan_sched.count--;
+    memmove(&lorawan_sched.uplinks[index], &lorawan_sched.uplinks[index + 1], (lorawan_sched.count - index) * sizeof(lorawan_uplink_t));
+    // the queue has room for a socket waiting to write
+    mp_poll_wake();
+}
+
+static uint32_t lorawan_uplink_enqueue (lorawan_uplink_t *uplink, TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+    for ( ; ; ) {
+        xSemaphoreTake(xUplinkMutex, portMAX_DELAY);
+        if (lorawan_sched.count < LORAWAN_UPLINK_QUEUE_SIZE) {
+            // sequence number 0 means "no uplink"
+            if (++lorawan_sched.next_seq == 0) {
+                lorawan_sched.next_seq = 1;
+            }
+            uplink->seq = lorawan_sched.next_seq;
+            lorawan_sched.result_seq[uplink->seq % LORAWAN_UPLINK_RESULTS] = 0;
+            lorawan_uplink_insert(uplink, false);
+            xSemaphoreGive(xUplinkMutex);
+            return uplink->seq;
+        }
+        xSemaphoreGive(xUplinkMutex);
+        if (timeout != portMAX_DELAY && (xTaskGetTickCount() - start) >= timeout) {
+            return 0;
+        }
+        vTaskDelay (LORAWAN_UPLINK_POLL_MS / portTICK_PERIOD_MS);
+    }
+}
+
+static uint32_t lorawan_uplink_wait (uint32_t seq) {
+    uint32_t slot = seq % LORAWAN_UPLINK_RESULTS;
+    for ( ; ; ) {
+        // several sockets can be waiting, so the bit is cleared by the waiters before checking
+        xEventGroupClearBits(LoRaEvents, LORA_STATUS_UPLINK_DONE);
+        if (lorawan_sched.result_seq[slot] == seq) {
+            return lorawan_sched.result[slot];
+        }
+        xEventGroupWaitBits(LoRaEvents, LORA_STATUS_UPLINK_DONE, pdFALSE, pdFALSE, (TickType_t)portMAX_DELAY);
+    }
+}
+
+static void lorawan_uplink_done (uint32_t seq, uint32_t status) {
+    if (seq != 0) {
+        uint32_t slot = seq % LORAWAN_UPLINK_RESULTS;
+        lorawan_sched.result[slot] = status;
+        lorawan_sched.result_seq[slot] = seq;
+        if (seq == lorawan_sched.active_seq) {
+            lorawan_sched.active_seq = 0;
+        }
+        xEventGroupSetBits(LoRaEvents, LORA_STATUS_UPLINK_DONE);
+    }
+}
+
+// must be called with xUplinkMutex taken
+static void lorawan_uplink_expire (uint32_t i) {
+    lorawan_uplink_done(lorawan_sched.uplinks[i].seq, LORA_STATUS_ERROR);
+    lorawan_uplink_remove(i);
+    lora_obj.events |= MODLORA_TX_FAILED_EVENT;
+    if (lora_obj.trigger & MODLORA_TX_FAILED_EVENT) {
+        mp_irq_queue_interrupt(lora_callback_handler, (void *)&lora_obj);
+    }
+}
+
+static void lorawan_uplink_flush (void) {
+    xSemaphoreTake(xUplinkMutex, portMAX_DELAY);
+    while (lorawan_sched.count > 0) {
+        lorawan_uplink_done(lorawan_sched.uplinks[0].seq, LORA_STATUS_ERROR);
+        lorawan_uplink_remove(0);
+    }
+    xSemaphoreGive(xUplinkMutex);
+    lorawan_uplink_done(lorawan_sched.active_seq, LORA_STATUS_ERROR);
+}
+
+static LoRaMacStatus_t lorawan_uplink_start (lorawan_uplink_t *uplink) {
+    MibRequestConfirm_t mibReq;
+    McpsReq_t mcpsReq;
+    LoRaMacTxInfo_t txInfo;
+    LoRaMacStatus_t mac_status;
+    EventBits_t status = 0;
+    bool empty_frame = false;
+    int8_t mac_datarate = 0;
+
+    // set the new data rate before checking if Tx is possible, but store the current one
+    if (!lora_obj.adr) {
+        mibReq.Type = MIB_CHANNELS_DATARATE;
+        LoRaMacMibGetRequestConfirm( &mibReq );
+        mac_datarate = mibReq.Param.ChannelsDatarate;
+        mibReq.Param.ChannelsDatarate = uplink->tx.dr;
+        LoRaMacMibSetRequestConfirm( &mibReq );
+    }
+
+    if (LoRaMacQueryTxPossible (uplink->tx.len, &txInfo) != LORAMAC_STATUS_OK) {
+        // send an empty frame in order to flush MAC commands
+        mcpsReq.Type = MCPS_UNCONFIRMED;
+        mcpsReq.Req.Unconfirmed.fBuffer = NULL;
+        mcpsReq.Req.Unconfirmed.fBufferSize = 0;
+        mcpsReq.Req.Unconfirmed.Datarate = uplink->tx.dr;
+        empty_frame = true;
+        status |= LORA_STATUS_MSG_SIZE;
+    } else {
+        if (uplink->tx.confirmed) {
+            mcpsReq.Type = MCPS_CONFIRMED;
+            mcpsReq.Req.Confirmed.fPort = uplink->tx.port;
+            mcpsReq.Req.Confirmed.fBuffer = uplink->tx.data;
+            mcpsReq.Req.Confirmed.fBufferSize = uplink->tx.len;
+            mcpsReq.Req.Confirmed.NbTrials = lora_obj.tx_retries + 1;
+            mcpsReq.Req.Confirmed.Datarate = uplink->tx.dr;
+        } else {
+            mcpsReq.Type = MCPS_UNCONFIRMED;
+            mcpsReq.Req.Unconfirmed.fPort = uplink->tx.port;
+            mcpsReq.Req.Unconfirmed.fBuffer = uplink->tx.data;
+            mcpsReq.Req.Unconfirmed.fBufferSize = uplink->tx.len;
+            mcpsReq.Req.Unconfirmed.Datarate = uplink->tx.dr;
+        }
+    }
+#if defined(FIPY) || defined(LOPY4)
+    xSemaphoreTake(xLoRaSigfoxSem, portMAX_DELAY);
+#endif
+
+    // set back the original datarate
+    if (!lora_obj.adr) {
+        mibReq.Param.ChannelsDatarate = mac_datarate;
+        LoRaMacMibSetRequestConfirm( &mibReq );
+    }
+
+    mac_status = LoRaMacMcpsRequest(&mcpsReq);
+    MPTRACE(MPTRACE_LORA_TX_REQUEST, empty_frame ? 0 : uplink->tx.len, uplink->tx.dr);
+    if (mac_status == LORAMAC_STATUS_BUSY) {
+        // the MAC is still busy with the previous transaction, the caller will retry
+    #if defined(FIPY) || defined(LOPY4)
+        xSemaphoreGive(xLoRaSigfoxSem);
+    #endif
+    } else if (mac_status != LORAMAC_STATUS_OK || empty_frame) {
+        // the command has failed, send the response now
+        lora_obj.state = E_LORA_STATE_IDLE;
+        status |= LORA_STATUS_ERROR;
+        lorawan_uplink_done(uplink->seq, status);
+    #if defined(FIPY) || defined(LOPY4)
+        xSemaphoreGive(xLoRaSigfoxSem);
+    #endif
+    } else {
+        // the MAC delays the transmission itself if the duty cycle doesn't allow it yet
+        lora_obj.state = E_LORA_STATE_TX;
+    }
+    return mac_status;
+}
+
+// called from the LoRa task while it is idle
+static void lorawan_uplink_schedule (void) {
+    if (lora_obj.stack_mode != E_LORA_STACK_MODE_LORAWAN || !lora_obj.joined || lorawan_sched.active_seq != 0) {
+        return;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    xSemaphoreTake(xUplinkMutex, portMAX_DELAY);
+    for (uint32_t i = 0; i < lorawan_sched.count; ) {
+        lorawan_uplink_t *uplink = &lorawan_sched.uplinks[i];
+        if (uplink->deadline != 0 && (int32_t)(now - uplink->deadline) >= 0) {
+            // too late to be useful, report it as failed
+            lorawan_uplink_expire(i);
+        } else {
+            i++;
+        }
+    }
+    while (lorawan_sched.count > 0 && lorawan_sched.uplinks[0].deadline != 0) {
+        // the duty cycle may hold the next one past its deadline, don't commit it to the MAC then
+        lorawan_uplink_t *uplink = &lorawan_sched.uplinks[0];
+        int8_t datarate = uplink->tx.dr;
+        if (lora_obj.adr) {
+            MibRequestConfirm_t mibReq;
+            mibReq.Type = MIB_CHANNELS_DATARATE;
+            LoRaMacMibGetRequestConfirm(&mibReq);
+            datarate = mibReq.Param.ChannelsDatarate;
+        }
+        TickType_t delay = LoRaMacQueryNextTxDelay(datarate) / portTICK_PERIOD_MS;
+        if ((int32_t)(now + delay - uplink->deadline) < 0) {
+            break;
+        }
+        lorawan_uplink_expire(0);
+    }
+    if (lorawan_sched.count == 0) {
+        xSemaphoreGive(xUplinkMutex);
+        return;
+    }
+    // the MAC keeps a pointer to the payload, so it's copied to a static location
+    lorawan_uplink_active = lorawan_sched.uplinks[0];
+    lorawan_uplink_remove(0);
+    xSemaphoreGive(xUplinkMutex);
+
+    lorawan_sched.active_seq = lorawan_uplink_active.seq;
+    if (lorawan_uplink_start(&lorawan_uplink_active) == LORAMAC_STATUS_BUSY) {
+        lorawan_sched.active_seq = 0;
+        xSemaphoreTake(xUplinkMutex, portMAX_DELAY);
+        lorawan_uplink_insert(&lorawan_uplink_active, true);
+        xSemaphoreGive(xUplinkMutex);
+    }
+}
+
 /******************************************************************************/
 // Micro Python bindings; LoRa class
 
@@ -1785,6 +2975,50 @@ static mp_obj_t lora_init_helper(lora_obj_t *self, const mp_arg_val_t *args) {
     cmd_data.info.init.device_class = args[13].u_int;
     lora_validate_device_class(cmd_data.info.init.device_class);
 
+    // the frames are kept in the shared packet buffer pool, this is the quota of LoRa in whole blocks
+    if (args[15].u_obj != MP_OBJ_NULL) {
+        uint32_t rx_buffer_size = mp_obj_get_int(args[15].u_obj);
+        if (rx_buffer_size < LORA_RX_BUFFER_SIZE_MIN || rx_buffer_size > LORA_RX_BUFFER_SIZE_MAX) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "rx buffer size must be between %d and %d",
+                                                    LORA_RX_BUFFER_SIZE_MIN, LORA_RX_BUFFER_SIZE_MAX));
+        }
+        pktbuf_stats_t stats;
+        pktbuf_get_stats(PKTBUF_OWNER_LORA, &stats);
+        uint32_t quota = (rx_buffer_size + PKTBUF_DATA_SIZE - 1) / PKTBUF_DATA_SIZE;
+        // the pool starts small, the blocks it's missing come from the IDF heap
+        if (!pktbuf_grow(quota)) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+        if (!pktbuf_set_quota(PKTBUF_OWNER_LORA, quota, MIN(stats.reserve, quota))) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+        }
+    }
+
+    // the queues are allocated from the IDF heap, report it if they don't fit
+    if (args[16].u_obj != MP_OBJ_NULL) {
+        uint32_t cmd_queue_size = lora_validate_queue_size(args[16].u_obj);
+        if (cmd_queue_size != lora_cmd_queue_size && !lora_cmd_queue_resize(cmd_queue_size)) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    }
+    if (args[17].u_obj != MP_OBJ_NULL) {
+        uint32_t cb_queue_size = lora_validate_queue_size(args[17].u_obj);
+        if (cb_queue_size != lora_cb_queue_size && !lora_cb_queue_resize(cb_queue_size)) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    }
+    // a new depth drops the history and the statistics, 0 disables the ring but not the statistics
+    if (args[18].u_obj != MP_OBJ_NULL) {
+        mp_int_t depth = mp_obj_get_int(args[18].u_obj);
+        if (depth < 0 || depth > LORA_LINK_HISTORY_DEPTH_MAX) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "link history depth must be between 0 and %d",
+                                                    LORA_LINK_HISTORY_DEPTH_MAX));
+        }
+        if (depth != lora_link_history.depth && !lora_link_history_alloc(depth)) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    }
+
     // send message to the lora task
     cmd_data.cmd = E_LORA_CMD_INIT;
     lora_send_cmd(&cmd_data);
@@ -1809,6 +3043,10 @@ STATIC const mp_arg_t lora_init_args[] = {
     { MP_QSTR_tx_retries,   MP_ARG_KW_ONLY  | MP_ARG_INT,   {.u_int = 2} },
     { MP_QSTR_device_class, MP_ARG_KW_ONLY  | MP_ARG_INT,   {.u_int = CLASS_A} },
     { MP_QSTR_region,       MP_ARG_KW_ONLY  | MP_ARG_OBJ,   {.u_obj = MP_OBJ_NULL} },
+    { MP_QSTR_rx_buffer_size, MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = MP_OBJ_NULL} },
+    { MP_QSTR_cmd_queue_size, MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = MP_OBJ_NULL} },
+    { MP_QSTR_cb_queue_size,  MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = MP_OBJ_NULL} },
+    { MP_QSTR_link_history,   MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = MP_OBJ_NULL} },
 };
 STATIC mp_obj_t lora_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args) {
     // parse args
@@ -1818,6 +3056,8 @@ STATIC mp_obj_t lora_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_ui
     mp_arg_val_t args[MP_ARRAY_SIZE(lora_init_args)];
     mp_arg_parse_all(n_args, all_args, &kw_args, MP_ARRAY_SIZE(args), lora_init_args, args);
 
+    modlora_init0();
+
     // setup the object
     lora_obj_t *self = (lora_obj_t *)&lora_obj;
     self->base.type = (mp_obj_t)&mod_network_nic_type_lora;
@@ -1989,6 +3229,8 @@ STATIC mp_obj_t lora_join_multicast_group (mp_uint_t n_args, const mp_obj_t *pos
         { MP_QSTR_mcAddress,    MP_ARG_REQUIRED | MP_ARG_INT, {.u_int  = -1}         },
         { MP_QSTR_mcNwkKey,     MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
         { MP_QSTR_mcAppKey,     MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_frequency,    MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0}           },
+        { MP_QSTR_dr,           MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = -1}          },
     };
     
     // parse args
@@ -1998,15 +3240,48 @@ STATIC mp_obj_t lora_join_multicast_group (mp_uint_t n_args, const mp_obj_t *pos
     mp_buffer_info_t bufinfo_0, bufinfo_1;
     mp_get_buffer_raise(args[1].u_obj, &bufinfo_0, MP_BUFFER_READ);
     mp_get_buffer_raise(args[2].u_obj, &bufinfo_1, MP_BUFFER_READ);
-    
-    MulticastParams_t *channelParam = m_new_obj(MulticastParams_t);
+    if (bufinfo_0.len != sizeof(lorawan_mc_groups[0].params.NwkSKey) || bufinfo_1.len != sizeof(lorawan_mc_groups[0].params.AppSKey)) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+
+    uint32_t mcAddr = args[0].u_int;
+    lorawan_mc_group_t *group = NULL;
+    for (int i = 0; i < LORAWAN_MC_GROUPS_MAX; i++) {
+        if (!lorawan_mc_groups[i].used) {
+            group = &lorawan_mc_groups[i];
+            break;
+        }
+    }
+    if (group == NULL || LoRaMacMulticastGetChannel(mcAddr) != NULL) {
+        return mp_const_false;
+    }
+
+    // in class C the continuous window listens on the channel of the group
+    if (args[3].u_int > 0 || args[4].u_int >= 0) {
+        MibRequestConfirm_t mibReq;
+        mibReq.Type = MIB_RX2_CHANNEL;
+        LoRaMacMibGetRequestConfirm(&mibReq);
+        if (args[3].u_int > 0) {
+            lora_validate_frequency(args[3].u_int);
+            mibReq.Param.Rx2Channel.Frequency = args[3].u_int;
+        }
+        if (args[4].u_int >= 0) {
+            mibReq.Param.Rx2Channel.Datarate = args[4].u_int;
+        }
+        if (LoRaMacMibSetRequestConfirm(&mibReq) != LORAMAC_STATUS_OK) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+    }
+
+    MulticastParams_t *channelParam = &group->params;
     channelParam->Next = NULL;
     channelParam->DownLinkCounter = 0;
-    channelParam->Address = args[0].u_int;
+    channelParam->Address = mcAddr;
     memcpy(channelParam->NwkSKey, bufinfo_0.buf, sizeof(channelParam->NwkSKey));
     memcpy(channelParam->AppSKey, bufinfo_1.buf, sizeof(channelParam->AppSKey));
     
     if (LoRaMacMulticastChannelLink(channelParam) == LORAMAC_STATUS_OK) {
+        group->used = true;
         return mp_const_true;
     }
             
@@ -2016,15 +3291,114 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(lora_join_multicast_group_obj, 0, lora_join_mu
 
 STATIC mp_obj_t lora_leave_multicast_group (mp_obj_t self_in, mp_obj_t multicast_addr_obj) {
     uint32_t mcAddr = mp_obj_get_int(multicast_addr_obj);
-    MulticastParams_t *channelParam = LoRaMacMulticastGetChannel(mcAddr);
-    if (LoRaMacMulticastChannelUnlink(channelParam) == LORAMAC_STATUS_OK) {
-        m_del_obj(MulticastParams_t, channelParam);
-        return mp_const_true;
+    for (int i = 0; i < LORAWAN_MC_GROUPS_MAX; i++) {
+        lorawan_mc_group_t *group = &lorawan_mc_groups[i];
+        if (group->used && group->params.Address == mcAddr) {
+            if (LoRaMacMulticastChannelUnlink(&group->params) == LORAMAC_STATUS_OK) {
+                group->used = false;
+                return mp_const_true;
+            }
+            break;
+        }
     }
     return mp_const_false;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(lora_leave_multicast_group_obj, lora_leave_multicast_group);
 
+STATIC mp_obj_t lora_multicast_groups (mp_obj_t self_in) {
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (int i = 0; i < LORAWAN_MC_GROUPS_MAX; i++) {
+        if (lorawan_mc_groups[i].used) {
+            mp_obj_t tuple[2];
+            tuple[0] = mp_obj_new_int_from_uint(lorawan_mc_groups[i].params.Address);
+            tuple[1] = mp_obj_new_int_from_uint(lorawan_mc_groups[i].params.DownLinkCounter);
+            mp_obj_list_append(list, mp_obj_new_tuple(2, tuple));
+        }
+    }
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_multicast_groups_obj, lora_multicast_groups);
+
+STATIC mp_obj_t lora_frag_session (mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_nb_frag,      MP_ARG_OBJ,                   {.u_obj = mp_const_none} },
+        { MP_QSTR_frag_size,    MP_ARG_INT,                   {.u_int = 0} },
+        { MP_QSTR_padding,      MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_index,        MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_port,         MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = LORAWAN_FRAG_PORT_DEFAULT} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    uint32_t nb_frag = 0;
+    if (args[0].u_obj != mp_const_none) {
+        nb_frag = mp_obj_get_int(args[0].u_obj);
+        if (nb_frag < 1 || nb_frag > LORAWAN_FRAG_NB_MAX || args[1].u_int < 1 || args[1].u_int > LORAWAN_FRAG_SIZE_MAX ||
+            args[2].u_int < 0 || args[2].u_int >= args[1].u_int || args[3].u_int < 0 || args[3].u_int > LORAWAN_FRAG_INDEX_MAX ||
+            args[4].u_int < 1 || args[4].u_int > 223) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+    }
+    if (!lorawan_frag_init()) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+
+    // the current session ends once the fragment being written is done
+    MP_THREAD_GIL_EXIT();
+    xSemaphoreTake(lorawan_frag_lock, portMAX_DELAY);
+    MP_THREAD_GIL_ENTER();
+    portENTER_CRITICAL(&lorawan_frag_mux);
+    lorawan_frag.state = E_LORAWAN_FRAG_IDLE;
+    portEXIT_CRITICAL(&lorawan_frag_mux);
+
+    if (nb_frag > 0) {
+        if (!updater_async_start()) {
+            xSemaphoreGive(lorawan_frag_lock);
+            mp_raise_OSError(MP_EIO);
+        }
+        portENTER_CRITICAL(&lorawan_frag_mux);
+        lorawan_frag.present = 0;
+        lorawan_frag.nb_frag = nb_frag;
+        lorawan_frag.next = 0;
+        lorawan_frag.frag_size = args[1].u_int;
+        lorawan_frag.padding = args[2].u_int;
+        lorawan_frag.index = args[3].u_int;
+        lorawan_frag.port = args[4].u_int;
+        lorawan_frag.received = 0;
+        lorawan_frag.duplicates = 0;
+        lorawan_frag.dropped = 0;
+        lorawan_frag.coded = 0;
+        lorawan_frag.state = E_LORAWAN_FRAG_RECEIVING;
+        portEXIT_CRITICAL(&lorawan_frag_mux);
+    }
+    xSemaphoreGive(lorawan_frag_lock);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(lora_frag_session_obj, 1, lora_frag_session);
+
+STATIC mp_obj_t lora_frag_stats (mp_obj_t self_in) {
+    mp_obj_t tuple[6];
+    portENTER_CRITICAL(&lorawan_frag_mux);
+    lorawan_frag_t frag = lorawan_frag;
+    portEXIT_CRITICAL(&lorawan_frag_mux);
+
+    // None while the session is running, then whether the image was written and activated
+    if (frag.state == E_LORAWAN_FRAG_DONE || frag.state == E_LORAWAN_FRAG_FAILED) {
+        tuple[0] = mp_obj_new_bool(frag.state == E_LORAWAN_FRAG_DONE);
+    } else {
+        tuple[0] = mp_const_none;
+    }
+    tuple[1] = mp_obj_new_int(frag.next);
+    tuple[2] = mp_obj_new_int_from_uint(frag.received);
+    tuple[3] = mp_obj_new_int_from_uint(frag.duplicates);
+    tuple[4] = mp_obj_new_int_from_uint(frag.dropped);
+    tuple[5] = mp_obj_new_int_from_uint(frag.coded);
+    return mp_obj_new_tuple(6, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_frag_stats_obj, lora_frag_stats);
+
 STATIC mp_obj_t lora_compliance_test(mp_uint_t n_args, const mp_obj_t *args) {
     // get
     if (n_args == 1) {
@@ -2202,6 +3576,254 @@ STATIC mp_obj_t lora_power_mode(mp_uint_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(lora_power_mode_obj, 1, 2, lora_power_mode);
 
+// low-power listening of the raw LoRa mode: the radio sleeps and wakes up every interval to run a CAD,
+// and only opens an RX window when a preamble is detected. interval=0 listens continuously again
+STATIC mp_obj_t lora_sniff(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_interval,       MP_ARG_OBJ,                   {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_rx_window,      MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = 0} },
+    };
+    lora_cmd_data_t cmd_data;
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[0].u_obj == MP_OBJ_NULL) {
+        return mp_obj_new_int_from_uint(lora_sniff_data.interval_ms);
+    }
+
+    // the LoRaWAN MAC schedules its own receive windows
+    if (lora_obj.stack_mode != E_LORA_STACK_MODE_LORA) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+
+    mp_int_t interval = mp_obj_get_int(args[0].u_obj);
+    if (interval < 0 || args[1].u_int < 0) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+
+    cmd_data.cmd = E_LORA_CMD_SNIFF;
+    cmd_data.info.sniff.interval_ms = interval;
+    cmd_data.info.sniff.rx_window_ms = args[1].u_int;
+    lora_send_cmd (&cmd_data);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(lora_sniff_obj, 1, lora_sniff);
+
+// receiver hopping of the raw LoRa mode: the LoRa task runs CADs on each (frequency, sf, bandwidth[, dwell])
+// entry for dwell ms before moving to the next one, and listens on the entry where a preamble is detected.
+// The frames then carry the entry number, starting at 1, as their port. An empty list stops scanning
+STATIC mp_obj_t lora_scan(mp_uint_t n_args, const mp_obj_t *args) {
+    lora_cmd_data_t cmd_data;
+
+    if (n_args == 1) {
+        mp_obj_t entries = mp_obj_new_list(0, NULL);
+        for (uint32_t i = 0; i < lora_scan_data.count; i++) {
+            lora_scan_entry_t *entry = &lora_scan_data.entries[i];
+            mp_obj_t tuple[4];
+            tuple[0] = mp_obj_new_int_from_uint(entry->frequency);
+            tuple[1] = mp_obj_new_int(entry->sf);
+            tuple[2] = mp_obj_new_int(entry->bandwidth);
+            tuple[3] = mp_obj_new_int(entry->dwell_ms);
+            mp_obj_list_append(entries, mp_obj_new_tuple(4, tuple));
+        }
+        return entries;
+    }
+
+    // the LoRaWAN MAC schedules its own receive windows
+    if (lora_obj.stack_mode != E_LORA_STACK_MODE_LORA) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+
+    mp_obj_t *items;
+    size_t count;
+    mp_obj_get_array(args[1], &count, &items);
+    if (count > LORA_SCAN_ENTRIES_MAX) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "at most %d scan entries", LORA_SCAN_ENTRIES_MAX));
+    }
+
+    memset(&cmd_data.info.scan, 0, sizeof(cmd_data.info.scan));
+    for (uint32_t i = 0; i < count; i++) {
+        mp_obj_t *fields;
+        size_t n_fields;
+        mp_obj_get_array(items[i], &n_fields, &fields);
+        if (n_fields < 3 || n_fields > 4) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        lora_scan_entry_t *entry = &cmd_data.info.scan.entries[i];
+        entry->frequency = mp_obj_get_int(fields[0]);
+        lora_validate_frequency(entry->frequency);
+        entry->sf = mp_obj_get_int(fields[1]);
+        lora_validate_sf(entry->sf);
+        entry->bandwidth = mp_obj_get_int(fields[2]);
+        lora_validate_bandwidth(entry->bandwidth);
+        mp_int_t dwell = (n_fields == 4) ? mp_obj_get_int(fields[3]) : LORA_SCAN_DWELL_MS_DEFAULT;
+        if (dwell <= 0 || dwell > 0xFFFF) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        entry->dwell_ms = dwell;
+    }
+    cmd_data.info.scan.count = count;
+
+    cmd_data.cmd = E_LORA_CMD_SCAN;
+    lora_send_cmd (&cmd_data);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(lora_scan_obj, 1, 2, lora_scan);
+
+// the clock stamping the received frames, in us, for scheduling the replies with send_at()
+STATIC mp_obj_t lora_ticks_us(mp_obj_t self_in) {
+    return mp_obj_new_int_from_uint((uint32_t)mp_hal_ticks_us_non_blocking());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_ticks_us_obj, lora_ticks_us);
+
+// sends a raw frame when ticks_us() reaches at, without listen-before-talk. Blocks until it's sent
+// and returns how late it started in us, raises ETIMEDOUT if the time was missed
+STATIC mp_obj_t lora_send_at(mp_obj_t self_in, mp_obj_t buf_in, mp_obj_t at_in) {
+    lora_cmd_data_t cmd_data;
+    mp_buffer_info_t bufinfo;
+
+    if (lora_obj.stack_mode != E_LORA_STACK_MODE_LORA || lora_obj.pwr_mode == E_LORA_MODE_SLEEP) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+    if (bufinfo.len == 0 || bufinfo.len > LORA_PAYLOAD_SIZE_MAX) {
+        mp_raise_OSError(MP_EMSGSIZE);
+    }
+
+    cmd_data.cmd = E_LORA_CMD_TX_AT;
+    memcpy(cmd_data.info.tx_at.tx.data, bufinfo.buf, bufinfo.len);
+    cmd_data.info.tx_at.tx.len = bufinfo.len;
+    cmd_data.info.tx_at.at_us = mp_obj_get_int_truncated(at_in);
+
+    MP_THREAD_GIL_EXIT();
+    xEventGroupClearBits(LoRaEvents, LORA_STATUS_COMPLETED | LORA_STATUS_ERROR);
+    xQueueSend(xCmdQueue, (void *)&cmd_data, (TickType_t)portMAX_DELAY);
+    lora_cmd_queue_update_hwm();
+    uint32_t result = xEventGroupWaitBits(LoRaEvents, LORA_STATUS_COMPLETED | LORA_STATUS_ERROR,
+                                          pdTRUE, pdFALSE, (TickType_t)portMAX_DELAY);
+    MP_THREAD_GIL_ENTER();
+
+    if (result & LORA_STATUS_ERROR) {
+        mp_raise_OSError(MP_ETIMEDOUT);
+    }
+    lora_obj.sftx = lora_obj.sf;
+    lora_obj.tx_time_on_air = Radio.TimeOnAir(MODEM_LORA, bufinfo.len);
+    lora_obj.tx_counter += 1;
+    lora_obj.tx_frequency = lora_obj.frequency;
+    return mp_obj_new_int(lora_tx_at_data.error_last_us);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(lora_send_at_obj, lora_send_at);
+
+STATIC mp_obj_t lora_send_at_stats(mp_obj_t self_in) {
+    static const qstr lora_send_at_stats_fields[] = {
+        MP_QSTR_sent, MP_QSTR_missed, MP_QSTR_latency, MP_QSTR_mean_error, MP_QSTR_max_error, MP_QSTR_last_error
+    };
+
+    mp_obj_t stats_tuple[6];
+    stats_tuple[0] = mp_obj_new_int_from_uint(lora_tx_at_data.sent);
+    stats_tuple[1] = mp_obj_new_int_from_uint(lora_tx_at_data.missed);
+    stats_tuple[2] = mp_obj_new_int(lora_tx_at_data.latency_us);
+    stats_tuple[3] = mp_obj_new_int(lora_tx_at_data.sent ? (mp_int_t)(lora_tx_at_data.error_sum_us / lora_tx_at_data.sent) : 0);
+    stats_tuple[4] = mp_obj_new_int(lora_tx_at_data.error_max_us);
+    stats_tuple[5] = mp_obj_new_int(lora_tx_at_data.error_last_us);
+
+    return mp_obj_new_attrtuple(lora_send_at_stats_fields, sizeof(stats_tuple) / sizeof(stats_tuple[0]), stats_tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_send_at_stats_obj, lora_send_at_stats);
+
+// (cads, detections, packets) of each scan entry
+STATIC mp_obj_t lora_scan_stats(mp_obj_t self_in) {
+    mp_obj_t stats = mp_obj_new_list(0, NULL);
+    for (uint32_t i = 0; i < lora_scan_data.count; i++) {
+        mp_obj_t tuple[3];
+        tuple[0] = mp_obj_new_int_from_uint(lora_scan_data.stats[i].cads);
+        tuple[1] = mp_obj_new_int_from_uint(lora_scan_data.stats[i].detections);
+        tuple[2] = mp_obj_new_int_from_uint(lora_scan_data.stats[i].packets);
+        mp_obj_list_append(stats, mp_obj_new_tuple(3, tuple));
+    }
+    return stats;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_scan_stats_obj, lora_scan_stats);
+
+// listen-before-talk of the raw LoRa mode: a frame is only sent when the RSSI is below threshold,
+// otherwise the LoRa task retries it after a random exponential backoff, up to max_attempts times (0 for no limit)
+STATIC mp_obj_t lora_lbt(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_threshold,      MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_max_attempts,   MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_backoff,        MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = MP_OBJ_NULL} },
+    };
+    static const qstr lora_lbt_info_fields[] = {
+        MP_QSTR_threshold, MP_QSTR_max_attempts, MP_QSTR_backoff, MP_QSTR_busy, MP_QSTR_failed
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[0].u_obj == MP_OBJ_NULL && args[1].u_obj == MP_OBJ_NULL && args[2].u_obj == MP_OBJ_NULL) {
+        mp_obj_t lbt_tuple[5];
+        lbt_tuple[0] = mp_obj_new_int(lora_lbt_data.threshold);
+        lbt_tuple[1] = mp_obj_new_int(lora_lbt_data.max_attempts);
+        lbt_tuple[2] = mp_obj_new_int(lora_lbt_data.backoff_ms);
+        lbt_tuple[3] = mp_obj_new_int_from_uint(lora_lbt_data.busy);
+        lbt_tuple[4] = mp_obj_new_int_from_uint(lora_lbt_data.failed);
+        return mp_obj_new_attrtuple(lora_lbt_info_fields, sizeof(lbt_tuple) / sizeof(lbt_tuple[0]), lbt_tuple);
+    }
+
+    // validate everything before changing anything
+    mp_int_t threshold = lora_lbt_data.threshold;
+    mp_int_t max_attempts = lora_lbt_data.max_attempts;
+    mp_int_t backoff = lora_lbt_data.backoff_ms;
+    if (args[0].u_obj != MP_OBJ_NULL) {
+        threshold = mp_obj_get_int(args[0].u_obj);
+    }
+    if (args[1].u_obj != MP_OBJ_NULL) {
+        max_attempts = mp_obj_get_int(args[1].u_obj);
+    }
+    if (args[2].u_obj != MP_OBJ_NULL) {
+        backoff = mp_obj_get_int(args[2].u_obj);
+    }
+    if (threshold < INT16_MIN || threshold > 0 || max_attempts < 0 || max_attempts > UINT16_MAX ||
+        backoff < 1 || backoff > UINT16_MAX) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+
+    lora_lbt_data.threshold = threshold;
+    lora_lbt_data.max_attempts = max_attempts;
+    lora_lbt_data.backoff_ms = backoff;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(lora_lbt_obj, 1, lora_lbt);
+
+STATIC mp_obj_t lora_sniff_stats(mp_obj_t self_in) {
+    static const qstr lora_sniff_stats_fields[] = {
+        MP_QSTR_cad_count, MP_QSTR_detections, MP_QSTR_packets, MP_QSTR_false_wakeups,
+        MP_QSTR_cad_ms, MP_QSTR_rx_ms, MP_QSTR_sleep_ms, MP_QSTR_charge_uah
+    };
+
+    uint32_t sleep_ms = lora_sniff_data.sleep_ms;
+    if (lora_sniff_data.sleeping) {
+        sleep_ms += (xTaskGetTickCount() - lora_sniff_data.sleep_start) * portTICK_PERIOD_MS;
+    }
+    // estimate of the charge drawn by the radio, from the typical currents of the datasheet
+    uint64_t charge = ((uint64_t)lora_sniff_data.cad_ms + lora_sniff_data.rx_ms) * LORA_SNIFF_RX_CURRENT_UA +
+                      (uint64_t)sleep_ms * LORA_SNIFF_SLEEP_CURRENT_UA;
+
+    mp_obj_t stats_tuple[8];
+    stats_tuple[0] = mp_obj_new_int_from_uint(lora_sniff_data.cad_count);
+    stats_tuple[1] = mp_obj_new_int_from_uint(lora_sniff_data.detections);
+    stats_tuple[2] = mp_obj_new_int_from_uint(lora_sniff_data.packets);
+    stats_tuple[3] = mp_obj_new_int_from_uint(lora_sniff_data.false_wakeups);
+    stats_tuple[4] = mp_obj_new_int_from_uint(lora_sniff_data.cad_ms);
+    stats_tuple[5] = mp_obj_new_int_from_uint(lora_sniff_data.rx_ms);
+    stats_tuple[6] = mp_obj_new_int_from_uint(sleep_ms);
+    stats_tuple[7] = mp_obj_new_int_from_uint(charge / 3600000);
+
+    return mp_obj_new_attrtuple(lora_sniff_stats_fields, sizeof(stats_tuple) / sizeof(stats_tuple[0]), stats_tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_sniff_stats_obj, lora_sniff_stats);
+
 STATIC mp_obj_t lora_stats(mp_obj_t self_in) {
     lora_obj_t *self = self_in;
     float snr;
@@ -2237,6 +3859,118 @@ STATIC mp_obj_t lora_stats(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_stats_obj, lora_stats);
 
+// copies the latest records, the oldest first, as many as fit in the buffer; without one returns how many are held
+STATIC mp_obj_t lora_link_history_read (mp_uint_t n_args, const mp_obj_t *args) {
+    if (n_args == 1) {
+        return mp_obj_new_int_from_uint(lora_link_history.count);
+    }
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[1], &bufinfo, MP_BUFFER_WRITE);
+    lora_link_record_t *dst = bufinfo.buf;
+    uint32_t n = bufinfo.len / sizeof(lora_link_record_t);
+
+    portENTER_CRITICAL(&lora_link_history_mux);
+    if (n > lora_link_history.count) {
+        n = lora_link_history.count;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t index = (lora_link_history.head + lora_link_history.depth - n + i) % lora_link_history.depth;
+        // the buffer may not be aligned
+        memcpy(&dst[i], &lora_link_history.records[index], sizeof(lora_link_record_t));
+    }
+    portEXIT_CRITICAL(&lora_link_history_mux);
+
+    return mp_obj_new_int_from_uint(n);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(lora_link_history_obj, 1, 2, lora_link_history_read);
+
+static mp_obj_t lora_link_percentiles (const uint16_t *hist, uint32_t nbins, int32_t offset, uint32_t total, float scale) {
+    static const uint8_t pct[] = { 10, 50, 90 };
+    mp_obj_t values[3];
+    uint32_t bin = 0, acc = 0;
+
+    for (uint32_t i = 0; i < 3; i++) {
+        if (total == 0) {
+            values[i] = mp_const_none;
+            continue;
+        }
+        // nearest rank
+        uint32_t rank = (total * pct[i] + 99) / 100;
+        if (rank == 0) {
+            rank = 1;
+        }
+        while (acc + hist[bin] < rank && bin < nbins - 1) {
+            acc += hist[bin++];
+        }
+        values[i] = mp_obj_new_float(((int32_t)bin + offset) * scale);
+    }
+    return mp_obj_new_tuple(3, values);
+}
+
+STATIC mp_obj_t lora_link_stats (mp_obj_t self_in) {
+    static const qstr lora_link_stats_fields[] = {
+        MP_QSTR_uplinks, MP_QSTR_downlinks, MP_QSTR_confirmed, MP_QSTR_acked, MP_QSTR_failed, MP_QSTR_retries,
+        MP_QSTR_rssi_ewma, MP_QSTR_snr_ewma, MP_QSTR_rssi_pct, MP_QSTR_snr_pct
+    };
+    // one bin per dB of RSSI and per 0.25 dB of SNR, the percentiles come out of a single pass
+    uint16_t rssi_hist[LORA_LINK_RSSI_BINS] = { 0 };
+    uint16_t snr_hist[256] = { 0 };
+    uint32_t samples = 0;
+    lora_link_history_t stats;
+
+    portENTER_CRITICAL(&lora_link_history_mux);
+    stats = lora_link_history;
+    for (uint32_t i = 0; i < lora_link_history.count; i++) {
+        const lora_link_record_t *record = &lora_link_history.records[i];
+        if (record->flags & MODLORA_LINK_DOWNLINK) {
+            int32_t rssi = record->rssi - LORA_LINK_RSSI_MIN;
+            rssi = (rssi < 0) ? 0 : ((rssi >= LORA_LINK_RSSI_BINS) ? LORA_LINK_RSSI_BINS - 1 : rssi);
+            rssi_hist[rssi]++;
+            snr_hist[record->snr + 128]++;
+            samples++;
+        }
+    }
+    portEXIT_CRITICAL(&lora_link_history_mux);
+
+    mp_obj_t stats_tuple[10];
+    stats_tuple[0] = mp_obj_new_int_from_uint(stats.uplinks);
+    stats_tuple[1] = mp_obj_new_int_from_uint(stats.downlinks);
+    stats_tuple[2] = mp_obj_new_int_from_uint(stats.confirmed);
+    stats_tuple[3] = mp_obj_new_int_from_uint(stats.acked);
+    stats_tuple[4] = mp_obj_new_int_from_uint(stats.failed);
+    stats_tuple[5] = mp_obj_new_int_from_uint(stats.retries);
+    stats_tuple[6] = stats.downlinks ? mp_obj_new_float(stats.rssi_ewma / 16.0f) : mp_const_none;
+    stats_tuple[7] = stats.downlinks ? mp_obj_new_float(stats.snr_ewma / 64.0f) : mp_const_none;
+    stats_tuple[8] = lora_link_percentiles(rssi_hist, LORA_LINK_RSSI_BINS, LORA_LINK_RSSI_MIN, samples, 1.0f);
+    stats_tuple[9] = lora_link_percentiles(snr_hist, 256, -128, samples, 0.25f);
+
+    return mp_obj_new_attrtuple(lora_link_stats_fields, sizeof(stats_tuple) / sizeof(stats_tuple[0]), stats_tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_link_stats_obj, lora_link_stats);
+
+STATIC mp_obj_t lora_queue_stats(mp_obj_t self_in) {
+    static const qstr lora_queue_stats_fields[] = {
+        MP_QSTR_cmd_queue_size, MP_QSTR_cmd_queue_hwm, MP_QSTR_cb_queue_size, MP_QSTR_cb_queue_hwm,
+        MP_QSTR_rx_buffer_size, MP_QSTR_rx_buffer_hwm, MP_QSTR_rx_dropped
+    };
+
+    pktbuf_stats_t rx_stats;
+    pktbuf_get_stats(PKTBUF_OWNER_LORA, &rx_stats);
+
+    mp_obj_t stats_tuple[7];
+    stats_tuple[0] = mp_obj_new_int_from_uint(lora_cmd_queue_size);
+    stats_tuple[1] = mp_obj_new_int_from_uint(lora_cmd_queue_hwm);
+    stats_tuple[2] = mp_obj_new_int_from_uint(lora_cb_queue_size);
+    stats_tuple[3] = mp_obj_new_int_from_uint(lora_cb_queue_hwm);
+    stats_tuple[4] = mp_obj_new_int_from_uint(rx_stats.quota * PKTBUF_DATA_SIZE);
+    stats_tuple[5] = mp_obj_new_int_from_uint(rx_stats.peak * PKTBUF_DATA_SIZE);
+    stats_tuple[6] = mp_obj_new_int_from_uint(rx_stats.refused);
+
+    return mp_obj_new_attrtuple(lora_queue_stats_fields, sizeof(stats_tuple) / sizeof(stats_tuple[0]), stats_tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_queue_stats_obj, lora_queue_stats);
+
 STATIC mp_obj_t lora_has_joined(mp_obj_t self_in) {
     lora_obj_t *self = self_in;
     return self->joined ? mp_const_true : mp_const_false;
@@ -2304,6 +4038,80 @@ STATIC mp_obj_t lora_mac(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_mac_obj, lora_mac);
 
+/// \method recv_frames(buf, info, *, timeout=None)
+/// Drains the queued frames into buf in a single call. For each frame a row of
+/// (offset, length, port, rssi, snr, sf, timestamp) is written into info, which
+/// must be an array('i'). Returns the number of frames received.
+STATIC mp_obj_t lora_recv_frames(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_buf,          MP_ARG_REQUIRED | MP_ARG_OBJ,   },
+        { MP_QSTR_info,         MP_ARG_REQUIRED | MP_ARG_OBJ,   },
+        { MP_QSTR_timeout,      MP_ARG_KW_ONLY  | MP_ARG_OBJ,   {.u_obj = mp_const_none} },
+    };
+
+    // parse arguments
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_WRITE);
+    mp_buffer_info_t infoinfo;
+    mp_get_buffer_raise(args[1].u_obj, &infoinfo, MP_BUFFER_WRITE);
+    if (infoinfo.typecode != 'i' && infoinfo.typecode != 'l') {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "info must be an array of type 'i'"));
+    }
+    uint32_t max_frames = infoinfo.len / (LORA_RX_FRAME_INFO_FIELDS * sizeof(int32_t));
+
+    int32_t timeout_ms = -1;
+    if (args[2].u_obj != mp_const_none) {
+        timeout_ms = mp_obj_get_int(args[2].u_obj);
+    }
+
+    MP_THREAD_GIL_EXIT();
+    int32_t n_frames = lora_recv_many(bufinfo.buf, bufinfo.len, infoinfo.buf, max_frames, timeout_ms);
+    MP_THREAD_GIL_ENTER();
+    return mp_obj_new_int(n_frames);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(lora_recv_frames_obj, 1, lora_recv_frames);
+
+/// \method recv_buf(*, timeout=None)
+/// Takes the next queued frame without copying it, returns a tuple of
+/// (buf, port, rssi, snr, sf, timestamp) where buf is a pycom.PktBuf, or None
+/// on timeout. The frame stays in the packet buffer pool until buf is released.
+STATIC mp_obj_t lora_recv_buf(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_timeout,      MP_ARG_KW_ONLY  | MP_ARG_OBJ,   {.u_obj = mp_const_none} },
+    };
+
+    // parse arguments
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    int32_t timeout_ms = -1;
+    if (args[0].u_obj != mp_const_none) {
+        timeout_ms = mp_obj_get_int(args[0].u_obj);
+    }
+
+    MP_THREAD_GIL_EXIT();
+    pktbuf_t *pb = lora_rx_wait(timeout_ms) ? pktbuf_queue_pop(&lora_rx_queue) : NULL;
+    MP_THREAD_GIL_ENTER();
+    if (pb == NULL) {
+        return mp_const_none;
+    }
+
+    // the rest of a frame partially read by recv()
+    lora_rx_frame_hdr_t *hdr = (lora_rx_frame_hdr_t *)pb->meta;
+    mp_obj_t tuple[6];
+    tuple[0] = modpycom_pktbuf_new(pb, hdr->index);
+    tuple[1] = mp_obj_new_int(hdr->port);
+    tuple[2] = mp_obj_new_int(hdr->rssi);
+    tuple[3] = mp_obj_new_int(hdr->snr);
+    tuple[4] = mp_obj_new_int(hdr->sf);
+    tuple[5] = mp_obj_new_int_from_uint(hdr->timestamp);
+    return mp_obj_new_tuple(6, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(lora_recv_buf_obj, 1, lora_recv_buf);
+
 /// \method callback(trigger, handler, arg)
 STATIC mp_obj_t lora_callback(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     STATIC const mp_arg_t allowed_args[] = {
@@ -2410,6 +4218,7 @@ STATIC mp_obj_t lora_nvram_restore (mp_obj_t self_in) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(lora_nvram_restore_obj, lora_nvram_restore);
 
 STATIC mp_obj_t lora_nvram_erase (mp_obj_t self_in) {
+    modlora_nvs_cache_reset();
     if (ESP_OK != nvs_erase_all(modlora_nvs_handle)) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
     }
@@ -2463,6 +4272,9 @@ STATIC const mp_map_elem_t lora_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_join),                  (mp_obj_t)&lora_join_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_join_multicast_group),  (mp_obj_t)&lora_join_multicast_group_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_leave_multicast_group), (mp_obj_t)&lora_leave_multicast_group_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_multicast_groups),      (mp_obj_t)&lora_multicast_groups_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_frag_session),          (mp_obj_t)&lora_frag_session_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_frag_stats),            (mp_obj_t)&lora_frag_stats_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_tx_power),              (mp_obj_t)&lora_tx_power_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_bandwidth),             (mp_obj_t)&lora_bandwidth_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_frequency),             (mp_obj_t)&lora_frequency_obj },
@@ -2470,13 +4282,26 @@ STATIC const mp_map_elem_t lora_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_preamble),              (mp_obj_t)&lora_preamble_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_sf),                    (mp_obj_t)&lora_sf_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_power_mode),            (mp_obj_t)&lora_power_mode_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sniff),                 (mp_obj_t)&lora_sniff_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sniff_stats),           (mp_obj_t)&lora_sniff_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_scan),                  (mp_obj_t)&lora_scan_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_scan_stats),            (mp_obj_t)&lora_scan_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_ticks_us),              (mp_obj_t)&lora_ticks_us_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_send_at),               (mp_obj_t)&lora_send_at_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_send_at_stats),         (mp_obj_t)&lora_send_at_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_lbt),                   (mp_obj_t)&lora_lbt_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_stats),                 (mp_obj_t)&lora_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_link_history),          (mp_obj_t)&lora_link_history_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_link_stats),            (mp_obj_t)&lora_link_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_queue_stats),           (mp_obj_t)&lora_queue_stats_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_has_joined),            (mp_obj_t)&lora_has_joined_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_add_channel),           (mp_obj_t)&lora_add_channel_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_remove_channel),        (mp_obj_t)&lora_remove_channel_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_mac),                   (mp_obj_t)&lora_mac_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_compliance_test),       (mp_obj_t)&lora_compliance_test_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_callback),              (mp_obj_t)&lora_callback_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_frames),           (mp_obj_t)&lora_recv_frames_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_buf),              (mp_obj_t)&lora_recv_buf_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_events),                (mp_obj_t)&lora_events_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ischannel_free),        (mp_obj_t)&lora_ischannel_free_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_battery_level),     (mp_obj_t)&lora_set_battery_level_obj },
@@ -2516,6 +4341,12 @@ STATIC const mp_map_elem_t lora_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_RX_PACKET_EVENT),     MP_OBJ_NEW_SMALL_INT(MODLORA_RX_EVENT) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_TX_PACKET_EVENT),     MP_OBJ_NEW_SMALL_INT(MODLORA_TX_EVENT) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_TX_FAILED_EVENT),     MP_OBJ_NEW_SMALL_INT(MODLORA_TX_FAILED_EVENT) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_FRAG_DONE_EVENT),     MP_OBJ_NEW_SMALL_INT(MODLORA_FRAG_DONE_EVENT) },
+
+    { MP_OBJ_NEW_QSTR(MP_QSTR_LINK_DOWNLINK),       MP_OBJ_NEW_SMALL_INT(MODLORA_LINK_DOWNLINK) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_LINK_CONFIRMED),      MP_OBJ_NEW_SMALL_INT(MODLORA_LINK_CONFIRMED) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_LINK_ACK),            MP_OBJ_NEW_SMALL_INT(MODLORA_LINK_ACK) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_LINK_FAILED),         MP_OBJ_NEW_SMALL_INT(MODLORA_LINK_FAILED) },
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_CLASS_A),             MP_OBJ_NEW_SMALL_INT(CLASS_A) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_CLASS_C),             MP_OBJ_NEW_SMALL_INT(CLASS_C) },
@@ -2588,6 +4419,7 @@ static int lora_socket_socket (mod_network_socket_obj_t *s, int *_errno) {
 
     // port number 2 is the default one
     LORAWAN_SOCKET_SET_PORT(s->sock_base.u.sd, 2);
+    LORAWAN_SOCKET_DEADLINE(s) = 0;
     return 0;
 }
 
@@ -2618,12 +4450,18 @@ static int lora_socket_send (mod_network_socket_obj_t *s, const byte *buf, mp_ui
     } else if (len > 0) {
         if (lora_obj.stack_mode == E_LORA_STACK_MODE_LORA) {
             n_bytes = lora_send (buf, len, s->sock_base.timeout);
+            if (n_bytes < 0) {
+                *_errno = MP_EBUSY;
+                return -1;
+            }
         } else {
             if (lora_obj.joined) {
                 n_bytes = lorawan_send (buf, len, s->sock_base.timeout,
                                         LORAWAN_SOCKET_IS_CONFIRMED(s->sock_base.u.sd),
                                         LORAWAN_SOCKET_GET_DR(s->sock_base.u.sd),
-                                        LORAWAN_SOCKET_GET_PORT(s->sock_base.u.sd));
+                                        LORAWAN_SOCKET_GET_PORT(s->sock_base.u.sd),
+                                        LORAWAN_SOCKET_GET_PRIORITY(s->sock_base.u.sd),
+                                        LORAWAN_SOCKET_DEADLINE(s));
             } else {
                 *_errno = MP_ENETDOWN;
                 return -1;
@@ -2704,6 +4542,20 @@ static int lora_socket_setsockopt(mod_network_socket_obj_t *s, mp_uint_t level,
             return -1;
         }
         LORAWAN_SOCKET_SET_DR(s->sock_base.u.sd, *(uint8_t *)optval);
+    } else if (opt == SO_LORAWAN_PRIORITY) {
+        uint32_t priority = *(uint32_t *)optval;
+        if (priority > LORAWAN_UPLINK_PRIORITY_MAX) {
+            *_errno = MP_EINVAL;
+            return -1;
+        }
+        LORAWAN_SOCKET_SET_PRIORITY(s->sock_base.u.sd, priority);
+    } else if (opt == SO_LORAWAN_DEADLINE) {
+        // in milliseconds, 0 means that the uplink never expires
+        if (*(int32_t *)optval < 0) {
+            *_errno = MP_EINVAL;
+            return -1;
+        }
+        LORAWAN_SOCKET_DEADLINE(s) = *(uint32_t *)optval;
     } else {
         *_errno = MP_EOPNOTSUPP;
         return -1;
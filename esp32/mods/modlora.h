@@ -17,9 +17,17 @@
  DEFINE CONSTANTS
  ******************************************************************************/
 #define LORA_PAYLOAD_SIZE_MAX                                   (255)
-#define LORA_CMD_QUEUE_SIZE_MAX                                 (7)
-#define LORA_DATA_QUEUE_SIZE_MAX                                (7)
-#define LORA_CB_QUEUE_SIZE_MAX                                  (7)
+#define LORA_CMD_QUEUE_SIZE_DEFAULT                             (7)
+#define LORA_RX_BUFFER_SIZE_MIN                                 (PKTBUF_DATA_SIZE)
+#define LORA_RX_BUFFER_SIZE_MAX                                 (PKTBUF_BLOCKS_MAX * PKTBUF_DATA_SIZE)
+#define LORA_CB_QUEUE_SIZE_DEFAULT                              (7)
+#define LORA_LINK_HISTORY_DEPTH_DEFAULT                         (32)
+#define LORA_LINK_HISTORY_DEPTH_MAX                             (1024)
+#define LORA_SCAN_ENTRIES_MAX                                   (8)
+#define LORA_SCAN_DWELL_MS_DEFAULT                              (50)
+#define LORA_TX_AT_SPIN_US                                      (3000)
+#define LORA_TX_AT_LATE_US                                      (500)
+#define LORA_QUEUE_SIZE_MAX                                     (64)
 #define LORA_STACK_SIZE                                         (4096)
 #define LORA_TIMER_STACK_SIZE                                   (3072)
 #define LORA_TASK_PRIORITY                                      (6)
@@ -29,6 +37,22 @@
 #define LORA_STATUS_ERROR                                       (0x02)
 #define LORA_STATUS_MSG_SIZE                                    (0x04)
 #define LORA_STATUS_RESET_DONE                                  (0x08)
+#define LORA_STATUS_UPLINK_DONE                                 (0x10)
+#define LORA_STATUS_CHANNEL_BUSY                                (0x20)
+
+// outcome of a tagged raw frame, see lora_ot_tx_result()
+#define LORA_OT_TX_PENDING                                      (0)
+#define LORA_OT_TX_DONE                                         (1)
+#define LORA_OT_TX_FAILED                                       (-1)
+
+#define LORAWAN_UPLINK_QUEUE_SIZE                               (8)
+#define LORAWAN_UPLINK_PRIORITY_MAX                             (15)
+
+#define LORAWAN_MC_GROUPS_MAX                                   (4)
+#define LORAWAN_FRAG_PORT_DEFAULT                               (201)
+#define LORAWAN_FRAG_WINDOW_SLOTS                               (64)
+#define LORAWAN_FRAG_STACK_SIZE                                 (3072)
+#define LORAWAN_FRAG_TASK_PRIORITY                              (5)
 
 /******************************************************************************
  DEFINE TYPES
@@ -38,9 +62,11 @@ typedef enum {
     E_LORA_CMD_JOIN,
     E_LORA_CMD_TX,
     E_LORA_CMD_CONFIG_CHANNEL,
-    E_LORA_CMD_LORAWAN_TX,
     E_LORA_CMD_SLEEP,
     E_LORA_CMD_WAKE_UP,
+    E_LORA_CMD_SNIFF,
+    E_LORA_CMD_SCAN,
+    E_LORA_CMD_TX_AT,
 } lora_cmd_t;
 
 typedef enum {
@@ -110,8 +136,17 @@ typedef struct {
     uint8_t     port;
     uint8_t     dr;
     bool        confirmed;
+    uint8_t     tag;        // raw frames, non zero to report the outcome to Pymesh
 } lora_tx_cmd_data_t;
 
+// pending LoRaWAN uplink, owned by the uplink scheduler of the LoRa task
+typedef struct {
+    lora_tx_cmd_data_t  tx;
+    uint32_t            seq;
+    TickType_t          deadline;   // 0 if the uplink never expires
+    uint8_t             priority;   // higher values are transmitted first
+} lorawan_uplink_t;
+
 typedef struct {
     uint32_t    frequency;
     uint8_t     index;
@@ -120,11 +155,37 @@ typedef struct {
     bool        add;
 } lora_config_channel_cmd_data_t;
 
+typedef struct {
+    uint32_t    interval_ms;    // 0 to listen continuously
+    uint32_t    rx_window_ms;   // 0 to compute it from the interval and the radio settings
+} lora_sniff_cmd_data_t;
+
+// raw frame sent at a given time of the clock stamping the received frames
+typedef struct {
+    lora_tx_cmd_data_t  tx;
+    uint32_t            at_us;
+} lora_tx_at_cmd_data_t;
+
+typedef struct {
+    uint32_t    frequency;
+    uint16_t    dwell_ms;       // time spent running CADs on the entry before hopping to the next one
+    uint8_t     sf;
+    uint8_t     bandwidth;
+} lora_scan_entry_t;
+
+typedef struct {
+    lora_scan_entry_t   entries[LORA_SCAN_ENTRIES_MAX];
+    uint8_t             count;  // 0 to stop scanning
+} lora_scan_cmd_data_t;
+
 typedef union {
     lora_init_cmd_data_t                init;
     lora_join_cmd_data_t                join;
     lora_tx_cmd_data_t                  tx;
     lora_config_channel_cmd_data_t      channel;
+    lora_sniff_cmd_data_t               sniff;
+    lora_scan_cmd_data_t                scan;
+    lora_tx_at_cmd_data_t               tx_at;
 } lora_cmd_info_u_t;
 
 typedef struct {
@@ -134,11 +195,16 @@ typedef struct {
 
 ///////////////////////////////////////////
 
+// metadata of every received frame, kept in the PKTBUF_META_SIZE bytes of its packet buffer
 typedef struct {
-    uint8_t data[LORA_PAYLOAD_SIZE_MAX + 1];
-    uint8_t len;
-    uint8_t port;
-} lora_rx_data_t;
+    uint32_t    timestamp;
+    int16_t     rssi;
+    int8_t      snr;
+    uint8_t     sf;
+    uint8_t     port;
+    uint8_t     len;
+    uint8_t     index;      // read offset of a partially received frame
+} lora_rx_frame_hdr_t;
 
 typedef void ( *modlora_timerCallback )( void );
 /******************************************************************************
@@ -153,11 +219,14 @@ extern bool modlora_nvs_set_uint(uint32_t key_idx, uint32_t value);
 extern bool modlora_nvs_set_blob(uint32_t key_idx, const void *value, uint32_t length);
 extern bool modlora_nvs_get_uint(uint32_t key_idx, uint32_t *value);
 extern bool modlora_nvs_get_blob(uint32_t key_idx, void *value, uint32_t *length);
+extern bool modlora_nvs_set_counter(uint32_t key_idx, uint32_t value, bool reserve);
+extern bool modlora_nvs_get_counter(uint32_t key_idx, uint32_t *value);
 extern void modlora_sleep_module(void);
 extern bool modlora_is_module_sleep(void);
 IRAM_ATTR extern void modlora_set_timer_callback(modlora_timerCallback cb);
 
-extern int lora_ot_recv(uint8_t *buf, int8_t *rssi);
-extern void lora_ot_send(const uint8_t *buf, uint16_t len);
+extern int lora_ot_recv(uint8_t *buf, int8_t *rssi, uint32_t *timestamp);
+extern bool lora_ot_send(const uint8_t *buf, uint16_t len, uint8_t tag);
+extern int lora_ot_tx_result(uint8_t tag);
 
 #endif  // MODLORA_H_
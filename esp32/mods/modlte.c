@@ -28,6 +28,7 @@
 #include "esp_heap_caps.h"
 #include "sdkconfig.h"
 #include "esp_system.h"
+#include "esp_attr.h"
 #include "esp_spi_flash.h"
 #include "nvs_flash.h"
 #include "esp_event_loop.h"
@@ -47,6 +48,7 @@
 #include "modussl.h"
 
 #include "lteppp.h"
+#include "sqnstp.h"
 #include "modlte.h"
 
 #include "lwip/sockets.h"
@@ -56,6 +58,7 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "freertos/event_groups.h"
 
 #include "esp_system.h"
@@ -73,12 +76,32 @@
 /******************************************************************************
  DEFINE TYPES
  ******************************************************************************/
+// what is needed to go back to PPP without attaching again, kept across deep sleep
+typedef struct {
+    uint32_t    magic;
+    uint8_t     cid;
+    bool        legacy;
+    bool        legacyattach;
+    bool        carrier;
+} lte_rtc_cache_t;
+
+// a socket of the modem's own IP stack, the AT+SQNSD connection id is its index + 1
+typedef struct {
+    bool        used;
+    bool        open;
+    uint8_t     proto;              // 0 for TCP and 1 for UDP, as given to AT+SQNSD
+    uint8_t     ip[MOD_NETWORK_IPV4ADDR_BUF_SIZE];
+    uint16_t    port;
+    uint16_t    local_port;
+} lte_modem_socket_t;
 
 /******************************************************************************
  DEFINE CONSTANTS
  ******************************************************************************/
 #define LTE_NUM_UARTS               2
 #define UART_TRANSFER_MAX_LEN       1
+// read from the image file at a time during a modem_stp_send()
+#define LTE_STP_CHUNK_SIZE          2048
 
 #define  DEFAULT_PROTO_TYPE          (const char*)"IP"
 #define  DEFAULT_APN                 (const char*)""
@@ -101,6 +124,23 @@
 #define PSM_ACTIVE_1M         0b001
 #define PSM_ACTIVE_6M         0b010
 #define PSM_ACTIVE_DISABLED   0b111
+// room for the +CPSMS: line, the two timers are 8 bit strings
+#define PSM_RSP_SIZE_MAX      64
+
+#define LTE_RTC_CACHE_MAGIC         (0x4C545243)    // "LTRC"
+#define LTE_FAST_RESUME_POLL_MS     (10)
+
+// the AF_LTE sockets, run by the modem's IP stack through AT commands instead of PPP and lwIP
+#define LTE_MODEM_SOCKETS_MAX           (6)
+#define LTE_MODEM_PKT_SIZE_MAX          (1500)
+// the data sent follows the prompt of AT+SQNSSENDEXT in chunks that stay NULL terminated
+#define LTE_MODEM_SEND_CHUNK_SIZE       (LTE_AT_CMD_DATA_SIZE_MAX - 1)
+// the data received is hex encoded in the response of AT+SQNSRECV
+#define LTE_MODEM_RECV_SIZE_MAX         ((LTE_AT_RSP_SIZE_MAX - 64) / 2)
+// the modem gives up connecting after LTE_MODEM_CONN_TIMEOUT_DS tenths of a second
+#define LTE_MODEM_CONN_TIMEOUT_DS       (150)
+#define LTE_MODEM_CONNECT_TIMEOUT_MS    (20000)
+#define LTE_MODEM_POLL_MS               (50)
 
 /******************************************************************************
  DECLARE PRIVATE DATA
@@ -118,6 +158,13 @@ static bool lte_debug = false;
 
 static bool lte_ue_is_out_of_coverage = false;
 
+static RTC_DATA_ATTR lte_rtc_cache_t lte_rtc_cache;
+
+// keeps the commands of the socket functions, which run without the GIL, apart from the others
+static SemaphoreHandle_t lte_at_mutex = NULL;
+static lte_modem_socket_t lte_modem_sockets[LTE_MODEM_SOCKETS_MAX];
+static const mp_obj_base_t lte_modem_nic_obj = { (const mp_obj_type_t *)&mod_network_nic_type_lte_modem };
+
 extern TaskHandle_t xLTEUpgradeTaskHndl;
 extern TaskHandle_t mpTaskHandle;
 extern TaskHandle_t svTaskHandle;
@@ -136,10 +183,15 @@ extern TaskHandle_t xLTETaskHndl;
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
+static bool lte_push_at_command_direct (const char *cmd_str, uint32_t timeout, const char *expected_rsp, size_t len, bool continuation);
 static bool lte_push_at_command_ext_cont (char *cmd_str, uint32_t timeout, const char *expected_rsp, size_t len, bool continuation);
 static bool lte_push_at_command_ext (char *cmd_str, uint32_t timeout, const char *expected_rsp, size_t len);
 static bool lte_push_at_command (char *cmd_str, uint32_t timeout);
 static void lte_pause_ppp(void);
+static bool lte_set_uart_baudrate(uint32_t baudrate);
+static void lte_rtc_cache_store(void);
+static void lte_rtc_cache_clear(void);
+static int32_t lte_wait_ip(uint32_t start, uint32_t timeout);
 static bool lte_check_attached(bool legacy);
 static void lte_check_init(void);
 static bool lte_check_sim_present(void);
@@ -151,6 +203,19 @@ STATIC mp_obj_t lte_deinit(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
 STATIC mp_obj_t lte_disconnect(mp_obj_t self_in);
 static void lte_set_default_inf(void);
 static void lte_callback_handler(void* arg);
+static void lte_modem_socket_reset_all(void);
+
+static int lte_modem_socket_socket (mod_network_socket_obj_t *s, int *_errno);
+static void lte_modem_socket_close (mod_network_socket_obj_t *s);
+static int lte_modem_socket_bind (mod_network_socket_obj_t *s, byte *ip, mp_uint_t port, int *_errno);
+static int lte_modem_socket_connect (mod_network_socket_obj_t *s, byte *ip, mp_uint_t port, int *_errno);
+static int lte_modem_socket_send (mod_network_socket_obj_t *s, const byte *buf, mp_uint_t len, int *_errno);
+static int lte_modem_socket_sendto (mod_network_socket_obj_t *s, const byte *buf, mp_uint_t len, byte *ip, mp_uint_t port, int *_errno);
+static int lte_modem_socket_recv (mod_network_socket_obj_t *s, byte *buf, mp_uint_t len, int *_errno);
+static int lte_modem_socket_recvfrom (mod_network_socket_obj_t *s, byte *buf, mp_uint_t len, byte *ip, mp_uint_t *port, int *_errno);
+static int lte_modem_socket_setsockopt (mod_network_socket_obj_t *s, mp_uint_t level, mp_uint_t opt, const void *optval, mp_uint_t optlen, int *_errno);
+static int lte_modem_socket_settimeout (mod_network_socket_obj_t *s, mp_int_t timeout_ms, int *_errno);
+static int lte_modem_socket_ioctl (mod_network_socket_obj_t *s, mp_uint_t request, mp_uint_t arg, int *_errno);
 
 //#define MSG(fmt, ...) printf("[%u] modlte: " fmt, mp_hal_ticks_ms(), ##__VA_ARGS__)
 #define MSG(fmt, ...) (void)0
@@ -160,6 +225,9 @@ static void lte_callback_handler(void* arg);
  ******************************************************************************/
 
 void modlte_init0(void) {
+    if (lte_at_mutex == NULL) {
+        lte_at_mutex = xSemaphoreCreateRecursiveMutex();
+    }
     lteppp_init();
 }
 void modlte_start_modem(void)
@@ -204,22 +272,30 @@ static void lte_callback_handler(void* arg)
 
 }
 
-static bool lte_push_at_command_ext_cont (char *cmd_str, uint32_t timeout, const char *expected_rsp, size_t len, bool continuation)
+// leaves the GIL alone, the socket functions call it without holding it
+static bool lte_push_at_command_direct (const char *cmd_str, uint32_t timeout, const char *expected_rsp, size_t len, bool continuation)
 {
     lte_task_cmd_data_t cmd = { .timeout = timeout, .dataLen = len, .expect_continuation = continuation};
     memcpy(cmd.data, cmd_str, len);
     uint32_t start = mp_hal_ticks_ms();
     if (lte_debug)
-        printf("[AT] %u %s\n", start, cmd_str);
+        printf("[AT] %u %.*s\n", start, (int)len, cmd_str);
+    xSemaphoreTakeRecursive(lte_at_mutex, portMAX_DELAY);
     lteppp_send_at_command(&cmd, &modlte_rsp);
-    if (continuation || (expected_rsp == NULL) || (strstr(modlte_rsp.data, expected_rsp) != NULL)) {
-        if (lte_debug)
-            printf("[AT-OK] +%u %s\n", mp_hal_ticks_ms()-start, modlte_rsp.data);
-        return true;
-    }
+    bool ok = continuation || (expected_rsp == NULL) || (strstr(modlte_rsp.data, expected_rsp) != NULL);
     if (lte_debug)
-        printf("[AT-FAIL] +%u %s\n", mp_hal_ticks_ms()-start, modlte_rsp.data);
-    return false;
+        printf("%s +%u %s\n", ok ? "[AT-OK]" : "[AT-FAIL]", mp_hal_ticks_ms()-start, modlte_rsp.data);
+    xSemaphoreGiveRecursive(lte_at_mutex);
+    return ok;
+}
+
+static bool lte_push_at_command_ext_cont (char *cmd_str, uint32_t timeout, const char *expected_rsp, size_t len, bool continuation)
+{
+    // the LTE task does the work, let the other threads run meanwhile
+    MP_THREAD_GIL_EXIT();
+    bool ok = lte_push_at_command_direct(cmd_str, timeout, expected_rsp, len, continuation);
+    MP_THREAD_GIL_ENTER();
+    return ok;
 }
 
 static bool lte_push_at_command_ext(char *cmd_str, uint32_t timeout, const char *expected_rsp, size_t len) {
@@ -230,6 +306,78 @@ static bool lte_push_at_command (char *cmd_str, uint32_t timeout) {
     return lte_push_at_command_ext(cmd_str, timeout, LTE_OK_RSP, strlen(cmd_str));
 }
 
+// keeps modlte_rsp to the caller from its command until it is done reading the response, the GIL is
+// given away while waiting as the holder takes it back after each of its commands
+static void lte_at_lock(void) {
+    MP_THREAD_GIL_EXIT();
+    xSemaphoreTakeRecursive(lte_at_mutex, portMAX_DELAY);
+    MP_THREAD_GIL_ENTER();
+}
+
+static void lte_at_unlock(void) {
+    xSemaphoreGiveRecursive(lte_at_mutex);
+}
+
+// switch the modem UART and ours to baudrate, going back to the current rate if
+// the modem can't be reached afterwards
+static bool lte_set_uart_baudrate(uint32_t baudrate) {
+    char at_cmd[20];
+    uint32_t current = lteppp_get_uart_baudrate();
+
+    if (baudrate == current) {
+        return true;
+    }
+    snprintf(at_cmd, sizeof(at_cmd), "%u", baudrate);
+    lte_at_lock();
+    bool supported = lte_push_at_command("AT+IPR=?", LTE_RX_TIMEOUT_MIN_MS) && strstr(modlte_rsp.data, at_cmd);
+    lte_at_unlock();
+    if (!supported) {
+        return false;
+    }
+    snprintf(at_cmd, sizeof(at_cmd), "AT+IPR=%u", baudrate);
+    if (!lte_push_at_command(at_cmd, LTE_RX_TIMEOUT_MIN_MS)) {
+        return false;
+    }
+    // the modem confirms at the old rate and switches right after
+    lteppp_set_uart_baudrate(baudrate);
+    mp_hal_delay_ms(LTE_UART_BAUDRATE_SETTLE_MS);
+    for (int i = 0; i < LTE_UART_BAUDRATE_CHECK_TRIALS; i++) {
+        if (lte_push_at_command("AT", LTE_RX_TIMEOUT_MIN_MS)) {
+            return true;
+        }
+    }
+    // the link doesn't work at the new rate, ask the modem to go back in case it did switch
+    snprintf(at_cmd, sizeof(at_cmd), "AT+IPR=%u", current);
+    lte_push_at_command(at_cmd, LTE_RX_TIMEOUT_MIN_MS);
+    lteppp_set_uart_baudrate(current);
+    mp_hal_delay_ms(LTE_UART_BAUDRATE_SETTLE_MS);
+    lte_push_at_command("AT", LTE_RX_TIMEOUT_MIN_MS);
+    return false;
+}
+
+static void lte_rtc_cache_store(void) {
+    lte_rtc_cache.cid = lte_obj.cid;
+    lte_rtc_cache.legacy = (lteppp_get_legacy() == E_LTE_LEGACY);
+    lte_rtc_cache.legacyattach = lte_legacyattach_flag;
+    lte_rtc_cache.carrier = lte_obj.carrier;
+    lte_rtc_cache.magic = LTE_RTC_CACHE_MAGIC;
+}
+
+static void lte_rtc_cache_clear(void) {
+    lte_rtc_cache.magic = 0;
+}
+
+// wait for PPP to hand out an address, returns the ms elapsed since start or -1 on timeout
+static int32_t lte_wait_ip(uint32_t start, uint32_t timeout) {
+    while (lteppp_ipv4() == 0) {
+        if (mp_hal_ticks_ms() - start >= timeout) {
+            return -1;
+        }
+        mp_hal_delay_ms(LTE_FAST_RESUME_POLL_MS);
+    }
+    return mp_hal_ticks_ms() - start;
+}
+
 static void lte_pause_ppp(void) {
     mp_hal_delay_ms(LTE_PPP_BACK_OFF_TIME_MS);
     if (!lte_push_at_command("+++", LTE_PPP_BACK_OFF_TIME_MS)) {
@@ -268,6 +416,7 @@ static bool lte_check_attached(bool legacy) {
                 }
             }
         }
+        lte_at_lock();
         lte_push_at_command("AT", LTE_RX_TIMEOUT_MIN_MS);
         lte_push_at_command("AT+CGATT?", LTE_RX_TIMEOUT_MIN_MS);
         if (((pos = strstr(modlte_rsp.data, "+CGATT")) && (strlen(pos) >= 7) && (pos[7] == '1' || pos[8] == '1'))) {
@@ -317,6 +466,7 @@ static bool lte_check_attached(bool legacy) {
                 lteppp_set_state(E_LTE_IDLE);
             }
         }
+        lte_at_unlock();
     }
     if (attached && lteppp_get_state() < E_LTE_PPP) {
         lteppp_set_state(E_LTE_ATTACHED);
@@ -328,23 +478,23 @@ static bool lte_check_attached(bool legacy) {
 }
 
 static bool lte_check_legacy_version(void) {
-    if (lte_push_at_command("ATI1", LTE_RX_TIMEOUT_MAX_MS)) {
-        return strstr(modlte_rsp.data, "LR5.1.1.0-33080");
-    } else {
-        if (lte_push_at_command("ATI1", LTE_RX_TIMEOUT_MAX_MS)) {
-            return strstr(modlte_rsp.data, "LR5.1.1.0-33080");
-        } else {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "LTE modem version not read"));
-        }
+    lte_at_lock();
+    bool version_read = lte_push_at_command("ATI1", LTE_RX_TIMEOUT_MAX_MS) || lte_push_at_command("ATI1", LTE_RX_TIMEOUT_MAX_MS);
+    bool legacy = version_read && strstr(modlte_rsp.data, "LR5.1.1.0-33080");
+    lte_at_unlock();
+    if (!version_read) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "LTE modem version not read"));
     }
-    return true;
+    return legacy;
 }
 
 static int lte_get_modem_version(void)
 {
     /* Get modem version */
     char * ver = NULL;
+    int v = 0;
 
+    lte_at_lock();
     lte_push_at_command_ext("AT!=\"showver\"", LTE_RX_TIMEOUT_MAX_MS, NULL, strlen("AT!=\"showver\""));
     ver = strstr(modlte_rsp.data, "Software     :");
 
@@ -352,15 +502,14 @@ static int lte_get_modem_version(void)
     {
         ver = strstr(ver, "[");
         char * ver_close =  strstr(ver, "]");
-        int v = 0;
         if (ver != NULL && ver_close != NULL && ver_close > ver) {
             ver[ver_close - ver] = '\0';
             ver++;
             v = atoi(ver);
         }
-        return v;
     }
-    return 0;
+    lte_at_unlock();
+    return v;
 }
 
 static void lte_check_init(void) {
@@ -381,24 +530,23 @@ static void lte_check_inppp(void) {
 }
 
 static bool lte_check_sim_present(void) {
+    lte_at_lock();
     lte_push_at_command("AT+CFUN?", LTE_RX_TIMEOUT_MIN_MS);
     if (strstr(modlte_rsp.data, "+CFUN: 0")) {
     	lte_push_at_command("AT+CFUN=4", LTE_RX_TIMEOUT_MAX_MS);
     	mp_hal_delay_ms(LTE_RX_TIMEOUT_MIN_MS);
     }
     lte_push_at_command("AT+CPIN?", LTE_RX_TIMEOUT_MAX_MS);
-    if (strstr(modlte_rsp.data, "READY")) {
-    	return true;
-    } else {
-    	for (int n=0; n < 4; n++) {
-    		mp_hal_delay_ms(1000);
-    		lte_push_at_command("AT+CPIN?", LTE_RX_TIMEOUT_MAX_MS);
-    		if (strstr(modlte_rsp.data, "READY")) {
-    			return true;
-    		}
-    	}
-    	return false;
+    bool ready = strstr(modlte_rsp.data, "READY");
+    lte_at_unlock();
+    for (int n=0; n < 4 && !ready; n++) {
+    	mp_hal_delay_ms(1000);
+    	lte_at_lock();
+    	lte_push_at_command("AT+CPIN?", LTE_RX_TIMEOUT_MAX_MS);
+    	ready = strstr(modlte_rsp.data, "READY");
+    	lte_at_unlock();
     }
+    return ready;
 }
 
 static void TASK_LTE_UPGRADE(void *pvParameters){
@@ -454,6 +602,10 @@ static mp_obj_t lte_init_helper(lte_obj_t *self, const mp_arg_val_t *args) {
         //printf("All done since we were already initialised.\n");
         return mp_const_none;
     }
+    uint32_t uart_baudrate = args[8].u_int;
+    if (uart_baudrate > 0 && !lteppp_uart_baudrate_supported(uart_baudrate)) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "invalid uart_baudrate %d", uart_baudrate));
+    }
     modem_state  = lteppp_get_modem_conn_state();
     switch(modem_state)
     {
@@ -474,7 +626,9 @@ static mp_obj_t lte_init_helper(lte_obj_t *self, const mp_arg_val_t *args) {
         break;
     case E_LTE_MODEM_CONNECTING:
         // Block till modem is connected
+        MP_THREAD_GIL_EXIT();
         xSemaphoreTake(xLTE_modem_Conn_Sem, portMAX_DELAY);
+        MP_THREAD_GIL_ENTER();
         if (E_LTE_MODEM_DISCONNECTED == lteppp_get_modem_conn_state()) {
             xSemaphoreGive(xLTE_modem_Conn_Sem);
             nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Couldn't connect to Modem (modem_state=connecting)"));
@@ -492,14 +646,20 @@ static mp_obj_t lte_init_helper(lte_obj_t *self, const mp_arg_val_t *args) {
     }
     lte_obj.cid = args[1].u_int;
 
+    lte_at_lock();
     lte_push_at_command("AT+CFUN?", LTE_RX_TIMEOUT_MIN_MS);
-    if (strstr(modlte_rsp.data, "+CFUN: 0") || strstr(modlte_rsp.data, "+CFUN: 4")) {
+    bool radio_off = strstr(modlte_rsp.data, "+CFUN: 0") || strstr(modlte_rsp.data, "+CFUN: 4");
+    lte_at_unlock();
+    if (radio_off) {
         const char *carrier = "standard";
         lte_obj.carrier = false;
         if (args[0].u_obj != mp_const_none) {
             carrier = mp_obj_str_get_str(args[0].u_obj);
+            lte_at_lock();
             lte_push_at_command("AT+SQNCTM=?", LTE_RX_TIMEOUT_MIN_MS);
-            if (!strstr(modlte_rsp.data, carrier)) {
+            bool supported = strstr(modlte_rsp.data, carrier);
+            lte_at_unlock();
+            if (!supported) {
                 xSemaphoreGive(xLTE_modem_Conn_Sem);
                 nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "invalid carrier %s", carrier));
             } else if (!strstr(carrier, "standard")) {
@@ -511,6 +671,7 @@ static mp_obj_t lte_init_helper(lte_obj_t *self, const mp_arg_val_t *args) {
         lte_legacyattach_flag = args[2].u_bool;
 
         // configure the carrier
+        lte_at_lock();
         lte_push_at_command("AT+SQNCTM?", LTE_RX_TIMEOUT_MAX_MS);
         const char* detected_carrier = modlte_rsp.data;
         if (!strstr(detected_carrier, carrier) && (args[0].u_obj != mp_const_none)) {
@@ -527,13 +688,21 @@ static mp_obj_t lte_init_helper(lte_obj_t *self, const mp_arg_val_t *args) {
         if (!strstr(detected_carrier, carrier) && (!strstr(detected_carrier, "standard"))) {
             lte_obj.carrier = true;
         }
+        lte_at_unlock();
         lte_push_at_command("AT+CFUN=4", LTE_RX_TIMEOUT_MAX_MS);
         lte_push_at_command("AT", LTE_RX_TIMEOUT_MAX_MS);
         lte_push_at_command("AT", LTE_RX_TIMEOUT_MAX_MS);
     }
 
+    // the faster rate is optional, the modem stays at the default one if it can't be used
+    if (uart_baudrate > 0 && !lte_set_uart_baudrate(uart_baudrate)) {
+        if (lte_debug)
+            printf("uart_baudrate %u failed, staying at %u\n", uart_baudrate, lteppp_get_uart_baudrate());
+    }
+
     lteppp_set_state(E_LTE_IDLE);
     mod_network_register_nic(&lte_obj);
+    mod_network_register_nic((mp_obj_t)&lte_modem_nic_obj);
     lte_obj.init = true;
 
     // configure PSM
@@ -568,8 +737,15 @@ STATIC mp_obj_t lte_psm(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw
         MP_QSTR_active_unit,
     };
 
+    // parsed from a copy, the decoding below may raise
+    char resp[PSM_RSP_SIZE_MAX] = "";
+    lte_at_lock();
     lte_push_at_command("AT+CPSMS?", LTE_RX_TIMEOUT_MAX_MS);
-    const char *resp = modlte_rsp.data;
+    const char *rsp_pos = strstr(modlte_rsp.data, "+CPSMS: ");
+    if (rsp_pos) {
+        strncpy(resp, rsp_pos, sizeof(resp) - 1);
+    }
+    lte_at_unlock();
     char *pos;
     if ( ( pos = strstr(resp, "+CPSMS: ") ) ) {
         // decode the resp:
@@ -631,6 +807,7 @@ static const mp_arg_t lte_init_args[] = {
     { MP_QSTR_psm_period_unit,                      MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = PSM_PERIOD_DISABLED } },
     { MP_QSTR_psm_active_value,                     MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 0 } },
     { MP_QSTR_psm_active_unit,                      MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = PSM_ACTIVE_DISABLED } },
+    { MP_QSTR_uart_baudrate,                        MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 0 } },
 };
 
 static mp_obj_t lte_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args) {
@@ -713,6 +890,7 @@ STATIC mp_obj_t lte_deinit(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
             }
             if (!args[0].u_bool || !args[2].u_bool) { /* backward compatibility for dettach method FIXME */
                 vTaskDelay(100);
+                lte_set_uart_baudrate(MICROPY_LTE_UART_BAUDRATE);
                 lte_push_at_command("AT!=\"setlpm airplane=1 enable=1\"", LTE_RX_TIMEOUT_MAX_MS);
                 lteppp_deinit();
                 lte_obj.init = false;
@@ -720,6 +898,8 @@ STATIC mp_obj_t lte_deinit(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
             }
         }
 
+        lte_set_uart_baudrate(MICROPY_LTE_UART_BAUDRATE);
+        lte_rtc_cache_clear();
         if (lte_check_sim_present()) {
             if (args[1].u_bool) {
                 if (lte_push_at_command("AT+CFUN=4,1", LTE_RX_TIMEOUT_MAX_MS)) {
@@ -765,6 +945,9 @@ STATIC mp_obj_t lte_deinit(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
     }
     lteppp_deinit();
     mod_network_deregister_nic(&lte_obj);
+    mod_network_deregister_nic((mp_obj_t)&lte_modem_nic_obj);
+    // the modem has dropped its sockets
+    lte_modem_socket_reset_all();
     return mp_const_none;
 
 error:
@@ -884,17 +1067,19 @@ STATIC mp_obj_t lte_attach(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
         }
 
         const char *carrier = "standard";
-        if (!lte_push_at_command("AT+SQNCTM?", LTE_RX_TIMEOUT_MAX_MS)) {
-            if (!lte_push_at_command("AT+SQNCTM?", LTE_RX_TIMEOUT_MAX_MS)) {
-                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Modem did not respond!\n"));
-            }
+        lte_at_lock();
+        bool responded = lte_push_at_command("AT+SQNCTM?", LTE_RX_TIMEOUT_MAX_MS) || lte_push_at_command("AT+SQNCTM?", LTE_RX_TIMEOUT_MAX_MS);
+        bool standard = responded && strstr(modlte_rsp.data, carrier);
+        lte_at_unlock();
+        if (!responded) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Modem did not respond!\n"));
         }
-        if (strstr(modlte_rsp.data, carrier)) {
+        if (standard) {
             lte_obj.carrier = false;
             /* Get configured bands in modem */
+            lte_at_lock();
             lte_push_at_command_ext("AT+SMDD", LTE_RX_TIMEOUT_MAX_MS, NULL, strlen("AT+SMDD"));
             /* Dummy command for command response > Uart buff size */
-            MP_THREAD_GIL_EXIT();
             if(strstr(modlte_rsp.data, "17 bands") != NULL)
             {
                 is_hw_new_band_support = true;
@@ -909,7 +1094,7 @@ STATIC mp_obj_t lte_attach(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
                 }
                 lte_push_at_command_ext("Pycom_Dummy", LTE_RX_TIMEOUT_MAX_MS, NULL, strlen("Pycom_Dummy"));
             }
-            MP_THREAD_GIL_ENTER();
+            lte_at_unlock();
             int version = lte_get_modem_version();
 
             if(version > 0 && version > SQNS_SW_FULL_BAND_SUPPORT)
@@ -1023,6 +1208,7 @@ mp_obj_t lte_detach(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_arg
 
     lte_obj_t *self = (lte_obj_t*)pos_args[0];
 
+    lte_rtc_cache_clear();
     if (lteppp_get_state() == E_LTE_PPP) {
         lte_disconnect(self);
     }
@@ -1159,6 +1345,7 @@ STATIC mp_obj_t lte_connect(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
         lteppp_connect();
         lteppp_set_state(E_LTE_PPP);
         vTaskDelay(1000);
+        lte_rtc_cache_store();
     } else if (lteppp_get_state() == E_LTE_PPP) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "modem already connected"));
     } else if (lteppp_get_state() == E_LTE_SUSPENDED) {
@@ -1200,6 +1387,7 @@ STATIC mp_obj_t lte_resume(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
             lteppp_resume();
             lteppp_set_state(E_LTE_PPP);
             vTaskDelay(1500);
+            lte_rtc_cache_store();
         } else {
             MSG("resume ATO failed -> reconnect\n");
             lteppp_disconnect();
@@ -1217,6 +1405,69 @@ STATIC mp_obj_t lte_resume(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(lte_resume_obj, 1, lte_resume);
 
+/** go straight back to PPP after pppsuspend() or deep sleep with PSM, relying on
+ * the modem having kept its registration and PDP context. Returns the time to IP
+ * in ms, or None when the full attach()/connect() sequence is needed.
+ */
+STATIC mp_obj_t lte_fast_resume(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    lte_check_init();
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_timeout,  MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = LTE_RX_TIMEOUT_MAX_MS} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    uint32_t start = mp_hal_ticks_ms();
+    if (lteppp_get_state() == E_LTE_PPP) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "modem already connected"));
+    }
+    if (lte_rtc_cache.magic != LTE_RTC_CACHE_MAGIC) {
+        return mp_const_none;
+    }
+
+    // a single registration query, <stat> 1 or 5 means the bearer is still up
+    lte_at_lock();
+    if (!lte_push_at_command("AT+CEREG?", LTE_RX_TIMEOUT_MIN_MS)) {
+        lte_at_unlock();
+        return mp_const_none;
+    }
+    char *pos = strstr(modlte_rsp.data, "+CEREG: ");
+    bool registered = pos && (pos = strchr(pos, ',')) && (pos[1] == '1' || pos[1] == '5');
+    lte_at_unlock();
+    if (!registered) {
+        lte_rtc_cache_clear();
+        return mp_const_none;
+    }
+
+    lte_obj.cid = lte_rtc_cache.cid;
+    lte_obj.carrier = lte_rtc_cache.carrier;
+    lte_legacyattach_flag = lte_rtc_cache.legacyattach;
+    lteppp_set_legacy(lte_rtc_cache.legacy ? E_LTE_LEGACY : E_LTE_NORMAL);
+    lteppp_set_state(E_LTE_ATTACHED);
+
+    // the data session may still be open from pppsuspend(), otherwise start it on the cached context
+    if (lte_rtc_cache.legacy || !lte_push_at_command_ext("ATO", LTE_RX_TIMEOUT_MAX_MS, LTE_CONNECT_RSP, strlen("ATO"))) {
+        char at_cmd[LTE_AT_CMD_SIZE_MAX - 4];
+        sprintf(at_cmd, "AT+CGDATA=\"PPP\",%d", lte_obj.cid);
+        if (!lte_push_at_command_ext(at_cmd, LTE_RX_TIMEOUT_MAX_MS, LTE_CONNECT_RSP, strlen(at_cmd))) {
+            lte_rtc_cache_clear();
+            return mp_const_none;
+        }
+    }
+    mod_network_register_nic(&lte_obj);
+    lteppp_connect();
+    lteppp_resume();
+    lteppp_set_state(E_LTE_PPP);
+    int32_t time_to_ip = lte_wait_ip(start, args[0].u_int);
+    if (time_to_ip < 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_TimeoutError, "timed out"));
+    }
+    return mp_obj_new_int(time_to_ip);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(lte_fast_resume_obj, 1, lte_fast_resume);
+
 STATIC mp_obj_t lte_disconnect(mp_obj_t self_in) {
     lte_check_init();
     if (lteppp_get_state() == E_LTE_PPP || lteppp_get_state() == E_LTE_SUSPENDED) {
@@ -1255,10 +1506,20 @@ STATIC mp_obj_t lte_send_raw_at(mp_obj_t self_in, mp_obj_t cmd_o) {
     lte_check_init();
     lte_check_inppp();
     const char *cmd = mp_obj_str_get_str(cmd_o);
-    lte_push_at_command((char *)cmd, LTE_RX_TIMEOUT_MAX_MS);
+    nlr_buf_t nlr;
     vstr_t vstr;
-    vstr_init_len(&vstr, strlen(modlte_rsp.data));
-    strcpy(vstr.buf, modlte_rsp.data);
+    lte_at_lock();
+    if (nlr_push(&nlr) == 0) {
+        lte_push_at_command((char *)cmd, LTE_RX_TIMEOUT_MAX_MS);
+        vstr_init_len(&vstr, strlen(modlte_rsp.data));
+        strcpy(vstr.buf, modlte_rsp.data);
+        nlr_pop();
+    } else {
+        // lte_at_mutex would stay taken for good if the MemoryError went past it
+        lte_at_unlock();
+        nlr_jump(nlr.ret_val);
+    }
+    lte_at_unlock();
     return mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
 }
 //STATIC MP_DEFINE_CONST_FUN_OBJ_2(lte_send_raw_at_obj, lte_send_raw_at);
@@ -1277,24 +1538,32 @@ STATIC mp_obj_t lte_send_at_cmd(mp_uint_t n_args, const mp_obj_t *pos_args, mp_m
     if (args[0].u_obj == mp_const_none) {
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "the command must be specified!"));
     }
-    if (MP_OBJ_IS_STR_OR_BYTES(args[0].u_obj))
-    {
-        size_t len;
-        lte_push_at_command_ext((char *)(mp_obj_str_get_data(args[0].u_obj, &len)), args[1].u_int, NULL, len);
-    }
-    else
+    if (!MP_OBJ_IS_STR_OR_BYTES(args[0].u_obj))
     {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_TypeError, mpexception_num_type_invalid_arguments));
     }
 
+    size_t len;
+    const char *cmd = mp_obj_str_get_data(args[0].u_obj, &len);
+    nlr_buf_t nlr;
     vstr_t vstr;
-    vstr_init(&vstr, 0);
-    vstr_add_str(&vstr, modlte_rsp.data);
-    while(modlte_rsp.data_remaining)
-    {
-        lte_push_at_command_ext("Pycom_Dummy", args[1].u_int, NULL, strlen("Pycom_Dummy") );
+    // the parts of a long response follow each other only while lte_at_mutex is held
+    lte_at_lock();
+    if (nlr_push(&nlr) == 0) {
+        lte_push_at_command_ext((char *)cmd, args[1].u_int, NULL, len);
+        vstr_init(&vstr, 0);
         vstr_add_str(&vstr, modlte_rsp.data);
+        while(modlte_rsp.data_remaining)
+        {
+            lte_push_at_command_ext("Pycom_Dummy", args[1].u_int, NULL, strlen("Pycom_Dummy") );
+            vstr_add_str(&vstr, modlte_rsp.data);
+        }
+        nlr_pop();
+    } else {
+        lte_at_unlock();
+        nlr_jump(nlr.ret_val);
     }
+    lte_at_unlock();
     return mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(lte_send_at_cmd_obj, 1, lte_send_at_cmd);
@@ -1305,11 +1574,10 @@ STATIC mp_obj_t lte_imei(mp_obj_t self_in) {
     lte_check_inppp();
     char *pos;
     vstr_t vstr;
-    char *resp;
+    const char *resp;
     vstr_init_len(&vstr, strlen("AT+CGSN"));
     strcpy(vstr.buf, "AT+CGSN");
-    lte_send_raw_at(MP_OBJ_NULL, mp_obj_new_str_from_vstr(&mp_type_str, &vstr));
-    resp = modlte_rsp.data;
+    resp = mp_obj_str_get_str(lte_send_raw_at(MP_OBJ_NULL, mp_obj_new_str_from_vstr(&mp_type_str, &vstr)));
     if (strcmp(resp, "000000000000000") == 0) {
         vstr_init_len(&vstr, 5);
         memcpy(vstr.buf, "UNSET", 5);
@@ -1330,11 +1598,10 @@ STATIC mp_obj_t lte_time(mp_obj_t self_in) {
     lte_check_inppp();
     char *pos;
     vstr_t vstr;
-    char *resp;
+    const char *resp;
     vstr_init_len(&vstr, strlen("AT+CCLK?"));
     strcpy(vstr.buf, "AT+CCLK?");
-    lte_send_raw_at(MP_OBJ_NULL, mp_obj_new_str_from_vstr(&mp_type_str, &vstr));
-    resp = modlte_rsp.data;
+    resp = mp_obj_str_get_str(lte_send_raw_at(MP_OBJ_NULL, mp_obj_new_str_from_vstr(&mp_type_str, &vstr)));
     if ((pos = strstr(resp, "+CCLK:")) && (strlen(pos) > 20)) {
         char *start_pos;
         char *end_pos;
@@ -1357,8 +1624,8 @@ STATIC mp_obj_t lte_iccid(mp_obj_t self_in) {
 		vstr_t vstr;
 		vstr_init_len(&vstr, strlen("AT+SQNCCID?"));
 		strcpy(vstr.buf, "AT+SQNCCID?");
-		lte_send_raw_at(MP_OBJ_NULL, mp_obj_new_str_from_vstr(&mp_type_str, &vstr));
-		if ((pos = strstr(modlte_rsp.data, "SQNCCID:")) && (strlen(pos) > 25)) {
+		const char *resp = mp_obj_str_get_str(lte_send_raw_at(MP_OBJ_NULL, mp_obj_new_str_from_vstr(&mp_type_str, &vstr)));
+		if ((pos = strstr(resp, "SQNCCID:")) && (strlen(pos) > 25)) {
 			iccid = strchr(pos, '"')+1;
 			pos = strchr(iccid, '"');
 			vstr_init_len(&vstr, strlen(iccid)-strlen(pos));
@@ -1372,6 +1639,12 @@ STATIC mp_obj_t lte_iccid(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(lte_iccid_obj, lte_iccid);
 
+STATIC mp_obj_t lte_uart_baudrate(mp_obj_t self_in) {
+    lte_check_init();
+    return mp_obj_new_int_from_uint(lteppp_get_uart_baudrate());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(lte_uart_baudrate_obj, lte_uart_baudrate);
+
 STATIC mp_obj_t lte_ue_coverage(mp_obj_t self_in) {
     lte_check_init();
     lte_check_inppp();
@@ -1388,6 +1661,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(lte_ue_coverage_obj, lte_ue_coverage);
 
 STATIC mp_obj_t lte_reset(mp_obj_t self_in) {
     lte_check_init();
+    lte_rtc_cache_clear();
     lte_disconnect(self_in);
     if (!lte_push_at_command("AT+CFUN=0", LTE_RX_TIMEOUT_MAX_MS)) {
         mp_hal_delay_ms(LTE_RX_TIMEOUT_MIN_MS);
@@ -1410,6 +1684,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(lte_reset_obj, lte_reset);
 
 STATIC mp_obj_t lte_factory_reset(mp_obj_t self_in) {
     lte_check_init();
+    lte_rtc_cache_clear();
     lte_disconnect(self_in);
     if (!lte_push_at_command("AT&F", LTE_RX_TIMEOUT_MAX_MS * 2)) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
@@ -1513,6 +1788,116 @@ STATIC mp_obj_t lte_upgrade_mode(void) {
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(lte_upgrade_mode_obj, lte_upgrade_mode);
+
+// The image may be a file or any object with seek() and read() methods, like
+// the bootrom image of sqnsbrz.py
+STATIC void lte_stp_seek(mp_obj_t blob, uint32_t offset) {
+    const mp_stream_p_t *stream = mp_get_stream(blob);
+    if (stream != NULL && stream->ioctl != NULL) {
+        int errcode;
+        struct mp_stream_seek_t seek = { .offset = offset, .whence = MP_SEEK_SET };
+        if (stream->ioctl(blob, MP_STREAM_SEEK, (uintptr_t)&seek, &errcode) == MP_STREAM_ERROR) {
+            mp_raise_OSError(errcode);
+        }
+    } else {
+        mp_obj_t dest[3];
+        mp_load_method(blob, MP_QSTR_seek, dest);
+        dest[2] = mp_obj_new_int_from_uint(offset);
+        mp_call_method_n_kw(1, 0, dest);
+    }
+}
+
+STATIC mp_uint_t lte_stp_read(mp_obj_t blob, uint8_t *buf, mp_uint_t len) {
+    const mp_stream_p_t *stream = mp_get_stream(blob);
+    if (stream != NULL && stream->read != NULL) {
+        int errcode;
+        mp_uint_t n = mp_stream_read_exactly(blob, buf, len, &errcode);
+        if (errcode != 0) {
+            mp_raise_OSError(errcode);
+        }
+        return n;
+    }
+    mp_obj_t dest[3];
+    mp_load_method(blob, MP_QSTR_read, dest);
+    dest[2] = mp_obj_new_int_from_uint(len);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(mp_call_method_n_kw(1, 0, dest), &bufinfo, MP_BUFFER_READ);
+    len = MIN(len, bufinfo.len);
+    memcpy(buf, bufinfo.buf, len);
+    return len;
+}
+
+// Pushes a modem firmware image over the Sequans transfer protocol, in place
+// of frozen/LTE/sqnstp.py. The image is read from blob, from
+// offset on, and the number of bytes the modem took is returned, so a failed
+// transfer can be resumed by calling again with that offset. The image is
+// read under the GIL but the UART exchange runs without it.
+STATIC mp_obj_t lte_modem_stp_send(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_blob, ARG_size, ARG_offset, ARG_uart, ARG_progress, ARG_timeout };
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_blob,         MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_size,         MP_ARG_REQUIRED | MP_ARG_INT, },
+        { MP_QSTR_offset,       MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_uart,         MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 1} },
+        { MP_QSTR_progress,     MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_timeout,      MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = SQNSTP_TIMEOUT_MS} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    mp_obj_t blob = args[ARG_blob].u_obj;
+    uint32_t size = args[ARG_size].u_int;
+    uint32_t offset = args[ARG_offset].u_int;
+    mp_obj_t progress = args[ARG_progress].u_obj;
+    uart_port_t uart = args[ARG_uart].u_int;
+    if (uart >= UART_NUM_MAX || offset > size) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+
+    lte_stp_seek(blob, offset);
+
+    sqnstp_t stp;
+    sqnstp_init(&stp, uart, args[ARG_timeout].u_int);
+    uint8_t *chunk = m_new(uint8_t, LTE_STP_CHUNK_SIZE);
+
+    MP_THREAD_GIL_EXIT();
+    sqnstp_err_t err = sqnstp_reset(&stp, false);
+    if (err == E_SQNSTP_OK) {
+        err = sqnstp_open_session(&stp);
+    }
+    MP_THREAD_GIL_ENTER();
+
+    while (err == E_SQNSTP_OK && offset < size) {
+        mp_uint_t len = lte_stp_read(blob, chunk, MIN(LTE_STP_CHUNK_SIZE, size - offset));
+        if (len == 0) {
+            break;
+        }
+
+        // the UART runs at full speed while the other threads carry on
+        uint32_t sent;
+        MP_THREAD_GIL_EXIT();
+        err = sqnstp_send(&stp, chunk, len, &sent);
+        MP_THREAD_GIL_ENTER();
+        offset += sent;
+
+        if (progress != mp_const_none) {
+            mp_call_function_2(progress, mp_obj_new_int_from_uint(offset), mp_obj_new_int_from_uint(size));
+        }
+    }
+    m_del(uint8_t, chunk, LTE_STP_CHUNK_SIZE);
+
+    if (err != E_SQNSTP_OK) {
+        mp_printf(&mp_plat_print, "%s\n", sqnstp_strerror(err));
+    } else {
+        MP_THREAD_GIL_EXIT();
+        stp.timeout_ms = SQNSTP_CLOSE_TIMEOUT_MS;
+        sqnstp_reset(&stp, true);
+        MP_THREAD_GIL_ENTER();
+    }
+    return mp_obj_new_int_from_uint(offset);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(lte_modem_stp_send_fun_obj, 2, lte_modem_stp_send);
+STATIC MP_DEFINE_CONST_STATICMETHOD_OBJ(lte_modem_stp_send_obj, &lte_modem_stp_send_fun_obj);
 #ifdef LTE_DEBUG_BUFF
 STATIC mp_obj_t lte_debug_buff(void) {
     vstr_t vstr;
@@ -1590,14 +1975,17 @@ STATIC const mp_map_elem_t lte_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_disconnect),          (mp_obj_t)&lte_disconnect_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_pppsuspend),          (mp_obj_t)&lte_suspend_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_pppresume),           (mp_obj_t)&lte_resume_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_fast_resume),         (mp_obj_t)&lte_fast_resume_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_time),                (mp_obj_t)&lte_time_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_isconnected),         (mp_obj_t)&lte_isconnected_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_imei),                (mp_obj_t)&lte_imei_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_iccid),               (mp_obj_t)&lte_iccid_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_uart_baudrate),       (mp_obj_t)&lte_uart_baudrate_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_send_at_cmd),         (mp_obj_t)&lte_send_at_cmd_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_reset),               (mp_obj_t)&lte_reset_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_factory_reset),       (mp_obj_t)&lte_factory_reset_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_modem_upgrade_mode),  (mp_obj_t)&lte_upgrade_mode_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_modem_stp_send),      (mp_obj_t)&lte_modem_stp_send_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_reconnect_uart),      (mp_obj_t)&lte_reconnect_uart_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ue_coverage),         (mp_obj_t)&lte_ue_coverage_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_lte_callback),         (mp_obj_t)&lte_callback_obj },
@@ -1646,6 +2034,7 @@ const mod_network_nic_type_t mod_network_nic_type_lte = {
     .n_send = lwipsocket_socket_send,
     .n_recv = lwipsocket_socket_recv,
     .n_recvfrom = lwipsocket_socket_recvfrom,
+    .n_sendmsg = lwipsocket_socket_sendmsg,
     .n_settimeout = lwipsocket_socket_settimeout,
     .n_setsockopt = lwipsocket_socket_setsockopt,
     .n_bind = lwipsocket_socket_bind,
@@ -1654,3 +2043,332 @@ const mod_network_nic_type_t mod_network_nic_type_lte = {
     .inf_up = ltepp_is_ppp_conn_up,
     .set_default_inf = lte_set_default_inf
 };
+
+const mod_network_nic_type_t mod_network_nic_type_lte_modem = {
+    .base = {
+        { &mp_type_type },
+        .name = MP_QSTR_LTE,
+     },
+
+    .n_socket = lte_modem_socket_socket,
+    .n_close = lte_modem_socket_close,
+    .n_bind = lte_modem_socket_bind,
+    .n_connect = lte_modem_socket_connect,
+    .n_send = lte_modem_socket_send,
+    .n_sendto = lte_modem_socket_sendto,
+    .n_recv = lte_modem_socket_recv,
+    .n_recvfrom = lte_modem_socket_recvfrom,
+    .n_setsockopt = lte_modem_socket_setsockopt,
+    .n_settimeout = lte_modem_socket_settimeout,
+    .n_ioctl = lte_modem_socket_ioctl,
+};
+
+///******************************************************************************/
+//// Micro Python bindings; LTE modem socket
+//
+// Small datagrams are sent by the modem itself while it is attached, which saves the HDLC framing
+// on the UART and the LCP keepalives of PPP. The socket functions that exchange data are called
+// without the GIL, so they use lte_push_at_command_direct() and keep lte_at_mutex for their sequences.
+
+// the sockets stay allocated until closed, so that a stale one can't close a newer one
+static void lte_modem_socket_reset_all(void) {
+    for (int i = 0; i < LTE_MODEM_SOCKETS_MAX; i++) {
+        lte_modem_sockets[i].open = false;
+    }
+}
+
+// the modem's sockets can be used once attached, and not while the UART carries PPP
+static bool lte_modem_socket_ready(void) {
+    lte_state_t state = lteppp_get_state();
+    return lte_obj.init && (state == E_LTE_ATTACHED || state == E_LTE_SUSPENDED);
+}
+
+static lte_modem_socket_t *lte_modem_socket_get(mod_network_socket_obj_t *s, int *_errno) {
+    int32_t sd = s->sock_base.u.sd;
+    if (sd < 1 || sd > LTE_MODEM_SOCKETS_MAX || !lte_modem_sockets[sd - 1].used) {
+        *_errno = MP_EBADF;
+        return NULL;
+    }
+    if (!lte_modem_socket_ready()) {
+        *_errno = MP_ENETDOWN;
+        return NULL;
+    }
+    return &lte_modem_sockets[sd - 1];
+}
+
+static void lte_modem_socket_shut(int32_t sd, lte_modem_socket_t *sock) {
+    if (sock->open) {
+        char at_cmd[LTE_AT_CMD_DATA_SIZE_MAX];
+        snprintf(at_cmd, sizeof(at_cmd), "AT+SQNSH=%d", sd);
+        lte_push_at_command_direct(at_cmd, LTE_RX_TIMEOUT_MAX_MS, LTE_OK_RSP, strlen(at_cmd), false);
+        sock->open = false;
+    }
+}
+
+// (re)connects the modem socket to ip and port, in command mode and with hex encoded received data
+static int lte_modem_socket_open(int32_t sd, lte_modem_socket_t *sock, const byte *ip, mp_uint_t port, int *_errno) {
+    char at_cmd[LTE_AT_CMD_DATA_SIZE_MAX];
+    bool ok;
+
+    xSemaphoreTakeRecursive(lte_at_mutex, portMAX_DELAY);
+    lte_modem_socket_shut(sd, sock);
+    snprintf(at_cmd, sizeof(at_cmd), "AT+SQNSCFG=%d,%d,%d,0,%d,50", sd, lte_obj.cid, LTE_MODEM_PKT_SIZE_MAX, LTE_MODEM_CONN_TIMEOUT_DS);
+    ok = lte_push_at_command_direct(at_cmd, LTE_RX_TIMEOUT_MAX_MS, LTE_OK_RSP, strlen(at_cmd), false);
+    if (ok) {
+        snprintf(at_cmd, sizeof(at_cmd), "AT+SQNSCFGEXT=%d,1,1,0,0,0", sd);
+        ok = lte_push_at_command_direct(at_cmd, LTE_RX_TIMEOUT_MAX_MS, LTE_OK_RSP, strlen(at_cmd), false);
+    }
+    if (ok) {
+        snprintf(at_cmd, sizeof(at_cmd), "AT+SQNSD=%d,%d,%u,\"%u.%u.%u.%u\",0,%u,1", sd, sock->proto, (unsigned int)port,
+                 ip[3], ip[2], ip[1], ip[0], sock->local_port);
+        ok = lte_push_at_command_direct(at_cmd, LTE_MODEM_CONNECT_TIMEOUT_MS, LTE_OK_RSP, strlen(at_cmd), false);
+    }
+    xSemaphoreGiveRecursive(lte_at_mutex);
+
+    if (!ok) {
+        *_errno = (sock->proto == 0) ? MP_ECONNREFUSED : MP_EIO;
+        return -1;
+    }
+    memcpy(sock->ip, ip, MOD_NETWORK_IPV4ADDR_BUF_SIZE);
+    sock->port = port;
+    sock->open = true;
+    return 0;
+}
+
+// returns the number of bytes waiting in the modem, or -1 if it doesn't know the socket anymore
+static int lte_modem_socket_pending(int32_t sd) {
+    char at_cmd[LTE_AT_CMD_DATA_SIZE_MAX];
+    int pending = -1;
+    snprintf(at_cmd, sizeof(at_cmd), "AT+SQNSI=%d", sd);
+    xSemaphoreTakeRecursive(lte_at_mutex, portMAX_DELAY);
+    if (lte_push_at_command_direct(at_cmd, LTE_RX_TIMEOUT_MAX_MS, LTE_OK_RSP, strlen(at_cmd), false)) {
+        // +SQNSI: <connId>,<sent>,<received>,<buff_in>,<ack_waiting>
+        const char *pos = strstr(modlte_rsp.data, "+SQNSI:");
+        unsigned int id, sent, received, buff_in;
+        if (pos != NULL && sscanf(pos, "+SQNSI: %u,%u,%u,%u", &id, &sent, &received, &buff_in) == 4) {
+            pending = buff_in;
+        }
+    }
+    xSemaphoreGiveRecursive(lte_at_mutex);
+    return pending;
+}
+
+static int lte_modem_socket_send_data(int32_t sd, const byte *buf, mp_uint_t len, int *_errno) {
+    char at_cmd[LTE_AT_CMD_DATA_SIZE_MAX];
+    bool ok;
+
+    snprintf(at_cmd, sizeof(at_cmd), "AT+SQNSSENDEXT=%d,%u", sd, (unsigned int)len);
+    xSemaphoreTakeRecursive(lte_at_mutex, portMAX_DELAY);
+    ok = lte_push_at_command_direct(at_cmd, LTE_RX_TIMEOUT_MAX_MS, ">", strlen(at_cmd), false);
+    if (ok) {
+        // the modem takes exactly len bytes after the prompt, then answers
+        for (mp_uint_t offset = 0; offset < len; offset += LTE_MODEM_SEND_CHUNK_SIZE) {
+            lte_push_at_command_direct((const char *)&buf[offset], 0, NULL, MIN(len - offset, LTE_MODEM_SEND_CHUNK_SIZE), true);
+        }
+        ok = lte_push_at_command_direct("Pycom_Dummy", LTE_RX_TIMEOUT_MAX_MS, LTE_OK_RSP, strlen("Pycom_Dummy"), false);
+    }
+    xSemaphoreGiveRecursive(lte_at_mutex);
+
+    if (!ok) {
+        *_errno = MP_EIO;
+        return -1;
+    }
+    return len;
+}
+
+// waits for data as long as the timeout of the socket allows, polling the modem
+static int lte_modem_socket_recv_data(mod_network_socket_obj_t *s, lte_modem_socket_t *sock, byte *buf, mp_uint_t len, int *_errno) {
+    int32_t sd = s->sock_base.u.sd;
+    uint32_t start = mp_hal_ticks_ms();
+    int pending;
+
+    if (!sock->open) {
+        *_errno = MP_ENOTCONN;
+        return -1;
+    }
+    while ((pending = lte_modem_socket_pending(sd)) == 0) {
+        if (s->sock_base.timeout == 0 || (s->sock_base.timeout > 0 && mp_hal_ticks_ms() - start >= s->sock_base.timeout)) {
+            *_errno = MP_EAGAIN;
+            return -1;
+        }
+        vTaskDelay(LTE_MODEM_POLL_MS / portTICK_PERIOD_MS);
+    }
+    if (pending < 0) {
+        // a stream closed by the peer reads as the end of it
+        sock->open = false;
+        if (sock->proto == 0) {
+            return 0;
+        }
+        *_errno = MP_EIO;
+        return -1;
+    }
+
+    char at_cmd[LTE_AT_CMD_DATA_SIZE_MAX];
+    int ret = -1;
+    len = MIN(MIN(len, (mp_uint_t)pending), LTE_MODEM_RECV_SIZE_MAX);
+    snprintf(at_cmd, sizeof(at_cmd), "AT+SQNSRECV=%d,%u", sd, (unsigned int)len);
+    xSemaphoreTakeRecursive(lte_at_mutex, portMAX_DELAY);
+    if (lte_push_at_command_direct(at_cmd, LTE_RX_TIMEOUT_MAX_MS, LTE_OK_RSP, strlen(at_cmd), false)) {
+        // +SQNSRECV: <connId>,<n>\r\n<2 * n hex digits>\r\nOK
+        const char *pos = strstr(modlte_rsp.data, "+SQNSRECV:");
+        unsigned int id, n;
+        if (pos != NULL && sscanf(pos, "+SQNSRECV: %u,%u", &id, &n) == 2 && (pos = strchr(pos, '\n')) != NULL) {
+            pos++;
+            n = MIN(n, len);
+            for (ret = 0; ret < (int)n && unichar_isxdigit(pos[0]) && unichar_isxdigit(pos[1]); ret++, pos += 2) {
+                buf[ret] = (unichar_xdigit_value(pos[0]) << 4) | unichar_xdigit_value(pos[1]);
+            }
+        }
+    }
+    xSemaphoreGiveRecursive(lte_at_mutex);
+
+    if (ret < 0) {
+        *_errno = MP_EIO;
+    }
+    return ret;
+}
+
+static int lte_modem_socket_socket (mod_network_socket_obj_t *s, int *_errno) {
+    uint8_t type = s->sock_base.u.u_param.type;
+    if (type != SOCK_STREAM && type != SOCK_DGRAM) {
+        *_errno = MP_EOPNOTSUPP;
+        return -1;
+    }
+    if (!lte_modem_socket_ready()) {
+        *_errno = MP_ENETDOWN;
+        return -1;
+    }
+    for (int i = 0; i < LTE_MODEM_SOCKETS_MAX; i++) {
+        if (!lte_modem_sockets[i].used) {
+            memset(&lte_modem_sockets[i], 0, sizeof(lte_modem_sockets[i]));
+            lte_modem_sockets[i].used = true;
+            lte_modem_sockets[i].proto = (type == SOCK_STREAM) ? 0 : 1;
+            s->sock_base.u.sd = i + 1;
+            return 0;
+        }
+    }
+    *_errno = MP_EMFILE;
+    return -1;
+}
+
+// also called by the finaliser, so the GIL is kept while the modem closes the socket
+static void lte_modem_socket_close (mod_network_socket_obj_t *s) {
+    int32_t sd = s->sock_base.u.sd;
+    if (sd >= 1 && sd <= LTE_MODEM_SOCKETS_MAX && lte_modem_sockets[sd - 1].used) {
+        if (lte_modem_socket_ready()) {
+            lte_modem_socket_shut(sd, &lte_modem_sockets[sd - 1]);
+        }
+        lte_modem_sockets[sd - 1].used = false;
+        lte_modem_sockets[sd - 1].open = false;
+    }
+    modusocket_socket_delete(sd);
+}
+
+static int lte_modem_socket_bind (mod_network_socket_obj_t *s, byte *ip, mp_uint_t port, int *_errno) {
+    lte_modem_socket_t *sock = lte_modem_socket_get(s, _errno);
+    if (sock == NULL) {
+        return -1;
+    }
+    // the local port is given to the modem when the socket connects
+    if (sock->open) {
+        *_errno = MP_EINVAL;
+        return -1;
+    }
+    sock->local_port = port;
+    return 0;
+}
+
+static int lte_modem_socket_connect (mod_network_socket_obj_t *s, byte *ip, mp_uint_t port, int *_errno) {
+    lte_modem_socket_t *sock = lte_modem_socket_get(s, _errno);
+    if (sock == NULL) {
+        return -1;
+    }
+    return lte_modem_socket_open(s->sock_base.u.sd, sock, ip, port, _errno);
+}
+
+static int lte_modem_socket_send (mod_network_socket_obj_t *s, const byte *buf, mp_uint_t len, int *_errno) {
+    lte_modem_socket_t *sock = lte_modem_socket_get(s, _errno);
+    if (sock == NULL) {
+        return -1;
+    }
+    if (!sock->open) {
+        *_errno = MP_ENOTCONN;
+        return -1;
+    }
+    if (len > LTE_MODEM_PKT_SIZE_MAX) {
+        // a stream takes what fits, a datagram can't be split
+        if (sock->proto == 1) {
+            *_errno = MP_EMSGSIZE;
+            return -1;
+        }
+        len = LTE_MODEM_PKT_SIZE_MAX;
+    }
+    return lte_modem_socket_send_data(s->sock_base.u.sd, buf, len, _errno);
+}
+
+// a datagram socket is connected to each new destination, so alternating ones costs an AT+SQNSD each time
+static int lte_modem_socket_sendto (mod_network_socket_obj_t *s, const byte *buf, mp_uint_t len, byte *ip, mp_uint_t port, int *_errno) {
+    lte_modem_socket_t *sock = lte_modem_socket_get(s, _errno);
+    if (sock == NULL) {
+        return -1;
+    }
+    if (sock->proto == 1 && (!sock->open || sock->port != port || memcmp(sock->ip, ip, MOD_NETWORK_IPV4ADDR_BUF_SIZE))) {
+        if (lte_modem_socket_open(s->sock_base.u.sd, sock, ip, port, _errno) != 0) {
+            return -1;
+        }
+    }
+    return lte_modem_socket_send(s, buf, len, _errno);
+}
+
+static int lte_modem_socket_recv (mod_network_socket_obj_t *s, byte *buf, mp_uint_t len, int *_errno) {
+    lte_modem_socket_t *sock = lte_modem_socket_get(s, _errno);
+    if (sock == NULL) {
+        return -1;
+    }
+    return lte_modem_socket_recv_data(s, sock, buf, len, _errno);
+}
+
+// the modem only lets the connected peer through, so it is the sender
+static int lte_modem_socket_recvfrom (mod_network_socket_obj_t *s, byte *buf, mp_uint_t len, byte *ip, mp_uint_t *port, int *_errno) {
+    lte_modem_socket_t *sock = lte_modem_socket_get(s, _errno);
+    if (sock == NULL) {
+        return -1;
+    }
+    int ret = lte_modem_socket_recv_data(s, sock, buf, len, _errno);
+    if (ret >= 0) {
+        memcpy(ip, sock->ip, MOD_NETWORK_IPV4ADDR_BUF_SIZE);
+        *port = sock->port;
+    }
+    return ret;
+}
+
+static int lte_modem_socket_setsockopt (mod_network_socket_obj_t *s, mp_uint_t level, mp_uint_t opt, const void *optval, mp_uint_t optlen, int *_errno) {
+    *_errno = MP_EOPNOTSUPP;
+    return -1;
+}
+
+static int lte_modem_socket_settimeout (mod_network_socket_obj_t *s, mp_int_t timeout_ms, int *_errno) {
+    s->sock_base.timeout = timeout_ms;
+    return 0;
+}
+
+static int lte_modem_socket_ioctl (mod_network_socket_obj_t *s, mp_uint_t request, mp_uint_t arg, int *_errno) {
+    mp_int_t ret = 0;
+    lte_modem_socket_t *sock = lte_modem_socket_get(s, _errno);
+    if (sock == NULL) {
+        return MP_STREAM_ERROR;
+    }
+    if (request == MP_STREAM_POLL) {
+        mp_uint_t flags = arg;
+        if ((flags & MP_STREAM_POLL_RD) && sock->open && lte_modem_socket_pending(s->sock_base.u.sd) != 0) {
+            ret |= MP_STREAM_POLL_RD;
+        }
+        if ((flags & MP_STREAM_POLL_WR) && (sock->open || sock->proto == 1)) {
+            ret |= MP_STREAM_POLL_WR;
+        }
+    } else {
+        *_errno = MP_EINVAL;
+        ret = MP_STREAM_ERROR;
+    }
+    return ret;
+}
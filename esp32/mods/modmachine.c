@@ -37,6 +37,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #include "py/mpconfig.h"
 #include "py/obj.h"
@@ -51,6 +52,9 @@
 #include "esp_spi_flash.h"
 #include "nvs_flash.h"
 #include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_bt.h"
+#include "driver/uart.h"
 #include "soc/timer_group_struct.h"
 #include "esp_flash_encrypt.h"
 #include "esp_secure_boot.h"
@@ -65,7 +69,9 @@
 #include "machpwm.h"
 #include "machrtc.h"
 #include "mperror.h"
+#include "mpexception.h"
 #include "mpsleep.h"
+#include "mpcpufreq.h"
 #include "pybadc.h"
 #include "pybdac.h"
 #include "pybsd.h"
@@ -75,9 +81,17 @@
 #include "machwdt.h"
 #include "machcan.h"
 #include "machrmt.h"
+#include "machledstrip.h"
+#include "machonewire.h"
+#include "machcounter.h"
+#include "machulp.h"
+#include "machtimer_alarm.h"
 #include "machtouch.h"
 #include "pycom_config.h"
 #include "modmachine.h"
+#include "modpycom_nvs.h"
+#include "mptrace.h"
+#include "mpenergy.h"
 #if defined (GPY) || defined (FIPY)
 #include "lteppp.h"
 #endif
@@ -97,6 +111,7 @@
 #include "../pygate/concentrator/loragw_hal_esp.h"
 #include "lora_pkt_fwd.h"
 #include "mpirq.h"
+#include "mpthreadport.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -106,9 +121,28 @@
 #define PYGATE_ERROR_EVENT          (0x00004)
 #endif
 
+#define MACHINE_AUTO_SLEEP_MIN_MS_DEFAULT      (20)
+// the first bytes received by the UART are used to wake up, the REPL loses them
+#define MACHINE_AUTO_SLEEP_UART_THRESHOLD       (3)
+
 static RTC_DATA_ATTR int64_t mach_expected_wakeup_time;
 static int64_t mach_remaining_sleep_time;
 
+// light sleep taken automatically by the delays, see machine.auto_sleep()
+typedef struct {
+    bool enabled;
+    uint32_t min_ms;
+    uint32_t sleeps;
+    uint32_t skipped;
+    uint64_t residency_us;
+    uint32_t timer_wakeups;
+    uint64_t latency_sum_us;
+    uint32_t latency_max_us;
+    uint32_t margin_us;         // running average of the latency, the sleeps end earlier by this much
+} machine_auto_sleep_t;
+
+static machine_auto_sleep_t machine_auto_sleep_state = { .min_ms = MACHINE_AUTO_SLEEP_MIN_MS_DEFAULT };
+
 #ifdef PYGATE_ENABLED
 typedef struct _machine_obj_t {
     mp_obj_base_t           base;
@@ -153,6 +187,76 @@ void machine_init0(void) {
 #endif
 }
 
+// Called by mp_hal_delay_ms with the GIL released, sleeps in light sleep if nothing else has to run
+// Returns the part of the delay still to be waited for
+uint32_t machine_auto_sleep(uint32_t delay_ms) {
+    machine_auto_sleep_t *state = &machine_auto_sleep_state;
+
+    if (!state->enabled || delay_ms < state->min_ms) {
+        return delay_ms;
+    }
+    // the tick of FreeRTOS is not compensated after the sleep, the other threads would be late,
+    // the radios refuse the light sleep and the peripherals clocked by the APB stop
+    if (mp_thread_count() > 1 || wlan_obj.started || esp_bt_controller_get_status() != ESP_BT_CONTROLLER_STATUS_IDLE ||
+        mach_timer_alarm_pending() || machcounter_any_active()
+#if defined(FIPY) || defined(GPY)
+        || lteppp_get_modem_conn_state() < E_LTE_MODEM_DISCONNECTED
+#endif
+#ifdef MOD_LORA_ENABLED
+        || !modlora_is_module_sleep()
+#endif
+        ) {
+        state->skipped++;
+        return delay_ms;
+    }
+
+    // wake up early by the average latency so that the delay is not overshot
+    uint64_t sleep_us = (uint64_t)delay_ms * 1000;
+    uint64_t margin_us = state->margin_us;
+    if (margin_us >= sleep_us) {
+        state->skipped++;
+        return delay_ms;
+    }
+    esp_sleep_enable_timer_wakeup(sleep_us - margin_us);
+    uart_set_wakeup_threshold(UART_NUM_0, MACHINE_AUTO_SLEEP_UART_THRESHOLD);
+    esp_sleep_enable_uart_wakeup(UART_NUM_0);
+
+    int64_t start = esp_timer_get_time();
+    mpenergy_set(MPENERGY_RAIL_CPU, false);
+    esp_err_t err = esp_light_sleep_start();
+    mpenergy_set(MPENERGY_RAIL_CPU, true);
+    int64_t end = esp_timer_get_time();
+
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_UART);
+    if (err != ESP_OK) {
+        state->skipped++;
+        return delay_ms;
+    }
+
+    state->sleeps++;
+    state->residency_us += end - start;
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER) {
+        // time between the programmed wake up and the return to the application
+        int64_t latency = end - start - (int64_t)(sleep_us - margin_us);
+        if (latency < 0) {
+            latency = 0;
+        }
+        state->timer_wakeups++;
+        state->latency_sum_us += latency;
+        state->latency_max_us = MAX(state->latency_max_us, (uint32_t)latency);
+        state->margin_us = (state->margin_us * 7 + latency) / 8;
+    }
+
+    int64_t elapsed_ms = (end - start) / 1000;
+    return (elapsed_ms >= delay_ms) ? 0 : (delay_ms - elapsed_ms);
+}
+
+void machine_auto_sleep_deinit(void) {
+    memset(&machine_auto_sleep_state, 0, sizeof(machine_auto_sleep_state));
+    machine_auto_sleep_state.min_ms = MACHINE_AUTO_SLEEP_MIN_MS_DEFAULT;
+}
+
 #ifdef PYGATE_ENABLED
 void machine_register_pygate_sig_handler(_sig_func_cb_ptr sig_handler)
 {
@@ -214,7 +318,9 @@ STATIC mp_obj_t machine_info(void) {
     mp_printf(&mp_plat_print, "MPTask stack water mark: %d\n", (unsigned int)uxTaskGetStackHighWaterMark((TaskHandle_t)mpTaskHandle));
     mp_printf(&mp_plat_print, "ServersTask stack water mark: %d\n", (unsigned int)uxTaskGetStackHighWaterMark((TaskHandle_t)svTaskHandle));
 #if defined (LOPY) || defined (LOPY4) || defined (FIPY)
-    mp_printf(&mp_plat_print, "LoRaTask stack water mark: %d\n", (unsigned int)uxTaskGetStackHighWaterMark((TaskHandle_t)xLoRaTaskHndl));
+    if (xLoRaTaskHndl != NULL) {
+        mp_printf(&mp_plat_print, "LoRaTask stack water mark: %d\n", (unsigned int)uxTaskGetStackHighWaterMark((TaskHandle_t)xLoRaTaskHndl));
+    }
 #endif
 #if defined (SIPY) || defined (LOPY4) || defined (FIPY)
     mp_printf(&mp_plat_print, "SigfoxTask stack water mark: %d\n", (unsigned int)uxTaskGetStackHighWaterMark((TaskHandle_t)xSigfoxTaskHndl));
@@ -228,17 +334,319 @@ STATIC mp_obj_t machine_info(void) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(machine_info_obj, machine_info);
 
+STATIC mp_obj_t machine_irq_stats(size_t n_args, const mp_obj_t *args) {
+    mp_irq_stats_t stats;
+    mp_irq_get_stats(&stats, n_args > 0 && mp_obj_is_true(args[0]));
+    mp_obj_t tuple[3];
+    tuple[0] = mp_obj_new_int_from_uint(stats.queued);
+    tuple[1] = mp_obj_new_int_from_uint(stats.coalesced);
+    tuple[2] = mp_obj_new_int_from_uint(stats.dropped);
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_irq_stats_obj, 0, 1, machine_irq_stats);
+
+#define MACHINE_TASK_STATS_MAX                  (32)
+
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+// the counters of the previous sample, so that the CPU share covers the time between two calls
+static struct {
+    UBaseType_t number;
+    uint32_t run_time;
+} machine_task_prev[MACHINE_TASK_STATS_MAX];
+static uint32_t machine_task_prev_total;
+#else
+extern TaskHandle_t xSocketOpsTaskHndl;
+#if defined (GPY) || defined (FIPY)
+extern TaskHandle_t xLTETaskHndl;
+extern TaskHandle_t xLTEUartEvtTaskHndl;
+#endif
+#endif
+
+STATIC mp_obj_t machine_task_stats_entry(TaskHandle_t task, eTaskState state, UBaseType_t priority, mp_obj_t run_time, mp_obj_t cpu) {
+    static const qstr machine_task_stats_fields[] = {
+        MP_QSTR_name, MP_QSTR_core, MP_QSTR_priority, MP_QSTR_state, MP_QSTR_runtime, MP_QSTR_cpu, MP_QSTR_stack_free
+    };
+    // same letters as vTaskList()
+    static const char states[] = { 'X', 'R', 'B', 'S', 'D' };
+    const char *name = pcTaskGetTaskName(task);
+    BaseType_t core = xTaskGetAffinity(task);
+
+    mp_obj_t tuple[7];
+    tuple[0] = mp_obj_new_str(name, strlen(name));
+    tuple[1] = (core == tskNO_AFFINITY) ? mp_const_none : mp_obj_new_int(core);
+    tuple[2] = mp_obj_new_int(priority);
+    tuple[3] = mp_obj_new_str(&states[state < sizeof(states) ? state : sizeof(states) - 1], 1);
+    tuple[4] = run_time;
+    tuple[5] = cpu;
+    tuple[6] = mp_obj_new_int_from_uint(uxTaskGetStackHighWaterMark(task));
+    return mp_obj_new_attrtuple(machine_task_stats_fields, 7, tuple);
+}
+
+// one (name, core, priority, state, runtime, cpu, stack_free) entry per task, cpu being the share of one core
+// in % since the previous call. Without the FreeRTOS run time stats only the tasks of the port are listed
+STATIC mp_obj_t machine_task_stats(void) {
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    UBaseType_t n_tasks = uxTaskGetNumberOfTasks() + 2;
+    TaskStatus_t *status = m_new(TaskStatus_t, n_tasks);
+    uint32_t total;
+    UBaseType_t n = uxTaskGetSystemState(status, n_tasks, &total);
+    uint32_t elapsed = total - machine_task_prev_total;
+
+    for (UBaseType_t i = 0; i < n; i++) {
+        uint32_t run_time = status[i].ulRunTimeCounter;
+        uint32_t prev = 0;
+        uint32_t slot = status[i].xTaskNumber % MACHINE_TASK_STATS_MAX;
+        if (machine_task_prev[slot].number == status[i].xTaskNumber) {
+            prev = machine_task_prev[slot].run_time;
+        }
+        machine_task_prev[slot].number = status[i].xTaskNumber;
+        machine_task_prev[slot].run_time = run_time;
+        mp_obj_t cpu = mp_obj_new_float(elapsed ? ((run_time - prev) * 100.0f) / elapsed : 0.0f);
+        mp_obj_list_append(list, machine_task_stats_entry(status[i].xHandle, status[i].eCurrentState,
+                                                          status[i].uxCurrentPriority, mp_obj_new_int_from_uint(run_time), cpu));
+    }
+    machine_task_prev_total = total;
+    m_del(TaskStatus_t, status, n_tasks);
+#else
+    TaskHandle_t tasks[] = {
+        mpTaskHandle, svTaskHandle, xSocketOpsTaskHndl,
+    #if defined (LOPY) || defined (LOPY4) || defined (FIPY)
+        xLoRaTaskHndl, xLoRaTimerTaskHndl,
+    #endif
+    #if defined (SIPY) || defined (LOPY4) || defined (FIPY)
+        xSigfoxTaskHndl,
+    #endif
+    #if defined (GPY) || defined (FIPY)
+        xLTETaskHndl, xLTEUartEvtTaskHndl,
+    #endif
+        xTimerGetTimerDaemonTaskHandle(), xTaskGetIdleTaskHandleForCPU(0), xTaskGetIdleTaskHandleForCPU(1),
+    };
+    for (uint32_t i = 0; i < MP_ARRAY_SIZE(tasks); i++) {
+        if (tasks[i] != NULL) {
+            mp_obj_list_append(list, machine_task_stats_entry(tasks[i], eTaskGetState(tasks[i]), uxTaskPriorityGet(tasks[i]),
+                                                              mp_const_none, mp_const_none));
+        }
+    }
+#endif
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(machine_task_stats_obj, machine_task_stats);
+
+// the sources being traced, a mask of the TRACE_* constants
+STATIC mp_obj_t machine_trace(size_t n_args, const mp_obj_t *args) {
+    if (n_args > 0) {
+        if (!mptrace_enable(mp_obj_get_int(args[0]))) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_MemoryError, "no memory for the trace buffer"));
+        }
+        return mp_const_none;
+    }
+    return mp_obj_new_int_from_uint(mptrace_mask);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_trace_obj, 0, 1, machine_trace);
+
+// records an event of the application among the ones of the drivers, when TRACE_USER is enabled
+STATIC mp_obj_t machine_trace_event(size_t n_args, const mp_obj_t *args) {
+    uint32_t arg0 = (n_args > 1) ? mp_obj_get_int_truncated(args[1]) : 0;
+    uint32_t arg1 = (n_args > 2) ? mp_obj_get_int_truncated(args[2]) : 0;
+    MPTRACE(MPTRACE_USER | (mp_obj_get_int(args[0]) & 0xFF), arg0, arg1);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_trace_event_obj, 1, 3, machine_trace_event);
+
+// the records not dumped yet, 16 bytes each to be decoded by esp32/tools/mptrace_decode.py.
+// Given a buffer they are written into it and the number of bytes is returned
+STATIC mp_obj_t machine_trace_dump(size_t n_args, const mp_obj_t *args) {
+    if (n_args > 0) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_WRITE);
+        // through an aligned buffer, the one given might not be
+        mptrace_record_t records[8];
+        uint32_t max = bufinfo.len / sizeof(mptrace_record_t);
+        uint32_t len = 0;
+        while (len < max) {
+            uint32_t n = mptrace_dump(records, MIN(max - len, MP_ARRAY_SIZE(records)));
+            if (n == 0) {
+                break;
+            }
+            memcpy((uint8_t *)bufinfo.buf + len * sizeof(mptrace_record_t), records, n * sizeof(mptrace_record_t));
+            len += n;
+        }
+        return mp_obj_new_int_from_uint(len * sizeof(mptrace_record_t));
+    }
+
+    uint32_t pending = mptrace_pending();
+    if (pending == 0) {
+        return mp_const_empty_bytes;
+    }
+    vstr_t vstr;
+    vstr_init_len(&vstr, pending * sizeof(mptrace_record_t));
+    vstr.len = mptrace_dump((mptrace_record_t *)vstr.buf, pending) * sizeof(mptrace_record_t);
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_trace_dump_obj, 0, 1, machine_trace_dump);
+
+STATIC mp_obj_t machine_energy_per_message(uint64_t uj, uint32_t messages) {
+    return (messages > 0) ? mp_obj_new_int_from_ull(uj / messages) : mp_const_none;
+}
+
+// the estimate of the energy used since boot or the last reset, from the active time of the rails and
+// their currents: (elapsed_us, uj, messages, uj_per_message), all the rails over all the messages
+STATIC mp_obj_t machine_energy(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const qstr machine_energy_fields[] = {
+        MP_QSTR_elapsed_us, MP_QSTR_uj, MP_QSTR_messages, MP_QSTR_uj_per_message
+    };
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_reset,        MP_ARG_BOOL,                  {.u_bool = false} },
+        { MP_QSTR_voltage,      MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = -1} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    // the supply the currents are drawn from, in mV
+    if (args[1].u_int != -1) {
+        if (args[1].u_int <= 0) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        mpenergy_set_voltage(args[1].u_int);
+    }
+
+    uint64_t uj = mpenergy_total_uj();
+    uint32_t messages = mpenergy_total_messages();
+    mp_obj_t tuple[4];
+    tuple[0] = mp_obj_new_int_from_ull(mpenergy_elapsed_us());
+    tuple[1] = mp_obj_new_int_from_ull(uj);
+    tuple[2] = mp_obj_new_int_from_uint(messages);
+    tuple[3] = machine_energy_per_message(uj, messages);
+    if (args[0].u_bool) {
+        mpenergy_reset();
+    }
+    return mp_obj_new_attrtuple(machine_energy_fields, 4, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(machine_energy_obj, 0, machine_energy);
+
+// (active_us, spans, current, uj, active) of one of the ENERGY_* rails, current in µA. The rails the
+// firmware doesn't see, e.g. Sigfox in its library, are switched by the application with active=
+STATIC mp_obj_t machine_energy_rail(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const qstr machine_energy_rail_fields[] = {
+        MP_QSTR_active_us, MP_QSTR_spans, MP_QSTR_current, MP_QSTR_uj, MP_QSTR_active
+    };
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_rail,         MP_ARG_REQUIRED | MP_ARG_INT, },
+        { MP_QSTR_current,      MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = -1} },
+        { MP_QSTR_active,       MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = MP_OBJ_NULL} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_int_t rail = args[0].u_int;
+    if (rail < 0 || rail >= MPENERGY_RAIL_COUNT || args[1].u_int < -1) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    if (args[1].u_int != -1) {
+        mpenergy_set_current(rail, args[1].u_int);
+    }
+    if (args[2].u_obj != MP_OBJ_NULL) {
+        mpenergy_set(rail, mp_obj_is_true(args[2].u_obj));
+    }
+
+    mpenergy_rail_stats_t stats;
+    mpenergy_get_rail(rail, &stats);
+    mp_obj_t tuple[5];
+    tuple[0] = mp_obj_new_int_from_ull(stats.active_us);
+    tuple[1] = mp_obj_new_int_from_uint(stats.spans);
+    tuple[2] = mp_obj_new_int_from_uint(stats.current_ua);
+    tuple[3] = mp_obj_new_int_from_ull(mpenergy_rail_uj(rail));
+    tuple[4] = mp_obj_new_bool(stats.active);
+    return mp_obj_new_attrtuple(machine_energy_rail_fields, 5, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(machine_energy_rail_obj, 1, machine_energy_rail);
+
+// (messages, uj, uj_per_message) of one of the LINK_* links, charged with its radio rails. The LoRa
+// messages are counted by the firmware, the application adds the others once delivered with delivered=
+STATIC mp_obj_t machine_energy_link(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const qstr machine_energy_link_fields[] = {
+        MP_QSTR_messages, MP_QSTR_uj, MP_QSTR_uj_per_message
+    };
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_link,         MP_ARG_REQUIRED | MP_ARG_INT, },
+        { MP_QSTR_delivered,    MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = 0} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_int_t link = args[0].u_int;
+    if (link < 0 || link >= MPENERGY_LINK_COUNT || args[1].u_int < 0) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    if (args[1].u_int > 0) {
+        mpenergy_message(link, args[1].u_int);
+    }
+
+    uint64_t uj = mpenergy_link_uj(link);
+    uint32_t messages = mpenergy_messages(link);
+    mp_obj_t tuple[3];
+    tuple[0] = mp_obj_new_int_from_uint(messages);
+    tuple[1] = mp_obj_new_int_from_ull(uj);
+    tuple[2] = machine_energy_per_message(uj, messages);
+    return mp_obj_new_attrtuple(machine_energy_link_fields, 3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(machine_energy_link_obj, 1, machine_energy_link);
+
 mp_obj_t NORETURN machine_reset(void) {
+    modpycom_nvs_flush_all();
     machtimer_deinit();
     machine_wdt_start(1);
     for ( ; ; );
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(machine_reset_obj, machine_reset);
 
-STATIC mp_obj_t machine_freq(void) {
-    return mp_obj_new_int(ets_get_cpu_frequency() * 1000000);
+STATIC mp_obj_t machine_freq(mp_uint_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        return mp_obj_new_int(mpcpufreq_get() * 1000000);
+    }
+    // setting a frequency stops the automatic scaling
+    mp_int_t hz = mp_obj_get_int(args[0]);
+    if ((hz % 1000000) != 0 || !mpcpufreq_set(hz / 1000000)) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    return mp_const_none;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_0(machine_freq_obj, machine_freq);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_freq_obj, 0, 1, machine_freq);
+
+STATIC mp_obj_t machine_freq_auto(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_enable,       MP_ARG_OBJ,                   {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_low,          MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = 80000000} },
+        { MP_QSTR_high,         MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = 240000000} },
+        { MP_QSTR_idle_ms,      MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = 30} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[0].u_obj == MP_OBJ_NULL) {
+        return mp_obj_new_bool(mpcpufreq_get_auto());
+    }
+    if ((args[1].u_int % 1000000) != 0 || (args[2].u_int % 1000000) != 0 || args[3].u_int < 0 ||
+        !mpcpufreq_set_auto(mp_obj_is_true(args[0].u_obj), args[1].u_int / 1000000, args[2].u_int / 1000000, args[3].u_int)) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(machine_freq_auto_obj, 0, machine_freq_auto);
+
+STATIC mp_obj_t machine_freq_stats(mp_uint_t n_args, const mp_obj_t *args) {
+    mpcpufreq_stats_t stats;
+    mpcpufreq_get_stats(&stats, n_args > 0 && mp_obj_is_true(args[0]));
+
+    mp_obj_t tuple[MPCPUFREQ_NUM_STATES + 1];
+    for (int i = 0; i < MPCPUFREQ_NUM_STATES; i++) {
+        tuple[i] = mp_obj_new_int_from_ull(stats.time_us[i] / 1000);
+    }
+    tuple[MPCPUFREQ_NUM_STATES] = mp_obj_new_int_from_uint(stats.switches);
+    return mp_obj_new_tuple(MPCPUFREQ_NUM_STATES + 1, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_freq_stats_obj, 0, 1, machine_freq_stats);
 
 STATIC mp_obj_t machine_unique_id(void) {
     uint8_t id[6];
@@ -343,6 +751,31 @@ STATIC mp_obj_t machine_pygate_cmd_get (void) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(machine_pygate_cmd_get_obj, machine_pygate_cmd_get);
 
+// the counters are written in place when a buffer is given (e.g. array('I', [0] * n)),
+// so it can be polled without allocating
+STATIC mp_obj_t machine_pygate_stats (mp_uint_t n_args, const mp_obj_t *args) {
+    uint32_t stats[LORA_GW_STAT_NUM];
+
+    lora_gw_get_stats(stats);
+
+    if (n_args > 0) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_WRITE);
+        if (bufinfo.len < sizeof(stats)) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "buffer too small"));
+        }
+        memcpy(bufinfo.buf, stats, sizeof(stats));
+        return args[0];
+    }
+
+    mp_obj_t tuple[LORA_GW_STAT_NUM];
+    for (int i = 0; i < LORA_GW_STAT_NUM; i++) {
+        tuple[i] = mp_obj_new_int_from_uint(stats[i]);
+    }
+    return mp_obj_new_tuple(LORA_GW_STAT_NUM, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_pygate_stats_obj, 0, 1, machine_pygate_stats);
+
 STATIC mp_obj_t machine_callback(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     STATIC const mp_arg_t allowed_args[] = {
         { MP_QSTR_trigger,      MP_ARG_REQUIRED | MP_ARG_OBJ,   },
@@ -400,6 +833,51 @@ STATIC mp_obj_t machine_idle(void) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(machine_idle_obj, machine_idle);
 
+STATIC mp_obj_t machine_auto_sleep_config(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_enable,       MP_ARG_OBJ,                   {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_min_ms,       MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = -1} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[1].u_int != -1) {
+        // below 1 ms the sleep costs more than it saves
+        if (args[1].u_int < 1) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        machine_auto_sleep_state.min_ms = args[1].u_int;
+    }
+    if (args[0].u_obj == MP_OBJ_NULL) {
+        return mp_obj_new_bool(machine_auto_sleep_state.enabled);
+    }
+    machine_auto_sleep_state.enabled = mp_obj_is_true(args[0].u_obj);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(machine_auto_sleep_obj, 0, machine_auto_sleep_config);
+
+STATIC mp_obj_t machine_auto_sleep_stats(mp_uint_t n_args, const mp_obj_t *args) {
+    machine_auto_sleep_t *state = &machine_auto_sleep_state;
+    mp_obj_t tuple[5];
+
+    tuple[0] = mp_obj_new_int_from_uint(state->sleeps);
+    tuple[1] = mp_obj_new_int_from_ull(state->residency_us / 1000);
+    tuple[2] = mp_obj_new_int_from_uint((state->timer_wakeups > 0) ? (uint32_t)(state->latency_sum_us / state->timer_wakeups) : 0);
+    tuple[3] = mp_obj_new_int_from_uint(state->latency_max_us);
+    tuple[4] = mp_obj_new_int_from_uint(state->skipped);
+    if (n_args > 0 && mp_obj_is_true(args[0])) {
+        // the margin is kept, it still applies to the next sleeps
+        state->sleeps = 0;
+        state->timer_wakeups = 0;
+        state->latency_sum_us = 0;
+        state->residency_us = 0;
+        state->latency_max_us = 0;
+        state->skipped = 0;
+    }
+    return mp_obj_new_tuple(5, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_auto_sleep_stats_obj, 0, 1, machine_auto_sleep_stats);
+
 STATIC mp_obj_t machine_sleep (uint n_args, const mp_obj_t *arg) {
 
     bool reconnect = false;
@@ -445,7 +923,10 @@ STATIC mp_obj_t machine_sleep (uint n_args, const mp_obj_t *arg) {
     // TRUE means wlan_deinit is called from machine_sleep
     wlan_deinit(mp_const_true);
 
-    if(ESP_OK != esp_light_sleep_start())
+    mpenergy_set(MPENERGY_RAIL_CPU, false);
+    esp_err_t err = esp_light_sleep_start();
+    mpenergy_set(MPENERGY_RAIL_CPU, true);
+    if(ESP_OK != err)
     {
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Wifi or BT not stopped before sleep"));
     }
@@ -460,6 +941,7 @@ STATIC mp_obj_t machine_sleep (uint n_args, const mp_obj_t *arg) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_sleep_obj,0, 2, machine_sleep);
 
 STATIC mp_obj_t machine_deepsleep (uint n_args, const mp_obj_t *arg) {
+    modpycom_nvs_flush_all();
 #ifndef RGB_LED_DISABLE
     mperror_enable_heartbeat(false);
 #endif
@@ -608,11 +1090,15 @@ STATIC const mp_rom_map_elem_t machine_module_globals_table[] = {
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_reset),                   (mp_obj_t)(&machine_reset_obj) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_freq),                    (mp_obj_t)(&machine_freq_obj) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_freq_auto),               (mp_obj_t)(&machine_freq_auto_obj) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_freq_stats),              (mp_obj_t)(&machine_freq_stats_obj) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_unique_id),               (mp_obj_t)(&machine_unique_id_obj) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_main),                    (mp_obj_t)(&machine_main_obj) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_rng),                     (mp_obj_t)(&machine_rng_get_obj) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_idle),                    (mp_obj_t)(&machine_idle_obj) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_sleep),                   (mp_obj_t)(&machine_sleep_obj) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_auto_sleep),              (mp_obj_t)(&machine_auto_sleep_obj) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_auto_sleep_stats),        (mp_obj_t)(&machine_auto_sleep_stats_obj) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_deepsleep),               (mp_obj_t)(&machine_deepsleep_obj) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_remaining_sleep_time),    (mp_obj_t)(&machine_remaining_sleep_time_obj) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_pin_sleep_wakeup),        (mp_obj_t)(&machine_pin_sleep_wakeup_obj) },
@@ -622,6 +1108,14 @@ STATIC const mp_rom_map_elem_t machine_module_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_disable_irq),             (mp_obj_t)&machine_disable_irq_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_enable_irq),              (mp_obj_t)&machine_enable_irq_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_info),                    (mp_obj_t)&machine_info_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_irq_stats),               (mp_obj_t)&machine_irq_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_task_stats),              (mp_obj_t)&machine_task_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_trace),                   (mp_obj_t)&machine_trace_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_trace_event),             (mp_obj_t)&machine_trace_event_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_trace_dump),              (mp_obj_t)&machine_trace_dump_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_energy),                  (mp_obj_t)&machine_energy_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_energy_rail),             (mp_obj_t)&machine_energy_rail_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_energy_link),             (mp_obj_t)&machine_energy_link_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_temperature),             (mp_obj_t)&machine_temperature_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_flash_encrypt),           (mp_obj_t)&machine_flash_encrypt_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_secure_boot),             (mp_obj_t)&machine_secure_boot_obj },
@@ -633,6 +1127,7 @@ STATIC const mp_rom_map_elem_t machine_module_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_pygate_debug_level),      (mp_obj_t)&machine_pygate_debug_level_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_pygate_cmd_decode),       (mp_obj_t)&machine_pygate_cmd_decode_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_pygate_cmd_get),          (mp_obj_t)&machine_pygate_cmd_get_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_pygate_stats),            (mp_obj_t)&machine_pygate_stats_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_callback),                (mp_obj_t)&machine_callback_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_events),                  (mp_obj_t)&machine_events_obj },
 #endif
@@ -650,6 +1145,10 @@ STATIC const mp_rom_map_elem_t machine_module_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_WDT),                     (mp_obj_t)&mach_wdt_type },
     { MP_OBJ_NEW_QSTR(MP_QSTR_CAN),                     (mp_obj_t)&mach_can_type },
     { MP_OBJ_NEW_QSTR(MP_QSTR_RMT),                     (mp_obj_t)&mach_rmt_type },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_LEDStrip),                (mp_obj_t)&mach_ledstrip_type },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_OneWire),                 (mp_obj_t)&mach_onewire_type },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_Counter),                 (mp_obj_t)&mach_counter_type },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_ULP),                     (mp_obj_t)&mach_ulp_type },
     { MP_OBJ_NEW_QSTR(MP_QSTR_Touch),                   (mp_obj_t)&machine_touchpad_type },
 
 
@@ -665,10 +1164,31 @@ STATIC const mp_rom_map_elem_t machine_module_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_PIN_WAKE),            MP_OBJ_NEW_SMALL_INT(MPSLEEP_GPIO_WAKE) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_RTC_WAKE),            MP_OBJ_NEW_SMALL_INT(MPSLEEP_RTC_WAKE) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ULP_WAKE),            MP_OBJ_NEW_SMALL_INT(MPSLEEP_ULP_WAKE) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_TOUCH_WAKE),          MP_OBJ_NEW_SMALL_INT(MPSLEEP_TOUCH_WAKE) },
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_WAKEUP_ALL_LOW),      MP_OBJ_NEW_SMALL_INT(ESP_EXT1_WAKEUP_ALL_LOW) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_WAKEUP_ANY_HIGH),     MP_OBJ_NEW_SMALL_INT(ESP_EXT1_WAKEUP_ANY_HIGH) },
 
+    { MP_OBJ_NEW_QSTR(MP_QSTR_TRACE_LORA),          MP_OBJ_NEW_SMALL_INT(MPTRACE_MASK(MPTRACE_SRC_LORA)) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_TRACE_LTE),           MP_OBJ_NEW_SMALL_INT(MPTRACE_MASK(MPTRACE_SRC_LTE)) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_TRACE_IRQ),           MP_OBJ_NEW_SMALL_INT(MPTRACE_MASK(MPTRACE_SRC_IRQ)) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_TRACE_GC),            MP_OBJ_NEW_SMALL_INT(MPTRACE_MASK(MPTRACE_SRC_GC)) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_TRACE_SOCKET),        MP_OBJ_NEW_SMALL_INT(MPTRACE_MASK(MPTRACE_SRC_SOCKET)) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_TRACE_USER),          MP_OBJ_NEW_SMALL_INT(MPTRACE_MASK(MPTRACE_SRC_USER)) },
+
+    { MP_OBJ_NEW_QSTR(MP_QSTR_ENERGY_CPU),          MP_OBJ_NEW_SMALL_INT(MPENERGY_RAIL_CPU) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_ENERGY_FLASH),        MP_OBJ_NEW_SMALL_INT(MPENERGY_RAIL_FLASH) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_ENERGY_LORA_TX),      MP_OBJ_NEW_SMALL_INT(MPENERGY_RAIL_LORA_TX) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_ENERGY_LORA_RX),      MP_OBJ_NEW_SMALL_INT(MPENERGY_RAIL_LORA_RX) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_ENERGY_SIGFOX),       MP_OBJ_NEW_SMALL_INT(MPENERGY_RAIL_SIGFOX) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_ENERGY_LTE),          MP_OBJ_NEW_SMALL_INT(MPENERGY_RAIL_LTE) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_ENERGY_WLAN),         MP_OBJ_NEW_SMALL_INT(MPENERGY_RAIL_WLAN) },
+
+    { MP_OBJ_NEW_QSTR(MP_QSTR_LINK_LORA),           MP_OBJ_NEW_SMALL_INT(MPENERGY_LINK_LORA) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_LINK_SIGFOX),         MP_OBJ_NEW_SMALL_INT(MPENERGY_LINK_SIGFOX) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_LINK_LTE),            MP_OBJ_NEW_SMALL_INT(MPENERGY_LINK_LTE) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_LINK_WLAN),           MP_OBJ_NEW_SMALL_INT(MPENERGY_LINK_WLAN) },
+
 #ifdef PYGATE_ENABLED
     { MP_OBJ_NEW_QSTR(MP_QSTR_PYGATE_START_EVT),    MP_OBJ_NEW_SMALL_INT(PYGATE_START_EVENT) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_PYGATE_STOP_EVT),     MP_OBJ_NEW_SMALL_INT(PYGATE_STOP_EVENT) },
@@ -24,5 +24,7 @@ typedef void (*_sig_func_cb_ptr)(int);
 extern mp_obj_t NORETURN machine_reset(void);
 extern void machine_register_pygate_sig_handler(_sig_func_cb_ptr sig_handler);
 extern void machine_pygate_set_status(machine_pygate_states_t status);
+extern uint32_t machine_auto_sleep(uint32_t delay_ms);
+extern void machine_auto_sleep_deinit(void);
 
 #endif
@@ -12,13 +12,20 @@
 #include "py/obj.h"
 #include "py/runtime.h"
 #include "py/gc.h"
+#include "py/qstr.h"
+#include <stdlib.h>
 #include <string.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
 #include "mdns.h"
 #include "netutils.h"
 
 #include "modmdns.h"
 #include "modnetwork.h"
+#include "mpirq.h"
 
 
 /******************************************************************************
@@ -27,6 +34,21 @@
 #define MOD_MDNS_PROTO_TCP      (0)
 #define MOD_MDNS_PROTO_UDP      (1)
 
+#define MOD_MDNS_BROWSE_MAX                 (4)
+#define MOD_MDNS_SERVICE_TYPE_LEN_MAX       (32)
+#define MOD_MDNS_CACHE_BUCKETS              (16)
+#define MOD_MDNS_CACHE_MAX                  (32)
+#define MOD_MDNS_BROWSE_RESULTS_MAX         (20)
+#define MOD_MDNS_BROWSE_QUERY_MS            (1000)      // how long a refresh collects the answers
+#define MOD_MDNS_BROWSE_INTERVAL_DEF        (30)        // seconds
+#define MOD_MDNS_BROWSE_TTL_DEF             (120)       // seconds
+#define MOD_MDNS_BROWSE_STACK_SIZE          (3072)
+#define MOD_MDNS_BROWSE_TASK_PRIORITY       (5)
+
+#define MOD_MDNS_SERVICE_ADDED_EVENT        (0x01)
+#define MOD_MDNS_SERVICE_CHANGED_EVENT      (0x02)
+#define MOD_MDNS_SERVICE_REMOVED_EVENT      (0x04)
+
 /******************************************************************************
  DEFINE PRIVATE TYPES
  ******************************************************************************/
@@ -38,6 +60,45 @@ typedef struct mod_mdns_query_obj_s {
     mp_obj_t txt;                 /* txt record */
     mp_obj_t addr;                /* linked list of IP addresses found */
 }mod_mdns_query_obj_t;
+
+// one service instance seen by a browse, allocated outside of the heap so that it survives the soft resets
+typedef struct mod_mdns_cache_entry_s {
+    struct mod_mdns_cache_entry_s *next;    /* next in the bucket */
+    uint32_t hash;
+    TickType_t expires;
+    uint32_t addr;
+    uint16_t port;
+    uint8_t browse;
+    uint8_t txt_count;
+    uint16_t len;
+    char data[];                            /* instance name, hostname then the txt keys and values, nul terminated */
+}mod_mdns_cache_entry_t;
+
+typedef struct mod_mdns_browse_s {
+    char service_type[MOD_MDNS_SERVICE_TYPE_LEN_MAX];
+    uint8_t proto;
+    bool active;
+    bool refreshed;                         /* answered at least once since started */
+    uint32_t interval_ms;
+    uint32_t ttl_ms;
+    TickType_t next_refresh;
+}mod_mdns_browse_t;
+
+typedef struct mod_mdns_browser_s {
+    TaskHandle_t task;
+    SemaphoreHandle_t query_lock;           /* held by the task while querying, mdns_free() waits for it */
+    SemaphoreHandle_t cache_lock;
+    mod_mdns_browse_t browse[MOD_MDNS_BROWSE_MAX];
+    mod_mdns_cache_entry_t *buckets[MOD_MDNS_CACHE_BUCKETS];
+    uint32_t count;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t events;
+    uint32_t trigger;
+    mp_obj_t handler;
+    mp_obj_t handler_arg;
+}mod_mdns_browser_t;
+
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
@@ -47,10 +108,248 @@ typedef struct mod_mdns_query_obj_s {
  ******************************************************************************/
 STATIC bool initialized = false;
 STATIC const mp_obj_type_t mod_mdns_query_type;
+STATIC mod_mdns_browser_t mod_mdns_browser;
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void modmdns_deinit_all (void) {
+    // the browsing goes on, only the callback belongs to the heap being released
+    mod_mdns_browser.trigger = 0;
+    mod_mdns_browser.handler = MP_OBJ_NULL;
+    mod_mdns_browser.handler_arg = MP_OBJ_NULL;
+}
 
 /******************************************************************************
  DEFINE PRIVATE FUNCTIONS
  ******************************************************************************/
+STATIC const char *mod_mdns_proto_str(mp_int_t proto_num) {
+    if(proto_num != MOD_MDNS_PROTO_TCP && proto_num != MOD_MDNS_PROTO_UDP) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "proto must be 0 (TCP) or 1 (UDP)"));
+    }
+    return proto_num == MOD_MDNS_PROTO_TCP ? "_tcp" : "_udp";
+}
+
+STATIC mod_mdns_query_obj_t *mod_mdns_query_obj_new(const char *instance_name, const char *hostname, mp_int_t port, uint32_t addr) {
+    mod_mdns_query_obj_t *query_obj = m_new(mod_mdns_query_obj_t, 1);
+    query_obj->base.type = (mp_obj_t)&mod_mdns_query_type;
+    query_obj->instance_name = mp_obj_new_str(instance_name, strlen(instance_name));
+    query_obj->hostname = mp_obj_new_str(hostname, strlen(hostname));
+    query_obj->port = mp_obj_new_int(port);
+    query_obj->txt = mp_obj_new_list(0, NULL);
+    query_obj->addr = netutils_format_ipv4_addr((uint8_t *)&addr, NETUTILS_BIG);
+    return query_obj;
+}
+
+STATIC void mod_mdns_query_obj_add_txt(mod_mdns_query_obj_t *query_obj, const char *key, const char *value) {
+    mp_obj_t tuple[2];
+    tuple[0] = mp_obj_new_str(key, strlen(key));
+    tuple[1] = mp_obj_new_str(value, strlen(value));
+    mp_obj_list_append(query_obj->txt, mp_obj_new_tuple(2, tuple));
+}
+
+STATIC uint32_t mod_mdns_cache_hash(uint8_t browse, const char *instance_name) {
+    return qstr_compute_hash((const byte *)instance_name, strlen(instance_name)) + browse;
+}
+
+STATIC int mod_mdns_browse_find(const char *service_type, uint8_t proto) {
+    for (int i = 0; i < MOD_MDNS_BROWSE_MAX; i++) {
+        mod_mdns_browse_t *b = &mod_mdns_browser.browse[i];
+        if (b->active && b->proto == proto && strcmp(b->service_type, service_type) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// builds the cache entry of a result, NULL when out of memory
+STATIC mod_mdns_cache_entry_t *mod_mdns_cache_entry_new(uint8_t browse, mdns_result_t *result) {
+    const char *instance_name = result->instance_name ? result->instance_name : "";
+    const char *hostname = result->hostname ? result->hostname : "";
+    size_t len = strlen(instance_name) + 1 + strlen(hostname) + 1;
+    for (int i = 0; i < result->txt_count; i++) {
+        len += strlen(result->txt[i].key) + 1 + strlen(result->txt[i].value ? result->txt[i].value : "") + 1;
+    }
+    if (len > UINT16_MAX) {
+        return NULL;
+    }
+
+    mod_mdns_cache_entry_t *entry = malloc(sizeof(mod_mdns_cache_entry_t) + len);
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->next = NULL;
+    entry->hash = mod_mdns_cache_hash(browse, instance_name);
+    entry->addr = result->addr ? result->addr->addr.u_addr.ip4.addr : 0;
+    entry->port = result->port;
+    entry->browse = browse;
+    entry->txt_count = result->txt_count;
+    entry->len = len;
+    char *p = entry->data;
+    p = stpcpy(p, instance_name) + 1;
+    p = stpcpy(p, hostname) + 1;
+    for (int i = 0; i < result->txt_count; i++) {
+        p = stpcpy(p, result->txt[i].key) + 1;
+        p = stpcpy(p, result->txt[i].value ? result->txt[i].value : "") + 1;
+    }
+    return entry;
+}
+
+STATIC bool mod_mdns_cache_entry_equal(const mod_mdns_cache_entry_t *a, const mod_mdns_cache_entry_t *b) {
+    return a->addr == b->addr && a->port == b->port && a->txt_count == b->txt_count &&
+           a->len == b->len && memcmp(a->data, b->data, a->len) == 0;
+}
+
+STATIC mod_mdns_cache_entry_t **mod_mdns_cache_find(uint8_t browse, const char *instance_name) {
+    uint32_t hash = mod_mdns_cache_hash(browse, instance_name);
+    mod_mdns_cache_entry_t **pe = &mod_mdns_browser.buckets[hash % MOD_MDNS_CACHE_BUCKETS];
+    for ( ; *pe != NULL; pe = &(*pe)->next) {
+        if ((*pe)->hash == hash && (*pe)->browse == browse && strcmp((*pe)->data, instance_name) == 0) {
+            break;
+        }
+    }
+    return pe;
+}
+
+// with the cache lock held, returns the events caused
+STATIC uint32_t mod_mdns_cache_update(uint8_t browse, mdns_result_t *result, TickType_t expires) {
+    mod_mdns_cache_entry_t *entry = mod_mdns_cache_entry_new(browse, result);
+    if (entry == NULL) {
+        return 0;
+    }
+    entry->expires = expires;
+
+    mod_mdns_cache_entry_t **pe = mod_mdns_cache_find(browse, entry->data);
+    mod_mdns_cache_entry_t *old = *pe;
+    if (old != NULL) {
+        if (mod_mdns_cache_entry_equal(old, entry)) {
+            old->expires = expires;
+            free(entry);
+            return 0;
+        }
+        entry->next = old->next;
+        *pe = entry;
+        free(old);
+        return MOD_MDNS_SERVICE_CHANGED_EVENT;
+    }
+    if (mod_mdns_browser.count >= MOD_MDNS_CACHE_MAX) {
+        free(entry);
+        return 0;
+    }
+    *pe = entry;
+    mod_mdns_browser.count++;
+    return MOD_MDNS_SERVICE_ADDED_EVENT;
+}
+
+// with the cache lock held, drops the entries of a browse or all the expired ones (browse < 0)
+STATIC uint32_t mod_mdns_cache_purge(int browse, TickType_t now) {
+    uint32_t events = 0;
+    for (int i = 0; i < MOD_MDNS_CACHE_BUCKETS; i++) {
+        mod_mdns_cache_entry_t **pe = &mod_mdns_browser.buckets[i];
+        while (*pe != NULL) {
+            mod_mdns_cache_entry_t *entry = *pe;
+            if ((browse < 0) ? ((int32_t)(now - entry->expires) >= 0) : (entry->browse == browse)) {
+                *pe = entry->next;
+                free(entry);
+                mod_mdns_browser.count--;
+                events |= MOD_MDNS_SERVICE_REMOVED_EVENT;
+            } else {
+                pe = &entry->next;
+            }
+        }
+    }
+    return events;
+}
+
+STATIC mod_mdns_query_obj_t *mod_mdns_cache_query_obj(const mod_mdns_cache_entry_t *entry) {
+    const char *instance_name = entry->data;
+    const char *hostname = instance_name + strlen(instance_name) + 1;
+    mod_mdns_query_obj_t *query_obj = mod_mdns_query_obj_new(instance_name, hostname, entry->port, entry->addr);
+    const char *p = hostname + strlen(hostname) + 1;
+    for (int i = 0; i < entry->txt_count; i++) {
+        const char *value = p + strlen(p) + 1;
+        mod_mdns_query_obj_add_txt(query_obj, p, value);
+        p = value + strlen(value) + 1;
+    }
+    return query_obj;
+}
+
+STATIC void mod_mdns_callback_handler(void *arg) {
+    (void)arg;
+    mp_obj_t handler = mod_mdns_browser.handler;
+    if (handler != MP_OBJ_NULL && handler != mp_const_none) {
+        mp_call_function_1(handler, mod_mdns_browser.handler_arg);
+    }
+}
+
+// refreshes the browsed services in turn and expires what wasn't announced anymore
+STATIC void TASK_MDNS_Browse(void *pvParameters) {
+    for ( ; ; ) {
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = portMAX_DELAY;
+        uint32_t events = 0;
+
+        for (int i = 0; i < MOD_MDNS_BROWSE_MAX; i++) {
+            mod_mdns_browse_t *b = &mod_mdns_browser.browse[i];
+            if (!b->active) {
+                continue;
+            }
+            if ((int32_t)(now - b->next_refresh) >= 0) {
+                // the slot can be stopped and reused meanwhile
+                char service_type[MOD_MDNS_SERVICE_TYPE_LEN_MAX];
+                uint8_t proto;
+                xSemaphoreTake(mod_mdns_browser.cache_lock, portMAX_DELAY);
+                strcpy(service_type, b->service_type);
+                proto = b->proto;
+                xSemaphoreGive(mod_mdns_browser.cache_lock);
+
+                mdns_result_t *results = NULL;
+                esp_err_t ret = ESP_FAIL;
+                xSemaphoreTake(mod_mdns_browser.query_lock, portMAX_DELAY);
+                if (initialized && b->active) {
+                    ret = mdns_query_ptr(service_type, proto == MOD_MDNS_PROTO_TCP ? "_tcp" : "_udp",
+                                         MOD_MDNS_BROWSE_QUERY_MS, MOD_MDNS_BROWSE_RESULTS_MAX, &results);
+                }
+                xSemaphoreGive(mod_mdns_browser.query_lock);
+
+                now = xTaskGetTickCount();
+                if (ret == ESP_OK) {
+                    xSemaphoreTake(mod_mdns_browser.cache_lock, portMAX_DELAY);
+                    if (b->active && b->proto == proto && strcmp(b->service_type, service_type) == 0) {
+                        for (mdns_result_t *result = results; result != NULL; result = result->next) {
+                            events |= mod_mdns_cache_update(i, result, now + b->ttl_ms / portTICK_PERIOD_MS);
+                        }
+                        b->refreshed = true;
+                    }
+                    xSemaphoreGive(mod_mdns_browser.cache_lock);
+                }
+                if (results != NULL) {
+                    mdns_query_results_free(results);
+                }
+                b->next_refresh = now + b->interval_ms / portTICK_PERIOD_MS;
+            }
+            TickType_t left = b->next_refresh - now;
+            if ((int32_t)left < 0) {
+                left = 0;
+            }
+            if (left < wait) {
+                wait = left;
+            }
+        }
+
+        xSemaphoreTake(mod_mdns_browser.cache_lock, portMAX_DELAY);
+        events |= mod_mdns_cache_purge(-1, now);
+        mod_mdns_browser.events |= events;
+        xSemaphoreGive(mod_mdns_browser.cache_lock);
+
+        if (mod_mdns_browser.trigger & events) {
+            mp_irq_queue_interrupt_non_ISR(mod_mdns_callback_handler, NULL);
+        }
+
+        // woken up early when a browse starts
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
 
 /******************************************************************************
  DEFINE MDNS CLASS FUNCTIONS
@@ -86,9 +385,24 @@ STATIC mp_obj_t mod_mdns_deinit() {
 
     if(initialized == true) {
 
+        // the browse task mustn't be in the middle of a query
+        if (mod_mdns_browser.query_lock != NULL) {
+            MP_THREAD_GIL_EXIT();
+            xSemaphoreTake(mod_mdns_browser.query_lock, portMAX_DELAY);
+            MP_THREAD_GIL_ENTER();
+        }
         mdns_service_remove_all();
         mdns_free();
         initialized = false;
+        if (mod_mdns_browser.query_lock != NULL) {
+            xSemaphoreGive(mod_mdns_browser.query_lock);
+            xSemaphoreTake(mod_mdns_browser.cache_lock, portMAX_DELAY);
+            for (int i = 0; i < MOD_MDNS_BROWSE_MAX; i++) {
+                mod_mdns_browser.browse[i].active = false;
+                mod_mdns_cache_purge(i, 0);
+            }
+            xSemaphoreGive(mod_mdns_browser.cache_lock);
+        }
     }
 
     return mp_const_none;
@@ -251,12 +565,8 @@ STATIC mp_obj_t mod_mdns_query(mp_uint_t n_args, const mp_obj_t *pos_args, mp_ma
         const char * service_type = mp_obj_str_get_str(args[1].u_obj);
 
         // Get proto
-        const char * proto = NULL;
         mp_int_t proto_num = args[2].u_int;
-        if(proto_num != MOD_MDNS_PROTO_TCP && proto_num != MOD_MDNS_PROTO_UDP) {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "proto must be 0 (TCP) or 1 (UDP)"));
-        }
-        proto = proto_num == MOD_MDNS_PROTO_TCP ? "_tcp" : "_udp";
+        const char * proto = mod_mdns_proto_str(proto_num);
 
         // Get instance name
         const char * instance_name = NULL;
@@ -264,6 +574,49 @@ STATIC mp_obj_t mod_mdns_query(mp_uint_t n_args, const mp_obj_t *pos_args, mp_ma
             instance_name = mp_obj_str_get_str(args[3].u_obj);
         }
 
+        // Answer from the cache when the service is browsed
+        if (mod_mdns_browser.cache_lock != NULL) {
+            mp_obj_t queries_list = MP_OBJ_NULL;
+            MP_THREAD_GIL_EXIT();
+            xSemaphoreTake(mod_mdns_browser.cache_lock, portMAX_DELAY);
+            MP_THREAD_GIL_ENTER();
+            int browse = mod_mdns_browse_find(service_type, proto_num);
+            if (browse >= 0 && mod_mdns_browser.browse[browse].refreshed) {
+                nlr_buf_t nlr;
+                if (nlr_push(&nlr) == 0) {
+                    if (instance_name != NULL) {
+                        mod_mdns_cache_entry_t *entry = *mod_mdns_cache_find(browse, instance_name);
+                        if (entry != NULL) {
+                            queries_list = mp_obj_new_list(0, NULL);
+                            mp_obj_list_append(queries_list, mod_mdns_cache_query_obj(entry));
+                        }
+                    } else {
+                        queries_list = mp_obj_new_list(0, NULL);
+                        for (int i = 0; i < MOD_MDNS_CACHE_BUCKETS; i++) {
+                            for (mod_mdns_cache_entry_t *e = mod_mdns_browser.buckets[i]; e != NULL; e = e->next) {
+                                if (e->browse == browse) {
+                                    mp_obj_list_append(queries_list, mod_mdns_cache_query_obj(e));
+                                }
+                            }
+                        }
+                    }
+                    nlr_pop();
+                } else {
+                    xSemaphoreGive(mod_mdns_browser.cache_lock);
+                    nlr_jump(nlr.ret_val);
+                }
+            }
+            if (queries_list != MP_OBJ_NULL) {
+                mod_mdns_browser.hits++;
+            } else {
+                mod_mdns_browser.misses++;
+            }
+            xSemaphoreGive(mod_mdns_browser.cache_lock);
+            if (queries_list != MP_OBJ_NULL) {
+                return queries_list;
+            }
+        }
+
 
         mdns_result_t *results;
         esp_err_t ret;
@@ -283,25 +636,12 @@ STATIC mp_obj_t mod_mdns_query(mp_uint_t n_args, const mp_obj_t *pos_args, mp_ma
             mdns_result_t *result = results;
             mp_obj_t queries_list = mp_obj_new_list(0, NULL);
             while(result != NULL) {
-                mod_mdns_query_obj_t *query_obj = m_new(mod_mdns_query_obj_t, 1);
-                query_obj->base.type = (mp_obj_t)&mod_mdns_query_type;
-                query_obj->instance_name = mp_obj_new_str(result->instance_name, strlen(result->instance_name));
-                query_obj->hostname = mp_obj_new_str(result->hostname, strlen(result->hostname));
-                query_obj->port = mp_obj_new_int(result->port);
-
-                query_obj->txt = mp_obj_new_list(0, NULL);
+                mod_mdns_query_obj_t *query_obj = mod_mdns_query_obj_new(result->instance_name ? result->instance_name : "",
+                                                                         result->hostname ? result->hostname : "",
+                                                                         result->port,
+                                                                         result->addr ? result->addr->addr.u_addr.ip4.addr : 0);
                 for(int i = 0; i < result->txt_count; i++) {
-                    mp_obj_t tuple[2];
-                    tuple[0] = mp_obj_new_str(result->txt[i].key, strlen(result->txt[i].key));
-                    tuple[1] = mp_obj_new_str(result->txt[i].value, strlen(result->txt[i].value));
-                    mp_obj_list_append(query_obj->txt, mp_obj_new_tuple(2, tuple));
-                }
-
-                if (result->addr) {
-                    query_obj->addr = netutils_format_ipv4_addr((uint8_t *)&result->addr->addr.u_addr.ip4.addr, NETUTILS_BIG);
-                } else {
-                    u32_t zero_ip = 0;
-                    query_obj->addr = netutils_format_ipv4_addr((uint8_t *)&zero_ip, NETUTILS_BIG);
+                    mod_mdns_query_obj_add_txt(query_obj, result->txt[i].key, result->txt[i].value ? result->txt[i].value : "");
                 }
 
                 mp_obj_list_append(queries_list, query_obj);
@@ -323,6 +663,139 @@ STATIC mp_obj_t mod_mdns_query(mp_uint_t n_args, const mp_obj_t *pos_args, mp_ma
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_mdns_query_obj, 3, mod_mdns_query);
 
+// Keep the announced services of a type cached, query() answers from the cache then
+STATIC mp_obj_t mod_mdns_browse(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    STATIC const mp_arg_t mod_mdns_browse_args[] = {
+            { MP_QSTR_service_type,             MP_ARG_OBJ  | MP_ARG_REQUIRED, },
+            { MP_QSTR_proto,                    MP_ARG_INT  | MP_ARG_REQUIRED, },
+            { MP_QSTR_interval,                 MP_ARG_INT  | MP_ARG_KW_ONLY,  {.u_int = MOD_MDNS_BROWSE_INTERVAL_DEF}},
+            { MP_QSTR_ttl,                      MP_ARG_INT  | MP_ARG_KW_ONLY,  {.u_int = MOD_MDNS_BROWSE_TTL_DEF}},
+            { MP_QSTR_stop,                     MP_ARG_BOOL | MP_ARG_KW_ONLY,  {.u_bool = false}},
+    };
+
+    if(initialized == false) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_RuntimeError, "MDNS module is not initialized!"));
+    }
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(mod_mdns_browse_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(args), mod_mdns_browse_args, args);
+
+    size_t len;
+    const char* service_type = mp_obj_str_get_data(args[0].u_obj, &len);
+    if (len == 0 || len >= MOD_MDNS_SERVICE_TYPE_LEN_MAX) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "service_type must be a valid string"));
+    }
+    mp_int_t proto_num = args[1].u_int;
+    mod_mdns_proto_str(proto_num);
+    if (args[2].u_int <= 0 || args[3].u_int < args[2].u_int) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "ttl must be at least the interval"));
+    }
+
+    // created on the first use, they're kept across soft resets
+    if (mod_mdns_browser.task == NULL) {
+        if (mod_mdns_browser.query_lock == NULL) {
+            mod_mdns_browser.query_lock = xSemaphoreCreateMutex();
+            mod_mdns_browser.cache_lock = xSemaphoreCreateMutex();
+        }
+        if (mod_mdns_browser.query_lock == NULL || mod_mdns_browser.cache_lock == NULL ||
+            xTaskCreatePinnedToCore(TASK_MDNS_Browse, "MDNSBrowse", MOD_MDNS_BROWSE_STACK_SIZE / sizeof(StackType_t), NULL,
+                                    MOD_MDNS_BROWSE_TASK_PRIORITY, &mod_mdns_browser.task, 1) != pdPASS) {
+            mod_mdns_browser.task = NULL;
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    }
+
+    MP_THREAD_GIL_EXIT();
+    xSemaphoreTake(mod_mdns_browser.cache_lock, portMAX_DELAY);
+    MP_THREAD_GIL_ENTER();
+    int browse = mod_mdns_browse_find(service_type, proto_num);
+    if (args[4].u_bool) {
+        if (browse >= 0) {
+            mod_mdns_browser.browse[browse].active = false;
+            mod_mdns_cache_purge(browse, 0);
+        }
+        xSemaphoreGive(mod_mdns_browser.cache_lock);
+        return mp_const_none;
+    }
+    if (browse < 0) {
+        for (int i = 0; i < MOD_MDNS_BROWSE_MAX; i++) {
+            if (!mod_mdns_browser.browse[i].active) {
+                browse = i;
+                break;
+            }
+        }
+        if (browse < 0) {
+            xSemaphoreGive(mod_mdns_browser.cache_lock);
+            mp_raise_OSError(MP_ENOBUFS);
+        }
+        mod_mdns_browse_t *b = &mod_mdns_browser.browse[browse];
+        memcpy(b->service_type, service_type, len + 1);
+        b->proto = proto_num;
+        b->refreshed = false;
+        b->active = true;
+    }
+    mod_mdns_browse_t *b = &mod_mdns_browser.browse[browse];
+    b->interval_ms = args[2].u_int * 1000;
+    b->ttl_ms = args[3].u_int * 1000;
+    b->next_refresh = xTaskGetTickCount();
+    xSemaphoreGive(mod_mdns_browser.cache_lock);
+
+    xTaskNotifyGive(mod_mdns_browser.task);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_mdns_browse_obj, 2, mod_mdns_browse);
+
+/// \method callback(trigger, handler, arg)
+STATIC mp_obj_t mod_mdns_callback(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_trigger,      MP_ARG_REQUIRED | MP_ARG_OBJ,   },
+        { MP_QSTR_handler,      MP_ARG_OBJ,                     {.u_obj = mp_const_none} },
+        { MP_QSTR_arg,          MP_ARG_OBJ,                     {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    if (args[0].u_obj != mp_const_none && args[1].u_obj != mp_const_none) {
+        mod_mdns_browser.handler_arg = args[2].u_obj;
+        mod_mdns_browser.handler = args[1].u_obj;
+        mp_irq_add((mp_obj_t)&mod_mdns, args[1].u_obj);
+        mod_mdns_browser.trigger = mp_obj_get_int(args[0].u_obj);
+    } else {
+        mod_mdns_browser.trigger = 0;
+        mp_irq_remove((mp_obj_t)&mod_mdns);
+        mod_mdns_browser.handler = MP_OBJ_NULL;
+        mod_mdns_browser.handler_arg = MP_OBJ_NULL;
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_mdns_callback_obj, 1, mod_mdns_callback);
+
+STATIC mp_obj_t mod_mdns_events(void) {
+    if (mod_mdns_browser.cache_lock == NULL) {
+        return MP_OBJ_NEW_SMALL_INT(0);
+    }
+    MP_THREAD_GIL_EXIT();
+    xSemaphoreTake(mod_mdns_browser.cache_lock, portMAX_DELAY);
+    MP_THREAD_GIL_ENTER();
+    uint32_t events = mod_mdns_browser.events;
+    mod_mdns_browser.events = 0;
+    xSemaphoreGive(mod_mdns_browser.cache_lock);
+    return mp_obj_new_int(events);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_mdns_events_obj, mod_mdns_events);
+
+// Cache hits, misses and the number of services cached
+STATIC mp_obj_t mod_mdns_stats(void) {
+    mp_obj_t tuple[3];
+    tuple[0] = mp_obj_new_int_from_uint(mod_mdns_browser.hits);
+    tuple[1] = mp_obj_new_int_from_uint(mod_mdns_browser.misses);
+    tuple[2] = mp_obj_new_int_from_uint(mod_mdns_browser.count);
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_mdns_stats_obj, mod_mdns_stats);
+
 STATIC mp_obj_t mod_mdns_query_instance_name(mp_obj_t self) {
 
     return ((mod_mdns_query_obj_t *)self)->instance_name;
@@ -380,10 +853,17 @@ STATIC const mp_map_elem_t mod_mdns_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_add_service),                     (mp_obj_t)&mod_mdns_add_service_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_remove_service),                  (mp_obj_t)&mod_mdns_remove_service_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_query),                           (mp_obj_t)&mod_mdns_query_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_browse),                          (mp_obj_t)&mod_mdns_browse_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_callback),                        (mp_obj_t)&mod_mdns_callback_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_events),                          (mp_obj_t)&mod_mdns_events_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stats),                           (mp_obj_t)&mod_mdns_stats_obj },
 
     // class constants
     { MP_OBJ_NEW_QSTR(MP_QSTR_PROTO_TCP),                     MP_OBJ_NEW_SMALL_INT(MOD_MDNS_PROTO_TCP) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_PROTO_UDP),                     MP_OBJ_NEW_SMALL_INT(MOD_MDNS_PROTO_UDP) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SERVICE_ADDED_EVENT),           MP_OBJ_NEW_SMALL_INT(MOD_MDNS_SERVICE_ADDED_EVENT) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SERVICE_CHANGED_EVENT),         MP_OBJ_NEW_SMALL_INT(MOD_MDNS_SERVICE_CHANGED_EVENT) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SERVICE_REMOVED_EVENT),         MP_OBJ_NEW_SMALL_INT(MOD_MDNS_SERVICE_REMOVED_EVENT) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mod_mdns_globals, mod_mdns_globals_table);
@@ -13,4 +13,6 @@
 
 extern const mp_obj_module_t mod_mdns;
 
+extern void modmdns_deinit_all (void);
+
 #endif  // MODMDNS_H_
@@ -11,9 +11,12 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_attr.h"
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 
@@ -35,6 +38,9 @@
 
 #include "util/mpirq.h"
 
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+
 #include "modusocket.h"
 
 // openThread includes
@@ -60,8 +66,10 @@
  ******************************************************************************/
 #define MESH_STACK_SIZE                                             (8192)
 #define MESH_TASK_PRIORITY                                          (6)
-#define OT_DATA_QUEUE_SIZE_MAX                                      (5)
-#define OT_RX_PACK_SIZE_MAX                                         (512)
+// longest the Mesh task sleeps when nothing wakes it up, 0 to only wake up on events
+#define MESH_TASK_IDLE_MS_DEF                                       (1000)
+#define MESH_SOCKET_RX_SIZE_DEF                                     (4096)
+#define MESH_SOCKET_RX_SIZE_MIN                                     (256)
 #define IPV6_HEADER_UDP_PROTOCOL_CODE                               (17)
 #define MESH_CLI_OUTPUT_SIZE                                        (1024)
 #define MESH_NEIGBORS_MAX                                           (16)
@@ -86,6 +94,12 @@
 // max number of UDP sockets
 #define UDP_SOCKETS_MAX                                             (3)
 
+// Mesh.snapshot() holds the whole tables, a router has at most 62 router neighbors and its children
+#define MESH_SNAPSHOT_NEIGHBORS_MAX                                 (64)
+#define MESH_SNAPSHOT_ROUTERS_MAX                                   (63)
+// longest Mesh.snapshot() waits for the Mesh task to copy the tables
+#define MESH_SNAPSHOT_TIMEOUT_MS                                    (1000)
+
 // UDP datagrams arrived on Border Router interface have an additional header
 // first part header size, in bytes
 #define BORDER_ROUTER_HEADER_1                                      (1)
@@ -98,12 +112,21 @@
 // total size of BR header
 #define BORDER_ROUTER_HEADER_SIZE                                   (BORDER_ROUTER_HEADER_1 + BORDER_ROUTER_HEADER_2 + BORDER_ROUTER_HEADER_3)
 
+// biggest UDP payload bridged by the Border Router forwarding (IPv6 minimum MTU)
+#define BORDER_ROUTER_FORWARD_PAYLOAD_MAX                           (1280)
+// longest the Mesh task blocks on a TCP forwarding endpoint that doesn't keep up
+#define BORDER_ROUTER_FORWARD_TCP_TIMEOUT_MS                        (100)
+
 /******************************************************************************
  DEFINE TYPES
  ******************************************************************************/
 typedef struct {
     mp_obj_base_t base;
     bool ot_ready;
+    uint32_t idle_ms;
+    uint32_t rx_size;                       // bytes of the RX ring of each socket
+    uint32_t rx_received;
+    uint32_t rx_dropped;
 
     char otCliBuffer[128];
     int otCliBufferLen;
@@ -120,14 +143,12 @@ typedef struct {
     uint8_t           trigger;
 }ot_obj_t;
 
+// each datagram received is stored in the RX ring of the socket as this header followed by its payload
 typedef struct {
-    uint8_t data[OT_RX_PACK_SIZE_MAX];
     uint16_t len;
-    otIp6Address src_ip;
     uint16_t src_port;
-    otIp6Address dest_ip;
-    uint16_t dest_port;
-} ot_rx_data_t;
+    otIp6Address src_ip;
+} mesh_rx_hdr_t;
 
 typedef struct {
     uint8_t preamble[6];
@@ -146,6 +167,59 @@ typedef struct {
     int8_t preference;
 }border_router_info_t;
 
+// native forwarding of the Border Router datagrams to an lwIP endpoint, done by the Mesh task
+typedef struct {
+    volatile int sd;                        // lwIP socket, -1 when the datagrams go to the Pymesh sockets
+    bool tcp;                               // each datagram is prefixed by its length (2 bytes, big endian)
+    bool header;                            // each datagram starts with the BR header
+    uint32_t forwarded;
+    uint32_t bytes;
+    uint32_t errors;
+}mesh_br_forward_t;
+
+// the records returned by Mesh.snapshot(), little endian, the header is followed by the neighbors then the routers:
+//   header:   struct.unpack_from('<IIBBH', buf)       (neighbors_gen, routers_gen, neighbors_num, routers_num, 0)
+//   neighbor: struct.unpack_from('<8sHbbBBH', buf, o) (mac, rloc16, rssi, last_rssi, role, lq_in, age)
+//   router:   struct.unpack_from('<8sHBBBBBB', buf, o) (mac, rloc16, id, next_hop, path_cost, lq_in, lq_out, age)
+typedef struct __attribute__((packed)) {
+    uint32_t neighbors_gen;                 // incremented when a neighbor comes, goes or changes its role, rloc16 or link
+    uint32_t routers_gen;                   // incremented when a router comes, goes or changes its route
+    uint8_t neighbors_num;
+    uint8_t routers_num;
+    uint16_t reserved;
+}mesh_snapshot_hdr_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t mac[OT_EXT_ADDRESS_SIZE];
+    uint16_t rloc16;
+    int8_t rssi;                            // average
+    int8_t last_rssi;
+    uint8_t role;
+    uint8_t lq_in;
+    uint16_t age;                           // seconds, saturated
+}mesh_snapshot_neighbor_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t mac[OT_EXT_ADDRESS_SIZE];
+    uint16_t rloc16;
+    uint8_t id;
+    uint8_t next_hop;
+    uint8_t path_cost;
+    uint8_t lq_in;
+    uint8_t lq_out;
+    uint8_t age;
+}mesh_snapshot_router_t;
+
+// filled by the Mesh task, the only one running OpenThread, so the tables are consistent with each other
+typedef struct {
+    mesh_snapshot_hdr_t hdr;
+    mesh_snapshot_neighbor_t neighbors[MESH_SNAPSHOT_NEIGHBORS_MAX];
+    mesh_snapshot_router_t routers[MESH_SNAPSHOT_ROUTERS_MAX];
+    uint32_t neighbors_hash;                // of the fields counted as a change, age and RSSI are not
+    uint32_t routers_hash;
+    volatile bool request;
+}mesh_snapshot_t;
+
 
 typedef struct {
     mod_network_socket_obj_t *s;            // pointer to the NIC socket
@@ -153,7 +227,10 @@ typedef struct {
     uint16_t port;                          // UDP port
     otIp6Address ip;                        // ipv6
     //char ip_str[MOD_USOCKET_IPV6_CHARS_MAX];// IPv6 in string
-    QueueHandle_t rx_queue;                 // queue for RX packages
+    uint8_t *rx_buf;                        // ring of the datagrams received, the oldest are dropped when full
+    uint32_t rx_size;
+    uint32_t rx_head;
+    volatile uint32_t rx_used;
 }pymesh_socket_t;
 
 /******************************************************************************
@@ -164,6 +241,10 @@ static otInstance *ot = NULL;
 static otIp6Prefix border_router_prefix;
 static mesh_obj_t mesh_obj;
 static pymesh_socket_t sockets[UDP_SOCKETS_MAX];
+static portMUX_TYPE mesh_rx_mux = portMUX_INITIALIZER_UNLOCKED;
+static mesh_br_forward_t br_forward = {.sd = -1};
+static uint8_t br_forward_buf[sizeof(uint16_t) + BORDER_ROUTER_HEADER_SIZE + BORDER_ROUTER_FORWARD_PAYLOAD_MAX];
+static mesh_snapshot_t *mesh_snapshot;  // allocated by the first Mesh.snapshot() and kept
 
 /******************************************************************************
  DECLARE PUBLIC DATA
@@ -183,6 +264,8 @@ static void socket_udp_cb(void *aContext, otMessage *aMessage,
 
 static void br_ip6_rcv_cb(otMessage *aMessage, void *aContext);
 
+static void mesh_snapshot_take(mesh_snapshot_t *snap);
+
 static bool otIp6ToString(otIp6Address ipv6, char* ip_str, int str_len);
 
 static otInstance* openthread_init(uint8_t key[]);
@@ -210,6 +293,9 @@ static int mesh_add_border_router(const char* ipv6_net_str, int preference_level
 static int mesh_del_border_router(const char* ipv6_net_str);
 
 static pymesh_socket_t *find_socket(mod_network_socket_obj_t *nic_sock);
+static void mesh_rx_ring_push(pymesh_socket_t *sock, const otIp6Address *src_ip, uint16_t src_port,
+        const uint8_t *prefix, uint16_t prefix_len, otMessage *msg, uint16_t offset, uint16_t len);
+static void mesh_rx_ring_copy_out(pymesh_socket_t *sock, uint32_t pos, void *data, uint32_t len);
 
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
@@ -222,6 +308,29 @@ bool lora_mesh_ready(void) {
     return mesh_obj.ot_ready;
 }
 
+// wakes the Mesh task up, OpenThread has work to do
+void mesh_task_signal(void) {
+    if (xMeshTaskHndl != NULL) {
+        xTaskNotifyGive(xMeshTaskHndl);
+    }
+}
+
+IRAM_ATTR void mesh_task_signal_from_isr(void) {
+    if (mesh_obj.ot_ready && xMeshTaskHndl != NULL) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(xMeshTaskHndl, &xHigherPriorityTaskWoken);
+        if (xHigherPriorityTaskWoken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+// called by OpenThread, from any task, when a tasklet is posted
+void otTaskletsSignalPending(otInstance *aInstance) {
+    (void) aInstance;
+    mesh_task_signal();
+}
+
 // opens a new UDP socket on Pymesh
 int mesh_socket_open(mod_network_socket_obj_t *s, int *_errno) {
 
@@ -232,8 +341,10 @@ int mesh_socket_open(mod_network_socket_obj_t *s, int *_errno) {
 
     memset(&sock->udp_sock, 0, sizeof(otUdpSocket));
 
-    otEXPECT_ACTION(NULL != (sock->rx_queue = xQueueCreate(OT_DATA_QUEUE_SIZE_MAX, sizeof(ot_rx_data_t))),
-            *_errno = MP_ENOBUFS);
+    otEXPECT_ACTION(NULL != (sock->rx_buf = malloc(mesh_obj.rx_size)), *_errno = MP_ENOBUFS);
+    sock->rx_size = mesh_obj.rx_size;
+    sock->rx_head = 0;
+    sock->rx_used = 0;
 
     // open socket
     otEXPECT_ACTION(
@@ -245,7 +356,8 @@ int mesh_socket_open(mod_network_socket_obj_t *s, int *_errno) {
 
     exit: if (*_errno != 0) {
         printf("err: %d", *_errno);
-        vQueueDelete(sock->rx_queue);
+        free(sock->rx_buf);
+        sock->rx_buf = NULL;
         sock->s = NULL;
         return -1;
     }
@@ -260,14 +372,14 @@ void mesh_socket_close(mod_network_socket_obj_t *s) {
         // destroy a specific socket
         pymesh_socket_t *sock = find_socket(s);
         otUdpClose(&sock->udp_sock);
-        vQueueDelete(sock->rx_queue);
+        free(sock->rx_buf);
         memset(sock, 0, sizeof(pymesh_socket_t));
     } else {
         // destroy all sockets
         for (int i = 0 ; i < UDP_SOCKETS_MAX; i++) {
             if (sockets[i].s) {
                 otUdpClose(&sockets[i].udp_sock);
-                vQueueDelete(sockets[i].rx_queue);
+                free(sockets[i].rx_buf);
                 memset(&sockets[i], 0, sizeof(pymesh_socket_t));
             }
         }
@@ -354,7 +466,7 @@ int mesh_socket_sendto(mod_network_socket_obj_t *s, const byte *buf, mp_uint_t l
 int mesh_socket_recvfrom(mod_network_socket_obj_t *s, byte *buf, mp_uint_t len, byte *ip, mp_uint_t *port,
         int *_errno) {
 
-    ot_rx_data_t rx_data;
+    mesh_rx_hdr_t hdr;
 
     *_errno = 0;
 
@@ -362,18 +474,27 @@ int mesh_socket_recvfrom(mod_network_socket_obj_t *s, byte *buf, mp_uint_t len,
 
     otEXPECT_ACTION(NULL != (sock = find_socket(s)), *_errno = MP_ENOENT);
 
-    if (xQueueReceive(sock->rx_queue, &rx_data, 0)) {
-        // adjust the len
-        if (rx_data.len < len) {
-            len = rx_data.len;
+    portENTER_CRITICAL(&mesh_rx_mux);
+    if (sock->rx_used > 0) {
+        mesh_rx_ring_copy_out(sock, sock->rx_head, &hdr, sizeof(hdr));
+
+        // adjust the len, the rest of a longer datagram is discarded
+        if (hdr.len < len) {
+            len = hdr.len;
         }
 
-        memcpy(buf, rx_data.data, len);
-        otIp6ToString(rx_data.src_ip, (char*)ip, MOD_USOCKET_IPV6_CHARS_MAX);
-        *port = rx_data.src_port;
+        // straight from the ring into the buffer given to recv()/recv_into()
+        mesh_rx_ring_copy_out(sock, (sock->rx_head + sizeof(hdr)) % sock->rx_size, buf, len);
+        sock->rx_head = (sock->rx_head + sizeof(hdr) + hdr.len) % sock->rx_size;
+        sock->rx_used -= sizeof(hdr) + hdr.len;
+        portEXIT_CRITICAL(&mesh_rx_mux);
+
+        otIp6ToString(hdr.src_ip, (char*)ip, MOD_USOCKET_IPV6_CHARS_MAX);
+        *port = hdr.src_port;
 
         return len;
     }
+    portEXIT_CRITICAL(&mesh_rx_mux);
     exit: if (*_errno != 0) {
         printf("err: %d", *_errno);
         return -1;
@@ -384,19 +505,95 @@ int mesh_socket_recvfrom(mod_network_socket_obj_t *s, byte *buf, mp_uint_t len,
 /******************************************************************************
  DEFINE PRIVATE FUNCTIONS
  ******************************************************************************/
+static void mesh_rx_ring_copy_in(pymesh_socket_t *sock, uint32_t pos, const void *data, uint32_t len) {
+    uint32_t first = MIN(len, sock->rx_size - pos);
+    memcpy(sock->rx_buf + pos, data, first);
+    memcpy(sock->rx_buf, (const uint8_t *)data + first, len - first);
+}
+
+static void mesh_rx_ring_copy_out(pymesh_socket_t *sock, uint32_t pos, void *data, uint32_t len) {
+    uint32_t first = MIN(len, sock->rx_size - pos);
+    memcpy(data, sock->rx_buf + pos, first);
+    memcpy((uint8_t *)data + first, sock->rx_buf, len - first);
+}
+
+// must be called inside mesh_rx_mux
+static void mesh_rx_ring_drop(pymesh_socket_t *sock) {
+    mesh_rx_hdr_t hdr;
+    mesh_rx_ring_copy_out(sock, sock->rx_head, &hdr, sizeof(hdr));
+    sock->rx_head = (sock->rx_head + sizeof(hdr) + hdr.len) % sock->rx_size;
+    sock->rx_used -= sizeof(hdr) + hdr.len;
+    mesh_obj.rx_dropped++;
+}
+
+/*
+ * called by openthread, stores the prefix followed by len bytes of the message read from offset,
+ * the oldest datagrams are dropped to make room
+ */
+static void mesh_rx_ring_push(pymesh_socket_t *sock, const otIp6Address *src_ip, uint16_t src_port,
+        const uint8_t *prefix, uint16_t prefix_len, otMessage *msg, uint16_t offset, uint16_t len) {
+    mesh_rx_hdr_t hdr;
+
+    if (sock->rx_buf == NULL) {
+        return;
+    }
+
+    // a datagram longer than the whole ring is truncated
+    if (sizeof(hdr) + prefix_len + len > sock->rx_size) {
+        len = sock->rx_size - sizeof(hdr) - prefix_len;
+    }
+    hdr.len = prefix_len + len;
+    hdr.src_port = src_port;
+    hdr.src_ip = *src_ip;
+    uint32_t total = sizeof(hdr) + hdr.len;
+
+    portENTER_CRITICAL(&mesh_rx_mux);
+    while (sock->rx_size - sock->rx_used < total) {
+        mesh_rx_ring_drop(sock);
+    }
+    uint32_t pos = (sock->rx_head + sock->rx_used) % sock->rx_size;
+    portEXIT_CRITICAL(&mesh_rx_mux);
+
+    // the room is reserved, recvfrom() only reads the datagrams already committed
+    mesh_rx_ring_copy_in(sock, pos, &hdr, sizeof(hdr));
+    pos = (pos + sizeof(hdr)) % sock->rx_size;
+    if (prefix_len > 0) {
+        mesh_rx_ring_copy_in(sock, pos, prefix, prefix_len);
+        pos = (pos + prefix_len) % sock->rx_size;
+    }
+    uint32_t first = MIN(len, sock->rx_size - pos);
+    otMessageRead(msg, offset, sock->rx_buf + pos, first);
+    if (len > first) {
+        otMessageRead(msg, offset + first, sock->rx_buf, len - first);
+    }
+
+    portENTER_CRITICAL(&mesh_rx_mux);
+    sock->rx_used += total;
+    mesh_obj.rx_received++;
+    portEXIT_CRITICAL(&mesh_rx_mux);
+}
+
 /*
  * Main function executed by Mesh task
  */
 static void TASK_Mesh(void *pvParameters) {
     
     for (;;) {
-        vTaskDelay(1 / portTICK_PERIOD_MS);
-
-        // openThread process tasklets
+        // sleep until the radio, the alarm, a tasklet or the CLI has something for OpenThread,
+        // every event is a notification so each received frame gets its own iteration
+        TickType_t wait = portMAX_DELAY;
+        if (mesh_obj.ot_ready && (otTaskletsArePending(ot) || otRadioIsPending())) {
+            wait = 0;
+        } else if (mesh_obj.idle_ms > 0) {
+            wait = mesh_obj.idle_ms / portTICK_PERIOD_MS;
+        }
+        ulTaskNotifyTake(pdFALSE, wait);
 
-        // CLI
         if (mesh_obj.ot_ready) {
 
+            // the alarm fired, processed here not to run OpenThread from the LoRa timer task
+            otPlatAlarmProcess(ot);
+
             // Radio 802.15.4 TX/RX state-machine
             otRadioProcess(ot);
 
@@ -408,6 +605,11 @@ static void TASK_Mesh(void *pvParameters) {
                 mesh_obj.otCliBufferLen = 0;
             }
 
+            if (mesh_snapshot && mesh_snapshot->request) {
+                mesh_snapshot_take(mesh_snapshot);
+                mesh_snapshot->request = false;
+            }
+
             // Log output
             otPlatLogFlush();
         }
@@ -420,8 +622,6 @@ static void TASK_Mesh(void *pvParameters) {
  */
 static void modmesh_init(void) {
 
-    //xRxQueue = xQueueCreate(OT_DATA_QUEUE_SIZE_MAX, sizeof(ot_rx_data_t));
-
     ot_obj.handler = mp_const_none;
     ot_obj.handler_arg = mp_const_none;
     
@@ -628,6 +828,65 @@ static int mesh_routers(uint8_t routers_num, otRouterInfo routers[routers_num])
     return router_crt;
 }
 
+// FNV-1a, only to tell whether a table changed between two snapshots
+static uint32_t mesh_snapshot_hash(uint32_t hash, const void *data, size_t len) {
+    const uint8_t *p = data;
+    while (len--) {
+        hash = (hash ^ *p++) * 16777619;
+    }
+    return hash;
+}
+
+// copies the neighbors and the routers tables in a single pass, called by the Mesh task
+static void mesh_snapshot_take(mesh_snapshot_t *snap) {
+    otNeighborInfoIterator iterator = OT_NEIGHBOR_INFO_ITERATOR_INIT;
+    otNeighborInfo nei;
+    otRouterInfo router;
+    uint32_t hash = 2166136261;
+    uint8_t n = 0;
+
+    while (n < MESH_SNAPSHOT_NEIGHBORS_MAX && otThreadGetNextNeighborInfo(ot, &iterator, &nei) == OT_ERROR_NONE) {
+        mesh_snapshot_neighbor_t *rec = &snap->neighbors[n++];
+        memcpy(rec->mac, nei.mExtAddress.m8, OT_EXT_ADDRESS_SIZE);
+        rec->rloc16 = nei.mRloc16;
+        rec->rssi = nei.mAverageRssi;
+        rec->last_rssi = nei.mLastRssi;
+        rec->role = nei.mIsChild ? OT_DEVICE_ROLE_CHILD : OT_DEVICE_ROLE_ROUTER;
+        rec->lq_in = nei.mLinkQualityIn;
+        rec->age = MIN(nei.mAge, UINT16_MAX);
+        hash = mesh_snapshot_hash(hash, rec, offsetof(mesh_snapshot_neighbor_t, rssi));
+        hash = mesh_snapshot_hash(hash, &rec->role, 2);
+    }
+    snap->hdr.neighbors_num = n;
+    if (hash != snap->neighbors_hash) {
+        snap->neighbors_hash = hash;
+        snap->hdr.neighbors_gen++;
+    }
+
+    hash = 2166136261;
+    n = 0;
+    uint8_t maxRouterId = otThreadGetMaxRouterId(ot);
+    for (uint8_t i = 0; i <= maxRouterId && n < MESH_SNAPSHOT_ROUTERS_MAX; i++) {
+        if (otThreadGetRouterInfo(ot, i, &router) != OT_ERROR_NONE) {
+            continue;
+        }
+        mesh_snapshot_router_t *rec = &snap->routers[n++];
+        memcpy(rec->mac, router.mExtAddress.m8, OT_EXT_ADDRESS_SIZE);
+        rec->rloc16 = router.mRloc16;
+        rec->id = router.mRouterId;
+        rec->next_hop = router.mNextHop;
+        rec->path_cost = router.mPathCost;
+        rec->lq_in = router.mLinkQualityIn;
+        rec->lq_out = router.mLinkQualityOut;
+        rec->age = router.mAge;
+        hash = mesh_snapshot_hash(hash, rec, offsetof(mesh_snapshot_router_t, age));
+    }
+    snap->hdr.routers_num = n;
+    if (hash != snap->routers_hash) {
+        snap->routers_hash = hash;
+        snap->hdr.routers_gen++;
+    }
+}
 
 // returns Leader Data, ex: ip address of the leader
 static int mesh_leader_data(otRouterInfo *leaderRouterData, otLeaderData *leaderData) {
@@ -800,32 +1059,13 @@ static void socket_udp_cb(void *aContext, otMessage *aMessage,
 
     if (!sock) return;
 
-    ot_rx_data_t rx_data;
     uint16_t payloadLength = otMessageGetLength(aMessage) - otMessageGetOffset(aMessage);
 
-    if (payloadLength > sizeof(rx_data.data))
-        payloadLength = sizeof(rx_data.data);
+//    otPlatLog(0, 0,"socket_udp_cb %dB p=%d", payloadLength, aMessageInfo->mPeerPort);
 
-    rx_data.len = otMessageRead(aMessage, otMessageGetOffset(aMessage),
-            rx_data.data, payloadLength);
-    rx_data.src_port = aMessageInfo->mPeerPort;
-
-    rx_data.src_ip = aMessageInfo->mPeerAddr;
-
-//    char ip_str[MOD_USOCKET_IPV6_CHARS_MAX];
-//    otIp6ToString(rx_data.src_ip, ip_str, MOD_USOCKET_IPV6_CHARS_MAX);
-//    otPlatLog(0, 0,"socket_udp_cb %dB p=%d %s", rx_data.len, rx_data.src_port, ip_str);
-//    otPlatLog(0, 0,"reg in queue, call handler");
-
-    // store packet received in queue, to be consumed by socket.recvfrom()
-    if (!xQueueSend(sock->rx_queue, (void *) &rx_data, 0)) {
-        // queue is full, so we should drop the oldest item, to add the new one
-        ot_rx_data_t rx_data_drop;
-        xQueueReceive(sock->rx_queue, &rx_data_drop, 0);
-
-        // try to store it again
-        xQueueSend(sock->rx_queue, (void *) &rx_data, 0);
-    }
+    // store packet received in the ring, to be consumed by socket.recvfrom()
+    mesh_rx_ring_push(sock, &aMessageInfo->mPeerAddr, aMessageInfo->mPeerPort, NULL, 0,
+            aMessage, otMessageGetOffset(aMessage), payloadLength);
 
 
     // callback to mpy if registered
@@ -862,6 +1102,41 @@ static void socket_udp_cb(void *aContext, otMessage *aMessage,
 }
 
 
+// sends a Border Router datagram to the forwarding endpoint, from the Mesh task
+static void mesh_br_forward_send(otMessage *aMessage, const uint8_t *br_header, uint16_t offset, uint16_t len) {
+    int sd = br_forward.sd;
+    uint32_t size = 0;
+
+    if (len > BORDER_ROUTER_FORWARD_PAYLOAD_MAX) {
+        br_forward.errors++;
+        return;
+    }
+
+    if (br_forward.tcp) {
+        uint16_t frame_len = len + (br_forward.header ? BORDER_ROUTER_HEADER_SIZE : 0);
+        br_forward_buf[size++] = frame_len >> 8;
+        br_forward_buf[size++] = frame_len;
+    }
+    if (br_forward.header) {
+        memcpy(&br_forward_buf[size], br_header, BORDER_ROUTER_HEADER_SIZE);
+        size += BORDER_ROUTER_HEADER_SIZE;
+    }
+    size += otMessageRead(aMessage, offset, &br_forward_buf[size], len);
+
+    int sent = lwip_send(sd, br_forward_buf, size, 0);
+    if (sent == size) {
+        br_forward.forwarded++;
+        br_forward.bytes += size;
+    } else {
+        br_forward.errors++;
+        if (br_forward.tcp && sent > 0) {
+            // the stream lost its framing, stop forwarding rather than sending garbage
+            br_forward.sd = -1;
+            lwip_close(sd);
+        }
+    }
+}
+
 // function called by openthread when an IPv6 datagram arrived
 // in *aContext we could put the IP of the BR, based on which we should make the filtering
 void br_ip6_rcv_cb(otMessage *aMessage, void *aContext){
@@ -880,14 +1155,10 @@ void br_ip6_rcv_cb(otMessage *aMessage, void *aContext){
     // suppose we have IPv6+UDP message, so offset is after header
     uint16_t messageOffset = sizeof(ipv6_and_udp_header_t);//otMessageGetOffset(aMessage);
 
-    ot_rx_data_t rx_data;
-    rx_data.len = messageLength - sizeof(ipv6_and_udp_header_t) + BORDER_ROUTER_HEADER_SIZE;
+    uint8_t br_header[BORDER_ROUTER_HEADER_SIZE];
 
-    if (rx_data.len > sizeof(rx_data.data))
-        rx_data.len = sizeof(rx_data.data);
-
-    // read data content of UDP datagram
-    otMessageRead(aMessage, messageOffset, rx_data.data + BORDER_ROUTER_HEADER_SIZE, rx_data.len);
+    if (messageLength < sizeof(ipv6_and_udp_header_t))
+        return;
 
     // read ipv6+UDP datagram header, to find ipv6 source and destination and ports
     otMessageRead(aMessage, 0, (void*)&header, sizeof(ipv6_and_udp_header_t));
@@ -897,16 +1168,16 @@ void br_ip6_rcv_cb(otMessage *aMessage, void *aContext){
     header.src_port = HostSwap16(header.src_port);
 
     // create a small preamble(header), as BORDER_ROUTER_HEADER_1_CONST + dest IP + dest port
-    rx_data.data[0] = BORDER_ROUTER_HEADER_1_CONST;
+    br_header[0] = BORDER_ROUTER_HEADER_1_CONST;
 
     // add IP destination
-    memcpy( rx_data.data + BORDER_ROUTER_HEADER_1,
+    memcpy( br_header + BORDER_ROUTER_HEADER_1,
             &header.dest_ip6.mFields.m8[0],
             BORDER_ROUTER_HEADER_2);
 
     // add port destination
-    rx_data.data[BORDER_ROUTER_HEADER_1 + BORDER_ROUTER_HEADER_2] = header.dst_port >> 8;
-    rx_data.data[BORDER_ROUTER_HEADER_1 + BORDER_ROUTER_HEADER_2 + 1] = header.dst_port;
+    br_header[BORDER_ROUTER_HEADER_1 + BORDER_ROUTER_HEADER_2] = header.dst_port >> 8;
+    br_header[BORDER_ROUTER_HEADER_1 + BORDER_ROUTER_HEADER_2 + 1] = header.dst_port;
 
 //    char source[MOD_USOCKET_IPV6_CHARS_MAX];
 //    otIp6ToString(header.source_ip6, source, MOD_USOCKET_IPV6_CHARS_MAX);
@@ -930,7 +1201,14 @@ void br_ip6_rcv_cb(otMessage *aMessage, void *aContext){
     if (matching_bits < border_router_prefix.mLength)
         return;
 
-    // the source IPv6 matches the BR prefix, so we should add data payload into the RX_queue
+    // the source IPv6 matches the BR prefix, bridge it natively if a forwarding endpoint is set
+    if (br_forward.sd >= 0) {
+        mesh_br_forward_send(aMessage, br_header, messageOffset, messageLength - sizeof(ipv6_and_udp_header_t));
+        otMessageFree(aMessage);
+        return;
+    }
+
+    // otherwise we should add data payload into the RX_queue
 
     // first, let's find the socket
     pymesh_socket_t *sock = NULL;
@@ -958,23 +1236,11 @@ void br_ip6_rcv_cb(otMessage *aMessage, void *aContext){
     }
 
 
-    rx_data.dest_ip = header.dest_ip6;
-    rx_data.src_ip = header.source_ip6;
-    rx_data.dest_port = header.dst_port;
-    rx_data.src_port = header.src_port;
-
-    //otPlatLog(0, 0,"reg in queue, call handler %d", rx_data.src_port);
+    //otPlatLog(0, 0,"reg in ring, call handler %d", header.src_port);
 
-    // store packet received in queue, to be consumed by socket.recvfrom()
-
-    if (!xQueueSend(sock->rx_queue, (void *) &rx_data, 0)) {
-        // queue is full, so we should drop the oldest item, to add the new one
-        ot_rx_data_t rx_data_drop;
-        xQueueReceive(sock->rx_queue, &rx_data_drop, 0);
-
-        // try to store it again
-        xQueueSend(sock->rx_queue, (void *) &rx_data, 0);
-    }
+    // store the BR header and the UDP payload in the ring, to be consumed by socket.recvfrom()
+    mesh_rx_ring_push(sock, &header.source_ip6, header.src_port, br_header, BORDER_ROUTER_HEADER_SIZE,
+            aMessage, messageOffset, messageLength - sizeof(ipv6_and_udp_header_t));
 
     // free message
     otMessageFree(aMessage);
@@ -1027,6 +1293,8 @@ void otConsoleCb(const char *aBuf, uint16_t aBufLength, void *aContext){
 STATIC const mp_arg_t mesh_init_args[] = {
     { MP_QSTR_id,                             MP_ARG_INT,   {.u_int  = 0} },
     { MP_QSTR_key,         MP_ARG_KW_ONLY  | MP_ARG_OBJ,   {.u_obj  = MP_OBJ_NULL} },
+    { MP_QSTR_idle_ms,     MP_ARG_KW_ONLY  | MP_ARG_INT,   {.u_int  = MESH_TASK_IDLE_MS_DEF} },
+    { MP_QSTR_rx_buffer_size, MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int  = MESH_SOCKET_RX_SIZE_DEF} },
 };
 /*
  * start Lora Mesh openthread
@@ -1053,7 +1321,13 @@ STATIC mp_obj_t mesh_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_ui
             memcpy(master_key, bufinfo.buf, sizeof(master_key));
         }
 
+        if (args[2].u_int < 0 || args[3].u_int < MESH_SOCKET_RX_SIZE_MIN || args[3].u_int > UINT16_MAX) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+        }
+
         modmesh_init();
+        mesh_obj.idle_ms = args[2].u_int;
+        mesh_obj.rx_size = args[3].u_int;
         //printf("mesh task started\n");
         
         // setup the object
@@ -1070,6 +1344,7 @@ STATIC mp_obj_t mesh_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_ui
             mesh_obj.otCliBufferLen = 0;
         }
         mesh_obj.ot_ready = (ot != NULL);
+        mesh_task_signal();
     }
 
     return (mp_obj_t)self;
@@ -1082,6 +1357,12 @@ STATIC mp_obj_t mesh_deinit_cmd (mp_obj_t self_in) {
     
     openthread_deinit();
     vTaskDelete(xMeshTaskHndl);
+    xMeshTaskHndl = NULL;
+
+    if (br_forward.sd >= 0) {
+        lwip_close(br_forward.sd);
+        br_forward.sd = -1;
+    }
 
     return mp_obj_new_bool(true);
 }
@@ -1123,6 +1404,7 @@ STATIC mp_obj_t mesh_cli(mp_obj_t self_in, mp_obj_t data) {
 
     mesh_obj.otCliBufferLen = len;
     mesh_obj.meshCliOutputDone = false;
+    mesh_task_signal();
     while (!mesh_obj.meshCliOutputDone && timeout >= 0) {
         mp_hal_delay_ms(300);
         timeout -= 300;
@@ -1269,6 +1551,50 @@ STATIC mp_obj_t mesh_routers_cmd (mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mesh_routers_obj, mesh_routers_cmd);
 
+/*
+ * copies the neighbors and routers tables into buf as packed records (see mesh_snapshot_hdr_t) and returns
+ * the number of bytes written, the generations in the header tell whether a table changed since the last call
+ */
+STATIC mp_obj_t mesh_snapshot_cmd (mp_obj_t self_in, mp_obj_t buf_in) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_WRITE);
+
+    if (!mesh_obj.ot_ready) {
+        mp_raise_OSError(MP_EPERM);
+    }
+    if (mesh_snapshot == NULL) {
+        if (NULL == (mesh_snapshot = calloc(1, sizeof(mesh_snapshot_t)))) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    }
+
+    // the Mesh task copies the tables between two OpenThread runs, not to walk them while they change
+    int timeout = MESH_SNAPSHOT_TIMEOUT_MS;
+    mesh_snapshot->request = true;
+    mesh_task_signal();
+    while (mesh_snapshot->request) {
+        if (timeout <= 0) {
+            mp_raise_OSError(MP_ETIMEDOUT);
+        }
+        mp_hal_delay_ms(1);
+        timeout--;
+    }
+
+    size_t nei_len = mesh_snapshot->hdr.neighbors_num * sizeof(mesh_snapshot_neighbor_t);
+    size_t routers_len = mesh_snapshot->hdr.routers_num * sizeof(mesh_snapshot_router_t);
+    size_t len = sizeof(mesh_snapshot_hdr_t) + nei_len + routers_len;
+    if (bufinfo.len < len) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+
+    uint8_t *dest = bufinfo.buf;
+    memcpy(dest, &mesh_snapshot->hdr, sizeof(mesh_snapshot_hdr_t));
+    memcpy(dest + sizeof(mesh_snapshot_hdr_t), mesh_snapshot->neighbors, nei_len);
+    memcpy(dest + sizeof(mesh_snapshot_hdr_t) + nei_len, mesh_snapshot->routers, routers_len);
+    return mp_obj_new_int_from_uint(len);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mesh_snapshot_obj, mesh_snapshot_cmd);
+
 /*
  * returns a list with all Leader properties(partition, mac and rloc16)
  */
@@ -1375,6 +1701,107 @@ STATIC mp_obj_t mesh_border_router_del (mp_obj_t self_in, mp_obj_t br_prefixj) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mesh_border_router_del_obj, mesh_border_router_del);
 
+/*
+ * forwards the Border Router datagrams to an UDP or TCP endpoint (host, port) from C, instead of the Pymesh sockets
+ * None stops the forwarding, no param returns (forwarded, bytes, errors)
+ */
+STATIC mp_obj_t mesh_border_router_forward (mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_address,              MP_ARG_OBJ,                   {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_tcp,                  MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_header,               MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[0].u_obj == MP_OBJ_NULL) {
+        mp_obj_t tuple[3];
+        tuple[0] = mp_obj_new_int_from_uint(br_forward.forwarded);
+        tuple[1] = mp_obj_new_int_from_uint(br_forward.bytes);
+        tuple[2] = mp_obj_new_int_from_uint(br_forward.errors);
+        return mp_obj_new_tuple(3, tuple);
+    }
+
+    // stop the current forwarding, the Mesh task checks the socket before each datagram
+    int sd = br_forward.sd;
+    br_forward.sd = -1;
+    if (sd >= 0) {
+        lwip_close(sd);
+    }
+
+    if (args[0].u_obj == mp_const_none) {
+        return mp_const_none;
+    }
+
+    mp_obj_t *addr;
+    mp_obj_get_array_fixed_n(args[0].u_obj, 2, &addr);
+    const char *host = mp_obj_str_get_str(addr[0]);
+    mp_int_t port = mp_obj_get_int(addr[1]);
+    if (port <= 0 || port > UINT16_MAX) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    bool tcp = args[1].u_bool;
+
+    const struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = tcp ? SOCK_STREAM : SOCK_DGRAM,
+    };
+    struct addrinfo *res;
+    char port_s[6];
+    sprintf(port_s, "%d", port);
+    MP_THREAD_GIL_EXIT();
+    int32_t result = lwip_getaddrinfo(host, port_s, &hints, &res);
+    MP_THREAD_GIL_ENTER();
+    if (result != 0 || res == NULL) {
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(result)));
+    }
+
+    sd = lwip_socket(AF_INET, hints.ai_socktype, 0);
+    if (sd < 0) {
+        lwip_freeaddrinfo(res);
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    MP_THREAD_GIL_EXIT();
+    result = lwip_connect(sd, res->ai_addr, res->ai_addrlen);
+    MP_THREAD_GIL_ENTER();
+    lwip_freeaddrinfo(res);
+    if (result != 0) {
+        lwip_close(sd);
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+
+    if (tcp) {
+        // don't stall the Mesh task on a slow endpoint, such datagrams are counted as errors
+        struct timeval tv = {
+            .tv_sec = 0,
+            .tv_usec = BORDER_ROUTER_FORWARD_TCP_TIMEOUT_MS * 1000,
+        };
+        lwip_setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+
+    br_forward.tcp = tcp;
+    br_forward.header = args[2].u_bool;
+    br_forward.forwarded = 0;
+    br_forward.bytes = 0;
+    br_forward.errors = 0;
+    // set last, so the Mesh task sees a complete configuration
+    br_forward.sd = sd;
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mesh_border_router_forward_obj, 1, mesh_border_router_forward);
+
+/*
+ * returns (received, dropped), the datagrams stored in the sockets RX rings and the ones dropped to make room
+ */
+STATIC mp_obj_t mesh_rx_stats (mp_obj_t self_in) {
+    mp_obj_t tuple[2];
+    tuple[0] = mp_obj_new_int_from_uint(mesh_obj.rx_received);
+    tuple[1] = mp_obj_new_int_from_uint(mesh_obj.rx_dropped);
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mesh_rx_stats_obj, mesh_rx_stats);
+
 STATIC const mp_map_elem_t mesh_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_state),                   (mp_obj_t)&mesh_state_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_cli),                     (mp_obj_t)&mesh_cli_obj },
@@ -1383,10 +1810,13 @@ STATIC const mp_map_elem_t mesh_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_ipaddr),                  (mp_obj_t)&mesh_ipaddr_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_neighbors),               (mp_obj_t)&mesh_neighbors_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_routers),                 (mp_obj_t)&mesh_routers_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_snapshot),                (mp_obj_t)&mesh_snapshot_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_leader),                  (mp_obj_t)&mesh_leader_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_rx_cb),                   (mp_obj_t)&mesh_rx_cb_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_rx_stats),                (mp_obj_t)&mesh_rx_stats_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_border_router),           (mp_obj_t)&mesh_border_router_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_border_router_del),       (mp_obj_t)&mesh_border_router_del_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_border_router_forward),   (mp_obj_t)&mesh_border_router_forward_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),                  (mp_obj_t)&mesh_deinit_obj },
 };
 
@@ -41,6 +41,10 @@ extern const mp_obj_type_t lora_mesh_type;
 
 extern bool lora_mesh_ready(void);
 
+extern void mesh_task_signal(void);
+
+extern void mesh_task_signal_from_isr(void);
+
 /******************************************************************************
  * socket functions used in modlora.c
  */
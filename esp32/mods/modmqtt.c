@@ -0,0 +1,1605 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "py/mpstate.h"
+#include "py/runtime.h"
+#include "py/obj.h"
+#include "py/objtuple.h"
+#include "py/objlist.h"
+#include "py/mperrno.h"
+#include "py/mphal.h"
+#include "py/mpthread.h"
+#include "py/stream.h"
+#include "py/builtin.h"
+#include "extmod/vfs.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "modnetwork.h"
+#include "modusocket.h"
+#include "modussl.h"
+#include "lwipsocket.h"
+#include "modmqtt.h"
+#include "mpexception.h"
+#include "mpirq.h"
+
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define MOD_MQTT_CLIENTS_MAX                (4)         // size of the mod_mqtt_obj root pointer
+#define MOD_MQTT_STACK_SIZE                 (3072)
+#define MOD_MQTT_TASK_PRIORITY              (6)         // above the Python threads, acks aren't delayed by them
+#define MOD_MQTT_POLL_MS                    (20)        // longest delay of a queued packet while waiting for input
+#define MOD_MQTT_IO_TIMEOUT_MS              (5000)      // for the rest of a packet once its first byte is in
+#define MOD_MQTT_RETRY_MS                   (10000)     // before sending again an unacknowledged packet
+#define MOD_MQTT_INFLIGHT_MAX               (8)         // QoS 1 and 2 publications waiting for their acks
+#define MOD_MQTT_INBOX_MAX                  (16)        // received messages not handed to Python yet
+#define MOD_MQTT_QOS2_MAX                   (8)         // received QoS 2 messages waiting for their PUBREL
+#define MOD_MQTT_PACKET_MAX                 (32 * 1024)
+#define MOD_MQTT_QUEUE_DEF                  (16)
+#define MOD_MQTT_TIMEOUT_DEF                (5)         // s, of subscribe() and unsubscribe()
+#define MOD_MQTT_CONNECT_TIMEOUT_DEF        (30)        // s
+#define MOD_MQTT_BATCH_SIZE                 (1460)      // packets sent together, in one TCP segment or TLS record
+#define MOD_MQTT_SPILL_SIZE_DEF             (64 * 1024)
+
+// packet types, in the upper half of the first byte
+#define MQTT_CONNECT                        (0x10)
+#define MQTT_CONNACK                        (0x20)
+#define MQTT_PUBLISH                        (0x30)
+#define MQTT_PUBACK                         (0x40)
+#define MQTT_PUBREC                         (0x50)
+#define MQTT_PUBREL                         (0x60)
+#define MQTT_PUBCOMP                        (0x70)
+#define MQTT_SUBSCRIBE                      (0x80)
+#define MQTT_SUBACK                         (0x90)
+#define MQTT_UNSUBSCRIBE                    (0xA0)
+#define MQTT_UNSUBACK                       (0xB0)
+#define MQTT_PINGREQ                        (0xC0)
+#define MQTT_PINGRESP                       (0xD0)
+#define MQTT_DISCONNECT                     (0xE0)
+
+#define MQTT_FLAG_DUP                       (0x08)
+#define MQTT_FLAG_RETAIN                    (0x01)
+#define MQTT_SUBACK_FAILURE                 (0x80)
+
+#define MOD_MQTT_STATE_CONNECTING           (0)
+#define MOD_MQTT_STATE_CONNECTED            (1)
+#define MOD_MQTT_STATE_CLOSED               (2)         // the task is over or about to be
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+// a packet to send, kept after that if it has to be acknowledged
+typedef struct mod_mqtt_packet_s {
+    struct mod_mqtt_packet_s *next;
+    uint32_t queued_ms;                     // when publish() was called, for the latency
+    uint32_t sent_ms;
+    uint32_t len;
+    uint16_t mid;
+    uint8_t qos;                            // of a PUBLISH, or 2 for the PUBREL that follows it
+    uint8_t data[];
+} mod_mqtt_packet_t;
+
+typedef struct {
+    mod_mqtt_packet_t *head;
+    mod_mqtt_packet_t *tail;
+} mod_mqtt_list_t;
+
+// a received PUBLISH, the topic followed by the payload
+typedef struct mod_mqtt_msg_s {
+    struct mod_mqtt_msg_s *next;
+    uint32_t payload_len;
+    uint16_t topic_len;
+    uint16_t mid;
+    uint8_t header;
+    uint8_t data[];
+} mod_mqtt_msg_t;
+
+// the publications kept while offline, or while the queue is full, sent in order once connected
+// it outlives the connections, the task of each one sends it after what is queued
+typedef struct {
+    mod_mqtt_list_t loaded;                 // requeued, or read back from the spill file, the oldest
+    mod_mqtt_list_t ram;                    // newer than what is left in the spill file
+    uint32_t count;                         // of both lists
+    uint32_t bytes;
+    uint32_t max;                           // bytes in RAM before spilling, 0 if there's no backlog
+    uint32_t spilled;                       // bytes of the spill file not read back yet
+    uint32_t spill_offset;
+    uint32_t spill_max;
+    uint32_t discarded;                     // publications lost, the backlog being full
+    uint32_t sent;
+    uint64_t latency_sum;                   // ms, from publish() to the socket
+    uint32_t latency_max;
+    portMUX_TYPE mux;
+    volatile bool busy;                     // the spill file is being written or read
+    volatile bool refill;                   // the interrupt task is asked to read it back
+} mod_mqtt_session_t;
+
+// state shared with the task, outside of the MicroPython heap
+typedef struct {
+    mp_obj_t obj;                           // given to the interrupt task, not used by the MQTT task
+    mod_mqtt_session_t *session;            // in obj, rooted while the task runs
+    mod_network_socket_obj_t *sock;
+    QueueHandle_t out;
+    SemaphoreHandle_t ack;                  // given on CONNACK, SUBACK, UNSUBACK and when the task ends
+    volatile TaskHandle_t task;
+    mod_mqtt_packet_t *inflight;
+    uint32_t inflight_count;
+    mod_mqtt_list_t unsent;                 // taken from the queue or the backlog when the connection failed
+    mod_mqtt_msg_t *inbox;
+    mod_mqtt_msg_t *inbox_tail;
+    uint32_t inbox_count;
+    uint32_t dropped;
+    portMUX_TYPE inbox_mux;
+    uint32_t keepalive_ms;
+    uint32_t tx_ms;
+    uint32_t ping_ms;                       // when the PINGREQ waiting for its PINGRESP was sent, 0 if none
+    uint16_t qos2_mids[MOD_MQTT_QOS2_MAX];
+    uint8_t qos2_count;
+    volatile uint16_t ack_mid;              // of the SUBSCRIBE or UNSUBSCRIBE waited for
+    volatile uint8_t ack_code;
+    volatile uint8_t state;
+    volatile bool stop;                     // the task must end now
+    volatile bool closing;                  // a DISCONNECT is queued, the task ends once it's sent
+    uint8_t batch[MOD_MQTT_BATCH_SIZE];
+} mod_mqtt_conn_t;
+
+typedef struct {
+    mp_obj_base_t base;
+    mp_obj_t client_id;
+    mp_obj_t user;
+    mp_obj_t password;
+    mp_obj_t sock;
+    mp_obj_t subs;                          // list of (topic filter, callback)
+    mp_obj_t handler;                       // called when the connection is lost
+    mp_obj_t spill;                         // path of the file the backlog spills to, or None
+    mod_mqtt_conn_t *conn;
+    mod_mqtt_session_t session;
+    uint32_t queue_len;
+    uint32_t timeout_ms;
+    uint16_t keepalive;
+    uint16_t mid;
+    int8_t slot;
+    bool clean_session;
+} mod_mqtt_obj_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+STATIC const qstr mod_mqtt_message_fields[] = {
+    MP_QSTR_topic, MP_QSTR_payload, MP_QSTR_qos, MP_QSTR_retain, MP_QSTR_dup, MP_QSTR_mid
+};
+
+STATIC const qstr mod_mqtt_stats_fields[] = {
+    MP_QSTR_queued, MP_QSTR_inflight, MP_QSTR_dropped, MP_QSTR_backlog, MP_QSTR_spilled, MP_QSTR_discarded,
+    MP_QSTR_sent, MP_QSTR_latency_avg, MP_QSTR_latency_max
+};
+
+/******************************************************************************
+ DECLARE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC void mod_mqtt_release (mod_mqtt_obj_t *self, bool close);
+STATIC void mod_mqtt_spill (mod_mqtt_obj_t *self, bool all);
+STATIC void mod_mqtt_backlog_free (mod_mqtt_session_t *s);
+STATIC void mod_mqtt_unroot (mod_mqtt_obj_t *self);
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void modmqtt_deinit_all (void) {
+    // the tasks use sockets of the heap being released
+    for (int i = 0; i < MOD_MQTT_CLIENTS_MAX; i++) {
+        mod_mqtt_obj_t *self = MP_STATE_PORT(mod_mqtt_obj)[i];
+        if (self != MP_OBJ_NULL) {
+            mod_mqtt_release(self, false);
+            // what wasn't sent is kept for the next boot
+            if (self->spill != mp_const_none) {
+                mod_mqtt_spill(self, true);
+            }
+            mod_mqtt_backlog_free(&self->session);
+            MP_STATE_PORT(mod_mqtt_obj)[i] = MP_OBJ_NULL;
+        }
+    }
+}
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+// MQTT 3.1.1 section 4.7: '+' matches one level, '#' the parent level and all below it,
+// and the wildcards at the first level don't match the topics starting with '$'
+STATIC bool mod_mqtt_topic_matches (const byte *sub, size_t slen, const byte *topic, size_t tlen) {
+    if (tlen > 0 && topic[0] == '$' && slen > 0 && (sub[0] == '+' || sub[0] == '#')) {
+        return false;
+    }
+    size_t s = 0;
+    size_t t = 0;
+    while (s < slen) {
+        if (sub[s] == '#') {
+            return s + 1 == slen;
+        } else if (sub[s] == '+') {
+            while (t < tlen && topic[t] != '/') {
+                t++;
+            }
+            s++;
+        } else {
+            while (s < slen && sub[s] != '/') {
+                if (t == tlen || topic[t] != sub[s]) {
+                    return false;
+                }
+                s++;
+                t++;
+            }
+        }
+        // both at the end of a level
+        if (s == slen) {
+            return t == tlen;
+        }
+        if (t == tlen) {
+            // "a/#" also matches "a"
+            return s + 2 == slen && sub[s + 1] == '#';
+        }
+        if (topic[t] != '/') {
+            return false;
+        }
+        s++;
+        t++;
+    }
+    return t == tlen;
+}
+
+// monotonic, unlike mp_hal_ticks_ms() which follows the RTC
+STATIC uint32_t mod_mqtt_ms (void) {
+    return (uint32_t)mp_hal_ticks_ms_non_blocking();
+}
+
+STATIC uint32_t mod_mqtt_len_size (uint32_t len) {
+    uint32_t size = 1;
+    while (len >= 0x80) {
+        len >>= 7;
+        size++;
+    }
+    return size;
+}
+
+STATIC uint8_t *mod_mqtt_put_u16 (uint8_t *d, uint16_t value) {
+    d[0] = value >> 8;
+    d[1] = value;
+    return d + 2;
+}
+
+STATIC uint8_t *mod_mqtt_put_str (uint8_t *d, const void *str, size_t len) {
+    d = mod_mqtt_put_u16(d, len);
+    memcpy(d, str, len);
+    return d + len;
+}
+
+// allocates a packet of the given remaining length, body points after its fixed header
+STATIC mod_mqtt_packet_t *mod_mqtt_packet_new (uint8_t header, uint32_t remaining, uint8_t **body) {
+    uint32_t len = 1 + mod_mqtt_len_size(remaining) + remaining;
+    mod_mqtt_packet_t *p = malloc(sizeof(mod_mqtt_packet_t) + len);
+    if (p == NULL) {
+        return NULL;
+    }
+    p->next = NULL;
+    p->queued_ms = mod_mqtt_ms();
+    p->sent_ms = 0;
+    p->len = len;
+    p->mid = 0;
+    p->qos = 0;
+    uint8_t *d = p->data;
+    *d++ = header;
+    // 7 bits per byte, least significant first
+    do {
+        uint8_t b = remaining & 0x7F;
+        remaining >>= 7;
+        *d++ = b | (remaining ? 0x80 : 0);
+    } while (remaining);
+    *body = d;
+    return p;
+}
+
+STATIC mod_mqtt_packet_t *mod_mqtt_packet_alloc (uint8_t header, uint32_t remaining, uint8_t **body) {
+    if (remaining > MOD_MQTT_PACKET_MAX) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    mod_mqtt_packet_t *p = mod_mqtt_packet_new(header, remaining, body);
+    if (p == NULL) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    return p;
+}
+
+STATIC void mod_mqtt_free_packets (mod_mqtt_packet_t *p) {
+    while (p != NULL) {
+        mod_mqtt_packet_t *next = p->next;
+        free(p);
+        p = next;
+    }
+}
+
+STATIC void mod_mqtt_list_append (mod_mqtt_list_t *list, mod_mqtt_packet_t *p) {
+    p->next = NULL;
+    if (list->tail != NULL) {
+        list->tail->next = p;
+    } else {
+        list->head = p;
+    }
+    list->tail = p;
+}
+
+STATIC mod_mqtt_packet_t *mod_mqtt_list_pop (mod_mqtt_list_t *list) {
+    mod_mqtt_packet_t *p = list->head;
+    if (p != NULL) {
+        list->head = p->next;
+        if (list->head == NULL) {
+            list->tail = NULL;
+        }
+        p->next = NULL;
+    }
+    return p;
+}
+
+// moves the packets of src before those of dst
+STATIC void mod_mqtt_list_prepend (mod_mqtt_list_t *dst, mod_mqtt_list_t *src) {
+    if (src->head == NULL) {
+        return;
+    }
+    src->tail->next = dst->head;
+    if (dst->tail == NULL) {
+        dst->tail = src->tail;
+    }
+    dst->head = src->head;
+    src->head = src->tail = NULL;
+}
+
+// the message id of a PUBLISH follows its topic
+STATIC void mod_mqtt_publish_set_mid (mod_mqtt_packet_t *p, uint16_t mid) {
+    uint32_t i = 1;
+    while (p->data[i++] & 0x80);
+    i += 2 + ((p->data[i] << 8) | p->data[i + 1]);
+    mod_mqtt_put_u16(&p->data[i], mid);
+    p->mid = mid;
+}
+
+STATIC bool mod_mqtt_backlog_empty (mod_mqtt_session_t *s) {
+    return s->count == 0 && s->spilled == 0 && !s->busy;
+}
+
+// puts the publications of the list back before the rest of the backlog, frees the other packets
+STATIC void mod_mqtt_requeue (mod_mqtt_session_t *s, mod_mqtt_list_t *list) {
+    mod_mqtt_list_t keep = { NULL, NULL };
+    uint32_t count = 0, bytes = 0;
+    mod_mqtt_packet_t *p;
+    while ((p = mod_mqtt_list_pop(list)) != NULL) {
+        if (s->max > 0 && (p->data[0] & 0xF0) == MQTT_PUBLISH) {
+            mod_mqtt_list_append(&keep, p);
+            count++;
+            bytes += p->len;
+        } else {
+            free(p);
+        }
+    }
+    portENTER_CRITICAL(&s->mux);
+    mod_mqtt_list_prepend(&s->loaded, &keep);
+    s->count += count;
+    s->bytes += bytes;
+    portEXIT_CRITICAL(&s->mux);
+}
+
+STATIC void mod_mqtt_backlog_free (mod_mqtt_session_t *s) {
+    mod_mqtt_free_packets(s->loaded.head);
+    mod_mqtt_free_packets(s->ram.head);
+    s->loaded.head = s->loaded.tail = NULL;
+    s->ram.head = s->ram.tail = NULL;
+    s->count = 0;
+    s->bytes = 0;
+}
+
+/******************************************************************************
+ MQTT TASK
+ ******************************************************************************/
+STATIC bool mod_mqtt_send (mod_mqtt_conn_t *conn, const uint8_t *buf, uint32_t len) {
+    uint32_t start = mod_mqtt_ms();
+    while (len > 0) {
+        int _errno = 0;
+        int n = lwipsocket_socket_send(conn->sock, buf, len, &_errno);
+        if (n < 0) {
+            if (_errno == MP_EAGAIN && mod_mqtt_ms() - start < MOD_MQTT_IO_TIMEOUT_MS && !conn->stop) {
+                vTaskDelay(1);
+                continue;
+            }
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    conn->tx_ms = mod_mqtt_ms();
+    return true;
+}
+
+STATIC bool mod_mqtt_send_ack (mod_mqtt_conn_t *conn, uint8_t header, uint16_t mid) {
+    uint8_t pkt[4] = { header, 2, mid >> 8, mid };
+    return mod_mqtt_send(conn, pkt, sizeof(pkt));
+}
+
+STATIC bool mod_mqtt_recv (mod_mqtt_conn_t *conn, uint8_t *buf, uint32_t len) {
+    while (len > 0) {
+        int _errno = 0;
+        int n = lwipsocket_socket_recv(conn->sock, buf, len, &_errno);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+STATIC bool mod_mqtt_readable (mod_mqtt_conn_t *conn, uint32_t timeout_ms) {
+    // TLS records already decrypted aren't seen by select()
+    if (conn->sock->sock_base.is_ssl &&
+        mbedtls_ssl_get_bytes_avail(&((mp_obj_ssl_socket_t *)conn->sock)->ssl) > 0) {
+        return true;
+    }
+    int32_t sd = conn->sock->sock_base.u.sd;
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(sd, &rfds);
+    struct timeval tv = { .tv_sec = 0, .tv_usec = timeout_ms * 1000 };
+    return lwip_select(sd + 1, &rfds, NULL, NULL, &tv) > 0;
+}
+
+// hands a received message to the interrupt task, which calls the Python callbacks
+STATIC void mod_mqtt_deliver_handler (void *arg);
+
+STATIC void mod_mqtt_inbox_push (mod_mqtt_conn_t *conn, uint8_t header, const uint8_t *topic, uint16_t topic_len,
+                                 uint16_t mid, const uint8_t *payload, uint32_t payload_len) {
+    if (conn->inbox_count >= MOD_MQTT_INBOX_MAX) {
+        conn->dropped++;
+        return;
+    }
+    mod_mqtt_msg_t *msg = malloc(sizeof(mod_mqtt_msg_t) + topic_len + payload_len);
+    if (msg == NULL) {
+        conn->dropped++;
+        return;
+    }
+    msg->next = NULL;
+    msg->payload_len = payload_len;
+    msg->topic_len = topic_len;
+    msg->mid = mid;
+    msg->header = header;
+    memcpy(msg->data, topic, topic_len);
+    memcpy(msg->data + topic_len, payload, payload_len);
+
+    portENTER_CRITICAL(&conn->inbox_mux);
+    if (conn->inbox_tail != NULL) {
+        conn->inbox_tail->next = msg;
+    } else {
+        conn->inbox = msg;
+    }
+    conn->inbox_tail = msg;
+    conn->inbox_count++;
+    portEXIT_CRITICAL(&conn->inbox_mux);
+
+    mp_irq_queue_interrupt_non_ISR(mod_mqtt_deliver_handler, conn->obj);
+}
+
+STATIC mod_mqtt_msg_t *mod_mqtt_inbox_pop (mod_mqtt_conn_t *conn) {
+    portENTER_CRITICAL(&conn->inbox_mux);
+    mod_mqtt_msg_t *msg = conn->inbox;
+    if (msg != NULL) {
+        conn->inbox = msg->next;
+        if (conn->inbox == NULL) {
+            conn->inbox_tail = NULL;
+        }
+        conn->inbox_count--;
+    }
+    portEXIT_CRITICAL(&conn->inbox_mux);
+    return msg;
+}
+
+// removes the packet waiting for an ack of the given type, returns it
+STATIC mod_mqtt_packet_t *mod_mqtt_inflight_find (mod_mqtt_conn_t *conn, uint8_t type, uint16_t mid, bool remove) {
+    for (mod_mqtt_packet_t **pp = &conn->inflight; *pp != NULL; pp = &(*pp)->next) {
+        mod_mqtt_packet_t *p = *pp;
+        if (p->mid == mid && (p->data[0] & 0xF0) == type) {
+            if (remove) {
+                *pp = p->next;
+                conn->inflight_count--;
+            }
+            return p;
+        }
+    }
+    return NULL;
+}
+
+STATIC bool mod_mqtt_handle_publish (mod_mqtt_conn_t *conn, uint8_t header, const uint8_t *body, uint32_t len) {
+    uint8_t qos = (header >> 1) & 0x03;
+    if (len < 2 || qos > 2) {
+        return false;
+    }
+    uint16_t topic_len = (body[0] << 8) | body[1];
+    uint32_t offset = 2 + topic_len + (qos ? 2 : 0);
+    if (offset > len || topic_len == 0) {
+        return false;
+    }
+    uint16_t mid = 0;
+    if (qos) {
+        mid = (body[2 + topic_len] << 8) | body[3 + topic_len];
+    }
+
+    if (qos == 1) {
+        if (!mod_mqtt_send_ack(conn, MQTT_PUBACK, mid)) {
+            return false;
+        }
+    } else if (qos == 2) {
+        if (!mod_mqtt_send_ack(conn, MQTT_PUBREC, mid)) {
+            return false;
+        }
+        // delivered only once, until the PUBREL
+        for (int i = 0; i < conn->qos2_count; i++) {
+            if (conn->qos2_mids[i] == mid) {
+                return true;
+            }
+        }
+        if (conn->qos2_count < MOD_MQTT_QOS2_MAX) {
+            conn->qos2_mids[conn->qos2_count++] = mid;
+        }
+    }
+    mod_mqtt_inbox_push(conn, header, body + 2, topic_len, mid, body + offset, len - offset);
+    return true;
+}
+
+STATIC bool mod_mqtt_handle (mod_mqtt_conn_t *conn, uint8_t header, const uint8_t *body, uint32_t len) {
+    uint8_t type = header & 0xF0;
+    if (type == MQTT_PUBLISH) {
+        return mod_mqtt_handle_publish(conn, header, body, len);
+    } else if (type == MQTT_PINGRESP) {
+        conn->ping_ms = 0;
+        return true;
+    }
+
+    // the rest carry a message id or the CONNACK flags and code
+    if (len < 2) {
+        return false;
+    }
+    uint16_t mid = (body[0] << 8) | body[1];
+    mod_mqtt_packet_t *p;
+    switch (type) {
+    case MQTT_CONNACK:
+        conn->ack_code = body[1];
+        conn->state = (body[1] == 0) ? MOD_MQTT_STATE_CONNECTED : MOD_MQTT_STATE_CLOSED;
+        xSemaphoreGive(conn->ack);
+        return conn->state == MOD_MQTT_STATE_CONNECTED;
+    case MQTT_PUBACK:
+        if ((p = mod_mqtt_inflight_find(conn, MQTT_PUBLISH, mid, true)) != NULL) {
+            free(p);
+        }
+        break;
+    case MQTT_PUBREC:
+        // the publication is replaced by its PUBREL, kept until the PUBCOMP
+        if ((p = mod_mqtt_inflight_find(conn, MQTT_PUBLISH, mid, false)) != NULL) {
+            p->data[0] = MQTT_PUBREL | 0x02;
+            p->data[1] = 2;
+            mod_mqtt_put_u16(&p->data[2], mid);
+            p->len = 4;
+            p->sent_ms = mod_mqtt_ms();
+        }
+        return mod_mqtt_send_ack(conn, MQTT_PUBREL | 0x02, mid);
+    case MQTT_PUBREL:
+        for (int i = 0; i < conn->qos2_count; i++) {
+            if (conn->qos2_mids[i] == mid) {
+                conn->qos2_mids[i] = conn->qos2_mids[--conn->qos2_count];
+                break;
+            }
+        }
+        return mod_mqtt_send_ack(conn, MQTT_PUBCOMP, mid);
+    case MQTT_PUBCOMP:
+        if ((p = mod_mqtt_inflight_find(conn, MQTT_PUBREL, mid, true)) != NULL) {
+            free(p);
+        }
+        break;
+    case MQTT_SUBACK:
+    case MQTT_UNSUBACK:
+        if (mid == conn->ack_mid) {
+            conn->ack_code = (type == MQTT_SUBACK && len > 2) ? body[2] : 0;
+            xSemaphoreGive(conn->ack);
+        }
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+STATIC bool mod_mqtt_receive (mod_mqtt_conn_t *conn) {
+    uint8_t header;
+    if (!mod_mqtt_readable(conn, MOD_MQTT_POLL_MS)) {
+        return true;
+    }
+    if (!mod_mqtt_recv(conn, &header, 1)) {
+        return false;
+    }
+    uint32_t len = 0;
+    for (int shift = 0; ; shift += 7) {
+        uint8_t b;
+        if (shift > 21 || !mod_mqtt_recv(conn, &b, 1)) {
+            return false;
+        }
+        len |= (b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            break;
+        }
+    }
+    if (len > MOD_MQTT_PACKET_MAX) {
+        return false;
+    }
+    uint8_t *body = malloc(len > 0 ? len : 1);
+    if (body == NULL) {
+        return false;
+    }
+    bool ok = mod_mqtt_recv(conn, body, len) && mod_mqtt_handle(conn, header, body, len);
+    free(body);
+    return ok;
+}
+
+STATIC void mod_mqtt_refill_handler (void *arg);
+
+// the next packet to send, what is queued goes before the backlog, which is only sent once connected
+STATIC mod_mqtt_packet_t *mod_mqtt_next (mod_mqtt_conn_t *conn, bool remove) {
+    mod_mqtt_packet_t *p;
+    if ((remove ? xQueueReceive(conn->out, &p, 0) : xQueuePeek(conn->out, &p, 0)) == pdTRUE) {
+        return p;
+    }
+    if (conn->state != MOD_MQTT_STATE_CONNECTED) {
+        return NULL;
+    }
+    mod_mqtt_session_t *s = conn->session;
+    mod_mqtt_list_t *list = &s->loaded;
+    bool refill = false;
+    portENTER_CRITICAL(&s->mux);
+    if (list->head == NULL) {
+        if (s->spilled > 0 || s->busy) {
+            // the newer publications wait for the rest of the spill file
+            refill = s->spilled > 0 && !s->busy && !s->refill;
+            s->refill |= refill;
+            list = NULL;
+        } else {
+            list = &s->ram;
+        }
+    }
+    p = (list != NULL) ? list->head : NULL;
+    if (p != NULL && remove) {
+        mod_mqtt_list_pop(list);
+        s->count--;
+        s->bytes -= p->len;
+    }
+    portEXIT_CRITICAL(&s->mux);
+    if (refill) {
+        mp_irq_queue_interrupt_non_ISR(mod_mqtt_refill_handler, conn->obj);
+    }
+    return p;
+}
+
+STATIC void mod_mqtt_sent (mod_mqtt_conn_t *conn, mod_mqtt_packet_t *p) {
+    if ((p->data[0] & 0xF0) == MQTT_PUBLISH) {
+        mod_mqtt_session_t *s = conn->session;
+        uint32_t latency = conn->tx_ms - p->queued_ms;
+        portENTER_CRITICAL(&s->mux);
+        s->sent++;
+        s->latency_sum += latency;
+        if (latency > s->latency_max) {
+            s->latency_max = latency;
+        }
+        portEXIT_CRITICAL(&s->mux);
+    }
+    if (p->qos > 0) {
+        p->sent_ms = conn->tx_ms;
+        p->next = conn->inflight;
+        conn->inflight = p;
+        conn->inflight_count++;
+    } else {
+        free(p);
+    }
+}
+
+STATIC bool mod_mqtt_send_batch (mod_mqtt_conn_t *conn, mod_mqtt_list_t *batch, uint32_t len) {
+    mod_mqtt_packet_t *p = batch->head;
+    bool ok;
+    if (p->next == NULL) {
+        ok = mod_mqtt_send(conn, p->data, p->len);
+    } else {
+        uint8_t *d = conn->batch;
+        for ( ; p != NULL; p = p->next) {
+            memcpy(d, p->data, p->len);
+            d += p->len;
+        }
+        ok = mod_mqtt_send(conn, conn->batch, len);
+    }
+    if (!ok) {
+        // back to the backlog when the connection is released
+        while ((p = mod_mqtt_list_pop(batch)) != NULL) {
+            mod_mqtt_list_append(&conn->unsent, p);
+        }
+        return false;
+    }
+    while ((p = mod_mqtt_list_pop(batch)) != NULL) {
+        mod_mqtt_sent(conn, p);
+    }
+    return true;
+}
+
+// the small packets are sent together, a socket write each would cost a TCP segment or a TLS record
+STATIC bool mod_mqtt_send_queued (mod_mqtt_conn_t *conn) {
+    mod_mqtt_list_t batch = { NULL, NULL };
+    uint32_t len = 0;
+    mod_mqtt_packet_t *p;
+    while ((p = mod_mqtt_next(conn, false)) != NULL) {
+        uint8_t type = p->data[0] & 0xF0;
+        if (type != MQTT_CONNECT && conn->state != MOD_MQTT_STATE_CONNECTED) {
+            break;
+        }
+        if (p->qos > 0 && conn->inflight_count >= MOD_MQTT_INFLIGHT_MAX) {
+            // the rest of the queue waits for acks, in order
+            break;
+        }
+        // the front of the queue could have changed since the peek
+        if ((p = mod_mqtt_next(conn, true)) == NULL) {
+            break;
+        }
+        type = p->data[0] & 0xF0;
+        if (len > 0 && len + p->len > MOD_MQTT_BATCH_SIZE) {
+            if (!mod_mqtt_send_batch(conn, &batch, len)) {
+                mod_mqtt_list_append(&conn->unsent, p);
+                return false;
+            }
+            len = 0;
+        }
+        mod_mqtt_list_append(&batch, p);
+        len += p->len;
+        if (type == MQTT_DISCONNECT) {
+            mod_mqtt_send_batch(conn, &batch, len);
+            return false;
+        }
+    }
+    return len == 0 || mod_mqtt_send_batch(conn, &batch, len);
+}
+
+STATIC bool mod_mqtt_check_timers (mod_mqtt_conn_t *conn) {
+    uint32_t now = mod_mqtt_ms();
+    if (conn->state != MOD_MQTT_STATE_CONNECTED) {
+        return true;
+    }
+    if (conn->keepalive_ms > 0) {
+        if (conn->ping_ms != 0) {
+            if (now - conn->ping_ms > conn->keepalive_ms) {
+                // no PINGRESP, the connection is lost
+                return false;
+            }
+        } else if (now - conn->tx_ms >= conn->keepalive_ms) {
+            uint8_t pkt[2] = { MQTT_PINGREQ, 0 };
+            if (!mod_mqtt_send(conn, pkt, sizeof(pkt))) {
+                return false;
+            }
+            conn->ping_ms = conn->tx_ms | 1;
+        }
+    }
+    for (mod_mqtt_packet_t *p = conn->inflight; p != NULL; p = p->next) {
+        if (now - p->sent_ms >= MOD_MQTT_RETRY_MS) {
+            if ((p->data[0] & 0xF0) == MQTT_PUBLISH) {
+                p->data[0] |= MQTT_FLAG_DUP;
+            }
+            if (!mod_mqtt_send(conn, p->data, p->len)) {
+                return false;
+            }
+            p->sent_ms = conn->tx_ms;
+        }
+    }
+    return true;
+}
+
+STATIC void mod_mqtt_closed_handler (void *arg);
+
+STATIC void TASK_MQTT (void *pvParameters) {
+    mod_mqtt_conn_t *conn = pvParameters;
+
+    while (!conn->stop && mod_mqtt_send_queued(conn) && mod_mqtt_receive(conn) && mod_mqtt_check_timers(conn));
+
+    conn->state = MOD_MQTT_STATE_CLOSED;
+    // wakes up connect() or subscribe()
+    xSemaphoreGive(conn->ack);
+    mp_irq_queue_interrupt_non_ISR(mod_mqtt_closed_handler, conn->obj);
+    conn->task = NULL;
+    vTaskDelete(NULL);
+}
+
+/******************************************************************************
+ INTERRUPT TASK HANDLERS
+ ******************************************************************************/
+STATIC mp_obj_t mod_mqtt_message (const mod_mqtt_msg_t *msg) {
+    mp_obj_t items[6] = {
+        mp_obj_new_bytes(msg->data, msg->topic_len),
+        mp_obj_new_bytes(msg->data + msg->topic_len, msg->payload_len),
+        MP_OBJ_NEW_SMALL_INT((msg->header >> 1) & 0x03),
+        mp_obj_new_bool(msg->header & MQTT_FLAG_RETAIN),
+        mp_obj_new_bool(msg->header & MQTT_FLAG_DUP),
+        MP_OBJ_NEW_SMALL_INT(msg->mid),
+    };
+    return mp_obj_new_attrtuple(mod_mqtt_message_fields, MP_ARRAY_SIZE(items), items);
+}
+
+STATIC void mod_mqtt_deliver_handler (void *arg) {
+    mod_mqtt_obj_t *self = arg;
+    mod_mqtt_msg_t *msg;
+    while (self->conn != NULL && (msg = mod_mqtt_inbox_pop(self->conn)) != NULL) {
+        mp_obj_t message;
+        nlr_buf_t nlr;
+        if (nlr_push(&nlr) == 0) {
+            message = mod_mqtt_message(msg);
+            nlr_pop();
+        } else {
+            free(msg);
+            nlr_jump(nlr.ret_val);
+        }
+        free(msg);
+
+        mp_obj_t topic = ((mp_obj_tuple_t *)MP_OBJ_TO_PTR(message))->items[0];
+        mp_buffer_info_t tbuf;
+        mp_get_buffer_raise(topic, &tbuf, MP_BUFFER_READ);
+        // a callback can subscribe or unsubscribe
+        for (size_t i = 0; ; i++) {
+            size_t len;
+            mp_obj_t *subs;
+            mp_obj_list_get(self->subs, &len, &subs);
+            if (i >= len) {
+                break;
+            }
+            mp_obj_t *sub = ((mp_obj_tuple_t *)MP_OBJ_TO_PTR(subs[i]))->items;
+            mp_buffer_info_t sbuf;
+            mp_get_buffer_raise(sub[0], &sbuf, MP_BUFFER_READ);
+            if (mod_mqtt_topic_matches(sbuf.buf, sbuf.len, tbuf.buf, tbuf.len)) {
+                mp_call_function_2(sub[1], self, message);
+            }
+        }
+    }
+}
+
+STATIC void mod_mqtt_closed_handler (void *arg) {
+    mod_mqtt_obj_t *self = arg;
+    mod_mqtt_conn_t *conn = self->conn;
+    bool lost = false;
+    if (conn != NULL && conn->state == MOD_MQTT_STATE_CLOSED) {
+        lost = !conn->stop && !conn->closing;
+        // the messages received before are still delivered
+        mod_mqtt_deliver_handler(self);
+        mod_mqtt_release(self, true);
+    }
+    mod_mqtt_unroot(self);
+    if (lost && self->handler != mp_const_none) {
+        mp_call_function_1(self->handler, self);
+    }
+}
+
+// a PUBLISH of the spill file, NULL at its end or if what follows isn't one
+STATIC mod_mqtt_packet_t *mod_mqtt_read_packet (mp_obj_t file) {
+    int _errno = 0;
+    uint8_t header;
+    if (mp_stream_read_exactly(file, &header, 1, &_errno) != 1 || (header & 0xF0) != MQTT_PUBLISH) {
+        return NULL;
+    }
+    uint32_t remaining = 0;
+    for (int shift = 0; ; shift += 7) {
+        uint8_t b;
+        if (shift > 21 || mp_stream_read_exactly(file, &b, 1, &_errno) != 1) {
+            return NULL;
+        }
+        remaining |= (b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            break;
+        }
+    }
+    uint8_t *body;
+    mod_mqtt_packet_t *p;
+    if (remaining > MOD_MQTT_PACKET_MAX || (p = mod_mqtt_packet_new(header, remaining, &body)) == NULL) {
+        return NULL;
+    }
+    if (mp_stream_read_exactly(file, body, remaining, &_errno) != remaining) {
+        free(p);
+        return NULL;
+    }
+    p->qos = (header >> 1) & 0x03;
+    return p;
+}
+
+STATIC void mod_mqtt_spill_remove (mod_mqtt_obj_t *self) {
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_vfs_remove(self->spill);
+        nlr_pop();
+    }
+    self->session.spill_offset = 0;
+}
+
+STATIC uint16_t mod_mqtt_next_mid (mod_mqtt_obj_t *self);
+
+// reads back the oldest part of the spill file, up to half of the RAM of the backlog
+STATIC void mod_mqtt_refill_handler (void *arg) {
+    mod_mqtt_obj_t *self = arg;
+    mod_mqtt_session_t *s = &self->session;
+    if (s->busy || s->spilled == 0) {
+        s->refill = false;
+        return;
+    }
+    s->busy = true;
+
+    // read after an exception too
+    mod_mqtt_list_t list = { NULL, NULL };
+    volatile uint32_t count = 0, bytes = 0;
+    volatile uint32_t offset = s->spill_offset;
+    bool end = true;
+    volatile mp_obj_t file = MP_OBJ_NULL;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t args[2] = { self->spill, MP_OBJ_NEW_QSTR(MP_QSTR_rb) };
+        file = mp_builtin_open(2, args, (mp_map_t *)&mp_const_empty_map);
+        struct mp_stream_seek_t seek = { .offset = offset, .whence = 0 };
+        int _errno;
+        const mp_stream_p_t *stream_p = mp_get_stream_raise(file, MP_STREAM_OP_IOCTL);
+        if (stream_p->ioctl(file, MP_STREAM_SEEK, (uintptr_t)&seek, &_errno) == MP_STREAM_ERROR) {
+            mp_raise_OSError(_errno);
+        }
+        mod_mqtt_packet_t *p = NULL;
+        while (bytes < s->max / 2 || count == 0) {
+            if ((p = mod_mqtt_read_packet(file)) == NULL) {
+                break;
+            }
+            offset += p->len;
+            // the ids of another boot could be in use
+            if (p->qos > 0) {
+                mod_mqtt_publish_set_mid(p, mod_mqtt_next_mid(self));
+            }
+            mod_mqtt_list_append(&list, p);
+            count++;
+            bytes += p->len;
+        }
+        end = (p == NULL);
+        mp_stream_close(file);
+        nlr_pop();
+    } else if (file != MP_OBJ_NULL) {
+        // unreadable, the rest of the file is lost
+        if (nlr_push(&nlr) == 0) {
+            mp_stream_close(file);
+            nlr_pop();
+        }
+    }
+
+    uint32_t consumed = offset - s->spill_offset;
+    portENTER_CRITICAL(&s->mux);
+    // after the requeued ones
+    mod_mqtt_list_prepend(&list, &s->loaded);
+    s->loaded = list;
+    s->count += count;
+    s->bytes += bytes;
+    s->spilled = (end || consumed >= s->spilled) ? 0 : s->spilled - consumed;
+    portEXIT_CRITICAL(&s->mux);
+    s->spill_offset = offset;
+    if (s->spilled == 0) {
+        mod_mqtt_spill_remove(self);
+    }
+    s->busy = false;
+    s->refill = false;
+}
+
+/******************************************************************************
+ PYTHON CONTEXT HELPERS
+ ******************************************************************************/
+// moves the publications kept in RAM to the end of the spill file, with the requeued ones if it's empty
+STATIC void mod_mqtt_spill (mod_mqtt_obj_t *self, bool all) {
+    mod_mqtt_session_t *s = &self->session;
+    mod_mqtt_list_t list = { NULL, NULL };
+    portENTER_CRITICAL(&s->mux);
+    if (!s->busy) {
+        if (all && s->spilled == 0) {
+            list = s->loaded;
+            s->loaded.head = s->loaded.tail = NULL;
+        }
+        mod_mqtt_list_prepend(&s->ram, &list);
+        list = s->ram;
+        s->ram.head = s->ram.tail = NULL;
+        for (mod_mqtt_packet_t *p = list.head; p != NULL; p = p->next) {
+            s->count--;
+            s->bytes -= p->len;
+        }
+        s->busy = (list.head != NULL);
+    }
+    portEXIT_CRITICAL(&s->mux);
+    if (list.head == NULL) {
+        return;
+    }
+
+    volatile mp_obj_t file = MP_OBJ_NULL;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t args[2] = { self->spill, MP_OBJ_NEW_QSTR(MP_QSTR_ab) };
+        file = mp_builtin_open(2, args, (mp_map_t *)&mp_const_empty_map);
+        mod_mqtt_packet_t *p;
+        while ((p = list.head) != NULL) {
+            if (s->spilled + p->len <= s->spill_max) {
+                int _errno = 0;
+                if (mp_stream_write_exactly(file, p->data, p->len, &_errno) != p->len) {
+                    mp_raise_OSError(_errno);
+                }
+                portENTER_CRITICAL(&s->mux);
+                s->spilled += p->len;
+                portEXIT_CRITICAL(&s->mux);
+            } else {
+                s->discarded++;
+            }
+            list.head = p->next;
+            free(p);
+        }
+        mp_stream_close(file);
+        nlr_pop();
+    } else {
+        // the file system is full or gone, the rest is lost
+        for (mod_mqtt_packet_t *p = list.head; p != NULL; p = p->next) {
+            s->discarded++;
+        }
+        mod_mqtt_free_packets(list.head);
+        if (file != MP_OBJ_NULL && nlr_push(&nlr) == 0) {
+            mp_stream_close(file);
+            nlr_pop();
+        }
+    }
+    s->busy = false;
+}
+
+// keeps the client alive while its task runs, or while its backlog waits for one
+STATIC bool mod_mqtt_root (mod_mqtt_obj_t *self) {
+    if (self->slot < 0) {
+        for (int i = 0; i < MOD_MQTT_CLIENTS_MAX; i++) {
+            if (MP_STATE_PORT(mod_mqtt_obj)[i] == MP_OBJ_NULL) {
+                MP_STATE_PORT(mod_mqtt_obj)[i] = self;
+                self->slot = i;
+                return true;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+STATIC void mod_mqtt_unroot (mod_mqtt_obj_t *self) {
+    if (self->conn == NULL && self->session.count == 0 && self->slot >= 0 &&
+        MP_STATE_PORT(mod_mqtt_obj)[self->slot] == self) {
+        MP_STATE_PORT(mod_mqtt_obj)[self->slot] = MP_OBJ_NULL;
+        self->slot = -1;
+    }
+}
+
+STATIC bool mod_mqtt_backlog_add (mod_mqtt_obj_t *self, mod_mqtt_packet_t *p) {
+    mod_mqtt_session_t *s = &self->session;
+    if (s->max > 0 && s->bytes + p->len > s->max && self->spill != mp_const_none) {
+        mod_mqtt_spill(self, false);
+    }
+    // over the limit only while the spill file is in use
+    if (s->max == 0 || (s->bytes + p->len > s->max && !s->busy) || !mod_mqtt_root(self)) {
+        free(p);
+        s->discarded++;
+        return false;
+    }
+    portENTER_CRITICAL(&s->mux);
+    mod_mqtt_list_append(&s->ram, p);
+    s->count++;
+    s->bytes += p->len;
+    portEXIT_CRITICAL(&s->mux);
+    return true;
+}
+
+STATIC void mod_mqtt_release (mod_mqtt_obj_t *self, bool close) {
+    mod_mqtt_conn_t *conn = self->conn;
+    if (conn == NULL) {
+        return;
+    }
+    conn->stop = true;
+    MP_THREAD_GIL_EXIT();
+    while (conn->task != NULL) {
+        vTaskDelay(1);
+    }
+    MP_THREAD_GIL_ENTER();
+    if (self->conn != conn) {
+        // released by another thread meanwhile
+        return;
+    }
+    self->conn = NULL;
+
+    // what wasn't sent, or wasn't acknowledged, goes back to the backlog before the rest of it
+    mod_mqtt_list_t back = { NULL, NULL };
+    mod_mqtt_packet_t *p;
+    while ((p = conn->inflight) != NULL) {
+        // the oldest is the last one
+        conn->inflight = p->next;
+        p->data[0] |= ((p->data[0] & 0xF0) == MQTT_PUBLISH) ? MQTT_FLAG_DUP : 0;
+        p->next = back.head;
+        back.head = p;
+        if (back.tail == NULL) {
+            back.tail = p;
+        }
+    }
+    while ((p = mod_mqtt_list_pop(&conn->unsent)) != NULL) {
+        mod_mqtt_list_append(&back, p);
+    }
+    while (xQueueReceive(conn->out, &p, 0) == pdTRUE) {
+        mod_mqtt_list_append(&back, p);
+    }
+    mod_mqtt_requeue(&self->session, &back);
+    mod_mqtt_msg_t *msg;
+    while ((msg = mod_mqtt_inbox_pop(conn)) != NULL) {
+        free(msg);
+    }
+    vQueueDelete(conn->out);
+    vSemaphoreDelete(conn->ack);
+    free(conn);
+
+    mp_obj_t sock = self->sock;
+    self->sock = mp_const_none;
+    if (close && sock != mp_const_none) {
+        mp_obj_t dest[2];
+        mp_load_method(sock, MP_QSTR_close, dest);
+        mp_call_method_n_kw(0, 0, dest);
+    }
+}
+
+STATIC bool mod_mqtt_wait_ack (mod_mqtt_conn_t *conn, uint32_t timeout_ms) {
+    MP_THREAD_GIL_EXIT();
+    bool acked = xSemaphoreTake(conn->ack, timeout_ms / portTICK_PERIOD_MS) == pdTRUE;
+    MP_THREAD_GIL_ENTER();
+    return acked;
+}
+
+// the packet is left to the caller if it can't be queued
+STATIC bool mod_mqtt_queue (mod_mqtt_obj_t *self, mod_mqtt_packet_t *p, bool priority) {
+    mod_mqtt_conn_t *conn = self->conn;
+    if (conn == NULL || conn->state == MOD_MQTT_STATE_CLOSED || conn->closing) {
+        return false;
+    }
+    BaseType_t queued = priority ? xQueueSendToFront(conn->out, &p, 0) : xQueueSendToBack(conn->out, &p, 0);
+    return queued == pdTRUE;
+}
+
+STATIC uint16_t mod_mqtt_next_mid (mod_mqtt_obj_t *self) {
+    // 0 isn't a valid message id
+    if (++self->mid == 0) {
+        self->mid = 1;
+    }
+    return self->mid;
+}
+
+STATIC mod_mqtt_conn_t *mod_mqtt_get_conn (mod_mqtt_obj_t *self) {
+    if (self->conn == NULL || self->conn->state != MOD_MQTT_STATE_CONNECTED) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+    return self->conn;
+}
+
+// sends a SUBSCRIBE or UNSUBSCRIBE and waits for its ack
+STATIC bool mod_mqtt_request (mod_mqtt_obj_t *self, mod_mqtt_packet_t *p) {
+    mod_mqtt_conn_t *conn = self->conn;
+    conn->ack_mid = p->mid;
+    xSemaphoreTake(conn->ack, 0);
+    if (!mod_mqtt_queue(self, p, true)) {
+        free(p);
+        return false;
+    }
+    return mod_mqtt_wait_ack(conn, self->timeout_ms) && self->conn == conn &&
+           conn->state == MOD_MQTT_STATE_CONNECTED && conn->ack_code != MQTT_SUBACK_FAILURE;
+}
+
+/******************************************************************************
+ DEFINE MQTT CLASS FUNCTIONS
+ ******************************************************************************/
+STATIC const mp_arg_t mod_mqtt_init_args[] = {
+    { MP_QSTR_client_id,                MP_ARG_REQUIRED | MP_ARG_OBJ, },
+    { MP_QSTR_user,                     MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    { MP_QSTR_password,                 MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    { MP_QSTR_keepalive,                MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0} },
+    { MP_QSTR_clean_session,            MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = true} },
+    { MP_QSTR_queue,                    MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = MOD_MQTT_QUEUE_DEF} },
+    { MP_QSTR_timeout,                  MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = MOD_MQTT_TIMEOUT_DEF} },
+    { MP_QSTR_backlog,                  MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 0} },
+    { MP_QSTR_spill,                    MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    { MP_QSTR_spill_size,               MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = MOD_MQTT_SPILL_SIZE_DEF} },
+};
+
+STATIC mp_obj_t mod_mqtt_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args) {
+    // parse args
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, all_args + n_args);
+    mp_arg_val_t args[MP_ARRAY_SIZE(mod_mqtt_init_args)];
+    mp_arg_parse_all(n_args, all_args, &kw_args, MP_ARRAY_SIZE(args), mod_mqtt_init_args, args);
+
+    if (args[3].u_int < 0 || args[3].u_int > 0xFFFF || args[5].u_int < 1 || args[6].u_int < 0 ||
+        args[7].u_int < 0 || args[9].u_int < 0 || (args[8].u_obj != mp_const_none && args[7].u_int == 0)) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    // checked here rather than when connecting
+    mp_obj_str_get_str(args[0].u_obj);
+    for (int i = 1; i <= 2; i++) {
+        if (args[i].u_obj != mp_const_none) {
+            mp_obj_str_get_str(args[i].u_obj);
+        }
+    }
+    if (args[8].u_obj != mp_const_none) {
+        mp_obj_str_get_str(args[8].u_obj);
+    }
+
+    mod_mqtt_obj_t *self = m_new_obj(mod_mqtt_obj_t);
+    self->base.type = &mod_mqtt_type;
+    self->client_id = args[0].u_obj;
+    self->user = args[1].u_obj;
+    self->password = args[2].u_obj;
+    self->sock = mp_const_none;
+    self->subs = mp_obj_new_list(0, NULL);
+    self->handler = mp_const_none;
+    self->conn = NULL;
+    self->keepalive = args[3].u_int;
+    self->clean_session = args[4].u_bool;
+    self->queue_len = args[5].u_int;
+    self->timeout_ms = args[6].u_int * 1000;
+    self->mid = 0;
+    self->slot = -1;
+
+    mod_mqtt_session_t *s = &self->session;
+    memset(s, 0, sizeof(*s));
+    s->max = args[7].u_int;
+    s->spill_max = args[9].u_int;
+    s->mux = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+    self->spill = args[8].u_obj;
+    if (self->spill != mp_const_none) {
+        // left by a previous boot, sent first
+        nlr_buf_t nlr;
+        if (nlr_push(&nlr) == 0) {
+            mp_obj_t stat = mp_vfs_stat(self->spill);
+            s->spilled = mp_obj_get_int(((mp_obj_tuple_t *)MP_OBJ_TO_PTR(stat))->items[6]);
+            nlr_pop();
+        }
+    }
+    return self;
+}
+
+STATIC mp_obj_t mod_mqtt_connect(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_sock,                 MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_timeout,              MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = MOD_MQTT_CONNECT_TIMEOUT_DEF} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    mod_mqtt_obj_t *self = pos_args[0];
+
+    // a connected stream socket of lwIP, or its SSL wrapper, that the task uses from now on
+    mp_obj_t sock = args[0].u_obj;
+    if (mp_obj_get_type(sock)->protocol != &socket_stream_p ||
+        ((mod_network_socket_obj_t *)sock)->sock_base.nic_type->n_send != lwipsocket_socket_send) {
+        mp_raise_TypeError(mpexception_num_type_invalid_arguments);
+    }
+    if (self->conn != NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+
+    if (!mod_mqtt_root(self)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_resource_not_avaliable));
+    }
+
+    // the CONNECT packet
+    size_t id_len, user_len = 0, password_len = 0;
+    const char *id = mp_obj_str_get_data(self->client_id, &id_len);
+    const char *user = NULL, *password = NULL;
+    uint8_t flags = self->clean_session ? 0x02 : 0x00;
+    if (self->user != mp_const_none) {
+        user = mp_obj_str_get_data(self->user, &user_len);
+        flags |= 0x80;
+    }
+    if (self->password != mp_const_none) {
+        password = mp_obj_str_get_data(self->password, &password_len);
+        flags |= 0x40;
+    }
+    uint8_t *d;
+    mod_mqtt_packet_t *p = mod_mqtt_packet_alloc(MQTT_CONNECT, 10 + 2 + id_len + (user ? 2 + user_len : 0) +
+                                                 (password ? 2 + password_len : 0), &d);
+    d = mod_mqtt_put_str(d, "MQTT", 4);
+    *d++ = 4;                   // protocol level of 3.1.1
+    *d++ = flags;
+    d = mod_mqtt_put_u16(d, self->keepalive);
+    d = mod_mqtt_put_str(d, id, id_len);
+    if (user) {
+        d = mod_mqtt_put_str(d, user, user_len);
+    }
+    if (password) {
+        d = mod_mqtt_put_str(d, password, password_len);
+    }
+
+    mod_mqtt_conn_t *conn = calloc(1, sizeof(mod_mqtt_conn_t));
+    if (conn == NULL || (conn->out = xQueueCreate(self->queue_len, sizeof(mod_mqtt_packet_t *))) == NULL ||
+        (conn->ack = xSemaphoreCreateBinary()) == NULL) {
+        if (conn != NULL) {
+            if (conn->out != NULL) {
+                vQueueDelete(conn->out);
+            }
+            free(conn);
+        }
+        free(p);
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    conn->obj = self;
+    conn->session = &self->session;
+    conn->sock = sock;
+    conn->inbox_mux = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+    conn->keepalive_ms = self->keepalive * 1000;
+    conn->tx_ms = mod_mqtt_ms();
+    conn->state = MOD_MQTT_STATE_CONNECTING;
+    xQueueSendToBack(conn->out, &p, 0);
+
+    // blocking reads with a timeout, the task only reads once select() tells there's something
+    int _errno;
+    lwipsocket_socket_settimeout(conn->sock, MOD_MQTT_IO_TIMEOUT_MS, &_errno);
+    self->sock = sock;
+    self->conn = conn;
+
+    // the handle is set before the task can run, it may be done and have cleared it by the time this returns
+    if (xTaskCreatePinnedToCore(TASK_MQTT, "MQTT", MOD_MQTT_STACK_SIZE / sizeof(StackType_t), conn,
+                                MOD_MQTT_TASK_PRIORITY, (TaskHandle_t *)&conn->task, 1) != pdPASS) {
+        conn->task = NULL;
+        mod_mqtt_release(self, false);
+        mod_mqtt_unroot(self);
+        mp_raise_OSError(MP_ENOMEM);
+    }
+
+    // the task gives the semaphore on CONNACK or if it fails
+    if (!mod_mqtt_wait_ack(conn, args[1].u_int * 1000) || self->conn != conn ||
+        conn->state != MOD_MQTT_STATE_CONNECTED) {
+        if (self->conn == conn) {
+            conn->closing = true;
+            mod_mqtt_release(self, true);
+        }
+        return mp_const_false;
+    }
+    return mp_const_true;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_mqtt_connect_obj, 2, mod_mqtt_connect);
+
+STATIC mp_obj_t mod_mqtt_isconnected(mp_obj_t self_in) {
+    mod_mqtt_obj_t *self = self_in;
+    return mp_obj_new_bool(self->conn != NULL && self->conn->state == MOD_MQTT_STATE_CONNECTED);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_mqtt_isconnected_obj, mod_mqtt_isconnected);
+
+STATIC mp_obj_t mod_mqtt_publish(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_topic,                MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_payload,              MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_qos,                  MP_ARG_INT,                   {.u_int = 0} },
+        { MP_QSTR_retain,               MP_ARG_BOOL,                  {.u_bool = false} },
+        { MP_QSTR_dup,                  MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_priority,             MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    mod_mqtt_obj_t *self = pos_args[0];
+
+    mp_buffer_info_t topic, payload;
+    mp_get_buffer_raise(args[0].u_obj, &topic, MP_BUFFER_READ);
+    mp_get_buffer_raise(args[1].u_obj, &payload, MP_BUFFER_READ);
+    mp_int_t qos = args[2].u_int;
+    if (qos < 0 || qos > 2 || topic.len == 0 || topic.len > 0xFFFF) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    // kept in the backlog while offline, if there's one
+    mod_mqtt_conn_t *conn = self->conn;
+    bool online = conn != NULL && conn->state == MOD_MQTT_STATE_CONNECTED && !conn->closing;
+    if (!online && self->session.max == 0) {
+        mod_mqtt_get_conn(self);
+    }
+
+    uint8_t header = MQTT_PUBLISH | (args[4].u_bool ? MQTT_FLAG_DUP : 0) | (qos << 1) |
+                     (args[3].u_bool ? MQTT_FLAG_RETAIN : 0);
+    uint8_t *d;
+    mod_mqtt_packet_t *p = mod_mqtt_packet_alloc(header, 2 + topic.len + (qos ? 2 : 0) + payload.len, &d);
+    d = mod_mqtt_put_str(d, topic.buf, topic.len);
+    if (qos) {
+        p->mid = mod_mqtt_next_mid(self);
+        p->qos = qos;
+        d = mod_mqtt_put_u16(d, p->mid);
+    }
+    memcpy(d, payload.buf, payload.len);
+    // the queue is only used once the backlog is sent, to keep the order
+    if (online && mod_mqtt_backlog_empty(&self->session) && mod_mqtt_queue(self, p, args[5].u_bool)) {
+        return mp_const_true;
+    }
+    return mp_obj_new_bool(mod_mqtt_backlog_add(self, p));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_mqtt_publish_obj, 3, mod_mqtt_publish);
+
+STATIC mp_obj_t mod_mqtt_subscribe(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_topic,                MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_qos,                  MP_ARG_INT,                   {.u_int = 0} },
+        { MP_QSTR_callback,             MP_ARG_OBJ,                   {.u_obj = mp_const_none} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    mod_mqtt_obj_t *self = pos_args[0];
+
+    mp_buffer_info_t topic;
+    mp_get_buffer_raise(args[0].u_obj, &topic, MP_BUFFER_READ);
+    mp_int_t qos = args[1].u_int;
+    if (qos < 0 || qos > 2 || topic.len == 0 || topic.len > 0xFFFF || !mp_obj_is_callable(args[2].u_obj)) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    mod_mqtt_get_conn(self);
+    // kept as bytes, like the topics of the messages they are matched with
+    mp_obj_t sub[2] = { mp_obj_new_bytes(topic.buf, topic.len), args[2].u_obj };
+    mp_obj_t entry = mp_obj_new_tuple(2, sub);
+
+    uint8_t *d;
+    mod_mqtt_packet_t *p = mod_mqtt_packet_alloc(MQTT_SUBSCRIBE | 0x02, 2 + 2 + topic.len + 1, &d);
+    p->mid = mod_mqtt_next_mid(self);
+    d = mod_mqtt_put_u16(d, p->mid);
+    d = mod_mqtt_put_str(d, topic.buf, topic.len);
+    *d = qos;
+    if (!mod_mqtt_request(self, p)) {
+        return mp_const_false;
+    }
+    mp_obj_list_append(self->subs, entry);
+    return mp_const_true;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_mqtt_subscribe_obj, 2, mod_mqtt_subscribe);
+
+STATIC mp_obj_t mod_mqtt_unsubscribe(mp_obj_t self_in, mp_obj_t topic_in) {
+    mod_mqtt_obj_t *self = self_in;
+    mp_buffer_info_t topic;
+    mp_get_buffer_raise(topic_in, &topic, MP_BUFFER_READ);
+    if (topic.len == 0 || topic.len > 0xFFFF) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    mod_mqtt_get_conn(self);
+
+    uint8_t *d;
+    mod_mqtt_packet_t *p = mod_mqtt_packet_alloc(MQTT_UNSUBSCRIBE | 0x02, 2 + 2 + topic.len, &d);
+    p->mid = mod_mqtt_next_mid(self);
+    d = mod_mqtt_put_u16(d, p->mid);
+    mod_mqtt_put_str(d, topic.buf, topic.len);
+    if (!mod_mqtt_request(self, p)) {
+        return mp_const_false;
+    }
+
+    // the callbacks of this exact filter aren't called anymore
+    bool removed = false;
+    mp_obj_list_t *subs = MP_OBJ_TO_PTR(self->subs);
+    for (size_t i = subs->len; i-- > 0; ) {
+        mp_buffer_info_t sbuf;
+        mp_get_buffer_raise(((mp_obj_tuple_t *)MP_OBJ_TO_PTR(subs->items[i]))->items[0], &sbuf, MP_BUFFER_READ);
+        if (sbuf.len == topic.len && memcmp(sbuf.buf, topic.buf, topic.len) == 0) {
+            mp_obj_list_remove(self->subs, subs->items[i]);
+            removed = true;
+        }
+    }
+    return mp_obj_new_bool(removed);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_mqtt_unsubscribe_obj, mod_mqtt_unsubscribe);
+
+STATIC mp_obj_t mod_mqtt_disconnect(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_force,                MP_ARG_BOOL,                  {.u_bool = false} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    mod_mqtt_obj_t *self = pos_args[0];
+
+    mod_mqtt_conn_t *conn = self->conn;
+    if (conn == NULL) {
+        return mp_const_none;
+    }
+    // unless forced, what is already queued is sent before the DISCONNECT
+    uint8_t *d;
+    mod_mqtt_packet_t *p = mod_mqtt_packet_alloc(MQTT_DISCONNECT, 0, &d);
+    bool queued = mod_mqtt_queue(self, p, args[0].u_bool);
+    conn->closing = true;
+    if (!queued) {
+        free(p);
+    } else {
+        uint32_t start = mod_mqtt_ms();
+        MP_THREAD_GIL_EXIT();
+        while (conn->task != NULL && mod_mqtt_ms() - start < self->timeout_ms) {
+            vTaskDelay(1);
+        }
+        MP_THREAD_GIL_ENTER();
+    }
+    mod_mqtt_release(self, true);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_mqtt_disconnect_obj, 1, mod_mqtt_disconnect);
+
+STATIC mp_obj_t mod_mqtt_callback(mp_obj_t self_in, mp_obj_t handler) {
+    mod_mqtt_obj_t *self = self_in;
+    if (handler != mp_const_none && !mp_obj_is_callable(handler)) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    self->handler = handler;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_mqtt_callback_obj, mod_mqtt_callback);
+
+STATIC mp_obj_t mod_mqtt_stats(mp_obj_t self_in) {
+    mod_mqtt_obj_t *self = self_in;
+    mod_mqtt_conn_t *conn = self->conn;
+    mod_mqtt_session_t *s = &self->session;
+    portENTER_CRITICAL(&s->mux);
+    uint32_t sent = s->sent;
+    uint64_t latency_sum = s->latency_sum;
+    uint32_t latency_max = s->latency_max;
+    portEXIT_CRITICAL(&s->mux);
+    mp_obj_t stats[9] = {
+        MP_OBJ_NEW_SMALL_INT(conn ? uxQueueMessagesWaiting(conn->out) : 0),
+        MP_OBJ_NEW_SMALL_INT(conn ? conn->inflight_count : 0),
+        mp_obj_new_int_from_uint(conn ? conn->dropped : 0),
+        mp_obj_new_int_from_uint(s->count),
+        mp_obj_new_int_from_uint(s->spilled),
+        mp_obj_new_int_from_uint(s->discarded),
+        mp_obj_new_int_from_uint(sent),
+        mp_obj_new_int_from_uint(sent ? (uint32_t)(latency_sum / sent) : 0),
+        mp_obj_new_int_from_uint(latency_max),
+    };
+    return mp_obj_new_attrtuple(mod_mqtt_stats_fields, MP_ARRAY_SIZE(stats), stats);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_mqtt_stats_obj, mod_mqtt_stats);
+
+STATIC mp_obj_t mod_mqtt_match(mp_obj_t sub_in, mp_obj_t topic_in) {
+    mp_buffer_info_t sub, topic;
+    mp_get_buffer_raise(sub_in, &sub, MP_BUFFER_READ);
+    mp_get_buffer_raise(topic_in, &topic, MP_BUFFER_READ);
+    return mp_obj_new_bool(mod_mqtt_topic_matches(sub.buf, sub.len, topic.buf, topic.len));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_mqtt_match_fun_obj, mod_mqtt_match);
+STATIC MP_DEFINE_CONST_STATICMETHOD_OBJ(mod_mqtt_match_obj, (mp_obj_t)&mod_mqtt_match_fun_obj);
+
+STATIC void mod_mqtt_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    mod_mqtt_obj_t *self = self_in;
+    mp_printf(print, "MQTT('%s', connected=%s)", mp_obj_str_get_str(self->client_id),
+              mp_obj_is_true(mod_mqtt_isconnected(self)) ? "True" : "False");
+}
+
+STATIC const mp_map_elem_t mod_mqtt_locals_dict_table[] = {
+    // instance methods
+    { MP_OBJ_NEW_QSTR(MP_QSTR_connect),             (mp_obj_t)&mod_mqtt_connect_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_isconnected),         (mp_obj_t)&mod_mqtt_isconnected_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_publish),             (mp_obj_t)&mod_mqtt_publish_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_subscribe),           (mp_obj_t)&mod_mqtt_subscribe_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_unsubscribe),         (mp_obj_t)&mod_mqtt_unsubscribe_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_disconnect),          (mp_obj_t)&mod_mqtt_disconnect_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_callback),            (mp_obj_t)&mod_mqtt_callback_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stats),               (mp_obj_t)&mod_mqtt_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_match),               (mp_obj_t)&mod_mqtt_match_obj },
+};
+STATIC MP_DEFINE_CONST_DICT(mod_mqtt_locals_dict, mod_mqtt_locals_dict_table);
+
+const mp_obj_type_t mod_mqtt_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_MQTT,
+    .print = mod_mqtt_print,
+    .make_new = mod_mqtt_make_new,
+    .locals_dict = (mp_obj_t)&mod_mqtt_locals_dict,
+};
@@ -54,6 +54,7 @@
 #endif
 
 #include "modmdns.h"
+#include "modmqtt.h"
 #ifdef PYETH_ENABLED
 #include "modeth.h"
 #endif
@@ -136,6 +137,12 @@ mp_obj_t mod_network_find_nic(const mod_network_socket_obj_t *s, const uint8_t *
             {
                 return nic;
             }
+#if (defined(GPY) || defined (FIPY))
+        } else if (s->sock_base.u.u_param.domain == AF_LTE) {
+            if (mp_obj_get_type(nic) == (mp_obj_type_t *)&mod_network_nic_type_lte_modem) {
+                return nic;
+            }
+#endif
         }
     }
     nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Network card not available"));
@@ -388,6 +395,7 @@ STATIC const mp_map_elem_t mp_module_network_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_Coap),                (mp_obj_t)&mod_coap },
 #endif
     { MP_OBJ_NEW_QSTR(MP_QSTR_MDNS),                (mp_obj_t)&mod_mdns },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_MQTT),                (mp_obj_t)&mod_mqtt_type },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_network_globals, mp_module_network_globals_table);
@@ -43,6 +43,7 @@
  DEFINE CONSTANTS
  ******************************************************************************/
 #define MOD_NETWORK_IPV4ADDR_BUF_SIZE             (4)
+#define MOD_NETWORK_SENDMSG_MAX_BUFS              (16)
 
 /******************************************************************************
  DEFINE TYPES
@@ -76,6 +77,8 @@ typedef struct _mod_network_nic_type_t {
     int (*n_recv)(struct _mod_network_socket_obj_t *socket, byte *buf, mp_uint_t len, int *_errno);
     int (*n_sendto)(struct _mod_network_socket_obj_t *socket, const byte *buf, mp_uint_t len, byte *ip, mp_uint_t port, int *_errno);
     int (*n_recvfrom)(struct _mod_network_socket_obj_t *socket, byte *buf, mp_uint_t len, byte *ip, mp_uint_t *port, int *_errno);
+    // optional, sends several buffers at once, to ip and port unless ip is NULL
+    int (*n_sendmsg)(struct _mod_network_socket_obj_t *socket, const mp_buffer_info_t *bufs, mp_uint_t count, byte *ip, mp_uint_t port, int *_errno);
     int (*n_setsockopt)(struct _mod_network_socket_obj_t *socket, mp_uint_t level, mp_uint_t opt, const void *optval, mp_uint_t optlen, int *_errno);
     int (*n_settimeout)(struct _mod_network_socket_obj_t *socket, mp_int_t timeout_ms, int *_errno);
     int (*n_ioctl)(struct _mod_network_socket_obj_t *socket, mp_uint_t request, mp_uint_t arg, int *_errno);
@@ -107,6 +110,7 @@ typedef struct _mod_network_socket_base_t {
     mod_network_sock_conn_status_t conn_status;
     int err;
     uint8_t domain;
+    uint32_t lora_deadline;                         // of the LoRaWAN uplinks in ms, 0 if they never expire
 } mod_network_socket_base_t;
 
 typedef struct _mod_network_socket_obj_t {
@@ -122,6 +126,7 @@ extern const mod_network_nic_type_t mod_network_nic_type_lora;
 extern const mod_network_nic_type_t mod_network_nic_type_bt;
 extern const mod_network_nic_type_t mod_network_nic_type_sigfox;
 extern const mod_network_nic_type_t mod_network_nic_type_lte;
+extern const mod_network_nic_type_t mod_network_nic_type_lte_modem;
 
 /******************************************************************************
  DECLARE FUNCTIONS
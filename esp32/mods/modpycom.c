@@ -39,6 +39,10 @@
 #include "modmachine.h"
 #include "esp32chipinfo.h"
 #include "modwlan.h"
+#include "modpycom_log.h"
+#include "modpycom_mmap.h"
+#include "modpycom_nvs.h"
+#include "modpycom_pktbuf.h"
 
 
 #include <string.h>
@@ -60,6 +64,8 @@ void modpycom_init0(void) {
     if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &pycom_nvs_handle) != ESP_OK) {
         mp_printf(&mp_plat_print, "Error while opening Pycom NVS name space\n");
     }
+    modpycom_nvs_init0(pycom_nvs_handle);
+    modpycom_pktbuf_init0();
     rmt_driver_install(RMT_CHANNEL_0, 1000, 0);
     if (updater_read_boot_info (&boot_info, &boot_info_offset) == false) {
         mp_printf(&mp_plat_print, "Error reading bootloader information!\n");
@@ -176,19 +182,50 @@ STATIC mp_obj_t mod_pycom_rgb_led (mp_uint_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_rgb_led_obj, 0,1,mod_pycom_rgb_led);
 
-STATIC mp_obj_t mod_pycom_ota_start (void) {
-    if (!updater_start()) {
+STATIC mp_obj_t mod_pycom_ota_start (size_t n_args, const mp_obj_t *args) {
+    if (!updater_async_start()) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
     }
+    // with an id the progress is saved, so that ota_resume(id) can continue it after a reset
+    if (n_args > 0 && args[0] != mp_const_none) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_READ);
+        if (bufinfo.len == 0 || bufinfo.len > UPDATER_CHECKPOINT_ID_MAX_LEN) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        updater_set_id(bufinfo.buf, bufinfo.len);
+    }
     return mp_const_none;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_pycom_ota_start_obj, mod_pycom_ota_start);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_ota_start_obj, 0, 1, mod_pycom_ota_start);
+
+STATIC mp_obj_t mod_pycom_ota_resume (mp_obj_t id) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(id, &bufinfo, MP_BUFFER_READ);
+    if (bufinfo.len == 0 || bufinfo.len > UPDATER_CHECKPOINT_ID_MAX_LEN) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+
+    // reads back the part already written to check it, which takes a while
+    MP_THREAD_GIL_EXIT();
+    int32_t offset = updater_async_resume(bufinfo.buf, bufinfo.len);
+    MP_THREAD_GIL_ENTER();
+    if (offset < 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+    return mp_obj_new_int(offset);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_pycom_ota_resume_obj, mod_pycom_ota_resume);
 
 STATIC mp_obj_t mod_pycom_ota_write (mp_obj_t data) {
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
 
-    if (!updater_write(bufinfo.buf, bufinfo.len)) {
+    // the chunk is copied and written to flash in the background, only waits when the flash is behind
+    MP_THREAD_GIL_EXIT();
+    bool ret = updater_async_write(bufinfo.buf, bufinfo.len);
+    MP_THREAD_GIL_ENTER();
+    if (!ret) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
     }
     return mp_const_none;
@@ -196,18 +233,25 @@ STATIC mp_obj_t mod_pycom_ota_write (mp_obj_t data) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_pycom_ota_write_obj, mod_pycom_ota_write);
 
 STATIC mp_obj_t mod_pycom_ota_finish (void) {
-    if (!updater_finish()) {
+    MP_THREAD_GIL_EXIT();
+    bool ret = updater_async_flush();
+    MP_THREAD_GIL_ENTER();
+    if (!ret || !updater_finish()) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
     }
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_pycom_ota_finish_obj, mod_pycom_ota_finish);
 
-STATIC mp_obj_t mod_pycom_ota_verify (void) {
-    bool ret_val = updater_verify();
+STATIC mp_obj_t mod_pycom_ota_verify (size_t n_args, const mp_obj_t *args) {
+    // by default the SHA256 computed while writing is checked, full=True reads the whole image again
+    bool full = (n_args > 0) ? mp_obj_is_true(args[0]) : false;
+    MP_THREAD_GIL_EXIT();
+    bool ret_val = updater_verify(full);
+    MP_THREAD_GIL_ENTER();
     return mp_obj_new_bool(ret_val);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_pycom_ota_verify_obj, mod_pycom_ota_verify);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_ota_verify_obj, 0, 1, mod_pycom_ota_verify);
 
 STATIC mp_obj_t mod_pycom_ota_slot (void) {
     int ota_slot = updater_ota_next_slot_address();
@@ -268,102 +312,6 @@ STATIC mp_obj_t mod_pycom_pulses_get (mp_obj_t gpio, mp_obj_t timeout) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_pycom_pulses_get_obj, mod_pycom_pulses_get);
 
 
-STATIC mp_obj_t mod_pycom_nvs_set (mp_obj_t _key, mp_obj_t _value) {
-
-    const char *key = mp_obj_str_get_str(_key);
-    esp_err_t esp_err = ESP_OK;
-
-    if (MP_OBJ_IS_STR_OR_BYTES(_value)) {
-        const char *value = mp_obj_str_get_str(_value);
-        if (strlen(value) >= 1984) {
-            // Maximum length (including null character) can be 1984 bytes
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "value too long (max: 1984)"));
-        }
-        esp_err = nvs_set_str(pycom_nvs_handle, key, value);
-    } else if(MP_OBJ_IS_INT(_value)) {
-        uint32_t value = mp_obj_get_int_truncated(_value);
-        esp_err = nvs_set_u32(pycom_nvs_handle, key, value);
-    } else {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Value must be string, bytes or integer"));
-    }
-
-    if (ESP_OK == esp_err) {
-        nvs_commit(pycom_nvs_handle);
-    } else if (ESP_ERR_NVS_NOT_ENOUGH_SPACE == esp_err || ESP_ERR_NVS_PAGE_FULL == esp_err || ESP_ERR_NVS_NO_FREE_PAGES == esp_err) {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "No free space available"));
-    } else if (ESP_ERR_NVS_INVALID_NAME == esp_err) {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Key is invalid"));
-    } else if (ESP_ERR_NVS_KEY_TOO_LONG == esp_err) {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Key is too long"));
-    } else {
-        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_Exception, "Error occurred while storing value, code: %d", esp_err));
-    }
-    return mp_const_none;
-}
-STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_pycom_nvs_set_obj, mod_pycom_nvs_set);
-
-STATIC mp_obj_t mod_pycom_nvs_get (mp_uint_t n_args, const mp_obj_t *args) {
-
-    const char *key = mp_obj_str_get_str(args[0]);
-    esp_err_t esp_err = ESP_OK;
-    mp_obj_t ret = mp_const_none;
-    uint32_t value;
-
-    esp_err = nvs_get_u32(pycom_nvs_handle, key, &value);
-    if (esp_err == ESP_OK) {
-        ret = mp_obj_new_int(value);
-    }
-    else {
-        esp_err = nvs_get_str(pycom_nvs_handle, key, NULL, &value);
-        if(esp_err == ESP_OK) {
-            char* value_string = (char*)malloc(value);
-
-            esp_err = nvs_get_str(pycom_nvs_handle, key, value_string, &value);
-
-            if(esp_err == ESP_OK) {
-                //do not count the terminating \0
-                ret = mp_obj_new_str(value_string, value-1);
-            }
-            free(value_string);
-        }
-    }
-
-    if(esp_err == ESP_ERR_NVS_NOT_FOUND) {
-        if (n_args > 1) {
-            // return user defined NoExistValue
-            return args[1];
-        }
-        else
-        {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "No matching object for the provided key"));
-        }
-    } else if(esp_err != ESP_OK) {
-        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_Exception, "Error occurred while fetching value, code: %d", esp_err));
-    }
-
-    return ret;
-}
-STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_nvs_get_obj, 1, 2, mod_pycom_nvs_get);
-
-STATIC mp_obj_t mod_pycom_nvs_erase (mp_obj_t _key) {
-    const char *key = mp_obj_str_get_str(_key);
-
-    if (ESP_ERR_NVS_NOT_FOUND == nvs_erase_key(pycom_nvs_handle, key)) {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_KeyError, "key not found"));
-    }
-    return mp_const_none;
-}
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_pycom_nvs_erase_obj, mod_pycom_nvs_erase);
-
-STATIC mp_obj_t mod_pycom_nvs_erase_all (void) {
-    if (ESP_OK != nvs_erase_all(pycom_nvs_handle)) {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
-    }
-    nvs_commit(pycom_nvs_handle);
-    return mp_const_none;
-}
-STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_pycom_nvs_erase_all_obj, mod_pycom_nvs_erase_all);
-
 STATIC mp_obj_t mod_pycom_wifi_on_boot (mp_uint_t n_args, const mp_obj_t *args) {
     if (n_args == 0) {
         return mp_obj_new_bool(config_get_wifi_on_boot());
@@ -382,6 +330,37 @@ STATIC mp_obj_t mod_pycom_wifi_on_boot (mp_uint_t n_args, const mp_obj_t *args)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_wifi_on_boot_obj, 0, 2, mod_pycom_wifi_on_boot);
 
+// The boot profile is used from the next boot, see mptask.c for what the lazy one defers
+STATIC mp_obj_t mod_pycom_lazy_boot (mp_uint_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        uint32_t lazy;
+        if (nvs_get_u32(pycom_nvs_handle, MPTASK_LAZY_BOOT_KEY, &lazy) != ESP_OK) {
+            lazy = 0;
+        }
+        return mp_obj_new_bool(lazy != 0);
+    }
+    if (nvs_set_u32(pycom_nvs_handle, MPTASK_LAZY_BOOT_KEY, mp_obj_is_true(args[0])) != ESP_OK
+        || nvs_commit(pycom_nvs_handle) != ESP_OK) {
+        mp_raise_msg(&mp_type_OSError, mpexception_os_operation_failed);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_lazy_boot_obj, 0, 1, mod_pycom_lazy_boot);
+
+// Returns the time of the boot phases in us since the power on, None for the ones not reached yet
+STATIC mp_obj_t mod_pycom_boot_times (void) {
+    static const qstr names[MPTASK_BOOT_NUM_PHASES] = {
+        MP_QSTR_start, MP_QSTR_mp_init, MP_QSTR_drivers, MP_QSTR_fs, MP_QSTR_boot_py, MP_QSTR_main_py
+    };
+    mp_obj_t times = mp_obj_new_dict(MPTASK_BOOT_NUM_PHASES);
+    for (mptask_boot_phase_t phase = 0; phase < MPTASK_BOOT_NUM_PHASES; phase++) {
+        int64_t t = mptask_get_boot_time(phase);
+        mp_obj_dict_store(times, MP_OBJ_NEW_QSTR(names[phase]), t ? mp_obj_new_int_from_ll(t) : mp_const_none);
+    }
+    return times;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_pycom_boot_times_obj, mod_pycom_boot_times);
+
 STATIC mp_obj_t mod_pycom_wifi_mode (mp_uint_t n_args, const mp_obj_t *args) {
     uint8_t mode;
     if (n_args) {
@@ -1065,6 +1044,7 @@ STATIC const mp_map_elem_t pycom_module_globals_table[] = {
         { MP_OBJ_NEW_QSTR(MP_QSTR_heartbeat),                       (mp_obj_t)&mod_pycom_heartbeat_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_rgbled),                          (mp_obj_t)&mod_pycom_rgb_led_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_ota_start),                       (mp_obj_t)&mod_pycom_ota_start_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_ota_resume),                      (mp_obj_t)&mod_pycom_ota_resume_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_ota_write),                       (mp_obj_t)&mod_pycom_ota_write_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_ota_finish),                      (mp_obj_t)&mod_pycom_ota_finish_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_ota_verify),                      (mp_obj_t)&mod_pycom_ota_verify_obj },
@@ -1075,7 +1055,12 @@ STATIC const mp_map_elem_t pycom_module_globals_table[] = {
         { MP_OBJ_NEW_QSTR(MP_QSTR_nvs_get),                         (mp_obj_t)&mod_pycom_nvs_get_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_nvs_erase),                       (mp_obj_t)&mod_pycom_nvs_erase_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_nvs_erase_all),                   (mp_obj_t)&mod_pycom_nvs_erase_all_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_nvs_flush),                       (mp_obj_t)&mod_pycom_nvs_flush_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_nvs_flush_interval),              (mp_obj_t)&mod_pycom_nvs_flush_interval_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_nvs_keys),                        (mp_obj_t)&mod_pycom_nvs_keys_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_wifi_on_boot),                    (mp_obj_t)&mod_pycom_wifi_on_boot_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_lazy_boot),                       (mp_obj_t)&mod_pycom_lazy_boot_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_boot_times),                      (mp_obj_t)&mod_pycom_boot_times_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_wdt_on_boot),                     (mp_obj_t)&mod_pycom_wdt_on_boot_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_wdt_on_boot_timeout),             (mp_obj_t)&mod_pycom_wdt_on_boot_timeout_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_heartbeat_on_boot),               (mp_obj_t)&mod_pycom_heartbeat_on_boot_obj },
@@ -1106,12 +1091,23 @@ STATIC const mp_map_elem_t pycom_module_globals_table[] = {
 
 #endif //(VARIANT == PYBYTES)
         { MP_OBJ_NEW_QSTR(MP_QSTR_bootmgr),                         (mp_obj_t)&mod_pycom_bootmgr_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_Log),                             (mp_obj_t)&pycom_log_type },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_mmap),                            (mp_obj_t)&pycom_mmap_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_freeze_mpy),                      (mp_obj_t)&pycom_freeze_mpy_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_pktbuf),                          (mp_obj_t)&pycom_pktbuf_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_PktBuf),                          (mp_obj_t)&pycom_pktbuf_type },
 
         // class constants
         { MP_OBJ_NEW_QSTR(MP_QSTR_FACTORY),                         MP_OBJ_NEW_SMALL_INT(0) },
         { MP_OBJ_NEW_QSTR(MP_QSTR_OTA_0),                           MP_OBJ_NEW_SMALL_INT(1) },
         { MP_OBJ_NEW_QSTR(MP_QSTR_FAT),                           MP_OBJ_NEW_SMALL_INT(0) },
         { MP_OBJ_NEW_QSTR(MP_QSTR_LittleFS),                        MP_OBJ_NEW_SMALL_INT(1) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_PKTBUF_LORA),                     MP_OBJ_NEW_SMALL_INT(PKTBUF_OWNER_LORA) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_PKTBUF_SIGFOX),                   MP_OBJ_NEW_SMALL_INT(PKTBUF_OWNER_SIGFOX) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_PKTBUF_BT),                       MP_OBJ_NEW_SMALL_INT(PKTBUF_OWNER_BT) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_PKTBUF_LTE),                      MP_OBJ_NEW_SMALL_INT(PKTBUF_OWNER_LTE) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_PKTBUF_ETH),                      MP_OBJ_NEW_SMALL_INT(PKTBUF_OWNER_ETH) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_PKTBUF_WLAN),                     MP_OBJ_NEW_SMALL_INT(PKTBUF_OWNER_WLAN) },
 
 };
 
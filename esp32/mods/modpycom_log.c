@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "py/mpconfig.h"
+#include "py/obj.h"
+#include "py/runtime.h"
+#include "py/mperrno.h"
+#include "lib/oofatfs/ff.h"
+#include "extmod/vfs.h"
+#include "extmod/vfs_fat.h"
+
+#include "lfs.h"
+#include "vfs_littlefs.h"
+#include "modpycom_log.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+/* A log is kept in two segment files (<path>.0 and <path>.1) on LittleFS. Records are only ever appended to
+ * the newer segment, which is a plain append in LittleFS programming just the touched flash pages.
+ * When the newer segment is full the older one is truncated and becomes the newer one, so between
+ * max_records and 2 * max_records of the latest records are kept.
+ * Discarded records are remembered in an attribute of the segment, the data is not rewritten. */
+#define PYCOM_LOG_SEGMENTS                  (2)
+#define PYCOM_LOG_MAGIC                     (0x474f4c50) // "PLOG"
+#define LFS_ATTRIBUTE_LOG_CONSUMED          ((uint8_t)2)
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t record_size;
+} pycom_log_header_t;
+
+typedef struct {
+    lfs_file_t fp;
+    char *path;
+    uint32_t seq;
+    uint32_t records;   // Number of records appended to the segment
+    uint32_t consumed;  // Number of records discarded from the start of the segment
+} pycom_log_segment_t;
+
+typedef struct {
+    mp_obj_base_t base;
+    vfs_lfs_struct_t *littlefs;
+    pycom_log_segment_t seg[PYCOM_LOG_SEGMENTS];
+    uint32_t record_size;
+    uint32_t max_records;
+    uint8_t active;
+    bool open;
+} pycom_log_obj_t;
+
+typedef struct {
+    mp_obj_base_t base;
+    mp_fun_1_t iternext;
+    pycom_log_obj_t *log;
+    uint32_t index;
+} pycom_log_it_t;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC void pycom_log_check_res(int res) {
+    if (res < LFS_ERR_OK) {
+        mp_raise_OSError(littleFsErrorToErrno(res));
+    }
+}
+
+STATIC pycom_log_obj_t *pycom_log_get(mp_obj_t self_in) {
+    pycom_log_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (!self->open) {
+        mp_raise_OSError(MP_EBADF);
+    }
+    return self;
+}
+
+STATIC uint32_t pycom_log_count(pycom_log_obj_t *self) {
+    uint32_t count = 0;
+    for (int i = 0; i < PYCOM_LOG_SEGMENTS; i++) {
+        count += self->seg[i].records - self->seg[i].consumed;
+    }
+    return count;
+}
+
+// Empties the segment, must be called with the lock held
+STATIC int pycom_log_segment_reset(pycom_log_obj_t *self, pycom_log_segment_t *seg, uint32_t seq) {
+    lfs_t *lfs = &self->littlefs->lfs;
+    pycom_log_header_t header = { .magic = PYCOM_LOG_MAGIC, .seq = seq, .record_size = self->record_size };
+
+    int res = lfs_file_truncate(lfs, &seg->fp, 0);
+    if (res >= LFS_ERR_OK) {
+        res = lfs_file_rewind(lfs, &seg->fp);
+    }
+    if (res >= LFS_ERR_OK) {
+        res = lfs_file_write(lfs, &seg->fp, &header, sizeof(header));
+    }
+    if (res >= LFS_ERR_OK) {
+        res = lfs_file_sync(lfs, &seg->fp);
+    }
+    if (res >= LFS_ERR_OK) {
+        seg->seq = seq;
+        seg->records = 0;
+        seg->consumed = 0;
+        res = lfs_setattr(lfs, seg->path, LFS_ATTRIBUTE_LOG_CONSUMED, &seg->consumed, sizeof(seg->consumed));
+    }
+    return res;
+}
+
+// Opens the segment and recovers its state, must be called with the lock held
+STATIC int pycom_log_segment_open(pycom_log_obj_t *self, pycom_log_segment_t *seg) {
+    lfs_t *lfs = &self->littlefs->lfs;
+    pycom_log_header_t header;
+
+    int res = lfs_file_open(lfs, &seg->fp, seg->path, LFS_O_RDWR | LFS_O_CREAT);
+    littlefs_import_cache_invalidate(self->littlefs);
+    if (res < LFS_ERR_OK) {
+        return res;
+    }
+
+    lfs_soff_t size = lfs_file_size(lfs, &seg->fp);
+    if (size < (lfs_soff_t)sizeof(header)
+        || lfs_file_read(lfs, &seg->fp, &header, sizeof(header)) != (lfs_ssize_t)sizeof(header)
+        || header.magic != PYCOM_LOG_MAGIC) {
+        // New (or unusable) segment
+        res = pycom_log_segment_reset(self, seg, 0);
+    } else if (header.record_size != self->record_size) {
+        res = LFS_ERR_INVAL;
+    } else {
+        seg->seq = header.seq;
+        seg->records = (size - sizeof(header)) / self->record_size;
+        // Drop a record which was only partially written when the power was lost
+        lfs_off_t end = sizeof(header) + seg->records * self->record_size;
+        if (end != (lfs_off_t)size) {
+            res = lfs_file_truncate(lfs, &seg->fp, end);
+        }
+        if (lfs_getattr(lfs, seg->path, LFS_ATTRIBUTE_LOG_CONSUMED, &seg->consumed, sizeof(seg->consumed)) != (lfs_ssize_t)sizeof(seg->consumed)
+            || seg->consumed > seg->records) {
+            seg->consumed = 0;
+        }
+    }
+
+    if (res < LFS_ERR_OK) {
+        lfs_file_close(lfs, &seg->fp);
+    }
+    return res;
+}
+
+STATIC void pycom_log_close_helper(pycom_log_obj_t *self) {
+    if (!self->open) {
+        return;
+    }
+    self->open = false;
+    littlefs_lock(self->littlefs);
+        for (int i = 0; i < PYCOM_LOG_SEGMENTS; i++) {
+            lfs_file_close(&self->littlefs->lfs, &self->seg[i].fp);
+        }
+    littlefs_unlock(self->littlefs);
+    for (int i = 0; i < PYCOM_LOG_SEGMENTS; i++) {
+        free(self->seg[i].path);
+        self->seg[i].path = NULL;
+    }
+}
+
+// Reads count records starting from index (counted from the oldest one), must be called with the lock held
+STATIC int pycom_log_read_helper(pycom_log_obj_t *self, uint32_t index, uint32_t count, byte *buf) {
+    lfs_t *lfs = &self->littlefs->lfs;
+    // Oldest first
+    for (int i = 0; i < PYCOM_LOG_SEGMENTS && count > 0; i++) {
+        pycom_log_segment_t *seg = &self->seg[(self->active + 1 + i) % PYCOM_LOG_SEGMENTS];
+        uint32_t available = seg->records - seg->consumed;
+        if (index >= available) {
+            index -= available;
+            continue;
+        }
+        uint32_t n = MIN(count, available - index);
+        lfs_off_t off = sizeof(pycom_log_header_t) + (seg->consumed + index) * self->record_size;
+        lfs_size_t size = n * self->record_size;
+        int res = lfs_file_seek(lfs, &seg->fp, off, LFS_SEEK_SET);
+        if (res >= LFS_ERR_OK) {
+            res = lfs_file_read(lfs, &seg->fp, buf, size);
+        }
+        if (res < LFS_ERR_OK) {
+            return res;
+        } else if (res != (int)size) {
+            return LFS_ERR_CORRUPT;
+        }
+        buf += size;
+        count -= n;
+        index = 0;
+    }
+    return LFS_ERR_OK;
+}
+
+STATIC mp_obj_t pycom_log_read_records(pycom_log_obj_t *self, uint32_t index, uint32_t count) {
+    vstr_t vstr;
+    vstr_init_len(&vstr, count * self->record_size);
+    littlefs_lock(self->littlefs);
+        int res = pycom_log_read_helper(self, index, count, (byte *)vstr.buf);
+    littlefs_unlock(self->littlefs);
+    if (res < LFS_ERR_OK) {
+        vstr_clear(&vstr);
+        pycom_log_check_res(res);
+    }
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+
+STATIC mp_obj_t pycom_log_it_iternext(mp_obj_t self_in) {
+    pycom_log_it_t *self = MP_OBJ_TO_PTR(self_in);
+    pycom_log_obj_t *log = pycom_log_get(self->log);
+    if (self->index >= pycom_log_count(log)) {
+        return MP_OBJ_STOP_ITERATION;
+    }
+    return pycom_log_read_records(log, self->index++, 1);
+}
+
+/******************************************************************************/
+// Micro Python bindings
+
+STATIC mp_obj_t pycom_log_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
+    enum { ARG_path, ARG_record_size, ARG_max_records };
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_path,             MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_record_size,      MP_ARG_REQUIRED | MP_ARG_INT, },
+        { MP_QSTR_max_records,      MP_ARG_REQUIRED | MP_ARG_INT, },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[ARG_record_size].u_int <= 0 || args[ARG_max_records].u_int <= 0) {
+        mp_raise_ValueError("record_size and max_records must be positive");
+    }
+
+    const char *path = mp_obj_str_get_str(args[ARG_path].u_obj);
+    const char *path_out;
+    mp_vfs_mount_t *vfs = mp_vfs_lookup_path(path, &path_out);
+    if (vfs == MP_VFS_NONE || vfs == MP_VFS_ROOT || mp_obj_get_type(vfs->obj) != &mp_littlefs_vfs_type) {
+        mp_raise_ValueError("path must be on a LittleFS file system");
+    }
+
+    pycom_log_obj_t *self = m_new_obj_with_finaliser(pycom_log_obj_t);
+    memset(self, 0, sizeof(*self));
+    self->base.type = type;
+    self->littlefs = &((fs_user_mount_t *)MP_OBJ_TO_PTR(vfs->obj))->fs.littlefs;
+    self->record_size = args[ARG_record_size].u_int;
+    self->max_records = args[ARG_max_records].u_int;
+
+    const char *base_path = concat_with_cwd(self->littlefs, path_out);
+    if (base_path == NULL) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    for (int i = 0; i < PYCOM_LOG_SEGMENTS; i++) {
+        self->seg[i].path = malloc(strlen(base_path) + 3);
+        if (self->seg[i].path != NULL) {
+            sprintf(self->seg[i].path, "%s.%d", base_path, i);
+        }
+    }
+    free((void *)base_path);
+    if (self->seg[0].path == NULL || self->seg[1].path == NULL) {
+        free(self->seg[0].path);
+        free(self->seg[1].path);
+        mp_raise_OSError(MP_ENOMEM);
+    }
+
+    littlefs_lock(self->littlefs);
+        int res = pycom_log_segment_open(self, &self->seg[0]);
+        if (res >= LFS_ERR_OK) {
+            res = pycom_log_segment_open(self, &self->seg[1]);
+            if (res < LFS_ERR_OK) {
+                lfs_file_close(&self->littlefs->lfs, &self->seg[0].fp);
+            }
+        }
+        if (res >= LFS_ERR_OK) {
+            if (self->seg[0].seq == 0 && self->seg[1].seq == 0) {
+                // Brand new log
+                res = pycom_log_segment_reset(self, &self->seg[0], 1);
+            }
+            self->active = (self->seg[0].seq >= self->seg[1].seq) ? 0 : 1;
+            self->open = true;
+        }
+    littlefs_unlock(self->littlefs);
+
+    if (!self->open) {
+        free(self->seg[0].path);
+        free(self->seg[1].path);
+        if (res == LFS_ERR_INVAL) {
+            mp_raise_ValueError("record_size doesn't match the existing log");
+        }
+        pycom_log_check_res(res);
+    } else if (res < LFS_ERR_OK) {
+        pycom_log_close_helper(self);
+        pycom_log_check_res(res);
+    }
+    return MP_OBJ_FROM_PTR(self);
+}
+
+// Appends one or more records, their data must be given in a single buffer
+STATIC mp_obj_t pycom_log_append(mp_obj_t self_in, mp_obj_t data) {
+    pycom_log_obj_t *self = pycom_log_get(self_in);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+    if (bufinfo.len == 0 || (bufinfo.len % self->record_size) != 0) {
+        mp_raise_ValueError("length must be a multiple of record_size");
+    }
+
+    lfs_t *lfs = &self->littlefs->lfs;
+    const byte *buf = bufinfo.buf;
+    uint32_t count = bufinfo.len / self->record_size;
+    int res = LFS_ERR_OK;
+
+    littlefs_lock(self->littlefs);
+        while (count > 0 && res >= LFS_ERR_OK) {
+            pycom_log_segment_t *seg = &self->seg[self->active];
+            if (seg->records >= self->max_records) {
+                // Overwrite the oldest segment
+                uint8_t next = (self->active + 1) % PYCOM_LOG_SEGMENTS;
+                res = pycom_log_segment_reset(self, &self->seg[next], seg->seq + 1);
+                if (res >= LFS_ERR_OK) {
+                    self->active = next;
+                }
+                continue;
+            }
+            uint32_t n = MIN(count, self->max_records - seg->records);
+            lfs_size_t size = n * self->record_size;
+            res = lfs_file_seek(lfs, &seg->fp, 0, LFS_SEEK_END);
+            if (res >= LFS_ERR_OK) {
+                res = lfs_file_write(lfs, &seg->fp, buf, size);
+                if (res >= LFS_ERR_OK && res != (int)size) {
+                    res = LFS_ERR_NOSPC;
+                }
+            }
+            if (res >= LFS_ERR_OK) {
+                seg->records += n;
+                buf += size;
+                count -= n;
+            }
+        }
+        if (res >= LFS_ERR_OK) {
+            res = lfs_file_sync(lfs, &self->seg[self->active].fp);
+        }
+    littlefs_unlock(self->littlefs);
+
+    pycom_log_check_res(res);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(pycom_log_append_obj, pycom_log_append);
+
+// Returns count records starting from index (0 is the oldest one) in a single bytes object
+STATIC mp_obj_t pycom_log_read(size_t n_args, const mp_obj_t *args) {
+    pycom_log_obj_t *self = pycom_log_get(args[0]);
+    mp_int_t index = mp_obj_get_int(args[1]);
+    mp_int_t count = (n_args > 2) ? mp_obj_get_int(args[2]) : 1;
+    uint32_t available = pycom_log_count(self);
+    if (index < 0 || count < 0 || (uint32_t)index > available || (uint32_t)count > available - index) {
+        mp_raise_msg(&mp_type_IndexError, "record index out of range");
+    }
+    return pycom_log_read_records(self, index, count);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(pycom_log_read_obj, 2, 3, pycom_log_read);
+
+// Drops the oldest count records (all of them by default), e.g.: after they have been sent
+STATIC mp_obj_t pycom_log_discard(size_t n_args, const mp_obj_t *args) {
+    pycom_log_obj_t *self = pycom_log_get(args[0]);
+    uint32_t count = pycom_log_count(self);
+    if (n_args > 1) {
+        mp_int_t n = mp_obj_get_int(args[1]);
+        if (n < 0) {
+            mp_raise_ValueError(NULL);
+        }
+        count = MIN(count, (uint32_t)n);
+    }
+
+    littlefs_lock(self->littlefs);
+        for (int i = 0; i < PYCOM_LOG_SEGMENTS && count > 0; i++) {
+            pycom_log_segment_t *seg = &self->seg[(self->active + 1 + i) % PYCOM_LOG_SEGMENTS];
+            uint32_t n = MIN(count, seg->records - seg->consumed);
+            if (n > 0) {
+                seg->consumed += n;
+                count -= n;
+                if (lfs_setattr(&self->littlefs->lfs, seg->path, LFS_ATTRIBUTE_LOG_CONSUMED, &seg->consumed, sizeof(seg->consumed)) < LFS_ERR_OK) {
+                    break;
+                }
+            }
+        }
+    littlefs_unlock(self->littlefs);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(pycom_log_discard_obj, 1, 2, pycom_log_discard);
+
+STATIC mp_obj_t pycom_log_close(mp_obj_t self_in) {
+    pycom_log_close_helper(MP_OBJ_TO_PTR(self_in));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(pycom_log_close_obj, pycom_log_close);
+
+STATIC mp_obj_t pycom_log_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
+    switch (op) {
+        case MP_UNARY_OP_BOOL: return mp_obj_new_bool(pycom_log_count(pycom_log_get(self_in)) != 0);
+        case MP_UNARY_OP_LEN: return MP_OBJ_NEW_SMALL_INT(pycom_log_count(pycom_log_get(self_in)));
+        default: return MP_OBJ_NULL; // op not supported
+    }
+}
+
+// Iterates over the records from the oldest one, each is returned as a bytes object
+STATIC mp_obj_t pycom_log_getiter(mp_obj_t self_in, mp_obj_iter_buf_t *iter_buf) {
+    assert(sizeof(pycom_log_it_t) <= sizeof(mp_obj_iter_buf_t));
+    pycom_log_it_t *it = (pycom_log_it_t *)iter_buf;
+    it->base.type = &mp_type_polymorph_iter;
+    it->iternext = pycom_log_it_iternext;
+    it->log = pycom_log_get(self_in);
+    it->index = 0;
+    return MP_OBJ_FROM_PTR(it);
+}
+
+STATIC const mp_rom_map_elem_t pycom_log_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_append),                  MP_ROM_PTR(&pycom_log_append_obj) },
+    { MP_ROM_QSTR(MP_QSTR_read),                    MP_ROM_PTR(&pycom_log_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_discard),                 MP_ROM_PTR(&pycom_log_discard_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close),                   MP_ROM_PTR(&pycom_log_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__),                 MP_ROM_PTR(&pycom_log_close_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(pycom_log_locals_dict, pycom_log_locals_dict_table);
+
+const mp_obj_type_t pycom_log_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Log,
+    .make_new = pycom_log_make_new,
+    .unary_op = pycom_log_unary_op,
+    .getiter = pycom_log_getiter,
+    .locals_dict = (mp_obj_dict_t *)&pycom_log_locals_dict,
+};
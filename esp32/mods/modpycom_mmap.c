@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "py/mpconfig.h"
+#include "py/obj.h"
+#include "py/runtime.h"
+#include "py/mperrno.h"
+#include "py/nlr.h"
+#include "py/persistentcode.h"
+#include "lib/oofatfs/ff.h"
+#include "extmod/vfs.h"
+#include "extmod/vfs_fat.h"
+
+#include "esp_spi_flash.h"
+#include "esp_partition.h"
+
+#include "sflash_diskio.h"
+#include "mptask.h"
+#include "modpycom_mmap.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+/* The flash is mapped through the MMU of the flash cache in pages of SPI_FLASH_MMU_PAGE_SIZE (64 KB) into the
+ * data address space, reading the buffer reads the flash (decrypted if flash encryption is enabled) with no copy
+ * on the heap. A FatFS file on the internal flash is mapped in place if its clusters are contiguous, which is the
+ * case for a file written in one go on a not fragmented file system. LittleFS doesn't store files contiguously.
+ * The mapping mirrors the flash: it must not be used after the file has been modified or removed.
+ * The memory viewed through a buffer doesn't keep the mapping alive, it stays valid until close() is called. */
+
+/* pycom.freeze_mpy() combines .mpy files into an image in this data partition, which is mapped at every (soft) reset
+ * and imported from like frozen modules: the bytecode and the str/bytes constants are used in place from the flash,
+ * only the function objects, their constant tables and the qstrs of the image take RAM. The image is bound to the
+ * firmware which built it and is ignored after a firmware update, until it is rebuilt.
+ * Only the LAYOUT_8MB=perf table (lib/partitions_8MB_perf.csv) has this partition, with another table a data
+ * partition labeled "mpy" must be added. */
+#define PYCOM_MPY_IMAGE_PARTITION           "mpy"
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+typedef struct {
+    mp_obj_base_t base;
+    const void *ptr;
+    size_t len;
+    spi_flash_mmap_handle_t handle;
+    bool mapped;
+} pycom_mmap_obj_t;
+
+typedef struct {
+    const esp_partition_t *part;
+    size_t erased;
+} pycom_mpy_image_writer_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+// The image partition stays mapped across soft resets
+static const void *pycom_mpy_image;
+static const esp_partition_t *pycom_mpy_image_part;
+static bool pycom_mpy_image_mapped;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC pycom_mmap_obj_t *pycom_mmap_get(mp_obj_t self_in) {
+    pycom_mmap_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (!self->mapped) {
+        mp_raise_OSError(MP_EBADF);
+    }
+    return self;
+}
+
+// Maps len bytes of the flash starting from addr, which doesn't need to be page aligned
+STATIC void pycom_mmap_flash(pycom_mmap_obj_t *self, uint32_t addr, size_t len) {
+    uint32_t page_addr = addr & ~(SPI_FLASH_MMU_PAGE_SIZE - 1);
+    const void *ptr;
+    if (ESP_OK != spi_flash_mmap(page_addr, len + (addr - page_addr), SPI_FLASH_MMAP_DATA, &ptr, &self->handle)) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    self->ptr = (const uint8_t *)ptr + (addr - page_addr);
+    self->len = len;
+    self->mapped = true;
+}
+
+// Returns the flash address of the file, if it is stored contiguously
+STATIC uint32_t pycom_mmap_fat_file(FATFS *fs, const char *path, size_t *len) {
+    FIL fp;
+    FRESULT res = f_open(fs, &fp, path, FA_READ);
+    if (res != FR_OK) {
+        mp_raise_OSError(fresult_to_errno_table[res]);
+    }
+
+    bool contiguous = true;
+    DWORD sclust = fp.obj.sclust;
+    FSIZE_t size = f_size(&fp);
+    FSIZE_t cluster_size = (FSIZE_t)fs->csize * SFLASH_FS_SECTOR_SIZE;
+    for (FSIZE_t ofs = cluster_size; ofs < size && contiguous; ofs += cluster_size) {
+        // seeking into a cluster (not to its start) makes it the current one
+        res = f_lseek(&fp, ofs + 1);
+        contiguous = (res == FR_OK) && (fp.clust == sclust + (ofs / cluster_size));
+    }
+    f_close(&fp);
+
+    if (res != FR_OK) {
+        mp_raise_OSError(fresult_to_errno_table[res]);
+    } else if (!contiguous) {
+        mp_raise_msg(&mp_type_OSError, "file is not stored contiguously");
+    }
+    *len = size;
+    return sflash_get_start_address() + (fs->database + (sclust - 2) * fs->csize) * SFLASH_FS_SECTOR_SIZE;
+}
+
+// Mirrors the image into the flash, erasing the sectors as the image grows
+STATIC bool pycom_mpy_image_write(void *data, size_t offset, const void *buf, size_t len) {
+    pycom_mpy_image_writer_t *writer = data;
+    if (offset + len > writer->erased) {
+        size_t end = (offset + len + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1);
+        if (ESP_OK != esp_partition_erase_range(writer->part, writer->erased, end - writer->erased)) {
+            return false;
+        }
+        writer->erased = end;
+    }
+    return ESP_OK == esp_partition_write(writer->part, offset, buf, len);
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void modpycom_mmap_mount_mpy_image(bool enable) {
+    if (!pycom_mpy_image_mapped) {
+        pycom_mpy_image_mapped = true;
+        pycom_mpy_image_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PYCOM_MPY_IMAGE_PARTITION);
+        spi_flash_mmap_handle_t handle;
+        if (pycom_mpy_image_part != NULL
+            && ESP_OK != esp_partition_mmap(pycom_mpy_image_part, 0, pycom_mpy_image_part->size, SPI_FLASH_MMAP_DATA, &pycom_mpy_image, &handle)) {
+            pycom_mpy_image = NULL;
+        }
+    }
+
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        if (enable && pycom_mpy_image != NULL) {
+            mp_raw_code_image_mount(pycom_mpy_image, pycom_mpy_image_part->size);
+        } else {
+            mp_raw_code_image_mount(NULL, 0);
+        }
+        nlr_pop();
+    } else {
+        // out of memory for the qstrs, start without the image
+        mp_raw_code_image_mount(NULL, 0);
+    }
+}
+
+/******************************************************************************/
+// Micro Python bindings
+
+// pycom.mmap(name): maps a file of the FatFS /flash file system if name is a path or else the whole data partition with that label
+STATIC mp_obj_t pycom_mmap(mp_obj_t name_in) {
+    const char *name = mp_obj_str_get_str(name_in);
+
+    pycom_mmap_obj_t *self = m_new_obj(pycom_mmap_obj_t);
+    self->base.type = &pycom_mmap_type;
+    self->mapped = false;
+
+    if (name[0] != '/') {
+        const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, name);
+        if (part == NULL) {
+            mp_raise_OSError(MP_ENOENT);
+        }
+        if (ESP_OK != esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &self->ptr, &self->handle)) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+        self->len = part->size;
+        self->mapped = true;
+        return MP_OBJ_FROM_PTR(self);
+    }
+
+    const char *path_out;
+    mp_vfs_mount_t *vfs = mp_vfs_lookup_path(name, &path_out);
+    if (vfs == MP_VFS_NONE || vfs == MP_VFS_ROOT || vfs->obj != MP_OBJ_FROM_PTR(&sflash_vfs_flash)
+        || mp_obj_get_type(vfs->obj) != &mp_fat_vfs_type) {
+        mp_raise_ValueError("path must be on the FatFS flash file system");
+    }
+
+    size_t len;
+    uint32_t addr = pycom_mmap_fat_file(&sflash_vfs_flash.fs.fatfs, path_out, &len);
+    if (len == 0) {
+        self->ptr = NULL;
+        self->len = 0;
+        self->mapped = true;
+        self->handle = 0;
+        return MP_OBJ_FROM_PTR(self);
+    }
+    // the flash must hold what FatFS has written so far
+    if (sflash_disk_flush() != RES_OK) {
+        mp_raise_OSError(MP_EIO);
+    }
+    pycom_mmap_flash(self, addr, len);
+    return MP_OBJ_FROM_PTR(self);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(pycom_mmap_obj, pycom_mmap);
+
+STATIC mp_obj_t pycom_mmap_close(mp_obj_t self_in) {
+    pycom_mmap_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->mapped) {
+        if (self->len > 0) {
+            spi_flash_munmap(self->handle);
+        }
+        self->mapped = false;
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(pycom_mmap_close_obj, pycom_mmap_close);
+
+STATIC mp_obj_t pycom_mmap_exit(size_t n_args, const mp_obj_t *args) {
+    (void)n_args;
+    return pycom_mmap_close(args[0]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(pycom_mmap_exit_obj, 4, 4, pycom_mmap_exit);
+
+STATIC mp_obj_t pycom_mmap_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
+    switch (op) {
+        case MP_UNARY_OP_LEN: return MP_OBJ_NEW_SMALL_INT(pycom_mmap_get(self_in)->len);
+        default: return MP_OBJ_NULL; // op not supported
+    }
+}
+
+STATIC mp_int_t pycom_mmap_get_buffer(mp_obj_t self_in, mp_buffer_info_t *bufinfo, mp_uint_t flags) {
+    pycom_mmap_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (!self->mapped || (flags & MP_BUFFER_WRITE)) {
+        // read-only, and nothing to read once closed
+        return 1;
+    }
+    bufinfo->buf = (void *)self->ptr;
+    bufinfo->len = self->len;
+    bufinfo->typecode = 'B';
+    return 0;
+}
+
+STATIC const mp_map_elem_t pycom_mmap_locals_dict_table[] = {
+    { MP_OBJ_NEW_QSTR(MP_QSTR_close),           (mp_obj_t)&pycom_mmap_close_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR___enter__),       (mp_obj_t)&mp_identity_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR___exit__),        (mp_obj_t)&pycom_mmap_exit_obj },
+};
+STATIC MP_DEFINE_CONST_DICT(pycom_mmap_locals_dict, pycom_mmap_locals_dict_table);
+
+// pycom.freeze_mpy(files): replaces the image with the given .mpy files (absolute paths), used from the next (soft) reset
+STATIC mp_obj_t pycom_freeze_mpy(mp_obj_t files_in) {
+    if (pycom_mpy_image_part == NULL) {
+        mp_raise_OSError(MP_ENODEV);
+    }
+    size_t n_files;
+    mp_obj_t *files;
+    mp_obj_get_array(files_in, &n_files, &files);
+
+    pycom_mpy_image_writer_t writer = { .part = pycom_mpy_image_part, .erased = 0 };
+    mp_raw_code_image_writer_t image_writer = {
+        .data = &writer,
+        .max_len = pycom_mpy_image_part->size,
+        .write = pycom_mpy_image_write,
+    };
+    return mp_obj_new_int_from_uint(mp_raw_code_image_build(n_files, files, &image_writer));
+}
+MP_DEFINE_CONST_FUN_OBJ_1(pycom_freeze_mpy_obj, pycom_freeze_mpy);
+
+const mp_obj_type_t pycom_mmap_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_MMap,
+    .unary_op = pycom_mmap_unary_op,
+    .buffer_p = { .get_buffer = pycom_mmap_get_buffer },
+    .locals_dict = (mp_obj_t)&pycom_mmap_locals_dict,
+};
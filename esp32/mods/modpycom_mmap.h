@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef MODPYCOM_MMAP_H_
+#define MODPYCOM_MMAP_H_
+
+extern const mp_obj_type_t pycom_mmap_type;
+
+MP_DECLARE_CONST_FUN_OBJ_1(pycom_mmap_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(pycom_freeze_mpy_obj);
+
+// Must be called right after mp_init(), the image is only mounted if enable is true
+extern void modpycom_mmap_mount_mpy_image(bool enable);
+
+#endif /* MODPYCOM_MMAP_H_ */
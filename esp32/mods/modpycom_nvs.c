@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "py/mpconfig.h"
+#include "py/obj.h"
+#include "py/objstr.h"
+#include "py/runtime.h"
+#include "py/mperrno.h"
+
+#include "nvs.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+
+#include "mpirq.h"
+#include "mpexception.h"
+#include "modpycom_nvs.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+/* pycom.nvs_set() only updates a RAM copy of the value, the values changed are written together with a single
+ * commit by pycom.nvs_flush(), by a timer flush_interval ms after the first change, or before a reset or a deep
+ * sleep. A counter updated every second is then written to the flash once per flush instead of on every update.
+ * An interval of 0 writes each value straight away, as it was done before.
+ * The NVS has no way to list the keys of a namespace in this IDF, the keys set from here are kept in a blob. */
+#define PYCOM_NVS_KEY_MAX                       (15)
+#define PYCOM_NVS_STR_MAX                       (1984)  // including the null character
+#define PYCOM_NVS_BLOB_MAX                      (4000)
+#define PYCOM_NVS_CACHE_ENTRIES_MAX             (32)
+#define PYCOM_NVS_FLUSH_INTERVAL_DEF            (5000)
+#define PYCOM_NVS_INDEX_KEY                     "__keys"
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+typedef enum {
+    PYCOM_NVS_U32 = 0,
+    PYCOM_NVS_STR,
+    PYCOM_NVS_BLOB,
+    PYCOM_NVS_ERASED,
+} pycom_nvs_type_t;
+
+typedef struct _pycom_nvs_entry_t {
+    struct _pycom_nvs_entry_t *next;
+    char key[PYCOM_NVS_KEY_MAX + 1];
+    uint8_t type;
+    bool dirty;
+    uint16_t len;                       // of the string, with the null character, or of the blob
+    union {
+        uint32_t u32;
+        uint8_t *data;
+    } value;
+} pycom_nvs_entry_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+// only used while holding the GIL, from the MicroPython task or from the interrupt task
+static nvs_handle pycom_nvs_handle;
+static pycom_nvs_entry_t *pycom_nvs_cache = NULL;
+static uint32_t pycom_nvs_cache_count = 0;
+static uint32_t pycom_nvs_flush_interval = PYCOM_NVS_FLUSH_INTERVAL_DEF;
+static TimerHandle_t pycom_nvs_timer = NULL;
+static char *pycom_nvs_index = NULL;    // the null terminated keys one after the other
+static size_t pycom_nvs_index_len = 0;
+static bool pycom_nvs_index_loaded = false;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC NORETURN void pycom_nvs_raise (esp_err_t esp_err) {
+    if (ESP_ERR_NVS_NOT_ENOUGH_SPACE == esp_err || ESP_ERR_NVS_PAGE_FULL == esp_err || ESP_ERR_NVS_NO_FREE_PAGES == esp_err) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "No free space available"));
+    } else if (ESP_ERR_NVS_INVALID_NAME == esp_err) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Key is invalid"));
+    } else if (ESP_ERR_NVS_KEY_TOO_LONG == esp_err) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Key is too long"));
+    } else {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_Exception, "Error occurred while storing value, code: %d", esp_err));
+    }
+}
+
+STATIC void pycom_nvs_entry_free (pycom_nvs_entry_t *entry) {
+    if (entry->type == PYCOM_NVS_STR || entry->type == PYCOM_NVS_BLOB) {
+        free(entry->value.data);
+    }
+    free(entry);
+}
+
+STATIC pycom_nvs_entry_t *pycom_nvs_cache_find (const char *key) {
+    for (pycom_nvs_entry_t *entry = pycom_nvs_cache; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+STATIC bool pycom_nvs_cache_dirty (void) {
+    for (pycom_nvs_entry_t *entry = pycom_nvs_cache; entry != NULL; entry = entry->next) {
+        if (entry->dirty) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// drops the values already in the flash
+STATIC void pycom_nvs_cache_trim (void) {
+    pycom_nvs_entry_t **prev = &pycom_nvs_cache;
+    while (*prev != NULL) {
+        pycom_nvs_entry_t *entry = *prev;
+        if (!entry->dirty) {
+            *prev = entry->next;
+            pycom_nvs_entry_free(entry);
+            pycom_nvs_cache_count--;
+        } else {
+            prev = &entry->next;
+        }
+    }
+}
+
+STATIC void pycom_nvs_index_load (void) {
+    if (pycom_nvs_index_loaded) {
+        return;
+    }
+    size_t len = 0;
+    if (nvs_get_blob(pycom_nvs_handle, PYCOM_NVS_INDEX_KEY, NULL, &len) == ESP_OK && len > 0) {
+        pycom_nvs_index = malloc(len);
+        if (pycom_nvs_index != NULL && nvs_get_blob(pycom_nvs_handle, PYCOM_NVS_INDEX_KEY, pycom_nvs_index, &len) == ESP_OK) {
+            pycom_nvs_index_len = len;
+        }
+    }
+    pycom_nvs_index_loaded = true;
+}
+
+STATIC char *pycom_nvs_index_find (const char *key) {
+    for (char *k = pycom_nvs_index; k != NULL && k < pycom_nvs_index + pycom_nvs_index_len; k += strlen(k) + 1) {
+        if (strcmp(k, key) == 0) {
+            return k;
+        }
+    }
+    return NULL;
+}
+
+// returns true if the index was changed
+STATIC bool pycom_nvs_index_update (const char *key, bool present) {
+    char *k = pycom_nvs_index_find(key);
+    if (present && k == NULL) {
+        size_t len = strlen(key) + 1;
+        char *index = realloc(pycom_nvs_index, pycom_nvs_index_len + len);
+        if (index == NULL) {
+            return false;
+        }
+        memcpy(index + pycom_nvs_index_len, key, len);
+        pycom_nvs_index = index;
+        pycom_nvs_index_len += len;
+        return true;
+    } else if (!present && k != NULL) {
+        size_t len = strlen(k) + 1;
+        memmove(k, k + len, pycom_nvs_index + pycom_nvs_index_len - (k + len));
+        pycom_nvs_index_len -= len;
+        return true;
+    }
+    return false;
+}
+
+STATIC void pycom_nvs_index_clear (void) {
+    free(pycom_nvs_index);
+    pycom_nvs_index = NULL;
+    pycom_nvs_index_len = 0;
+    pycom_nvs_index_loaded = true;
+}
+
+// writes the dirty values with a single commit, those that could not be written stay dirty
+STATIC esp_err_t pycom_nvs_flush (uint32_t *written) {
+    esp_err_t ret = ESP_OK;
+    bool index_changed = false;
+    uint32_t count = 0;
+
+    pycom_nvs_index_load();
+    for (pycom_nvs_entry_t *entry = pycom_nvs_cache; entry != NULL; entry = entry->next) {
+        if (!entry->dirty) {
+            continue;
+        }
+        esp_err_t esp_err;
+        switch (entry->type) {
+            case PYCOM_NVS_U32:
+                esp_err = nvs_set_u32(pycom_nvs_handle, entry->key, entry->value.u32);
+                break;
+            case PYCOM_NVS_STR:
+                esp_err = nvs_set_str(pycom_nvs_handle, entry->key, (const char *)entry->value.data);
+                break;
+            case PYCOM_NVS_BLOB:
+                esp_err = nvs_set_blob(pycom_nvs_handle, entry->key, entry->value.data, entry->len);
+                break;
+            default:
+                esp_err = nvs_erase_key(pycom_nvs_handle, entry->key);
+                if (esp_err == ESP_ERR_NVS_NOT_FOUND) {
+                    esp_err = ESP_OK;
+                }
+                break;
+        }
+        if (esp_err != ESP_OK) {
+            ret = esp_err;
+            continue;
+        }
+        entry->dirty = false;
+        index_changed |= pycom_nvs_index_update(entry->key, entry->type != PYCOM_NVS_ERASED);
+        count++;
+    }
+    if (index_changed) {
+        if (pycom_nvs_index_len > 0) {
+            nvs_set_blob(pycom_nvs_handle, PYCOM_NVS_INDEX_KEY, pycom_nvs_index, pycom_nvs_index_len);
+        } else {
+            nvs_erase_key(pycom_nvs_handle, PYCOM_NVS_INDEX_KEY);
+        }
+    }
+    if (count > 0) {
+        esp_err_t esp_err = nvs_commit(pycom_nvs_handle);
+        if (ret == ESP_OK) {
+            ret = esp_err;
+        }
+    }
+
+    // the erased keys are not worth keeping
+    pycom_nvs_entry_t **prev = &pycom_nvs_cache;
+    while (*prev != NULL) {
+        pycom_nvs_entry_t *entry = *prev;
+        if (!entry->dirty && entry->type == PYCOM_NVS_ERASED) {
+            *prev = entry->next;
+            pycom_nvs_entry_free(entry);
+            pycom_nvs_cache_count--;
+        } else {
+            prev = &entry->next;
+        }
+    }
+    if (written != NULL) {
+        *written = count;
+    }
+    return ret;
+}
+
+// runs in the interrupt task
+STATIC void pycom_nvs_flush_handler (void *arg) {
+    // on failure the values stay dirty and are written with the next flush
+    pycom_nvs_flush(NULL);
+}
+
+STATIC void pycom_nvs_timer_callback (TimerHandle_t timer) {
+    mp_irq_queue_interrupt_non_ISR(pycom_nvs_flush_handler, NULL);
+}
+
+// the timer is not restarted by the next changes, so a value updated all the time is still written
+STATIC void pycom_nvs_schedule_flush (void) {
+    if (pycom_nvs_flush_interval == 0) {
+        esp_err_t esp_err = pycom_nvs_flush(NULL);
+        if (esp_err != ESP_OK) {
+            pycom_nvs_raise(esp_err);
+        }
+    } else if (pycom_nvs_timer != NULL && xTimerIsTimerActive(pycom_nvs_timer) == pdFALSE) {
+        // starts the timer as well
+        xTimerChangePeriod(pycom_nvs_timer, pycom_nvs_flush_interval / portTICK_PERIOD_MS, 0);
+    }
+}
+
+// the entry of the key, created if needed, with the previous value released
+STATIC pycom_nvs_entry_t *pycom_nvs_cache_put (const char *key) {
+    pycom_nvs_entry_t *entry = pycom_nvs_cache_find(key);
+    if (entry != NULL) {
+        if (entry->type == PYCOM_NVS_STR || entry->type == PYCOM_NVS_BLOB) {
+            free(entry->value.data);
+            entry->value.data = NULL;
+        }
+        entry->type = PYCOM_NVS_ERASED;
+        return entry;
+    }
+
+    if (pycom_nvs_cache_count >= PYCOM_NVS_CACHE_ENTRIES_MAX) {
+        pycom_nvs_cache_trim();
+        if (pycom_nvs_cache_count >= PYCOM_NVS_CACHE_ENTRIES_MAX) {
+            esp_err_t esp_err = pycom_nvs_flush(NULL);
+            if (esp_err != ESP_OK) {
+                pycom_nvs_raise(esp_err);
+            }
+            pycom_nvs_cache_trim();
+        }
+    }
+    entry = calloc(1, sizeof(pycom_nvs_entry_t));
+    if (entry == NULL) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    strcpy(entry->key, key);
+    entry->type = PYCOM_NVS_ERASED;
+    entry->next = pycom_nvs_cache;
+    pycom_nvs_cache = entry;
+    pycom_nvs_cache_count++;
+    return entry;
+}
+
+// the copy is made before the entry is touched, so a failure leaves the previous value
+STATIC void pycom_nvs_cache_set_data (const char *key, uint8_t type, const void *data, size_t len) {
+    uint8_t *copy = malloc(len > 0 ? len : 1);
+    if (copy == NULL) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    memcpy(copy, data, len);
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        pycom_nvs_entry_t *entry = pycom_nvs_cache_put(key);
+        nlr_pop();
+        entry->value.data = copy;
+        entry->len = len;
+        entry->type = type;
+        entry->dirty = true;
+    } else {
+        free(copy);
+        nlr_jump(nlr.ret_val);
+    }
+}
+
+// reads the value from the flash into the cache, returns NULL if the key is not there
+STATIC pycom_nvs_entry_t *pycom_nvs_load (const char *key) {
+    uint32_t u32;
+    size_t len;
+    uint8_t type;
+
+    if (nvs_get_u32(pycom_nvs_handle, key, &u32) == ESP_OK) {
+        type = PYCOM_NVS_U32;
+    } else if (nvs_get_str(pycom_nvs_handle, key, NULL, &len) == ESP_OK) {
+        type = PYCOM_NVS_STR;
+    } else if (nvs_get_blob(pycom_nvs_handle, key, NULL, &len) == ESP_OK) {
+        type = PYCOM_NVS_BLOB;
+    } else {
+        return NULL;
+    }
+
+    pycom_nvs_entry_t *entry = pycom_nvs_cache_put(key);
+    entry->dirty = false;
+    if (type == PYCOM_NVS_U32) {
+        entry->value.u32 = u32;
+    } else {
+        entry->value.data = malloc(len > 0 ? len : 1);
+        esp_err_t esp_err = ESP_ERR_NO_MEM;
+        if (entry->value.data != NULL) {
+            if (type == PYCOM_NVS_STR) {
+                esp_err = nvs_get_str(pycom_nvs_handle, key, (char *)entry->value.data, &len);
+            } else {
+                esp_err = nvs_get_blob(pycom_nvs_handle, key, entry->value.data, &len);
+            }
+        }
+        if (esp_err != ESP_OK) {
+            // left as an erased entry, which is clean and dropped by the next trim
+            free(entry->value.data);
+            entry->value.data = NULL;
+            return NULL;
+        }
+        entry->len = len;
+    }
+    entry->type = type;
+    return entry;
+}
+
+STATIC const char *pycom_nvs_get_key (mp_obj_t key_in) {
+    const char *key = mp_obj_str_get_str(key_in);
+    if (strlen(key) > PYCOM_NVS_KEY_MAX) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Key is too long"));
+    } else if (key[0] == '\0') {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Key is invalid"));
+    }
+    return key;
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void modpycom_nvs_init0 (nvs_handle handle) {
+    pycom_nvs_handle = handle;
+    if (pycom_nvs_timer == NULL) {
+        pycom_nvs_timer = xTimerCreate("NVS_Flush", PYCOM_NVS_FLUSH_INTERVAL_DEF / portTICK_PERIOD_MS, 0, NULL, pycom_nvs_timer_callback);
+    }
+}
+
+void modpycom_nvs_flush_all (void) {
+    if (pycom_nvs_timer != NULL) {
+        xTimerStop(pycom_nvs_timer, 0);
+    }
+    pycom_nvs_flush(NULL);
+}
+
+/******************************************************************************
+ DEFINE MICROPYTHON FUNCTIONS
+ ******************************************************************************/
+STATIC mp_obj_t mod_pycom_nvs_set (mp_obj_t _key, mp_obj_t _value) {
+    const char *key = pycom_nvs_get_key(_key);
+
+    if (MP_OBJ_IS_STR_OR_BYTES(_value)) {
+        const char *value = mp_obj_str_get_str(_value);
+        size_t len = strlen(value) + 1;
+        if (len > PYCOM_NVS_STR_MAX) {
+            // Maximum length (including null character) can be 1984 bytes
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "value too long (max: 1984)"));
+        }
+        pycom_nvs_entry_t *entry = pycom_nvs_cache_find(key);
+        if (entry != NULL && entry->type == PYCOM_NVS_STR && entry->len == len && memcmp(entry->value.data, value, len) == 0) {
+            return mp_const_none;
+        }
+        pycom_nvs_cache_set_data(key, PYCOM_NVS_STR, value, len);
+    } else if (MP_OBJ_IS_INT(_value)) {
+        uint32_t value = mp_obj_get_int_truncated(_value);
+        pycom_nvs_entry_t *entry = pycom_nvs_cache_find(key);
+        if (entry != NULL && entry->type == PYCOM_NVS_U32 && entry->value.u32 == value) {
+            return mp_const_none;
+        }
+        entry = pycom_nvs_cache_put(key);
+        entry->type = PYCOM_NVS_U32;
+        entry->value.u32 = value;
+        entry->dirty = true;
+    } else {
+        mp_buffer_info_t bufinfo;
+        if (!mp_get_buffer(_value, &bufinfo, MP_BUFFER_READ)) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Value must be string, bytes, integer or a buffer"));
+        }
+        if (bufinfo.len > PYCOM_NVS_BLOB_MAX) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "value too long (max: 4000)"));
+        }
+        pycom_nvs_entry_t *entry = pycom_nvs_cache_find(key);
+        if (entry != NULL && entry->type == PYCOM_NVS_BLOB && entry->len == bufinfo.len
+            && memcmp(entry->value.data, bufinfo.buf, bufinfo.len) == 0) {
+            return mp_const_none;
+        }
+        pycom_nvs_cache_set_data(key, PYCOM_NVS_BLOB, bufinfo.buf, bufinfo.len);
+    }
+    pycom_nvs_schedule_flush();
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_2(mod_pycom_nvs_set_obj, mod_pycom_nvs_set);
+
+STATIC mp_obj_t mod_pycom_nvs_get (mp_uint_t n_args, const mp_obj_t *args) {
+    const char *key = mp_obj_str_get_str(args[0]);
+
+    pycom_nvs_entry_t *entry = pycom_nvs_cache_find(key);
+    if (entry == NULL && strlen(key) <= PYCOM_NVS_KEY_MAX) {
+        entry = pycom_nvs_load(key);
+    }
+
+    if (entry == NULL || entry->type == PYCOM_NVS_ERASED) {
+        if (n_args > 1) {
+            // return user defined NoExistValue
+            return args[1];
+        }
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "No matching object for the provided key"));
+    } else if (entry->type == PYCOM_NVS_U32) {
+        return mp_obj_new_int(entry->value.u32);
+    } else if (entry->type == PYCOM_NVS_STR) {
+        //do not count the terminating \0
+        return mp_obj_new_str((const char *)entry->value.data, entry->len - 1);
+    }
+    return mp_obj_new_bytes(entry->value.data, entry->len);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_nvs_get_obj, 1, 2, mod_pycom_nvs_get);
+
+STATIC mp_obj_t mod_pycom_nvs_erase (mp_obj_t _key) {
+    const char *key = pycom_nvs_get_key(_key);
+
+    pycom_nvs_entry_t *entry = pycom_nvs_cache_find(key);
+    if (entry == NULL) {
+        entry = pycom_nvs_load(key);
+    }
+    if (entry == NULL || entry->type == PYCOM_NVS_ERASED) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_KeyError, "key not found"));
+    }
+    pycom_nvs_cache_put(key)->dirty = true;
+    pycom_nvs_schedule_flush();
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(mod_pycom_nvs_erase_obj, mod_pycom_nvs_erase);
+
+STATIC mp_obj_t mod_pycom_nvs_erase_all (void) {
+    // nothing left to write
+    while (pycom_nvs_cache != NULL) {
+        pycom_nvs_entry_t *entry = pycom_nvs_cache;
+        pycom_nvs_cache = entry->next;
+        pycom_nvs_entry_free(entry);
+    }
+    pycom_nvs_cache_count = 0;
+    pycom_nvs_index_clear();
+    if (ESP_OK != nvs_erase_all(pycom_nvs_handle)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+    nvs_commit(pycom_nvs_handle);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_0(mod_pycom_nvs_erase_all_obj, mod_pycom_nvs_erase_all);
+
+// returns the number of values written
+STATIC mp_obj_t mod_pycom_nvs_flush (void) {
+    uint32_t written;
+    if (pycom_nvs_timer != NULL) {
+        xTimerStop(pycom_nvs_timer, 0);
+    }
+    esp_err_t esp_err = pycom_nvs_flush(&written);
+    if (esp_err != ESP_OK) {
+        pycom_nvs_raise(esp_err);
+    }
+    return mp_obj_new_int_from_uint(written);
+}
+MP_DEFINE_CONST_FUN_OBJ_0(mod_pycom_nvs_flush_obj, mod_pycom_nvs_flush);
+
+STATIC mp_obj_t mod_pycom_nvs_flush_interval (mp_uint_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        return mp_obj_new_int_from_uint(pycom_nvs_flush_interval);
+    }
+    mp_int_t interval = mp_obj_get_int(args[0]);
+    if (interval < 0) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    pycom_nvs_flush_interval = interval;
+    if (pycom_nvs_timer != NULL) {
+        xTimerStop(pycom_nvs_timer, 0);
+    }
+    if (pycom_nvs_cache_dirty()) {
+        pycom_nvs_schedule_flush();
+    }
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_nvs_flush_interval_obj, 0, 1, mod_pycom_nvs_flush_interval);
+
+// the keys set with nvs_set(), also those not written yet
+STATIC mp_obj_t mod_pycom_nvs_keys (void) {
+    mp_obj_t keys = mp_obj_new_list(0, NULL);
+
+    pycom_nvs_index_load();
+    for (char *k = pycom_nvs_index; k != NULL && k < pycom_nvs_index + pycom_nvs_index_len; k += strlen(k) + 1) {
+        pycom_nvs_entry_t *entry = pycom_nvs_cache_find(k);
+        if (entry == NULL || entry->type != PYCOM_NVS_ERASED) {
+            mp_obj_list_append(keys, mp_obj_new_str(k, strlen(k)));
+        }
+    }
+    for (pycom_nvs_entry_t *entry = pycom_nvs_cache; entry != NULL; entry = entry->next) {
+        if (entry->type != PYCOM_NVS_ERASED && pycom_nvs_index_find(entry->key) == NULL) {
+            mp_obj_list_append(keys, mp_obj_new_str(entry->key, strlen(entry->key)));
+        }
+    }
+    return keys;
+}
+MP_DEFINE_CONST_FUN_OBJ_0(mod_pycom_nvs_keys_obj, mod_pycom_nvs_keys);
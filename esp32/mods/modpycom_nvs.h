@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef MODPYCOM_NVS_H_
+#define MODPYCOM_NVS_H_
+
+#include "nvs.h"
+
+MP_DECLARE_CONST_FUN_OBJ_2(mod_pycom_nvs_set_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_nvs_get_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(mod_pycom_nvs_erase_obj);
+MP_DECLARE_CONST_FUN_OBJ_0(mod_pycom_nvs_erase_all_obj);
+MP_DECLARE_CONST_FUN_OBJ_0(mod_pycom_nvs_flush_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(mod_pycom_nvs_flush_interval_obj);
+MP_DECLARE_CONST_FUN_OBJ_0(mod_pycom_nvs_keys_obj);
+
+extern void modpycom_nvs_init0 (nvs_handle handle);
+
+// Writes the values not written yet, called before a reset or a deep sleep
+extern void modpycom_nvs_flush_all (void);
+
+#endif /* MODPYCOM_NVS_H_ */
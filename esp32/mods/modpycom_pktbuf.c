@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "py/mpconfig.h"
+#include "py/obj.h"
+#include "py/objtuple.h"
+#include "py/runtime.h"
+#include "py/mperrno.h"
+
+#include "mpexception.h"
+#include "pktbuf.h"
+#include "modpycom_pktbuf.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+/* A PktBuf object holds a reference to a block of the pool, the frame a driver has queued in it is read through
+ * the buffer protocol without a copy. The block goes back to the pool on release(), at the end of a with statement
+ * or when the object is collected. As with pycom.mmap(), the memory viewed through a buffer doesn't keep the block
+ * alive: a memoryview must not be used after the PktBuf object is released. */
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+typedef struct {
+    mp_obj_base_t base;
+    pktbuf_t *pb;
+    uint32_t offset;
+} pycom_pktbuf_obj_t;
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void modpycom_pktbuf_init0 (void) {
+    pktbuf_init();
+    // the objects of the previous heap are gone without their finaliser being called
+    pktbuf_release_python();
+}
+
+mp_obj_t modpycom_pktbuf_new (pktbuf_t *pb, uint32_t offset) {
+    pycom_pktbuf_obj_t *self = m_new_obj_with_finaliser(pycom_pktbuf_obj_t);
+    self->base.type = &pycom_pktbuf_type;
+    self->pb = pb;
+    self->offset = (offset < pb->len) ? offset : pb->len;
+    pb->flags |= PKTBUF_FLAG_PYTHON;
+    return MP_OBJ_FROM_PTR(self);
+}
+
+/******************************************************************************/
+// Micro Python bindings
+
+STATIC mp_obj_t pycom_pktbuf_release(mp_obj_t self_in) {
+    pycom_pktbuf_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->pb != NULL) {
+        self->pb->flags &= ~PKTBUF_FLAG_PYTHON;
+        pktbuf_unref(self->pb);
+        self->pb = NULL;
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(pycom_pktbuf_release_obj, pycom_pktbuf_release);
+
+STATIC mp_obj_t pycom_pktbuf_exit(size_t n_args, const mp_obj_t *args) {
+    (void)n_args;
+    return pycom_pktbuf_release(args[0]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(pycom_pktbuf_exit_obj, 4, 4, pycom_pktbuf_exit);
+
+STATIC mp_obj_t pycom_pktbuf_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
+    pycom_pktbuf_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    switch (op) {
+        case MP_UNARY_OP_LEN:
+            if (self->pb == NULL) {
+                mp_raise_OSError(MP_EBADF);
+            }
+            return MP_OBJ_NEW_SMALL_INT(self->pb->len - self->offset);
+        default: return MP_OBJ_NULL; // op not supported
+    }
+}
+
+STATIC mp_int_t pycom_pktbuf_get_buffer(mp_obj_t self_in, mp_buffer_info_t *bufinfo, mp_uint_t flags) {
+    pycom_pktbuf_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->pb == NULL) {
+        // nothing to read once released
+        return 1;
+    }
+    bufinfo->buf = &self->pb->data[self->offset];
+    bufinfo->len = self->pb->len - self->offset;
+    bufinfo->typecode = 'B';
+    return 0;
+}
+
+STATIC const mp_map_elem_t pycom_pktbuf_locals_dict_table[] = {
+    { MP_OBJ_NEW_QSTR(MP_QSTR_release),         (mp_obj_t)&pycom_pktbuf_release_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR___del__),         (mp_obj_t)&pycom_pktbuf_release_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR___enter__),       (mp_obj_t)&mp_identity_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR___exit__),        (mp_obj_t)&pycom_pktbuf_exit_obj },
+};
+STATIC MP_DEFINE_CONST_DICT(pycom_pktbuf_locals_dict, pycom_pktbuf_locals_dict_table);
+
+const mp_obj_type_t pycom_pktbuf_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_PktBuf,
+    .unary_op = pycom_pktbuf_unary_op,
+    .buffer_p = { .get_buffer = pycom_pktbuf_get_buffer },
+    .locals_dict = (mp_obj_t)&pycom_pktbuf_locals_dict,
+};
+
+// pycom.pktbuf([owner], *, quota, reserve): the (blocks, free, block_size) of the pool, or the
+// (used, peak, quota, reserve, refused) blocks of a subsystem, whose quota and reserve can be changed
+STATIC mp_obj_t pycom_pktbuf(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_owner,        MP_ARG_OBJ,                     {.u_obj = mp_const_none} },
+        { MP_QSTR_quota,        MP_ARG_KW_ONLY | MP_ARG_OBJ,    {.u_obj = mp_const_none} },
+        { MP_QSTR_reserve,      MP_ARG_KW_ONLY | MP_ARG_OBJ,    {.u_obj = mp_const_none} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[0].u_obj == mp_const_none) {
+        static const qstr pool_fields[] = { MP_QSTR_blocks, MP_QSTR_free, MP_QSTR_block_size };
+        mp_obj_t tuple[3];
+        tuple[0] = MP_OBJ_NEW_SMALL_INT(pktbuf_blocks());
+        tuple[1] = MP_OBJ_NEW_SMALL_INT(pktbuf_free_blocks());
+        tuple[2] = MP_OBJ_NEW_SMALL_INT(PKTBUF_DATA_SIZE);
+        return mp_obj_new_attrtuple(pool_fields, 3, tuple);
+    }
+
+    mp_int_t owner = mp_obj_get_int(args[0].u_obj);
+    if (owner < 0 || owner >= PKTBUF_OWNER_COUNT) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    pktbuf_stats_t stats;
+    pktbuf_get_stats(owner, &stats);
+    if (args[1].u_obj != mp_const_none || args[2].u_obj != mp_const_none) {
+        mp_int_t quota = (args[1].u_obj != mp_const_none) ? mp_obj_get_int(args[1].u_obj) : stats.quota;
+        mp_int_t reserve = (args[2].u_obj != mp_const_none) ? mp_obj_get_int(args[2].u_obj) : stats.reserve;
+        if (quota < 0 || reserve < 0 || !pktbuf_set_quota(owner, quota, reserve)) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+        }
+        pktbuf_get_stats(owner, &stats);
+    }
+
+    static const qstr owner_fields[] = { MP_QSTR_used, MP_QSTR_peak, MP_QSTR_quota, MP_QSTR_reserve, MP_QSTR_refused };
+    mp_obj_t tuple[5];
+    tuple[0] = MP_OBJ_NEW_SMALL_INT(stats.used);
+    tuple[1] = MP_OBJ_NEW_SMALL_INT(stats.peak);
+    tuple[2] = MP_OBJ_NEW_SMALL_INT(stats.quota);
+    tuple[3] = MP_OBJ_NEW_SMALL_INT(stats.reserve);
+    tuple[4] = mp_obj_new_int_from_uint(stats.refused);
+    return mp_obj_new_attrtuple(owner_fields, 5, tuple);
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(pycom_pktbuf_obj, 0, pycom_pktbuf);
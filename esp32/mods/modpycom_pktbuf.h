@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef MODPYCOM_PKTBUF_H_
+#define MODPYCOM_PKTBUF_H_
+
+#include "pktbuf.h"
+
+extern const mp_obj_type_t pycom_pktbuf_type;
+
+MP_DECLARE_CONST_FUN_OBJ_KW(pycom_pktbuf_obj);
+
+extern void modpycom_pktbuf_init0 (void);
+
+// Wraps the bytes of pb from offset into a PktBuf object, which takes over the reference of the caller
+extern mp_obj_t modpycom_pktbuf_new (pktbuf_t *pb, uint32_t offset);
+
+#endif /* MODPYCOM_PKTBUF_H_ */
@@ -24,9 +24,183 @@
 
 #include "modnetwork.h"
 #include "modusocket.h"
+#include "mpirq.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #include "sigfox/modsigfox.h"
 
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define SIGFOX_ASYNC_QUEUE_LEN                      (8)
+#define SIGFOX_ASYNC_RESULTS_MAX                    (8)
+#define SIGFOX_ASYNC_STACK_SIZE                     (3072)
+#define SIGFOX_ASYNC_TASK_PRIORITY                  (5)         // below the Sigfox task doing the radio work
+#define SIGFOX_ASYNC_TX_REPEAT_DEF                  (2)
+
+#define SIGFOX_TX_PACKET_EVENT                      (0x01)
+#define SIGFOX_RX_PACKET_EVENT                      (0x02)
+#define SIGFOX_TX_FAILED_EVENT                      (0x04)
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+typedef struct {
+    uint32_t    id;
+    uint8_t     data[FSK_TX_PAYLOAD_SIZE_MAX];
+    uint8_t     len;
+    uint8_t     tx_repeat;
+    bool        rx;
+    bool        oob;
+} sigfox_async_msg_t;
+
+typedef struct {
+    uint32_t    id;
+    int         err;
+    int8_t      rx_len;                 // -1 when no downlink came
+    uint8_t     rx[SIGFOX_RX_PAYLOAD_SIZE_MAX];
+} sigfox_async_result_t;
+
+typedef struct {
+    QueueHandle_t               queue;
+    SemaphoreHandle_t           lock;           // one transmission at a time, queued or through a socket
+    portMUX_TYPE                mux;
+    mod_network_socket_obj_t    sock;
+    bool                        sock_open;
+    uint32_t                    next_id;
+    uint32_t                    events;
+    uint32_t                    trigger;
+    mp_obj_t                    handler;
+    mp_obj_t                    handler_arg;
+    sigfox_async_result_t       results[SIGFOX_ASYNC_RESULTS_MAX];
+    uint8_t                     results_head;
+    uint8_t                     results_count;
+} sigfox_async_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+STATIC sigfox_async_t sigfox_async = {.mux = portMUX_INITIALIZER_UNLOCKED};
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC void sigfox_async_callback_handler(void *arg) {
+    (void)arg;
+    mp_obj_t handler = sigfox_async.handler;
+    if (handler != MP_OBJ_NULL && handler != mp_const_none) {
+        mp_call_function_1(handler, sigfox_async.handler_arg);
+    }
+}
+
+STATIC void sigfox_async_complete(uint32_t id, int err, const uint8_t *rx, int rx_len) {
+    uint32_t events = err ? SIGFOX_TX_FAILED_EVENT : SIGFOX_TX_PACKET_EVENT;
+    if (rx_len >= 0) {
+        events |= SIGFOX_RX_PACKET_EVENT;
+    }
+
+    portENTER_CRITICAL(&sigfox_async.mux);
+    // the oldest result makes room when nobody collected them
+    uint8_t slot = (sigfox_async.results_head + sigfox_async.results_count) % SIGFOX_ASYNC_RESULTS_MAX;
+    if (sigfox_async.results_count == SIGFOX_ASYNC_RESULTS_MAX) {
+        sigfox_async.results_head = (sigfox_async.results_head + 1) % SIGFOX_ASYNC_RESULTS_MAX;
+    } else {
+        sigfox_async.results_count++;
+    }
+    sigfox_async_result_t *res = &sigfox_async.results[slot];
+    res->id = id;
+    res->err = err;
+    res->rx_len = rx_len;
+    if (rx_len > 0) {
+        memcpy(res->rx, rx, rx_len);
+    }
+    sigfox_async.events |= events;
+    bool notify = (sigfox_async.trigger & events) != 0;
+    portEXIT_CRITICAL(&sigfox_async.mux);
+
+    if (notify) {
+        mp_irq_queue_interrupt_non_ISR(sigfox_async_callback_handler, NULL);
+    }
+}
+
+// runs without the GIL, the same way the socket calls are made
+STATIC void TASK_Sigfox_Async(void *pvParameters) {
+    sigfox_async_msg_t msg;
+    mod_network_socket_obj_t *s = &sigfox_async.sock;
+
+    for ( ; ; ) {
+        // left in the queue until sent, so that it counts as pending
+        xQueuePeek(sigfox_async.queue, &msg, portMAX_DELAY);
+        xSemaphoreTake(sigfox_async.lock, portMAX_DELAY);
+
+        int _errno = 0;
+        mp_int_t val = msg.rx;
+        sigfox_socket_setsockopt(s, SOL_SIGFOX, SO_SIGFOX_RX, &val, sizeof(val), &_errno);
+        val = msg.tx_repeat;
+        sigfox_socket_setsockopt(s, SOL_SIGFOX, SO_SIGFOX_TX_REPEAT, &val, sizeof(val), &_errno);
+        val = msg.oob;
+        sigfox_socket_setsockopt(s, SOL_SIGFOX, SO_SIGFOX_OOB, &val, sizeof(val), &_errno);
+
+        // blocks for the whole sequence, including the downlink window
+        sigfox_socket_settimeout(s, -1, &_errno);
+        _errno = 0;
+        int err = 0;
+        uint8_t rx[SIGFOX_RX_PAYLOAD_SIZE_MAX];
+        int rx_len = -1;
+        if (sigfox_socket_send(s, msg.data, msg.len, &_errno) < 0) {
+            err = _errno ? _errno : MP_EIO;
+        } else if (msg.rx) {
+            // the downlink is already there once the send returns
+            sigfox_socket_settimeout(s, 0, &_errno);
+            int n = sigfox_socket_recv(s, rx, sizeof(rx), &_errno);
+            if (n >= 0) {
+                rx_len = n;
+            }
+        }
+
+        xSemaphoreGive(sigfox_async.lock);
+        xQueueReceive(sigfox_async.queue, &msg, 0);
+        sigfox_async_complete(msg.id, err, rx, rx_len);
+    }
+}
+
+STATIC void sigfox_async_init(void) {
+    // created once, they survive the soft resets
+    if (sigfox_async.lock == NULL) {
+        sigfox_async.lock = xSemaphoreCreateMutex();
+        sigfox_async.queue = xQueueCreate(SIGFOX_ASYNC_QUEUE_LEN, sizeof(sigfox_async_msg_t));
+        if (sigfox_async.lock == NULL || sigfox_async.queue == NULL ||
+            xTaskCreatePinnedToCore(TASK_Sigfox_Async, "SigfoxQ", SIGFOX_ASYNC_STACK_SIZE / sizeof(StackType_t), NULL,
+                                    SIGFOX_ASYNC_TASK_PRIORITY, NULL, 1) != pdPASS) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    }
+    // the interrupt handlers are gone after a soft reset
+    if (mp_irq_find(&sigfox_obj) == NULL) {
+        sigfox_async.trigger = 0;
+        sigfox_async.handler = MP_OBJ_NULL;
+        sigfox_async.handler_arg = MP_OBJ_NULL;
+    }
+}
+
+// the socket sends wait for the queued transmissions in flight
+STATIC int sigfox_socket_send_locked (mod_network_socket_obj_t *s, const byte *buf, mp_uint_t len, int *_errno) {
+    if (sigfox_async.lock == NULL) {
+        return sigfox_socket_send(s, buf, len, _errno);
+    }
+    xSemaphoreTake(sigfox_async.lock, portMAX_DELAY);
+    int ret = sigfox_socket_send(s, buf, len, _errno);
+    xSemaphoreGive(sigfox_async.lock);
+    return ret;
+}
+
+/******************************************************************************/
+// Micro Python bindings; Sigfox class
+
 
 STATIC const mp_arg_t sigfox_init_args[] = {
     { MP_QSTR_id,                             MP_ARG_INT,   {.u_int  = 0} },
@@ -62,6 +236,8 @@ STATIC mp_obj_t sigfox_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_
         mod_network_register_nic(self);
     }
 
+    sigfox_async_init();
+
     return (mp_obj_t)self;
 }
 
@@ -88,6 +264,136 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(sigfox_version_obj, sigfox_version);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(sigfox_info_obj, sigfox_info);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(sigfox_reset_obj, sigfox_reset);
 
+/// \method send_async(data, *, rx=False, tx_repeat=2, oob=False)
+/// Queues the message for the transmit task and returns its id right away,
+/// the outcome and the downlink are collected with completed()
+STATIC mp_obj_t sigfox_send_async(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_data,         MP_ARG_REQUIRED | MP_ARG_OBJ,   },
+        { MP_QSTR_rx,           MP_ARG_KW_ONLY | MP_ARG_BOOL,   {.u_bool = false} },
+        { MP_QSTR_tx_repeat,    MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = SIGFOX_ASYNC_TX_REPEAT_DEF} },
+        { MP_QSTR_oob,          MP_ARG_KW_ONLY | MP_ARG_BOOL,   {.u_bool = false} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+    sigfox_obj_t *self = pos_args[0];
+
+    if (self->state == E_SIGFOX_STATE_NOINIT || sigfox_async.queue == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
+    size_t max_len = (self->mode == E_SIGFOX_MODE_SIGFOX) ? SIGFOX_TX_PAYLOAD_SIZE_MAX : FSK_TX_PAYLOAD_SIZE_MAX;
+    if (bufinfo.len > max_len) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    if (args[2].u_int < 0 || args[2].u_int > 2) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+
+    if (!sigfox_async.sock_open) {
+        int _errno;
+        sigfox_async.sock.base.type = &socket_type;
+        sigfox_async.sock.sock_base.nic = self;
+        sigfox_async.sock.sock_base.nic_type = (mod_network_nic_type_t *)&mod_network_nic_type_sigfox;
+        if (sigfox_socket_socket(&sigfox_async.sock, &_errno) != 0) {
+            mp_raise_OSError(_errno);
+        }
+        sigfox_async.sock_open = true;
+    }
+
+    sigfox_async_msg_t msg = {
+        .id = sigfox_async.next_id++,
+        .len = bufinfo.len,
+        .tx_repeat = args[2].u_int,
+        .rx = args[1].u_bool,
+        .oob = args[3].u_bool,
+    };
+    memcpy(msg.data, bufinfo.buf, bufinfo.len);
+    if (xQueueSendToBack(sigfox_async.queue, &msg, 0) != pdTRUE) {
+        mp_raise_OSError(MP_ENOBUFS);
+    }
+    return mp_obj_new_int_from_uint(msg.id);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(sigfox_send_async_obj, 1, sigfox_send_async);
+
+/// \method completed()
+/// Returns the (id, errno, downlink) of the messages sent since the last call,
+/// downlink is None when none was requested or received
+STATIC mp_obj_t sigfox_completed(mp_obj_t self_in) {
+    sigfox_async_result_t results[SIGFOX_ASYNC_RESULTS_MAX];
+    uint8_t count;
+
+    portENTER_CRITICAL(&sigfox_async.mux);
+    count = sigfox_async.results_count;
+    for (uint8_t i = 0; i < count; i++) {
+        results[i] = sigfox_async.results[(sigfox_async.results_head + i) % SIGFOX_ASYNC_RESULTS_MAX];
+    }
+    sigfox_async.results_head = 0;
+    sigfox_async.results_count = 0;
+    portEXIT_CRITICAL(&sigfox_async.mux);
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (uint8_t i = 0; i < count; i++) {
+        mp_obj_t tuple[3];
+        tuple[0] = mp_obj_new_int_from_uint(results[i].id);
+        tuple[1] = MP_OBJ_NEW_SMALL_INT(results[i].err);
+        tuple[2] = (results[i].rx_len < 0) ? mp_const_none : mp_obj_new_bytes(results[i].rx, results[i].rx_len);
+        mp_obj_list_append(list, mp_obj_new_tuple(3, tuple));
+    }
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(sigfox_completed_obj, sigfox_completed);
+
+/// \method pending()
+/// Number of queued messages, the one being sent included
+STATIC mp_obj_t sigfox_pending(mp_obj_t self_in) {
+    mp_uint_t pending = (sigfox_async.queue != NULL) ? uxQueueMessagesWaiting(sigfox_async.queue) : 0;
+    return mp_obj_new_int_from_uint(pending);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(sigfox_pending_obj, sigfox_pending);
+
+/// \method callback(trigger, handler, arg)
+STATIC mp_obj_t sigfox_callback(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_trigger,      MP_ARG_REQUIRED | MP_ARG_OBJ,   },
+        { MP_QSTR_handler,      MP_ARG_OBJ,                     {.u_obj = mp_const_none} },
+        { MP_QSTR_arg,          MP_ARG_OBJ,                     {.u_obj = mp_const_none} },
+    };
+
+    // parse arguments
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+    sigfox_obj_t *self = pos_args[0];
+
+    // enable the callback
+    if (args[0].u_obj != mp_const_none && args[1].u_obj != mp_const_none) {
+        sigfox_async.handler_arg = (args[2].u_obj == mp_const_none) ? self : args[2].u_obj;
+        sigfox_async.handler = args[1].u_obj;
+        mp_irq_add(self, args[1].u_obj);
+        sigfox_async.trigger = mp_obj_get_int(args[0].u_obj);
+    } else {
+        sigfox_async.trigger = 0;
+        mp_irq_remove(self);
+        sigfox_async.handler = MP_OBJ_NULL;
+        sigfox_async.handler_arg = MP_OBJ_NULL;
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(sigfox_callback_obj, 1, sigfox_callback);
+
+STATIC mp_obj_t sigfox_events(mp_obj_t self_in) {
+    portENTER_CRITICAL(&sigfox_async.mux);
+    uint32_t events = sigfox_async.events;
+    sigfox_async.events = 0;
+    portEXIT_CRITICAL(&sigfox_async.mux);
+    return mp_obj_new_int(events);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(sigfox_events_obj, sigfox_events);
+
 
 STATIC const mp_map_elem_t sigfox_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_init),                (mp_obj_t)&sigfox_init_obj },
@@ -105,6 +411,11 @@ STATIC const mp_map_elem_t sigfox_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_freq_offset),         (mp_obj_t)&sigfox_freq_offset_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_info),                (mp_obj_t)&sigfox_info_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_reset),               (mp_obj_t)&sigfox_reset_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_send_async),          (mp_obj_t)&sigfox_send_async_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_completed),           (mp_obj_t)&sigfox_completed_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_pending),             (mp_obj_t)&sigfox_pending_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_callback),            (mp_obj_t)&sigfox_callback_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_events),              (mp_obj_t)&sigfox_events_obj },
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_SIGFOX),              MP_OBJ_NEW_SMALL_INT(E_SIGFOX_MODE_SIGFOX) },
 #if !defined(FIPY) && !defined(LOPY4)
@@ -115,6 +426,10 @@ STATIC const mp_map_elem_t sigfox_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_RCZ2),                MP_OBJ_NEW_SMALL_INT(E_SIGFOX_RCZ2) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_RCZ3),                MP_OBJ_NEW_SMALL_INT(E_SIGFOX_RCZ3) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_RCZ4),                MP_OBJ_NEW_SMALL_INT(E_SIGFOX_RCZ4) },
+
+    { MP_OBJ_NEW_QSTR(MP_QSTR_TX_PACKET_EVENT),     MP_OBJ_NEW_SMALL_INT(SIGFOX_TX_PACKET_EVENT) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_RX_PACKET_EVENT),     MP_OBJ_NEW_SMALL_INT(SIGFOX_RX_PACKET_EVENT) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_TX_FAILED_EVENT),     MP_OBJ_NEW_SMALL_INT(SIGFOX_TX_FAILED_EVENT) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(sigfox_locals_dict, sigfox_locals_dict_table);
@@ -129,7 +444,7 @@ const mod_network_nic_type_t mod_network_nic_type_sigfox = {
 
     .n_socket = sigfox_socket_socket,
     .n_close = sigfox_socket_close,
-    .n_send = sigfox_socket_send,
+    .n_send = sigfox_socket_send_locked,
     .n_recv = sigfox_socket_recv,
     .n_settimeout = sigfox_socket_settimeout,
     .n_setsockopt = sigfox_socket_setsockopt,
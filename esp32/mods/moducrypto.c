@@ -17,13 +17,16 @@
 #include "hwcrypto/aes.h"
 #include "hwcrypto/sha.h"
 #include "mpexception.h"
+#include "random.h"
 #include "mbedtls/entropy.h"
 #include "mbedtls/pk.h"
 #include "mbedtls/ctr_drbg.h"
+#include "mbedtls/gcm.h"
 
 /******************************************************************************
  DEFINE CONSTANTS
  ******************************************************************************/
+#define CRYPT_BLOCK_SIZE                        (16)
 
 /******************************************************************************
  DEFINE PRIVATE TYPES
@@ -33,8 +36,16 @@ typedef enum {
     CRYPT_MODE_CBC = 2,
     CRYPT_MODE_CFB = 3,
     CRYPT_MODE_CTR = 6,
+    CRYPT_MODE_CCM = 8,
+    CRYPT_MODE_GCM = 11,
 } crypt_mode_t;
 
+typedef enum {
+    CRYPT_AEAD_AAD = 0,     // still taking associated data
+    CRYPT_AEAD_DATA,        // message being processed
+    CRYPT_AEAD_DONE,        // tag computed
+} crypt_aead_state_t;
+
 typedef enum {
     CRYPT_SEGMENT_8 = 8,
     CRYPT_SEGMENT_128 = 128,
@@ -42,7 +53,20 @@ typedef enum {
 
 typedef struct _mp_obj_AES_t mp_obj_AES_t;
 
-typedef mp_obj_t(*crypt_func_t)(mp_obj_AES_t *, uint32_t, const unsigned char *, uint32_t);
+typedef void(*crypt_func_t)(mp_obj_AES_t *, uint32_t, const unsigned char *, unsigned char *, uint32_t);
+
+// State of the authenticated modes (CCM and GCM)
+typedef struct _crypt_aead_t {
+    mbedtls_gcm_context gcm;    // used only in GCM
+    vstr_t aad;
+    uint8_t nonce[16];
+    uint8_t tag[16];
+    uint8_t nonce_len;
+    uint8_t mac_len;
+    crypt_aead_state_t state;
+    int8_t operation;           // -1 until the first encrypt or decrypt
+    bool partial;               // GCM: the last part wasn't a multiple of 16 bytes
+} crypt_aead_t;
 
 typedef struct _mp_obj_AES_t {
     mp_obj_base_t base;
@@ -55,54 +79,51 @@ typedef struct _mp_obj_AES_t {
     uint8_t stream[16]; // used only in CTR
     uint32_t offset;
     crypt_func_t crypt_func;
+    crypt_aead_t *aead; // used only in CCM and GCM
+    crypt_mode_t mode;
 } mp_obj_AES_t;
 
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
-STATIC mp_obj_t aes_do_ecb(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, uint32_t len);
-STATIC mp_obj_t aes_do_cbc(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, uint32_t len);
-STATIC mp_obj_t aes_do_cfb(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, uint32_t len);
-STATIC mp_obj_t aes_do_ctr(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, uint32_t len);
+STATIC void aes_do_ecb(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len);
+STATIC void aes_do_cbc(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len);
+STATIC void aes_do_cfb(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len);
+STATIC void aes_do_ctr(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len);
+STATIC void aes_do_ccm(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len);
+STATIC void aes_do_gcm(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len);
 
 /******************************************************************************
  DEFINE PRIVATE FUNCTIONS
  ******************************************************************************/
 
-STATIC mp_obj_t aes_do_ecb(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, uint32_t len) {
+// All modes can work in place, i.e. with output == input
+STATIC void aes_do_ecb(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len) {
     int i;
-    uint8_t *output = m_new(uint8_t, len);
-    uint8_t *tmp = output;
 
     if ((len % 16) != 0) {
         mp_raise_ValueError("Input strings must be a multiple of 16 in length");
     }
 
     for (i = len / 16; i > 0; i--) {
-        esp_aes_crypt_ecb(&self->ctx, operation, input, tmp);
+        esp_aes_crypt_ecb(&self->ctx, operation, input, output);
         input += 16;
-        tmp += 16;
+        output += 16;
     }
-
-    return mp_obj_new_bytes(output, len);
 }
 
-STATIC mp_obj_t aes_do_cbc(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, uint32_t len) {
+STATIC void aes_do_cbc(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len) {
     int result;
-    uint8_t *output = m_new(uint8_t, len);
 
     result = esp_aes_crypt_cbc(&self->ctx, operation, len, self->u.IV, input, output);
 
     if (result == ERR_ESP_AES_INVALID_INPUT_LENGTH) {
         mp_raise_ValueError("Input strings must be a multiple of 16 in length");
     }
-
-    return mp_obj_new_bytes(output, len);
 }
 
-STATIC mp_obj_t aes_do_cfb(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, uint32_t len) {
+STATIC void aes_do_cfb(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len) {
     int result;
-    uint8_t *output = m_new(uint8_t, len);
 
     if (self->segment_size == CRYPT_SEGMENT_128) {
         result = esp_aes_crypt_cfb128(&self->ctx, operation, len, &self->offset, self->u.IV, input, output);
@@ -113,39 +134,295 @@ STATIC mp_obj_t aes_do_cfb(mp_obj_AES_t *self, uint32_t operation, const unsigne
     if (result == ERR_ESP_AES_INVALID_INPUT_LENGTH) {
         mp_raise_ValueError("Input strings must be a multiple of 16 in length");
     }
+}
 
-    return mp_obj_new_bytes(output, len);
+STATIC void aes_do_ctr(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len) {
+    esp_aes_crypt_ctr(&self->ctx, len, &self->offset, self->u.counter, self->stream, input, output);
 }
 
-STATIC mp_obj_t aes_do_ctr(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, uint32_t len) {
-    uint8_t *output = m_new(uint8_t, len);
+STATIC crypt_aead_t *aead_get(mp_obj_AES_t *self) {
+    if (self->aead == NULL) {
+        mp_raise_msg(&mp_type_TypeError, "only available in the CCM and GCM modes");
+    }
+    return self->aead;
+}
 
-    esp_aes_crypt_ctr(&self->ctx, len, &self->offset, self->u.counter, self->stream, input, output);
+// Moves from the associated data to the message, in the given direction
+STATIC void aead_start(mp_obj_AES_t *self, uint32_t operation) {
+    crypt_aead_t *aead = self->aead;
 
-    return mp_obj_new_bytes(output, len);
+    if (aead->state == CRYPT_AEAD_DONE) {
+        mp_raise_msg(&mp_type_TypeError, "the message is already complete");
+    }
+    if (aead->state == CRYPT_AEAD_DATA) {
+        if ((uint32_t)aead->operation != operation) {
+            mp_raise_msg(&mp_type_TypeError, "encrypt() and decrypt() can't be mixed");
+        }
+        return;
+    }
+
+    aead->state = CRYPT_AEAD_DATA;
+    aead->operation = operation;
+    if (self->mode == CRYPT_MODE_GCM) {
+        mbedtls_gcm_starts(&aead->gcm, operation == ESP_AES_ENCRYPT ? MBEDTLS_GCM_ENCRYPT : MBEDTLS_GCM_DECRYPT,
+                           aead->nonce, aead->nonce_len, (const unsigned char *)aead->aad.buf, aead->aad.len);
+    }
 }
 
-STATIC mp_obj_t AES_decrypt(mp_obj_t self_in, mp_obj_t ciphertext) {
+// CBC-MAC of len bytes into x, the last block is zero padded
+STATIC void ccm_cbc_mac(mp_obj_AES_t *self, uint8_t *x, const unsigned char *data, size_t len) {
+    while (len > 0) {
+        size_t n = MIN(len, CRYPT_BLOCK_SIZE);
+        for (size_t i = 0; i < n; i++) {
+            x[i] ^= data[i];
+        }
+        esp_aes_crypt_ecb(&self->ctx, ESP_AES_ENCRYPT, x, x);
+        data += n;
+        len -= n;
+    }
+}
+
+// CCM as in RFC 3610 / NIST SP 800-38C, the whole message at once, as its
+// length goes into the first block of the MAC
+STATIC void aes_do_ccm(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len) {
+    crypt_aead_t *aead = self->aead;
+    uint8_t q = 15 - aead->nonce_len;  // size of the length field
+    uint8_t x[CRYPT_BLOCK_SIZE];
+    uint8_t ctr[CRYPT_BLOCK_SIZE];
+    uint8_t s[CRYPT_BLOCK_SIZE];
+
+    if (aead->state != CRYPT_AEAD_AAD) {
+        mp_raise_msg(&mp_type_TypeError, "CCM takes the whole message in a single call");
+    }
+    if (q < 4 && len >= (1UL << (8 * q))) {
+        mp_raise_ValueError("message too long for the nonce length");
+    }
+    aead_start(self, operation);
+
+    // B0: flags, nonce and message length
+    x[0] = (aead->aad.len > 0 ? 0x40 : 0) | (((aead->mac_len - 2) / 2) << 3) | (q - 1);
+    memcpy(x + 1, aead->nonce, aead->nonce_len);
+    for (int i = 0; i < q; i++) {
+        x[15 - i] = (i < 4) ? (len >> (8 * i)) & 0xFF : 0;
+    }
+    esp_aes_crypt_ecb(&self->ctx, ESP_AES_ENCRYPT, x, x);
+
+    // the associated data, prefixed with its length
+    if (aead->aad.len > 0) {
+        uint8_t b[CRYPT_BLOCK_SIZE] = { 0 };
+        size_t alen = aead->aad.len;
+        size_t hlen;
+        if (alen < 0xFF00) {
+            b[0] = alen >> 8;
+            b[1] = alen;
+            hlen = 2;
+        } else {
+            b[0] = 0xFF;
+            b[1] = 0xFE;
+            b[2] = alen >> 24;
+            b[3] = alen >> 16;
+            b[4] = alen >> 8;
+            b[5] = alen;
+            hlen = 6;
+        }
+        size_t n = MIN(alen, CRYPT_BLOCK_SIZE - hlen);
+        memcpy(b + hlen, aead->aad.buf, n);
+        ccm_cbc_mac(self, x, b, CRYPT_BLOCK_SIZE);
+        ccm_cbc_mac(self, x, (const unsigned char *)aead->aad.buf + n, alen - n);
+    }
+
+    // the message, in counter mode starting at 1; the MAC is over the plaintext
+    memset(ctr, 0, sizeof(ctr));
+    ctr[0] = q - 1;
+    memcpy(ctr + 1, aead->nonce, aead->nonce_len);
+    while (len > 0) {
+        size_t n = MIN(len, CRYPT_BLOCK_SIZE);
+        for (int i = 15; i > 15 - q; i--) {
+            if (++ctr[i] != 0) {
+                break;
+            }
+        }
+        esp_aes_crypt_ecb(&self->ctx, ESP_AES_ENCRYPT, ctr, s);
+        if (operation == ESP_AES_ENCRYPT) {
+            ccm_cbc_mac(self, x, input, n);
+        }
+        for (size_t i = 0; i < n; i++) {
+            output[i] = input[i] ^ s[i];
+        }
+        if (operation == ESP_AES_DECRYPT) {
+            ccm_cbc_mac(self, x, output, n);
+        }
+        input += n;
+        output += n;
+        len -= n;
+    }
+
+    // the tag is the MAC encrypted with counter 0
+    memset(ctr + 16 - q, 0, q);
+    esp_aes_crypt_ecb(&self->ctx, ESP_AES_ENCRYPT, ctr, s);
+    for (int i = 0; i < aead->mac_len; i++) {
+        aead->tag[i] = x[i] ^ s[i];
+    }
+
+    aead->state = CRYPT_AEAD_DONE;
+    vstr_clear(&aead->aad);
+}
+
+STATIC void aes_do_gcm(mp_obj_AES_t *self, uint32_t operation, const unsigned char *input, unsigned char *output, uint32_t len) {
+    crypt_aead_t *aead = self->aead;
+
+    aead_start(self, operation);
+    if (aead->partial) {
+        mp_raise_ValueError("only the last part of the message can be other than a multiple of 16 in length");
+    }
+    aead->partial = (len % 16) != 0;
+    mbedtls_gcm_update(&aead->gcm, len, input, output);
+}
+
+STATIC void aead_finish(mp_obj_AES_t *self) {
+    crypt_aead_t *aead = aead_get(self);
+
+    if (aead->state == CRYPT_AEAD_DONE) {
+        return;
+    }
+    if (self->mode == CRYPT_MODE_CCM) {
+        // authenticate the associated data only
+        aes_do_ccm(self, ESP_AES_ENCRYPT, NULL, NULL, 0);
+        return;
+    }
+    aead_start(self, aead->state == CRYPT_AEAD_DATA ? aead->operation : ESP_AES_ENCRYPT);
+    mbedtls_gcm_finish(&aead->gcm, aead->tag, aead->mac_len);
+    mbedtls_gcm_free(&aead->gcm);
+    aead->state = CRYPT_AEAD_DONE;
+    vstr_clear(&aead->aad);
+}
+
+STATIC mp_obj_t aes_crypt(mp_obj_t self_in, uint32_t operation, mp_obj_t data) {
     mp_obj_AES_t *self = self_in;
     mp_buffer_info_t bufinfo;
+    vstr_t vstr;
+
+    mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+    vstr_init_len(&vstr, bufinfo.len);
+    self->crypt_func(self, operation, bufinfo.buf, (unsigned char *)vstr.buf, bufinfo.len);
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+
+STATIC mp_obj_t aes_crypt_into(mp_obj_t self_in, uint32_t operation, mp_obj_t src, mp_obj_t dst) {
+    mp_obj_AES_t *self = self_in;
+    mp_buffer_info_t srcinfo;
+    mp_buffer_info_t dstinfo;
 
-    mp_get_buffer_raise(ciphertext, &bufinfo, MP_BUFFER_READ);
-    return self->crypt_func(self, ESP_AES_DECRYPT, bufinfo.buf, bufinfo.len);
+    mp_get_buffer_raise(src, &srcinfo, MP_BUFFER_READ);
+    mp_get_buffer_raise(dst, &dstinfo, MP_BUFFER_WRITE);
+    if (dstinfo.len < srcinfo.len) {
+        mp_raise_ValueError("output buffer too small");
+    }
+    self->crypt_func(self, operation, srcinfo.buf, dstinfo.buf, srcinfo.len);
+    return mp_const_none;
+}
+
+STATIC mp_obj_t AES_decrypt(mp_obj_t self_in, mp_obj_t ciphertext) {
+    return aes_crypt(self_in, ESP_AES_DECRYPT, ciphertext);
 }
 MP_DEFINE_CONST_FUN_OBJ_2(AES_decrypt_obj, AES_decrypt);
 
 STATIC mp_obj_t AES_encrypt(mp_obj_t self_in, mp_obj_t plaintext) {
+    return aes_crypt(self_in, ESP_AES_ENCRYPT, plaintext);
+}
+MP_DEFINE_CONST_FUN_OBJ_2(AES_encrypt_obj, AES_encrypt);
+
+STATIC mp_obj_t AES_decrypt_into(mp_obj_t self_in, mp_obj_t ciphertext, mp_obj_t output) {
+    return aes_crypt_into(self_in, ESP_AES_DECRYPT, ciphertext, output);
+}
+MP_DEFINE_CONST_FUN_OBJ_3(AES_decrypt_into_obj, AES_decrypt_into);
+
+STATIC mp_obj_t AES_encrypt_into(mp_obj_t self_in, mp_obj_t plaintext, mp_obj_t output) {
+    return aes_crypt_into(self_in, ESP_AES_ENCRYPT, plaintext, output);
+}
+MP_DEFINE_CONST_FUN_OBJ_3(AES_encrypt_into_obj, AES_encrypt_into);
+
+STATIC mp_obj_t AES_update(mp_obj_t self_in, mp_obj_t assoc_data) {
     mp_obj_AES_t *self = self_in;
+    crypt_aead_t *aead = aead_get(self);
     mp_buffer_info_t bufinfo;
 
-    mp_get_buffer_raise(plaintext, &bufinfo, MP_BUFFER_READ);
-    return self->crypt_func(self, ESP_AES_ENCRYPT, bufinfo.buf, bufinfo.len);
+    if (aead->state != CRYPT_AEAD_AAD) {
+        mp_raise_msg(&mp_type_TypeError, "update() can only be called before encrypt() or decrypt()");
+    }
+    mp_get_buffer_raise(assoc_data, &bufinfo, MP_BUFFER_READ);
+    vstr_add_strn(&aead->aad, bufinfo.buf, bufinfo.len);
+    return mp_const_none;
 }
-MP_DEFINE_CONST_FUN_OBJ_2(AES_encrypt_obj, AES_encrypt);
+MP_DEFINE_CONST_FUN_OBJ_2(AES_update_obj, AES_update);
+
+STATIC mp_obj_t AES_digest(mp_obj_t self_in) {
+    mp_obj_AES_t *self = self_in;
+
+    aead_finish(self);
+    return mp_obj_new_bytes(self->aead->tag, self->aead->mac_len);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(AES_digest_obj, AES_digest);
+
+STATIC mp_obj_t AES_verify(mp_obj_t self_in, mp_obj_t mac_tag) {
+    mp_obj_AES_t *self = self_in;
+    mp_buffer_info_t bufinfo;
+
+    aead_finish(self);
+    mp_get_buffer_raise(mac_tag, &bufinfo, MP_BUFFER_READ);
+
+    // constant time compare
+    uint8_t diff = (bufinfo.len != self->aead->mac_len);
+    for (size_t i = 0; i < self->aead->mac_len; i++) {
+        diff |= self->aead->tag[i] ^ ((i < bufinfo.len) ? ((uint8_t *)bufinfo.buf)[i] : 0);
+    }
+    if (diff != 0) {
+        mp_raise_ValueError("MAC check failed");
+    }
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_2(AES_verify_obj, AES_verify);
+
+STATIC mp_obj_t AES_encrypt_and_digest(mp_obj_t self_in, mp_obj_t plaintext) {
+    aead_get(self_in);
+    mp_obj_t tuple[2];
+    tuple[0] = aes_crypt(self_in, ESP_AES_ENCRYPT, plaintext);
+    tuple[1] = AES_digest(self_in);
+    return mp_obj_new_tuple(2, tuple);
+}
+MP_DEFINE_CONST_FUN_OBJ_2(AES_encrypt_and_digest_obj, AES_encrypt_and_digest);
+
+STATIC mp_obj_t AES_decrypt_and_verify(mp_obj_t self_in, mp_obj_t ciphertext, mp_obj_t mac_tag) {
+    aead_get(self_in);
+    mp_obj_t plaintext = aes_crypt(self_in, ESP_AES_DECRYPT, ciphertext);
+    AES_verify(self_in, mac_tag);
+    return plaintext;
+}
+MP_DEFINE_CONST_FUN_OBJ_3(AES_decrypt_and_verify_obj, AES_decrypt_and_verify);
+
+// Releases the GCM context, which mbedtls allocates outside of the GC heap
+STATIC mp_obj_t AES_del(mp_obj_t self_in) {
+    mp_obj_AES_t *self = self_in;
+
+    if (self->mode == CRYPT_MODE_GCM && self->aead != NULL && self->aead->state != CRYPT_AEAD_DONE) {
+        mbedtls_gcm_free(&self->aead->gcm);
+        self->aead->state = CRYPT_AEAD_DONE;
+    }
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(AES_del_obj, AES_del);
 
 STATIC const mp_map_elem_t AES_locals_dict_table[] = {
-    { MP_OBJ_NEW_QSTR(MP_QSTR_decrypt),    (mp_obj_t) &AES_decrypt_obj },
-    { MP_OBJ_NEW_QSTR(MP_QSTR_encrypt),    (mp_obj_t) &AES_encrypt_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_decrypt),            (mp_obj_t) &AES_decrypt_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_encrypt),            (mp_obj_t) &AES_encrypt_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_decrypt_into),       (mp_obj_t) &AES_decrypt_into_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_encrypt_into),       (mp_obj_t) &AES_encrypt_into_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_update),             (mp_obj_t) &AES_update_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_digest),             (mp_obj_t) &AES_digest_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_verify),             (mp_obj_t) &AES_verify_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_encrypt_and_digest), (mp_obj_t) &AES_encrypt_and_digest_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_decrypt_and_verify), (mp_obj_t) &AES_decrypt_and_verify_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR___del__),            (mp_obj_t) &AES_del_obj },
 };
 
 STATIC MP_DEFINE_CONST_DICT(AES_locals_dict, AES_locals_dict_table);
@@ -171,6 +448,8 @@ STATIC mp_obj_t AES_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uin
         { MP_QSTR_IV,           MP_ARG_OBJ,                     {.u_obj = mp_const_none} },
         { MP_QSTR_counter,      MP_ARG_OBJ,                     {.u_obj = mp_const_none} },
         { MP_QSTR_segment_size, MP_ARG_INT,                     {.u_int = -1} },
+        { MP_QSTR_nonce,        MP_ARG_KW_ONLY | MP_ARG_OBJ,    {.u_obj = mp_const_none} },
+        { MP_QSTR_mac_len,      MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = 16} },
     };
 
     // parse arguments
@@ -179,12 +458,18 @@ STATIC mp_obj_t AES_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uin
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args, all_args, &kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
 
-    // and store them
-    mp_obj_AES_t *self = m_new_obj(mp_obj_AES_t);
+    // and store them, the GCM context needs to be released when collected
+    mp_obj_AES_t *self;
+    if (args[1].u_int == CRYPT_MODE_GCM) {
+        self = m_new_obj_with_finaliser(mp_obj_AES_t);
+    } else {
+        self = m_new_obj(mp_obj_AES_t);
+    }
     mp_buffer_info_t bufinfo;
 
     self->base.type = &AESCipher_type;
     self->offset = 0;
+    self->aead = NULL;
 
     // store the key
     mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
@@ -198,6 +483,7 @@ STATIC mp_obj_t AES_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uin
     // store the mode
     crypt_mode_t mode;
     mode = args[1].u_int;
+    self->mode = mode;
 
     switch (mode) {
     case CRYPT_MODE_ECB:
@@ -216,15 +502,25 @@ STATIC mp_obj_t AES_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uin
         self->crypt_func = &aes_do_ctr;
         break;
 
+    case CRYPT_MODE_CCM:
+        self->crypt_func = &aes_do_ccm;
+        break;
+
+    case CRYPT_MODE_GCM:
+        self->crypt_func = &aes_do_gcm;
+        break;
+
     default:
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError,
             "Unknown cipher feedback mode %d", mode));
         break;
     }
 
-    // store the IV (ignored in ECB & CTR)
+    // store the IV (ignored in ECB & CTR, the nonce in CCM & GCM)
     if (mode != CRYPT_MODE_ECB &&
         mode != CRYPT_MODE_CTR &&
+        mode != CRYPT_MODE_CCM &&
+        mode != CRYPT_MODE_GCM &&
         args[2].u_obj != mp_const_none
     ) {
         mp_get_buffer_raise(args[2].u_obj, &bufinfo, MP_BUFFER_READ);
@@ -258,11 +554,58 @@ STATIC mp_obj_t AES_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uin
         mp_raise_ValueError("segment_size must be 8 or 128"); // for CFB
     }
 
+    // the nonce and the tag length of the authenticated modes
+    if (mode == CRYPT_MODE_CCM || mode == CRYPT_MODE_GCM) {
+        mp_obj_t nonce = (args[5].u_obj != mp_const_none) ? args[5].u_obj : args[2].u_obj;
+        if (nonce == mp_const_none) {
+            mp_raise_ValueError("a nonce is required in CCM and GCM modes");
+        }
+        mp_get_buffer_raise(nonce, &bufinfo, MP_BUFFER_READ);
+
+        mp_int_t mac_len = args[6].u_int;
+        if (mode == CRYPT_MODE_CCM) {
+            if (bufinfo.len < 7 || bufinfo.len > 13) {
+                mp_raise_ValueError("CCM nonce must be 7 to 13 bytes long");
+            }
+            if (mac_len < 4 || mac_len > 16 || (mac_len & 1)) {
+                mp_raise_ValueError("CCM mac_len must be even, from 4 to 16");
+            }
+        } else {
+            if (bufinfo.len < 1 || bufinfo.len > 16) {
+                mp_raise_ValueError("GCM nonce must be 1 to 16 bytes long");
+            }
+            if (mac_len < 4 || mac_len > 16) {
+                mp_raise_ValueError("GCM mac_len must be from 4 to 16");
+            }
+        }
+
+        crypt_aead_t *aead = m_new_obj(crypt_aead_t);
+        memset(aead, 0, sizeof(crypt_aead_t));
+        memcpy(aead->nonce, bufinfo.buf, bufinfo.len);
+        aead->nonce_len = bufinfo.len;
+        aead->mac_len = mac_len;
+        aead->state = CRYPT_AEAD_AAD;
+        aead->operation = -1;
+        vstr_init(&aead->aad, 0);
+
+        if (mode == CRYPT_MODE_GCM) {
+            mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
+            mbedtls_gcm_init(&aead->gcm);
+            if (mbedtls_gcm_setkey(&aead->gcm, MBEDTLS_CIPHER_ID_AES, bufinfo.buf, bufinfo.len * 8) != 0) {
+                mbedtls_gcm_free(&aead->gcm);
+                nlr_raise(mp_obj_new_exception(&mp_type_MemoryError));
+            }
+        }
+        self->aead = aead;
+    } else if (args[5].u_obj != mp_const_none) {
+        mp_raise_ValueError("'nonce' parameter only useful with CCM and GCM modes");
+    }
+
     return self;
 }
 
 STATIC mp_obj_t getrandbits(mp_obj_t bits) {
-    uint32_t num_cycles, i;
+    uint32_t num_cycles;
     vstr_t vstr;
 
     num_cycles = mp_obj_get_int(bits);
@@ -270,9 +613,7 @@ STATIC mp_obj_t getrandbits(mp_obj_t bits) {
     num_cycles >>= 5;
 
     vstr_init_len(&vstr, num_cycles << 2); // going to get 32 bit integers (4 bytes)
-    for (i = 0; i < num_cycles; i++) {
-        *((uint32_t *) (vstr.buf + (i << 2))) = esp_random();
-    }
+    rng_fill((uint8_t *)vstr.buf, num_cycles << 2);
 
     return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
 }
@@ -479,6 +820,8 @@ STATIC const mp_map_elem_t mp_module_AES_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_MODE_CBC),            MP_OBJ_NEW_SMALL_INT(CRYPT_MODE_CBC) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_MODE_CFB),            MP_OBJ_NEW_SMALL_INT(CRYPT_MODE_CFB) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_MODE_CTR),            MP_OBJ_NEW_SMALL_INT(CRYPT_MODE_CTR) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_MODE_CCM),            MP_OBJ_NEW_SMALL_INT(CRYPT_MODE_CCM) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_MODE_GCM),            MP_OBJ_NEW_SMALL_INT(CRYPT_MODE_GCM) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_SEGMENT_8),           MP_OBJ_NEW_SMALL_INT(CRYPT_SEGMENT_8) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_SEGMENT_128),         MP_OBJ_NEW_SMALL_INT(CRYPT_SEGMENT_128) },
 };
@@ -17,6 +17,7 @@
 #include "py/mpconfig.h"
 #include "py/nlr.h"
 #include "py/runtime.h"
+#include "py/objstr.h"
 #include "sha1_alt.h"
 #include "sha256_alt.h"
 #include "sha512_alt.h"
@@ -27,6 +28,18 @@
 #include "mbedtls/sha256.h"
 #include "mbedtls/sha512.h"
 
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+// Below this many bytes the cost of locking the SHA engine outweighs its speed,
+// so such messages are hashed in software
+#define HASH_ACCEL_MIN_LEN                  (512)
+// Updates at least this long are hashed with the GIL released
+#define HASH_GIL_RELEASE_LEN                (4096)
+
+#define HMAC_IPAD                           (0x36)
+#define HMAC_OPAD                           (0x5C)
+
 STATIC bool hash_busy = false;
 
 /******************************************************************************
@@ -38,6 +51,7 @@ typedef struct _mp_obj_hash_t {
     uint8_t  h_size;
     uint8_t  buf_count;
     bool  digested;
+    bool  started;
     uint8_t buffer[128];
     union {
         struct MD5Context md5_context;
@@ -47,11 +61,19 @@ typedef struct _mp_obj_hash_t {
     }u;
 } mp_obj_hash_t;
 
+typedef struct _mp_obj_hmac_t {
+    mp_obj_base_t base;
+    mp_obj_hash_t inner;
+    uint8_t okey[128];
+} mp_obj_hmac_t;
+
 
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
-STATIC void hash_update_internal(mp_obj_t self_in, mp_obj_t data, bool digest);
+STATIC void hash_init (mp_obj_hash_t *self, const mp_obj_type_t *type);
+STATIC void hash_update_internal (mp_obj_hash_t *self, const uint8_t *data, size_t len);
+STATIC void hash_finish (mp_obj_hash_t *self);
 STATIC mp_obj_t hash_read (mp_obj_t self_in);
 
 /******************************************************************************
@@ -59,142 +81,67 @@ STATIC mp_obj_t hash_read (mp_obj_t self_in);
  ******************************************************************************/
 
 
-STATIC void generic_hash_update(mp_obj_hash_t *self, void *data, uint32_t len) {
+// The SHA engine can't resume from a state computed in software, so the
+// choice is made once, when the first block is processed, by looking at how
+// much data is at hand. If the engine is in use the mbedtls port falls back
+// to software by itself.
+STATIC void hash_select_engine(mp_obj_hash_t *self, size_t avail) {
+    if (avail >= HASH_ACCEL_MIN_LEN) {
+        return;
+    }
     switch (self->base.type->name) {
     case MP_QSTR_sha1:
-        mbedtls_sha1_update_ret(&self->u.sha1_context, data, len);
+        self->u.sha1_context.mode = ESP_MBEDTLS_SHA1_SOFTWARE;
         break;
 
     case MP_QSTR_sha224:
     case MP_QSTR_sha256:
-        mbedtls_sha256_update_ret(&self->u.sha256_context, data, len);
+        self->u.sha256_context.mode = ESP_MBEDTLS_SHA256_SOFTWARE;
         break;
 
     case MP_QSTR_sha384:
     case MP_QSTR_sha512:
-        mbedtls_sha512_update_ret(&self->u.sha512_context, data, len);
+        self->u.sha512_context.mode = ESP_MBEDTLS_SHA512_SOFTWARE;
         break;
 
-    case MP_QSTR_md5:
-        MD5Update(&self->u.md5_context, data, len);
+    default:
+        // md5 is always done in software
         break;
     }
 }
 
-STATIC void hash_update_internal(mp_obj_t self_in, mp_obj_t data, bool digest) {
-    mp_obj_hash_t *self = self_in;
-    mp_buffer_info_t bufinfo;
-    uint32_t len;
-
-    if (digest == true) {
-        generic_hash_update(self, self->buffer, self->buf_count);
-        return;
-    }
-
-    if (!data) {
-        return;
-    }
-
-    mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
-
-    // Try to fill the buffer to the top
-    len = self->b_size - self->buf_count;
-    len = MIN(len, bufinfo.len);
-
-    memcpy(self->buffer + self->buf_count, bufinfo.buf, len);
-
-    self->buf_count += len;
-
-    // check if there is a complete block
-    if (self->buf_count != self->b_size && digest == false) {
-        return;
+STATIC void generic_hash_update(mp_obj_hash_t *self, const void *data, uint32_t len, size_t avail) {
+    if (!self->started) {
+        self->started = true;
+        hash_select_engine(self, avail);
     }
 
-    // process it
-    generic_hash_update(self, self->buffer, self->buf_count);
-    self->buf_count = 0;
-
-    // update the input string information
-    bufinfo.buf = ((uint8_t *) bufinfo.buf) + len;
-    bufinfo.len -= len;
-
-    // see if there is at least another complete block
-    len = bufinfo.len / self->b_size;
-    if (len != 0) {
-        // process it (them)
-        len *= self->b_size;
-        generic_hash_update(self, bufinfo.buf, len);
-
-        // update the input string information
-        bufinfo.buf = ((uint8_t *) bufinfo.buf) + len;
-        bufinfo.len -= len;
-    }
-
-    // and copy any remaining bytes to the buffer
-    memcpy(self->buffer, bufinfo.buf, bufinfo.len);
-    self->buf_count = bufinfo.len;
-}
+    switch (self->base.type->name) {
+    case MP_QSTR_sha1:
+        mbedtls_sha1_update_ret(&self->u.sha1_context, data, len);
+        break;
 
-STATIC mp_obj_t hash_read(mp_obj_t self_in) {
-    mp_obj_hash_t *self = self_in;
+    case MP_QSTR_sha224:
+    case MP_QSTR_sha256:
+        mbedtls_sha256_update_ret(&self->u.sha256_context, data, len);
+        break;
 
-    if (!self->digested) {
-        // process any remaining data in the buffer
-        hash_update_internal(self, MP_OBJ_NULL, true);
-
-        switch (self->base.type->name) {
-        case MP_QSTR_sha1:
-            mbedtls_sha1_finish_ret(&self->u.sha1_context, (uint8_t *)self->buffer);
-            mbedtls_sha1_free(&self->u.sha1_context);
-            break;
-
-        case MP_QSTR_sha224:
-        case MP_QSTR_sha256:
-            mbedtls_sha256_finish_ret(&self->u.sha256_context, (uint8_t *)self->buffer);
-            mbedtls_sha256_free(&self->u.sha256_context);
-            break;
-
-        case MP_QSTR_sha384:
-        case MP_QSTR_sha512:
-            mbedtls_sha512_finish_ret(&self->u.sha512_context, (uint8_t *)self->buffer);
-            mbedtls_sha512_free(&self->u.sha512_context);
-            break;
-
-        case MP_QSTR_md5:
-            MD5Final((uint8_t *)self->buffer, &self->u.md5_context);
-            break;
-        }
+    case MP_QSTR_sha384:
+    case MP_QSTR_sha512:
+        mbedtls_sha512_update_ret(&self->u.sha512_context, data, len);
+        break;
 
-        self->digested = true;
-        hash_busy = false;
+    case MP_QSTR_md5:
+        MD5Update(&self->u.md5_context, (const unsigned char *)data, len);
+        break;
     }
-
-    return mp_obj_new_bytes(self->buffer, self->h_size);
 }
 
-/******************************************************************************/
-// Micro Python bindings
-
-/// \classmethod \constructor([data])
-/// initial data must be given if block_size wants to be passed
-STATIC mp_obj_t hash_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
-    mp_arg_check_num(n_args, n_kw, 0, 1, false);
-
-
-    if (hash_busy == true) {
-        mp_raise_msg(&mp_type_OSError, "only one active hash operation is permitted at a time");
-    }
-
-    hash_busy = true;
-
-    mp_obj_hash_t *self = m_new_obj(mp_obj_hash_t);
-
+STATIC void hash_init(mp_obj_hash_t *self, const mp_obj_type_t *type) {
     memset(self, 0, sizeof(mp_obj_hash_t));
-
-    self->digested = false;
     self->base.type = type;
 
-    switch (self->base.type->name) {
+    switch (type->name) {
     case MP_QSTR_sha1:
         self->h_size = 20;
         self->b_size = 64;
@@ -236,9 +183,125 @@ STATIC mp_obj_t hash_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
         MD5Init(&self->u.md5_context);
         break;
     }
+}
+
+// A full buffer is only processed once more data arrives (or on digest), so
+// that the first block can be hashed by the engine best suited for the rest
+// of the message. Whole blocks are taken straight from the caller's buffer.
+STATIC void hash_update_internal(mp_obj_hash_t *self, const uint8_t *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+
+    size_t avail = self->buf_count + len;
+
+    if (self->buf_count > 0) {
+        // top up the buffer
+        size_t n = MIN(self->b_size - self->buf_count, len);
+        memcpy(self->buffer + self->buf_count, data, n);
+        self->buf_count += n;
+        data += n;
+        len -= n;
+        if (len == 0) {
+            return;
+        }
+        generic_hash_update(self, self->buffer, self->b_size, avail);
+        self->buf_count = 0;
+    }
+
+    // process the complete blocks in place
+    size_t n = len - (len % self->b_size);
+    if (n > 0) {
+        if (n >= HASH_GIL_RELEASE_LEN) {
+            MP_THREAD_GIL_EXIT();
+            generic_hash_update(self, data, n, avail);
+            MP_THREAD_GIL_ENTER();
+        } else {
+            generic_hash_update(self, data, n, avail);
+        }
+        data += n;
+        len -= n;
+    }
+
+    // and copy any remaining bytes to the buffer
+    memcpy(self->buffer, data, len);
+    self->buf_count = len;
+}
+
+// Leaves the digest at the start of self->buffer
+STATIC void hash_finish(mp_obj_hash_t *self) {
+    // process any remaining data in the buffer
+    if (self->buf_count > 0) {
+        generic_hash_update(self, self->buffer, self->buf_count, self->buf_count);
+    } else if (!self->started) {
+        hash_select_engine(self, 0);
+    }
+
+    switch (self->base.type->name) {
+    case MP_QSTR_sha1:
+        mbedtls_sha1_finish_ret(&self->u.sha1_context, (uint8_t *)self->buffer);
+        mbedtls_sha1_free(&self->u.sha1_context);
+        break;
+
+    case MP_QSTR_sha224:
+    case MP_QSTR_sha256:
+        mbedtls_sha256_finish_ret(&self->u.sha256_context, (uint8_t *)self->buffer);
+        mbedtls_sha256_free(&self->u.sha256_context);
+        break;
+
+    case MP_QSTR_sha384:
+    case MP_QSTR_sha512:
+        mbedtls_sha512_finish_ret(&self->u.sha512_context, (uint8_t *)self->buffer);
+        mbedtls_sha512_free(&self->u.sha512_context);
+        break;
+
+    case MP_QSTR_md5:
+        MD5Final((uint8_t *)self->buffer, &self->u.md5_context);
+        break;
+    }
+
+    self->digested = true;
+}
+
+STATIC void hash_update_obj_internal(mp_obj_hash_t *self, mp_obj_t data) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+    hash_update_internal(self, bufinfo.buf, bufinfo.len);
+}
+
+STATIC mp_obj_t hash_read(mp_obj_t self_in) {
+    mp_obj_hash_t *self = self_in;
+
+    if (!self->digested) {
+        hash_finish(self);
+        hash_busy = false;
+    }
+
+    return mp_obj_new_bytes(self->buffer, self->h_size);
+}
+
+STATIC void hash_take_lock(void) {
+    if (hash_busy == true) {
+        mp_raise_msg(&mp_type_OSError, "only one active hash operation is permitted at a time");
+    }
+    hash_busy = true;
+}
+
+/******************************************************************************/
+// Micro Python bindings
+
+/// \classmethod \constructor([data])
+/// initial data must be given if block_size wants to be passed
+STATIC mp_obj_t hash_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 0, 1, false);
+
+    hash_take_lock();
+
+    mp_obj_hash_t *self = m_new_obj(mp_obj_hash_t);
+    hash_init(self, type);
 
     if (n_args) {
-        hash_update_internal(self, args[0], false);
+        hash_update_obj_internal(self, args[0]);
     }
 
     return self;
@@ -247,7 +310,7 @@ STATIC mp_obj_t hash_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
 STATIC mp_obj_t hash_update(mp_obj_t self_in, mp_obj_t arg) {
     mp_obj_hash_t *self = self_in;
     if (self->digested == false) {
-        hash_update_internal(self, arg, false);
+        hash_update_obj_internal(self, arg);
     }
     return mp_const_none;
 }
@@ -307,6 +370,115 @@ STATIC const mp_obj_type_t sha512_type = {
    .locals_dict = (mp_obj_t)&hash_locals_dict,
 };
 
+STATIC const mp_obj_type_t *hash_types[] = {
+    &md5_type, &sha1_type, &sha224_type, &sha256_type, &sha384_type, &sha512_type,
+};
+
+// digestmod can be one of the hash constructors or its name
+STATIC const mp_obj_type_t *hmac_get_digestmod(mp_obj_t digestmod) {
+    for (size_t i = 0; i < MP_ARRAY_SIZE(hash_types); i++) {
+        const mp_obj_type_t *type = hash_types[i];
+        if (digestmod == (mp_obj_t)type ||
+            (MP_OBJ_IS_STR(digestmod) && mp_obj_str_get_qstr(digestmod) == type->name)) {
+            return type;
+        }
+    }
+    mp_raise_ValueError(mpexception_value_invalid_arguments);
+}
+
+/// \classmethod \constructor(key, msg=None, digestmod=sha256)
+STATIC mp_obj_t hmac_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_key,          MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_msg,          MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+        { MP_QSTR_digestmod,    MP_ARG_OBJ,  {.u_obj = (mp_obj_t)&sha256_type} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    const mp_obj_type_t *digestmod = hmac_get_digestmod(args[1].u_obj);
+    mp_buffer_info_t keyinfo;
+    mp_get_buffer_raise(args[0].u_obj, &keyinfo, MP_BUFFER_READ);
+
+    hash_take_lock();
+
+    mp_obj_hmac_t *self = m_new_obj(mp_obj_hmac_t);
+    self->base.type = type;
+
+    // keys longer than a block are hashed first
+    const uint8_t *key = keyinfo.buf;
+    size_t key_len = keyinfo.len;
+    hash_init(&self->inner, digestmod);
+    if (key_len > self->inner.b_size) {
+        hash_update_internal(&self->inner, key, key_len);
+        hash_finish(&self->inner);
+        memcpy(self->okey, self->inner.buffer, self->inner.h_size);
+        key = self->okey;
+        key_len = self->inner.h_size;
+        hash_init(&self->inner, digestmod);
+    }
+
+    // the inner pad is left in the buffer, to be processed along with the message
+    uint8_t b_size = self->inner.b_size;
+    for (size_t i = 0; i < b_size; i++) {
+        uint8_t k = (i < key_len) ? key[i] : 0;
+        self->inner.buffer[i] = k ^ HMAC_IPAD;
+        self->okey[i] = k ^ HMAC_OPAD;
+    }
+    self->inner.buf_count = b_size;
+
+    if (args[1].u_obj != mp_const_none) {
+        hash_update_obj_internal(&self->inner, args[1].u_obj);
+    }
+
+    return self;
+}
+
+STATIC mp_obj_t hmac_update(mp_obj_t self_in, mp_obj_t arg) {
+    mp_obj_hmac_t *self = self_in;
+    if (self->inner.digested == false) {
+        hash_update_obj_internal(&self->inner, arg);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(hmac_update_obj, hmac_update);
+
+STATIC mp_obj_t hmac_digest(mp_obj_t self_in) {
+    mp_obj_hmac_t *self = self_in;
+
+    if (!self->inner.digested) {
+        hash_finish(&self->inner);
+
+        // the outer hash is always short, so it never needs the engine
+        mp_obj_hash_t outer;
+        hash_init(&outer, self->inner.base.type);
+        hash_update_internal(&outer, self->okey, outer.b_size);
+        hash_update_internal(&outer, self->inner.buffer, outer.h_size);
+        hash_finish(&outer);
+
+        memcpy(self->inner.buffer, outer.buffer, outer.h_size);
+        memset(self->okey, 0, sizeof(self->okey));
+        hash_busy = false;
+    }
+
+    return mp_obj_new_bytes(self->inner.buffer, self->inner.h_size);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(hmac_digest_obj, hmac_digest);
+
+STATIC const mp_map_elem_t hmac_locals_dict_table[] = {
+    { MP_OBJ_NEW_QSTR(MP_QSTR_update),    (mp_obj_t) &hmac_update_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_digest),    (mp_obj_t) &hmac_digest_obj },
+};
+
+STATIC MP_DEFINE_CONST_DICT(hmac_locals_dict, hmac_locals_dict_table);
+
+STATIC const mp_obj_type_t hmac_type = {
+   { &mp_type_type },
+   .name = MP_QSTR_hmac,
+   .make_new = hmac_make_new,
+   .locals_dict = (mp_obj_t)&hmac_locals_dict,
+};
+
 STATIC const mp_map_elem_t mp_module_hashlib_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__),    MP_OBJ_NEW_QSTR(MP_QSTR_uhashlib) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_md5),         (mp_obj_t)&md5_type },
@@ -315,6 +487,7 @@ STATIC const mp_map_elem_t mp_module_hashlib_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_sha256),      (mp_obj_t)&sha256_type },
     { MP_OBJ_NEW_QSTR(MP_QSTR_sha384),      (mp_obj_t)&sha384_type },
     { MP_OBJ_NEW_QSTR(MP_QSTR_sha512),      (mp_obj_t)&sha512_type },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_hmac),        (mp_obj_t)&hmac_type },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_hashlib_globals, mp_module_hashlib_globals_table);
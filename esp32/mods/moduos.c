@@ -53,7 +53,9 @@
 #include "extmod/vfs.h"
 #include "extmod/vfs_fat.h"
 #include "vfs_littlefs.h"
+#include "sflash_diskio_littlefs.h"
 #include "random.h"
+#include "flashcache.h"
 #include "mpexception.h"
 #include "pybsd.h"
 #include "machuart.h"
@@ -159,17 +161,109 @@ STATIC mp_obj_t os_sync(void) {
 }
 MP_DEFINE_CONST_FUN_OBJ_0(mod_os_sync_obj, os_sync);
 
+// returns the bytes read, the bytes programmed and the blocks erased by the LittleFS flash driver
+STATIC mp_obj_t os_flash_stats(size_t n_args, const mp_obj_t *args) {
+    sflash_littlefs_stats_t stats;
+    littlefs_get_stats(&stats, n_args > 0 && mp_obj_is_true(args[0]));
+    mp_obj_t tuple[3] = {
+        mp_obj_new_int_from_uint(stats.bytes_read),
+        mp_obj_new_int_from_uint(stats.bytes_programmed),
+        mp_obj_new_int_from_uint(stats.blocks_erased),
+    };
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(os_flash_stats_obj, 0, 1, os_flash_stats);
+
+// returns the hits and the misses of the cache of the flash sectors read decrypted (FatFS and updater)
+STATIC mp_obj_t os_flash_cache_stats(size_t n_args, const mp_obj_t *args) {
+    uint32_t hits, misses;
+    flashcache_get_stats(&hits, &misses, n_args > 0 && mp_obj_is_true(args[0]));
+    mp_obj_t tuple[2] = {
+        mp_obj_new_int_from_uint(hits),
+        mp_obj_new_int_from_uint(misses),
+    };
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(os_flash_cache_stats_obj, 0, 1, os_flash_cache_stats);
+
+// returns the erase count of each block of the LittleFS file system since boot
+STATIC mp_obj_t os_flash_erase_counts(void) {
+    const uint32_t *counts = littlefs_get_erase_counts();
+    if (counts == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (uint32_t i = 0; i < lfscfg.block_count; i++) {
+        mp_obj_list_append(list, mp_obj_new_int_from_uint(counts[i]));
+    }
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(os_flash_erase_counts_obj, os_flash_erase_counts);
+
+// returns how often and how long (in microseconds, total and maximum) the LittleFS lock had to be waited for
+STATIC mp_obj_t os_flash_lock_stats(size_t n_args, const mp_obj_t *args) {
+    if (sflash_vfs_flash.fs.littlefs.mutex == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+    lfs_lock_stats_t stats;
+    littlefs_get_lock_stats(&sflash_vfs_flash.fs.littlefs, &stats, n_args > 0 && mp_obj_is_true(args[0]));
+    mp_obj_t tuple[3] = {
+        mp_obj_new_int_from_uint(stats.contended),
+        mp_obj_new_int_from_uint(stats.wait_us),
+        mp_obj_new_int_from_uint(stats.max_wait_us),
+    };
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(os_flash_lock_stats_obj, 0, 1, os_flash_lock_stats);
+
+// returns whether a new file of the given size fits in the free space of the LittleFS file system
+STATIC mp_obj_t os_flash_fits(mp_obj_t nbytes_in) {
+    mp_int_t nbytes = mp_obj_get_int(nbytes_in);
+    if (sflash_vfs_flash.fs.littlefs.mutex == NULL || nbytes < 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+    int res = littlefs_fits(&sflash_vfs_flash.fs.littlefs, nbytes);
+    if (res < 0) {
+        mp_raise_OSError(littleFsErrorToErrno(res));
+    }
+    return mp_obj_new_bool(res);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(os_flash_fits_obj, os_flash_fits);
+
+// returns the import stats of the LittleFS file system, the directories listed for them and the other lookups
+STATIC mp_obj_t os_flash_import_stats(size_t n_args, const mp_obj_t *args) {
+    if (sflash_vfs_flash.fs.littlefs.mutex == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+    lfs_import_stats_t stats;
+    littlefs_get_import_stats(&sflash_vfs_flash.fs.littlefs, &stats, n_args > 0 && mp_obj_is_true(args[0]));
+    mp_obj_t tuple[3] = {
+        mp_obj_new_int_from_uint(stats.calls),
+        mp_obj_new_int_from_uint(stats.dir_reads),
+        mp_obj_new_int_from_uint(stats.lookups),
+    };
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(os_flash_import_stats_obj, 0, 1, os_flash_import_stats);
+
 STATIC mp_obj_t os_urandom(mp_obj_t num) {
     mp_int_t n = mp_obj_get_int(num);
     vstr_t vstr;
     vstr_init_len(&vstr, n);
-    for (int i = 0; i < n; i++) {
-        vstr.buf[i] = rng_get();
-    }
+    rng_fill((uint8_t *)vstr.buf, n);
     return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(os_urandom_obj, os_urandom);
 
+// fills the whole buffer with random bytes without allocating, returns its length
+STATIC mp_obj_t os_urandom_into(mp_obj_t buf_in) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_WRITE);
+    rng_fill(bufinfo.buf, bufinfo.len);
+    return mp_obj_new_int(bufinfo.len);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(os_urandom_into_obj, os_urandom_into);
+
 STATIC mp_obj_t os_dupterm(uint n_args, const mp_obj_t *args) {
     if (n_args == 0) {
         if (MP_STATE_PORT(mp_os_stream_o) == MP_OBJ_NULL) {
@@ -214,7 +308,14 @@ STATIC const mp_rom_map_elem_t os_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_unlink),          MP_ROM_PTR(&mp_vfs_remove_obj) },
 
     { MP_ROM_QSTR(MP_QSTR_sync),            MP_ROM_PTR(&mod_os_sync_obj) },
+    { MP_ROM_QSTR(MP_QSTR_flash_stats),     MP_ROM_PTR(&os_flash_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_flash_cache_stats), MP_ROM_PTR(&os_flash_cache_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_flash_erase_counts), MP_ROM_PTR(&os_flash_erase_counts_obj) },
+    { MP_ROM_QSTR(MP_QSTR_flash_lock_stats), MP_ROM_PTR(&os_flash_lock_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_flash_fits),      MP_ROM_PTR(&os_flash_fits_obj) },
+    { MP_ROM_QSTR(MP_QSTR_flash_import_stats), MP_ROM_PTR(&os_flash_import_stats_obj) },
     { MP_ROM_QSTR(MP_QSTR_urandom),         MP_ROM_PTR(&os_urandom_obj) },
+    { MP_ROM_QSTR(MP_QSTR_urandom_into),    MP_ROM_PTR(&os_urandom_into_obj) },
 
     // MicroPython additions
     // removed: mkfs
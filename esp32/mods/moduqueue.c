@@ -11,7 +11,10 @@
 #include "py/obj.h"
 #include "py/objstr.h"
 #include "py/runtime.h"
+#include "py/mperrno.h"
+#include "py/stream.h"
 #include "mpexception.h"
+#include "mppoll.h"
 #include "moduqueue.h"
 
 /******************************************************************************
@@ -19,9 +22,60 @@
  ******************************************************************************/
 
 /******************************************************************************
- DECLARE PRIVATE DATA
+ DEFINE PRIVATE FUNCTIONS
  ******************************************************************************/
-STATIC const mp_obj_type_t mp_queue_type;
+STATIC TickType_t mp_queue_ticks(bool block, mp_obj_t timeout) {
+    if (!block) {
+        return 0;
+    }
+    if (timeout == mp_const_none) {
+        return portMAX_DELAY;
+    }
+    return (TickType_t)(mp_obj_get_int_truncated(timeout) / portTICK_PERIOD_MS);
+}
+
+// the ticks left of a wait that started at start
+STATIC TickType_t mp_queue_ticks_left(TickType_t ticks, TickType_t start) {
+    if (ticks == portMAX_DELAY) {
+        return ticks;
+    }
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    return (elapsed < ticks) ? ticks - elapsed : 0;
+}
+
+// the GIL is only given away when the caller has to wait
+STATIC bool mp_queue_send(mp_obj_queue_t *self, mp_obj_t item, TickType_t ticks) {
+    if (!xQueueSend(self->handle, (void *)&item, 0)) {
+        if (ticks == 0) {
+            return false;
+        }
+        MP_THREAD_GIL_EXIT();
+        BaseType_t res = xQueueSend(self->handle, (void *)&item, ticks);
+        MP_THREAD_GIL_ENTER();
+        if (!res) {
+            return false;
+        }
+    }
+    // select() and poll() may be waiting for the other end
+    mp_poll_wake();
+    return true;
+}
+
+STATIC bool mp_queue_receive(mp_obj_queue_t *self, mp_obj_t *item, TickType_t ticks) {
+    if (!xQueueReceive(self->handle, (void *)item, 0)) {
+        if (ticks == 0) {
+            return false;
+        }
+        MP_THREAD_GIL_EXIT();
+        BaseType_t res = xQueueReceive(self->handle, (void *)item, ticks);
+        MP_THREAD_GIL_ENTER();
+        if (!res) {
+            return false;
+        }
+    }
+    mp_poll_wake();
+    return true;
+}
 
 /******************************************************************************/
 // Micro Python bindings; Queue class
@@ -91,13 +145,9 @@ STATIC mp_obj_t mp_queue_put(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
 
-    uint32_t timeout_ms = (args[2].u_obj == mp_const_none) ? portMAX_DELAY : mp_obj_get_int_truncated(args[2].u_obj);
-    MP_THREAD_GIL_EXIT();
-    if (!xQueueSend(self->handle, (void *)&args[0].u_obj, args[1].u_bool ? (TickType_t)(timeout_ms / portTICK_PERIOD_MS) : 0)) {
-        MP_THREAD_GIL_ENTER();
+    if (!mp_queue_send(self, args[0].u_obj, mp_queue_ticks(args[1].u_bool, args[2].u_obj))) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Full"));
     }
-    MP_THREAD_GIL_ENTER();
 
     return mp_const_none;
 }
@@ -114,19 +164,71 @@ STATIC mp_obj_t mp_queue_get(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
 
-    uint32_t timeout_ms = (args[1].u_obj == mp_const_none) ? portMAX_DELAY : mp_obj_get_int_truncated(args[1].u_obj);
     mp_obj_t item;
-    MP_THREAD_GIL_EXIT();
-    if (!xQueueReceive(self->handle, (void *)&item, args[0].u_bool ? (TickType_t)(timeout_ms / portTICK_PERIOD_MS) : 0)) {
-        MP_THREAD_GIL_ENTER();
+    if (!mp_queue_receive(self, &item, mp_queue_ticks(args[0].u_bool, args[1].u_obj))) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Empty"));
     }
-    MP_THREAD_GIL_ENTER();
 
     return item;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mp_queue_get_obj, 1, mp_queue_get);
 
+// puts the items in order, returns how many of them were put before the queue stayed full until the timeout
+STATIC mp_obj_t mp_queue_put_many(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_items,      MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_block,                        MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_timeout,                      MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+    };
+
+    // parse args
+    mp_obj_queue_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    TickType_t ticks = mp_queue_ticks(args[1].u_bool, args[2].u_obj);
+    TickType_t start = xTaskGetTickCount();
+    mp_uint_t count = 0;
+    mp_obj_t iter = mp_getiter(args[0].u_obj, NULL);
+    mp_obj_t item;
+    while ((item = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
+        if (!mp_queue_send(self, item, mp_queue_ticks_left(ticks, start))) {
+            break;
+        }
+        count++;
+    }
+
+    return mp_obj_new_int_from_uint(count);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mp_queue_put_many_obj, 1, mp_queue_put_many);
+
+// waits like get() for the first item only, then takes the ones already queued up to n
+STATIC mp_obj_t mp_queue_get_many(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_n,          MP_ARG_REQUIRED | MP_ARG_INT, },
+        { MP_QSTR_block,                        MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_timeout,                      MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+    };
+
+    // parse args
+    mp_obj_queue_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    mp_obj_t item;
+    if (args[0].u_int > 0 && mp_queue_receive(self, &item, mp_queue_ticks(args[1].u_bool, args[2].u_obj))) {
+        mp_obj_list_append(list, item);
+        for (mp_int_t i = 1; i < args[0].u_int && xQueueReceive(self->handle, (void *)&item, 0); i++) {
+            mp_obj_list_append(list, item);
+        }
+        mp_poll_wake();
+    }
+
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mp_queue_get_many_obj, 1, mp_queue_get_many);
+
 STATIC mp_obj_t mp_queue_empty(mp_obj_t self_in) {
     mp_obj_queue_t *self = self_in;
     mp_obj_t buffer;
@@ -146,11 +248,37 @@ STATIC mp_obj_t mp_queue_full(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mp_queue_full_obj, mp_queue_full);
 
+STATIC mp_obj_t mp_queue_qsize(mp_obj_t self_in) {
+    mp_obj_queue_t *self = self_in;
+    return MP_OBJ_NEW_SMALL_INT(uxQueueMessagesWaiting(self->handle));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mp_queue_qsize_obj, mp_queue_qsize);
+
+// readable with items queued and writable with room left, for select() and poll()
+STATIC mp_uint_t mp_queue_ioctl(mp_obj_t self_in, mp_uint_t request, mp_uint_t arg, int *errcode) {
+    mp_obj_queue_t *self = self_in;
+    if (request == MP_STREAM_POLL) {
+        mp_uint_t ret = 0;
+        if ((arg & MP_STREAM_POLL_RD) && uxQueueMessagesWaiting(self->handle) > 0) {
+            ret |= MP_STREAM_POLL_RD;
+        }
+        if ((arg & MP_STREAM_POLL_WR) && uxQueueSpacesAvailable(self->handle) > 0) {
+            ret |= MP_STREAM_POLL_WR;
+        }
+        return ret;
+    }
+    *errcode = MP_EINVAL;
+    return MP_STREAM_ERROR;
+}
+
 STATIC const mp_map_elem_t queue_locals_dict_table[] = {
     // instance methods
     { MP_OBJ_NEW_QSTR(MP_QSTR___del__),                 (mp_obj_t)&mp_queue_delete_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_put),                     (mp_obj_t)&mp_queue_put_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get),                     (mp_obj_t)&mp_queue_get_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_put_many),                (mp_obj_t)&mp_queue_put_many_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_many),                (mp_obj_t)&mp_queue_get_many_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_qsize),                   (mp_obj_t)&mp_queue_qsize_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_empty),                   (mp_obj_t)&mp_queue_empty_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_full),                    (mp_obj_t)&mp_queue_full_obj },
 
@@ -160,8 +288,13 @@ STATIC const mp_map_elem_t queue_locals_dict_table[] = {
 
 STATIC MP_DEFINE_CONST_DICT(queue_locals_dict, queue_locals_dict_table);
 
-STATIC const mp_obj_type_t mp_queue_type = {
+STATIC const mp_stream_p_t queue_stream_p = {
+    .ioctl = mp_queue_ioctl,
+};
+
+const mp_obj_type_t mp_queue_type = {
     { &mp_type_type },
     .name = MP_QSTR_Queue,
+    .protocol = &queue_stream_p,
     .locals_dict = (mp_obj_t)&queue_locals_dict,
 };
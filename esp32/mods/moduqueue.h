@@ -25,4 +25,9 @@ typedef struct _mp_obj_queue_t {
     uint32_t maxsize;
 } mp_obj_queue_t;
 
+/******************************************************************************
+ DECLARE EXPORTED DATA
+ ******************************************************************************/
+extern const mp_obj_type_t mp_queue_type;
+
 #endif /* MODUQUEUE_H_ */
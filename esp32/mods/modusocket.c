@@ -60,7 +60,10 @@
 #include "lwip/sockets.h"
 #include "lwip/dns.h"
 #include "lwip/netdb.h"
+#include "lwip/tcpip.h"
 #include "lwipsocket.h"
+#include "mpirq.h"
+#include "mptrace.h"
 
 #include "mbedtls/ssl.h"
 
@@ -74,6 +77,9 @@
 #define MODUSOCKET_MAX_SOCKETS                      15
 #define MODUSOCKET_CONN_TIMEOUT                     -2
 #define MODUSOCKET_MAX_DNS_SERV                      2
+#define MODUSOCKET_DNS_CACHE_SIZE                   MP_ARRAY_SIZE(MP_STATE_PORT(modusocket_dns_handler))
+#define MODUSOCKET_DNS_NAME_MAX                     64
+#define MODUSOCKET_DNS_MAX_AGE_DEFAULT              60 // seconds
 /******************************************************************************
  DEFINE PRIVATE TYPES
  ******************************************************************************/
@@ -82,6 +88,21 @@ typedef struct {
     bool    user;
 } modusocket_sock_t;
 
+typedef enum {
+    MODUSOCKET_DNS_FREE = 0,
+    MODUSOCKET_DNS_PENDING,
+    MODUSOCKET_DNS_DONE,
+    MODUSOCKET_DNS_FAILED,
+} modusocket_dns_state_t;
+
+typedef struct {
+    char        name[MODUSOCKET_DNS_NAME_MAX];
+    uint32_t    ip;         // network byte order
+    uint32_t    updated;    // time of the answer in ms
+    uint8_t     state;
+    bool        unread;     // an answer of dnsresolve() is returned at least once even if the cache is disabled
+} modusocket_dns_entry_t;
+
 /******************************************************************************
  DEFINE PRIVATE DATA
  ******************************************************************************/
@@ -96,8 +117,19 @@ STATIC mod_network_socket_obj_t* modsocket_sock;
 STATIC TimerHandle_t modsocket_conn_timeout_timer;
 STATIC bool modsocket_istimeout = false;
 
+// Answers of getaddrinfo() and dnsresolve(), shared with the lwIP thread
+STATIC modusocket_dns_entry_t modusocket_dns_cache[MODUSOCKET_DNS_CACHE_SIZE];
+STATIC uint32_t modusocket_dns_max_age = MODUSOCKET_DNS_MAX_AGE_DEFAULT * 1000;
+STATIC SemaphoreHandle_t modusocket_dns_mutex;
+
 STATIC void TASK_SOCK_OPS (void *pvParameters) ;
 STATIC void modsocket_timer_callback( TimerHandle_t xTimer );
+STATIC int modusocket_dns_find (const char *name);
+STATIC bool modusocket_dns_lookup (const char *name, uint32_t *ip);
+STATIC void modusocket_dns_store (const char *name, uint32_t ip);
+STATIC void modusocket_dns_start (void *arg);
+STATIC void modusocket_dns_found (const char *name, const ip_addr_t *ipaddr, void *arg);
+STATIC void modusocket_dns_handler (void *arg);
 /******************************************************************************
  DEFINE PUBLIC DATA
  ******************************************************************************/
@@ -112,6 +144,16 @@ void modusocket_pre_init (void) {
 	xTaskCreatePinnedToCore(TASK_SOCK_OPS, "Socket Operations", 4096 / sizeof(StackType_t), NULL, 5, &xSocketOpsTaskHndl, 1);
 	// Create semaphore
 	xSocketOpsSem = xSemaphoreCreateMutex();
+	modusocket_dns_mutex = xSemaphoreCreateMutex();
+}
+
+void modusocket_init0 (void) {
+    // the handlers belong to the previous heap, the cached answers stay valid
+    xSemaphoreTake(modusocket_dns_mutex, portMAX_DELAY);
+    for (int i = 0; i < MODUSOCKET_DNS_CACHE_SIZE; i++) {
+        MP_STATE_PORT(modusocket_dns_handler)[i] = MP_OBJ_NULL;
+    }
+    xSemaphoreGive(modusocket_dns_mutex);
 }
 
 void modusocket_socket_add (int32_t sd, bool user) {
@@ -230,7 +272,7 @@ STATIC mp_obj_t socket_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_
     // Save Domain type
     s->sock_base.domain = s->sock_base.u.u_param.domain;
     // don't forget to select a network card
-    if (s->sock_base.u.u_param.domain == AF_INET) {
+    if (s->sock_base.u.u_param.domain == AF_INET || s->sock_base.u.u_param.domain == AF_LTE) {
         socket_select_nic(s, (const byte *)"");
     } else {
         if (s->sock_base.u.u_param.type != SOCK_RAW) {
@@ -466,9 +508,11 @@ STATIC mp_obj_t socket_send(mp_obj_t self_in, mp_obj_t buf_in) {
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
     int _errno;
+    MPTRACE(MPTRACE_SOCKET_SEND, self->sock_base.u.sd, bufinfo.len);
     MP_THREAD_GIL_EXIT();
     mp_int_t ret = self->sock_base.nic_type->n_send(self, bufinfo.buf, bufinfo.len, &_errno);
     MP_THREAD_GIL_ENTER();
+    MPTRACE(MPTRACE_SOCKET_SENT, self->sock_base.u.sd, ret);
     if (ret < 0) {
         if (_errno == MP_EAGAIN && self->sock_base.timeout > 0) {
             nlr_raise(mp_obj_new_exception_msg(&mp_type_TimeoutError, "timed out"));
@@ -479,16 +523,13 @@ STATIC mp_obj_t socket_send(mp_obj_t self_in, mp_obj_t buf_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_send_obj, socket_send);
 
-// method socket.recv(bufsize)
-STATIC mp_obj_t socket_recv(mp_obj_t self_in, mp_obj_t len_in) {
-    mod_network_socket_obj_t *self = self_in;
-    mp_int_t len = mp_obj_get_int(len_in);
-    vstr_t vstr;
-    vstr_init_len(&vstr, len);
+// receives straight into buf, shared by recv() and recv_into()
+STATIC mp_int_t socket_recv_buf(mod_network_socket_obj_t *self, byte *buf, mp_int_t len) {
     int _errno;
     MP_THREAD_GIL_EXIT();
-    mp_int_t ret = self->sock_base.nic_type->n_recv(self, (byte*)vstr.buf, len, &_errno);
+    mp_int_t ret = self->sock_base.nic_type->n_recv(self, buf, len, &_errno);
     MP_THREAD_GIL_ENTER();
+    MPTRACE(MPTRACE_SOCKET_RECV, self->sock_base.u.sd, ret);
     if (ret < 0) {
         if (_errno == MP_EAGAIN || _errno == MBEDTLS_ERR_SSL_TIMEOUT ) {
             if (self->sock_base.timeout > 0) {
@@ -500,7 +541,18 @@ STATIC mp_obj_t socket_recv(mp_obj_t self_in, mp_obj_t len_in) {
             nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(_errno)));
         }
     }
+    return ret;
+}
+
+// method socket.recv(bufsize)
+STATIC mp_obj_t socket_recv(mp_obj_t self_in, mp_obj_t len_in) {
+    mod_network_socket_obj_t *self = self_in;
+    mp_int_t len = mp_obj_get_int(len_in);
+    vstr_t vstr;
+    vstr_init_len(&vstr, len);
+    mp_int_t ret = socket_recv_buf(self, (byte*)vstr.buf, len);
     if (ret == 0) {
+        vstr_clear(&vstr);
         return mp_const_empty_bytes;
     }
     vstr.len = ret;
@@ -509,6 +561,28 @@ STATIC mp_obj_t socket_recv(mp_obj_t self_in, mp_obj_t len_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_recv_obj, socket_recv);
 
+// gets the writable buffer given to the *_into() methods and its length, limited to nbytes if given
+STATIC mp_int_t socket_get_into_buf(size_t n_args, const mp_obj_t *args, mp_buffer_info_t *bufinfo) {
+    mp_get_buffer_raise(args[1], bufinfo, MP_BUFFER_WRITE);
+    mp_int_t len = bufinfo->len;
+    if (n_args > 2) {
+        len = mp_obj_get_int(args[2]);
+        if (len < 0 || len > bufinfo->len) {
+            len = bufinfo->len;
+        }
+    }
+    return len;
+}
+
+// method socket.recv_into(buffer[, nbytes])
+STATIC mp_obj_t socket_recv_into(mp_uint_t n_args, const mp_obj_t *args) {
+    mod_network_socket_obj_t *self = args[0];
+    mp_buffer_info_t bufinfo;
+    mp_int_t len = socket_get_into_buf(n_args, args, &bufinfo);
+    return mp_obj_new_int(socket_recv_buf(self, bufinfo.buf, len));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_recv_into_obj, 2, 3, socket_recv_into);
+
 // method socket.sendto(bytes, address)
 STATIC mp_obj_t socket_sendto(mp_obj_t self_in, mp_obj_t data_in, mp_obj_t addr_in) {
     mod_network_socket_obj_t *self = self_in;
@@ -539,9 +613,11 @@ STATIC mp_obj_t socket_sendto(mp_obj_t self_in, mp_obj_t data_in, mp_obj_t addr_
 
     // call the nic to sendto
     int _errno;
+    MPTRACE(MPTRACE_SOCKET_SEND, self->sock_base.u.sd, bufinfo.len);
     MP_THREAD_GIL_EXIT();
     mp_int_t ret = self->sock_base.nic_type->n_sendto(self, bufinfo.buf, bufinfo.len, ip, port, &_errno);
     MP_THREAD_GIL_ENTER();
+    MPTRACE(MPTRACE_SOCKET_SENT, self->sock_base.u.sd, ret);
     if (ret < 0) {
         if (_errno == MP_EAGAIN && self->sock_base.timeout > 0) {
             nlr_raise(mp_obj_new_exception_msg(&mp_type_TimeoutError, "timed out"));
@@ -552,56 +628,141 @@ STATIC mp_obj_t socket_sendto(mp_obj_t self_in, mp_obj_t data_in, mp_obj_t addr_
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(socket_sendto_obj, socket_sendto);
 
-// method socket.recvfrom(bufsize)
-STATIC mp_obj_t socket_recvfrom(mp_obj_t self_in, mp_obj_t len_in) {
-    mod_network_socket_obj_t *self = self_in;
-    vstr_t vstr;
-    vstr_init_len(&vstr, mp_obj_get_int(len_in));
-    byte ip[MOD_USOCKET_IPV6_CHARS_MAX];
-    mp_uint_t port;
+// method socket.sendmsg(buffers[, ancdata[, flags[, address]]])
+STATIC mp_obj_t socket_sendmsg(mp_uint_t n_args, const mp_obj_t *args) {
+    mod_network_socket_obj_t *self = args[0];
+    mp_buffer_info_t bufs[MOD_NETWORK_SENDMSG_MAX_BUFS];
+    size_t count;
+    mp_obj_t *items;
+
+    mp_obj_get_array(args[1], &count, &items);
+    if (count > MOD_NETWORK_SENDMSG_MAX_BUFS) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    for (size_t i = 0; i < count; i++) {
+        mp_get_buffer_raise(items[i], &bufs[i], MP_BUFFER_READ);
+    }
+    // there is no ancillary data to send
+    if (n_args > 2 && mp_obj_is_true(args[2])) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+
+    uint8_t ip[MOD_USOCKET_IPV6_CHARS_MAX];
+    uint8_t *to = NULL;
+    mp_uint_t port = 0;
+    if (n_args > 4 && args[4] != mp_const_none) {
+        port = netutils_parse_inet_addr(args[4], ip, NETUTILS_LITTLE);
+        to = ip;
+    }
+
+    int _errno;
+    mp_int_t ret;
+    if (self->sock_base.nic_type->n_sendmsg != NULL) {
+        MP_THREAD_GIL_EXIT();
+        ret = self->sock_base.nic_type->n_sendmsg(self, bufs, count, to, port, &_errno);
+        MP_THREAD_GIL_ENTER();
+    } else {
+        // the nic sends one buffer at a time, join them so that a datagram isn't split
+        vstr_t vstr;
+        vstr_init(&vstr, 0);
+        for (size_t i = 0; i < count; i++) {
+            vstr_add_strn(&vstr, bufs[i].buf, bufs[i].len);
+        }
+        MP_THREAD_GIL_EXIT();
+        if (to != NULL) {
+            ret = self->sock_base.nic_type->n_sendto(self, (byte *)vstr.buf, vstr.len, to, port, &_errno);
+        } else {
+            ret = self->sock_base.nic_type->n_send(self, (byte *)vstr.buf, vstr.len, &_errno);
+        }
+        MP_THREAD_GIL_ENTER();
+        vstr_clear(&vstr);
+    }
+    if (ret < 0) {
+        if (_errno == MP_EAGAIN && self->sock_base.timeout > 0) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_TimeoutError, "timed out"));
+        }
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(_errno)));
+    }
+    return mp_obj_new_int_from_uint(ret);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_sendmsg_obj, 2, 5, socket_sendmsg);
+
+// receives a datagram straight into buf, shared by recvfrom() and recvfrom_into()
+STATIC mp_int_t socket_recvfrom_buf(mod_network_socket_obj_t *self, byte *buf, mp_int_t len, byte *ip, mp_uint_t *port) {
     int _errno;
 
     ip[0] = 0;// init IP with null
     MP_THREAD_GIL_EXIT();
-    mp_int_t ret = self->sock_base.nic_type->n_recvfrom(self, (byte*)vstr.buf, vstr.len, ip, &port, &_errno);
+    mp_int_t ret = self->sock_base.nic_type->n_recvfrom(self, buf, len, ip, port, &_errno);
     MP_THREAD_GIL_ENTER();
+    MPTRACE(MPTRACE_SOCKET_RECV, self->sock_base.u.sd, ret);
     if (ret < 0) {
         if ((_errno == MP_EAGAIN || _errno == MBEDTLS_ERR_SSL_TIMEOUT ) && self->sock_base.timeout > 0) {
             nlr_raise(mp_obj_new_exception_msg(&mp_type_TimeoutError, "timed out"));
         }
         nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(_errno)));
     }
-    mp_obj_t tuple[2];
-    if (ret == 0) {
-        tuple[0] = mp_const_empty_bytes;
-    } else {
-        vstr.len = ret;
-        vstr.buf[vstr.len] = '\0';
-        tuple[0] = mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
-    }
+    return ret;
+}
+
+STATIC mp_obj_t socket_format_from_addr(mod_network_socket_obj_t *self, byte *ip, mp_uint_t port) {
 #ifdef MOD_LORA_ENABLED
     // check if lora NIC and IP is not set (so Lora Raw or LoraWAN, but no Lora Mesh)
     if (self->sock_base.nic_type == &mod_network_nic_type_lora) {
             if (ip[0] == 0) {
-            tuple[1] = mp_obj_new_int(port);
+            return mp_obj_new_int(port);
             } else {
                 // Lora Mesh
                 mp_obj_t addr[2] = {
                 addr[0] = mp_obj_new_str((char*)ip, strlen((char*)ip)),
                 addr[1] = mp_obj_new_int(port),
                 };
-                tuple[1] = mp_obj_new_tuple(2, addr);
+                return mp_obj_new_tuple(2, addr);
             }
-    } else {
-        tuple[1] = netutils_format_inet_addr(ip, port, NETUTILS_LITTLE);
     }
-#else
-    tuple[1] = netutils_format_inet_addr(ip, port, NETUTILS_LITTLE);
 #endif
+    return netutils_format_inet_addr(ip, port, NETUTILS_LITTLE);
+}
+
+// method socket.recvfrom(bufsize)
+STATIC mp_obj_t socket_recvfrom(mp_obj_t self_in, mp_obj_t len_in) {
+    mod_network_socket_obj_t *self = self_in;
+    vstr_t vstr;
+    vstr_init_len(&vstr, mp_obj_get_int(len_in));
+    byte ip[MOD_USOCKET_IPV6_CHARS_MAX];
+    mp_uint_t port;
+
+    mp_int_t ret = socket_recvfrom_buf(self, (byte*)vstr.buf, vstr.len, ip, &port);
+    mp_obj_t tuple[2];
+    if (ret == 0) {
+        vstr_clear(&vstr);
+        tuple[0] = mp_const_empty_bytes;
+    } else {
+        vstr.len = ret;
+        vstr.buf[vstr.len] = '\0';
+        tuple[0] = mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+    }
+    tuple[1] = socket_format_from_addr(self, ip, port);
     return mp_obj_new_tuple(2, tuple);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_recvfrom_obj, socket_recvfrom);
 
+// method socket.recvfrom_into(buffer[, nbytes])
+STATIC mp_obj_t socket_recvfrom_into(mp_uint_t n_args, const mp_obj_t *args) {
+    mod_network_socket_obj_t *self = args[0];
+    mp_buffer_info_t bufinfo;
+    mp_int_t len = socket_get_into_buf(n_args, args, &bufinfo);
+    byte ip[MOD_USOCKET_IPV6_CHARS_MAX];
+    mp_uint_t port;
+
+    mp_int_t ret = socket_recvfrom_buf(self, bufinfo.buf, len, ip, &port);
+    mp_obj_t tuple[2];
+    tuple[0] = mp_obj_new_int(ret);
+    tuple[1] = socket_format_from_addr(self, ip, port);
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_recvfrom_into_obj, 2, 3, socket_recvfrom_into);
+
 // method socket.setsockopt(level, optname, value)
 STATIC mp_obj_t socket_setsockopt(mp_uint_t n_args, const mp_obj_t *args) {
     mod_network_socket_obj_t *self = args[0];
@@ -794,8 +955,11 @@ STATIC const mp_map_elem_t socket_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_send),            (mp_obj_t)&socket_send_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_sendall),         (mp_obj_t)&socket_send_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv),            (mp_obj_t)&socket_recv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_into),       (mp_obj_t)&socket_recv_into_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_sendto),          (mp_obj_t)&socket_sendto_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sendmsg),         (mp_obj_t)&socket_sendmsg_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recvfrom),        (mp_obj_t)&socket_recvfrom_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recvfrom_into),   (mp_obj_t)&socket_recvfrom_into_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_setsockopt),      (mp_obj_t)&socket_setsockopt_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_settimeout),      (mp_obj_t)&socket_settimeout_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_setblocking),     (mp_obj_t)&socket_setblocking_obj },
@@ -819,7 +983,9 @@ STATIC const mp_map_elem_t raw_socket_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_send),            (mp_obj_t)&socket_send_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_sendto),          (mp_obj_t)&socket_sendto_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv),            (mp_obj_t)&socket_recv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_into),       (mp_obj_t)&socket_recv_into_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recvfrom),        (mp_obj_t)&socket_recvfrom_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recvfrom_into),   (mp_obj_t)&socket_recvfrom_into_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_settimeout),      (mp_obj_t)&socket_settimeout_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_bind),            (mp_obj_t)&socket_bind_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_setblocking),     (mp_obj_t)&socket_setblocking_obj },
@@ -831,6 +997,7 @@ STATIC const mp_map_elem_t raw_socket_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_close),           (mp_obj_t)&socket_close_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_send),            (mp_obj_t)&socket_send_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv),            (mp_obj_t)&socket_recv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recv_into),       (mp_obj_t)&socket_recv_into_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_settimeout),      (mp_obj_t)&socket_settimeout_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_setblocking),     (mp_obj_t)&socket_setblocking_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_setsockopt),      (mp_obj_t)&socket_setsockopt_obj },
@@ -900,6 +1067,136 @@ STATIC const mp_obj_type_t raw_socket_type = {
     .locals_dict = (mp_obj_t)&raw_socket_locals_dict,
 };
 
+STATIC uint32_t modusocket_dns_now (void) {
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+// must be called with modusocket_dns_mutex taken
+STATIC int modusocket_dns_find (const char *name) {
+    for (int i = 0; i < MODUSOCKET_DNS_CACHE_SIZE; i++) {
+        if (modusocket_dns_cache[i].state != MODUSOCKET_DNS_FREE && !strcmp(modusocket_dns_cache[i].name, name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// must be called with modusocket_dns_mutex taken, returns -1 if all the entries have a lookup in progress
+STATIC int modusocket_dns_alloc (const char *name) {
+    int idx = -1;
+    uint32_t now = modusocket_dns_now();
+    uint32_t oldest = 0;
+
+    for (int i = 0; i < MODUSOCKET_DNS_CACHE_SIZE; i++) {
+        modusocket_dns_entry_t *entry = &modusocket_dns_cache[i];
+        if (entry->state == MODUSOCKET_DNS_FREE || entry->state == MODUSOCKET_DNS_FAILED) {
+            idx = i;
+            break;
+        } else if (entry->state == MODUSOCKET_DNS_DONE && (idx < 0 || now - entry->updated > oldest)) {
+            idx = i;
+            oldest = now - entry->updated;
+        }
+    }
+    if (idx >= 0) {
+        strcpy(modusocket_dns_cache[idx].name, name);
+        modusocket_dns_cache[idx].state = MODUSOCKET_DNS_FREE;
+        MP_STATE_PORT(modusocket_dns_handler)[idx] = MP_OBJ_NULL;
+    }
+    return idx;
+}
+
+STATIC bool modusocket_dns_lookup (const char *name, uint32_t *ip) {
+    bool found = false;
+
+    xSemaphoreTake(modusocket_dns_mutex, portMAX_DELAY);
+    int idx = modusocket_dns_find(name);
+    if (idx >= 0 && modusocket_dns_cache[idx].state == MODUSOCKET_DNS_DONE &&
+        modusocket_dns_now() - modusocket_dns_cache[idx].updated < modusocket_dns_max_age) {
+        *ip = modusocket_dns_cache[idx].ip;
+        found = true;
+    }
+    xSemaphoreGive(modusocket_dns_mutex);
+    return found;
+}
+
+STATIC void modusocket_dns_store (const char *name, uint32_t ip) {
+    if (modusocket_dns_max_age == 0 || strlen(name) >= MODUSOCKET_DNS_NAME_MAX) {
+        return;
+    }
+    xSemaphoreTake(modusocket_dns_mutex, portMAX_DELAY);
+    int idx = modusocket_dns_find(name);
+    if (idx < 0) {
+        idx = modusocket_dns_alloc(name);
+    }
+    // a lookup in progress will update the entry itself
+    if (idx >= 0 && modusocket_dns_cache[idx].state != MODUSOCKET_DNS_PENDING) {
+        modusocket_dns_cache[idx].ip = ip;
+        modusocket_dns_cache[idx].updated = modusocket_dns_now();
+        modusocket_dns_cache[idx].unread = false;
+        modusocket_dns_cache[idx].state = MODUSOCKET_DNS_DONE;
+    }
+    xSemaphoreGive(modusocket_dns_mutex);
+}
+
+// runs in the lwIP thread
+STATIC void modusocket_dns_start (void *arg) {
+    modusocket_dns_entry_t *entry = arg;
+    ip_addr_t ipaddr;
+
+    err_t err = dns_gethostbyname(entry->name, &ipaddr, modusocket_dns_found, entry);
+    if (err == ERR_OK) {
+        // answered from the table of lwIP
+        modusocket_dns_found(entry->name, &ipaddr, entry);
+    } else if (err != ERR_INPROGRESS) {
+        modusocket_dns_found(entry->name, NULL, entry);
+    }
+}
+
+// runs in the lwIP thread
+STATIC void modusocket_dns_found (const char *name, const ip_addr_t *ipaddr, void *arg) {
+    modusocket_dns_entry_t *entry = arg;
+    int idx = entry - modusocket_dns_cache;
+
+    xSemaphoreTake(modusocket_dns_mutex, portMAX_DELAY);
+    if (ipaddr != NULL && ipaddr->type == IPADDR_TYPE_V4) {
+        entry->ip = ipaddr->u_addr.ip4.addr;
+        entry->updated = modusocket_dns_now();
+        entry->state = MODUSOCKET_DNS_DONE;
+    } else {
+        entry->state = MODUSOCKET_DNS_FAILED;
+    }
+    entry->unread = true;
+    bool notify = MP_STATE_PORT(modusocket_dns_handler)[idx] != MP_OBJ_NULL;
+    xSemaphoreGive(modusocket_dns_mutex);
+
+    if (notify) {
+        mp_irq_queue_interrupt_non_ISR(modusocket_dns_handler, entry);
+    }
+}
+
+STATIC void modusocket_dns_handler (void *arg) {
+    modusocket_dns_entry_t *entry = arg;
+    int idx = entry - modusocket_dns_cache;
+    mp_obj_t args[2];
+
+    xSemaphoreTake(modusocket_dns_mutex, portMAX_DELAY);
+    mp_obj_t handler = MP_STATE_PORT(modusocket_dns_handler)[idx];
+    MP_STATE_PORT(modusocket_dns_handler)[idx] = MP_OBJ_NULL;
+    uint32_t ip = entry->ip;
+    bool failed = (entry->state == MODUSOCKET_DNS_FAILED);
+    if (failed) {
+        entry->state = MODUSOCKET_DNS_FREE;
+    }
+    entry->unread = false;
+    xSemaphoreGive(modusocket_dns_mutex);
+
+    if (handler != MP_OBJ_NULL) {
+        args[0] = mp_obj_new_str(entry->name, strlen(entry->name));
+        args[1] = failed ? mp_const_none : netutils_format_ipv4_addr((uint8_t *)&ip, NETUTILS_BIG);
+        mp_call_function_n_kw(handler, 2, 0, args);
+    }
+}
+
 ///******************************************************************************/
 //// usocket module
 
@@ -913,34 +1210,126 @@ STATIC mp_obj_t mod_usocket_getaddrinfo(size_t n_args, const mp_obj_t *args) {
     const char *host = mp_obj_str_get_data(args[0], &hlen);
     mp_int_t port = mp_obj_get_int(args[1]);
 
-    const struct addrinfo hints = {
-        .ai_family = AF_INET,
-        .ai_socktype = SOCK_STREAM,
-    };
-    struct addrinfo *res;
-    struct in_addr *addr;
+    uint32_t ip;
+
+    if (!modusocket_dns_lookup(host, &ip)) {
+        const struct addrinfo hints = {
+            .ai_family = AF_INET,
+            .ai_socktype = SOCK_STREAM,
+        };
+        struct addrinfo *res;
+
+        char port_s[6];
+        sprintf(port_s, "%d", port);
+        MP_THREAD_GIL_EXIT();
+        int32_t result = getaddrinfo(host, port_s, &hints, &res);
+        MP_THREAD_GIL_ENTER();
+        if(result != 0 || res == NULL) {
+            nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(result)));
+        }
+        ip = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+
+        //getaddrinfo() allocates memory, needs to be freed
+        freeaddrinfo(res);
 
-    char port_s[6];
-    sprintf(port_s, "%d", port);
-    int32_t result = getaddrinfo(host, port_s, &hints, &res);
-    if(result != 0 || res == NULL) {
-        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(result)));
+        modusocket_dns_store(host, ip);
     }
-    addr = &((struct sockaddr_in *)res->ai_addr)->sin_addr;
+
     mp_obj_tuple_t *tuple = mp_obj_new_tuple(5, NULL);
-    tuple->items[0] = MP_OBJ_NEW_SMALL_INT(res->ai_family);
-    tuple->items[1] = MP_OBJ_NEW_SMALL_INT(res->ai_socktype);
+    tuple->items[0] = MP_OBJ_NEW_SMALL_INT(AF_INET);
+    tuple->items[1] = MP_OBJ_NEW_SMALL_INT(SOCK_STREAM);
     tuple->items[2] = MP_OBJ_NEW_SMALL_INT(0);
     tuple->items[3] = MP_OBJ_NEW_QSTR(MP_QSTR_);
-    tuple->items[4] = netutils_format_inet_addr((uint8_t *) &addr->s_addr, port, NETUTILS_BIG);
-
-    //getaddrinfo() allocates memory, needs to be freed
-    freeaddrinfo(res);
+    tuple->items[4] = netutils_format_inet_addr((uint8_t *)&ip, port, NETUTILS_BIG);
 
     return mp_obj_new_list(1, (mp_obj_t*) &tuple);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_usocket_getaddrinfo_obj, 2, 6, mod_usocket_getaddrinfo);
 
+/// \function dnsresolve(host, handler=None)
+/// Returns the address of host if it is known, otherwise starts looking it up in the background and returns None.
+/// The handler is called with (host, address or None) when the lookup completes, or dnsresolve() can be polled.
+STATIC mp_obj_t mod_usocket_dnsresolve(size_t n_args, const mp_obj_t *args) {
+    size_t hlen;
+    const char *host = mp_obj_str_get_data(args[0], &hlen);
+    ip4_addr_t literal;
+
+    if (ip4addr_aton(host, &literal)) {
+        return netutils_format_ipv4_addr((uint8_t *)&literal.addr, NETUTILS_BIG);
+    }
+    if (hlen == 0 || hlen >= MODUSOCKET_DNS_NAME_MAX) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+
+    xSemaphoreTake(modusocket_dns_mutex, portMAX_DELAY);
+    int idx = modusocket_dns_find(host);
+    if (idx >= 0) {
+        modusocket_dns_entry_t *entry = &modusocket_dns_cache[idx];
+        if (entry->state == MODUSOCKET_DNS_DONE &&
+            (entry->unread || modusocket_dns_now() - entry->updated < modusocket_dns_max_age)) {
+            uint32_t ip = entry->ip;
+            entry->unread = false;
+            if (modusocket_dns_max_age == 0) {
+                entry->state = MODUSOCKET_DNS_FREE;
+            }
+            xSemaphoreGive(modusocket_dns_mutex);
+            return netutils_format_ipv4_addr((uint8_t *)&ip, NETUTILS_BIG);
+        } else if (entry->state == MODUSOCKET_DNS_FAILED) {
+            entry->state = MODUSOCKET_DNS_FREE;
+            xSemaphoreGive(modusocket_dns_mutex);
+            nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(EAI_FAIL)));
+        } else if (entry->state == MODUSOCKET_DNS_PENDING) {
+            if (n_args > 1) {
+                MP_STATE_PORT(modusocket_dns_handler)[idx] = (args[1] != mp_const_none) ? args[1] : MP_OBJ_NULL;
+            }
+            xSemaphoreGive(modusocket_dns_mutex);
+            return mp_const_none;
+        }
+    } else if ((idx = modusocket_dns_alloc(host)) < 0) {
+        xSemaphoreGive(modusocket_dns_mutex);
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    modusocket_dns_entry_t *entry = &modusocket_dns_cache[idx];
+    entry->state = MODUSOCKET_DNS_PENDING;
+    entry->unread = false;
+    MP_STATE_PORT(modusocket_dns_handler)[idx] = (n_args > 1 && args[1] != mp_const_none) ? args[1] : MP_OBJ_NULL;
+    xSemaphoreGive(modusocket_dns_mutex);
+
+    if (tcpip_callback(modusocket_dns_start, entry) != ERR_OK) {
+        xSemaphoreTake(modusocket_dns_mutex, portMAX_DELAY);
+        entry->state = MODUSOCKET_DNS_FREE;
+        MP_STATE_PORT(modusocket_dns_handler)[idx] = MP_OBJ_NULL;
+        xSemaphoreGive(modusocket_dns_mutex);
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_usocket_dnsresolve_obj, 1, 2, mod_usocket_dnsresolve);
+
+/// \function dnscache([max_age])
+/// Gets or sets for how many seconds an answer is reused, 0 disables the cache and empties it.
+STATIC mp_obj_t mod_usocket_dnscache(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        return mp_obj_new_int_from_uint(modusocket_dns_max_age / 1000);
+    }
+    mp_int_t max_age = mp_obj_get_int(args[0]);
+    if (max_age < 0 || max_age > UINT32_MAX / 2000) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    xSemaphoreTake(modusocket_dns_mutex, portMAX_DELAY);
+    modusocket_dns_max_age = max_age * 1000;
+    if (max_age == 0) {
+        for (int i = 0; i < MODUSOCKET_DNS_CACHE_SIZE; i++) {
+            if (modusocket_dns_cache[i].state == MODUSOCKET_DNS_DONE && !modusocket_dns_cache[i].unread) {
+                modusocket_dns_cache[i].state = MODUSOCKET_DNS_FREE;
+            }
+        }
+    }
+    xSemaphoreGive(modusocket_dns_mutex);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_usocket_dnscache_obj, 0, 1, mod_usocket_dnscache);
+
 STATIC mp_obj_t mod_usocket_dnsserver(size_t n_args, const mp_obj_t *args)
 {
     if(n_args == 1)
@@ -991,12 +1380,74 @@ STATIC mp_obj_t mod_usocket_dnsserver(size_t n_args, const mp_obj_t *args)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_usocket_dnsserver_obj, 0, 2, mod_usocket_dnsserver);
 
+/// \function profile([profile], *, rcvbuf, sndbuf, tcp_wnd, max_sockets)
+/// Gets (rcvbuf, sndbuf, tcp_wnd, max_sockets) or sets the buffers given to the sockets created from now on,
+/// starting from one of the PROFILE_ presets or from the current values.
+STATIC mp_obj_t mod_usocket_profile(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_profile,      MP_ARG_OBJ,                  {.u_obj = mp_const_none} },
+        { MP_QSTR_rcvbuf,       MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_sndbuf,       MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_tcp_wnd,      MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_max_sockets,  MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+
+    lwipsocket_profile_t profile;
+    lwipsocket_get_profile(&profile);
+    if (n_args == 0 && kw_args->used == 0) {
+        mp_obj_t tuple[4];
+        tuple[0] = mp_obj_new_int(profile.rcvbuf);
+        tuple[1] = mp_obj_new_int(profile.sndbuf);
+        tuple[2] = mp_obj_new_int(profile.tcp_wnd);
+        tuple[3] = mp_obj_new_int(profile.max_sockets);
+        return mp_obj_new_tuple(4, tuple);
+    }
+
+    if (args[0].u_obj != mp_const_none && !lwipsocket_get_profile_preset(mp_obj_get_int(args[0].u_obj), &profile)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    int32_t *fields[] = {&profile.rcvbuf, &profile.sndbuf, &profile.tcp_wnd, &profile.max_sockets};
+    for (int i = 0; i < MP_ARRAY_SIZE(fields); i++) {
+        if (args[i + 1].u_obj != mp_const_none) {
+            *fields[i] = mp_obj_get_int(args[i + 1].u_obj);
+        }
+    }
+    if (!lwipsocket_set_profile(&profile)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_usocket_profile_obj, 0, mod_usocket_profile);
+
+/// \function stats([reset])
+/// Returns (open, peak, created, refused, mem_errors, tx_bytes, rx_bytes) of the lwIP sockets.
+STATIC mp_obj_t mod_usocket_stats(size_t n_args, const mp_obj_t *args) {
+    lwipsocket_stats_t stats;
+    lwipsocket_get_stats(&stats, n_args > 0 && mp_obj_is_true(args[0]));
+    mp_obj_t tuple[7];
+    tuple[0] = mp_obj_new_int_from_uint(stats.open);
+    tuple[1] = mp_obj_new_int_from_uint(stats.peak);
+    tuple[2] = mp_obj_new_int_from_uint(stats.created);
+    tuple[3] = mp_obj_new_int_from_uint(stats.refused);
+    tuple[4] = mp_obj_new_int_from_uint(stats.mem_errors);
+    tuple[5] = mp_obj_new_int_from_ull(stats.tx_bytes);
+    tuple[6] = mp_obj_new_int_from_ull(stats.rx_bytes);
+    return mp_obj_new_tuple(7, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_usocket_stats_obj, 0, 1, mod_usocket_stats);
+
 STATIC const mp_map_elem_t mp_module_usocket_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__),        MP_OBJ_NEW_QSTR(MP_QSTR_usocket) },
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_socket),          (mp_obj_t)&socket_type },
     { MP_OBJ_NEW_QSTR(MP_QSTR_getaddrinfo),     (mp_obj_t)&mod_usocket_getaddrinfo_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_dnsserver),       (mp_obj_t)&mod_usocket_dnsserver_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_dnsresolve),      (mp_obj_t)&mod_usocket_dnsresolve_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_dnscache),        (mp_obj_t)&mod_usocket_dnscache_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_profile),         (mp_obj_t)&mod_usocket_profile_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stats),           (mp_obj_t)&mod_usocket_stats_obj },
 
     // class exceptions
     { MP_OBJ_NEW_QSTR(MP_QSTR_error),           (mp_obj_t)&mp_type_OSError },
@@ -1012,6 +1463,10 @@ STATIC const mp_map_elem_t mp_module_usocket_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_AF_SIGFOX),       MP_OBJ_NEW_SMALL_INT(AF_SIGFOX) },
 #endif
 
+#if defined (GPY) || defined (FIPY)
+    { MP_OBJ_NEW_QSTR(MP_QSTR_AF_LTE),          MP_OBJ_NEW_SMALL_INT(AF_LTE) },
+#endif
+
     { MP_OBJ_NEW_QSTR(MP_QSTR_SOCK_STREAM),     MP_OBJ_NEW_SMALL_INT(SOCK_STREAM) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_SOCK_DGRAM),      MP_OBJ_NEW_SMALL_INT(SOCK_DGRAM) },
 #if defined (LOPY) || defined (SIPY) || defined (LOPY4) || defined(FIPY)
@@ -1037,10 +1492,20 @@ STATIC const mp_map_elem_t mp_module_usocket_globals_table[] = {
 #endif
     { MP_OBJ_NEW_QSTR(MP_QSTR_SOL_SOCKET),      MP_OBJ_NEW_SMALL_INT(SOL_SOCKET) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_SO_REUSEADDR),    MP_OBJ_NEW_SMALL_INT(SO_REUSEADDR) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SO_RCVBUF),       MP_OBJ_NEW_SMALL_INT(SO_RCVBUF) },
+#if LWIPSOCKET_PER_SOCKET_TCP
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SO_SNDBUF),       MP_OBJ_NEW_SMALL_INT(SO_SNDBUF) },
+#endif
+
+    { MP_OBJ_NEW_QSTR(MP_QSTR_PROFILE_SMALL),   MP_OBJ_NEW_SMALL_INT(LWIPSOCKET_PROFILE_SMALL) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_PROFILE_DEFAULT), MP_OBJ_NEW_SMALL_INT(LWIPSOCKET_PROFILE_DEFAULT) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_PROFILE_LARGE),   MP_OBJ_NEW_SMALL_INT(LWIPSOCKET_PROFILE_LARGE) },
 
 #if defined(LOPY) || defined (LOPY4) || defined(FIPY)
     { MP_OBJ_NEW_QSTR(MP_QSTR_SO_CONFIRMED),    MP_OBJ_NEW_SMALL_INT(SO_LORAWAN_CONFIRMED) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_SO_DR),           MP_OBJ_NEW_SMALL_INT(SO_LORAWAN_DR) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SO_PRIORITY),     MP_OBJ_NEW_SMALL_INT(SO_LORAWAN_PRIORITY) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SO_DEADLINE),     MP_OBJ_NEW_SMALL_INT(SO_LORAWAN_DEADLINE) },
 #endif
 #if defined(SIPY) || defined (LOPY4) || defined(FIPY)
      { MP_OBJ_NEW_QSTR(MP_QSTR_SO_RX),          MP_OBJ_NEW_SMALL_INT(SO_SIGFOX_RX) },
@@ -43,6 +43,8 @@
 
 #define AF_LORA                             (0xA0)
 #define AF_SIGFOX                           (0xA1)
+// IP sockets run by the LTE modem's own stack, without PPP
+#define AF_LTE                              (0xA2)
 
 #define SOL_LORA                            (0xFFF05)
 #define SOL_SIGFOX                          (0xFFF06)
@@ -53,6 +55,8 @@
 #define SO_SIGFOX_TX_REPEAT                 (0xF0005)
 #define SO_SIGFOX_OOB                       (0xF0006)
 #define SO_SIGFOX_BIT                       (0xF0007)
+#define SO_LORAWAN_PRIORITY                 (0xF0008)
+#define SO_LORAWAN_DEADLINE                 (0xF0009)
 
 /* chars for storing an IPv6 address 39 chars + zero end string
 * ex: ABCD:ABCD:ABCD:ABCD:ABCD:ABCD:ABCD:ABCD 4*8+7=39 chars */
@@ -60,10 +64,12 @@
 
 extern const mp_obj_dict_t socket_locals_dict;
 extern const mp_stream_p_t socket_stream_p;
+extern const mp_stream_p_t raw_socket_stream_p;
 
 extern const mp_obj_type_t socket_type;
 
 extern void modusocket_pre_init (void);
+extern void modusocket_init0 (void);
 extern void modusocket_socket_add (int32_t sd, bool user);
 extern void modusocket_socket_delete (int32_t sd);
 extern void modusocket_enter_sleep (void);
@@ -27,20 +27,88 @@
 #include "modusocket.h"
 #include "modussl.h"
 #include "mptask.h"
+#include "mpsleep.h"
+#include "mpcpufreq.h"
 #include "pycom_general_util.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
 
 /******************************************************************************
  DEFINE CONSTANTS
  ******************************************************************************/
 #define DEFAULT_SSL_READ_TIMEOUT                    10 //sec
 
+#define MOD_SSL_SESSION_CACHE_SIZE                  3
+#define MOD_SSL_SESSION_TICKET_MAX                  224
+#define MOD_SSL_CACHE_MAGIC                         0x53534C43
+
+#define MOD_SSL_CA_CACHE_SIZE                       2
+#define MOD_SSL_CA_PATH_MAX                         64
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// a resumable session, without the peer certificate and with the ticket inline so that it can live in RTC memory
+typedef struct {
+    char                    key[MOD_SSL_SESSION_KEY_MAX];
+    uint32_t                used;
+    uint8_t                 authmode;
+    mbedtls_ssl_session     session;
+    uint8_t                 ticket[MOD_SSL_SESSION_TICKET_MAX];
+} mod_ssl_cache_entry_t;
+
+typedef struct {
+    uint32_t                magic;
+    bool                    enabled;
+    bool                    persist;    // kept across deep sleep
+    uint32_t                counter;
+    mod_ssl_cache_entry_t   entry[MOD_SSL_SESSION_CACHE_SIZE];
+} mod_ssl_cache_t;
+
+// a parsed CA chain shared by the low memory sockets verifying against the same file
+typedef struct {
+    char                    path[MOD_SSL_CA_PATH_MAX];
+    uint32_t                refs;
+    mbedtls_x509_crt        crt;
+} mod_ssl_ca_entry_t;
+
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
+STATIC void mod_ssl_cache_check (void);
+STATIC mod_ssl_ca_entry_t *mod_ssl_ca_acquire (const char *path);
 
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
+static RTC_DATA_ATTR mod_ssl_cache_t mod_ssl_cache;
+static SemaphoreHandle_t mod_ssl_cache_mutex = NULL;
+static bool mod_ssl_cache_booted = false;
+static mod_ssl_ca_entry_t mod_ssl_ca_cache[MOD_SSL_CA_CACHE_SIZE];
+
+// the low memory profile only offers AES suites, which run on the AES peripheral
+static const int mod_ssl_low_mem_ciphersuites[] = {
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_RSA_WITH_AES_128_CBC_SHA256,
+    MBEDTLS_TLS_RSA_WITH_AES_128_CBC_SHA,
+    0
+};
+
+static const mbedtls_ecp_group_id mod_ssl_low_mem_curves[] = {
+    MBEDTLS_ECP_DP_SECP256R1,
+    MBEDTLS_ECP_DP_SECP384R1,
+    MBEDTLS_ECP_DP_NONE
+};
+
 // tiny object for storing ssl sessions
 STATIC mp_obj_t ssl_session_free(mp_obj_t self_in) {
     mp_obj_ssl_session_t *self = self_in;
@@ -125,7 +193,21 @@ static int32_t mod_ssl_setup_socket (mp_obj_ssl_socket_t *ssl_sock, const mbedtl
 
     mbedtls_ssl_conf_authmode(&ssl_sock->conf, ssl_verify);
     mbedtls_ssl_conf_rng(&ssl_sock->conf, mbedtls_ctr_drbg_random, &ssl_sock->ctr_drbg);
-    mbedtls_ssl_conf_ca_chain(&ssl_sock->conf, &ssl_sock->cacert, NULL);
+    if (ssl_sock->ca_entry != NULL) {
+        mbedtls_ssl_conf_ca_chain(&ssl_sock->conf, &((mod_ssl_ca_entry_t *)ssl_sock->ca_entry)->crt, NULL);
+    } else {
+        mbedtls_ssl_conf_ca_chain(&ssl_sock->conf, &ssl_sock->cacert, NULL);
+    }
+    if (ssl_sock->profile == MOD_SSL_PROFILE_LOW_MEM) {
+        mbedtls_ssl_conf_ciphersuites(&ssl_sock->conf, mod_ssl_low_mem_ciphersuites);
+        mbedtls_ssl_conf_curves(&ssl_sock->conf, mod_ssl_low_mem_curves);
+    #if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+        if (client_or_server == MBEDTLS_SSL_IS_CLIENT) {
+            // ask the server for 2 KB records
+            mbedtls_ssl_conf_max_frag_len(&ssl_sock->conf, MBEDTLS_SSL_MAX_FRAG_LEN_2048);
+        }
+    #endif
+    }
     if (client_cert && client_key) {
         if ((ret = mbedtls_ssl_conf_own_cert(&ssl_sock->conf,
                                              &ssl_sock->own_cert,
@@ -169,17 +251,9 @@ static int32_t mod_ssl_setup_socket (mp_obj_ssl_socket_t *ssl_sock, const mbedtl
         mbedtls_ssl_set_bio(&ssl_sock->ssl, &ssl_sock->context_fd, mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
 
         //printf("Performing the SSL/TLS handshake...\n");
-        int count = 0;
-        while ((ret = mbedtls_ssl_handshake(&ssl_sock->ssl)) != 0)
-        {
-            if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_TIMEOUT) || count >= ssl_sock->read_timeout) {
-                 //printf("mbedtls_ssl_handshake returned -0x%x\n", -ret);
-                return ret;
-            }
-            if(ret == MBEDTLS_ERR_SSL_TIMEOUT)
-            {
-                count++;
-            }
+        if ((ret = mod_ssl_handshake(ssl_sock)) != 0) {
+            //printf("mbedtls_ssl_handshake returned -0x%x\n", -ret);
+            return ret;
         }
 
         //printf("Verifying peer X.509 certificate...\n");
@@ -204,6 +278,223 @@ static int32_t mod_ssl_setup_socket (mp_obj_ssl_socket_t *ssl_sock, const mbedtl
 }
 
 
+/******************************************************************************/
+// Session cache used by wrap_socket() to resume sessions automatically
+
+STATIC void mod_ssl_cache_check (void) {
+    if (mod_ssl_cache_mutex == NULL) {
+        // only called from wrap_socket() with the GIL held
+        mod_ssl_cache_mutex = xSemaphoreCreateMutex();
+    }
+    // waking up from deep sleep keeps the sessions only if asked to
+    if (mod_ssl_cache.magic != MOD_SSL_CACHE_MAGIC ||
+        (!mod_ssl_cache_booted && !mod_ssl_cache.persist && mpsleep_get_reset_cause() == MPSLEEP_DEEPSLEEP_RESET)) {
+        bool enabled = (mod_ssl_cache.magic == MOD_SSL_CACHE_MAGIC) ? mod_ssl_cache.enabled : true;
+        bool persist = (mod_ssl_cache.magic == MOD_SSL_CACHE_MAGIC) && mod_ssl_cache.persist;
+        memset(&mod_ssl_cache, 0, sizeof(mod_ssl_cache));
+        mod_ssl_cache.magic = MOD_SSL_CACHE_MAGIC;
+        mod_ssl_cache.enabled = enabled;
+        mod_ssl_cache.persist = persist;
+    }
+    mod_ssl_cache_booted = true;
+}
+
+// builds "host:port" from the server host name, or from the peer address if there is none
+STATIC bool mod_ssl_cache_key (mp_obj_ssl_socket_t *ssl_sock, char *key) {
+    struct sockaddr_in peer;
+    socklen_t len = sizeof(peer);
+
+    if (getpeername(ssl_sock->sock_base.u.sd, (struct sockaddr *)&peer, &len) != 0) {
+        return false;
+    }
+    if (ssl_sock->host_name[0] != '\0') {
+        snprintf(key, MOD_SSL_SESSION_KEY_MAX, "%s:%u", ssl_sock->host_name, ntohs(peer.sin_port));
+    } else {
+        uint8_t *ip = (uint8_t *)&peer.sin_addr.s_addr;
+        snprintf(key, MOD_SSL_SESSION_KEY_MAX, "%u.%u.%u.%u:%u", ip[0], ip[1], ip[2], ip[3], ntohs(peer.sin_port));
+    }
+    return true;
+}
+
+// must be called with mod_ssl_cache_mutex taken
+STATIC mod_ssl_cache_entry_t *mod_ssl_cache_find (const char *key) {
+    for (int i = 0; i < MOD_SSL_SESSION_CACHE_SIZE; i++) {
+        if (mod_ssl_cache.entry[i].key[0] != '\0' && !strcmp(mod_ssl_cache.entry[i].key, key)) {
+            return &mod_ssl_cache.entry[i];
+        }
+    }
+    return NULL;
+}
+
+STATIC bool mod_ssl_cache_resume (mp_obj_ssl_socket_t *ssl_sock, const char *key) {
+    bool found = false;
+
+    xSemaphoreTake(mod_ssl_cache_mutex, portMAX_DELAY);
+    mod_ssl_cache_entry_t *entry = mod_ssl_cache_find(key);
+    // a session verified less strictly than now asked for is not reused
+    if (entry != NULL && entry->authmode == ssl_sock->authmode) {
+        mbedtls_ssl_session session = entry->session;
+        session.ticket = (entry->session.ticket_len > 0) ? entry->ticket : NULL;
+        // the session is copied, the entry can be replaced during the handshake
+        found = (mbedtls_ssl_set_session(&ssl_sock->ssl, &session) == 0);
+        entry->used = ++mod_ssl_cache.counter;
+    }
+    xSemaphoreGive(mod_ssl_cache_mutex);
+    return found;
+}
+
+STATIC void mod_ssl_cache_store (mp_obj_ssl_socket_t *ssl_sock, const char *key) {
+    mbedtls_ssl_session session;
+
+    memset(&session, 0, sizeof(session));
+    if (mbedtls_ssl_get_session(&ssl_sock->ssl, &session) != 0) {
+        mbedtls_ssl_session_free(&session);
+        return;
+    }
+
+    xSemaphoreTake(mod_ssl_cache_mutex, portMAX_DELAY);
+    mod_ssl_cache_entry_t *entry = mod_ssl_cache_find(key);
+    if (entry == NULL) {
+        entry = &mod_ssl_cache.entry[0];
+        for (int i = 1; i < MOD_SSL_SESSION_CACHE_SIZE; i++) {
+            if (mod_ssl_cache.entry[i].used < entry->used) {
+                entry = &mod_ssl_cache.entry[i];
+            }
+        }
+    }
+    strcpy(entry->key, key);
+    entry->authmode = ssl_sock->authmode;
+    entry->used = ++mod_ssl_cache.counter;
+    entry->session = session;
+    // the peer certificate is not needed to resume, a ticket too large is dropped and the session ID is used alone
+    entry->session.peer_cert = NULL;
+    entry->session.ticket = NULL;
+    if (session.ticket_len > sizeof(entry->ticket)) {
+        entry->session.ticket_len = 0;
+    } else if (session.ticket_len > 0) {
+        memcpy(entry->ticket, session.ticket, session.ticket_len);
+    }
+    xSemaphoreGive(mod_ssl_cache_mutex);
+
+    mbedtls_ssl_session_free(&session);
+}
+
+STATIC void mod_ssl_cache_drop (const char *key) {
+    xSemaphoreTake(mod_ssl_cache_mutex, portMAX_DELAY);
+    mod_ssl_cache_entry_t *entry = mod_ssl_cache_find(key);
+    if (entry != NULL) {
+        memset(entry, 0, sizeof(*entry));
+    }
+    xSemaphoreGive(mod_ssl_cache_mutex);
+}
+
+// Performs the handshake on a connected socket, trying to resume a cached session first
+int32_t mod_ssl_handshake (mp_obj_ssl_socket_t *ssl_sock) {
+    int32_t ret;
+    uint32_t count = 0;
+    char key[MOD_SSL_SESSION_KEY_MAX];
+    bool cached = ssl_sock->session_cache && mod_ssl_cache.enabled && mod_ssl_cache_key(ssl_sock, key);
+    bool resuming = cached && mod_ssl_cache_resume(ssl_sock, key);
+    unsigned char master[sizeof(ssl_sock->ssl.session_negotiate->master)];
+
+    if (resuming) {
+        memcpy(master, ssl_sock->ssl.session_negotiate->master, sizeof(master));
+    }
+
+    // the public key operations are CPU bound, keep the high frequency when it scales
+    mpcpufreq_boost_acquire();
+    int64_t start = esp_timer_get_time();
+    while ((ret = mbedtls_ssl_handshake(&ssl_sock->ssl)) != 0)
+    {
+        if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_TIMEOUT) || count >= ssl_sock->read_timeout) {
+            mpcpufreq_boost_release();
+            if (resuming) {
+                mod_ssl_cache_drop(key);
+            }
+            return ret;
+        }
+        if(ret == MBEDTLS_ERR_SSL_TIMEOUT)
+        {
+            count++;
+        }
+    }
+    mpcpufreq_boost_release();
+    ssl_sock->handshake_ms = (esp_timer_get_time() - start) / 1000;
+    // a full handshake derives a new master secret
+    ssl_sock->resumed = resuming && !memcmp(ssl_sock->ssl.session->master, master, sizeof(master));
+
+    if (cached) {
+        mod_ssl_cache_store(ssl_sock, key);
+    }
+    return 0;
+}
+
+/******************************************************************************/
+// CA chains shared by the sockets of the low memory profile
+
+// returns the parsed chain of the file, or NULL if it can't be shared and each socket must parse its own
+STATIC mod_ssl_ca_entry_t *mod_ssl_ca_acquire (const char *path) {
+    mod_ssl_ca_entry_t *entry = NULL;
+
+    if (strlen(path) >= MOD_SSL_CA_PATH_MAX) {
+        return NULL;
+    }
+
+    xSemaphoreTake(mod_ssl_cache_mutex, portMAX_DELAY);
+    for (int i = 0; i < MOD_SSL_CA_CACHE_SIZE; i++) {
+        if (mod_ssl_ca_cache[i].refs > 0 && !strcmp(mod_ssl_ca_cache[i].path, path)) {
+            mod_ssl_ca_cache[i].refs++;
+            xSemaphoreGive(mod_ssl_cache_mutex);
+            return &mod_ssl_ca_cache[i];
+        }
+        if (mod_ssl_ca_cache[i].refs == 0 && entry == NULL) {
+            entry = &mod_ssl_ca_cache[i];
+        }
+    }
+    if (entry != NULL) {
+        // reserve the entry, wrap_socket() is the only caller and holds the GIL while parsing
+        entry->refs = 1;
+        entry->path[0] = '\0';
+    }
+    xSemaphoreGive(mod_ssl_cache_mutex);
+
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    vstr_t vstr;
+    const char *ca_cert = pycom_util_read_file(path, &vstr);
+    if (ca_cert == NULL) {
+        entry->refs = 0;
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "CA file not found"));
+    }
+    mbedtls_x509_crt_init(&entry->crt);
+    int ret = mbedtls_x509_crt_parse(&entry->crt, (uint8_t *)ca_cert, strlen(ca_cert) + 1);
+    vstr_clear(&vstr);
+    if (ret < 0) {
+        mbedtls_x509_crt_free(&entry->crt);
+        entry->refs = 0;
+        mp_raise_OSError(ret);
+    }
+    strcpy(entry->path, path);
+    return entry;
+}
+
+// Drops the reference of the socket to a shared CA chain, the chain is freed with the last one
+void mod_ssl_release (mp_obj_ssl_socket_t *ssl_sock) {
+    mod_ssl_ca_entry_t *entry = ssl_sock->ca_entry;
+
+    if (entry != NULL) {
+        ssl_sock->ca_entry = NULL;
+        xSemaphoreTake(mod_ssl_cache_mutex, portMAX_DELAY);
+        if (--entry->refs == 0) {
+            mbedtls_x509_crt_free(&entry->crt);
+            entry->path[0] = '\0';
+        }
+        xSemaphoreGive(mod_ssl_cache_mutex);
+    }
+}
+
 /******************************************************************************/
 // Micro Python bindings; SSL class
 
@@ -219,6 +510,8 @@ STATIC mp_obj_t mod_ssl_wrap_socket(mp_uint_t n_args, const mp_obj_t *pos_args,
         { MP_QSTR_server_hostname,              MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
         { MP_QSTR_saved_session,                MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
         { MP_QSTR_timeout,                      MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+        { MP_QSTR_session_cache,                MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_profile,                      MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = MOD_SSL_PROFILE_DEFAULT} },
     };
 
     int32_t _error;
@@ -246,6 +539,11 @@ STATIC mp_obj_t mod_ssl_wrap_socket(mp_uint_t n_args, const mp_obj_t *pos_args,
         goto arg_error;
     }
 
+    uint32_t profile = args[11].u_int;
+    if (profile != MOD_SSL_PROFILE_DEFAULT && profile != MOD_SSL_PROFILE_LOW_MEM) {
+        goto arg_error;
+    }
+
     // socket type check
     if (!mp_obj_is_type(args[0].u_obj, &socket_type)) {
     	goto arg_error;
@@ -268,6 +566,22 @@ STATIC mp_obj_t mod_ssl_wrap_socket(mp_uint_t n_args, const mp_obj_t *pos_args,
     ssl_sock->base.type = &ssl_socket_type;
     ssl_sock->o_sock = args[0].u_obj;       // this is needed so that the GC doesnt collect the socket
 
+    // sessions are resumed automatically by clients unless one is given
+    mod_ssl_cache_check();
+    ssl_sock->session_cache = args[10].u_bool && !server_side && saved_session == NULL;
+    ssl_sock->resumed = false;
+    ssl_sock->handshake_ms = 0;
+    ssl_sock->authmode = verify_type;
+    ssl_sock->host_name[0] = '\0';
+    if (host_name != NULL && strlen(host_name) < sizeof(ssl_sock->host_name) - 6) {
+        strcpy(ssl_sock->host_name, host_name);
+    } else if (host_name != NULL) {
+        ssl_sock->session_cache = false;
+    }
+    ssl_sock->profile = profile;
+    ssl_sock->ca_entry = NULL;
+    ssl_sock->heap_used = 0;
+
     //Read timeout
     if(args[9].u_obj == mp_const_none)
     {
@@ -279,7 +593,10 @@ STATIC mp_obj_t mod_ssl_wrap_socket(mp_uint_t n_args, const mp_obj_t *pos_args,
     }
 
     const char *ca_cert = NULL;
-    if (cafile_path) {
+    if (cafile_path && profile == MOD_SSL_PROFILE_LOW_MEM) {
+        ssl_sock->ca_entry = mod_ssl_ca_acquire(cafile_path);
+    }
+    if (cafile_path && ssl_sock->ca_entry == NULL) {
         ca_cert = pycom_util_read_file(cafile_path, &ssl_sock->vstr_ca);
         if(ca_cert == NULL) {
             nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "CA file not found"));
@@ -289,17 +606,20 @@ STATIC mp_obj_t mod_ssl_wrap_socket(mp_uint_t n_args, const mp_obj_t *pos_args,
     const char *client_cert = NULL;
     const char *client_key = NULL;
     if (certfile_path && keyfile_path) {
-        client_cert = pycom_util_read_file(certfile_path, &ssl_sock->vstr_ca);
+        client_cert = pycom_util_read_file(certfile_path, &ssl_sock->vstr_cert);
         if(client_cert == NULL) {
             nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "certificate file not found"));
         }
-        client_key = pycom_util_read_file(keyfile_path, &ssl_sock->vstr_ca);
+        client_key = pycom_util_read_file(keyfile_path, &ssl_sock->vstr_key);
         if(client_key == NULL) {
             nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "key file not found"));
         }
     }
 
 
+    // the heap used by mbedTLS for this socket, record buffers and parsed certificates included
+    size_t heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
     MP_THREAD_GIL_EXIT();
 
     _error = mod_ssl_setup_socket(ssl_sock, saved_session, host_name, ca_cert, client_cert, client_key,
@@ -307,7 +627,20 @@ STATIC mp_obj_t mod_ssl_wrap_socket(mp_uint_t n_args, const mp_obj_t *pos_args,
 
     MP_THREAD_GIL_ENTER();
 
+    size_t heap_now = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    ssl_sock->heap_used = (heap_free > heap_now) ? heap_free - heap_now : 0;
+
+    // the certificates are parsed, their PEM text is not needed anymore
+    if (ca_cert) {
+        vstr_clear(&ssl_sock->vstr_ca);
+    }
+    if (client_cert) {
+        vstr_clear(&ssl_sock->vstr_cert);
+        vstr_clear(&ssl_sock->vstr_key);
+    }
+
     if (_error) {
+        mod_ssl_release(ssl_sock);
         mp_raise_OSError(_error);
     }
 
@@ -350,10 +683,78 @@ STATIC mp_obj_t mod_ssl_save_session(mp_uint_t n_args, const mp_obj_t *pos_args,
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_ssl_save_session_obj, 0, mod_ssl_save_session);
 
+STATIC mp_obj_t mod_ssl_handshake_info(mp_obj_t ssl_sock_in) {
+    if (!mp_obj_is_type(ssl_sock_in, &ssl_socket_type)) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    mp_obj_ssl_socket_t *ssl_sock = ssl_sock_in;
+    mp_obj_t tuple[2];
+    tuple[0] = mp_obj_new_int_from_uint(ssl_sock->handshake_ms);
+    tuple[1] = mp_obj_new_bool(ssl_sock->resumed);
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ssl_handshake_info_obj, mod_ssl_handshake_info);
+
+STATIC mp_obj_t mod_ssl_mem_info(mp_obj_t ssl_sock_in) {
+    if (!mp_obj_is_type(ssl_sock_in, &ssl_socket_type)) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    mp_obj_ssl_socket_t *ssl_sock = ssl_sock_in;
+    mp_obj_t tuple[3];
+    tuple[0] = mp_obj_new_int_from_uint(ssl_sock->heap_used);
+    tuple[1] = mp_obj_new_int_from_uint(sizeof(mp_obj_ssl_socket_t));
+    tuple[2] = mp_obj_new_bool(ssl_sock->ca_entry != NULL);
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ssl_mem_info_obj, mod_ssl_mem_info);
+
+STATIC mp_obj_t mod_ssl_session_cache(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_enable,       MP_ARG_OBJ,                     {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_persist,      MP_ARG_KW_ONLY | MP_ARG_OBJ,    {.u_obj = MP_OBJ_NULL} },
+    };
+
+    // parse arguments
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mod_ssl_cache_check();
+
+    if (args[0].u_obj == MP_OBJ_NULL && args[1].u_obj == MP_OBJ_NULL) {
+        mp_int_t count = 0;
+        for (int i = 0; i < MOD_SSL_SESSION_CACHE_SIZE; i++) {
+            count += (mod_ssl_cache.entry[i].key[0] != '\0');
+        }
+        mp_obj_t tuple[3];
+        tuple[0] = mp_obj_new_bool(mod_ssl_cache.enabled);
+        tuple[1] = mp_obj_new_bool(mod_ssl_cache.persist);
+        tuple[2] = mp_obj_new_int(count);
+        return mp_obj_new_tuple(3, tuple);
+    }
+
+    xSemaphoreTake(mod_ssl_cache_mutex, portMAX_DELAY);
+    if (args[0].u_obj != MP_OBJ_NULL) {
+        mod_ssl_cache.enabled = mp_obj_is_true(args[0].u_obj);
+        if (!mod_ssl_cache.enabled) {
+            memset(mod_ssl_cache.entry, 0, sizeof(mod_ssl_cache.entry));
+        }
+    }
+    if (args[1].u_obj != MP_OBJ_NULL) {
+        mod_ssl_cache.persist = mp_obj_is_true(args[1].u_obj);
+    }
+    xSemaphoreGive(mod_ssl_cache_mutex);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_ssl_session_cache_obj, 0, mod_ssl_session_cache);
+
 STATIC const mp_map_elem_t mp_module_ussl_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__),            MP_OBJ_NEW_QSTR(MP_QSTR_ussl) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_wrap_socket),         (mp_obj_t)&mod_ssl_wrap_socket_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_save_session),        (mp_obj_t)&mod_ssl_save_session_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_handshake_info),      (mp_obj_t)&mod_ssl_handshake_info_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_session_cache),       (mp_obj_t)&mod_ssl_session_cache_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_mem_info),            (mp_obj_t)&mod_ssl_mem_info_obj },
 
     // class exceptions
     { MP_OBJ_NEW_QSTR(MP_QSTR_SSLError),            (mp_obj_t)&mp_type_OSError },
@@ -365,6 +766,9 @@ STATIC const mp_map_elem_t mp_module_ussl_globals_table[] = {
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_SSL_TIMEOUT),         MP_OBJ_NEW_SMALL_INT(MBEDTLS_ERR_SSL_TIMEOUT) },
 
+    { MP_OBJ_NEW_QSTR(MP_QSTR_PROFILE_DEFAULT),     MP_OBJ_NEW_SMALL_INT(MOD_SSL_PROFILE_DEFAULT) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_PROFILE_LOW_MEM),     MP_OBJ_NEW_SMALL_INT(MOD_SSL_PROFILE_LOW_MEM) },
+
     // { MP_OBJ_NEW_QSTR(MP_QSTR_PROTOCOL_SSLv3),      MP_OBJ_NEW_SMALL_INT(SL_SO_SEC_METHOD_SSLV3) },
     // { MP_OBJ_NEW_QSTR(MP_QSTR_PROTOCOL_TLSv1),      MP_OBJ_NEW_SMALL_INT(SL_SO_SEC_METHOD_TLSV1) },
     // { MP_OBJ_NEW_QSTR(MP_QSTR_PROTOCOL_TLSv1_1),    MP_OBJ_NEW_SMALL_INT(SL_SO_SEC_METHOD_TLSV1_1) },
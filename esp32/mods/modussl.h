@@ -24,6 +24,14 @@
 #include "mbedtls/error.h"
 #include "mbedtls/certs.h"
 
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define MOD_SSL_SESSION_KEY_MAX                     72 // host name or peer address, and port
+
+#define MOD_SSL_PROFILE_DEFAULT                     0
+#define MOD_SSL_PROFILE_LOW_MEM                     1
+
 /******************************************************************************
  DEFINE TYPES
  ******************************************************************************/
@@ -43,6 +51,16 @@ typedef struct _mp_obj_ssl_socket_t {
     mbedtls_x509_crt own_cert;
     mbedtls_pk_context pk_key;
     uint8_t read_timeout;
+    // automatic session resumption
+    bool session_cache;
+    bool resumed;
+    uint8_t authmode;
+    uint32_t handshake_ms;
+    char host_name[MOD_SSL_SESSION_KEY_MAX];
+    // memory profile
+    uint8_t profile;
+    void *ca_entry;         // shared CA chain, NULL if cacert is used
+    uint32_t heap_used;
 } mp_obj_ssl_socket_t;
 
 typedef struct _mp_obj_ssl_session_t {
@@ -50,4 +68,10 @@ typedef struct _mp_obj_ssl_session_t {
     mbedtls_ssl_session saved_session;
 } mp_obj_ssl_session_t;
 
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+extern int32_t mod_ssl_handshake (mp_obj_ssl_socket_t *ssl_sock);
+extern void mod_ssl_release (mp_obj_ssl_socket_t *ssl_sock);
+
 #endif /* MODUSSL_H_ */
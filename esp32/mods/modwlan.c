@@ -20,8 +20,10 @@
 #include "py/mphal.h"
 #include "py/mperrno.h"
 #include "py/misc.h"
+#include "py/objint.h"
 
 #include "esp_heap_caps.h"
+#include "esp32chipinfo.h"
 #include "sdkconfig.h"
 #include "esp_system.h"
 #include "esp_spi_flash.h"
@@ -29,6 +31,7 @@
 #include "esp_wifi.h"
 #include "esp_wifi_types.h"
 #include "esp_event_loop.h"
+#include "esp_timer.h"
 #include "ff.h"
 #include "lfs.h"
 #include "vfs_littlefs.h"
@@ -51,6 +54,8 @@
 #include "lwip/dns.h"
 #include "lwip/netdb.h"
 #include "lwipsocket.h"
+#include "mbedtls/md.h"
+#include "mbedtls/pkcs5.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -60,10 +65,87 @@
 #include "pycom_config.h"
 #include "pycom_general_util.h"
 #include "app_sys_evt.h"
+#include "mpenergy.h"
 
 /******************************************************************************
  DEFINE TYPES
  ******************************************************************************/
+/* Single producer (the WiFi driver task), single consumer (the MicroPython task) ring of variable-length frame records,
+ * so the driver callback never has to wait for the consumer nor take a lock. */
+typedef struct {
+    uint8_t                 *buf;
+    uint32_t                size;
+    volatile uint32_t       head;       // only written by the driver callback
+    volatile uint32_t       tail;       // only written by the MicroPython task
+    volatile uint32_t       dropped;
+    // filters applied in the driver callback before a frame is stored
+    uint32_t                snaplen;
+    uint64_t                subtypes;   // bit (type * 16 + subtype) of the 802.11 frame control
+    int32_t                 min_rssi;
+    uint8_t                 mac_prefix[6];
+    uint8_t                 mac_prefix_len;
+} wlan_prom_ring_t;
+
+/* The access point of the last connection made with fast=True, kept across deep sleep and, in NVS, across power cycles.
+ * The PMK is derived from the SSID and the passphrase with 4096 rounds of PBKDF2, given to the driver in hex it's not
+ * derived again on each connection. */
+typedef struct {
+    uint32_t                magic;
+    uint32_t                key_hash;   // of the passphrase the PMK comes from
+    uint8_t                 ssid[32];
+    uint8_t                 ssid_len;
+    uint8_t                 bssid[6];
+    uint8_t                 channel;
+    uint8_t                 auth;       // of the access point
+    bool                    pmk_valid;
+    uint8_t                 pmk[32];
+} wlan_fast_cache_t;
+
+typedef struct {
+    wifi_config_t           fallback;   // scanning, used if the direct attempt fails
+    int64_t                 start_us;   // of the connection attempt, 0 once connected
+    uint32_t                connect_ms;
+    uint32_t                boot_ms;    // from the boot or the wake up to the IP address
+    uint32_t                key_hash;
+    uint8_t                 pmk[32];
+    bool                    pmk_valid;
+    bool                    requested;  // the access point is stored once connected
+    volatile bool           pending;    // the direct attempt is in progress
+    bool                    direct;     // the last connection didn't scan
+} wlan_fast_state_t;
+
+/* A scan started with blocking=False goes one channel at a time, from the SCAN_DONE event of the previous one. The
+ * records of all channels are gathered in a buffer kept for the next scans, one per access point. */
+typedef struct {
+    wifi_scan_config_t      config;
+    wifi_ap_record_t        *records;
+    uint8_t                 ssid[33];
+    uint8_t                 bssid[6];
+    uint16_t                channels;   // bit n for the channel n
+    uint8_t                 num_channels;
+    volatile uint8_t        done;       // channels scanned
+    volatile uint16_t       count;
+    volatile bool           running;
+} wlan_scan_state_t;
+
+/* The frames given at once to send_raw(), sent from an esp_timer callback one per interval, the list of them repeated
+ * the given number of times. The copies of the frames and the counters are in a single allocation, kept until the next
+ * batch so that the counters can still be read once it's done. */
+typedef struct {
+    esp_timer_handle_t      timer;
+    uint8_t                 *mem;
+    uint32_t                *offsets;   // of each frame in frames, one more for the end of the last one
+    uint32_t                *ok;
+    uint32_t                *failed;
+    uint8_t                 *frames;
+    uint32_t                count;
+    uint32_t                index;      // of the next frame to send
+    uint32_t                repeat;     // rounds left, the current one included
+    wifi_interface_t        ifx;
+    bool                    use_sys_seq;
+    volatile bool           running;
+    volatile bool           busy;       // in the callback, the memory is not freed meanwhile
+} wlan_raw_batch_t;
 
 /******************************************************************************
  DEFINE CONSTANTS
@@ -78,6 +160,26 @@
 
 #define MAX_WIFI_PKT_PARAMS                    18
 
+#define WLAN_FAST_CACHE_MAGIC                   0x57464331
+#define WLAN_FAST_NVS_NAMESPACE                 "PY_WLAN"
+#define WLAN_FAST_NVS_KEY                       "fast"
+#define WLAN_PMK_ROUNDS                         4096
+
+#define WLAN_SCAN_RECORDS_MAX                   (64)
+
+// Default size of the promiscuous capture ring, it is allocated in PSRAM when the board has it
+#define WLAN_PROM_RING_SIZE_DEFAULT             (8 * 1024)
+#define WLAN_PROM_RING_SIZE_DEFAULT_PSRAM       (64 * 1024)
+#define WLAN_PROM_RING_SIZE_MIN                 (1024)
+
+#define WLAN_PROM_CONFIG_PARAMS                 6
+
+#define WLAN_RAW_FRAME_LEN_MIN                  (24)
+#define WLAN_RAW_FRAME_LEN_MAX                  (1500)
+#define WLAN_RAW_INTERVAL_US_MIN                (100)
+#define WLAN_RAW_INTERVAL_US_DEFAULT            (1000)
+#define WLAN_RAW_BATCH_MAX                      (256)
+
 #define SMART_CONF_TASK_STACK_SIZE              4096
 
 #define SMART_CONF_TASK_PRIORITY                5
@@ -115,10 +217,23 @@ static bool wlan_conn_recover_hidden = false;
 static wlan_wpa2_ent_obj_t wlan_wpa2_ent;
 static TimerHandle_t wlan_conn_timeout_timer = NULL;
 static TimerHandle_t wlan_smartConfig_timeout = NULL;
-static uint8_t wlan_prom_data_buff[2][MAX_WIFI_PROM_PKT_SIZE] = {0};
-static wlan_internal_prom_t wlan_prom_packet[2];
-
-static uint8_t token = 0;
+static TimerHandle_t wlan_hop_timer = NULL;
+static SemaphoreHandle_t wlan_hop_mutex;
+static uint8_t wlan_hop_channels[MAX_WIFI_CHANNELS];
+static uint8_t wlan_hop_num = 0;
+static uint8_t wlan_hop_idx = 0;
+static RTC_DATA_ATTR wlan_fast_cache_t wlan_fast_cache;
+static wlan_fast_state_t wlan_fast;
+static wlan_raw_batch_t wlan_raw_batch;
+static bool wlan_fast_loaded = false;
+static wlan_scan_state_t wlan_scan_state;
+
+static wlan_prom_ring_t wlan_prom_ring = {
+    .buf = NULL,
+    .snaplen = MAX_WIFI_PROM_PKT_SIZE,
+    .subtypes = UINT64_MAX,
+    .min_rssi = INT32_MIN,
+};
 
 // Event bits
 const int CONNECTED_BIT = BIT0;
@@ -161,7 +276,10 @@ STATIC void wlan_set_security_internal (uint8_t auth, const char *key);
 STATIC void wlan_validate_channel (uint8_t channel);
 STATIC void wlan_set_antenna (uint8_t antenna);
 static esp_err_t wlan_event_handler(void *ctx, system_event_t *event);
-STATIC void wlan_do_connect (const char* ssid, const char* bssid, const wifi_auth_mode_t auth, const char* key, int32_t timeout, const wlan_wpa2_ent_obj_t * const wpa2_ent, const char *hostname, uint8_t channel);
+STATIC void wlan_do_connect (const char* ssid, const char* bssid, const wifi_auth_mode_t auth, const char* key, int32_t timeout, const wlan_wpa2_ent_obj_t * const wpa2_ent, const char *hostname, uint8_t channel, bool fast);
+STATIC void wlan_fast_connected (void);
+STATIC bool wlan_fast_fallback (void);
+STATIC void wlan_scan_next (void);
 static void wlan_init_wlan_recover_params(void);
 static void wlan_timer_callback( TimerHandle_t xTimer );
 static void wlan_validate_country(const char * country);
@@ -169,9 +287,14 @@ static void wlan_validate_country_policy(uint8_t policy);
 STATIC void wlan_stop_sta_conn_timer();
 STATIC void wlan_set_default_inf(void);
 STATIC void wlan_stop_smartConfig_timer();
+STATIC void wlan_stop_hop_timer();
 static void smart_config_callback(smartconfig_status_t status, void *pdata);
 static void TASK_SMART_CONFIG (void *pvParameters);
 STATIC void wlan_callback_handler(void* arg);
+STATIC bool wlan_prom_ring_push(const wifi_promiscuous_pkt_t *pkt, wifi_promiscuous_pkt_type_t type);
+STATIC mp_obj_t wlan_prom_ring_pop(void);
+STATIC bool wlan_prom_ring_alloc(uint32_t size);
+STATIC void wlan_raw_batch_stop(void);
 //*****************************************************************************
 //
 //! \brief The Function Handles WLAN Events
@@ -198,11 +321,9 @@ void wlan_pre_init (void) {
     wlan_obj.started = false;
     wlan_obj.is_promiscuous = false;
     wlan_obj.events = 0;
-    (wlan_prom_packet[0].data) = (uint8_t*) (&(wlan_prom_data_buff[0][0]));
-    (wlan_prom_packet[1].data) = (uint8_t*) (&(wlan_prom_data_buff[1][0]));
-    wlan_obj.mutex = xSemaphoreCreateMutex();
     timeout_mutex = xSemaphoreCreateMutex();
     smartConfigTimeout_mutex = xSemaphoreCreateMutex();
+    wlan_hop_mutex = xSemaphoreCreateMutex();
     // create Smart Config Task
     xTaskCreatePinnedToCore(TASK_SMART_CONFIG, "SmartConfig", SMART_CONF_TASK_STACK_SIZE / sizeof(StackType_t), NULL, SMART_CONF_TASK_PRIORITY, &SmartConfTaskHandle, 1);
 }
@@ -333,7 +454,7 @@ void wlan_setup (wlan_internal_setup_t *config) {
                 }
 
                 // connect to the requested access point
-                wlan_do_connect (config->ssid_sta, NULL, config->auth, config->key_sta, 30000, &wlan_wpa2_ent, NULL, 0);
+                wlan_do_connect (config->ssid_sta, NULL, config->auth, config->key_sta, 30000, &wlan_wpa2_ent, NULL, 0, false);
             }
 
             MP_THREAD_GIL_ENTER();
@@ -368,9 +489,12 @@ STATIC esp_err_t wlan_event_handler(void *ctx, system_event_t *event) {
     switch(event->event_id) {
         case SYSTEM_EVENT_STA_START: /**< ESP32 station start */
             wlan_obj.sta_stopped = false;
+            mpenergy_set(MPENERGY_RAIL_WLAN, true);
             break;
         case SYSTEM_EVENT_STA_STOP:                 /**< ESP32 station stop */
             wlan_obj.sta_stopped = true;
+            // the radio stays on for the soft-AP of the STA_AP mode
+            mpenergy_set(MPENERGY_RAIL_WLAN, !wlan_obj.soft_ap_stopped);
             break;
         case SYSTEM_EVENT_STA_CONNECTED: /**< ESP32 station connected to AP */
         {
@@ -385,6 +509,7 @@ STATIC esp_err_t wlan_event_handler(void *ctx, system_event_t *event) {
         }
             break;
         case SYSTEM_EVENT_STA_GOT_IP: /**< ESP32 station got IP from connected AP */
+            wlan_fast_connected();
             xEventGroupSetBits(wifi_event_group, CONNECTED_BIT);
             mod_network_register_nic(&wlan_obj);
 #if defined(FIPY) || defined(GPY)
@@ -397,6 +522,10 @@ STATIC esp_err_t wlan_event_handler(void *ctx, system_event_t *event) {
             xEventGroupClearBits(wifi_event_group, CONNECTED_BIT);
             system_event_sta_disconnected_t *disconn = &event->event_info.disconnected;
         	is_inf_up = false;
+            if (wlan_fast_fallback()) {
+                // the access point moved or changed, scanning for it this time
+                break;
+            }
             switch (disconn->reason) {
                 case WIFI_REASON_AUTH_FAIL:
                 case WIFI_REASON_ASSOC_LEAVE:
@@ -420,10 +549,12 @@ STATIC esp_err_t wlan_event_handler(void *ctx, system_event_t *event) {
         case SYSTEM_EVENT_AP_START:                 /**< ESP32 soft-AP start */
             mod_wlan_ap_number_of_connections = 0;
             wlan_obj.soft_ap_stopped = false;
+            mpenergy_set(MPENERGY_RAIL_WLAN, true);
             break;
         case SYSTEM_EVENT_AP_STOP:                  /**< ESP32 soft-AP stop */
             xEventGroupClearBits(wifi_event_group, CONNECTED_BIT);
             wlan_obj.soft_ap_stopped = true;
+            mpenergy_set(MPENERGY_RAIL_WLAN, !wlan_obj.sta_stopped);
             break;
         case SYSTEM_EVENT_AP_STACONNECTED:          /**< a station connected to ESP32 soft-AP */
             mod_wlan_ap_number_of_connections++;
@@ -435,8 +566,10 @@ STATIC esp_err_t wlan_event_handler(void *ctx, system_event_t *event) {
                 xEventGroupClearBits(wifi_event_group, CONNECTED_BIT);
             }
             break;
-        case SYSTEM_EVENT_WIFI_READY:                /**< ESP32 WiFi ready */
         case SYSTEM_EVENT_SCAN_DONE:                /**< ESP32 finish scanning AP */
+            wlan_scan_next();
+            break;
+        case SYSTEM_EVENT_WIFI_READY:                /**< ESP32 WiFi ready */
         case SYSTEM_EVENT_STA_AUTHMODE_CHANGE:      /**< the auth mode of AP connected by ESP32 station changed */
         case SYSTEM_EVENT_STA_LOST_IP:              /**< ESP32 station lost IP and the IP is reset to 0 */
         case SYSTEM_EVENT_STA_WPS_ER_SUCCESS:       /**< ESP32 station wps succeeds in enrollee mode */
@@ -489,6 +622,19 @@ STATIC void wlan_timer_callback( TimerHandle_t xTimer )
         //stop smart config
         xEventGroupSetBits(wifi_event_group, ESPTOUCH_STOP_BIT);
     }
+    else if (xTimer == wlan_hop_timer)
+    {
+        // skip this hop rather than block the timer task while the schedule is being changed
+        if (xSemaphoreTake(wlan_hop_mutex, 0) == pdTRUE)
+        {
+            if (wlan_hop_num > 0)
+            {
+                wlan_hop_idx = (wlan_hop_idx + 1) % wlan_hop_num;
+                esp_wifi_set_channel(wlan_hop_channels[wlan_hop_idx], WIFI_SECOND_CHAN_NONE);
+            }
+            xSemaphoreGive(wlan_hop_mutex);
+        }
+    }
     else
     {
         //Nothing
@@ -516,6 +662,17 @@ STATIC void wlan_stop_smartConfig_timer()
     }
     xSemaphoreGive(smartConfigTimeout_mutex);
 }
+STATIC void wlan_stop_hop_timer()
+{
+    xSemaphoreTake(wlan_hop_mutex, portMAX_DELAY);
+    if (wlan_hop_timer != NULL) {
+        xTimerStop(wlan_hop_timer, 0);
+        xTimerDelete(wlan_hop_timer, 0);
+        wlan_hop_timer = NULL;
+    }
+    wlan_hop_num = 0;
+    xSemaphoreGive(wlan_hop_mutex);
+}
 
 // Must be called only when GIL is not locked
 STATIC void wlan_setup_ap (const char *ssid, uint32_t auth, const char *key, uint32_t channel, bool add_mac, bool hidden) {
@@ -725,8 +882,154 @@ static void wlan_validate_country_policy(uint8_t policy)
     }
 }
 
+// FNV-1a, only tells whether the passphrase changed
+STATIC uint32_t wlan_fast_hash (const char *key) {
+    uint32_t hash = 2166136261;
+    for ( ; key != NULL && *key != '\0'; key++) {
+        hash = (hash ^ (uint8_t)*key) * 16777619;
+    }
+    return hash;
+}
+
+// the RTC copy doesn't survive a power cycle, the NVS one is read then
+STATIC void wlan_fast_load (void) {
+    if (wlan_fast_loaded) {
+        return;
+    }
+    wlan_fast_loaded = true;
+    if (wlan_fast_cache.magic == WLAN_FAST_CACHE_MAGIC) {
+        return;
+    }
+    nvs_handle handle;
+    if (nvs_open(WLAN_FAST_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        size_t len = sizeof(wlan_fast_cache);
+        if (nvs_get_blob(handle, WLAN_FAST_NVS_KEY, &wlan_fast_cache, &len) != ESP_OK || len != sizeof(wlan_fast_cache)) {
+            wlan_fast_cache.magic = 0;
+        }
+        nvs_close(handle);
+    }
+}
+
+// runs in the interrupt task, the NVS writes take too long for the event task
+STATIC void wlan_fast_persist (void *arg) {
+    wlan_fast_cache_t stored;
+    size_t len = sizeof(stored);
+    nvs_handle handle;
+    if (nvs_open(WLAN_FAST_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    // the flash is only written when the access point changes
+    if (nvs_get_blob(handle, WLAN_FAST_NVS_KEY, &stored, &len) != ESP_OK || len != sizeof(stored) ||
+        memcmp(&stored, &wlan_fast_cache, sizeof(stored)) != 0) {
+        if (wlan_fast_cache.magic == WLAN_FAST_CACHE_MAGIC) {
+            nvs_set_blob(handle, WLAN_FAST_NVS_KEY, &wlan_fast_cache, sizeof(wlan_fast_cache));
+        } else {
+            nvs_erase_key(handle, WLAN_FAST_NVS_KEY);
+        }
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
+
+STATIC bool wlan_fast_is_psk (uint8_t auth) {
+    return auth == WIFI_AUTH_WPA_PSK || auth == WIFI_AUTH_WPA2_PSK || auth == WIFI_AUTH_WPA_WPA2_PSK;
+}
+
+STATIC void wlan_fast_put_pmk (wifi_config_t *config, const uint8_t *pmk) {
+    static const char hex[] = "0123456789abcdef";
+    // 64 hex digits, the driver takes them as the PMK itself
+    for (int i = 0; i < 32; i++) {
+        config->sta.password[2 * i] = hex[pmk[i] >> 4];
+        config->sta.password[2 * i + 1] = hex[pmk[i] & 0x0F];
+    }
+}
+
+// joins the access point of the last connection without scanning, if it's the same network
+STATIC void wlan_fast_setup (wifi_config_t *config, const char *ssid, const char *key, uint8_t auth) {
+    size_t ssid_len = strlen(ssid);
+    uint32_t key_hash = wlan_fast_hash(key);
+    wlan_fast_load();
+    bool known = wlan_fast_cache.magic == WLAN_FAST_CACHE_MAGIC && wlan_fast_cache.ssid_len == ssid_len &&
+                 memcmp(wlan_fast_cache.ssid, ssid, ssid_len) == 0 && wlan_fast_cache.key_hash == key_hash;
+    if (auth == WIFI_AUTH_MAX && known) {
+        auth = wlan_fast_cache.auth;
+    }
+
+    wlan_fast.key_hash = key_hash;
+    wlan_fast.pmk_valid = false;
+    size_t key_len = (key != NULL) ? strlen(key) : 0;
+    if (wlan_fast_is_psk(auth) && key_len >= 8 && key_len <= 63) {
+        if (known && wlan_fast_cache.pmk_valid) {
+            memcpy(wlan_fast.pmk, wlan_fast_cache.pmk, sizeof(wlan_fast.pmk));
+            wlan_fast.pmk_valid = true;
+        } else {
+            mbedtls_md_context_t md;
+            mbedtls_md_init(&md);
+            wlan_fast.pmk_valid = mbedtls_md_setup(&md, mbedtls_md_info_from_type(MBEDTLS_MD_SHA1), 1) == 0 &&
+                                  mbedtls_pkcs5_pbkdf2_hmac(&md, (const uint8_t *)key, key_len, (const uint8_t *)ssid, ssid_len,
+                                                            WLAN_PMK_ROUNDS, sizeof(wlan_fast.pmk), wlan_fast.pmk) == 0;
+            mbedtls_md_free(&md);
+        }
+        if (wlan_fast.pmk_valid) {
+            wlan_fast_put_pmk(config, wlan_fast.pmk);
+        }
+    }
+
+    memcpy(&wlan_fast.fallback, config, sizeof(wifi_config_t));
+    if (known && wlan_fast_cache.channel > 0) {
+        memcpy(config->sta.bssid, wlan_fast_cache.bssid, sizeof(config->sta.bssid));
+        config->sta.bssid_set = true;
+        config->sta.channel = wlan_fast_cache.channel;
+        config->sta.scan_method = WIFI_FAST_SCAN;
+        wlan_fast.pending = true;
+    }
+}
+
+// the direct attempt failed, tries again with the scanning configuration
+STATIC bool wlan_fast_fallback (void) {
+    if (!wlan_fast.pending) {
+        return false;
+    }
+    wlan_fast.pending = false;
+    wlan_fast_cache.channel = 0;
+    return esp_wifi_set_config(WIFI_IF_STA, &wlan_fast.fallback) == ESP_OK && esp_wifi_connect() == ESP_OK;
+}
+
+STATIC void wlan_fast_connected (void) {
+    if (wlan_fast.start_us == 0) {
+        // a reconnection of the driver
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    wlan_fast.connect_ms = (now - wlan_fast.start_us) / 1000;
+    wlan_fast.boot_ms = now / 1000;
+    wlan_fast.direct = wlan_fast.pending;
+    wlan_fast.pending = false;
+    wlan_fast.start_us = 0;
+    if (!wlan_fast.requested) {
+        return;
+    }
+
+    wlan_fast_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    cache.magic = WLAN_FAST_CACHE_MAGIC;
+    cache.key_hash = wlan_fast.key_hash;
+    cache.ssid_len = strnlen((const char *)wlan_fast.fallback.sta.ssid, sizeof(cache.ssid));
+    memcpy(cache.ssid, wlan_fast.fallback.sta.ssid, cache.ssid_len);
+    memcpy(cache.bssid, wlan_obj.bssid, sizeof(cache.bssid));
+    cache.channel = wlan_obj.channel;
+    cache.auth = wlan_obj.auth;
+    cache.pmk_valid = wlan_fast.pmk_valid;
+    memcpy(cache.pmk, wlan_fast.pmk, sizeof(cache.pmk));
+    if (memcmp(&cache, &wlan_fast_cache, sizeof(cache)) != 0) {
+        memcpy(&wlan_fast_cache, &cache, sizeof(cache));
+        mp_irq_queue_interrupt_non_ISR(wlan_fast_persist, NULL);
+    }
+}
+
 STATIC void wlan_do_connect (const char* ssid, const char* bssid, const wifi_auth_mode_t auth, const char* key,
-                             int32_t timeout, const wlan_wpa2_ent_obj_t * const wpa2_ent, const char* hostname, uint8_t channel) {
+                             int32_t timeout, const wlan_wpa2_ent_obj_t * const wpa2_ent, const char* hostname, uint8_t channel,
+                             bool fast) {
 
     esp_wpa2_config_t wpa2_config = WPA2_CONFIG_INIT_DEFAULT();
     wifi_config_t wifi_config;
@@ -756,6 +1059,13 @@ STATIC void wlan_do_connect (const char* ssid, const char* bssid, const wifi_aut
         wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
     }
 
+    wlan_fast.pending = false;
+    wlan_fast.requested = fast && bssid == NULL && channel == 0 && auth != WIFI_AUTH_WPA2_ENTERPRISE;
+    if (wlan_fast.requested) {
+        wlan_fast_setup(&wifi_config, ssid, key, auth);
+    }
+    wlan_fast.start_us = esp_timer_get_time();
+
     if (ESP_OK != esp_wifi_set_config(WIFI_IF_STA, &wifi_config)) {
         goto os_error;
     }
@@ -861,11 +1171,7 @@ STATIC void wlan_callback_handler(void* arg)
 
 STATIC void promiscuous_callback(void *buf, wifi_promiscuous_pkt_type_t type)
 {
-
-    wifi_pkt_rx_ctrl_t* wlan_ctrl_pkt = (wifi_pkt_rx_ctrl_t*)buf;
-
     bool trigger = false;
-    static uint8_t old_token = 0xFF;
 
     switch (type)
     {
@@ -905,43 +1211,154 @@ STATIC void promiscuous_callback(void *buf, wifi_promiscuous_pkt_type_t type)
         break;
     }
 
-    if (trigger && (token != old_token))
+    if (trigger && wlan_prom_ring_push((const wifi_promiscuous_pkt_t *)buf, type))
     {
-        xSemaphoreTake(wlan_obj.mutex, portMAX_DELAY);
+        // merged with the pending one while the handler has not run yet, so the handler should drain the ring with wifi_packets()
+        mp_irq_queue_interrupt(wlan_callback_handler, &wlan_obj);
+    }
+}
 
-        wlan_prom_packet[token].rx_ctrl.rssi = wlan_ctrl_pkt->rssi;
-        wlan_prom_packet[token].rx_ctrl.rate = wlan_ctrl_pkt->rate;
-        wlan_prom_packet[token].rx_ctrl.sig_mode = wlan_ctrl_pkt->sig_mode;
-        wlan_prom_packet[token].rx_ctrl.mcs = wlan_ctrl_pkt->mcs;
-        wlan_prom_packet[token].rx_ctrl.cwb = wlan_ctrl_pkt->cwb;
-        wlan_prom_packet[token].rx_ctrl.aggregation = wlan_ctrl_pkt->aggregation;
-        wlan_prom_packet[token].rx_ctrl.stbc = wlan_ctrl_pkt->stbc;
-        wlan_prom_packet[token].rx_ctrl.fec_coding = wlan_ctrl_pkt->fec_coding;
-        wlan_prom_packet[token].rx_ctrl.sgi = wlan_ctrl_pkt->sgi;
-        wlan_prom_packet[token].rx_ctrl.noise_floor = wlan_ctrl_pkt->noise_floor;
-        wlan_prom_packet[token].rx_ctrl.ampdu_cnt = wlan_ctrl_pkt->ampdu_cnt;
-        wlan_prom_packet[token].rx_ctrl.channel = wlan_ctrl_pkt->channel;
-        wlan_prom_packet[token].rx_ctrl.secondary_channel = wlan_ctrl_pkt->secondary_channel;
-        wlan_prom_packet[token].rx_ctrl.timestamp = wlan_ctrl_pkt->timestamp;
-        wlan_prom_packet[token].rx_ctrl.ant = wlan_ctrl_pkt->ant;
-        wlan_prom_packet[token].rx_ctrl.sig_len = wlan_ctrl_pkt->sig_len;
-        wlan_prom_packet[token].rx_ctrl.rx_state = wlan_ctrl_pkt->rx_state;
+STATIC bool wlan_prom_ring_push(const wifi_promiscuous_pkt_t *pkt, wifi_promiscuous_pkt_type_t type)
+{
+    wlan_prom_ring_t *ring = &wlan_prom_ring;
+    uint32_t data_len = 0;
 
-        wlan_prom_packet[token].pkt_type = type;
+    if (ring->buf == NULL || pkt->rx_ctrl.rssi < ring->min_rssi) {
+        return false;
+    }
 
+    if (type == WIFI_PKT_MGMT || type == WIFI_PKT_DATA) {
+        const uint8_t *frame = pkt->payload;
+        uint32_t sig_len = pkt->rx_ctrl.sig_len;
 
-        if(type != WIFI_PKT_CTRL)
-        {
-            memcpy(&(wlan_prom_packet[token].data[0]), &(((wifi_promiscuous_pkt_t*)buf)->payload), wlan_prom_packet[token].rx_ctrl.sig_len);
+        if (sig_len < 2 || (ring->subtypes & (1ULL << ((((frame[0] >> 2) & 0x03) << 4) | (frame[0] >> 4)))) == 0) {
+            return false;
+        }
+        // addr2 is the transmitter address
+        if (ring->mac_prefix_len > 0 && (sig_len < 16 || memcmp(&frame[10], ring->mac_prefix, ring->mac_prefix_len) != 0)) {
+            return false;
         }
+        data_len = MIN(sig_len, ring->snaplen);
+    } else if (type == WIFI_PKT_MISC) {
+        data_len = MIN(pkt->rx_ctrl.sig_len, ring->snaplen);
+    }
 
-        xSemaphoreGive(wlan_obj.mutex);
+    uint32_t need = (sizeof(wlan_internal_prom_t) + data_len + 3) & ~3;
+    uint32_t head = ring->head;
+    uint32_t tail = ring->tail;
+    uint32_t start;
 
-        old_token = token;
+    // head == tail means empty, so a record never fills the last free byte before the tail
+    if (head >= tail) {
+        if (head + need < ring->size || (head + need == ring->size && tail > 0)) {
+            start = head;
+        } else if (need < tail) {
+            ((wlan_internal_prom_t *)&ring->buf[head])->len = 0;
+            start = 0;
+        } else {
+            ring->dropped++;
+            return false;
+        }
+    } else if (head + need < tail) {
+        start = head;
+    } else {
+        ring->dropped++;
+        return false;
+    }
 
-        mp_irq_queue_interrupt(wlan_callback_handler, &wlan_obj);
+    wlan_internal_prom_t *rec = (wlan_internal_prom_t *)&ring->buf[start];
+    rec->rx_ctrl = pkt->rx_ctrl;
+    rec->len = need;
+    rec->data_len = data_len;
+    rec->pkt_type = type;
+    memcpy((uint8_t *)rec + sizeof(wlan_internal_prom_t), pkt->payload, data_len);
+
+    // the record must be complete before the consumer can see it
+    __sync_synchronize();
+    ring->head = (start + need == ring->size) ? 0 : start + need;
+
+    return true;
+}
+
+// Removes the oldest frame from the ring, returns MP_OBJ_NULL if it is empty
+STATIC mp_obj_t wlan_prom_ring_pop(void)
+{
+    STATIC const qstr wlan_pkt_info_fields[] = {
+            MP_QSTR_rssi, MP_QSTR_rate, MP_QSTR_sig_mode, MP_QSTR_mcs, MP_QSTR_cwb, MP_QSTR_aggregation, MP_QSTR_stbc, MP_QSTR_fec_coding, MP_QSTR_sgi, MP_QSTR_noise_floor, MP_QSTR_ampdu_cnt, MP_QSTR_channel,
+            MP_QSTR_sec_channel, MP_QSTR_time_stamp, MP_QSTR_ant, MP_QSTR_sig_len, MP_QSTR_rx_state, MP_QSTR_data
+        };
+
+    wlan_prom_ring_t *ring = &wlan_prom_ring;
+    uint32_t tail = ring->tail;
+
+    if (ring->buf == NULL || tail == ring->head) {
+        return MP_OBJ_NULL;
+    }
+    __sync_synchronize();
+
+    wlan_internal_prom_t *rec = (wlan_internal_prom_t *)&ring->buf[tail];
+    if (rec->len == 0) {
+        // wrap marker, the next record is at the start of the ring
+        tail = 0;
+        rec = (wlan_internal_prom_t *)ring->buf;
+    }
+
+    mp_obj_t tuple[MAX_WIFI_PKT_PARAMS];
 
+    tuple[0] = mp_obj_new_int(rec->rx_ctrl.rssi);
+    tuple[1] = mp_obj_new_int(rec->rx_ctrl.rate);
+    tuple[2] = mp_obj_new_int(rec->rx_ctrl.sig_mode);
+    tuple[3] = mp_obj_new_int(rec->rx_ctrl.mcs);
+    tuple[4] = mp_obj_new_int(rec->rx_ctrl.cwb);
+    tuple[5] = mp_obj_new_int(rec->rx_ctrl.aggregation);
+    tuple[6] = mp_obj_new_int(rec->rx_ctrl.stbc);
+    tuple[7] = mp_obj_new_int(rec->rx_ctrl.fec_coding);
+    tuple[8] = mp_obj_new_int(rec->rx_ctrl.sgi);
+    tuple[9] = mp_obj_new_int(rec->rx_ctrl.noise_floor);
+    tuple[10] = mp_obj_new_int(rec->rx_ctrl.ampdu_cnt);
+    tuple[11] = mp_obj_new_int(rec->rx_ctrl.channel);
+    tuple[12] = mp_obj_new_int(rec->rx_ctrl.secondary_channel);
+    tuple[13] = mp_obj_new_int(rec->rx_ctrl.timestamp);
+    tuple[14] = mp_obj_new_int(rec->rx_ctrl.ant);
+    tuple[15] = mp_obj_new_int(rec->rx_ctrl.sig_len);
+    tuple[16] = mp_obj_new_int(rec->rx_ctrl.rx_state);
+
+    if(rec->pkt_type != WIFI_PKT_CTRL)
+    {
+        tuple[17] = mp_obj_new_bytes((uint8_t *)rec + sizeof(wlan_internal_prom_t), rec->data_len);
+    }
+    else
+    {
+        tuple[17] = mp_const_none;
     }
+
+    tail += rec->len;
+    // the record must be copied out before the producer can overwrite it
+    __sync_synchronize();
+    ring->tail = (tail == ring->size) ? 0 : tail;
+
+    return mp_obj_new_attrtuple(wlan_pkt_info_fields, MAX_WIFI_PKT_PARAMS, tuple);
+}
+
+STATIC bool wlan_prom_ring_alloc(uint32_t size)
+{
+    uint8_t *buf = NULL;
+
+    if (esp32_get_chip_rev() > 0) {
+        buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (buf == NULL) {
+        buf = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (buf == NULL) {
+        return false;
+    }
+    heap_caps_free(wlan_prom_ring.buf);
+    wlan_prom_ring.buf = buf;
+    wlan_prom_ring.size = size;
+    wlan_prom_ring.head = 0;
+    wlan_prom_ring.tail = 0;
+    return true;
 }
 
 STATIC void wlan_set_default_inf(void)
@@ -1286,7 +1703,10 @@ mp_obj_t wlan_deinit(mp_obj_t self_in) {
             }
         }
 
+        wlan_stop_hop_timer();
+        wlan_raw_batch_stop();
         mod_network_deregister_nic(&wlan_obj);
+        wlan_scan_state.running = false;
         esp_wifi_stop();
 
         /* wait for sta and Soft-AP to stop */
@@ -1309,11 +1729,139 @@ mp_obj_t wlan_deinit(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(wlan_deinit_obj, wlan_deinit);
 
-STATIC mp_obj_t wlan_scan(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+STATIC mp_obj_t wlan_scan_record (const wifi_ap_record_t *ap_record) {
     STATIC const qstr wlan_scan_info_fields[] = {
         MP_QSTR_ssid, MP_QSTR_bssid, MP_QSTR_sec, MP_QSTR_channel, MP_QSTR_rssi
     };
+    mp_obj_t tuple[5];
+    tuple[0] = mp_obj_new_str((const char *)ap_record->ssid, strlen((char *)ap_record->ssid));
+    tuple[1] = mp_obj_new_bytes((const byte *)ap_record->bssid, sizeof(ap_record->bssid));
+    tuple[2] = mp_obj_new_int(ap_record->authmode);
+    tuple[3] = mp_obj_new_int(ap_record->primary);
+    tuple[4] = mp_obj_new_int(ap_record->rssi);
+    return mp_obj_new_attrtuple(wlan_scan_info_fields, 5, tuple);
+}
+
+// runs in the event task once a channel is scanned
+STATIC void wlan_scan_next (void) {
+    wlan_scan_state_t *scan = &wlan_scan_state;
+    if (!scan->running) {
+        // a blocking scan
+        return;
+    }
+
+    uint16_t count = scan->count;
+    uint16_t num = WLAN_SCAN_RECORDS_MAX - count;
+    if (num == 0 || esp_wifi_scan_get_ap_records(&num, &scan->records[count]) != ESP_OK) {
+        num = 0;
+    }
+    // the neighbouring channels show the same access points, only the strongest record of each is kept
+    for (uint16_t i = count; i < count + num; ) {
+        wifi_ap_record_t *rec = &scan->records[i];
+        uint16_t j;
+        for (j = 0; j < count; j++) {
+            if (memcmp(scan->records[j].bssid, rec->bssid, sizeof(rec->bssid)) == 0) {
+                break;
+            }
+        }
+        if (j < count) {
+            if (rec->rssi > scan->records[j].rssi) {
+                memcpy(&scan->records[j], rec, sizeof(wifi_ap_record_t));
+            }
+            memcpy(rec, &scan->records[count + num - 1], sizeof(wifi_ap_record_t));
+            num--;
+        } else {
+            i++;
+        }
+    }
+    scan->count = count + num;
+    scan->done++;
 
+    uint32_t event = MOD_WLAN_SCAN_CHANNEL_DONE;
+    if (scan->done < scan->num_channels) {
+        do {
+            scan->config.channel++;
+        } while (!(scan->channels & (1 << scan->config.channel)));
+        if (esp_wifi_scan_start(&scan->config, false) != ESP_OK) {
+            scan->running = false;
+        }
+    } else {
+        scan->running = false;
+    }
+    if (!scan->running) {
+        event |= MOD_WLAN_SCAN_DONE;
+    }
+    wlan_obj.events |= event;
+    if (wlan_obj.trigger & event) {
+        mp_irq_queue_interrupt_non_ISR(wlan_callback_handler, &wlan_obj);
+    }
+}
+
+STATIC void wlan_scan_start_async (const wifi_scan_config_t *config, mp_obj_t channels_in) {
+    wlan_scan_state_t *scan = &wlan_scan_state;
+    if (scan->running) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_resource_not_avaliable));
+    }
+    if (scan->records == NULL) {
+        scan->records = heap_caps_malloc(WLAN_SCAN_RECORDS_MAX * sizeof(wifi_ap_record_t), MALLOC_CAP_8BIT);
+        if (scan->records == NULL) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+    }
+
+    // the filters are copied, the Python objects could go away before the scan ends
+    memcpy(&scan->config, config, sizeof(wifi_scan_config_t));
+    if (config->ssid != NULL) {
+        strncpy((char *)scan->ssid, (const char *)config->ssid, sizeof(scan->ssid) - 1);
+        scan->ssid[sizeof(scan->ssid) - 1] = '\0';
+        scan->config.ssid = scan->ssid;
+    }
+    if (config->bssid != NULL) {
+        memcpy(scan->bssid, config->bssid, sizeof(scan->bssid));
+        scan->config.bssid = scan->bssid;
+    }
+
+    uint16_t mask = 0;
+    if (channels_in != mp_const_none) {
+        mp_obj_t *channels;
+        size_t len;
+        mp_obj_get_array(channels_in, &len, &channels);
+        if (len == 0) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid channels"));
+        }
+        for (size_t i = 0; i < len; i++) {
+            uint8_t channel = mp_obj_get_int(channels[i]);
+            wlan_validate_channel(channel);
+            mask |= 1 << channel;
+        }
+    } else if (config->channel > 0) {
+        mask = 1 << config->channel;
+    } else {
+        // those allowed in the country set
+        wifi_country_t country;
+        uint8_t first = 1, num = 13;
+        if (esp_wifi_get_country(&country) == ESP_OK && country.nchan > 0) {
+            first = country.schan;
+            num = country.nchan;
+        }
+        for (uint8_t channel = first; channel < first + num && channel <= MAX_WIFI_CHANNELS; channel++) {
+            mask |= 1 << channel;
+        }
+    }
+
+    scan->channels = mask;
+    scan->num_channels = __builtin_popcount(mask);
+    scan->count = 0;
+    scan->done = 0;
+    scan->config.channel = __builtin_ctz(mask);
+    scan->running = true;
+    if (esp_wifi_scan_start(&scan->config, false) != ESP_OK) {
+        scan->running = false;
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Scan operation Failed!"));
+    }
+}
+
+STATIC mp_obj_t wlan_scan(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     STATIC const mp_arg_t allowed_args[] = {
         { MP_QSTR_ssid,                 MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
         { MP_QSTR_bssid,                MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
@@ -1321,6 +1869,9 @@ STATIC mp_obj_t wlan_scan(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *
         { MP_QSTR_show_hidden,          MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
         { MP_QSTR_type,                 MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
         { MP_QSTR_scantime,             MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_blocking,             MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_channels,             MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_dwell,                MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
     };
 
     // parse args
@@ -1432,6 +1983,25 @@ STATIC mp_obj_t wlan_scan(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *
         }
     }
 
+    // ms spent on each channel, whatever the scan type
+    if(args[8].u_obj != mp_const_none)
+    {
+        mp_int_t dwell = mp_obj_get_int(args[8].u_obj);
+        if(dwell <= 0)
+        {
+            goto scan_time_err;
+        }
+        if(scan_config.scan_type == WIFI_SCAN_TYPE_PASSIVE)
+        {
+            scan_config.scan_time.passive = dwell;
+        }
+        else
+        {
+            scan_config.scan_time.active.min = 0;
+            scan_config.scan_time.active.max = dwell;
+        }
+    }
+
     ptr_config = &scan_config;
 
     // check for the correct wlan mode
@@ -1439,6 +2009,15 @@ STATIC mp_obj_t wlan_scan(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
     }
 
+    // returns at once, the results come with scan_results()
+    if (!args[6].u_bool) {
+        wlan_scan_start_async(ptr_config, args[7].u_obj);
+        return mp_const_none;
+    }
+    if (wlan_scan_state.running) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_resource_not_avaliable));
+    }
+
     MP_THREAD_GIL_EXIT();
     esp_err_t err = esp_wifi_scan_start(ptr_config, true);
     MP_THREAD_GIL_ENTER();
@@ -1473,15 +2052,8 @@ STATIC mp_obj_t wlan_scan(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *
         if (ESP_OK == esp_wifi_scan_get_ap_records(&ap_num, (wifi_ap_record_t *)ap_record_buffer)) {
             for (int i = 0; i < ap_num; i++) {
                 ap_record = &ap_record_buffer[i];
-                mp_obj_t tuple[5];
-                tuple[0] = mp_obj_new_str((const char *)ap_record->ssid, strlen((char *)ap_record->ssid));
-                tuple[1] = mp_obj_new_bytes((const byte *)ap_record->bssid, sizeof(ap_record->bssid));
-                tuple[2] = mp_obj_new_int(ap_record->authmode);
-                tuple[3] = mp_obj_new_int(ap_record->primary);
-                tuple[4] = mp_obj_new_int(ap_record->rssi);
-
                 // add the network to the list
-                mp_obj_list_append(nets, mp_obj_new_attrtuple(wlan_scan_info_fields, 5, tuple));
+                mp_obj_list_append(nets, wlan_scan_record(ap_record));
             }
         }
         free(ap_record_buffer);
@@ -1495,6 +2067,32 @@ scan_time_err:
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(wlan_scan_obj, 1, wlan_scan);
 
+// the records of the scan started with blocking=False, from the given index, those of the channels done so far
+STATIC mp_obj_t wlan_scan_results(mp_uint_t n_args, const mp_obj_t *args) {
+    wlan_scan_state_t *scan = &wlan_scan_state;
+    mp_int_t start = (n_args > 1) ? mp_obj_get_int(args[1]) : 0;
+    mp_obj_t nets = mp_obj_new_list(0, NULL);
+    uint16_t count = scan->count;
+    for (mp_int_t i = MAX(start, 0); i < count; i++) {
+        mp_obj_list_append(nets, wlan_scan_record(&scan->records[i]));
+    }
+    return nets;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(wlan_scan_results_obj, 1, 2, wlan_scan_results);
+
+// (running, channels scanned, channels to scan, records)
+STATIC mp_obj_t wlan_scan_status(mp_obj_t self_in) {
+    wlan_scan_state_t *scan = &wlan_scan_state;
+    mp_obj_t tuple[4] = {
+        mp_obj_new_bool(scan->running),
+        MP_OBJ_NEW_SMALL_INT(scan->done),
+        MP_OBJ_NEW_SMALL_INT(scan->num_channels),
+        MP_OBJ_NEW_SMALL_INT(scan->count),
+    };
+    return mp_obj_new_tuple(4, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(wlan_scan_status_obj, wlan_scan_status);
+
 STATIC mp_obj_t wlan_connect(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     STATIC const mp_arg_t allowed_args[] = {
         { MP_QSTR_ssid,                 MP_ARG_REQUIRED | MP_ARG_OBJ, },
@@ -1507,6 +2105,7 @@ STATIC mp_obj_t wlan_connect(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_
         { MP_QSTR_identity,             MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
         { MP_QSTR_hostname,             MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
         { MP_QSTR_channel,              MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_fast,                 MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
     };
 
     // check for the correct wlan mode
@@ -1625,7 +2224,7 @@ STATIC mp_obj_t wlan_connect(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_
         vTaskDelay(100/portTICK_PERIOD_MS);
     }
     // connect to the requested access point
-    wlan_do_connect (ssid, bssid, auth, key, timeout, &wlan_wpa2_ent, hostname, channel);
+    wlan_do_connect (ssid, bssid, auth, key, timeout, &wlan_wpa2_ent, hostname, channel, args[10].u_bool);
 
     return mp_const_none;
 
@@ -1836,6 +2435,20 @@ STATIC mp_obj_t wlan_ssid (mp_uint_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(wlan_ssid_obj, 1, 2, wlan_ssid);
 
+// (ms of the last connection, ms from the boot or the wake up, True if it didn't scan), None while connecting
+STATIC mp_obj_t wlan_connect_time (mp_obj_t self_in) {
+    if (wlan_fast.start_us != 0 || wlan_fast.boot_ms == 0) {
+        return mp_const_none;
+    }
+    mp_obj_t tuple[3] = {
+        mp_obj_new_int_from_uint(wlan_fast.connect_ms),
+        mp_obj_new_int_from_uint(wlan_fast.boot_ms),
+        mp_obj_new_bool(wlan_fast.direct),
+    };
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(wlan_connect_time_obj, wlan_connect_time);
+
 STATIC mp_obj_t wlan_bssid (mp_obj_t self_in) {
     wlan_obj_t *self = self_in;
     return mp_obj_new_bytes((const byte *)self->bssid, 6);
@@ -2118,12 +2731,157 @@ STATIC mp_obj_t wlan_hostname (mp_uint_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(wlan_hostname_obj, 1, 2, wlan_hostname);
 
+// runs in the esp_timer task, one frame per call
+STATIC void wlan_raw_batch_send(void *arg)
+{
+    wlan_raw_batch_t *batch = &wlan_raw_batch;
+
+    batch->busy = true;
+    if (batch->running) {
+        uint32_t i = batch->index;
+        if (ESP_OK == esp_wifi_80211_tx(batch->ifx, &batch->frames[batch->offsets[i]], batch->offsets[i + 1] - batch->offsets[i],
+                                        batch->use_sys_seq)) {
+            batch->ok[i]++;
+        } else {
+            batch->failed[i]++;
+        }
+        if (++batch->index == batch->count) {
+            batch->index = 0;
+            if (--batch->repeat == 0) {
+                batch->running = false;
+                esp_timer_stop(batch->timer);
+            }
+        }
+    }
+    batch->busy = false;
+}
+
+STATIC void wlan_raw_batch_stop(void)
+{
+    if (wlan_raw_batch.timer != NULL) {
+        wlan_raw_batch.running = false;
+        esp_timer_stop(wlan_raw_batch.timer);
+        // a callback already started finishes with the frame it sends
+        while (wlan_raw_batch.busy) {
+            vTaskDelay(1 / portTICK_PERIOD_MS);
+        }
+    }
+}
+
+STATIC uint32_t wlan_raw_frame_len(size_t len)
+{
+    if (len > WLAN_RAW_FRAME_LEN_MAX || len < WLAN_RAW_FRAME_LEN_MIN) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Buffer size should be between 24 and 1500 bytes!"));
+    }
+    return len;
+}
+
+// frames is a list or a tuple of frames, or a buffer with all of them one after the other if lengths is given
+STATIC void wlan_raw_batch_start(wifi_interface_t ifx, bool use_sys_seq, mp_obj_t frames, mp_obj_t lengths,
+                                 mp_int_t interval_us, mp_int_t repeat)
+{
+    wlan_raw_batch_t *batch = &wlan_raw_batch;
+    mp_buffer_info_t bufinfo;
+    mp_obj_t *items;
+    size_t count;
+    uint32_t total = 0;
+
+    if (lengths != mp_const_none) {
+        mp_get_buffer_raise(frames, &bufinfo, MP_BUFFER_READ);
+        mp_obj_get_array(lengths, &count, &items);
+        for (size_t i = 0; i < count; i++) {
+            total += wlan_raw_frame_len(mp_obj_get_int(items[i]));
+        }
+        if (total > bufinfo.len) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "the lengths exceed the buffer"));
+        }
+    } else if (MP_OBJ_IS_TYPE(frames, &mp_type_list) || MP_OBJ_IS_TYPE(frames, &mp_type_tuple)) {
+        mp_obj_get_array(frames, &count, &items);
+        for (size_t i = 0; i < count; i++) {
+            mp_get_buffer_raise(items[i], &bufinfo, MP_BUFFER_READ);
+            total += wlan_raw_frame_len(bufinfo.len);
+        }
+    } else {
+        // a single frame repeated
+        mp_get_buffer_raise(frames, &bufinfo, MP_BUFFER_READ);
+        items = &frames;
+        count = 1;
+        total = wlan_raw_frame_len(bufinfo.len);
+    }
+    if (count == 0 || count > WLAN_RAW_BATCH_MAX) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "between 1 and 256 frames per batch"));
+    }
+    if (interval_us < WLAN_RAW_INTERVAL_US_MIN || repeat < 1) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+
+    if (batch->timer == NULL) {
+        esp_timer_create_args_t timer_args = {
+            .callback = wlan_raw_batch_send,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "wlan_raw",
+        };
+        if (ESP_OK != esp_timer_create(&timer_args, &batch->timer)) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+        }
+    }
+    // the previous batch is given up, even if it's not done
+    wlan_raw_batch_stop();
+    heap_caps_free(batch->mem);
+    batch->mem = NULL;
+    batch->count = 0;
+
+    // the driver copies the frame, but not from the PSRAM
+    uint8_t *mem = heap_caps_malloc(((count + 1) + (count * 2)) * sizeof(uint32_t) + total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (mem == NULL) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    batch->mem = mem;
+    batch->offsets = (uint32_t *)mem;
+    batch->ok = &batch->offsets[count + 1];
+    batch->failed = &batch->ok[count];
+    batch->frames = (uint8_t *)&batch->failed[count];
+
+    uint32_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t len;
+        if (lengths != mp_const_none) {
+            len = mp_obj_get_int(items[i]);
+            memcpy(&batch->frames[offset], (uint8_t *)bufinfo.buf + offset, len);
+        } else {
+            mp_get_buffer_raise(items[i], &bufinfo, MP_BUFFER_READ);
+            len = bufinfo.len;
+            memcpy(&batch->frames[offset], bufinfo.buf, len);
+        }
+        batch->offsets[i] = offset;
+        batch->ok[i] = 0;
+        batch->failed[i] = 0;
+        offset += len;
+    }
+    batch->offsets[count] = offset;
+    batch->count = count;
+    batch->index = 0;
+    batch->repeat = repeat;
+    batch->ifx = ifx;
+    batch->use_sys_seq = use_sys_seq;
+    batch->running = true;
+
+    if (ESP_OK != esp_timer_start_periodic(batch->timer, interval_us)) {
+        batch->running = false;
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+}
+
 STATIC mp_obj_t wlan_send_raw (mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
 
     STATIC const mp_arg_t allowed_args[] = {
         { MP_QSTR_Buffer,                     MP_ARG_KW_ONLY  | MP_ARG_REQUIRED    |MP_ARG_OBJ,},
         { MP_QSTR_interface,                  MP_ARG_KW_ONLY  | MP_ARG_INT,    {.u_int = WIFI_MODE_STA}},
         { MP_QSTR_use_sys_seq,              MP_ARG_KW_ONLY  | MP_ARG_BOOL,    {.u_bool = true}},
+        { MP_QSTR_lengths,                    MP_ARG_KW_ONLY  | MP_ARG_OBJ,     {.u_obj = mp_const_none}},
+        { MP_QSTR_interval,                   MP_ARG_KW_ONLY  | MP_ARG_INT,     {.u_int = WLAN_RAW_INTERVAL_US_DEFAULT}},
+        { MP_QSTR_repeat,                     MP_ARG_KW_ONLY  | MP_ARG_INT,     {.u_int = 1}},
     };
 
     mp_buffer_info_t value_bufinfo;
@@ -2158,6 +2916,19 @@ STATIC mp_obj_t wlan_send_raw (mp_uint_t n_args, const mp_obj_t *pos_args, mp_ma
         break;
     }
 
+    // Buffer=None stops the batch in progress
+    if (args[0].u_obj == mp_const_none) {
+        wlan_raw_batch_stop();
+        return mp_const_none;
+    }
+
+    // several frames, or one repeated, are sent in the background, send_raw_status() tells how it went
+    if (args[3].u_obj != mp_const_none || args[5].u_int != 1 ||
+        MP_OBJ_IS_TYPE(args[0].u_obj, &mp_type_list) || MP_OBJ_IS_TYPE(args[0].u_obj, &mp_type_tuple)) {
+        wlan_raw_batch_start(ifx, args[2].u_bool, args[0].u_obj, args[3].u_obj, args[4].u_int, args[5].u_int);
+        return mp_const_none;
+    }
+
     if(!MP_OBJ_IS_TYPE(args[0].u_obj, &mp_type_bytes))
     {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_TypeError, mpexception_num_type_invalid_arguments));
@@ -2165,11 +2936,7 @@ STATIC mp_obj_t wlan_send_raw (mp_uint_t n_args, const mp_obj_t *pos_args, mp_ma
     else
     {
         mp_get_buffer_raise(args[0].u_obj, &value_bufinfo, MP_BUFFER_READ);
-
-        if(value_bufinfo.len > 1500 || value_bufinfo.len < 24)
-        {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Buffer size should be between 24 and 1500 bytes!"));
-        }
+        wlan_raw_frame_len(value_bufinfo.len);
     }
 
     //send packet
@@ -2183,6 +2950,20 @@ STATIC mp_obj_t wlan_send_raw (mp_uint_t n_args, const mp_obj_t *pos_args, mp_ma
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(wlan_send_raw_obj, 1, wlan_send_raw);
 
+// (running, ok, failed) of the last batch, with the counters of each frame
+STATIC mp_obj_t wlan_send_raw_status (mp_obj_t self_in) {
+    wlan_raw_batch_t *batch = &wlan_raw_batch;
+    mp_obj_tuple_t *ok = mp_obj_new_tuple(batch->count, NULL);
+    mp_obj_tuple_t *failed = mp_obj_new_tuple(batch->count, NULL);
+    for (uint32_t i = 0; i < batch->count; i++) {
+        ok->items[i] = mp_obj_new_int_from_uint(batch->ok[i]);
+        failed->items[i] = mp_obj_new_int_from_uint(batch->failed[i]);
+    }
+    mp_obj_t tuple[3] = { mp_obj_new_bool(batch->running), MP_OBJ_FROM_PTR(ok), MP_OBJ_FROM_PTR(failed) };
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(wlan_send_raw_status_obj, wlan_send_raw_status);
+
 STATIC mp_obj_t wlan_channel (mp_uint_t n_args, const mp_obj_t *args) {
     wlan_obj_t *self = args[0];
     if (n_args == 1) {
@@ -2245,6 +3026,69 @@ STATIC mp_obj_t wlan_channel (mp_uint_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(wlan_channel_obj, 1, 2, wlan_channel);
 
+STATIC mp_obj_t wlan_hop(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_channels,     MP_ARG_OBJ,                     {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_dwell_ms,     MP_ARG_INT,                     {.u_int = 200} },
+    };
+
+    // parse arguments
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+    wlan_obj_t *self = pos_args[0];
+
+    if (args[0].u_obj == MP_OBJ_NULL) {
+        /* return the current schedule */
+        if (wlan_hop_num == 0) {
+            return mp_const_none;
+        }
+        mp_obj_t channels[MAX_WIFI_CHANNELS];
+        for (int i = 0; i < wlan_hop_num; i++) {
+            channels[i] = mp_obj_new_int(wlan_hop_channels[i]);
+        }
+        return mp_obj_new_tuple(wlan_hop_num, channels);
+    }
+
+    wlan_stop_hop_timer();
+    if (args[0].u_obj == mp_const_none) {
+        return mp_const_none;
+    }
+
+    if (self->mode != WIFI_MODE_STA || !self->is_promiscuous) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Wifi is not in promiscuous mode!"));
+    }
+
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_get_array(args[0].u_obj, &len, &items);
+    TickType_t period = args[1].u_int / portTICK_PERIOD_MS;
+    if (len == 0 || len > MAX_WIFI_CHANNELS || args[1].u_int < 0 || period == 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
+    }
+    uint8_t channels[MAX_WIFI_CHANNELS];
+    for (size_t i = 0; i < len; i++) {
+        channels[i] = mp_obj_get_int(items[i]);
+        wlan_validate_channel(channels[i]);
+    }
+
+    esp_wifi_set_channel(channels[0], WIFI_SECOND_CHAN_NONE);
+
+    xSemaphoreTake(wlan_hop_mutex, portMAX_DELAY);
+    memcpy(wlan_hop_channels, channels, len);
+    wlan_hop_num = len;
+    wlan_hop_idx = 0;
+    wlan_hop_timer = xTimerCreate("Wlan_Hop", period, pdTRUE, 0, wlan_timer_callback);
+    xSemaphoreGive(wlan_hop_mutex);
+
+    if (wlan_hop_timer == NULL || xTimerStart(wlan_hop_timer, 0) != pdPASS) {
+        wlan_stop_hop_timer();
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_operation_failed));
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(wlan_hop_obj, 1, wlan_hop);
+
 STATIC mp_obj_t wlan_antenna (mp_uint_t n_args, const mp_obj_t *args) {
     wlan_obj_t *self = args[0];
     if (n_args == 1) {
@@ -2503,6 +3347,10 @@ STATIC mp_obj_t wlan_promiscuous_mode (mp_uint_t n_args, const mp_obj_t *args)
         /* Set promiscuous mode */
         if(mp_obj_is_true(args[1]))
         {
+            if (wlan_prom_ring.buf == NULL && !wlan_prom_ring_alloc(esp32_get_chip_rev() > 0 ? WLAN_PROM_RING_SIZE_DEFAULT_PSRAM : WLAN_PROM_RING_SIZE_DEFAULT))
+            {
+                goto error;
+            }
             if(ESP_OK == esp_wifi_set_promiscuous(true))
             {
                 self->is_promiscuous = true;
@@ -2515,6 +3363,7 @@ STATIC mp_obj_t wlan_promiscuous_mode (mp_uint_t n_args, const mp_obj_t *args)
         }
         else
         {
+            wlan_stop_hop_timer();
             if(ESP_OK == esp_wifi_set_promiscuous(false))
             {
                 self->is_promiscuous = false;
@@ -2615,54 +3464,117 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(wlan_events_obj, wlan_events);
 
 STATIC mp_obj_t wlan_packet(mp_obj_t self_in) {
 
-    wlan_obj_t* self = self_in;
+    mp_obj_t packet = wlan_prom_ring_pop();
 
-    STATIC const qstr wlan_pkt_info_fields[] = {
-            MP_QSTR_rssi, MP_QSTR_rate, MP_QSTR_sig_mode, MP_QSTR_mcs, MP_QSTR_cwb, MP_QSTR_aggregation, MP_QSTR_stbc, MP_QSTR_fec_coding, MP_QSTR_sgi, MP_QSTR_noise_floor, MP_QSTR_ampdu_cnt, MP_QSTR_channel,
-            MP_QSTR_sec_channel, MP_QSTR_time_stamp, MP_QSTR_ant, MP_QSTR_sig_len, MP_QSTR_rx_state, MP_QSTR_data
-        };
+    return (packet == MP_OBJ_NULL) ? mp_const_none : packet;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(wlan_packet_obj, wlan_packet);
 
-    uint8_t loc_tocken = token;
+STATIC mp_obj_t wlan_packets(mp_uint_t n_args, const mp_obj_t *args) {
 
-    xSemaphoreTake(self->mutex, portMAX_DELAY);
+    mp_int_t max = (n_args > 1) ? mp_obj_get_int(args[1]) : -1;
+    mp_obj_t list = mp_obj_new_list(0, NULL);
 
-    token ^= 1;
+    for (mp_int_t i = 0; i != max; i++) {
+        mp_obj_t packet = wlan_prom_ring_pop();
+        if (packet == MP_OBJ_NULL) {
+            break;
+        }
+        mp_obj_list_append(list, packet);
+    }
 
-    xSemaphoreGive(self->mutex);
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(wlan_packets_obj, 1, 2, wlan_packets);
 
-    mp_obj_t tuple[MAX_WIFI_PKT_PARAMS];
+STATIC mp_obj_t wlan_prom_config(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_size,         MP_ARG_KW_ONLY | MP_ARG_OBJ,    {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_snaplen,      MP_ARG_KW_ONLY | MP_ARG_OBJ,    {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_subtypes,     MP_ARG_KW_ONLY | MP_ARG_OBJ,    {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_mac,          MP_ARG_KW_ONLY | MP_ARG_OBJ,    {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_rssi,         MP_ARG_KW_ONLY | MP_ARG_OBJ,    {.u_obj = MP_OBJ_NULL} },
+    };
+    STATIC const qstr wlan_prom_config_fields[] = {
+        MP_QSTR_size, MP_QSTR_snaplen, MP_QSTR_subtypes, MP_QSTR_mac, MP_QSTR_rssi, MP_QSTR_dropped
+    };
 
-    tuple[0] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.rssi);
-    tuple[1] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.rate);
-    tuple[2] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.sig_mode);
-    tuple[3] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.mcs);
-    tuple[4] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.cwb);
-    tuple[5] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.aggregation);
-    tuple[6] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.stbc);
-    tuple[7] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.fec_coding);
-    tuple[8] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.sgi);
-    tuple[9] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.noise_floor);
-    tuple[10] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.ampdu_cnt);
-    tuple[11] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.channel);
-    tuple[12] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.secondary_channel);
-    tuple[13] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.timestamp);
-    tuple[14] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.ant);
-    tuple[15] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.sig_len);
-    tuple[16] = mp_obj_new_int(wlan_prom_packet[loc_tocken].rx_ctrl.rx_state);
-
-    if(wlan_prom_packet[loc_tocken].pkt_type != WIFI_PKT_CTRL)
-    {
-        tuple[17] = mp_obj_new_bytes((const uint8_t*)(wlan_prom_packet[loc_tocken].data), wlan_prom_packet[loc_tocken].rx_ctrl.sig_len);
+    // parse arguments
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), allowed_args, args);
+    wlan_obj_t *self = pos_args[0];
+    wlan_prom_ring_t *ring = &wlan_prom_ring;
+
+    if (args[0].u_obj != MP_OBJ_NULL) {
+        uint32_t size = (mp_obj_get_int(args[0].u_obj) + 3) & ~3;
+        if (size < WLAN_PROM_RING_SIZE_MIN) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid buffer size"));
+        }
+        // the driver callback must not be writing to the ring while it is replaced
+        if (self->is_promiscuous) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+        }
+        if (!wlan_prom_ring_alloc(size)) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
     }
-    else
-    {
-        tuple[17] = mp_const_none;
+    if (args[1].u_obj != MP_OBJ_NULL) {
+        mp_int_t snaplen = mp_obj_get_int(args[1].u_obj);
+        if (snaplen < 0) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid snaplen"));
+        }
+        ring->snaplen = MIN(snaplen, MAX_WIFI_PROM_PKT_SIZE);
+    }
+    if (args[2].u_obj != MP_OBJ_NULL) {
+        if (args[2].u_obj == mp_const_none) {
+            ring->subtypes = UINT64_MAX;
+        } else if (MP_OBJ_IS_SMALL_INT(args[2].u_obj)) {
+            ring->subtypes = (uint32_t)MP_OBJ_SMALL_INT_VALUE(args[2].u_obj);
+        } else if (MP_OBJ_IS_TYPE(args[2].u_obj, &mp_type_int)) {
+            uint8_t mask[8];
+            mp_obj_int_to_bytes_impl(args[2].u_obj, false, sizeof(mask), mask);
+            ring->subtypes = 0;
+            for (int i = sizeof(mask) - 1; i >= 0; i--) {
+                ring->subtypes = (ring->subtypes << 8) | mask[i];
+            }
+        } else {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_TypeError, "invalid subtypes mask"));
+        }
+    }
+    if (args[3].u_obj != MP_OBJ_NULL) {
+        // disable the filter while the prefix is being changed
+        ring->mac_prefix_len = 0;
+        if (args[3].u_obj != mp_const_none) {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(args[3].u_obj, &bufinfo, MP_BUFFER_READ);
+            if (bufinfo.len > sizeof(ring->mac_prefix)) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid MAC prefix"));
+            }
+            memcpy(ring->mac_prefix, bufinfo.buf, bufinfo.len);
+            ring->mac_prefix_len = bufinfo.len;
+        }
+    }
+    if (args[4].u_obj != MP_OBJ_NULL) {
+        ring->min_rssi = (args[4].u_obj == mp_const_none) ? INT32_MIN : mp_obj_get_int(args[4].u_obj);
     }
 
+    for (size_t i = 0; i < MP_ARRAY_SIZE(allowed_args); i++) {
+        if (args[i].u_obj != MP_OBJ_NULL) {
+            return mp_const_none;
+        }
+    }
 
-    return mp_obj_new_attrtuple(wlan_pkt_info_fields, MAX_WIFI_PKT_PARAMS, tuple);
+    mp_obj_t tuple[WLAN_PROM_CONFIG_PARAMS];
+    tuple[0] = mp_obj_new_int_from_uint(ring->buf ? ring->size : 0);
+    tuple[1] = mp_obj_new_int_from_uint(ring->snaplen);
+    tuple[2] = (ring->subtypes == UINT64_MAX) ? mp_const_none : mp_obj_new_int_from_ull(ring->subtypes);
+    tuple[3] = (ring->mac_prefix_len == 0) ? mp_const_none : mp_obj_new_bytes(ring->mac_prefix, ring->mac_prefix_len);
+    tuple[4] = (ring->min_rssi == INT32_MIN) ? mp_const_none : mp_obj_new_int(ring->min_rssi);
+    tuple[5] = mp_obj_new_int_from_uint(ring->dropped);
+
+    return mp_obj_new_attrtuple(wlan_prom_config_fields, WLAN_PROM_CONFIG_PARAMS, tuple);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(wlan_packet_obj, wlan_packet);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(wlan_prom_config_obj, 1, wlan_prom_config);
 
 STATIC mp_obj_t wlan_ctrl_pkt_filter(mp_uint_t n_args, const mp_obj_t *args) {
 
@@ -2697,10 +3609,13 @@ STATIC const mp_map_elem_t wlan_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_init),                (mp_obj_t)&wlan_init_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),              (mp_obj_t)&wlan_deinit_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_scan),                (mp_obj_t)&wlan_scan_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_scan_results),        (mp_obj_t)&wlan_scan_results_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_scan_status),         (mp_obj_t)&wlan_scan_status_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_connect),             (mp_obj_t)&wlan_connect_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_disconnect),          (mp_obj_t)&wlan_disconnect_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_isconnected),         (mp_obj_t)&wlan_isconnected_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ifconfig),            (mp_obj_t)&wlan_ifconfig_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_connect_time),        (mp_obj_t)&wlan_connect_time_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_mode),                (mp_obj_t)&wlan_mode_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_bandwidth),           (mp_obj_t)&wlan_bandwidth_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ssid),                (mp_obj_t)&wlan_ssid_obj },
@@ -2717,11 +3632,15 @@ STATIC const mp_map_elem_t wlan_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_joined_ap_info),      (mp_obj_t)&wlan_joined_ap_info_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_wifi_protocol),       (mp_obj_t)&wlan_wifi_protocol_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_send_raw),            (mp_obj_t)&wlan_send_raw_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_send_raw_status),     (mp_obj_t)&wlan_send_raw_status_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_promiscuous),         (mp_obj_t)&wlan_promiscuous_mode_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_callback),            (mp_obj_t)&wlan_callback_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_events),              (mp_obj_t)&wlan_events_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_wifi_packet),         (mp_obj_t)&wlan_packet_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ctrl_pkt_filter),     (mp_obj_t)&wlan_ctrl_pkt_filter_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_wifi_packets),        (mp_obj_t)&wlan_packets_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_hop),                 (mp_obj_t)&wlan_hop_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_prom_config),         (mp_obj_t)&wlan_prom_config_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_smartConfig),         (mp_obj_t)&wlan_smartConfig_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_Connected_ap_pwd),    (mp_obj_t)&wlan_smartConfkey_obj },
 
@@ -2767,6 +3686,8 @@ STATIC const mp_map_elem_t wlan_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_FILTER_CTRL_PKT_CFENDACK),     MP_OBJ_NEW_SMALL_INT(WIFI_PROMIS_CTRL_FILTER_MASK_CFENDACK) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_SMART_CONF_DONE),             MP_OBJ_NEW_SMALL_INT(MOD_WLAN_SMART_CONFIG_DONE) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_SMART_CONF_TIMEOUT),             MP_OBJ_NEW_SMALL_INT(MOD_WLAN_SMART_CONFIG_TIMEOUT) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SCAN_CHANNEL_DONE),             MP_OBJ_NEW_SMALL_INT(MOD_WLAN_SCAN_CHANNEL_DONE) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SCAN_DONE),                     MP_OBJ_NEW_SMALL_INT(MOD_WLAN_SCAN_DONE) },
 };
 STATIC MP_DEFINE_CONST_DICT(wlan_locals_dict, wlan_locals_dict_table);
 
@@ -2789,6 +3710,7 @@ const mod_network_nic_type_t mod_network_nic_type_wlan = {
     .n_recv = lwipsocket_socket_recv,
     .n_sendto = lwipsocket_socket_sendto,
     .n_recvfrom = lwipsocket_socket_recvfrom,
+    .n_sendmsg = lwipsocket_socket_sendmsg,
     .n_setsockopt = lwipsocket_socket_setsockopt,
     .n_settimeout = lwipsocket_socket_settimeout,
     .n_ioctl = lwipsocket_socket_ioctl,
@@ -36,6 +36,8 @@
 
 #define MOD_WLAN_SMART_CONFIG_DONE                   0x00000040    // 64
 #define MOD_WLAN_SMART_CONFIG_TIMEOUT                0x00000080    // 128
+#define MOD_WLAN_SCAN_CHANNEL_DONE                   0x00000100    // 256
+#define MOD_WLAN_SCAN_DONE                           0x00000200    // 512
 
 /******************************************************************************
  DEFINE TYPES
@@ -99,13 +101,14 @@ typedef struct _wlan_obj_t {
     int32_t                 events;
     mp_obj_t                handler;
     mp_obj_t                handler_arg;
-    SemaphoreHandle_t       mutex;
 } wlan_obj_t;
 
+// Header of a frame stored in the promiscuous capture ring, the data of the frame follows it
 typedef struct wlan_internal_prom_t
 {
     wifi_pkt_rx_ctrl_t                rx_ctrl;
-    uint8_t*                        data;
+    uint16_t                        len;        // size of the whole record, 0 marks a wrap to the start of the ring
+    uint16_t                        data_len;
     wifi_promiscuous_pkt_type_t        pkt_type;
 }wlan_internal_prom_t;
 
@@ -12,6 +12,8 @@
 
 #include "py/mpstate.h"
 #include "py/runtime.h"
+#include "py/mphal.h"
+#include "py/mperrno.h"
 #include "bufhelper.h"
 
 #include "esp_heap_caps.h"
@@ -25,6 +27,12 @@
 #include "esp_intr.h"
 #include "soc/dport_reg.h"
 #include "soc/gpio_sig_map.h"
+#include "soc/syscon_struct.h"
+#include "driver/i2s.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "adc.h"
 #include "esp_adc_cal.h"
@@ -33,6 +41,7 @@
 #include "mpsleep.h"
 #include "machpin.h"
 #include "pins.h"
+#include "mpirq.h"
 
 
 /******************************************************************************
@@ -41,6 +50,22 @@
 #define PYB_ADC_NUM_CHANNELS                (ADC1_CHANNEL_MAX)
 #define V_REF_NOM                           1100
 
+// continuous sampling through the I2S0 DMA, the only I2S unit wired to the ADC
+#define PYB_ADC_DMA_I2S_NUM                 (I2S_NUM_0)
+#define PYB_ADC_DMA_BUF_COUNT               (4)
+#define PYB_ADC_DMA_BUF_LEN                 (512)       // samples
+#define PYB_ADC_DMA_RING_SIZE_DEF           (8192)      // samples
+#define PYB_ADC_DMA_RATE_MIN                (1000)      // total samples per second
+#define PYB_ADC_DMA_RATE_MAX                (500000)
+#define PYB_ADC_DMA_PATTERNS_MAX            (16)        // entries of the SAR ADC1 pattern table
+#define PYB_ADC_DMA_STACK_SIZE              (2048)
+#define PYB_ADC_DMA_TASK_PRIORITY           (7)
+#define PYB_ADC_DMA_STOP_POLL_MS            (100)
+
+// handler events
+#define PYB_ADC_DMA_HALF_EVENT              (0x01)
+#define PYB_ADC_DMA_FULL_EVENT              (0x02)
+
 /******************************************************************************
  DEFINE TYPES
  ******************************************************************************/
@@ -56,12 +81,30 @@ typedef struct {
     esp_adc_cal_characteristics_t characteristics;
     pyb_adc_obj_t *adc;
     pin_obj_t *pin;
+    uint16_t *lut;              // millivolts of every raw value, built on first use
+    uint8_t lut_width;
     uint8_t channel;
     uint8_t attn;
     bool calibrate;
     bool enabled;
 } pyb_adc_channel_obj_t;
 
+// samples taken by the DMA, as the raw 16 bit words of the ADC: the channel in the bits 12-15 and the value below
+typedef struct {
+    uint16_t            *buf;
+    uint32_t            size;
+    uint32_t            head;
+    volatile uint32_t   used;
+    uint32_t            samples;
+    uint32_t            overruns;
+    mp_obj_t            handler;
+    uint8_t             events;
+    volatile bool       running;
+    TaskHandle_t        task;
+    SemaphoreHandle_t   sem;
+    uint16_t            chunk[PYB_ADC_DMA_BUF_LEN];
+} pyb_adc_dma_t;
+
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
@@ -74,16 +117,24 @@ STATIC pyb_adc_channel_obj_t pyb_adc_channel_obj[PYB_ADC_NUM_CHANNELS] = { {.pin
                                                                            {.pin = &PIN_MODULE_P18, .channel = ADC1_CHANNEL_6, .enabled = false},
                                                                            {.pin = &PIN_MODULE_P17, .channel = ADC1_CHANNEL_7, .enabled = false}, };
 STATIC pyb_adc_obj_t pyb_adc_obj = {.vref = V_REF_NOM, .enabled = false};
+STATIC pyb_adc_dma_t pyb_adc_dma;
+STATIC portMUX_TYPE pyb_adc_dma_mux = portMUX_INITIALIZER_UNLOCKED;
 STATIC const mp_obj_type_t pyb_adc_channel_type;
 
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
 STATIC mp_obj_t adc_channel_deinit(mp_obj_t self_in);
+STATIC void pyb_adc_dma_stop (void);
 
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
  ******************************************************************************/
+void pyb_adc_deinit_all (void) {
+    // the handler belongs to the heap of the previous session
+    pyb_adc_dma_stop();
+}
+
 STATIC void pyb_adc_init (pyb_adc_obj_t *self) {
     adc1_config_width(self->width - 9);     // ADC_WIDTH_9Bit = 0
     self->enabled = true;
@@ -101,9 +152,155 @@ STATIC void pyb_adc_channel_init (pyb_adc_channel_obj_t *self) {
     pyb_adc_check_init();
     adc1_config_channel_atten(self->channel, self->attn);
     esp_adc_cal_characterize(ADC_UNIT_1, self->attn, self->adc->width - 9,self->adc->vref, &self->characteristics);
+    self->calibrate = false;
+    // the attenuation may have changed
+    self->lut_width = 0;
     self->enabled = true;
 }
 
+// returns the conversion table of the channel, after redoing the calibration if needed
+STATIC const uint16_t *pyb_adc_channel_lut (pyb_adc_channel_obj_t *self) {
+    if (self->calibrate) {
+        self->calibrate = false;
+        self->lut_width = 0;
+        esp_adc_cal_characterize(ADC_UNIT_1, self->attn, self->adc->width - 9,self->adc->vref, &self->characteristics);
+    }
+    if (self->lut_width != self->adc->width) {
+        uint32_t n_values = 1 << self->adc->width;
+        if (self->lut == NULL) {
+            // sized for the widest conversions, so that it's allocated only once
+            self->lut = heap_caps_malloc((1 << 12) * sizeof(uint16_t), MALLOC_CAP_8BIT);
+            if (self->lut == NULL) {
+                mp_raise_OSError(MP_ENOMEM);
+            }
+        }
+        for (uint32_t raw = 0; raw < n_values; raw++) {
+            self->lut[raw] = esp_adc_cal_raw_to_voltage(raw, &self->characteristics);
+        }
+        self->lut_width = self->adc->width;
+    }
+    return self->lut;
+}
+
+// converts raw samples to millivolts in place, the bits above the ADC width (the channel of DMA samples) are ignored
+STATIC void pyb_adc_channel_convert (pyb_adc_channel_obj_t *self, uint16_t *samples, uint32_t count) {
+    const uint16_t *lut = pyb_adc_channel_lut(self);
+    uint16_t mask = (1 << self->adc->width) - 1;
+    for (uint32_t i = 0; i < count; i++) {
+        samples[i] = lut[samples[i] & mask];
+    }
+}
+
+STATIC void pyb_adc_dma_callback_handler (void *arg) {
+    if (pyb_adc_dma.handler != mp_const_none) {
+        mp_call_function_1(pyb_adc_dma.handler, arg);
+    }
+}
+
+STATIC void pyb_adc_dma_push (const uint16_t *samples, uint32_t count) {
+    uint8_t events = 0;
+
+    portENTER_CRITICAL(&pyb_adc_dma_mux);
+    uint32_t before = pyb_adc_dma.used;
+    uint32_t space = pyb_adc_dma.size - before;
+    if (count > space) {
+        // the oldest samples are kept, so that what has been read is contiguous
+        pyb_adc_dma.overruns += count - space;
+        count = space;
+    }
+    uint32_t tail = (pyb_adc_dma.head + before) % pyb_adc_dma.size;
+    uint32_t chunk = (count < pyb_adc_dma.size - tail) ? count : pyb_adc_dma.size - tail;
+    memcpy(&pyb_adc_dma.buf[tail], samples, chunk * sizeof(uint16_t));
+    memcpy(pyb_adc_dma.buf, &samples[chunk], (count - chunk) * sizeof(uint16_t));
+    pyb_adc_dma.used = before + count;
+    pyb_adc_dma.samples += count;
+    if (before < pyb_adc_dma.size / 2 && pyb_adc_dma.used >= pyb_adc_dma.size / 2) {
+        events |= PYB_ADC_DMA_HALF_EVENT;
+    }
+    if (before < pyb_adc_dma.size && pyb_adc_dma.used == pyb_adc_dma.size) {
+        events |= PYB_ADC_DMA_FULL_EVENT;
+    }
+    pyb_adc_dma.events |= events;
+    portEXIT_CRITICAL(&pyb_adc_dma_mux);
+
+    xSemaphoreGive(pyb_adc_dma.sem);
+    if (events && pyb_adc_dma.handler != mp_const_none) {
+        mp_irq_queue_interrupt_non_ISR(pyb_adc_dma_callback_handler, (void *)&pyb_adc_obj);
+    }
+}
+
+STATIC uint32_t pyb_adc_dma_pop (uint16_t *samples, uint32_t count) {
+    portENTER_CRITICAL(&pyb_adc_dma_mux);
+    if (count > pyb_adc_dma.used) {
+        count = pyb_adc_dma.used;
+    }
+    uint32_t chunk = (count < pyb_adc_dma.size - pyb_adc_dma.head) ? count : pyb_adc_dma.size - pyb_adc_dma.head;
+    memcpy(samples, &pyb_adc_dma.buf[pyb_adc_dma.head], chunk * sizeof(uint16_t));
+    memcpy(&samples[chunk], pyb_adc_dma.buf, (count - chunk) * sizeof(uint16_t));
+    pyb_adc_dma.head = (pyb_adc_dma.head + count) % pyb_adc_dma.size;
+    pyb_adc_dma.used -= count;
+    portEXIT_CRITICAL(&pyb_adc_dma_mux);
+    return count;
+}
+
+STATIC void TASK_ADC_DMA (void *pvParameters) {
+    size_t bytes;
+
+    while (pyb_adc_dma.running) {
+        if (i2s_read(PYB_ADC_DMA_I2S_NUM, pyb_adc_dma.chunk, sizeof(pyb_adc_dma.chunk), &bytes,
+                     PYB_ADC_DMA_STOP_POLL_MS / portTICK_PERIOD_MS) == ESP_OK && bytes > 0) {
+            uint32_t count = bytes / sizeof(uint16_t);
+            // the I2S unit stores the two 16 bit samples of each 32 bit word swapped
+            for (uint32_t i = 0; i + 1 < count; i += 2) {
+                uint16_t sample = pyb_adc_dma.chunk[i];
+                pyb_adc_dma.chunk[i] = pyb_adc_dma.chunk[i + 1];
+                pyb_adc_dma.chunk[i + 1] = sample;
+            }
+            pyb_adc_dma_push(pyb_adc_dma.chunk, count);
+        }
+    }
+    pyb_adc_dma.task = NULL;
+    vTaskDelete(NULL);
+}
+
+// the SAR ADC1 converts the channels of its pattern table in a round robin, one per I2S sample
+STATIC void pyb_adc_dma_set_patterns (pyb_adc_channel_obj_t **channels, uint32_t count) {
+    uint32_t tab[PYB_ADC_DMA_PATTERNS_MAX / 4] = { 0 };
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t pattern = (channels[i]->channel << 4) | ((channels[i]->adc->width - 9) << 2) | channels[i]->attn;
+        tab[i / 4] |= pattern << (24 - 8 * (i % 4));
+    }
+    SYSCON.saradc_ctrl.sar1_patt_len = count - 1;
+    for (uint32_t i = 0; i < MP_ARRAY_SIZE(tab); i++) {
+        SYSCON.saradc_sar1_patt_tab[i] = tab[i];
+    }
+}
+
+STATIC void pyb_adc_dma_stop (void) {
+    if (!pyb_adc_dma.running) {
+        return;
+    }
+    pyb_adc_dma.running = false;
+    MP_THREAD_GIL_EXIT();
+    while (pyb_adc_dma.task != NULL) {
+        vTaskDelay(1);
+    }
+    MP_THREAD_GIL_ENTER();
+    i2s_adc_disable(PYB_ADC_DMA_I2S_NUM);
+    i2s_driver_uninstall(PYB_ADC_DMA_I2S_NUM);
+    mp_irq_remove(&pyb_adc_obj);
+    pyb_adc_dma.handler = mp_const_none;
+    // wake up a reader so it returns what's left
+    xSemaphoreGive(pyb_adc_dma.sem);
+}
+
+STATIC void pyb_adc_dma_check_stopped (void) {
+    // single conversions can't be done while the DMA owns the ADC
+    if (pyb_adc_dma.running) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_resource_not_avaliable));
+    }
+}
+
 /******************************************************************************/
 /* Micro Python bindings : adc object                                         */
 
@@ -156,6 +353,7 @@ STATIC mp_obj_t adc_init(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *k
         nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
     }
     pyb_adc_obj_t *self = pos_args[0];
+    pyb_adc_dma_stop();
     self->width = args[0].u_int;
     pyb_adc_init(self);
     return mp_const_none;
@@ -191,6 +389,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(adc_vref_obj, 1, 2, adc_vref);
 
 STATIC mp_obj_t adc_deinit(mp_obj_t self_in) {
     pyb_adc_obj_t *self = self_in;
+    pyb_adc_dma_stop();
     self->enabled = false;
     return mp_const_none;
 }
@@ -246,17 +445,223 @@ STATIC mp_obj_t adc_channel(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(adc_channel_obj, 1, adc_channel);
 
+// continuous sampling of channels (a list of ADCChannel) at rate samples per second each, through the I2S DMA
+STATIC mp_obj_t adc_start(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_channels,       MP_ARG_REQUIRED | MP_ARG_OBJ,  },
+        { MP_QSTR_rate,           MP_ARG_REQUIRED | MP_ARG_INT,  },
+        { MP_QSTR_buffer_size,    MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = PYB_ADC_DMA_RING_SIZE_DEF} },
+        { MP_QSTR_handler,        MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    pyb_adc_check_init();
+    pyb_adc_dma_check_stopped();
+
+    mp_uint_t n_channels;
+    mp_obj_t *channels_o;
+    mp_obj_get_array(args[0].u_obj, &n_channels, &channels_o);
+    if (n_channels < 1 || n_channels > PYB_ADC_DMA_PATTERNS_MAX) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    pyb_adc_channel_obj_t *channels[PYB_ADC_DMA_PATTERNS_MAX];
+    for (mp_uint_t i = 0; i < n_channels; i++) {
+        if (!MP_OBJ_IS_TYPE(channels_o[i], &pyb_adc_channel_type)) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        channels[i] = channels_o[i];
+        if (!channels[i]->enabled) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+        }
+    }
+
+    mp_int_t rate = args[1].u_int * n_channels;
+    if (args[1].u_int <= 0 || rate < PYB_ADC_DMA_RATE_MIN || rate > PYB_ADC_DMA_RATE_MAX ||
+        args[2].u_int < PYB_ADC_DMA_BUF_LEN) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    if (args[3].u_obj != mp_const_none && !mp_obj_is_callable(args[3].u_obj)) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+
+    if (pyb_adc_dma.size != args[2].u_int) {
+        uint16_t *buf = heap_caps_malloc(args[2].u_int * sizeof(uint16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (buf == NULL) {
+            mp_raise_OSError(MP_ENOMEM);
+        }
+        if (pyb_adc_dma.buf != NULL) {
+            heap_caps_free(pyb_adc_dma.buf);
+        }
+        pyb_adc_dma.buf = buf;
+        pyb_adc_dma.size = args[2].u_int;
+    }
+    if (pyb_adc_dma.sem == NULL) {
+        pyb_adc_dma.sem = xSemaphoreCreateBinary();
+    }
+    pyb_adc_dma.head = 0;
+    pyb_adc_dma.used = 0;
+    pyb_adc_dma.samples = 0;
+    pyb_adc_dma.overruns = 0;
+    pyb_adc_dma.events = 0;
+
+    i2s_config_t i2s_config = {
+        .mode = I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN,
+        .sample_rate = rate,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+        .communication_format = I2S_COMM_FORMAT_I2S_MSB,
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+        .dma_buf_count = PYB_ADC_DMA_BUF_COUNT,
+        .dma_buf_len = PYB_ADC_DMA_BUF_LEN,
+        .use_apll = false,
+    };
+    if (i2s_driver_install(PYB_ADC_DMA_I2S_NUM, &i2s_config, 0, NULL) != ESP_OK) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_resource_not_avaliable));
+    }
+    i2s_set_adc_mode(ADC_UNIT_1, channels[0]->channel);
+    i2s_adc_enable(PYB_ADC_DMA_I2S_NUM);
+    // enabling the I2S mode programs a single channel
+    pyb_adc_dma_set_patterns(channels, n_channels);
+
+    pyb_adc_dma.handler = args[3].u_obj;
+    if (pyb_adc_dma.handler != mp_const_none) {
+        // keeps a reference to the handler
+        mp_irq_add(&pyb_adc_obj, pyb_adc_dma.handler);
+    } else {
+        mp_irq_remove(&pyb_adc_obj);
+    }
+
+    pyb_adc_dma.running = true;
+    if (xTaskCreatePinnedToCore(TASK_ADC_DMA, "ADC_DMA", PYB_ADC_DMA_STACK_SIZE / sizeof(StackType_t), NULL,
+                                PYB_ADC_DMA_TASK_PRIORITY, &pyb_adc_dma.task, 1) != pdPASS) {
+        pyb_adc_dma.running = false;
+        pyb_adc_dma.task = NULL;
+        i2s_adc_disable(PYB_ADC_DMA_I2S_NUM);
+        i2s_driver_uninstall(PYB_ADC_DMA_I2S_NUM);
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(adc_start_obj, 1, adc_start);
+
+STATIC mp_obj_t adc_stop(mp_obj_t self_in) {
+    pyb_adc_dma_stop();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(adc_stop_obj, adc_stop);
+
+// reads the sampled words, waiting up to timeout ms (forever if None) for the buffer to be filled
+STATIC mp_obj_t adc_readinto(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    STATIC const mp_arg_t allowed_args[] = {
+        { MP_QSTR_buf,            MP_ARG_REQUIRED | MP_ARG_OBJ,  },
+        { MP_QSTR_timeout,        MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_WRITE);
+    int32_t timeout_ms = (args[1].u_obj == mp_const_none) ? -1 : mp_obj_get_int(args[1].u_obj);
+
+    if (pyb_adc_dma.buf == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+
+    uint16_t *samples = bufinfo.buf;
+    uint32_t count = bufinfo.len / sizeof(uint16_t);
+    uint32_t done = 0;
+    TickType_t start = xTaskGetTickCount();
+    for ( ; ; ) {
+        done += pyb_adc_dma_pop(&samples[done], count - done);
+        if (done == count || !pyb_adc_dma.running) {
+            break;
+        }
+        uint32_t wait_ms = PYB_ADC_DMA_STOP_POLL_MS;
+        if (timeout_ms >= 0) {
+            uint32_t elapsed_ms = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+            if (elapsed_ms >= timeout_ms) {
+                break;
+            }
+            if (timeout_ms - elapsed_ms < wait_ms) {
+                wait_ms = timeout_ms - elapsed_ms;
+            }
+        }
+        MP_THREAD_GIL_EXIT();
+        xSemaphoreTake(pyb_adc_dma.sem, wait_ms / portTICK_PERIOD_MS);
+        MP_THREAD_GIL_ENTER();
+    }
+    return mp_obj_new_int(done * sizeof(uint16_t));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(adc_readinto_obj, 1, adc_readinto);
+
+// converts DMA samples of several channels to millivolts in place, each one with the calibration of its channel
+STATIC mp_obj_t adc_convert(mp_obj_t self_in, mp_obj_t buf_o) {
+    pyb_adc_obj_t *self = self_in;
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_o, &bufinfo, MP_BUFFER_RW);
+    // the channel is only stored above 12 bit values
+    if (self->width != 12) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+
+    const uint16_t *luts[PYB_ADC_NUM_CHANNELS];
+    for (int i = 0; i < PYB_ADC_NUM_CHANNELS; i++) {
+        luts[i] = pyb_adc_channel_obj[i].enabled ? pyb_adc_channel_lut(&pyb_adc_channel_obj[i]) : NULL;
+    }
+    uint16_t *samples = bufinfo.buf;
+    uint32_t count = bufinfo.len / sizeof(uint16_t);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t channel = samples[i] >> 12;
+        if (channel >= PYB_ADC_NUM_CHANNELS || luts[channel] == NULL) {
+            mp_raise_ValueError(mpexception_value_invalid_arguments);
+        }
+        samples[i] = luts[channel][samples[i] & 0x0FFF];
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(adc_convert_obj, adc_convert);
+
+// returns the events (HALF_EVENT, FULL_EVENT) that happened since the last call
+STATIC mp_obj_t adc_events(mp_obj_t self_in) {
+    portENTER_CRITICAL(&pyb_adc_dma_mux);
+    uint8_t events = pyb_adc_dma.events;
+    pyb_adc_dma.events = 0;
+    portEXIT_CRITICAL(&pyb_adc_dma_mux);
+    return MP_OBJ_NEW_SMALL_INT(events);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(adc_events_obj, adc_events);
+
+// returns (samples, overruns, buffered) of the continuous sampling
+STATIC mp_obj_t adc_stats(mp_obj_t self_in) {
+    mp_obj_t tuple[3];
+    tuple[0] = mp_obj_new_int_from_uint(pyb_adc_dma.samples);
+    tuple[1] = mp_obj_new_int_from_uint(pyb_adc_dma.overruns);
+    tuple[2] = mp_obj_new_int_from_uint(pyb_adc_dma.used);
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(adc_stats_obj, adc_stats);
+
 STATIC const mp_map_elem_t adc_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_init),                (mp_obj_t)&adc_init_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),              (mp_obj_t)&adc_deinit_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_channel),             (mp_obj_t)&adc_channel_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_vref),                (mp_obj_t)&adc_vref_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_vref_to_pin),         (mp_obj_t)&adc_vref_to_pin_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_start),               (mp_obj_t)&adc_start_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stop),                (mp_obj_t)&adc_stop_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_readinto),            (mp_obj_t)&adc_readinto_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_convert),             (mp_obj_t)&adc_convert_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_events),              (mp_obj_t)&adc_events_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stats),               (mp_obj_t)&adc_stats_obj },
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_ATTN_0DB),            MP_OBJ_NEW_SMALL_INT(ADC_ATTEN_0db) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ATTN_2_5DB),          MP_OBJ_NEW_SMALL_INT(ADC_ATTEN_2_5db) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ATTN_6DB),            MP_OBJ_NEW_SMALL_INT(ADC_ATTEN_6db) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ATTN_11DB),           MP_OBJ_NEW_SMALL_INT(ADC_ATTEN_11db) },
+
+    { MP_OBJ_NEW_QSTR(MP_QSTR_HALF_EVENT),          MP_OBJ_NEW_SMALL_INT(PYB_ADC_DMA_HALF_EVENT) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_FULL_EVENT),          MP_OBJ_NEW_SMALL_INT(PYB_ADC_DMA_FULL_EVENT) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(adc_locals_dict, adc_locals_dict_table);
@@ -299,23 +704,20 @@ STATIC mp_obj_t adc_channel_value(mp_obj_t self_in) {
     if (!self->enabled) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
     }
+    pyb_adc_dma_check_stopped();
     return MP_OBJ_NEW_SMALL_INT(adc1_get_raw(self->channel));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(adc_channel_value_obj, adc_channel_value);
 
 STATIC mp_obj_t adc_channel_voltage(mp_obj_t self_in) {
     pyb_adc_channel_obj_t *self = self_in;
-    uint32_t voltage;
     // the channel must be enabled
     if (!self->enabled) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
     }
-    if (self->calibrate) {
-        self->calibrate = false;
-        esp_adc_cal_characterize(ADC_UNIT_1, self->attn, self->adc->width - 9,self->adc->vref, &self->characteristics);
-    }
-    esp_adc_cal_get_voltage(self->channel, &self->characteristics, &voltage);
-    return MP_OBJ_NEW_SMALL_INT(voltage);
+    pyb_adc_dma_check_stopped();
+    const uint16_t *lut = pyb_adc_channel_lut(self);
+    return MP_OBJ_NEW_SMALL_INT(lut[adc1_get_raw(self->channel)]);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(adc_channel_voltage_obj, adc_channel_voltage);
 
@@ -329,6 +731,20 @@ STATIC mp_obj_t adc_channel_value_to_voltage(mp_obj_t self_in, mp_obj_t value_o)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(adc_channel_value_to_voltage_obj, adc_channel_value_to_voltage);
 
+// converts a buffer of raw 16 bit samples (e.g. an array('H')) to millivolts in place
+STATIC mp_obj_t adc_channel_convert(mp_obj_t self_in, mp_obj_t buf_o) {
+    pyb_adc_channel_obj_t *self = self_in;
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_o, &bufinfo, MP_BUFFER_RW);
+    // the channel must be enabled
+    if (!self->enabled) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+    pyb_adc_channel_convert(self, bufinfo.buf, bufinfo.len / sizeof(uint16_t));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(adc_channel_convert_obj, adc_channel_convert);
+
 STATIC mp_obj_t adc_channel_call(mp_obj_t self_in, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *args) {
     mp_arg_check_num(n_args, n_kw, 0, 0, false);
     return adc_channel_value (self_in);
@@ -340,6 +756,7 @@ STATIC const mp_map_elem_t adc_channel_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_value),               (mp_obj_t)&adc_channel_value_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_voltage),             (mp_obj_t)&adc_channel_voltage_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_value_to_voltage),    (mp_obj_t)&adc_channel_value_to_voltage_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_convert),             (mp_obj_t)&adc_channel_convert_obj },
 };
 
 STATIC MP_DEFINE_CONST_DICT(adc_channel_locals_dict, adc_channel_locals_dict_table);
@@ -12,4 +12,6 @@
 
 extern const mp_obj_type_t pyb_adc_type;
 
+extern void pyb_adc_deinit_all (void);
+
 #endif /* PYBADC_H_ */
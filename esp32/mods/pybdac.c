@@ -7,19 +7,45 @@
  * available at https://www.pycom.io/opensource/licensing
  */
 
+#include <stdint.h>
+#include <string.h>
 
 #include "py/runtime.h"
+#include "py/mphal.h"
+#include "py/mperrno.h"
+
+#include "driver/i2s.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #include "analog.h"
 #include "pybdac.h"
 #include "mpexception.h"
 #include "machpin.h"
+#include "mpirq.h"
 
 
 /******************************************************************************
  DECLARE CONSTANTS
  ******************************************************************************/
 #define PYB_DAC_NUM                         2
+
+// buffer playback through the I2S0 DMA, the only I2S unit wired to the DACs
+#define PYB_DAC_DMA_I2S_NUM                 (I2S_NUM_0)
+#define PYB_DAC_DMA_BUF_COUNT               (4)
+#define PYB_DAC_DMA_BUF_LEN                 (256)       // frames
+#define PYB_DAC_DMA_RATE_MIN                (1000)
+#define PYB_DAC_DMA_RATE_MAX                (200000)
+#define PYB_DAC_DMA_STACK_SIZE              (2048)
+#define PYB_DAC_DMA_TASK_PRIORITY           (7)
+#define PYB_DAC_DMA_STOP_POLL_MS            (100)
+#define PYB_DAC_DMA_MID_SCALE               (0x80)
+
+// handler events
+#define PYB_DAC_DMA_HALF_EVENT              (0x01)      // the first half of the buffer has been played
+#define PYB_DAC_DMA_END_EVENT               (0x02)      // the second half of the buffer has been played
+#define PYB_DAC_DMA_DONE_EVENT              (0x04)      // the playback is over
 /******************************************************************************
  DEFINE TYPES
  ******************************************************************************/
@@ -35,18 +61,35 @@ typedef struct {
     uint8_t tone_scale;
 } pyb_dac_obj_t;
 
+// playback of a buffer of 8 bit samples, read in place from the Python object
+typedef struct {
+    pyb_dac_obj_t       *dac;
+    const uint8_t       *buf;
+    uint32_t            len;
+    uint32_t            pos;
+    uint32_t            underruns;
+    mp_obj_t            handler;
+    uint8_t             events;
+    bool                loop;
+    volatile bool       running;
+    TaskHandle_t        task;
+    uint32_t            frames[PYB_DAC_DMA_BUF_LEN];
+} pyb_dac_dma_t;
+
 
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
 STATIC pyb_dac_obj_t pyb_dac_obj[PYB_DAC_NUM] = { {.id = 0, .enabled = false, .tone = false},
                                                   {.id = 1, .enabled = false, .tone = false} };
+STATIC pyb_dac_dma_t pyb_dac_dma;
 
 
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
 STATIC mp_obj_t dac_deinit(mp_obj_t self_in);
+STATIC void pyb_dac_dma_stop (void);
 
 esp_err_t set_dac(void){
 
@@ -62,10 +105,106 @@ esp_err_t set_dac(void){
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
  ******************************************************************************/
+void pyb_dac_deinit_all (void) {
+    // the buffer being played belongs to the heap of the previous session
+    pyb_dac_dma_stop();
+}
+
 STATIC void pyb_dac_init (pyb_dac_obj_t *self) {
     self->enabled = true;
 }
 
+STATIC void pyb_dac_dma_callback_handler (void *arg) {
+    if (pyb_dac_dma.handler != mp_const_none) {
+        mp_call_function_1(pyb_dac_dma.handler, arg);
+    }
+}
+
+STATIC void pyb_dac_dma_signal (uint8_t events) {
+    pyb_dac_dma.events |= events;
+    if (pyb_dac_dma.handler != mp_const_none) {
+        mp_irq_queue_interrupt_non_ISR(pyb_dac_dma_callback_handler, (void *)pyb_dac_dma.dac);
+    }
+}
+
+STATIC void TASK_DAC_DMA (void *pvParameters) {
+    uint32_t half = pyb_dac_dma.len / 2;
+    size_t written;
+
+    while (pyb_dac_dma.running) {
+        // the upper byte of each 16 bit half of a frame goes to the DAC, both halves carry the sample
+        uint32_t count = pyb_dac_dma.len - pyb_dac_dma.pos;
+        if (count > PYB_DAC_DMA_BUF_LEN) {
+            count = PYB_DAC_DMA_BUF_LEN;
+        }
+        const uint8_t *samples = &pyb_dac_dma.buf[pyb_dac_dma.pos];
+        for (uint32_t i = 0; i < count; i++) {
+            pyb_dac_dma.frames[i] = (samples[i] << 24) | (samples[i] << 8);
+        }
+        if (i2s_write(PYB_DAC_DMA_I2S_NUM, pyb_dac_dma.frames, count * sizeof(uint32_t), &written,
+                      PYB_DAC_DMA_STOP_POLL_MS / portTICK_PERIOD_MS) != ESP_OK) {
+            continue;
+        }
+        if (written < count * sizeof(uint32_t)) {
+            // the rest is retried, the DMA didn't give the room back in time
+            pyb_dac_dma.underruns++;
+        }
+        uint32_t prev = pyb_dac_dma.pos;
+        pyb_dac_dma.pos += written / sizeof(uint32_t);
+
+        if (prev < half && pyb_dac_dma.pos >= half) {
+            pyb_dac_dma_signal(PYB_DAC_DMA_HALF_EVENT);
+        }
+        if (pyb_dac_dma.pos >= pyb_dac_dma.len) {
+            pyb_dac_dma.pos = 0;
+            if (!pyb_dac_dma.loop) {
+                break;
+            }
+            pyb_dac_dma_signal(PYB_DAC_DMA_END_EVENT);
+        }
+    }
+
+    if (pyb_dac_dma.running) {
+        // played once, flush the DMA ring with the mid scale so it doesn't keep repeating the last samples
+        for (uint32_t i = 0; i < PYB_DAC_DMA_BUF_LEN; i++) {
+            pyb_dac_dma.frames[i] = (PYB_DAC_DMA_MID_SCALE << 24) | (PYB_DAC_DMA_MID_SCALE << 8);
+        }
+        for (uint32_t i = 0; i < PYB_DAC_DMA_BUF_COUNT; i++) {
+            i2s_write(PYB_DAC_DMA_I2S_NUM, pyb_dac_dma.frames, sizeof(pyb_dac_dma.frames), &written, portMAX_DELAY);
+        }
+        pyb_dac_dma.running = false;
+        pyb_dac_dma_signal(PYB_DAC_DMA_END_EVENT | PYB_DAC_DMA_DONE_EVENT);
+    }
+    pyb_dac_dma.task = NULL;
+    vTaskDelete(NULL);
+}
+
+STATIC void pyb_dac_dma_stop (void) {
+    if (pyb_dac_dma.dac == NULL) {
+        return;
+    }
+    pyb_dac_dma.running = false;
+    MP_THREAD_GIL_EXIT();
+    while (pyb_dac_dma.task != NULL) {
+        vTaskDelay(1);
+    }
+    MP_THREAD_GIL_ENTER();
+    i2s_set_dac_mode(I2S_DAC_CHANNEL_DISABLE);
+    i2s_driver_uninstall(PYB_DAC_DMA_I2S_NUM);
+    mp_irq_remove(pyb_dac_dma.dac);
+    pyb_dac_dma.dac = NULL;
+    pyb_dac_dma.buf = NULL;
+    MP_STATE_PORT(pyb_dac_play_buf) = MP_OBJ_NULL;
+    // back to the DC value and the tone generator
+    set_dac();
+}
+
+STATIC void pyb_dac_dma_check_stopped (void) {
+    if (pyb_dac_dma.dac != NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_resource_not_avaliable));
+    }
+}
+
 /******************************************************************************/
 /* Micro Python bindings : dac object                                         */
 
@@ -124,6 +263,9 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(dac_init_obj, 1, dac_init);
 STATIC mp_obj_t dac_deinit(mp_obj_t self_in) {
     pyb_dac_obj_t *self = self_in;
 
+    if (pyb_dac_dma.dac == self) {
+        pyb_dac_dma_stop();
+    }
     self->enabled = false;
     self->dc_value = 0;
     set_dac();
@@ -134,6 +276,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(dac_deinit_obj, dac_deinit);
 
 STATIC mp_obj_t dac_write(mp_obj_t self_in, mp_obj_t value_o) {
     pyb_dac_obj_t *self = self_in;
+    pyb_dac_dma_check_stopped();
     float value = mp_obj_get_float(value_o);
     if (value > 1.0f) {
         value = 1.0f;
@@ -164,6 +307,7 @@ STATIC mp_obj_t dac_tone(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_a
     pyb_dac_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    pyb_dac_dma_check_stopped();
 
     //DAC1 and DAC2 use the same step value, tone_freq = 8M/(2^16/(tone_step+1)
     uint16_t tone =  args[0].u_int;
@@ -191,11 +335,116 @@ STATIC mp_obj_t dac_tone(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_a
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(dac_tone_obj, 1, dac_tone);
 
 
+// plays a buffer of 8 bit samples at rate samples per second, once or in a loop, through the I2S DMA
+// the handler is called with HALF_EVENT and END_EVENT as each half has been played, so it can be refilled
+STATIC mp_obj_t dac_play(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_buf,     MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_rate,    MP_ARG_REQUIRED | MP_ARG_INT, },
+        { MP_QSTR_loop,    MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_handler, MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+    };
+
+    pyb_dac_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
+    if (bufinfo.len < 2 || args[1].u_int < PYB_DAC_DMA_RATE_MIN || args[1].u_int > PYB_DAC_DMA_RATE_MAX) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    if (args[3].u_obj != mp_const_none && !mp_obj_is_callable(args[3].u_obj)) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+    if (!self->enabled) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_request_not_possible));
+    }
+
+    // a new buffer replaces the one being played
+    pyb_dac_dma_stop();
+
+    i2s_config_t i2s_config = {
+        .mode = I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_DAC_BUILT_IN,
+        .sample_rate = args[1].u_int,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+        .communication_format = I2S_COMM_FORMAT_I2S_MSB,
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+        .dma_buf_count = PYB_DAC_DMA_BUF_COUNT,
+        .dma_buf_len = PYB_DAC_DMA_BUF_LEN,
+        .use_apll = false,
+    };
+    // fails as well while the ADC samples through the same I2S unit
+    if (i2s_driver_install(PYB_DAC_DMA_I2S_NUM, &i2s_config, 0, NULL) != ESP_OK) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, mpexception_os_resource_not_avaliable));
+    }
+    // DAC1 (P22, GPIO25) is the right channel, DAC2 (P21, GPIO26) the left one
+    i2s_set_dac_mode(self->id == 0 ? I2S_DAC_CHANNEL_RIGHT_EN : I2S_DAC_CHANNEL_LEFT_EN);
+
+    // the buffer is read in place, so it's kept alive until the playback is stopped
+    MP_STATE_PORT(pyb_dac_play_buf) = args[0].u_obj;
+    pyb_dac_dma.dac = self;
+    pyb_dac_dma.buf = bufinfo.buf;
+    pyb_dac_dma.len = bufinfo.len;
+    pyb_dac_dma.pos = 0;
+    pyb_dac_dma.underruns = 0;
+    pyb_dac_dma.events = 0;
+    pyb_dac_dma.loop = args[2].u_bool;
+    pyb_dac_dma.handler = args[3].u_obj;
+    if (pyb_dac_dma.handler != mp_const_none) {
+        mp_irq_add(self, pyb_dac_dma.handler);
+    }
+
+    pyb_dac_dma.running = true;
+    if (xTaskCreatePinnedToCore(TASK_DAC_DMA, "DAC_DMA", PYB_DAC_DMA_STACK_SIZE / sizeof(StackType_t), NULL,
+                                PYB_DAC_DMA_TASK_PRIORITY, &pyb_dac_dma.task, 1) != pdPASS) {
+        pyb_dac_dma.running = false;
+        pyb_dac_dma.task = NULL;
+        pyb_dac_dma_stop();
+        mp_raise_OSError(MP_ENOMEM);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(dac_play_obj, 1, dac_play);
+
+STATIC mp_obj_t dac_stop(mp_obj_t self_in) {
+    if (pyb_dac_dma.dac == self_in) {
+        pyb_dac_dma_stop();
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(dac_stop_obj, dac_stop);
+
+STATIC mp_obj_t dac_playing(mp_obj_t self_in) {
+    return mp_obj_new_bool(pyb_dac_dma.dac == self_in && pyb_dac_dma.running);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(dac_playing_obj, dac_playing);
+
+// returns the events (HALF_EVENT, END_EVENT, DONE_EVENT) that happened since the last call
+STATIC mp_obj_t dac_events(mp_obj_t self_in) {
+    uint8_t events = 0;
+    if (pyb_dac_dma.dac == self_in) {
+        events = pyb_dac_dma.events;
+        pyb_dac_dma.events &= ~events;
+    }
+    return MP_OBJ_NEW_SMALL_INT(events);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(dac_events_obj, dac_events);
+
 STATIC const mp_map_elem_t dac_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_init),                (mp_obj_t)&dac_init_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),              (mp_obj_t)&dac_deinit_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_write),               (mp_obj_t)&dac_write_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_tone),                (mp_obj_t)&dac_tone_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_play),                (mp_obj_t)&dac_play_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stop),                (mp_obj_t)&dac_stop_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_playing),             (mp_obj_t)&dac_playing_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_events),              (mp_obj_t)&dac_events_obj },
+
+    { MP_OBJ_NEW_QSTR(MP_QSTR_HALF_EVENT),          MP_OBJ_NEW_SMALL_INT(PYB_DAC_DMA_HALF_EVENT) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_END_EVENT),           MP_OBJ_NEW_SMALL_INT(PYB_DAC_DMA_END_EVENT) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_DONE_EVENT),          MP_OBJ_NEW_SMALL_INT(PYB_DAC_DMA_DONE_EVENT) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(dac_locals_dict, dac_locals_dict_table);
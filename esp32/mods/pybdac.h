@@ -12,4 +12,6 @@
 
 extern const mp_obj_type_t pyb_dac_type;
 
+extern void pyb_dac_deinit_all (void);
+
 #endif /* PYBDAC_H_ */
@@ -37,11 +37,13 @@
 /******************************************************************************
  DEFINE PRIVATE CONSTANTS
  ******************************************************************************/
+#define PYBSD_FREQ_DEFAULT_HZ               (SDMMC_FREQ_DEFAULT * 1000)
+#define PYBSD_FREQ_MAX_HZ                   (SDMMC_FREQ_HIGHSPEED * 1000)
 
 /******************************************************************************
  DECLARE PUBLIC DATA
  ******************************************************************************/
-pybsd_obj_t pybsd_obj = {.enabled = false};
+pybsd_obj_t pybsd_obj = {.freq_khz = SDMMC_FREQ_DEFAULT, .width = 1, .enabled = false};
 
 /******************************************************************************
  DECLARE PRIVATE DATA
@@ -64,7 +66,7 @@ STATIC void pyb_sd_hw_init (pybsd_obj_t *self) {
         {
             .gpio_cd = SDMMC_SLOT_NO_CD,
             .gpio_wp = SDMMC_SLOT_NO_WP,
-            .width   = 1,  // single bit bus
+            .width   = self->width,  // 4 bit bus needs DAT1-DAT3 wired to GPIO4, GPIO12 and GPIO13
         };
 
         sdmmc_host_init();
@@ -74,8 +76,26 @@ STATIC void pyb_sd_hw_init (pybsd_obj_t *self) {
 }
 
 STATIC mp_obj_t pyb_sd_init_helper (pybsd_obj_t *self, const mp_arg_val_t *args) {
+    mp_int_t freq = PYBSD_FREQ_DEFAULT_HZ;
+    if (args[0].u_obj != MP_OBJ_NULL && args[0].u_obj != mp_const_none) {
+        freq = mp_obj_get_int(args[0].u_obj);
+    }
+    mp_int_t width = args[1].u_int;
+    if ((width != 1 && width != 4) || freq < SDMMC_FREQ_PROBING * 1000 || freq > PYBSD_FREQ_MAX_HZ) {
+        mp_raise_ValueError(mpexception_value_invalid_arguments);
+    }
+
+    // the slot must be configured again if the bus width changes
+    if (self->enabled && width != self->width) {
+        sd_disk_deinit();
+        sdmmc_host_deinit();
+        self->enabled = false;
+    }
+    self->width = width;
+    self->freq_khz = freq / 1000;
+
     pyb_sd_hw_init (self);
-    if (sd_disk_init() != 0) {
+    if (sd_disk_init(self->width, self->freq_khz) != 0) {
         mp_raise_msg(&mp_type_OSError, mpexception_os_operation_failed);
     }
 
@@ -89,6 +109,7 @@ STATIC mp_obj_t pyb_sd_init_helper (pybsd_obj_t *self, const mp_arg_val_t *args)
 STATIC const mp_arg_t pyb_sd_init_args[] = {
     { MP_QSTR_id,                          MP_ARG_INT, {.u_int = 0} },
     { MP_QSTR_freq,                        MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+    { MP_QSTR_width,                       MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1} },
 };
 STATIC mp_obj_t pyb_sd_make_new (const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args) {
     // parse args
@@ -176,6 +197,16 @@ STATIC const mp_map_elem_t pyb_sd_locals_dict_table[] = {
 
 STATIC MP_DEFINE_CONST_DICT(pyb_sd_locals_dict, pyb_sd_locals_dict_table);
 
+/// called by the FatFS VFS when a block device is mounted, the SD card then gets
+/// its sectors read and written directly instead of through the Python block protocol
+void pyb_sd_init_vfs_native (fs_user_mount_t *vfs, mp_obj_t bdev) {
+    if (bdev == (mp_obj_t)&pybsd_obj) {
+        vfs->flags |= FSUSER_NATIVE;
+        vfs->readblocks[2] = (mp_obj_t)sd_disk_read; // native version
+        vfs->writeblocks[2] = (mp_obj_t)sd_disk_write; // native version
+    }
+}
+
 const mp_obj_type_t pyb_sd_type = {
     { &mp_type_type },
     .name = MP_QSTR_SD,
@@ -10,11 +10,16 @@
 #ifndef PYBSD_H_
 #define PYBSD_H_
 
+#include "py/obj.h"
+#include "extmod/vfs_fat.h"
+
 /******************************************************************************
  DEFINE PUBLIC TYPES
  ******************************************************************************/
 typedef struct {
     mp_obj_base_t       base;
+    uint32_t            freq_khz;
+    uint8_t             width;
     bool                enabled;
 } pybsd_obj_t;
 
@@ -24,4 +29,9 @@ typedef struct {
 extern pybsd_obj_t pybsd_obj;
 extern const mp_obj_type_t pyb_sd_type;
 
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+extern void pyb_sd_init_vfs_native (fs_user_mount_t *vfs, mp_obj_t bdev);
+
 #endif // PYBSD_H_
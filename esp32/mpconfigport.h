@@ -40,17 +40,30 @@
 #define __INCLUDED_MPCONFIGPORT_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "mp_pycom_err.h"
 
 // options to control how Micro Python is built
+#ifndef MICROPY_OBJ_REPR     // can be configured by make option
 #define MICROPY_OBJ_REPR                            (MICROPY_OBJ_REPR_A)
+#endif
 #define MICROPY_ALLOC_PATH_MAX                      (128)
+#define MICROPY_QSTR_HASH_INDEX                     (1)
+#define MICROPY_MAP_COMPACT                         (1)
 #define MICROPY_EMIT_X64                            (0)
 #define MICROPY_EMIT_THUMB                          (0)
 #define MICROPY_EMIT_INLINE_THUMB                   (0)
+#define MICROPY_EMIT_XTENSAWIN                      (1)
 #define MICROPY_MEM_STATS                           (0)
 #define MICROPY_DEBUG_PRINTERS                      (1)
 #define MICROPY_ENABLE_GC                           (1)
+#define MICROPY_GC_SPLIT_HEAP                       (1)
+#define MICROPY_GC_SPLIT_HEAP_LARGE_ALLOC           (256)
+#define MICROPY_GC_INCREMENTAL_SWEEP                (1)
+#define MICROPY_GC_PAUSE_HISTOGRAM                  (8)
+#define MICROPY_GC_STATS                            (1)
+#define MICROPY_GC_FREE_LISTS                       (16)
+#define MICROPY_GC_RESERVE                          (16)
 #define MICROPY_STACK_CHECK                         (1)
 #define MICROPY_HELPER_REPL                         (1)
 #define MICROPY_PY_BUILTINS_HELP                    (1)
@@ -63,13 +76,14 @@
 #define MICROPY_PY_BUILTINS_COMPLEX                 (1)
 #define MICROPY_PY_BUILTINS_STR_UNICODE             (1)
 #define MICROPY_PY_BUILTINS_BYTEARRAY               (1)
+#define MICROPY_PY_BUILTINS_BYTEARRAY_METHODS       (1)
 #define MICROPY_PY_BUILTINS_MEMORYVIEW              (1)
 #define MICROPY_PY_BUILTINS_FROZENSET               (1)
 #define MICROPY_PY_BUILTINS_SET                     (1)
 #define MICROPY_PY_BUILTINS_SLICE                   (1)
 #define MICROPY_PY_BUILTINS_PROPERTY                (1)
 #define MICROPY_PY_BUILTINS_EXECFILE                (1)
-#define MICROPY_PY_WEBSOCKET                        (1)
+#define MICROPY_PY_UWEBSOCKET                       (1)
 #define MICROPY_PY___FILE__                         (1)
 #define MICROPY_PY_GC                               (1)
 #define MICROPY_PY_ARRAY                            (1)
@@ -81,46 +95,73 @@
 #define MICROPY_PY_IO                               (1)
 #define MICROPY_PY_IO_FILEIO                        (1)
 #define MICROPY_PY_STRUCT                           (1)
+#define MICROPY_PY_STRUCT_TYPE                      (1)
 #define MICROPY_PY_SYS                              (1)
 #define MICROPY_PY_THREAD                           (1)
 #define MICROPY_PY_THREAD_GIL                       (1)
 #define MICROPY_PY_THREAD_GIL_VM_DIVISOR            (8)
+#define MICROPY_PY_THREAD_GIL_CONTENTION            (1)
+#define MICROPY_PY_THREAD_GIL_SLICE_US              (10000)
+// the pystacks, with PYSTACK_ENABLED=1, are allocated by mpthreadport.c
+#define MICROPY_PY_THREAD_PYSTACK                   (1)
+// thread placement and CPU usage, see mpthreadport.c
+#define MICROPY_PORT_THREAD_GLOBALS \
+    { MP_ROM_QSTR(MP_QSTR_config),              MP_ROM_PTR(&mp_thread_config_obj) }, \
+    { MP_ROM_QSTR(MP_QSTR_cpu_usage),           MP_ROM_PTR(&mp_thread_cpu_usage_obj) },
 #define MICROPY_PY_SYS_MAXSIZE                      (1)
 #define MICROPY_PY_SYS_EXIT                         (1)
 #define MICROPY_PY_SYS_STDFILES                     (1)
 #define MICROPY_PY_UBINASCII                        (1)
+#define MICROPY_PY_UCRC                             (1)
+#define MICROPY_PY_UDSP                             (1)
 #define MICROPY_PY_UERRNO                           (1)
 #define MICROPY_PY_UCTYPES                          (1)
 #define MICROPY_PY_UHASHLIB                         (0)
 #define MICROPY_PY_UHASHLIB_SHA1                    (0)
 #define MICROPY_PY_UJSON                            (1)
 #define MICROPY_PY_URE                              (1)
+#define MICROPY_PY_URE_MATCH_SPAN_START_END         (1)
+#define MICROPY_PY_URE_CACHE                        (4)
 #define MICROPY_PY_USELECT                          (1)
 #define MICROPY_PY_MACHINE                          (1)
 #define MICROPY_PY_MICROPYTHON_MEM_INFO             (1)
+#define MICROPY_PY_MICROPYTHON_PROFILE              (32)
+#define MICROPY_PY_MICROPYTHON_TEMPLATE             (1)
 #define MICROPY_PY_UTIMEQ                           (1)
+#define MICROPY_PY_UASYNCIO                         (1)
 #define MICROPY_CPYTHON_COMPAT                      (1)
 #define MICROPY_LONGINT_IMPL                        (MICROPY_LONGINT_IMPL_MPZ)
 #ifndef MICROPY_FLOAT_IMPL   // can be configured by make option
 #define MICROPY_FLOAT_IMPL                          (MICROPY_FLOAT_IMPL_FLOAT)
 #endif
+#define MICROPY_FLOAT_FORMAT_SHORTEST               (1)
 #define MICROPY_ERROR_REPORTING                     (MICROPY_ERROR_REPORTING_NORMAL)
 #define MICROPY_OPT_COMPUTED_GOTO                   (1)
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE    (0)
+#define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_RAM         (1)
+#define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_RAM_SIZE    (512)
 #define MICROPY_REPL_AUTO_INDENT                    (1)
+#define MICROPY_REPL_FILE_TRANSFER                  (1)
 #define MICROPY_COMP_MODULE_CONST                   (1)
+#define MICROPY_COMP_CONST_TUPLE                    (1)
 #define MICROPY_ENABLE_FINALISER                    (1)
 #define MICROPY_COMP_TRIPLE_TUPLE_ASSIGN            (1)
 #define MICROPY_USE_INTERNAL_PRINTF                 (0)
 #define MICROPY_PY_SYS_EXC_INFO                     (1)
 #define MICROPY_MODULE_FROZEN_STR                   (0)
 #define MICROPY_MODULE_FROZEN_MPY                   (1)
+#define MICROPY_MODULE_FROZEN_INDEX                 (1)
 #define MICROPY_PERSISTENT_CODE_LOAD                (1)
+#define MICROPY_PERSISTENT_CODE_IMAGE               (1)
+#define MICROPY_PERSISTENT_CODE_SAVE                (1)
+#define MICROPY_PERSISTENT_CODE_CACHE               (1)
 #define MICROPY_QSTR_EXTRA_POOL                     mp_qstr_frozen_const_pool
 #define MICROPY_PY_FRAMEBUF                         (1)
 #define MICROPY_PY_UZLIB                            (1)
+#define MICROPY_PY_UZLIB_COMPRESS                   (1)
 
 #define MICROPY_STREAMS_NON_BLOCK                   (1)
+#define MICROPY_STREAMS_POSIX_API                   (1)
 #define MICROPY_PY_BUILTINS_TIMEOUTERROR            (1)
 #define MICROPY_PY_ALL_SPECIAL_METHODS              (1)
 
@@ -141,10 +182,16 @@
 #define MICROPY_FATFS_REENTRANT                     (1)
 #define MICROPY_FATFS_TIMEOUT                       (5000)
 #define MICROPY_FATFS_SYNC_T                        SemaphoreHandle_t
+#define MICROPY_FATFS_SECTOR_CACHE                  (1)
+#define MICROPY_FATFS_SECTOR_CACHE_LINES            (8)
 
 #define MICROPY_VFS                                 (1)
 #define MICROPY_VFS_FAT                             (1)
 
+// a mounted SD card bypasses the Python block protocol, see mods/pybsd.c
+void pyb_sd_init_vfs_native(struct _fs_user_mount_t *vfs, void *bdev);
+#define MICROPY_VFS_FAT_NATIVE_BDEV(vfs, bdev)      pyb_sd_init_vfs_native(vfs, bdev)
+
 #define MICROPY_READER_VFS                          (1)
 #define MICROPY_PY_BUILTINS_INPUT                   (1)
 
@@ -173,6 +220,14 @@ typedef long mp_off_t;
 
 #define MP_PLAT_PRINT_STRN(str, len)                mp_hal_stdout_tx_strn_cooked(str, len)
 
+// native code is executed from IRAM, see util/nativecode.c
+void *esp_native_code_commit(void *buf, size_t len);
+#define MP_PLAT_COMMIT_EXEC(buf, len)               esp_native_code_commit(buf, len)
+
+// the hard interrupt handlers must not touch the heap, see util/mpirq.c
+bool mp_irq_in_hard_handler(void);
+#define MICROPY_GC_CONTEXT_LOCKED()                 mp_irq_in_hard_handler()
+
 // extra built in names to add to the global namespace
 #define MICROPY_PORT_BUILTINS \
     { MP_OBJ_NEW_QSTR(MP_QSTR_help),  (mp_obj_t)&mp_builtin_help_obj },   \
@@ -215,6 +270,8 @@ extern const struct _mp_obj_module_t mp_module_uqueue;
     { MP_OBJ_NEW_QSTR(MP_QSTR_socket),          (mp_obj_t)&mp_module_usocket },   \
     { MP_OBJ_NEW_QSTR(MP_QSTR_select),          (mp_obj_t)&mp_module_uselect },   \
     { MP_OBJ_NEW_QSTR(MP_QSTR_binascii),        (mp_obj_t)&mp_module_ubinascii }, \
+    { MP_OBJ_NEW_QSTR(MP_QSTR_crc),             (mp_obj_t)&mp_module_ucrc },      \
+    { MP_OBJ_NEW_QSTR(MP_QSTR_dsp),             (mp_obj_t)&mp_module_udsp },      \
     { MP_OBJ_NEW_QSTR(MP_QSTR_struct),          (mp_obj_t)&mp_module_ustruct },   \
     { MP_OBJ_NEW_QSTR(MP_QSTR_re),              (mp_obj_t)&mp_module_ure },       \
     { MP_OBJ_NEW_QSTR(MP_QSTR_json),            (mp_obj_t)&mp_module_ujson },     \
@@ -237,6 +294,10 @@ extern const struct _mp_obj_module_t mp_module_uqueue;
 #define MICROPY_END_ATOMIC_SECTION(state)           portEXIT_CRITICAL_NESTED(state)
 
 #define MICROPY_EVENT_POLL_HOOK                     mp_hal_delay_ms(1);
+// select() and poll() sleep until an object may be ready
+struct _mp_map_t;
+extern void mp_poll_wait(struct _mp_map_t *poll_map, int32_t timeout_ms);
+#define MICROPY_PY_USELECT_WAIT(poll_map, timeout)  mp_poll_wait(poll_map, timeout);
 
 #define MICROPY_PORT_ROOT_POINTERS \
     const char *readline_hist[8];                               \
@@ -253,6 +314,12 @@ extern const struct _mp_obj_module_t mp_module_uqueue;
     mp_obj_list_t bts_srv_list;                                 \
     mp_obj_list_t bts_attr_list;                                \
     mp_obj_t coap_ptr;                                          \
+    mp_obj_t modusocket_dns_handler[8];                         \
+    mp_obj_t pyb_dac_play_buf;                                  \
+    mp_obj_t mach_spi_dma_pending[2];                           \
+    mp_obj_t mach_ledstrip_obj[8];                              \
+    mp_obj_t mach_counter_obj[8];                               \
+    mp_obj_t mod_mqtt_obj[4];                                   \
 
 // we need to provide a declaration/definition of alloca()
 #include <alloca.h>
@@ -261,7 +328,11 @@ extern const struct _mp_obj_module_t mp_module_uqueue;
 #define MICROPY_MPHALPORT_H                                     "esp32_mphal.h"
 #define MICROPY_HW_MCU_NAME                                     "ESP32"
 #define MICROPY_PORT_SFLASH_BLOCK_COUNT_4MB                     127
+#if PYCOM_LAYOUT_8MB_PERF
+#define MICROPY_PORT_SFLASH_BLOCK_COUNT_8MB                     384
+#else
 #define MICROPY_PORT_SFLASH_BLOCK_COUNT_8MB                     1024
+#endif
 
 #define DEFAULT_AP_PASSWORD                                     "www.pycom.io"
 #define DEFAULT_AP_CHANNEL                                      (6)
@@ -40,6 +40,8 @@
 #include "moduos.h"
 #include "mperror.h"
 #include "mpirq.h"
+#include "mppoll.h"
+#include "nativecode.h"
 #include "serverstask.h"
 #include "modnetwork.h"
 #include "modwlan.h"
@@ -67,11 +69,25 @@
 #include "updater.h"
 #include "pycom_config.h"
 #include "mpsleep.h"
+#include "mpcpufreq.h"
 #include "machrtc.h"
 #include "modbt.h"
 #include "machtimer.h"
+#include "pybadc.h"
+#include "pybdac.h"
+#include "machspi.h"
+#include "machine_i2c.h"
+#include "machrmt.h"
+#include "machledstrip.h"
+#include "machcounter.h"
+#include "machtouch.h"
+#include "modmqtt.h"
+#include "modmdns.h"
+#include "modmachine.h"
 #include "machtimer_alarm.h"
 #include "mptask.h"
+#include "modpycom_mmap.h"
+#include "modpycom_nvs.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -88,6 +104,7 @@
 #include "sflash_diskio_littlefs.h"
 #include "lteppp.h"
 #include "esp32chipinfo.h"
+#include "esp_timer.h"
 
 
 /******************************************************************************
@@ -106,10 +123,16 @@ extern TaskHandle_t svTaskHandle;
  ******************************************************************************/
 #define GC_POOL_SIZE_BYTES                                          (67 * 1024)
 #define GC_POOL_SIZE_BYTES_PSRAM                                    ((2048 + 512) * 1024)
+#define GC_POOL_SIZE_BYTES_INTERNAL                                 (32 * 1024)     // small objects on PSRAM boards
+#define GC_POOL_SIZE_BYTES_SMALL_MIN                                (16 * 1024)     // left for small objects by the large region
 
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
+STATIC void mptask_boot_mark(mptask_boot_phase_t phase);
+STATIC void mptask_read_boot_profile(void);
+STATIC bool mptask_create_default_files(void);
+STATIC bool mptask_defer_lora(void);
 STATIC void mptask_preinit (void);
 STATIC void mptask_init_sflash_filesystem (void);
 STATIC void mptask_init_sflash_filesystem_fatfs(void);
@@ -129,6 +152,16 @@ fs_user_mount_t sflash_vfs_flash;
  DECLARE PRIVATE DATA
  ******************************************************************************/
 static uint8_t *gc_pool_upy;
+static uint8_t *gc_pool_internal;
+
+// Time of each boot phase in us since the power on (esp_timer_get_time()), 0 if it hasn't been reached yet
+static int64_t mptask_boot_times[MPTASK_BOOT_NUM_PHASES];
+// With the lazy boot profile the LoRa stack (on boards without Sigfox) is started by the first LoRa() instead of at every boot and the
+// default files of /flash are only created on a power on, not after a wake from deep sleep.
+static bool mptask_lazy;
+// Without PSRAM, the end of the heap can be kept for the large buffers (MPTASK_GC_LARGE_KEY), so that the long-lived
+// small objects can't fragment it. Only read at power on, the heap layout doesn't change with a soft reset.
+static uint32_t mptask_gc_large_size;
 
 static char fresh_main_py[] = "# main.py -- put your code here!\r\n";
 static char fresh_boot_py[] = "# boot.py -- run on boot-up\r\n";
@@ -139,6 +172,7 @@ static char fresh_boot_py[] = "# boot.py -- run on boot-up\r\n";
 void TASK_Micropython (void *pvParameters) {
     // initialize the garbage collector with the top of our stack
     volatile uint32_t sp = (uint32_t)get_sp();
+    mptask_boot_mark(MPTASK_BOOT_PHASE_START);
     uint32_t gc_pool_size;
     bool soft_reset = false;
     uint32_t stack_len;
@@ -179,12 +213,14 @@ void TASK_Micropython (void *pvParameters) {
     if (mpsleep_get_reset_cause() != MPSLEEP_DEEPSLEEP_RESET) {
         rtc_init0();
     }
+    mptask_read_boot_profile();
 
     // initialization that must not be repeted after a soft reset
     mptask_preinit();
 #if MICROPY_PY_THREAD
     mp_thread_preinit(mpTaskStack, stack_len, chip_rev);
     mp_irq_preinit();
+    mp_poll_preinit();
 #endif
     /* Creat Socket Operation task */
     modusocket_pre_init();
@@ -198,6 +234,8 @@ void TASK_Micropython (void *pvParameters) {
 
     if (esp32_get_chip_rev() > 0) {
         gc_pool_size = GC_POOL_SIZE_BYTES_PSRAM;
+        // keep the small objects in internal RAM, the large buffers go to PSRAM
+        gc_pool_internal = heap_caps_malloc(GC_POOL_SIZE_BYTES_INTERNAL, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     } else {
         gc_pool_size = GC_POOL_SIZE_BYTES;
     }
@@ -214,19 +252,44 @@ void TASK_Micropython (void *pvParameters) {
 
 soft_reset:
 
+    if (soft_reset) {
+        memset(mptask_boot_times, 0, sizeof(mptask_boot_times));
+        mptask_boot_mark(MPTASK_BOOT_PHASE_START);
+    }
+
     // thread init
 #if MICROPY_PY_THREAD
     mp_thread_init();
 #endif
+#if MICROPY_ENABLE_PYSTACK
+    mp_thread_pystack_init();
+#endif
 
     // GC init
-    gc_init((void *)gc_pool_upy, (void *)(gc_pool_upy + gc_pool_size));
+    if (gc_pool_internal) {
+        gc_init((void *)gc_pool_internal, (void *)(gc_pool_internal + GC_POOL_SIZE_BYTES_INTERNAL));
+        gc_add((void *)gc_pool_upy, (void *)(gc_pool_upy + gc_pool_size));
+    } else if (mptask_gc_large_size > 0) {
+        uint8_t *gc_pool_large = gc_pool_upy + gc_pool_size - mptask_gc_large_size;
+        gc_init((void *)gc_pool_upy, (void *)gc_pool_large);
+        gc_add((void *)gc_pool_large, (void *)(gc_pool_upy + gc_pool_size));
+        // the small objects only spill into the large region when a collection can't make room for them
+        gc_split_strict(true);
+    } else {
+        gc_init((void *)gc_pool_upy, (void *)(gc_pool_upy + gc_pool_size));
+    }
 
     // MicroPython init
     mp_init();
+#if MICROPY_EMIT_XTENSAWIN
+    esp_native_code_init();
+#endif
+    // before anything else creates qstrs, the image numbers its qstrs from here
+    modpycom_mmap_mount_mpy_image(!safeboot);
     mp_obj_list_init(mp_sys_path, 0);
     mp_obj_list_init(mp_sys_argv, 0);
     mp_obj_list_append(mp_sys_path, MP_OBJ_NEW_QSTR(MP_QSTR_)); // current dir (or base dir of the script)
+    mptask_boot_mark(MPTASK_BOOT_PHASE_MP_INIT);
 
     // execute all basic initializations
     pin_init0();    // always before the rest of the peripherals
@@ -241,6 +304,7 @@ soft_reset:
     mp_hal_init(soft_reset);
     readline_init0();
     mod_network_init0();
+    modusocket_init0();
     modbt_init0();
     machtimer_init0();
     modpycom_init0();
@@ -259,15 +323,20 @@ soft_reset:
         mptask_config_wifi(false);
         // these ones are special because they need uPy running and they launch tasks
 #ifdef MOD_LORA_ENABLED
-        modlora_init0();
+        if (!mptask_defer_lora()) {
+            modlora_init0();
+        }
 #endif
 #ifdef MOD_SIGFOX_ENABLED
         modsigfox_init0();
 #endif
     }
 
+    mptask_boot_mark(MPTASK_BOOT_PHASE_DRIVERS);
+
     // initialize the serial flash file system
     mptask_init_sflash_filesystem();
+    mptask_boot_mark(MPTASK_BOOT_PHASE_FS);
 
 #if defined(MOD_LORA_ENABLED) || defined(MOD_SIGFOX_ENABLED)
     // must be done after initializing the file system
@@ -303,6 +372,7 @@ soft_reset:
 
     if (!safeboot) {
         // run boot.py
+        mptask_boot_mark(MPTASK_BOOT_PHASE_BOOT_PY);
         int ret = pyexec_file("boot.py");
         if (ret & PYEXEC_FORCED_EXIT) {
             goto soft_reset_exit;
@@ -336,6 +406,7 @@ soft_reset:
             } else {
                 main_py = mp_obj_str_get_str(MP_STATE_PORT(machine_config_main));
             }
+            mptask_boot_mark(MPTASK_BOOT_PHASE_MAIN_PY);
             int ret = pyexec_file(main_py);
             if (ret & PYEXEC_FORCED_EXIT) {
                 goto soft_reset_exit;
@@ -365,10 +436,27 @@ soft_reset:
 
 soft_reset_exit:
 
+    // stop the DMA tasks while the GIL is still held, they use objects of the heap being released
+    pyb_adc_deinit_all();
+    pyb_dac_deinit_all();
+    machspi_deinit_all();
+    machine_i2c_deinit_all();
+    machledstrip_deinit_all();
+    machcounter_deinit_all();
+    machtouch_deinit_all();
+    modmqtt_deinit_all();
+    modmdns_deinit_all();
+    modpycom_nvs_flush_all();
+    machine_auto_sleep_deinit();
+    // back to the fixed frequency of the boot
+    mpcpufreq_set(CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
     machtimer_deinit();
 #if MICROPY_PY_THREAD
     mp_irq_kill();
     mp_thread_deinit();
+#endif
+#if MICROPY_EMIT_XTENSAWIN
+    esp_native_code_deinit();
 #endif
     mpsleep_signal_soft_reset();
     mp_printf(&mp_plat_print, "PYB: soft reboot\n");
@@ -376,13 +464,17 @@ soft_reset_exit:
     ets_delay_us(5000);
 
     uart_deinit_all();
-    // TODO: rmt_deinit_all();
+    rmt_deinit_all();
     rmt_deinit_rgb();
 
     soft_reset = true;
     goto soft_reset;
 }
 
+int64_t mptask_get_boot_time(mptask_boot_phase_t phase) {
+    return mptask_boot_times[phase];
+}
+
 bool isLittleFs(const TCHAR *path){
 #ifndef FS_USE_LITTLEFS
     if (config_get_boot_fs_type() == 0x01) {
@@ -400,8 +492,42 @@ bool isLittleFs(const TCHAR *path){
 /******************************************************************************
  DEFINE PRIVATE FUNCTIONS
  ******************************************************************************/
+STATIC void mptask_boot_mark(mptask_boot_phase_t phase) {
+    mptask_boot_times[phase] = esp_timer_get_time();
+}
+
+STATIC void mptask_read_boot_profile(void) {
+    nvs_handle nvs;
+    if (nvs_open("PY_NVM", NVS_READONLY, &nvs) == ESP_OK) {
+        uint32_t lazy;
+        if (nvs_get_u32(nvs, MPTASK_LAZY_BOOT_KEY, &lazy) == ESP_OK) {
+            mptask_lazy = (lazy != 0);
+        }
+        uint32_t large_kb;
+        if (nvs_get_u32(nvs, MPTASK_GC_LARGE_KEY, &large_kb) == ESP_OK) {
+            mptask_gc_large_size = MIN(large_kb, (GC_POOL_SIZE_BYTES - GC_POOL_SIZE_BYTES_SMALL_MIN) / 1024) * 1024;
+        }
+        nvs_close(nvs);
+    }
+}
+
+STATIC bool mptask_defer_lora(void) {
+#ifdef MOD_SIGFOX_ENABLED
+    // Sigfox shares the radio, and the semaphore guarding it, with LoRa
+    return false;
+#else
+    return mptask_lazy;
+#endif
+}
+
+// The files are there since the power on that preceded the deep sleep, unless they have been removed in between
+STATIC bool mptask_create_default_files(void) {
+    return !mptask_lazy || mpsleep_get_reset_cause() != MPSLEEP_DEEPSLEEP_RESET;
+}
+
 STATIC void mptask_preinit (void) {
     wlan_pre_init();
+    mpcpufreq_init0();
     //eth_pre_init();
     //TODO: Re-check this: increased stack is needed by modified FTP implementation due to LittleFS vs FatFs
     xTaskCreatePinnedToCore(TASK_Servers, "Servers", 2*SERVERS_STACK_LEN, NULL, SERVERS_PRIORITY, &svTaskHandle, 1);
@@ -424,8 +550,15 @@ STATIC void mptask_init_sflash_filesystem_fatfs(void) {
     fs_user_mount_t *vfs_fat = &sflash_vfs_flash;
     vfs_fat->flags = 0;
     pyb_flash_init_vfs(vfs_fat);
+    // the object isn't on the MicroPython heap so the sector cache can't be either, only spend PSRAM on it
+    void *cache_mem = NULL;
+    if (esp32_get_chip_rev() > 0) {
+        cache_mem = heap_caps_malloc(FAT_VFS_CACHE_MEM_SIZE(MICROPY_FATFS_SECTOR_CACHE_LINES), MALLOC_CAP_SPIRAM);
+    }
+    fat_vfs_cache_init(vfs_fat, cache_mem, MICROPY_FATFS_SECTOR_CACHE_LINES);
 
     FILINFO fno;
+    bool create_files = mptask_create_default_files();
 
     // Create it if needed, and mount it on /flash.
     FRESULT res = f_mount(&vfs_fat->fs.fatfs);
@@ -438,10 +571,11 @@ STATIC void mptask_init_sflash_filesystem_fatfs(void) {
         }
         // create empty main.py
         mptask_create_main_py();
+        create_files = true;
     }
     else if (res == FR_OK) {
         // mount sucessful
-        if (FR_OK != f_stat(&vfs_fat->fs.fatfs, "/main.py", &fno)) {
+        if (create_files && FR_OK != f_stat(&vfs_fat->fs.fatfs, "/main.py", &fno)) {
             // create empty main.py
             mptask_create_main_py();
         }
@@ -465,6 +599,10 @@ STATIC void mptask_init_sflash_filesystem_fatfs(void) {
     // It is set to the internal flash filesystem by default.
     MP_STATE_PORT(vfs_cur) = vfs;
 
+    if (!create_files) {
+        return;
+    }
+
     // create /flash/sys, /flash/lib and /flash/cert if they don't exist
     if (FR_OK != f_chdir (&vfs_fat->fs.fatfs, "/sys")) {
         f_mkdir(&vfs_fat->fs.fatfs, "/sys");
@@ -520,9 +658,38 @@ STATIC void mptask_init_sflash_filesystem_littlefs(void) {
         lfscfg.lookahead_size = 32;
     }
 
+    // The wear-leveling can be tuned with pycom.nvs_set() (PY_NVM is its name space)
+    nvs_handle nvs;
+    if (nvs_open("PY_NVM", NVS_READONLY, &nvs) == ESP_OK) {
+        uint32_t block_cycles;
+        if (nvs_get_u32(nvs, SFLASH_LITTLEFS_BLOCK_CYCLES_KEY, &block_cycles) == ESP_OK && block_cycles < 0xffffffff) {
+            lfscfg.block_cycles = block_cycles;
+        }
+        nvs_close(nvs);
+    }
+
+    // With PSRAM use block sized read/prog caches, this needs less flash operations for big files
+    if (esp32_get_chip_rev() > 0) {
+        void *read_buffer = heap_caps_malloc(SFLASH_BLOCK_SIZE, MALLOC_CAP_SPIRAM);
+        void *prog_buffer = heap_caps_malloc(SFLASH_BLOCK_SIZE, MALLOC_CAP_SPIRAM);
+        if (read_buffer != NULL && prog_buffer != NULL) {
+            lfscfg.read_buffer = read_buffer;
+            lfscfg.prog_buffer = prog_buffer;
+            lfscfg.cache_size = SFLASH_BLOCK_SIZE;
+        } else {
+            free(read_buffer);
+            free(prog_buffer);
+        }
+    }
+
+    littlefs_init_erase_counts();
+
+    bool create_files = mptask_create_default_files();
+
     // Mount the file system if exists
     if(LFS_ERR_OK != lfs_mount(littlefsptr, &lfscfg))
     {
+        create_files = true;
         // File system does not exist, create it and mount
         if(LFS_ERR_OK == lfs_format(littlefsptr, &lfscfg))
         {
@@ -559,6 +726,12 @@ STATIC void mptask_init_sflash_filesystem_littlefs(void) {
     vfs_littlefs->fs.littlefs.cwd[1] = '\0';
 
     vfs_littlefs->fs.littlefs.mutex = xSemaphoreCreateMutex();
+    // Count the blocks in use in the background, statvfs only reads the result
+    littlefs_resync_size(&vfs_littlefs->fs.littlefs);
+
+    if (!create_files) {
+        return;
+    }
 
     xSemaphoreTake(vfs_littlefs->fs.littlefs.mutex, portMAX_DELAY);
 
@@ -21,6 +21,24 @@
 #define MICROPY_TASK_STACK_SIZE                 (8 * 1024)
 #define MICROPY_TASK_STACK_SIZE_PSRAM           (12 * 1024)
 
+// NVS key (in the namespace of pycom.nvs_set()) selecting the lazy boot profile from the next boot
+#define MPTASK_LAZY_BOOT_KEY                    "lazy_boot"
+// NVS key with the KB of the heap kept for the large buffers on boards without PSRAM, 0 or unset for a single heap
+#define MPTASK_GC_LARGE_KEY                     "gc_large_kb"
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+typedef enum {
+    MPTASK_BOOT_PHASE_START = 0,        // the MicroPython task starts, or a soft reset
+    MPTASK_BOOT_PHASE_MP_INIT,          // the interpreter is initialised
+    MPTASK_BOOT_PHASE_DRIVERS,          // the peripherals and the (non deferred) radio stacks are initialised
+    MPTASK_BOOT_PHASE_FS,               // /flash is mounted
+    MPTASK_BOOT_PHASE_BOOT_PY,          // boot.py starts
+    MPTASK_BOOT_PHASE_MAIN_PY,          // main.py starts
+    MPTASK_BOOT_NUM_PHASES
+} mptask_boot_phase_t;
+
 
 /******************************************************************************
  DECLARE PUBLIC VARIABLES
@@ -33,4 +51,5 @@ extern fs_user_mount_t sflash_vfs_flash;
 extern void TASK_Micropython (void *pvParameters);
 extern bool isLittleFs(const TCHAR *path);
 extern void mptask_config_wifi(bool force_start);
+extern int64_t mptask_get_boot_time(mptask_boot_phase_t phase);
 #endif /* MPTASK_H_ */
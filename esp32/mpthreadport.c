@@ -36,11 +36,13 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "py/mpconfig.h"
 #include "py/mpstate.h"
 #include "py/gc.h"
 #include "py/mpthread.h"
+#include "py/runtime.h"
 
 #include "sdkconfig.h"
 #include "esp_system.h"
@@ -52,12 +54,14 @@
 
 #include  "py/gc.h"
 
+#include "esp_heap_caps.h"
 #include "mpirq.h"
 
 #if MICROPY_PY_THREAD
 
 #define MP_THREAD_MIN_STACK_SIZE                        (5 * 1024)
 #define MP_THREAD_DEFAULT_STACK_SIZE                    (MP_THREAD_MIN_STACK_SIZE)
+#define MP_THREAD_DEFAULT_CORE                          (1)
 
 // this structure forms a linked list, one node per active thread
 typedef struct _thread_t {
@@ -67,6 +71,10 @@ typedef struct _thread_t {
     void *stack;            // pointer to the stack
     StaticTask_t *tcb;      // pointer to the Task Control Block
     size_t stack_len;       // number of words in the stack
+    #if MICROPY_ENABLE_PYSTACK
+    void *pystack;          // the frames of the Python functions, in PSRAM if there's some
+    size_t pystack_len;     // number of bytes in the pystack
+    #endif
     struct _thread_t *next;
 } thread_t;
 
@@ -78,6 +86,11 @@ STATIC thread_t *thread; // root pointer, handled by mp_thread_gc_others
 STATIC bool during_soft_reset = false;
 STATIC uint8_t mp_chip_revision;
 
+// applied to the threads started by _thread.start_new_thread, see _thread.config()
+STATIC BaseType_t thread_core = MP_THREAD_DEFAULT_CORE;
+STATIC UBaseType_t thread_priority = MP_THREAD_PRIORITY;
+STATIC mp_thread_stack_mem_t thread_stack_mem = MP_THREAD_STACK_MEM_ANY;
+
 void mp_thread_preinit(void *stack, uint32_t stack_len, uint8_t chip_revision) {
     mp_thread_set_state(&mp_state_ctx.thread);
     // create first entry in linked list of all threads
@@ -89,6 +102,16 @@ void mp_thread_preinit(void *stack, uint32_t stack_len, uint8_t chip_revision) {
     thread->stack_len = stack_len;
     thread->next = NULL;
     mp_chip_revision = chip_revision;
+    #if MICROPY_ENABLE_PYSTACK
+    // it lasts as long as the main task, across the soft resets
+    if (chip_revision > 0) {
+        thread->pystack_len = MP_THREAD_PYSTACK_SIZE_MAIN_PSRAM;
+        thread->pystack = heap_caps_malloc(thread->pystack_len, MALLOC_CAP_SPIRAM);
+    } else {
+        thread->pystack_len = MP_THREAD_PYSTACK_SIZE_MAIN;
+        thread->pystack = malloc(thread->pystack_len);
+    }
+    #endif
 }
 
 void mp_thread_init(void) {
@@ -96,6 +119,21 @@ void mp_thread_init(void) {
     {
         mp_thread_mutex_init(&thread_mutex);
     }
+    thread_core = MP_THREAD_DEFAULT_CORE;
+    thread_priority = MP_THREAD_PRIORITY;
+    thread_stack_mem = MP_THREAD_STACK_MEM_ANY;
+}
+
+uint32_t mp_thread_count(void) {
+    uint32_t count = 0;
+    mp_thread_mutex_lock(&thread_mutex, 1);
+    for (thread_t *th = thread; th != NULL; th = th->next) {
+        if (th->ready) {
+            count++;
+        }
+    }
+    mp_thread_mutex_unlock(&thread_mutex);
+    return count;
 }
 
 void mp_thread_gc_others(void) {
@@ -110,11 +148,22 @@ void mp_thread_gc_others(void) {
             continue;
         }
         gc_collect_root(th->stack, th->stack_len); // probably not needed
+        #if MICROPY_ENABLE_PYSTACK
+        // only the pystack of the calling thread is scanned by gc_collect_start()
+        gc_collect_root(th->pystack, th->pystack_len / sizeof(void*));
+        #endif
     }
     mp_thread_mutex_unlock(&thread_mutex);
 }
 
+mp_state_thread_t *mp_thread_isr_state[portNUM_PROCESSORS];
+
 mp_state_thread_t *mp_thread_get_state(void) {
+    // a hard interrupt handler doesn't belong to the task it interrupted
+    mp_state_thread_t *ts = mp_thread_isr_state[xPortGetCoreID()];
+    if (ts != NULL) {
+        return ts;
+    }
     return pvTaskGetThreadLocalStoragePointer(NULL, 1);
 }
 
@@ -154,7 +203,7 @@ STATIC void freertos_entry(void *arg) {
     for (;;);
 }
 
-void mp_thread_create_ex(void *(*entry)(void*), void *arg, size_t *stack_size, int priority, char *name) {
+STATIC void mp_thread_create_task(void *(*entry)(void*), void *arg, size_t *stack_size, int priority, BaseType_t core, mp_thread_stack_mem_t stack_mem, char *name) {
     // store thread entry function into a global variable so we can access it
     ext_thread_entry = entry;
 
@@ -167,6 +216,10 @@ void mp_thread_create_ex(void *(*entry)(void*), void *arg, size_t *stack_size, i
     StaticTask_t *tcb;
     StackType_t *stack;
     thread_t *th;
+    #if MICROPY_ENABLE_PYSTACK
+    void *pystack;
+    size_t pystack_len;
+    #endif
 
     // allocate TCB, stack and linked-list node (must be outside thread_mutex lock)
     if (mp_chip_revision > 0) {
@@ -175,7 +228,13 @@ void mp_thread_create_ex(void *(*entry)(void*), void *arg, size_t *stack_size, i
         if (!tcb) {
             goto memory_error;
         }
-        stack = malloc(*stack_size);
+        if (stack_mem == MP_THREAD_STACK_MEM_PSRAM) {
+            stack = heap_caps_malloc(*stack_size, MALLOC_CAP_SPIRAM);
+        } else if (stack_mem == MP_THREAD_STACK_MEM_INTERNAL) {
+            stack = heap_caps_malloc(*stack_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        } else {
+            stack = malloc(*stack_size);
+        }
         if (!stack) {
             goto memory_error;
         }
@@ -183,17 +242,29 @@ void mp_thread_create_ex(void *(*entry)(void*), void *arg, size_t *stack_size, i
         if (!th) {
             goto memory_error;
         }
+        #if MICROPY_ENABLE_PYSTACK
+        // the frames are kept out of the internal RAM whatever the memory of the stack
+        pystack_len = MP_THREAD_PYSTACK_SIZE_PSRAM;
+        pystack = heap_caps_malloc(pystack_len, MALLOC_CAP_SPIRAM);
+        if (!pystack) {
+            goto memory_error;
+        }
+        #endif
     } else {
         // for revision 0 devices we allocate from the MicroPython heap which is all in the internal memory
         tcb = m_new(StaticTask_t, 1);
         stack = m_new(StackType_t, *stack_size / sizeof(StackType_t));
         th = m_new_obj(thread_t);
+        #if MICROPY_ENABLE_PYSTACK
+        pystack_len = MP_THREAD_PYSTACK_SIZE;
+        pystack = m_new(byte, pystack_len);
+        #endif
     }
 
     mp_thread_mutex_lock(&thread_mutex, 1);
 
     // create thread
-    TaskHandle_t id = xTaskCreateStaticPinnedToCore(freertos_entry, name, *stack_size / sizeof(StackType_t), arg, priority, stack, tcb, 1);
+    TaskHandle_t id = xTaskCreateStaticPinnedToCore(freertos_entry, name, *stack_size / sizeof(StackType_t), arg, priority, stack, tcb, core);
     if (id == NULL) {
         mp_thread_mutex_unlock(&thread_mutex);
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "can't create thread"));
@@ -209,6 +280,10 @@ void mp_thread_create_ex(void *(*entry)(void*), void *arg, size_t *stack_size, i
     th->stack = stack;
     th->tcb = tcb;
     th->stack_len = *stack_size / sizeof(StackType_t);
+    #if MICROPY_ENABLE_PYSTACK
+    th->pystack = pystack;
+    th->pystack_len = pystack_len;
+    #endif
     th->next = thread;
     thread = th;
 
@@ -220,9 +295,26 @@ memory_error:
     nlr_raise(mp_obj_new_exception_msg(&mp_type_MemoryError, "can't create thread"));
 }
 
+void mp_thread_create_ex(void *(*entry)(void*), void *arg, size_t *stack_size, int priority, char *name) {
+    mp_thread_create_task(entry, arg, stack_size, priority, MP_THREAD_DEFAULT_CORE, MP_THREAD_STACK_MEM_ANY, name);
+}
+
 void mp_thread_create(void *(*entry)(void*), void *arg, size_t *stack_size) {
-    mp_thread_create_ex(entry, arg, stack_size, MP_THREAD_PRIORITY, "MPThread");
+    mp_thread_create_task(entry, arg, stack_size, thread_priority, thread_core, thread_stack_mem, "MPThread");
+}
+
+#if MICROPY_ENABLE_PYSTACK
+void mp_thread_pystack_init(void) {
+    mp_thread_mutex_lock(&thread_mutex, 1);
+    for (thread_t *th = thread; th != NULL; th = th->next) {
+        if (th->id == xTaskGetCurrentTaskHandle()) {
+            mp_pystack_init(th->pystack, (byte*)th->pystack + th->pystack_len);
+            break;
+        }
+    }
+    mp_thread_mutex_unlock(&thread_mutex);
 }
+#endif
 
 void mp_thread_finish(void) {
     mp_thread_mutex_lock(&thread_mutex, 1);
@@ -261,10 +353,16 @@ void vPortCleanUpTCB (void *tcb) {
             }
             // explicitly release all its memory
             if (mp_chip_revision > 0) {
+                #if MICROPY_ENABLE_PYSTACK
+                free(th->pystack);
+                #endif
                 free(th->tcb);
                 free(th->stack);
                 free(th);
             } else {
+                #if MICROPY_ENABLE_PYSTACK
+                m_del(byte, th->pystack, th->pystack_len);
+                #endif
                 m_del(StaticTask_t, th->tcb, 1);
                 m_del(StackType_t, th->stack, th->stack_len);
                 m_del(thread_t, th, 1);
@@ -302,6 +400,17 @@ void mp_thread_mutex_unlock(mp_thread_mutex_t *mutex) {
     xSemaphoreGive(mutex->handle);
 }
 
+#if MICROPY_PY_THREAD_GIL_CONTENTION
+// the interrupts task runs above the Python threads, it must not wait for a time slice
+bool mp_thread_is_urgent(void) {
+    return uxTaskPriorityGet(NULL) > MP_THREAD_PRIORITY;
+}
+
+void mp_thread_yield(void) {
+    taskYIELD();
+}
+#endif
+
 void mp_thread_deinit(void) {
     mp_thread_mutex_lock(&thread_mutex, 1);
     during_soft_reset = true;
@@ -320,6 +429,94 @@ void mp_thread_deinit(void) {
     vTaskDelay(2);
 }
 
+/******************************************************************************/
+// Micro Python bindings, added to the _thread module
+
+STATIC mp_obj_t mp_thread_config(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_core, ARG_priority, ARG_psram };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_core,         MP_ARG_KW_ONLY | MP_ARG_OBJ,   {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_priority,     MP_ARG_KW_ONLY | MP_ARG_INT,   {.u_int = -1} },
+        { MP_QSTR_psram,        MP_ARG_KW_ONLY | MP_ARG_OBJ,   {.u_obj = MP_OBJ_NULL} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (n_args == 0 && kw_args->used == 0) {
+        mp_obj_t tuple[3];
+        tuple[0] = (thread_core == tskNO_AFFINITY) ? mp_const_none : mp_obj_new_int(thread_core);
+        tuple[1] = mp_obj_new_int(thread_priority);
+        tuple[2] = (thread_stack_mem == MP_THREAD_STACK_MEM_ANY) ? mp_const_none : mp_obj_new_bool(thread_stack_mem == MP_THREAD_STACK_MEM_PSRAM);
+        return mp_obj_new_tuple(3, tuple);
+    }
+
+    // validate everything before changing anything
+    BaseType_t core = thread_core;
+    if (args[ARG_core].u_obj != MP_OBJ_NULL) {
+        if (args[ARG_core].u_obj == mp_const_none) {
+            core = tskNO_AFFINITY;
+        } else {
+            core = mp_obj_get_int(args[ARG_core].u_obj);
+            if (core < 0 || core >= portNUM_PROCESSORS) {
+                mp_raise_ValueError("invalid core");
+            }
+        }
+    }
+    // the interrupts task must keep running above the Python threads
+    UBaseType_t priority = thread_priority;
+    if (args[ARG_priority].u_int != -1) {
+        if (args[ARG_priority].u_int < 1 || args[ARG_priority].u_int >= INTERRUPTS_TASK_PRIORITY) {
+            mp_raise_ValueError("invalid priority");
+        }
+        priority = args[ARG_priority].u_int;
+    }
+    mp_thread_stack_mem_t stack_mem = thread_stack_mem;
+    if (args[ARG_psram].u_obj != MP_OBJ_NULL) {
+        if (args[ARG_psram].u_obj == mp_const_none) {
+            stack_mem = MP_THREAD_STACK_MEM_ANY;
+        } else if (mp_obj_is_true(args[ARG_psram].u_obj)) {
+            if (mp_chip_revision == 0) {
+                mp_raise_ValueError("no PSRAM for the stacks");
+            }
+            stack_mem = MP_THREAD_STACK_MEM_PSRAM;
+        } else {
+            stack_mem = MP_THREAD_STACK_MEM_INTERNAL;
+        }
+    }
+
+    thread_core = core;
+    thread_priority = priority;
+    thread_stack_mem = stack_mem;
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(mp_thread_config_obj, 0, mp_thread_config);
+
+STATIC mp_obj_t mp_thread_cpu_usage(void) {
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    UBaseType_t n_tasks = uxTaskGetNumberOfTasks();
+    TaskStatus_t *status = m_new(TaskStatus_t, n_tasks);
+    uint32_t total_run_time;
+    n_tasks = uxTaskGetSystemState(status, n_tasks, &total_run_time);
+    // the run time counters of both cores add up against the same timer,
+    // past 2^31 the product no longer fits in 32 bits
+    uint64_t per_cent = ((uint64_t)total_run_time * portNUM_PROCESSORS) / 100;
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (UBaseType_t i = 0; i < n_tasks; i++) {
+        mp_obj_t tuple[3];
+        tuple[0] = mp_obj_new_str(status[i].pcTaskName, strlen(status[i].pcTaskName));
+        tuple[1] = mp_obj_new_int(status[i].uxCurrentPriority);
+        tuple[2] = mp_obj_new_int(per_cent ? status[i].ulRunTimeCounter / per_cent : 0);
+        mp_obj_list_append(list, mp_obj_new_tuple(3, tuple));
+    }
+    m_del(TaskStatus_t, status, n_tasks);
+    return list;
+#else
+    mp_raise_NotImplementedError("FreeRTOS run-time stats are disabled");
+#endif
+}
+MP_DEFINE_CONST_FUN_OBJ_0(mp_thread_cpu_usage_obj, mp_thread_cpu_usage);
+
 #else
 
 void vPortCleanUpTCB (void *tcb) {
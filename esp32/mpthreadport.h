@@ -45,11 +45,26 @@
 
 #define MP_THREAD_PRIORITY                  5
 
+#if MICROPY_ENABLE_PYSTACK
+// bytes of the stacks of the Python frames, allocated in PSRAM on the boards having it, so
+// that a deep recursion uses less of the internal RAM
+#define MP_THREAD_PYSTACK_SIZE_MAIN         (4 * 1024)
+#define MP_THREAD_PYSTACK_SIZE_MAIN_PSRAM   (64 * 1024)
+#define MP_THREAD_PYSTACK_SIZE              (2 * 1024)
+#define MP_THREAD_PYSTACK_SIZE_PSRAM        (16 * 1024)
+#endif
+
 typedef struct _mp_thread_mutex_t {
     SemaphoreHandle_t handle;
     StaticSemaphore_t buffer;
 } mp_thread_mutex_t;
 
+typedef enum {
+    MP_THREAD_STACK_MEM_ANY = 0,
+    MP_THREAD_STACK_MEM_INTERNAL,
+    MP_THREAD_STACK_MEM_PSRAM,
+} mp_thread_stack_mem_t;
+
 typedef struct _mp_obj_thread_lock_t {
     mp_obj_base_t base;
     mp_thread_mutex_t *mutex;
@@ -58,9 +73,16 @@ typedef struct _mp_obj_thread_lock_t {
 
 void mp_thread_preinit(void *stack, uint32_t stack_len, uint8_t chip_revision);
 void mp_thread_init(void);
+uint32_t mp_thread_count(void);
 void mp_thread_gc_others(void);
 void mp_thread_deinit(void);
 mp_obj_thread_lock_t *mp_thread_new_thread_lock(void);
 void mp_thread_create_ex(void *(*entry)(void*), void *arg, size_t *stack_size, int priority, char *name);
 
+// set while a hard interrupt handler runs on the given core, see util/mpirq.c
+extern mp_state_thread_t *mp_thread_isr_state[portNUM_PROCESSORS];
+
+extern const mp_obj_fun_builtin_var_t mp_thread_config_obj;
+extern const mp_obj_fun_builtin_fixed_t mp_thread_cpu_usage_obj;
+
 #endif // __MICROPY_INCLUDED_ESP32_MPTHREADPORT_H__
@@ -24,8 +24,7 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
-#define _GNU_SOURCE     /* needed for qsort_r to be defined */
-#include <stdlib.h>     /* qsort_r */
+#include <stdlib.h>     /* malloc, free */
 #include <stdio.h>      /* printf, fprintf, snprintf, fopen, fputs */
 #include <string.h>     /* memset, memcpy */
 #include <pthread.h>
@@ -51,6 +50,8 @@ Maintainer: Michael Coracin
                                             to ensure beacon can be sent */
 #define BEACON_RESERVED         2120000 /* Time on air of the beacon, with some margin */
 
+#define JIT_MAX_PRE_DELAY       (TX_START_DELAY + BEACON_GUARD + TX_JIT_DELAY) /* Largest pre_delay of a node */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 static pthread_mutex_t mx_jit_queue = PTHREAD_MUTEX_INITIALIZER; /* control access to JIT queue */
@@ -58,6 +59,119 @@ static pthread_mutex_t mx_jit_queue = PTHREAD_MUTEX_INITIALIZER; /* control acce
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+/* Timestamps order, valid across the counter roll-over as long as all the
+ * packets are within half of its range (TX_MAX_ADVANCE_DELAY is far smaller) */
+static inline bool jit_before(uint32_t a_count_us, uint32_t b_count_us) {
+    return (int32_t)(a_count_us - b_count_us) < 0;
+}
+
+static inline uint32_t jit_count_at(struct jit_queue_s *queue, int pos) {
+    return queue->nodes[queue->heap[pos]].pkt.count_us;
+}
+
+static inline void jit_heap_set(struct jit_queue_s *queue, int pos, uint16_t node) {
+    queue->heap[pos] = node;
+    queue->nodes[node].heap_pos = pos;
+}
+
+static void jit_heap_swap(struct jit_queue_s *queue, int pos1, int pos2) {
+    uint16_t node = queue->heap[pos1];
+
+    jit_heap_set(queue, pos1, queue->heap[pos2]);
+    jit_heap_set(queue, pos2, node);
+}
+
+static void jit_heap_sift_up(struct jit_queue_s *queue, int pos) {
+    int parent;
+
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (!jit_before(jit_count_at(queue, pos), jit_count_at(queue, parent))) {
+            break;
+        }
+        jit_heap_swap(queue, pos, parent);
+        pos = parent;
+    }
+}
+
+static void jit_heap_sift_down(struct jit_queue_s *queue, int pos) {
+    int child;
+
+    for (child = 2 * pos + 1; child < queue->num_pkt; child = 2 * pos + 1) {
+        if (((child + 1) < queue->num_pkt) && jit_before(jit_count_at(queue, child + 1), jit_count_at(queue, child))) {
+            child++;
+        }
+        if (!jit_before(jit_count_at(queue, child), jit_count_at(queue, pos))) {
+            break;
+        }
+        jit_heap_swap(queue, pos, child);
+        pos = child;
+    }
+}
+
+/* The removed node ends up right after the heap, with the free nodes */
+static void jit_heap_remove(struct jit_queue_s *queue, int pos) {
+    int last = queue->num_pkt - 1;
+
+    if (queue->nodes[queue->heap[pos]].pkt_type == JIT_PKT_TYPE_BEACON) {
+        queue->num_beacon--;
+    }
+    jit_heap_swap(queue, pos, last);
+    queue->num_pkt--;
+    if (pos < queue->num_pkt) {
+        jit_heap_sift_down(queue, pos);
+        jit_heap_sift_up(queue, pos);
+    }
+}
+
+bool jit_collision_test(uint32_t p1_count_us, uint32_t p1_pre_delay, uint32_t p1_post_delay, uint32_t p2_count_us, uint32_t p2_pre_delay, uint32_t p2_post_delay) {
+    if (((p1_count_us - p2_count_us) <= (p1_pre_delay + p2_post_delay + TX_MARGIN_DELAY)) ||
+            ((p2_count_us - p1_count_us) <= (p2_pre_delay + p1_post_delay + TX_MARGIN_DELAY))) {
+        return true;
+    } else {
+        return false;
+    }
+}
+
+/* Look in the sub-heap at pos for a node colliding with the given packet, and return its index
+ * or -1. As timestamps only grow down the heap, a node starting after the packet ends plus the
+ * largest pre_delay can't collide, and neither can its children. */
+static int jit_find_collision(struct jit_queue_s *queue, int pos, uint32_t count_us, uint32_t pre_delay, uint32_t post_delay, enum jit_pkt_type_e pkt_type) {
+    struct jit_node_s *node;
+    uint32_t target_pre_delay;
+    int idx;
+
+    if (pos >= queue->num_pkt) {
+        return -1;
+    }
+    node = &queue->nodes[queue->heap[pos]];
+    if ((int32_t)(node->pkt.count_us - count_us) > (int32_t)(JIT_MAX_PRE_DELAY + post_delay + TX_MARGIN_DELAY)) {
+        return -1;
+    }
+
+    /* We ignore Beacon Guard for Class A/C downlinks */
+    if (((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C)) && (node->pkt_type == JIT_PKT_TYPE_BEACON)) {
+        target_pre_delay = TX_START_DELAY;
+    } else {
+        target_pre_delay = node->pre_delay;
+    }
+
+    /* Check if there is a collision
+     *  Warning: unsigned arithmetic (handle roll-over)
+     *      t_packet_new - pre_delay_packet_new < t_packet_prev + post_delay_packet_prev (OVERLAP on post delay)
+     *      t_packet_new + post_delay_packet_new > t_packet_prev - pre_delay_packet_prev (OVERLAP on pre delay)
+     */
+    if (jit_collision_test(count_us, pre_delay, post_delay, node->pkt.count_us, target_pre_delay, node->post_delay) == true) {
+        return queue->heap[pos];
+    }
+
+    idx = jit_find_collision(queue, 2 * pos + 1, count_us, pre_delay, post_delay, pkt_type);
+    if (idx < 0) {
+        idx = jit_find_collision(queue, 2 * pos + 2, count_us, pre_delay, post_delay, pkt_type);
+    }
+    return idx;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -66,7 +180,7 @@ bool jit_queue_is_full(struct jit_queue_s *queue) {
 
     pthread_mutex_lock(&mx_jit_queue);
 
-    result = (queue->num_pkt == JIT_QUEUE_MAX) ? true : false;
+    result = (queue->num_pkt == queue->capacity) ? true : false;
 
     pthread_mutex_unlock(&mx_jit_queue);
 
@@ -85,63 +199,50 @@ bool jit_queue_is_empty(struct jit_queue_s *queue) {
     return result;
 }
 
-void jit_queue_init(struct jit_queue_s *queue) {
+bool jit_queue_init(struct jit_queue_s *queue, uint16_t capacity) {
     int i;
 
-    pthread_mutex_lock(&mx_jit_queue);
-
-    memset(queue, 0, sizeof(*queue));
-    for (i = 0; i < JIT_QUEUE_MAX; i++) {
-        queue->nodes[i].pre_delay = 0;
-        queue->nodes[i].post_delay = 0;
+    if ((capacity == 0) || (capacity > JIT_QUEUE_MAX)) {
+        MSG_ERROR("jitqueue: invalid capacity %u\n", capacity);
+        return false;
     }
 
-    pthread_mutex_unlock(&mx_jit_queue);
-}
-
-int compare(const void *a, const void *b, void *arg) {
-    struct jit_node_s *p = (struct jit_node_s *)a;
-    struct jit_node_s *q = (struct jit_node_s *)b;
-    int *counter = (int *)arg;
-    int p_count, q_count;
-
-    p_count = p->pkt.count_us;
-    q_count = q->pkt.count_us;
+    pthread_mutex_lock(&mx_jit_queue);
 
-    if (p_count > q_count) {
-        *counter = *counter + 1;
+    if (queue->capacity != capacity) {
+        free(queue->nodes);
+        free(queue->heap);
+        queue->nodes = malloc(capacity * sizeof(struct jit_node_s));
+        queue->heap = malloc(capacity * sizeof(uint16_t));
+        if ((queue->nodes == NULL) || (queue->heap == NULL)) {
+            free(queue->nodes);
+            free(queue->heap);
+            memset(queue, 0, sizeof(*queue));
+            pthread_mutex_unlock(&mx_jit_queue);
+            MSG_ERROR("jitqueue: cannot allocate %u nodes\n", capacity);
+            return false;
+        }
+        queue->capacity = capacity;
     }
 
-    return p_count - q_count;
-}
-
-void jit_sort_queue(struct jit_queue_s *queue) {
-    int counter = 0;
-
-    if (queue->num_pkt == 0) {
-        return;
+    queue->num_pkt = 0;
+    queue->num_beacon = 0;
+    memset(&queue->stats, 0, sizeof(queue->stats));
+    memset(queue->nodes, 0, capacity * sizeof(struct jit_node_s));
+    for (i = 0; i < capacity; i++) {
+        jit_heap_set(queue, i, i);
     }
 
-    //MSG_DEBUG("jit: sorting queue in ascending order packet timestamp - queue size:%u\n", queue->num_pkt);
-    qsort_r(queue->nodes, queue->num_pkt, sizeof(queue->nodes[0]), compare, &counter);
-    //MSG_DEBUG("jit: sorting queue done - swapped:%d\n", counter);
-}
+    pthread_mutex_unlock(&mx_jit_queue);
 
-bool jit_collision_test(uint32_t p1_count_us, uint32_t p1_pre_delay, uint32_t p1_post_delay, uint32_t p2_count_us, uint32_t p2_pre_delay, uint32_t p2_post_delay) {
-    if (((p1_count_us - p2_count_us) <= (p1_pre_delay + p2_post_delay + TX_MARGIN_DELAY)) ||
-            ((p2_count_us - p1_count_us) <= (p2_pre_delay + p1_post_delay + TX_MARGIN_DELAY))) {
-        return true;
-    } else {
-        return false;
-    }
+    return true;
 }
 
 enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type) {
-    int i = 0;
+    int idx;
     uint32_t time_us = time->tv_sec * 1000000UL + time->tv_usec; /* convert time in µs */
     uint32_t packet_post_delay = 0;
     uint32_t packet_pre_delay = 0;
-    uint32_t target_pre_delay = 0;
     enum jit_error_e err_collision = JIT_ERROR_OK;
     uint32_t asap_count_us;
 
@@ -154,6 +255,9 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, st
 
     if (jit_queue_is_full(queue)) {
         MSG_ERROR("jitqueue: cannot enqueue packet, JIT queue is full\n");
+        pthread_mutex_lock(&mx_jit_queue);
+        queue->stats.full++;
+        pthread_mutex_unlock(&mx_jit_queue);
         return JIT_ERROR_FULL;
     }
 
@@ -184,47 +288,15 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, st
 
         /* Search for the ASAP timestamp to be given to the packet */
         asap_count_us = time_us + 1E6; /*FIXME:this is a double literal*/ /* TODO: Take 1 second margin, to be refined */
-        if (queue->num_pkt == 0) {
-            /* If the jit queue is empty, we can insert this packet */
-            MSG_DEBUG("insert IMMEDIATE downlink, first in JiT queue (count_us=%u)\n", asap_count_us);
-        } else {
-            /* Else we can try to insert it:
-                - ASAP meaning NOW + MARGIN
-                - at the last index of the queue
-                - between 2 downlinks in the queue
-            */
-
-            /* First, try if the ASAP time collides with an already enqueued downlink */
-            for (i = 0; i < queue->num_pkt; i++) {
-                if (jit_collision_test(asap_count_us, packet_pre_delay, packet_post_delay, queue->nodes[i].pkt.count_us, queue->nodes[i].pre_delay, queue->nodes[i].post_delay) == true) {
-                    MSG_DEBUG("cannot insert IMMEDIATE downlink at asap_count_us=%u, collides with pkt.count_us=%u (index=%d)\n", asap_count_us, queue->nodes[i].pkt.count_us, i);
-                    break;
-                }
-            }
-            if (i == queue->num_pkt) {
-                /* No collision with ASAP time, we can insert it */
-                MSG_DEBUG("insert IMMEDIATE downlink ASAP at asap_count_us=%u (no collision)\n", asap_count_us);
-            } else {
-                /* Search for the best slot then */
-                for (i = 0; i < queue->num_pkt; i++) {
-                    asap_count_us = queue->nodes[i].pkt.count_us + queue->nodes[i].post_delay + packet_pre_delay + TX_JIT_DELAY + TX_MARGIN_DELAY;
-                    if (i == (queue->num_pkt - 1)) {
-                        /* Last packet index, we can insert after this one */
-                        MSG_DEBUG("insert IMMEDIATE downlink, last in JiT queue (count_us=%u)\n", asap_count_us);
-                    } else {
-                        /* Check if packet can be inserted between this index and the next one */
-                        MSG_DEBUG("try to insert IMMEDIATE downlink (count_us=%u) between index %d and index %d?\n", asap_count_us, i, i + 1);
-                        if (jit_collision_test(asap_count_us, packet_pre_delay, packet_post_delay, queue->nodes[i + 1].pkt.count_us, queue->nodes[i + 1].pre_delay, queue->nodes[i + 1].post_delay) == true) {
-                            MSG_DEBUG("failed to insert IMMEDIATE downlink (asap_count_us=%u), continue...\n", asap_count_us);
-                            continue;
-                        } else {
-                            MSG_DEBUG("insert IMMEDIATE downlink (asap_count_us=%u)\n", asap_count_us);
-                            break;
-                        }
-                    }
-                }
-            }
+
+        /* Try ASAP meaning NOW + MARGIN, then right after each colliding packet. The slot only
+         * moves forward in time, so every enqueued packet is passed at most once. */
+        while ((idx = jit_find_collision(queue, 0, asap_count_us, packet_pre_delay, packet_post_delay, pkt_type)) >= 0) {
+            MSG_DEBUG("cannot insert IMMEDIATE downlink at asap_count_us=%u, collides with pkt.count_us=%u (index=%d)\n", asap_count_us, queue->nodes[idx].pkt.count_us, idx);
+            asap_count_us = queue->nodes[idx].pkt.count_us + queue->nodes[idx].post_delay + packet_pre_delay + TX_JIT_DELAY + TX_MARGIN_DELAY;
         }
+        MSG_DEBUG("insert IMMEDIATE downlink at asap_count_us=%u\n", asap_count_us);
+
         /* Set packet with ASAP timestamp */
         packet->count_us = asap_count_us;
     }
@@ -239,6 +311,7 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, st
      */
     if (packet->count_us <= time_us + TX_START_DELAY + TX_MARGIN_DELAY + TX_JIT_DELAY) {
         MSG_WARN("jitqueue: IGNORED: not REJECTED, already too late to send it (current=%u, packet=%u, type=%d)\n", time_us, packet->count_us, pkt_type);
+        queue->stats.too_late++;
         // pthread_mutex_unlock(&mx_jit_queue);
         // return JIT_ERROR_TOO_LATE;
     }
@@ -255,6 +328,7 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, st
     if ((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_B)) {
         if (packet->count_us > time_us + TX_MAX_ADVANCE_DELAY) {
             MSG_ERROR("jitqueue: Packet REJECTED, timestamp seems wrong, too much in advance (current=%u, packet=%u, max=%f, type=%d)\n", time_us, packet->count_us, TX_MAX_ADVANCE_DELAY, pkt_type);
+            queue->stats.too_early++;
             pthread_mutex_unlock(&mx_jit_queue);
             return JIT_ERROR_TOO_EARLY;
         }
@@ -265,56 +339,45 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, st
      *        - Valid for both Downlinks and beacon packets
      *        - Beacon guard can be ignored if we try to queue a Class A downlink
      */
-    for (i = 0; i < queue->num_pkt; i++) {
-        /* We ignore Beacon Guard for Class A/C downlinks */
-        if (((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C)) && (queue->nodes[i].pkt_type == JIT_PKT_TYPE_BEACON)) {
-            target_pre_delay = TX_START_DELAY;
-        } else {
-            target_pre_delay = queue->nodes[i].pre_delay;
-        }
-
-        /* Check if there is a collision
-         *  Warning: unsigned arithmetic (handle roll-over)
-         *      t_packet_new - pre_delay_packet_new < t_packet_prev + post_delay_packet_prev (OVERLAP on post delay)
-         *      t_packet_new + post_delay_packet_new > t_packet_prev - pre_delay_packet_prev (OVERLAP on pre delay)
-         */
-        if (jit_collision_test(packet->count_us, packet_pre_delay, packet_post_delay, queue->nodes[i].pkt.count_us, target_pre_delay, queue->nodes[i].post_delay) == true) {
-            switch (queue->nodes[i].pkt_type) {
-                case JIT_PKT_TYPE_DOWNLINK_CLASS_A:
-                case JIT_PKT_TYPE_DOWNLINK_CLASS_B:
-                case JIT_PKT_TYPE_DOWNLINK_CLASS_C:
-                    MSG_ERROR("jitqueue: Packet (type=%d) REJECTED, collision with packet already programmed at %u (%u)\n", pkt_type, queue->nodes[i].pkt.count_us, packet->count_us);
-                    err_collision = JIT_ERROR_COLLISION_PACKET;
-                    break;
-                case JIT_PKT_TYPE_BEACON:
-                    if (pkt_type != JIT_PKT_TYPE_BEACON) {
-                        /* do not overload logs for beacon/beacon collision, as it is expected to happen with beacon pre-scheduling algorith used */
-                        MSG_ERROR("jitqueue: Packet (type=%d) REJECTED, collision with beacon already programmed at %u (%u)\n", pkt_type, queue->nodes[i].pkt.count_us, packet->count_us);
-                    }
-                    err_collision = JIT_ERROR_COLLISION_BEACON;
-                    break;
-                default:
-                    MSG_ERROR("jitqueue: Unknown packet type, should not occur, BUG?\n");
-                    assert(0);
-                    break;
-            }
-            pthread_mutex_unlock(&mx_jit_queue);
-            return err_collision;
+    idx = jit_find_collision(queue, 0, packet->count_us, packet_pre_delay, packet_post_delay, pkt_type);
+    if (idx >= 0) {
+        switch (queue->nodes[idx].pkt_type) {
+            case JIT_PKT_TYPE_DOWNLINK_CLASS_A:
+            case JIT_PKT_TYPE_DOWNLINK_CLASS_B:
+            case JIT_PKT_TYPE_DOWNLINK_CLASS_C:
+                MSG_ERROR("jitqueue: Packet (type=%d) REJECTED, collision with packet already programmed at %u (%u)\n", pkt_type, queue->nodes[idx].pkt.count_us, packet->count_us);
+                queue->stats.collision_packet++;
+                err_collision = JIT_ERROR_COLLISION_PACKET;
+                break;
+            case JIT_PKT_TYPE_BEACON:
+                if (pkt_type != JIT_PKT_TYPE_BEACON) {
+                    /* do not overload logs for beacon/beacon collision, as it is expected to happen with beacon pre-scheduling algorith used */
+                    MSG_ERROR("jitqueue: Packet (type=%d) REJECTED, collision with beacon already programmed at %u (%u)\n", pkt_type, queue->nodes[idx].pkt.count_us, packet->count_us);
+                    queue->stats.collision_beacon++;
+                }
+                err_collision = JIT_ERROR_COLLISION_BEACON;
+                break;
+            default:
+                MSG_ERROR("jitqueue: Unknown packet type, should not occur, BUG?\n");
+                assert(0);
+                break;
         }
+        pthread_mutex_unlock(&mx_jit_queue);
+        return err_collision;
     }
 
     /* Finally enqueue it */
-    /* Insert packet at the end of the queue */
-    memcpy(&(queue->nodes[queue->num_pkt].pkt), packet, sizeof(struct lgw_pkt_tx_s));
-    queue->nodes[queue->num_pkt].pre_delay = packet_pre_delay;
-    queue->nodes[queue->num_pkt].post_delay = packet_post_delay;
-    queue->nodes[queue->num_pkt].pkt_type = pkt_type;
+    /* Take the first free node, right after the heap, and move it up to its place */
+    idx = queue->heap[queue->num_pkt];
+    memcpy(&(queue->nodes[idx].pkt), packet, sizeof(struct lgw_pkt_tx_s));
+    queue->nodes[idx].pre_delay = packet_pre_delay;
+    queue->nodes[idx].post_delay = packet_post_delay;
+    queue->nodes[idx].pkt_type = pkt_type;
     if (pkt_type == JIT_PKT_TYPE_BEACON) {
         queue->num_beacon++;
     }
     queue->num_pkt++;
-    /* Sort the queue in ascending order of packet timestamp */
-    jit_sort_queue(queue);
+    jit_heap_sift_up(queue, queue->num_pkt - 1);
 
     /* Done */
     pthread_mutex_unlock(&mx_jit_queue);
@@ -332,7 +395,7 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
         return JIT_ERROR_INVALID;
     }
 
-    if ((index < 0) || (index >= JIT_QUEUE_MAX)) {
+    if ((index < 0) || (index >= queue->capacity)) {
         MSG_ERROR("jitqueue: invalid parameter\n");
         return JIT_ERROR_INVALID;
     }
@@ -344,21 +407,17 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
 
     pthread_mutex_lock(&mx_jit_queue);
 
+    /* The node may have been dropped by jit_peek in the meantime */
+    if (queue->nodes[index].heap_pos >= queue->num_pkt) {
+        pthread_mutex_unlock(&mx_jit_queue);
+        MSG_ERROR("jitqueue: cannot dequeue packet, node %d is not in the queue\n", index);
+        return JIT_ERROR_INVALID;
+    }
+
     /* Dequeue requested packet */
     memcpy(packet, &(queue->nodes[index].pkt), sizeof(struct lgw_pkt_tx_s));
-    queue->num_pkt--;
     *pkt_type = queue->nodes[index].pkt_type;
-    if (*pkt_type == JIT_PKT_TYPE_BEACON) {
-        queue->num_beacon--;
-        //MSG_DEBUG("jitqueue: --- Beacon dequeued ---\n");
-    }
-
-    /* Replace dequeued packet with last packet of the queue */
-    memcpy(&(queue->nodes[index]), &(queue->nodes[queue->num_pkt]), sizeof(struct jit_node_s));
-    memset(&(queue->nodes[queue->num_pkt]), 0, sizeof(struct jit_node_s));
-
-    /* Sort queue in ascending order of packet timestamp */
-    jit_sort_queue(queue);
+    jit_heap_remove(queue, queue->nodes[index].heap_pos);
 
     /* Done */
     pthread_mutex_unlock(&mx_jit_queue);
@@ -370,11 +429,29 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
     return JIT_ERROR_OK;
 }
 
-enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *pkt_idx) {
+enum jit_error_e jit_read(struct jit_queue_s *queue, int index, struct lgw_pkt_tx_s *packet) {
+    if ((packet == NULL) || (index < 0) || (index >= queue->capacity)) {
+        MSG_ERROR("jitqueue: invalid parameter\n");
+        return JIT_ERROR_INVALID;
+    }
+
+    pthread_mutex_lock(&mx_jit_queue);
+
+    if (queue->nodes[index].heap_pos >= queue->num_pkt) {
+        pthread_mutex_unlock(&mx_jit_queue);
+        return JIT_ERROR_INVALID;
+    }
+    memcpy(packet, &(queue->nodes[index].pkt), sizeof(struct lgw_pkt_tx_s));
+
+    pthread_mutex_unlock(&mx_jit_queue);
+
+    return JIT_ERROR_OK;
+}
+
+enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, uint32_t advance_us, int *pkt_idx) {
     /* Return index of node containing a packet inline with given time */
-    int i = 0;
-    int idx_highest_priority = -1;
     uint32_t time_us;
+    uint32_t count_us;
 
     if ((time == NULL) || (pkt_idx == NULL)) {
         MSG_ERROR("jitqueue: invalid parameter\n");
@@ -389,8 +466,8 @@ enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *
 
     pthread_mutex_lock(&mx_jit_queue);
 
-    /* Search for highest priority packet to be sent */
-    for (i = 0; i < queue->num_pkt; i++) {
+    /* The highest priority packet to be sent is at the top of the heap */
+    while (queue->num_pkt > 0) {
         /* First check if that packet is outdated:
          *  If a packet seems too much in advance, and was not rejected at enqueue time,
          *  it means that we missed it for peeking, we need to drop it
@@ -398,45 +475,32 @@ enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *
          *  Warning: unsigned arithmetic
          *      t_packet > t_current + TX_MAX_ADVANCE_DELAY
          */
-        if (queue->nodes[i].pkt.count_us >= time_us + TX_MAX_ADVANCE_DELAY) {
-            /* We drop the packet to avoid lock-up */
-            queue->num_pkt--;
-            if (queue->nodes[i].pkt_type == JIT_PKT_TYPE_BEACON) {
-                queue->num_beacon--;
-                MSG_WARN("jitqueue: --- Beacon dropped (current_time=%u, packet_time=%u) ---\n", time_us, queue->nodes[i].pkt.count_us);
-            } else {
-                MSG_WARN("jitqueue: --- Packet dropped (current_time=%u, packet_time=%u, p-c=%u(%f)) ---\n", time_us, queue->nodes[i].pkt.count_us, (queue->nodes[i].pkt.count_us-time_us),(queue->nodes[i].pkt.count_us-(double)time_us) );
-            }
-
-            /* Replace dropped packet with last packet of the queue */
-            memcpy(&(queue->nodes[i]), &(queue->nodes[queue->num_pkt]), sizeof(struct jit_node_s));
-            memset(&(queue->nodes[queue->num_pkt]), 0, sizeof(struct jit_node_s));
-
-            /* Sort queue in ascending order of packet timestamp */
-            jit_sort_queue(queue);
-
-            /* restart loop  after purge to find packet to be sent */
-            i = 0;
-            continue;
+        count_us = jit_count_at(queue, 0);
+        if ((count_us - time_us) < TX_MAX_ADVANCE_DELAY) {
+            break;
         }
 
-        /* Then look for highest priority packet to be sent:
-         *  Warning: unsigned arithmetic (handle roll-over)
-         *      t_packet < t_highest
-         */
-        if ((idx_highest_priority == -1) || (((queue->nodes[i].pkt.count_us - time_us) < (queue->nodes[idx_highest_priority].pkt.count_us - time_us)))) {
-            idx_highest_priority = i;
+        /* We drop the packet to avoid lock-up */
+        if (queue->nodes[queue->heap[0]].pkt_type == JIT_PKT_TYPE_BEACON) {
+            MSG_WARN("jitqueue: --- Beacon dropped (current_time=%u, packet_time=%u) ---\n", time_us, count_us);
+        } else {
+            MSG_WARN("jitqueue: --- Packet dropped (current_time=%u, packet_time=%u, p-c=%u(%f)) ---\n", time_us, count_us, (count_us-time_us),(count_us-(double)time_us) );
         }
+        queue->stats.dropped++;
+        jit_heap_remove(queue, 0);
     }
 
-    /* Peek criteria 1: look for a packet to be sent in next TX_JIT_DELAY ms timeframe
+    /* Peek criteria 1: look for a packet to be sent in next advance_us timeframe, at least TX_JIT_DELAY
      *  Warning: unsigned arithmetic (handle roll-over)
-     *      t_packet < t_current + TX_JIT_DELAY
+     *      t_packet < t_current + advance_us
      */
-    if ((queue->nodes[idx_highest_priority].pkt.count_us - time_us) < TX_JIT_DELAY) {
-        *pkt_idx = idx_highest_priority;
+    if (advance_us < TX_JIT_DELAY) {
+        advance_us = TX_JIT_DELAY;
+    }
+    if ((queue->num_pkt > 0) && ((jit_count_at(queue, 0) - time_us) < advance_us)) {
+        *pkt_idx = queue->heap[0];
         //MSG_DEBUG("jit: peek packet with count_us=%u at index %d\n",
-        //          queue->nodes[idx_highest_priority].pkt.count_us, idx_highest_priority);
+        //          jit_count_at(queue, 0), queue->heap[0]);
     } else {
         *pkt_idx = -1;
     }
@@ -446,6 +510,37 @@ enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *
     return JIT_ERROR_OK;
 }
 
+void jit_record_margin(struct jit_queue_s *queue, int32_t margin_us) {
+    int bin;
+
+    if (margin_us < 0) {
+        bin = 0;
+    } else if (margin_us < TX_START_DELAY) {
+        bin = 1;
+    } else if (margin_us < 10000) {
+        bin = 2;
+    } else if (margin_us < 100000) {
+        bin = 3;
+    } else {
+        bin = 4;
+    }
+
+    pthread_mutex_lock(&mx_jit_queue);
+    queue->stats.tx_margin[bin]++;
+    pthread_mutex_unlock(&mx_jit_queue);
+}
+
+void jit_get_stats(struct jit_queue_s *queue, struct jit_stats_s *stats, bool reset) {
+    pthread_mutex_lock(&mx_jit_queue);
+
+    *stats = queue->stats;
+    if (reset) {
+        memset(&queue->stats, 0, sizeof(queue->stats));
+    }
+
+    pthread_mutex_unlock(&mx_jit_queue);
+}
+
 void jit_print_queue(struct jit_queue_s *queue, bool show_all) {
     int i = 0;
     int loop_end;
@@ -457,15 +552,14 @@ void jit_print_queue(struct jit_queue_s *queue, bool show_all) {
 
         mp_printf(&mp_plat_print,"[jit] queue contains %d packets:\n", queue->num_pkt);
         mp_printf(&mp_plat_print,"[jit] queue contains %d beacons:\n", queue->num_beacon);
-        loop_end = (show_all == true) ? JIT_QUEUE_MAX : queue->num_pkt;
+        loop_end = (show_all == true) ? queue->capacity : queue->num_pkt;
         for (i = 0; i < loop_end; i++) {
             mp_printf(&mp_plat_print," - node[%d]: count_us=%u - type=%d\n",
-                      i,
-                      queue->nodes[i].pkt.count_us,
-                      queue->nodes[i].pkt_type);
+                      queue->heap[i],
+                      queue->nodes[queue->heap[i]].pkt.count_us,
+                      queue->nodes[queue->heap[i]].pkt_type);
         }
 
         pthread_mutex_unlock(&mx_jit_queue);
     }
 }
-
@@ -37,8 +37,10 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
-#define JIT_QUEUE_MAX           32  /* Maximum number of packets to be stored in JiT queue */
+#define JIT_QUEUE_DEFAULT_SIZE  32  /* Default number of packets that can be stored in JiT queue */
+#define JIT_QUEUE_MAX           256 /* Maximum configurable size of the JiT queue */
 #define JIT_NUM_BEACON_IN_QUEUE 3   /* Number of beacons to be loaded in JiT queue at any time */
+#define JIT_MARGIN_BINS         5   /* Time left when a packet reaches the concentrator: missed, < 1.5 ms, < 10 ms, < 100 ms, more */
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
@@ -72,12 +74,26 @@ struct jit_node_s {
     /* Internal fields */
     uint32_t pre_delay;             /* Amount of time before packet timestamp to be reserved */
     uint32_t post_delay;            /* Amount of time after packet timestamp to be reserved (time on air) */
+    uint16_t heap_pos;              /* Position of the node in the heap */
+};
+
+struct jit_stats_s {
+    uint32_t too_late;              /* Packets enqueued while already too late to be sent */
+    uint32_t too_early;             /* Packets rejected, timestamp too much in advance */
+    uint32_t full;                  /* Packets rejected, queue full */
+    uint32_t collision_packet;      /* Packets rejected, collision with an enqueued packet */
+    uint32_t collision_beacon;      /* Packets rejected, collision with an enqueued beacon */
+    uint32_t dropped;               /* Packets dropped from the queue, missed for TX */
+    uint32_t tx_margin[JIT_MARGIN_BINS]; /* Packets loaded into the concentrator, by time left before TX */
 };
 
 struct jit_queue_s {
-    uint8_t num_pkt;                /* Total number of packets in the queue (downlinks, beacons...) */
-    uint8_t num_beacon;             /* Number of beacons in the queue */
-    struct jit_node_s nodes[JIT_QUEUE_MAX]; /* Nodes/packets array in the queue */
+    uint16_t capacity;              /* Number of nodes allocated */
+    uint16_t num_pkt;               /* Total number of packets in the queue (downlinks, beacons...) */
+    uint16_t num_beacon;            /* Number of beacons in the queue */
+    struct jit_node_s *nodes;       /* Nodes/packets pool, a node keeps its index while enqueued */
+    uint16_t *heap;                 /* Node indexes, min-heap on packet timestamp followed by the free nodes */
+    struct jit_stats_s stats;       /* Events counters */
 };
 
 /* -------------------------------------------------------------------------- */
@@ -102,11 +118,14 @@ bool jit_queue_is_empty(struct jit_queue_s *queue);
 /**
 @brief Initialize a Just in Time queue.
 
-@param queue[in] Just in Time queue to be initialized. Memory should have been allocated already.
+@param queue[in] Just in Time queue to be initialized.
+@param capacity[in] Number of packets the queue can hold, up to JIT_QUEUE_MAX.
+@return true if the queue could be allocated, false otherwise.
 
-This function is used to reset every elements in the allocated queue.
+This function is used to reset every elements in the queue. The nodes are allocated on first
+use and kept for the next initializations, unless the capacity changes.
 */
-void jit_queue_init(struct jit_queue_s *queue);
+bool jit_queue_init(struct jit_queue_s *queue, uint16_t capacity);
 
 /**
 @brief Add a packet in a Just-in-Time queue
@@ -127,7 +146,7 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval *time, st
 @brief Dequeue a packet from a Just-in-Time queue
 
 @param queue[in/out] Just in Time queue from which the packet should be removed
-@param index[in] in the queue where to get the packet to be removed
+@param index[in] node index of the packet to be removed
 @param packet[out] that was at index
 @param pkt_type[out] Type of packet dequeued: Downlink, Beacon
 @return success if the function was able to dequeue the packet
@@ -137,19 +156,50 @@ The index is generally got using the jit_peek function.
 */
 enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e *pkt_type);
 
+/**
+@brief Copy a packet of a Just-in-Time queue, leaving it in the queue
+
+@param queue[in] Just in Time queue holding the packet
+@param index[in] node index of the packet
+@param packet[out] that is at index
+@return success if the packet is still in the queue
+
+This function is used to load a packet into the concentrator ahead of its time. It keeps its slot
+in the queue, so that packets enqueued afterwards are still checked against it.
+*/
+enum jit_error_e jit_read(struct jit_queue_s *queue, int index, struct lgw_pkt_tx_s *packet);
+
 /**
 @brief Check if there is a packet soon to be sent from the JiT queue.
 
 @param queue[in] Just in Time queue to parse for peeking a packet
 @param time[in] Current concentrator time
-@param pkt_idx[out] Packet index which is soon to be dequeued.
+@param advance_us[in] How long before its timestamp a packet is returned, at least the JiT delay
+@param pkt_idx[out] Node index of the packet which is soon to be dequeued.
 @return success if the function was able to parse the queue. pkt_idx is set to -1 if no packet found.
 
 This function is typically used to check in JiT queue if there is a packet soon to be sent.
-It search the packet with the highest priority in queue, and check if its timestamp is near
+It takes the packet with the highest priority in queue, and check if its timestamp is near
 enough the current concentrator time.
 */
-enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *pkt_idx);
+enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, uint32_t advance_us, int *pkt_idx);
+
+/**
+@brief Count a packet loaded into the concentrator in the margin histogram
+
+@param queue[in/out] Just in Time queue
+@param margin_us[in] Time left before the packet timestamp once it was loaded, negative if missed
+*/
+void jit_record_margin(struct jit_queue_s *queue, int32_t margin_us);
+
+/**
+@brief Get the events counters of a Just-in-Time queue
+
+@param queue[in/out] Just in Time queue
+@param stats[out] Counters accumulated since the previous reset
+@param reset[in] Clear the counters once copied
+*/
+void jit_get_stats(struct jit_queue_s *queue, struct jit_stats_s *stats, bool reset);
 
 /**
 @brief Debug function to print the queue's content on console
@@ -53,6 +53,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include <pthread.h>
 
 #include "trace.h"
+#include "lora_pkt_fwd.h"
 #include "jitqueue.h"
 #include "timersync.h"
 #include "parson.h"
@@ -97,6 +98,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define PUSH_TIMEOUT_MS     100
 #define PULL_TIMEOUT_MS     200
 #define FETCH_SLEEP_MS      50          /* nb of ms waited when a fetch return no packets */
+#define UP_POLL_MS          10          /* nb of ms waited when the upstream queue is empty */
+#define TX_STAGE_DELAY      500000      /* downlinks are loaded into the concentrator up to this many us ahead */
 
 #define PROTOCOL_VERSION    2           /* v1.3 */
 
@@ -106,8 +109,19 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define PKT_PULL_RESP   3
 #define PKT_PULL_ACK    4
 #define PKT_TX_ACK      5
+#define PKT_PUSH_DATA_BIN   0x40 /* compact binary PUSH_DATA, not part of the Semtech protocol */
+
+/* records of a PKT_PUSH_DATA_BIN datagram, each one is: type (1 byte), length (2 bytes LE), body
+ *   UP_REC_RXPK: tmst (4), freq_hz (4), if_chain (1), rf_chain (1), status (1), modulation (1),
+ *                bandwidth (1), datarate (4), coderate (1), rssi x10 (2), snr x10 (2), payload
+ *                (multi-byte fields are little endian, status and modulation as in loragw_hal.h)
+ *   UP_REC_STAT: the "stat" member of the JSON status report */
+#define UP_REC_RXPK     1
+#define UP_REC_STAT     2
+#define UP_REC_RXPK_HDR_SIZE    23
 
 #define NB_PKT_MAX      2 /* max number of packets per fetch/send cycle */
+#define RX_QUEUE_SIZE   16 /* packets buffered between the fetch and upstream threads, power of 2 */
 
 #define MIN_LORA_PREAMB 6 /* minimum Lora preamble length for this application */
 #define STD_LORA_PREAMB 8
@@ -143,6 +157,17 @@ struct coord_s {
     short   alt;    /*!> altitude in meters (WGS 84 geoid ref.) */
 };
 
+/**
+@struct up_enc_s
+@brief Upstream datagram being serialized, in place in the send buffer
+*/
+struct up_enc_s {
+    uint8_t *buf;
+    int     size;
+    int     index;
+    bool    overflow;   /*!> set when something didn't fit, the rest is dropped */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
@@ -155,6 +180,12 @@ static bool fwd_valid_pkt = true; /* packets with PAYLOAD CRC OK are forwarded *
 static bool fwd_error_pkt = false; /* packets with PAYLOAD CRC ERROR are NOT forwarded */
 static bool fwd_nocrc_pkt = false; /* packets with NO PAYLOAD CRC are NOT forwarded */
 
+/* upstream format */
+static bool binary_uplink = false; /* send PKT_PUSH_DATA_BIN datagrams instead of JSON */
+
+/* downstream scheduling */
+static uint16_t jit_queue_size = JIT_QUEUE_DEFAULT_SIZE; /* number of downlinks/beacons the JiT queue can hold */
+
 /* network configuration variables */
 static uint64_t lgwm = 0; /* Lora gateway MAC address */
 static char serv_addr[64] = STR(DEFAULT_SERVER); /* address of the server (host name or IPv4/IPv6) */
@@ -186,6 +217,9 @@ static struct coord_s reference_coord;
 /* Enable faking the GPS coordinates of the gateway */
 static bool gps_fake_enable; /* enable the feature */
 
+/* GPIO of a PPS signal that disciplines the time of class B downlinks, -1 if none */
+static int pps_gpio = -1;
+
 /* measurements to establish statistics */
 static pthread_mutex_t mx_meas_up = PTHREAD_MUTEX_INITIALIZER; /* control access to the upstream measurements */
 static uint32_t meas_nb_rx_rcv = 0; /* count packets received */
@@ -197,6 +231,12 @@ static uint32_t meas_up_network_byte = 0; /* sum of UDP bytes sent for upstream
 static uint32_t meas_up_payload_byte = 0; /* sum of radio payload bytes sent for upstream traffic */
 static uint32_t meas_up_dgram_sent = 0; /* number of datagrams sent for upstream traffic */
 static uint32_t meas_up_ack_rcv = 0; /* number of datagrams acknowledged for upstream traffic */
+static uint32_t meas_fetch_nb = 0; /* number of lgw_receive calls */
+static uint32_t meas_fetch_us = 0; /* sum of the time spent in lgw_receive, in us */
+static uint32_t meas_fetch_max_us = 0; /* longest lgw_receive call, in us */
+static uint32_t meas_fetch_pkt = 0; /* number of packets fetched by the calls that returned some */
+static uint32_t meas_fetch_pkt_us = 0; /* sum of the time spent in the calls that returned packets, in us */
+static uint32_t meas_up_ack_rtt_ms = 0; /* sum of the PUSH_DATA round trip times, in ms */
 
 static pthread_mutex_t mx_meas_dw = PTHREAD_MUTEX_INITIALIZER; /* control access to the downstream measurements */
 static uint32_t meas_dw_pull_sent = 0; /* number of PULL requests sent for downstream traffic */
@@ -211,6 +251,20 @@ static uint32_t meas_nb_tx_rejected_collision_packet = 0; /* count packets were
 static uint32_t meas_nb_tx_rejected_collision_beacon = 0; /* count packets were TX request were rejected due to collision with a beacon already programmed */
 static uint32_t meas_nb_tx_rejected_too_late = 0; /* count packets were TX request were rejected because it is too late to program it */
 static uint32_t meas_nb_tx_rejected_too_early = 0; /* count packets were TX request were rejected because timestamp is too much in advance */
+static uint32_t meas_dw_ack_rtt_ms = 0; /* sum of the PULL_DATA round trip times, in ms */
+
+/* measurements exported through lora_gw_get_stats, the upstream ones first, the downstream ones
+ * from LORA_GW_STAT_DW_PULL_SENT, in the order of enum lora_gw_stat_e */
+static uint32_t * const stats_meas[LORA_GW_STAT_NUM] = {
+    &meas_nb_rx_rcv, &meas_nb_rx_ok, &meas_nb_rx_bad, &meas_nb_rx_nocrc,
+    &meas_up_pkt_fwd, &meas_up_payload_byte, &meas_up_dgram_sent, &meas_up_network_byte,
+    &meas_up_ack_rcv, &meas_up_ack_rtt_ms, NULL /* LORA_GW_STAT_UP_PKT_DROPPED, atomic */,
+    &meas_dw_pull_sent, &meas_dw_ack_rcv, &meas_dw_ack_rtt_ms, &meas_dw_dgram_rcv,
+    &meas_dw_network_byte, &meas_dw_payload_byte, &meas_nb_tx_requested, &meas_nb_tx_ok,
+    &meas_nb_tx_fail, &meas_nb_tx_rejected_collision_packet, &meas_nb_tx_rejected_collision_beacon,
+    &meas_nb_tx_rejected_too_late, &meas_nb_tx_rejected_too_early
+};
+static uint32_t stats_total[LORA_GW_STAT_NUM]; /* measurements of the past report intervals */
 
 static pthread_mutex_t mx_stat_rep = PTHREAD_MUTEX_INITIALIZER; /* control access to the status report */
 static bool report_ready = false; /* true when there is a new report to send to the server */
@@ -222,6 +276,12 @@ static uint32_t autoquit_threshold = 0; /* enable auto-quit after a number of no
 /* Just In Time TX scheduling */
 static struct jit_queue_s jit_queue;
 
+/* received packets, single producer (fetch thread) single consumer (upstream thread) */
+static struct lgw_pkt_rx_s rx_queue[RX_QUEUE_SIZE];
+static uint32_t rx_queue_head = 0; /* only written by the fetch thread */
+static uint32_t rx_queue_tail = 0; /* only written by the upstream thread */
+static uint32_t rx_queue_dropped = 0; /* packets lost because the upstream thread fell behind */
+
 /* Gateway specificities */
 static int8_t antenna_gain = 0;
 
@@ -245,11 +305,22 @@ static int parse_gateway_configuration(const char * conf_file);
 
 static double time_diff(struct timeval x , struct timeval y);
 
+static int parse_utc_time(const char *str, struct timeval *utc);
+
 static void obtain_time(void);
 
 static void loragw_exit(int status);
 
+static bool rx_queue_push(const struct lgw_pkt_rx_s *pkt);
+
+static int rx_queue_pop(struct lgw_pkt_rx_s *pkt, int max_pkt);
+
+static void serialize_rxpk_json(struct up_enc_s *enc, const struct lgw_pkt_rx_s *p, bool first);
+
+static void serialize_rxpk_bin(struct up_enc_s *enc, const struct lgw_pkt_rx_s *p);
+
 /* threads */
+void thread_fetch(void);
 void thread_up(void);
 void thread_down(void);
 void thread_jit(void);
@@ -639,6 +710,7 @@ static int parse_gateway_configuration(const char * conf_file) {
     JSON_Value *val = NULL; /* needed to detect the absence of some fields */
     const char *str; /* pointer to sub-strings in the JSON data */
     unsigned long long ull = 0;
+    int n;
 
     /* try to parse JSON */
     root_val = json_parse_file_with_comments(conf_file);
@@ -721,6 +793,25 @@ static int parse_gateway_configuration(const char * conf_file) {
     }
     MSG_INFO("[main] packets received with no CRC will%s be forwarded\n", (fwd_nocrc_pkt ? "" : " NOT"));
 
+    /* upstream format */
+    val = json_object_get_value(conf_obj, "binary_uplink");
+    if (json_value_get_type(val) == JSONBoolean) {
+        binary_uplink = (bool)json_value_get_boolean(val);
+    }
+    MSG_INFO("[main] upstream datagrams will be sent as %s\n", (binary_uplink ? "binary" : "JSON"));
+
+    /* JiT queue size (optional) */
+    val = json_object_get_value(conf_obj, "jit_queue_size");
+    if (val != NULL) {
+        n = (int)json_value_get_number(val);
+        if ((n > 0) && (n <= JIT_QUEUE_MAX)) {
+            jit_queue_size = (uint16_t)n;
+        } else {
+            MSG_WARN("[main] invalid jit_queue_size %d, keeping %u\n", n, jit_queue_size);
+        }
+    }
+    MSG_INFO("[main] JiT queue can hold %u packets\n", jit_queue_size);
+
     /* get reference coordinates */
     val = json_object_get_value(conf_obj, "ref_latitude");
     if (val != NULL) {
@@ -749,6 +840,13 @@ static int parse_gateway_configuration(const char * conf_file) {
         }
     }
 
+    /* PPS input (optional) */
+    val = json_object_get_value(conf_obj, "pps_pin");
+    if (json_value_get_type(val) == JSONNumber) {
+        pps_gpio = (int)json_value_get_number(val);
+        MSG_INFO("[main] PPS input is GPIO %d\n", pps_gpio);
+    }
+
     /* Auto-quit threshold (optional) */
     val = json_object_get_value(conf_obj, "autoquit_threshold");
     if (val != NULL) {
@@ -773,6 +871,26 @@ static double time_diff(struct timeval x , struct timeval y)
     return diff / 1000000.0;
 }
 
+/* parses an ISO 8601 UTC time such as "2021-03-04T10:11:12.345678Z" */
+static int parse_utc_time(const char *str, struct timeval *utc)
+{
+    int year, month, day, hour, min;
+    double sec;
+    int64_t days;
+
+    if (sscanf(str, "%d-%d-%dT%d:%d:%lf", &year, &month, &day, &hour, &min, &sec) != 6 ||
+        month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || min > 59 || sec < 0 || sec >= 61) {
+        return -1;
+    }
+
+    /* days since 1970-01-01, with the year starting in March so that the leap day comes last */
+    year -= (month <= 2);
+    days = (int64_t)365 * year + year / 4 - year / 100 + year / 400 + (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1 - 719468;
+    utc->tv_sec = days * 86400 + hour * 3600 + min * 60 + (int)sec;
+    utc->tv_usec = (sec - (int)sec) * 1E6;
+    return 0;
+}
+
 /*static double difftimespec(struct timespec end, struct timespec beginning) {
     double x;
 
@@ -890,6 +1008,50 @@ static int send_tx_ack(uint8_t token_h, uint8_t token_l, enum jit_error_e error)
 }
 
 
+/* fold the measurements of the interval in the totals, called with the matching mutex taken */
+static void stats_accumulate(int first, int last) {
+    int i;
+
+    for (i = first; i < last; i++) {
+        if (stats_meas[i] != NULL) {
+            stats_total[i] += *stats_meas[i];
+        }
+    }
+}
+
+static void stats_reset(void) {
+    int i;
+
+    pthread_mutex_lock(&mx_meas_up);
+    pthread_mutex_lock(&mx_meas_dw);
+    for (i = 0; i < LORA_GW_STAT_NUM; i++) {
+        if (stats_meas[i] != NULL) {
+            *stats_meas[i] = 0;
+        }
+        stats_total[i] = 0;
+    }
+    __atomic_store_n(&rx_queue_dropped, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&mx_meas_dw);
+    pthread_mutex_unlock(&mx_meas_up);
+}
+
+void lora_gw_get_stats(uint32_t *stats) {
+    int i;
+
+    pthread_mutex_lock(&mx_meas_up);
+    for (i = 0; i < LORA_GW_STAT_DW_PULL_SENT; i++) {
+        stats[i] = stats_total[i] + ((stats_meas[i] != NULL) ? *stats_meas[i] : 0);
+    }
+    stats[LORA_GW_STAT_UP_PKT_DROPPED] += __atomic_load_n(&rx_queue_dropped, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&mx_meas_up);
+
+    pthread_mutex_lock(&mx_meas_dw);
+    for (i = LORA_GW_STAT_DW_PULL_SENT; i < LORA_GW_STAT_NUM; i++) {
+        stats[i] = stats_total[i] + *stats_meas[i];
+    }
+    pthread_mutex_unlock(&mx_meas_dw);
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- MAIN FUNCTION -------------------------------------------------------- */
 
@@ -898,6 +1060,7 @@ void lora_gw_init(const char* global_conf) {
 
     quit_sig = false;
     exit_sig = false;
+    stats_reset();
 
     xTaskCreatePinnedToCore(TASK_lora_gw, "LoraGW",
         LORA_GW_STACK_SIZE / sizeof(StackType_t),
@@ -976,6 +1139,7 @@ void TASK_lora_gw(void *pvParameters) {
     //char *debug_cfg_path = "/flash/debug_conf.json"; /* if present, all other configuration files are ignored */
 
     /* threads */
+    pthread_t thrid_fetch;
     pthread_t thrid_up;
     pthread_t thrid_down;
     pthread_t thrid_jit;
@@ -998,6 +1162,12 @@ void TASK_lora_gw(void *pvParameters) {
     uint32_t cp_up_payload_byte;
     uint32_t cp_up_dgram_sent;
     uint32_t cp_up_ack_rcv;
+    uint32_t cp_up_pkt_dropped;
+    uint32_t cp_fetch_nb;
+    uint32_t cp_fetch_us;
+    uint32_t cp_fetch_max_us;
+    uint32_t cp_fetch_pkt;
+    uint32_t cp_fetch_pkt_us;
     uint32_t cp_dw_pull_sent;
     uint32_t cp_dw_ack_rcv;
     uint32_t cp_dw_dgram_rcv;
@@ -1010,6 +1180,7 @@ void TASK_lora_gw(void *pvParameters) {
     uint32_t cp_nb_tx_rejected_collision_beacon = 0;
     uint32_t cp_nb_tx_rejected_too_late = 0;
     uint32_t cp_nb_tx_rejected_too_early = 0;
+    struct jit_stats_s cp_jit_stats;
 
     /* GPS coordinates variables */
     struct coord_s cp_gps_coord = {0.0, 0.0, 0};
@@ -1250,21 +1421,36 @@ void TASK_lora_gw(void *pvParameters) {
     }
     cfg.stack_size = (7 * 1024);
     esp_pthread_set_cfg(&cfg);
+    i = pthread_create( &thrid_fetch, NULL, (void * (*)(void *))thread_fetch, NULL);
+    if (i != 0) {
+        MSG_ERROR("[main] impossible to create fetch thread\n");
+        exit_sig = true;
+        pthread_join(thrid_up, NULL);
+        pthread_join(thrid_down, NULL);
+        exit(EXIT_FAILURE);
+    }
+
     i = pthread_create( &thrid_jit, NULL, (void * (*)(void *))thread_jit, NULL);
     if (i != 0) {
         MSG_ERROR("[main] impossible to create JIT thread\n");
         exit_sig = true;
+        pthread_join(thrid_fetch, NULL);
         pthread_join(thrid_up, NULL);
         pthread_join(thrid_down, NULL);
         exit(EXIT_FAILURE);
     }
 
+    if (pps_gpio >= 0 && timersync_pps_init(pps_gpio) != 0) {
+        MSG_WARN("[main] no PPS, class B downlinks are disabled\n");
+    }
+
     cfg.stack_size = (7 * 1024);
     esp_pthread_set_cfg(&cfg);
     i = pthread_create( &thrid_timersync, NULL, (void * (*)(void *))thread_timersync, NULL);
     if (i != 0) {
         MSG_ERROR("[main] impossible to create Timer Sync thread (%d) (%d) (%d,%d,%d)\n", i, errno, EAGAIN, EINVAL, EPERM);
         exit_sig = true;
+        pthread_join(thrid_fetch, NULL);
         pthread_join(thrid_up, NULL);
         pthread_join(thrid_down, NULL);
         pthread_join(thrid_jit, NULL);
@@ -1294,6 +1480,12 @@ void TASK_lora_gw(void *pvParameters) {
         cp_up_payload_byte = meas_up_payload_byte;
         cp_up_dgram_sent   = meas_up_dgram_sent;
         cp_up_ack_rcv      = meas_up_ack_rcv;
+        cp_fetch_nb        = meas_fetch_nb;
+        cp_fetch_us        = meas_fetch_us;
+        cp_fetch_max_us    = meas_fetch_max_us;
+        cp_fetch_pkt       = meas_fetch_pkt;
+        cp_fetch_pkt_us    = meas_fetch_pkt_us;
+        stats_accumulate(0, LORA_GW_STAT_DW_PULL_SENT);
         meas_nb_rx_rcv = 0;
         meas_nb_rx_ok = 0;
         meas_nb_rx_bad = 0;
@@ -1303,6 +1495,14 @@ void TASK_lora_gw(void *pvParameters) {
         meas_up_payload_byte = 0;
         meas_up_dgram_sent = 0;
         meas_up_ack_rcv = 0;
+        meas_fetch_nb = 0;
+        meas_fetch_us = 0;
+        meas_fetch_max_us = 0;
+        meas_fetch_pkt = 0;
+        meas_fetch_pkt_us = 0;
+        meas_up_ack_rtt_ms = 0;
+        cp_up_pkt_dropped = __atomic_exchange_n(&rx_queue_dropped, 0, __ATOMIC_RELAXED);
+        stats_total[LORA_GW_STAT_UP_PKT_DROPPED] += cp_up_pkt_dropped;
         pthread_mutex_unlock(&mx_meas_up);
         if (cp_nb_rx_rcv > 0) {
             rx_ok_ratio = (float)cp_nb_rx_ok / (float)cp_nb_rx_rcv;
@@ -1333,6 +1533,7 @@ void TASK_lora_gw(void *pvParameters) {
         cp_nb_tx_rejected_collision_beacon +=  meas_nb_tx_rejected_collision_beacon;
         cp_nb_tx_rejected_too_late         +=  meas_nb_tx_rejected_too_late;
         cp_nb_tx_rejected_too_early        +=  meas_nb_tx_rejected_too_early;
+        stats_accumulate(LORA_GW_STAT_DW_PULL_SENT, LORA_GW_STAT_NUM);
         meas_dw_pull_sent = 0;
         meas_dw_ack_rcv = 0;
         meas_dw_dgram_rcv = 0;
@@ -1345,7 +1546,9 @@ void TASK_lora_gw(void *pvParameters) {
         meas_nb_tx_rejected_collision_beacon = 0;
         meas_nb_tx_rejected_too_late = 0;
         meas_nb_tx_rejected_too_early = 0;
+        meas_dw_ack_rtt_ms = 0;
         pthread_mutex_unlock(&mx_meas_dw);
+        jit_get_stats(&jit_queue, &cp_jit_stats, true);
         if (cp_dw_pull_sent > 0) {
             dw_ack_ratio = (float)cp_dw_ack_rcv / (float)cp_dw_pull_sent;
         } else {
@@ -1360,11 +1563,19 @@ void TASK_lora_gw(void *pvParameters) {
         /* display a report */
 #if LORAPF_DEBUG_LEVEL >= LORAPF_INFO_
         if ( debug_level >= LORAPF_INFO_){
+        struct timersync_stats_s cp_timersync_stats;
         MSG_INFO("[main] report\n##### %s #####\n", stat_timestamp);
         mp_printf(&mp_plat_print, "### [UPSTREAM] ###\n");
         mp_printf(&mp_plat_print, "# RF packets received by concentrator: %u\n", cp_nb_rx_rcv);
         mp_printf(&mp_plat_print, "# CRC_OK: %.2f%%, CRC_FAIL: %.2f%%, NO_CRC: %.2f%%\n", 100.0 * rx_ok_ratio, 100.0 * rx_bad_ratio, 100.0 * rx_nocrc_ratio);
         mp_printf(&mp_plat_print, "# RF packets forwarded: %u (%u bytes)\n", cp_up_pkt_fwd, cp_up_payload_byte);
+        mp_printf(&mp_plat_print, "# RF packets dropped (upstream queue full): %u\n", cp_up_pkt_dropped);
+        if (cp_fetch_nb != 0) {
+            mp_printf(&mp_plat_print, "# Concentrator fetches: %u (avg %u us, max %u us)\n", cp_fetch_nb, cp_fetch_us / cp_fetch_nb, cp_fetch_max_us);
+        }
+        if (cp_fetch_pkt != 0) {
+            mp_printf(&mp_plat_print, "# Concentrator fetch time per packet: %u us\n", cp_fetch_pkt_us / cp_fetch_pkt);
+        }
         mp_printf(&mp_plat_print, "# PUSH_DATA datagrams sent: %u (%u bytes)\n", cp_up_dgram_sent, cp_up_network_byte);
         mp_printf(&mp_plat_print, "# PUSH_DATA acknowledged: %.2f%%\n", 100.0 * up_ack_ratio);
         mp_printf(&mp_plat_print, "### [DOWNSTREAM] ###\n");
@@ -1379,6 +1590,9 @@ void TASK_lora_gw(void *pvParameters) {
             mp_printf(&mp_plat_print, "# TX rejected (too early): %.2f%% (req:%u, rej:%u)\n", 100.0 * cp_nb_tx_rejected_too_early / cp_nb_tx_requested, cp_nb_tx_requested, cp_nb_tx_rejected_too_early);
         }
         mp_printf(&mp_plat_print, "### [JIT] ###\n");
+        mp_printf(&mp_plat_print, "# rejected: too early %u, full %u, collision packet %u, collision beacon %u\n", cp_jit_stats.too_early, cp_jit_stats.full, cp_jit_stats.collision_packet, cp_jit_stats.collision_beacon);
+        mp_printf(&mp_plat_print, "# enqueued too late: %u, dropped: %u\n", cp_jit_stats.too_late, cp_jit_stats.dropped);
+        mp_printf(&mp_plat_print, "# loaded with: missed %u, <1.5ms %u, <10ms %u, <100ms %u, more %u\n", cp_jit_stats.tx_margin[0], cp_jit_stats.tx_margin[1], cp_jit_stats.tx_margin[2], cp_jit_stats.tx_margin[3], cp_jit_stats.tx_margin[4]);
         jit_print_queue (&jit_queue, false);
         mp_printf(&mp_plat_print, "### [GPS] ###\n");
         if (gps_fake_enable == true) {
@@ -1386,6 +1600,14 @@ void TASK_lora_gw(void *pvParameters) {
         } else {
             mp_printf(&mp_plat_print, "# GPS sync is disabled\n");
         }
+        timersync_get_stats(&cp_timersync_stats);
+        mp_printf(&mp_plat_print, "### [TIMESYNC] ###\n");
+        mp_printf(&mp_plat_print, "# concentrator clock: %u samples, residual %.2f us, drift %.2f ppm\n", cp_timersync_stats.samples, cp_timersync_stats.residual_us, cp_timersync_stats.drift_ppm);
+        if (cp_timersync_stats.pps_locked) {
+            mp_printf(&mp_plat_print, "# PPS locked: host drift %.2f ppm, jitter %.2f us, error %.2f us\n", cp_timersync_stats.host_drift_ppm, cp_timersync_stats.pps_jitter_us, cp_timersync_stats.error_us);
+        } else {
+            mp_printf(&mp_plat_print, "# PPS not locked\n");
+        }
         mp_printf(&mp_plat_print, "##### END #####\n");
         }
 #endif
@@ -1398,7 +1620,8 @@ void TASK_lora_gw(void *pvParameters) {
     }
     MSG_INFO("[main] Exited main packet forwarder loop\n");
 
-    /* wait for upstream thread to finish (1 fetch cycle max) */
+    /* wait for fetch and upstream threads to finish (1 fetch cycle max) */
+    pthread_join(thrid_fetch, NULL);
     pthread_join(thrid_up, NULL);
     pthread_join(thrid_down, NULL); /* don't wait for downstream thread */
     pthread_join(thrid_jit, NULL); /* don't wait for jit thread */
@@ -1423,7 +1646,318 @@ void TASK_lora_gw(void *pvParameters) {
 }
 
 /* -------------------------------------------------------------------------- */
-/* --- THREAD 1: RECEIVING PACKETS AND FORWARDING THEM ---------------------- */
+/* --- UPSTREAM QUEUE ------------------------------------------------------- */
+
+static bool rx_queue_push(const struct lgw_pkt_rx_s *pkt) {
+    uint32_t head = rx_queue_head;
+    uint32_t tail = __atomic_load_n(&rx_queue_tail, __ATOMIC_ACQUIRE);
+
+    if ((head - tail) >= RX_QUEUE_SIZE) {
+        return false;
+    }
+    rx_queue[head & (RX_QUEUE_SIZE - 1)] = *pkt;
+    /* publish the packet only once it has been completely copied */
+    __atomic_store_n(&rx_queue_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static int rx_queue_pop(struct lgw_pkt_rx_s *pkt, int max_pkt) {
+    uint32_t tail = rx_queue_tail;
+    uint32_t head = __atomic_load_n(&rx_queue_head, __ATOMIC_ACQUIRE);
+    int nb_pkt = 0;
+
+    while ((tail != head) && (nb_pkt < max_pkt)) {
+        pkt[nb_pkt++] = rx_queue[tail & (RX_QUEUE_SIZE - 1)];
+        ++tail;
+    }
+    /* give the slots back to the fetch thread */
+    __atomic_store_n(&rx_queue_tail, tail, __ATOMIC_RELEASE);
+    return nb_pkt;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- UPSTREAM SERIALIZATION ----------------------------------------------- */
+
+#define enc_lit(enc, str)   enc_raw((enc), (str), sizeof(str) - 1)
+
+static void serialize_error(const char *what) {
+    MSG_ERROR("[up  ] received packet with unknown %s\n", what);
+    quit_sig = true;
+    machine_pygate_set_status(PYGATE_ERROR);
+}
+
+static void enc_raw(struct up_enc_s *enc, const void *data, int len) {
+    if ((enc->index + len) > enc->size) {
+        enc->overflow = true;
+        return;
+    }
+    memcpy(enc->buf + enc->index, data, len);
+    enc->index += len;
+}
+
+static void enc_uint(struct up_enc_s *enc, uint32_t val) {
+    char digits[10];
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + (val % 10);
+        val /= 10;
+    } while (val != 0);
+    if ((enc->index + n) > enc->size) {
+        enc->overflow = true;
+        return;
+    }
+    while (n > 0) {
+        enc->buf[enc->index++] = digits[--n];
+    }
+}
+
+/* val is scaled by 10^decimals, so no floating point formatting is needed */
+static void enc_fixed(struct up_enc_s *enc, int32_t val, int decimals) {
+    uint32_t mag = (val < 0) ? -(uint32_t)val : (uint32_t)val;
+    uint32_t div = 1;
+    int i;
+
+    for (i = 0; i < decimals; ++i) {
+        div *= 10;
+    }
+    if (val < 0) {
+        enc_lit(enc, "-");
+    }
+    enc_uint(enc, mag / div);
+    if (decimals > 0) {
+        char c;
+        mag %= div;
+        enc_lit(enc, ".");
+        for (div /= 10; div > 0; div /= 10) {
+            c = '0' + ((mag / div) % 10);
+            enc_raw(enc, &c, 1);
+        }
+    }
+}
+
+static void enc_le(struct up_enc_s *enc, uint32_t val, int len) {
+    if ((enc->index + len) > enc->size) {
+        enc->overflow = true;
+        return;
+    }
+    while (len-- > 0) {
+        enc->buf[enc->index++] = (uint8_t)val;
+        val >>= 8;
+    }
+}
+
+static void serialize_rxpk_json(struct up_enc_s *enc, const struct lgw_pkt_rx_s *p, bool first) {
+    int j;
+
+    /* Start of packet, add inter-packet separator if necessary */
+    if (first) {
+        enc_lit(enc, "{");
+    } else {
+        enc_lit(enc, ",{");
+    }
+
+    /* RAW timestamp, 8-17 useful chars */
+    enc_lit(enc, "\"tmst\":");
+    enc_uint(enc, p->count_us);
+
+    /* Packet concentrator channel, RF chain & RX frequency, 34-36 useful chars */
+    enc_lit(enc, ",\"chan\":");
+    enc_uint(enc, p->if_chain);
+    enc_lit(enc, ",\"rfch\":");
+    enc_uint(enc, p->rf_chain);
+    enc_lit(enc, ",\"freq\":");
+    enc_fixed(enc, p->freq_hz, 6);
+
+    /* Packet status, 9-10 useful chars */
+    switch (p->status) {
+        case STAT_CRC_OK:
+            enc_lit(enc, ",\"stat\":1");
+            break;
+        case STAT_CRC_BAD:
+            enc_lit(enc, ",\"stat\":-1");
+            break;
+        case STAT_NO_CRC:
+            enc_lit(enc, ",\"stat\":0");
+            break;
+        default:
+            serialize_error("status");
+            enc_lit(enc, ",\"stat\":?");
+    }
+
+    /* Packet modulation, 13-14 useful chars */
+    if (p->modulation == MOD_LORA) {
+        enc_lit(enc, ",\"modu\":\"LORA\"");
+
+        /* Lora datarate & bandwidth, 16-19 useful chars */
+        switch (p->datarate) {
+            case DR_LORA_SF7:
+                enc_lit(enc, ",\"datr\":\"SF7");
+                break;
+            case DR_LORA_SF8:
+                enc_lit(enc, ",\"datr\":\"SF8");
+                break;
+            case DR_LORA_SF9:
+                enc_lit(enc, ",\"datr\":\"SF9");
+                break;
+            case DR_LORA_SF10:
+                enc_lit(enc, ",\"datr\":\"SF10");
+                break;
+            case DR_LORA_SF11:
+                enc_lit(enc, ",\"datr\":\"SF11");
+                break;
+            case DR_LORA_SF12:
+                enc_lit(enc, ",\"datr\":\"SF12");
+                break;
+            default:
+                serialize_error("datarate");
+                enc_lit(enc, ",\"datr\":\"SF?");
+        }
+        switch (p->bandwidth) {
+            case BW_125KHZ:
+                enc_lit(enc, "BW125\"");
+                break;
+            case BW_250KHZ:
+                enc_lit(enc, "BW250\"");
+                break;
+            case BW_500KHZ:
+                enc_lit(enc, "BW500\"");
+                break;
+            default:
+                serialize_error("bandwidth");
+                enc_lit(enc, "BW?\"");
+        }
+
+        /* Packet ECC coding rate, 11-13 useful chars */
+        switch (p->coderate) {
+            case CR_LORA_4_5:
+                enc_lit(enc, ",\"codr\":\"4/5\"");
+                break;
+            case CR_LORA_4_6:
+                enc_lit(enc, ",\"codr\":\"4/6\"");
+                break;
+            case CR_LORA_4_7:
+                enc_lit(enc, ",\"codr\":\"4/7\"");
+                break;
+            case CR_LORA_4_8:
+                enc_lit(enc, ",\"codr\":\"4/8\"");
+                break;
+            case 0: /* treat the CR0 case (mostly false sync) */
+                enc_lit(enc, ",\"codr\":\"OFF\"");
+                break;
+            default:
+                serialize_error("coderate");
+                enc_lit(enc, ",\"codr\":\"?\"");
+        }
+
+        /* Lora SNR, 11-13 useful chars */
+        enc_lit(enc, ",\"lsnr\":");
+        enc_fixed(enc, lrintf(p->snr * 10), 1);
+    } else if (p->modulation == MOD_FSK) {
+        enc_lit(enc, ",\"modu\":\"FSK\"");
+
+        /* FSK datarate, 11-14 useful chars */
+        enc_lit(enc, ",\"datr\":");
+        enc_uint(enc, p->datarate);
+    } else {
+        serialize_error("modulation");
+    }
+
+    /* Packet RSSI, payload size, 18-23 useful chars */
+    enc_lit(enc, ",\"rssi\":");
+    enc_fixed(enc, lrintf(p->rssi), 0);
+    enc_lit(enc, ",\"size\":");
+    enc_uint(enc, p->size);
+
+    /* Packet base64-encoded payload, 14-350 useful chars */
+    enc_lit(enc, ",\"data\":\"");
+    if ((enc->size - enc->index) < 341) { /* 255 bytes = 340 chars in b64 + null char */
+        enc->overflow = true;
+    } else {
+        j = bin_to_b64(p->payload, p->size, (char *)(enc->buf + enc->index), 341);
+        if (j >= 0) {
+            enc->index += j;
+        } else {
+            MSG_ERROR("[up  ] bin_to_b64 failed line %u\n", (__LINE__ - 4));
+            quit_sig = true;
+            machine_pygate_set_status(PYGATE_ERROR);
+        }
+    }
+    enc_lit(enc, "\"");
+
+    /* End of packet serialization */
+    enc_lit(enc, "}");
+}
+
+static void serialize_rxpk_bin(struct up_enc_s *enc, const struct lgw_pkt_rx_s *p) {
+    enc_le(enc, UP_REC_RXPK, 1);
+    enc_le(enc, UP_REC_RXPK_HDR_SIZE + p->size, 2);
+    enc_le(enc, p->count_us, 4);
+    enc_le(enc, p->freq_hz, 4);
+    enc_le(enc, p->if_chain, 1);
+    enc_le(enc, p->rf_chain, 1);
+    enc_le(enc, p->status, 1);
+    enc_le(enc, p->modulation, 1);
+    enc_le(enc, p->bandwidth, 1);
+    enc_le(enc, p->datarate, 4);
+    enc_le(enc, p->coderate, 1);
+    enc_le(enc, (uint16_t)(int16_t)lrintf(p->rssi * 10), 2);
+    enc_le(enc, (uint16_t)(int16_t)lrintf(p->snr * 10), 2);
+    enc_raw(enc, p->payload, p->size);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 0: FETCHING PACKETS FROM THE CONCENTRATOR --------------------- */
+
+void thread_fetch(void) {
+    MSG_INFO("[fetch] start\n");
+    int i;
+    int nb_pkt;
+    struct lgw_pkt_rx_s rxpkt[NB_PKT_MAX]; /* array containing inbound packets + metadata */
+    uint32_t fetch_start;
+    uint32_t fetch_us;
+
+    /* drain the SX1308 FIFO independently of the backhaul latency */
+    while (!exit_sig && !quit_sig) {
+        pthread_mutex_lock(&mx_concent);
+        fetch_start = mp_hal_ticks_us();
+        nb_pkt = lgw_receive(NB_PKT_MAX, rxpkt);
+        fetch_us = mp_hal_ticks_us() - fetch_start;
+        pthread_mutex_unlock(&mx_concent);
+        if (nb_pkt == LGW_HAL_ERROR) {
+            MSG_ERROR("[fetch] failed packet fetch\n");
+            nb_pkt = 0;
+        }
+
+        /* time spent on the concentrator, to keep an eye on the SPI transfers cost */
+        pthread_mutex_lock(&mx_meas_up);
+        meas_fetch_nb += 1;
+        meas_fetch_us += fetch_us;
+        if (fetch_us > meas_fetch_max_us) {
+            meas_fetch_max_us = fetch_us;
+        }
+        if (nb_pkt > 0) {
+            meas_fetch_pkt += nb_pkt;
+            meas_fetch_pkt_us += fetch_us;
+        }
+        pthread_mutex_unlock(&mx_meas_up);
+
+        for (i = 0; i < nb_pkt; ++i) {
+            if (!rx_queue_push(&rxpkt[i])) {
+                __atomic_add_fetch(&rx_queue_dropped, 1, __ATOMIC_RELAXED);
+            }
+        }
+
+        /* wait a short time if the FIFO is empty */
+        if (nb_pkt == 0) {
+            wait_ms ((FETCH_SLEEP_MS));
+        }
+    }
+    MSG_INFO("[fetch] End of fetch thread\n\n");
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 1: FORWARDING RECEIVED PACKETS -------------------------------- */
 
 void thread_up(void) {
     MSG_INFO("[up  ] start\n");
@@ -1451,6 +1985,9 @@ void thread_up(void) {
     /* report management variable */
     bool send_report = false;
 
+    /* upstream datagram serialization */
+    struct up_enc_s enc;
+
     /* mote info variables */
     uint32_t mote_addr = 0;
     uint16_t mote_fcnt = 0;
@@ -1465,19 +2002,13 @@ void thread_up(void) {
 
     /* pre-fill the data buffer with fixed fields */
     buff_up[0] = PROTOCOL_VERSION;
-    buff_up[3] = PKT_PUSH_DATA;
+    buff_up[3] = binary_uplink ? PKT_PUSH_DATA_BIN : PKT_PUSH_DATA;
     *(uint32_t *)(buff_up + 4) = net_mac_h;
     *(uint32_t *)(buff_up + 8) = net_mac_l;
 
     while (!exit_sig && !quit_sig) {
-        /* fetch packets */
-        pthread_mutex_lock(&mx_concent);
-        nb_pkt = lgw_receive(NB_PKT_MAX, rxpkt);  // Crashing here
-        pthread_mutex_unlock(&mx_concent);
-        if (nb_pkt == LGW_HAL_ERROR) {
-            MSG_ERROR("[up  ] failed packet fetch, exiting\n");
-            //exit(EXIT_FAILURE);
-        }
+        /* take the packets queued by the fetch thread */
+        nb_pkt = rx_queue_pop(rxpkt, NB_PKT_MAX);
 
         /* check if there are status report to send */
         send_report = report_ready; /* copy the variable so it doesn't change mid-function */
@@ -1485,7 +2016,7 @@ void thread_up(void) {
 
         /* wait a short time if no packets, nor status report */
         if ((nb_pkt == 0) && (send_report == false)) {
-            wait_ms ((FETCH_SLEEP_MS));
+            wait_ms ((UP_POLL_MS));
             continue;
         }
 
@@ -1496,11 +2027,15 @@ void thread_up(void) {
         buff_up[1] = token_h;
         buff_up[2] = token_l;
         token++;
-        buff_index = 12; /* 12-byte header */
+        enc.buf = buff_up;
+        enc.size = TX_BUFF_SIZE - 1; /* room for the string terminator */
+        enc.index = 12; /* 12-byte header */
+        enc.overflow = false;
 
         /* start of JSON structure */
-        memcpy((void *)(buff_up + buff_index), (void *)"{\"rxpk\":[", 9);
-        buff_index += 9;
+        if (!binary_uplink) {
+            enc_lit(&enc, "{\"rxpk\":[");
+        }
 
         /* serialize Lora packets metadata and payload */
         pkt_in_dgram = 0;
@@ -1554,201 +2089,12 @@ void thread_up(void) {
             meas_up_payload_byte += p->size;
             pthread_mutex_unlock(&mx_meas_up);
 
-            /* Start of packet, add inter-packet separator if necessary */
-            if (pkt_in_dgram == 0) {
-                buff_up[buff_index] = '{';
-                ++buff_index;
+            /* written straight into the datagram, without intermediate buffers */
+            if (binary_uplink) {
+                serialize_rxpk_bin(&enc, p);
             } else {
-                buff_up[buff_index] = ',';
-                buff_up[buff_index + 1] = '{';
-                buff_index += 2;
-            }
-
-            /* RAW timestamp, 8-17 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, "\"tmst\":%u", p->count_us);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                quit_sig = true;
-            }
-
-            /* Packet concentrator channel, RF chain & RX frequency, 34-36 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf", p->if_chain, p->rf_chain, ((double)p->freq_hz / 1e6));
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
-            }
-
-            /* Packet status, 9-10 useful chars */
-            switch (p->status) {
-                case STAT_CRC_OK:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":1", 9);
-                    buff_index += 9;
-                    break;
-                case STAT_CRC_BAD:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":-1", 10);
-                    buff_index += 10;
-                    break;
-                case STAT_NO_CRC:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":0", 9);
-                    buff_index += 9;
-                    break;
-                default:
-                    MSG_ERROR("[up  ] received packet with unknown status\n");
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":?", 9);
-                    buff_index += 9;
-                    quit_sig = true;
-                    machine_pygate_set_status(PYGATE_ERROR);
+                serialize_rxpk_json(&enc, p, (pkt_in_dgram == 0));
             }
-
-            /* Packet modulation, 13-14 useful chars */
-            if (p->modulation == MOD_LORA) {
-                memcpy((void *)(buff_up + buff_index), (void *)",\"modu\":\"LORA\"", 14);
-                buff_index += 14;
-
-                /* Lora datarate & bandwidth, 16-19 useful chars */
-                switch (p->datarate) {
-                    case DR_LORA_SF7:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF7", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF8:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF8", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF9:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF9", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF10:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF10", 13);
-                        buff_index += 13;
-                        break;
-                    case DR_LORA_SF11:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF11", 13);
-                        buff_index += 13;
-                        break;
-                    case DR_LORA_SF12:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF12", 13);
-                        buff_index += 13;
-                        break;
-                    default:
-                        MSG_ERROR("[up  ] lora packet with unknown datarate\n");
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF?", 12);
-                        buff_index += 12;
-                        quit_sig = true;
-                        machine_pygate_set_status(PYGATE_ERROR);
-                }
-                switch (p->bandwidth) {
-                    case BW_125KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW125\"", 6);
-                        buff_index += 6;
-                        break;
-                    case BW_250KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW250\"", 6);
-                        buff_index += 6;
-                        break;
-                    case BW_500KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW500\"", 6);
-                        buff_index += 6;
-                        break;
-                    default:
-                        MSG_ERROR("[up  ] lora packet with unknown bandwidth\n");
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW?\"", 4);
-                        buff_index += 4;
-                        quit_sig = true;
-                        machine_pygate_set_status(PYGATE_ERROR);
-                }
-
-                /* Packet ECC coding rate, 11-13 useful chars */
-                switch (p->coderate) {
-                    case CR_LORA_4_5:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/5\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_6:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/6\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_7:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/7\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_8:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/8\"", 13);
-                        buff_index += 13;
-                        break;
-                    case 0: /* treat the CR0 case (mostly false sync) */
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"OFF\"", 13);
-                        buff_index += 13;
-                        break;
-                    default:
-                        MSG_ERROR("[up  ] lora packet with unknown coderate\n");
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"?\"", 11);
-                        buff_index += 11;
-                        quit_sig = true;
-                        machine_pygate_set_status(PYGATE_ERROR);
-                }
-
-                /* Lora SNR, 11-13 useful chars */
-                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"lsnr\":%.1f", p->snr);
-                if (j > 0) {
-                    buff_index += j;
-                } else {
-                    MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                    quit_sig = true;
-                    machine_pygate_set_status(PYGATE_ERROR);
-                }
-            } else if (p->modulation == MOD_FSK) {
-                memcpy((void *)(buff_up + buff_index), (void *)",\"modu\":\"FSK\"", 13);
-                buff_index += 13;
-
-                /* FSK datarate, 11-14 useful chars */
-                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"datr\":%u", p->datarate);
-                if (j > 0) {
-                    buff_index += j;
-                } else {
-                    MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                    quit_sig = true;
-                    machine_pygate_set_status(PYGATE_ERROR);
-                }
-            } else {
-                MSG_ERROR("[up  ] received packet with unknown modulation\n");
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
-            }
-
-            /* Packet RSSI, payload size, 18-23 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"rssi\":%.0f,\"size\":%u", p->rssi, p->size);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 4));
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
-            }
-
-            /* Packet base64-encoded payload, 14-350 useful chars */
-            memcpy((void *)(buff_up + buff_index), (void *)",\"data\":\"", 9);
-            buff_index += 9;
-            j = bin_to_b64(p->payload, p->size, (char *)(buff_up + buff_index), 341); /* 255 bytes = 340 chars in b64 + null char */
-            if (j >= 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] bin_to_b64 failed line %u\n", (__LINE__ - 5));
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
-            }
-            buff_up[buff_index] = '"';
-            ++buff_index;
-
-            /* End of packet serialization */
-            buff_up[buff_index] = '}';
-            ++buff_index;
             ++pkt_in_dgram;
         }
 
@@ -1756,19 +2102,19 @@ void thread_up(void) {
         if (pkt_in_dgram == 0) {
             if (send_report == true) {
                 /* need to clean up the beginning of the payload */
-                buff_index -= 8; /* removes "rxpk":[ */
+                if (!binary_uplink) {
+                    enc.index -= 8; /* removes "rxpk":[ */
+                }
             } else {
                 /* all packet have been filtered out and no report, restart loop */
                 continue;
             }
-        } else {
+        } else if (!binary_uplink) {
             /* end of packet array */
-            buff_up[buff_index] = ']';
-            ++buff_index;
+            enc_lit(&enc, "]");
             /* add separator if needed */
             if (send_report == true) {
-                buff_up[buff_index] = ',';
-                ++buff_index;
+                enc_lit(&enc, ",");
             }
         }
 
@@ -1776,23 +2122,29 @@ void thread_up(void) {
         if (send_report == true) {
             pthread_mutex_lock(&mx_stat_rep);
             report_ready = false;
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, "%s", status_report);
-            pthread_mutex_unlock(&mx_stat_rep);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG_ERROR("[up  ] snprintf failed line %u\n", (__LINE__ - 5));
-                quit_sig = true;
-                machine_pygate_set_status(PYGATE_ERROR);
+            j = strlen(status_report);
+            if (binary_uplink) {
+                enc_le(&enc, UP_REC_STAT, 1);
+                enc_le(&enc, j, 2);
             }
+            enc_raw(&enc, status_report, j);
+            pthread_mutex_unlock(&mx_stat_rep);
         }
 
         /* end of JSON datagram payload */
-        buff_up[buff_index] = '}';
-        ++buff_index;
+        if (!binary_uplink) {
+            enc_lit(&enc, "}");
+        }
+        if (enc.overflow) {
+            MSG_ERROR("[up  ] upstream datagram too large, dropped\n");
+            continue;
+        }
+        buff_index = enc.index;
         buff_up[buff_index] = 0; /* add string terminator, for safety */
 
-        MSG_DEBUG("[up  ] send PUSH_DATA [%u:%u]: %s\n", token_h, token_l, (char *)(buff_up + 12)); /* DEBUG: display JSON payload */
+        if (!binary_uplink) {
+            MSG_DEBUG("[up  ] send PUSH_DATA [%u:%u]: %s\n", token_h, token_l, (char *)(buff_up + 12)); /* DEBUG: display JSON payload */
+        }
 
         /* send datagram to server */
         send(sock_up, (void *)buff_up, buff_index, 0);
@@ -1802,6 +2154,7 @@ void thread_up(void) {
         pthread_mutex_lock(&mx_meas_up);
         meas_up_dgram_sent += 1;
         meas_up_network_byte += buff_index;
+        pthread_mutex_unlock(&mx_meas_up);
 
         /* wait for acknowledge (in 2 times, to catch extra packets) */
         for (i = 0; i < 2; ++i) {
@@ -1823,11 +2176,13 @@ void thread_up(void) {
                 continue;
             } else {
                 MSG_DEBUG("[up  ] received PUSH_ACK [%u:%u] in %i ms\n", buff_ack[1], buff_ack[2], (int)(1000 * time_diff(send_time, recv_time)));
+                pthread_mutex_lock(&mx_meas_up);
                 meas_up_ack_rcv += 1;
+                meas_up_ack_rtt_ms += (uint32_t)(1000 * time_diff(send_time, recv_time));
+                pthread_mutex_unlock(&mx_meas_up);
                 break;
             }
         }
-        pthread_mutex_unlock(&mx_meas_up);
         wait_ms (5);
     }
     MSG_INFO("[up  ] End of upstream thread\n\n");
@@ -1871,6 +2226,7 @@ void thread_down(void) {
     /* Just In Time downlink */
     struct timeval current_unix_time;
     struct timeval current_concentrator_time;
+    struct timeval utc_tx; /* UTC time of a class B downlink */
     enum jit_error_e jit_result = JIT_ERROR_OK;
     enum jit_pkt_type_e downlink_type;
 
@@ -1889,7 +2245,10 @@ void thread_down(void) {
     *(uint32_t *)(buff_req + 8) = net_mac_l;
 
     /* JIT queue initialization */
-    jit_queue_init(&jit_queue);
+    if (!jit_queue_init(&jit_queue, jit_queue_size)) {
+        quit_sig = true;
+        machine_pygate_set_status(PYGATE_ERROR);
+    }
 
     while (!exit_sig && !quit_sig) {
 
@@ -1949,6 +2308,7 @@ void thread_down(void) {
                         autoquit_cnt = 0;
                         pthread_mutex_lock(&mx_meas_dw);
                         meas_dw_ack_rcv += 1;
+                        meas_dw_ack_rtt_ms += (uint32_t)(1000 * time_diff(send_time, recv_time));
                         pthread_mutex_unlock(&mx_meas_dw);
                         MSG_DEBUG("[down] received PULL_ACK [%u:%u] in %i ms\n", buff_down[1], buff_down[2], (int)(1000 * time_diff(send_time, recv_time)));
                     }
@@ -2003,9 +2363,19 @@ void thread_down(void) {
                         json_value_free(root_val);
                         continue;
                     }
-                    MSG_WARN("[down] GPS disabled, impossible to send packet on specific UTC time, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
+                    if (parse_utc_time(str, &utc_tx) != 0) {
+                        MSG_WARN("[down] invalid \"txpk.time\" %s, TX aborted\n", str);
+                        json_value_free(root_val);
+                        continue;
+                    }
+                    if (timersync_utc_to_count(utc_tx, &txpkt.count_us) != 0) {
+                        MSG_WARN("[down] no PPS lock, impossible to send packet on specific UTC time, TX aborted\n");
+                        json_value_free(root_val);
+                        continue;
+                    }
+
+                    /* GPS time is given, we consider it is a Class B downlink */
+                    downlink_type = JIT_PKT_TYPE_DOWNLINK_CLASS_B;
                 }
             }
 
@@ -2299,7 +2669,11 @@ void thread_jit(void) {
     MSG_INFO("[jit ] start\n");
     int result = LGW_HAL_SUCCESS;
     struct lgw_pkt_tx_s pkt;
+    struct lgw_pkt_tx_s staged_pkt;
     int pkt_index = -1;
+    int staged_index = -1; /* node of the packet loaded into the concentrator, it stays enqueued until sent */
+    uint32_t now_us;
+    uint32_t busy_until_us = 0; /* end of the last emission, the TX buffer must not be reloaded before */
     struct timeval current_unix_time;
     struct timeval current_concentrator_time;
     enum jit_error_e jit_result;
@@ -2307,29 +2681,33 @@ void thread_jit(void) {
     uint8_t tx_status;
 
     while (!exit_sig && !quit_sig) {
-        /* transfer data and metadata to the concentrator, and schedule TX */
         gettimeofday(&current_unix_time, NULL);
         get_concentrator_time(&current_concentrator_time, current_unix_time);
-        jit_result = jit_peek(&jit_queue, &current_concentrator_time, &pkt_index);
+        now_us = current_concentrator_time.tv_sec * 1000000UL + current_concentrator_time.tv_usec;
+
+        /* the concentrator triggers the loaded packet by itself, it leaves the queue once its time has come */
+        if (staged_index > -1 && (int32_t)(now_us - staged_pkt.count_us) >= 0) {
+            jit_result = jit_dequeue(&jit_queue, staged_index, &pkt, &pkt_type);
+            if (jit_result == JIT_ERROR_OK) {
+                pthread_mutex_lock(&mx_meas_dw);
+                meas_nb_tx_ok += 1;
+                pthread_mutex_unlock(&mx_meas_dw);
+                MSG_DEBUG("[jit ] sent: count_us=%u\n", staged_pkt.count_us);
+            }
+            busy_until_us = staged_pkt.count_us + lgw_time_on_air(&staged_pkt) * 1000UL;
+            staged_index = -1;
+        }
+
+        /* load the next packet as soon as the concentrator is free, instead of just before its time */
+        jit_result = jit_peek(&jit_queue, &current_concentrator_time, TX_STAGE_DELAY, &pkt_index);
         if (jit_result == JIT_ERROR_OK) {
-            if (pkt_index > -1) {
-                jit_result = jit_dequeue(&jit_queue, pkt_index, &pkt, &pkt_type);
+            /* the next packet is already loaded, or the previous one is still on air */
+            if (pkt_index > -1 && pkt_index != staged_index && (int32_t)(busy_until_us - now_us) <= 0) {
+                jit_result = jit_read(&jit_queue, pkt_index, &pkt);
                 if (jit_result == JIT_ERROR_OK) {
-
-                    /* check if concentrator is free for sending new packet */
-                    result = lgw_status(TX_STATUS, &tx_status);
-                    if (result == LGW_HAL_ERROR) {
-                    } else {
-                        if (tx_status == TX_EMITTING) {
-                            MSG_WARN("[jit ] concentrator is currently busy\n");
-                            print_tx_status(tx_status);
-                            // continue;
-                        } else if (tx_status == TX_SCHEDULED) {
-                            MSG_WARN("[jit ] a downlink was already scheduled, overwritting it...\n");
-                            print_tx_status(tx_status);
-                        } else {
-                            /* Nothing to do */
-                        }
+                    if (staged_index > -1) {
+                        /* an earlier packet was enqueued meanwhile, the one replaced is loaded again after it */
+                        MSG_INFO("[jit ] count_us=%u loaded before count_us=%u\n", pkt.count_us, staged_pkt.count_us);
                     }
 
                     /* send packet to concentrator */
@@ -2341,15 +2719,22 @@ void thread_jit(void) {
                         meas_nb_tx_fail += 1;
                         pthread_mutex_unlock(&mx_meas_dw);
                         MSG_WARN("[jit ] lgw_send failed\n");
-                        continue;
+                        if (lgw_status(TX_STATUS, &tx_status) == LGW_HAL_SUCCESS) {
+                            print_tx_status(tx_status);
+                        }
+                        jit_dequeue(&jit_queue, pkt_index, &pkt, &pkt_type);
+                        staged_index = -1;
                     } else {
-                        pthread_mutex_lock(&mx_meas_dw);
-                        meas_nb_tx_ok += 1;
-                        pthread_mutex_unlock(&mx_meas_dw);
+                        gettimeofday(&current_unix_time, NULL);
+                        get_concentrator_time(&current_concentrator_time, current_unix_time);
+                        now_us = current_concentrator_time.tv_sec * 1000000UL + current_concentrator_time.tv_usec;
+                        jit_record_margin(&jit_queue, (int32_t)(pkt.count_us - now_us));
                         MSG_DEBUG("[jit ] lgw_send done: count_us=%u\n", pkt.count_us);
+                        staged_pkt = pkt;
+                        staged_index = pkt_index;
                     }
                 } else {
-                    MSG_ERROR("[jit ] jit_dequeue failed with %d\n", jit_result);
+                    MSG_ERROR("[jit ] jit_read failed with %d\n", jit_result);
                 }
             }
         } else if (jit_result == JIT_ERROR_EMPTY) {
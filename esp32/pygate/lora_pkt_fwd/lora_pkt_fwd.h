@@ -25,12 +25,43 @@ Maintainer: Michael Coracin
 #ifndef _LORA_PKTFWD_H
 #define _LORA_PKTFWD_H
 
+#include <stdint.h>
 #include "py/mpprint.h"
 
-int lora_gw_init(char *);
+/* counters returned by lora_gw_get_stats, accumulated since the forwarder was started */
+enum lora_gw_stat_e {
+    LORA_GW_STAT_RX_RCV,                    /* packets received */
+    LORA_GW_STAT_RX_OK,                     /* packets received with PAYLOAD CRC OK */
+    LORA_GW_STAT_RX_BAD,                    /* packets received with PAYLOAD CRC ERROR */
+    LORA_GW_STAT_RX_NOCRC,                  /* packets received with NO PAYLOAD CRC */
+    LORA_GW_STAT_UP_PKT_FWD,                /* radio packets forwarded to the server */
+    LORA_GW_STAT_UP_PAYLOAD_BYTE,           /* radio payload bytes forwarded */
+    LORA_GW_STAT_UP_DGRAM_SENT,             /* PUSH_DATA datagrams sent */
+    LORA_GW_STAT_UP_NETWORK_BYTE,           /* PUSH_DATA bytes sent */
+    LORA_GW_STAT_UP_ACK_RCV,                /* PUSH_DATA acknowledged */
+    LORA_GW_STAT_UP_ACK_RTT_MS,             /* sum of the PUSH_DATA round trip times, in ms */
+    LORA_GW_STAT_UP_PKT_DROPPED,            /* radio packets dropped, upstream queue full */
+    LORA_GW_STAT_DW_PULL_SENT,              /* PULL_DATA sent */
+    LORA_GW_STAT_DW_ACK_RCV,                /* PULL_DATA acknowledged */
+    LORA_GW_STAT_DW_ACK_RTT_MS,             /* sum of the PULL_DATA round trip times, in ms */
+    LORA_GW_STAT_DW_DGRAM_RCV,              /* PULL_RESP datagrams received */
+    LORA_GW_STAT_DW_NETWORK_BYTE,           /* PULL_RESP bytes received */
+    LORA_GW_STAT_DW_PAYLOAD_BYTE,           /* radio payload bytes to be sent */
+    LORA_GW_STAT_TX_REQUESTED,              /* TX requests from the server */
+    LORA_GW_STAT_TX_OK,                     /* packets emitted */
+    LORA_GW_STAT_TX_FAIL,                   /* packets failed to be emitted */
+    LORA_GW_STAT_TX_REJ_COLLISION_PACKET,   /* TX requests rejected by the JiT queue, collision with a packet */
+    LORA_GW_STAT_TX_REJ_COLLISION_BEACON,   /* TX requests rejected by the JiT queue, collision with a beacon */
+    LORA_GW_STAT_TX_REJ_TOO_LATE,           /* TX requests rejected by the JiT queue, too late */
+    LORA_GW_STAT_TX_REJ_TOO_EARLY,          /* TX requests rejected by the JiT queue, too early */
+    LORA_GW_STAT_NUM
+};
+
+void lora_gw_init(const char *global_conf);
 void pygate_reset();
 int lora_gw_get_debug_level();
 void lora_gw_set_debug_level(int level);
+void lora_gw_get_stats(uint32_t *stats);
 
 #endif
 /* --- EOF ------------------------------------------------------------------ */
@@ -18,6 +18,10 @@ Description:
     LoRa concentrator : Timer synchronization
         Provides synchronization between unix, concentrator and gps clocks
 
+        The concentrator counter is sampled against the machtimer counter of the ESP32 and a
+        linear regression over the last samples follows its drift. An optional PPS input,
+        timestamped with the same counter, disciplines the conversion of UTC times.
+
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Michael Coracin
 */
@@ -27,8 +31,18 @@ Maintainer: Michael Coracin
 
 #include <stdio.h>        /* printf, fprintf, snprintf, fopen, fputs */
 #include <stdint.h>        /* C99 types */
+#include <string.h>        /* memset */
+#include <math.h>          /* sqrt, fabs, round */
 #include <pthread.h>
 
+#include "py/mpconfig.h"
+#include "py/obj.h"
+#include "esp_attr.h"
+#include "soc/soc.h"
+#include "driver/gpio.h"
+#include "machtimer.h"
+#include "machpin.h"
+
 #include "trace.h"
 #include "timersync.h"
 #include "loragw_hal.h"
@@ -38,6 +52,44 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
 
+#define TIMERSYNC_PERIOD_MS     750     /* time between two samples of the concentrator counter */
+#define TIMERSYNC_WINDOW        16      /* samples kept for the regression, about 12 s */
+#define TIMERSYNC_MIN_SAMPLES   4       /* below this only the offset is estimated, the rate is nominal */
+#define TIMERSYNC_STEP_US       2000    /* a sample this far from the model restarts it (concentrator reset) */
+#define TIMERSYNC_RTT_SLACK_US  100     /* samples read this much slower than the fastest one are left out */
+
+#define PPS_TOLERANCE_US        500     /* an edge further than this from a whole second is a glitch */
+#define PPS_MAX_GAP_S           4       /* edges further apart than this restart the lock */
+#define PPS_RATE_FILTER         8       /* weight of the new period in the rate estimate is 1/PPS_RATE_FILTER */
+
+#define HOST_TICKS_PER_US       ((double)CLK_FREQ / 1000000.0)
+
+struct timersync_sample_s {
+    double host_us;         /* machtimer counter halfway through the read of the concentrator counter */
+    int64_t concent_us;     /* unwrapped concentrator counter */
+    uint32_t rtt_us;        /* time taken by the read */
+};
+
+/* concent_us = ref_concent + offset + slope * (host_us - ref_host) */
+struct timersync_model_s {
+    bool valid;
+    double ref_host;
+    int64_t ref_concent;
+    double offset;
+    double slope;
+    double residual_us;     /* rms distance of the samples to the model */
+    uint32_t samples;
+};
+
+struct timersync_pps_s {
+    bool locked;
+    double host_us;         /* machtimer counter at the last edge */
+    int64_t unix_s;         /* UTC second that the last edge marks */
+    double host_per_us;     /* host microseconds per true microsecond */
+    double jitter_us;       /* mean distance of the edges to the rate estimate */
+    uint32_t count;         /* edges seen at the last update */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
 
@@ -54,8 +106,20 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
-static pthread_mutex_t mx_timersync = PTHREAD_MUTEX_INITIALIZER; /* control access to timer sync offsets */
-static struct timeval offset_unix_concent = {0, 0}; /* timer offset between unix host and concentrator */
+static pthread_mutex_t mx_timersync = PTHREAD_MUTEX_INITIALIZER; /* control access to the clock model */
+static struct timersync_model_s timersync_model = {0};
+static struct timersync_pps_s timersync_pps = {0};
+
+/* only used by the sync thread */
+static struct timersync_sample_s samples[TIMERSYNC_WINDOW];
+static uint32_t samples_nb = 0;
+static uint32_t samples_next = 0;
+static uint32_t last_trigcnt = 0;
+static int64_t last_concent_us = 0;
+
+/* written by the PPS interrupt */
+static volatile uint64_t pps_edge_ticks = 0;
+static volatile uint32_t pps_edge_count = 0;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE SHARED VARIABLES (GLOBAL) ------------------------------------ */
@@ -63,85 +127,279 @@ extern bool exit_sig;
 extern bool quit_sig;
 extern pthread_mutex_t mx_concent;
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static double host_time_us(void) {
+    return machtimer_get_timer_counter_value() / HOST_TICKS_PER_US;
+}
+
+static double timeval_us(const struct timeval *tv) {
+    return tv->tv_sec * 1E6 + tv->tv_usec;
+}
+
+static double model_predict(const struct timersync_model_s *model, double host_us) {
+    return model->ref_concent + model->offset + model->slope * (host_us - model->ref_host);
+}
+
+static IRAM_ATTR void timersync_pps_isr(void) {
+    pps_edge_ticks = machtimer_get_timer_counter_value();
+    pps_edge_count++;
+}
+
+/* fits the samples read about as fast as the fastest one, the others waited on the MCU link */
+static void timersync_fit(void) {
+    struct timersync_model_s model = {0};
+    uint32_t rtt_min = UINT32_MAX;
+    uint32_t i, n = 0;
+    double mean_x = 0, mean_y = 0, sxx = 0, sxy = 0, sse = 0;
+    const struct timersync_sample_s *ref = &samples[(samples_next + TIMERSYNC_WINDOW - samples_nb) % TIMERSYNC_WINDOW];
+
+    for (i = 0; i < samples_nb; i++) {
+        if (samples[i].rtt_us < rtt_min) {
+            rtt_min = samples[i].rtt_us;
+        }
+    }
+    for (i = 0; i < samples_nb; i++) {
+        if (samples[i].rtt_us <= rtt_min + TIMERSYNC_RTT_SLACK_US) {
+            mean_x += samples[i].host_us - ref->host_us;
+            mean_y += samples[i].concent_us - ref->concent_us;
+            n++;
+        }
+    }
+    mean_x /= n;
+    mean_y /= n;
+    for (i = 0; i < samples_nb; i++) {
+        if (samples[i].rtt_us <= rtt_min + TIMERSYNC_RTT_SLACK_US) {
+            double dx = samples[i].host_us - ref->host_us - mean_x;
+            double dy = samples[i].concent_us - ref->concent_us - mean_y;
+            sxx += dx * dx;
+            sxy += dx * dy;
+        }
+    }
+
+    model.valid = true;
+    model.ref_host = ref->host_us + mean_x;
+    model.ref_concent = ref->concent_us;
+    model.offset = mean_y;
+    model.slope = (n >= TIMERSYNC_MIN_SAMPLES && sxx > 0) ? sxy / sxx : 1.0;
+    model.samples = n;
+    for (i = 0; i < samples_nb; i++) {
+        if (samples[i].rtt_us <= rtt_min + TIMERSYNC_RTT_SLACK_US) {
+            double err = samples[i].concent_us - model_predict(&model, samples[i].host_us);
+            sse += err * err;
+        }
+    }
+    model.residual_us = sqrt(sse / n);
+
+    pthread_mutex_lock(&mx_timersync);
+    timersync_model = model;
+    pthread_mutex_unlock(&mx_timersync);
+}
+
+static void timersync_sample(void) {
+    struct timersync_sample_s sample;
+    struct timersync_model_s model;
+    uint32_t trigcnt;
+    double t0, t1;
+    int x;
+
+    /* hold the concentrator only for the read, so that a fetch doesn't stretch the sample */
+    pthread_mutex_lock(&mx_concent);
+    t0 = host_time_us();
+    x = lgw_get_trigcnt(&trigcnt);
+    t1 = host_time_us();
+    pthread_mutex_unlock(&mx_concent);
+    if (x != LGW_HAL_SUCCESS) {
+        MSG_WARN("[ts  ] failed to read the concentrator counter\n");
+        return;
+    }
+
+    /* the counter wraps after 71 minutes, the model works on its unwrapped value */
+    sample.host_us = (t0 + t1) / 2;
+    sample.rtt_us = (uint32_t)(t1 - t0);
+    sample.concent_us = (samples_nb == 0) ? trigcnt : last_concent_us + (uint32_t)(trigcnt - last_trigcnt);
+
+    pthread_mutex_lock(&mx_timersync);
+    model = timersync_model;
+    pthread_mutex_unlock(&mx_timersync);
+    if (model.valid && fabs(sample.concent_us - model_predict(&model, sample.host_us)) > TIMERSYNC_STEP_US + sample.rtt_us) {
+        MSG_WARN("[ts  ] concentrator counter jumped, restarting the clock model\n");
+        samples_nb = 0;
+        sample.concent_us = trigcnt;
+    }
+    last_trigcnt = trigcnt;
+    last_concent_us = sample.concent_us;
+
+    samples[samples_next] = sample;
+    samples_next = (samples_next + 1) % TIMERSYNC_WINDOW;
+    if (samples_nb < TIMERSYNC_WINDOW) {
+        samples_nb++;
+    }
+    timersync_fit();
+}
+
+/* names the second of the last PPS edge from the system clock and follows the host rate between edges */
+static void timersync_pps_update(void) {
+    struct timersync_pps_s pps;
+    struct timeval unix_now;
+    uint64_t ticks;
+    uint32_t count;
+    double host_now, host_edge;
+
+    do {
+        count = pps_edge_count;
+        ticks = pps_edge_ticks;
+    } while (count != pps_edge_count);
+
+    pthread_mutex_lock(&mx_timersync);
+    pps = timersync_pps;
+    pthread_mutex_unlock(&mx_timersync);
+
+    host_now = host_time_us();
+    gettimeofday(&unix_now, NULL);
+    if (count == pps.count) {
+        if (pps.locked && host_now - pps.host_us > PPS_MAX_GAP_S * 1E6) {
+            MSG_WARN("[ts  ] PPS lost\n");
+            pps.locked = false;
+        }
+    } else {
+        host_edge = ticks / HOST_TICKS_PER_US;
+        if (pps.count != 0) {
+            double period = host_edge - pps.host_us;
+            double seconds = round(period / 1E6);
+            if (seconds >= 1 && seconds <= PPS_MAX_GAP_S && count - pps.count == seconds &&
+                fabs(period - seconds * 1E6) < PPS_TOLERANCE_US * seconds) {
+                double rate = period / (seconds * 1E6);
+                if (pps.locked) {
+                    pps.jitter_us += (fabs(period - seconds * 1E6 * pps.host_per_us) / seconds - pps.jitter_us) / PPS_RATE_FILTER;
+                    pps.host_per_us += (rate - pps.host_per_us) / PPS_RATE_FILTER;
+                } else {
+                    MSG_INFO("[ts  ] PPS locked\n");
+                    pps.jitter_us = 0;
+                    pps.host_per_us = rate;
+                    pps.locked = true;
+                }
+            } else {
+                if (pps.locked) {
+                    MSG_WARN("[ts  ] PPS glitch, lock lost\n");
+                }
+                pps.locked = false;
+            }
+        }
+        /* the system clock only has to be right within half a second to name it */
+        pps.unix_s = (int64_t)round((timeval_us(&unix_now) - (host_now - host_edge)) / 1E6);
+        pps.host_us = host_edge;
+        pps.count = count;
+    }
+
+    pthread_mutex_lock(&mx_timersync);
+    timersync_pps = pps;
+    pthread_mutex_unlock(&mx_timersync);
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
+/* the unix time given is a recent gettimeofday(), it is placed on the host clock relative to now */
 int get_concentrator_time(struct timeval *concent_time, struct timeval unix_time) {
-    struct timeval local_timeval;
+    struct timersync_model_s model;
+    struct timeval unix_now;
+    double host_now;
+    uint32_t count_us;
 
     if (concent_time == NULL) {
         MSG_ERROR("[ts  ] %s invalid parameter\n", __FUNCTION__);
         return -1;
     }
 
+    host_now = host_time_us();
+    gettimeofday(&unix_now, NULL);
     pthread_mutex_lock(&mx_timersync); /* protect global variable access */
-    timersub(&unix_time, &offset_unix_concent, &local_timeval);
+    model = timersync_model;
     pthread_mutex_unlock(&mx_timersync);
 
-    /* TODO: handle sx1301 coutner wrap-up !! */
-    concent_time->tv_sec = local_timeval.tv_sec;
-    concent_time->tv_usec = local_timeval.tv_usec;
+    if (!model.valid) {
+        /* no sample yet */
+        *concent_time = unix_time;
+        return 0;
+    }
+    count_us = (uint32_t)(int64_t)model_predict(&model, host_now + timeval_us(&unix_time) - timeval_us(&unix_now));
+    concent_time->tv_sec = count_us / 1000000UL;
+    concent_time->tv_usec = count_us - (concent_time->tv_sec * 1000000UL);
     /*
     MSG_DEBUG("[ts  ] --> TIME: unix current time is    (%ld,%ld)[s,us]\n", unix_time.tv_sec, unix_time.tv_usec);
-    MSG_DEBUG("[ts  ]           concent current time is (%ld,%ld)[s,us]\n", local_timeval.tv_sec, local_timeval.tv_usec);
-    MSG_DEBUG("[ts  ]           offset is               (%ld,%ld)[s,us]\n", offset_unix_concent.tv_sec, offset_unix_concent.tv_usec);
+    MSG_DEBUG("[ts  ]           concent current time is (%ld,%ld)[s,us]\n", concent_time->tv_sec, concent_time->tv_usec);
     */
     return 0;
 }
 
-/* ---------------------------------------------------------------------------------------------- */
-/* --- THREAD 6: REGULARLAY MONITOR THE OFFSET BETWEEN UNIX CLOCK AND CONCENTRATOR CLOCK -------- */
+/* the concentrator counter at a UTC time, only precise enough for class B when the PPS is locked */
+int timersync_utc_to_count(struct timeval utc_time, uint32_t *count_us) {
+    struct timersync_model_s model;
+    struct timersync_pps_s pps;
 
-void thread_timersync(void) {
-    MSG_INFO("[ts  ] start\n");
-    struct timeval unix_timeval;
-    struct timeval concentrator_timeval;
-    uint32_t sx1301_timecount = 0;
-    struct timeval offset_previous = {0, 0};
-    struct timeval offset_drift = {0, 0}; /* delta between current and previous offset */
+    pthread_mutex_lock(&mx_timersync);
+    model = timersync_model;
+    pps = timersync_pps;
+    pthread_mutex_unlock(&mx_timersync);
 
-    while (!exit_sig && !quit_sig) {
-        /* Get current unix time */
-        gettimeofday(&unix_timeval, NULL);
+    if (!model.valid || !pps.locked || count_us == NULL) {
+        return -1;
+    }
+    *count_us = (uint32_t)(int64_t)model_predict(&model, pps.host_us + (timeval_us(&utc_time) - pps.unix_s * 1E6) * pps.host_per_us);
+    return 0;
+}
 
-        /* Get current concentrator counter value (1MHz) */
-        lgw_get_trigcnt(&sx1301_timecount);
+void timersync_get_stats(struct timersync_stats_s *stats) {
+    struct timersync_model_s model;
+    struct timersync_pps_s pps;
 
-        concentrator_timeval.tv_sec = sx1301_timecount / 1000000UL;
-        concentrator_timeval.tv_usec = sx1301_timecount - (concentrator_timeval.tv_sec * 1000000UL);
+    pthread_mutex_lock(&mx_timersync);
+    model = timersync_model;
+    pps = timersync_pps;
+    pthread_mutex_unlock(&mx_timersync);
 
-        /* Compute offset between unix and concentrator timers, with microsecond precision */
-        offset_previous.tv_sec = offset_unix_concent.tv_sec;
-        offset_previous.tv_usec = offset_unix_concent.tv_usec;
+    memset(stats, 0, sizeof(*stats));
+    stats->samples = model.samples;
+    stats->residual_us = model.residual_us;
+    stats->drift_ppm = model.valid ? (model.slope - 1.0) * 1E6 : 0;
+    stats->pps_locked = pps.locked;
+    if (pps.locked) {
+        stats->host_drift_ppm = (pps.host_per_us - 1.0) * 1E6;
+        stats->pps_jitter_us = pps.jitter_us;
+    }
+    stats->error_us = sqrt(stats->residual_us * stats->residual_us + stats->pps_jitter_us * stats->pps_jitter_us);
+}
+
+/* timestamps the rising edges of a PPS signal with the machtimer counter */
+int timersync_pps_init(uint32_t gpio) {
+    pin_obj_t *pin = pin_find_pin_by_num(&pin_cpu_pins_locals_dict, gpio);
+    if (pin == NULL) {
+        MSG_ERROR("[ts  ] invalid PPS GPIO %u\n", gpio);
+        return -1;
+    }
+    pin_config(pin, -1, -1, GPIO_MODE_INPUT, MACHPIN_PULL_NONE, 0);
+    pin_irq_disable(pin);
+    pin_extint_register(pin, GPIO_INTR_POSEDGE, 0);
+    machpin_register_irq_c_handler(pin, (void *)timersync_pps_isr);
+    pin_irq_enable(pin);
+    MSG_INFO("[ts  ] PPS input on GPIO %u\n", gpio);
+    return 0;
+}
 
-        pthread_mutex_lock(&mx_timersync); /* protect global variable access */
-        timersub(&unix_timeval, &concentrator_timeval, &offset_unix_concent);
-        pthread_mutex_unlock(&mx_timersync);
+/* ---------------------------------------------------------------------------------------------- */
+/* --- THREAD 6: REGULARLAY MONITOR THE OFFSET BETWEEN UNIX CLOCK AND CONCENTRATOR CLOCK -------- */
 
-        timersub(&offset_unix_concent, &offset_previous, &offset_drift);
+void thread_timersync(void) {
+    MSG_INFO("[ts  ] start\n");
 
-/*
-        MSG_DEBUG("[ts  ] unix_timeval (%ld,%ld)[s,us]\n",
-                  unix_timeval.tv_sec,
-                  unix_timeval.tv_usec);
-        MSG_DEBUG("[ts  ] concentrator (%ld,%ld)[s,us] = %u [us]\n",
-                  concentrator_timeval.tv_sec,
-                  concentrator_timeval.tv_usec,
-                  sx1301_timecount);
-
-        MSG_DEBUG("[ts  ] offset       (%ld,%ld)[s,us], drift=%ld [us]\n",
-            offset_unix_concent.tv_sec,
-            offset_unix_concent.tv_usec,
-            offset_drift.tv_sec * 1000000UL + offset_drift.tv_usec);
-*/
+    while (!exit_sig && !quit_sig) {
+        timersync_sample();
+        timersync_pps_update();
 
-        /* delay next sync */
-        /* If we consider a crystal oscillator precision of about 20ppm worst case, and a clock
-            running at 1MHz, this would mean 1µs drift every 50000µs (10000000/20).
-            As here the time precision is not critical, we should be able to cope with at least 1ms drift,
-            which should occur after 50s (50000µs * 1000).
-            Let's set the thread sleep to 1 minute for now */
-        wait_ms(750);
+        /* a 20 ppm crystal drifts 15 us between two samples, which the regression follows */
+        wait_ms(TIMERSYNC_PERIOD_MS);
     }
     MSG_INFO("[ts  ] end exit=%u quit=%u\n", exit_sig, quit_sig);
 }
@@ -28,13 +28,34 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+#include <stdint.h>      /* C99 types */
+#include <stdbool.h>     /* bool type */
 #include <sys/time.h>    /* timeval */
 
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+struct timersync_stats_s {
+    uint32_t samples;           /* samples of the concentrator counter used by the regression */
+    double residual_us;         /* rms distance of the samples to the regression */
+    double drift_ppm;           /* concentrator clock against the host clock */
+    bool pps_locked;
+    double host_drift_ppm;      /* host clock against the PPS, valid when locked */
+    double pps_jitter_us;
+    double error_us;            /* expected error of a UTC time converted to the concentrator counter */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
 int get_concentrator_time(struct timeval *concent_time, struct timeval unix_time);
 
+int timersync_utc_to_count(struct timeval utc_time, uint32_t *count_us);
+
+void timersync_get_stats(struct timersync_stats_s *stats);
+
+int timersync_pps_init(uint32_t gpio);
+
 void thread_timersync(void);
 
 #endif
@@ -50,6 +50,7 @@ static volatile bool sleep_sockets = false;
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
+static void servers_wait (void);
 
 /******************************************************************************
  DECLARE PUBLIC DATA
@@ -61,8 +62,6 @@ extern TaskHandle_t svTaskHandle;
  DECLARE PUBLIC FUNCTIONS
  ******************************************************************************/
 void TASK_Servers (void *pvParameters) {
-    bool cycle = false;
-
     strcpy (servers_user, SERVERS_DEF_USER);
     strcpy (servers_pass, SERVERS_DEF_PASS);
 
@@ -99,11 +98,8 @@ void TASK_Servers (void *pvParameters) {
             modusocket_close_all_user_sockets();
         }
 
-        if (cycle) {
-            telnet_run();
-        } else {
-            ftp_run();
-        }
+        telnet_run();
+        ftp_run();
 
         if (sleep_sockets) {
 //            pybwdt_srv_sleeping(true);  //  FIXME
@@ -124,9 +120,8 @@ void TASK_Servers (void *pvParameters) {
             mp_hal_reset_safe_and_boot(true);
         }
 
-        // move to the next cycle
-        cycle = cycle ? false : true;
-        vTaskDelay (SERVERS_CYCLE_TIME_MS / portTICK_PERIOD_MS);
+        // sleep until one of the sockets needs attention, or until the servers have to run again
+        servers_wait();
     }
 }
 
@@ -185,6 +180,15 @@ void servers_close_socket (int32_t *sd) {
     }
 }
 
+void servers_fd_set (int32_t sd, fd_set *set, int32_t *maxfd) {
+    if (sd > 0) {
+        FD_SET(sd, set);
+        if (sd > *maxfd) {
+            *maxfd = sd;
+        }
+    }
+}
+
 void servers_set_login (char *user, char *pass) {
     if (strlen(user) > SERVERS_USER_PASS_LEN_MAX || strlen(pass) > SERVERS_USER_PASS_LEN_MAX) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, mpexception_value_invalid_arguments));
@@ -208,3 +212,24 @@ uint32_t servers_get_timeout (void) {
 /******************************************************************************
  DEFINE PRIVATE FUNCTIONS
  ******************************************************************************/
+static void servers_wait (void) {
+    fd_set rfds, wfds;
+    int32_t maxfd = -1;
+
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    uint32_t wait = MIN(telnet_select_fds(&rfds, &wfds, &maxfd), ftp_select_fds(&rfds, &wfds, &maxfd));
+    if (servers_data.do_enable || servers_data.do_disable || servers_data.do_reset || servers_data.reset_and_safe_boot) {
+        wait = 0;
+    }
+
+    if (wait == 0) {
+        // more work is pending, only let the other tasks at this priority run
+        taskYIELD();
+    } else if (maxfd >= 0) {
+        struct timeval tv = { .tv_sec = wait / 1000, .tv_usec = (wait % 1000) * 1000 };
+        select(maxfd + 1, &rfds, &wfds, NULL, &tv);
+    } else {
+        vTaskDelay(wait / portTICK_PERIOD_MS);
+    }
+}
@@ -10,6 +10,8 @@
 #ifndef SERVERSTASK_H_
 #define SERVERSTASK_H_
 
+#include "lwip/sockets.h"
+
 /******************************************************************************
  DEFINE CONSTANTS
  ******************************************************************************/
@@ -23,6 +25,8 @@
 #define SERVERS_USER_PASS_LEN_MAX                   32
 
 #define SERVERS_CYCLE_TIME_MS                       2
+// longest sleep while waiting for socket events, bounds the reaction to the control flags
+#define SERVERS_IDLE_TIME_MS                        50
 
 #define SERVERS_DEF_USER                            "micro"
 #define SERVERS_DEF_PASS                            "python"
@@ -50,6 +54,7 @@ extern void servers_wlan_cycle_power (void);
 extern void servers_reset_and_safe_boot (void);
 extern bool servers_are_enabled (void);
 extern void servers_close_socket (int32_t *sd);
+extern void servers_fd_set (int32_t sd, fd_set *set, int32_t *maxfd);
 extern void servers_set_login (char *user, char *pass);
 extern void server_sleep_sockets (void);
 extern void servers_set_timeout (uint32_t timeout);
@@ -8,6 +8,7 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "py/mpconfig.h"
@@ -26,8 +27,10 @@
 #include "modnetwork.h"
 //#include "modwlan.h"
 #include "modusocket.h"
+#include "mppoll.h"
 //#include "debug.h"
 #include "utils/interrupt_char.h"
+#include "lib/utils/pyexec.h"
 #include "genhdr/mpversion.h"
 
 #include "lwip/sockets.h"
@@ -47,7 +50,14 @@
 #define TELNET_TX_RETRIES_MAX               50
 #define TELNET_WAIT_TIME_MS                 2
 #define TELNET_LOGIN_RETRIES_MAX            3
-#define TELNET_CYCLE_TIME_MS                (SERVERS_CYCLE_TIME_MS * 2)
+// The REPL output is queued in a ring sent by the servers task, a print never waits for the client. Small writes
+// are gathered into large segments, so Nagle is disabled. When the ring is full in the friendly REPL the output is
+// dropped and a note says how much, in the raw REPL, a protocol with the host, the REPL waits for some space.
+// Must be a power of 2
+#define TELNET_TX_BUFFER_SIZE               4096
+// how soon the output queued while the servers task sleeps goes out
+#define TELNET_TX_POLL_MS                   5
+#define TELNET_TX_WAIT_MS                   1000
 
 #define SE 240
 #define AYT 246
@@ -100,7 +110,12 @@ typedef union {
 
 typedef struct {
     uint8_t             *rxBuffer;
+    uint8_t             *txBuffer;
+    volatile uint32_t   txHead;     // written by the REPL under telnet_tx_mux
+    volatile uint32_t   txTail;     // only written by the servers task
+    volatile uint32_t   txDropped;
     uint32_t            timeout;
+    uint32_t            last_run;
     telnet_state_t      state;
     telnet_substate_t   substate;
     int32_t             sd;
@@ -125,6 +140,8 @@ typedef struct {
  DECLARE PRIVATE DATA
  ******************************************************************************/
 static telnet_data_t telnet_data;
+static portMUX_TYPE telnet_tx_mux = portMUX_INITIALIZER_UNLOCKED;
+extern TaskHandle_t svTaskHandle;
 static const char* telnet_welcome_msg       = "MicroPython " MICROPY_GIT_TAG " on " MICROPY_BUILD_DATE "; " MICROPY_HW_BOARD_NAME " with " MICROPY_HW_MCU_NAME "\r\n";
 static const char* telnet_request_user      = "Login as: ";
 static const char* telnet_request_password  = "Password: ";
@@ -144,9 +161,12 @@ static void telnet_send_and_proceed (void *data, int32_t Len, telnet_connected_s
 static telnet_result_t telnet_send_non_blocking (void *data, int32_t Len);
 static telnet_result_t telnet_recv_text_non_blocking (void *buff, int32_t Maxlen, int32_t *rxLen);
 static void telnet_process (void);
+static int32_t telnet_rx_space (void);
 static int telnet_process_credential (char *credential, int32_t rxLen);
 static void telnet_parse_input (uint8_t *str, int32_t *len);
-static bool telnet_send_with_retries (int32_t sd, const void *pBuf, int32_t len);
+static uint32_t telnet_tx_used (void);
+static int32_t telnet_tx_put (const char *str, int32_t len);
+static void telnet_tx_drain (void);
 static void telnet_reset_buffer (void);
 
 /******************************************************************************
@@ -155,11 +175,16 @@ static void telnet_reset_buffer (void);
 void telnet_init (void) {
     // allocate memory for the receive buffer (from the RTOS heap)
     telnet_data.rxBuffer = malloc(TELNET_RX_BUFFER_SIZE);
+    telnet_data.txBuffer = malloc(TELNET_TX_BUFFER_SIZE);
     telnet_data.state = E_TELNET_STE_DISABLED;
 }
 
 void telnet_run (void) {
     int32_t rxLen;
+    uint32_t now = mp_hal_ticks_ms();
+    uint32_t cycle_ms = now - telnet_data.last_run;
+    telnet_data.last_run = now;
+
     switch (telnet_data.state) {
         case E_TELNET_STE_DISABLED:
             telnet_wait_for_enabled();
@@ -251,15 +276,72 @@ void telnet_run (void) {
     }
 
     if (telnet_data.state >= E_TELNET_STE_CONNECTED) {
-        if (telnet_data.timeout++ > (servers_get_timeout() / TELNET_CYCLE_TIME_MS)) {
+        if ((telnet_data.timeout += cycle_ms) > servers_get_timeout()) {
             telnet_reset();
         }
     }
 }
 
+uint32_t telnet_select_fds (fd_set *rfds, fd_set *wfds, int32_t *maxfd) {
+    switch (telnet_data.state) {
+        case E_TELNET_STE_DISABLED:
+            return telnet_data.enabled ? 0 : SERVERS_IDLE_TIME_MS;
+        case E_TELNET_STE_START:
+            // retry creating the listening socket
+            return SERVERS_CYCLE_TIME_MS;
+        case E_TELNET_STE_LISTEN:
+            servers_fd_set(telnet_data.sd, rfds, maxfd);
+            break;
+        case E_TELNET_STE_CONNECTED:
+            if (telnet_data.substate.connected == E_TELNET_STE_SUB_GET_USER ||
+                telnet_data.substate.connected == E_TELNET_STE_SUB_GET_PASSWORD) {
+                servers_fd_set(telnet_data.n_sd, rfds, maxfd);
+            } else {
+                servers_fd_set(telnet_data.n_sd, wfds, maxfd);
+            }
+            break;
+        case E_TELNET_STE_LOGGED_IN:
+            if (telnet_tx_used() > 0) {
+                // wake up as soon as the client takes more
+                servers_fd_set(telnet_data.n_sd, wfds, maxfd);
+            }
+            if (telnet_rx_space() <= 0) {
+                // wait for the REPL to drain the receive buffer
+                return SERVERS_CYCLE_TIME_MS;
+            }
+            servers_fd_set(telnet_data.n_sd, rfds, maxfd);
+            return TELNET_TX_POLL_MS;
+        default:
+            break;
+    }
+    return SERVERS_IDLE_TIME_MS;
+}
+
 void telnet_tx_strn (const char *str, int len) {
     if (telnet_data.n_sd > 0 && telnet_data.state == E_TELNET_STE_LOGGED_IN && len > 0) {
-        telnet_send_with_retries(telnet_data.n_sd, str, len);
+        if (telnet_data.txDropped > 0) {
+            char note[48];
+            int32_t note_len = snprintf(note, sizeof(note), "\r\n[%u bytes of output dropped]\r\n", telnet_data.txDropped);
+            if (TELNET_TX_BUFFER_SIZE - telnet_tx_used() < note_len + len) {
+                // still no room, keep dropping rather than sending pieces
+                telnet_data.txDropped += len;
+                return;
+            }
+            telnet_tx_put(note, note_len);
+            telnet_data.txDropped = 0;
+        }
+
+        int32_t copied = telnet_tx_put(str, len);
+        if (copied < len && pyexec_mode_kind == PYEXEC_MODE_RAW_REPL && xTaskGetCurrentTaskHandle() != svTaskHandle) {
+            for (uint32_t waited = 0; copied < len && waited < TELNET_TX_WAIT_MS &&
+                 telnet_data.state == E_TELNET_STE_LOGGED_IN; waited += TELNET_WAIT_TIME_MS) {
+                mp_hal_delay_ms(TELNET_WAIT_TIME_MS);
+                copied += telnet_tx_put(str + copied, len - copied);
+            }
+        }
+        if (copied < len) {
+            telnet_data.txDropped += len - copied;
+        }
     }
 }
 
@@ -373,7 +455,13 @@ static void telnet_wait_for_connection (void) {
         option |= O_NONBLOCK;
         fcntl(telnet_data.n_sd, F_SETFL, option);
 
+        // the output is gathered by telnet_tx_strn(), no need to wait for more
+        option = 1;
+        setsockopt(telnet_data.n_sd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+
         // client connected, so go on
+        telnet_data.txTail = telnet_data.txHead;
+        telnet_data.txDropped = 0;
         telnet_data.rxWindex = 0;
         telnet_data.rxRindex = 0;
         telnet_data.txRetries = 0;
@@ -424,12 +512,57 @@ static telnet_result_t telnet_recv_text_non_blocking (void *buff, int32_t Maxlen
     return E_TELNET_RESULT_AGAIN;
 }
 
-static void telnet_process (void) {
-    int32_t rxLen;
+static int32_t telnet_rx_space (void) {
     int32_t maxLen = (telnet_data.rxWindex >= telnet_data.rxRindex) ? (TELNET_RX_BUFFER_SIZE - telnet_data.rxWindex) :
                                                                    ((telnet_data.rxRindex - telnet_data.rxWindex) - 1);
     // to avoid an overrrun
-    maxLen = (telnet_data.rxRindex == 0) ? (maxLen - 1) : maxLen;
+    return (telnet_data.rxRindex == 0) ? (maxLen - 1) : maxLen;
+}
+
+static uint32_t telnet_tx_used (void) {
+    return telnet_data.txHead - telnet_data.txTail;
+}
+
+// returns how much of str fits in the ring
+static int32_t telnet_tx_put (const char *str, int32_t len) {
+    portENTER_CRITICAL(&telnet_tx_mux);
+    uint32_t head = telnet_data.txHead;
+    len = MIN(len, TELNET_TX_BUFFER_SIZE - (head - telnet_data.txTail));
+    uint32_t offset = head & (TELNET_TX_BUFFER_SIZE - 1);
+    uint32_t first = MIN(len, TELNET_TX_BUFFER_SIZE - offset);
+    memcpy(telnet_data.txBuffer + offset, str, first);
+    memcpy(telnet_data.txBuffer, str + first, len - first);
+    telnet_data.txHead = head + len;
+    portEXIT_CRITICAL(&telnet_tx_mux);
+    return len;
+}
+
+// sends what the client takes without waiting, in as few segments as possible
+static void telnet_tx_drain (void) {
+    uint32_t tail = telnet_data.txTail;
+    uint32_t used;
+    while ((used = telnet_data.txHead - tail) > 0) {
+        uint32_t offset = tail & (TELNET_TX_BUFFER_SIZE - 1);
+        int32_t sent = send(telnet_data.n_sd, telnet_data.txBuffer + offset, MIN(used, TELNET_TX_BUFFER_SIZE - offset), 0);
+        if (sent <= 0) {
+            if (errno != EAGAIN) {
+                telnet_reset();
+            }
+            break;
+        }
+        tail += sent;
+        telnet_data.txTail = tail;
+    }
+}
+
+static void telnet_process (void) {
+    int32_t rxLen;
+    int32_t maxLen = telnet_rx_space();
+
+    telnet_tx_drain();
+    if (telnet_data.state != E_TELNET_STE_LOGGED_IN) {
+        return;
+    }
 
     if (maxLen > 0) {
         if (E_TELNET_RESULT_OK == telnet_recv_text_non_blocking(&telnet_data.rxBuffer[telnet_data.rxWindex], maxLen, &rxLen)) {
@@ -536,6 +669,7 @@ static void telnet_parse_input (uint8_t *str, int32_t *len) {
             (ch == mp_interrupt_char || ch == CHAR_CTRL_F))) {
             if (ch == mp_interrupt_char) {
                 mp_keyboard_interrupt();
+                mp_poll_wake();
             } else if (ch == CHAR_CTRL_F) {
                 *str++ = CHAR_CTRL_D;
                 mp_hal_reset_safe_and_boot(false);
@@ -551,33 +685,6 @@ static void telnet_parse_input (uint8_t *str, int32_t *len) {
     }
 }
 
-static bool telnet_send_with_retries (int32_t sd, const void *pBuf, int32_t len) {
-    int32_t retries = 0;
-    uint32_t delay = TELNET_WAIT_TIME_MS;
-
-    do {
-        // make it blocking
-        uint32_t option = fcntl(sd, F_GETFL, 0);
-        option &= ~O_NONBLOCK;
-        fcntl(sd, F_SETFL, option);
-        if (send(sd, pBuf, len, 0) > 0) {
-            // make it non-blocking again
-            option |= O_NONBLOCK;
-            fcntl(sd, F_SETFL, option);
-            return true;
-        } else if (EAGAIN != errno) {
-            // make it non-blocking again
-            option |= O_NONBLOCK;
-            fcntl(sd, F_SETFL, option);
-            return false;
-        }
-        // start with the default delay and increment it on each retry
-        mp_hal_delay_ms(delay++);
-    } while (++retries <= TELNET_TX_RETRIES_MAX);
-
-    return false;
-}
-
 static void telnet_reset_buffer (void) {
     // erase any characters present in the current line
     memset (telnet_data.rxBuffer, '\b', TELNET_RX_BUFFER_SIZE / 2);
@@ -10,11 +10,14 @@
 #ifndef TELNET_H_
 #define TELNET_H_
 
+#include "lwip/sockets.h"
+
 /******************************************************************************
  DECLARE EXPORTED FUNCTIONS
  ******************************************************************************/
 extern void telnet_init (void);
 extern void telnet_run (void);
+extern uint32_t telnet_select_fds (fd_set *rfds, fd_set *wfds, int32_t *maxfd);
 extern void telnet_tx_strn (const char *str, int len);
 extern bool telnet_rx_any (void);
 extern int  telnet_rx_char (void);
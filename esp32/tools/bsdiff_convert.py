@@ -0,0 +1,169 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2021, Pycom Limited.
+#
+# This software is licensed under the GNU GPL version 3 or any
+# later version, with permitted additional terms. For more information
+# see the Pycom Licence v1.0 document supplied with this file, or
+# available at https://www.pycom.io/opensource/licensing
+#
+
+# Converts a bsdiff patch ("BSDIFF40", bzip2 blocks) into the zlib ("BSDIFFZ0") or heatshrink ("BSDIFFH0") variants
+# accepted by the updater. Both only need a small window per block while patching, so they can be applied on boards
+# without PSRAM. heatshrink patches are larger but are the fastest to apply.
+
+import argparse
+import bz2
+import struct
+import zlib
+
+HEADER_LEN = 32
+
+# Must match UPDATER_HEATSHRINK_WINDOW_BITS and UPDATER_HEATSHRINK_LOOKAHEAD_BITS in ftp/updater.c
+HS_WINDOW_BITS = 10
+HS_LOOKAHEAD_BITS = 5
+HS_MIN_MATCH = 2        # A back-reference is only shorter than literals from 2 bytes
+HS_MAX_CHAIN = 32       # Candidates compared for each position
+
+
+def offtin(buf):
+    y = struct.unpack('<Q', buf)[0]
+    if y & (1 << 63):
+        y = -(y & ~(1 << 63))
+    return y
+
+
+def offtout(x):
+    if x < 0:
+        x = -x | (1 << 63)
+    return struct.pack('<Q', x)
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.byte = 0
+        self.count = 0
+
+    def write(self, value, bits):
+        for i in range(bits - 1, -1, -1):
+            self.byte = (self.byte << 1) | ((value >> i) & 1)
+            self.count += 1
+            if self.count == 8:
+                self.out.append(self.byte)
+                self.byte = 0
+                self.count = 0
+
+    def flush(self):
+        if self.count:
+            self.out.append(self.byte << (8 - self.count))
+        return bytes(self.out)
+
+
+def compress_zlib(data, wbits):
+    c = zlib.compressobj(9, zlib.DEFLATED, wbits)
+    return c.compress(data) + c.flush()
+
+
+def compress_heatshrink(data):
+    # Greedy LZSS in the heatshrink format: tag bit 1 + 8 bits literal, or
+    # tag bit 0 + (offset - 1) in HS_WINDOW_BITS bits + (length - 1) in HS_LOOKAHEAD_BITS bits
+    window = 1 << HS_WINDOW_BITS
+    max_len = 1 << HS_LOOKAHEAD_BITS
+    chains = {}
+    bw = BitWriter()
+    pos = 0
+
+    def insert(p):
+        if p + HS_MIN_MATCH <= len(data):
+            chains.setdefault(data[p:p + HS_MIN_MATCH], []).append(p)
+
+    while pos < len(data):
+        best_len, best_off = 0, 0
+        for cand in reversed(chains.get(data[pos:pos + HS_MIN_MATCH], [])[-HS_MAX_CHAIN:]):
+            if pos - cand > window:
+                break
+            n = 0
+            while n < max_len and pos + n < len(data) and data[cand + n] == data[pos + n]:
+                n += 1
+            if n > best_len:
+                best_len, best_off = n, pos - cand
+                if n == max_len:
+                    break
+        if best_len >= HS_MIN_MATCH:
+            bw.write(0, 1)
+            bw.write(best_off - 1, HS_WINDOW_BITS)
+            bw.write(best_len - 1, HS_LOOKAHEAD_BITS)
+        else:
+            best_len = 1
+            bw.write(1, 1)
+            bw.write(data[pos], 8)
+        for p in range(pos, pos + best_len):
+            insert(p)
+        pos += best_len
+    return bw.flush()
+
+
+def decompress_heatshrink(data, size):
+    # Mirror of the decoder in ftp/updater.c, used to verify the conversion
+    bits = ''.join('{:08b}'.format(b) for b in data)
+    out = bytearray()
+    i = 0
+    while len(out) < size:
+        if bits[i] == '1':
+            out.append(int(bits[i + 1:i + 9], 2))
+            i += 9
+        else:
+            off = int(bits[i + 1:i + 1 + HS_WINDOW_BITS], 2) + 1
+            n = int(bits[i + 1 + HS_WINDOW_BITS:i + 1 + HS_WINDOW_BITS + HS_LOOKAHEAD_BITS], 2) + 1
+            i += 1 + HS_WINDOW_BITS + HS_LOOKAHEAD_BITS
+            for _ in range(n):
+                # Bytes before the start of the stream come from the zeroed window
+                out.append(out[-off] if off <= len(out) else 0)
+    return bytes(out[:size])
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Converts a BSDIFF40 patch to the BSDIFFZ0 or BSDIFFH0 format')
+    parser.add_argument('patch', help='bsdiff patch file (BSDIFF40)')
+    parser.add_argument('output', help='Output patch file')
+    parser.add_argument('--format', default='zlib', choices=('zlib', 'heatshrink'),
+                        help='Compression of the output blocks (default: zlib)')
+    parser.add_argument('--wbits', type=int, default=12, choices=range(9, 16),
+                        help='zlib window bits (zlib format only), the board allocates 2^wbits bytes per block (default: 12)')
+    args = parser.parse_args()
+
+    with open(args.patch, 'rb') as f:
+        patch = f.read()
+
+    if patch[:8] != b'BSDIFF40':
+        raise SystemExit('Not a BSDIFF40 patch')
+
+    ctrllen = offtin(patch[8:16])
+    datalen = offtin(patch[16:24])
+    newsize = offtin(patch[24:32])
+    blocks = (patch[HEADER_LEN:HEADER_LEN + ctrllen],
+              patch[HEADER_LEN + ctrllen:HEADER_LEN + ctrllen + datalen],
+              patch[HEADER_LEN + ctrllen + datalen:])
+    blocks = [bz2.decompress(b) for b in blocks]
+    if args.format == 'heatshrink':
+        magic = b'BSDIFFH0'
+        compressed = [compress_heatshrink(b) for b in blocks]
+        for b, c in zip(blocks, compressed):
+            if decompress_heatshrink(c, len(b)) != b:
+                raise SystemExit('heatshrink verification failed')
+        blocks = compressed
+    else:
+        magic = b'BSDIFFZ0'
+        blocks = [compress_zlib(b, args.wbits) for b in blocks]
+
+    with open(args.output, 'wb') as f:
+        f.write(magic + offtout(len(blocks[0])) + offtout(len(blocks[1])) + offtout(newsize))
+        for b in blocks:
+            f.write(b)
+
+    print('%s: %d bytes -> %s: %d bytes' % (args.patch, len(patch), args.output, sum(len(b) for b in blocks) + HEADER_LEN))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+// replaces esp32/lora/board.h for the host build, without the MicroPython,
+// FreeRTOS and SX127x dependencies of the real one. Same guard, so that
+// the real one is skipped when forced in ahead of esp32/lora/utilities.c
+
+#ifndef LORA_BOARD_H_
+#define LORA_BOARD_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "esp_attr.h"
+
+// the MAC runs from a single thread of the simulator
+#define MICROPY_BEGIN_ATOMIC_SECTION()              (0)
+#define MICROPY_END_ATOMIC_SECTION(state)           (void)(state)
+
+#include "lora/system/timer.h"
+#include "radio.h"
+#include "timer-board.h"
+#include "utilities.h"
+
+#define USE_MODEM_LORA
+
+// as in the SX1272 and SX1276 drivers
+#define RADIO_WAKEUP_TIME                           1 // [ms]
+
+#endif // LORA_BOARD_H_
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef LORA_SIM_ESP_ATTR_H_
+#define LORA_SIM_ESP_ATTR_H_
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#endif // LORA_SIM_ESP_ATTR_H_
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+// the part of esp32/mods/modlora.h used by the MAC and the timers
+
+#ifndef LORA_SIM_MODLORA_H_
+#define LORA_SIM_MODLORA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_attr.h"
+
+typedef enum {
+    E_LORA_NVS_ELE_JOINED = 0,
+    E_LORA_NVS_ELE_UPLINK,
+    E_LORA_NVS_ELE_DWLINK,
+    E_LORA_NVS_ELE_DEVADDR,
+    E_LORA_NVS_ELE_NWSKEY,
+    E_LORA_NVS_ELE_APPSKEY,
+    E_LORA_NVS_ELE_NET_ID,
+    E_LORA_NVS_ELE_ADR_ACKS,
+    E_LORA_NVS_ELE_MAC_PARAMS,
+    E_LORA_NVS_ELE_CHANNELS,
+    E_LORA_NVS_ELE_ACK_REQ,
+    E_LORA_NVS_MAC_NXT_TX,
+    E_LORA_NVS_MAC_CMD_BUF_IDX,
+    E_LORA_NVS_MAC_CMD_BUF_RPT_IDX,
+    E_LORA_NVS_ELE_MAC_BUF,
+    E_LORA_NVS_ELE_MAC_RPT_BUF,
+    E_LORA_NVS_ELE_REGION,
+    E_LORA_NVS_ELE_CHANNELMASK,
+    E_LORA_NVS_ELE_CHANNELMASK_REMAINING,
+    E_LORA_NVS_NUM_KEYS
+} e_lora_nvs_key_t;
+
+typedef void ( *modlora_timerCallback )( void );
+
+extern bool modlora_nvs_set_uint(uint32_t key_idx, uint32_t value);
+extern bool modlora_nvs_set_blob(uint32_t key_idx, const void *value, uint32_t length);
+extern bool modlora_nvs_set_counter(uint32_t key_idx, uint32_t value, bool reserve);
+extern void modlora_set_timer_callback(modlora_timerCallback cb);
+
+#endif // LORA_SIM_MODLORA_H_
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef LORA_SIM_H_
+#define LORA_SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+typedef void (*sim_event_cb_t)(void *arg);
+
+typedef struct {
+    uint32_t alarm_starts;          // TimerHwStartAt(), the alarm moved to a new first deadline
+    uint32_t alarm_stops;           // TimerHwStop(), no timer queued anymore
+    uint32_t alarm_fires;
+    uint32_t timer_callbacks;       // the MAC timers expired
+    uint32_t nvs_writes;
+    uint64_t mac_ns;                // CPU time spent in the MAC, its timers and the radio events
+} sim_stats_t;
+
+typedef struct {
+    uint32_t sent;
+    uint32_t lost;                  // overlapped on air by another one on the same channel and SF
+    uint64_t airtime_us;
+} sim_air_stats_t;
+
+/******************************************************************************
+ DECLARE PUBLIC DATA
+ ******************************************************************************/
+extern sim_stats_t sim_stats;
+
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+// virtual clock and events, sim_clock.c
+uint64_t sim_now_us(void);
+void sim_schedule(uint64_t at_us, sim_event_cb_t cb, void *arg);
+void sim_run_until(uint64_t limit_us);
+void sim_mac_enter(void);
+void sim_mac_exit(void);
+
+// radio, air and gateway, sim_radio.c
+void sim_seed(uint64_t seed);
+uint32_t sim_rand(void);
+uint32_t sim_time_on_air_us(uint8_t sf, uint32_t bw_hz, uint8_t size);
+void sim_air_reset(void);
+void sim_gateway_session(uint32_t devaddr, const uint8_t *nwkskey);
+void sim_nodes_add(uint32_t count, uint32_t interval_ms, uint8_t sf, uint8_t size, const uint32_t *channels, uint32_t nchannels, uint64_t until_us);
+void sim_air_stats(sim_air_stats_t *node, sim_air_stats_t *others, uint32_t *acks);
+
+#endif // LORA_SIM_H_
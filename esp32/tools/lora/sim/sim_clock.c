@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "board.h"
+#include "modlora.h"
+#include "sim.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define SIM_CALLBACKS_MAX                   16
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+typedef struct {
+    uint64_t at;
+    uint64_t seq;                   // the events due at the same time run in the order they were scheduled
+    sim_event_cb_t cb;
+    void *arg;
+} sim_event_t;
+
+/******************************************************************************
+ DECLARE PUBLIC DATA
+ ******************************************************************************/
+sim_stats_t sim_stats;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+static uint64_t sim_now;
+static uint64_t sim_alarm;
+static bool sim_alarm_armed;
+
+static sim_event_t *sim_events;
+static uint32_t sim_events_count;
+static uint32_t sim_events_size;
+static uint64_t sim_events_seq;
+
+// the timers expired, run after TimerIrqHandler() as the LoRa task does on the board
+static modlora_timerCallback sim_callbacks[SIM_CALLBACKS_MAX];
+static uint32_t sim_callbacks_count;
+
+static struct timespec sim_mac_start;
+static uint32_t sim_mac_depth;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+static bool sim_event_before(const sim_event_t *a, const sim_event_t *b) {
+    return (a->at < b->at) || ((a->at == b->at) && (a->seq < b->seq));
+}
+
+static void sim_event_pop(sim_event_t *event) {
+    *event = sim_events[0];
+    sim_event_t last = sim_events[--sim_events_count];
+    uint32_t index = 0;
+    for (;;) {
+        uint32_t child = (index * 2) + 1;
+        if (child >= sim_events_count) {
+            break;
+        }
+        if ((child + 1 < sim_events_count) && sim_event_before(&sim_events[child + 1], &sim_events[child])) {
+            child++;
+        }
+        if (!sim_event_before(&sim_events[child], &last)) {
+            break;
+        }
+        sim_events[index] = sim_events[child];
+        index = child;
+    }
+    sim_events[index] = last;
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+uint64_t sim_now_us(void) {
+    return sim_now;
+}
+
+void sim_schedule(uint64_t at_us, sim_event_cb_t cb, void *arg) {
+    if (sim_events_count == sim_events_size) {
+        sim_events_size = sim_events_size ? (sim_events_size * 2) : 64;
+        sim_events = realloc(sim_events, sim_events_size * sizeof(sim_event_t));
+        if (sim_events == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    sim_event_t event = { .at = (at_us < sim_now) ? sim_now : at_us, .seq = sim_events_seq++, .cb = cb, .arg = arg };
+    uint32_t index = sim_events_count++;
+    while (index > 0) {
+        uint32_t parent = (index - 1) / 2;
+        if (!sim_event_before(&event, &sim_events[parent])) {
+            break;
+        }
+        sim_events[index] = sim_events[parent];
+        index = parent;
+    }
+    sim_events[index] = event;
+}
+
+// runs the events and the expired timers in time order up to limit_us, the clock is left there
+void sim_run_until(uint64_t limit_us) {
+    for (;;) {
+        bool alarm = sim_alarm_armed && (sim_events_count == 0 || sim_alarm <= sim_events[0].at);
+        uint64_t next = alarm ? sim_alarm : (sim_events_count ? sim_events[0].at : UINT64_MAX);
+        if (next > limit_us) {
+            break;
+        }
+        if (next > sim_now) {
+            sim_now = next;
+        }
+        if (alarm) {
+            sim_alarm_armed = false;
+            sim_stats.alarm_fires++;
+            sim_mac_enter();
+            TimerIrqHandler();
+            for (uint32_t i = 0; i < sim_callbacks_count; i++) {
+                sim_callbacks[i]();
+            }
+            sim_callbacks_count = 0;
+            sim_mac_exit();
+        } else {
+            sim_event_t event;
+            sim_event_pop(&event);
+            event.cb(event.arg);
+        }
+    }
+    if (limit_us > sim_now) {
+        sim_now = limit_us;
+    }
+}
+
+// the nested calls are only counted once
+void sim_mac_enter(void) {
+    if (sim_mac_depth++ == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &sim_mac_start);
+    }
+}
+
+void sim_mac_exit(void) {
+    if (--sim_mac_depth == 0) {
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        sim_stats.mac_ns += (uint64_t)((end.tv_sec - sim_mac_start.tv_sec) * 1000000000LL + (end.tv_nsec - sim_mac_start.tv_nsec));
+    }
+}
+
+/******************************************************************************
+ TIMER BOARD, the virtual clock in place of esp32/lora/timer-board.c
+ ******************************************************************************/
+uint64_t TimerHwGetTimeUs(void) {
+    return sim_now;
+}
+
+TimerTime_t TimerHwGetTime(void) {
+    return (TimerTime_t)(sim_now / 1000);
+}
+
+void TimerHwStartAt(uint64_t deadline) {
+    sim_stats.alarm_starts++;
+    sim_alarm = deadline;
+    sim_alarm_armed = true;
+}
+
+void TimerHwStop(void) {
+    sim_stats.alarm_stops++;
+    sim_alarm_armed = false;
+}
+
+TimerTime_t TimerHwComputeTimeDifference(TimerTime_t eventInTime) {
+    return TimerHwGetTime() - eventInTime;
+}
+
+void TimerHwEnterLowPowerStopMode(void) {
+}
+
+/******************************************************************************
+ MODLORA, what the MAC needs from esp32/mods/modlora.c
+ ******************************************************************************/
+void modlora_set_timer_callback(modlora_timerCallback cb) {
+    sim_stats.timer_callbacks++;
+    if (sim_callbacks_count < SIM_CALLBACKS_MAX) {
+        sim_callbacks[sim_callbacks_count++] = cb;
+    }
+}
+
+bool modlora_nvs_set_uint(uint32_t key_idx, uint32_t value) {
+    sim_stats.nvs_writes++;
+    return true;
+}
+
+bool modlora_nvs_set_blob(uint32_t key_idx, const void *value, uint32_t length) {
+    sim_stats.nvs_writes++;
+    return true;
+}
+
+bool modlora_nvs_set_counter(uint32_t key_idx, uint32_t value, bool reserve) {
+    sim_stats.nvs_writes++;
+    return true;
+}
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+// Runs the LoRaWAN MAC of lib/lora against a simulated radio and clock. The scenarios
+// print the same lines on every host for a given seed, "lorasim check" compares them with
+// lorasim.exp, "lorasim bench" adds the CPU time spent in the MAC.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "board.h"
+#include "LoRaMac.h"
+#include "LoRaMacTest.h"
+#include "region/Region.h"
+#include "sim.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define SIM_SEED                            0x5EED1234ULL
+#define SIM_DEVADDR                         0x26011234
+#define SIM_CHANNELS_MAX                    72
+#define SIM_SELECTIONS                      100000
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+typedef struct {
+    const char *name;
+    LoRaMacRegion_t region;
+    int8_t datarate;
+    bool confirmed;
+    uint8_t size;
+    uint32_t uplinks;
+    uint32_t interval_ms;
+    // the other nodes, on the default channels of the region with the SF of the datarate
+    uint32_t nodes;
+    uint32_t nodes_interval_ms;
+    uint8_t nodes_sf;
+    uint8_t nodes_size;
+} sim_scenario_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+static const uint8_t sim_nwkskey[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+static const uint8_t sim_appskey[16] = { 0x3C, 0x4F, 0xCF, 0x09, 0x88, 0x15, 0xF7, 0xAB, 0xA6, 0xD2, 0xAE, 0x28, 0x16, 0x15, 0x7E, 0x2B };
+
+static const uint32_t sim_eu868_channels[] = { 868100000, 868300000, 868500000 };
+
+static const sim_scenario_t sim_scenarios[] = {
+    { "eu868-unconfirmed",      LORAMAC_REGION_EU868, DR_5, false, 12, 1000, 10000,   0,     0, 0,  0 },
+    { "eu868-confirmed",        LORAMAC_REGION_EU868, DR_5, true,  12,  200, 10000,   0,     0, 0,  0 },
+    { "eu868-sf12-unconfirmed", LORAMAC_REGION_EU868, DR_0, false, 12,  100, 60000,   0,     0, 0,  0 },
+    { "us915-unconfirmed",      LORAMAC_REGION_US915, DR_0, false, 11,  720, 10000,   0,     0, 0,  0 },
+    { "eu868-200-nodes",        LORAMAC_REGION_EU868, DR_5, false, 12,   60, 60000, 200, 60000, 7, 20 },
+    { "eu868-1000-nodes",       LORAMAC_REGION_EU868, DR_5, false, 12,   60, 60000, 1000, 60000, 7, 20 },
+    { "eu868-1000-nodes-confirmed", LORAMAC_REGION_EU868, DR_5, true, 12, 60, 60000, 1000, 60000, 7, 20 },
+};
+
+static const sim_scenario_t *sim_scenario;
+
+static LoRaMacPrimitives_t sim_primitives;
+static LoRaMacCallback_t sim_callbacks;
+
+static struct {
+    uint8_t payload[64];
+    uint64_t until;
+    uint32_t requested;
+    uint32_t busy;
+    uint32_t confirmed;
+    uint32_t acked;
+    uint32_t retries;
+    uint32_t indications;
+    uint32_t channels[SIM_CHANNELS_MAX];
+} sim_app;
+
+static bool sim_bench;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+static void sim_mcps_confirm(McpsConfirm_t *confirm) {
+    if (confirm->Status == LORAMAC_EVENT_INFO_STATUS_OK) {
+        sim_app.confirmed++;
+    }
+    if (confirm->AckReceived) {
+        sim_app.acked++;
+    }
+    if (confirm->McpsRequest == MCPS_CONFIRMED && confirm->NbRetries > 1) {
+        sim_app.retries += confirm->NbRetries - 1;
+    }
+    if (confirm->Channel < SIM_CHANNELS_MAX) {
+        sim_app.channels[confirm->Channel]++;
+    }
+}
+
+static void sim_mcps_indication(McpsIndication_t *indication) {
+    sim_app.indications++;
+}
+
+static void sim_mlme_confirm(MlmeConfirm_t *confirm) {
+}
+
+static void sim_mlme_indication(MlmeIndication_t *indication) {
+}
+
+static uint8_t sim_battery_level(void) {
+    return 255;
+}
+
+static void sim_mib_set(MibRequestConfirm_t *mib) {
+    if (LoRaMacMibSetRequestConfirm(mib) != LORAMAC_STATUS_OK) {
+        fprintf(stderr, "MIB %d refused\n", mib->Type);
+        exit(1);
+    }
+}
+
+// as modlora.c with an ABP activation
+static void sim_mac_init(LoRaMacRegion_t region) {
+    MibRequestConfirm_t mib;
+
+    sim_primitives.MacMcpsConfirm = sim_mcps_confirm;
+    sim_primitives.MacMcpsIndication = sim_mcps_indication;
+    sim_primitives.MacMlmeConfirm = sim_mlme_confirm;
+    sim_primitives.MacMlmeIndication = sim_mlme_indication;
+    sim_callbacks.GetBatteryLevel = sim_battery_level;
+    if (LoRaMacInitialization(&sim_primitives, &sim_callbacks, region) != LORAMAC_STATUS_OK) {
+        fprintf(stderr, "region %d not supported\n", region);
+        exit(1);
+    }
+
+    mib.Type = MIB_ADR;
+    mib.Param.AdrEnable = false;
+    sim_mib_set(&mib);
+    mib.Type = MIB_PUBLIC_NETWORK;
+    mib.Param.EnablePublicNetwork = true;
+    sim_mib_set(&mib);
+    mib.Type = MIB_DEVICE_CLASS;
+    mib.Param.Class = CLASS_A;
+    sim_mib_set(&mib);
+    LoRaMacTestSetDutyCycleOn(false);
+
+    mib.Type = MIB_NETWORK_ACTIVATION;
+    mib.Param.NetworkActivation = ACTIVATION_TYPE_ABP;
+    sim_mib_set(&mib);
+    mib.Type = MIB_NET_ID;
+    mib.Param.NetID = 0;
+    sim_mib_set(&mib);
+    mib.Type = MIB_DEV_ADDR;
+    mib.Param.DevAddr = SIM_DEVADDR;
+    sim_mib_set(&mib);
+    mib.Type = MIB_NWK_SKEY;
+    mib.Param.NwkSKey = (uint8_t *)sim_nwkskey;
+    sim_mib_set(&mib);
+    mib.Type = MIB_APP_SKEY;
+    mib.Param.AppSKey = (uint8_t *)sim_appskey;
+    sim_mib_set(&mib);
+    mib.Type = MIB_NETWORK_JOINED;
+    mib.Param.IsNetworkJoined = true;
+    sim_mib_set(&mib);
+    mib.Type = MIB_UPLINK_COUNTER;
+    mib.Param.UpLinkCounter = 0;
+    sim_mib_set(&mib);
+    mib.Type = MIB_DOWNLINK_COUNTER;
+    mib.Param.DownLinkCounter = 0;
+    sim_mib_set(&mib);
+
+    sim_gateway_session(SIM_DEVADDR, sim_nwkskey);
+}
+
+static void sim_app_uplink(void *arg) {
+    McpsReq_t req;
+    if (sim_scenario->confirmed) {
+        req.Type = MCPS_CONFIRMED;
+        req.Req.Confirmed.fPort = 1;
+        req.Req.Confirmed.fBuffer = sim_app.payload;
+        req.Req.Confirmed.fBufferSize = sim_scenario->size;
+        req.Req.Confirmed.NbTrials = 3;
+        req.Req.Confirmed.Datarate = sim_scenario->datarate;
+    } else {
+        req.Type = MCPS_UNCONFIRMED;
+        req.Req.Unconfirmed.fPort = 1;
+        req.Req.Unconfirmed.fBuffer = sim_app.payload;
+        req.Req.Unconfirmed.fBufferSize = sim_scenario->size;
+        req.Req.Unconfirmed.Datarate = sim_scenario->datarate;
+    }
+    sim_app.payload[0] = sim_app.requested;
+
+    sim_mac_enter();
+    LoRaMacStatus_t status = LoRaMacMcpsRequest(&req);
+    sim_mac_exit();
+    if (status == LORAMAC_STATUS_OK) {
+        sim_app.requested++;
+    } else {
+        sim_app.busy++;
+    }
+
+    uint64_t next = sim_now_us() + (uint64_t)sim_scenario->interval_ms * 1000;
+    if (next < sim_app.until) {
+        sim_schedule(next, sim_app_uplink, NULL);
+    }
+}
+
+static double sim_seconds(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void sim_run_scenario(const sim_scenario_t *scenario) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    sim_scenario = scenario;
+    sim_seed(SIM_SEED);
+    sim_air_reset();
+    memset(&sim_app, 0, sizeof(sim_app));
+    sim_mac_init(scenario->region);
+    memset(&sim_stats, 0, sizeof(sim_stats));
+
+    uint64_t begin = sim_now_us();
+    sim_app.until = begin + (uint64_t)scenario->uplinks * scenario->interval_ms * 1000;
+    sim_schedule(begin, sim_app_uplink, NULL);
+    if (scenario->nodes > 0) {
+        sim_nodes_add(scenario->nodes, scenario->nodes_interval_ms, scenario->nodes_sf, scenario->nodes_size,
+                      sim_eu868_channels, sizeof(sim_eu868_channels) / sizeof(sim_eu868_channels[0]), sim_app.until);
+    }
+    // time for the last one to be confirmed, retransmissions included
+    sim_run_until(sim_app.until + 60 * 1000000ULL);
+
+    sim_air_stats_t node, others;
+    uint32_t acks;
+    sim_air_stats(&node, &others, &acks);
+
+    uint32_t used = 0, min = UINT32_MAX, max = 0;
+    for (uint32_t i = 0; i < SIM_CHANNELS_MAX; i++) {
+        if (sim_app.channels[i]) {
+            used++;
+            min = MIN(min, sim_app.channels[i]);
+            max = MAX(max, sim_app.channels[i]);
+        }
+    }
+
+    printf("%s\n", scenario->name);
+    printf("  uplinks %u busy %u confirmed %u acked %u retries %u downlinks %u\n", sim_app.requested, sim_app.busy,
+           sim_app.confirmed, sim_app.acked, sim_app.retries, sim_app.indications);
+    printf("  channels %u min %u max %u\n", used, used ? min : 0, max);
+    printf("  air sent %u lost %u airtime %llu ms, others sent %u lost %u, acks %u\n", node.sent, node.lost,
+           (unsigned long long)(node.airtime_us / 1000), others.sent, others.lost, acks);
+    printf("  alarm starts %u stops %u fires %u, timer callbacks %u, nvs writes %u\n", sim_stats.alarm_starts,
+           sim_stats.alarm_stops, sim_stats.alarm_fires, sim_stats.timer_callbacks, sim_stats.nvs_writes);
+    if (sim_bench) {
+        uint32_t frames = node.sent ? node.sent : 1;
+        printf("  bench: %.0f ns MAC CPU per frame sent, %.3f s to simulate %llu s\n", (double)sim_stats.mac_ns / frames,
+               sim_seconds(&start), (unsigned long long)((sim_now_us() - begin) / 1000000));
+    }
+}
+
+// the channel drawn for each uplink, the whole plan of the region enabled
+static void sim_run_selection(const char *name, LoRaMacRegion_t region, int8_t datarate) {
+    uint32_t counts[SIM_CHANNELS_MAX] = { 0 };
+    NextChanParams_t params = { .AggrTimeOff = 0, .LastAggrTx = 0, .Datarate = datarate, .Joined = true, .DutyCycleEnabled = false };
+    struct timespec start;
+
+    srand1(SIM_SEED);
+    RegionInitDefaults(region, INIT_TYPE_INIT);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < SIM_SELECTIONS; i++) {
+        uint8_t channel;
+        TimerTime_t time, aggregated;
+        if (RegionNextChannel(region, &params, &channel, &time, &aggregated) && (channel < SIM_CHANNELS_MAX)) {
+            counts[channel]++;
+        }
+    }
+    double elapsed = sim_seconds(&start);
+
+    uint32_t used = 0, min = UINT32_MAX, max = 0;
+    for (uint32_t i = 0; i < SIM_CHANNELS_MAX; i++) {
+        if (counts[i]) {
+            used++;
+            min = MIN(min, counts[i]);
+            max = MAX(max, counts[i]);
+        }
+    }
+    printf("%s\n", name);
+    printf("  selections %u channels %u min %u max %u\n", SIM_SELECTIONS, used, used ? min : 0, max);
+    if (sim_bench) {
+        printf("  bench: %.0f ns per RegionNextChannel()\n", elapsed * 1e9 / SIM_SELECTIONS);
+    }
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+int main(int argc, char **argv) {
+    const char *only = NULL;
+    if ((argc < 2) || (strcmp(argv[1], "check") && strcmp(argv[1], "bench"))) {
+        fprintf(stderr, "usage: %s check|bench [scenario]\n", argv[0]);
+        return 2;
+    }
+    sim_bench = !strcmp(argv[1], "bench");
+    if (argc > 2) {
+        only = argv[2];
+    }
+
+    for (uint32_t i = 0; i < sizeof(sim_scenarios) / sizeof(sim_scenarios[0]); i++) {
+        if (!only || !strcmp(only, sim_scenarios[i].name)) {
+            sim_run_scenario(&sim_scenarios[i]);
+        }
+    }
+    if (!only || !strcmp(only, "eu868-selection")) {
+        sim_run_selection("eu868-selection", LORAMAC_REGION_EU868, DR_5);
+    }
+    if (!only || !strcmp(only, "us915-selection")) {
+        sim_run_selection("us915-selection", LORAMAC_REGION_US915, DR_0);
+    }
+    return 0;
+}
@@ -0,0 +1,538 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "board.h"
+#include "LoRaMac.h"
+#include "LoRaMacCrypto.h"
+#include "sim.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define SIM_NODE_SELF                       0
+
+// the longest frame on air is below 3 s (SF12, 125 kHz, 255 bytes takes 9 s but the regions stop at 51)
+#define SIM_AIR_KEEP_US                     (10 * 1000000ULL)
+
+#define SIM_RECEIVE_DELAY1_US               (1000 * 1000ULL)
+
+#define SIM_FRAME_TYPE_DATA_UNCONFIRMED_UP  0x02
+#define SIM_FRAME_TYPE_DATA_CONFIRMED_UP    0x04
+#define SIM_FRAME_TYPE_DATA_UNCONFIRMED_DOWN 0x03
+#define SIM_FCTRL_ACK                       0x20
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint32_t freq;
+    uint32_t node;
+    uint8_t sf;
+    uint8_t size;
+    uint8_t payload[];              // only kept for the frames of the MAC
+} sim_packet_t;
+
+struct sim_nodes_s;
+
+typedef struct {
+    uint32_t node;
+    struct sim_nodes_s *group;
+} sim_node_t;
+
+typedef struct sim_nodes_s {
+    struct sim_nodes_s *next;
+    uint64_t until;
+    uint32_t interval_ms;
+    uint32_t nchannels;
+    uint32_t channels[16];
+    uint8_t sf;
+    uint8_t size;
+    sim_node_t nodes[];
+} sim_nodes_t;
+
+typedef struct {
+    uint64_t start;
+    uint32_t freq;
+    uint8_t sf;
+    uint8_t size;
+    uint8_t data[16];
+} sim_downlink_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+static uint64_t sim_random_state = 1;
+
+static struct {
+    RadioEvents_t *events;
+    RadioState_t state;
+    RadioModems_t modem;
+    uint32_t freq;
+    uint32_t op;                    // the events of an operation cancelled since are ignored
+    uint32_t tx_bw;
+    uint32_t tx_datarate;
+    uint8_t tx_coderate;
+    uint16_t tx_preamble;
+    bool tx_crc;
+    uint32_t rx_bw;
+    uint32_t rx_datarate;
+    uint16_t rx_symbols;
+    bool rx_continuous;
+    uint8_t rx_size;
+    uint8_t rx_buffer[16];
+} sim_radio;
+
+static sim_packet_t **sim_air;
+static uint32_t sim_air_count;
+static uint32_t sim_air_size;
+static sim_air_stats_t sim_air_self;
+static sim_air_stats_t sim_air_others;
+
+static sim_nodes_t *sim_nodes;
+static uint32_t sim_node_count;
+
+static struct {
+    uint32_t devaddr;
+    uint8_t nwkskey[16];
+    uint32_t downlink_counter;
+    uint32_t acks;
+    bool pending;
+    sim_downlink_t downlink;
+} sim_gateway;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+static void *sim_alloc(size_t size) {
+    void *p = calloc(1, size);
+    if (p == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static uint32_t sim_bandwidth_hz(uint32_t bandwidth) {
+    switch (bandwidth) {
+        case 1: return 250000;
+        case 2: return 500000;
+        default: return 125000;
+    }
+}
+
+// as SX1272GetTimeOnAir(), the MAC frames have an explicit header and a CRC
+static uint32_t sim_lora_time_on_air_us(uint8_t sf, uint32_t bw_hz, uint8_t coderate, uint16_t preamble, bool crc, uint8_t size) {
+    double ts = (double)(1 << sf) / bw_hz;
+    bool ldro = ((bw_hz == 125000) && (sf >= 11)) || ((bw_hz == 250000) && (sf == 12));
+    double tmp = ceil((8 * size - 4 * sf + 28 + 16 * crc) / (double)(4 * (sf - (ldro ? 2 : 0)))) * (coderate + 4);
+    double symbols = preamble + 4.25 + 8 + ((tmp > 0) ? tmp : 0);
+    return (uint32_t)ceil(symbols * ts * 1000000);
+}
+
+static uint32_t sim_tx_time_on_air_us(uint8_t size) {
+    if (sim_radio.modem == MODEM_FSK) {
+        // preamble, sync word, length, payload and CRC
+        return (uint32_t)(((uint64_t)(sim_radio.tx_preamble + 3 + 1 + size + 2) * 8 * 1000000) / sim_radio.tx_datarate);
+    }
+    return sim_lora_time_on_air_us(sim_radio.tx_datarate, sim_bandwidth_hz(sim_radio.tx_bw), sim_radio.tx_coderate,
+                                   sim_radio.tx_preamble, sim_radio.tx_crc, size);
+}
+
+static void sim_air_prune(void) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < sim_air_count; i++) {
+        if (sim_air[i]->end + SIM_AIR_KEEP_US >= sim_now_us()) {
+            sim_air[n++] = sim_air[i];
+        } else {
+            free(sim_air[i]);
+        }
+    }
+    sim_air_count = n;
+}
+
+static void sim_gateway_receive(sim_packet_t *packet) {
+    uint8_t mtype = packet->payload[0] >> 5;
+    if ((packet->size < 12) || ((mtype != SIM_FRAME_TYPE_DATA_UNCONFIRMED_UP) && (mtype != SIM_FRAME_TYPE_DATA_CONFIRMED_UP))) {
+        return;
+    }
+    uint32_t devaddr = packet->payload[1] | (packet->payload[2] << 8) | (packet->payload[3] << 16) | ((uint32_t)packet->payload[4] << 24);
+    if ((devaddr != sim_gateway.devaddr) || (mtype != SIM_FRAME_TYPE_DATA_CONFIRMED_UP)) {
+        return;
+    }
+
+    // an empty frame with the ACK bit, sent in RX1 on the channel and data rate of the uplink as in EU868
+    sim_downlink_t *downlink = &sim_gateway.downlink;
+    uint32_t counter = sim_gateway.downlink_counter++;
+    uint8_t *data = downlink->data;
+    data[0] = SIM_FRAME_TYPE_DATA_UNCONFIRMED_DOWN << 5;
+    memcpy(&data[1], &packet->payload[1], 4);
+    data[5] = SIM_FCTRL_ACK;
+    data[6] = counter & 0xFF;
+    data[7] = (counter >> 8) & 0xFF;
+    uint32_t mic;
+    LoRaMacComputeMic(data, 8, sim_gateway.nwkskey, devaddr, DOWN_LINK, counter, &mic);
+    data[8] = mic & 0xFF;
+    data[9] = (mic >> 8) & 0xFF;
+    data[10] = (mic >> 16) & 0xFF;
+    data[11] = (mic >> 24) & 0xFF;
+    downlink->size = 12;
+    downlink->start = packet->end + SIM_RECEIVE_DELAY1_US;
+    downlink->freq = packet->freq;
+    downlink->sf = packet->sf;
+    sim_gateway.pending = true;
+}
+
+// a frame is lost when any other one on the same channel and SF overlapped it, the capture effect is ignored
+static void sim_air_end(void *arg) {
+    sim_packet_t *packet = arg;
+    bool lost = false;
+    for (uint32_t i = 0; i < sim_air_count; i++) {
+        sim_packet_t *other = sim_air[i];
+        if ((other != packet) && (other->freq == packet->freq) && (other->sf == packet->sf) &&
+            (other->start < packet->end) && (packet->start < other->end)) {
+            lost = true;
+            break;
+        }
+    }
+
+    sim_air_stats_t *stats = (packet->node == SIM_NODE_SELF) ? &sim_air_self : &sim_air_others;
+    stats->sent++;
+    stats->airtime_us += packet->end - packet->start;
+    if (lost) {
+        stats->lost++;
+    } else if (packet->node == SIM_NODE_SELF) {
+        sim_gateway_receive(packet);
+    }
+    sim_air_prune();
+}
+
+static sim_packet_t *sim_air_add(uint32_t node, uint32_t freq, uint8_t sf, uint32_t toa_us, const uint8_t *payload, uint8_t size) {
+    sim_packet_t *packet = sim_alloc(sizeof(sim_packet_t) + (payload ? size : 0));
+    packet->start = sim_now_us();
+    packet->end = packet->start + toa_us;
+    packet->freq = freq;
+    packet->node = node;
+    packet->sf = sf;
+    packet->size = size;
+    if (payload) {
+        memcpy(packet->payload, payload, size);
+    }
+    if (sim_air_count == sim_air_size) {
+        sim_air_size = sim_air_size ? (sim_air_size * 2) : 64;
+        sim_air = realloc(sim_air, sim_air_size * sizeof(sim_packet_t *));
+        if (sim_air == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    sim_air[sim_air_count++] = packet;
+    sim_schedule(packet->end, sim_air_end, packet);
+    return packet;
+}
+
+static uint64_t sim_exponential_us(uint32_t mean_ms) {
+    double u = (sim_rand() + 1.0) / 4294967297.0;
+    return (uint64_t)(-log(u) * mean_ms * 1000);
+}
+
+static void sim_node_send(void *arg) {
+    sim_node_t *node = arg;
+    sim_nodes_t *group = node->group;
+    uint32_t freq = group->channels[sim_rand() % group->nchannels];
+    sim_air_add(node->node, freq, group->sf, sim_time_on_air_us(group->sf, 125000, group->size), NULL, group->size);
+
+    uint64_t next = sim_now_us() + sim_exponential_us(group->interval_ms);
+    if (next < group->until) {
+        sim_schedule(next, sim_node_send, node);
+    }
+}
+
+/******************************************************************************
+ RADIO, in place of the SX1272 and SX1276 drivers
+ ******************************************************************************/
+static void sim_radio_tx_done(void *arg) {
+    if ((uint32_t)(uintptr_t)arg == sim_radio.op) {
+        sim_radio.state = RF_IDLE;
+        sim_mac_enter();
+        sim_radio.events->TxDone();
+        sim_mac_exit();
+    }
+}
+
+static void sim_radio_rx_done(void *arg) {
+    if ((uint32_t)(uintptr_t)arg == sim_radio.op) {
+        if (!sim_radio.rx_continuous) {
+            sim_radio.state = RF_IDLE;
+        }
+        sim_mac_enter();
+        sim_radio.events->RxDone(sim_radio.rx_buffer, (uint32_t)sim_now_us(), sim_radio.rx_size, -60, 10, sim_radio.rx_datarate);
+        sim_mac_exit();
+    }
+}
+
+static void sim_radio_rx_timeout(void *arg) {
+    if ((uint32_t)(uintptr_t)arg == sim_radio.op) {
+        sim_radio.state = RF_IDLE;
+        sim_mac_enter();
+        sim_radio.events->RxTimeout();
+        sim_mac_exit();
+    }
+}
+
+static void SimRadioInit(RadioEvents_t *events) {
+    sim_radio.events = events;
+    sim_radio.state = RF_IDLE;
+    sim_radio.op++;
+}
+
+static RadioState_t SimRadioGetStatus(void) {
+    return sim_radio.state;
+}
+
+static void SimRadioSetModem(RadioModems_t modem) {
+    sim_radio.modem = modem;
+}
+
+static void SimRadioSetChannel(uint32_t freq) {
+    sim_radio.freq = freq;
+}
+
+static uint32_t SimRadioGetChannel(void) {
+    return sim_radio.freq;
+}
+
+static bool SimRadioIsChannelFree(RadioModems_t modem, uint32_t freq, int16_t rssiThresh, uint32_t maxCarrierSenseTime) {
+    for (uint32_t i = 0; i < sim_air_count; i++) {
+        if ((sim_air[i]->freq == freq) && (sim_air[i]->start <= sim_now_us()) && (sim_air[i]->end > sim_now_us())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t SimRadioRandom(void) {
+    return sim_rand();
+}
+
+static void SimRadioSetRxConfig(RadioModems_t modem, uint32_t bandwidth, uint32_t datarate, uint8_t coderate,
+                                uint32_t bandwidthAfc, uint16_t preambleLen, uint16_t symbTimeout, bool fixLen,
+                                uint8_t payloadLen, bool crcOn, bool freqHopOn, uint8_t hopPeriod,
+                                bool iqInverted, bool rxContinuous) {
+    sim_radio.modem = modem;
+    sim_radio.rx_bw = bandwidth;
+    sim_radio.rx_datarate = datarate;
+    sim_radio.rx_symbols = symbTimeout;
+    sim_radio.rx_continuous = rxContinuous;
+}
+
+static void SimRadioSetTxConfig(RadioModems_t modem, int8_t power, uint32_t fdev, uint32_t bandwidth, uint32_t datarate,
+                                uint8_t coderate, uint16_t preambleLen, bool fixLen, bool crcOn, bool freqHopOn,
+                                uint8_t hopPeriod, bool iqInverted, uint32_t timeout) {
+    sim_radio.modem = modem;
+    sim_radio.tx_bw = bandwidth;
+    sim_radio.tx_datarate = datarate;
+    sim_radio.tx_coderate = coderate;
+    sim_radio.tx_preamble = preambleLen;
+    sim_radio.tx_crc = crcOn;
+}
+
+static bool SimRadioCheckRfFrequency(uint32_t frequency) {
+    return true;
+}
+
+static uint32_t SimRadioTimeOnAir(RadioModems_t modem, uint8_t pktLen) {
+    return (sim_tx_time_on_air_us(pktLen) + 999) / 1000;
+}
+
+static void SimRadioSend(uint8_t *buffer, uint8_t size) {
+    uint32_t toa = sim_tx_time_on_air_us(size);
+    sim_radio.state = RF_TX_RUNNING;
+    sim_radio.op++;
+    sim_air_add(SIM_NODE_SELF, sim_radio.freq, (sim_radio.modem == MODEM_LORA) ? sim_radio.tx_datarate : 0, toa, buffer, size);
+    // after the end of the frame on air, so that the gateway has it before the receive windows
+    sim_schedule(sim_now_us() + toa, sim_radio_tx_done, (void *)(uintptr_t)sim_radio.op);
+}
+
+static void SimRadioSleep(void) {
+    sim_radio.state = RF_IDLE;
+    sim_radio.op++;
+}
+
+static void SimRadioRx(uint32_t timeout) {
+    sim_radio.state = RF_RX_RUNNING;
+    sim_radio.op++;
+    void *op = (void *)(uintptr_t)sim_radio.op;
+
+    uint64_t symbol = ((uint64_t)1000000 << sim_radio.rx_datarate) / sim_bandwidth_hz(sim_radio.rx_bw);
+    uint64_t window = (uint64_t)sim_radio.rx_symbols * symbol;
+    if ((timeout > 0) && ((uint64_t)timeout * 1000 < window)) {
+        window = (uint64_t)timeout * 1000;
+    }
+
+    sim_downlink_t *downlink = &sim_gateway.downlink;
+    if (sim_gateway.pending && (downlink->start + (8 * symbol) < sim_now_us())) {
+        // its receive window was missed
+        sim_gateway.pending = false;
+    }
+    if (sim_gateway.pending && (downlink->freq == sim_radio.freq) && (downlink->sf == sim_radio.rx_datarate) &&
+        (sim_radio.rx_continuous || (downlink->start <= sim_now_us() + window))) {
+        sim_gateway.pending = false;
+        sim_gateway.acks++;
+        memcpy(sim_radio.rx_buffer, downlink->data, downlink->size);
+        sim_radio.rx_size = downlink->size;
+        uint64_t start = (downlink->start > sim_now_us()) ? downlink->start : sim_now_us();
+        sim_schedule(start + sim_time_on_air_us(downlink->sf, sim_bandwidth_hz(sim_radio.rx_bw), downlink->size), sim_radio_rx_done, op);
+    } else if (!sim_radio.rx_continuous) {
+        sim_schedule(sim_now_us() + window, sim_radio_rx_timeout, op);
+    }
+}
+
+static void SimRadioStandby(void) {
+    SimRadioSleep();
+}
+
+static void SimRadioStartCad(void) {
+}
+
+static void SimRadioSetTxContinuousWave(uint32_t freq, int8_t power, uint16_t time) {
+}
+
+static int16_t SimRadioRssi(RadioModems_t modem) {
+    return -120;
+}
+
+static void SimRadioWrite(uint8_t addr, uint8_t data) {
+}
+
+static uint8_t SimRadioRead(uint8_t addr) {
+    return 0;
+}
+
+static void SimRadioWriteBuffer(uint8_t addr, uint8_t *buffer, uint8_t size) {
+}
+
+static void SimRadioReadBuffer(uint8_t addr, uint8_t *buffer, uint8_t size) {
+}
+
+static void SimRadioSetMaxPayloadLength(RadioModems_t modem, uint8_t max) {
+}
+
+static void SimRadioSetPublicNetwork(bool enable) {
+}
+
+static void SimRadioReset(void) {
+    SimRadioSleep();
+}
+
+const struct Radio_s Radio = {
+    SimRadioInit,
+    SimRadioGetStatus,
+    SimRadioSetModem,
+    SimRadioSetChannel,
+    SimRadioGetChannel,
+    SimRadioIsChannelFree,
+    SimRadioRandom,
+    SimRadioSetRxConfig,
+    SimRadioSetTxConfig,
+    SimRadioCheckRfFrequency,
+    SimRadioTimeOnAir,
+    SimRadioSend,
+    SimRadioSleep,
+    SimRadioStandby,
+    SimRadioRx,
+    SimRadioStartCad,
+    SimRadioSetTxContinuousWave,
+    SimRadioRssi,
+    SimRadioWrite,
+    SimRadioRead,
+    SimRadioWriteBuffer,
+    SimRadioReadBuffer,
+    SimRadioSetMaxPayloadLength,
+    SimRadioSetPublicNetwork,
+    SimRadioReset
+};
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+// xorshift64*, the same sequence on every host for a given seed
+void sim_seed(uint64_t seed) {
+    sim_random_state = seed ? seed : 1;
+}
+
+uint32_t sim_rand(void) {
+    sim_random_state ^= sim_random_state >> 12;
+    sim_random_state ^= sim_random_state << 25;
+    sim_random_state ^= sim_random_state >> 27;
+    return (uint32_t)((sim_random_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+uint32_t sim_time_on_air_us(uint8_t sf, uint32_t bw_hz, uint8_t size) {
+    return sim_lora_time_on_air_us(sf, bw_hz, 1, 8, true, size);
+}
+
+// only once the events of the previous scenario all ran, the nodes stop by themselves
+void sim_air_reset(void) {
+    for (uint32_t i = 0; i < sim_air_count; i++) {
+        free(sim_air[i]);
+    }
+    sim_air_count = 0;
+    while (sim_nodes != NULL) {
+        sim_nodes_t *next = sim_nodes->next;
+        free(sim_nodes);
+        sim_nodes = next;
+    }
+    sim_node_count = 0;
+    memset(&sim_air_self, 0, sizeof(sim_air_self));
+    memset(&sim_air_others, 0, sizeof(sim_air_others));
+    sim_gateway.pending = false;
+    sim_gateway.acks = 0;
+}
+
+void sim_gateway_session(uint32_t devaddr, const uint8_t *nwkskey) {
+    sim_gateway.devaddr = devaddr;
+    memcpy(sim_gateway.nwkskey, nwkskey, sizeof(sim_gateway.nwkskey));
+    sim_gateway.downlink_counter = 0;
+}
+
+// count other nodes sending size bytes at a mean interval, Poisson distributed, on one of the channels
+void sim_nodes_add(uint32_t count, uint32_t interval_ms, uint8_t sf, uint8_t size, const uint32_t *channels, uint32_t nchannels, uint64_t until_us) {
+    sim_nodes_t *group = sim_alloc(sizeof(sim_nodes_t) + count * sizeof(sim_node_t));
+    group->next = sim_nodes;
+    group->until = until_us;
+    group->interval_ms = interval_ms;
+    group->nchannels = (nchannels > 16) ? 16 : nchannels;
+    memcpy(group->channels, channels, group->nchannels * sizeof(uint32_t));
+    group->sf = sf;
+    group->size = size;
+    sim_nodes = group;
+
+    // the first frames are spread over an interval, not all sent at once
+    for (uint32_t i = 0; i < count; i++) {
+        sim_node_t *node = &group->nodes[i];
+        node->node = ++sim_node_count;
+        node->group = group;
+        sim_schedule(sim_now_us() + ((uint64_t)sim_rand() * interval_ms * 1000 >> 32), sim_node_send, node);
+    }
+}
+
+void sim_air_stats(sim_air_stats_t *node, sim_air_stats_t *others, uint32_t *acks) {
+    *node = sim_air_self;
+    *others = sim_air_others;
+    *acks = sim_gateway.acks;
+}
@@ -80,7 +80,13 @@ if [ "${BOARD}" != "SIPY" ]; then
     fi
     
     cp ${BUILD_DIR}/lib/${PART_FILE_8MB} ${PKG_TMP_DIR}
-    cat boards/$1/${SCRIPT_FILE_8MB} > ${PKG_TMP_DIR}/${SCRIPT_FILE_8MB} || { echo >&2 "Cannot create ${SCRIPT_FILE_8MB} file! Aborting."; exit 1; }
+    if [ "${LAYOUT_8MB}" = "perf" ]; then
+        # the app slots and otadata of lib/partitions_8MB_perf.csv
+        sed -e 's/"0x1EF000"/"0x280000"/g' -e 's/"0x210000"/"0x400000"/' -e 's/"0x1FF000"/"0x290000"/' \
+            boards/$1/${SCRIPT_FILE_8MB} > ${PKG_TMP_DIR}/${SCRIPT_FILE_8MB} || { echo >&2 "Cannot create ${SCRIPT_FILE_8MB} file! Aborting."; exit 1; }
+    else
+        cat boards/$1/${SCRIPT_FILE_8MB} > ${PKG_TMP_DIR}/${SCRIPT_FILE_8MB} || { echo >&2 "Cannot create ${SCRIPT_FILE_8MB} file! Aborting."; exit 1; }
+    fi
 
     if [ "${BOARD}" = "LOPY" -o "${BOARD}" = "WIPY" ]; then
        if [ $4 ]; then
@@ -0,0 +1,131 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2021, Pycom Limited.
+#
+# This software is licensed under the GNU GPL version 3 or any
+# later version, with permitted additional terms. For more information
+# see the Pycom Licence v1.0 document supplied with this file, or
+# available at https://www.pycom.io/opensource/licensing
+#
+
+# Decodes the records returned by machine.trace_dump(), e.g. saved on the device with
+#   open('/flash/trace.bin', 'ab').write(machine.trace_dump())
+# or printed with ubinascii.hexlify() and given with --hex. The records of both cores are merged by time and
+# --latency FROM TO adds the statistics of the time from each FROM event to the next TO one (wake to send to ack).
+
+import argparse
+import binascii
+import os
+import re
+import struct
+import sys
+
+RECORD = struct.Struct('<IHBBII')
+
+HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'util', 'mptrace.h')
+
+USER = 0x0F00
+
+
+def load_names(header):
+    names = {}
+    with open(header) as f:
+        for m in re.finditer(r'MPTRACE_(\w+)\s*=\s*(0x[0-9a-fA-F]+)', f.read()):
+            names[int(m.group(2), 16)] = m.group(1)
+    return names
+
+
+def event_name(names, event):
+    if event & 0xFF00 == USER:
+        return 'USER_{}'.format(event & 0xFF)
+    return names.get(event, '0x{:04x}'.format(event))
+
+
+def read_records(data):
+    if len(data) % RECORD.size:
+        print('warning: {} trailing bytes ignored'.format(len(data) % RECORD.size), file=sys.stderr)
+    return [RECORD.unpack_from(data, i) for i in range(0, len(data) - RECORD.size + 1, RECORD.size)]
+
+
+def unwrap(records):
+    # the timestamps are 32-bit µs, extended per core assuming less than 71 minutes between two records
+    out = []
+    last = {}
+    lost = 0
+    for ts, event, core, seq, arg0, arg1 in records:
+        if core in last:
+            prev_ts, prev_seq, base = last[core]
+            if ts < prev_ts:
+                base += 1 << 32
+            lost += (seq - prev_seq - 1) & 0xFF
+        else:
+            base = 0
+        last[core] = (ts, seq, base)
+        out.append((base + ts, event, core, arg0, arg1))
+    out.sort(key=lambda r: r[0])
+    return out, lost
+
+
+def format_args(event, arg0, arg1):
+    if event == 0x0200:
+        # LTE_AT_CMD, the second one is the start of the command
+        tag = struct.pack('<I', arg1).rstrip(b'\x00').decode('ascii', 'replace')
+        return '{} AT{}'.format(arg0, tag)
+    if arg1 & 0x80000000:
+        arg1 -= 1 << 32
+    return '{} {}'.format(arg0, arg1)
+
+
+def latency(records, names, start, end):
+    samples = []
+    begin = None
+    for ts, event, core, arg0, arg1 in records:
+        name = event_name(names, event)
+        if name == start:
+            begin = ts
+        elif name == end and begin is not None:
+            samples.append(ts - begin)
+            begin = None
+    if not samples:
+        return '{} -> {}: no samples'.format(start, end)
+    samples.sort()
+    return '{} -> {}: {} samples, min {} us, median {} us, max {} us, mean {:.0f} us'.format(
+        start, end, len(samples), samples[0], samples[len(samples) // 2], samples[-1], sum(samples) / len(samples))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decodes the records of machine.trace_dump()')
+    parser.add_argument('file', nargs='?', help='the dump, read from stdin by default')
+    parser.add_argument('--hex', action='store_true', help='the dump is hexlified text')
+    parser.add_argument('--header', default=HEADER, help='mptrace.h with the event ids')
+    parser.add_argument('--latency', nargs=2, action='append', default=[], metavar=('FROM', 'TO'),
+                        help='time from each FROM event to the next TO one, e.g. LORA_TX_REQUEST LORA_CONFIRM')
+    args = parser.parse_args()
+
+    if args.file:
+        with open(args.file, 'rb') as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+    if args.hex:
+        data = binascii.unhexlify(re.sub(rb'[^0-9a-fA-F]', b'', data))
+
+    names = load_names(args.header)
+    records, lost = unwrap(read_records(data))
+    if not records:
+        return
+
+    first = records[0][0]
+    prev = first
+    for ts, event, core, arg0, arg1 in records:
+        print('{:>12.3f} ms {:>+10d} us  cpu{}  {:<18} {}'.format(
+            (ts - first) / 1000.0, ts - prev, core, event_name(names, event), format_args(event, arg0, arg1)))
+        prev = ts
+    if lost:
+        print('{} records overwritten before being dumped'.format(lost))
+    for start, end in args.latency:
+        print(latency(records, names, start, end))
+
+
+if __name__ == '__main__':
+    main()
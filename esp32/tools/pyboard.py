@@ -41,10 +41,18 @@ To run a script from the local machine on the board and print out the results:
     import pyboard
     pyboard.execfile('test.py', device='/dev/ttyACM0')
 
+To copy a file to the board while in the raw REPL:
+
+    pyb.put_file('main.py', '/flash/main.py')
+
 This script can also be run directly.  To execute a local script, use:
 
     ./pyboard.py test.py
 
+Or to copy files to the board (to /flash when no path is given):
+
+    ./pyboard.py --put main.py --put lib/util.py:/flash/lib/util.py
+
 Or:
 
     python pyboard.py test.py
@@ -55,6 +63,8 @@ import sys
 import time
 import os
 import stat
+import struct
+import binascii
 from threading import Thread
 
 try:
@@ -590,6 +600,62 @@ class Pyboard:
             pyfile = f.read()
         return self.exec_(pyfile)
 
+    def _put_frame(self, payload):
+        frame = struct.pack('<I', len(payload)) + payload + \
+            struct.pack('<I', binascii.crc32(payload) & 0xffffffff)
+        while True:
+            self.connection.write(frame)
+            reply = self.connection.read_with_timeout(1, 10)
+            if reply == b'K':
+                return
+            elif reply == b'R':
+                continue    # corrupted on the way, sent again
+            elif reply == b'E':
+                raise PyboardError('could not write the file, errno ' +
+                    self.read_until(b'\r\n').strip().decode('ascii'))
+            raise PyboardError('no answer while writing the file')
+
+    def _put_file_exec(self, data, remote):
+        # for boards without the binary transfer, much slower
+        self.exec_("f = open('{}', 'wb')".format(remote))
+        for i in range(0, len(data), 256):
+            self.exec_("f.write(ubinascii.unhexlify('{}'))".format(
+                binascii.hexlify(data[i:i + 256]).decode('ascii')))
+        self.exec_("f.close()")
+
+    def put_file(self, local, remote):
+        """Copies a file to the board, which must be in the raw REPL.
+
+        The file is sent in binary frames checked with a CRC32 when the
+        firmware supports it (CTRL-E F), otherwise with code writing it
+        from hex.
+        """
+        with open(local, 'rb') as f:
+            data = f.read()
+
+        # check we have a prompt
+        prompt = self.read_until(b'>')
+        if not prompt.endswith(b'>'):
+            raise PyboardError('could not enter raw repl')
+
+        self.connection.enable_binary()
+        try:
+            self.connection.write(b'\x05F')
+            if self.connection.read_with_timeout(1, 2) != b'F':
+                # old firmware, the characters were taken as code, CTRL-C drops them
+                self.connection.write(b'\x03\x01')
+                self.read_until(b'raw REPL; CTRL-B to exit\r\n')
+                self.exec_('import ubinascii')
+                return self._put_file_exec(data, remote)
+            chunk = int(self.read_until(b'\r\n').strip())
+
+            self._put_frame(struct.pack('<I', len(data)) + remote.encode('utf8'))
+            for i in range(0, len(data), chunk):
+                self._put_frame(data[i:i + chunk])
+            self._put_frame(b'')
+        finally:
+            self.connection.disable_binary()
+
     def get_time(self):
         t = str(self.eval('pyb.RTC().datetime()'), encoding='utf8')[1:-1].split(', ')
         return int(t[4]) * 3600 + int(t[5]) * 60 + int(t[6])
@@ -616,6 +682,7 @@ def main():
     cmd_parser.add_argument('-c', '--command', help='program passed in as string')
     cmd_parser.add_argument('-w', '--wait', default=0, type=int, help='seconds to wait for USB connected board to become available')
     cmd_parser.add_argument('--follow', action='store_true', help='follow the output after running the scripts [default if no scripts given]')
+    cmd_parser.add_argument('--put', action='append', default=[], metavar='LOCAL[:REMOTE]', help='copy a file to the board, to /flash if no path is given')
     cmd_parser.add_argument('files', nargs='*', help='input files')
     args = cmd_parser.parse_args()
 
@@ -635,6 +702,23 @@ def main():
             stdout_write_bytes(ret_err)
             sys.exit(1)
 
+    if args.put:
+        try:
+            pyb = Pyboard(args.device, args.baudrate, args.user, args.password, args.wait)
+            pyb.enter_raw_repl_no_reset()
+            for put in args.put:
+                local, _, remote = put.partition(':')
+                if not remote:
+                    remote = '/flash/' + os.path.basename(local)
+                pyb.put_file(local, remote)
+            pyb.exit_raw_repl()
+            pyb.close()
+        except PyboardError as er:
+            print(er)
+            sys.exit(1)
+        except KeyboardInterrupt:
+            sys.exit(1)
+
     if args.command is not None:
         execbuffer(to_bytes(args.command))
 
@@ -643,7 +727,7 @@ def main():
             pyfile = f.read()
             execbuffer(pyfile)
 
-    if args.follow or (args.command is None and len(args.files) == 0):
+    if args.follow or (args.command is None and len(args.files) == 0 and not args.put):
         try:
             pyb = Pyboard(args.device, args.baudrate, args.user, args.password, args.wait)
             ret, ret_err = pyb.follow(timeout=None, data_consumer=stdout_write_bytes)
@@ -5,6 +5,7 @@ set -e
 BOARD="$1"
 RELEASE_TYP="$2"
 VARIANT="$3"
+LAYOUT_8MB="$4"
 if [ ${VARIANT} != "BASE" ] ; then
   BUILD_DIR="build-${VARIANT}"
 else
@@ -12,6 +13,10 @@ else
 fi
 
 IMG_MAX_SIZE_8MB=2027520
+if [ "${LAYOUT_8MB}" = "perf" ] ; then
+  # lib/partitions_8MB_perf.csv
+  IMG_MAX_SIZE_8MB=2621440
+fi
 IMG_MAX_SIZE_4MB=1761280
 OS="$(uname)"
 
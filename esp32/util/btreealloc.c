@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btreealloc.h"
+#include "esp32chipinfo.h"
+
+#include "esp_heap_caps.h"
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+// the PSRAM first on the boards which have it, the internal RAM when it's full
+void *btree_malloc(size_t size) {
+    void *ptr = NULL;
+    if (esp32_get_chip_rev() > 0) {
+        ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    }
+    return ptr != NULL ? ptr : malloc(size);
+}
+
+void *btree_calloc(size_t n, size_t size) {
+    if (size != 0 && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *ptr = btree_malloc(n * size);
+    if (ptr != NULL) {
+        memset(ptr, 0, n * size);
+    }
+    return ptr;
+}
+
+void *btree_realloc(void *ptr, size_t size) {
+    void *new_ptr = NULL;
+    if (esp32_get_chip_rev() > 0) {
+        new_ptr = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM);
+    }
+    return new_ptr != NULL ? new_ptr : realloc(ptr, size);
+}
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef BTREEALLOC_H_
+#define BTREEALLOC_H_
+
+#include <stddef.h>
+
+/* The berkeley-db sources are built with malloc, calloc and realloc redefined to these (see BTREE_DEFS_EXTRA).
+ * Its page pool would otherwise go to the internal RAM, as the IDF keeps the allocations under
+ * CONFIG_SPIRAM_MALLOC_ALWAYSINTERNAL there. The blocks are released with the usual free(). */
+void *btree_malloc(size_t size);
+void *btree_calloc(size_t n, size_t size);
+void *btree_realloc(void *ptr, size_t size);
+
+#endif // BTREEALLOC_H_
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "py/mpconfig.h"
+#include "py/misc.h"
+
+#include "flashcache.h"
+#include "esp32chipinfo.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_spi_flash.h"
+#include "esp_heap_caps.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+#define FLASHCACHE_SECTOR_SIZE          SPI_FLASH_SEC_SIZE
+#define FLASHCACHE_SECTORS_PSRAM        (16)
+#define FLASHCACHE_SECTORS              (2)
+#define FLASHCACHE_FREE                 (UINT32_MAX)
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+typedef struct {
+    uint32_t addr;                  // FLASHCACHE_FREE if the entry holds nothing
+    uint32_t used;                  // value of flashcache_clock at the last access
+} flashcache_entry_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+static SemaphoreHandle_t flashcache_mutex;
+static flashcache_entry_t *flashcache_entries;
+static uint8_t *flashcache_data;
+static uint32_t flashcache_count;
+static uint32_t flashcache_clock;
+static uint32_t flashcache_hits;
+static uint32_t flashcache_misses;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+// returns the entry holding the sector, reading it into the least recently used one on a miss
+static int flashcache_lookup(uint32_t addr) {
+    int victim = 0;
+    for (int i = 0; i < flashcache_count; i++) {
+        if (flashcache_entries[i].addr == addr) {
+            flashcache_hits++;
+            return i;
+        }
+        if (flashcache_entries[i].used < flashcache_entries[victim].used) {
+            victim = i;
+        }
+    }
+
+    flashcache_misses++;
+    flashcache_entries[victim].addr = FLASHCACHE_FREE;
+    if (ESP_OK != spi_flash_read_encrypted(addr, &flashcache_data[victim * FLASHCACHE_SECTOR_SIZE], FLASHCACHE_SECTOR_SIZE)) {
+        return -1;
+    }
+    flashcache_entries[victim].addr = addr;
+    return victim;
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void flashcache_init(void) {
+    if (flashcache_mutex != NULL) {
+        return;
+    }
+
+    uint32_t count = FLASHCACHE_SECTORS;
+    uint8_t *data = NULL;
+    if (esp32_get_chip_rev() > 0) {
+        count = FLASHCACHE_SECTORS_PSRAM;
+        data = heap_caps_malloc(count * FLASHCACHE_SECTOR_SIZE, MALLOC_CAP_SPIRAM);
+    }
+    if (data == NULL) {
+        count = FLASHCACHE_SECTORS;
+        data = heap_caps_malloc(count * FLASHCACHE_SECTOR_SIZE, MALLOC_CAP_8BIT);
+    }
+    flashcache_entries = heap_caps_malloc(count * sizeof(flashcache_entry_t), MALLOC_CAP_8BIT);
+    if (data == NULL || flashcache_entries == NULL) {
+        // without the cache every read goes to the flash
+        free(data);
+        free(flashcache_entries);
+        flashcache_entries = NULL;
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        flashcache_entries[i].addr = FLASHCACHE_FREE;
+        flashcache_entries[i].used = 0;
+    }
+    flashcache_data = data;
+    flashcache_count = count;
+    flashcache_mutex = xSemaphoreCreateMutex();
+}
+
+// same as spi_flash_read_encrypted(), also when the flash encryption is disabled
+esp_err_t flashcache_read(size_t src, void *dest, size_t size) {
+    if (flashcache_mutex == NULL) {
+        return spi_flash_read_encrypted(src, dest, size);
+    }
+
+    esp_err_t ret = ESP_OK;
+    uint8_t *out = dest;
+    xSemaphoreTake(flashcache_mutex, portMAX_DELAY);
+    while (size > 0) {
+        uint32_t addr = src & ~(FLASHCACHE_SECTOR_SIZE - 1);
+        uint32_t off = src - addr;
+        uint32_t n = MIN(size, FLASHCACHE_SECTOR_SIZE - off);
+        int i = flashcache_lookup(addr);
+        if (i < 0) {
+            ret = ESP_FAIL;
+            break;
+        }
+        flashcache_entries[i].used = ++flashcache_clock;
+        memcpy(out, &flashcache_data[i * FLASHCACHE_SECTOR_SIZE + off], n);
+        out += n;
+        src += n;
+        size -= n;
+    }
+    xSemaphoreGive(flashcache_mutex);
+    return ret;
+}
+
+void flashcache_invalidate(size_t addr, size_t size) {
+    if (flashcache_mutex == NULL || size == 0) {
+        return;
+    }
+
+    xSemaphoreTake(flashcache_mutex, portMAX_DELAY);
+    for (int i = 0; i < flashcache_count; i++) {
+        if (flashcache_entries[i].addr != FLASHCACHE_FREE
+            && flashcache_entries[i].addr < addr + size && addr < flashcache_entries[i].addr + FLASHCACHE_SECTOR_SIZE) {
+            flashcache_entries[i].addr = FLASHCACHE_FREE;
+            flashcache_entries[i].used = 0;
+        }
+    }
+    xSemaphoreGive(flashcache_mutex);
+}
+
+void flashcache_get_stats(uint32_t *hits, uint32_t *misses, bool clear) {
+    *hits = flashcache_hits;
+    *misses = flashcache_misses;
+    if (clear) {
+        flashcache_hits = 0;
+        flashcache_misses = 0;
+    }
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef FLASHCACHE_H_
+#define FLASHCACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/* LRU cache of flash sectors read through the MMU, i.e. decrypted when flash encryption is enabled.
+ * spi_flash_read_encrypted() maps, copies and unmaps the flash on every call, which makes each small read of the
+ * FatFS driver or of the updater cost a cache flush. The sectors are kept in PSRAM on the boards which have it.
+ * Whoever erases or writes a region which may have been read through the cache must invalidate it. */
+void flashcache_init(void);
+esp_err_t flashcache_read(size_t src, void *dest, size_t size);
+void flashcache_invalidate(size_t addr, size_t size);
+void flashcache_get_stats(uint32_t *hits, uint32_t *misses, bool clear);
+
+#endif // FLASHCACHE_H_
@@ -16,6 +16,7 @@
 #include "py/gc.h"
 #include "py/mpthread.h"
 #include "gccollect.h"
+#include "mptrace.h"
 #include "soc/cpu.h"
 #include "xtensa/hal.h"
 
@@ -47,7 +48,9 @@ static void gc_collect_inner(int level) {
 DECLARE PUBLIC FUNCTIONS
  ******************************************************************************/
 void gc_collect(void) {
+    MPTRACE(MPTRACE_GC_START, 0, 0);
     gc_collect_start();
     gc_collect_inner(0);
     gc_collect_end();
+    MPTRACE(MPTRACE_GC_END, 0, 0);
 }
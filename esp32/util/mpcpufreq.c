@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "py/mpstate.h"
+#include "py/runtime.h"
+#include "py/mphal.h"
+
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "soc/rtc.h"
+#include "rom/ets_sys.h"
+#include "xtensa/core-macros.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/xtensa_timer.h"
+
+#include "mpcpufreq.h"
+
+/******************************************************************************
+ DECLARE PRIVATE CONSTANTS
+ ******************************************************************************/
+#define MPCPUFREQ_SAMPLE_PERIOD_US                  (10 * 1000)
+// the compare register must not be set in the past, see the power management of the IDF
+#define MPCPUFREQ_CCOMPARE_MIN_CYCLES               (1000)
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+typedef struct {
+    esp_timer_handle_t timer;
+    bool auto_enabled;
+    uint32_t mhz;
+    uint32_t low_mhz;
+    uint32_t high_mhz;
+    uint32_t idle_samples;      // consecutive samples without the GIL taken before lowering the frequency
+    uint32_t idle_count;
+    uint32_t boost;             // number of boost requests held
+    int64_t state_start;
+    mpcpufreq_stats_t stats;
+} mpcpufreq_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+STATIC portMUX_TYPE mpcpufreq_mux = portMUX_INITIALIZER_UNLOCKED;
+STATIC mpcpufreq_t mpcpufreq;
+
+/******************************************************************************
+ DECLARE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC int mpcpufreq_state (uint32_t mhz);
+STATIC void mpcpufreq_switch (uint32_t mhz);
+STATIC void mpcpufreq_sample (void *arg);
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void mpcpufreq_init0 (void) {
+    memset(&mpcpufreq, 0, sizeof(mpcpufreq));
+    mpcpufreq.mhz = ets_get_cpu_frequency();
+    mpcpufreq.state_start = esp_timer_get_time();
+
+    esp_timer_create_args_t args = {
+        .callback = mpcpufreq_sample,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "cpufreq"
+    };
+    esp_timer_create(&args, &mpcpufreq.timer);
+}
+
+bool mpcpufreq_set (uint32_t mhz) {
+    if (mpcpufreq_state(mhz) < 0) {
+        return false;
+    }
+    mpcpufreq_set_auto(false, 0, 0, 0);
+    portENTER_CRITICAL(&mpcpufreq_mux);
+    mpcpufreq_switch(mhz);
+    portEXIT_CRITICAL(&mpcpufreq_mux);
+    return true;
+}
+
+uint32_t mpcpufreq_get (void) {
+    return ets_get_cpu_frequency();
+}
+
+bool mpcpufreq_set_auto (bool enable, uint32_t low_mhz, uint32_t high_mhz, uint32_t idle_ms) {
+    if (!enable) {
+        if (mpcpufreq.auto_enabled) {
+            esp_timer_stop(mpcpufreq.timer);
+            mpcpufreq.auto_enabled = false;
+        }
+        return true;
+    }
+    if (mpcpufreq_state(low_mhz) < 0 || mpcpufreq_state(high_mhz) < 0 || low_mhz > high_mhz) {
+        return false;
+    }
+    portENTER_CRITICAL(&mpcpufreq_mux);
+    mpcpufreq.low_mhz = low_mhz;
+    mpcpufreq.high_mhz = high_mhz;
+    mpcpufreq.idle_samples = (idle_ms * 1000 + MPCPUFREQ_SAMPLE_PERIOD_US - 1) / MPCPUFREQ_SAMPLE_PERIOD_US;
+    mpcpufreq.idle_count = 0;
+    // the caller is running Python code
+    mpcpufreq_switch(high_mhz);
+    portEXIT_CRITICAL(&mpcpufreq_mux);
+    if (!mpcpufreq.auto_enabled) {
+        mpcpufreq.auto_enabled = true;
+        esp_timer_start_periodic(mpcpufreq.timer, MPCPUFREQ_SAMPLE_PERIOD_US);
+    }
+    return true;
+}
+
+bool mpcpufreq_get_auto (void) {
+    return mpcpufreq.auto_enabled;
+}
+
+// Keeps the high frequency until the matching release, for the work that is CPU bound (TLS handshake, OTA patch)
+void mpcpufreq_boost_acquire (void) {
+    portENTER_CRITICAL(&mpcpufreq_mux);
+    if (mpcpufreq.boost++ == 0 && mpcpufreq.auto_enabled) {
+        mpcpufreq.idle_count = 0;
+        mpcpufreq_switch(mpcpufreq.high_mhz);
+    }
+    portEXIT_CRITICAL(&mpcpufreq_mux);
+}
+
+void mpcpufreq_boost_release (void) {
+    portENTER_CRITICAL(&mpcpufreq_mux);
+    if (mpcpufreq.boost > 0) {
+        mpcpufreq.boost--;
+    }
+    portEXIT_CRITICAL(&mpcpufreq_mux);
+}
+
+void mpcpufreq_get_stats (mpcpufreq_stats_t *stats, bool reset) {
+    portENTER_CRITICAL(&mpcpufreq_mux);
+    int64_t now = esp_timer_get_time();
+    mpcpufreq.stats.time_us[mpcpufreq_state(mpcpufreq.mhz)] += now - mpcpufreq.state_start;
+    mpcpufreq.state_start = now;
+    *stats = mpcpufreq.stats;
+    if (reset) {
+        memset(&mpcpufreq.stats, 0, sizeof(mpcpufreq.stats));
+    }
+    portEXIT_CRITICAL(&mpcpufreq_mux);
+}
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC int mpcpufreq_state (uint32_t mhz) {
+    switch (mhz) {
+    case 80:
+        return 0;
+    case 160:
+        return 1;
+    case 240:
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+// Must be called in the critical section
+STATIC void mpcpufreq_switch (uint32_t mhz) {
+    uint32_t old_mhz = ets_get_cpu_frequency();
+    if (mhz == old_mhz) {
+        return;
+    }
+    rtc_cpu_freq_config_t config;
+    if (!rtc_clk_cpu_freq_mhz_to_config(mhz, &config)) {
+        return;
+    }
+    rtc_clk_cpu_freq_set_config(&config);
+    ets_update_cpu_frequency(mhz);
+
+    // the tick is counted in CPU cycles, scale what remains of the current one on this core
+    // the other core catches up at its next tick
+    _xt_tick_divisor = mhz * 1000000 / XT_TICK_PER_SEC;
+    uint32_t ccount = XTHAL_GET_CCOUNT();
+    uint32_t ccompare = XTHAL_GET_CCOMPARE(XT_TIMER_INDEX);
+    if ((ccompare - MPCPUFREQ_CCOMPARE_MIN_CYCLES) - ccount < UINT32_MAX / 2) {
+        uint32_t diff = ((ccompare - ccount) / old_mhz) * mhz;
+        if (diff < _xt_tick_divisor) {
+            XTHAL_SET_CCOMPARE(XT_TIMER_INDEX, ccount + diff);
+        }
+    }
+
+    int64_t now = esp_timer_get_time();
+    mpcpufreq.stats.time_us[mpcpufreq_state(mpcpufreq.mhz)] += now - mpcpufreq.state_start;
+    mpcpufreq.stats.switches++;
+    mpcpufreq.state_start = now;
+    mpcpufreq.mhz = mhz;
+}
+
+// Runs from the esp_timer task, the VM is considered busy while a thread holds the GIL
+STATIC void mpcpufreq_sample (void *arg) {
+    bool busy = mpcpufreq.boost > 0;
+#if MICROPY_PY_THREAD_GIL
+    if (MP_STATE_VM(gil_mutex).handle != NULL && uxSemaphoreGetCount(MP_STATE_VM(gil_mutex).handle) == 0) {
+        busy = true;
+    }
+#endif
+
+    portENTER_CRITICAL(&mpcpufreq_mux);
+    if (mpcpufreq.auto_enabled) {
+        if (busy) {
+            mpcpufreq.idle_count = 0;
+            mpcpufreq_switch(mpcpufreq.high_mhz);
+        } else if (++mpcpufreq.idle_count >= mpcpufreq.idle_samples) {
+            mpcpufreq_switch(mpcpufreq.low_mhz);
+        }
+    }
+    portEXIT_CRITICAL(&mpcpufreq_mux);
+}
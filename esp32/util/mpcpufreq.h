@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef MPCPUFREQ_H_
+#define MPCPUFREQ_H_
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+// the APB stays at 80 MHz only with the PLL, the lower frequencies would change the peripheral clocks
+#define MPCPUFREQ_NUM_STATES                        (3)
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+typedef struct {
+    uint64_t time_us[MPCPUFREQ_NUM_STATES];         // time spent at 80, 160 and 240 MHz
+    uint32_t switches;
+} mpcpufreq_stats_t;
+
+/******************************************************************************
+ DECLARE FUNCTIONS
+ ******************************************************************************/
+void mpcpufreq_init0 (void);
+bool mpcpufreq_set (uint32_t mhz);
+uint32_t mpcpufreq_get (void);
+bool mpcpufreq_set_auto (bool enable, uint32_t low_mhz, uint32_t high_mhz, uint32_t idle_ms);
+bool mpcpufreq_get_auto (void);
+void mpcpufreq_boost_acquire (void);
+void mpcpufreq_boost_release (void);
+void mpcpufreq_get_stats (mpcpufreq_stats_t *stats, bool reset);
+
+#endif /* MPCPUFREQ_H_ */
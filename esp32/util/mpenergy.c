@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "py/mpconfig.h"
+#include "py/misc.h"
+
+#include "mpenergy.h"
+
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+typedef struct {
+    uint64_t active_us;                             // of the spans ended
+    int64_t since;                                  // start of the running span
+    uint32_t spans;
+    uint32_t current_ua;
+    bool active;
+} mpenergy_account_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+// the CPU is awake from boot, esp_timer_get_time() starts there too
+static DRAM_ATTR mpenergy_account_t mpenergy_rails[MPENERGY_RAIL_COUNT] = {
+    [MPENERGY_RAIL_CPU]         = { .current_ua = MICROPY_HW_ENERGY_CPU_UA, .active = true, .spans = 1 },
+    [MPENERGY_RAIL_FLASH]       = { .current_ua = MICROPY_HW_ENERGY_FLASH_UA },
+    [MPENERGY_RAIL_LORA_TX]     = { .current_ua = MICROPY_HW_ENERGY_LORA_TX_UA },
+    [MPENERGY_RAIL_LORA_RX]     = { .current_ua = MICROPY_HW_ENERGY_LORA_RX_UA },
+    [MPENERGY_RAIL_SIGFOX]      = { .current_ua = MICROPY_HW_ENERGY_SIGFOX_UA },
+    [MPENERGY_RAIL_LTE]         = { .current_ua = MICROPY_HW_ENERGY_LTE_UA },
+    [MPENERGY_RAIL_WLAN]        = { .current_ua = MICROPY_HW_ENERGY_WLAN_UA },
+};
+static DRAM_ATTR uint32_t mpenergy_msgs[MPENERGY_LINK_COUNT];
+static int64_t mpenergy_start;
+static uint32_t mpenergy_voltage_mv = MICROPY_HW_ENERGY_VOLTAGE_MV;
+static portMUX_TYPE mpenergy_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// the radio rails of each link
+static const uint8_t mpenergy_link_rails[MPENERGY_LINK_COUNT][2] = {
+    [MPENERGY_LINK_LORA]        = { MPENERGY_RAIL_LORA_TX, MPENERGY_RAIL_LORA_RX },
+    [MPENERGY_LINK_SIGFOX]      = { MPENERGY_RAIL_SIGFOX, MPENERGY_RAIL_COUNT },
+    [MPENERGY_LINK_LTE]         = { MPENERGY_RAIL_LTE, MPENERGY_RAIL_COUNT },
+    [MPENERGY_LINK_WLAN]        = { MPENERGY_RAIL_WLAN, MPENERGY_RAIL_COUNT },
+};
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+// called with the lock held
+static uint64_t mpenergy_active_us(const mpenergy_account_t *r, int64_t now) {
+    return r->active_us + (r->active ? (uint64_t)(now - r->since) : 0);
+}
+
+// µs x µA x mV overflows 64 bits within hours, reduced to nC first it holds for months
+static uint64_t mpenergy_uj(uint64_t active_us, uint32_t current_ua, uint32_t voltage_mv) {
+    return ((active_us * current_ua) / 1000) * voltage_mv / 1000000;
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+IRAM_ATTR void mpenergy_set(mpenergy_rail_t rail, bool active) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&mpenergy_mux);
+    mpenergy_account_t *r = &mpenergy_rails[rail];
+    if (active && !r->active) {
+        r->since = now;
+        r->spans++;
+        r->active = true;
+    } else if (!active && r->active) {
+        r->active_us += now - r->since;
+        r->active = false;
+    }
+    portEXIT_CRITICAL(&mpenergy_mux);
+}
+
+IRAM_ATTR void mpenergy_message(mpenergy_link_t link, uint32_t count) {
+    portENTER_CRITICAL(&mpenergy_mux);
+    mpenergy_msgs[link] += count;
+    portEXIT_CRITICAL(&mpenergy_mux);
+}
+
+void mpenergy_get_rail(mpenergy_rail_t rail, mpenergy_rail_stats_t *stats) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&mpenergy_mux);
+    mpenergy_account_t *r = &mpenergy_rails[rail];
+    stats->active_us = mpenergy_active_us(r, now);
+    stats->spans = r->spans;
+    stats->current_ua = r->current_ua;
+    stats->active = r->active;
+    portEXIT_CRITICAL(&mpenergy_mux);
+}
+
+uint32_t mpenergy_messages(mpenergy_link_t link) {
+    return mpenergy_msgs[link];
+}
+
+uint64_t mpenergy_rail_uj(mpenergy_rail_t rail) {
+    mpenergy_rail_stats_t stats;
+    mpenergy_get_rail(rail, &stats);
+    return mpenergy_uj(stats.active_us, stats.current_ua, mpenergy_voltage_mv);
+}
+
+uint64_t mpenergy_link_uj(mpenergy_link_t link) {
+    uint64_t uj = 0;
+    for (uint32_t i = 0; i < MP_ARRAY_SIZE(mpenergy_link_rails[0]); i++) {
+        if (mpenergy_link_rails[link][i] < MPENERGY_RAIL_COUNT) {
+            uj += mpenergy_rail_uj(mpenergy_link_rails[link][i]);
+        }
+    }
+    return uj;
+}
+
+uint64_t mpenergy_total_uj(void) {
+    uint64_t uj = 0;
+    for (uint32_t i = 0; i < MPENERGY_RAIL_COUNT; i++) {
+        uj += mpenergy_rail_uj(i);
+    }
+    return uj;
+}
+
+uint32_t mpenergy_total_messages(void) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < MPENERGY_LINK_COUNT; i++) {
+        count += mpenergy_msgs[i];
+    }
+    return count;
+}
+
+uint64_t mpenergy_elapsed_us(void) {
+    return esp_timer_get_time() - mpenergy_start;
+}
+
+void mpenergy_set_current(mpenergy_rail_t rail, uint32_t current_ua) {
+    mpenergy_rails[rail].current_ua = current_ua;
+}
+
+void mpenergy_set_voltage(uint32_t voltage_mv) {
+    mpenergy_voltage_mv = voltage_mv;
+}
+
+uint32_t mpenergy_get_voltage(void) {
+    return mpenergy_voltage_mv;
+}
+
+void mpenergy_reset(void) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&mpenergy_mux);
+    for (uint32_t i = 0; i < MPENERGY_RAIL_COUNT; i++) {
+        mpenergy_account_t *r = &mpenergy_rails[i];
+        r->active_us = 0;
+        r->since = now;
+        r->spans = r->active ? 1 : 0;
+    }
+    memset(mpenergy_msgs, 0, sizeof(mpenergy_msgs));
+    mpenergy_start = now;
+    portEXIT_CRITICAL(&mpenergy_mux);
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef MPENERGY_H_
+#define MPENERGY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "py/mpconfig.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+// the typical currents of the rails in µA, the boards give the ones of their radios in mpconfigboard.h
+#ifndef MICROPY_HW_ENERGY_VOLTAGE_MV
+#define MICROPY_HW_ENERGY_VOLTAGE_MV                (3300)
+#endif
+#ifndef MICROPY_HW_ENERGY_CPU_UA
+#define MICROPY_HW_ENERGY_CPU_UA                    (40000)     // both cores awake at 160 MHz, light sleep excluded
+#endif
+#ifndef MICROPY_HW_ENERGY_FLASH_UA
+#define MICROPY_HW_ENERGY_FLASH_UA                  (20000)     // program or erase of the SPI flash
+#endif
+#ifndef MICROPY_HW_ENERGY_WLAN_UA
+#define MICROPY_HW_ENERGY_WLAN_UA                   (80000)     // WiFi started, on top of the CPU
+#endif
+#ifndef MICROPY_HW_ENERGY_LORA_TX_UA
+#define MICROPY_HW_ENERGY_LORA_TX_UA                (0)
+#endif
+#ifndef MICROPY_HW_ENERGY_LORA_RX_UA
+#define MICROPY_HW_ENERGY_LORA_RX_UA                (0)
+#endif
+#ifndef MICROPY_HW_ENERGY_SIGFOX_UA
+#define MICROPY_HW_ENERGY_SIGFOX_UA                 (0)
+#endif
+#ifndef MICROPY_HW_ENERGY_LTE_UA
+#define MICROPY_HW_ENERGY_LTE_UA                    (0)
+#endif
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// the parts of the board drawing current while active
+typedef enum {
+    MPENERGY_RAIL_CPU = 0,
+    MPENERGY_RAIL_FLASH,
+    MPENERGY_RAIL_LORA_TX,
+    MPENERGY_RAIL_LORA_RX,                          // receiving or listening, CAD included
+    MPENERGY_RAIL_SIGFOX,
+    MPENERGY_RAIL_LTE,                              // modem attached or attaching
+    MPENERGY_RAIL_WLAN,
+    MPENERGY_RAIL_COUNT
+} mpenergy_rail_t;
+
+// the links the messages are delivered over, each one is charged with its radio rails
+typedef enum {
+    MPENERGY_LINK_LORA = 0,
+    MPENERGY_LINK_SIGFOX,
+    MPENERGY_LINK_LTE,
+    MPENERGY_LINK_WLAN,
+    MPENERGY_LINK_COUNT
+} mpenergy_link_t;
+
+typedef struct {
+    uint64_t active_us;                             // the running span included
+    uint32_t spans;
+    uint32_t current_ua;
+    bool active;
+} mpenergy_rail_stats_t;
+
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+// from any context including the ISRs, setting the state a rail is already in does nothing
+extern void mpenergy_set(mpenergy_rail_t rail, bool active);
+extern void mpenergy_message(mpenergy_link_t link, uint32_t count);
+
+extern void mpenergy_get_rail(mpenergy_rail_t rail, mpenergy_rail_stats_t *stats);
+extern uint32_t mpenergy_messages(mpenergy_link_t link);
+extern uint64_t mpenergy_rail_uj(mpenergy_rail_t rail);
+extern uint64_t mpenergy_link_uj(mpenergy_link_t link);
+extern uint64_t mpenergy_total_uj(void);
+extern uint32_t mpenergy_total_messages(void);
+// since boot or the last reset
+extern uint64_t mpenergy_elapsed_us(void);
+
+extern void mpenergy_set_current(mpenergy_rail_t rail, uint32_t current_ua);
+extern void mpenergy_set_voltage(uint32_t voltage_mv);
+extern uint32_t mpenergy_get_voltage(void);
+
+// clears the times and the messages, the active rails start a new span, the currents are kept
+extern void mpenergy_reset(void);
+
+#endif /* MPENERGY_H_ */
@@ -7,6 +7,8 @@
  * available at https://www.pycom.io/opensource/licensing
  */
 
+#include <string.h>
+
 #include "py/mpconfig.h"
 #include "py/obj.h"
 #include "py/runtime.h"
@@ -14,12 +16,14 @@
 #include "mpexception.h"
 #include "mperror.h"
 #include "mpirq.h"
+#include "mptrace.h"
 #include "mpthreadport.h"
 #include "py/stackctrl.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_attr.h"
+#include "esp_spi_flash.h"
 
 #if MICROPY_PY_THREAD
 
@@ -34,11 +38,69 @@ typedef struct {
 STATIC QueueHandle_t InterruptsQueue;
 STATIC bool mp_irq_is_alive;
 
+// the sources (handler and argument) waiting in InterruptsQueue, at most one entry each
+STATIC mp_callback_obj_t mp_irq_pending[INTERRUPTS_QUEUE_LEN];
+STATIC portMUX_TYPE mp_irq_pending_mux = portMUX_INITIALIZER_UNLOCKED;
+STATIC mp_irq_stats_t mp_irq_stats;
+
 STATIC mpirq_args_t mpirq_args;
 
+// the thread state of the hard handlers, one per core as both can take interrupts
+STATIC mp_state_thread_t mp_irq_hard_state[portNUM_PROCESSORS];
+
 /******************************************************************************
  DECLARE PRIVATE FUNCTIONS
  ******************************************************************************/
+// Returns true if the event has to be queued, false if it was merged with a pending one or dropped
+STATIC IRAM_ATTR bool mp_irq_pending_add(const mp_callback_obj_t *cb) {
+    bool queue = false;
+    int free_slot = -1;
+
+    portENTER_CRITICAL_ISR(&mp_irq_pending_mux);
+    for (int i = 0; i < INTERRUPTS_QUEUE_LEN; i++) {
+        if (mp_irq_pending[i].handler == cb->handler && mp_irq_pending[i].arg == cb->arg) {
+            mp_irq_stats.coalesced++;
+            goto done;
+        }
+        if (mp_irq_pending[i].handler == NULL && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0) {
+        mp_irq_stats.dropped++;
+    } else {
+        mp_irq_pending[free_slot] = *cb;
+        mp_irq_stats.queued++;
+        queue = true;
+    }
+done:
+    portEXIT_CRITICAL_ISR(&mp_irq_pending_mux);
+    return queue;
+}
+
+// Forgets a pending source, either because it's about to run or because the queue was full
+STATIC IRAM_ATTR void mp_irq_pending_remove(const mp_callback_obj_t *cb, bool dropped) {
+    portENTER_CRITICAL_ISR(&mp_irq_pending_mux);
+    for (int i = 0; i < INTERRUPTS_QUEUE_LEN; i++) {
+        if (mp_irq_pending[i].handler == cb->handler && mp_irq_pending[i].arg == cb->arg) {
+            mp_irq_pending[i].handler = NULL;
+            mp_irq_pending[i].arg = NULL;
+            break;
+        }
+    }
+    if (dropped) {
+        mp_irq_stats.queued--;
+        mp_irq_stats.dropped++;
+    }
+    portEXIT_CRITICAL_ISR(&mp_irq_pending_mux);
+}
+
+STATIC void mp_irq_pending_reset(void) {
+    portENTER_CRITICAL(&mp_irq_pending_mux);
+    memset(mp_irq_pending, 0, sizeof(mp_irq_pending));
+    portEXIT_CRITICAL(&mp_irq_pending_mux);
+}
+
 static void *TASK_Interrupts(void *pvParameters) {
     mpirq_args_t *args = (mpirq_args_t *)pvParameters;
 
@@ -48,6 +110,9 @@ static void *TASK_Interrupts(void *pvParameters) {
 
     mp_stack_set_top(&ts + 1); // need to include ts in root-pointer scan
     mp_stack_set_limit(INTERRUPTS_TASK_STACK_SIZE - 1024);
+    #if MICROPY_ENABLE_PYSTACK
+    mp_thread_pystack_init();
+    #endif
 
     mp_locals_set(args->dict_locals);
     mp_globals_set(args->dict_globals);
@@ -65,12 +130,17 @@ static void *TASK_Interrupts(void *pvParameters) {
             break;
         }
 
+        // the events of this source that arrive from now on need another call
+        mp_irq_pending_remove(&cb, false);
+
         MP_THREAD_GIL_ENTER();
 
+        MPTRACE(MPTRACE_IRQ_RUN, cb.handler, 0);
         nlr_buf_t nlr;
         if (nlr_push(&nlr) == 0) {
             cb.handler(cb.arg);
             nlr_pop();
+            MPTRACE(MPTRACE_IRQ_DONE, cb.handler, 0);
         } else {
             // uncaught exception, check for SystemExit
             mp_obj_base_t *exc = (mp_obj_base_t*)nlr.ret_val;
@@ -98,6 +168,12 @@ static void *TASK_Interrupts(void *pvParameters) {
     return NULL;
 }
 
+STATIC void mp_irq_hard_exception(void *exc) {
+    // this function will be called by the interrupt thread
+    mp_printf(&mp_plat_print, "Unhandled exception in hard callback handler\n");
+    mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(exc));
+}
+
 /******************************************************************************
  DEFINE PUBLIC FUNCTIONS
  ******************************************************************************/
@@ -113,6 +189,7 @@ void mp_irq_init0(void) {
 
     mp_irq_is_alive = true;
     xQueueReset(InterruptsQueue);
+    mp_irq_pending_reset();
 
     mpirq_args.dict_locals = mp_locals_get();
     mpirq_args.dict_globals = mp_globals_get();
@@ -151,7 +228,17 @@ void IRAM_ATTR mp_irq_queue_interrupt(void (* handler)(void *), void *arg) {
 
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
-    xQueueSendFromISR(InterruptsQueue, &cb, &xHigherPriorityTaskWoken);
+    // the NULL handler that kills the task is never merged
+    if (handler != NULL && !mp_irq_pending_add(&cb)) {
+        MPTRACE(MPTRACE_IRQ_QUEUED, handler, 1);
+        return;
+    }
+    if (xQueueSendFromISR(InterruptsQueue, &cb, &xHigherPriorityTaskWoken) != pdTRUE && handler != NULL) {
+        MPTRACE(MPTRACE_IRQ_QUEUED, handler, 2);
+        mp_irq_pending_remove(&cb, true);
+    } else {
+        MPTRACE(MPTRACE_IRQ_QUEUED, handler, 0);
+    }
 
     if( xHigherPriorityTaskWoken)
     {
@@ -161,7 +248,12 @@ void IRAM_ATTR mp_irq_queue_interrupt(void (* handler)(void *), void *arg) {
 
 void mp_irq_queue_interrupt_non_ISR(void (* handler)(void *), void *arg) {
     mp_callback_obj_t cb = {.handler = handler, .arg = arg};
-    (void)xQueueSend(InterruptsQueue, &cb, 0);
+    if (!mp_irq_pending_add(&cb)) {
+        return;
+    }
+    if (xQueueSend(InterruptsQueue, &cb, 0) != pdTRUE) {
+        mp_irq_pending_remove(&cb, true);
+    }
 }
 
 void IRAM_ATTR mp_irq_queue_interrupt_immediate_thread_delete(TaskHandle_t id) {
@@ -183,13 +275,76 @@ void mp_irq_kill(void) {
         vTaskDelay(3 / portTICK_PERIOD_MS);
     } while (mp_irq_is_alive);
     xQueueReset(InterruptsQueue);
+    mp_irq_pending_reset();
     // TODO disable all interrupts here at hardware level
 }
 
+void mp_irq_get_stats(mp_irq_stats_t *stats, bool clear) {
+    portENTER_CRITICAL(&mp_irq_pending_mux);
+    *stats = mp_irq_stats;
+    if (clear) {
+        memset(&mp_irq_stats, 0, sizeof(mp_irq_stats));
+    }
+    portEXIT_CRITICAL(&mp_irq_pending_mux);
+}
+
+// Hard handlers run straight from the interrupt without the GIL, hence they
+// can't allocate and are limited to native and viper code which needs less of
+// the small interrupt stack than the bytecode VM.
+void mp_irq_check_hard_handler(mp_obj_t handler) {
+    if (!mp_obj_fun_is_native(handler)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "hard handlers must be native or viper functions"));
+    }
+}
+
+bool IRAM_ATTR mp_irq_in_hard_handler(void) {
+    return mp_thread_isr_state[xPortGetCoreID()] != NULL;
+}
+
+// Returns false when the handler can't run now and has to go through the queue
+bool IRAM_ATTR mp_irq_call_hard(mp_obj_t handler, mp_obj_t arg) {
+    // the runtime is in flash, unreachable while a flash operation disables the cache
+    if (!spi_flash_cache_enabled()) {
+        return false;
+    }
+    uint32_t core = xPortGetCoreID();
+    if (mp_thread_isr_state[core] != NULL) {
+        return false;
+    }
+
+    mp_state_thread_t *ts = &mp_irq_hard_state[core];
+    memset(ts, 0, sizeof(*ts));
+    ts->dict_locals = mpirq_args.dict_locals;
+    ts->dict_globals = mpirq_args.dict_globals;
+    mp_thread_isr_state[core] = ts;
+    mp_stack_set_top(&ts);
+    mp_stack_set_limit(INTERRUPTS_HARD_STACK_LIMIT);
+
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_call_function_1(handler, arg);
+        nlr_pop();
+    } else {
+        // nothing can be allocated here, so the exception is a static or an existing object
+        mp_irq_queue_interrupt(mp_irq_hard_exception, nlr.ret_val);
+    }
+
+    mp_thread_isr_state[core] = NULL;
+    return true;
+}
+
 #else
 
 void IRAM_ATTR mp_irq_queue_interrupt(void (* handler)(void *), void *arg) {
 
 }
 
+bool IRAM_ATTR mp_irq_in_hard_handler(void) {
+    return false;
+}
+
+void mp_irq_get_stats(mp_irq_stats_t *stats, bool clear) {
+    memset(stats, 0, sizeof(*stats));
+}
+
 #endif  // MICROPY_PY_THREAD
@@ -21,6 +21,9 @@
 
 #define INTERRUPTS_QUEUE_LEN                       (32)
 
+// stack the hard handlers may use on top of the interrupt stack already in use
+#define INTERRUPTS_HARD_STACK_LIMIT                (1024)
+
 #define INTERRUPT_OBJ_CLEAN(obj)                   {\
                                                        (obj)->handler = NULL; \
                                                        (obj)->handler_arg = NULL; \
@@ -34,6 +37,12 @@ typedef struct {
     void *arg;
 } mp_callback_obj_t;
 
+typedef struct {
+    uint32_t queued;        // events passed on to the interrupts task
+    uint32_t coalesced;     // events merged with one of the same source still in the queue
+    uint32_t dropped;       // events lost because the queue was full
+} mp_irq_stats_t;
+
 /******************************************************************************
  DECLARE EXPORTED DATA
  ******************************************************************************/
@@ -52,4 +61,7 @@ void mp_irq_queue_interrupt(void (* handler)(void *), void *arg);
 void mp_irq_queue_interrupt_non_ISR(void (* handler)(void *), void *arg);
 void mp_irq_queue_interrupt_immediate_thread_delete(TaskHandle_t id);
 void mp_irq_kill(void);
+void mp_irq_get_stats(mp_irq_stats_t *stats, bool clear);
+void mp_irq_check_hard_handler(mp_obj_t handler);
+bool mp_irq_call_hard(mp_obj_t handler, mp_obj_t arg);
 #endif /* MPIRQ_H_ */
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <string.h>
+
+#include "py/mpconfig.h"
+#include "py/obj.h"
+#include "py/runtime.h"
+#include "py/stream.h"
+#include "extmod/moduselect.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+
+#include "lwip/sockets.h"
+
+#include "modnetwork.h"
+#include "modusocket.h"
+#include "lwipsocket.h"
+#include "machuart.h"
+#include "moduqueue.h"
+#include "mppoll.h"
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+// the shorter of two waits in ms, a negative one is endless
+#define MPPOLL_MIN_WAIT(a, b)                       (((a) < 0 || (b) < (a)) ? (b) : (a))
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+// given by every source of events that can make a polled object ready
+static SemaphoreHandle_t mp_poll_sem = NULL;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+STATIC bool mp_poll_is_lwip_socket (mp_obj_t obj) {
+    // plain and SSL sockets share the stream protocol, raw LoRa and Sigfox sockets have their own
+    if (mp_obj_get_type(obj)->protocol != &socket_stream_p) {
+        return false;
+    }
+    mod_network_socket_obj_t *s = MP_OBJ_TO_PTR(obj);
+    return s->sock_base.nic_type != NULL && s->sock_base.nic_type->n_ioctl == lwipsocket_socket_ioctl && s->sock_base.u.sd >= 0;
+}
+
+STATIC bool mp_poll_has_wake_source (mp_obj_t obj) {
+    if (mp_obj_is_type(obj, &mach_uart_type) || mp_obj_is_type(obj, &mp_queue_type)) {
+        return true;
+    }
+#if defined(LOPY) || defined(LOPY4) || defined(FIPY)
+    if (mp_obj_get_type(obj)->protocol == &raw_socket_stream_p) {
+        mod_network_socket_obj_t *s = MP_OBJ_TO_PTR(obj);
+        return s->sock_base.nic_type == &mod_network_nic_type_lora;
+    }
+#endif
+    return false;
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void mp_poll_preinit (void) {
+    mp_poll_sem = xSemaphoreCreateBinary();
+}
+
+void mp_poll_wake (void) {
+    if (mp_poll_sem != NULL) {
+        xSemaphoreGive(mp_poll_sem);
+    }
+}
+
+IRAM_ATTR void mp_poll_wake_from_isr (void) {
+    if (mp_poll_sem != NULL) {
+        xSemaphoreGiveFromISR(mp_poll_sem, NULL);
+    }
+}
+
+// Called by select() and poll() when none of the objects is ready, sleeps until one of them may be or for timeout_ms
+// (-1 waits forever). lwIP sockets are waited for with lwIP select, the other objects through their wake up source.
+void mp_poll_wait (mp_map_t *poll_map, mp_int_t timeout_ms) {
+    fd_set rset, wset, xset;
+    int maxfd = -1;
+    bool others = false;
+    mp_int_t slice = timeout_ms;
+
+    FD_ZERO(&rset);
+    FD_ZERO(&wset);
+    FD_ZERO(&xset);
+    for (mp_uint_t i = 0; i < poll_map->alloc; i++) {
+        if (!mp_map_slot_is_filled(poll_map, i)) {
+            continue;
+        }
+        poll_obj_t *poll_obj = MP_OBJ_TO_PTR(poll_map->table[i].value);
+        if (poll_obj->flags == 0) {
+            continue;
+        }
+        if (mp_poll_is_lwip_socket(poll_obj->obj)) {
+            int sd = ((mod_network_socket_obj_t *)MP_OBJ_TO_PTR(poll_obj->obj))->sock_base.u.sd;
+            if (poll_obj->flags & MP_STREAM_POLL_RD) {
+                FD_SET(sd, &rset);
+            }
+            if (poll_obj->flags & MP_STREAM_POLL_WR) {
+                FD_SET(sd, &wset);
+            }
+            FD_SET(sd, &xset);
+            maxfd = MAX(maxfd, sd);
+        } else {
+            others = true;
+            if (!mp_poll_has_wake_source(poll_obj->obj)) {
+                slice = MPPOLL_MIN_WAIT(slice, MPPOLL_POLLED_SLICE_MS);
+            }
+        }
+    }
+    if (maxfd >= 0) {
+        slice = MPPOLL_MIN_WAIT(slice, others ? MPPOLL_MIXED_SLICE_MS : MPPOLL_IP_SLICE_MS);
+    }
+
+    MP_THREAD_GIL_EXIT();
+    if (maxfd >= 0) {
+        struct timeval tv = { .tv_sec = slice / 1000, .tv_usec = (slice % 1000) * 1000 };
+        lwip_select_r(maxfd + 1, &rset, &wset, &xset, &tv);
+        // the wake ups that happened meanwhile are covered by the poll that follows
+        xSemaphoreTake(mp_poll_sem, 0);
+    } else {
+        xSemaphoreTake(mp_poll_sem, (slice < 0) ? portMAX_DELAY : MAX(pdMS_TO_TICKS(slice), 1));
+    }
+    MP_THREAD_GIL_ENTER();
+
+    // a keyboard interrupt ends the wait
+    if (MP_STATE_VM(mp_pending_exception) != MP_OBJ_NULL) {
+        mp_obj_t obj = MP_STATE_VM(mp_pending_exception);
+        MP_STATE_VM(mp_pending_exception) = MP_OBJ_NULL;
+        nlr_raise(obj);
+    }
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef MPPOLL_H_
+#define MPPOLL_H_
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+// longest sleep while only lwIP sockets are polled, lwIP can't be woken up by a keyboard interrupt
+#define MPPOLL_IP_SLICE_MS                          (100)
+// longest sleep of lwIP select when objects without a socket are polled too
+#define MPPOLL_MIXED_SLICE_MS                       (10)
+// objects without a wake up source are polled as often as before
+#define MPPOLL_POLLED_SLICE_MS                      (1)
+
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void mp_poll_preinit (void);
+void mp_poll_wake (void);
+void mp_poll_wake_from_isr (void);
+void mp_poll_wait (mp_map_t *poll_map, mp_int_t timeout_ms);
+
+#endif /* MPPOLL_H_ */
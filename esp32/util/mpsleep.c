@@ -72,6 +72,12 @@ void mpsleep_init0 (void) {
         case ESP_SLEEP_WAKEUP_TIMER:
             mpsleep_wake_reason = MPSLEEP_RTC_WAKE;
             break;
+        case ESP_SLEEP_WAKEUP_ULP:
+            mpsleep_wake_reason = MPSLEEP_ULP_WAKE;
+            break;
+        case ESP_SLEEP_WAKEUP_TOUCHPAD:
+            mpsleep_wake_reason = MPSLEEP_TOUCH_WAKE;
+            break;
         case ESP_SLEEP_WAKEUP_UNDEFINED:
         default:
             mpsleep_wake_reason = MPSLEEP_PWRON_WAKE;
@@ -31,7 +31,8 @@ typedef enum {
     MPSLEEP_PWRON_WAKE = 0,
     MPSLEEP_GPIO_WAKE,
     MPSLEEP_RTC_WAKE,
-    MPSLEEP_ULP_WAKE
+    MPSLEEP_ULP_WAKE,
+    MPSLEEP_TOUCH_WAKE
 } mpsleep_wake_reason_t;
 
 /******************************************************************************
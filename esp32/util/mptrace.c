@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "py/mpconfig.h"
+#include "py/misc.h"
+
+#include "mptrace.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// every core writes only into its own ring, so masking the interrupts of the core is enough
+typedef struct {
+    mptrace_record_t *records;
+    volatile uint32_t head;         // records written so far
+    uint32_t tail;                  // first record not dumped yet
+} mptrace_ring_t;
+
+/******************************************************************************
+ DECLARE PUBLIC DATA
+ ******************************************************************************/
+DRAM_ATTR volatile uint32_t mptrace_mask = 0;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+static DRAM_ATTR mptrace_ring_t mptrace_rings[portNUM_PROCESSORS];
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+static uint32_t mptrace_dump_ring(mptrace_ring_t *ring, mptrace_record_t *dest, uint32_t max) {
+    uint32_t head = ring->head;
+    uint32_t tail = ring->tail;
+    if (head - tail > MPTRACE_DEPTH) {
+        tail = head - MPTRACE_DEPTH;
+    }
+    uint32_t n = MIN(head - tail, max);
+    for (uint32_t i = 0; i < n; i++) {
+        dest[i] = ring->records[(tail + i) & (MPTRACE_DEPTH - 1)];
+    }
+    ring->tail = tail + n;
+
+    // the core may have written over the oldest ones meanwhile, they are lost
+    uint32_t oldest = ring->head - MPTRACE_DEPTH;
+    uint32_t skip = 0;
+    if ((int32_t)(oldest - tail) > 0) {
+        skip = MIN(oldest - tail, n);
+        memmove(dest, &dest[skip], (n - skip) * sizeof(mptrace_record_t));
+    }
+    return n - skip;
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+// the rings are only allocated the first time that tracing is enabled
+bool mptrace_enable(uint32_t mask) {
+    if (mask != 0 && mptrace_rings[0].records == NULL) {
+        mptrace_record_t *records = heap_caps_malloc(portNUM_PROCESSORS * MPTRACE_DEPTH * sizeof(mptrace_record_t),
+                                                     MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (records == NULL) {
+            return false;
+        }
+        for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+            mptrace_rings[core].records = &records[core * MPTRACE_DEPTH];
+        }
+    }
+    mptrace_mask = mask;
+    return true;
+}
+
+void IRAM_ATTR mptrace_record(uint16_t id, uint32_t arg0, uint32_t arg1) {
+    uint32_t state = portENTER_CRITICAL_NESTED();
+    uint32_t core = xPortGetCoreID();
+    mptrace_ring_t *ring = &mptrace_rings[core];
+    uint32_t index = ring->head;
+    mptrace_record_t *record = &ring->records[index & (MPTRACE_DEPTH - 1)];
+    ring->head = index + 1;
+    record->timestamp = (uint32_t)esp_timer_get_time();
+    record->id = id;
+    record->core = core;
+    record->seq = index;
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+    portEXIT_CRITICAL_NESTED(state);
+}
+
+uint32_t mptrace_pending(void) {
+    uint32_t pending = 0;
+    if (mptrace_rings[0].records != NULL) {
+        for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+            pending += MIN(mptrace_rings[core].head - mptrace_rings[core].tail, MPTRACE_DEPTH);
+        }
+    }
+    return pending;
+}
+
+// moves up to max records into dest, the oldest first for each core
+uint32_t mptrace_dump(mptrace_record_t *dest, uint32_t max) {
+    uint32_t n = 0;
+    if (mptrace_rings[0].records != NULL) {
+        for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+            n += mptrace_dump_ring(&mptrace_rings[core], &dest[n], max - n);
+        }
+    }
+    return n;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef MPTRACE_H_
+#define MPTRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+// records kept per core, must be a power of 2
+#define MPTRACE_DEPTH                               (256)
+
+// the sources, each one is enabled by its bit in the mask
+#define MPTRACE_SRC_LORA                            (1)
+#define MPTRACE_SRC_LTE                             (2)
+#define MPTRACE_SRC_IRQ                             (3)
+#define MPTRACE_SRC_GC                              (4)
+#define MPTRACE_SRC_SOCKET                          (5)
+#define MPTRACE_SRC_USER                            (15)
+
+#define MPTRACE_MASK(src)                           (1 << (src))
+
+// records an event if its source is enabled, cheap enough for the ISRs and the hot paths
+#define MPTRACE(id, arg0, arg1)                     do { \
+                                                        if (mptrace_mask & MPTRACE_MASK((id) >> 8)) { \
+                                                            mptrace_record((id), (uint32_t)(arg0), (uint32_t)(arg1)); \
+                                                        } \
+                                                    } while (0)
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// the source is the high byte, the values are read by esp32/tools/mptrace_decode.py
+typedef enum {
+    MPTRACE_LORA_TX_REQUEST =                       0x0100,     // LoRaWAN frame handed to the MAC: length, datarate
+    MPTRACE_LORA_TX_START =                         0x0101,     // raw frame handed to the radio: length
+    MPTRACE_LORA_TX_DONE =                          0x0102,
+    MPTRACE_LORA_RX_DONE =                          0x0103,     // length, rssi
+    MPTRACE_LORA_RX_TIMEOUT =                       0x0104,
+    MPTRACE_LORA_RX_ERROR =                         0x0105,
+    MPTRACE_LORA_CONFIRM =                          0x0106,     // LoRaWAN uplink done: status, ack received
+    MPTRACE_LTE_AT_CMD =                            0x0200,     // length, the 4 characters after "AT"
+    MPTRACE_LTE_AT_RSP =                            0x0201,     // length, expected or final response seen
+    MPTRACE_LTE_PPP_IN =                            0x0202,     // length
+    MPTRACE_LTE_PPP_OUT =                           0x0203,     // length
+    MPTRACE_IRQ_QUEUED =                            0x0300,     // handler, 0 queued, 1 merged or 2 dropped
+    MPTRACE_IRQ_RUN =                               0x0301,     // handler
+    MPTRACE_IRQ_DONE =                              0x0302,     // handler
+    MPTRACE_GC_START =                              0x0400,
+    MPTRACE_GC_END =                                0x0401,
+    MPTRACE_SOCKET_SEND =                           0x0500,     // socket, length
+    MPTRACE_SOCKET_SENT =                           0x0501,     // socket, result
+    MPTRACE_SOCKET_RECV =                           0x0502,     // socket, result
+    MPTRACE_USER =                                  0x0F00,     // machine.trace_event(), the low byte is given by the caller
+} mptrace_event_t;
+
+// 16 bytes, '<IHBBII' for the struct module
+typedef struct {
+    uint32_t timestamp;     // µs, low 32 bits of esp_timer_get_time()
+    uint16_t id;
+    uint8_t core;
+    uint8_t seq;            // low bits of the record number of the core, a gap means records were overwritten
+    uint32_t arg0;
+    uint32_t arg1;
+} mptrace_record_t;
+
+/******************************************************************************
+ DECLARE EXPORTED DATA
+ ******************************************************************************/
+extern volatile uint32_t mptrace_mask;
+
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+bool mptrace_enable(uint32_t mask);
+void mptrace_record(uint16_t id, uint32_t arg0, uint32_t arg1);
+uint32_t mptrace_pending(void);
+uint32_t mptrace_dump(mptrace_record_t *dest, uint32_t max);
+
+#endif /* MPTRACE_H_ */
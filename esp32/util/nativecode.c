@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "py/mpconfig.h"
+#include "py/misc.h"
+#include "py/gc.h"
+
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "soc/soc.h"
+#include "freertos/xtensa_api.h"
+#include "xtensa/corebits.h"
+#include "nativecode.h"
+
+#if MICROPY_EMIT_XTENSAWIN
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+// Native code lives in executable IRAM which is outside of the GC heap, so the
+// blocks are chained together to be able to release them on soft reset.
+typedef struct _native_code_block_t {
+    struct _native_code_block_t *next;
+    uint32_t code[];
+} native_code_block_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+STATIC native_code_block_t *native_code_head = NULL;
+STATIC xt_exc_handler native_code_prev_handler = NULL;
+STATIC bool native_code_handler_installed = false;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+// IRAM can only be accessed with 32-bit loads, but the runtime decodes the
+// prelude and the constant data of a native function with byte loads. The
+// offending l8ui/l16ui/l16si instructions are emulated here using word loads.
+// Frozen native code is executed from flash through the instruction bus, which
+// has the same restriction.
+STATIC IRAM_ATTR void native_code_load_store_error_handler(XtExcFrame *frame) {
+    uint32_t addr = frame->excvaddr;
+    if ((addr >= SOC_IRAM_LOW && addr < SOC_IRAM_HIGH) || (addr >= SOC_IROM_LOW && addr < SOC_IROM_HIGH)) {
+        // the instruction itself may be in IRAM too, so fetch it word by word
+        uint32_t pc = frame->pc;
+        const uint32_t *ip = (const uint32_t *)(pc & ~3);
+        uint32_t insn = (uint32_t)(((uint64_t)ip[0] | ((uint64_t)ip[1] << 32)) >> ((pc & 3) * 8)) & 0xffffff;
+        uint32_t op0 = insn & 0xf;
+        uint32_t t = (insn >> 4) & 0xf;
+        uint32_t r = (insn >> 12) & 0xf;
+        if (op0 == 2 && (r == 0 || r == 1 || r == 9)) {
+            uint32_t word = *(const uint32_t *)(addr & ~3);
+            uint32_t val = word >> ((addr & 3) * 8);
+            if (r == 0) {
+                val &= 0xff;
+            } else if (r == 1) {
+                val &= 0xffff;
+            } else {
+                val = (uint32_t)(int32_t)(int16_t)val;
+            }
+            (&frame->a0)[t] = val;
+            frame->pc = pc + 3;
+            return;
+        }
+    }
+    if (native_code_prev_handler != NULL) {
+        native_code_prev_handler(frame);
+    }
+}
+
+STATIC void native_code_install_handler(void) {
+    if (!native_code_handler_installed) {
+        native_code_prev_handler = xt_set_exception_handler(EXCCAUSE_LOAD_STORE_ERROR, native_code_load_store_error_handler);
+        native_code_handler_installed = true;
+    }
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void esp_native_code_init(void) {
+#if MICROPY_MODULE_FROZEN_MPY
+    // frozen modules may contain native code, which runs from flash
+    native_code_install_handler();
+#endif
+}
+
+void *esp_native_code_commit(void *buf, size_t len) {
+    len = (len + 3) & ~3;
+    native_code_block_t *block = heap_caps_malloc(sizeof(native_code_block_t) + len, MALLOC_CAP_EXEC);
+    if (block == NULL) {
+        m_malloc_fail(len);
+    }
+    native_code_install_handler();
+    // IRAM only supports 32-bit stores, so memcpy can't be used
+    const uint32_t *src = buf;
+    for (size_t i = 0; i < len / 4; i++) {
+        block->code[i] = src[i];
+    }
+    block->next = native_code_head;
+    native_code_head = block;
+    return block->code;
+}
+
+void esp_native_code_deinit(void) {
+    while (native_code_head != NULL) {
+        native_code_block_t *next = native_code_head->next;
+        heap_caps_free(native_code_head);
+        native_code_head = next;
+    }
+}
+
+#endif // MICROPY_EMIT_XTENSAWIN
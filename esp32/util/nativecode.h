@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef NATIVECODE_H_
+#define NATIVECODE_H_
+
+#include <stddef.h>
+
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void esp_native_code_init(void);
+void *esp_native_code_commit(void *buf, size_t len);
+void esp_native_code_deinit(void);
+
+#endif /* NATIVECODE_H_ */
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "py/mpconfig.h"
+#include "py/misc.h"
+
+#include "pktbuf.h"
+
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+// the blocks go from one subsystem to the other, no memory is set aside for an idle interface
+static DRAM_ATTR pktbuf_t *pktbuf_chunks[(PKTBUF_BLOCKS_MAX + PKTBUF_BLOCKS - 1) / PKTBUF_BLOCKS];
+static DRAM_ATTR uint32_t pktbuf_chunk_count;
+static DRAM_ATTR uint32_t pktbuf_block_count;
+static DRAM_ATTR pktbuf_t *pktbuf_free_list;
+static DRAM_ATTR uint32_t pktbuf_free_count;
+static DRAM_ATTR pktbuf_stats_t pktbuf_owners[PKTBUF_OWNER_COUNT];
+static portMUX_TYPE pktbuf_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/******************************************************************************
+ DEFINE PRIVATE FUNCTIONS
+ ******************************************************************************/
+// the free blocks the other owners may still claim out of their reserve
+static IRAM_ATTR uint32_t pktbuf_reserved_for_others(pktbuf_owner_t owner) {
+    uint32_t reserved = 0;
+    for (uint32_t i = 0; i < PKTBUF_OWNER_COUNT; i++) {
+        if (i != owner && pktbuf_owners[i].used < pktbuf_owners[i].reserve) {
+            reserved += pktbuf_owners[i].reserve - pktbuf_owners[i].used;
+        }
+    }
+    return reserved;
+}
+
+// called with the lock held
+static IRAM_ATTR void pktbuf_drop_ref(pktbuf_t *pb) {
+    if (--pb->refs == 0) {
+        pktbuf_owners[pb->owner].used--;
+        pb->next = pktbuf_free_list;
+        pktbuf_free_list = pb;
+        pktbuf_free_count++;
+    }
+}
+
+// the number of blocks in the chunk, each one but the last holds PKTBUF_BLOCKS
+static uint32_t pktbuf_chunk_blocks(uint32_t chunk) {
+    return MIN(PKTBUF_BLOCKS, PKTBUF_BLOCKS_MAX - chunk * PKTBUF_BLOCKS);
+}
+
+/******************************************************************************
+ DEFINE PUBLIC FUNCTIONS
+ ******************************************************************************/
+void pktbuf_init(void) {
+    if (pktbuf_chunk_count > 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < PKTBUF_OWNER_COUNT; i++) {
+        memset(&pktbuf_owners[i], 0, sizeof(pktbuf_stats_t));
+        pktbuf_owners[i].quota = PKTBUF_BLOCKS;
+    }
+    pktbuf_grow(PKTBUF_BLOCKS);
+}
+
+bool pktbuf_grow(uint32_t n) {
+    if (n > PKTBUF_BLOCKS_MAX) {
+        return false;
+    }
+    while (pktbuf_block_count < n) {
+        uint32_t blocks = pktbuf_chunk_blocks(pktbuf_chunk_count);
+        pktbuf_t *chunk = heap_caps_malloc(blocks * sizeof(pktbuf_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (chunk == NULL) {
+            return false;
+        }
+        for (uint32_t i = 0; i < blocks; i++) {
+            chunk[i].next = (i + 1 < blocks) ? &chunk[i + 1] : NULL;
+            chunk[i].refs = 0;
+        }
+        portENTER_CRITICAL(&pktbuf_mux);
+        chunk[blocks - 1].next = pktbuf_free_list;
+        pktbuf_free_list = chunk;
+        pktbuf_free_count += blocks;
+        pktbuf_chunks[pktbuf_chunk_count++] = chunk;
+        pktbuf_block_count += blocks;
+        portEXIT_CRITICAL(&pktbuf_mux);
+    }
+    return true;
+}
+
+IRAM_ATTR pktbuf_t *pktbuf_alloc(pktbuf_owner_t owner) {
+    pktbuf_t *pb = NULL;
+    portENTER_CRITICAL(&pktbuf_mux);
+    pktbuf_stats_t *stats = &pktbuf_owners[owner];
+    if (pktbuf_free_list != NULL && stats->used < stats->quota
+        && (stats->used < stats->reserve || pktbuf_free_count > pktbuf_reserved_for_others(owner))) {
+        pb = pktbuf_free_list;
+        pktbuf_free_list = pb->next;
+        pktbuf_free_count--;
+        pb->next = NULL;
+        pb->len = 0;
+        pb->owner = owner;
+        pb->flags = 0;
+        pb->refs = 1;
+        if (++stats->used > stats->peak) {
+            stats->peak = stats->used;
+        }
+    } else {
+        stats->refused++;
+    }
+    portEXIT_CRITICAL(&pktbuf_mux);
+    return pb;
+}
+
+IRAM_ATTR void pktbuf_ref(pktbuf_t *pb) {
+    portENTER_CRITICAL(&pktbuf_mux);
+    pb->refs++;
+    portEXIT_CRITICAL(&pktbuf_mux);
+}
+
+IRAM_ATTR void pktbuf_unref(pktbuf_t *pb) {
+    portENTER_CRITICAL(&pktbuf_mux);
+    pktbuf_drop_ref(pb);
+    portEXIT_CRITICAL(&pktbuf_mux);
+}
+
+IRAM_ATTR void pktbuf_queue_push(pktbuf_queue_t *queue, pktbuf_t *pb) {
+    pb->next = NULL;
+    portENTER_CRITICAL(&pktbuf_mux);
+    if (queue->tail != NULL) {
+        queue->tail->next = pb;
+    } else {
+        queue->head = pb;
+    }
+    queue->tail = pb;
+    queue->count++;
+    portEXIT_CRITICAL(&pktbuf_mux);
+}
+
+pktbuf_t *pktbuf_queue_pop(pktbuf_queue_t *queue) {
+    portENTER_CRITICAL(&pktbuf_mux);
+    pktbuf_t *pb = queue->head;
+    if (pb != NULL) {
+        queue->head = pb->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+        queue->count--;
+        pb->next = NULL;
+    }
+    portEXIT_CRITICAL(&pktbuf_mux);
+    return pb;
+}
+
+pktbuf_t *pktbuf_queue_peek(pktbuf_queue_t *queue) {
+    portENTER_CRITICAL(&pktbuf_mux);
+    pktbuf_t *pb = queue->head;
+    if (pb != NULL) {
+        pb->refs++;
+    }
+    portEXIT_CRITICAL(&pktbuf_mux);
+    return pb;
+}
+
+bool pktbuf_queue_remove(pktbuf_queue_t *queue, pktbuf_t *pb) {
+    bool removed = false;
+    portENTER_CRITICAL(&pktbuf_mux);
+    if (queue->head == pb) {
+        queue->head = pb->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+        queue->count--;
+        pktbuf_drop_ref(pb);
+        removed = true;
+    }
+    portEXIT_CRITICAL(&pktbuf_mux);
+    return removed;
+}
+
+void pktbuf_queue_flush(pktbuf_queue_t *queue) {
+    portENTER_CRITICAL(&pktbuf_mux);
+    pktbuf_t *pb = queue->head;
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->count = 0;
+    while (pb != NULL) {
+        pktbuf_t *next = pb->next;
+        pktbuf_drop_ref(pb);
+        pb = next;
+    }
+    portEXIT_CRITICAL(&pktbuf_mux);
+}
+
+bool pktbuf_set_quota(pktbuf_owner_t owner, uint32_t quota, uint32_t reserve) {
+    if (quota > pktbuf_block_count || reserve > quota) {
+        return false;
+    }
+    bool set = false;
+    portENTER_CRITICAL(&pktbuf_mux);
+    // the reserves together can't take more than the whole pool
+    uint32_t reserved = reserve;
+    for (uint32_t i = 0; i < PKTBUF_OWNER_COUNT; i++) {
+        if (i != owner) {
+            reserved += pktbuf_owners[i].reserve;
+        }
+    }
+    if (reserved <= pktbuf_block_count) {
+        pktbuf_owners[owner].quota = quota;
+        pktbuf_owners[owner].reserve = reserve;
+        set = true;
+    }
+    portEXIT_CRITICAL(&pktbuf_mux);
+    return set;
+}
+
+void pktbuf_get_stats(pktbuf_owner_t owner, pktbuf_stats_t *stats) {
+    portENTER_CRITICAL(&pktbuf_mux);
+    *stats = pktbuf_owners[owner];
+    portEXIT_CRITICAL(&pktbuf_mux);
+}
+
+uint32_t pktbuf_blocks(void) {
+    return pktbuf_block_count;
+}
+
+uint32_t pktbuf_free_blocks(void) {
+    return pktbuf_free_count;
+}
+
+void pktbuf_release_python(void) {
+    portENTER_CRITICAL(&pktbuf_mux);
+    for (uint32_t c = 0; c < pktbuf_chunk_count; c++) {
+        for (uint32_t i = 0; i < pktbuf_chunk_blocks(c); i++) {
+            pktbuf_t *pb = &pktbuf_chunks[c][i];
+            if (pb->refs > 0 && (pb->flags & PKTBUF_FLAG_PYTHON)) {
+                pb->flags &= ~PKTBUF_FLAG_PYTHON;
+                pktbuf_drop_ref(pb);
+            }
+        }
+    }
+    portEXIT_CRITICAL(&pktbuf_mux);
+}
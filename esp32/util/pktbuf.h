@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2021, Pycom Limited.
+ *
+ * This software is licensed under the GNU GPL version 3 or any
+ * later version, with permitted additional terms. For more information
+ * see the Pycom Licence v1.0 document supplied with this file, or
+ * available at https://www.pycom.io/opensource/licensing
+ */
+
+#ifndef PKTBUF_H_
+#define PKTBUF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/******************************************************************************
+ DEFINE CONSTANTS
+ ******************************************************************************/
+// one block holds a whole frame of the radios, the pool is shared by all the subsystems
+#define PKTBUF_DATA_SIZE                            (256)
+#define PKTBUF_META_SIZE                            (12)
+#define PKTBUF_BLOCKS                               (12)        // allocated at boot, the pool grows by as many
+#define PKTBUF_BLOCKS_MAX                           (128)
+
+#define PKTBUF_FLAG_PYTHON                          (0x01)      // one of the references is held by a PktBuf object
+
+/******************************************************************************
+ DEFINE TYPES
+ ******************************************************************************/
+// the subsystems the blocks are accounted to
+typedef enum {
+    PKTBUF_OWNER_LORA = 0,
+    PKTBUF_OWNER_SIGFOX,
+    PKTBUF_OWNER_BT,
+    PKTBUF_OWNER_LTE,
+    PKTBUF_OWNER_ETH,
+    PKTBUF_OWNER_WLAN,
+    PKTBUF_OWNER_COUNT
+} pktbuf_owner_t;
+
+typedef struct _pktbuf_t {
+    struct _pktbuf_t *next;                         // in a queue or the free list
+    uint16_t len;
+    uint8_t owner;
+    uint8_t flags;
+    volatile uint32_t refs;
+    uint32_t meta[PKTBUF_META_SIZE / sizeof(uint32_t)];     // for the owner, e.g. the radio metadata of a frame
+    uint8_t data[PKTBUF_DATA_SIZE];
+} pktbuf_t;
+
+// FIFO of blocks, it holds a reference to each of them
+typedef struct {
+    pktbuf_t *head;
+    pktbuf_t *tail;
+    volatile uint32_t count;
+} pktbuf_queue_t;
+
+typedef struct {
+    uint32_t used;
+    uint32_t peak;
+    uint32_t quota;                                 // at most this many blocks
+    uint32_t reserve;                               // kept free for the owner, whatever the others use
+    uint32_t refused;
+} pktbuf_stats_t;
+
+/******************************************************************************
+ DECLARE PUBLIC FUNCTIONS
+ ******************************************************************************/
+// allocates the pool on the first call, it survives the soft resets
+extern void pktbuf_init(void);
+
+// from any context including the ISRs, NULL if the pool or the quota of the owner is exhausted
+extern pktbuf_t *pktbuf_alloc(pktbuf_owner_t owner);
+extern void pktbuf_ref(pktbuf_t *pb);
+extern void pktbuf_unref(pktbuf_t *pb);
+
+// the queue takes over the reference of the caller
+extern void pktbuf_queue_push(pktbuf_queue_t *queue, pktbuf_t *pb);
+// the caller gets the reference of the queue
+extern pktbuf_t *pktbuf_queue_pop(pktbuf_queue_t *queue);
+// the head with a new reference for the caller, it stays valid even if the queue is flushed meanwhile
+extern pktbuf_t *pktbuf_queue_peek(pktbuf_queue_t *queue);
+// takes pb out of the queue if it is still its head
+extern bool pktbuf_queue_remove(pktbuf_queue_t *queue, pktbuf_t *pb);
+extern void pktbuf_queue_flush(pktbuf_queue_t *queue);
+
+// adds blocks until the pool has at least n of them, false if they can't be allocated;
+// the pool never shrinks, so a block stays valid as long as a reference to it is held
+extern bool pktbuf_grow(uint32_t n);
+
+// the quota can't be more than the blocks of the pool, grow it first
+extern bool pktbuf_set_quota(pktbuf_owner_t owner, uint32_t quota, uint32_t reserve);
+extern void pktbuf_get_stats(pktbuf_owner_t owner, pktbuf_stats_t *stats);
+extern uint32_t pktbuf_blocks(void);
+extern uint32_t pktbuf_free_blocks(void);
+
+// drops the references of the PktBuf objects, on soft reset as their heap is going away
+extern void pktbuf_release_python(void);
+
+#endif /* PKTBUF_H_ */
@@ -8,12 +8,24 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #include "py/obj.h"
 #include "random.h"
 #include "esp_system.h"
 #include "machrtc.h"
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "mbedtls/ctr_drbg.h"
+
+/******************************************************************************
+* DEFINE CONSTANTS
+******************************************************************************/
+// small requests are served from this much DRBG output, the bigger ones are generated in place
+#define RNG_POOL_SIZE                   (64)
+
 /******************************************************************************
 * LOCAL TYPES
 ******************************************************************************/
@@ -27,11 +39,16 @@ typedef union _rng_id_t {
 * LOCAL VARIABLES
 ******************************************************************************/
 static uint32_t s_seed;
+static mbedtls_ctr_drbg_context rng_drbg;
+static SemaphoreHandle_t rng_mutex;
+static uint8_t rng_pool[RNG_POOL_SIZE];
+static uint32_t rng_pool_left;
 
 /******************************************************************************
 * LOCAL FUNCTION DECLARATIONS
 ******************************************************************************/
 STATIC uint32_t lfsr (uint32_t input);
+STATIC int rng_hw_entropy (void *ctx, unsigned char *buf, size_t len);
 
 /******************************************************************************
 * PRIVATE FUNCTIONS
@@ -40,6 +57,18 @@ STATIC uint32_t lfsr (uint32_t input) {
     return (input >> 1) ^ (-(input & 0x01) & 0x00E10000);
 }
 
+// the DRBG seed and reseeds come from the hardware RNG
+STATIC int rng_hw_entropy (void *ctx, unsigned char *buf, size_t len) {
+    while (len > 0) {
+        uint32_t word = esp_random();
+        size_t n = MIN(len, sizeof(word));
+        memcpy(buf, &word, n);
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
 /******************************************************************************/
 // Micro Python bindings;
 
@@ -70,9 +99,44 @@ void rng_init0 (void) {
     if (s_seed == 0) {
         s_seed = 1;
     }
+
+    if (rng_mutex == NULL) {
+        rng_mutex = xSemaphoreCreateMutex();
+        mbedtls_ctr_drbg_init(&rng_drbg);
+        mbedtls_ctr_drbg_seed(&rng_drbg, rng_hw_entropy, NULL, juggler.id8, sizeof(juggler.id8));
+    }
 }
 
 uint32_t rng_get (void) {
     s_seed = lfsr(s_seed);
     return s_seed;
 }
+
+// fills buf from the DRBG, no allocation, safe to call from any task but not from an ISR
+void rng_fill (uint8_t *buf, size_t len) {
+    xSemaphoreTake(rng_mutex, portMAX_DELAY);
+    if (len >= RNG_POOL_SIZE) {
+        while (len > 0) {
+            size_t n = MIN(len, MBEDTLS_CTR_DRBG_MAX_REQUEST);
+            mbedtls_ctr_drbg_random(&rng_drbg, buf, n);
+            buf += n;
+            len -= n;
+        }
+    } else {
+        while (len > 0) {
+            if (rng_pool_left == 0) {
+                mbedtls_ctr_drbg_random(&rng_drbg, rng_pool, RNG_POOL_SIZE);
+                rng_pool_left = RNG_POOL_SIZE;
+            }
+            size_t n = MIN(len, rng_pool_left);
+            uint8_t *src = &rng_pool[RNG_POOL_SIZE - rng_pool_left];
+            memcpy(buf, src, n);
+            // what was handed out is never handed out again
+            memset(src, 0, n);
+            rng_pool_left -= n;
+            buf += n;
+            len -= n;
+        }
+    }
+    xSemaphoreGive(rng_mutex);
+}
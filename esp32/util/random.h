@@ -10,8 +10,20 @@
 #ifndef __RANDOM_H
 #define __RANDOM_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * rng_get() is a fast LFSR seeded from the MAC address and the RTC, for backoffs and jitter only.
+ *
+ * rng_fill() is a CSPRNG for keys and nonces: an AES-CTR DRBG (mbedtls, on the AES accelerator) seeded and
+ * reseeded from the hardware RNG. The hardware RNG (esp_random) is only a true random source while the WiFi
+ * or the Bluetooth radio is on, otherwise its output is pseudo-random, so the seed taken at boot is also
+ * mixed with the MAC address and reseeding happens every 10000 requests.
+ */
 void rng_init0 (void);
 uint32_t rng_get (void);
+void rng_fill (uint8_t *buf, size_t len);
 
 MP_DECLARE_CONST_FUN_OBJ_0(machine_rng_get_obj);
 
@@ -38,6 +38,11 @@ void SOCKETFIFO_Init (FIFO_t *fifo, void *elements, uint32_t maxcount) {
     FIFO_Init (socketfifo, maxcount, socketfifo_Push, socketfifo_Pop);
 }
 
+void SOCKETFIFO_Select (FIFO_t *fifo) {
+    // switch to a fifo already initialized with SOCKETFIFO_Init()
+    socketfifo = fifo;
+}
+
 bool SOCKETFIFO_Push (const void * const element) {
     return FIFO_bPushElement (socketfifo, element);
 }
@@ -35,6 +35,7 @@ typedef struct {
  ** Declare public functions
  */
 extern void SOCKETFIFO_Init (FIFO_t *fifo, void *elements, uint32_t maxcount);
+extern void SOCKETFIFO_Select (FIFO_t *fifo);
 extern bool SOCKETFIFO_Push (const void * const element);
 extern bool SOCKETFIFO_Pop (void * const element);
 extern bool SOCKETFIFO_Peek (void * const element);
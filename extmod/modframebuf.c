@@ -39,6 +39,8 @@ typedef struct _mp_obj_framebuf_t {
     void *buf;
     uint16_t width, height, stride;
     uint8_t format;
+    // the area drawn since the last dirty(), empty when x0 == x1
+    uint16_t dirty_x0, dirty_y0, dirty_x1, dirty_y1;
 } mp_obj_framebuf_t;
 
 typedef void (*setpixel_t)(const mp_obj_framebuf_t*, int, int, uint32_t);
@@ -123,12 +125,23 @@ STATIC uint32_t rgb565_getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
 }
 
 STATIC void rgb565_fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
-    uint16_t *b = &((uint16_t*)fb->buf)[x + y * fb->stride];
-    while (h--) {
-        for (int ww = w; ww; --ww) {
-            *b++ = col;
-        }
-        b += fb->stride - w;
+    uint16_t *row = &((uint16_t*)fb->buf)[x + y * fb->stride];
+    // the first row is filled a word at a time, the others are copies of it
+    uint16_t *b = row;
+    int ww = w;
+    if (((uintptr_t)b & 2) && ww > 0) {
+        *b++ = col;
+        --ww;
+    }
+    uint32_t col2 = (col & 0xffff) | (col << 16);
+    for (; ww >= 2; ww -= 2, b += 2) {
+        *(uint32_t*)b = col2;
+    }
+    if (ww) {
+        *b = col;
+    }
+    for (uint16_t *dest = row + fb->stride; --h > 0; dest += fb->stride) {
+        memcpy(dest, row, w * sizeof(uint16_t));
     }
 }
 
@@ -244,7 +257,29 @@ static inline uint32_t getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
     return formats[fb->format].getpixel(fb, x, y);
 }
 
-STATIC void fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
+// adds the area, clipped to the framebuffer, to the dirty one
+STATIC void mark_dirty(mp_obj_framebuf_t *fb, int x, int y, int w, int h) {
+    int xend = MIN(fb->width, x + w);
+    int yend = MIN(fb->height, y + h);
+    x = MAX(x, 0);
+    y = MAX(y, 0);
+    if (x >= xend || y >= yend) {
+        return;
+    }
+    if (fb->dirty_x0 == fb->dirty_x1) {
+        fb->dirty_x0 = x;
+        fb->dirty_y0 = y;
+        fb->dirty_x1 = xend;
+        fb->dirty_y1 = yend;
+    } else {
+        fb->dirty_x0 = MIN(fb->dirty_x0, x);
+        fb->dirty_y0 = MIN(fb->dirty_y0, y);
+        fb->dirty_x1 = MAX(fb->dirty_x1, xend);
+        fb->dirty_y1 = MAX(fb->dirty_y1, yend);
+    }
+}
+
+STATIC void fill_rect(mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
     if (h < 1 || w < 1 || x + w <= 0 || y + h <= 0 || y >= fb->height || x >= fb->width) {
         // No operation needed.
         return;
@@ -257,6 +292,27 @@ STATIC void fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, u
     y = MAX(y, 0);
 
     formats[fb->format].fill_rect(fb, x, y, xend - x, yend - y, col);
+    mark_dirty(fb, x, y, xend - x, yend - y);
+}
+
+// bytes from the start of the buffer to the start of row y, for the
+// horizontal formats, and to the page holding row y for MVLSB
+STATIC size_t row_offset(const mp_obj_framebuf_t *fb, int y) {
+    switch (fb->format) {
+        case FRAMEBUF_MVLSB:
+            return (y >> 3) * fb->stride;
+        case FRAMEBUF_RGB565:
+            return y * fb->stride * 2;
+        case FRAMEBUF_GS2_HMSB:
+            return y * fb->stride / 4;
+        case FRAMEBUF_GS4_HMSB:
+            return y * fb->stride / 2;
+        case FRAMEBUF_MHLSB:
+        case FRAMEBUF_MHMSB:
+            return y * fb->stride / 8;
+        default:
+            return y * fb->stride;
+    }
 }
 
 STATIC mp_obj_t framebuf_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
@@ -299,6 +355,9 @@ STATIC mp_obj_t framebuf_make_new(const mp_obj_type_t *type, size_t n_args, size
             mp_raise_ValueError("invalid format");
     }
 
+    // what the buffer holds hasn't been shown yet
+    mark_dirty(o, 0, 0, o->width, o->height);
+
     return MP_OBJ_FROM_PTR(o);
 }
 
@@ -315,6 +374,7 @@ STATIC mp_obj_t framebuf_fill(mp_obj_t self_in, mp_obj_t col_in) {
     mp_obj_framebuf_t *self = MP_OBJ_TO_PTR(self_in);
     mp_int_t col = mp_obj_get_int(col_in);
     formats[self->format].fill_rect(self, 0, 0, self->width, self->height, col);
+    mark_dirty(self, 0, 0, self->width, self->height);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(framebuf_fill_obj, framebuf_fill);
@@ -346,6 +406,7 @@ STATIC mp_obj_t framebuf_pixel(size_t n_args, const mp_obj_t *args) {
         } else {
             // set
             setpixel(self, x, y, mp_obj_get_int(args[3]));
+            mark_dirty(self, x, y, 1, 1);
         }
     }
     return mp_const_none;
@@ -411,6 +472,8 @@ STATIC mp_obj_t framebuf_line(size_t n_args, const mp_obj_t *args) {
     mp_int_t y2 = mp_obj_get_int(args[4]);
     mp_int_t col = mp_obj_get_int(args[5]);
 
+    mark_dirty(self, MIN(x1, x2), MIN(y1, y2), MAX(x1, x2) - MIN(x1, x2) + 1, MAX(y1, y2) - MIN(y1, y2) + 1);
+
     mp_int_t dx = x2 - x1;
     mp_int_t sx;
     if (dx > 0) {
@@ -495,6 +558,37 @@ STATIC mp_obj_t framebuf_blit(size_t n_args, const mp_obj_t *args) {
     int x0end = MIN(self->width, x + source->width);
     int y0end = MIN(self->height, y + source->height);
 
+    mark_dirty(self, x0, y0, x0end - x0, y0end - y0);
+
+    if (self->format == source->format && (self->format == FRAMEBUF_RGB565 || self->format == FRAMEBUF_GS8)) {
+        // the pixels are whole bytes, the rows are copied without going through getpixel/setpixel
+        size_t bpp = self->format == FRAMEBUF_RGB565 ? 2 : 1;
+        size_t w = x0end - x0;
+        byte *dest = (byte*)self->buf + (x0 + y0 * self->stride) * bpp;
+        const byte *src = (const byte*)source->buf + (x1 + y1 * source->stride) * bpp;
+        for (; y0 < y0end; ++y0) {
+            if (key == -1) {
+                memmove(dest, src, w * bpp);
+            } else if (bpp == 2) {
+                for (size_t i = 0; i < w; ++i) {
+                    uint16_t col = ((const uint16_t*)src)[i];
+                    if (col != (uint32_t)key) {
+                        ((uint16_t*)dest)[i] = col;
+                    }
+                }
+            } else {
+                for (size_t i = 0; i < w; ++i) {
+                    if (src[i] != (uint32_t)key) {
+                        dest[i] = src[i];
+                    }
+                }
+            }
+            dest += self->stride * bpp;
+            src += source->stride * bpp;
+        }
+        return mp_const_none;
+    }
+
     for (; y0 < y0end; ++y0) {
         int cx1 = x1;
         for (int cx0 = x0; cx0 < x0end; ++cx0) {
@@ -538,6 +632,7 @@ STATIC mp_obj_t framebuf_scroll(mp_obj_t self_in, mp_obj_t xstep_in, mp_obj_t ys
             setpixel(self, x, y, getpixel(self, x - xstep, y - ystep));
         }
     }
+    mark_dirty(self, 0, 0, self->width, self->height);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(framebuf_scroll_obj, framebuf_scroll);
@@ -553,6 +648,8 @@ STATIC mp_obj_t framebuf_text(size_t n_args, const mp_obj_t *args) {
         col = mp_obj_get_int(args[4]);
     }
 
+    mark_dirty(self, x0, y0, strlen(str) * 8, 8);
+
     // loop over chars
     for (; *str; ++str) {
         // get char and make sure its in range of font
@@ -580,6 +677,57 @@ STATIC mp_obj_t framebuf_text(size_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(framebuf_text_obj, 4, 5, framebuf_text);
 
+// dirty(): return the area (x, y, w, h) drawn since the last call, or None
+STATIC mp_obj_t framebuf_dirty(mp_obj_t self_in) {
+    mp_obj_framebuf_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->dirty_x0 == self->dirty_x1) {
+        return mp_const_none;
+    }
+    mp_obj_t tuple[4] = {
+        MP_OBJ_NEW_SMALL_INT(self->dirty_x0),
+        MP_OBJ_NEW_SMALL_INT(self->dirty_y0),
+        MP_OBJ_NEW_SMALL_INT(self->dirty_x1 - self->dirty_x0),
+        MP_OBJ_NEW_SMALL_INT(self->dirty_y1 - self->dirty_y0),
+    };
+    self->dirty_x0 = self->dirty_x1 = 0;
+    self->dirty_y0 = self->dirty_y1 = 0;
+    return mp_obj_new_tuple(4, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(framebuf_dirty_obj, framebuf_dirty);
+
+// invalidate([x, y, w, h]): add the area, or the whole framebuffer, to the
+// dirty one, e.g. after writing to the buffer directly
+STATIC mp_obj_t framebuf_invalidate(size_t n_args, const mp_obj_t *args) {
+    mp_obj_framebuf_t *self = MP_OBJ_TO_PTR(args[0]);
+    if (n_args == 1) {
+        mark_dirty(self, 0, 0, self->width, self->height);
+    } else if (n_args == 5) {
+        mark_dirty(self, mp_obj_get_int(args[1]), mp_obj_get_int(args[2]), mp_obj_get_int(args[3]), mp_obj_get_int(args[4]));
+    } else {
+        mp_raise_TypeError(NULL);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(framebuf_invalidate_obj, 1, 5, framebuf_invalidate);
+
+// rows(y, h): return a memoryview of the bytes of the rows y to y + h - 1,
+// whole pages of 8 rows for MVLSB, to send what dirty() returned as is
+STATIC mp_obj_t framebuf_rows(mp_obj_t self_in, mp_obj_t y_in, mp_obj_t h_in) {
+    mp_obj_framebuf_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_int_t y = mp_obj_get_int(y_in);
+    mp_int_t h = mp_obj_get_int(h_in);
+    if (y < 0 || h < 0 || y + h > self->height) {
+        mp_raise_ValueError(NULL);
+    }
+    size_t start = row_offset(self, y);
+    size_t end = self->format == FRAMEBUF_MVLSB ? row_offset(self, y + h + 7) : row_offset(self, y + h);
+    if (h == 0) {
+        end = start;
+    }
+    return mp_obj_new_memoryview('B', end - start, (byte*)self->buf + start);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(framebuf_rows_obj, framebuf_rows);
+
 STATIC const mp_rom_map_elem_t framebuf_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_fill), MP_ROM_PTR(&framebuf_fill_obj) },
     { MP_ROM_QSTR(MP_QSTR_fill_rect), MP_ROM_PTR(&framebuf_fill_rect_obj) },
@@ -591,6 +739,9 @@ STATIC const mp_rom_map_elem_t framebuf_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_blit), MP_ROM_PTR(&framebuf_blit_obj) },
     { MP_ROM_QSTR(MP_QSTR_scroll), MP_ROM_PTR(&framebuf_scroll_obj) },
     { MP_ROM_QSTR(MP_QSTR_text), MP_ROM_PTR(&framebuf_text_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dirty), MP_ROM_PTR(&framebuf_dirty_obj) },
+    { MP_ROM_QSTR(MP_QSTR_invalidate), MP_ROM_PTR(&framebuf_invalidate_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rows), MP_ROM_PTR(&framebuf_rows_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(framebuf_locals_dict, framebuf_locals_dict_table);
 
@@ -619,6 +770,7 @@ STATIC mp_obj_t legacy_framebuffer1(size_t n_args, const mp_obj_t *args) {
     } else {
         o->stride = o->width;
     }
+    mark_dirty(o, 0, 0, o->width, o->height);
 
     return MP_OBJ_FROM_PTR(o);
 }
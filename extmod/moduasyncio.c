@@ -0,0 +1,451 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/stream.h"
+#include "py/mperrno.h"
+#include "py/mphal.h"
+#include "py/smallint.h"
+#include "extmod/moduselect.h"
+
+#if MICROPY_PY_UASYNCIO
+
+// The core of an event loop: the coroutines are resumed from C, and what they await tells the loop
+// when to resume them next. The run queue is a heap ordered like utimeq, the streams waited for are
+// polled with the poll map of uselect, so the port sleeps until one of them may be ready.
+
+#define MODULO MICROPY_PY_UTIME_TICKS_PERIOD
+
+enum {
+    WAIT_SLEEP,
+    WAIT_READ,
+    WAIT_WRITE,
+};
+
+// Returned by sleep_ms(), wait_read() and wait_write(), awaiting it yields it once to the loop
+typedef struct _mp_obj_uasyncio_wait_t {
+    mp_obj_base_t base;
+    uint8_t kind;
+    bool yielded;
+    mp_obj_t arg; // the delay in ms as a small int, or the stream
+} mp_obj_uasyncio_wait_t;
+
+struct qentry {
+    mp_uint_t time;
+    mp_uint_t id;
+    mp_obj_t coro;
+};
+
+// A stream with the coroutines waiting for it, starts with the poll_obj_t for mp_poll_map_wait()
+typedef struct _uasyncio_io_t {
+    poll_obj_t poll;
+    mp_obj_t reader;
+    mp_obj_t writer;
+} uasyncio_io_t;
+
+typedef struct _mp_obj_uasyncio_loop_t {
+    mp_obj_base_t base;
+    mp_map_t io_map;
+    mp_obj_t main; // the coroutine of run_until_complete()
+    mp_obj_t result;
+    bool stopped;
+    mp_uint_t switches;
+    mp_uint_t max_late; // the longest a due coroutine waited to be resumed, in ms
+    mp_uint_t next_id;
+    mp_uint_t alloc;
+    mp_uint_t len;
+    struct qentry items[];
+} mp_obj_uasyncio_loop_t;
+
+STATIC const mp_obj_type_t uasyncio_wait_type;
+
+STATIC mp_int_t ticks_diff(mp_uint_t end, mp_uint_t start) {
+    return ((end - start + MODULO / 2) & (MODULO - 1)) - MODULO / 2;
+}
+
+STATIC bool entry_less_than(struct qentry *item, struct qentry *parent) {
+    mp_int_t diff = ticks_diff(item->time, parent->time);
+    if (diff == 0) {
+        return (mp_int_t)(item->id - parent->id) < 0;
+    }
+    return diff < 0;
+}
+
+STATIC void heap_siftdown(mp_obj_uasyncio_loop_t *heap, mp_uint_t pos) {
+    struct qentry item = heap->items[pos];
+    while (pos > 0) {
+        mp_uint_t parent_pos = (pos - 1) >> 1;
+        if (!entry_less_than(&item, &heap->items[parent_pos])) {
+            break;
+        }
+        heap->items[pos] = heap->items[parent_pos];
+        pos = parent_pos;
+    }
+    heap->items[pos] = item;
+}
+
+STATIC void heap_siftup(mp_obj_uasyncio_loop_t *heap, mp_uint_t pos) {
+    struct qentry item = heap->items[pos];
+    for (mp_uint_t child_pos = 2 * pos + 1; child_pos < heap->len; child_pos = 2 * pos + 1) {
+        // choose the smaller child
+        if (child_pos + 1 < heap->len && entry_less_than(&heap->items[child_pos + 1], &heap->items[child_pos])) {
+            child_pos += 1;
+        }
+        if (!entry_less_than(&heap->items[child_pos], &item)) {
+            break;
+        }
+        heap->items[pos] = heap->items[child_pos];
+        pos = child_pos;
+    }
+    heap->items[pos] = item;
+}
+
+STATIC void loop_push(mp_obj_uasyncio_loop_t *self, mp_int_t delay, mp_obj_t coro) {
+    if (self->len == self->alloc) {
+        mp_raise_msg(&mp_type_IndexError, "queue overflow");
+    }
+    struct qentry *item = &self->items[self->len];
+    item->time = (mp_hal_ticks_ms() + MAX(delay, 0)) & (MODULO - 1);
+    item->id = self->next_id++;
+    item->coro = coro;
+    heap_siftdown(self, self->len);
+    self->len++;
+}
+
+STATIC mp_obj_t loop_pop(mp_obj_uasyncio_loop_t *self) {
+    mp_obj_t coro = self->items[0].coro;
+    self->len -= 1;
+    self->items[0] = self->items[self->len];
+    self->items[self->len].coro = MP_OBJ_NULL; // so we don't retain a pointer
+    if (self->len) {
+        heap_siftup(self, 0);
+    }
+    return coro;
+}
+
+#if MICROPY_PY_USELECT
+STATIC void loop_io_add(mp_obj_uasyncio_loop_t *self, mp_obj_t stream, mp_uint_t flag, mp_obj_t coro) {
+    mp_map_elem_t *elem = mp_map_lookup(&self->io_map, mp_obj_id(stream), MP_MAP_LOOKUP);
+    uasyncio_io_t *io;
+    if (elem == NULL) {
+        const mp_stream_p_t *stream_p = mp_get_stream_raise(stream, MP_STREAM_OP_IOCTL);
+        io = m_new_obj(uasyncio_io_t);
+        io->poll.obj = stream;
+        io->poll.ioctl = stream_p->ioctl;
+        io->poll.flags = 0;
+        io->poll.flags_ret = 0;
+        io->reader = MP_OBJ_NULL;
+        io->writer = MP_OBJ_NULL;
+        mp_map_lookup(&self->io_map, mp_obj_id(stream), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = MP_OBJ_FROM_PTR(io);
+    } else {
+        io = MP_OBJ_TO_PTR(elem->value);
+    }
+    mp_obj_t *waiter = (flag == MP_STREAM_POLL_RD) ? &io->reader : &io->writer;
+    if (*waiter != MP_OBJ_NULL) {
+        // one coroutine at a time per direction
+        mp_raise_OSError(MP_EEXIST);
+    }
+    *waiter = coro;
+    io->poll.flags |= flag;
+}
+
+// queues the coroutines of the ready streams, errors and hang ups wake both of them
+STATIC void loop_io_ready(mp_obj_uasyncio_loop_t *self) {
+    for (mp_uint_t i = 0; i < self->io_map.alloc; i++) {
+        if (!mp_map_slot_is_filled(&self->io_map, i)) {
+            continue;
+        }
+        uasyncio_io_t *io = MP_OBJ_TO_PTR(self->io_map.table[i].value);
+        mp_uint_t ret = io->poll.flags_ret;
+        io->poll.flags_ret = 0;
+        if ((ret & ~MP_STREAM_POLL_WR) && io->reader != MP_OBJ_NULL) {
+            loop_push(self, 0, io->reader);
+            io->reader = MP_OBJ_NULL;
+            io->poll.flags &= ~MP_STREAM_POLL_RD;
+        }
+        if ((ret & ~MP_STREAM_POLL_RD) && io->writer != MP_OBJ_NULL) {
+            loop_push(self, 0, io->writer);
+            io->writer = MP_OBJ_NULL;
+            io->poll.flags &= ~MP_STREAM_POLL_WR;
+        }
+        if (io->poll.flags == 0) {
+            // removing leaves the other slots in place
+            mp_map_lookup(&self->io_map, self->io_map.table[i].key, MP_MAP_LOOKUP_REMOVE_IF_FOUND);
+        }
+    }
+}
+#endif
+
+// resumes the coroutine until its next await and queues it again according to what it waits for
+STATIC void loop_step(mp_obj_uasyncio_loop_t *self, mp_obj_t coro) {
+    mp_obj_t ret;
+    self->switches++;
+    mp_vm_return_kind_t kind = mp_resume(coro, mp_const_none, MP_OBJ_NULL, &ret);
+    if (kind == MP_VM_RETURN_YIELD) {
+        if (ret == mp_const_none) {
+            loop_push(self, 0, coro);
+        } else if (MP_OBJ_IS_SMALL_INT(ret)) {
+            loop_push(self, MP_OBJ_SMALL_INT_VALUE(ret), coro);
+        } else if (MP_OBJ_IS_TYPE(ret, &uasyncio_wait_type)) {
+            mp_obj_uasyncio_wait_t *wait = MP_OBJ_TO_PTR(ret);
+            if (wait->kind == WAIT_SLEEP) {
+                loop_push(self, MP_OBJ_SMALL_INT_VALUE(wait->arg), coro);
+            #if MICROPY_PY_USELECT
+            } else {
+                loop_io_add(self, wait->arg, (wait->kind == WAIT_READ) ? MP_STREAM_POLL_RD : MP_STREAM_POLL_WR, coro);
+            #endif
+            }
+        } else {
+            mp_raise_TypeError("can't await this");
+        }
+    } else if (kind == MP_VM_RETURN_NORMAL) {
+        if (coro == self->main) {
+            self->result = ret;
+            self->stopped = true;
+        }
+    } else {
+        nlr_raise(ret);
+    }
+}
+
+STATIC void loop_run(mp_obj_uasyncio_loop_t *self) {
+    self->stopped = false;
+    while (!self->stopped) {
+        // run the due coroutines, those queued meanwhile wait until the streams were polled
+        mp_uint_t now = mp_hal_ticks_ms() & (MODULO - 1);
+        mp_uint_t round_id = self->next_id;
+        while (!self->stopped && self->len > 0 && (mp_int_t)(self->items[0].id - round_id) < 0) {
+            mp_int_t late = ticks_diff(now, self->items[0].time);
+            if (late < 0) {
+                break;
+            }
+            if ((mp_uint_t)late > self->max_late) {
+                self->max_late = late;
+            }
+            loop_step(self, loop_pop(self));
+        }
+        if (self->stopped) {
+            break;
+        }
+
+        mp_uint_t timeout = -1;
+        if (self->len > 0) {
+            timeout = MAX(ticks_diff(self->items[0].time, mp_hal_ticks_ms()), 0);
+        } else if (self->io_map.used == 0) {
+            // nothing left to run
+            break;
+        }
+        #if MICROPY_PY_USELECT
+        if (self->io_map.used > 0) {
+            mp_poll_map_wait(&self->io_map, timeout);
+            loop_io_ready(self);
+            continue;
+        }
+        #endif
+        if (timeout > 0) {
+            mp_hal_delay_ms(timeout);
+        }
+    }
+}
+
+STATIC mp_obj_t uasyncio_loop_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 1, 1, false);
+    mp_uint_t alloc = mp_obj_get_int(args[0]);
+    mp_obj_uasyncio_loop_t *o = m_new_obj_var(mp_obj_uasyncio_loop_t, struct qentry, alloc);
+    memset(o, 0, sizeof(*o) + sizeof(*o->items) * alloc);
+    o->base.type = type;
+    mp_map_init(&o->io_map, 0);
+    o->main = MP_OBJ_NULL;
+    o->result = mp_const_none;
+    o->alloc = alloc;
+    return MP_OBJ_FROM_PTR(o);
+}
+
+STATIC mp_obj_t uasyncio_loop_create_task(mp_obj_t self_in, mp_obj_t coro) {
+    loop_push(MP_OBJ_TO_PTR(self_in), 0, coro);
+    return coro;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(uasyncio_loop_create_task_obj, uasyncio_loop_create_task);
+
+STATIC mp_obj_t uasyncio_loop_call_later_ms(mp_obj_t self_in, mp_obj_t delay, mp_obj_t coro) {
+    loop_push(MP_OBJ_TO_PTR(self_in), mp_obj_get_int(delay), coro);
+    return coro;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(uasyncio_loop_call_later_ms_obj, uasyncio_loop_call_later_ms);
+
+// runs until stop() or until nothing is left to run or wait for
+STATIC mp_obj_t uasyncio_loop_run_forever(mp_obj_t self_in) {
+    loop_run(MP_OBJ_TO_PTR(self_in));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(uasyncio_loop_run_forever_obj, uasyncio_loop_run_forever);
+
+// runs until the coroutine returns, and returns what it returned
+STATIC mp_obj_t uasyncio_loop_run_until_complete(mp_obj_t self_in, mp_obj_t coro) {
+    mp_obj_uasyncio_loop_t *self = MP_OBJ_TO_PTR(self_in);
+    loop_push(self, 0, coro);
+    self->main = coro;
+    self->result = mp_const_none;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        loop_run(self);
+        nlr_pop();
+    } else {
+        self->main = MP_OBJ_NULL;
+        nlr_jump(nlr.ret_val);
+    }
+    self->main = MP_OBJ_NULL;
+    mp_obj_t result = self->result;
+    self->result = mp_const_none;
+    return result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(uasyncio_loop_run_until_complete_obj, uasyncio_loop_run_until_complete);
+
+STATIC mp_obj_t uasyncio_loop_stop(mp_obj_t self_in) {
+    mp_obj_uasyncio_loop_t *self = MP_OBJ_TO_PTR(self_in);
+    self->stopped = true;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(uasyncio_loop_stop_obj, uasyncio_loop_stop);
+
+// the coroutine switches and the longest a due coroutine waited in ms, optionally cleared
+STATIC mp_obj_t uasyncio_loop_stats(size_t n_args, const mp_obj_t *args) {
+    mp_obj_uasyncio_loop_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_obj_t tuple[2] = {
+        mp_obj_new_int_from_uint(self->switches),
+        mp_obj_new_int_from_uint(self->max_late),
+    };
+    if (n_args > 1 && mp_obj_is_true(args[1])) {
+        self->switches = 0;
+        self->max_late = 0;
+    }
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(uasyncio_loop_stats_obj, 1, 2, uasyncio_loop_stats);
+
+STATIC mp_obj_t uasyncio_loop_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
+    mp_obj_uasyncio_loop_t *self = MP_OBJ_TO_PTR(self_in);
+    switch (op) {
+        case MP_UNARY_OP_BOOL: return mp_obj_new_bool(self->len != 0 || self->io_map.used != 0);
+        case MP_UNARY_OP_LEN: return MP_OBJ_NEW_SMALL_INT(self->len + self->io_map.used);
+        default: return MP_OBJ_NULL; // op not supported
+    }
+}
+
+STATIC const mp_rom_map_elem_t uasyncio_loop_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_create_task), MP_ROM_PTR(&uasyncio_loop_create_task_obj) },
+    { MP_ROM_QSTR(MP_QSTR_call_later_ms), MP_ROM_PTR(&uasyncio_loop_call_later_ms_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run_forever), MP_ROM_PTR(&uasyncio_loop_run_forever_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run_until_complete), MP_ROM_PTR(&uasyncio_loop_run_until_complete_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stop), MP_ROM_PTR(&uasyncio_loop_stop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&uasyncio_loop_stats_obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(uasyncio_loop_locals_dict, uasyncio_loop_locals_dict_table);
+
+STATIC const mp_obj_type_t uasyncio_loop_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Loop,
+    .make_new = uasyncio_loop_make_new,
+    .unary_op = uasyncio_loop_unary_op,
+    .locals_dict = (void*)&uasyncio_loop_locals_dict,
+};
+
+STATIC mp_obj_t uasyncio_wait_iternext(mp_obj_t self_in) {
+    mp_obj_uasyncio_wait_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->yielded) {
+        return MP_OBJ_STOP_ITERATION;
+    }
+    self->yielded = true;
+    return self_in;
+}
+
+STATIC const mp_obj_type_t uasyncio_wait_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_wait,
+    .getiter = mp_identity_getiter,
+    .iternext = uasyncio_wait_iternext,
+};
+
+STATIC mp_obj_t uasyncio_new_wait(uint8_t kind, mp_obj_t arg) {
+    mp_obj_uasyncio_wait_t *o = m_new_obj(mp_obj_uasyncio_wait_t);
+    o->base.type = &uasyncio_wait_type;
+    o->kind = kind;
+    o->yielded = false;
+    o->arg = arg;
+    return MP_OBJ_FROM_PTR(o);
+}
+
+STATIC mp_obj_t mod_uasyncio_sleep_ms(mp_obj_t ms) {
+    return uasyncio_new_wait(WAIT_SLEEP, MP_OBJ_NEW_SMALL_INT(mp_obj_get_int(ms)));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_uasyncio_sleep_ms_obj, mod_uasyncio_sleep_ms);
+
+STATIC mp_obj_t mod_uasyncio_sleep(mp_obj_t s) {
+    #if MICROPY_PY_BUILTINS_FLOAT
+    mp_int_t ms = 1000 * mp_obj_get_float(s);
+    #else
+    mp_int_t ms = 1000 * mp_obj_get_int(s);
+    #endif
+    return uasyncio_new_wait(WAIT_SLEEP, MP_OBJ_NEW_SMALL_INT(ms));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_uasyncio_sleep_obj, mod_uasyncio_sleep);
+
+#if MICROPY_PY_USELECT
+STATIC mp_obj_t mod_uasyncio_wait_read(mp_obj_t stream) {
+    mp_get_stream_raise(stream, MP_STREAM_OP_IOCTL);
+    return uasyncio_new_wait(WAIT_READ, stream);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_uasyncio_wait_read_obj, mod_uasyncio_wait_read);
+
+STATIC mp_obj_t mod_uasyncio_wait_write(mp_obj_t stream) {
+    mp_get_stream_raise(stream, MP_STREAM_OP_IOCTL);
+    return uasyncio_new_wait(WAIT_WRITE, stream);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_uasyncio_wait_write_obj, mod_uasyncio_wait_write);
+#endif
+
+STATIC const mp_rom_map_elem_t mp_module_uasyncio_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR__uasyncio) },
+    { MP_ROM_QSTR(MP_QSTR_Loop), MP_ROM_PTR(&uasyncio_loop_type) },
+    { MP_ROM_QSTR(MP_QSTR_sleep_ms), MP_ROM_PTR(&mod_uasyncio_sleep_ms_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sleep), MP_ROM_PTR(&mod_uasyncio_sleep_obj) },
+    #if MICROPY_PY_USELECT
+    { MP_ROM_QSTR(MP_QSTR_wait_read), MP_ROM_PTR(&mod_uasyncio_wait_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_wait_write), MP_ROM_PTR(&mod_uasyncio_wait_write_obj) },
+    #endif
+};
+
+STATIC MP_DEFINE_CONST_DICT(mp_module_uasyncio_globals, mp_module_uasyncio_globals_table);
+
+const mp_obj_module_t mp_module_uasyncio = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&mp_module_uasyncio_globals,
+};
+
+#endif // MICROPY_PY_UASYNCIO
@@ -31,6 +31,57 @@
 #include "py/runtime.h"
 #include "py/binary.h"
 #include "extmod/modubinascii.h"
+#include "extmod/ubinascii_base64.h"
+
+STATIC const char hexdigits[16] = "0123456789abcdef";
+
+STATIC size_t binascii_hexlify_len(size_t len, const char *sep) {
+    // Code below assumes non-zero buffer length when computing size with
+    // separator, so handle the zero-length case here.
+    if (len == 0) {
+        return 0;
+    }
+    return len * 2 + ((sep != NULL) ? len - 1 : 0);
+}
+
+STATIC void binascii_hexlify(const byte *in, size_t len, byte *out, const char *sep) {
+    for (size_t i = len; i--;) {
+        byte b = *in++;
+        out[0] = hexdigits[b >> 4];
+        out[1] = hexdigits[b & 0xf];
+        out += 2;
+        if (sep != NULL && i != 0) {
+            *out++ = *sep;
+        }
+    }
+}
+
+// Returns the number of bytes written or, for a bad digit or an odd number
+// of digits, raises ValueError
+STATIC size_t binascii_unhexlify(const byte *in, size_t len, byte *out) {
+    if ((len & 1) != 0) {
+        mp_raise_ValueError("odd-length string");
+    }
+    for (size_t i = len / 2; i--;) {
+        byte hi = in[0];
+        byte lo = in[1];
+        if (!unichar_isxdigit(hi) || !unichar_isxdigit(lo)) {
+            mp_raise_ValueError("non-hex digit found");
+        }
+        *out++ = (unichar_xdigit_value(hi) << 4) | unichar_xdigit_value(lo);
+        in += 2;
+    }
+    return len / 2;
+}
+
+STATIC byte *binascii_get_out_buf(mp_obj_t buf_in, size_t needed) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_WRITE);
+    if (bufinfo.len < needed) {
+        mp_raise_ValueError("buffer too small");
+    }
+    return bufinfo.buf;
+}
 
 mp_obj_t mod_binascii_hexlify(size_t n_args, const mp_obj_t *args) {
     // Second argument is for an extension to allow a separator to be used
@@ -39,183 +90,137 @@ mp_obj_t mod_binascii_hexlify(size_t n_args, const mp_obj_t *args) {
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_READ);
 
-    // Code below assumes non-zero buffer length when computing size with
-    // separator, so handle the zero-length case here.
     if (bufinfo.len == 0) {
         return mp_const_empty_bytes;
     }
 
-    vstr_t vstr;
-    size_t out_len = bufinfo.len * 2;
     if (n_args > 1) {
         // 1-char separator between hex numbers
-        out_len += bufinfo.len - 1;
         sep = mp_obj_str_get_str(args[1]);
     }
-    vstr_init_len(&vstr, out_len);
-    byte *in = bufinfo.buf, *out = (byte*)vstr.buf;
-    for (mp_uint_t i = bufinfo.len; i--;) {
-        byte d = (*in >> 4);
-        if (d > 9) {
-            d += 'a' - '9' - 1;
-        }
-        *out++ = d + '0';
-        d = (*in++ & 0xf);
-        if (d > 9) {
-            d += 'a' - '9' - 1;
-        }
-        *out++ = d + '0';
-        if (sep != NULL && i != 0) {
-            *out++ = *sep;
-        }
-    }
+    vstr_t vstr;
+    vstr_init_len(&vstr, binascii_hexlify_len(bufinfo.len, sep));
+    binascii_hexlify(bufinfo.buf, bufinfo.len, (byte*)vstr.buf, sep);
     return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_binascii_hexlify_obj, 1, 2, mod_binascii_hexlify);
 
+mp_obj_t mod_binascii_hexlify_into(size_t n_args, const mp_obj_t *args) {
+    const char *sep = NULL;
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_READ);
+    if (n_args > 2) {
+        sep = mp_obj_str_get_str(args[2]);
+    }
+    size_t out_len = binascii_hexlify_len(bufinfo.len, sep);
+    byte *out = binascii_get_out_buf(args[1], out_len);
+    binascii_hexlify(bufinfo.buf, bufinfo.len, out, sep);
+    return MP_OBJ_NEW_SMALL_INT(out_len);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_binascii_hexlify_into_obj, 2, 3, mod_binascii_hexlify_into);
+
 mp_obj_t mod_binascii_unhexlify(mp_obj_t data) {
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
 
-    if ((bufinfo.len & 1) != 0) {
-        mp_raise_ValueError("odd-length string");
-    }
     vstr_t vstr;
     vstr_init_len(&vstr, bufinfo.len / 2);
-    byte *in = bufinfo.buf, *out = (byte*)vstr.buf;
-    byte hex_byte = 0;
-    for (mp_uint_t i = bufinfo.len; i--;) {
-        byte hex_ch = *in++;
-        if (unichar_isxdigit(hex_ch)) {
-            hex_byte += unichar_xdigit_value(hex_ch);
-        } else {
-            mp_raise_ValueError("non-hex digit found");
-        }
-        if (i & 1) {
-            hex_byte <<= 4;
-        } else {
-            *out++ = hex_byte;
-            hex_byte = 0;
-        }
-    }
+    binascii_unhexlify(bufinfo.buf, bufinfo.len, (byte*)vstr.buf);
     return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
 }
 MP_DEFINE_CONST_FUN_OBJ_1(mod_binascii_unhexlify_obj, mod_binascii_unhexlify);
 
-// If ch is a character in the base64 alphabet, and is not a pad character, then
-// the corresponding integer between 0 and 63, inclusively, is returned.
-// Otherwise, -1 is returned.
-static int mod_binascii_sextet(byte ch) {
-    if (ch >= 'A' && ch <= 'Z') {
-        return ch - 'A';
-    } else if (ch >= 'a' && ch <= 'z') {
-        return ch - 'a' + 26;
-    } else if (ch >= '0' && ch <= '9') {
-        return ch - '0' + 52;
-    } else if (ch == '+') {
-        return 62;
-    } else if (ch == '/') {
-        return 63;
-    } else {
-        return -1;
+mp_obj_t mod_binascii_unhexlify_into(mp_obj_t data, mp_obj_t buf) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+    byte *out = binascii_get_out_buf(buf, bufinfo.len / 2);
+    return MP_OBJ_NEW_SMALL_INT(binascii_unhexlify(bufinfo.buf, bufinfo.len, out));
+}
+MP_DEFINE_CONST_FUN_OBJ_2(mod_binascii_unhexlify_into_obj, mod_binascii_unhexlify_into);
+
+STATIC size_t binascii_a2b_base64(const mp_buffer_info_t *bufinfo, byte *out, size_t max_len) {
+    int len = base64_decode(bufinfo->buf, bufinfo->len, out, max_len, true);
+    if (len == BASE64_ERR_PADDING) {
+        mp_raise_ValueError("incorrect padding");
+    } else if (len == BASE64_ERR_SPACE) {
+        mp_raise_ValueError("buffer too small");
     }
+    return len;
 }
 
 mp_obj_t mod_binascii_a2b_base64(mp_obj_t data) {
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
-    byte *in = bufinfo.buf;
 
     vstr_t vstr;
-    vstr_init(&vstr, (bufinfo.len / 4) * 3 + 1); // Potentially over-allocate
-    byte *out = (byte *)vstr.buf;
-
-    uint shift = 0;
-    int nbits = 0; // Number of meaningful bits in shift
-    bool hadpad = false; // Had a pad character since last valid character
-    for (size_t i = 0; i < bufinfo.len; i++) {
-        if (in[i] == '=') {
-            if ((nbits == 2) || ((nbits == 4) && hadpad)) {
-                nbits = 0;
-                break;
-            }
-            hadpad = true;
-        }
-
-        int sextet = mod_binascii_sextet(in[i]);
-        if (sextet == -1) {
-            continue;
-        }
-        hadpad = false;
-        shift = (shift << 6) | sextet;
-        nbits += 6;
-
-        if (nbits >= 8) {
-            nbits -= 8;
-            out[vstr.len++] = (shift >> nbits) & 0xFF;
-        }
-    }
-
-    if (nbits) {
-        mp_raise_ValueError("incorrect padding");
-    }
-
+    size_t max_len = BASE64_DECODED_MAX_LEN(bufinfo.len); // Potentially over-allocate
+    vstr_init(&vstr, max_len);
+    vstr.len = binascii_a2b_base64(&bufinfo, (byte*)vstr.buf, max_len);
     return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
 }
 MP_DEFINE_CONST_FUN_OBJ_1(mod_binascii_a2b_base64_obj, mod_binascii_a2b_base64);
 
-mp_obj_t mod_binascii_b2a_base64(mp_obj_t data) {
+mp_obj_t mod_binascii_a2b_base64_into(mp_obj_t data, mp_obj_t buf) {
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+    mp_buffer_info_t outinfo;
+    mp_get_buffer_raise(buf, &outinfo, MP_BUFFER_WRITE);
+    return MP_OBJ_NEW_SMALL_INT(binascii_a2b_base64(&bufinfo, outinfo.buf, outinfo.len));
+}
+MP_DEFINE_CONST_FUN_OBJ_2(mod_binascii_a2b_base64_into_obj, mod_binascii_a2b_base64_into);
+
+STATIC const mp_arg_t binascii_b2a_base64_args[] = {
+    { MP_QSTR_data,    MP_ARG_REQUIRED | MP_ARG_OBJ, },
+    { MP_QSTR_buf,     MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+    { MP_QSTR_newline, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
+};
+
+// Encodes into buf_in, or into a new bytes object when buf_in is MP_OBJ_NULL
+STATIC mp_obj_t binascii_b2a_base64(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args, bool into) {
+    enum { ARG_data, ARG_buf, ARG_newline };
+    mp_arg_val_t args[MP_ARRAY_SIZE(binascii_b2a_base64_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(args), binascii_b2a_base64_args, args);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[ARG_data].u_obj, &bufinfo, MP_BUFFER_READ);
+    bool newline = args[ARG_newline].u_bool;
+    size_t out_len = BASE64_ENCODED_LEN(bufinfo.len) + newline;
 
     vstr_t vstr;
-    vstr_init_len(&vstr, ((bufinfo.len != 0) ? (((bufinfo.len - 1) / 3) + 1) * 4 : 0) + 1);
-
-    // First pass, we convert input buffer to numeric base 64 values
-    byte *in = bufinfo.buf, *out = (byte*)vstr.buf;
-    mp_uint_t i;
-    for (i = bufinfo.len; i >= 3; i -= 3) {
-        *out++ = (in[0] & 0xFC) >> 2;
-        *out++ = (in[0] & 0x03) << 4 | (in[1] & 0xF0) >> 4;
-        *out++ = (in[1] & 0x0F) << 2 | (in[2] & 0xC0) >> 6;
-        *out++ = in[2] & 0x3F;
-        in += 3;
-    }
-    if (i != 0) {
-        *out++ = (in[0] & 0xFC) >> 2;
-        if (i == 2) {
-            *out++ = (in[0] & 0x03) << 4 | (in[1] & 0xF0) >> 4;
-            *out++ = (in[1] & 0x0F) << 2;
+    byte *out;
+    if (into) {
+        if (args[ARG_buf].u_obj == MP_OBJ_NULL) {
+            mp_raise_TypeError("buffer required");
         }
-        else {
-            *out++ = (in[0] & 0x03) << 4;
-            *out++ = 64;
+        out = binascii_get_out_buf(args[ARG_buf].u_obj, out_len);
+    } else {
+        if (args[ARG_buf].u_obj != MP_OBJ_NULL) {
+            mp_raise_TypeError(NULL);
         }
-        *out = 64;
+        vstr_init_len(&vstr, out_len);
+        out = (byte*)vstr.buf;
     }
 
-    // Second pass, we convert number base 64 values to actual base64 ascii encoding
-    out = (byte*)vstr.buf;
-    for (mp_uint_t j = vstr.len - 1; j--;) {
-        if (*out < 26) {
-            *out += 'A';
-        } else if (*out < 52) {
-            *out += 'a' - 26;
-        } else if (*out < 62) {
-            *out += '0' - 52;
-        } else if (*out == 62) {
-            *out ='+';
-        } else if (*out == 63) {
-            *out = '/';
-        } else {
-            *out = '=';
-        }
-        out++;
+    base64_encode(bufinfo.buf, bufinfo.len, (char*)out, true);
+    if (newline) {
+        out[out_len - 1] = '\n';
+    }
+
+    if (into) {
+        return MP_OBJ_NEW_SMALL_INT(out_len);
     }
-    *out = '\n';
     return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
 }
-MP_DEFINE_CONST_FUN_OBJ_1(mod_binascii_b2a_base64_obj, mod_binascii_b2a_base64);
+
+mp_obj_t mod_binascii_b2a_base64(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    return binascii_b2a_base64(n_args, pos_args, kw_args, false);
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(mod_binascii_b2a_base64_obj, 1, mod_binascii_b2a_base64);
+
+mp_obj_t mod_binascii_b2a_base64_into(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    return binascii_b2a_base64(n_args, pos_args, kw_args, true);
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(mod_binascii_b2a_base64_into_obj, 2, mod_binascii_b2a_base64_into);
 
 #if MICROPY_PY_UBINASCII_CRC32
 #include "uzlib/tinf.h"
@@ -238,6 +243,10 @@ STATIC const mp_rom_map_elem_t mp_module_binascii_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_unhexlify), MP_ROM_PTR(&mod_binascii_unhexlify_obj) },
     { MP_ROM_QSTR(MP_QSTR_a2b_base64), MP_ROM_PTR(&mod_binascii_a2b_base64_obj) },
     { MP_ROM_QSTR(MP_QSTR_b2a_base64), MP_ROM_PTR(&mod_binascii_b2a_base64_obj) },
+    { MP_ROM_QSTR(MP_QSTR_hexlify_into), MP_ROM_PTR(&mod_binascii_hexlify_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_unhexlify_into), MP_ROM_PTR(&mod_binascii_unhexlify_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_a2b_base64_into), MP_ROM_PTR(&mod_binascii_a2b_base64_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_b2a_base64_into), MP_ROM_PTR(&mod_binascii_b2a_base64_into_obj) },
     #if MICROPY_PY_UBINASCII_CRC32
     { MP_ROM_QSTR(MP_QSTR_crc32), MP_ROM_PTR(&mod_binascii_crc32_obj) },
     #endif
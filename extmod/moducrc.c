@@ -0,0 +1,244 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "py/runtime.h"
+
+#if MICROPY_PY_UCRC
+
+// A CRC following the Rocksoft model (width, poly, init, refin, refout,
+// xorout), computed a byte at a time through a 256 entry table which is
+// built once, when the CRC object is created.
+//
+// The register is kept reflected when refin is set, and left aligned in 32
+// bits otherwise, so that the same byte loop works for any width.
+
+typedef struct _mp_obj_crc_t {
+    mp_obj_base_t base;
+    uint8_t width;
+    bool refin;
+    bool refout;
+    uint32_t init;      // initial value of the register
+    uint32_t xorout;
+    uint32_t reg;
+    uint32_t table[256];
+} mp_obj_crc_t;
+
+typedef struct _crc_preset_t {
+    qstr name;
+    uint8_t width;
+    bool refin;         // refout is the same for all of these
+    uint32_t poly;
+    uint32_t init;
+    uint32_t xorout;
+} crc_preset_t;
+
+// From the catalogue of parametrised CRC algorithms, by the names it uses
+STATIC const crc_preset_t crc_presets[] = {
+    { MP_QSTR_crc8,              8,  false, 0x07,       0x00,       0x00 },
+    { MP_QSTR_crc8_maxim,        8,  true,  0x31,       0x00,       0x00 },
+    { MP_QSTR_crc16_arc,         16, true,  0x8005,     0x0000,     0x0000 },
+    { MP_QSTR_crc16_modbus,      16, true,  0x8005,     0xffff,     0x0000 },
+    { MP_QSTR_crc16_kermit,      16, true,  0x1021,     0x0000,     0x0000 },
+    { MP_QSTR_crc16_xmodem,      16, false, 0x1021,     0x0000,     0x0000 },
+    { MP_QSTR_crc16_ccitt_false, 16, false, 0x1021,     0xffff,     0x0000 },
+    { MP_QSTR_crc32,             32, true,  0x04c11db7, 0xffffffff, 0xffffffff },
+    { MP_QSTR_crc32c,            32, true,  0x1edc6f41, 0xffffffff, 0xffffffff },
+};
+
+STATIC uint32_t crc_reflect(uint32_t v, uint8_t width) {
+    uint32_t r = 0;
+    for (uint8_t i = 0; i < width; i++) {
+        r = (r << 1) | (v & 1);
+        v >>= 1;
+    }
+    return r;
+}
+
+STATIC uint32_t crc_mask(uint8_t width) {
+    return (width == 32) ? 0xffffffff : ((1UL << width) - 1);
+}
+
+STATIC void crc_setup(mp_obj_crc_t *self, uint8_t width, uint32_t poly, uint32_t init,
+                      bool refin, bool refout, uint32_t xorout) {
+    uint32_t mask = crc_mask(width);
+    self->width = width;
+    self->refin = refin;
+    self->refout = refout;
+    self->xorout = xorout & mask;
+
+    if (refin) {
+        poly = crc_reflect(poly & mask, width);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int j = 0; j < 8; j++) {
+                c = (c & 1) ? (c >> 1) ^ poly : (c >> 1);
+            }
+            self->table[i] = c;
+        }
+        self->init = crc_reflect(init & mask, width);
+    } else {
+        poly = (poly & mask) << (32 - width);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i << 24;
+            for (int j = 0; j < 8; j++) {
+                c = (c & 0x80000000) ? (c << 1) ^ poly : (c << 1);
+            }
+            self->table[i] = c;
+        }
+        self->init = (init & mask) << (32 - width);
+    }
+    self->reg = self->init;
+}
+
+STATIC uint32_t crc_update(const mp_obj_crc_t *self, uint32_t reg, const uint8_t *buf, size_t len) {
+    const uint32_t *table = self->table;
+    if (self->refin) {
+        while (len--) {
+            reg = table[(reg ^ *buf++) & 0xff] ^ (reg >> 8);
+        }
+    } else {
+        while (len--) {
+            reg = table[(reg >> 24) ^ *buf++] ^ (reg << 8);
+        }
+    }
+    return reg;
+}
+
+STATIC mp_obj_t crc_value(const mp_obj_crc_t *self, uint32_t reg) {
+    if (!self->refin) {
+        reg >>= 32 - self->width;
+    }
+    if (self->refin != self->refout) {
+        reg = crc_reflect(reg, self->width);
+    }
+    return mp_obj_new_int_from_uint(reg ^ self->xorout);
+}
+
+STATIC mp_obj_t crc_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
+    enum { ARG_width, ARG_poly, ARG_init, ARG_refin, ARG_refout, ARG_xorout };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_width,  MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_poly,   MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_init,   MP_ARG_OBJ, {.u_obj = MP_OBJ_NEW_SMALL_INT(0)} },
+        { MP_QSTR_refin,  MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_refout, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_xorout, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NEW_SMALL_INT(0)} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_crc_t *self = m_new_obj(mp_obj_crc_t);
+    self->base.type = type;
+
+    if (MP_OBJ_IS_STR(args[ARG_width].u_obj)) {
+        // one of the presets, by name
+        qstr name = mp_obj_str_get_qstr(args[ARG_width].u_obj);
+        for (size_t i = 0; i < MP_ARRAY_SIZE(crc_presets); i++) {
+            const crc_preset_t *p = &crc_presets[i];
+            if (p->name == name) {
+                crc_setup(self, p->width, p->poly, p->init, p->refin, p->refin, p->xorout);
+                return MP_OBJ_FROM_PTR(self);
+            }
+        }
+        mp_raise_ValueError("unknown CRC");
+    }
+
+    mp_int_t width = mp_obj_get_int(args[ARG_width].u_obj);
+    if (width < 1 || width > 32) {
+        mp_raise_ValueError("width must be 1-32");
+    }
+    if (args[ARG_poly].u_obj == MP_OBJ_NULL) {
+        mp_raise_TypeError("poly required");
+    }
+    bool refin = args[ARG_refin].u_bool;
+    bool refout = (args[ARG_refout].u_obj == mp_const_none) ? refin : mp_obj_is_true(args[ARG_refout].u_obj);
+    // 32 bit values may not fit in a small int, so these are truncated
+    crc_setup(self, width, mp_obj_get_int_truncated(args[ARG_poly].u_obj),
+              mp_obj_get_int_truncated(args[ARG_init].u_obj), refin, refout,
+              mp_obj_get_int_truncated(args[ARG_xorout].u_obj));
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC mp_obj_t crc_update_meth(mp_obj_t self_in, mp_obj_t data) {
+    mp_obj_crc_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+    self->reg = crc_update(self, self->reg, bufinfo.buf, bufinfo.len);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(crc_update_obj, crc_update_meth);
+
+STATIC mp_obj_t crc_digest(mp_obj_t self_in) {
+    mp_obj_crc_t *self = MP_OBJ_TO_PTR(self_in);
+    return crc_value(self, self->reg);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(crc_digest_obj, crc_digest);
+
+STATIC mp_obj_t crc_reset(mp_obj_t self_in) {
+    mp_obj_crc_t *self = MP_OBJ_TO_PTR(self_in);
+    self->reg = self->init;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(crc_reset_obj, crc_reset);
+
+// One shot CRC of data, which leaves the running CRC alone
+STATIC mp_obj_t crc_calc(mp_obj_t self_in, mp_obj_t data) {
+    mp_obj_crc_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+    return crc_value(self, crc_update(self, self->init, bufinfo.buf, bufinfo.len));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(crc_calc_obj, crc_calc);
+
+STATIC const mp_rom_map_elem_t crc_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&crc_update_obj) },
+    { MP_ROM_QSTR(MP_QSTR_digest), MP_ROM_PTR(&crc_digest_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&crc_reset_obj) },
+    { MP_ROM_QSTR(MP_QSTR_calc), MP_ROM_PTR(&crc_calc_obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(crc_locals_dict, crc_locals_dict_table);
+
+STATIC const mp_obj_type_t crc_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_CRC,
+    .make_new = crc_make_new,
+    .locals_dict = (void*)&crc_locals_dict,
+};
+
+STATIC const mp_rom_map_elem_t mp_module_ucrc_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_ucrc) },
+    { MP_ROM_QSTR(MP_QSTR_CRC), MP_ROM_PTR(&crc_type) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(mp_module_ucrc_globals, mp_module_ucrc_globals_table);
+
+const mp_obj_module_t mp_module_ucrc = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&mp_module_ucrc_globals,
+};
+
+#endif // MICROPY_PY_UCRC
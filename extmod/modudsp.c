@@ -0,0 +1,708 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <math.h>
+
+#include "py/runtime.h"
+#include "py/binary.h"
+#include "py/smallint.h"
+
+#if MICROPY_PY_UDSP
+
+// Numeric kernels over array.array, memoryview or any other object with the
+// buffer protocol, of typecode 'h', 'H', 'i' or 'f'.
+//
+// Each operation is written once and expanded by DSP_FOR_TYPE into a loop
+// per element type, so the inner loops do no type dispatch. Integer results
+// are rounded and saturated to the range of the destination type, integer
+// sums and products are accumulated in 64 bits. Destinations may be the same
+// buffer as a source.
+
+#if !MICROPY_PY_BUILTINS_FLOAT
+#error udsp requires MICROPY_PY_BUILTINS_FLOAT
+#endif
+
+// Expands the statements once per supported typecode, with T the element
+// type, IS_FLOAT, and LO/HI the range of integer types.
+#define DSP_FOR_TYPE(typecode, ...) \
+    switch (typecode) { \
+        case 'h': { typedef int16_t T; enum { IS_FLOAT = 0 }; const int64_t LO = INT16_MIN, HI = INT16_MAX; (void)LO; (void)HI; __VA_ARGS__; break; } \
+        case 'H': { typedef uint16_t T; enum { IS_FLOAT = 0 }; const int64_t LO = 0, HI = UINT16_MAX; (void)LO; (void)HI; __VA_ARGS__; break; } \
+        case 'i': { typedef int32_t T; enum { IS_FLOAT = 0 }; const int64_t LO = INT32_MIN, HI = INT32_MAX; (void)LO; (void)HI; __VA_ARGS__; break; } \
+        default: { typedef float T; enum { IS_FLOAT = 1 }; const int64_t LO = 0, HI = 0; (void)LO; (void)HI; __VA_ARGS__; break; } \
+    }
+
+typedef struct _dsp_array_t {
+    void *buf;
+    size_t len;         // in elements
+    char typecode;
+} dsp_array_t;
+
+STATIC void dsp_get_array(mp_obj_t obj, dsp_array_t *a, int flags) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(obj, &bufinfo, flags);
+    switch (bufinfo.typecode) {
+        case 'h': case 'H': case 'i': case 'f':
+            break;
+        default:
+            mp_raise_ValueError("unsupported array type");
+    }
+    a->buf = bufinfo.buf;
+    a->len = bufinfo.len / mp_binary_get_size('@', bufinfo.typecode, NULL);
+    a->typecode = bufinfo.typecode;
+}
+
+// dst has to be of the same type as src and hold at least len elements
+STATIC void dsp_check_dst(const dsp_array_t *dst, const dsp_array_t *src, size_t len) {
+    if (dst->typecode != src->typecode) {
+        mp_raise_ValueError("array types differ");
+    }
+    if (dst->len < len) {
+        mp_raise_ValueError("destination too small");
+    }
+}
+
+static inline int64_t dsp_sat(int64_t v, int64_t lo, int64_t hi) {
+    return (v < lo) ? lo : (v > hi) ? hi : v;
+}
+
+static inline int64_t dsp_round_sat(mp_float_t v, int64_t lo, int64_t hi) {
+    if (v <= (mp_float_t)lo) {
+        return lo;
+    } else if (v >= (mp_float_t)hi) {
+        return hi;
+    }
+    return (int64_t)MICROPY_FLOAT_C_FUN(floor)(v + MICROPY_FLOAT_CONST(0.5));
+}
+
+STATIC mp_obj_t dsp_new_int(int64_t v) {
+    if (MP_SMALL_INT_FITS(v)) {
+        return MP_OBJ_NEW_SMALL_INT(v);
+    }
+    return mp_obj_new_int_from_ll(v);
+}
+
+/******************************************************************************/
+// Elementwise operations
+
+enum { DSP_OP_ADD, DSP_OP_MUL };
+
+// dst[i] = a[i] op b[i], or a[i] op b when b is a number
+STATIC mp_obj_t dsp_elementwise(mp_obj_t dst_in, mp_obj_t a_in, mp_obj_t b_in, int op) {
+    dsp_array_t dst, a, b;
+    dsp_get_array(a_in, &a, MP_BUFFER_READ);
+    dsp_get_array(dst_in, &dst, MP_BUFFER_WRITE);
+    dsp_check_dst(&dst, &a, a.len);
+    size_t n = a.len;
+
+    if (mp_obj_is_integer(b_in) || mp_obj_is_float(b_in)) {
+        mp_float_t k = mp_obj_get_float(b_in);
+        DSP_FOR_TYPE(a.typecode,
+            const T *s = a.buf;
+            T *d = dst.buf;
+            for (size_t i = 0; i < n; i++) {
+                mp_float_t v = (op == DSP_OP_ADD) ? s[i] + k : s[i] * k;
+                d[i] = IS_FLOAT ? (T)v : (T)dsp_round_sat(v, LO, HI);
+            }
+        )
+        return mp_const_none;
+    }
+
+    dsp_get_array(b_in, &b, MP_BUFFER_READ);
+    if (b.typecode != a.typecode) {
+        mp_raise_ValueError("array types differ");
+    }
+    if (b.len != n) {
+        mp_raise_ValueError("lengths differ");
+    }
+    DSP_FOR_TYPE(a.typecode,
+        const T *s = a.buf;
+        const T *t = b.buf;
+        T *d = dst.buf;
+        if (IS_FLOAT) {
+            for (size_t i = 0; i < n; i++) {
+                d[i] = (op == DSP_OP_ADD) ? s[i] + t[i] : s[i] * t[i];
+            }
+        } else if (op == DSP_OP_ADD) {
+            for (size_t i = 0; i < n; i++) {
+                d[i] = (T)dsp_sat((int64_t)s[i] + t[i], LO, HI);
+            }
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                d[i] = (T)dsp_sat((int64_t)s[i] * t[i], LO, HI);
+            }
+        }
+    )
+    return mp_const_none;
+}
+
+STATIC mp_obj_t dsp_add(mp_obj_t dst_in, mp_obj_t a_in, mp_obj_t b_in) {
+    return dsp_elementwise(dst_in, a_in, b_in, DSP_OP_ADD);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(dsp_add_obj, dsp_add);
+
+STATIC mp_obj_t dsp_mul(mp_obj_t dst_in, mp_obj_t a_in, mp_obj_t b_in) {
+    return dsp_elementwise(dst_in, a_in, b_in, DSP_OP_MUL);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(dsp_mul_obj, dsp_mul);
+
+// scale(dst, src, k, offset=0): dst[i] = src[i] * k + offset
+//
+// dst may also be an 'f' array for integer src, to convert e.g. raw ADC
+// samples for rfft().
+STATIC mp_obj_t dsp_scale(size_t n_args, const mp_obj_t *args) {
+    dsp_array_t dst, a;
+    dsp_get_array(args[1], &a, MP_BUFFER_READ);
+    dsp_get_array(args[0], &dst, MP_BUFFER_WRITE);
+    mp_float_t k = mp_obj_get_float(args[2]);
+    mp_float_t offset = (n_args > 3) ? mp_obj_get_float(args[3]) : 0;
+    size_t n = a.len;
+    if (dst.typecode == 'f' && a.typecode != 'f') {
+        if (dst.len < n) {
+            mp_raise_ValueError("destination too small");
+        }
+        float *d = dst.buf;
+        DSP_FOR_TYPE(a.typecode,
+            const T *s = a.buf;
+            for (size_t i = 0; i < n; i++) {
+                d[i] = s[i] * k + offset;
+            }
+        )
+        return mp_const_none;
+    }
+    dsp_check_dst(&dst, &a, n);
+    DSP_FOR_TYPE(a.typecode,
+        const T *s = a.buf;
+        T *d = dst.buf;
+        for (size_t i = 0; i < n; i++) {
+            mp_float_t v = s[i] * k + offset;
+            d[i] = IS_FLOAT ? (T)v : (T)dsp_round_sat(v, LO, HI);
+        }
+    )
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(dsp_scale_obj, 3, 4, dsp_scale);
+
+/******************************************************************************/
+// Reductions
+
+STATIC mp_obj_t dsp_sum(mp_obj_t a_in) {
+    dsp_array_t a;
+    dsp_get_array(a_in, &a, MP_BUFFER_READ);
+    size_t n = a.len;
+    DSP_FOR_TYPE(a.typecode,
+        const T *s = a.buf;
+        if (IS_FLOAT) {
+            mp_float_t acc = 0;
+            for (size_t i = 0; i < n; i++) {
+                acc += s[i];
+            }
+            return mp_obj_new_float(acc);
+        } else {
+            int64_t acc = 0;
+            for (size_t i = 0; i < n; i++) {
+                acc += s[i];
+            }
+            return dsp_new_int(acc);
+        }
+    )
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(dsp_sum_obj, dsp_sum);
+
+STATIC mp_obj_t dsp_mean(mp_obj_t a_in) {
+    dsp_array_t a;
+    dsp_get_array(a_in, &a, MP_BUFFER_READ);
+    size_t n = a.len;
+    if (n == 0) {
+        mp_raise_ValueError("empty array");
+    }
+    mp_float_t mean = 0;
+    DSP_FOR_TYPE(a.typecode,
+        const T *s = a.buf;
+        if (IS_FLOAT) {
+            mp_float_t acc = 0;
+            for (size_t i = 0; i < n; i++) {
+                acc += s[i];
+            }
+            mean = acc / n;
+        } else {
+            int64_t acc = 0;
+            for (size_t i = 0; i < n; i++) {
+                acc += s[i];
+            }
+            mean = (mp_float_t)acc / n;
+        }
+    )
+    return mp_obj_new_float(mean);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(dsp_mean_obj, dsp_mean);
+
+STATIC mp_obj_t dsp_minmax(mp_obj_t a_in, bool is_max) {
+    dsp_array_t a;
+    dsp_get_array(a_in, &a, MP_BUFFER_READ);
+    size_t n = a.len;
+    if (n == 0) {
+        mp_raise_ValueError("empty array");
+    }
+    DSP_FOR_TYPE(a.typecode,
+        const T *s = a.buf;
+        T m = s[0];
+        if (is_max) {
+            for (size_t i = 1; i < n; i++) {
+                if (s[i] > m) {
+                    m = s[i];
+                }
+            }
+        } else {
+            for (size_t i = 1; i < n; i++) {
+                if (s[i] < m) {
+                    m = s[i];
+                }
+            }
+        }
+        return IS_FLOAT ? mp_obj_new_float(m) : dsp_new_int((int64_t)m);
+    )
+    return mp_const_none;
+}
+
+STATIC mp_obj_t dsp_min(mp_obj_t a_in) {
+    return dsp_minmax(a_in, false);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(dsp_min_obj, dsp_min);
+
+STATIC mp_obj_t dsp_max(mp_obj_t a_in) {
+    return dsp_minmax(a_in, true);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(dsp_max_obj, dsp_max);
+
+STATIC mp_obj_t dsp_rms(mp_obj_t a_in) {
+    dsp_array_t a;
+    dsp_get_array(a_in, &a, MP_BUFFER_READ);
+    size_t n = a.len;
+    if (n == 0) {
+        mp_raise_ValueError("empty array");
+    }
+    mp_float_t ms = 0;
+    DSP_FOR_TYPE(a.typecode,
+        const T *s = a.buf;
+        if (IS_FLOAT || sizeof(T) > 2) {
+            // the squares of 32 bit values would overflow a 64 bit sum
+            mp_float_t acc = 0;
+            for (size_t i = 0; i < n; i++) {
+                mp_float_t v = s[i];
+                acc += v * v;
+            }
+            ms = acc / n;
+        } else {
+            uint64_t acc = 0;
+            for (size_t i = 0; i < n; i++) {
+                int64_t v = s[i];
+                acc += v * v;
+            }
+            ms = (mp_float_t)acc / n;
+        }
+    )
+    return mp_obj_new_float(MICROPY_FLOAT_C_FUN(sqrt)(ms));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(dsp_rms_obj, dsp_rms);
+
+STATIC mp_obj_t dsp_dot(mp_obj_t a_in, mp_obj_t b_in) {
+    dsp_array_t a, b;
+    dsp_get_array(a_in, &a, MP_BUFFER_READ);
+    dsp_get_array(b_in, &b, MP_BUFFER_READ);
+    if (b.typecode != a.typecode) {
+        mp_raise_ValueError("array types differ");
+    }
+    if (b.len != a.len) {
+        mp_raise_ValueError("lengths differ");
+    }
+    size_t n = a.len;
+    DSP_FOR_TYPE(a.typecode,
+        const T *s = a.buf;
+        const T *t = b.buf;
+        if (IS_FLOAT) {
+            mp_float_t acc = 0;
+            for (size_t i = 0; i < n; i++) {
+                acc += s[i] * t[i];
+            }
+            return mp_obj_new_float(acc);
+        } else {
+            int64_t acc = 0;
+            for (size_t i = 0; i < n; i++) {
+                acc += (int64_t)s[i] * t[i];
+            }
+            return dsp_new_int(acc);
+        }
+    )
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(dsp_dot_obj, dsp_dot);
+
+/******************************************************************************/
+// Filters
+//
+// Both only produce the outputs for which the whole window is inside src,
+// len(src) - window + 1 of them, and return that count. dst[i] only depends
+// on src[i] and later samples, so dst may be src for filtering in place.
+
+// moving_average(dst, src, n)
+STATIC mp_obj_t dsp_moving_average(mp_obj_t dst_in, mp_obj_t src_in, mp_obj_t n_in) {
+    dsp_array_t dst, src;
+    dsp_get_array(src_in, &src, MP_BUFFER_READ);
+    dsp_get_array(dst_in, &dst, MP_BUFFER_WRITE);
+    mp_int_t w = mp_obj_get_int(n_in);
+    if (w < 1 || (size_t)w > src.len) {
+        mp_raise_ValueError("bad window");
+    }
+    size_t n = src.len - w + 1;
+    dsp_check_dst(&dst, &src, n);
+    DSP_FOR_TYPE(src.typecode,
+        const T *s = src.buf;
+        T *d = dst.buf;
+        if (IS_FLOAT) {
+            mp_float_t acc = 0;
+            mp_float_t inv = MICROPY_FLOAT_CONST(1.0) / w;
+            for (mp_int_t i = 0; i < w - 1; i++) {
+                acc += s[i];
+            }
+            for (size_t i = 0; i < n; i++) {
+                acc += s[i + w - 1];
+                T old = s[i];
+                d[i] = acc * inv;
+                acc -= old;
+            }
+        } else {
+            // the running sum is exact for integers, round to nearest
+            int64_t acc = 0;
+            for (mp_int_t i = 0; i < w - 1; i++) {
+                acc += s[i];
+            }
+            for (size_t i = 0; i < n; i++) {
+                acc += s[i + w - 1];
+                T old = s[i];
+                int64_t v = (acc >= 0) ? (acc + w / 2) / w : -((-acc + w / 2) / w);
+                d[i] = (T)v;
+                acc -= old;
+            }
+        }
+    )
+    return MP_OBJ_NEW_SMALL_INT(n);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(dsp_moving_average_obj, dsp_moving_average);
+
+// fir(dst, src, taps): dst[i] = sum(taps[k] * src[i + len(taps) - 1 - k])
+//
+// taps is an 'f' array, or for integer data also an 'h' array of Q15
+// coefficients, which keeps the whole filter in 16x16 bit multiply and
+// accumulate.
+STATIC mp_obj_t dsp_fir(mp_obj_t dst_in, mp_obj_t src_in, mp_obj_t taps_in) {
+    dsp_array_t dst, src, taps;
+    dsp_get_array(src_in, &src, MP_BUFFER_READ);
+    dsp_get_array(dst_in, &dst, MP_BUFFER_WRITE);
+    dsp_get_array(taps_in, &taps, MP_BUFFER_READ);
+    if (taps.len < 1 || taps.len > src.len) {
+        mp_raise_ValueError("bad taps");
+    }
+    size_t n = src.len - taps.len + 1;
+    size_t m = taps.len;
+    dsp_check_dst(&dst, &src, n);
+
+    if (taps.typecode == 'h' && src.typecode != 'f') {
+        const int16_t *h = taps.buf;
+        DSP_FOR_TYPE(src.typecode,
+            const T *s = src.buf;
+            T *d = dst.buf;
+            for (size_t i = 0; i < n; i++) {
+                const T *x = s + i + m - 1;
+                int64_t acc = 0;
+                for (size_t k = 0; k < m; k++) {
+                    acc += (int32_t)h[k] * (int64_t)x[-(mp_int_t)k];
+                }
+                d[i] = (T)dsp_sat((acc + (1 << 14)) >> 15, LO, HI);
+            }
+        )
+    } else if (taps.typecode == 'f') {
+        const float *h = taps.buf;
+        DSP_FOR_TYPE(src.typecode,
+            const T *s = src.buf;
+            T *d = dst.buf;
+            for (size_t i = 0; i < n; i++) {
+                const T *x = s + i + m - 1;
+                mp_float_t acc = 0;
+                for (size_t k = 0; k < m; k++) {
+                    acc += h[k] * x[-(mp_int_t)k];
+                }
+                d[i] = IS_FLOAT ? (T)acc : (T)dsp_round_sat(acc, LO, HI);
+            }
+        )
+    } else {
+        mp_raise_ValueError("unsupported taps type");
+    }
+    return MP_OBJ_NEW_SMALL_INT(n);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(dsp_fir_obj, dsp_fir);
+
+/******************************************************************************/
+// Spectra
+//
+// rfft() transforms N real samples, N a power of 2, in place into the packed
+// half spectrum: buf[0] is bin 0, buf[1] is bin N/2, both real, and
+// buf[2k], buf[2k + 1] are the real and imaginary parts of bin k, for k from
+// 1 to N/2 - 1. The other half is the complex conjugate of this one.
+//
+// It is done as a complex FFT of N/2 points, the even samples as the real and
+// the odd ones as the imaginary parts, which is then split into the spectrum
+// of the real sequence. The twiddle factors come from a recurrence, so there
+// is one sin/cos pair per pass and no table.
+
+#define DSP_PI MICROPY_FLOAT_CONST(3.14159265358979323846)
+
+enum { DSP_WIN_HANN, DSP_WIN_HAMMING, DSP_WIN_BLACKMAN };
+
+STATIC float *dsp_get_float_array(mp_obj_t obj, size_t *len, int flags) {
+    dsp_array_t a;
+    dsp_get_array(obj, &a, flags);
+    if (a.typecode != 'f') {
+        mp_raise_ValueError("'f' array required");
+    }
+    *len = a.len;
+    return a.buf;
+}
+
+// In place radix-2 FFT of n interleaved complex values
+STATIC void dsp_cfft(float *data, size_t n) {
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            float t = data[2 * i];
+            data[2 * i] = data[2 * j];
+            data[2 * j] = t;
+            t = data[2 * i + 1];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j + 1] = t;
+        }
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1) {
+        size_t half = len >> 1;
+        mp_float_t theta = -2 * DSP_PI / len;
+        mp_float_t wpr = MICROPY_FLOAT_C_FUN(sin)(theta / 2);
+        wpr = -2 * wpr * wpr;
+        mp_float_t wpi = MICROPY_FLOAT_C_FUN(sin)(theta);
+        mp_float_t wr = 1, wi = 0;
+        for (size_t m = 0; m < half; m++) {
+            for (size_t i = m; i < n; i += len) {
+                float *a = data + 2 * i;
+                float *b = data + 2 * (i + half);
+                float tr = wr * b[0] - wi * b[1];
+                float ti = wr * b[1] + wi * b[0];
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+            mp_float_t wt = wr;
+            wr += wr * wpr - wi * wpi;
+            wi += wi * wpr + wt * wpi;
+        }
+    }
+}
+
+STATIC mp_obj_t dsp_rfft(mp_obj_t buf_in) {
+    size_t len;
+    float *data = dsp_get_float_array(buf_in, &len, MP_BUFFER_WRITE);
+    if (len < 2 || (len & (len - 1)) != 0) {
+        mp_raise_ValueError("length must be a power of 2");
+    }
+    size_t n = len / 2;
+    dsp_cfft(data, n);
+
+    // X[0] and X[N/2] are both real
+    float z0r = data[0];
+    data[0] = z0r + data[1];
+    data[1] = z0r - data[1];
+
+    // X[k] and X[n - k] from Z[k] and Z[n - k], with W = exp(-2*pi*i/N)
+    mp_float_t theta = -DSP_PI / n;
+    mp_float_t wpr = MICROPY_FLOAT_C_FUN(sin)(theta / 2);
+    wpr = -2 * wpr * wpr;
+    mp_float_t wpi = MICROPY_FLOAT_C_FUN(sin)(theta);
+    mp_float_t wr = 1 + wpr, wi = wpi;
+    for (size_t k = 1; k <= n / 2; k++) {
+        float *a = data + 2 * k;
+        float *b = data + 2 * (n - k);
+        float er = (a[0] + b[0]) / 2;
+        float ei = (a[1] - b[1]) / 2;
+        float or_ = (a[1] + b[1]) / 2;
+        float oi = (b[0] - a[0]) / 2;
+        float tr = wr * or_ - wi * oi;
+        float ti = wr * oi + wi * or_;
+        a[0] = er + tr;
+        a[1] = ei + ti;
+        if (b != a) {
+            b[0] = er - tr;
+            b[1] = ti - ei;
+        }
+        mp_float_t wt = wr;
+        wr += wr * wpr - wi * wpi;
+        wi += wi * wpr + wt * wpi;
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(dsp_rfft_obj, dsp_rfft);
+
+// window(buf, kind): multiplies buf in place by a periodic window, as used
+// ahead of an FFT
+STATIC mp_obj_t dsp_window(mp_obj_t buf_in, mp_obj_t kind_in) {
+    size_t n;
+    float *data = dsp_get_float_array(buf_in, &n, MP_BUFFER_WRITE);
+    mp_int_t kind = mp_obj_get_int(kind_in);
+    mp_float_t a0, a1, a2;
+    switch (kind) {
+        case DSP_WIN_HANN:
+            a0 = MICROPY_FLOAT_CONST(0.5); a1 = MICROPY_FLOAT_CONST(0.5); a2 = 0;
+            break;
+        case DSP_WIN_HAMMING:
+            a0 = MICROPY_FLOAT_CONST(0.54); a1 = MICROPY_FLOAT_CONST(0.46); a2 = 0;
+            break;
+        case DSP_WIN_BLACKMAN:
+            a0 = MICROPY_FLOAT_CONST(0.42); a1 = MICROPY_FLOAT_CONST(0.5); a2 = MICROPY_FLOAT_CONST(0.08);
+            break;
+        default:
+            mp_raise_ValueError("unknown window");
+    }
+    mp_float_t step = 2 * DSP_PI / n;
+    for (size_t i = 0; i < n; i++) {
+        mp_float_t w = a0 - a1 * MICROPY_FLOAT_C_FUN(cos)(step * i);
+        if (a2 != 0) {
+            w += a2 * MICROPY_FLOAT_C_FUN(cos)(2 * step * i);
+        }
+        data[i] *= w;
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(dsp_window_obj, dsp_window);
+
+// magnitude(dst, buf): dst[k] = |X[k]| for k from 0 to N/2, from the packed
+// output of rfft(). dst may be buf.
+STATIC mp_obj_t dsp_magnitude(mp_obj_t dst_in, mp_obj_t buf_in) {
+    size_t len, dst_len;
+    const float *data = dsp_get_float_array(buf_in, &len, MP_BUFFER_READ);
+    float *d = dsp_get_float_array(dst_in, &dst_len, MP_BUFFER_WRITE);
+    if (len < 2 || (len & 1)) {
+        mp_raise_ValueError("bad spectrum");
+    }
+    size_t n = len / 2;
+    if (dst_len < n + 1) {
+        mp_raise_ValueError("destination too small");
+    }
+    // read ahead of every write, for the in place case
+    float dc = data[0];
+    float nyquist = data[1];
+    d[0] = MICROPY_FLOAT_C_FUN(fabs)(dc);
+    for (size_t k = 1; k < n; k++) {
+        float re = data[2 * k];
+        float im = data[2 * k + 1];
+        d[k] = MICROPY_FLOAT_C_FUN(sqrt)(re * re + im * im);
+    }
+    d[n] = MICROPY_FLOAT_C_FUN(fabs)(nyquist);
+    return MP_OBJ_NEW_SMALL_INT(n + 1);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(dsp_magnitude_obj, dsp_magnitude);
+
+// band_energy(dst, buf, edges): dst[b] is the sum of |X[k]|^2 over the bins
+// edges[b] <= k < edges[b + 1], from the packed output of rfft()
+STATIC mp_obj_t dsp_band_energy(mp_obj_t dst_in, mp_obj_t buf_in, mp_obj_t edges_in) {
+    size_t len, dst_len, n_edges;
+    const float *data = dsp_get_float_array(buf_in, &len, MP_BUFFER_READ);
+    float *d = dsp_get_float_array(dst_in, &dst_len, MP_BUFFER_WRITE);
+    mp_obj_t *edges;
+    mp_obj_get_array(edges_in, &n_edges, &edges);
+    if (len < 2 || (len & 1)) {
+        mp_raise_ValueError("bad spectrum");
+    }
+    if (n_edges < 2 || dst_len < n_edges - 1) {
+        mp_raise_ValueError("bad bands");
+    }
+    size_t n = len / 2;
+    mp_int_t lo = mp_obj_get_int(edges[0]);
+    for (size_t b = 0; b + 1 < n_edges; b++) {
+        mp_int_t hi = mp_obj_get_int(edges[b + 1]);
+        if (lo < 0 || hi < lo || (size_t)hi > n + 1) {
+            mp_raise_ValueError("bad bands");
+        }
+        mp_float_t acc = 0;
+        for (mp_int_t k = lo; k < hi; k++) {
+            if (k == 0) {
+                acc += data[0] * data[0];
+            } else if ((size_t)k == n) {
+                acc += data[1] * data[1];
+            } else {
+                acc += data[2 * k] * data[2 * k] + data[2 * k + 1] * data[2 * k + 1];
+            }
+        }
+        d[b] = acc;
+        lo = hi;
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(dsp_band_energy_obj, dsp_band_energy);
+
+STATIC const mp_rom_map_elem_t mp_module_udsp_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_udsp) },
+    { MP_ROM_QSTR(MP_QSTR_add), MP_ROM_PTR(&dsp_add_obj) },
+    { MP_ROM_QSTR(MP_QSTR_mul), MP_ROM_PTR(&dsp_mul_obj) },
+    { MP_ROM_QSTR(MP_QSTR_scale), MP_ROM_PTR(&dsp_scale_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sum), MP_ROM_PTR(&dsp_sum_obj) },
+    { MP_ROM_QSTR(MP_QSTR_mean), MP_ROM_PTR(&dsp_mean_obj) },
+    { MP_ROM_QSTR(MP_QSTR_min), MP_ROM_PTR(&dsp_min_obj) },
+    { MP_ROM_QSTR(MP_QSTR_max), MP_ROM_PTR(&dsp_max_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rms), MP_ROM_PTR(&dsp_rms_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dot), MP_ROM_PTR(&dsp_dot_obj) },
+    { MP_ROM_QSTR(MP_QSTR_moving_average), MP_ROM_PTR(&dsp_moving_average_obj) },
+    { MP_ROM_QSTR(MP_QSTR_fir), MP_ROM_PTR(&dsp_fir_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rfft), MP_ROM_PTR(&dsp_rfft_obj) },
+    { MP_ROM_QSTR(MP_QSTR_window), MP_ROM_PTR(&dsp_window_obj) },
+    { MP_ROM_QSTR(MP_QSTR_magnitude), MP_ROM_PTR(&dsp_magnitude_obj) },
+    { MP_ROM_QSTR(MP_QSTR_band_energy), MP_ROM_PTR(&dsp_band_energy_obj) },
+    { MP_ROM_QSTR(MP_QSTR_HANN), MP_ROM_INT(DSP_WIN_HANN) },
+    { MP_ROM_QSTR(MP_QSTR_HAMMING), MP_ROM_INT(DSP_WIN_HAMMING) },
+    { MP_ROM_QSTR(MP_QSTR_BLACKMAN), MP_ROM_INT(DSP_WIN_BLACKMAN) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(mp_module_udsp_globals, mp_module_udsp_globals_table);
+
+const mp_obj_module_t mp_module_udsp = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&mp_module_udsp_globals,
+};
+
+#endif // MICROPY_PY_UDSP
@@ -25,22 +25,78 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "py/objlist.h"
+#include "py/objstr.h"
 #include "py/objstringio.h"
 #include "py/parsenum.h"
 #include "py/runtime.h"
 #include "py/stream.h"
+#include "py/stackctrl.h"
 
 #if MICROPY_PY_UJSON
 
-STATIC mp_obj_t mod_ujson_dump(mp_obj_t obj, mp_obj_t stream) {
+// The output of dump() can be gathered in a fixed buffer, written to the
+// stream each time it fills up, instead of a write per token.
+typedef struct _ujson_chunk_t {
+    mp_obj_t stream;
+    byte *buf;
+    size_t len;
+    size_t size;
+} ujson_chunk_t;
+
+STATIC void ujson_chunk_flush(ujson_chunk_t *chunk) {
+    if (chunk->len > 0) {
+        int errcode;
+        mp_stream_write_exactly(chunk->stream, chunk->buf, chunk->len, &errcode);
+        if (errcode != 0) {
+            mp_raise_OSError(errcode);
+        }
+        chunk->len = 0;
+    }
+}
+
+STATIC void ujson_chunk_strn(void *data, const char *str, size_t len) {
+    ujson_chunk_t *chunk = data;
+    while (len > 0) {
+        size_t n = MIN(len, chunk->size - chunk->len);
+        memcpy(chunk->buf + chunk->len, str, n);
+        chunk->len += n;
+        str += n;
+        len -= n;
+        if (chunk->len == chunk->size) {
+            ujson_chunk_flush(chunk);
+        }
+    }
+}
+
+STATIC mp_obj_t mod_ujson_dump(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_obj, ARG_stream, ARG_chunk_size };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_obj, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_stream, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_chunk_size, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t stream = args[ARG_stream].u_obj;
     mp_get_stream_raise(stream, MP_STREAM_OP_WRITE);
-    mp_print_t print = {MP_OBJ_TO_PTR(stream), mp_stream_write_adaptor};
-    mp_obj_print_helper(&print, obj, PRINT_JSON);
+    if (args[ARG_chunk_size].u_int <= 0) {
+        mp_print_t print = {MP_OBJ_TO_PTR(stream), mp_stream_write_adaptor};
+        mp_obj_print_helper(&print, args[ARG_obj].u_obj, PRINT_JSON);
+        return mp_const_none;
+    }
+
+    ujson_chunk_t chunk = {stream, m_new(byte, args[ARG_chunk_size].u_int), 0, args[ARG_chunk_size].u_int};
+    mp_print_t print = {&chunk, ujson_chunk_strn};
+    mp_obj_print_helper(&print, args[ARG_obj].u_obj, PRINT_JSON);
+    ujson_chunk_flush(&chunk);
+    m_del(byte, chunk.buf, chunk.size);
     return mp_const_none;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_ujson_dump_obj, mod_ujson_dump);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_ujson_dump_obj, 2, mod_ujson_dump);
 
 STATIC mp_obj_t mod_ujson_dumps(mp_obj_t obj) {
     vstr_t vstr;
@@ -87,18 +143,55 @@ STATIC byte ujson_stream_next(ujson_stream_t *s) {
     return s->cur;
 }
 
-STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
-    const mp_stream_p_t *stream_p = mp_get_stream_raise(stream_obj, MP_STREAM_OP_READ);
-    ujson_stream_t s = {stream_obj, stream_p->read, 0, 0};
-    vstr_t vstr;
-    vstr_init(&vstr, 8);
+// Decodes the string after the opening quote into vstr and consumes the closing quote
+STATIC bool ujson_parse_string(ujson_stream_t *ps, vstr_t *vstr) {
+    ujson_stream_t s = *ps;
+    vstr_reset(vstr);
+    for (; !S_END(s) && S_CUR(s) != '"';) {
+        byte c = S_CUR(s);
+        if (c == '\\') {
+            c = S_NEXT(s);
+            switch (c) {
+                case 'b': c = 0x08; break;
+                case 'f': c = 0x0c; break;
+                case 'n': c = 0x0a; break;
+                case 'r': c = 0x0d; break;
+                case 't': c = 0x09; break;
+                case 'u': {
+                    mp_uint_t num = 0;
+                    for (int i = 0; i < 4; i++) {
+                        c = (S_NEXT(s) | 0x20) - '0';
+                        if (c > 9) {
+                            c -= ('a' - ('9' + 1));
+                        }
+                        num = (num << 4) | c;
+                    }
+                    vstr_add_char(vstr, num);
+                    goto str_cont;
+                }
+            }
+        }
+        vstr_add_byte(vstr, c);
+    str_cont:
+        S_NEXT(s);
+    }
+    if (S_END(s)) {
+        return false;
+    }
+    S_NEXT(s);
+    *ps = s;
+    return true;
+}
+
+// Parses one value from the current character, the stream is left on the character following it
+STATIC mp_obj_t ujson_parse_value(ujson_stream_t *ps, vstr_t *vstr) {
+    ujson_stream_t s = *ps;
     mp_obj_list_t stack; // we use a list as a simple stack for nested JSON
     stack.len = 0;
     stack.items = NULL;
     mp_obj_t stack_top = MP_OBJ_NULL;
     mp_obj_type_t *stack_top_type = NULL;
     mp_obj_t stack_key = MP_OBJ_NULL;
-    S_NEXT(s);
     for (;;) {
         cont:
         if (S_END(s)) {
@@ -141,47 +234,17 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
                 }
                 break;
             case '"':
-                vstr_reset(&vstr);
-                for (; !S_END(s) && S_CUR(s) != '"';) {
-                    byte c = S_CUR(s);
-                    if (c == '\\') {
-                        c = S_NEXT(s);
-                        switch (c) {
-                            case 'b': c = 0x08; break;
-                            case 'f': c = 0x0c; break;
-                            case 'n': c = 0x0a; break;
-                            case 'r': c = 0x0d; break;
-                            case 't': c = 0x09; break;
-                            case 'u': {
-                                mp_uint_t num = 0;
-                                for (int i = 0; i < 4; i++) {
-                                    c = (S_NEXT(s) | 0x20) - '0';
-                                    if (c > 9) {
-                                        c -= ('a' - ('9' + 1));
-                                    }
-                                    num = (num << 4) | c;
-                                }
-                                vstr_add_char(&vstr, num);
-                                goto str_cont;
-                            }
-                        }
-                    }
-                    vstr_add_byte(&vstr, c);
-                str_cont:
-                    S_NEXT(s);
-                }
-                if (S_END(s)) {
+                if (!ujson_parse_string(&s, vstr)) {
                     goto fail;
                 }
-                S_NEXT(s);
-                next = mp_obj_new_str(vstr.buf, vstr.len);
+                next = mp_obj_new_str(vstr->buf, vstr->len);
                 break;
             case '-':
             case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9': {
                 bool flt = false;
-                vstr_reset(&vstr);
+                vstr_reset(vstr);
                 for (;;) {
-                    vstr_add_byte(&vstr, cur);
+                    vstr_add_byte(vstr, cur);
                     cur = S_CUR(s);
                     if (cur == '.' || cur == 'E' || cur == 'e') {
                         flt = true;
@@ -193,9 +256,9 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
                     S_NEXT(s);
                 }
                 if (flt) {
-                    next = mp_parse_num_decimal(vstr.buf, vstr.len, false, false, NULL);
+                    next = mp_parse_num_decimal(vstr->buf, vstr->len, false, false, NULL);
                 } else {
-                    next = mp_parse_num_integer(vstr.buf, vstr.len, 10, NULL);
+                    next = mp_parse_num_integer(vstr->buf, vstr->len, 10, NULL);
                 }
                 break;
             }
@@ -260,25 +323,234 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
         }
     }
     success:
+    if (stack_top == MP_OBJ_NULL || stack.len != 0) {
+        // not exactly 1 object
+        goto fail;
+    }
+    *ps = s;
+    return stack_top;
+
+    fail:
+    mp_raise_ValueError("syntax error in JSON");
+}
+
+STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
+    const mp_stream_p_t *stream_p = mp_get_stream_raise(stream_obj, MP_STREAM_OP_READ);
+    ujson_stream_t s = {stream_obj, stream_p->read, 0, 0};
+    vstr_t vstr;
+    vstr_init(&vstr, 8);
+    S_NEXT(s);
+    mp_obj_t obj = ujson_parse_value(&s, &vstr);
     // eat trailing whitespace
     while (unichar_isspace(S_CUR(s))) {
         S_NEXT(s);
     }
     if (!S_END(s)) {
         // unexpected chars
-        goto fail;
-    }
-    if (stack_top == MP_OBJ_NULL || stack.len != 0) {
-        // not exactly 1 object
-        goto fail;
+        mp_raise_ValueError("syntax error in JSON");
     }
     vstr_clear(&vstr);
-    return stack_top;
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ujson_load_obj, mod_ujson_load);
+
+// select() walks down the objects and arrays leading to the selected paths
+// and only builds the values found there, everything else is skipped
+// without allocating. A path is made of the keys and the array indices
+// separated by dots, e.g. "wifi.networks.0.ssid".
+
+typedef struct _ujson_select_t {
+    ujson_stream_t s;
+    vstr_t vstr;            // the strings being parsed
+    vstr_t path;            // the path of the current value
+    size_t n_paths;
+    mp_obj_t *paths;
+    mp_obj_t result;
+    size_t found;
+} ujson_select_t;
+
+#define UJSON_SELECT_NONE   (0)
+#define UJSON_SELECT_EXACT  (1)
+#define UJSON_SELECT_PREFIX (2)
+
+STATIC void ujson_skip_ws(ujson_stream_t *ps) {
+    for (;;) {
+        switch (ps->cur) {
+            case ',':
+            case ':':
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                ujson_stream_next(ps);
+                break;
+            default:
+                return;
+        }
+    }
+}
+
+STATIC void ujson_skip_value(ujson_stream_t *ps) {
+    ujson_stream_t s = *ps;
+    size_t depth = 0;
+    do {
+        byte c = S_CUR(s);
+        switch (c) {
+            case S_EOF:
+                goto fail;
+            case '"':
+                while (S_NEXT(s) != '"') {
+                    if (S_END(s)) {
+                        goto fail;
+                    }
+                    if (S_CUR(s) == '\\') {
+                        S_NEXT(s);
+                    }
+                }
+                S_NEXT(s);
+                break;
+            case '{':
+            case '[':
+                depth++;
+                S_NEXT(s);
+                break;
+            case '}':
+            case ']':
+                if (depth == 0) {
+                    goto fail;
+                }
+                depth--;
+                S_NEXT(s);
+                break;
+            case ',':
+            case ':':
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                S_NEXT(s);
+                break;
+            default:
+                // a primitive, up to the next delimiter
+                while (!S_END(s) && !unichar_isspace(S_CUR(s)) && S_CUR(s) != ',' && S_CUR(s) != ':'
+                    && S_CUR(s) != ']' && S_CUR(s) != '}') {
+                    S_NEXT(s);
+                }
+                break;
+        }
+    } while (depth > 0);
+    *ps = s;
+    return;
 
     fail:
     mp_raise_ValueError("syntax error in JSON");
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ujson_load_obj, mod_ujson_load);
+
+STATIC int ujson_select_match(ujson_select_t *sel) {
+    int match = UJSON_SELECT_NONE;
+    for (size_t i = 0; i < sel->n_paths; i++) {
+        size_t len;
+        const char *path = mp_obj_str_get_data(sel->paths[i], &len);
+        if (len < sel->path.len || memcmp(path, sel->path.buf, sel->path.len) != 0) {
+            continue;
+        }
+        if (len == sel->path.len) {
+            if (len > 0) {
+                return UJSON_SELECT_EXACT;
+            }
+        } else if (sel->path.len == 0 || path[sel->path.len] == '.') {
+            match = UJSON_SELECT_PREFIX;
+        }
+    }
+    return match;
+}
+
+STATIC void ujson_select_value(ujson_select_t *sel) {
+    MP_STACK_CHECK();
+    ujson_skip_ws(&sel->s);
+    int match = ujson_select_match(sel);
+    byte cur = sel->s.cur;
+
+    if (match == UJSON_SELECT_EXACT) {
+        mp_obj_t value = ujson_parse_value(&sel->s, &sel->vstr);
+        mp_obj_t key = mp_obj_new_str(sel->path.buf, sel->path.len);
+        if (mp_obj_dict_get_map(sel->result)->used == sel->found) {
+            sel->found++;
+        }
+        mp_obj_dict_store(sel->result, key, value);
+        return;
+    }
+    if (match == UJSON_SELECT_NONE || (cur != '{' && cur != '[')) {
+        ujson_skip_value(&sel->s);
+        return;
+    }
+
+    size_t base = sel->path.len;
+    size_t index = 0;
+    ujson_stream_next(&sel->s);
+    for (;;) {
+        ujson_skip_ws(&sel->s);
+        if (sel->s.cur == '}' || sel->s.cur == ']') {
+            ujson_stream_next(&sel->s);
+            break;
+        }
+        sel->path.len = base;
+        if (base > 0) {
+            vstr_add_byte(&sel->path, '.');
+        }
+        if (cur == '{') {
+            if (sel->s.cur != '"') {
+                mp_raise_ValueError("syntax error in JSON");
+            }
+            ujson_stream_next(&sel->s);
+            if (!ujson_parse_string(&sel->s, &sel->vstr)) {
+                mp_raise_ValueError("syntax error in JSON");
+            }
+            vstr_add_strn(&sel->path, sel->vstr.buf, sel->vstr.len);
+        } else {
+            vstr_printf(&sel->path, "%u", (uint)index++);
+        }
+        ujson_select_value(sel);
+        sel->path.len = base;
+        if (sel->found == sel->n_paths) {
+            // no need to read the rest
+            return;
+        }
+    }
+}
+
+STATIC mp_obj_t mod_ujson_select(mp_obj_t obj, mp_obj_t paths_in) {
+    ujson_select_t sel;
+    vstr_t vstr_in;
+    mp_obj_stringio_t sio;
+    if (MP_OBJ_IS_STR_OR_BYTES(obj)) {
+        size_t len;
+        const char *buf = mp_obj_str_get_data(obj, &len);
+        vstr_in = (vstr_t){len, len, (char*)buf, true};
+        sio = (mp_obj_stringio_t){{&mp_type_stringio}, &vstr_in, 0, MP_OBJ_NULL};
+        obj = MP_OBJ_FROM_PTR(&sio);
+    }
+    const mp_stream_p_t *stream_p = mp_get_stream_raise(obj, MP_STREAM_OP_READ);
+    sel.s = (ujson_stream_t){obj, stream_p->read, 0, 0};
+    mp_obj_get_array(paths_in, &sel.n_paths, &sel.paths);
+    for (size_t i = 0; i < sel.n_paths; i++) {
+        if (!MP_OBJ_IS_STR(sel.paths[i])) {
+            mp_raise_TypeError("paths must be strings");
+        }
+    }
+    sel.result = mp_obj_new_dict(0);
+    sel.found = 0;
+    vstr_init(&sel.vstr, 8);
+    vstr_init(&sel.path, 16);
+
+    S_NEXT(sel.s);
+    ujson_select_value(&sel);
+
+    vstr_clear(&sel.vstr);
+    vstr_clear(&sel.path);
+    return sel.result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_ujson_select_obj, mod_ujson_select);
 
 STATIC mp_obj_t mod_ujson_loads(mp_obj_t obj) {
     size_t len;
@@ -295,6 +567,7 @@ STATIC const mp_rom_map_elem_t mp_module_ujson_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_dumps), MP_ROM_PTR(&mod_ujson_dumps_obj) },
     { MP_ROM_QSTR(MP_QSTR_load), MP_ROM_PTR(&mod_ujson_load_obj) },
     { MP_ROM_QSTR(MP_QSTR_loads), MP_ROM_PTR(&mod_ujson_loads_obj) },
+    { MP_ROM_QSTR(MP_QSTR_select), MP_ROM_PTR(&mod_ujson_select_obj) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_ujson_globals, mp_module_ujson_globals_table);
@@ -41,8 +41,14 @@
 
 #define FLAG_DEBUG 0x1000
 
+// the longest literal prefix kept to scan for before running the matcher
+#define URE_PREFIX_MAX (8)
+
 typedef struct _mp_obj_re_t {
     mp_obj_base_t base;
+    // the characters every match starts with, if any
+    uint8_t prefix_len;
+    char prefix[URE_PREFIX_MAX];
     ByteProg re;
 } mp_obj_re_t;
 
@@ -54,6 +60,57 @@ typedef struct _mp_obj_match_t {
 } mp_obj_match_t;
 
 
+
+// The subject can be a str or bytes, or any object with the buffer protocol,
+// e.g. a memoryview slice of a receive buffer, which is then seen as bytes.
+STATIC const mp_obj_type_t *ure_get_subject(mp_obj_t obj, Subject *subj) {
+    size_t len;
+    const mp_obj_type_t *type;
+    if (mp_obj_is_str_or_bytes(obj)) {
+        subj->begin = mp_obj_str_get_data(obj, &len);
+        type = mp_obj_get_type(obj);
+    } else {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(obj, &bufinfo, MP_BUFFER_READ);
+        subj->begin = bufinfo.buf;
+        len = bufinfo.len;
+        type = &mp_type_bytes;
+    }
+    subj->end = subj->begin + len;
+    return type;
+}
+
+// Run the program on the subject, scanning for the literal prefix of the
+// pattern, if it has one, rather than trying the matcher at each position.
+STATIC int ure_run(mp_obj_re_t *self, Subject *subj, const char **caps, int caps_num, bool is_anchored) {
+    if (is_anchored || self->prefix_len == 0) {
+        return re1_5_recursiveloopprog(&self->re, subj, caps, caps_num, is_anchored);
+    }
+    if (subj->end - subj->begin < self->prefix_len) {
+        return 0;
+    }
+    const char *sp = subj->begin;
+    const char *last = subj->end - self->prefix_len;
+    while (sp <= last) {
+        sp = memchr(sp, self->prefix[0], last - sp + 1);
+        if (sp == NULL) {
+            break;
+        }
+        if (memcmp(sp, self->prefix, self->prefix_len) == 0
+            && re1_5_recursiveloopprog_at(&self->re, subj, sp, caps, caps_num)) {
+            return 1;
+        }
+        sp++;
+    }
+    return 0;
+}
+
+STATIC const char *match_subject_begin(mp_obj_match_t *self, const mp_obj_type_t **type) {
+    Subject subj;
+    *type = ure_get_subject(self->str, &subj);
+    return subj.begin;
+}
+
 STATIC void match_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
     (void)kind;
     mp_obj_match_t *self = MP_OBJ_TO_PTR(self_in);
@@ -72,8 +129,9 @@ STATIC mp_obj_t match_group(mp_obj_t self_in, mp_obj_t no_in) {
         // no match for this group
         return mp_const_none;
     }
-    return mp_obj_new_str_of_type(mp_obj_get_type(self->str),
-        (const byte*)start, self->caps[no * 2 + 1] - start);
+    const mp_obj_type_t *type;
+    match_subject_begin(self, &type);
+    return mp_obj_new_str_of_type(type, (const byte*)start, self->caps[no * 2 + 1] - start);
 }
 MP_DEFINE_CONST_FUN_OBJ_2(match_group_obj, match_group);
 
@@ -112,7 +170,8 @@ STATIC void match_span_helper(size_t n_args, const mp_obj_t *args, mp_obj_t span
     const char *start = self->caps[no * 2];
     if (start != NULL) {
         // have a match for this group
-        const char *begin = mp_obj_str_get_str(self->str);
+        const mp_obj_type_t *type;
+        const char *begin = match_subject_begin(self, &type);
         s = start - begin;
         e = self->caps[no * 2 + 1] - begin;
     }
@@ -142,6 +201,27 @@ STATIC mp_obj_t match_end(size_t n_args, const mp_obj_t *args) {
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(match_end_obj, 1, 2, match_end);
 
+// spans(buf): store the start and end of each group, -1 for those that didn't
+// match, into the integer array buf, and return the number of groups; unlike
+// group() and span() this allocates nothing
+STATIC mp_obj_t match_spans(mp_obj_t self_in, mp_obj_t buf_in) {
+    mp_obj_match_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_WRITE);
+    size_t n = bufinfo.len / mp_binary_get_size('@', bufinfo.typecode, NULL);
+    if (n < (size_t)self->num_matches * 2) {
+        mp_raise_ValueError("buffer too small");
+    }
+    const mp_obj_type_t *type;
+    const char *begin = match_subject_begin(self, &type);
+    for (int i = 0; i < self->num_matches * 2; i++) {
+        mp_int_t pos = self->caps[i] == NULL ? -1 : self->caps[i] - begin;
+        mp_binary_set_val_array_from_int(bufinfo.typecode, bufinfo.buf, i, pos);
+    }
+    return MP_OBJ_NEW_SMALL_INT(self->num_matches);
+}
+MP_DEFINE_CONST_FUN_OBJ_2(match_spans_obj, match_spans);
+
 #endif
 
 STATIC const mp_rom_map_elem_t match_locals_dict_table[] = {
@@ -153,6 +233,7 @@ STATIC const mp_rom_map_elem_t match_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_span), MP_ROM_PTR(&match_span_obj) },
     { MP_ROM_QSTR(MP_QSTR_start), MP_ROM_PTR(&match_start_obj) },
     { MP_ROM_QSTR(MP_QSTR_end), MP_ROM_PTR(&match_end_obj) },
+    { MP_ROM_QSTR(MP_QSTR_spans), MP_ROM_PTR(&match_spans_obj) },
     #endif
 };
 
@@ -175,14 +256,12 @@ STATIC mp_obj_t ure_exec(bool is_anchored, uint n_args, const mp_obj_t *args) {
     (void)n_args;
     mp_obj_re_t *self = MP_OBJ_TO_PTR(args[0]);
     Subject subj;
-    size_t len;
-    subj.begin = mp_obj_str_get_data(args[1], &len);
-    subj.end = subj.begin + len;
+    ure_get_subject(args[1], &subj);
     int caps_num = (self->re.sub + 1) * 2;
     mp_obj_match_t *match = m_new_obj_var(mp_obj_match_t, char*, caps_num);
     // cast is a workaround for a bug in msvc: it treats const char** as a const pointer instead of a pointer to pointer to const char
     memset((char*)match->caps, 0, caps_num * sizeof(char*));
-    int res = re1_5_recursiveloopprog(&self->re, &subj, match->caps, caps_num, is_anchored);
+    int res = ure_run(self, &subj, match->caps, caps_num, is_anchored);
     if (res == 0) {
         m_del_var(mp_obj_match_t, char*, caps_num, match);
         return mp_const_none;
@@ -207,10 +286,7 @@ MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(re_search_obj, 2, 4, re_search);
 STATIC mp_obj_t re_split(size_t n_args, const mp_obj_t *args) {
     mp_obj_re_t *self = MP_OBJ_TO_PTR(args[0]);
     Subject subj;
-    size_t len;
-    const mp_obj_type_t *str_type = mp_obj_get_type(args[1]);
-    subj.begin = mp_obj_str_get_data(args[1], &len);
-    subj.end = subj.begin + len;
+    const mp_obj_type_t *str_type = ure_get_subject(args[1], &subj);
     int caps_num = (self->re.sub + 1) * 2;
 
     int maxsplit = 0;
@@ -223,7 +299,7 @@ STATIC mp_obj_t re_split(size_t n_args, const mp_obj_t *args) {
     while (true) {
         // cast is a workaround for a bug in msvc: it treats const char** as a const pointer instead of a pointer to pointer to const char
         memset((char**)caps, 0, caps_num * sizeof(char*));
-        int res = re1_5_recursiveloopprog(&self->re, &subj, caps, caps_num, false);
+        int res = ure_run(self, &subj, caps, caps_num, false);
 
         // if we didn't have a match, or had an empty match, it's time to stop
         if (!res || caps[0] == caps[1]) {
@@ -261,11 +337,8 @@ STATIC mp_obj_t re_sub_helper(mp_obj_t self_in, size_t n_args, const mp_obj_t *a
         // Note: flags are currently ignored
     }
 
-    size_t where_len;
-    const char *where_str = mp_obj_str_get_data(where, &where_len);
     Subject subj;
-    subj.begin = where_str;
-    subj.end = subj.begin + where_len;
+    const mp_obj_type_t *where_type = ure_get_subject(where, &subj);
     int caps_num = (self->re.sub + 1) * 2;
 
     vstr_t vstr_return;
@@ -278,7 +351,7 @@ STATIC mp_obj_t re_sub_helper(mp_obj_t self_in, size_t n_args, const mp_obj_t *a
     for (;;) {
         // cast is a workaround for a bug in msvc: it treats const char** as a const pointer instead of a pointer to pointer to const char
         memset((char*)match->caps, 0, caps_num * sizeof(char*));
-        int res = re1_5_recursiveloopprog(&self->re, &subj, match->caps, caps_num, false);
+        int res = ure_run(self, &subj, match->caps, caps_num, false);
 
         // If we didn't have a match, or had an empty match, it's time to stop
         if (!res || match->caps[0] == match->caps[1]) {
@@ -347,13 +420,16 @@ STATIC mp_obj_t re_sub_helper(mp_obj_t self_in, size_t n_args, const mp_obj_t *a
 
     if (vstr_return.buf == NULL) {
         // Optimisation for case of no substitutions
+        if (where_type != mp_obj_get_type(where)) {
+            return mp_obj_new_bytes((const byte*)subj.begin, subj.end - subj.begin);
+        }
         return where;
     }
 
     // Add post-match string
     vstr_add_strn(&vstr_return, subj.begin, subj.end - subj.begin);
 
-    return mp_obj_new_str_from_vstr(mp_obj_get_type(where), &vstr_return);
+    return mp_obj_new_str_from_vstr(where_type, &vstr_return);
 }
 
 STATIC mp_obj_t re_sub(size_t n_args, const mp_obj_t *args) {
@@ -398,6 +474,14 @@ STATIC mp_obj_t mod_re_compile(size_t n_args, const mp_obj_t *args) {
 error:
         mp_raise_ValueError("Error in regex");
     }
+    // a run of Char instructions right after Save 0 is a literal that every
+    // match starts with
+    const char *pc = HANDLE_ANCHORED(o->re.insts, true) + 2;
+    o->prefix_len = 0;
+    while (pc[0] == Char && o->prefix_len < URE_PREFIX_MAX) {
+        o->prefix[o->prefix_len++] = pc[1];
+        pc += 2;
+    }
     if (flags & FLAG_DEBUG) {
         re1_5_dumpcode(&o->re);
     }
@@ -405,9 +489,43 @@ error:
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_re_compile_obj, 1, 2, mod_re_compile);
 
+#if MICROPY_PY_URE_CACHE
+// The module-level functions keep the most recently used patterns compiled,
+// as (pattern, regex) pairs with the latest first, so calling them with the
+// same pattern again doesn't compile it again.
+STATIC mp_obj_t mod_re_compile_cached(mp_obj_t pattern) {
+    mp_obj_t *cache = MP_STATE_VM(ure_cache);
+    size_t i = 0;
+    for (; i < MICROPY_PY_URE_CACHE; i++) {
+        mp_obj_t p = cache[i * 2];
+        if (p == MP_OBJ_NULL) {
+            break;
+        }
+        if (p == pattern || (mp_obj_is_str_or_bytes(pattern) && mp_obj_get_type(p) == mp_obj_get_type(pattern) && mp_obj_equal(p, pattern))) {
+            mp_obj_t re = cache[i * 2 + 1];
+            memmove(&cache[2], &cache[0], i * 2 * sizeof(mp_obj_t));
+            cache[0] = pattern;
+            cache[1] = re;
+            return re;
+        }
+    }
+    mp_obj_t re = mod_re_compile(1, &pattern);
+    if (i == MICROPY_PY_URE_CACHE) {
+        // drop the least recently used
+        i -= 1;
+    }
+    memmove(&cache[2], &cache[0], i * 2 * sizeof(mp_obj_t));
+    cache[0] = pattern;
+    cache[1] = re;
+    return re;
+}
+#else
+#define mod_re_compile_cached(pattern) mod_re_compile(1, &(pattern))
+#endif
+
 STATIC mp_obj_t mod_re_exec(bool is_anchored, uint n_args, const mp_obj_t *args) {
     (void)n_args;
-    mp_obj_t self = mod_re_compile(1, args);
+    mp_obj_t self = mod_re_compile_cached(args[0]);
 
     const mp_obj_t args2[] = {self, args[1]};
     mp_obj_t match = ure_exec(is_anchored, 2, args2);
@@ -426,7 +544,7 @@ MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_re_search_obj, 2, 4, mod_re_search);
 
 #if MICROPY_PY_URE_SUB
 STATIC mp_obj_t mod_re_sub(size_t n_args, const mp_obj_t *args) {
-    mp_obj_t self = mod_re_compile(1, args);
+    mp_obj_t self = mod_re_compile_cached(args[0]);
     return re_sub_helper(self, n_args, args);
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_re_sub_obj, 3, 5, mod_re_sub);
@@ -36,6 +36,7 @@
 #include "py/stream.h"
 #include "py/mperrno.h"
 #include "py/mphal.h"
+#include "extmod/moduselect.h"
 
 // Flags for poll()
 #define FLAG_ONESHOT (1)
@@ -44,13 +45,6 @@
 ///
 /// This module provides the select function.
 
-typedef struct _poll_obj_t {
-    mp_obj_t obj;
-    mp_uint_t (*ioctl)(mp_obj_t obj, mp_uint_t request, uintptr_t arg, int *errcode);
-    mp_uint_t flags;
-    mp_uint_t flags_ret;
-} poll_obj_t;
-
 STATIC void poll_map_add(mp_map_t *poll_map, const mp_obj_t *obj, mp_uint_t obj_len, mp_uint_t flags, bool or_flags) {
     for (mp_uint_t i = 0; i < obj_len; i++) {
         mp_map_elem_t *elem = mp_map_lookup(poll_map, mp_obj_id(obj[i]), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
@@ -74,6 +68,17 @@ STATIC void poll_map_add(mp_map_t *poll_map, const mp_obj_t *obj, mp_uint_t obj_
     }
 }
 
+#ifdef MICROPY_PY_USELECT_WAIT
+// the time left before the timeout in ms, -1 if there is none
+STATIC mp_int_t poll_time_left(mp_uint_t start_tick, mp_uint_t timeout) {
+    if (timeout == (mp_uint_t)-1) {
+        return -1;
+    }
+    mp_uint_t elapsed = mp_hal_ticks_ms() - start_tick;
+    return (elapsed >= timeout) ? 0 : timeout - elapsed;
+}
+#endif
+
 // poll each object in the map
 STATIC mp_uint_t poll_map_poll(mp_map_t *poll_map, size_t *rwx_num) {
     mp_uint_t n_ready = 0;
@@ -111,6 +116,27 @@ STATIC mp_uint_t poll_map_poll(mp_map_t *poll_map, size_t *rwx_num) {
     return n_ready;
 }
 
+// Polls the objects of the map until one of them is ready or for timeout ms, -1 waits forever.
+// Returns the number of ready objects, their poll_obj_t have the events in flags_ret.
+mp_uint_t mp_poll_map_wait(mp_map_t *poll_map, mp_uint_t timeout) {
+    mp_uint_t start_tick = mp_hal_ticks_ms();
+    mp_uint_t n_ready;
+    for (;;) {
+        // poll the objects
+        n_ready = poll_map_poll(poll_map, NULL);
+        if (n_ready > 0 || (timeout != -1 && mp_hal_ticks_ms() - start_tick >= timeout)) {
+            break;
+        }
+        #ifdef MICROPY_PY_USELECT_WAIT
+        MICROPY_PY_USELECT_WAIT(poll_map, poll_time_left(start_tick, timeout))
+        #else
+        MICROPY_EVENT_POLL_HOOK
+        #endif
+    }
+
+    return n_ready;
+}
+
 /// \function select(rlist, wlist, xlist[, timeout])
 STATIC mp_obj_t select_select(size_t n_args, const mp_obj_t *args) {
     // get array data from tuple/list arguments
@@ -173,7 +199,11 @@ STATIC mp_obj_t select_select(size_t n_args, const mp_obj_t *args) {
             mp_map_deinit(&poll_map);
             return mp_obj_new_tuple(3, list_array);
         }
+        #ifdef MICROPY_PY_USELECT_WAIT
+        MICROPY_PY_USELECT_WAIT(&poll_map, poll_time_left(start_tick, timeout))
+        #else
         MICROPY_EVENT_POLL_HOOK
+        #endif
     }
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_select_select_obj, 3, 4, select_select);
@@ -245,18 +275,7 @@ STATIC mp_uint_t poll_poll_internal(uint n_args, const mp_obj_t *args) {
 
     self->flags = flags;
 
-    mp_uint_t start_tick = mp_hal_ticks_ms();
-    mp_uint_t n_ready;
-    for (;;) {
-        // poll the objects
-        n_ready = poll_map_poll(&self->poll_map, NULL);
-        if (n_ready > 0 || (timeout != -1 && mp_hal_ticks_ms() - start_tick >= timeout)) {
-            break;
-        }
-        MICROPY_EVENT_POLL_HOOK
-    }
-
-    return n_ready;
+    return mp_poll_map_wait(&self->poll_map, timeout);
 }
 
 STATIC mp_obj_t poll_poll(size_t n_args, const mp_obj_t *args) {
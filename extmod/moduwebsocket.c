@@ -38,6 +38,11 @@ enum { FRAME_HEADER, FRAME_OPT, PAYLOAD, CONTROL };
 
 enum { BLOCKING_WRITE = 0x80 };
 
+// Frames up to this size are sent with their header in a single stream write
+#ifndef MICROPY_PY_UWEBSOCKET_WRITE_COALESCE
+#define MICROPY_PY_UWEBSOCKET_WRITE_COALESCE (256)
+#endif
+
 typedef struct _mp_obj_websocket_t {
     mp_obj_base_t base;
     mp_obj_t sock;
@@ -47,7 +52,8 @@ typedef struct _mp_obj_websocket_t {
     byte to_recv;
     byte mask_pos;
     byte buf_pos;
-    byte buf[6];
+    // Extended length (up to 8 bytes) and mask
+    byte buf[12];
     byte opts;
     // Copy of last data frame flags
     byte ws_flags;
@@ -74,6 +80,37 @@ STATIC mp_obj_t websocket_make_new(const mp_obj_type_t *type, size_t n_args, siz
     return  MP_OBJ_FROM_PTR(o);
 }
 
+// Unmask the payload in place, a word at a time where the buffer allows it
+STATIC void websocket_unmask(mp_obj_websocket_t *self, byte *p, size_t len) {
+    uint32_t mask32;
+    memcpy(&mask32, self->mask, sizeof(mask32));
+    if (mask32 == 0) {
+        // Unmasked frame
+        return;
+    }
+    while (len != 0 && ((uintptr_t)p & 3) != 0) {
+        *p++ ^= self->mask[self->mask_pos++ & 3];
+        len--;
+    }
+    if (len >= 4) {
+        // The mask rotated to the current position, whole words keep it
+        byte rot[4];
+        for (int i = 0; i < 4; i++) {
+            rot[i] = self->mask[(self->mask_pos + i) & 3];
+        }
+        memcpy(&mask32, rot, sizeof(mask32));
+        uint32_t *w = (uint32_t*)p;
+        for (size_t n = len >> 2; n != 0; n--) {
+            *w++ ^= mask32;
+        }
+        p = (byte*)w;
+        len &= 3;
+    }
+    while (len-- != 0) {
+        *p++ ^= self->mask[self->mask_pos++ & 3];
+    }
+}
+
 STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode) {
     mp_obj_websocket_t *self =  MP_OBJ_TO_PTR(self_in);
     const mp_stream_p_t *stream_p = mp_get_stream(self->sock);
@@ -121,7 +158,7 @@ STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
                     to_recv += 2;
                 } else if (sz == 127) {
                     // Msg size is next 8 bytes
-                    assert(0);
+                    to_recv += 8;
                 }
                 if (self->buf[1] & 0x80) {
                     // Next 4 bytes is mask
@@ -144,14 +181,21 @@ STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
             }
 
             case FRAME_OPT: {
-                if ((self->buf_pos & 3) == 2) {
-                    // First two bytes are message length
-                    self->msg_sz = (self->buf[0] << 8) | self->buf[1];
-                }
-                if (self->buf_pos >= 4) {
+                if (self->buf_pos == 4 || self->buf_pos == 6 || self->buf_pos == 12) {
                     // Last 4 bytes is mask
                     memcpy(self->mask, self->buf + self->buf_pos - 4, 4);
                 }
+                if (self->msg_sz == 126) {
+                    // First two bytes are message length
+                    self->msg_sz = (self->buf[0] << 8) | self->buf[1];
+                } else if (self->msg_sz == 127) {
+                    // First eight bytes are message length, more than 4GB isn't supported
+                    if (self->buf[0] | self->buf[1] | self->buf[2] | self->buf[3]) {
+                        *errcode = MP_EINVAL;
+                        return MP_STREAM_ERROR;
+                    }
+                    self->msg_sz = (self->buf[4] << 24) | (self->buf[5] << 16) | (self->buf[6] << 8) | self->buf[7];
+                }
                 self->buf_pos = 0;
                 if ((self->last_flags & FRAME_OPCODE_MASK) >= FRAME_CLOSE) {
                     self->state = CONTROL;
@@ -169,16 +213,14 @@ STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
                     goto no_payload;
                 }
 
+                // The payload goes straight into the caller's buffer
                 size_t sz = MIN(size, self->msg_sz);
                 out_sz = stream_p->read(self->sock, buf, sz, errcode);
                 if (out_sz == 0 || out_sz == MP_STREAM_ERROR) {
                     return out_sz;
                 }
 
-                sz = out_sz;
-                for (byte *p = buf; sz--; p++) {
-                    *p ^= self->mask[self->mask_pos++ & 3];
-                }
+                websocket_unmask(self, buf, out_sz);
 
                 self->msg_sz -= out_sz;
                 if (self->msg_sz == 0) {
@@ -218,17 +260,31 @@ no_payload:
 
 STATIC mp_uint_t websocket_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode) {
     mp_obj_websocket_t *self =  MP_OBJ_TO_PTR(self_in);
-    assert(size < 0x10000);
-    byte header[4] = {0x80 | (self->opts & FRAME_OPCODE_MASK)};
+    byte header[10 + MICROPY_PY_UWEBSOCKET_WRITE_COALESCE] = {0x80 | (self->opts & FRAME_OPCODE_MASK)};
     int hdr_sz;
     if (size < 126) {
         header[1] = size;
         hdr_sz = 2;
-    } else {
+    } else if (size < 0x10000) {
         header[1] = 126;
         header[2] = size >> 8;
         header[3] = size & 0xff;
         hdr_sz = 4;
+    } else {
+        header[1] = 127;
+        memset(header + 2, 0, 4);
+        header[6] = size >> 24;
+        header[7] = size >> 16;
+        header[8] = size >> 8;
+        header[9] = size & 0xff;
+        hdr_sz = 10;
+    }
+
+    // Small frames go out in one write, so that the header doesn't end up
+    // alone in a segment with the payload held back until it's acked
+    bool coalesce = size <= MICROPY_PY_UWEBSOCKET_WRITE_COALESCE;
+    if (coalesce) {
+        memcpy(header + hdr_sz, buf, size);
     }
 
     mp_obj_t dest[3];
@@ -238,9 +294,17 @@ STATIC mp_uint_t websocket_write(mp_obj_t self_in, const void *buf, mp_uint_t si
         mp_call_method_n_kw(1, 0, dest);
     }
 
-    mp_uint_t out_sz = mp_stream_write_exactly(self->sock, header, hdr_sz, errcode);
-    if (*errcode == 0) {
-        out_sz = mp_stream_write_exactly(self->sock, buf, size, errcode);
+    mp_uint_t out_sz;
+    if (coalesce) {
+        out_sz = mp_stream_write_exactly(self->sock, header, hdr_sz + size, errcode);
+        if (*errcode == 0) {
+            out_sz -= hdr_sz;
+        }
+    } else {
+        out_sz = mp_stream_write_exactly(self->sock, header, hdr_sz, errcode);
+        if (*errcode == 0) {
+            out_sz = mp_stream_write_exactly(self->sock, buf, size, errcode);
+        }
     }
 
     if (self->opts & BLOCKING_WRITE) {
@@ -94,7 +94,8 @@ STATIC mp_obj_t decompio_make_new(const mp_obj_type_t *type, size_t n_args, size
 header_error:
             mp_raise_ValueError("compression header");
         }
-        dict_sz = 1 << dict_opt;
+        // the header carries CINFO, i.e. the window bits minus 8
+        dict_sz = 1 << (dict_opt + 8);
     } else {
         dict_sz = 1 << -dict_opt;
     }
@@ -201,10 +202,299 @@ error:
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_uzlib_decompress_obj, 1, 3, mod_uzlib_decompress);
 
+#if MICROPY_PY_UZLIB_COMPRESS
+
+#define COMP_RAW  (0)
+#define COMP_ZLIB (1)
+#define COMP_GZIP (2)
+
+#define COMPIO_OUTBUF_SIZE (64)
+
+typedef struct _mp_obj_compio_t {
+    mp_obj_base_t base;
+    mp_obj_t dest_stream;
+    struct uzlib_comp comp;
+    byte *buf;          // history window followed by the input not compressed yet
+    size_t buf_len;
+    size_t pos;         // start of the input not compressed yet
+    uint32_t chksum;
+    uint32_t in_len;
+    uint8_t format;
+    bool closed;
+    byte outbuf[COMPIO_OUTBUF_SIZE];
+} mp_obj_compio_t;
+
+// Same wbits convention as DecompIO: 8..15 for zlib, -8..-15 for raw
+// deflate and 24..31 (16 + 8..15) for gzip. Returns the window bits.
+STATIC int comp_parse_wbits(mp_int_t wbits, uint8_t *format) {
+    if (wbits >= 8 + 16 && wbits <= 15 + 16) {
+        *format = COMP_GZIP;
+        return wbits - 16;
+    } else if (wbits >= 8 && wbits <= 15) {
+        *format = COMP_ZLIB;
+        return wbits;
+    } else if (wbits >= -15 && wbits <= -8) {
+        *format = COMP_RAW;
+        return -wbits;
+    }
+    mp_raise_ValueError("wbits");
+}
+
+STATIC void comp_init(struct uzlib_comp *c, int win_bits, mp_int_t hash_bits) {
+    if (hash_bits < 0) {
+        // One bucket per two bytes of window, up to 4096 buckets
+        hash_bits = MIN(win_bits - 1, 12);
+    } else if (hash_bits < 4 || hash_bits > 16) {
+        mp_raise_ValueError("hash_bits");
+    }
+    c->hash_bits = hash_bits;
+    c->hash_table = m_new0(uzlib_hash_entry_t, 1 << hash_bits);
+    c->dict_size = 1 << win_bits;
+}
+
+STATIC uint32_t comp_chksum_init(int format) {
+    return format == COMP_GZIP ? 0xffffffff : 1;
+}
+
+STATIC uint32_t comp_chksum(int format, const void *data, size_t len, uint32_t sum) {
+    if (format == COMP_ZLIB) {
+        return uzlib_adler32(data, len, sum);
+    } else if (format == COMP_GZIP) {
+        return uzlib_crc32(data, len, sum);
+    }
+    return sum;
+}
+
+STATIC void comp_outbytes(struct Outbuf *out, uint32_t val, int n, bool big_endian) {
+    for (int i = 0; i < n; i++) {
+        int shift = big_endian ? 8 * (n - 1 - i) : 8 * i;
+        outbits(out, (val >> shift) & 0xff, 8);
+    }
+}
+
+STATIC void comp_start(struct uzlib_comp *c, int format, int win_bits) {
+    if (format == COMP_ZLIB) {
+        uint32_t cmf = ((win_bits - 8) << 4) | 8;
+        uint32_t flg = 31 - (cmf << 8) % 31;
+        comp_outbytes(&c->out, (cmf << 8) | flg, 2, true);
+    } else if (format == COMP_GZIP) {
+        // magic, deflate, no flags, no mtime, no extra flags, unknown OS
+        static const byte gzip_header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+        for (size_t i = 0; i < sizeof(gzip_header); i++) {
+            outbits(&c->out, gzip_header[i], 8);
+        }
+    }
+    zlib_start_block(&c->out);
+}
+
+STATIC void comp_finish(struct uzlib_comp *c, int format, uint32_t chksum, uint32_t in_len) {
+    zlib_finish_block(&c->out);
+    if (format == COMP_ZLIB) {
+        comp_outbytes(&c->out, chksum, 4, true);
+    } else if (format == COMP_GZIP) {
+        comp_outbytes(&c->out, ~chksum, 4, false);
+        comp_outbytes(&c->out, in_len, 4, false);
+    }
+}
+
+STATIC void compio_drain(struct Outbuf *out) {
+    byte *p = (void*)out;
+    p -= offsetof(mp_obj_compio_t, comp) + offsetof(struct uzlib_comp, out);
+    mp_obj_compio_t *self = (mp_obj_compio_t*)p;
+
+    int err;
+    mp_stream_write_exactly(self->dest_stream, out->outbuf, out->outlen, &err);
+    if (err != 0) {
+        mp_raise_OSError(err);
+    }
+    out->outlen = 0;
+}
+
+STATIC void compio_compress_pending(mp_obj_compio_t *self) {
+    uzlib_compress(&self->comp, self->buf + self->pos, self->buf_len - self->pos);
+    self->pos = self->buf_len;
+}
+
+// Keep only the last window of the input as history, and move the hash
+// entries along with it
+STATIC void compio_slide(mp_obj_compio_t *self) {
+    size_t dict_size = self->comp.dict_size;
+    size_t shift = self->buf_len - dict_size;
+    memmove(self->buf, self->buf + shift, dict_size);
+    const byte *keep = self->buf + shift;
+    for (size_t i = 0; i < (1u << self->comp.hash_bits); i++) {
+        uzlib_hash_entry_t e = self->comp.hash_table[i];
+        self->comp.hash_table[i] = (e != NULL && e >= keep) ? e - shift : NULL;
+    }
+    self->buf_len = self->pos = dict_size;
+}
+
+STATIC mp_obj_t compio_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
+    enum { ARG_stream, ARG_wbits, ARG_hash_bits };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_stream,    MP_ARG_REQUIRED | MP_ARG_OBJ, },
+        { MP_QSTR_wbits,     MP_ARG_INT, {.u_int = 10} },
+        { MP_QSTR_hash_bits, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = -1} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_get_stream_raise(args[ARG_stream].u_obj, MP_STREAM_OP_WRITE);
+    mp_obj_compio_t *o = m_new_obj(mp_obj_compio_t);
+    o->base.type = type;
+    o->dest_stream = args[ARG_stream].u_obj;
+    int win_bits = comp_parse_wbits(args[ARG_wbits].u_int, &o->format);
+
+    memset(&o->comp, 0, sizeof(o->comp));
+    comp_init(&o->comp, win_bits, args[ARG_hash_bits].u_int);
+    o->comp.out.outbuf = o->outbuf;
+    o->comp.out.outsize = COMPIO_OUTBUF_SIZE;
+    o->comp.out.flush = compio_drain;
+
+    // Room for one window of history plus one window of new input
+    o->buf = m_new(byte, 2 * o->comp.dict_size);
+    o->buf_len = 0;
+    o->pos = 0;
+    o->chksum = comp_chksum_init(o->format);
+    o->in_len = 0;
+    o->closed = false;
+
+    comp_start(&o->comp, o->format, win_bits);
+    return MP_OBJ_FROM_PTR(o);
+}
+
+STATIC mp_uint_t compio_write(mp_obj_t o_in, const void *buf, mp_uint_t size, int *errcode) {
+    mp_obj_compio_t *o = MP_OBJ_TO_PTR(o_in);
+    if (o->closed) {
+        *errcode = MP_EINVAL;
+        return MP_STREAM_ERROR;
+    }
+
+    o->chksum = comp_chksum(o->format, buf, size, o->chksum);
+    o->in_len += size;
+
+    const byte *src = buf;
+    mp_uint_t left = size;
+    while (left > 0) {
+        size_t n = MIN(left, 2 * o->comp.dict_size - o->buf_len);
+        memcpy(o->buf + o->buf_len, src, n);
+        o->buf_len += n;
+        src += n;
+        left -= n;
+        if (o->buf_len == 2 * o->comp.dict_size) {
+            compio_compress_pending(o);
+            compio_slide(o);
+        }
+    }
+    return size;
+}
+
+STATIC mp_uint_t compio_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg, int *errcode) {
+    mp_obj_compio_t *o = MP_OBJ_TO_PTR(o_in);
+    (void)arg;
+    switch (request) {
+        case MP_STREAM_FLUSH:
+            if (o->closed) {
+                *errcode = MP_EINVAL;
+                return MP_STREAM_ERROR;
+            }
+            // Only whole bytes can be written out, the last few bits of the
+            // deflate stream are kept until more data comes in or close()
+            compio_compress_pending(o);
+            compio_drain(&o->comp.out);
+            return 0;
+        case MP_STREAM_CLOSE:
+            if (!o->closed) {
+                compio_compress_pending(o);
+                comp_finish(&o->comp, o->format, o->chksum, o->in_len);
+                compio_drain(&o->comp.out);
+                o->closed = true;
+                m_del(byte, o->buf, 2 * o->comp.dict_size);
+                m_del(uzlib_hash_entry_t, o->comp.hash_table, 1 << o->comp.hash_bits);
+                o->buf = NULL;
+                o->comp.hash_table = NULL;
+            }
+            return 0;
+        default:
+            *errcode = MP_EINVAL;
+            return MP_STREAM_ERROR;
+    }
+}
+
+STATIC mp_obj_t compio___exit__(size_t n_args, const mp_obj_t *args) {
+    (void)n_args;
+    return mp_stream_close(args[0]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(compio___exit___obj, 4, 4, compio___exit__);
+
+STATIC const mp_rom_map_elem_t compio_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_write), MP_ROM_PTR(&mp_stream_write_obj) },
+    { MP_ROM_QSTR(MP_QSTR_flush), MP_ROM_PTR(&mp_stream_flush_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&mp_stream_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___enter__), MP_ROM_PTR(&mp_identity_obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__), MP_ROM_PTR(&compio___exit___obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(compio_locals_dict, compio_locals_dict_table);
+
+STATIC const mp_stream_p_t compio_stream_p = {
+    .write = compio_write,
+    .ioctl = compio_ioctl,
+};
+
+STATIC const mp_obj_type_t compio_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_CompIO,
+    .make_new = compio_make_new,
+    .protocol = &compio_stream_p,
+    .locals_dict = (void*)&compio_locals_dict,
+};
+
+STATIC void compress_grow(struct Outbuf *out) {
+    out->outbuf = m_renew(byte, out->outbuf, out->outsize, out->outsize + 256);
+    out->outsize += 256;
+}
+
+STATIC mp_obj_t mod_uzlib_compress(size_t n_args, const mp_obj_t *args) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_READ);
+
+    uint8_t format;
+    int win_bits = comp_parse_wbits(n_args > 1 ? mp_obj_get_int(args[1]) : 10, &format);
+
+    // The whole input is in memory, so it serves as the history itself
+    struct uzlib_comp comp;
+    memset(&comp, 0, sizeof(comp));
+    comp_init(&comp, win_bits, -1);
+    comp.out.outsize = (bufinfo.len / 2 + 32) & ~15;
+    comp.out.outbuf = m_new(byte, comp.out.outsize);
+    comp.out.flush = compress_grow;
+
+    comp_start(&comp, format, win_bits);
+    uzlib_compress(&comp, bufinfo.buf, bufinfo.len);
+    uint32_t chksum = comp_chksum(format, bufinfo.buf, bufinfo.len, comp_chksum_init(format));
+    comp_finish(&comp, format, chksum, bufinfo.len);
+    m_del(uzlib_hash_entry_t, comp.hash_table, 1 << comp.hash_bits);
+
+    vstr_t vstr;
+    vstr.alloc = comp.out.outsize;
+    vstr.len = comp.out.outlen;
+    vstr.buf = (char*)comp.out.outbuf;
+    vstr.fixed_buf = false;
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_uzlib_compress_obj, 1, 2, mod_uzlib_compress);
+
+#endif // MICROPY_PY_UZLIB_COMPRESS
+
 STATIC const mp_rom_map_elem_t mp_module_uzlib_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_uzlib) },
     { MP_ROM_QSTR(MP_QSTR_decompress), MP_ROM_PTR(&mod_uzlib_decompress_obj) },
     { MP_ROM_QSTR(MP_QSTR_DecompIO), MP_ROM_PTR(&decompio_type) },
+    #if MICROPY_PY_UZLIB_COMPRESS
+    { MP_ROM_QSTR(MP_QSTR_compress), MP_ROM_PTR(&mod_uzlib_compress_obj) },
+    { MP_ROM_QSTR(MP_QSTR_CompIO), MP_ROM_PTR(&compio_type) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_uzlib_globals, mp_module_uzlib_globals_table);
@@ -222,5 +512,9 @@ const mp_obj_module_t mp_module_uzlib = {
 #include "uzlib/tinfgzip.c"
 #include "uzlib/adler32.c"
 #include "uzlib/crc32.c"
+#if MICROPY_PY_UZLIB_COMPRESS
+#include "uzlib/defl_static.c"
+#include "uzlib/genlz77.c"
+#endif
 
 #endif // MICROPY_PY_UZLIB
@@ -44,6 +44,12 @@
 #define DEBUG_printf(...) (void)0
 #endif
 
+// Per-connection buffer for the file transfers, the chunks of a get are this
+// size less their 2 bytes length
+#ifndef MICROPY_PY_WEBREPL_BUF_SIZE
+#define MICROPY_PY_WEBREPL_BUF_SIZE (1024)
+#endif
+
 struct webrepl_file {
     char sig[2];
     char type;
@@ -65,6 +71,7 @@ typedef struct _mp_obj_webrepl_t {
     uint32_t data_to_recv;
     struct webrepl_file hdr;
     mp_obj_t cur_file;
+    byte *buf;
 } mp_obj_webrepl_t;
 
 // These get passed to functions which aren't force-l32, so can't be const
@@ -104,6 +111,7 @@ STATIC mp_obj_t webrepl_make_new(const mp_obj_type_t *type, size_t n_args, size_
     o->hdr_to_recv = sizeof(struct webrepl_file);
     o->data_to_recv = 0;
     o->state = STATE_PASSWD;
+    o->buf = m_new(byte, MICROPY_PY_WEBREPL_BUF_SIZE);
     write_webrepl_str(args[0], SSTR(passwd_prompt));
     return o;
 }
@@ -119,9 +127,9 @@ STATIC void check_file_op_finished(mp_obj_webrepl_t *self) {
 
 STATIC int write_file_chunk(mp_obj_webrepl_t *self) {
     const mp_stream_p_t *file_stream = mp_get_stream(self->cur_file);
-    byte readbuf[2 + 256];
+    byte *readbuf = self->buf;
     int err;
-    mp_uint_t out_sz = file_stream->read(self->cur_file, readbuf + 2, sizeof(readbuf) - 2, &err);
+    mp_uint_t out_sz = file_stream->read(self->cur_file, readbuf + 2, MICROPY_PY_WEBREPL_BUF_SIZE - 2, &err);
     if (out_sz == MP_STREAM_ERROR) {
         return out_sz;
     }
@@ -246,15 +254,24 @@ STATIC mp_uint_t _webrepl_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
     }
 
     if (self->data_to_recv != 0) {
-        static byte filebuf[512];
+        byte *filebuf = self->buf;
         filebuf[0] = *(byte*)buf;
         mp_uint_t buf_sz = 1;
-        if (--self->data_to_recv != 0) {
-            size_t to_read = MIN(sizeof(filebuf) - 1, self->data_to_recv);
-            mp_uint_t sz = sock_stream->read(self->sock, filebuf + 1, to_read, errcode);
+        self->data_to_recv--;
+        // Take whatever the socket already holds, up to a full buffer
+        while (self->data_to_recv != 0 && buf_sz < MICROPY_PY_WEBREPL_BUF_SIZE) {
+            size_t to_read = MIN(MICROPY_PY_WEBREPL_BUF_SIZE - buf_sz, self->data_to_recv);
+            mp_uint_t sz = sock_stream->read(self->sock, filebuf + buf_sz, to_read, errcode);
             if (sz == MP_STREAM_ERROR) {
+                if (mp_is_nonblocking_error(*errcode)) {
+                    // The bytes read so far are still written below
+                    break;
+                }
                 return sz;
             }
+            if (sz == 0) {
+                break;
+            }
             self->data_to_recv -= sz;
             buf_sz += sz;
         }
@@ -141,6 +141,7 @@ struct Subject {
 int re1_5_backtrack(ByteProg*, Subject*, const char**, int, int);
 int re1_5_pikevm(ByteProg*, Subject*, const char**, int, int);
 int re1_5_recursiveloopprog(ByteProg*, Subject*, const char**, int, int);
+int re1_5_recursiveloopprog_at(ByteProg*, Subject*, const char*, const char**, int);
 int re1_5_recursiveprog(ByteProg*, Subject*, const char**, int, int);
 int re1_5_thompsonvm(ByteProg*, Subject*, const char**, int, int);
 
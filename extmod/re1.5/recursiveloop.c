@@ -84,3 +84,9 @@ re1_5_recursiveloopprog(ByteProg *prog, Subject *input, const char **subp, int n
 {
 	return recursiveloop(HANDLE_ANCHORED(prog->insts, is_anchored), input->begin, input, subp, nsubp);
 }
+
+int
+re1_5_recursiveloopprog_at(ByteProg *prog, Subject *input, const char *sp, const char **subp, int nsubp)
+{
+	return recursiveloop(HANDLE_ANCHORED(prog->insts, 1), sp, input, subp, nsubp);
+}
@@ -0,0 +1,146 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "extmod/ubinascii_base64.h"
+
+static const char base64_alphabet[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Sextet of every character, 0xff for the ones outside of the alphabet
+static const uint8_t base64_sextet[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+size_t base64_encode(const uint8_t *in, size_t len, char *out, bool pad) {
+    char *start = out;
+
+    // a whole group of 3 bytes at a time, through a 24 bit word
+    for (; len >= 3; len -= 3) {
+        uint32_t w = (in[0] << 16) | (in[1] << 8) | in[2];
+        out[0] = base64_alphabet[w >> 18];
+        out[1] = base64_alphabet[(w >> 12) & 0x3f];
+        out[2] = base64_alphabet[(w >> 6) & 0x3f];
+        out[3] = base64_alphabet[w & 0x3f];
+        in += 3;
+        out += 4;
+    }
+
+    if (len != 0) {
+        uint32_t w = (in[0] << 16) | ((len == 2) ? (in[1] << 8) : 0);
+        *out++ = base64_alphabet[w >> 18];
+        *out++ = base64_alphabet[(w >> 12) & 0x3f];
+        if (len == 2) {
+            *out++ = base64_alphabet[(w >> 6) & 0x3f];
+        } else if (pad) {
+            *out++ = '=';
+        }
+        if (pad) {
+            *out++ = '=';
+        }
+    }
+
+    return out - start;
+}
+
+int base64_decode(const char *in_chars, size_t len, uint8_t *out, size_t max_len, bool pad) {
+    const uint8_t *in = (const uint8_t *)in_chars;
+    const uint8_t *end = in + len;
+    uint8_t *start = out;
+    uint8_t *out_end = out + max_len;
+
+    uint32_t shift = 0;
+    int nbits = 0; // Number of meaningful bits in shift
+    bool hadpad = false; // Had a pad character since last valid character
+    while (in < end) {
+        // fast path: a whole group of 4 valid characters
+        if (nbits == 0 && end - in >= 4) {
+            uint32_t a = base64_sextet[in[0]];
+            uint32_t b = base64_sextet[in[1]];
+            uint32_t c = base64_sextet[in[2]];
+            uint32_t d = base64_sextet[in[3]];
+            if (((a | b | c | d) & 0xc0) == 0) {
+                if (out_end - out < 3) {
+                    return BASE64_ERR_SPACE;
+                }
+                uint32_t w = (a << 18) | (b << 12) | (c << 6) | d;
+                out[0] = w >> 16;
+                out[1] = w >> 8;
+                out[2] = w;
+                out += 3;
+                in += 4;
+                hadpad = false;
+                continue;
+            }
+        }
+
+        uint8_t ch = *in++;
+        if (ch == '=') {
+            if ((nbits == 2) || ((nbits == 4) && hadpad)) {
+                nbits = 0;
+                break;
+            }
+            hadpad = true;
+        }
+
+        uint32_t sextet = base64_sextet[ch];
+        if (sextet > 63) {
+            continue;
+        }
+        hadpad = false;
+        shift = (shift << 6) | sextet;
+        nbits += 6;
+
+        if (nbits >= 8) {
+            nbits -= 8;
+            if (out == out_end) {
+                return BASE64_ERR_SPACE;
+            }
+            *out++ = (shift >> nbits) & 0xff;
+        }
+    }
+
+    // a single character left over never makes a byte
+    if (nbits == 6 || (pad && nbits != 0)) {
+        return BASE64_ERR_PADDING;
+    }
+
+    return out - start;
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Pycom Limited
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef MICROPY_INCLUDED_EXTMOD_UBINASCII_BASE64_H
+#define MICROPY_INCLUDED_EXTMOD_UBINASCII_BASE64_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Plain C base64 codec, shared by ubinascii and the C code of the ports
+// (e.g. the Pygate packet forwarder), so it has no dependency on py/.
+
+// Length of the encoding of len bytes, with or without the padding
+#define BASE64_ENCODED_LEN(len)         ((((len) + 2) / 3) * 4)
+#define BASE64_ENCODED_LEN_NOPAD(len)   (((len) / 3) * 4 + (((len) % 3) ? ((len) % 3) + 1 : 0))
+// Upper bound of the decoding of len characters
+#define BASE64_DECODED_MAX_LEN(len)     (((len) / 4) * 3 + 2)
+
+// Encodes len bytes into out, which must hold BASE64_ENCODED_LEN(len)
+// bytes (or the NOPAD one). Returns the number of characters written, no
+// terminator is added.
+size_t base64_encode(const uint8_t *in, size_t len, char *out, bool pad);
+
+// Decodes len characters into out, at most max_len bytes. Characters outside
+// of the alphabet are skipped and decoding stops at the padding, as
+// binascii.a2b_base64() does. When pad is true, input not padded to a whole
+// number of groups is an error; otherwise the last partial group is decoded.
+// Returns the number of bytes written, BASE64_ERR_PADDING or BASE64_ERR_SPACE.
+#define BASE64_ERR_PADDING              (-1)
+#define BASE64_ERR_SPACE                (-2)
+int base64_decode(const char *in, size_t len, uint8_t *out, size_t max_len, bool pad);
+
+#endif // MICROPY_INCLUDED_EXTMOD_UBINASCII_BASE64_H
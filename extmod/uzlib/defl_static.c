@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) uzlib authors
+ *
+ * This software is provided 'as-is', without any express
+ * or implied warranty.  In no event will the authors be
+ * held liable for any damages arising from the use of
+ * this software.
+ *
+ * Permission is granted to anyone to use this software
+ * for any purpose, including commercial applications,
+ * and to alter it and redistribute it freely, subject to
+ * the following restrictions:
+ *
+ * 1. The origin of this software must not be
+ *    misrepresented; you must not claim that you
+ *    wrote the original software. If you use this
+ *    software in a product, an acknowledgment in
+ *    the product documentation would be appreciated
+ *    but is not required.
+ *
+ * 2. Altered source versions must be plainly marked
+ *    as such, and must not be misrepresented as
+ *    being the original software.
+ *
+ * 3. This notice may not be removed or altered from
+ *    any source distribution.
+ */
+
+/*
+ * Static Huffman deflate bit writer, with the interface of the PuTTY
+ * derived encoder (see defl_static.h). Instead of growing the output
+ * buffer with realloc(), it calls out->flush when the buffer is full,
+ * so the caller decides whether to drain it to a stream or grow it.
+ */
+
+#include <assert.h>
+#include "defl_static.h"
+
+static const unsigned short defl_length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const unsigned char defl_length_bits[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const unsigned short defl_dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const unsigned char defl_dist_bits[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/* Huffman codes are sent MSB first, everything else LSB first */
+static unsigned long mirrorbits(unsigned long b, int n)
+{
+    unsigned long ret = 0;
+    while (n-- > 0) {
+        ret = (ret << 1) | (b & 1);
+        b >>= 1;
+    }
+    return ret;
+}
+
+void outbits(struct Outbuf *out, unsigned long bits, int nbits)
+{
+    assert(out->noutbits + nbits <= 32);
+    out->outbits |= bits << out->noutbits;
+    out->noutbits += nbits;
+    while (out->noutbits >= 8) {
+        if (out->outlen >= out->outsize) {
+            out->flush(out);
+        }
+        out->outbuf[out->outlen++] = (unsigned char)(out->outbits & 0xFF);
+        out->outbits >>= 8;
+        out->noutbits -= 8;
+    }
+}
+
+/* Emit a literal/length symbol (0..287) using the static code table */
+static void outsym(struct Outbuf *out, int sym)
+{
+    if (sym < 144) {
+        outbits(out, mirrorbits(0x30 + sym, 8), 8);
+    } else if (sym < 256) {
+        outbits(out, mirrorbits(0x190 + sym - 144, 9), 9);
+    } else if (sym < 280) {
+        outbits(out, mirrorbits(sym - 256, 7), 7);
+    } else {
+        outbits(out, mirrorbits(0xc0 + sym - 280, 8), 8);
+    }
+}
+
+void zlib_start_block(struct Outbuf *out)
+{
+    outbits(out, 1, 1); /* Final block */
+    outbits(out, 1, 2); /* Static huffman block */
+}
+
+void zlib_finish_block(struct Outbuf *out)
+{
+    outsym(out, 256); /* End of block */
+    outbits(out, 0, 7); /* Make sure all bits are flushed */
+    out->outbits = 0;
+    out->noutbits = 0;
+}
+
+void zlib_literal(struct Outbuf *out, unsigned char c)
+{
+    outsym(out, c);
+}
+
+void zlib_match(struct Outbuf *out, int distance, int len)
+{
+    assert(distance >= 1 && distance <= 32768);
+    assert(len >= 3 && len <= 258);
+
+    int i = 28;
+    while (defl_length_base[i] > len) {
+        i--;
+    }
+    outsym(out, 257 + i);
+    if (defl_length_bits[i]) {
+        outbits(out, len - defl_length_base[i], defl_length_bits[i]);
+    }
+
+    i = 29;
+    while (defl_dist_base[i] > distance) {
+        i--;
+    }
+    outbits(out, mirrorbits(i, 5), 5);
+    if (defl_dist_bits[i]) {
+        outbits(out, distance - defl_dist_base[i], defl_dist_bits[i]);
+    }
+}
@@ -30,12 +30,17 @@
    They may be altered/distinct from the originals used in PuTTY source
    code. */
 
+#ifndef DEFL_STATIC_H_INCLUDED
+#define DEFL_STATIC_H_INCLUDED
+
 struct Outbuf {
     unsigned char *outbuf;
     int outlen, outsize;
     unsigned long outbits;
     int noutbits;
     int comp_disabled;
+    /* Called when outbuf is full; must make room (drain or grow) */
+    void (*flush)(struct Outbuf *out);
 };
 
 void outbits(struct Outbuf *out, unsigned long bits, int nbits);
@@ -43,3 +48,5 @@ void zlib_start_block(struct Outbuf *ctx);
 void zlib_finish_block(struct Outbuf *ctx);
 void zlib_literal(struct Outbuf *ectx, unsigned char c);
 void zlib_match(struct Outbuf *ectx, int distance, int len);
+
+#endif /* DEFL_STATIC_H_INCLUDED */
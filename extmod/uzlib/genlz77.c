@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) uzlib authors
+ *
+ * This software is provided 'as-is', without any express
+ * or implied warranty.  In no event will the authors be
+ * held liable for any damages arising from the use of
+ * this software.
+ *
+ * Permission is granted to anyone to use this software
+ * for any purpose, including commercial applications,
+ * and to alter it and redistribute it freely, subject to
+ * the following restrictions:
+ *
+ * 1. The origin of this software must not be
+ *    misrepresented; you must not claim that you
+ *    wrote the original software. If you use this
+ *    software in a product, an acknowledgment in
+ *    the product documentation would be appreciated
+ *    but is not required.
+ *
+ * 2. Altered source versions must be plainly marked
+ *    as such, and must not be misrepresented as
+ *    being the original software.
+ *
+ * 3. This notice may not be removed or altered from
+ *    any source distribution.
+ */
+
+/*
+ * Simple LZ77 match finder feeding the static deflate encoder. It keeps a
+ * single entry per hash bucket, so memory use is exactly
+ * (1 << hash_bits) pointers, and it never looks back further than
+ * c->dict_size bytes, so only that much history needs to stay intact in
+ * front of src between calls.
+ */
+
+#include <string.h>
+#include "uzlib.h"
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+
+#define HASH(c, p) ((((p)[0] << 8) ^ ((p)[1] << 4) ^ (p)[2]) & ((1 << (c)->hash_bits) - 1))
+
+void TINFCC uzlib_compress(struct uzlib_comp *c, const uint8_t *src, unsigned slen)
+{
+    const uint8_t *end = src + slen;
+    const uint8_t *top = end - MIN_MATCH;
+
+    if (slen < MIN_MATCH) {
+        top = src;
+    }
+
+    while (src < top) {
+        uzlib_hash_entry_t *bucket = &c->hash_table[HASH(c, src)];
+        const uint8_t *subs = *bucket;
+        *bucket = src;
+        if (subs != NULL && subs < src && (unsigned)(src - subs) <= c->dict_size
+            && memcmp(src, subs, MIN_MATCH) == 0) {
+            const uint8_t *start = src;
+            const uint8_t *m = subs + MIN_MATCH;
+            src += MIN_MATCH;
+            while (src < end && *src == *m && src - start < MAX_MATCH) {
+                src++;
+                m++;
+            }
+            zlib_match(&c->out, start - subs, src - start);
+        } else {
+            zlib_literal(&c->out, *src++);
+        }
+    }
+
+    /* Tail too short to be hashed */
+    while (src < end) {
+        zlib_literal(&c->out, *src++);
+    }
+}
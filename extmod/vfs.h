@@ -47,6 +47,11 @@
 #define BP_IOCTL_SEC_COUNT      (4)
 #define BP_IOCTL_SEC_SIZE       (5)
 
+// keep recently used FAT sectors in RAM, see extmod/vfs_fat_diskio.c
+#ifndef MICROPY_FATFS_SECTOR_CACHE
+#define MICROPY_FATFS_SECTOR_CACHE (0)
+#endif
+
 typedef struct _fs_user_mount_t {
     mp_obj_base_t base;
     uint16_t flags;
@@ -60,6 +65,9 @@ typedef struct _fs_user_mount_t {
             mp_obj_t count[2];
         } old;
     } u;
+    #if MICROPY_FATFS_SECTOR_CACHE
+    struct _fat_sector_cache_t *cache;
+    #endif
     //Block device underlying this filesystem
     union {
         FATFS fatfs;
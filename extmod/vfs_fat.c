@@ -65,7 +65,20 @@ STATIC mp_import_stat_t fat_vfs_import_stat(void *vfs_in, const char *path) {
 }
 
 STATIC mp_obj_t fat_vfs_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    #if MICROPY_FATFS_SECTOR_CACHE
+    enum { ARG_bdev, ARG_cache };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_cache, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = MICROPY_FATFS_SECTOR_CACHE_LINES} },
+    };
+    mp_arg_val_t parsed[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, args, MP_ARRAY_SIZE(allowed_args), allowed_args, parsed);
+    if (parsed[ARG_cache].u_int < 0) {
+        mp_raise_ValueError(NULL);
+    }
+    #else
     mp_arg_check_num(n_args, n_kw, 1, 1, false);
+    #endif
 
     // create new object
     fs_user_mount_t *vfs = m_new_obj(fs_user_mount_t);
@@ -73,6 +86,12 @@ STATIC mp_obj_t fat_vfs_make_new(const mp_obj_type_t *type, size_t n_args, size_
     vfs->flags = FSUSER_FREE_OBJ;
     vfs->fs.fatfs.drv = vfs;
 
+    #if MICROPY_FATFS_SECTOR_CACHE
+    // the cache is sized when the filesystem is created, cache=0 disables it
+    size_t n_lines = parsed[ARG_cache].u_int;
+    fat_vfs_cache_init(vfs, n_lines ? m_new(uint8_t, FAT_VFS_CACHE_MEM_SIZE(n_lines)) : NULL, n_lines);
+    #endif
+
     // load block protocol methods
     mp_load_method(args[0], MP_QSTR_readblocks, vfs->readblocks);
     mp_load_method_maybe(args[0], MP_QSTR_writeblocks, vfs->writeblocks);
@@ -86,6 +105,11 @@ STATIC mp_obj_t fat_vfs_make_new(const mp_obj_type_t *type, size_t n_args, size_
         mp_load_method(args[0], MP_QSTR_count, vfs->u.old.count);
     }
 
+    #ifdef MICROPY_VFS_FAT_NATIVE_BDEV
+    // let the port access its own block devices without going through the block protocol
+    MICROPY_VFS_FAT_NATIVE_BDEV(vfs, args[0]);
+    #endif
+
     // mount the block device so the VFS methods can be used
     FRESULT res = f_mount(&vfs->fs.fatfs);
     if (res == FR_NO_FILESYSTEM) {
@@ -454,12 +478,40 @@ STATIC mp_obj_t vfs_fat_mount(mp_obj_t self_in, mp_obj_t readonly, mp_obj_t mkfs
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(vfs_fat_mount_obj, vfs_fat_mount);
 
 STATIC mp_obj_t vfs_fat_umount(mp_obj_t self_in) {
+    #if MICROPY_FATFS_SECTOR_CACHE
+    fs_user_mount_t *self = MP_OBJ_TO_PTR(self_in);
+    if (fat_vfs_cache_flush(self) != RES_OK) {
+        mp_raise_OSError(MP_EIO);
+    }
+    #else
     (void)self_in;
+    #endif
     // keep the FAT filesystem mounted internally so the VFS methods can still be used
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(fat_vfs_umount_obj, vfs_fat_umount);
 
+#if MICROPY_FATFS_SECTOR_CACHE
+/// \method cache_stats([clear])
+/// Return the (hits, misses, writebacks) counters of the sector cache, and reset them if clear is True.
+STATIC mp_obj_t fat_vfs_cache_stats(size_t n_args, const mp_obj_t *args) {
+    fs_user_mount_t *self = MP_OBJ_TO_PTR(args[0]);
+    fat_sector_cache_t *cache = self->cache;
+    mp_obj_t tuple[3] = {
+        mp_obj_new_int_from_uint(cache ? cache->hits : 0),
+        mp_obj_new_int_from_uint(cache ? cache->misses : 0),
+        mp_obj_new_int_from_uint(cache ? cache->writebacks : 0),
+    };
+    if (cache != NULL && n_args > 1 && mp_obj_is_true(args[1])) {
+        cache->hits = 0;
+        cache->misses = 0;
+        cache->writebacks = 0;
+    }
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(fat_vfs_cache_stats_obj, 1, 2, fat_vfs_cache_stats);
+#endif
+
 STATIC mp_obj_t fat_vfs_fsformat(mp_obj_t vfs_in)
 {
 	fs_user_mount_t * vfs = MP_OBJ_TO_PTR(vfs_in);
@@ -493,6 +545,9 @@ STATIC const mp_rom_map_elem_t fat_vfs_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_getfree), MP_ROM_PTR(&fat_vfs_getfree_obj) },
     { MP_ROM_QSTR(MP_QSTR_mount), MP_ROM_PTR(&vfs_fat_mount_obj) },
     { MP_ROM_QSTR(MP_QSTR_umount), MP_ROM_PTR(&fat_vfs_umount_obj) },
+    #if MICROPY_FATFS_SECTOR_CACHE
+    { MP_ROM_QSTR(MP_QSTR_cache_stats), MP_ROM_PTR(&fat_vfs_cache_stats_obj) },
+    #endif
 	{ MP_ROM_QSTR(MP_QSTR_fsformat), MP_ROM_PTR(&fat_vfs_fsformat_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(fat_vfs_locals_dict, fat_vfs_locals_dict_table);
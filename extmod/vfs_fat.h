@@ -29,6 +29,7 @@
 #include "py/lexer.h"
 #include "py/obj.h"
 #include "lib/oofatfs/ff.h"
+#include "lib/oofatfs/diskio.h"
 #include "extmod/vfs.h"
 
 // these are the values for fs_user_mount_t.flags
@@ -37,6 +38,37 @@
 #define FSUSER_HAVE_IOCTL   (0x0004) // new protocol with ioctl
 #define FSUSER_NO_FILESYSTEM (0x0008) // the block device has no filesystem on it
 
+#if MICROPY_FATFS_SECTOR_CACHE
+
+// default number of sectors cached per mounted FAT filesystem
+#ifndef MICROPY_FATFS_SECTOR_CACHE_LINES
+#define MICROPY_FATFS_SECTOR_CACHE_LINES (8)
+#endif
+
+typedef struct _fat_cache_line_t {
+    DWORD sector;
+    uint32_t used; // LRU stamp, 0 if the line is empty
+    bool dirty;
+} fat_cache_line_t;
+
+typedef struct _fat_sector_cache_t {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t writebacks;
+    uint32_t clock;
+    size_t n_lines;
+    fat_cache_line_t *line;
+    uint8_t *data;
+} fat_sector_cache_t;
+
+// number of bytes of memory fat_vfs_cache_init() needs for n_lines sectors
+#define FAT_VFS_CACHE_MEM_SIZE(n_lines) (sizeof(fat_sector_cache_t) + (n_lines) * (sizeof(fat_cache_line_t) + FF_MAX_SS))
+
+void fat_vfs_cache_init(fs_user_mount_t *vfs, void *mem, size_t n_lines);
+DRESULT fat_vfs_cache_flush(fs_user_mount_t *vfs);
+
+#endif
+
 extern const byte fresult_to_errno_table[20];
 extern const mp_obj_type_t mp_fat_vfs_type;
 extern const mp_obj_type_t mp_type_vfs_fat_fileio;
@@ -32,6 +32,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "py/mphal.h"
 
@@ -53,6 +54,218 @@ STATIC fs_user_mount_t *disk_get_device(void *bdev) {
     return (fs_user_mount_t*)bdev;
 }
 
+STATIC DRESULT disk_read_device(fs_user_mount_t *vfs, BYTE *buff, DWORD sector, UINT count) {
+    if (vfs->flags & FSUSER_NATIVE) {
+        mp_uint_t (*f)(uint8_t*, uint32_t, uint32_t) = (void*)(uintptr_t)vfs->readblocks[2];
+        if (f(buff, sector, count) != 0) {
+            return RES_ERROR;
+        }
+    } else {
+        mp_obj_array_t ar = {{&mp_type_bytearray}, BYTEARRAY_TYPECODE, 0, count * SECSIZE(&vfs->fatfs), buff};
+        vfs->readblocks[2] = MP_OBJ_NEW_SMALL_INT(sector);
+        vfs->readblocks[3] = MP_OBJ_FROM_PTR(&ar);
+        mp_call_method_n_kw(2, 0, vfs->readblocks);
+        // TODO handle error return
+    }
+
+    return RES_OK;
+}
+
+STATIC DRESULT disk_write_device(fs_user_mount_t *vfs, const BYTE *buff, DWORD sector, UINT count) {
+    if (vfs->flags & FSUSER_NATIVE) {
+        mp_uint_t (*f)(const uint8_t*, uint32_t, uint32_t) = (void*)(uintptr_t)vfs->writeblocks[2];
+        if (f(buff, sector, count) != 0) {
+            return RES_ERROR;
+        }
+    } else {
+        mp_obj_array_t ar = {{&mp_type_bytearray}, BYTEARRAY_TYPECODE, 0, count * SECSIZE(&vfs->fatfs), (void*)buff};
+        vfs->writeblocks[2] = MP_OBJ_NEW_SMALL_INT(sector);
+        vfs->writeblocks[3] = MP_OBJ_FROM_PTR(&ar);
+        mp_call_method_n_kw(2, 0, vfs->writeblocks);
+        // TODO handle error return
+    }
+
+    return RES_OK;
+}
+
+#if MICROPY_FATFS_SECTOR_CACHE
+
+// The sector cache keeps the sectors FatFs reads and writes one at a time,
+// which are mostly FAT and directory sectors, so walking a directory or a
+// cluster chain again doesn't go to the block device. Writes to the FAT and
+// root directory area are held back until the next CTRL_SYNC, which FatFs
+// issues at the end of every operation modifying the volume, all other
+// writes go straight through. Multi-sector transfers bypass the cache but
+// keep it coherent. Data written to the block device behind FatFs's back is
+// not seen.
+
+void fat_vfs_cache_init(fs_user_mount_t *vfs, void *mem, size_t n_lines) {
+    if (mem == NULL || n_lines == 0) {
+        vfs->cache = NULL;
+        return;
+    }
+    fat_sector_cache_t *cache = mem;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->writebacks = 0;
+    cache->clock = 0;
+    cache->n_lines = n_lines;
+    cache->line = (fat_cache_line_t*)(cache + 1);
+    cache->data = (uint8_t*)(cache->line + n_lines);
+    for (size_t i = 0; i < n_lines; ++i) {
+        cache->line[i].used = 0;
+        cache->line[i].dirty = false;
+    }
+    vfs->cache = cache;
+}
+
+STATIC inline uint8_t *fat_cache_line_data(fs_user_mount_t *vfs, fat_cache_line_t *line) {
+    return vfs->cache->data + (line - vfs->cache->line) * SECSIZE(&vfs->fs.fatfs);
+}
+
+STATIC fat_cache_line_t *fat_cache_lookup(fat_sector_cache_t *cache, DWORD sector) {
+    for (size_t i = 0; i < cache->n_lines; ++i) {
+        if (cache->line[i].used != 0 && cache->line[i].sector == sector) {
+            return &cache->line[i];
+        }
+    }
+    return NULL;
+}
+
+STATIC void fat_cache_touch(fat_sector_cache_t *cache, fat_cache_line_t *line) {
+    if (++cache->clock == 0) {
+        // the clock wrapped around, restart the LRU order
+        for (size_t i = 0; i < cache->n_lines; ++i) {
+            if (cache->line[i].used != 0) {
+                cache->line[i].used = 1;
+            }
+        }
+        cache->clock = 2;
+    }
+    line->used = cache->clock;
+}
+
+STATIC DRESULT fat_cache_write_back(fs_user_mount_t *vfs, fat_cache_line_t *line) {
+    if (line->dirty) {
+        DRESULT res = disk_write_device(vfs, fat_cache_line_data(vfs, line), line->sector, 1);
+        if (res != RES_OK) {
+            return res;
+        }
+        line->dirty = false;
+        vfs->cache->writebacks++;
+    }
+    return RES_OK;
+}
+
+// returns the empty or least recently used line, written back so it can be reused
+STATIC fat_cache_line_t *fat_cache_evict(fs_user_mount_t *vfs) {
+    fat_sector_cache_t *cache = vfs->cache;
+    fat_cache_line_t *victim = &cache->line[0];
+    for (size_t i = 0; i < cache->n_lines && victim->used != 0; ++i) {
+        if (cache->line[i].used < victim->used) {
+            victim = &cache->line[i];
+        }
+    }
+    if (fat_cache_write_back(vfs, victim) != RES_OK) {
+        return NULL;
+    }
+    victim->used = 0;
+    return victim;
+}
+
+DRESULT fat_vfs_cache_flush(fs_user_mount_t *vfs) {
+    if (vfs->cache == NULL) {
+        return RES_OK;
+    }
+    for (size_t i = 0; i < vfs->cache->n_lines; ++i) {
+        DRESULT res = fat_cache_write_back(vfs, &vfs->cache->line[i]);
+        if (res != RES_OK) {
+            return res;
+        }
+    }
+    return RES_OK;
+}
+
+STATIC DRESULT fat_cache_read(fs_user_mount_t *vfs, BYTE *buff, DWORD sector, UINT count) {
+    fat_sector_cache_t *cache = vfs->cache;
+    const size_t ssize = SECSIZE(&vfs->fs.fatfs);
+    if (count == 1) {
+        fat_cache_line_t *line = fat_cache_lookup(cache, sector);
+        if (line != NULL) {
+            cache->hits++;
+        } else {
+            cache->misses++;
+            line = fat_cache_evict(vfs);
+            if (line == NULL) {
+                return RES_ERROR;
+            }
+            DRESULT res = disk_read_device(vfs, fat_cache_line_data(vfs, line), sector, 1);
+            if (res != RES_OK) {
+                return res;
+            }
+            line->sector = sector;
+        }
+        fat_cache_touch(cache, line);
+        memcpy(buff, fat_cache_line_data(vfs, line), ssize);
+        return RES_OK;
+    }
+
+    DRESULT res = disk_read_device(vfs, buff, sector, count);
+    if (res != RES_OK) {
+        return res;
+    }
+    // cached sectors may be newer than the block device
+    for (size_t i = 0; i < cache->n_lines; ++i) {
+        fat_cache_line_t *line = &cache->line[i];
+        if (line->used != 0 && line->sector >= sector && line->sector - sector < count) {
+            memcpy(buff + (line->sector - sector) * ssize, fat_cache_line_data(vfs, line), ssize);
+        }
+    }
+    return RES_OK;
+}
+
+STATIC DRESULT fat_cache_write(fs_user_mount_t *vfs, const BYTE *buff, DWORD sector, UINT count) {
+    fat_sector_cache_t *cache = vfs->cache;
+    const size_t ssize = SECSIZE(&vfs->fs.fatfs);
+    if (count == 1) {
+        fat_cache_line_t *line = fat_cache_lookup(cache, sector);
+        // sectors before the data area hold the FATs and the FAT12/16 root directory
+        bool write_back = sector < vfs->fs.fatfs.database;
+        if (line == NULL && write_back) {
+            line = fat_cache_evict(vfs);
+            if (line == NULL) {
+                return RES_ERROR;
+            }
+            line->sector = sector;
+        }
+        if (line != NULL) {
+            memcpy(fat_cache_line_data(vfs, line), buff, ssize);
+            fat_cache_touch(cache, line);
+            if (write_back) {
+                line->dirty = true;
+                return RES_OK;
+            }
+            line->dirty = false;
+        }
+        return disk_write_device(vfs, buff, sector, 1);
+    }
+
+    DRESULT res = disk_write_device(vfs, buff, sector, count);
+    if (res != RES_OK) {
+        return res;
+    }
+    for (size_t i = 0; i < cache->n_lines; ++i) {
+        fat_cache_line_t *line = &cache->line[i];
+        if (line->used != 0 && line->sector >= sector && line->sector - sector < count) {
+            memcpy(fat_cache_line_data(vfs, line), buff + (line->sector - sector) * ssize, ssize);
+            line->dirty = false;
+        }
+    }
+    return RES_OK;
+}
+
+#endif // MICROPY_FATFS_SECTOR_CACHE
+
 /*-----------------------------------------------------------------------*/
 /* Read Sector(s)                                                        */
 /*-----------------------------------------------------------------------*/
@@ -69,20 +282,13 @@ DRESULT disk_read (
         return RES_PARERR;
     }
 
-    if (vfs->flags & FSUSER_NATIVE) {
-        mp_uint_t (*f)(uint8_t*, uint32_t, uint32_t) = (void*)(uintptr_t)vfs->readblocks[2];
-        if (f(buff, sector, count) != 0) {
-            return RES_ERROR;
-        }
-    } else {
-        mp_obj_array_t ar = {{&mp_type_bytearray}, BYTEARRAY_TYPECODE, 0, count * SECSIZE(&vfs->fatfs), buff};
-        vfs->readblocks[2] = MP_OBJ_NEW_SMALL_INT(sector);
-        vfs->readblocks[3] = MP_OBJ_FROM_PTR(&ar);
-        mp_call_method_n_kw(2, 0, vfs->readblocks);
-        // TODO handle error return
+    #if MICROPY_FATFS_SECTOR_CACHE
+    if (vfs->cache != NULL) {
+        return fat_cache_read(vfs, buff, sector, count);
     }
+    #endif
 
-    return RES_OK;
+    return disk_read_device(vfs, buff, sector, count);
 }
 
 /*-----------------------------------------------------------------------*/
@@ -106,23 +312,15 @@ DRESULT disk_write (
         return RES_WRPRT;
     }
 
-    if (vfs->flags & FSUSER_NATIVE) {
-        mp_uint_t (*f)(const uint8_t*, uint32_t, uint32_t) = (void*)(uintptr_t)vfs->writeblocks[2];
-        if (f(buff, sector, count) != 0) {
-            return RES_ERROR;
-        }
-    } else {
-        mp_obj_array_t ar = {{&mp_type_bytearray}, BYTEARRAY_TYPECODE, 0, count * SECSIZE(&vfs->fatfs), (void*)buff};
-        vfs->writeblocks[2] = MP_OBJ_NEW_SMALL_INT(sector);
-        vfs->writeblocks[3] = MP_OBJ_FROM_PTR(&ar);
-        mp_call_method_n_kw(2, 0, vfs->writeblocks);
-        // TODO handle error return
+    #if MICROPY_FATFS_SECTOR_CACHE
+    if (vfs->cache != NULL) {
+        return fat_cache_write(vfs, buff, sector, count);
     }
+    #endif
 
-    return RES_OK;
+    return disk_write_device(vfs, buff, sector, count);
 }
 
-
 /*-----------------------------------------------------------------------*/
 /* Miscellaneous Functions                                               */
 /*-----------------------------------------------------------------------*/
@@ -138,6 +336,12 @@ DRESULT disk_ioctl (
         return RES_PARERR;
     }
 
+    #if MICROPY_FATFS_SECTOR_CACHE
+    if (cmd == CTRL_SYNC && fat_vfs_cache_flush(vfs) != RES_OK) {
+        return RES_ERROR;
+    }
+    #endif
+
     // First part: call the relevant method of the underlying block device
     mp_obj_t ret = mp_const_none;
     if (vfs->flags & FSUSER_HAVE_IOCTL) {
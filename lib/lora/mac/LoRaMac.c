@@ -2362,6 +2362,7 @@ LoRaMacStatus_t SendFrameOnChannel( uint8_t channel )
     McpsConfirm.Datarate = LoRaMacParams.ChannelsDatarate;
     McpsConfirm.TxPower = txPower;
     McpsConfirm.UpLinkFrequency = Radio.GetChannel();
+    McpsConfirm.Channel = channel;
    
     // Store the time on air
     McpsConfirm.TxTimeOnAir = TxTimeOnAir;
@@ -2571,6 +2572,28 @@ LoRaMacStatus_t LoRaMacInitialization( LoRaMacPrimitives_t *primitives, LoRaMacC
     return LORAMAC_STATUS_OK;
 }
 
+TimerTime_t LoRaMacQueryNextTxDelay( int8_t datarate )
+{
+    NextChanParams_t nextChan;
+
+    if( ( LoRaMacState & LORAMAC_TX_DELAYED ) == LORAMAC_TX_DELAYED )
+    {
+        // the channel has been selected already, the frame waits for the timer
+        return TimerGetRemainingTime( &TxDelayedTimer );
+    }
+
+    // the same back-off ScheduleTx would apply before selecting the channel
+    CalculateBackOff( LastTxChannel );
+
+    nextChan.AggrTimeOff = ( MaxDCycle == 0 ) ? 0 : AggregatedTimeOff;
+    nextChan.Datarate = datarate;
+    nextChan.DutyCycleEnabled = DutyCycleOn;
+    nextChan.Joined = IsLoRaMacNetworkJoined;
+    nextChan.LastAggrTx = AggregatedLastTxDoneTime;
+
+    return RegionNextTxDelay( LoRaMacRegion, &nextChan );
+}
+
 LoRaMacStatus_t LoRaMacQueryTxPossible( uint8_t size, LoRaMacTxInfo_t* txInfo )
 {
     AdrNextParams_t adrNext;
@@ -3590,7 +3613,8 @@ void LoRaMacNvsSave( void )
     modlora_nvs_set_blob(E_LORA_NVS_ELE_MAC_RPT_BUF, MacCommandsBufferToRepeat, sizeof(MacCommandsBufferToRepeat));
 
     modlora_nvs_set_uint(E_LORA_NVS_ELE_DWLINK, DownLinkCounter);
-    modlora_nvs_set_uint(E_LORA_NVS_ELE_UPLINK, UpLinkCounter);
+    // the frame counter is reserved ahead in flash so that it's never reused after a power loss
+    modlora_nvs_set_counter(E_LORA_NVS_ELE_UPLINK, UpLinkCounter, true);
 
     modlora_nvs_set_blob(E_LORA_NVS_ELE_NWSKEY, LoRaMacNwkSKey, sizeof(LoRaMacNwkSKey));
     modlora_nvs_set_blob(E_LORA_NVS_ELE_APPSKEY, LoRaMacAppSKey, sizeof(LoRaMacAppSKey));
@@ -3598,10 +3622,15 @@ void LoRaMacNvsSave( void )
     modlora_nvs_set_uint(E_LORA_NVS_ELE_NET_ID, LoRaMacNetID);
     modlora_nvs_set_uint(E_LORA_NVS_ELE_DEVADDR, LoRaMacDevAddr);
 
-    modlora_nvs_set_uint(E_LORA_NVS_ELE_ADR_ACKS, AdrAckCounter);
+    modlora_nvs_set_counter(E_LORA_NVS_ELE_ADR_ACKS, AdrAckCounter, false);
 }
 
 void LoRaMacGetChannelList(ChannelParams_t **channels, uint32_t *size) {
+    GetPhyParams_t getPhy;
+
+    // the caller may write the channels, drop the cached channel plan
+    getPhy.Attribute = PHY_CHANNELS;
+    RegionGetPhyParam(LoRaMacRegion, &getPhy);
     RegionGetChannels(LoRaMacRegion, channels, size);
 }
 
@@ -897,6 +897,10 @@ typedef struct sMcpsConfirm
      * The uplink frequency related to the frame
      */
     uint32_t UpLinkFrequency;
+    /*!
+     * The channel index the frame was sent on
+     */
+    uint8_t Channel;
 }McpsConfirm_t;
 
 /*!
@@ -1826,6 +1830,18 @@ LoRaMacStatus_t LoRaMacInitialization( LoRaMacPrimitives_t *primitives, LoRaMacC
  */
 LoRaMacStatus_t LoRaMacQueryTxPossible( uint8_t size, LoRaMacTxInfo_t* txInfo );
 
+/*!
+ * \brief   Queries the LoRaMAC how long the next frame would wait for a
+ *          channel, according to the duty cycle restrictions. No channel is
+ *          selected, so the answer stays valid until the next transmission.
+ *
+ * \param   [IN] datarate - Datarate of the next frame
+ *
+ * \retval  TimerTime_t 0 if a channel is available now, otherwise the time
+ *          to wait in ms.
+ */
+TimerTime_t LoRaMacQueryNextTxDelay( int8_t datarate );
+
 /*!
  * \brief   LoRaMAC channel add service
  *
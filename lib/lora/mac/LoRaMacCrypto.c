@@ -21,8 +21,12 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #include <stdint.h>
 #include "utilities.h"
 
+#if defined( LORAMAC_CRYPTO_HW_AES )
+#include "hwcrypto/aes.h"
+#else
 #include "lora/system/crypto/aes.h"
 #include "lora/system/crypto/cmac.h"
+#endif
 
 #include "LoRaMacCrypto.h"
 
@@ -55,6 +59,91 @@ static uint8_t sBlock[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
                             0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
                           };
 
+#if defined( LORAMAC_CRYPTO_HW_AES )
+/*!
+ * AES computation context variable
+ */
+static esp_aes_context AesContext;
+
+/*!
+ * CMAC computation buffer, large enough for the B0 block followed by a full frame
+ */
+static uint8_t CmacBuffer[LORAMAC_MIC_BLOCK_B0_SIZE + 256];
+
+/*
+ * The hardware AES driver takes the peripheral lock on every call, so the
+ * functions below can run concurrently with the crypto module and TLS sockets.
+ */
+static void AesSetKey( const uint8_t *key )
+{
+    esp_aes_init( &AesContext );
+    esp_aes_setkey( &AesContext, key, 128 );
+}
+
+static void AesEncrypt( const uint8_t *in, uint8_t *out )
+{
+    esp_aes_crypt_ecb( &AesContext, ESP_AES_ENCRYPT, in, out );
+}
+
+/*!
+ * Multiplies a block by x in GF(2^128), used to derive the CMAC subkeys
+ */
+static void CmacDouble( uint8_t *block )
+{
+    uint8_t msb = block[0] & 0x80;
+
+    for( uint8_t i = 0; i < 15; i++ )
+    {
+        block[i] = ( block[i] << 1 ) | ( block[i + 1] >> 7 );
+    }
+    block[15] <<= 1;
+    if( msb != 0 )
+    {
+        block[15] ^= 0x87;
+    }
+}
+
+/*!
+ * \brief Computes the AES-CMAC of the first size bytes of CmacBuffer
+ *
+ * \remark The buffer is padded in place and the whole message is run through
+ *         the peripheral with a single CBC request
+ */
+static void AesCmac( const uint8_t *key, uint16_t size, uint8_t *mac )
+{
+    uint8_t subkey[16];
+    uint8_t iv[16];
+    uint16_t blocks = ( size + 15 ) / 16;
+    uint16_t last;
+
+    AesSetKey( key );
+
+    memset1( subkey, 0, sizeof( subkey ) );
+    AesEncrypt( subkey, subkey );
+    CmacDouble( subkey );
+    if( ( size == 0 ) || ( ( size % 16 ) != 0 ) )
+    {
+        // the last block is incomplete, pad it and use the second subkey
+        CmacDouble( subkey );
+        if( blocks == 0 )
+        {
+            blocks = 1;
+        }
+        CmacBuffer[size] = 0x80;
+        memset1( CmacBuffer + size + 1, 0, ( blocks * 16 ) - size - 1 );
+    }
+
+    last = ( blocks - 1 ) * 16;
+    for( uint8_t i = 0; i < 16; i++ )
+    {
+        CmacBuffer[last + i] ^= subkey[i];
+    }
+
+    memset1( iv, 0, sizeof( iv ) );
+    esp_aes_crypt_cbc( &AesContext, ESP_AES_ENCRYPT, blocks * 16, iv, CmacBuffer, CmacBuffer );
+    memcpy1( mac, CmacBuffer + last, 16 );
+}
+#else
 /*!
  * AES computation context variable
  */
@@ -65,6 +154,18 @@ static aes_context AesContext;
  */
 static AES_CMAC_CTX AesCmacCtx[1];
 
+static void AesSetKey( const uint8_t *key )
+{
+    memset1( AesContext.ksch, '\0', 240 );
+    aes_set_key_lora( key, 16, &AesContext );
+}
+
+static void AesEncrypt( const uint8_t *in, uint8_t *out )
+{
+    aes_encrypt_lora( in, out, &AesContext );
+}
+#endif
+
 /*!
  * \brief Computes the LoRaMAC frame MIC field
  *
@@ -92,6 +193,11 @@ void LoRaMacComputeMic( const uint8_t *buffer, uint16_t size, const uint8_t *key
 
     MicBlockB0[15] = size & 0xFF;
 
+#if defined( LORAMAC_CRYPTO_HW_AES )
+    memcpy1( CmacBuffer, MicBlockB0, LORAMAC_MIC_BLOCK_B0_SIZE );
+    memcpy1( CmacBuffer + LORAMAC_MIC_BLOCK_B0_SIZE, buffer, size & 0xFF );
+    AesCmac( key, LORAMAC_MIC_BLOCK_B0_SIZE + ( size & 0xFF ), Mic );
+#else
     AES_CMAC_Init( AesCmacCtx );
 
     AES_CMAC_SetKey( AesCmacCtx, key );
@@ -101,18 +207,14 @@ void LoRaMacComputeMic( const uint8_t *buffer, uint16_t size, const uint8_t *key
     AES_CMAC_Update( AesCmacCtx, buffer, size & 0xFF );
 
     AES_CMAC_Final( Mic, AesCmacCtx );
+#endif
 
     *mic = ( uint32_t )( ( uint32_t )Mic[3] << 24 | ( uint32_t )Mic[2] << 16 | ( uint32_t )Mic[1] << 8 | ( uint32_t )Mic[0] );
 }
 
 void LoRaMacPayloadEncrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint8_t *encBuffer )
 {
-    uint16_t i;
-    uint8_t bufferIndex = 0;
-    uint16_t ctr = 1;
-
-    memset1( AesContext.ksch, '\0', 240 );
-    aes_set_key_lora( key, 16, &AesContext );
+    AesSetKey( key );
 
     aBlock[5] = dir;
 
@@ -126,11 +228,22 @@ void LoRaMacPayloadEncrypt( const uint8_t *buffer, uint16_t size, const uint8_t
     aBlock[12] = ( sequenceCounter >> 16 ) & 0xFF;
     aBlock[13] = ( sequenceCounter >> 24 ) & 0xFF;
 
+#if defined( LORAMAC_CRYPTO_HW_AES )
+    // the block counter is in the last byte and a frame never has more than 16
+    // blocks, so this is plain AES-CTR starting at 1
+    size_t offset = 0;
+    aBlock[15] = 1;
+    esp_aes_crypt_ctr( &AesContext, size, &offset, aBlock, sBlock, buffer, encBuffer );
+#else
+    uint16_t i;
+    uint8_t bufferIndex = 0;
+    uint16_t ctr = 1;
+
     while( size >= 16 )
     {
         aBlock[15] = ( ( ctr ) & 0xFF );
         ctr++;
-        aes_encrypt_lora( aBlock, sBlock, &AesContext );
+        AesEncrypt( aBlock, sBlock );
         for( i = 0; i < 16; i++ )
         {
             encBuffer[bufferIndex + i] = buffer[bufferIndex + i] ^ sBlock[i];
@@ -142,12 +255,13 @@ void LoRaMacPayloadEncrypt( const uint8_t *buffer, uint16_t size, const uint8_t
     if( size > 0 )
     {
         aBlock[15] = ( ( ctr ) & 0xFF );
-        aes_encrypt_lora( aBlock, sBlock, &AesContext );
+        AesEncrypt( aBlock, sBlock );
         for( i = 0; i < size; i++ )
         {
             encBuffer[bufferIndex + i] = buffer[bufferIndex + i] ^ sBlock[i];
         }
     }
+#endif
 }
 
 void LoRaMacPayloadDecrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t address, uint8_t dir, uint32_t sequenceCounter, uint8_t *decBuffer )
@@ -157,6 +271,10 @@ void LoRaMacPayloadDecrypt( const uint8_t *buffer, uint16_t size, const uint8_t
 
 void LoRaMacJoinComputeMic( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint32_t *mic )
 {
+#if defined( LORAMAC_CRYPTO_HW_AES )
+    memcpy1( CmacBuffer, buffer, size & 0xFF );
+    AesCmac( key, size & 0xFF, Mic );
+#else
     AES_CMAC_Init( AesCmacCtx );
 
     AES_CMAC_SetKey( AesCmacCtx, key );
@@ -164,19 +282,19 @@ void LoRaMacJoinComputeMic( const uint8_t *buffer, uint16_t size, const uint8_t
     AES_CMAC_Update( AesCmacCtx, buffer, size & 0xFF );
 
     AES_CMAC_Final( Mic, AesCmacCtx );
+#endif
 
     *mic = ( uint32_t )( ( uint32_t )Mic[3] << 24 | ( uint32_t )Mic[2] << 16 | ( uint32_t )Mic[1] << 8 | ( uint32_t )Mic[0] );
 }
 
 void LoRaMacJoinDecrypt( const uint8_t *buffer, uint16_t size, const uint8_t *key, uint8_t *decBuffer )
 {
-    memset1( AesContext.ksch, '\0', 240 );
-    aes_set_key_lora( key, 16, &AesContext );
-    aes_encrypt_lora( buffer, decBuffer, &AesContext );
+    AesSetKey( key );
+    AesEncrypt( buffer, decBuffer );
     // Check if optional CFList is included
     if( size >= 16 )
     {
-        aes_encrypt_lora( buffer + 16, decBuffer + 16, &AesContext );
+        AesEncrypt( buffer + 16, decBuffer + 16 );
     }
 }
 
@@ -185,18 +303,17 @@ void LoRaMacJoinComputeSKeys( const uint8_t *key, const uint8_t *appNonce, uint1
     uint8_t nonce[16];
     uint8_t *pDevNonce = ( uint8_t * )&devNonce;
 
-    memset1( AesContext.ksch, '\0', 240 );
-    aes_set_key_lora( key, 16, &AesContext );
+    AesSetKey( key );
 
     memset1( nonce, 0, sizeof( nonce ) );
     nonce[0] = 0x01;
     memcpy1( nonce + 1, appNonce, 6 );
     memcpy1( nonce + 7, pDevNonce, 2 );
-    aes_encrypt_lora( nonce, nwkSKey, &AesContext );
+    AesEncrypt( nonce, nwkSKey );
 
     memset1( nonce, 0, sizeof( nonce ) );
     nonce[0] = 0x02;
     memcpy1( nonce + 1, appNonce, 6 );
     memcpy1( nonce + 7, pDevNonce, 2 );
-    aes_encrypt_lora( nonce, appSKey, &AesContext );
+    AesEncrypt( nonce, appSKey );
 }
@@ -52,6 +52,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define AS923_ALTERNATE_DR( )                      else if(region == LORAMAC_REGION_AS923) { return RegionAS923AlternateDr( alternateDr ); }
 #define AS923_CALC_BACKOFF( )                      else if(region == LORAMAC_REGION_AS923) { RegionAS923CalcBackOff( calcBackOff );}
 #define AS923_NEXT_CHANNEL( )                      else if(region == LORAMAC_REGION_AS923) { return RegionAS923NextChannel( nextChanParams, channel, time, aggregatedTimeOff ); }
+#define AS923_NEXT_TX_DELAY( )                     else if(region == LORAMAC_REGION_AS923) { return RegionAS923NextTxDelay( nextChanParams ); }
 #define AS923_CHANNEL_ADD( )                       else if(region == LORAMAC_REGION_AS923) { return RegionAS923ChannelAdd( channelAdd ); }
 #define AS923_CHANNEL_REMOVE( )                    else if(region == LORAMAC_REGION_AS923) { return RegionAS923ChannelsRemove( channelRemove ); }
 #define AS923_CHANNEL_MANUAL_ADD( )                else if(region == LORAMAC_REGION_AS923) { return RegionAS923ChannelManualAdd( channelAdd ); }
@@ -81,6 +82,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define AS923_ALTERNATE_DR( )
 #define AS923_CALC_BACKOFF( )
 #define AS923_NEXT_CHANNEL( )
+#define AS923_NEXT_TX_DELAY( )
 #define AS923_CHANNEL_ADD( )
 #define AS923_CHANNEL_REMOVE( )
 #define AS923_CHANNEL_MANUAL_ADD( )
@@ -113,6 +115,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define AU915_ALTERNATE_DR( )                      else if(region == LORAMAC_REGION_AU915) { return RegionAU915AlternateDr( alternateDr ); }
 #define AU915_CALC_BACKOFF( )                      else if(region == LORAMAC_REGION_AU915) { RegionAU915CalcBackOff( calcBackOff );}
 #define AU915_NEXT_CHANNEL( )                      else if(region == LORAMAC_REGION_AU915) { return RegionAU915NextChannel( nextChanParams, channel, time, aggregatedTimeOff ); }
+#define AU915_NEXT_TX_DELAY( )                     else if(region == LORAMAC_REGION_AU915) { return RegionAU915NextTxDelay( nextChanParams ); }
 #define AU915_CHANNEL_ADD( )                       else if(region == LORAMAC_REGION_AU915) { return RegionAU915ChannelAdd( channelAdd ); }
 #define AU915_CHANNEL_REMOVE( )                    else if(region == LORAMAC_REGION_AU915) { return RegionAU915ChannelsRemove( channelRemove ); }
 #define AU915_CHANNEL_MANUAL_ADD( )                else if(region == LORAMAC_REGION_AU915) { return RegionAU915ChannelManualAdd( channelAdd ); }
@@ -143,6 +146,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define AU915_ALTERNATE_DR( )
 #define AU915_CALC_BACKOFF( )
 #define AU915_NEXT_CHANNEL( )
+#define AU915_NEXT_TX_DELAY( )
 #define AU915_CHANNEL_ADD( )
 #define AU915_CHANNEL_REMOVE( )
 #define AU915_CHANNEL_MANUAL_ADD( )
@@ -176,6 +180,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define CN470_ALTERNATE_DR( )                      else if(region == LORAMAC_REGION_CN470) { return RegionCN470AlternateDr( alternateDr ); }
 #define CN470_CALC_BACKOFF( )                      else if(region == LORAMAC_REGION_CN470) { RegionCN470CalcBackOff( calcBackOff );}
 #define CN470_NEXT_CHANNEL( )                      else if(region == LORAMAC_REGION_CN470) { return RegionCN470NextChannel( nextChanParams, channel, time, aggregatedTimeOff ); }
+#define CN470_NEXT_TX_DELAY( )                     else if(region == LORAMAC_REGION_CN470) { return RegionCN470NextTxDelay( nextChanParams ); }
 #define CN470_CHANNEL_ADD( )                       else if(region == LORAMAC_REGION_CN470) { return RegionCN470ChannelAdd( channelAdd ); }
 #define CN470_CHANNEL_REMOVE( )                    else if(region == LORAMAC_REGION_CN470) { return RegionCN470ChannelsRemove( channelRemove ); }
 #define CN470_CHANNEL_MANUAL_ADD( )                else if(region == LORAMAC_REGION_CN470) { return RegionCN470ChannelManualAdd( channelAdd ); }
@@ -203,6 +208,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define CN470_ALTERNATE_DR( )
 #define CN470_CALC_BACKOFF( )
 #define CN470_NEXT_CHANNEL( )
+#define CN470_NEXT_TX_DELAY( )
 #define CN470_CHANNEL_ADD( )
 #define CN470_CHANNEL_REMOVE( )
 #define CN470_CHANNEL_MANUAL_ADD( )
@@ -233,6 +239,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define CN779_ALTERNATE_DR( )                      else if(region == LORAMAC_REGION_CN779) { return RegionCN779AlternateDr( alternateDr ); }
 #define CN779_CALC_BACKOFF( )                      else if(region == LORAMAC_REGION_CN779) { RegionCN779CalcBackOff( calcBackOff );}
 #define CN779_NEXT_CHANNEL( )                      else if(region == LORAMAC_REGION_CN779) { return RegionCN779NextChannel( nextChanParams, channel, time, aggregatedTimeOff ); }
+#define CN779_NEXT_TX_DELAY( )                     else if(region == LORAMAC_REGION_CN779) { return RegionCN779NextTxDelay( nextChanParams ); }
 #define CN779_CHANNEL_ADD( )                       else if(region == LORAMAC_REGION_CN779) { return RegionCN779ChannelAdd( channelAdd ); }
 #define CN779_CHANNEL_REMOVE( )                    else if(region == LORAMAC_REGION_CN779) { return RegionCN779ChannelsRemove( channelRemove ); }
 #define CN779_SET_CONTINUOUS_WAVE( )               else if(region == LORAMAC_REGION_CN779) { RegionCN779SetContinuousWave( continuousWave );}
@@ -257,6 +264,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define CN779_ALTERNATE_DR( )
 #define CN779_CALC_BACKOFF( )
 #define CN779_NEXT_CHANNEL( )
+#define CN779_NEXT_TX_DELAY( )
 #define CN779_CHANNEL_ADD( )
 #define CN779_CHANNEL_REMOVE( )
 #define CN779_SET_CONTINUOUS_WAVE( )
@@ -284,6 +292,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define EU433_ALTERNATE_DR( )                      else if(region == LORAMAC_REGION_EU433) { return RegionEU433AlternateDr( alternateDr ); }
 #define EU433_CALC_BACKOFF( )                      else if(region == LORAMAC_REGION_EU433) { RegionEU433CalcBackOff( calcBackOff );}
 #define EU433_NEXT_CHANNEL( )                      else if(region == LORAMAC_REGION_EU433) { return RegionEU433NextChannel( nextChanParams, channel, time, aggregatedTimeOff ); }
+#define EU433_NEXT_TX_DELAY( )                     else if(region == LORAMAC_REGION_EU433) { return RegionEU433NextTxDelay( nextChanParams ); }
 #define EU433_CHANNEL_ADD( )                       else if(region == LORAMAC_REGION_EU433) { return RegionEU433ChannelAdd( channelAdd ); }
 #define EU433_CHANNEL_REMOVE( )                    else if(region == LORAMAC_REGION_EU433) { return RegionEU433ChannelsRemove( channelRemove ); }
 #define EU433_CHANNEL_MANUAL_ADD( )                EU433_CASE { return RegionEU433ChannelManualAdd( channelAdd ); }
@@ -311,6 +320,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define EU433_ALTERNATE_DR( )
 #define EU433_CALC_BACKOFF( )
 #define EU433_NEXT_CHANNEL( )
+#define EU433_NEXT_TX_DELAY( )
 #define EU433_CHANNEL_ADD( )
 #define EU433_CHANNEL_REMOVE( )
 #define EU433_CHANNEL_MANUAL_ADD( )
@@ -341,6 +351,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define EU868_ALTERNATE_DR( )                      else if(region == LORAMAC_REGION_EU868) { return RegionEU868AlternateDr( alternateDr ); }
 #define EU868_CALC_BACKOFF( )                      else if(region == LORAMAC_REGION_EU868) { RegionEU868CalcBackOff( calcBackOff );}
 #define EU868_NEXT_CHANNEL( )                      else if(region == LORAMAC_REGION_EU868) { return RegionEU868NextChannel( nextChanParams, channel, time, aggregatedTimeOff ); }
+#define EU868_NEXT_TX_DELAY( )                     else if(region == LORAMAC_REGION_EU868) { return RegionEU868NextTxDelay( nextChanParams ); }
 #define EU868_CHANNEL_ADD( )                       else if(region == LORAMAC_REGION_EU868) { return RegionEU868ChannelAdd( channelAdd ); }
 #define EU868_CHANNEL_REMOVE( )                    else if(region == LORAMAC_REGION_EU868) { return RegionEU868ChannelsRemove( channelRemove ); }
 #define EU868_CHANNEL_MANUAL_ADD( )                else if(region == LORAMAC_REGION_EU868) { return RegionEU868ChannelManualAdd( channelAdd ); }
@@ -370,6 +381,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define EU868_ALTERNATE_DR( )
 #define EU868_CALC_BACKOFF( )
 #define EU868_NEXT_CHANNEL( )
+#define EU868_NEXT_TX_DELAY( )
 #define EU868_CHANNEL_ADD( )
 #define EU868_CHANNEL_REMOVE( )
 #define EU868_CHANNEL_MANUAL_ADD( )
@@ -402,6 +414,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define KR920_ALTERNATE_DR( )                      else if(region == LORAMAC_REGION_KR920) { return RegionKR920AlternateDr( alternateDr ); }
 #define KR920_CALC_BACKOFF( )                      else if(region == LORAMAC_REGION_KR920) { RegionKR920CalcBackOff( calcBackOff );}
 #define KR920_NEXT_CHANNEL( )                      else if(region == LORAMAC_REGION_KR920) { return RegionKR920NextChannel( nextChanParams, channel, time, aggregatedTimeOff ); }
+#define KR920_NEXT_TX_DELAY( )                     else if(region == LORAMAC_REGION_KR920) { return RegionKR920NextTxDelay( nextChanParams ); }
 #define KR920_CHANNEL_ADD( )                       else if(region == LORAMAC_REGION_KR920) { return RegionKR920ChannelAdd( channelAdd ); }
 #define KR920_CHANNEL_REMOVE( )                    else if(region == LORAMAC_REGION_KR920) { return RegionKR920ChannelsRemove( channelRemove ); }
 #define KR920_SET_CONTINUOUS_WAVE( )               else if(region == LORAMAC_REGION_KR920) { RegionKR920SetContinuousWave( continuousWave );}
@@ -426,6 +439,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define KR920_ALTERNATE_DR( )
 #define KR920_CALC_BACKOFF( )
 #define KR920_NEXT_CHANNEL( )
+#define KR920_NEXT_TX_DELAY( )
 #define KR920_CHANNEL_ADD( )
 #define KR920_CHANNEL_REMOVE( )
 #define KR920_SET_CONTINUOUS_WAVE( )
@@ -453,6 +467,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define IN865_ALTERNATE_DR( )                     else if(region == LORAMAC_REGION_IN865) { return RegionIN865AlternateDr( alternateDr ); }
 #define IN865_CALC_BACKOFF( )                     else if(region == LORAMAC_REGION_IN865) { RegionIN865CalcBackOff( calcBackOff );}
 #define IN865_NEXT_CHANNEL( )                     else if(region == LORAMAC_REGION_IN865) { return RegionIN865NextChannel( nextChanParams, channel, time, aggregatedTimeOff ); }
+#define IN865_NEXT_TX_DELAY( )                    else if(region == LORAMAC_REGION_IN865) { return RegionIN865NextTxDelay( nextChanParams ); }
 #define IN865_CHANNEL_ADD( )                      else if(region == LORAMAC_REGION_IN865) { return RegionIN865ChannelAdd( channelAdd ); }
 #define IN865_CHANNEL_REMOVE( )                   else if(region == LORAMAC_REGION_IN865) { return RegionIN865ChannelsRemove( channelRemove ); }
 #define IN865_CHANNEL_MANUAL_ADD( )               else if(region == LORAMAC_REGION_IN865) { return RegionIN865ChannelManualAdd( channelAdd ); }
@@ -482,6 +497,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define IN865_ALTERNATE_DR( )
 #define IN865_CALC_BACKOFF( )
 #define IN865_NEXT_CHANNEL( )
+#define IN865_NEXT_TX_DELAY( )
 #define IN865_CHANNEL_ADD( )
 #define IN865_CHANNEL_REMOVE( )
 #define IN865_CHANNEL_MANUAL_ADD( )
@@ -514,6 +530,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define US915_ALTERNATE_DR( )                      else if(region == LORAMAC_REGION_US915) { return RegionUS915AlternateDr( alternateDr ); }
 #define US915_CALC_BACKOFF( )                      else if(region == LORAMAC_REGION_US915) { RegionUS915CalcBackOff( calcBackOff );}
 #define US915_NEXT_CHANNEL( )                      else if(region == LORAMAC_REGION_US915) { return RegionUS915NextChannel( nextChanParams, channel, time, aggregatedTimeOff ); }
+#define US915_NEXT_TX_DELAY( )                     else if(region == LORAMAC_REGION_US915) { return RegionUS915NextTxDelay( nextChanParams ); }
 #define US915_CHANNEL_ADD( )                       else if(region == LORAMAC_REGION_US915) { return RegionUS915ChannelAdd( channelAdd ); }
 #define US915_CHANNEL_REMOVE( )                    else if(region == LORAMAC_REGION_US915) { return RegionUS915ChannelsRemove( channelRemove ); }
 #define US915_CHANNEL_MANUAL_ADD( )                else if(region == LORAMAC_REGION_US915) { return RegionUS915ChannelManualAdd( channelAdd ); }
@@ -544,6 +561,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define US915_ALTERNATE_DR( )
 #define US915_CALC_BACKOFF( )
 #define US915_NEXT_CHANNEL( )
+#define US915_NEXT_TX_DELAY( )
 #define US915_CHANNEL_ADD( )
 #define US915_CHANNEL_REMOVE( )
 #define US915_CHANNEL_MANUAL_ADD( )
@@ -577,6 +595,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define US915_HYBRID_ALTERNATE_DR( )                      else if(region == LORAMAC_REGION_US915_HYBRID) { return RegionUS915HybridAlternateDr( alternateDr ); }
 #define US915_HYBRID_CALC_BACKOFF( )                      else if(region == LORAMAC_REGION_US915_HYBRID) { RegionUS915HybridCalcBackOff( calcBackOff );}
 #define US915_HYBRID_NEXT_CHANNEL( )                      else if(region == LORAMAC_REGION_US915_HYBRID) { return RegionUS915HybridNextChannel( nextChanParams, channel, time, aggregatedTimeOff ); }
+#define US915_HYBRID_NEXT_TX_DELAY( )                     else if(region == LORAMAC_REGION_US915_HYBRID) { return RegionUS915HybridNextTxDelay( nextChanParams ); }
 #define US915_HYBRID_CHANNEL_ADD( )                       else if(region == LORAMAC_REGION_US915_HYBRID) { return RegionUS915HybridChannelAdd( channelAdd ); }
 #define US915_HYBRID_CHANNEL_REMOVE( )                    else if(region == LORAMAC_REGION_US915_HYBRID) { return RegionUS915HybridChannelsRemove( channelRemove ); }
 #define US915_HYBRID_CHANNEL_MANUAL_ADD( )                else if(region == LORAMAC_REGION_US915_HYBRID) { return RegionUS915HybridChannelManualAdd( channelAdd ); }
@@ -607,6 +626,7 @@ Maintainer: Miguel Luis ( Semtech ), Gregory Cristian ( Semtech ) and Daniel Jae
 #define US915_HYBRID_ALTERNATE_DR( )
 #define US915_HYBRID_CALC_BACKOFF( )
 #define US915_HYBRID_NEXT_CHANNEL( )
+#define US915_HYBRID_NEXT_TX_DELAY( )
 #define US915_HYBRID_CHANNEL_ADD( )
 #define US915_HYBRID_CHANNEL_REMOVE( )
 #define US915_HYBRID_CHANNEL_MANUAL_ADD( )
@@ -1002,6 +1022,27 @@ bool RegionNextChannel( LoRaMacRegion_t region, NextChanParams_t* nextChanParams
     }
 }
 
+TimerTime_t RegionNextTxDelay( LoRaMacRegion_t region, NextChanParams_t* nextChanParams )
+{
+
+    if(region >= LORAMAC_REGION_MAX) {
+        return 0;
+    }
+    AS923_NEXT_TX_DELAY( )
+    AU915_NEXT_TX_DELAY( )
+    CN470_NEXT_TX_DELAY( )
+    CN779_NEXT_TX_DELAY( )
+    EU433_NEXT_TX_DELAY( )
+    EU868_NEXT_TX_DELAY( )
+    IN865_NEXT_TX_DELAY( )
+    KR920_NEXT_TX_DELAY( )
+    US915_NEXT_TX_DELAY( )
+    US915_HYBRID_NEXT_TX_DELAY( )
+    else {
+        return 0;
+    }
+}
+
 LoRaMacStatus_t RegionChannelAdd( LoRaMacRegion_t region, ChannelAddParams_t* channelAdd )
 {
 
@@ -1443,6 +1443,18 @@ void RegionCalcBackOff( LoRaMacRegion_t region, CalcBackOffParams_t* calcBackOff
  */
 bool RegionNextChannel( LoRaMacRegion_t region, NextChanParams_t* nextChanParams, uint8_t* channel, TimerTime_t* time, TimerTime_t* aggregatedTimeOff );
 
+/*!
+ * \brief Computes how long the next uplink would wait for a channel. Unlike
+ *        RegionNextChannel, nothing is changed, so it can be called at any time.
+ *
+ * \param [IN] region LoRaWAN region.
+ *
+ * \param [IN] nextChanParams The parameters RegionNextChannel would be given.
+ *
+ * \retval Returns 0 if a channel is available, otherwise the time to wait in ms.
+ */
+TimerTime_t RegionNextTxDelay( LoRaMacRegion_t region, NextChanParams_t* nextChanParams );
+
 /*!
  * \brief Adds a channel.
  *
@@ -412,6 +412,16 @@ void RegionAU915CalcBackOff( CalcBackOffParams_t* calcBackOff );
  */
 bool RegionAU915NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel, TimerTime_t* time, TimerTime_t* aggregatedTimeOff );
 
+/*!
+ * \brief Computes how long the next uplink would wait for a channel, without
+ *        changing the state of the channels and the bands.
+ *
+ * \param [IN] nextChanParams Same as for RegionAU915NextChannel.
+ *
+ * \retval Returns 0 if a channel is available, otherwise the time to wait in ms.
+ */
+TimerTime_t RegionAU915NextTxDelay( NextChanParams_t* nextChanParams );
+
 /*!
  * \brief Adds a channel.
  *
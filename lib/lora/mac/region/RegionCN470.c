@@ -59,6 +59,11 @@ static uint16_t ChannelsMask[CHANNELS_MASK_SIZE];
  */
 static uint16_t ChannelsDefaultMask[CHANNELS_MASK_SIZE];
 
+/*!
+ * Channels supporting each datarate
+ */
+static RegionCommonChanCache_t ChanCache;
+
 // Static functions
 static int8_t GetNextLowerTxDr( int8_t dr, int8_t minDr )
 {
@@ -101,36 +106,7 @@ static int8_t LimitTxPower( int8_t txPower, int8_t maxBandTxPower, int8_t datara
 
 static uint8_t CountNbOfEnabledChannels( uint8_t datarate, uint16_t* channelsMask, ChannelParams_t* channels, Band_t* bands, uint8_t* enabledChannels, uint8_t* delayTx )
 {
-    uint8_t nbEnabledChannels = 0;
-    uint8_t delayTransmission = 0;
-
-    for( uint8_t i = 0, k = 0; i < CN470_MAX_NB_CHANNELS; i += 16, k++ )
-    {
-        for( uint8_t j = 0; j < 16; j++ )
-        {
-            if( ( channelsMask[k] & ( 1 << j ) ) != 0 )
-            {
-                if( channels[i + j].Frequency == 0 )
-                { // Check if the channel is enabled
-                    continue;
-                }
-                if( RegionCommonValueInRange( datarate, channels[i + j].DrRange.Fields.Min,
-                                              channels[i + j].DrRange.Fields.Max ) == false )
-                { // Check if the current channel selection supports the given datarate
-                    continue;
-                }
-                if( bands[channels[i + j].Band].TimeOff > 0 )
-                { // Check if the band is available for transmission
-                    delayTransmission++;
-                    continue;
-                }
-                enabledChannels[nbEnabledChannels++] = i + j;
-            }
-        }
-    }
-
-    *delayTx = delayTransmission;
-    return nbEnabledChannels;
+    return RegionCommonChanCacheCount( &ChanCache, datarate, channelsMask, channels, bands, CN470_MAX_NB_CHANNELS, enabledChannels, delayTx );
 }
 
 PhyParam_t RegionCN470GetPhyParam( GetPhyParams_t* getPhy )
@@ -246,6 +222,8 @@ PhyParam_t RegionCN470GetPhyParam( GetPhyParams_t* getPhy )
         }
         case PHY_CHANNELS:
         {
+            // the caller may write the channels through the pointer
+            RegionCommonChanCacheInvalidate( &ChanCache );
             phyParam.Channels = Channels;
             break;
         }
@@ -299,6 +277,7 @@ void RegionCN470InitDefaults( InitType_t type )
                 Channels[i].DrRange.Value = ( DR_5 << 4 ) | DR_0;
                 Channels[i].Band = 0;
             }
+            RegionCommonChanCacheInvalidate( &ChanCache );
 
             // Initialize the channels default mask
             ChannelsDefaultMask[0] = 0xFFFF;
@@ -773,6 +752,30 @@ bool RegionCN470NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
     }
 }
 
+TimerTime_t RegionCN470NextTxDelay( NextChanParams_t* nextChanParams )
+{
+    RegionCommonNextTxDelayParams_t nextTxDelayParams;
+    uint16_t* channelsMask = ChannelsMask;
+
+    // NextChannel reactivates the default channels when none is left
+    if( RegionCommonCountChannels( ChannelsMask, 0, CHANNELS_MASK_SIZE ) == 0 )
+    {
+        channelsMask = ChannelsDefaultMask;
+    }
+
+    nextTxDelayParams.Channels = Channels;
+    nextTxDelayParams.Bands = Bands;
+    nextTxDelayParams.ChannelsMask = channelsMask;
+    nextTxDelayParams.NbChannels = CN470_MAX_NB_CHANNELS;
+    nextTxDelayParams.Datarate = nextChanParams->Datarate;
+    nextTxDelayParams.Joined = nextChanParams->Joined;
+    nextTxDelayParams.DutyCycleEnabled = nextChanParams->DutyCycleEnabled;
+    nextTxDelayParams.AggrTimeOff = nextChanParams->AggrTimeOff;
+    nextTxDelayParams.LastAggrTx = nextChanParams->LastAggrTx;
+
+    return RegionCommonGetNextTxDelay( &nextTxDelayParams );
+}
+
 LoRaMacStatus_t RegionCN470ChannelAdd( ChannelAddParams_t* channelAdd )
 {
     return LORAMAC_STATUS_PARAMETER_INVALID;
@@ -840,6 +843,7 @@ LoRaMacStatus_t RegionCN470ChannelManualAdd( ChannelAddParams_t* channelAdd )
 
     memcpy( &(Channels[id]), channelAdd->NewChannel, sizeof( Channels[id] ) );
     Channels[id].Band = band;
+    RegionCommonChanCacheInvalidate( &ChanCache );
     ChannelsMask[ (id / 16) ] |= (1 << (id % 16));
 
     return LORAMAC_STATUS_OK;
@@ -932,6 +932,30 @@ bool RegionCN779NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
     }
 }
 
+TimerTime_t RegionCN779NextTxDelay( NextChanParams_t* nextChanParams )
+{
+    RegionCommonNextTxDelayParams_t nextTxDelayParams;
+    uint16_t* channelsMask = ChannelsMask;
+
+    // NextChannel reactivates the default channels when none is left
+    if( RegionCommonCountChannels( ChannelsMask, 0, CHANNELS_MASK_SIZE ) == 0 )
+    {
+        channelsMask = ChannelsDefaultMask;
+    }
+
+    nextTxDelayParams.Channels = Channels;
+    nextTxDelayParams.Bands = Bands;
+    nextTxDelayParams.ChannelsMask = channelsMask;
+    nextTxDelayParams.NbChannels = CN779_MAX_NB_CHANNELS;
+    nextTxDelayParams.Datarate = nextChanParams->Datarate;
+    nextTxDelayParams.Joined = nextChanParams->Joined;
+    nextTxDelayParams.DutyCycleEnabled = nextChanParams->DutyCycleEnabled;
+    nextTxDelayParams.AggrTimeOff = nextChanParams->AggrTimeOff;
+    nextTxDelayParams.LastAggrTx = nextChanParams->LastAggrTx;
+
+    return RegionCommonGetNextTxDelay( &nextTxDelayParams );
+}
+
 LoRaMacStatus_t RegionCN779ChannelAdd( ChannelAddParams_t* channelAdd )
 {
     uint8_t band = 0;
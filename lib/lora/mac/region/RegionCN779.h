@@ -422,6 +422,16 @@ void RegionCN779CalcBackOff( CalcBackOffParams_t* calcBackOff );
  */
 bool RegionCN779NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel, TimerTime_t* time, TimerTime_t* aggregatedTimeOff );
 
+/*!
+ * \brief Computes how long the next uplink would wait for a channel, without
+ *        changing the state of the channels and the bands.
+ *
+ * \param [IN] nextChanParams Same as for RegionCN779NextChannel.
+ *
+ * \retval Returns 0 if a channel is available, otherwise the time to wait in ms.
+ */
+TimerTime_t RegionCN779NextTxDelay( NextChanParams_t* nextChanParams );
+
 /*!
  * \brief Adds a channel.
  *
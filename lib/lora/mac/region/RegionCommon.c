@@ -361,3 +361,117 @@ void RegionCommonCalcBackOff( RegionCommonCalcBackOffParams_t* calcBackOffParams
         }
     }
 }
+
+void RegionCommonChanCacheInvalidate( RegionCommonChanCache_t* cache )
+{
+    cache->Valid = false;
+}
+
+static void RegionCommonChanCacheBuild( RegionCommonChanCache_t* cache, ChannelParams_t* channels, uint8_t nbChannels )
+{
+    memset1( ( uint8_t* )cache->DrChannels, 0, sizeof( cache->DrChannels ) );
+
+    for( uint8_t i = 0; i < nbChannels; i++ )
+    {
+        if( channels[i].Frequency == 0 )
+        {
+            continue;
+        }
+        for( uint8_t dr = channels[i].DrRange.Fields.Min; ( dr <= channels[i].DrRange.Fields.Max ) && ( dr < REGION_COMMON_CHAN_CACHE_NB_DR ); dr++ )
+        {
+            cache->DrChannels[dr][i / 16] |= 1 << ( i % 16 );
+        }
+    }
+    cache->Valid = true;
+}
+
+uint8_t RegionCommonChanCacheCount( RegionCommonChanCache_t* cache, uint8_t datarate, uint16_t* channelsMask, ChannelParams_t* channels,
+                                    Band_t* bands, uint8_t nbChannels, uint8_t* enabledChannels, uint8_t* delayTx )
+{
+    uint8_t nbEnabledChannels = 0;
+    uint8_t delayTransmission = 0;
+
+    if( cache->Valid == false )
+    {
+        RegionCommonChanCacheBuild( cache, channels, nbChannels );
+    }
+    if( datarate < REGION_COMMON_CHAN_CACHE_NB_DR )
+    {
+        for( uint8_t k = 0; k < ( nbChannels + 15 ) / 16; k++ )
+        {
+            uint32_t bits = cache->DrChannels[datarate][k] & channelsMask[k];
+
+            // only the candidates are visited, in increasing order like the full scan
+            while( bits != 0 )
+            {
+                uint8_t id = ( k * 16 ) + __builtin_ctz( bits );
+                bits &= bits - 1;
+
+                if( bands[channels[id].Band].TimeOff > 0 )
+                { // Check if the band is available for transmission
+                    delayTransmission++;
+                    continue;
+                }
+                enabledChannels[nbEnabledChannels++] = id;
+            }
+        }
+    }
+
+    *delayTx = delayTransmission;
+    return nbEnabledChannels;
+}
+
+static TimerTime_t RegionCommonGetBandTimeOff( bool joined, bool dutyCycle, Band_t* band )
+{
+    TimerTime_t elapsed;
+
+    // same as RegionCommonUpdateBandTimeOff, but the band is left as it is
+    if( joined == false )
+    {
+        elapsed = MAX( TimerGetElapsedTime( band->LastJoinTxDoneTime ),
+                       ( dutyCycle == true ) ? TimerGetElapsedTime( band->LastTxDoneTime ) : 0 );
+    }
+    else if( dutyCycle == true )
+    {
+        elapsed = TimerGetElapsedTime( band->LastTxDoneTime );
+    }
+    else
+    {
+        return 0;
+    }
+    return ( band->TimeOff > elapsed ) ? band->TimeOff - elapsed : 0;
+}
+
+TimerTime_t RegionCommonGetNextTxDelay( RegionCommonNextTxDelayParams_t* params )
+{
+    TimerTime_t aggrDelay = 0;
+    TimerTime_t bandDelay = ( TimerTime_t )( -1 );
+
+    if( params->AggrTimeOff > TimerGetElapsedTime( params->LastAggrTx ) )
+    {
+        aggrDelay = params->AggrTimeOff - TimerGetElapsedTime( params->LastAggrTx );
+    }
+
+    for( uint8_t i = 0; ( i < params->NbChannels ) && ( bandDelay > 0 ); i++ )
+    {
+        if( ( params->ChannelsMask[i / 16] & ( 1 << ( i % 16 ) ) ) == 0 )
+        {
+            continue;
+        }
+        if( ( params->Channels[i].Frequency == 0 ) ||
+            ( RegionCommonValueInRange( params->Datarate, params->Channels[i].DrRange.Fields.Min,
+                                        params->Channels[i].DrRange.Fields.Max ) == false ) )
+        {
+            continue;
+        }
+        TimerTime_t timeOff = RegionCommonGetBandTimeOff( params->Joined, params->DutyCycleEnabled, &params->Bands[params->Channels[i].Band] );
+        bandDelay = MIN( bandDelay, timeOff );
+    }
+
+    if( bandDelay == ( TimerTime_t )( -1 ) )
+    {
+        // no channel for the datarate, the MAC will fall back to the default one
+        bandDelay = 0;
+    }
+    return MAX( aggrDelay, bandDelay );
+}
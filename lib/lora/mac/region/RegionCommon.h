@@ -159,6 +159,72 @@ typedef struct sRegionCommonCalcBackOffParams
     TimerTime_t TxTimeOnAir;
 }RegionCommonCalcBackOffParams_t;
 
+/*!
+ * Size of the channels masks handled by the channels cache, enough for 96 channels.
+ */
+#define REGION_COMMON_CHAN_CACHE_MASK_SIZE          6
+
+/*!
+ * Number of datarates handled by the channels cache.
+ */
+#define REGION_COMMON_CHAN_CACHE_NB_DR              8
+
+/*!
+ * Channels supporting each datarate, for the regions with many channels.
+ * Only depends on the channels list, the masks are applied when it's used.
+ */
+typedef struct sRegionCommonChanCache
+{
+    /*!
+     * Per datarate mask of the defined channels supporting it.
+     */
+    uint16_t DrChannels[REGION_COMMON_CHAN_CACHE_NB_DR][REGION_COMMON_CHAN_CACHE_MASK_SIZE];
+    /*!
+     * Cleared whenever the channels list may have changed.
+     */
+    bool Valid;
+}RegionCommonChanCache_t;
+
+typedef struct sRegionCommonNextTxDelayParams
+{
+    /*!
+     * A pointer to region specific channels.
+     */
+    ChannelParams_t* Channels;
+    /*!
+     * A pointer to region specific bands.
+     */
+    Band_t* Bands;
+    /*!
+     * The channels which could be selected.
+     */
+    uint16_t* ChannelsMask;
+    /*!
+     * Number of channels of the region.
+     */
+    uint8_t NbChannels;
+    /*!
+     * The datarate of the next uplink.
+     */
+    int8_t Datarate;
+    /*!
+     * Set to true, if the node is joined.
+     */
+    bool Joined;
+    /*!
+     * Set to true, if the duty cycle is enabled.
+     */
+    bool DutyCycleEnabled;
+    /*!
+     * Aggregated time-off time.
+     */
+    TimerTime_t AggrTimeOff;
+    /*!
+     * Time of the last aggregated TX.
+     */
+    TimerTime_t LastAggrTx;
+}RegionCommonNextTxDelayParams_t;
+
 /*!
  * \brief Calculates the join duty cycle.
  *        This is a generic function and valid for all regions.
@@ -362,6 +428,51 @@ int8_t RegionCommonComputeTxPower( int8_t txPowerIndex, float maxEirp, float ant
  */
 void RegionCommonCalcBackOff( RegionCommonCalcBackOffParams_t* calcBackOffParams );
 
+/*!
+ * \brief Marks the channels cache to be rebuilt on its next use.
+ *        To be called whenever the channels list may change.
+ *
+ * \param [IN] cache The channels cache of the region.
+ */
+void RegionCommonChanCacheInvalidate( RegionCommonChanCache_t* cache );
+
+/*!
+ * \brief Lists the channels of the mask which support the datarate and whose
+ *        band is available, using the channels cache. Replaces the loop over
+ *        all the channels of the regions with 64 channels or more.
+ *
+ * \param [IN] cache The channels cache of the region, rebuilt if needed.
+ *
+ * \param [IN] datarate The datarate of the uplink.
+ *
+ * \param [IN] channelsMask The channels which may be selected.
+ *
+ * \param [IN] channels A pointer to the channels of the region.
+ *
+ * \param [IN] bands A pointer to the bands of the region.
+ *
+ * \param [IN] nbChannels Number of channels of the region.
+ *
+ * \param [OUT] enabledChannels The channels found.
+ *
+ * \param [OUT] delayTx Number of channels whose band isn't available yet.
+ *
+ * \retval Returns the number of channels found.
+ */
+uint8_t RegionCommonChanCacheCount( RegionCommonChanCache_t* cache, uint8_t datarate, uint16_t* channelsMask, ChannelParams_t* channels,
+                                    Band_t* bands, uint8_t nbChannels, uint8_t* enabledChannels, uint8_t* delayTx );
+
+/*!
+ * \brief Computes how long the next uplink would wait for a channel, without
+ *        changing the state of the bands. This is a generic function and valid
+ *        for all regions.
+ *
+ * \param [IN] params A pointer to the input parameters.
+ *
+ * \retval Returns 0 if a channel is available, otherwise the time to wait in ms.
+ */
+TimerTime_t RegionCommonGetNextTxDelay( RegionCommonNextTxDelayParams_t* params );
+
 /*! \} defgroup REGIONCOMMON */
 
 #endif // __REGIONCOMMON_H__
@@ -423,6 +423,16 @@ void RegionEU433CalcBackOff( CalcBackOffParams_t* calcBackOff );
  */
 bool RegionEU433NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel, TimerTime_t* time, TimerTime_t* aggregatedTimeOff );
 
+/*!
+ * \brief Computes how long the next uplink would wait for a channel, without
+ *        changing the state of the channels and the bands.
+ *
+ * \param [IN] nextChanParams Same as for RegionEU433NextChannel.
+ *
+ * \retval Returns 0 if a channel is available, otherwise the time to wait in ms.
+ */
+TimerTime_t RegionEU433NextTxDelay( NextChanParams_t* nextChanParams );
+
 /*!
  * \brief Adds a channel.
  *
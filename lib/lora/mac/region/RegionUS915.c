@@ -64,6 +64,11 @@ static uint16_t ChannelsMaskRemaining[CHANNELS_MASK_SIZE];
  */
 static uint16_t ChannelsDefaultMask[CHANNELS_MASK_SIZE];
 
+/*!
+ * Channels supporting each datarate
+ */
+static RegionCommonChanCache_t ChanCache;
+
 // Static functions
 static int8_t GetNextLowerTxDr( int8_t dr, int8_t minDr )
 {
@@ -117,36 +122,7 @@ static int8_t LimitTxPower( int8_t txPower, int8_t maxBandTxPower, int8_t datara
 
 static uint8_t CountNbOfEnabledChannels( uint8_t datarate, uint16_t* channelsMask, ChannelParams_t* channels, Band_t* bands, uint8_t* enabledChannels, uint8_t* delayTx )
 {
-    uint8_t nbEnabledChannels = 0;
-    uint8_t delayTransmission = 0;
-
-    for( uint8_t i = 0, k = 0; i < US915_MAX_NB_CHANNELS; i += 16, k++ )
-    {
-        for( uint8_t j = 0; j < 16; j++ )
-        {
-            if( ( channelsMask[k] & ( 1 << j ) ) != 0 )
-            {
-                if( channels[i + j].Frequency == 0 )
-                { // Check if the channel is enabled
-                    continue;
-                }
-                if( RegionCommonValueInRange( datarate, channels[i + j].DrRange.Fields.Min,
-                                              channels[i + j].DrRange.Fields.Max ) == false )
-                { // Check if the current channel selection supports the given datarate
-                    continue;
-                }
-                if( bands[channels[i + j].Band].TimeOff > 0 )
-                { // Check if the band is available for transmission
-                    delayTransmission++;
-                    continue;
-                }
-                enabledChannels[nbEnabledChannels++] = i + j;
-            }
-        }
-    }
-
-    *delayTx = delayTransmission;
-    return nbEnabledChannels;
+    return RegionCommonChanCacheCount( &ChanCache, datarate, channelsMask, channels, bands, US915_MAX_NB_CHANNELS, enabledChannels, delayTx );
 }
 
 PhyParam_t RegionUS915GetPhyParam( GetPhyParams_t* getPhy )
@@ -262,6 +238,8 @@ PhyParam_t RegionUS915GetPhyParam( GetPhyParams_t* getPhy )
         }
         case PHY_CHANNELS:
         {
+            // the caller may write the channels through the pointer
+            RegionCommonChanCacheInvalidate( &ChanCache );
             phyParam.Channels = Channels;
             break;
         }
@@ -318,6 +296,7 @@ void RegionUS915InitDefaults( InitType_t type )
                 Channels[i].DrRange.Value = ( DR_4 << 4 ) | DR_4;
                 Channels[i].Band = 0;
             }
+            RegionCommonChanCacheInvalidate( &ChanCache );
 
             // ChannelsMask
             ChannelsDefaultMask[0] = 0xFFFF;
@@ -833,6 +812,35 @@ bool RegionUS915NextChannel( NextChanParams_t* nextChanParams, uint8_t* channel,
     }
 }
 
+TimerTime_t RegionUS915NextTxDelay( NextChanParams_t* nextChanParams )
+{
+    RegionCommonNextTxDelayParams_t nextTxDelayParams;
+    uint16_t channelsMask[CHANNELS_MASK_SIZE];
+
+    // the channels NextChannel would choose from, without using them up
+    RegionCommonChanMaskCopy( channelsMask, ChannelsMaskRemaining, CHANNELS_MASK_SIZE );
+    if( RegionCommonCountChannels( channelsMask, 0, 4 ) == 0 )
+    {
+        RegionCommonChanMaskCopy( channelsMask, ChannelsMask, 4 );
+    }
+    if( ( nextChanParams->Datarate >= DR_4 ) && ( ( channelsMask[4] & 0x00FF ) == 0 ) )
+    {
+        channelsMask[4] = ChannelsMask[4];
+    }
+
+    nextTxDelayParams.Channels = Channels;
+    nextTxDelayParams.Bands = Bands;
+    nextTxDelayParams.ChannelsMask = channelsMask;
+    nextTxDelayParams.NbChannels = US915_MAX_NB_CHANNELS;
+    nextTxDelayParams.Datarate = nextChanParams->Datarate;
+    nextTxDelayParams.Joined = nextChanParams->Joined;
+    nextTxDelayParams.DutyCycleEnabled = nextChanParams->DutyCycleEnabled;
+    nextTxDelayParams.AggrTimeOff = nextChanParams->AggrTimeOff;
+    nextTxDelayParams.LastAggrTx = nextChanParams->LastAggrTx;
+
+    return RegionCommonGetNextTxDelay( &nextTxDelayParams );
+}
+
 LoRaMacStatus_t RegionUS915ChannelAdd( ChannelAddParams_t* channelAdd )
 {
     return LORAMAC_STATUS_PARAMETER_INVALID;
@@ -883,6 +891,7 @@ LoRaMacStatus_t RegionUS915ChannelManualAdd( ChannelAddParams_t* channelAdd )
 
     memcpy( &(Channels[id]), channelAdd->NewChannel, sizeof( Channels[id] ) );
     Channels[id].Band = band;
+    RegionCommonChanCacheInvalidate( &ChanCache );
     ChannelsMask[ (id / 16) ] |= (1 << (id % 16));
     // activate the channel in the remaining ones
     ChannelsMaskRemaining[id / 16] |= ChannelsMask[id / 16];
@@ -906,6 +915,7 @@ bool RegionUS915ChannelsManualRemove( ChannelRemoveParams_t* channelRemove  )
 
     // Remove the channel from the list of channels
     Channels[id] = ( ChannelParams_t ){ 0, 0, { 0 }, 0 };
+    RegionCommonChanCacheInvalidate( &ChanCache );
 
     // Set the channel mask remaining accordingly
     ChannelsMaskRemaining[id / 16] &= ChannelsMask[id / 16];
@@ -74,6 +74,8 @@ void SpiFrequency( Spi_t *obj, uint32_t hz );
  */
 #if defined(LOPY) || defined (LOPY4) || defined(FIPY)
 uint16_t SpiInOut( Spi_t *obj, uint16_t outData );
+
+void SpiInOutBuf( Spi_t *obj, const uint8_t *outData, uint8_t *inData, int size );
 #elif defined(SIPY)
 uint8_t SpiInOut(uint32_t spiNum, uint32_t outData);
 /*!
@@ -22,209 +22,152 @@ Maintainer: Miguel Luis and Gregory Cristian
 volatile uint8_t HasLoopedThroughMain = 0;
 
 /*!
- * Timers list head pointer
+ * Maximum number of timers queued at once
  */
-static TimerEvent_t *TimerListHead = NULL;
+#define TIMER_HEAP_SIZE                                 16
 
 /*!
- * \brief Adds or replace the head timer of the list.
- *
- * \remark The list is automatically sorted. The list head always contains the
- *         next timer to expire.
- *
- * \param [IN]  obj Timer object to be become the new head
- * \param [IN]  remainingTime Remaining time of the previous head to be replaced
- */
-static void TimerInsertNewHeadTimer( TimerEvent_t *obj, uint32_t remainingTime );
-
-/*!
- * \brief Adds a timer to the list.
- *
- * \remark The list is automatically sorted. The list head always contains the
- *         next timer to expire.
- *
- * \param [IN]  obj Timer object to be added to the list
- * \param [IN]  remainingTime Remaining time of the running head after which the object may be added
+ * Timers queued, ordered as a binary min-heap on their deadline so that the
+ * first one to expire is always at index 0
  */
-static void TimerInsertTimer( TimerEvent_t *obj, uint32_t remainingTime );
+static DRAM_ATTR TimerEvent_t *TimerHeap[TIMER_HEAP_SIZE];
+static DRAM_ATTR uint32_t TimerHeapCount = 0;
 
 /*!
- * \brief Sets a timeout with the duration "timestamp"
+ * \brief Moves the timer at the given heap index up or down to its place
  *
- * \param [IN] timestamp Delay duration
+ * \param [IN] index Heap index of the timer
  */
-static void TimerSetTimeout( TimerEvent_t *obj );
+static void TimerHeapFix( uint32_t index );
 
 /*!
- * \brief Check if the Object to be added is not already in the list
+ * \brief Removes the timer at the given heap index
  *
- * \param [IN] timestamp Delay duration
- * \retval true (the object is already in the list) or false
+ * \param [IN] index Heap index of the timer
  */
-static bool TimerExists( TimerEvent_t *obj );
+static void TimerHeapRemove( uint32_t index );
 
 /*!
- * \brief Read the timer value of the currently running timer
- *
- * \retval value current timer value
+ * \brief Programs the hardware alarm for the first timer to expire
  */
-TimerTime_t TimerGetValue( void );
-
+static void TimerSetTimeout( void );
 
 void TimerInit( TimerEvent_t *obj, void ( *callback )( void ) )
 {
+    // initialized again while queued
+    TimerStop( obj );
+
     obj->Timestamp = 0;
     obj->ReloadValue = 0;
     obj->IsRunning = false;
     obj->Callback = callback;
-    obj->Next = NULL;
+    obj->Deadline = 0;
+    obj->HeapIndex = -1;
 }
 
-IRAM_ATTR void TimerStart( TimerEvent_t *obj )
+// HeapIndex alone isn't trusted, the timers not initialized yet have it at 0
+static IRAM_ATTR bool TimerIsQueued( TimerEvent_t *obj )
 {
-    uint32_t elapsedTime = 0;
-    uint32_t remainingTime = 0;
-
-    uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
+    return ( obj->HeapIndex >= 0 ) && ( ( uint32_t )obj->HeapIndex < TimerHeapCount ) && ( TimerHeap[obj->HeapIndex] == obj );
+}
 
-    if( ( obj == NULL ) || ( TimerExists( obj ) == true ) )
-    {
-        MICROPY_END_ATOMIC_SECTION(ilevel);
-        return;
-    }
+static IRAM_ATTR void TimerHeapSet( uint32_t index, TimerEvent_t *obj )
+{
+    TimerHeap[index] = obj;
+    obj->HeapIndex = index;
+}
 
-    obj->Timestamp = obj->ReloadValue;
-    obj->IsRunning = false;
+static IRAM_ATTR void TimerHeapFix( uint32_t index )
+{
+    TimerEvent_t *obj = TimerHeap[index];
 
-    if( TimerListHead == NULL )
-    {
-        TimerInsertNewHeadTimer( obj, obj->Timestamp );
-    }
-    else
+    // up while it expires before its parent
+    while( index > 0 )
     {
-        if( TimerListHead->IsRunning == true )
+        uint32_t parent = ( index - 1 ) / 2;
+        if( TimerHeap[parent]->Deadline <= obj->Deadline )
         {
-            elapsedTime = TimerGetValue( );
-            if( elapsedTime > TimerListHead->Timestamp )
-            {
-                elapsedTime = TimerListHead->Timestamp; // security but should never occur
-            }
-            remainingTime = TimerListHead->Timestamp - elapsedTime;
-        }
-        else
-        {
-            remainingTime = TimerListHead->Timestamp;
+            break;
         }
+        TimerHeapSet( index, TimerHeap[parent] );
+        index = parent;
+    }
 
-        if( obj->Timestamp < remainingTime )
+    // down while a child expires before it
+    for( ;; )
+    {
+        uint32_t child = ( index * 2 ) + 1;
+        if( child >= TimerHeapCount )
         {
-            TimerInsertNewHeadTimer( obj, remainingTime );
+            break;
         }
-        else
+        if( ( child + 1 < TimerHeapCount ) && ( TimerHeap[child + 1]->Deadline < TimerHeap[child]->Deadline ) )
         {
-             TimerInsertTimer( obj, remainingTime );
+            child++;
         }
-    }
-    MICROPY_END_ATOMIC_SECTION(ilevel);
-}
-
-static IRAM_ATTR void TimerInsertTimer( TimerEvent_t *obj, uint32_t remainingTime )
-{
-    uint32_t aggregatedTimestamp = 0;      // hold the sum of timestamps
-    uint32_t aggregatedTimestampNext = 0;  // hold the sum of timestamps up to the next event
-
-    TimerEvent_t* prev = TimerListHead;
-    TimerEvent_t* cur = TimerListHead->Next;
-
-    if( cur == NULL )
-    { // obj comes just after the head
-        obj->Timestamp -= remainingTime;
-        prev->Next = obj;
-        obj->Next = NULL;
-    }
-    else
-    {
-        aggregatedTimestamp = remainingTime;
-        aggregatedTimestampNext = remainingTime + cur->Timestamp;
-
-        while( prev != NULL )
+        if( obj->Deadline <= TimerHeap[child]->Deadline )
         {
-            if( aggregatedTimestampNext > obj->Timestamp )
-            {
-                obj->Timestamp -= aggregatedTimestamp;
-                if( cur != NULL )
-                {
-                    cur->Timestamp -= obj->Timestamp;
-                }
-                prev->Next = obj;
-                obj->Next = cur;
-                break;
-            }
-            else
-            {
-                prev = cur;
-                cur = cur->Next;
-                if( cur == NULL )
-                { // obj comes at the end of the list
-                    aggregatedTimestamp = aggregatedTimestampNext;
-                    obj->Timestamp -= aggregatedTimestamp;
-                    prev->Next = obj;
-                    obj->Next = NULL;
-                    break;
-                }
-                else
-                {
-                    aggregatedTimestamp = aggregatedTimestampNext;
-                    aggregatedTimestampNext = aggregatedTimestampNext + cur->Timestamp;
-                }
-            }
+            break;
         }
+        TimerHeapSet( index, TimerHeap[child] );
+        index = child;
     }
+
+    TimerHeapSet( index, obj );
 }
 
-static IRAM_ATTR void TimerInsertNewHeadTimer( TimerEvent_t *obj, uint32_t remainingTime )
+static IRAM_ATTR void TimerHeapRemove( uint32_t index )
 {
-    TimerEvent_t* cur = TimerListHead;
+    TimerEvent_t *obj = TimerHeap[index];
 
-    if( cur != NULL )
+    obj->HeapIndex = -1;
+    obj->IsRunning = false;
+    TimerHeapCount--;
+    if( index < TimerHeapCount )
     {
-        cur->Timestamp = remainingTime - obj->Timestamp;
-        cur->IsRunning = false;
+        // the last one takes its place
+        TimerHeapSet( index, TimerHeap[TimerHeapCount] );
+        TimerHeapFix( index );
     }
-
-    obj->Next = cur;
-    obj->IsRunning = true;
-    TimerListHead = obj;
-    TimerSetTimeout( TimerListHead );
+    TimerHeap[TimerHeapCount] = NULL;
 }
 
-IRAM_ATTR void TimerIrqHandler( void )
+IRAM_ATTR void TimerStart( TimerEvent_t *obj )
 {
-    uint32_t elapsedTime = 0;
+    uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
 
-    // when all timers are stopped or expired, TimerListHead is NULL
-    if( TimerListHead == NULL )
+    if( ( obj == NULL ) || TimerIsQueued( obj ) || ( TimerHeapCount >= TIMER_HEAP_SIZE ) )
     {
+        MICROPY_END_ATOMIC_SECTION(ilevel);
         return;
     }
 
-    elapsedTime = TimerGetValue( );
+    obj->Timestamp = obj->ReloadValue;
+    obj->Deadline = TimerHwGetTimeUs( ) + ( ( uint64_t )obj->Timestamp * 1000 );
+    obj->IsRunning = true;
 
-    if( elapsedTime >= TimerListHead->Timestamp )
-    {
-        TimerListHead->Timestamp = 0;
-    }
-    else
+    TimerHeapSet( TimerHeapCount, obj );
+    TimerHeapCount++;
+    TimerHeapFix( obj->HeapIndex );
+
+    // only a new first deadline moves the alarm
+    if( TimerHeap[0] == obj )
     {
-        TimerListHead->Timestamp -= elapsedTime;
+        TimerSetTimeout( );
     }
+    MICROPY_END_ATOMIC_SECTION(ilevel);
+}
 
-    TimerListHead->IsRunning = false;
+IRAM_ATTR void TimerIrqHandler( void )
+{
+    uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
+    uint64_t now = TimerHwGetTimeUs( );
 
-    while( ( TimerListHead != NULL ) && ( TimerListHead->Timestamp == 0 ) )
+    while( ( TimerHeapCount > 0 ) && ( TimerHeap[0]->Deadline <= now ) )
     {
-        TimerEvent_t* elapsedTimer = TimerListHead;
-        TimerListHead = TimerListHead->Next;
+        TimerEvent_t* elapsedTimer = TimerHeap[0];
+        TimerHeapRemove( 0 );
+        elapsedTimer->Timestamp = 0;
 
         if( elapsedTimer->Callback != NULL )
         {
@@ -233,117 +176,29 @@ IRAM_ATTR void TimerIrqHandler( void )
         }
     }
 
-    // start the next TimerListHead if it exists
-    if( TimerListHead != NULL )
-    {
-        if( TimerListHead->IsRunning != true )
-        {
-            TimerListHead->IsRunning = true;
-            TimerSetTimeout( TimerListHead );
-        }
-    }
+    TimerSetTimeout( );
+    MICROPY_END_ATOMIC_SECTION(ilevel);
 }
 
 IRAM_ATTR void TimerStop( TimerEvent_t *obj )
 {
     uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
 
-    uint32_t elapsedTime = 0;
-    uint32_t remainingTime = 0;
-
-    TimerEvent_t* prev = TimerListHead;
-    TimerEvent_t* cur = TimerListHead;
-
-    // List is empty or the Obj to stop does not exist
-    if( ( TimerListHead == NULL ) || ( obj == NULL ) )
+    if( ( obj == NULL ) || !TimerIsQueued( obj ) )
     {
         MICROPY_END_ATOMIC_SECTION(ilevel);
         return;
     }
 
-    if( TimerListHead == obj ) // Stop the Head
-    {
-        if( TimerListHead->IsRunning == true ) // The head is already running
-        {
-            elapsedTime = TimerGetValue( );
-            if( elapsedTime > obj->Timestamp )
-            {
-                elapsedTime = obj->Timestamp;
-            }
-
-            remainingTime = obj->Timestamp - elapsedTime;
-
-            if( TimerListHead->Next != NULL )
-            {
-                TimerListHead->IsRunning = false;
-                TimerListHead = TimerListHead->Next;
-                TimerListHead->Timestamp += remainingTime;
-                TimerListHead->IsRunning = true;
-                TimerSetTimeout( TimerListHead );
-            }
-            else
-            {
-                TimerListHead = NULL;
-            }
-        }
-        else // Stop the head before it is started
-        {
-            if( TimerListHead->Next != NULL )
-            {
-                remainingTime = obj->Timestamp;
-                TimerListHead = TimerListHead->Next;
-                TimerListHead->Timestamp += remainingTime;
-            }
-            else
-            {
-                TimerListHead = NULL;
-            }
-        }
-    }
-    else // Stop an object within the list
-    {
-        remainingTime = obj->Timestamp;
+    bool first = ( obj->HeapIndex == 0 );
+    TimerHeapRemove( obj->HeapIndex );
 
-        while( cur != NULL )
-        {
-            if( cur == obj )
-            {
-                if( cur->Next != NULL )
-                {
-                    cur = cur->Next;
-                    prev->Next = cur;
-                    cur->Timestamp += remainingTime;
-                }
-                else
-                {
-                    cur = NULL;
-                    prev->Next = cur;
-                }
-                break;
-            }
-            else
-            {
-                prev = cur;
-                cur = cur->Next;
-            }
-        }
-    }
-    MICROPY_END_ATOMIC_SECTION(ilevel);
-}
-
-static IRAM_ATTR bool TimerExists( TimerEvent_t *obj )
-{
-    TimerEvent_t* cur = TimerListHead;
-
-    while( cur != NULL )
+    // the alarm of a timer still queued is left alone
+    if( first )
     {
-        if( cur == obj )
-        {
-            return true;
-        }
-        cur = cur->Next;
+        TimerSetTimeout( );
     }
-    return false;
+    MICROPY_END_ATOMIC_SECTION(ilevel);
 }
 
 void TimerReset( TimerEvent_t *obj )
@@ -359,20 +214,22 @@ void IRAM_ATTR TimerSetValue( TimerEvent_t *obj, uint32_t value )
     obj->ReloadValue = value;
 }
 
-IRAM_ATTR TimerTime_t TimerGetValue( void )
-{
-    return TimerHwGetElapsedTime( );
-}
-
 IRAM_ATTR TimerTime_t TimerGetCurrentTime( void )
 {
     return TimerHwGetTime( );
 }
 
-static IRAM_ATTR void TimerSetTimeout( TimerEvent_t *obj )
+static IRAM_ATTR void TimerSetTimeout( void )
 {
     HasLoopedThroughMain = 0;
-    TimerHwStart( obj->Timestamp );
+    if( TimerHeapCount > 0 )
+    {
+        TimerHwStartAt( TimerHeap[0]->Deadline );
+    }
+    else
+    {
+        TimerHwStop( );
+    }
 }
 
 IRAM_ATTR TimerTime_t TimerGetElapsedTime( TimerTime_t savedTime )
@@ -380,9 +237,27 @@ IRAM_ATTR TimerTime_t TimerGetElapsedTime( TimerTime_t savedTime )
     return TimerHwComputeTimeDifference( savedTime );
 }
 
+TimerTime_t TimerGetRemainingTime( TimerEvent_t *obj )
+{
+    TimerTime_t remaining = 0;
+    uint32_t ilevel = MICROPY_BEGIN_ATOMIC_SECTION();
+
+    if( TimerIsQueued( obj ) )
+    {
+        uint64_t now = TimerHwGetTimeUs( );
+        if( obj->Deadline > now )
+        {
+            remaining = ( TimerTime_t )( ( obj->Deadline - now + 999 ) / 1000 );
+        }
+    }
+
+    MICROPY_END_ATOMIC_SECTION(ilevel);
+    return remaining;
+}
+
 void TimerLowPowerHandler( void )
 {
-    if( ( TimerListHead != NULL ) && ( TimerListHead->IsRunning == true ) )
+    if( TimerHeapCount > 0 )
     {
         if( HasLoopedThroughMain < 5 )
         {
@@ -22,9 +22,10 @@ typedef struct TimerEvent_s
 {
     uint32_t Timestamp;         //! Current timer value
     uint32_t ReloadValue;       //! Timer delay value
-    bool IsRunning;             //! Is the timer currently running
+    bool IsRunning;             //! Is the timer currently queued
     void ( *Callback )( void ); //! Timer IRQ callback function
-    struct TimerEvent_s *Next;  //! Pointer to the next Timer object.
+    uint64_t Deadline;          //! Expiry time in us of the hardware timer
+    int16_t HeapIndex;          //! Position in the timers heap, -1 when not queued
 }TimerEvent_t;
 
 /*!
@@ -94,6 +95,14 @@ TimerTime_t TimerGetCurrentTime( void );
  */
 TimerTime_t TimerGetElapsedTime( TimerTime_t savedTime );
 
+/*!
+ * \brief Return the time left before a timer expires
+ *
+ * \param [IN] obj  Structure containing the timer object parameters
+ * \retval time     remaining time in ms, 0 if the timer is not running
+ */
+TimerTime_t TimerGetRemainingTime( TimerEvent_t *obj );
+
 /*!
  * \brief Manages the entry into ARM cortex deep-sleep mode
  */
@@ -34,7 +34,15 @@
 #include "py/repl.h"
 #include "py/gc.h"
 #include "py/frozenmod.h"
+#include "py/persistentcode.h"
 #include "py/mphal.h"
+#if MICROPY_REPL_FILE_TRANSFER
+#include "py/builtin.h"
+#include "py/mperrno.h"
+#include "py/stream.h"
+#include "extmod/vfs.h"
+#include "extmod/uzlib/uzlib.h"
+#endif
 #if MICROPY_HW_ENABLE_USB
 #include "irq.h"
 #include "usb.h"
@@ -77,6 +85,12 @@ STATIC int parse_compile_execute(const void *source, mp_parse_input_kind_t input
             module_fun = mp_make_function_from_raw_code(source, MP_OBJ_NULL, MP_OBJ_NULL);
         } else
         #endif
+        #if MICROPY_PERSISTENT_CODE_CACHE
+        if (exec_flags & EXEC_FLAG_SOURCE_IS_FILENAME) {
+            // the script is only compiled again when it changes
+            module_fun = mp_make_function_from_raw_code(mp_raw_code_compile_file_cached(source), MP_OBJ_NULL, MP_OBJ_NULL);
+        } else
+        #endif
         {
             #if MICROPY_ENABLE_COMPILER
             mp_lexer_t *lex;
@@ -154,6 +168,149 @@ STATIC int parse_compile_execute(const void *source, mp_parse_input_kind_t input
     return ret;
 }
 
+#if MICROPY_REPL_FILE_TRANSFER
+
+// CTRL-E F at the raw REPL prompt receives a file, much faster than writing it with
+// code sent in hex. The host waits for "F<chunk size>\r\n", then sends frames made of
+// the payload length (uint32 LE), the payload and its CRC32 (uint32 LE). The first
+// frame holds the size of the file (uint32 LE) then its path, the next ones the data
+// of at most chunk size bytes each and an empty frame ends the file. Each frame is
+// answered with K when done, R when corrupted to have it sent again, or E<errno>\r\n
+// which ends the transfer. The file is written next to the old one, which is only
+// replaced once the whole file is received.
+#define PYEXEC_XFER_CHUNK_SIZE      (4096)
+#define PYEXEC_XFER_TIMEOUT_MS      (5000)
+#define PYEXEC_XFER_RETRIES         (4)
+
+// returns false if the host stays silent for PYEXEC_XFER_TIMEOUT_MS
+STATIC bool pyexec_xfer_read(byte *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        mp_uint_t start = mp_hal_ticks_ms();
+        while (!mp_hal_stdin_rx_any()) {
+            if (mp_hal_ticks_ms() - start > PYEXEC_XFER_TIMEOUT_MS) {
+                return false;
+            }
+            mp_hal_delay_ms(1);
+        }
+        buf[i] = mp_hal_stdin_rx_chr();
+    }
+    return true;
+}
+
+STATIC uint32_t pyexec_xfer_get_u32(const byte *buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+// returns the length of the payload, asking for the frame again while it's corrupted
+STATIC size_t pyexec_xfer_receive(byte *buf) {
+    for (int retries = 0; ; retries++) {
+        byte word[4];
+        if (!pyexec_xfer_read(word, 4)) {
+            mp_raise_OSError(MP_ETIMEDOUT);
+        }
+        uint32_t len = pyexec_xfer_get_u32(word);
+        if (len > PYEXEC_XFER_CHUNK_SIZE) {
+            mp_raise_OSError(MP_EINVAL);
+        }
+        if (!pyexec_xfer_read(buf, len) || !pyexec_xfer_read(word, 4)) {
+            mp_raise_OSError(MP_ETIMEDOUT);
+        }
+        if ((uzlib_crc32(buf, len, 0xffffffff) ^ 0xffffffff) == pyexec_xfer_get_u32(word)) {
+            return len;
+        }
+        if (retries == PYEXEC_XFER_RETRIES) {
+            mp_raise_OSError(MP_EIO);
+        }
+        mp_hal_stdout_tx_strn("R", 1);
+    }
+}
+
+STATIC void pyexec_xfer_remove(mp_obj_t path) {
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_vfs_remove(path);
+        nlr_pop();
+    }
+}
+
+STATIC void pyexec_raw_repl_receive_file(void) {
+    byte *volatile buf = NULL;
+    volatile mp_obj_t file = MP_OBJ_NULL;
+    volatile mp_obj_t part = MP_OBJ_NULL;
+    char msg[16];
+
+    // the data can hold any byte
+    mp_hal_set_reset_char(-1);
+    snprintf(msg, sizeof(msg), "F%u\r\n", PYEXEC_XFER_CHUNK_SIZE);
+    mp_hal_stdout_tx_str(msg);
+
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        buf = m_new(byte, PYEXEC_XFER_CHUNK_SIZE);
+        size_t len = pyexec_xfer_receive(buf);
+        if (len <= 4) {
+            mp_raise_OSError(MP_EINVAL);
+        }
+        uint32_t size = pyexec_xfer_get_u32(buf);
+        mp_obj_t path = mp_obj_new_str((const char *)buf + 4, len - 4);
+        vstr_t vstr;
+        vstr_init(&vstr, len + 1);
+        vstr_add_strn(&vstr, (const char *)buf + 4, len - 4);
+        vstr_add_str(&vstr, ".part");
+        part = mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
+        mp_obj_t args[2] = { part, MP_OBJ_NEW_QSTR(MP_QSTR_wb) };
+        file = mp_builtin_open(2, args, (mp_map_t *)&mp_const_empty_map);
+        mp_hal_stdout_tx_strn("K", 1);
+
+        // a chunk is only acknowledged once written, the host never gets ahead of the VFS
+        uint32_t received = 0;
+        while ((len = pyexec_xfer_receive(buf)) > 0) {
+            int err;
+            if (mp_stream_write_exactly(file, buf, len, &err) != len) {
+                mp_raise_OSError(err != 0 ? err : MP_ENOSPC);
+            }
+            received += len;
+            mp_hal_stdout_tx_strn("K", 1);
+        }
+        mp_stream_close(file);
+        file = MP_OBJ_NULL;
+        if (received != size) {
+            mp_raise_OSError(MP_EIO);
+        }
+        pyexec_xfer_remove(path);
+        mp_vfs_rename(part, path);
+        nlr_pop();
+        mp_hal_stdout_tx_strn("K", 1);
+    } else {
+        int err = MP_EIO;
+        mp_obj_t exc = MP_OBJ_FROM_PTR(nlr.ret_val);
+        if (mp_obj_is_subclass_fast(MP_OBJ_FROM_PTR(mp_obj_get_type(exc)), MP_OBJ_FROM_PTR(&mp_type_OSError))) {
+            mp_obj_t value = mp_obj_exception_get_value(exc);
+            if (MP_OBJ_IS_SMALL_INT(value)) {
+                err = MP_OBJ_SMALL_INT_VALUE(value);
+            }
+        }
+        if (file != MP_OBJ_NULL) {
+            nlr_buf_t nlr_close;
+            if (nlr_push(&nlr_close) == 0) {
+                mp_stream_close(file);
+                nlr_pop();
+            }
+        }
+        if (part != MP_OBJ_NULL) {
+            pyexec_xfer_remove(part);
+        }
+        snprintf(msg, sizeof(msg), "E%d\r\n", err);
+        mp_hal_stdout_tx_str(msg);
+    }
+    if (buf != NULL) {
+        m_del(byte, buf, PYEXEC_XFER_CHUNK_SIZE);
+    }
+    mp_hal_set_reset_char(CHAR_CTRL_F);
+}
+
+#endif // MICROPY_REPL_FILE_TRANSFER
+
 #if MICROPY_ENABLE_COMPILER
 #if MICROPY_REPL_EVENT_DRIVEN
 
@@ -386,6 +543,17 @@ raw_repl_reset:
             } else if (c == CHAR_CTRL_D) {
                 // input finished
                 break;
+            #if MICROPY_REPL_FILE_TRANSFER
+            } else if (c == CHAR_CTRL_E && line.len == 0) {
+                c = mp_hal_stdin_rx_chr();
+                if (c == 'F') {
+                    pyexec_raw_repl_receive_file();
+                    mp_hal_stdout_tx_str(">");
+                } else {
+                    vstr_add_byte(&line, CHAR_CTRL_E);
+                    vstr_add_byte(&line, c);
+                }
+            #endif
             } else {
                 // let through any other raw 8-bit value
                 vstr_add_byte(&line, c);
@@ -181,6 +181,42 @@ STATIC mp_obj_t extra_coverage(void) {
         mp_printf(&mp_plat_print, "%p\n", gc_nbytes(NULL));
     }
 
+    // GC reserve
+    {
+        mp_printf(&mp_plat_print, "# GC reserve\n");
+
+        // emptying the reserve with allocations that don't raise keeps the scope
+        gc_lock();
+        gc_reserve_begin();
+        while (m_malloc_maybe(16) != NULL) {
+        }
+        mp_printf(&mp_plat_print, "%d\n", (int)MP_STATE_MEM(gc_reserve_depth));
+
+        // the MemoryError of the empty reserve goes through a nested scope, each one ends its own
+        nlr_buf_t nlr_outer;
+        gc_reserve_begin();
+        if (nlr_push(&nlr_outer) == 0) {
+            nlr_buf_t nlr_inner;
+            gc_reserve_begin();
+            if (nlr_push(&nlr_inner) == 0) {
+                m_malloc(16);
+                nlr_pop();
+            } else {
+                gc_reserve_end();
+                nlr_jump(nlr_inner.ret_val);
+            }
+            gc_reserve_end();
+            nlr_pop();
+        } else {
+            gc_reserve_end();
+            mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr_outer.ret_val));
+        }
+        mp_printf(&mp_plat_print, "%d\n", (int)MP_STATE_MEM(gc_reserve_depth));
+        gc_reserve_end();
+        gc_unlock();
+        mp_printf(&mp_plat_print, "%d\n", (int)MP_STATE_MEM(gc_reserve_depth));
+    }
+
     // vstr
     {
         mp_printf(&mp_plat_print, "# vstr\n");
@@ -197,3 +197,26 @@ mp_uint_t mp_hal_ticks_us(void) {
     gettimeofday(&tv, NULL);
     return tv.tv_sec * 1000000 + tv.tv_usec;
 }
+
+#if MICROPY_PY_MICROPYTHON_PROFILE
+STATIC void profile_sighandler(int signum) {
+    (void)signum;
+    mp_profile_tick();
+}
+
+// counts the CPU time of the process, a blocked interpreter isn't sampled
+void mp_hal_profile_timer(mp_uint_t period_us) {
+    struct itimerval timer = {
+        .it_interval = { .tv_sec = period_us / 1000000, .tv_usec = period_us % 1000000 },
+    };
+    timer.it_value = timer.it_interval;
+    if (period_us > 0) {
+        struct sigaction sa;
+        sa.sa_flags = SA_RESTART;
+        sa.sa_handler = profile_sighandler;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGPROF, &sa, NULL);
+    }
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+#endif
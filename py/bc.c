@@ -70,6 +70,56 @@ const byte *mp_decode_uint_skip(const byte *ptr) {
     return ptr;
 }
 
+// Works out the source position of the instruction at code_state->ip from
+// the line info in the prelude of the bytecode.
+void mp_bytecode_get_source_pos(const mp_code_state_t *code_state, qstr *source_file, size_t *source_line, qstr *block_name) {
+    const byte *ip = code_state->fun_bc->bytecode;
+    ip = mp_decode_uint_skip(ip); // skip n_state
+    ip = mp_decode_uint_skip(ip); // skip n_exc_stack
+    ip++; // skip scope_params
+    ip++; // skip n_pos_args
+    ip++; // skip n_kwonly_args
+    ip++; // skip n_def_pos_args
+    size_t bc = code_state->ip - ip;
+    size_t code_info_size = mp_decode_uint_value(ip);
+    ip = mp_decode_uint_skip(ip); // skip code_info_size
+    bc -= code_info_size;
+    #if MICROPY_PERSISTENT_CODE
+    *block_name = ip[0] | (ip[1] << 8);
+    *source_file = ip[2] | (ip[3] << 8);
+    ip += 4;
+    #else
+    *block_name = mp_decode_uint_value(ip);
+    ip = mp_decode_uint_skip(ip);
+    *source_file = mp_decode_uint_value(ip);
+    ip = mp_decode_uint_skip(ip);
+    #endif
+    size_t line = 1;
+    size_t c;
+    while ((c = *ip)) {
+        size_t b, l;
+        if ((c & 0x80) == 0) {
+            // 0b0LLBBBBB encoding
+            b = c & 0x1f;
+            l = c >> 5;
+            ip += 1;
+        } else {
+            // 0b1LLLBBBB 0bLLLLLLLL encoding (l's LSB in second byte)
+            b = c & 0xf;
+            l = ((c << 4) & 0x700) | ip[1];
+            ip += 2;
+        }
+        if (bc >= b) {
+            bc -= b;
+            line += l;
+        } else {
+            // found source line corresponding to bytecode offset
+            break;
+        }
+    }
+    *source_line = line;
+}
+
 STATIC NORETURN void fun_pos_args_mismatch(mp_obj_fun_bc_t *f, size_t expected, size_t given) {
 #if MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_TERSE
     // generic message, used also for other argument issues
@@ -204,7 +204,7 @@ STATIC void do_load(mp_obj_t module_obj, vstr_t *file) {
 
     // If we support frozen mpy modules and we found a corresponding file (and
     // its data) in the list of frozen files, execute it.
-    #if MICROPY_MODULE_FROZEN_MPY
+    #if MICROPY_MODULE_FROZEN_MPY || MICROPY_PERSISTENT_CODE_IMAGE
     if (frozen_type == MP_FROZEN_MPY) {
         do_execute_raw_code(module_obj, modref);
         return;
@@ -224,8 +224,15 @@ STATIC void do_load(mp_obj_t module_obj, vstr_t *file) {
     // If we can compile scripts then load the file and compile and execute it.
     #if MICROPY_ENABLE_COMPILER
     {
+        #if MICROPY_PERSISTENT_CODE_CACHE
+        #if MICROPY_PY___FILE__
+        mp_store_attr(module_obj, MP_QSTR___file__, MP_OBJ_NEW_QSTR(qstr_from_str(file_str)));
+        #endif
+        do_execute_raw_code(module_obj, mp_raw_code_compile_file_cached(file_str));
+        #else
         mp_lexer_t *lex = mp_lexer_new_from_file(file_str);
         do_load_from_lexer(module_obj, lex);
+        #endif
         return;
     }
     #else
@@ -95,6 +95,7 @@ STATIC const emit_method_table_t *emit_native_table[] = {
     &emit_native_thumb_method_table,
     &emit_native_thumb_method_table,
     &emit_native_xtensa_method_table,
+    &emit_native_xtensawin_method_table,
 };
 
 #elif MICROPY_EMIT_NATIVE
@@ -109,6 +110,8 @@ STATIC const emit_method_table_t *emit_native_table[] = {
 #define NATIVE_EMITTER(f) emit_native_arm_##f
 #elif MICROPY_EMIT_XTENSA
 #define NATIVE_EMITTER(f) emit_native_xtensa_##f
+#elif MICROPY_EMIT_XTENSAWIN
+#define NATIVE_EMITTER(f) emit_native_xtensawin_##f
 #else
 #error "unknown native emitter"
 #endif
@@ -131,6 +134,7 @@ STATIC const emit_inline_asm_method_table_t *emit_asm_table[] = {
     &emit_inline_thumb_method_table,
     &emit_inline_thumb_method_table,
     &emit_inline_xtensa_method_table,
+    NULL,
 };
 
 #elif MICROPY_EMIT_INLINE_ASM
@@ -313,7 +317,76 @@ STATIC void compile_delete_id(compiler_t *comp, qstr qst) {
     }
 }
 
+#if MICROPY_COMP_CONST_TUPLE
+// Whether the node is a literal that can be an item of a constant tuple
+STATIC bool c_is_const_literal(mp_parse_node_t pn) {
+    if (MP_PARSE_NODE_IS_SMALL_INT(pn) || MP_PARSE_NODE_IS_STRUCT_KIND(pn, PN_const_object)) {
+        return true;
+    } else if (MP_PARSE_NODE_IS_LEAF(pn)) {
+        uintptr_t arg = MP_PARSE_NODE_LEAF_ARG(pn);
+        switch (MP_PARSE_NODE_LEAF_KIND(pn)) {
+            case MP_PARSE_NODE_STRING:
+            case MP_PARSE_NODE_BYTES:
+                return true;
+            case MP_PARSE_NODE_TOKEN:
+                return arg == MP_TOKEN_KW_NONE || arg == MP_TOKEN_KW_TRUE || arg == MP_TOKEN_KW_FALSE;
+        }
+    }
+    return false;
+}
+
+STATIC mp_obj_t c_const_literal_obj(mp_parse_node_t pn) {
+    mp_obj_t o;
+    if (MP_PARSE_NODE_IS_SMALL_INT(pn)) {
+        return MP_OBJ_NEW_SMALL_INT(MP_PARSE_NODE_LEAF_SMALL_INT(pn));
+    } else if (mp_parse_node_get_const_object_maybe(pn, &o)) {
+        return o;
+    }
+    uintptr_t arg = MP_PARSE_NODE_LEAF_ARG(pn);
+    switch (MP_PARSE_NODE_LEAF_KIND(pn)) {
+        case MP_PARSE_NODE_STRING:
+            return MP_OBJ_NEW_QSTR(arg);
+        case MP_PARSE_NODE_BYTES: {
+            size_t len;
+            const byte *data = qstr_data(arg, &len);
+            return mp_obj_new_bytes(data, len);
+        }
+        default:
+            return arg == MP_TOKEN_KW_NONE ? mp_const_none : mp_obj_new_bool(arg == MP_TOKEN_KW_TRUE);
+    }
+}
+#endif
+
 STATIC void c_tuple(compiler_t *comp, mp_parse_node_t pn, mp_parse_node_struct_t *pns_list) {
+    #if MICROPY_COMP_CONST_TUPLE
+    // a tuple of literals is loaded as a constant rather than built each time
+    int n = pns_list == NULL ? 0 : MP_PARSE_NODE_STRUCT_NUM_NODES(pns_list);
+    bool is_const = n > 0 || !MP_PARSE_NODE_IS_NULL(pn);
+    if (!MP_PARSE_NODE_IS_NULL(pn) && !c_is_const_literal(pn)) {
+        is_const = false;
+    }
+    for (int i = 0; is_const && i < n; i++) {
+        is_const = c_is_const_literal(pns_list->nodes[i]);
+    }
+    if (is_const) {
+        // only create the actual tuple object on the last pass
+        if (comp->pass != MP_PASS_EMIT) {
+            EMIT_ARG(load_const_obj, mp_const_none);
+        } else {
+            size_t first = MP_PARSE_NODE_IS_NULL(pn) ? 0 : 1;
+            mp_obj_tuple_t *tuple = MP_OBJ_TO_PTR(mp_obj_new_tuple(first + n, NULL));
+            if (first) {
+                tuple->items[0] = c_const_literal_obj(pn);
+            }
+            for (int i = 0; i < n; i++) {
+                tuple->items[first + i] = c_const_literal_obj(pns_list->nodes[i]);
+            }
+            EMIT_ARG(load_const_obj, MP_OBJ_FROM_PTR(tuple));
+        }
+        return;
+    }
+    #endif
+
     int total = 0;
     if (!MP_PARSE_NODE_IS_NULL(pn)) {
         compile_node(comp, pn);
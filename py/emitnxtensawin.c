@@ -0,0 +1,27 @@
+// Xtensa-Windowed specific stuff
+
+#include "py/mpconfig.h"
+
+#if MICROPY_EMIT_XTENSAWIN
+
+// this is defined so that the assembler exports generic assembler API macros
+#define GENERIC_ASM_API (1)
+#define GENERIC_ASM_API_WIN (1)
+#include "py/asmxtensa.h"
+
+// The windowed ABI is only supported with the setjmp-based nlr, where the
+// nlr_buf_t contains the jmp_buf of the Xtensa newlib: a0-a11 of the caller
+// of setjmp, the caller's base save area and the return address of setjmp
+#define N_NLR_SETJMP (1)
+#define NLR_BUF_NUM_WORDS (2 + 17 + 1) // prev, ret_val, jmp_buf, pystack
+
+// Word indices of REG_LOCAL_x in nlr_buf_t
+#define NLR_BUF_IDX_LOCAL_1 (2 + 4) // a4
+#define NLR_BUF_IDX_LOCAL_2 (2 + 5) // a5
+#define NLR_BUF_IDX_LOCAL_3 (2 + 6) // a6
+
+#define N_XTENSAWIN (1)
+#define EXPORT_FUN(name) emit_native_xtensawin_##name
+#include "py/emitnative.c"
+
+#endif
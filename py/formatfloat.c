@@ -426,4 +426,133 @@ int mp_format_float(FPTYPE f, char *buf, size_t buf_size, char fmt, int prec, ch
     return s - buf;
 }
 
+#if MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_FLOAT && MICROPY_FLOAT_FORMAT_SHORTEST
+
+/***********************************************************************
+
+  Shortest round trip formatting of single precision floats, for repr().
+
+  The value is exact in a double, and so is its scaling by a power of 10
+  up to 1e22, which makes the digits come out as one integer, correctly
+  rounded, instead of one float operation per digit. 6 to 9 significant
+  digits are tried in turn, and the first that reads back as the same float
+  is printed. 9 always do, and with 6 or less digits the shortest form has
+  the 6 digit one plus trailing zeros, except for subnormals which have
+  fewer significant bits and start from 1 digit.
+
+***********************************************************************/
+
+static const double g_pow10_exact[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// v * 10^k, with a single rounding for |k| <= 22
+static double fp_scale10(double v, int k) {
+    for (; k > 22; k -= 22) {
+        v *= 1e22;
+    }
+    for (; k < -22; k += 22) {
+        v /= 1e22;
+    }
+    return (k >= 0) ? v * g_pow10_exact[k] : v / g_pow10_exact[-k];
+}
+
+int mp_format_float_shortest(float f, char *buf, size_t buf_size) {
+    if (buf_size < 16 || fp_iszero(f) || fp_isinf(f) || fp_isnan(f)) {
+        return mp_format_float(f, buf, buf_size, 'g', 7, '\0');
+    }
+
+    char *s = buf;
+    if (fp_signbit(f)) {
+        *s++ = '-';
+        f = -f;
+    }
+    double v = f;
+
+    // estimate the decimal exponent from the binary one, log10(2) ~ 0.30103
+    int e2;
+    frexp(v, &e2);
+    int e10 = ((e2 - 1) * 30103) / 100000 - ((e2 - 1) < 0);
+
+    uint32_t digits = 0;
+    int n_digits;
+    for (n_digits = (f < FPCONST(1.17549435e-38)) ? 1 : 6; n_digits <= 9; n_digits++) {
+        int k = e10 - n_digits + 1;
+        digits = (uint32_t)(fp_scale10(v, -k) + 0.5);
+        if (digits >= (uint32_t)g_pow10_exact[n_digits]) {
+            // the estimate was one too low, or rounding carried into a new digit
+            e10++;
+            n_digits--;
+            continue;
+        } else if (digits < (uint32_t)g_pow10_exact[n_digits - 1]) {
+            e10--;
+            n_digits--;
+            continue;
+        }
+        if ((float)fp_scale10(digits, k) == f) {
+            break;
+        }
+    }
+    if (n_digits > 9) {
+        n_digits = 9;
+    }
+    while (n_digits > 1 && digits % 10 == 0) {
+        digits /= 10;
+        n_digits--;
+    }
+
+    char d[9];
+    for (int i = n_digits - 1; i >= 0; i--) {
+        d[i] = '0' + digits % 10;
+        digits /= 10;
+    }
+
+    // the same switch to the exponent form as %.7g
+    if (e10 < -4 || e10 >= 7) {
+        *s++ = d[0];
+        if (n_digits > 1) {
+            *s++ = '.';
+            for (int i = 1; i < n_digits; i++) {
+                *s++ = d[i];
+            }
+        }
+        *s++ = 'e';
+        if (e10 < 0) {
+            *s++ = '-';
+            e10 = -e10;
+        } else {
+            *s++ = '+';
+        }
+        *s++ = '0' + e10 / 10;
+        *s++ = '0' + e10 % 10;
+    } else if (e10 < 0) {
+        *s++ = '0';
+        *s++ = '.';
+        for (int i = e10 + 1; i < 0; i++) {
+            *s++ = '0';
+        }
+        for (int i = 0; i < n_digits; i++) {
+            *s++ = d[i];
+        }
+    } else {
+        for (int i = 0; i <= e10; i++) {
+            *s++ = (i < n_digits) ? d[i] : '0';
+        }
+        if (n_digits > e10 + 1) {
+            *s++ = '.';
+            for (int i = e10 + 1; i < n_digits; i++) {
+                *s++ = d[i];
+            }
+        }
+    }
+    *s = '\0';
+
+    assert((size_t)(s + 1 - buf) <= buf_size);
+
+    return s - buf;
+}
+
+#endif // MICROPY_FLOAT_FORMAT_SHORTEST
+
 #endif // MICROPY_FLOAT_IMPL != MICROPY_FLOAT_IMPL_NONE
@@ -30,6 +30,9 @@
 
 #if MICROPY_PY_BUILTINS_FLOAT
 int mp_format_float(mp_float_t f, char *buf, size_t bufSize, char fmt, int prec, char sign);
+#if MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_FLOAT && MICROPY_FLOAT_FORMAT_SHORTEST
+int mp_format_float_shortest(float f, char *buf, size_t buf_size);
+#endif
 #endif
 
 #endif // MICROPY_INCLUDED_PY_FORMATFLOAT_H
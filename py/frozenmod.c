@@ -82,6 +82,65 @@ STATIC mp_lexer_t *mp_lexer_frozen_str(const char *str, size_t len) {
 extern const char mp_frozen_mpy_names[];
 extern const mp_raw_code_t *const mp_frozen_mpy_content[];
 
+#if MICROPY_MODULE_FROZEN_INDEX
+
+// The names are sorted and mp_frozen_mpy_index holds the offset of each of them
+extern const uint16_t mp_frozen_mpy_num;
+extern const uint16_t mp_frozen_mpy_index[];
+
+// Compares a name with str followed by the suffix character, if it isn't 0
+STATIC int frozen_name_cmp(const char *name, const char *str, size_t len, char suffix) {
+    int cmp = strncmp(name, str, len);
+    if (cmp != 0 || suffix == 0) {
+        return cmp != 0 ? cmp : (unsigned char)name[len];
+    }
+    if (name[len] != suffix) {
+        return (unsigned char)name[len] - (unsigned char)suffix;
+    }
+    return name[len + 1] != 0;
+}
+
+// Returns the index of the first name that isn't less than str and the suffix
+STATIC size_t frozen_mpy_lower_bound(const char *str, size_t len, char suffix) {
+    size_t lo = 0;
+    size_t hi = mp_frozen_mpy_num;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (frozen_name_cmp(mp_frozen_mpy_names + mp_frozen_mpy_index[mid], str, len, suffix) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+STATIC const mp_raw_code_t *mp_find_frozen_mpy(const char *str, size_t len) {
+    size_t i = frozen_mpy_lower_bound(str, len, 0);
+    if (i < mp_frozen_mpy_num && frozen_name_cmp(mp_frozen_mpy_names + mp_frozen_mpy_index[i], str, len, 0) == 0) {
+        return mp_frozen_mpy_content[i];
+    }
+    return NULL;
+}
+
+STATIC mp_import_stat_t mp_frozen_mpy_stat(const char *str) {
+    size_t len = strlen(str);
+    if (mp_find_frozen_mpy(str, len) != NULL) {
+        return MP_IMPORT_STAT_FILE;
+    }
+    // a directory if a name starts with str followed by a slash
+    size_t i = frozen_mpy_lower_bound(str, len, '/');
+    if (i < mp_frozen_mpy_num) {
+        const char *name = mp_frozen_mpy_names + mp_frozen_mpy_index[i];
+        if (strncmp(name, str, len) == 0 && name[len] == '/') {
+            return MP_IMPORT_STAT_DIR;
+        }
+    }
+    return MP_IMPORT_STAT_NO_EXIST;
+}
+
+#else
+
 STATIC const mp_raw_code_t *mp_find_frozen_mpy(const char *str, size_t len) {
     const char *name = mp_frozen_mpy_names;
     for (size_t i = 0; *name != 0; i++) {
@@ -96,8 +155,32 @@ STATIC const mp_raw_code_t *mp_find_frozen_mpy(const char *str, size_t len) {
 
 #endif
 
+#endif
+
+#if MICROPY_PERSISTENT_CODE_IMAGE
+
+#include "py/persistentcode.h"
+
+STATIC mp_raw_code_t *mp_find_image_mpy(const char *str, size_t len) {
+    const char *name = mp_raw_code_image_names();
+    if (name == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; *name != 0; i++) {
+        size_t l = strlen(name);
+        if (l == len && !memcmp(str, name, l)) {
+            return mp_raw_code_image_load(i);
+        }
+        name += l + 1;
+    }
+    return NULL;
+}
+
+#endif
+
 #if MICROPY_MODULE_FROZEN
 
+#if MICROPY_MODULE_FROZEN_STR || (MICROPY_MODULE_FROZEN_MPY && !MICROPY_MODULE_FROZEN_INDEX) || MICROPY_PERSISTENT_CODE_IMAGE
 STATIC mp_import_stat_t mp_frozen_stat_helper(const char *name, const char *str) {
     size_t len = strlen(str);
 
@@ -114,6 +197,7 @@ STATIC mp_import_stat_t mp_frozen_stat_helper(const char *name, const char *str)
     }
     return MP_IMPORT_STAT_NO_EXIST;
 }
+#endif
 
 mp_import_stat_t mp_frozen_stat(const char *str) {
     mp_import_stat_t stat;
@@ -126,12 +210,26 @@ mp_import_stat_t mp_frozen_stat(const char *str) {
     #endif
 
     #if MICROPY_MODULE_FROZEN_MPY
+    #if MICROPY_MODULE_FROZEN_INDEX
+    stat = mp_frozen_mpy_stat(str);
+    #else
     stat = mp_frozen_stat_helper(mp_frozen_mpy_names, str);
+    #endif
     if (stat != MP_IMPORT_STAT_NO_EXIST) {
         return stat;
     }
     #endif
 
+    #if MICROPY_PERSISTENT_CODE_IMAGE
+    const char *names = mp_raw_code_image_names();
+    if (names != NULL) {
+        stat = mp_frozen_stat_helper(names, str);
+        if (stat != MP_IMPORT_STAT_NO_EXIST) {
+            return stat;
+        }
+    }
+    #endif
+
     return MP_IMPORT_STAT_NO_EXIST;
 }
 
@@ -150,6 +248,13 @@ int mp_find_frozen_module(const char *str, size_t len, void **data) {
         return MP_FROZEN_MPY;
     }
     #endif
+    #if MICROPY_PERSISTENT_CODE_IMAGE
+    mp_raw_code_t *image_rc = mp_find_image_mpy(str, len);
+    if (image_rc != NULL) {
+        *data = image_rc;
+        return MP_FROZEN_MPY;
+    }
+    #endif
     return MP_FROZEN_NONE;
 }
 
@@ -31,6 +31,18 @@
 
 #include "py/gc.h"
 #include "py/runtime.h"
+#if MICROPY_GC_STATS_CALLERS
+#include "py/bc.h"
+#endif
+#if MICROPY_GC_FREE_LISTS
+#include "py/objstr.h"
+#endif
+
+// the pause of each collection is timed for the histogram and the stats
+#define GC_PAUSE_TIMING (MICROPY_GC_PAUSE_HISTOGRAM || MICROPY_GC_STATS)
+#if GC_PAUSE_TIMING
+#include "py/mphal.h"
+#endif
 
 #if MICROPY_ENABLE_GC
 
@@ -75,15 +87,22 @@
 #define ATB_3_IS_FREE(a) (((a) & ATB_MASK_3) == 0)
 
 #define BLOCK_SHIFT(block) (2 * ((block) & (BLOCKS_PER_ATB - 1)))
-#define ATB_GET_KIND(block) ((MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
-#define ATB_ANY_TO_FREE(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
-#define ATB_FREE_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_HEAD << BLOCK_SHIFT(block)); } while (0)
-#define ATB_FREE_TO_TAIL(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_TAIL << BLOCK_SHIFT(block)); } while (0)
-#define ATB_HEAD_TO_MARK(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
-#define ATB_MARK_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
-
-#define BLOCK_FROM_PTR(ptr) (((byte*)(ptr) - MP_STATE_MEM(gc_pool_start)) / BYTES_PER_BLOCK)
-#define PTR_FROM_BLOCK(block) (((block) * BYTES_PER_BLOCK + (uintptr_t)MP_STATE_MEM(gc_pool_start)))
+#define ATB_GET_KIND(area, block) (((area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
+#define ATB_ANY_TO_FREE(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
+#define ATB_FREE_TO_HEAD(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_HEAD << BLOCK_SHIFT(block)); } while (0)
+#define ATB_FREE_TO_TAIL(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_TAIL << BLOCK_SHIFT(block)); } while (0)
+#define ATB_HEAD_TO_MARK(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
+#define ATB_MARK_TO_HEAD(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
+
+#if MICROPY_GC_INCREMENTAL_SWEEP
+// live heads not reached yet by a pending sweep are still marked
+#define ATB_IS_HEAD(area, block) ((ATB_GET_KIND(area, block) & AT_HEAD) != 0)
+#else
+#define ATB_IS_HEAD(area, block) (ATB_GET_KIND(area, block) == AT_HEAD)
+#endif
+
+#define BLOCK_FROM_PTR(area, ptr) (((byte*)(ptr) - (area)->gc_pool_start) / BYTES_PER_BLOCK)
+#define PTR_FROM_BLOCK(area, block) (((block) * BYTES_PER_BLOCK + (uintptr_t)(area)->gc_pool_start))
 #define ATB_FROM_BLOCK(bl) ((bl) / BLOCKS_PER_ATB)
 
 #if MICROPY_ENABLE_FINALISER
@@ -92,11 +111,19 @@
 
 #define BLOCKS_PER_FTB (8)
 
-#define FTB_GET(block) ((MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
-#define FTB_SET(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
-#define FTB_CLEAR(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
+#define FTB_GET(area, block) (((area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
+#define FTB_SET(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
+#define FTB_CLEAR(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
 #endif
 
+#if MICROPY_GC_SPLIT_HEAP
+#define NEXT_AREA(area) ((area)->next)
+#else
+#define NEXT_AREA(area) (NULL)
+#endif
+
+// With the GIL only the thread holding it can allocate, so the GC needs no
+// lock of its own then, and per-thread allocation caches wouldn't save any.
 #if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
 #define GC_ENTER() mp_thread_mutex_lock(&MP_STATE_MEM(gc_mutex), 1)
 #define GC_EXIT() mp_thread_mutex_unlock(&MP_STATE_MEM(gc_mutex))
@@ -105,8 +132,15 @@
 #define GC_EXIT()
 #endif
 
+// whether the allocations come from between gc_reserve_begin() and gc_reserve_end()
+#if MICROPY_GC_RESERVE
+#define GC_RESERVING() (MP_STATE_MEM(gc_reserve_depth) > 0)
+#else
+#define GC_RESERVING() (0)
+#endif
+
 // TODO waste less memory; currently requires that all entries in alloc_table have a corresponding block in pool
-void gc_init(void *start, void *end) {
+STATIC void gc_setup_area(mp_state_mem_area_t *area, void *start, void *end) {
     // align end pointer on block boundary
     end = (void*)((uintptr_t)end & (~(BYTES_PER_BLOCK - 1)));
     DEBUG_printf("Initializing GC heap: %p..%p = " UINT_FMT " bytes\n", start, end, (byte*)end - (byte*)start);
@@ -118,36 +152,95 @@ void gc_init(void *start, void *end) {
     // => T = A * (1 + BLOCKS_PER_ATB / BLOCKS_PER_FTB + BLOCKS_PER_ATB * BYTES_PER_BLOCK)
     size_t total_byte_len = (byte*)end - (byte*)start;
 #if MICROPY_ENABLE_FINALISER
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len * BITS_PER_BYTE / (BITS_PER_BYTE + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
+    area->gc_alloc_table_byte_len = total_byte_len * BITS_PER_BYTE / (BITS_PER_BYTE + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
 #else
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len / (1 + BITS_PER_BYTE / 2 * BYTES_PER_BLOCK);
+    area->gc_alloc_table_byte_len = total_byte_len / (1 + BITS_PER_BYTE / 2 * BYTES_PER_BLOCK);
 #endif
 
-    MP_STATE_MEM(gc_alloc_table_start) = (byte*)start;
+    area->gc_alloc_table_start = (byte*)start;
 
 #if MICROPY_ENABLE_FINALISER
-    size_t gc_finaliser_table_byte_len = (MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
-    MP_STATE_MEM(gc_finaliser_table_start) = MP_STATE_MEM(gc_alloc_table_start) + MP_STATE_MEM(gc_alloc_table_byte_len);
+    size_t gc_finaliser_table_byte_len = (area->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
+    area->gc_finaliser_table_start = area->gc_alloc_table_start + area->gc_alloc_table_byte_len;
 #endif
 
-    size_t gc_pool_block_len = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
-    MP_STATE_MEM(gc_pool_start) = (byte*)end - gc_pool_block_len * BYTES_PER_BLOCK;
-    MP_STATE_MEM(gc_pool_end) = end;
+    size_t gc_pool_block_len = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    area->gc_pool_start = (byte*)end - gc_pool_block_len * BYTES_PER_BLOCK;
+    area->gc_pool_end = end;
 
 #if MICROPY_ENABLE_FINALISER
-    assert(MP_STATE_MEM(gc_pool_start) >= MP_STATE_MEM(gc_finaliser_table_start) + gc_finaliser_table_byte_len);
+    assert(area->gc_pool_start >= area->gc_finaliser_table_start + gc_finaliser_table_byte_len);
 #endif
 
     // clear ATBs
-    memset(MP_STATE_MEM(gc_alloc_table_start), 0, MP_STATE_MEM(gc_alloc_table_byte_len));
+    memset(area->gc_alloc_table_start, 0, area->gc_alloc_table_byte_len);
 
 #if MICROPY_ENABLE_FINALISER
     // clear FTBs
-    memset(MP_STATE_MEM(gc_finaliser_table_start), 0, gc_finaliser_table_byte_len);
+    memset(area->gc_finaliser_table_start, 0, gc_finaliser_table_byte_len);
 #endif
 
     // set last free ATB index to start of heap
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
+    area->gc_last_free_atb_index = 0;
+
+    #if MICROPY_GC_SPLIT_HEAP
+    area->next = NULL;
+    #endif
+
+    DEBUG_printf("GC layout:\n");
+    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_alloc_table_start, area->gc_alloc_table_byte_len, area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
+#if MICROPY_ENABLE_FINALISER
+    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_finaliser_table_start, gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
+#endif
+    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_pool_start, gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
+}
+
+#if MICROPY_GC_FREE_LISTS
+STATIC void gc_free_list_clear(void) {
+    memset(MP_STATE_MEM(gc_free_list), 0, sizeof(MP_STATE_MEM(gc_free_list)));
+    memset(MP_STATE_MEM(gc_free_list_len), 0, sizeof(MP_STATE_MEM(gc_free_list_len)));
+}
+
+// Called by the sweep for an unmarked head.  If it's a small tuple, or a
+// str/bytes with its data inline, and its free list has room, then it goes
+// on the list and stays allocated.  Other objects could only be mistaken for
+// these if their first word points to one of the types, and then it's still
+// a dead run of blocks of the right size.
+STATIC bool gc_free_list_keep(mp_state_mem_area_t *area, size_t block) {
+    size_t n_blocks = 1;
+    size_t end_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    while (block + n_blocks < end_block && ATB_GET_KIND(area, block + n_blocks) == AT_TAIL) {
+        if (++n_blocks > GC_FREE_LIST_MAX_BLOCKS) {
+            return false;
+        }
+    }
+
+    mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(area, block);
+    unsigned int kind;
+    if (obj->type == &mp_type_tuple || obj->type == &mp_type_attrtuple) {
+        kind = GC_FREE_LIST_TUPLE;
+    } else if ((obj->type == &mp_type_str || obj->type == &mp_type_bytes)
+        && ((mp_obj_str_t*)obj)->data == (const byte*)((mp_obj_str_t*)obj + 1)) {
+        kind = GC_FREE_LIST_STR;
+    } else {
+        return false;
+    }
+
+    uint16_t *len = &MP_STATE_MEM(gc_free_list_len)[kind][n_blocks - 1];
+    if (*len >= MICROPY_GC_FREE_LISTS) {
+        return false;
+    }
+    void **head = &MP_STATE_MEM(gc_free_list)[kind][n_blocks - 1];
+    *(void**)obj = *head;
+    *head = obj;
+    *len += 1;
+    return true;
+}
+#endif
+
+void gc_init(void *start, void *end) {
+    // the first area is the default one for allocations
+    gc_setup_area(&MP_STATE_MEM(area), start, end);
 
     // unlock the GC
     MP_STATE_MEM(gc_lock_depth) = 0;
@@ -155,6 +248,38 @@ void gc_init(void *start, void *end) {
     // allow auto collection
     MP_STATE_MEM(gc_auto_collect_enabled) = 1;
 
+    #if MICROPY_GC_SPLIT_HEAP
+    MP_STATE_MEM(gc_split_strict) = 0;
+    #endif
+
+    #if MICROPY_GC_INCREMENTAL_SWEEP
+    // nothing to sweep yet
+    MP_STATE_MEM(gc_sweep_area) = NULL;
+    MP_STATE_MEM(gc_sweep_deferred) = 0;
+    #endif
+
+    #if MICROPY_GC_PAUSE_HISTOGRAM
+    memset(MP_STATE_MEM(gc_pause_hist), 0, sizeof(MP_STATE_MEM(gc_pause_hist)));
+    #endif
+
+    #if MICROPY_GC_STATS
+    gc_stats_clear();
+    #endif
+
+    #if MICROPY_GC_FREE_LISTS
+    gc_free_list_clear();
+    #endif
+
+    #if MICROPY_GC_RESERVE
+    // the first allocations fill it
+    memset(MP_STATE_MEM(gc_reserve), 0, sizeof(MP_STATE_MEM(gc_reserve)));
+    MP_STATE_MEM(gc_reserve_len) = 0;
+    MP_STATE_MEM(gc_reserve_target) = MICROPY_GC_RESERVE;
+    MP_STATE_MEM(gc_reserve_depth) = 0;
+    MP_STATE_MEM(gc_reserve_refill) = 1;
+    MP_STATE_MEM(gc_reserve_taken) = 0;
+    #endif
+
     #if MICROPY_GC_ALLOC_THRESHOLD
     // by default, maxuint for gc threshold, effectively turning gc-by-threshold off
     MP_STATE_MEM(gc_alloc_threshold) = (size_t)-1;
@@ -164,14 +289,32 @@ void gc_init(void *start, void *end) {
     #if MICROPY_PY_THREAD
     mp_thread_mutex_init(&MP_STATE_MEM(gc_mutex));
     #endif
+}
 
-    DEBUG_printf("GC layout:\n");
-    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_alloc_table_start), MP_STATE_MEM(gc_alloc_table_byte_len), MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
-#if MICROPY_ENABLE_FINALISER
-    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_finaliser_table_start), gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
-#endif
-    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_pool_start), gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
+#if MICROPY_GC_SPLIT_HEAP
+void gc_add(void *start, void *end) {
+    // the area descriptor is kept at the start of the memory it describes
+    mp_state_mem_area_t *area = (mp_state_mem_area_t*)start;
+    start = (byte*)start + sizeof(mp_state_mem_area_t);
+
+    gc_setup_area(area, start, end);
+
+    // the new area goes last, so that it is searched last by default
+    GC_ENTER();
+    mp_state_mem_area_t *prev = &MP_STATE_MEM(area);
+    while (prev->next != NULL) {
+        prev = prev->next;
+    }
+    prev->next = area;
+    GC_EXIT();
+}
+
+void gc_split_strict(bool strict) {
+    GC_ENTER();
+    MP_STATE_MEM(gc_split_strict) = strict;
+    GC_EXIT();
 }
+#endif
 
 void gc_lock(void) {
     GC_ENTER();
@@ -186,16 +329,26 @@ void gc_unlock(void) {
 }
 
 bool gc_is_locked(void) {
-    return MP_STATE_MEM(gc_lock_depth) != 0;
+    return MP_STATE_MEM(gc_lock_depth) != 0 || MICROPY_GC_CONTEXT_LOCKED();
 }
 
 // ptr should be of type void*
-#define VERIFY_PTR(ptr) ( \
+#define VERIFY_PTR(area, ptr) ( \
         ((uintptr_t)(ptr) & (BYTES_PER_BLOCK - 1)) == 0      /* must be aligned on a block */ \
-        && ptr >= (void*)MP_STATE_MEM(gc_pool_start)     /* must be above start of pool */ \
-        && ptr < (void*)MP_STATE_MEM(gc_pool_end)        /* must be below end of pool */ \
+        && ptr >= (void*)(area)->gc_pool_start     /* must be above start of pool */ \
+        && ptr < (void*)(area)->gc_pool_end        /* must be below end of pool */ \
     )
 
+// returns the area the pointer belongs to, or NULL if it's not a heap pointer
+STATIC inline mp_state_mem_area_t *gc_get_ptr_area(const void *ptr) {
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        if (VERIFY_PTR(area, ptr)) {
+            return area;
+        }
+    }
+    return NULL;
+}
+
 #ifndef TRACE_MARK
 #if DEBUG_PRINT
 #define TRACE_MARK(block, ptr) DEBUG_printf("gc_mark(%p)\n", ptr)
@@ -208,7 +361,7 @@ bool gc_is_locked(void) {
 // children: mark the unmarked child blocks and put those newly marked
 // blocks on the stack. When all children have been checked, pop off the
 // topmost block on the stack and repeat with that one.
-STATIC void gc_mark_subtree(size_t block) {
+STATIC void gc_mark_subtree(mp_state_mem_area_t *area, size_t block) {
     // Start with the block passed in the argument.
     size_t sp = 0;
     for (;;) {
@@ -216,20 +369,24 @@ STATIC void gc_mark_subtree(size_t block) {
         size_t n_blocks = 0;
         do {
             n_blocks += 1;
-        } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
+        } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
 
         // check this block's children
-        void **ptrs = (void**)PTR_FROM_BLOCK(block);
+        void **ptrs = (void**)PTR_FROM_BLOCK(area, block);
         for (size_t i = n_blocks * BYTES_PER_BLOCK / sizeof(void*); i > 0; i--, ptrs++) {
             void *ptr = *ptrs;
-            if (VERIFY_PTR(ptr)) {
+            mp_state_mem_area_t *ptr_area = gc_get_ptr_area(ptr);
+            if (ptr_area != NULL) {
                 // Mark and push this pointer
-                size_t childblock = BLOCK_FROM_PTR(ptr);
-                if (ATB_GET_KIND(childblock) == AT_HEAD) {
+                size_t childblock = BLOCK_FROM_PTR(ptr_area, ptr);
+                if (ATB_GET_KIND(ptr_area, childblock) == AT_HEAD) {
                     // an unmarked head, mark it, and push it on gc stack
                     TRACE_MARK(childblock, ptr);
-                    ATB_HEAD_TO_MARK(childblock);
+                    ATB_HEAD_TO_MARK(ptr_area, childblock);
                     if (sp < MICROPY_ALLOC_GC_STACK_SIZE) {
+                        #if MICROPY_GC_SPLIT_HEAP
+                        MP_STATE_MEM(gc_area_stack)[sp] = ptr_area;
+                        #endif
                         MP_STATE_MEM(gc_stack)[sp++] = childblock;
                     } else {
                         MP_STATE_MEM(gc_stack_overflow) = 1;
@@ -245,6 +402,9 @@ STATIC void gc_mark_subtree(size_t block) {
 
         // pop the next block off the stack
         block = MP_STATE_MEM(gc_stack)[--sp];
+        #if MICROPY_GC_SPLIT_HEAP
+        area = MP_STATE_MEM(gc_area_stack)[sp];
+        #endif
     }
 }
 
@@ -253,27 +413,40 @@ STATIC void gc_deal_with_stack_overflow(void) {
         MP_STATE_MEM(gc_stack_overflow) = 0;
 
         // scan entire memory looking for blocks which have been marked but not their children
-        for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-            // trace (again) if mark bit set
-            if (ATB_GET_KIND(block) == AT_MARK) {
-                gc_mark_subtree(block);
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            for (size_t block = 0; block < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB; block++) {
+                // trace (again) if mark bit set
+                if (ATB_GET_KIND(area, block) == AT_MARK) {
+                    gc_mark_subtree(area, block);
+                }
             }
         }
     }
 }
 
-STATIC void gc_sweep(void) {
-    #if MICROPY_PY_GC_COLLECT_RETVAL
-    MP_STATE_MEM(gc_collected) = 0;
-    #endif
-    // free unmarked heads and their tails
+// Frees the unmarked heads of the area, with their tails, and unmarks the
+// marked ones, starting from the given block.  If budget isn't NULL it stops
+// at the first head or free block once *budget blocks have been swept, so it
+// never stops in the middle of a chain.  Returns the block it stopped at.
+STATIC size_t gc_sweep_area(mp_state_mem_area_t *area, size_t block, size_t *budget) {
+    // a sweep can't stop at a tail, so if it starts at one then it's been
+    // added by gc_realloc to a live chain that has already been swept
     int free_tail = 0;
-    for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-        switch (ATB_GET_KIND(block)) {
+    for (; block < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB; block++) {
+        size_t kind = ATB_GET_KIND(area, block);
+        if (budget != NULL) {
+            if (*budget == 0 && kind != AT_TAIL) {
+                break;
+            }
+            if (*budget > 0) {
+                *budget -= 1;
+            }
+        }
+        switch (kind) {
             case AT_HEAD:
 #if MICROPY_ENABLE_FINALISER
-                if (FTB_GET(block)) {
-                    mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(block);
+                if (FTB_GET(area, block)) {
+                    mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(area, block);
                     if (obj->type != NULL) {
                         // if the object has a type then see if it has a __del__ method
                         mp_obj_t dest[2];
@@ -290,11 +463,24 @@ STATIC void gc_sweep(void) {
                         }
                     }
                     // clear finaliser flag
-                    FTB_CLEAR(block);
+                    FTB_CLEAR(area, block);
                 }
 #endif
+                #if MICROPY_GC_FREE_LISTS
+                if (gc_free_list_keep(area, block)) {
+                    // the object stays allocated, with its tails
+                    free_tail = 0;
+                    break;
+                }
+                #endif
                 free_tail = 1;
-                DEBUG_printf("gc_sweep(%p)\n", PTR_FROM_BLOCK(block));
+                #if MICROPY_GC_INCREMENTAL_SWEEP
+                // allocations done while the sweep is pending may be past this block
+                if (block / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+                    area->gc_last_free_atb_index = block / BLOCKS_PER_ATB;
+                }
+                #endif
+                DEBUG_printf("gc_sweep(%p)\n", PTR_FROM_BLOCK(area, block));
                 #if MICROPY_PY_GC_COLLECT_RETVAL
                 MP_STATE_MEM(gc_collected)++;
                 #endif
@@ -302,24 +488,114 @@ STATIC void gc_sweep(void) {
 
             case AT_TAIL:
                 if (free_tail) {
-                    ATB_ANY_TO_FREE(block);
+                    ATB_ANY_TO_FREE(area, block);
                     #if CLEAR_ON_SWEEP
-                    memset((void*)PTR_FROM_BLOCK(block), 0, BYTES_PER_BLOCK);
+                    memset((void*)PTR_FROM_BLOCK(area, block), 0, BYTES_PER_BLOCK);
                     #endif
                 }
                 break;
 
             case AT_MARK:
-                ATB_MARK_TO_HEAD(block);
+                ATB_MARK_TO_HEAD(area, block);
                 free_tail = 0;
                 break;
         }
     }
+    return block;
+}
+
+STATIC void gc_sweep(void) {
+    #if MICROPY_PY_GC_COLLECT_RETVAL
+    MP_STATE_MEM(gc_collected) = 0;
+    #endif
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        gc_sweep_area(area, 0, NULL);
+    }
+}
+
+#if MICROPY_GC_INCREMENTAL_SWEEP
+// Carries on with the pending sweep for about n_blocks blocks, must be called
+// with the GC locked.  Returns true if there is still some left to sweep.
+STATIC bool gc_sweep_continue(size_t n_blocks) {
+    mp_state_mem_area_t *area = MP_STATE_MEM(gc_sweep_area);
+    size_t block = MP_STATE_MEM(gc_sweep_block);
+    while (area != NULL) {
+        block = gc_sweep_area(area, block, &n_blocks);
+        if (block < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB) {
+            break;
+        }
+        area = NEXT_AREA(area);
+        block = 0;
+    }
+    MP_STATE_MEM(gc_sweep_area) = area;
+    MP_STATE_MEM(gc_sweep_block) = block;
+    return area != NULL;
 }
 
+// returns true if the pending sweep hasn't reached the block yet
+STATIC bool gc_sweep_is_pending(mp_state_mem_area_t *area, size_t block) {
+    mp_state_mem_area_t *sweep_area = MP_STATE_MEM(gc_sweep_area);
+    if (sweep_area == NULL) {
+        return false;
+    }
+    if (area == sweep_area) {
+        return block >= MP_STATE_MEM(gc_sweep_block);
+    }
+    for (mp_state_mem_area_t *a = NEXT_AREA(sweep_area); a != NULL; a = NEXT_AREA(a)) {
+        if (a == area) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool gc_sweep_step(size_t n_blocks) {
+    GC_ENTER();
+    bool pending = MP_STATE_MEM(gc_sweep_area) != NULL;
+    if (pending && MP_STATE_MEM(gc_lock_depth) == 0) {
+        MP_STATE_MEM(gc_lock_depth)++;
+        pending = gc_sweep_continue(n_blocks);
+        MP_STATE_MEM(gc_lock_depth)--;
+    }
+    GC_EXIT();
+    return pending;
+}
+#endif
+
+#if GC_PAUSE_TIMING
+STATIC void gc_pause_record(mp_uint_t us) {
+    #if MICROPY_GC_PAUSE_HISTOGRAM
+    size_t bucket = 0;
+    for (mp_uint_t ms = us / 1000; ms > 0 && bucket < MICROPY_GC_PAUSE_HISTOGRAM - 1; ms >>= 1) {
+        bucket++;
+    }
+    MP_STATE_MEM(gc_pause_hist)[bucket]++;
+    #endif
+    #if MICROPY_GC_STATS
+    MP_STATE_MEM(gc_stats_collections)++;
+    MP_STATE_MEM(gc_stats_pause_total_us) += us;
+    if (us > MP_STATE_MEM(gc_stats_pause_max_us)) {
+        MP_STATE_MEM(gc_stats_pause_max_us) = us;
+    }
+    #endif
+}
+#endif
+
 void gc_collect_start(void) {
     GC_ENTER();
+    #if GC_PAUSE_TIMING
+    MP_STATE_MEM(gc_pause_start) = mp_hal_ticks_us();
+    #endif
     MP_STATE_MEM(gc_lock_depth)++;
+    #if MICROPY_GC_INCREMENTAL_SWEEP
+    // the marks can only be set once the previous sweep has cleared them
+    gc_sweep_continue(SIZE_MAX);
+    #endif
+    #if MICROPY_GC_FREE_LISTS
+    // what's left on the lists is unreachable, so this sweep frees it or
+    // puts it back
+    gc_free_list_clear();
+    #endif
     #if MICROPY_GC_ALLOC_THRESHOLD
     MP_STATE_MEM(gc_alloc_amount) = 0;
     #endif
@@ -333,6 +609,10 @@ void gc_collect_start(void) {
     size_t root_end = offsetof(mp_state_ctx_t, vm.qstr_last_chunk);
     gc_collect_root(ptrs + root_start / sizeof(void*), (root_end - root_start) / sizeof(void*));
 
+    #if MICROPY_GC_RESERVE
+    gc_collect_root(MP_STATE_MEM(gc_reserve), MP_STATE_MEM(gc_reserve_len));
+    #endif
+
     #if MICROPY_ENABLE_PYSTACK
     // Trace root pointers from the Python stack.
     ptrs = (void**)(void*)MP_STATE_THREAD(pystack_start);
@@ -343,13 +623,14 @@ void gc_collect_start(void) {
 void gc_collect_root(void **ptrs, size_t len) {
     for (size_t i = 0; i < len; i++) {
         void *ptr = ptrs[i];
-        if (VERIFY_PTR(ptr)) {
-            size_t block = BLOCK_FROM_PTR(ptr);
-            if (ATB_GET_KIND(block) == AT_HEAD) {
+        mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+        if (area != NULL) {
+            size_t block = BLOCK_FROM_PTR(area, ptr);
+            if (ATB_GET_KIND(area, block) == AT_HEAD) {
                 // An unmarked head: mark it, and mark all its children
                 TRACE_MARK(block, ptr);
-                ATB_HEAD_TO_MARK(block);
-                gc_mark_subtree(block);
+                ATB_HEAD_TO_MARK(area, block);
+                gc_mark_subtree(area, block);
             }
         }
     }
@@ -357,61 +638,92 @@ void gc_collect_root(void **ptrs, size_t len) {
 
 void gc_collect_end(void) {
     gc_deal_with_stack_overflow();
-    gc_sweep();
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
+    #if MICROPY_GC_INCREMENTAL_SWEEP
+    if (MP_STATE_MEM(gc_sweep_deferred)) {
+        // leave the sweep to gc_sweep_step() and to the following allocations
+        #if MICROPY_PY_GC_COLLECT_RETVAL
+        MP_STATE_MEM(gc_collected) = 0;
+        #endif
+        MP_STATE_MEM(gc_sweep_area) = &MP_STATE_MEM(area);
+        MP_STATE_MEM(gc_sweep_block) = 0;
+    } else
+    #endif
+    {
+        gc_sweep();
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            area->gc_last_free_atb_index = 0;
+        }
+    }
+    #if MICROPY_GC_RESERVE
+    MP_STATE_MEM(gc_reserve_refill) = 1;
+    #endif
     MP_STATE_MEM(gc_lock_depth)--;
+    #if GC_PAUSE_TIMING
+    gc_pause_record(mp_hal_ticks_us() - MP_STATE_MEM(gc_pause_start));
+    #endif
     GC_EXIT();
 }
 
 void gc_sweep_all(void) {
     GC_ENTER();
+    #if GC_PAUSE_TIMING
+    MP_STATE_MEM(gc_pause_start) = mp_hal_ticks_us();
+    #endif
     MP_STATE_MEM(gc_lock_depth)++;
     MP_STATE_MEM(gc_stack_overflow) = 0;
+    #if MICROPY_GC_INCREMENTAL_SWEEP
+    // unmark the live blocks left by a pending sweep so that they are freed too
+    gc_sweep_continue(SIZE_MAX);
+    #endif
+    #if MICROPY_GC_FREE_LISTS
+    gc_free_list_clear();
+    #endif
     gc_collect_end();
 }
 
-void gc_info(gc_info_t *info) {
-    GC_ENTER();
-    info->total = MP_STATE_MEM(gc_pool_end) - MP_STATE_MEM(gc_pool_start);
-    info->used = 0;
-    info->free = 0;
-    info->max_free = 0;
-    info->num_1block = 0;
-    info->num_2block = 0;
-    info->max_block = 0;
+// adds the usage of one area to info, the counters must have been initialised
+STATIC void gc_info_area(mp_state_mem_area_t *area, gc_info_t *info) {
+    info->total += area->gc_pool_end - area->gc_pool_start;
+    size_t used = 0;
+    size_t free = 0;
     bool finish = false;
     for (size_t block = 0, len = 0, len_free = 0; !finish;) {
-        size_t kind = ATB_GET_KIND(block);
+        size_t kind = ATB_GET_KIND(area, block);
         switch (kind) {
             case AT_FREE:
-                info->free += 1;
+                free += 1;
                 len_free += 1;
                 len = 0;
                 break;
 
+            #if MICROPY_GC_INCREMENTAL_SWEEP
+            case AT_MARK:
+            #endif
             case AT_HEAD:
-                info->used += 1;
+                used += 1;
                 len = 1;
                 break;
 
             case AT_TAIL:
-                info->used += 1;
+                used += 1;
                 len += 1;
                 break;
 
+            #if !MICROPY_GC_INCREMENTAL_SWEEP
             case AT_MARK:
                 // shouldn't happen
                 break;
+            #endif
         }
 
         block++;
-        finish = (block == MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
+        finish = (block == area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
         // Get next block type if possible
         if (!finish) {
-            kind = ATB_GET_KIND(block);
+            kind = ATB_GET_KIND(area, block);
         }
 
-        if (finish || kind == AT_FREE || kind == AT_HEAD) {
+        if (finish || kind != AT_TAIL) {
             if (len == 1) {
                 info->num_1block += 1;
             } else if (len == 2) {
@@ -420,7 +732,7 @@ void gc_info(gc_info_t *info) {
             if (len > info->max_block) {
                 info->max_block = len;
             }
-            if (finish || kind == AT_HEAD) {
+            if (finish || kind != AT_FREE) {
                 if (len_free > info->max_free) {
                     info->max_free = len_free;
                 }
@@ -429,11 +741,143 @@ void gc_info(gc_info_t *info) {
         }
     }
 
-    info->used *= BYTES_PER_BLOCK;
-    info->free *= BYTES_PER_BLOCK;
+    info->used += used * BYTES_PER_BLOCK;
+    info->free += free * BYTES_PER_BLOCK;
+}
+
+STATIC void gc_info_clear(gc_info_t *info) {
+    info->total = 0;
+    info->used = 0;
+    info->free = 0;
+    info->max_free = 0;
+    info->num_1block = 0;
+    info->num_2block = 0;
+    info->max_block = 0;
+}
+
+void gc_info(gc_info_t *info) {
+    GC_ENTER();
+    gc_info_clear(info);
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        gc_info_area(area, info);
+    }
     GC_EXIT();
 }
 
+#if MICROPY_GC_STATS
+void gc_stats_clear(void) {
+    memset(MP_STATE_MEM(gc_stats_allocs), 0, sizeof(MP_STATE_MEM(gc_stats_allocs)));
+    memset(MP_STATE_MEM(gc_stats_bytes), 0, sizeof(MP_STATE_MEM(gc_stats_bytes)));
+    MP_STATE_MEM(gc_stats_collections) = 0;
+    MP_STATE_MEM(gc_stats_pause_total_us) = 0;
+    MP_STATE_MEM(gc_stats_pause_max_us) = 0;
+    #if MICROPY_GC_FREE_LISTS
+    memset(MP_STATE_MEM(gc_stats_free_list_hits), 0, sizeof(MP_STATE_MEM(gc_stats_free_list_hits)));
+    memset(MP_STATE_MEM(gc_stats_free_list_misses), 0, sizeof(MP_STATE_MEM(gc_stats_free_list_misses)));
+    #endif
+    #if MICROPY_GC_STATS_CALLERS
+    memset(MP_STATE_MEM(gc_stats_callers), 0, sizeof(MP_STATE_MEM(gc_stats_callers)));
+    #endif
+}
+
+#if MICROPY_GC_STATS_CALLERS
+// Counts the allocation for the bytecode position.  A position not in the table
+// yet replaces the one with the lowest count and carries on from that count, so
+// that the positions allocating the most stay in the table.  The source position
+// is only decoded then, while the bytecode is known to be alive.
+STATIC void gc_stats_caller(const mp_code_state_t *code_state, size_t n_bytes) {
+    mp_gc_stats_caller_t *callers = MP_STATE_MEM(gc_stats_callers);
+    mp_gc_stats_caller_t *caller = &callers[0];
+    for (size_t i = 0; i < MICROPY_GC_STATS_CALLERS; i++) {
+        if (callers[i].ip == code_state->ip) {
+            caller = &callers[i];
+            goto found;
+        }
+        if (callers[i].count < caller->count) {
+            caller = &callers[i];
+        }
+    }
+    caller->ip = code_state->ip;
+    mp_bytecode_get_source_pos(code_state, &caller->source_file, &caller->source_line, &caller->block_name);
+found:
+    caller->count += 1;
+    caller->bytes += n_bytes;
+}
+#endif
+
+STATIC void gc_stats_alloc(size_t n_bytes, size_t n_blocks) {
+    size_t size_class = 0;
+    for (size_t n = n_blocks - 1; n > 0 && size_class < MP_GC_STATS_SIZE_CLASSES - 1; n >>= 1) {
+        size_class++;
+    }
+    MP_STATE_MEM(gc_stats_allocs)[size_class]++;
+    MP_STATE_MEM(gc_stats_bytes)[size_class] += n_bytes;
+    #if MICROPY_GC_STATS_CALLERS
+    const mp_code_state_t *code_state = MP_STATE_THREAD(current_code_state);
+    if (code_state != NULL) {
+        gc_stats_caller(code_state, n_bytes);
+    }
+    #endif
+}
+#endif
+
+#if MICROPY_GC_RESERVE
+// returns a block of the reserve if it fits, the lock must be held
+STATIC void *gc_reserve_take(size_t n_bytes, unsigned int alloc_flags) {
+    if (n_bytes > MICROPY_GC_RESERVE_BYTES || (alloc_flags & GC_ALLOC_FLAG_HAS_FINALISER)
+        || MP_STATE_MEM(gc_reserve_len) == 0) {
+        return NULL;
+    }
+    // it's as gc_alloc() left it, the bytes after n_bytes are still cleared
+    void *ptr = MP_STATE_MEM(gc_reserve)[--MP_STATE_MEM(gc_reserve_len)];
+    MP_STATE_MEM(gc_reserve)[MP_STATE_MEM(gc_reserve_len)] = NULL;
+    MP_STATE_MEM(gc_reserve_taken)++;
+    MP_STATE_MEM(gc_reserve_refill) = 1;
+    return ptr;
+}
+
+// allocates the missing blocks of the reserve, as long as there's room
+// without collecting
+STATIC void gc_reserve_fill(void) {
+    MP_STATE_MEM(gc_reserve_refill) = 0;
+    uint16_t auto_collect = MP_STATE_MEM(gc_auto_collect_enabled);
+    MP_STATE_MEM(gc_auto_collect_enabled) = 0;
+    while (MP_STATE_MEM(gc_reserve_len) < MP_STATE_MEM(gc_reserve_target)) {
+        void *ptr = gc_alloc(MICROPY_GC_RESERVE_BYTES, 0);
+        if (ptr == NULL) {
+            break;
+        }
+        MP_STATE_MEM(gc_reserve)[MP_STATE_MEM(gc_reserve_len)++] = ptr;
+    }
+    MP_STATE_MEM(gc_auto_collect_enabled) = auto_collect;
+}
+
+void gc_reserve_begin(void) {
+    GC_ENTER();
+    MP_STATE_MEM(gc_reserve_depth)++;
+    GC_EXIT();
+}
+
+void gc_reserve_end(void) {
+    GC_ENTER();
+    if (MP_STATE_MEM(gc_reserve_depth) > 0) {
+        MP_STATE_MEM(gc_reserve_depth)--;
+    }
+    GC_EXIT();
+}
+
+void gc_reserve_set(size_t n) {
+    GC_ENTER();
+    MP_STATE_MEM(gc_reserve_target) = MIN(n, MICROPY_GC_RESERVE);
+    // the blocks dropped are freed by the next collection
+    while (MP_STATE_MEM(gc_reserve_len) > MP_STATE_MEM(gc_reserve_target)) {
+        MP_STATE_MEM(gc_reserve)[--MP_STATE_MEM(gc_reserve_len)] = NULL;
+    }
+    MP_STATE_MEM(gc_reserve_refill) = 1;
+    GC_EXIT();
+}
+#endif
+
 void *gc_alloc(size_t n_bytes, unsigned int alloc_flags) {
     bool has_finaliser = alloc_flags & GC_ALLOC_FLAG_HAS_FINALISER;
     size_t n_blocks = ((n_bytes + BYTES_PER_BLOCK - 1) & (~(BYTES_PER_BLOCK - 1))) / BYTES_PER_BLOCK;
@@ -444,24 +888,64 @@ void *gc_alloc(size_t n_bytes, unsigned int alloc_flags) {
         return NULL;
     }
 
+    #if MICROPY_GC_RESERVE
+    // the flag is only a hint, so it can be read before taking the lock
+    if (MP_STATE_MEM(gc_reserve_refill) && !GC_RESERVING()
+        && MP_STATE_MEM(gc_lock_depth) == 0 && !MICROPY_GC_CONTEXT_LOCKED()) {
+        gc_reserve_fill();
+    }
+    #endif
+
     GC_ENTER();
 
     // check if GC is locked
-    if (MP_STATE_MEM(gc_lock_depth) > 0) {
+    if (MP_STATE_MEM(gc_lock_depth) > 0 || MICROPY_GC_CONTEXT_LOCKED()) {
+        void *ptr = NULL;
+        #if MICROPY_GC_RESERVE
+        if (GC_RESERVING() && !MICROPY_GC_CONTEXT_LOCKED()) {
+            ptr = gc_reserve_take(n_bytes, alloc_flags);
+        }
+        #endif
         GC_EXIT();
-        return NULL;
+        return ptr;
+    }
+
+    #if MICROPY_GC_INCREMENTAL_SWEEP
+    // every allocation takes its share of a pending sweep
+    if (MP_STATE_MEM(gc_sweep_area) != NULL) {
+        MP_STATE_MEM(gc_lock_depth)++;
+        gc_sweep_continue(MICROPY_GC_SWEEP_STEP_BLOCKS);
+        MP_STATE_MEM(gc_lock_depth)--;
     }
+    #endif
 
+    mp_state_mem_area_t *area;
+    mp_state_mem_area_t *first_area = &MP_STATE_MEM(area);
     size_t i;
     size_t end_block;
     size_t start_block;
     size_t n_free;
     int collected = !MP_STATE_MEM(gc_auto_collect_enabled);
 
+    #if MICROPY_GC_SPLIT_HEAP && MICROPY_GC_SPLIT_HEAP_LARGE_ALLOC
+    // keep the first area for small objects, large ones are looked for in the other areas first
+    if (n_bytes >= MICROPY_GC_SPLIT_HEAP_LARGE_ALLOC && first_area->next != NULL) {
+        first_area = first_area->next;
+    }
+    #endif
+
     #if MICROPY_GC_ALLOC_THRESHOLD
-    if (!collected && MP_STATE_MEM(gc_alloc_amount) >= MP_STATE_MEM(gc_alloc_threshold)) {
+    // no collection is started by the threshold while an event is delivered
+    if (!collected && !GC_RESERVING() && MP_STATE_MEM(gc_alloc_amount) >= MP_STATE_MEM(gc_alloc_threshold)) {
         GC_EXIT();
+        #if MICROPY_GC_INCREMENTAL_SWEEP
+        // there's still free memory, so the sweep doesn't have to be done now
+        MP_STATE_MEM(gc_sweep_deferred) = 1;
         gc_collect();
+        MP_STATE_MEM(gc_sweep_deferred) = 0;
+        #else
+        gc_collect();
+        #endif
         collected = 1;
         GC_ENTER();
     }
@@ -469,15 +953,50 @@ void *gc_alloc(size_t n_bytes, unsigned int alloc_flags) {
 
     for (;;) {
 
-        // look for a run of n_blocks available blocks
-        n_free = 0;
-        for (i = MP_STATE_MEM(gc_last_free_atb_index); i < MP_STATE_MEM(gc_alloc_table_byte_len); i++) {
-            byte a = MP_STATE_MEM(gc_alloc_table_start)[i];
-            if (ATB_0_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
-            if (ATB_1_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
-            if (ATB_2_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
-            if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
+        // look for a run of n_blocks available blocks, going through all the
+        // areas starting with the preferred one
+        area = first_area;
+        do {
+            n_free = 0;
+            for (i = area->gc_last_free_atb_index; i < area->gc_alloc_table_byte_len; i++) {
+                byte a = area->gc_alloc_table_start[i];
+                if (ATB_0_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
+                if (ATB_1_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
+                if (ATB_2_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
+                if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
+            }
+            #if MICROPY_GC_SPLIT_HEAP
+            if (MP_STATE_MEM(gc_split_strict) && !collected && !GC_RESERVING()) {
+                // try to make room in the preferred area before spilling over
+                break;
+            }
+            #endif
+            area = NEXT_AREA(area);
+            if (area == NULL) {
+                area = &MP_STATE_MEM(area);
+            }
+        } while (area != first_area);
+
+        #if MICROPY_GC_INCREMENTAL_SWEEP
+        if (MP_STATE_MEM(gc_sweep_area) != NULL) {
+            // finish the pending sweep before giving up or collecting again
+            MP_STATE_MEM(gc_lock_depth)++;
+            gc_sweep_continue(SIZE_MAX);
+            MP_STATE_MEM(gc_lock_depth)--;
+            continue;
         }
+        #endif
+
+        #if MICROPY_GC_RESERVE
+        if (GC_RESERVING()) {
+            // rather than collecting now, in the middle of delivering an event
+            void *ptr = gc_reserve_take(n_bytes, alloc_flags);
+            if (ptr != NULL) {
+                GC_EXIT();
+                return ptr;
+            }
+        }
+        #endif
 
         GC_EXIT();
         // nothing found!
@@ -502,27 +1021,38 @@ found:
     // before this one.  Also, whenever we free or shink a block we must check
     // if this index needs adjusting (see gc_realloc and gc_free).
     if (n_free == 1) {
-        MP_STATE_MEM(gc_last_free_atb_index) = (i + 1) / BLOCKS_PER_ATB;
+        area->gc_last_free_atb_index = (i + 1) / BLOCKS_PER_ATB;
     }
 
     // mark first block as used head
-    ATB_FREE_TO_HEAD(start_block);
+    ATB_FREE_TO_HEAD(area, start_block);
+
+    #if MICROPY_GC_INCREMENTAL_SWEEP
+    // the pending sweep keeps the block only if it's marked like the other live ones
+    if (gc_sweep_is_pending(area, start_block)) {
+        ATB_HEAD_TO_MARK(area, start_block);
+    }
+    #endif
 
     // mark rest of blocks as used tail
     // TODO for a run of many blocks can make this more efficient
     for (size_t bl = start_block + 1; bl <= end_block; bl++) {
-        ATB_FREE_TO_TAIL(bl);
+        ATB_FREE_TO_TAIL(area, bl);
     }
 
     // get pointer to first block
     // we must create this pointer before unlocking the GC so a collection can find it
-    void *ret_ptr = (void*)(MP_STATE_MEM(gc_pool_start) + start_block * BYTES_PER_BLOCK);
+    void *ret_ptr = (void*)(area->gc_pool_start + start_block * BYTES_PER_BLOCK);
     DEBUG_printf("gc_alloc(%p)\n", ret_ptr);
 
     #if MICROPY_GC_ALLOC_THRESHOLD
     MP_STATE_MEM(gc_alloc_amount) += n_blocks;
     #endif
 
+    #if MICROPY_GC_STATS
+    gc_stats_alloc(n_bytes, n_blocks);
+    #endif
+
     GC_EXIT();
 
     #if MICROPY_GC_CONSERVATIVE_CLEAR
@@ -543,7 +1073,7 @@ found:
         ((mp_obj_base_t*)ret_ptr)->type = NULL;
         // set mp_obj flag only if it has a finaliser
         GC_ENTER();
-        FTB_SET(start_block);
+        FTB_SET(area, start_block);
         GC_EXIT();
     }
     #else
@@ -557,6 +1087,40 @@ found:
     return ret_ptr;
 }
 
+#if MICROPY_GC_FREE_LISTS
+void *gc_free_list_alloc(unsigned int kind, size_t n_bytes) {
+    size_t n_blocks = (n_bytes + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK;
+    if (n_blocks == 0 || n_blocks > GC_FREE_LIST_MAX_BLOCKS) {
+        return NULL;
+    }
+
+    GC_ENTER();
+    if (MP_STATE_MEM(gc_lock_depth) > 0 || MICROPY_GC_CONTEXT_LOCKED()) {
+        GC_EXIT();
+        return NULL;
+    }
+    void **head = &MP_STATE_MEM(gc_free_list)[kind][n_blocks - 1];
+    void *ptr = *head;
+    if (ptr != NULL) {
+        *head = *(void**)ptr;
+        MP_STATE_MEM(gc_free_list_len)[kind][n_blocks - 1] -= 1;
+    }
+    #if MICROPY_GC_STATS
+    if (ptr != NULL) {
+        MP_STATE_MEM(gc_stats_free_list_hits)[kind] += 1;
+    } else {
+        MP_STATE_MEM(gc_stats_free_list_misses)[kind] += 1;
+    }
+    #endif
+    GC_EXIT();
+
+    if (ptr != NULL) {
+        memset(ptr, 0, n_blocks * BYTES_PER_BLOCK);
+    }
+    return ptr;
+}
+#endif
+
 /*
 void *gc_alloc(mp_uint_t n_bytes) {
     return _gc_alloc(n_bytes, false);
@@ -571,7 +1135,7 @@ void *gc_alloc_with_finaliser(mp_uint_t n_bytes) {
 // TODO: freeing here does not call finaliser
 void gc_free(void *ptr) {
     GC_ENTER();
-    if (MP_STATE_MEM(gc_lock_depth) > 0) {
+    if (MP_STATE_MEM(gc_lock_depth) > 0 || MICROPY_GC_CONTEXT_LOCKED()) {
         // TODO how to deal with this error?
         GC_EXIT();
         return;
@@ -583,24 +1147,25 @@ void gc_free(void *ptr) {
         GC_EXIT();
     } else {
         // get the GC block number corresponding to this pointer
-        assert(VERIFY_PTR(ptr));
-        size_t block = BLOCK_FROM_PTR(ptr);
-        assert(ATB_GET_KIND(block) == AT_HEAD);
+        mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+        assert(area != NULL);
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        assert(ATB_IS_HEAD(area, block));
 
         #if MICROPY_ENABLE_FINALISER
-        FTB_CLEAR(block);
+        FTB_CLEAR(area, block);
         #endif
 
         // set the last_free pointer to this block if it's earlier in the heap
-        if (block / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-            MP_STATE_MEM(gc_last_free_atb_index) = block / BLOCKS_PER_ATB;
+        if (block / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+            area->gc_last_free_atb_index = block / BLOCKS_PER_ATB;
         }
 
         // free head and all of its tail blocks
         do {
-            ATB_ANY_TO_FREE(block);
+            ATB_ANY_TO_FREE(area, block);
             block += 1;
-        } while (ATB_GET_KIND(block) == AT_TAIL);
+        } while (ATB_GET_KIND(area, block) == AT_TAIL);
 
         GC_EXIT();
 
@@ -612,14 +1177,15 @@ void gc_free(void *ptr) {
 
 size_t gc_nbytes(const void *ptr) {
     GC_ENTER();
-    if (VERIFY_PTR(ptr)) {
-        size_t block = BLOCK_FROM_PTR(ptr);
-        if (ATB_GET_KIND(block) == AT_HEAD) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area != NULL) {
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        if (ATB_IS_HEAD(area, block)) {
             // work out number of consecutive blocks in the chain starting with this on
             size_t n_blocks = 0;
             do {
                 n_blocks += 1;
-            } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
+            } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
             GC_EXIT();
             return n_blocks * BYTES_PER_BLOCK;
         }
@@ -675,15 +1241,16 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
 
     GC_ENTER();
 
-    if (MP_STATE_MEM(gc_lock_depth) > 0) {
+    if (MP_STATE_MEM(gc_lock_depth) > 0 || MICROPY_GC_CONTEXT_LOCKED()) {
         GC_EXIT();
         return NULL;
     }
 
     // get the GC block number corresponding to this pointer
-    assert(VERIFY_PTR(ptr));
-    size_t block = BLOCK_FROM_PTR(ptr);
-    assert(ATB_GET_KIND(block) == AT_HEAD);
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    assert(area != NULL);
+    size_t block = BLOCK_FROM_PTR(area, ptr);
+    assert(ATB_IS_HEAD(area, block));
 
     // compute number of new blocks that are requested
     size_t new_blocks = (n_bytes + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK;
@@ -696,9 +1263,9 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     // efficiently shrink it (see below for shrinking code).
     size_t n_free   = 0;
     size_t n_blocks = 1; // counting HEAD block
-    size_t max_block = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
+    size_t max_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
     for (size_t bl = block + n_blocks; bl < max_block; bl++) {
-        byte block_type = ATB_GET_KIND(bl);
+        byte block_type = ATB_GET_KIND(area, bl);
         if (block_type == AT_TAIL) {
             n_blocks++;
             continue;
@@ -724,12 +1291,12 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     if (new_blocks < n_blocks) {
         // free unneeded tail blocks
         for (size_t bl = block + new_blocks, count = n_blocks - new_blocks; count > 0; bl++, count--) {
-            ATB_ANY_TO_FREE(bl);
+            ATB_ANY_TO_FREE(area, bl);
         }
 
         // set the last_free pointer to end of this block if it's earlier in the heap
-        if ((block + new_blocks) / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-            MP_STATE_MEM(gc_last_free_atb_index) = (block + new_blocks) / BLOCKS_PER_ATB;
+        if ((block + new_blocks) / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+            area->gc_last_free_atb_index = (block + new_blocks) / BLOCKS_PER_ATB;
         }
 
         GC_EXIT();
@@ -745,8 +1312,8 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     if (new_blocks <= n_blocks + n_free) {
         // mark few more blocks as used tail
         for (size_t bl = block + n_blocks; bl < block + new_blocks; bl++) {
-            assert(ATB_GET_KIND(bl) == AT_FREE);
-            ATB_FREE_TO_TAIL(bl);
+            assert(ATB_GET_KIND(area, bl) == AT_FREE);
+            ATB_FREE_TO_TAIL(area, bl);
         }
 
         GC_EXIT();
@@ -767,7 +1334,7 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     }
 
     #if MICROPY_ENABLE_FINALISER
-    bool ftb_state = FTB_GET(block);
+    bool ftb_state = FTB_GET(area, block);
     #else
     bool ftb_state = false;
     #endif
@@ -801,115 +1368,130 @@ void gc_dump_info(void) {
         (uint)info.total, (uint)info.used, (uint)info.free);
     mp_printf(&mp_plat_print, " No. of 1-blocks: %u, 2-blocks: %u, max blk sz: %u, max free sz: %u\n",
            (uint)info.num_1block, (uint)info.num_2block, (uint)info.max_block, (uint)info.max_free);
+    #if MICROPY_GC_SPLIT_HEAP
+    if (MP_STATE_MEM(area).next != NULL) {
+        size_t n = 0;
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area), n++) {
+            GC_ENTER();
+            gc_info_clear(&info);
+            gc_info_area(area, &info);
+            GC_EXIT();
+            mp_printf(&mp_plat_print, " Area %u at %p: total: %u, used: %u, free: %u, max free sz: %u\n",
+                (uint)n, area->gc_pool_start, (uint)info.total, (uint)info.used, (uint)info.free, (uint)info.max_free);
+        }
+    }
+    #endif
 }
 
 void gc_dump_alloc_table(void) {
     GC_ENTER();
     static const size_t DUMP_BYTES_PER_LINE = 64;
-    #if !EXTENSIVE_HEAP_PROFILING
-    // When comparing heap output we don't want to print the starting
-    // pointer of the heap because it changes from run to run.
-    mp_printf(&mp_plat_print, "GC memory layout; from %p:", MP_STATE_MEM(gc_pool_start));
-    #endif
-    for (size_t bl = 0; bl < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; bl++) {
-        if (bl % DUMP_BYTES_PER_LINE == 0) {
-            // a new line of blocks
-            {
-                // check if this line contains only free blocks
-                size_t bl2 = bl;
-                while (bl2 < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB && ATB_GET_KIND(bl2) == AT_FREE) {
-                    bl2++;
-                }
-                if (bl2 - bl >= 2 * DUMP_BYTES_PER_LINE) {
-                    // there are at least 2 lines containing only free blocks, so abbreviate their printing
-                    mp_printf(&mp_plat_print, "\n       (%u lines all free)", (uint)(bl2 - bl) / DUMP_BYTES_PER_LINE);
-                    bl = bl2 & (~(DUMP_BYTES_PER_LINE - 1));
-                    if (bl >= MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB) {
-                        // got to end of heap
-                        break;
-                    }
-                }
-            }
-            // print header for new line of blocks
-            // (the cast to uint32_t is for 16-bit ports)
-            //mp_printf(&mp_plat_print, "\n%05x: ", (uint)(PTR_FROM_BLOCK(bl) & (uint32_t)0xfffff));
-            mp_printf(&mp_plat_print, "\n%05x: ", (uint)((bl * BYTES_PER_BLOCK) & (uint32_t)0xfffff));
-        }
-        int c = ' ';
-        switch (ATB_GET_KIND(bl)) {
-            case AT_FREE: c = '.'; break;
-            /* this prints out if the object is reachable from BSS or STACK (for unix only)
-            case AT_HEAD: {
-                c = 'h';
-                void **ptrs = (void**)(void*)&mp_state_ctx;
-                mp_uint_t len = offsetof(mp_state_ctx_t, vm.stack_top) / sizeof(mp_uint_t);
-                for (mp_uint_t i = 0; i < len; i++) {
-                    mp_uint_t ptr = (mp_uint_t)ptrs[i];
-                    if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
-                        c = 'B';
-                        break;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        #if !EXTENSIVE_HEAP_PROFILING
+        // When comparing heap output we don't want to print the starting
+        // pointer of the heap because it changes from run to run.
+        mp_printf(&mp_plat_print, "GC memory layout; from %p:", area->gc_pool_start);
+        #endif
+        for (size_t bl = 0; bl < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB; bl++) {
+            if (bl % DUMP_BYTES_PER_LINE == 0) {
+                // a new line of blocks
+                {
+                    // check if this line contains only free blocks
+                    size_t bl2 = bl;
+                    while (bl2 < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB && ATB_GET_KIND(area, bl2) == AT_FREE) {
+                        bl2++;
                     }
-                }
-                if (c == 'h') {
-                    ptrs = (void**)&c;
-                    len = ((mp_uint_t)MP_STATE_THREAD(stack_top) - (mp_uint_t)&c) / sizeof(mp_uint_t);
-                    for (mp_uint_t i = 0; i < len; i++) {
-                        mp_uint_t ptr = (mp_uint_t)ptrs[i];
-                        if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
-                            c = 'S';
+                    if (bl2 - bl >= 2 * DUMP_BYTES_PER_LINE) {
+                        // there are at least 2 lines containing only free blocks, so abbreviate their printing
+                        mp_printf(&mp_plat_print, "\n       (%u lines all free)", (uint)(bl2 - bl) / DUMP_BYTES_PER_LINE);
+                        bl = bl2 & (~(DUMP_BYTES_PER_LINE - 1));
+                        if (bl >= area->gc_alloc_table_byte_len * BLOCKS_PER_ATB) {
+                            // got to end of heap
                             break;
                         }
                     }
                 }
-                break;
+                // print header for new line of blocks
+                // (the cast to uint32_t is for 16-bit ports)
+                //mp_printf(&mp_plat_print, "\n%05x: ", (uint)(PTR_FROM_BLOCK(bl) & (uint32_t)0xfffff));
+                mp_printf(&mp_plat_print, "\n%05x: ", (uint)((bl * BYTES_PER_BLOCK) & (uint32_t)0xfffff));
             }
-            */
-            /* this prints the uPy object type of the head block */
-            case AT_HEAD: {
-                void **ptr = (void**)(MP_STATE_MEM(gc_pool_start) + bl * BYTES_PER_BLOCK);
-                if (*ptr == &mp_type_tuple) { c = 'T'; }
-                else if (*ptr == &mp_type_list) { c = 'L'; }
-                else if (*ptr == &mp_type_dict) { c = 'D'; }
-                else if (*ptr == &mp_type_str || *ptr == &mp_type_bytes) { c = 'S'; }
-                #if MICROPY_PY_BUILTINS_BYTEARRAY
-                else if (*ptr == &mp_type_bytearray) { c = 'A'; }
-                #endif
-                #if MICROPY_PY_ARRAY
-                else if (*ptr == &mp_type_array) { c = 'A'; }
-                #endif
-                #if MICROPY_PY_BUILTINS_FLOAT
-                else if (*ptr == &mp_type_float) { c = 'F'; }
-                #endif
-                else if (*ptr == &mp_type_fun_bc) { c = 'B'; }
-                else if (*ptr == &mp_type_module) { c = 'M'; }
-                else {
+            int c = ' ';
+            switch (ATB_GET_KIND(area, bl)) {
+                case AT_FREE: c = '.'; break;
+                /* this prints out if the object is reachable from BSS or STACK (for unix only)
+                case AT_HEAD: {
                     c = 'h';
-                    #if 0
-                    // This code prints "Q" for qstr-pool data, and "q" for qstr-str
-                    // data.  It can be useful to see how qstrs are being allocated,
-                    // but is disabled by default because it is very slow.
-                    for (qstr_pool_t *pool = MP_STATE_VM(last_pool); c == 'h' && pool != NULL; pool = pool->prev) {
-                        if ((qstr_pool_t*)ptr == pool) {
-                            c = 'Q';
+                    void **ptrs = (void**)(void*)&mp_state_ctx;
+                    mp_uint_t len = offsetof(mp_state_ctx_t, vm.stack_top) / sizeof(mp_uint_t);
+                    for (mp_uint_t i = 0; i < len; i++) {
+                        mp_uint_t ptr = (mp_uint_t)ptrs[i];
+                        if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
+                            c = 'B';
                             break;
                         }
-                        for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
-                            if ((const byte*)ptr == *q) {
-                                c = 'q';
+                    }
+                    if (c == 'h') {
+                        ptrs = (void**)&c;
+                        len = ((mp_uint_t)MP_STATE_THREAD(stack_top) - (mp_uint_t)&c) / sizeof(mp_uint_t);
+                        for (mp_uint_t i = 0; i < len; i++) {
+                            mp_uint_t ptr = (mp_uint_t)ptrs[i];
+                            if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
+                                c = 'S';
                                 break;
                             }
                         }
                     }
+                    break;
+                }
+                */
+                /* this prints the uPy object type of the head block */
+                case AT_HEAD: {
+                    void **ptr = (void**)(area->gc_pool_start + bl * BYTES_PER_BLOCK);
+                    if (*ptr == &mp_type_tuple) { c = 'T'; }
+                    else if (*ptr == &mp_type_list) { c = 'L'; }
+                    else if (*ptr == &mp_type_dict) { c = 'D'; }
+                    else if (*ptr == &mp_type_str || *ptr == &mp_type_bytes) { c = 'S'; }
+                    #if MICROPY_PY_BUILTINS_BYTEARRAY
+                    else if (*ptr == &mp_type_bytearray) { c = 'A'; }
                     #endif
+                    #if MICROPY_PY_ARRAY
+                    else if (*ptr == &mp_type_array) { c = 'A'; }
+                    #endif
+                    #if MICROPY_PY_BUILTINS_FLOAT
+                    else if (*ptr == &mp_type_float) { c = 'F'; }
+                    #endif
+                    else if (*ptr == &mp_type_fun_bc) { c = 'B'; }
+                    else if (*ptr == &mp_type_module) { c = 'M'; }
+                    else {
+                        c = 'h';
+                        #if 0
+                        // This code prints "Q" for qstr-pool data, and "q" for qstr-str
+                        // data.  It can be useful to see how qstrs are being allocated,
+                        // but is disabled by default because it is very slow.
+                        for (qstr_pool_t *pool = MP_STATE_VM(last_pool); c == 'h' && pool != NULL; pool = pool->prev) {
+                            if ((qstr_pool_t*)ptr == pool) {
+                                c = 'Q';
+                                break;
+                            }
+                            for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
+                                if ((const byte*)ptr == *q) {
+                                    c = 'q';
+                                    break;
+                                }
+                            }
+                        }
+                        #endif
+                    }
+                    break;
                 }
-                break;
+                case AT_TAIL: c = '='; break;
+                case AT_MARK: c = 'm'; break;
             }
-            case AT_TAIL: c = '='; break;
-            case AT_MARK: c = 'm'; break;
+            mp_printf(&mp_plat_print, "%c", c);
         }
-        mp_printf(&mp_plat_print, "%c", c);
+        mp_print_str(&mp_plat_print, "\n");
     }
-    mp_print_str(&mp_plat_print, "\n");
     GC_EXIT();
 }
 
@@ -33,6 +33,19 @@
 
 void gc_init(void *start, void *end);
 
+#if MICROPY_GC_SPLIT_HEAP
+// Adds the memory block to the heap as a new area.  The first area, given
+// to gc_init(), is used for small allocations, the later ones are preferred
+// for allocations of at least MICROPY_GC_SPLIT_HEAP_LARGE_ALLOC bytes.
+void gc_add(void *start, void *end);
+
+// When strict, an allocation is only placed in another area than its
+// preferred one after a collection couldn't make room in the latter.  This
+// keeps the small long-lived objects out of an area reserved for the large
+// buffers, at the cost of collecting more often.  Off after gc_init().
+void gc_split_strict(bool strict);
+#endif
+
 // These lock/unlock functions can be nested.
 // They can be used to prevent the GC from allocating/freeing.
 void gc_lock(void);
@@ -48,12 +61,45 @@ void gc_collect_end(void);
 // Use this function to sweep the whole heap and run all finalisers
 void gc_sweep_all(void);
 
+#if MICROPY_GC_INCREMENTAL_SWEEP
+// Sweeps up to n_blocks blocks of a pending sweep, returns true if there is
+// still some left.  Ports call it when the VM is idle.
+bool gc_sweep_step(size_t n_blocks);
+#endif
+
 enum {
     GC_ALLOC_FLAG_HAS_FINALISER = 1,
 };
 
 void *gc_alloc(size_t n_bytes, unsigned int alloc_flags);
 void gc_free(void *ptr); // does not call finaliser
+
+#if MICROPY_GC_FREE_LISTS
+// the kinds of objects the sweep keeps free lists of
+enum {
+    GC_FREE_LIST_TUPLE,     // tuple and attrtuple
+    GC_FREE_LIST_STR,       // str and bytes with their data inline
+    GC_FREE_LIST_NUM_KINDS,
+};
+#define GC_FREE_LIST_MAX_BLOCKS (2)
+#define GC_FREE_LIST_MAX_BYTES (GC_FREE_LIST_MAX_BLOCKS * MICROPY_BYTES_PER_GC_BLOCK)
+
+// Returns zeroed memory for an object of the kind from its free list, or
+// NULL if the list is empty or n_bytes is more than GC_FREE_LIST_MAX_BYTES
+void *gc_free_list_alloc(unsigned int kind, size_t n_bytes);
+#endif
+#if MICROPY_GC_RESERVE
+// Between these, an allocation of at most MICROPY_GC_RESERVE_BYTES without a
+// finaliser is given a block of the reserve when the heap is locked by
+// gc_lock(), or full without collecting.  Meant for the drivers making the
+// objects of an event, they can nest.  Not for the hard interrupt handlers.
+// A caller that may raise in between must catch the exception with nlr_push()
+// and call gc_reserve_end() before raising it again.
+void gc_reserve_begin(void);
+void gc_reserve_end(void);
+// Sets the number of blocks kept, at most MICROPY_GC_RESERVE
+void gc_reserve_set(size_t n);
+#endif
 size_t gc_nbytes(const void *ptr);
 void *gc_realloc(void *ptr, size_t n_bytes, bool allow_move);
 
@@ -68,6 +114,10 @@ typedef struct _gc_info_t {
 } gc_info_t;
 
 void gc_info(gc_info_t *info);
+#if MICROPY_GC_STATS
+// Clears the counters returned by gc.stats()
+void gc_stats_clear(void);
+#endif
 void gc_dump_info(void);
 void gc_dump_alloc_table(void);
 
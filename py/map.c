@@ -76,13 +76,89 @@ STATIC size_t get_hash_alloc_greater_or_equal_to(size_t x) {
 /******************************************************************************/
 /* map                                                                        */
 
+#if MICROPY_MAP_COMPACT
+
+// A map that is not ordered is a dense array of alloc entries, in order of
+// insertion, with a MP_OBJ_SENTINEL key where an entry was removed. The same
+// allocation carries on with the number of entries appended to the array so
+// far, and a hash index: an open addressed table of entry positions + 1,
+// 0 for a free slot, with 1, 2 or 4 bytes per slot depending on alloc.
+// A slot of a removed entry is reused by the next entry added through it.
+
+#define MAP_FILLED(map) (*(size_t*)&(map)->table[(map)->alloc])
+
+STATIC size_t map_index_len(size_t alloc) {
+    // at least a third of the slots are left free
+    size_t len = 4;
+    while (len < alloc + alloc / 2) {
+        len *= 2;
+    }
+    return len;
+}
+
+STATIC size_t map_index_width(size_t alloc) {
+    return alloc < 0xff ? 1 : alloc < 0xffff ? 2 : 4;
+}
+
+STATIC size_t map_table_bytes(size_t alloc) {
+    if (alloc == 0) {
+        return 0;
+    }
+    return alloc * sizeof(mp_map_elem_t) + sizeof(size_t) + map_index_len(alloc) * map_index_width(alloc);
+}
+
+STATIC mp_map_elem_t *map_table_new(size_t alloc) {
+    if (alloc == 0) {
+        return NULL;
+    }
+    return (mp_map_elem_t*)m_new0(byte, map_table_bytes(alloc));
+}
+
+STATIC size_t map_index_get(const byte *index, size_t width, size_t i) {
+    switch (width) {
+        case 1: return index[i];
+        case 2: return ((const uint16_t*)index)[i];
+        default: return ((const uint32_t*)index)[i];
+    }
+}
+
+STATIC void map_index_set(byte *index, size_t width, size_t i, size_t pos) {
+    switch (width) {
+        case 1: index[i] = pos; break;
+        case 2: ((uint16_t*)index)[i] = pos; break;
+        default: ((uint32_t*)index)[i] = pos; break;
+    }
+}
+
+STATIC mp_uint_t map_hash(mp_obj_t key) {
+    if (mp_obj_is_qstr(key)) {
+        return qstr_hash(MP_OBJ_QSTR_VALUE(key));
+    } else {
+        return MP_OBJ_SMALL_INT_VALUE(mp_unary_op(MP_UNARY_OP_HASH, key));
+    }
+}
+
+#else
+
+#define map_table_bytes(alloc) ((alloc) * sizeof(mp_map_elem_t))
+#define map_table_new(alloc) m_new0(mp_map_elem_t, (alloc))
+
+#endif // MICROPY_MAP_COMPACT
+
+size_t mp_map_table_bytes(const mp_map_t *map) {
+    if (map->is_ordered) {
+        return map->alloc * sizeof(mp_map_elem_t);
+    }
+    return map_table_bytes(map->alloc);
+}
+
 void mp_map_init(mp_map_t *map, size_t n) {
     if (n == 0) {
         map->alloc = 0;
         map->table = NULL;
     } else {
         map->alloc = n;
-        map->table = m_new0(mp_map_elem_t, map->alloc);
+        map->table = map_table_new(map->alloc);
     }
     map->used = 0;
     map->all_keys_are_qstrs = 1;
@@ -102,14 +178,14 @@ void mp_map_init_fixed_table(mp_map_t *map, size_t n, const mp_obj_t *table) {
 // Differentiate from mp_map_clear() - semantics is different
 void mp_map_deinit(mp_map_t *map) {
     if (!map->is_fixed) {
-        m_del(mp_map_elem_t, map->table, map->alloc);
+        m_del(byte, map->table, mp_map_table_bytes(map));
     }
     map->used = map->alloc = 0;
 }
 
 void mp_map_clear(mp_map_t *map) {
     if (!map->is_fixed) {
-        m_del(mp_map_elem_t, map->table, map->alloc);
+        m_del(byte, map->table, mp_map_table_bytes(map));
     }
     map->alloc = 0;
     map->used = 0;
@@ -118,6 +194,64 @@ void mp_map_clear(mp_map_t *map) {
     map->table = NULL;
 }
 
+#if MICROPY_MAP_COMPACT
+
+// Rebuilds the index of the entries [0, filled) of the table
+STATIC void map_index_build(mp_map_t *map, size_t filled) {
+    size_t width = map_index_width(map->alloc);
+    size_t mask = map_index_len(map->alloc) - 1;
+    byte *index = (byte*)(&MAP_FILLED(map) + 1);
+    memset(index, 0, (mask + 1) * width);
+    MAP_FILLED(map) = filled;
+    for (size_t pos = 0; pos < filled; pos++) {
+        size_t i = map_hash(map->table[pos].key) & mask;
+        while (map_index_get(index, width, i) != 0) {
+            i = (i + 1) & mask;
+        }
+        map_index_set(index, width, i, pos + 1);
+    }
+}
+
+// Called when the entry array is full. When more than a quarter of it are
+// holes the entries are compacted within the same allocation, so that a map
+// which sees as many removals as additions doesn't allocate, otherwise the
+// entries move to a bigger allocation.
+STATIC void mp_map_rehash(mp_map_t *map) {
+    size_t old_alloc = map->alloc;
+    mp_map_elem_t *old_table = map->table;
+    mp_map_elem_t *new_table;
+    size_t new_alloc;
+    if (map->used < old_alloc - old_alloc / 4) {
+        new_alloc = old_alloc;
+        new_table = old_table;
+    } else {
+        new_alloc = get_hash_alloc_greater_or_equal_to(map->used + 1);
+        new_table = map_table_new(new_alloc);
+    }
+    DEBUG_printf("mp_map_rehash(%p): " UINT_FMT " -> " UINT_FMT "\n", map, old_alloc, new_alloc);
+
+    // If we reach this point, table resizing succeeded, now we can edit the old map.
+    size_t filled = 0;
+    bool all_keys_are_qstrs = true;
+    for (size_t i = 0; i < old_alloc; i++) {
+        if (old_table[i].key != MP_OBJ_NULL && old_table[i].key != MP_OBJ_SENTINEL) {
+            all_keys_are_qstrs &= mp_obj_is_qstr(old_table[i].key);
+            new_table[filled++] = old_table[i];
+        }
+    }
+    if (new_table == old_table) {
+        mp_seq_clear(new_table, filled, new_alloc, sizeof(*new_table));
+    } else {
+        m_del(byte, old_table, map_table_bytes(old_alloc));
+    }
+    map->alloc = new_alloc;
+    map->all_keys_are_qstrs = all_keys_are_qstrs;
+    map->table = new_table;
+    map_index_build(map, filled);
+}
+
+#else
+
 STATIC void mp_map_rehash(mp_map_t *map) {
     size_t old_alloc = map->alloc;
     size_t new_alloc = get_hash_alloc_greater_or_equal_to(map->alloc + 1);
@@ -137,6 +271,8 @@ STATIC void mp_map_rehash(mp_map_t *map) {
     m_del(mp_map_elem_t, old_table, old_alloc);
 }
 
+#endif // MICROPY_MAP_COMPACT
+
 // MP_MAP_LOOKUP behaviour:
 //  - returns NULL if not found, else the slot it was found in with key,value non-null
 // MP_MAP_LOOKUP_ADD_IF_NOT_FOUND behaviour:
@@ -208,6 +344,66 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
 
     // map is a hash table (not an ordered array), so do a hash lookup
 
+    #if MICROPY_MAP_COMPACT
+    if (map->alloc == 0) {
+        if (lookup_kind == MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
+            mp_map_rehash(map);
+        } else {
+            return NULL;
+        }
+    }
+
+    mp_uint_t hash = map_hash(index);
+    for (;;) {
+        size_t width = map_index_width(map->alloc);
+        size_t mask = map_index_len(map->alloc) - 1;
+        byte *idx = (byte*)(&MAP_FILLED(map) + 1);
+        size_t avail_i = (size_t)-1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            size_t pos = map_index_get(idx, width, i);
+            if (pos == 0) {
+                // found free slot, so index is not in table
+                if (lookup_kind != MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
+                    return NULL;
+                }
+                size_t filled = MAP_FILLED(map);
+                if (filled == map->alloc) {
+                    // no room at the end of the entries
+                    break;
+                }
+                map_index_set(idx, width, avail_i != (size_t)-1 ? avail_i : i, filled + 1);
+                MAP_FILLED(map) = filled + 1;
+                map->used += 1;
+                mp_map_elem_t *elem = &map->table[filled];
+                elem->key = index;
+                elem->value = MP_OBJ_NULL;
+                if (!mp_obj_is_qstr(index)) {
+                    map->all_keys_are_qstrs = 0;
+                }
+                return elem;
+            }
+            mp_map_elem_t *elem = &map->table[pos - 1];
+            if (elem->key == MP_OBJ_SENTINEL) {
+                // slot of a removed entry, remember for later
+                if (avail_i == (size_t)-1) {
+                    avail_i = i;
+                }
+            } else if (elem->key == index || (!compare_only_ptrs && mp_obj_equal(elem->key, index))) {
+                // found index
+                if (lookup_kind == MP_MAP_LOOKUP_REMOVE_IF_FOUND) {
+                    // leave a hole in the entries, keep elem->value so that
+                    // caller can access it if needed
+                    map->used--;
+                    elem->key = MP_OBJ_SENTINEL;
+                }
+                return elem;
+            }
+        }
+        // compact or grow the entries, then add the new element
+        mp_map_rehash(map);
+    }
+    #else
+
     if (map->alloc == 0) {
         if (lookup_kind == MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
             mp_map_rehash(map);
@@ -293,6 +489,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
             }
         }
     }
+    #endif // MICROPY_MAP_COMPACT
 }
 
 /******************************************************************************/
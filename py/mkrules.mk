@@ -103,110 +103,62 @@ $(BUILD)/frozen.c: $(wildcard $(FROZEN_DIR)/*) $(HEADER_BUILD) $(FROZEN_EXTRA_DE
 endif
 
 ifneq ($(FROZEN_MPY_DIR),)
-OS_NAME := $(shell uname -s)
-
+# the frozen directories of the build, the first one holding a module wins
 ifeq ($(PYBYTES_ENABLED), 1)
-ifeq ($(OS_NAME), Linux)
-# make a list of all the .py files that need compiling and freezing
-FROZEN_MPY_PY_FILES := $(shell find -L $(FROZEN_MPY_DIR)/Pybytes/ -type f -name '*.py' | $(SED) -e 's/$(FROZEN_MPY_DIR)\/Pybytes\///')
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/Common/ -type f -name '*.py' | $(SED) -e 's/$(FROZEN_MPY_DIR)\/Common\///')
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/Custom/ -type f -name '*.py' | $(SED) -e 's/$(FROZEN_MPY_DIR)\/Custom\///')
-ifeq ($(BOARD), $(filter $(BOARD), GPY FIPY))
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/LTE/ -type f -name '*.py' | $(SED) -e 's/$(FROZEN_MPY_DIR)\/LTE\///')
-endif
-else
-# make a list of all the .py files that need compiling and freezing
-FROZEN_MPY_PY_FILES := $(shell find -L $(FROZEN_MPY_DIR)/Pybytes/ -type f -name '*.py' | $(SED) -e 's=^$(FROZEN_MPY_DIR)\/Pybytes\//==')
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/Common/ -type f -name '*.py' | $(SED) -e 's=^$(FROZEN_MPY_DIR)\/Common\//==')
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/Custom/ -type f -name '*.py' | $(SED) -e 's=^$(FROZEN_MPY_DIR)\/Custom\//==')
-ifeq ($(BOARD), $(filter $(BOARD), GPY FIPY))
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/LTE/ -type f -name '*.py' | $(SED) -e 's=^$(FROZEN_MPY_DIR)\/LTE\//==')
+FROZEN_MPY_SUBDIRS = Pybytes Common Custom
+else ifeq ($(PYBYTES_ENABLED), 0)
+FROZEN_MPY_SUBDIRS = Base Common Custom
 endif
+ifneq ($(filter $(BOARD), GPY FIPY),)
+FROZEN_MPY_SUBDIRS += LTE
 endif
 
+# make a list of all the .py files that need compiling and freezing
+FROZEN_MPY_PY_FILES := $(foreach d,$(FROZEN_MPY_SUBDIRS),$(patsubst $(FROZEN_MPY_DIR)/$(d)/%,%,$(shell find -L $(FROZEN_MPY_DIR)/$(d)/ -type f -name '*.py')))
 FROZEN_MPY_MPY_FILES := $(addprefix $(BUILD)/frozen_mpy/,$(FROZEN_MPY_PY_FILES:.py=.mpy))
 
-# to build .mpy files from .py files
-$(BUILD)/frozen_mpy/%.mpy: $(FROZEN_MPY_DIR)/Pybytes/%.py
-	@$(ECHO) "MPY $<"
-	$(Q)$(MKDIR) -p $(dir $@)
-	$(Q)$(MPY_CROSS) -o $@ -s $(^:$(FROZEN_MPY_DIR)/Pybytes/%=%) $(MPY_CROSS_FLAGS) $^
-
-# to build .mpy files from .py files
-$(BUILD)/frozen_mpy/%.mpy: $(FROZEN_MPY_DIR)/Common/%.py
-	@$(ECHO) "MPY $<"
-	$(Q)$(MKDIR) -p $(dir $@)
-	$(Q)$(MPY_CROSS) -o $@ -s $(^:$(FROZEN_MPY_DIR)/Common/%=%) $(MPY_CROSS_FLAGS) $^
-	
-# to build .mpy files from .py files
-$(BUILD)/frozen_mpy/%.mpy: $(FROZEN_MPY_DIR)/Custom/%.py
-	@$(ECHO) "MPY $<"
-	$(Q)$(MKDIR) -p $(dir $@)
-	$(Q)$(MPY_CROSS) -o $@ -s $(^:$(FROZEN_MPY_DIR)/Custom/%=%) $(MPY_CROSS_FLAGS) $^
-
-ifeq ($(BOARD), $(filter $(BOARD), GPY FIPY))
-# to build .mpy files from .py files
-$(BUILD)/frozen_mpy/%.mpy: $(FROZEN_MPY_DIR)/LTE/%.py
-	@$(ECHO) "MPY $<"
-	$(Q)$(MKDIR) -p $(dir $@)
-	$(Q)$(MPY_CROSS) -o $@ -s $(^:$(FROZEN_MPY_DIR)/LTE/%=%) $(MPY_CROSS_FLAGS) $^
-endif
-	
-endif
-
-ifeq ($(PYBYTES_ENABLED), 0)
-ifeq ($(OS_NAME), Linux)
-# make a list of all the .py files that need compiling and freezing
-FROZEN_MPY_PY_FILES := $(shell find -L $(FROZEN_MPY_DIR)/Base/ -type f -name '*.py' | $(SED) -e 's/$(FROZEN_MPY_DIR)\/Base\///')
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/Common/ -type f -name '*.py' | $(SED) -e 's/$(FROZEN_MPY_DIR)\/Common\///')
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/Custom/ -type f -name '*.py' | $(SED) -e 's/$(FROZEN_MPY_DIR)\/Custom\///')
-ifeq ($(BOARD), $(filter $(BOARD), GPY FIPY))
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/LTE/ -type f -name '*.py' | $(SED) -e 's/$(FROZEN_MPY_DIR)\/LTE\///')
-endif
+# Each .mpy file has its own rule so that they are built in parallel with make -j
+# and only for the .py files that changed. mpy-cross goes through a cache keyed by
+# content (see tools/mpy-cross-cache.py), set MPY_CROSS_CACHE= to bypass it.
+# It's kept out of $(BUILD) so that it survives make clean, and is shared by
+# the ports and boards.
+MPY_CROSS_CACHE ?= $(TOP)/.mpy-cross-cache
+ifneq ($(MPY_CROSS_CACHE),)
+MPY_CROSS_FROZEN = $(PYTHON) $(TOP)/tools/mpy-cross-cache.py -c $(MPY_CROSS_CACHE) $(MPY_CROSS)
 else
-# make a list of all the .py files that need compiling and freezing
-FROZEN_MPY_PY_FILES := $(shell find -L $(FROZEN_MPY_DIR)/Base/ -type f -name '*.py' | $(SED) -e 's=^$(FROZEN_MPY_DIR)\/Base\//==')
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/Common/ -type f -name '*.py' | $(SED) -e 's=^$(FROZEN_MPY_DIR)\/Common\//==')
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/Custom/ -type f -name '*.py' | $(SED) -e 's=^$(FROZEN_MPY_DIR)\/Custom\//==')
-ifeq ($(BOARD), $(filter $(BOARD), GPY FIPY))
-FROZEN_MPY_PY_FILES += $(shell find -L $(FROZEN_MPY_DIR)/LTE/ -type f -name '*.py' | $(SED) -e 's=^$(FROZEN_MPY_DIR)\/LTE\//==')
-endif
+MPY_CROSS_FROZEN = $(MPY_CROSS)
 endif
 
-FROZEN_MPY_MPY_FILES := $(addprefix $(BUILD)/frozen_mpy/,$(FROZEN_MPY_PY_FILES:.py=.mpy))
-
-# to build .mpy files from .py files
-$(BUILD)/frozen_mpy/%.mpy: $(FROZEN_MPY_DIR)/Base/%.py
-	@$(ECHO) "MPY $<"
+# the flags are recorded so that changing them rebuilds the .mpy files, the file is
+# only rewritten when they differ
+FROZEN_MPY_FLAGS_FILE = $(BUILD)/frozen_mpy/mpy_cross_flags
+FROZEN_MPY_FLAGS = $(MPY_CROSS_FLAGS) native: $(FROZEN_MPY_NATIVE)
+$(FROZEN_MPY_FLAGS_FILE): FORCE
 	$(Q)$(MKDIR) -p $(dir $@)
-	$(Q)$(MPY_CROSS) -o $@ -s $(^:$(FROZEN_MPY_DIR)/Base/%=%) $(MPY_CROSS_FLAGS) $^
+	$(Q)echo '$(FROZEN_MPY_FLAGS)' | cmp -s - $@ || echo '$(FROZEN_MPY_FLAGS)' > $@
 
 # to build .mpy files from .py files
-$(BUILD)/frozen_mpy/%.mpy: $(FROZEN_MPY_DIR)/Common/%.py
-	@$(ECHO) "MPY $<"
-	$(Q)$(MKDIR) -p $(dir $@)
-	$(Q)$(MPY_CROSS) -o $@ -s $(^:$(FROZEN_MPY_DIR)/Common/%=%) $(MPY_CROSS_FLAGS) $^
-	
-# to build .mpy files from .py files
-$(BUILD)/frozen_mpy/%.mpy: $(FROZEN_MPY_DIR)/Custom/%.py
-	@$(ECHO) "MPY $<"
-	$(Q)$(MKDIR) -p $(dir $@)
-	$(Q)$(MPY_CROSS) -o $@ -s $(^:$(FROZEN_MPY_DIR)/Custom/%=%) $(MPY_CROSS_FLAGS) $^
+define frozen_mpy_rule
+$(BUILD)/frozen_mpy/%.mpy: $(FROZEN_MPY_DIR)/$(1)/%.py $(FROZEN_MPY_FLAGS_FILE) $(wildcard $(MPY_CROSS))
+	@$$(ECHO) "MPY $$<"
+	$$(Q)$$(MKDIR) -p $$(dir $$@)
+	$$(Q)$$(MPY_CROSS_FROZEN) -o $$@ -s $$(<:$(FROZEN_MPY_DIR)/$(1)/%=%) $$(MPY_CROSS_FLAGS) $$<
+endef
+$(foreach d,$(FROZEN_MPY_SUBDIRS),$(eval $(call frozen_mpy_rule,$(d))))
 
-ifeq ($(BOARD), $(filter $(BOARD), GPY FIPY))	
-# to build .mpy files from .py files
-$(BUILD)/frozen_mpy/%.mpy: $(FROZEN_MPY_DIR)/LTE/%.py
-	@$(ECHO) "MPY $<"
-	$(Q)$(MKDIR) -p $(dir $@)
-	$(Q)$(MPY_CROSS) -o $@ -s $(^:$(FROZEN_MPY_DIR)/LTE/%=%) $(MPY_CROSS_FLAGS) $^
-endif
+# modules listed in FROZEN_MPY_NATIVE are emitted as native code
+$(addprefix $(BUILD)/frozen_mpy/,$(FROZEN_MPY_NATIVE:.py=.mpy)): MPY_CROSS_FLAGS += -X emit=native
 
-endif
+# to build frozen_mpy.c from all .mpy files, it is only replaced when its content
+# changes so that restoring identical .mpy files doesn't recompile it
+$(BUILD)/frozen_mpy.stamp: $(FROZEN_MPY_MPY_FILES) $(BUILD)/genhdr/qstrdefs.generated.h
+	@$(ECHO) "GEN $(BUILD)/frozen_mpy.c"
+	$(Q)$(MPY_TOOL) -f -q $(BUILD)/genhdr/qstrdefs.preprocessed.h $(FROZEN_MPY_MPY_FILES) > $(BUILD)/frozen_mpy.c.tmp
+	$(Q)if cmp -s $(BUILD)/frozen_mpy.c.tmp $(BUILD)/frozen_mpy.c; then $(RM) -f $(BUILD)/frozen_mpy.c.tmp; else mv -f $(BUILD)/frozen_mpy.c.tmp $(BUILD)/frozen_mpy.c; fi
+	$(Q)$(TOUCH) $@
 
-# to build frozen_mpy.c from all .mpy files
-$(BUILD)/frozen_mpy.c: $(FROZEN_MPY_MPY_FILES) $(BUILD)/genhdr/qstrdefs.generated.h
-	@$(ECHO) "GEN $@"
-	$(Q)$(MPY_TOOL) -f -q $(BUILD)/genhdr/qstrdefs.preprocessed.h $(FROZEN_MPY_MPY_FILES) > $@
+$(BUILD)/frozen_mpy.c: $(BUILD)/frozen_mpy.stamp
+	@:
 endif
 
 ifneq ($(PROG),)
@@ -24,8 +24,11 @@
  * THE SOFTWARE.
  */
 
+#include <string.h>
+
 #include "py/mpstate.h"
 #include "py/obj.h"
+#include "py/runtime.h"
 #include "py/gc.h"
 
 #if MICROPY_PY_GC && MICROPY_ENABLE_GC
@@ -76,6 +79,15 @@ STATIC mp_obj_t gc_mem_alloc(void) {
 }
 MP_DEFINE_CONST_FUN_OBJ_0(gc_mem_alloc_obj, gc_mem_alloc);
 
+// mem_largest(): return the number of bytes of the largest free block, the
+// largest allocation that can succeed without a collection
+STATIC mp_obj_t gc_mem_largest(void) {
+    gc_info_t info;
+    gc_info(&info);
+    return MP_OBJ_NEW_SMALL_INT(info.max_free * MICROPY_BYTES_PER_GC_BLOCK);
+}
+MP_DEFINE_CONST_FUN_OBJ_0(gc_mem_largest_obj, gc_mem_largest);
+
 #if MICROPY_GC_ALLOC_THRESHOLD
 STATIC mp_obj_t gc_threshold(size_t n_args, const mp_obj_t *args) {
     if (n_args == 0) {
@@ -95,6 +107,120 @@ STATIC mp_obj_t gc_threshold(size_t n_args, const mp_obj_t *args) {
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_threshold_obj, 0, 1, gc_threshold);
 #endif
 
+#if MICROPY_GC_RESERVE
+// reserve([n]): set the number of blocks kept for the drivers' events, or
+// return the number available, the number kept and the number taken so far
+STATIC mp_obj_t gc_reserve(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        mp_obj_t items[3] = {
+            MP_OBJ_NEW_SMALL_INT(MP_STATE_MEM(gc_reserve_len)),
+            MP_OBJ_NEW_SMALL_INT(MP_STATE_MEM(gc_reserve_target)),
+            mp_obj_new_int_from_uint(MP_STATE_MEM(gc_reserve_taken)),
+        };
+        return mp_obj_new_tuple(3, items);
+    }
+    mp_int_t val = mp_obj_get_int(args[0]);
+    if (val < 0) {
+        mp_raise_ValueError(NULL);
+    }
+    gc_reserve_set(val);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_reserve_obj, 0, 1, gc_reserve);
+#endif
+
+#if MICROPY_GC_PAUSE_HISTOGRAM
+// pauses([clear]): return the histogram of the collection pause times, bucket
+// n counts the pauses shorter than 2^n ms and the last one the longer ones
+STATIC mp_obj_t gc_pauses(size_t n_args, const mp_obj_t *args) {
+    mp_obj_t hist[MICROPY_GC_PAUSE_HISTOGRAM];
+    for (size_t i = 0; i < MICROPY_GC_PAUSE_HISTOGRAM; i++) {
+        hist[i] = mp_obj_new_int_from_uint(MP_STATE_MEM(gc_pause_hist)[i]);
+    }
+    if (n_args > 0 && mp_obj_is_true(args[0])) {
+        memset(MP_STATE_MEM(gc_pause_hist), 0, sizeof(MP_STATE_MEM(gc_pause_hist)));
+    }
+    return mp_obj_new_tuple(MICROPY_GC_PAUSE_HISTOGRAM, hist);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_pauses_obj, 0, 1, gc_pauses);
+#endif
+
+#if MICROPY_GC_STATS
+STATIC mp_obj_t gc_stats_tuple(const size_t *counts) {
+    mp_obj_t items[MP_GC_STATS_SIZE_CLASSES];
+    for (size_t i = 0; i < MP_GC_STATS_SIZE_CLASSES; i++) {
+        items[i] = mp_obj_new_int_from_uint(counts[i]);
+    }
+    return mp_obj_new_tuple(MP_GC_STATS_SIZE_CLASSES, items);
+}
+
+// stats([clear]): return a dict with the number and the bytes of allocations by
+// size class (class n counting those of up to 2^n blocks), the number of
+// collections and their pause times and, if enabled, the bytecode positions
+// allocating the most as (file, line, function, count, bytes) tuples
+STATIC mp_obj_t gc_stats(size_t n_args, const mp_obj_t *args) {
+    // take a copy first, building the result allocates
+    size_t allocs[MP_GC_STATS_SIZE_CLASSES];
+    size_t bytes[MP_GC_STATS_SIZE_CLASSES];
+    memcpy(allocs, MP_STATE_MEM(gc_stats_allocs), sizeof(allocs));
+    memcpy(bytes, MP_STATE_MEM(gc_stats_bytes), sizeof(bytes));
+    #if MICROPY_GC_STATS_CALLERS
+    mp_gc_stats_caller_t callers[MICROPY_GC_STATS_CALLERS];
+    memcpy(callers, MP_STATE_MEM(gc_stats_callers), sizeof(callers));
+    #endif
+    size_t collections = MP_STATE_MEM(gc_stats_collections);
+    uint64_t pause_total_us = MP_STATE_MEM(gc_stats_pause_total_us);
+    mp_uint_t pause_max_us = MP_STATE_MEM(gc_stats_pause_max_us);
+    #if MICROPY_GC_FREE_LISTS
+    size_t free_list_hits[GC_FREE_LIST_NUM_KINDS];
+    size_t free_list_misses[GC_FREE_LIST_NUM_KINDS];
+    memcpy(free_list_hits, MP_STATE_MEM(gc_stats_free_list_hits), sizeof(free_list_hits));
+    memcpy(free_list_misses, MP_STATE_MEM(gc_stats_free_list_misses), sizeof(free_list_misses));
+    #endif
+    if (n_args > 0 && mp_obj_is_true(args[0])) {
+        gc_stats_clear();
+    }
+
+    mp_obj_t dict = mp_obj_new_dict(8);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_allocs), gc_stats_tuple(allocs));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_bytes), gc_stats_tuple(bytes));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_collections), mp_obj_new_int_from_uint(collections));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_pause_total_us), mp_obj_new_int_from_ull(pause_total_us));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_pause_max_us), mp_obj_new_int_from_uint(pause_max_us));
+    #if MICROPY_GC_FREE_LISTS
+    // (tuple, str) allocations served from the free lists, or not
+    mp_obj_t items[GC_FREE_LIST_NUM_KINDS];
+    for (size_t i = 0; i < GC_FREE_LIST_NUM_KINDS; i++) {
+        items[i] = mp_obj_new_int_from_uint(free_list_hits[i]);
+    }
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_free_list_hits), mp_obj_new_tuple(GC_FREE_LIST_NUM_KINDS, items));
+    for (size_t i = 0; i < GC_FREE_LIST_NUM_KINDS; i++) {
+        items[i] = mp_obj_new_int_from_uint(free_list_misses[i]);
+    }
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_free_list_misses), mp_obj_new_tuple(GC_FREE_LIST_NUM_KINDS, items));
+    #endif
+    #if MICROPY_GC_STATS_CALLERS
+    mp_obj_t caller_list = mp_obj_new_list(0, NULL);
+    for (size_t i = 0; i < MICROPY_GC_STATS_CALLERS; i++) {
+        const mp_gc_stats_caller_t *caller = &callers[i];
+        if (caller->count > 0) {
+            mp_obj_t items[5] = {
+                MP_OBJ_NEW_QSTR(caller->source_file),
+                MP_OBJ_NEW_SMALL_INT(caller->source_line),
+                MP_OBJ_NEW_QSTR(caller->block_name),
+                mp_obj_new_int_from_uint(caller->count),
+                mp_obj_new_int_from_uint(caller->bytes),
+            };
+            mp_obj_list_append(caller_list, mp_obj_new_tuple(5, items));
+        }
+    }
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_callers), caller_list);
+    #endif
+    return dict;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_stats_obj, 0, 1, gc_stats);
+#endif
+
 STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_gc) },
     { MP_ROM_QSTR(MP_QSTR_collect), MP_ROM_PTR(&gc_collect_obj) },
@@ -103,9 +229,19 @@ STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_isenabled), MP_ROM_PTR(&gc_isenabled_obj) },
     { MP_ROM_QSTR(MP_QSTR_mem_free), MP_ROM_PTR(&gc_mem_free_obj) },
     { MP_ROM_QSTR(MP_QSTR_mem_alloc), MP_ROM_PTR(&gc_mem_alloc_obj) },
+    { MP_ROM_QSTR(MP_QSTR_mem_largest), MP_ROM_PTR(&gc_mem_largest_obj) },
     #if MICROPY_GC_ALLOC_THRESHOLD
     { MP_ROM_QSTR(MP_QSTR_threshold), MP_ROM_PTR(&gc_threshold_obj) },
     #endif
+    #if MICROPY_GC_RESERVE
+    { MP_ROM_QSTR(MP_QSTR_reserve), MP_ROM_PTR(&gc_reserve_obj) },
+    #endif
+    #if MICROPY_GC_PAUSE_HISTOGRAM
+    { MP_ROM_QSTR(MP_QSTR_pauses), MP_ROM_PTR(&gc_pauses_obj) },
+    #endif
+    #if MICROPY_GC_STATS
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&gc_stats_obj) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_gc_globals, mp_module_gc_globals_table);
@@ -25,12 +25,18 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "py/builtin.h"
 #include "py/stackctrl.h"
 #include "py/runtime.h"
 #include "py/gc.h"
 #include "py/mphal.h"
+#include "py/objstr.h"
+
+#if MICROPY_PY_MICROPYTHON_PROFILE
+#include "py/bc.h"
+#endif
 
 // Various builtins specific to MicroPython runtime,
 // living in micropython module
@@ -105,6 +111,20 @@ STATIC mp_obj_t mp_micropython_qstr_info(size_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_qstr_info_obj, 0, 1, mp_micropython_qstr_info);
 
+#if MICROPY_QSTR_HASH_INDEX
+STATIC mp_obj_t mp_micropython_qstr_index_info(void) {
+    size_t n_slots, n_lookups, n_probes;
+    qstr_index_info(&n_slots, &n_lookups, &n_probes);
+    mp_obj_t tuple[3] = {
+        mp_obj_new_int_from_uint(n_slots),
+        mp_obj_new_int_from_uint(n_lookups),
+        mp_obj_new_int_from_uint(n_probes),
+    };
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mp_micropython_qstr_index_info_obj, mp_micropython_qstr_index_info);
+#endif
+
 #endif // MICROPY_PY_MICROPYTHON_MEM_INFO
 
 #if MICROPY_PY_MICROPYTHON_STACK_USE
@@ -165,6 +185,94 @@ STATIC mp_obj_t mp_micropython_schedule(mp_obj_t function, mp_obj_t arg) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mp_micropython_schedule_obj, mp_micropython_schedule);
 #endif
 
+#if MICROPY_PY_MICROPYTHON_PROFILE
+// Called by the timer of the port, possibly from an interrupt where the code
+// being run can't be looked at safely, so the VM takes the sample itself at its
+// next pending check.  A tick while the previous one is still pending means
+// that the time went outside of the bytecode (blocked, in C or native code).
+void mp_profile_tick(void) {
+    MP_STATE_VM(profile_ticks) += 1;
+    MP_STATE_VM(profile_pending) = 1;
+}
+
+// A line not in the table yet replaces the one with the lowest count and carries
+// on from that count, so that the busiest lines stay in the table.
+void mp_profile_sample(const mp_code_state_t *code_state) {
+    MP_STATE_VM(profile_pending) = 0;
+    qstr source_file, block_name;
+    size_t source_line;
+    mp_bytecode_get_source_pos(code_state, &source_file, &source_line, &block_name);
+    mp_profile_entry_t *entries = MP_STATE_VM(profile_entries);
+    mp_profile_entry_t *entry = &entries[0];
+    for (size_t i = 0; i < MICROPY_PY_MICROPYTHON_PROFILE; i++) {
+        if (entries[i].source_line == source_line && entries[i].block_name == block_name
+            && entries[i].source_file == source_file) {
+            entry = &entries[i];
+            goto found;
+        }
+        if (entries[i].count < entry->count) {
+            entry = &entries[i];
+        }
+    }
+    entry->source_file = source_file;
+    entry->block_name = block_name;
+    entry->source_line = source_line;
+found:
+    entry->count += 1;
+}
+
+// profile_start([period_us]): clear the counts and sample the running code every period_us
+STATIC mp_obj_t mp_micropython_profile_start(size_t n_args, const mp_obj_t *args) {
+    mp_int_t period_us = (n_args > 0) ? mp_obj_get_int(args[0]) : 1000;
+    if (period_us <= 0) {
+        mp_raise_ValueError("period must be positive");
+    }
+    mp_hal_profile_timer(0);
+    memset(MP_STATE_VM(profile_entries), 0, sizeof(MP_STATE_VM(profile_entries)));
+    MP_STATE_VM(profile_ticks) = 0;
+    MP_STATE_VM(profile_pending) = 0;
+    mp_hal_profile_timer(period_us);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_profile_start_obj, 0, 1, mp_micropython_profile_start);
+
+STATIC mp_obj_t mp_micropython_profile_stop(void) {
+    mp_hal_profile_timer(0);
+    MP_STATE_VM(profile_pending) = 0;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mp_micropython_profile_stop_obj, mp_micropython_profile_stop);
+
+// profile_report(): return (ticks, lines), lines being (file, line, function, samples)
+// tuples with the busiest first, and ticks minus their samples the ones spent elsewhere
+STATIC mp_obj_t mp_micropython_profile_report(void) {
+    mp_profile_entry_t entries[MICROPY_PY_MICROPYTHON_PROFILE];
+    memcpy(entries, MP_STATE_VM(profile_entries), sizeof(entries));
+    for (size_t i = 1; i < MICROPY_PY_MICROPYTHON_PROFILE; i++) {
+        mp_profile_entry_t entry = entries[i];
+        size_t j = i;
+        for (; j > 0 && entries[j - 1].count < entry.count; j--) {
+            entries[j] = entries[j - 1];
+        }
+        entries[j] = entry;
+    }
+
+    mp_obj_t lines = mp_obj_new_list(0, NULL);
+    for (size_t i = 0; i < MICROPY_PY_MICROPYTHON_PROFILE && entries[i].count > 0; i++) {
+        mp_obj_t items[4] = {
+            MP_OBJ_NEW_QSTR(entries[i].source_file),
+            MP_OBJ_NEW_SMALL_INT(entries[i].source_line),
+            MP_OBJ_NEW_QSTR(entries[i].block_name),
+            mp_obj_new_int_from_uint(entries[i].count),
+        };
+        mp_obj_list_append(lines, mp_obj_new_tuple(4, items));
+    }
+    mp_obj_t items[2] = { mp_obj_new_int_from_uint(MP_STATE_VM(profile_ticks)), lines };
+    return mp_obj_new_tuple(2, items);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mp_micropython_profile_report_obj, mp_micropython_profile_report);
+#endif
+
 STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_micropython) },
     { MP_ROM_QSTR(MP_QSTR_const), MP_ROM_PTR(&mp_identity_obj) },
@@ -179,6 +287,9 @@ STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
 #endif
     { MP_ROM_QSTR(MP_QSTR_mem_info), MP_ROM_PTR(&mp_micropython_mem_info_obj) },
     { MP_ROM_QSTR(MP_QSTR_qstr_info), MP_ROM_PTR(&mp_micropython_qstr_info_obj) },
+    #if MICROPY_QSTR_HASH_INDEX
+    { MP_ROM_QSTR(MP_QSTR_qstr_index_info), MP_ROM_PTR(&mp_micropython_qstr_index_info_obj) },
+    #endif
 #endif
     #if MICROPY_PY_MICROPYTHON_STACK_USE
     { MP_ROM_QSTR(MP_QSTR_stack_use), MP_ROM_PTR(&mp_micropython_stack_use_obj) },
@@ -199,6 +310,14 @@ STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
     #if MICROPY_ENABLE_SCHEDULER
     { MP_ROM_QSTR(MP_QSTR_schedule), MP_ROM_PTR(&mp_micropython_schedule_obj) },
     #endif
+    #if MICROPY_PY_MICROPYTHON_PROFILE
+    { MP_ROM_QSTR(MP_QSTR_profile_start), MP_ROM_PTR(&mp_micropython_profile_start_obj) },
+    { MP_ROM_QSTR(MP_QSTR_profile_stop), MP_ROM_PTR(&mp_micropython_profile_stop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_profile_report), MP_ROM_PTR(&mp_micropython_profile_report_obj) },
+    #endif
+    #if MICROPY_PY_MICROPYTHON_TEMPLATE
+    { MP_ROM_QSTR(MP_QSTR_template), MP_ROM_PTR(&mp_type_str_template) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_micropython_globals, mp_module_micropython_globals_table);
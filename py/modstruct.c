@@ -31,6 +31,7 @@
 #include "py/runtime.h"
 #include "py/builtin.h"
 #include "py/objtuple.h"
+#include "py/objlist.h"
 #include "py/binary.h"
 #include "py/parsenum.h"
 
@@ -248,6 +249,281 @@ STATIC mp_obj_t struct_pack_into(size_t n_args, const mp_obj_t *args) {
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(struct_pack_into_obj, 3, MP_OBJ_FUN_ARGS_MAX, struct_pack_into);
 
+#if MICROPY_PY_STRUCT_TYPE
+
+// ustruct.Struct parses its format once into a table of fields, so that
+// the same layout can be packed and unpacked repeatedly without going
+// through the format string again.
+
+typedef struct _struct_field_t {
+    uint32_t offset;        // from the start of the structure, alignment applied
+    uint32_t count;         // number of values, or length of the bytes for 's'
+    char val_type;
+} struct_field_t;
+
+typedef struct _mp_obj_struct_t {
+    mp_obj_base_t base;
+    mp_obj_t format;
+    size_t size;
+    size_t num_items;
+    size_t num_fields;
+    char fmt_type;
+    struct_field_t fields[];
+} mp_obj_struct_t;
+
+typedef struct _mp_obj_struct_it_t {
+    mp_obj_base_t base;
+    mp_fun_1_t iternext;
+    mp_obj_struct_t *st;
+    mp_obj_t buf;
+    size_t offset;
+} mp_obj_struct_it_t;
+
+STATIC mp_obj_t struct_obj_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 1, 1, false);
+    const char *fmt = mp_obj_str_get_str(args[0]);
+
+    // count the fields first, a repeated type is a single field
+    const char *f = fmt;
+    get_fmt_type(&f);
+    size_t num_fields = 0;
+    for (; *f; f++) {
+        if (unichar_isdigit(*f)) {
+            get_fmt_num(&f);
+            if (*f == '\0') {
+                // a count without a type, reported as a bad typecode below
+                num_fields++;
+                break;
+            }
+        }
+        num_fields++;
+    }
+
+    mp_obj_struct_t *o = m_new_obj_var(mp_obj_struct_t, struct_field_t, num_fields);
+    o->base.type = type;
+    o->format = args[0];
+    o->num_fields = num_fields;
+    o->fmt_type = get_fmt_type(&fmt);
+
+    size_t size = 0;
+    size_t num_items = 0;
+    struct_field_t *field = o->fields;
+    for (; *fmt; fmt++, field++) {
+        mp_uint_t cnt = 1;
+        if (unichar_isdigit(*fmt)) {
+            cnt = get_fmt_num(&fmt);
+        }
+        field->val_type = *fmt;
+        field->count = cnt;
+        if (*fmt == 's') {
+            field->offset = size;
+            size += cnt;
+            num_items += 1;
+        } else {
+            mp_uint_t align;
+            size_t sz = mp_binary_get_size(o->fmt_type, *fmt, &align);
+            // the values of a repeated type are contiguous once the first one is aligned
+            size = (size + align - 1) & ~(align - 1);
+            field->offset = size;
+            size += sz * cnt;
+            num_items += cnt;
+        }
+    }
+    o->size = size;
+    o->num_items = num_items;
+    return MP_OBJ_FROM_PTR(o);
+}
+
+STATIC void struct_obj_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    (void)kind;
+    mp_obj_struct_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "Struct(%R)", self->format);
+}
+
+STATIC byte *struct_obj_get_ptr(mp_obj_struct_t *self, mp_buffer_info_t *bufinfo, mp_int_t offset) {
+    if (offset < 0) {
+        // negative offsets are relative to the end of the buffer
+        offset = (mp_int_t)bufinfo->len + offset;
+    }
+    if (offset < 0 || (size_t)offset + self->size > bufinfo->len) {
+        mp_raise_ValueError("buffer too small");
+    }
+    return (byte *)bufinfo->buf + offset;
+}
+
+// Decodes the values into items, or stores them into out when items is NULL
+STATIC void struct_obj_unpack_internal(mp_obj_struct_t *self, byte *base, mp_obj_t *items, mp_obj_t out) {
+    size_t i = 0;
+    for (size_t n = 0; n < self->num_fields; n++) {
+        const struct_field_t *field = &self->fields[n];
+        byte *p = base + field->offset;
+        if (field->val_type == 's') {
+            mp_obj_t item = mp_obj_new_bytes(p, field->count);
+            if (items != NULL) {
+                items[i] = item;
+            } else {
+                mp_obj_subscr(out, MP_OBJ_NEW_SMALL_INT(i), item);
+            }
+            i++;
+        } else {
+            for (uint32_t cnt = field->count; cnt > 0; cnt--, i++) {
+                mp_obj_t item = mp_binary_get_val(self->fmt_type, field->val_type, &p);
+                if (items != NULL) {
+                    items[i] = item;
+                } else {
+                    mp_obj_subscr(out, MP_OBJ_NEW_SMALL_INT(i), item);
+                }
+            }
+        }
+    }
+}
+
+STATIC void struct_obj_pack_internal(mp_obj_struct_t *self, byte *base, size_t n_args, const mp_obj_t *args) {
+    if (n_args != self->num_items) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "expected %d values", (int)self->num_items));
+    }
+    memset(base, 0, self->size);
+    for (size_t n = 0; n < self->num_fields; n++) {
+        const struct_field_t *field = &self->fields[n];
+        byte *p = base + field->offset;
+        if (field->val_type == 's') {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(*args++, &bufinfo, MP_BUFFER_READ);
+            memcpy(p, bufinfo.buf, MIN(bufinfo.len, field->count));
+        } else {
+            for (uint32_t cnt = field->count; cnt > 0; cnt--) {
+                mp_binary_set_val(self->fmt_type, field->val_type, *args++, &p);
+            }
+        }
+    }
+}
+
+STATIC mp_obj_t struct_obj_pack(size_t n_args, const mp_obj_t *args) {
+    mp_obj_struct_t *self = MP_OBJ_TO_PTR(args[0]);
+    vstr_t vstr;
+    vstr_init_len(&vstr, self->size);
+    struct_obj_pack_internal(self, (byte *)vstr.buf, n_args - 1, &args[1]);
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(struct_obj_pack_obj, 1, MP_OBJ_FUN_ARGS_MAX, struct_obj_pack);
+
+STATIC mp_obj_t struct_obj_pack_into(size_t n_args, const mp_obj_t *args) {
+    mp_obj_struct_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[1], &bufinfo, MP_BUFFER_WRITE);
+    byte *p = struct_obj_get_ptr(self, &bufinfo, mp_obj_get_int(args[2]));
+    struct_obj_pack_internal(self, p, n_args - 3, &args[3]);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(struct_obj_pack_into_obj, 3, MP_OBJ_FUN_ARGS_MAX, struct_obj_pack_into);
+
+// unpack_from(buffer, offset=0, *, out=None)
+// With out (a list, an array, or anything supporting the item assignment) the values are stored
+// into it instead of a new tuple, so decoding the same layout repeatedly doesn't allocate.
+STATIC mp_obj_t struct_obj_unpack_from(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_buffer, ARG_offset, ARG_out };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_buffer, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_offset, MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_out, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+    mp_obj_struct_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[ARG_buffer].u_obj, &bufinfo, MP_BUFFER_READ);
+    byte *p = struct_obj_get_ptr(self, &bufinfo, args[ARG_offset].u_int);
+
+    mp_obj_t out = args[ARG_out].u_obj;
+    if (out == mp_const_none) {
+        mp_obj_tuple_t *res = MP_OBJ_TO_PTR(mp_obj_new_tuple(self->num_items, NULL));
+        struct_obj_unpack_internal(self, p, res->items, MP_OBJ_NULL);
+        return MP_OBJ_FROM_PTR(res);
+    }
+    if (MP_OBJ_IS_TYPE(out, &mp_type_list)) {
+        mp_obj_list_t *list = MP_OBJ_TO_PTR(out);
+        if (list->len < self->num_items) {
+            mp_raise_ValueError("out too small");
+        }
+        struct_obj_unpack_internal(self, p, list->items, MP_OBJ_NULL);
+    } else {
+        struct_obj_unpack_internal(self, p, NULL, out);
+    }
+    return out;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(struct_obj_unpack_from_obj, 2, struct_obj_unpack_from);
+
+STATIC mp_obj_t struct_it_iternext(mp_obj_t self_in) {
+    mp_obj_struct_it_t *self = MP_OBJ_TO_PTR(self_in);
+    // the buffer is looked up again each time, it may have been resized
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(self->buf, &bufinfo, MP_BUFFER_READ);
+    if (self->offset + self->st->size > bufinfo.len) {
+        return MP_OBJ_STOP_ITERATION;
+    }
+    mp_obj_tuple_t *res = MP_OBJ_TO_PTR(mp_obj_new_tuple(self->st->num_items, NULL));
+    struct_obj_unpack_internal(self->st, (byte *)bufinfo.buf + self->offset, res->items, MP_OBJ_NULL);
+    self->offset += self->st->size;
+    return MP_OBJ_FROM_PTR(res);
+}
+
+STATIC mp_obj_t struct_obj_iter_unpack(mp_obj_t self_in, mp_obj_t buf_in) {
+    mp_obj_struct_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+    if (self->size == 0 || (bufinfo.len % self->size) != 0) {
+        mp_raise_ValueError("buffer size must be a multiple of the struct size");
+    }
+    mp_obj_struct_it_t *o = m_new_obj(mp_obj_struct_it_t);
+    o->base.type = &mp_type_polymorph_iter;
+    o->iternext = struct_it_iternext;
+    o->st = self;
+    o->buf = buf_in;
+    o->offset = 0;
+    return MP_OBJ_FROM_PTR(o);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(struct_obj_iter_unpack_obj, struct_obj_iter_unpack);
+
+STATIC const mp_rom_map_elem_t struct_obj_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_pack), MP_ROM_PTR(&struct_obj_pack_obj) },
+    { MP_ROM_QSTR(MP_QSTR_pack_into), MP_ROM_PTR(&struct_obj_pack_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_unpack), MP_ROM_PTR(&struct_obj_unpack_from_obj) },
+    { MP_ROM_QSTR(MP_QSTR_unpack_from), MP_ROM_PTR(&struct_obj_unpack_from_obj) },
+    { MP_ROM_QSTR(MP_QSTR_iter_unpack), MP_ROM_PTR(&struct_obj_iter_unpack_obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(struct_obj_locals_dict, struct_obj_locals_dict_table);
+
+STATIC void struct_obj_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+    if (dest[0] != MP_OBJ_NULL) {
+        // not load attribute
+        return;
+    }
+    mp_obj_struct_t *self = MP_OBJ_TO_PTR(self_in);
+    if (attr == MP_QSTR_size) {
+        dest[0] = MP_OBJ_NEW_SMALL_INT(self->size);
+    } else if (attr == MP_QSTR_format) {
+        dest[0] = self->format;
+    } else {
+        mp_map_elem_t *elem = mp_map_lookup((mp_map_t *)&struct_obj_locals_dict.map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+        if (elem != NULL) {
+            mp_convert_member_lookup(self_in, self->base.type, elem->value, dest);
+        }
+    }
+}
+
+STATIC const mp_obj_type_t struct_type_Struct = {
+    { &mp_type_type },
+    .name = MP_QSTR_Struct,
+    .print = struct_obj_print,
+    .make_new = struct_obj_make_new,
+    .attr = struct_obj_attr,
+    .locals_dict = (mp_obj_dict_t *)&struct_obj_locals_dict,
+};
+
+#endif // MICROPY_PY_STRUCT_TYPE
+
 STATIC const mp_rom_map_elem_t mp_module_struct_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_ustruct) },
     { MP_ROM_QSTR(MP_QSTR_calcsize), MP_ROM_PTR(&struct_calcsize_obj) },
@@ -255,6 +531,9 @@ STATIC const mp_rom_map_elem_t mp_module_struct_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_pack_into), MP_ROM_PTR(&struct_pack_into_obj) },
     { MP_ROM_QSTR(MP_QSTR_unpack), MP_ROM_PTR(&struct_unpack_from_obj) },
     { MP_ROM_QSTR(MP_QSTR_unpack_from), MP_ROM_PTR(&struct_unpack_from_obj) },
+    #if MICROPY_PY_STRUCT_TYPE
+    { MP_ROM_QSTR(MP_QSTR_Struct), MP_ROM_PTR(&struct_type_Struct) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_struct_globals, mp_module_struct_globals_table);
@@ -29,6 +29,7 @@
 
 #include "py/runtime.h"
 #include "py/stackctrl.h"
+#include "py/mphal.h"
 
 #if MICROPY_PY_THREAD
 
@@ -42,6 +43,53 @@
 #define DEBUG_printf(...) (void)0
 #endif
 
+#if MICROPY_PY_THREAD_GIL_CONTENTION
+/****************************************************************/
+// GIL handoff
+
+// Take the GIL, letting the holder know that someone is waiting for it.  The
+// counts are only hints: should an update from another core get lost the
+// holder just gives the GIL away more often than needed.
+void mp_thread_gil_enter(void) {
+    if (!mp_thread_mutex_lock(&MP_STATE_VM(gil_mutex), 0)) {
+        bool urgent = mp_thread_is_urgent();
+        mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+        MP_STATE_VM(gil_waiting) += 1;
+        MP_STATE_VM(gil_urgent) += urgent;
+        MICROPY_END_ATOMIC_SECTION(atomic_state);
+        mp_thread_mutex_lock(&MP_STATE_VM(gil_mutex), 1);
+        atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+        MP_STATE_VM(gil_waiting) -= 1;
+        MP_STATE_VM(gil_urgent) -= urgent;
+        MICROPY_END_ATOMIC_SECTION(atomic_state);
+        MP_STATE_VM(gil_handoffs) += 1;
+    }
+    MP_STATE_VM(gil_slice_start) = mp_hal_ticks_us();
+}
+
+// Called by the VM with the GIL held, gives it away only if that lets someone run.
+void mp_thread_gil_poll(void) {
+    uint16_t waiting = MP_STATE_VM(gil_waiting);
+    if (MP_STATE_VM(gil_urgent) == 0) {
+        if (waiting == 0) {
+            // code locking gil_mutex directly is not counted, so let it in once in a while
+            if (++MP_STATE_VM(gil_idle_polls) < MICROPY_PY_THREAD_GIL_IDLE_POLLS) {
+                return;
+            }
+        } else if (mp_hal_ticks_us() - MP_STATE_VM(gil_slice_start) < MICROPY_PY_THREAD_GIL_SLICE_US) {
+            return;
+        }
+    }
+    MP_STATE_VM(gil_idle_polls) = 0;
+    MP_THREAD_GIL_EXIT();
+    if (waiting != 0) {
+        // a waiter of the same priority only gets the mutex if we step aside
+        mp_thread_yield();
+    }
+    MP_THREAD_GIL_ENTER();
+}
+#endif
+
 /****************************************************************/
 // Lock object
 
@@ -161,7 +209,9 @@ STATIC void *thread_entry(void *args_in) {
     mp_stack_set_top(&ts + 1); // need to include ts in root-pointer scan
     mp_stack_set_limit(args->stack_size);
 
-    #if MICROPY_ENABLE_PYSTACK
+    #if MICROPY_ENABLE_PYSTACK && MICROPY_PY_THREAD_PYSTACK
+    mp_thread_pystack_init();
+    #elif MICROPY_ENABLE_PYSTACK
     // TODO threading and pystack is not fully supported, for now just make a small stack
     mp_obj_t mini_pystack[128];
     mp_pystack_init(mini_pystack, &mini_pystack[128]);
@@ -171,6 +221,11 @@ STATIC void *thread_entry(void *args_in) {
     mp_locals_set(args->dict_locals);
     mp_globals_set(args->dict_globals);
 
+    #if MICROPY_GC_STATS_CALLERS
+    // no code is running in this thread yet
+    ts.current_code_state = NULL;
+    #endif
+
     MP_THREAD_GIL_ENTER();
 
     // signal that we are set up and running
@@ -278,6 +333,17 @@ STATIC mp_obj_t mod_thread_allocate_lock(void) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_thread_allocate_lock_obj, mod_thread_allocate_lock);
 
+#if MICROPY_PY_THREAD_GIL_CONTENTION
+STATIC mp_obj_t mod_thread_gil_handoffs(size_t n_args, const mp_obj_t *args) {
+    mp_obj_t ret = mp_obj_new_int_from_uint(MP_STATE_VM(gil_handoffs));
+    if (n_args == 1 && mp_obj_is_true(args[0])) {
+        MP_STATE_VM(gil_handoffs) = 0;
+    }
+    return ret;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_thread_gil_handoffs_obj, 0, 1, mod_thread_gil_handoffs);
+#endif
+
 STATIC const mp_rom_map_elem_t mp_module_thread_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR__thread) },
     { MP_ROM_QSTR(MP_QSTR_LockType), MP_ROM_PTR(&mp_type_thread_lock) },
@@ -286,6 +352,12 @@ STATIC const mp_rom_map_elem_t mp_module_thread_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_start_new_thread), MP_ROM_PTR(&mod_thread_start_new_thread_obj) },
     { MP_ROM_QSTR(MP_QSTR_exit), MP_ROM_PTR(&mod_thread_exit_obj) },
     { MP_ROM_QSTR(MP_QSTR_allocate_lock), MP_ROM_PTR(&mod_thread_allocate_lock_obj) },
+    #if MICROPY_PY_THREAD_GIL_CONTENTION
+    { MP_ROM_QSTR(MP_QSTR_gil_handoffs), MP_ROM_PTR(&mod_thread_gil_handoffs_obj) },
+    #endif
+    #ifdef MICROPY_PORT_THREAD_GLOBALS
+    MICROPY_PORT_THREAD_GLOBALS
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_thread_globals, mp_module_thread_globals_table);
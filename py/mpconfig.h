@@ -142,12 +142,82 @@
 #define MICROPY_GC_CONSERVATIVE_CLEAR (MICROPY_ENABLE_GC)
 #endif
 
+// Whether the GC heap can be made of several separate memory areas (see gc_add)
+#ifndef MICROPY_GC_SPLIT_HEAP
+#define MICROPY_GC_SPLIT_HEAP (0)
+#endif
+
+// Allocations of at least this many bytes are looked for in the areas added
+// with gc_add() before the first one, so that the first area is kept for the
+// small objects; 0 to search the areas in order for every allocation
+#ifndef MICROPY_GC_SPLIT_HEAP_LARGE_ALLOC
+#define MICROPY_GC_SPLIT_HEAP_LARGE_ALLOC (0)
+#endif
+
 // Support automatic GC when reaching allocation threshold,
 // configurable by gc.threshold().
 #ifndef MICROPY_GC_ALLOC_THRESHOLD
 #define MICROPY_GC_ALLOC_THRESHOLD (1)
 #endif
 
+// Whether a collection triggered by the allocation threshold leaves the
+// sweep to be done in slices by gc_sweep_step(), instead of sweeping the
+// whole heap before returning to the VM
+#ifndef MICROPY_GC_INCREMENTAL_SWEEP
+#define MICROPY_GC_INCREMENTAL_SWEEP (0)
+#endif
+
+// Number of blocks swept by each allocation while a sweep is pending
+#ifndef MICROPY_GC_SWEEP_STEP_BLOCKS
+#define MICROPY_GC_SWEEP_STEP_BLOCKS (256)
+#endif
+
+// Number of buckets of the GC pause time histogram returned by gc.pauses(),
+// bucket n counts the pauses shorter than 2^n ms and the last one all the
+// longer ones; 0 to disable.  Requires mp_hal_ticks_us().
+#ifndef MICROPY_GC_PAUSE_HISTOGRAM
+#define MICROPY_GC_PAUSE_HISTOGRAM (0)
+#endif
+
+// Whether to count the allocations by size class, the collections and their
+// pause times, as returned by gc.stats().  Requires mp_hal_ticks_us().
+#ifndef MICROPY_GC_STATS
+#define MICROPY_GC_STATS (0)
+#endif
+
+// Number of bytecode positions that gc.stats() keeps the allocation counts of,
+// the ones allocating the most end up being kept; 0 to disable
+#ifndef MICROPY_GC_STATS_CALLERS
+#define MICROPY_GC_STATS_CALLERS (0)
+#endif
+
+// Whether the sweep keeps up to this many dead small tuples, and str/bytes
+// objects that hold their data inline, per size of 1 or 2 blocks, for new
+// objects of the same kind to reuse without searching the heap; 0 to disable.
+// The lists are dropped at the start of each collection.
+#ifndef MICROPY_GC_FREE_LISTS
+#define MICROPY_GC_FREE_LISTS (0)
+#endif
+
+// Number of blocks of MICROPY_GC_RESERVE_BYTES that the GC keeps allocated
+// in advance, for the objects made between gc_reserve_begin() and
+// gc_reserve_end() when the heap is locked or full; 0 to disable.  They are
+// taken back from the heap by the allocations following a collection.
+#ifndef MICROPY_GC_RESERVE
+#define MICROPY_GC_RESERVE (0)
+#endif
+
+// Size of each block of the reserve, larger allocations never use it
+#ifndef MICROPY_GC_RESERVE_BYTES
+#define MICROPY_GC_RESERVE_BYTES (4 * MICROPY_BYTES_PER_GC_BLOCK)
+#endif
+
+// Expression telling whether the heap is locked for the current context only,
+// on top of gc_lock(), e.g. while a handler runs straight from an interrupt
+#ifndef MICROPY_GC_CONTEXT_LOCKED
+#define MICROPY_GC_CONTEXT_LOCKED() (0)
+#endif
+
 // Number of bytes to allocate initially when creating new chunks to store
 // interned string data.  Smaller numbers lead to more chunks being needed
 // and more wastage at the end of the chunk.  Larger numbers lead to wasted
@@ -236,6 +306,21 @@
 #define MICROPY_QSTR_BYTES_IN_HASH (2)
 #endif
 
+// Whether to look up qstrs through an open addressed hash index over all the
+// pools, instead of scanning the pools one entry at a time. The index is
+// built in the heap on the first lookup, with at least 2 slots per qstr
+#ifndef MICROPY_QSTR_HASH_INDEX
+#define MICROPY_QSTR_HASH_INDEX (0)
+#endif
+
+// Whether dict and map tables are a dense array of entries in insertion
+// order plus a compact hash index, instead of a plain open addressed table.
+// Lookups and iteration are faster and removing then adding entries again
+// doesn't rehash, for about 10% more heap taken by the tables.
+#ifndef MICROPY_MAP_COMPACT
+#define MICROPY_MAP_COMPACT (0)
+#endif
+
 // Avoid using C stack when making Python function calls. C stack still
 // may be used if there's no free heap.
 #ifndef MICROPY_STACKLESS
@@ -272,6 +357,21 @@
 #define MICROPY_PERSISTENT_CODE_SAVE (0)
 #endif
 
+// Whether .mpy files can be combined into an image in read-only memory (eg
+// flash) and imported from there without copying their bytecode to RAM
+// Requires MICROPY_PERSISTENT_CODE_LOAD
+#ifndef MICROPY_PERSISTENT_CODE_IMAGE
+#define MICROPY_PERSISTENT_CODE_IMAGE (0)
+#endif
+
+// Whether the bytecode of .py files imported or executed from a file is saved
+// in a cache file (the file name with a "c" appended) and loaded from there as
+// long as the source doesn't change
+// Requires MICROPY_PERSISTENT_CODE_LOAD, MICROPY_PERSISTENT_CODE_SAVE and a file reader
+#ifndef MICROPY_PERSISTENT_CODE_CACHE
+#define MICROPY_PERSISTENT_CODE_CACHE (0)
+#endif
+
 // Whether generated code can persist independently of the VM/runtime instance
 // This is enabled automatically when needed by other features
 #ifndef MICROPY_PERSISTENT_CODE
@@ -323,8 +423,13 @@
 #define MICROPY_EMIT_INLINE_XTENSA (0)
 #endif
 
+// Whether to emit Xtensa-Windowed native code
+#ifndef MICROPY_EMIT_XTENSAWIN
+#define MICROPY_EMIT_XTENSAWIN (0)
+#endif
+
 // Convenience definition for whether any native emitter is enabled
-#define MICROPY_EMIT_NATIVE (MICROPY_EMIT_X64 || MICROPY_EMIT_X86 || MICROPY_EMIT_THUMB || MICROPY_EMIT_ARM || MICROPY_EMIT_XTENSA)
+#define MICROPY_EMIT_NATIVE (MICROPY_EMIT_X64 || MICROPY_EMIT_X86 || MICROPY_EMIT_THUMB || MICROPY_EMIT_ARM || MICROPY_EMIT_XTENSA || MICROPY_EMIT_XTENSAWIN)
 
 // Convenience definition for whether any inline assembler emitter is enabled
 #define MICROPY_EMIT_INLINE_ASM (MICROPY_EMIT_INLINE_THUMB || MICROPY_EMIT_INLINE_XTENSA)
@@ -361,6 +466,13 @@
 #define MICROPY_COMP_CONST_LITERAL (1)
 #endif
 
+// Whether to compile a tuple of literals, eg (1, 'a', None), to a constant
+// object instead of building it each time.  The tuples are saved in .mpy
+// files, which then need a runtime with this support to load them.
+#ifndef MICROPY_COMP_CONST_TUPLE
+#define MICROPY_COMP_CONST_TUPLE (0)
+#endif
+
 // Whether to enable lookup of constants in modules; eg module.CONST
 #ifndef MICROPY_COMP_MODULE_CONST
 #define MICROPY_COMP_MODULE_CONST (0)
@@ -442,6 +554,19 @@
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (0)
 #endif
 
+// Whether to cache result of map lookups in the above bytecodes in a RAM table
+// indexed by the position of the opcode, instead of in the bytecode.  This
+// doesn't change the bytecode or .mpy format and also speeds up bytecode that
+// isn't writable (eg frozen in ROM).  Ignored if caching in bytecode is enabled.
+#ifndef MICROPY_OPT_CACHE_MAP_LOOKUP_IN_RAM
+#define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_RAM (0)
+#endif
+
+// Number of entries (one byte each) of the above table, must be a power of 2
+#ifndef MICROPY_OPT_CACHE_MAP_LOOKUP_IN_RAM_SIZE
+#define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_RAM_SIZE (256)
+#endif
+
 // Whether to use fast versions of bitwise operations (and, or, xor) when the
 // arguments are both positive.  Increases Thumb2 code size by about 250 bytes.
 #ifndef MICROPY_OPT_MPZ_BITWISE
@@ -558,6 +683,13 @@
 #define MICROPY_REPL_AUTO_INDENT (0)
 #endif
 
+// Whether the raw REPL accepts files in binary, CRC checked frames (CTRL-E F),
+// which needs the port to provide mp_hal_stdin_rx_any()
+// Depends on MICROPY_PY_UZLIB for the CRC
+#ifndef MICROPY_REPL_FILE_TRANSFER
+#define MICROPY_REPL_FILE_TRANSFER (0)
+#endif
+
 // Whether port requires event-driven REPL functions
 #ifndef MICROPY_REPL_EVENT_DRIVEN
 #define MICROPY_REPL_EVENT_DRIVEN (0)
@@ -651,6 +783,13 @@ typedef double mp_float_t;
 #define MICROPY_FLOAT_HIGH_QUALITY_HASH (0)
 #endif
 
+// Whether repr() of single precision floats prints the fewest digits that
+// read back as the same float, instead of 7 significant digits (not with
+// MICROPY_OBJ_REPR_C, whose floats are 2 bits short of single precision)
+#ifndef MICROPY_FLOAT_FORMAT_SHORTEST
+#define MICROPY_FLOAT_FORMAT_SHORTEST (0)
+#endif
+
 // Enable features which improve CPython compatibility
 // but may lead to more code size/memory usage.
 // TODO: Originally intended as generic category to not
@@ -704,9 +843,15 @@ typedef double mp_float_t;
 #define MICROPY_MODULE_FROZEN_MPY (0)
 #endif
 
+// Whether frozen .mpy modules are looked up with the sorted index that
+// tools/mpy-tool.py generates, instead of scanning all their names
+#ifndef MICROPY_MODULE_FROZEN_INDEX
+#define MICROPY_MODULE_FROZEN_INDEX (0)
+#endif
+
 // Convenience macro for whether frozen modules are supported
 #ifndef MICROPY_MODULE_FROZEN
-#define MICROPY_MODULE_FROZEN (MICROPY_MODULE_FROZEN_STR || MICROPY_MODULE_FROZEN_MPY)
+#define MICROPY_MODULE_FROZEN (MICROPY_MODULE_FROZEN_STR || MICROPY_MODULE_FROZEN_MPY || MICROPY_PERSISTENT_CODE_IMAGE)
 #endif
 
 // Whether you can override builtins in the builtins module
@@ -846,6 +991,12 @@ typedef double mp_float_t;
 #define MICROPY_PY_BUILTINS_BYTEARRAY (1)
 #endif
 
+// Whether bytearray has the bytes methods (find, split, strip, ...) and
+// split_into(), which splits it into memoryviews without copying
+#ifndef MICROPY_PY_BUILTINS_BYTEARRAY_METHODS
+#define MICROPY_PY_BUILTINS_BYTEARRAY_METHODS (0)
+#endif
+
 // Whether to support dict.fromkeys() class method
 #ifndef MICROPY_PY_BUILTINS_DICT_FROMKEYS
 #define MICROPY_PY_BUILTINS_DICT_FROMKEYS (1)
@@ -1021,6 +1172,18 @@ typedef double mp_float_t;
 #define MICROPY_PY_MICROPYTHON_STACK_USE (MICROPY_PY_MICROPYTHON_MEM_INFO)
 #endif
 
+// Number of source lines that the sampling profiler of "micropython.profile_start"
+// keeps the sample counts of, the busiest ones end up being kept; 0 to disable.
+// Requires the port to provide mp_hal_profile_timer()
+#ifndef MICROPY_PY_MICROPYTHON_PROFILE
+#define MICROPY_PY_MICROPYTHON_PROFILE (0)
+#endif
+
+// Whether to provide "micropython.template", a str.format pattern parsed once
+#ifndef MICROPY_PY_MICROPYTHON_TEMPLATE
+#define MICROPY_PY_MICROPYTHON_TEMPLATE (0)
+#endif
+
 // Whether to provide "array" module. Note that large chunk of the
 // underlying code is shared with "bytearray" builtin type, so to
 // get real savings, it should be disabled too.
@@ -1131,6 +1294,11 @@ typedef double mp_float_t;
 #define MICROPY_PY_STRUCT (1)
 #endif
 
+// Whether to provide "struct.Struct" class, with the format parsed once
+#ifndef MICROPY_PY_STRUCT_TYPE
+#define MICROPY_PY_STRUCT_TYPE (0)
+#endif
+
 // Whether to provide "sys" module
 #ifndef MICROPY_PY_SYS
 #define MICROPY_PY_SYS (1)
@@ -1221,6 +1389,30 @@ typedef double mp_float_t;
 #define MICROPY_PY_THREAD_GIL_VM_DIVISOR (32)
 #endif
 
+// Whether the VM only gives the GIL away when another thread is waiting for it,
+// rather than every time the divisor above runs out.  The port must provide
+// mp_thread_is_urgent() and mp_thread_yield() (see py/mpthread.h).
+#ifndef MICROPY_PY_THREAD_GIL_CONTENTION
+#define MICROPY_PY_THREAD_GIL_CONTENTION (0)
+#endif
+
+// Microseconds a thread may keep the GIL while others of the same priority wait
+#ifndef MICROPY_PY_THREAD_GIL_SLICE_US
+#define MICROPY_PY_THREAD_GIL_SLICE_US (10000)
+#endif
+
+// Number of divisor periods after which the GIL is released even though no
+// waiter was counted, for code that locks gil_mutex directly.
+#ifndef MICROPY_PY_THREAD_GIL_IDLE_POLLS
+#define MICROPY_PY_THREAD_GIL_IDLE_POLLS (64)
+#endif
+
+// Whether the port gives each thread a pystack of its own, with
+// mp_thread_pystack_init(), instead of a small one on the C stack
+#ifndef MICROPY_PY_THREAD_PYSTACK
+#define MICROPY_PY_THREAD_PYSTACK (0)
+#endif
+
 // Extended modules
 
 #ifndef MICROPY_PY_UCTYPES
@@ -1237,6 +1429,12 @@ typedef double mp_float_t;
 #define MICROPY_PY_UZLIB (0)
 #endif
 
+// Whether to provide uzlib.compress and the uzlib.CompIO stream compressor
+// Depends on MICROPY_PY_UZLIB
+#ifndef MICROPY_PY_UZLIB_COMPRESS
+#define MICROPY_PY_UZLIB_COMPRESS (0)
+#endif
+
 #ifndef MICROPY_PY_UJSON
 #define MICROPY_PY_UJSON (0)
 #endif
@@ -1257,6 +1455,12 @@ typedef double mp_float_t;
 #define MICROPY_PY_URE_SUB (0)
 #endif
 
+// Number of patterns the module-level ure functions keep compiled; 0 to
+// compile the pattern on each call
+#ifndef MICROPY_PY_URE_CACHE
+#define MICROPY_PY_URE_CACHE (0)
+#endif
+
 #ifndef MICROPY_PY_UHEAPQ
 #define MICROPY_PY_UHEAPQ (0)
 #endif
@@ -1266,6 +1470,11 @@ typedef double mp_float_t;
 #define MICROPY_PY_UTIMEQ (0)
 #endif
 
+// Event loop core running the coroutines from C (_uasyncio module)
+#ifndef MICROPY_PY_UASYNCIO
+#define MICROPY_PY_UASYNCIO (0)
+#endif
+
 #ifndef MICROPY_PY_UHASHLIB
 #define MICROPY_PY_UHASHLIB (0)
 #endif
@@ -1304,6 +1513,16 @@ typedef double mp_float_t;
 #define MICROPY_PY_UBINASCII_CRC32 (0)
 #endif
 
+// Whether to provide the "ucrc" module, table driven CRCs of any width
+#ifndef MICROPY_PY_UCRC
+#define MICROPY_PY_UCRC (0)
+#endif
+
+// Whether to provide the "udsp" module, numeric kernels over arrays
+#ifndef MICROPY_PY_UDSP
+#define MICROPY_PY_UDSP (0)
+#endif
+
 #ifndef MICROPY_PY_URANDOM
 #define MICROPY_PY_URANDOM (0)
 #endif
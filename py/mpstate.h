@@ -31,6 +31,7 @@
 #include "py/mpconfig.h"
 #include "py/mpthread.h"
 #include "py/misc.h"
+#include "py/gc.h"
 #include "py/nlr.h"
 #include "py/obj.h"
 #include "py/objlist.h"
@@ -61,12 +62,38 @@ typedef struct _mp_sched_item_t {
     mp_obj_t arg;
 } mp_sched_item_t;
 
-// This structure hold information about the memory allocation system.
-typedef struct _mp_state_mem_t {
-    #if MICROPY_MEM_STATS
-    size_t total_bytes_allocated;
-    size_t current_bytes_allocated;
-    size_t peak_bytes_allocated;
+#if MICROPY_PY_MICROPYTHON_PROFILE
+// samples taken while running one source line
+typedef struct _mp_profile_entry_t {
+    qstr source_file;
+    qstr block_name;
+    size_t source_line;
+    size_t count;
+} mp_profile_entry_t;
+#endif
+
+#if MICROPY_GC_STATS
+// number of size classes the allocations are counted by, class n holding the
+// allocations of up to 2^n blocks and the last one the larger ones
+#define MP_GC_STATS_SIZE_CLASSES (8)
+
+#if MICROPY_GC_STATS_CALLERS
+// allocations done by the bytecode at one position
+typedef struct _mp_gc_stats_caller_t {
+    const byte *ip;
+    qstr source_file;
+    qstr block_name;
+    size_t source_line;
+    size_t count;
+    size_t bytes;
+} mp_gc_stats_caller_t;
+#endif
+#endif
+
+// This structure holds the tables and the pool of one area of the GC heap.
+typedef struct _mp_state_mem_area_t {
+    #if MICROPY_GC_SPLIT_HEAP
+    struct _mp_state_mem_area_t *next;
     #endif
 
     byte *gc_alloc_table_start;
@@ -77,8 +104,28 @@ typedef struct _mp_state_mem_t {
     byte *gc_pool_start;
     byte *gc_pool_end;
 
+    size_t gc_last_free_atb_index;
+} mp_state_mem_area_t;
+
+// This structure hold information about the memory allocation system.
+typedef struct _mp_state_mem_t {
+    #if MICROPY_MEM_STATS
+    size_t total_bytes_allocated;
+    size_t current_bytes_allocated;
+    size_t peak_bytes_allocated;
+    #endif
+
+    // the first area of the heap, further ones are chained to it with gc_add()
+    mp_state_mem_area_t area;
+
     int gc_stack_overflow;
     MICROPY_GC_STACK_ENTRY_TYPE gc_stack[MICROPY_ALLOC_GC_STACK_SIZE];
+    #if MICROPY_GC_SPLIT_HEAP
+    mp_state_mem_area_t *gc_area_stack[MICROPY_ALLOC_GC_STACK_SIZE];
+    // set when an allocation may only go to another area than its preferred
+    // one after a collection failed to make room there, see gc_split_strict()
+    uint16_t gc_split_strict;
+    #endif
     uint16_t gc_lock_depth;
 
     // This variable controls auto garbage collection.  If set to 0 then the
@@ -91,12 +138,59 @@ typedef struct _mp_state_mem_t {
     size_t gc_alloc_threshold;
     #endif
 
-    size_t gc_last_free_atb_index;
-
     #if MICROPY_PY_GC_COLLECT_RETVAL
     size_t gc_collected;
     #endif
 
+    #if MICROPY_GC_INCREMENTAL_SWEEP
+    // area and block the pending sweep carries on from, area is NULL when
+    // there is nothing left to sweep
+    mp_state_mem_area_t *gc_sweep_area;
+    size_t gc_sweep_block;
+    // set while a collection is allowed to leave its sweep pending
+    uint16_t gc_sweep_deferred;
+    #endif
+
+    #if MICROPY_GC_PAUSE_HISTOGRAM || MICROPY_GC_STATS
+    mp_uint_t gc_pause_start;
+    #endif
+
+    #if MICROPY_GC_PAUSE_HISTOGRAM
+    uint32_t gc_pause_hist[MICROPY_GC_PAUSE_HISTOGRAM];
+    #endif
+
+    #if MICROPY_GC_FREE_LISTS
+    // singly linked through their first word, by kind and number of blocks
+    void *gc_free_list[GC_FREE_LIST_NUM_KINDS][GC_FREE_LIST_MAX_BLOCKS];
+    uint16_t gc_free_list_len[GC_FREE_LIST_NUM_KINDS][GC_FREE_LIST_MAX_BLOCKS];
+    #endif
+
+    #if MICROPY_GC_RESERVE
+    // allocated blocks, the first gc_reserve_len ones are held for the taking
+    void *gc_reserve[MICROPY_GC_RESERVE];
+    uint16_t gc_reserve_len;
+    uint16_t gc_reserve_target;
+    uint16_t gc_reserve_depth;
+    // set when a refill may find room, after a collection or a take
+    uint16_t gc_reserve_refill;
+    size_t gc_reserve_taken;
+    #endif
+
+    #if MICROPY_GC_STATS
+    #if MICROPY_GC_FREE_LISTS
+    size_t gc_stats_free_list_hits[GC_FREE_LIST_NUM_KINDS];
+    size_t gc_stats_free_list_misses[GC_FREE_LIST_NUM_KINDS];
+    #endif
+    size_t gc_stats_allocs[MP_GC_STATS_SIZE_CLASSES];
+    size_t gc_stats_bytes[MP_GC_STATS_SIZE_CLASSES];
+    size_t gc_stats_collections;
+    uint64_t gc_stats_pause_total_us;
+    mp_uint_t gc_stats_pause_max_us;
+    #if MICROPY_GC_STATS_CALLERS
+    mp_gc_stats_caller_t gc_stats_callers[MICROPY_GC_STATS_CALLERS];
+    #endif
+    #endif
+
     #if MICROPY_PY_THREAD
     // This is a global mutex used to make the GC thread-safe.
     mp_thread_mutex_t gc_mutex;
@@ -178,11 +272,19 @@ typedef struct _mp_state_vm_t {
     mp_obj_t lwip_slip_stream;
     #endif
 
+    #if MICROPY_PY_URE && MICROPY_PY_URE_CACHE
+    mp_obj_t ure_cache[MICROPY_PY_URE_CACHE * 2];
+    #endif
+
     #if MICROPY_VFS
     struct _mp_vfs_mount_t *vfs_cur;
     struct _mp_vfs_mount_t *vfs_mount_table;
     #endif
 
+    #if MICROPY_QSTR_HASH_INDEX
+    uint16_t *qstr_index;
+    #endif
+
     //
     // END ROOT POINTER SECTION
     ////////////////////////////////////////////////////////////
@@ -193,6 +295,14 @@ typedef struct _mp_state_vm_t {
     size_t qstr_last_alloc;
     size_t qstr_last_used;
 
+    #if MICROPY_QSTR_HASH_INDEX
+    // slots in qstr_index, and the number of qstrs it was (tried to be) built for
+    size_t qstr_index_alloc;
+    size_t qstr_index_total;
+    size_t qstr_index_lookups;
+    size_t qstr_index_probes;
+    #endif
+
     #if MICROPY_PY_THREAD
     // This is a global mutex used to make qstr interning thread-safe.
     mp_thread_mutex_t qstr_mutex;
@@ -213,9 +323,24 @@ typedef struct _mp_state_vm_t {
     uint8_t sched_idx;
     #endif
 
+    #if MICROPY_PY_MICROPYTHON_PROFILE
+    // set by the timer, the VM takes the sample at its next pending check
+    volatile uint8_t profile_pending;
+    volatile mp_uint_t profile_ticks;
+    mp_profile_entry_t profile_entries[MICROPY_PY_MICROPYTHON_PROFILE];
+    #endif
+
     #if MICROPY_PY_THREAD_GIL
     // This is a global mutex used to make the VM/runtime thread-safe.
     mp_thread_mutex_t gil_mutex;
+    #if MICROPY_PY_THREAD_GIL_CONTENTION
+    // threads blocked on gil_mutex, and those of them that mustn't wait for a slice
+    volatile uint16_t gil_waiting;
+    volatile uint16_t gil_urgent;
+    uint16_t gil_idle_polls;
+    mp_uint_t gil_slice_start;
+    mp_uint_t gil_handoffs;
+    #endif
     #endif
 } mp_state_vm_t;
 
@@ -235,6 +360,11 @@ typedef struct _mp_state_thread_t {
     uint8_t *pystack_cur;
     #endif
 
+    #if MICROPY_GC_STATS_CALLERS
+    // the code run by the innermost call of the VM, or NULL
+    struct _mp_code_state_t *current_code_state;
+    #endif
+
     ////////////////////////////////////////////////////////////
     // START ROOT POINTER SECTION
     // Everything that needs GC scanning must start here, and
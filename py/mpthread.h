@@ -26,6 +26,8 @@
 #ifndef MICROPY_INCLUDED_PY_MPTHREAD_H
 #define MICROPY_INCLUDED_PY_MPTHREAD_H
 
+#include <stdbool.h>
+
 #include "py/mpconfig.h"
 
 #if MICROPY_PY_THREAD
@@ -46,12 +48,25 @@ void mp_thread_finish(void);
 void mp_thread_mutex_init(mp_thread_mutex_t *mutex);
 int mp_thread_mutex_lock(mp_thread_mutex_t *mutex, int wait);
 void mp_thread_mutex_unlock(mp_thread_mutex_t *mutex);
+#if MICROPY_ENABLE_PYSTACK && MICROPY_PY_THREAD_PYSTACK
+void mp_thread_pystack_init(void);
+#endif
 
 #endif // MICROPY_PY_THREAD
 
 #if MICROPY_PY_THREAD && MICROPY_PY_THREAD_GIL
 #include "py/mpstate.h"
+#if MICROPY_PY_THREAD_GIL_CONTENTION
+// provided by the port: whether the calling thread must get the GIL without
+// waiting for the holder's time slice, and a yield to the other ready threads
+bool mp_thread_is_urgent(void);
+void mp_thread_yield(void);
+void mp_thread_gil_enter(void);
+void mp_thread_gil_poll(void);
+#define MP_THREAD_GIL_ENTER() mp_thread_gil_enter()
+#else
 #define MP_THREAD_GIL_ENTER() mp_thread_mutex_lock(&MP_STATE_VM(gil_mutex), 1)
+#endif
 #define MP_THREAD_GIL_EXIT() mp_thread_mutex_unlock(&MP_STATE_VM(gil_mutex))
 #else
 #define MP_THREAD_GIL_ENTER()
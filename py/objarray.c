@@ -538,6 +538,77 @@ STATIC const mp_rom_map_elem_t array_locals_dict_table[] = {
 STATIC MP_DEFINE_CONST_DICT(array_locals_dict, array_locals_dict_table);
 #endif
 
+#if MICROPY_PY_BUILTINS_BYTEARRAY && MICROPY_PY_BUILTINS_BYTEARRAY_METHODS
+#if MICROPY_PY_BUILTINS_MEMORYVIEW
+// split_into(sep, out): clear the list out and fill it with a memoryview of
+// each piece of the bytearray ending with sep, sep excluded, and return the
+// number of bytes these pieces and their separators take.  Whatever is left
+// is an incomplete piece, e.g. a partial line, that isn't added.  The views
+// share the data, so they are only good until the bytearray is resized.
+STATIC mp_obj_t bytearray_split_into(mp_obj_t self_in, mp_obj_t sep_in, mp_obj_t out_in) {
+    mp_obj_array_t *self = MP_OBJ_TO_PTR(self_in);
+    if (!mp_obj_is_type(out_in, &mp_type_list)) {
+        mp_raise_TypeError(NULL);
+    }
+    mp_buffer_info_t sep;
+    mp_get_buffer_raise(sep_in, &sep, MP_BUFFER_READ);
+    if (sep.len == 0) {
+        mp_raise_ValueError("empty separator");
+    }
+
+    mp_obj_list_set_len(out_in, 0);
+    const byte *data = self->items;
+    size_t start = 0;
+    for (;;) {
+        const byte *p = find_subbytes(data + start, self->len - start, sep.buf, sep.len, 1);
+        if (p == NULL) {
+            break;
+        }
+        size_t end = p - data;
+        mp_obj_array_t *view = MP_OBJ_TO_PTR(mp_obj_new_memoryview(BYTEARRAY_TYPECODE | MP_OBJ_ARRAY_TYPECODE_FLAG_RW,
+            end - start, self->items));
+        view->memview_offset = start;
+        mp_obj_list_append(out_in, MP_OBJ_FROM_PTR(view));
+        start = end + sep.len;
+    }
+    return MP_OBJ_NEW_SMALL_INT(start);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(bytearray_split_into_obj, bytearray_split_into);
+#endif
+
+// bytearray also has the bytes methods, which take it as a buffer
+STATIC const mp_rom_map_elem_t bytearray_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_append), MP_ROM_PTR(&array_append_obj) },
+    { MP_ROM_QSTR(MP_QSTR_extend), MP_ROM_PTR(&array_extend_obj) },
+    #if MICROPY_CPYTHON_COMPAT
+    { MP_ROM_QSTR(MP_QSTR_decode), MP_ROM_PTR(&bytes_decode_obj) },
+    #endif
+    { MP_ROM_QSTR(MP_QSTR_find), MP_ROM_PTR(&str_find_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rfind), MP_ROM_PTR(&str_rfind_obj) },
+    { MP_ROM_QSTR(MP_QSTR_index), MP_ROM_PTR(&str_index_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rindex), MP_ROM_PTR(&str_rindex_obj) },
+    { MP_ROM_QSTR(MP_QSTR_split), MP_ROM_PTR(&str_split_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rsplit), MP_ROM_PTR(&str_rsplit_obj) },
+    #if MICROPY_PY_BUILTINS_MEMORYVIEW
+    { MP_ROM_QSTR(MP_QSTR_split_into), MP_ROM_PTR(&bytearray_split_into_obj) },
+    #endif
+    { MP_ROM_QSTR(MP_QSTR_startswith), MP_ROM_PTR(&str_startswith_obj) },
+    { MP_ROM_QSTR(MP_QSTR_endswith), MP_ROM_PTR(&str_endswith_obj) },
+    { MP_ROM_QSTR(MP_QSTR_strip), MP_ROM_PTR(&str_strip_obj) },
+    { MP_ROM_QSTR(MP_QSTR_lstrip), MP_ROM_PTR(&str_lstrip_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rstrip), MP_ROM_PTR(&str_rstrip_obj) },
+    #if MICROPY_PY_BUILTINS_STR_COUNT
+    { MP_ROM_QSTR(MP_QSTR_count), MP_ROM_PTR(&str_count_obj) },
+    #endif
+    #if MICROPY_PY_BUILTINS_STR_PARTITION
+    { MP_ROM_QSTR(MP_QSTR_partition), MP_ROM_PTR(&str_partition_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rpartition), MP_ROM_PTR(&str_rpartition_obj) },
+    #endif
+};
+
+STATIC MP_DEFINE_CONST_DICT(bytearray_locals_dict, bytearray_locals_dict_table);
+#endif
+
 #if MICROPY_PY_ARRAY
 const mp_obj_type_t mp_type_array = {
     { &mp_type_type },
@@ -564,7 +635,11 @@ const mp_obj_type_t mp_type_bytearray = {
     .binary_op = array_binary_op,
     .subscr = array_subscr,
     .buffer_p = { .get_buffer = array_get_buffer },
+    #if MICROPY_PY_BUILTINS_BYTEARRAY_METHODS
+    .locals_dict = (mp_obj_dict_t*)&bytearray_locals_dict,
+    #else
     .locals_dict = (mp_obj_dict_t*)&array_locals_dict,
+    #endif
 };
 #endif
 
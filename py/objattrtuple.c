@@ -25,6 +25,7 @@
  */
 
 #include "py/objtuple.h"
+#include "py/gc.h"
 
 #if MICROPY_PY_ATTRTUPLE || MICROPY_PY_COLLECTIONS
 
@@ -71,7 +72,14 @@ STATIC void mp_obj_attrtuple_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
 }
 
 mp_obj_t mp_obj_new_attrtuple(const qstr *fields, size_t n, const mp_obj_t *items) {
+    #if MICROPY_GC_FREE_LISTS
+    mp_obj_tuple_t *o = gc_free_list_alloc(GC_FREE_LIST_TUPLE, sizeof(mp_obj_tuple_t) + (n + 1) * sizeof(mp_obj_t));
+    if (o == NULL) {
+        o = m_new_obj_var(mp_obj_tuple_t, mp_obj_t, n + 1);
+    }
+    #else
     mp_obj_tuple_t *o = m_new_obj_var(mp_obj_tuple_t, mp_obj_t, n + 1);
+    #endif
     o->base.type = &mp_type_attrtuple;
     o->len = n;
     for (size_t i = 0; i < n; i++) {
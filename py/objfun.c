@@ -170,6 +170,16 @@ qstr mp_obj_fun_get_name(mp_const_obj_t fun_in) {
     return mp_obj_code_get_name(bc);
 }
 
+// whether fun is a function compiled with the native or viper emitter
+bool mp_obj_fun_is_native(mp_const_obj_t fun) {
+    #if MICROPY_EMIT_NATIVE
+    return mp_obj_get_type(fun) == &mp_type_fun_native;
+    #else
+    (void)fun;
+    return false;
+    #endif
+}
+
 #if MICROPY_CPYTHON_COMPAT
 STATIC void fun_bc_print(const mp_print_t *print, mp_obj_t o_in, mp_print_kind_t kind) {
     (void)kind;
@@ -418,6 +418,40 @@ const byte *str_index_to_ptr(const mp_obj_type_t *type, const byte *self_data, s
 }
 #endif
 
+// The bytes methods take any object with the buffer protocol as argument, so
+// that a bytearray or memoryview slice needn't be copied into a bytes first,
+// and bytearray shares them too.  Their results are always bytes.
+STATIC const mp_obj_type_t *str_get_self_data(mp_obj_t self_in, const byte **data, size_t *len) {
+    if (mp_obj_is_str_or_bytes(self_in)) {
+        GET_STR_DATA_LEN(self_in, str_data, str_len);
+        *data = str_data;
+        *len = str_len;
+        return mp_obj_get_type(self_in);
+    }
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(self_in, &bufinfo, MP_BUFFER_READ);
+    *data = bufinfo.buf;
+    *len = bufinfo.len;
+    return &mp_type_bytes;
+}
+
+STATIC const byte *str_get_arg_data(const mp_obj_type_t *self_type, mp_obj_t arg, size_t *len) {
+    if (self_type == &mp_type_str || mp_obj_is_str(arg)) {
+        if (mp_obj_get_type(arg) != self_type) {
+            bad_implicit_conversion(arg);
+        }
+        GET_STR_DATA_LEN(arg, str_data, str_len);
+        *len = str_len;
+        return str_data;
+    }
+    mp_buffer_info_t bufinfo;
+    if (!mp_get_buffer(arg, &bufinfo, MP_BUFFER_READ)) {
+        bad_implicit_conversion(arg);
+    }
+    *len = bufinfo.len;
+    return bufinfo.buf;
+}
+
 // This is used for both bytes and 8-bit strings. This is not used for unicode strings.
 STATIC mp_obj_t bytes_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value) {
     mp_obj_type_t *type = mp_obj_get_type(self_in);
@@ -497,7 +531,9 @@ STATIC mp_obj_t str_join(mp_obj_t self_in, mp_obj_t arg) {
 MP_DEFINE_CONST_FUN_OBJ_2(str_join_obj, str_join);
 
 mp_obj_t mp_obj_str_split(size_t n_args, const mp_obj_t *args) {
-    const mp_obj_type_t *self_type = mp_obj_get_type(args[0]);
+    const byte *s;
+    size_t len;
+    const mp_obj_type_t *self_type = str_get_self_data(args[0], &s, &len);
     mp_int_t splits = -1;
     mp_obj_t sep = mp_const_none;
     if (n_args > 1) {
@@ -508,7 +544,6 @@ mp_obj_t mp_obj_str_split(size_t n_args, const mp_obj_t *args) {
     }
 
     mp_obj_t res = mp_obj_new_list(0, NULL);
-    GET_STR_DATA_LEN(args[0], s, len);
     const byte *top = s + len;
 
     if (sep == mp_const_none) {
@@ -535,12 +570,8 @@ mp_obj_t mp_obj_str_split(size_t n_args, const mp_obj_t *args) {
 
     } else {
         // sep given
-        if (mp_obj_get_type(sep) != self_type) {
-            bad_implicit_conversion(sep);
-        }
-
         size_t sep_len;
-        const char *sep_str = mp_obj_str_get_data(sep, &sep_len);
+        const byte *sep_str = str_get_arg_data(self_type, sep, &sep_len);
 
         if (sep_len == 0) {
             mp_raise_ValueError("empty separator");
@@ -625,9 +656,10 @@ STATIC mp_obj_t str_rsplit(size_t n_args, const mp_obj_t *args) {
         // we split.
         return mp_obj_str_split(n_args, args);
     }
-    const mp_obj_type_t *self_type = mp_obj_get_type(args[0]);
+    const byte *s;
+    size_t len;
+    const mp_obj_type_t *self_type = str_get_self_data(args[0], &s, &len);
     mp_obj_t sep = args[1];
-    GET_STR_DATA_LEN(args[0], s, len);
 
     mp_int_t splits = mp_obj_get_int(args[2]);
     if (splits < 0) {
@@ -645,7 +677,7 @@ STATIC mp_obj_t str_rsplit(size_t n_args, const mp_obj_t *args) {
         mp_raise_NotImplementedError("rsplit(None,n)");
     } else {
         size_t sep_len;
-        const char *sep_str = mp_obj_str_get_data(sep, &sep_len);
+        const byte *sep_str = str_get_arg_data(self_type, sep, &sep_len);
 
         if (sep_len == 0) {
             mp_raise_ValueError("empty separator");
@@ -685,16 +717,11 @@ STATIC mp_obj_t str_rsplit(size_t n_args, const mp_obj_t *args) {
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(str_rsplit_obj, 1, 3, str_rsplit);
 
 STATIC mp_obj_t str_finder(size_t n_args, const mp_obj_t *args, int direction, bool is_index) {
-    const mp_obj_type_t *self_type = mp_obj_get_type(args[0]);
-    mp_check_self(mp_obj_is_str_or_bytes(args[0]));
-
-    // check argument type
-    if (mp_obj_get_type(args[1]) != self_type) {
-        bad_implicit_conversion(args[1]);
-    }
-
-    GET_STR_DATA_LEN(args[0], haystack, haystack_len);
-    GET_STR_DATA_LEN(args[1], needle, needle_len);
+    const byte *haystack;
+    size_t haystack_len;
+    const mp_obj_type_t *self_type = str_get_self_data(args[0], &haystack, &haystack_len);
+    size_t needle_len;
+    const byte *needle = str_get_arg_data(self_type, args[1], &needle_len);
 
     const byte *start = haystack;
     const byte *end = haystack + haystack_len;
@@ -749,12 +776,23 @@ STATIC mp_obj_t str_rindex(size_t n_args, const mp_obj_t *args) {
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(str_rindex_obj, 2, 4, str_rindex);
 
+// str and bytes have always taken each other as prefix or suffix
+STATIC const byte *str_get_affix_data(const mp_obj_type_t *self_type, mp_obj_t arg, size_t *len) {
+    if (mp_obj_is_str_or_bytes(arg)) {
+        GET_STR_DATA_LEN(arg, str_data, str_len);
+        *len = str_len;
+        return str_data;
+    }
+    return str_get_arg_data(self_type, arg, len);
+}
+
 // TODO: (Much) more variety in args
 STATIC mp_obj_t str_startswith(size_t n_args, const mp_obj_t *args) {
-    const mp_obj_type_t *self_type = mp_obj_get_type(args[0]);
-    GET_STR_DATA_LEN(args[0], str, str_len);
+    const byte *str;
+    size_t str_len;
+    const mp_obj_type_t *self_type = str_get_self_data(args[0], &str, &str_len);
     size_t prefix_len;
-    const char *prefix = mp_obj_str_get_data(args[1], &prefix_len);
+    const byte *prefix = str_get_affix_data(self_type, args[1], &prefix_len);
     const byte *start = str;
     if (n_args > 2) {
         start = str_index_to_ptr(self_type, str, str_len, args[2], true);
@@ -767,9 +805,11 @@ STATIC mp_obj_t str_startswith(size_t n_args, const mp_obj_t *args) {
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(str_startswith_obj, 2, 3, str_startswith);
 
 STATIC mp_obj_t str_endswith(size_t n_args, const mp_obj_t *args) {
-    GET_STR_DATA_LEN(args[0], str, str_len);
+    const byte *str;
+    size_t str_len;
+    const mp_obj_type_t *self_type = str_get_self_data(args[0], &str, &str_len);
     size_t suffix_len;
-    const char *suffix = mp_obj_str_get_data(args[1], &suffix_len);
+    const byte *suffix = str_get_affix_data(self_type, args[1], &suffix_len);
     if (n_args > 2) {
         mp_raise_NotImplementedError("start/end indices");
     }
@@ -784,8 +824,9 @@ MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(str_endswith_obj, 2, 3, str_endswith);
 enum { LSTRIP, RSTRIP, STRIP };
 
 STATIC mp_obj_t str_uni_strip(int type, size_t n_args, const mp_obj_t *args) {
-    mp_check_self(mp_obj_is_str_or_bytes(args[0]));
-    const mp_obj_type_t *self_type = mp_obj_get_type(args[0]);
+    const byte *orig_str;
+    size_t orig_str_len;
+    const mp_obj_type_t *self_type = str_get_self_data(args[0], &orig_str, &orig_str_len);
 
     const byte *chars_to_del;
     uint chars_to_del_len;
@@ -795,16 +836,11 @@ STATIC mp_obj_t str_uni_strip(int type, size_t n_args, const mp_obj_t *args) {
         chars_to_del = whitespace;
         chars_to_del_len = sizeof(whitespace) - 1;
     } else {
-        if (mp_obj_get_type(args[1]) != self_type) {
-            bad_implicit_conversion(args[1]);
-        }
-        GET_STR_DATA_LEN(args[1], s, l);
-        chars_to_del = s;
+        size_t l;
+        chars_to_del = str_get_arg_data(self_type, args[1], &l);
         chars_to_del_len = l;
     }
 
-    GET_STR_DATA_LEN(args[0], orig_str, orig_str_len);
-
     size_t first_good_char_pos = 0;
     bool first_good_char_pos_set = false;
     size_t last_good_char_pos = 0;
@@ -845,9 +881,8 @@ STATIC mp_obj_t str_uni_strip(int type, size_t n_args, const mp_obj_t *args) {
     assert(last_good_char_pos >= first_good_char_pos);
     //+1 to accommodate the last character
     size_t stripped_len = last_good_char_pos - first_good_char_pos + 1;
-    if (stripped_len == orig_str_len) {
+    if (stripped_len == orig_str_len && mp_obj_is_str_or_bytes(args[0])) {
         // If nothing was stripped, don't bother to dup original string
-        // TODO: watch out for this case when we'll get to bytearray.strip()
         assert(first_good_char_pos == 0);
         return args[0];
     }
@@ -941,6 +976,35 @@ STATIC NORETURN void terse_str_format_value_error(void) {
 #define terse_str_format_value_error()
 #endif
 
+// Appends the digits of a small int, the common case of the "{}", "%d" and "%x"
+// fields, without going through the padding and bignum logic of mp_print_mp_int
+STATIC void str_add_small_int(vstr_t *vstr, mp_int_t val, unsigned int base, char base_char) {
+    char buf[sizeof(mp_int_t) * 8 + 1];
+    char *p = buf + sizeof(buf);
+    mp_uint_t u = val < 0 ? -(mp_uint_t)val : (mp_uint_t)val;
+    do {
+        unsigned int d = u % base;
+        *--p = d < 10 ? '0' + d : base_char + d - 10;
+        u /= base;
+    } while (u != 0);
+    if (val < 0) {
+        *--p = '-';
+    }
+    vstr_add_strn(vstr, p, buf + sizeof(buf) - p);
+}
+
+// A field without format spec or conversion, the str() of arg
+STATIC void str_add_plain(vstr_t *vstr, const mp_print_t *print, mp_obj_t arg) {
+    if (mp_obj_is_str(arg)) {
+        GET_STR_DATA_LEN(arg, s, slen);
+        vstr_add_strn(vstr, (const char*)s, slen);
+    } else if (mp_obj_is_small_int(arg)) {
+        str_add_small_int(vstr, MP_OBJ_SMALL_INT_VALUE(arg), 10, 'a');
+    } else {
+        mp_obj_print_helper(print, arg, PRINT_STR);
+    }
+}
+
 STATIC vstr_t mp_obj_str_format_helper(const char *str, const char *top, int *arg_i, size_t n_args, const mp_obj_t *args, mp_map_t *kwargs) {
     vstr_t vstr;
     mp_print_t print;
@@ -960,7 +1024,12 @@ STATIC vstr_t mp_obj_str_format_helper(const char *str, const char *top, int *ar
             }
         }
         if (*str != '{') {
-            vstr_add_byte(&vstr, *str);
+            // copy the literal text up to the next field in one go
+            const char *lit = str;
+            while (str + 1 < top && str[1] != '{' && str[1] != '}') {
+                str++;
+            }
+            vstr_add_strn(&vstr, lit, str + 1 - lit);
             continue;
         }
 
@@ -1093,7 +1162,9 @@ STATIC vstr_t mp_obj_str_format_helper(const char *str, const char *top, int *ar
             (*arg_i)++;
         }
         if (!format_spec && !conversion) {
-            conversion = 's';
+            // a plain {} goes straight into the result, no intermediate str
+            str_add_plain(&vstr, &print, arg);
+            continue;
         }
         if (conversion) {
             mp_print_kind_t print_kind;
@@ -1128,9 +1199,18 @@ STATIC vstr_t mp_obj_str_format_helper(const char *str, const char *top, int *ar
             // precision   ::=  integer
             // type        ::=  "b" | "c" | "d" | "e" | "E" | "f" | "F" | "g" | "G" | "n" | "o" | "s" | "x" | "X" | "%"
 
-            // recursively call the formatter to format any nested specifiers
-            MP_STACK_CHECK();
-            vstr_t format_spec_vstr = mp_obj_str_format_helper(format_spec, str, arg_i, n_args, args, kwargs);
+            // recursively call the formatter to format any nested specifiers,
+            // a short spec without any is parsed from a copy on the stack
+            char format_spec_buf[16];
+            vstr_t format_spec_vstr;
+            if ((size_t)(str - format_spec) < sizeof(format_spec_buf)
+                && memchr(format_spec, '{', str - format_spec) == NULL) {
+                vstr_init_fixed_buf(&format_spec_vstr, sizeof(format_spec_buf), format_spec_buf);
+                vstr_add_strn(&format_spec_vstr, format_spec, str - format_spec);
+            } else {
+                MP_STACK_CHECK();
+                format_spec_vstr = mp_obj_str_format_helper(format_spec, str, arg_i, n_args, args, kwargs);
+            }
             const char *s = vstr_null_terminated_str(&format_spec_vstr);
             const char *stop = s + format_spec_vstr.len;
             if (isalignment(*s)) {
@@ -1401,12 +1481,18 @@ STATIC mp_obj_t str_modulo_format(mp_obj_t pattern, size_t n_args, const mp_obj_
     size_t arg_i = 0;
     vstr_t vstr;
     mp_print_t print;
-    vstr_init_print(&vstr, 16, &print);
+    vstr_init_print(&vstr, len + 16, &print);
 
     for (const byte *top = str + len; str < top; str++) {
         mp_obj_t arg = MP_OBJ_NULL;
         if (*str != '%') {
-            vstr_add_byte(&vstr, *str);
+            // copy the literal text up to the next conversion in one go
+            const byte *pct = memchr(str, '%', top - str);
+            if (pct == NULL) {
+                pct = top;
+            }
+            vstr_add_strn(&vstr, (const char*)str, pct - str);
+            str = pct - 1;
             continue;
         }
         if (++str >= top) {
@@ -1499,6 +1585,22 @@ not_enough_args:
             }
             arg = args[arg_i++];
         }
+
+        // the bare %d, %x and %s of a small int or a str skip the padding logic
+        if (flags == 0 && width == 0 && prec < 0 && alt == 0) {
+            if (mp_obj_is_small_int(arg) && (*str == 'd' || *str == 'i' || *str == 'u')) {
+                str_add_small_int(&vstr, MP_OBJ_SMALL_INT_VALUE(arg), 10, 'a');
+                continue;
+            } else if (mp_obj_is_small_int(arg) && (*str == 'x' || *str == 'X')) {
+                str_add_small_int(&vstr, MP_OBJ_SMALL_INT_VALUE(arg), 16, *str - ('X' - 'A'));
+                continue;
+            } else if (mp_obj_is_str(arg) && *str == 's') {
+                GET_STR_DATA_LEN(arg, s, slen);
+                vstr_add_strn(&vstr, (const char*)s, slen);
+                continue;
+            }
+        }
+
         switch (*str) {
             case 'c':
                 if (mp_obj_is_str(arg)) {
@@ -1589,6 +1691,274 @@ not_enough_args:
 }
 #endif
 
+#if MICROPY_PY_MICROPYTHON_TEMPLATE
+// micropython.template(fmt), a format string parsed once whose format() only
+// walks the cached fields. It takes the subset of str.format used for building
+// telemetry lines: {} or {N} with an optional [0][width][.precision][d|x|X|f|s]
+
+typedef struct _mp_str_template_field_t {
+    uint16_t lit_len;       // the literal text before the field
+    uint8_t arg;
+    char type;              // '\0' for a plain {}, MP_STR_TEMPLATE_END for the trailing text
+    char fill;
+    int8_t width;           // -1 if not given
+    int8_t prec;            // -1 if not given
+} mp_str_template_field_t;
+
+typedef struct _mp_obj_str_template_t {
+    mp_obj_base_t base;
+    mp_obj_t pattern;
+    const char *lit;        // the literals one after another, the {{ and }} escapes resolved
+    size_t size_hint;       // the length of the last result, to presize the next one
+    uint16_t n_fields;
+    uint16_t n_args;
+    mp_str_template_field_t fields[];
+} mp_obj_str_template_t;
+
+#define MP_STR_TEMPLATE_END     (1)
+
+STATIC NORETURN void str_template_bad_spec(void) {
+    if (MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_TERSE) {
+        terse_str_format_value_error();
+    } else {
+        mp_raise_ValueError("unsupported template field");
+    }
+}
+
+STATIC NORETURN void str_template_bad_arg(char type, mp_obj_t arg) {
+    if (MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_TERSE) {
+        terse_str_format_value_error();
+    } else {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError,
+            "unknown format code '%c' for object of type '%s'",
+            type, mp_obj_get_type_str(arg)));
+    }
+}
+
+STATIC const char *str_template_parse_int(const char *str, const char *top, int max, int *num) {
+    if (str >= top || !unichar_isdigit(*str)) {
+        str_template_bad_spec();
+    }
+    *num = 0;
+    for (; str < top && unichar_isdigit(*str); str++) {
+        *num = *num * 10 + (*str - '0');
+        if (*num > max) {
+            str_template_bad_spec();
+        }
+    }
+    return str;
+}
+
+STATIC mp_obj_t str_template_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 1, 1, false);
+    size_t len;
+    const char *str = mp_obj_str_get_data(args[0], &len);
+    const char *top = str + len;
+    if (len > 0xffff) {
+        str_template_bad_spec();
+    }
+
+    // at most one field per '{', plus the trailing text
+    size_t n_fields = 1;
+    for (const char *s = str; (s = memchr(s, '{', top - s)) != NULL; s++) {
+        n_fields++;
+    }
+    mp_obj_str_template_t *o = m_new_obj_var(mp_obj_str_template_t, mp_str_template_field_t, n_fields);
+    o->base.type = type;
+    o->pattern = args[0];
+    char *lit = m_new(char, len);
+    o->lit = lit;
+    o->n_fields = 0;
+    o->n_args = 0;
+
+    size_t lit_len = 0;
+    int arg_i = 0;          // -1 once a field was numbered
+    while (str < top) {
+        char c = *str++;
+        if (c != '{' && c != '}') {
+            *lit++ = c;
+            lit_len++;
+            continue;
+        }
+        if (str < top && *str == c) {
+            *lit++ = *str++;
+            lit_len++;
+            continue;
+        }
+        if (c == '}') {
+            str_template_bad_spec();
+        }
+
+        mp_str_template_field_t *f = &o->fields[o->n_fields++];
+        f->lit_len = lit_len;
+        lit_len = 0;
+        f->type = '\0';
+        f->fill = ' ';
+        f->width = -1;
+        f->prec = -1;
+
+        int num;
+        if (str < top && unichar_isdigit(*str)) {
+            if (arg_i > 0) {
+                str_template_bad_spec();
+            }
+            str = str_template_parse_int(str, top, 0xff, &num);
+            arg_i = -1;
+        } else {
+            if (arg_i < 0 || arg_i > 0xff) {
+                str_template_bad_spec();
+            }
+            num = arg_i++;
+        }
+        f->arg = num;
+        if (num >= o->n_args) {
+            o->n_args = num + 1;
+        }
+
+        if (str < top && *str == ':') {
+            str++;
+            if (str < top && *str == '0') {
+                f->fill = '0';
+                str++;
+            }
+            if (str < top && unichar_isdigit(*str)) {
+                str = str_template_parse_int(str, top, 127, &num);
+                f->width = num;
+            }
+            if (str < top && *str == '.') {
+                str = str_template_parse_int(str + 1, top, 127, &num);
+                f->prec = num;
+            }
+            if (str < top && *str != '}') {
+                f->type = *str++;
+            }
+            switch (f->type) {
+                case 'd':
+                case 'x':
+                case 'X':
+                    if (f->prec >= 0) {
+                        str_template_bad_spec();
+                    }
+                    break;
+                #if MICROPY_PY_BUILTINS_FLOAT
+                case 'f':
+                    break;
+                #endif
+                case 's':
+                    if (f->fill == '0') {
+                        str_template_bad_spec();
+                    }
+                    break;
+                default:
+                    // only the bare {} takes no type
+                    str_template_bad_spec();
+            }
+        }
+        if (str >= top || *str++ != '}') {
+            str_template_bad_spec();
+        }
+    }
+
+    mp_str_template_field_t *f = &o->fields[o->n_fields++];
+    f->lit_len = lit_len;
+    f->type = MP_STR_TEMPLATE_END;
+    o->size_hint = lit - o->lit + 8 * (o->n_fields - 1);
+    return MP_OBJ_FROM_PTR(o);
+}
+
+STATIC void str_template_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    (void)kind;
+    mp_obj_str_template_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_print_str(print, "template(");
+    mp_obj_print_helper(print, self->pattern, PRINT_REPR);
+    mp_print_str(print, ")");
+}
+
+STATIC mp_obj_t str_template_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_obj_str_template_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_arg_check_num(n_args, n_kw, self->n_args, MP_OBJ_FUN_ARGS_MAX, false);
+    vstr_t vstr;
+    mp_print_t print;
+    vstr_init_print(&vstr, self->size_hint, &print);
+
+    const char *lit = self->lit;
+    for (const mp_str_template_field_t *f = self->fields;; f++) {
+        vstr_add_strn(&vstr, lit, f->lit_len);
+        lit += f->lit_len;
+        if (f->type == MP_STR_TEMPLATE_END) {
+            break;
+        }
+        mp_obj_t arg = args[f->arg];
+        int flags = (f->fill == '0') ? PF_FLAG_PAD_AFTER_SIGN : 0;
+        switch (f->type) {
+            case '\0':
+                str_add_plain(&vstr, &print, arg);
+                break;
+
+            case 'd':
+            case 'x':
+            case 'X': {
+                if (!arg_looks_integer(arg)) {
+                    str_template_bad_arg(f->type, arg);
+                }
+                unsigned int base = (f->type == 'd') ? 10 : 16;
+                char base_char = f->type - ('X' - 'A');
+                if (f->width < 0 && mp_obj_is_small_int(arg)) {
+                    str_add_small_int(&vstr, MP_OBJ_SMALL_INT_VALUE(arg), base, base_char);
+                } else {
+                    mp_print_mp_int(&print, arg, base, base_char, flags, f->fill, f->width, 0);
+                }
+                break;
+            }
+
+            #if MICROPY_PY_BUILTINS_FLOAT
+            case 'f':
+                if (!arg_looks_numeric(arg)) {
+                    str_template_bad_arg(f->type, arg);
+                }
+                mp_print_float(&print, mp_obj_get_float(arg), 'f', flags, f->fill, f->width, f->prec);
+                break;
+            #endif
+
+            default: { // 's'
+                if (arg_looks_numeric(arg)) {
+                    str_template_bad_arg(f->type, arg);
+                }
+                size_t slen;
+                const char *s = mp_obj_str_get_data(arg, &slen);
+                if (f->prec >= 0 && slen > (size_t)f->prec) {
+                    slen = f->prec;
+                }
+                mp_print_strn(&print, s, slen, PF_FLAG_LEFT_ADJUST, ' ', f->width);
+                break;
+            }
+        }
+    }
+
+    self->size_hint = vstr.len;
+    return mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
+}
+
+STATIC mp_obj_t str_template_format(size_t n_args, const mp_obj_t *args) {
+    return str_template_call(args[0], n_args - 1, 0, args + 1);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR(str_template_format_obj, 1, str_template_format);
+
+STATIC const mp_rom_map_elem_t str_template_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_format), MP_ROM_PTR(&str_template_format_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(str_template_locals_dict, str_template_locals_dict_table);
+
+const mp_obj_type_t mp_type_str_template = {
+    { &mp_type_type },
+    .name = MP_QSTR_template,
+    .print = str_template_print,
+    .make_new = str_template_make_new,
+    .call = str_template_call,
+    .locals_dict = (mp_obj_dict_t*)&str_template_locals_dict,
+};
+#endif // MICROPY_PY_MICROPYTHON_TEMPLATE
+
 // The implementation is optimized, returning the original string if there's
 // nothing to replace.
 STATIC mp_obj_t str_replace(size_t n_args, const mp_obj_t *args) {
@@ -1699,16 +2069,11 @@ MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(str_replace_obj, 3, 4, str_replace);
 
 #if MICROPY_PY_BUILTINS_STR_COUNT
 STATIC mp_obj_t str_count(size_t n_args, const mp_obj_t *args) {
-    const mp_obj_type_t *self_type = mp_obj_get_type(args[0]);
-    mp_check_self(mp_obj_is_str_or_bytes(args[0]));
-
-    // check argument type
-    if (mp_obj_get_type(args[1]) != self_type) {
-        bad_implicit_conversion(args[1]);
-    }
-
-    GET_STR_DATA_LEN(args[0], haystack, haystack_len);
-    GET_STR_DATA_LEN(args[1], needle, needle_len);
+    const byte *haystack;
+    size_t haystack_len;
+    const mp_obj_type_t *self_type = str_get_self_data(args[0], &haystack, &haystack_len);
+    size_t needle_len;
+    const byte *needle = str_get_arg_data(self_type, args[1], &needle_len);
 
     const byte *start = haystack;
     const byte *end = haystack + haystack_len;
@@ -1742,14 +2107,11 @@ MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(str_count_obj, 2, 4, str_count);
 
 #if MICROPY_PY_BUILTINS_STR_PARTITION
 STATIC mp_obj_t str_partitioner(mp_obj_t self_in, mp_obj_t arg, int direction) {
-    mp_check_self(mp_obj_is_str_or_bytes(self_in));
-    mp_obj_type_t *self_type = mp_obj_get_type(self_in);
-    if (self_type != mp_obj_get_type(arg)) {
-        bad_implicit_conversion(arg);
-    }
-
-    GET_STR_DATA_LEN(self_in, str, str_len);
-    GET_STR_DATA_LEN(arg, sep, sep_len);
+    const byte *str;
+    size_t str_len;
+    const mp_obj_type_t *self_type = str_get_self_data(self_in, &str, &str_len);
+    size_t sep_len;
+    const byte *sep = str_get_arg_data(self_type, arg, &sep_len);
 
     if (sep_len == 0) {
         mp_raise_ValueError("empty separator");
@@ -1766,17 +2128,20 @@ STATIC mp_obj_t str_partitioner(mp_obj_t self_in, mp_obj_t arg, int direction) {
         result[2] = mp_const_empty_bytes;
     }
 
-    if (direction > 0) {
-        result[0] = self_in;
-    } else {
-        result[2] = self_in;
-    }
-
     const byte *position_ptr = find_subbytes(str, str_len, sep, sep_len, direction);
-    if (position_ptr != NULL) {
+    if (position_ptr == NULL) {
+        if (!mp_obj_is_str_or_bytes(self_in)) {
+            self_in = mp_obj_new_bytes(str, str_len);
+        }
+        if (direction > 0) {
+            result[0] = self_in;
+        } else {
+            result[2] = self_in;
+        }
+    } else {
         size_t position = position_ptr - str;
         result[0] = mp_obj_new_str_of_type(self_type, str, position);
-        result[1] = arg;
+        result[1] = mp_obj_get_type(arg) == self_type ? arg : mp_obj_new_bytes(sep, sep_len);
         result[2] = mp_obj_new_str_of_type(self_type, str + position + sep_len, str_len - position - sep_len);
     }
 
@@ -2006,6 +2371,24 @@ const mp_obj_str_t mp_const_empty_bytes_obj = {{&mp_type_bytes}, 0, 0, (const by
 // the data is copied across.  This function should only be used if the type is bytes,
 // or if the type is str and the string data is known to be not interned.
 mp_obj_t mp_obj_new_str_copy(const mp_obj_type_t *type, const byte* data, size_t len) {
+    #if MICROPY_GC_FREE_LISTS
+    if (data != NULL && sizeof(mp_obj_str_t) + len + 1 <= GC_FREE_LIST_MAX_BYTES) {
+        // a small str/bytes keeps its data right after the object, in one
+        // allocation, which the sweep can then keep for the next one
+        mp_obj_str_t *o = gc_free_list_alloc(GC_FREE_LIST_STR, sizeof(mp_obj_str_t) + len + 1);
+        if (o == NULL) {
+            o = m_new_obj_var(mp_obj_str_t, byte, len + 1);
+        }
+        o->base.type = type;
+        o->len = len;
+        o->hash = qstr_compute_hash(data, len);
+        byte *p = (byte*)(o + 1);
+        o->data = p;
+        memcpy(p, data, len * sizeof(byte));
+        p[len] = '\0';
+        return MP_OBJ_FROM_PTR(o);
+    }
+    #endif
     mp_obj_str_t *o = m_new_obj(mp_obj_str_t);
     o->base.type = type;
     o->len = len;
@@ -2049,6 +2432,16 @@ mp_obj_t mp_obj_new_str_from_vstr(const mp_obj_type_t *type, vstr_t *vstr) {
         }
     }
 
+    #if MICROPY_GC_FREE_LISTS
+    if (sizeof(mp_obj_str_t) + vstr->len + 1 <= GC_FREE_LIST_MAX_BYTES) {
+        // copy a short one inline, rather than keep the buffer
+        mp_obj_t o = mp_obj_new_str_copy(type, (const byte*)vstr->buf, vstr->len);
+        vstr_clear(vstr);
+        vstr->alloc = 0;
+        return o;
+    }
+    #endif
+
     // make a new str/bytes object
     mp_obj_str_t *o = m_new_obj(mp_obj_str_t);
     o->base.type = type;
@@ -104,4 +104,8 @@ MP_DECLARE_CONST_FUN_OBJ_1(str_isupper_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(str_islower_obj);
 MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(bytes_decode_obj);
 
+#if MICROPY_PY_MICROPYTHON_TEMPLATE
+extern const mp_obj_type_t mp_type_str_template;
+#endif
+
 #endif // MICROPY_INCLUDED_PY_OBJSTR_H
@@ -237,7 +237,14 @@ mp_obj_t mp_obj_new_tuple(size_t n, const mp_obj_t *items) {
     if (n == 0) {
         return mp_const_empty_tuple;
     }
+    #if MICROPY_GC_FREE_LISTS
+    mp_obj_tuple_t *o = gc_free_list_alloc(GC_FREE_LIST_TUPLE, sizeof(mp_obj_tuple_t) + n * sizeof(mp_obj_t));
+    if (o == NULL) {
+        o = m_new_obj_var(mp_obj_tuple_t, mp_obj_t, n);
+    }
+    #else
     mp_obj_tuple_t *o = m_new_obj_var(mp_obj_tuple_t, mp_obj_t, n);
+    #endif
     o->base.type = &mp_type_tuple;
     o->len = n;
     if (items) {
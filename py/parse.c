@@ -330,20 +330,43 @@ bool mp_parse_node_get_int_maybe(mp_parse_node_t pn, mp_obj_t *o) {
     if (MP_PARSE_NODE_IS_SMALL_INT(pn)) {
         *o = MP_OBJ_NEW_SMALL_INT(MP_PARSE_NODE_LEAF_SMALL_INT(pn));
         return true;
-    } else if (MP_PARSE_NODE_IS_STRUCT_KIND(pn, RULE_const_object)) {
-        mp_parse_node_struct_t *pns = (mp_parse_node_struct_t*)pn;
-        #if MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_D
-        // nodes are 32-bit pointers, but need to extract 64-bit object
-        *o = (uint64_t)pns->nodes[0] | ((uint64_t)pns->nodes[1] << 32);
-        #else
-        *o = (mp_obj_t)pns->nodes[0];
-        #endif
+    } else if (mp_parse_node_get_const_object_maybe(pn, o)) {
         return mp_obj_is_int(*o);
     } else {
         return false;
     }
 }
 
+bool mp_parse_node_get_const_object_maybe(mp_parse_node_t pn, mp_obj_t *o) {
+    if (!MP_PARSE_NODE_IS_STRUCT_KIND(pn, RULE_const_object)) {
+        return false;
+    }
+    mp_parse_node_struct_t *pns = (mp_parse_node_struct_t*)pn;
+    #if MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_D
+    // nodes are 32-bit pointers, but need to extract 64-bit object
+    *o = (uint64_t)pns->nodes[0] | ((uint64_t)pns->nodes[1] << 32);
+    #else
+    *o = (mp_obj_t)pns->nodes[0];
+    #endif
+    return true;
+}
+
+#if MICROPY_COMP_CONST_FOLDING || MICROPY_COMP_CONST
+// Get the data of a str or bytes literal, whether interned or not
+STATIC const byte *parse_node_get_str_data_maybe(mp_parse_node_t pn, bool *is_bytes, size_t *len) {
+    mp_obj_t o;
+    if (MP_PARSE_NODE_IS_LEAF(pn)
+        && (MP_PARSE_NODE_LEAF_KIND(pn) == MP_PARSE_NODE_STRING || MP_PARSE_NODE_LEAF_KIND(pn) == MP_PARSE_NODE_BYTES)) {
+        *is_bytes = MP_PARSE_NODE_LEAF_KIND(pn) == MP_PARSE_NODE_BYTES;
+        return qstr_data(MP_PARSE_NODE_LEAF_ARG(pn), len);
+    } else if (mp_parse_node_get_const_object_maybe(pn, &o) && mp_obj_is_str_or_bytes(o)) {
+        *is_bytes = !mp_obj_is_str(o);
+        return (const byte*)mp_obj_str_get_data(o, len);
+    }
+    return NULL;
+}
+#endif
+
 int mp_parse_node_extract_list(mp_parse_node_t *pn, size_t pn_kind, mp_parse_node_t **nodes) {
     if (MP_PARSE_NODE_IS_NULL(*pn)) {
         *nodes = NULL;
@@ -467,6 +490,27 @@ STATIC mp_parse_node_t mp_parse_node_new_small_int_checked(parser_t *parser, mp_
     return mp_parse_node_new_small_int(val);
 }
 
+STATIC mp_parse_node_t make_node_str(parser_t *parser, size_t src_line, bool is_bytes, const char *data, size_t len) {
+    // Don't automatically intern all strings/bytes.  doc strings (which are usually large)
+    // will be discarded by the compiler, and so we shouldn't intern them.
+    qstr qst = MP_QSTR_NULL;
+    if (len <= MICROPY_ALLOC_PARSE_INTERN_STRING_LEN) {
+        // intern short strings
+        qst = qstr_from_strn(data, len);
+    } else {
+        // check if this string is already interned
+        qst = qstr_find_strn(data, len);
+    }
+    if (qst != MP_QSTR_NULL) {
+        // qstr exists, make a leaf node
+        return mp_parse_node_new_leaf(is_bytes ? MP_PARSE_NODE_BYTES : MP_PARSE_NODE_STRING, qst);
+    } else {
+        // not interned, make a node holding a pointer to the string/bytes object
+        mp_obj_t o = mp_obj_new_str_copy(is_bytes ? &mp_type_bytes : &mp_type_str, (const byte*)data, len);
+        return make_node_const_object(parser, src_line, o);
+    }
+}
+
 STATIC void push_result_token(parser_t *parser, uint8_t rule_id) {
     mp_parse_node_t pn;
     mp_lexer_t *lex = parser->lexer;
@@ -479,6 +523,8 @@ STATIC void push_result_token(parser_t *parser, uint8_t rule_id) {
             && (elem = mp_map_lookup(&parser->consts, MP_OBJ_NEW_QSTR(id), MP_MAP_LOOKUP)) != NULL) {
             if (mp_obj_is_small_int(elem->value)) {
                 pn = mp_parse_node_new_small_int_checked(parser, elem->value);
+            } else if (mp_obj_is_qstr(elem->value)) {
+                pn = mp_parse_node_new_leaf(MP_PARSE_NODE_STRING, MP_OBJ_QSTR_VALUE(elem->value));
             } else {
                 pn = make_node_const_object(parser, lex->tok_line, elem->value);
             }
@@ -500,26 +546,7 @@ STATIC void push_result_token(parser_t *parser, uint8_t rule_id) {
         mp_obj_t o = mp_parse_num_decimal(lex->vstr.buf, lex->vstr.len, true, false, lex);
         pn = make_node_const_object(parser, lex->tok_line, o);
     } else if (lex->tok_kind == MP_TOKEN_STRING || lex->tok_kind == MP_TOKEN_BYTES) {
-        // Don't automatically intern all strings/bytes.  doc strings (which are usually large)
-        // will be discarded by the compiler, and so we shouldn't intern them.
-        qstr qst = MP_QSTR_NULL;
-        if (lex->vstr.len <= MICROPY_ALLOC_PARSE_INTERN_STRING_LEN) {
-            // intern short strings
-            qst = qstr_from_strn(lex->vstr.buf, lex->vstr.len);
-        } else {
-            // check if this string is already interned
-            qst = qstr_find_strn(lex->vstr.buf, lex->vstr.len);
-        }
-        if (qst != MP_QSTR_NULL) {
-            // qstr exists, make a leaf node
-            pn = mp_parse_node_new_leaf(lex->tok_kind == MP_TOKEN_STRING ? MP_PARSE_NODE_STRING : MP_PARSE_NODE_BYTES, qst);
-        } else {
-            // not interned, make a node holding a pointer to the string/bytes object
-            mp_obj_t o = mp_obj_new_str_copy(
-                lex->tok_kind == MP_TOKEN_STRING ? &mp_type_str : &mp_type_bytes,
-                (const byte*)lex->vstr.buf, lex->vstr.len);
-            pn = make_node_const_object(parser, lex->tok_line, o);
-        }
+        pn = make_node_str(parser, lex->tok_line, lex->tok_kind == MP_TOKEN_BYTES, lex->vstr.buf, lex->vstr.len);
     } else {
         pn = mp_parse_node_new_leaf(MP_PARSE_NODE_TOKEN, lex->tok_kind);
     }
@@ -600,6 +627,38 @@ STATIC bool fold_logical_constants(parser_t *parser, uint8_t rule_id, size_t *nu
     return false;
 }
 
+// folding for concatenation of str or bytes literals: 'a' + 'b'
+STATIC bool fold_str_concat(parser_t *parser, size_t num_args) {
+    bool is_bytes0;
+    size_t len;
+    if (parse_node_get_str_data_maybe(peek_result(parser, num_args - 1), &is_bytes0, &len) == NULL) {
+        return false;
+    }
+    for (ssize_t i = num_args - 2; i >= 1; i -= 2) {
+        bool is_bytes;
+        if (MP_PARSE_NODE_LEAF_ARG(peek_result(parser, i)) != MP_TOKEN_OP_PLUS
+            || parse_node_get_str_data_maybe(peek_result(parser, i - 1), &is_bytes, &len) == NULL
+            || is_bytes != is_bytes0) {
+            return false;
+        }
+    }
+
+    vstr_t vstr;
+    vstr_init(&vstr, 16);
+    for (ssize_t i = num_args - 1; i >= 0; i -= 2) {
+        bool is_bytes;
+        const byte *data = parse_node_get_str_data_maybe(peek_result(parser, i), &is_bytes, &len);
+        vstr_add_strn(&vstr, (const char*)data, len);
+    }
+    mp_parse_node_t pn = make_node_str(parser, parser->lexer->tok_line, is_bytes0, vstr.buf, vstr.len);
+    vstr_clear(&vstr);
+    for (size_t i = num_args; i > 0; i--) {
+        pop_result(parser);
+    }
+    push_result_node(parser, pn);
+    return true;
+}
+
 STATIC bool fold_constants(parser_t *parser, uint8_t rule_id, size_t num_args) {
     // this code does folding of arbitrary integer expressions, eg 1 + 2 * 3 + 4
     // it does not do partial folding, eg 1 + 2 + x -> 3 + x
@@ -635,6 +694,9 @@ STATIC bool fold_constants(parser_t *parser, uint8_t rule_id, size_t num_args) {
         // folding for binary ops: << >> + - * / % //
         mp_parse_node_t pn = peek_result(parser, num_args - 1);
         if (!mp_parse_node_get_int_maybe(pn, &arg0)) {
+            if (rule_id == RULE_arith_expr) {
+                return fold_str_concat(parser, num_args);
+            }
             return false;
         }
         for (ssize_t i = num_args - 2; i >= 1; i -= 2) {
@@ -693,6 +755,39 @@ STATIC bool fold_constants(parser_t *parser, uint8_t rule_id, size_t num_args) {
         }
         arg0 = mp_unary_op(op, arg0);
 
+    } else if (rule_id == RULE_comparison) {
+        // folding for comparisons of integers: < > == <= >= !=, chained or not
+        mp_parse_node_t pn = peek_result(parser, num_args - 1);
+        if (!mp_parse_node_get_int_maybe(pn, &arg0)) {
+            return false;
+        }
+        bool result = true;
+        for (ssize_t i = num_args - 2; i >= 1; i -= 2) {
+            mp_parse_node_t pn_op = peek_result(parser, i);
+            mp_obj_t arg1;
+            if (!MP_PARSE_NODE_IS_TOKEN(pn_op)
+                || !mp_parse_node_get_int_maybe(peek_result(parser, i - 1), &arg1)) {
+                return false;
+            }
+            mp_binary_op_t op;
+            switch (MP_PARSE_NODE_LEAF_ARG(pn_op)) {
+                case MP_TOKEN_OP_LESS: op = MP_BINARY_OP_LESS; break;
+                case MP_TOKEN_OP_MORE: op = MP_BINARY_OP_MORE; break;
+                case MP_TOKEN_OP_DBL_EQUAL: op = MP_BINARY_OP_EQUAL; break;
+                case MP_TOKEN_OP_LESS_EQUAL: op = MP_BINARY_OP_LESS_EQUAL; break;
+                case MP_TOKEN_OP_MORE_EQUAL: op = MP_BINARY_OP_MORE_EQUAL; break;
+                case MP_TOKEN_OP_NOT_EQUAL: op = MP_BINARY_OP_NOT_EQUAL; break;
+                default: return false; // in, is
+            }
+            result = result && mp_binary_op(op, arg0, arg1) == mp_const_true;
+            arg0 = arg1;
+        }
+        for (size_t i = num_args; i > 0; i--) {
+            pop_result(parser);
+        }
+        push_result_node(parser, mp_parse_node_new_leaf(MP_PARSE_NODE_TOKEN, result ? MP_TOKEN_KW_TRUE : MP_TOKEN_KW_FALSE));
+        return true;
+
     #if MICROPY_COMP_CONST
     } else if (rule_id == RULE_expr_stmt) {
         mp_parse_node_t pn1 = peek_result(parser, 0);
@@ -715,9 +810,21 @@ STATIC bool fold_constants(parser_t *parser, uint8_t rule_id, size_t num_args) {
                 // get the value
                 mp_parse_node_t pn_value = ((mp_parse_node_struct_t*)((mp_parse_node_struct_t*)pn1)->nodes[1])->nodes[0];
                 mp_obj_t value;
-                if (!mp_parse_node_get_int_maybe(pn_value, &value)) {
+                bool is_bytes;
+                size_t len;
+                const byte *data;
+                if (mp_parse_node_get_int_maybe(pn_value, &value)) {
+                    // an integer
+                } else if ((data = parse_node_get_str_data_maybe(pn_value, &is_bytes, &len)) != NULL) {
+                    // a str or bytes, kept as the node's qstr or object
+                    if (MP_PARSE_NODE_IS_LEAF(pn_value) && !is_bytes) {
+                        value = MP_OBJ_NEW_QSTR(MP_PARSE_NODE_LEAF_ARG(pn_value));
+                    } else if (!mp_parse_node_get_const_object_maybe(pn_value, &value)) {
+                        value = mp_obj_new_bytes(data, len);
+                    }
+                } else {
                     mp_obj_t exc = mp_obj_new_exception_msg(&mp_type_SyntaxError,
-                        "constant must be an integer");
+                        "constant must be an integer, str or bytes");
                     mp_obj_exception_add_traceback(exc, parser->lexer->source_name,
                         ((mp_parse_node_struct_t*)pn1)->source_line, MP_QSTR_NULL);
                     nlr_raise(exc);
@@ -33,6 +33,7 @@
 #include "py/emitglue.h"
 #include "py/persistentcode.h"
 #include "py/bc.h"
+#include "py/objtuple.h"
 
 #if MICROPY_PERSISTENT_CODE_LOAD || MICROPY_PERSISTENT_CODE_SAVE
 
@@ -71,6 +72,8 @@
 #define MPY_FEATURE_ARCH (MP_NATIVE_ARCH_ARMV6)
 #elif MICROPY_EMIT_XTENSA
 #define MPY_FEATURE_ARCH (MP_NATIVE_ARCH_XTENSA)
+#elif MICROPY_EMIT_XTENSAWIN
+#define MPY_FEATURE_ARCH (MP_NATIVE_ARCH_XTENSAWIN)
 #else
 #define MPY_FEATURE_ARCH (MP_NATIVE_ARCH_NONE)
 #endif
@@ -200,7 +203,7 @@ STATIC void arch_link_qstr(uint8_t *pc, bool is_obj, qstr qst) {
     if (is_obj) {
         val = (mp_uint_t)MP_OBJ_NEW_QSTR(qst);
     }
-    #if MICROPY_EMIT_X86 || MICROPY_EMIT_X64 || MICROPY_EMIT_ARM || MICROPY_EMIT_XTENSA
+    #if MICROPY_EMIT_X86 || MICROPY_EMIT_X64 || MICROPY_EMIT_ARM || MICROPY_EMIT_XTENSA || MICROPY_EMIT_XTENSAWIN
     pc[0] = val & 0xff;
     pc[1] = (val >> 8) & 0xff;
     pc[2] = (val >> 16) & 0xff;
@@ -268,6 +271,19 @@ STATIC mp_obj_t load_obj(mp_reader_t *reader) {
     byte obj_type = read_byte(reader);
     if (obj_type == 'e') {
         return MP_OBJ_FROM_PTR(&mp_const_ellipsis_obj);
+    } else if (obj_type == 'n') {
+        return mp_const_none;
+    } else if (obj_type == 'F') {
+        return mp_const_false;
+    } else if (obj_type == 'T') {
+        return mp_const_true;
+    } else if (obj_type == 't') {
+        size_t len = read_uint(reader, NULL);
+        mp_obj_tuple_t *tuple = MP_OBJ_TO_PTR(mp_obj_new_tuple(len, NULL));
+        for (size_t i = 0; i < len; i++) {
+            tuple->items[i] = load_obj(reader);
+        }
+        return MP_OBJ_FROM_PTR(tuple);
     } else {
         size_t len = read_uint(reader, NULL);
         vstr_t vstr;
@@ -337,7 +353,7 @@ STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader, qstr_window_t *qw) {
     byte *ip2;
     bytecode_prelude_t prelude = {0};
     #if MICROPY_EMIT_NATIVE
-    size_t prelude_offset;
+    size_t prelude_offset = 0;
     mp_uint_t type_sig = 0;
     size_t n_qstr_link = 0;
     #endif
@@ -405,12 +421,14 @@ STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader, qstr_window_t *qw) {
     }
 
     mp_uint_t *const_table = NULL;
+    size_t n_obj = 0;
+    size_t n_raw_code = 0;
     if (kind != MP_CODE_NATIVE_ASM) {
         // Load constant table for bytecode, native and viper
 
         // Number of entries in constant table
-        size_t n_obj = read_uint(reader, NULL);
-        size_t n_raw_code = read_uint(reader, NULL);
+        n_obj = read_uint(reader, NULL);
+        n_raw_code = read_uint(reader, NULL);
 
         // Allocate constant table
         size_t n_alloc = prelude.n_pos_args + prelude.n_kwonly_args + n_obj + n_raw_code;
@@ -474,7 +492,7 @@ STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader, qstr_window_t *qw) {
     return rc;
 }
 
-mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader) {
+STATIC void load_header(mp_reader_t *reader) {
     byte header[4];
     read_bytes(reader, header, sizeof(header));
     if (header[0] != 'M'
@@ -488,6 +506,10 @@ mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader) {
         && MPY_FEATURE_DECODE_ARCH(header[2]) != MPY_FEATURE_ARCH) {
         mp_raise_ValueError("incompatible .mpy arch");
     }
+}
+
+mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader) {
+    load_header(reader);
     qstr_window_t qw;
     qw.idx = 0;
     mp_raw_code_t *rc = load_raw_code(reader, &qw);
@@ -511,6 +533,417 @@ mp_raw_code_t *mp_raw_code_load_file(const char *filename) {
 
 #endif // MICROPY_HAS_FILE_READER
 
+#if MICROPY_PERSISTENT_CODE_IMAGE
+
+#if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+#error MICROPY_PERSISTENT_CODE_IMAGE needs bytecode which is not written to at runtime
+#endif
+
+#include "py/mperrno.h"
+#include "py/mpstate.h"
+#include "py/objlist.h"
+#include "py/objstr.h"
+
+// A code image holds the bytecode of .mpy files laid out so that it can be executed in place
+// from read-only memory, eg memory mapped flash.  Only the raw code structures, the constant
+// tables and the qstrs are created in RAM.  The qstrs referred to by the bytecode are numbered
+// as they are after the image is mounted right after mp_init(), so an image only works with
+// the firmware which built it.
+//
+// All offsets are from the start of the image and all records are 4 byte aligned:
+//   mp_image_header_t
+//   for each module the bytecode and mp_image_obj_t of each function followed by its
+//   mp_image_rc_t, the children of a function come before it
+//   the module names as "name\0name\0...\0", in the order of the module table
+//   the module table, the offset of the mp_image_rc_t of each module
+//   the qstr table, for each qstr its length as a 16-bit value followed by its data
+
+#define MP_IMAGE_MAGIC (0x4d49504d) // "MPIM"
+#define MP_IMAGE_VERSION (1)
+
+typedef struct _mp_image_header_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t n_module;
+    uint32_t firmware; // see mp_image_firmware_hash()
+    uint32_t qstr_base;
+    uint32_t n_qstr;
+    uint32_t qstr_table;
+    uint32_t module_names;
+    uint32_t module_table;
+    uint32_t len;
+} mp_image_header_t;
+
+typedef struct _mp_image_rc_t {
+    uint32_t fun_data;
+    uint32_t fun_data_len;
+    uint16_t scope_flags;
+    uint16_t n_args;
+    uint16_t n_obj;
+    uint16_t n_raw_code;
+    uint32_t const_table[]; // argument name qstrs, then offsets of the objects and of the children
+} mp_image_rc_t;
+
+typedef struct _mp_image_obj_t {
+    uint32_t type_len; // length << 8 | type, see load_obj()
+    byte data[]; // null terminated
+} mp_image_obj_t;
+
+STATIC const byte *mp_image = NULL;
+STATIC qstr mp_image_qstr_base;
+STATIC bool mp_image_used;
+
+STATIC inline qstr mp_image_qstr_count(void) {
+    return MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len;
+}
+
+// Identifies the firmware an image belongs to by the qstrs present before it is mounted
+STATIC uint32_t mp_image_firmware_hash(qstr qstr_base) {
+    uint32_t h = (MPY_VERSION << 16) | (MPY_FEATURE_FLAGS << 8) | mp_small_int_bits();
+    for (qstr q = 1; q < qstr_base; ++q) {
+        h = (h * 33) ^ qstr_hash(q);
+    }
+    return h;
+}
+
+bool mp_raw_code_image_mount(const byte *image, size_t len) {
+    mp_image = NULL;
+    mp_image_used = false;
+    mp_image_qstr_base = mp_image_qstr_count();
+    if (image == NULL) {
+        return false;
+    }
+
+    const mp_image_header_t *header = (const mp_image_header_t*)image;
+    if (len < sizeof(*header)
+        || header->magic != MP_IMAGE_MAGIC
+        || header->version != MP_IMAGE_VERSION
+        || header->len > len
+        || header->qstr_base != mp_image_qstr_base
+        || header->firmware != mp_image_firmware_hash(mp_image_qstr_base)) {
+        return false;
+    }
+
+    // The qstrs must get the numbers the bytecode uses, which they do as nothing else
+    // is interned in between
+    const byte *q = image + header->qstr_table;
+    for (size_t i = 0; i < header->n_qstr; ++i) {
+        size_t qlen = q[0] | (q[1] << 8);
+        if (qstr_from_strn((const char*)q + 2, qlen) != mp_image_qstr_base + i) {
+            return false;
+        }
+        q += 2 + qlen;
+    }
+    mp_image = image;
+    return true;
+}
+
+const char *mp_raw_code_image_names(void) {
+    if (mp_image == NULL) {
+        return NULL;
+    }
+    return (const char*)mp_image + ((const mp_image_header_t*)mp_image)->module_names;
+}
+
+STATIC mp_obj_t mp_image_load_obj(uint32_t offset) {
+    const mp_image_obj_t *obj = (const mp_image_obj_t*)(mp_image + offset);
+    byte obj_type = obj->type_len & 0xff;
+    size_t len = obj->type_len >> 8;
+    if (obj_type == 'e') {
+        return MP_OBJ_FROM_PTR(&mp_const_ellipsis_obj);
+    } else if (obj_type == 'n') {
+        return mp_const_none;
+    } else if (obj_type == 'F') {
+        return mp_const_false;
+    } else if (obj_type == 'T') {
+        return mp_const_true;
+    } else if (obj_type == 't') {
+        // the data holds the offsets of the items
+        const uint32_t *items = (const uint32_t*)obj->data;
+        mp_obj_tuple_t *tuple = MP_OBJ_TO_PTR(mp_obj_new_tuple(len, NULL));
+        for (size_t i = 0; i < len; ++i) {
+            tuple->items[i] = mp_image_load_obj(items[i]);
+        }
+        return MP_OBJ_FROM_PTR(tuple);
+    } else if (obj_type == 's' || obj_type == 'b') {
+        // the data stays in the image
+        mp_obj_str_t *o = m_new_obj(mp_obj_str_t);
+        o->base.type = (obj_type == 's') ? &mp_type_str : &mp_type_bytes;
+        o->hash = qstr_compute_hash(obj->data, len);
+        o->len = len;
+        o->data = obj->data;
+        return MP_OBJ_FROM_PTR(o);
+    } else if (obj_type == 'i') {
+        return mp_parse_num_integer((const char*)obj->data, len, 10, NULL);
+    } else {
+        assert(obj_type == 'f' || obj_type == 'c');
+        return mp_parse_num_decimal((const char*)obj->data, len, obj_type == 'c', false, NULL);
+    }
+}
+
+STATIC mp_raw_code_t *mp_image_load_raw_code(uint32_t offset) {
+    const mp_image_rc_t *irc = (const mp_image_rc_t*)(mp_image + offset);
+    const uint32_t *it = irc->const_table;
+    mp_uint_t *const_table = m_new(mp_uint_t, irc->n_args + irc->n_obj + irc->n_raw_code);
+    mp_uint_t *ct = const_table;
+    for (size_t i = 0; i < irc->n_args; ++i) {
+        *ct++ = (mp_uint_t)MP_OBJ_NEW_QSTR(*it++);
+    }
+    for (size_t i = 0; i < irc->n_obj; ++i) {
+        *ct++ = (mp_uint_t)mp_image_load_obj(*it++);
+    }
+    for (size_t i = 0; i < irc->n_raw_code; ++i) {
+        *ct++ = (mp_uint_t)(uintptr_t)mp_image_load_raw_code(*it++);
+    }
+
+    mp_raw_code_t *rc = mp_emit_glue_new_raw_code();
+    mp_emit_glue_assign_bytecode(rc, mp_image + irc->fun_data,
+        #if MICROPY_PERSISTENT_CODE_SAVE || MICROPY_DEBUG_PRINTERS
+        irc->fun_data_len,
+        #endif
+        const_table,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        irc->n_obj, irc->n_raw_code,
+        #endif
+        irc->scope_flags);
+    return rc;
+}
+
+mp_raw_code_t *mp_raw_code_image_load(size_t index) {
+    const mp_image_header_t *header = (const mp_image_header_t*)mp_image;
+    assert(mp_image != NULL && index < header->n_module);
+    mp_image_used = true;
+    return mp_image_load_raw_code(((const uint32_t*)(mp_image + header->module_table))[index]);
+}
+
+typedef struct _mp_image_build_t {
+    mp_raw_code_image_writer_t *writer;
+    size_t offset; // of the next byte emitted
+    size_t buf_len;
+    byte buf[128];
+    mp_map_t qstr_map; // qstr in this instance -> index in the qstr table
+    mp_obj_list_t *qstrs;
+} mp_image_build_t;
+
+STATIC void mp_image_flush(mp_image_build_t *b) {
+    if (b->buf_len > 0) {
+        if (!b->writer->write(b->writer->data, b->offset - b->buf_len, b->buf, b->buf_len)) {
+            mp_raise_OSError(MP_EIO);
+        }
+        b->buf_len = 0;
+    }
+}
+
+STATIC void mp_image_emit(mp_image_build_t *b, const void *data, size_t len) {
+    if (b->offset + len > b->writer->max_len) {
+        mp_raise_OSError(MP_ENOSPC);
+    }
+    const byte *d = data;
+    while (len > 0) {
+        size_t n = MIN(len, sizeof(b->buf) - b->buf_len);
+        memcpy(b->buf + b->buf_len, d, n);
+        b->buf_len += n;
+        b->offset += n;
+        d += n;
+        len -= n;
+        if (b->buf_len == sizeof(b->buf)) {
+            mp_image_flush(b);
+        }
+    }
+}
+
+STATIC void mp_image_emit_align(mp_image_build_t *b) {
+    static const byte zero[3] = {0};
+    mp_image_emit(b, zero, (4 - (b->offset & 3)) & 3);
+}
+
+// Returns the number a qstr of this instance has once the image is mounted
+STATIC qstr mp_image_build_qstr(mp_image_build_t *b, qstr qst) {
+    if (qst < mp_image_qstr_base) {
+        return qst;
+    }
+    mp_map_elem_t *elem = mp_map_lookup(&b->qstr_map, MP_OBJ_NEW_QSTR(qst), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+    if (elem->value == MP_OBJ_NULL) {
+        elem->value = MP_OBJ_NEW_SMALL_INT(b->qstrs->len);
+        mp_obj_list_append(MP_OBJ_FROM_PTR(b->qstrs), MP_OBJ_NEW_QSTR(qst));
+    }
+    return mp_image_qstr_base + MP_OBJ_SMALL_INT_VALUE(elem->value);
+}
+
+STATIC uint32_t mp_image_build_obj(mp_image_build_t *b, mp_reader_t *reader) {
+    byte obj_type = read_byte(reader);
+    if (obj_type == 't') {
+        // the items come before the tuple, which refers to them by offset
+        size_t len = read_uint(reader, NULL);
+        uint32_t *items = m_new(uint32_t, len);
+        for (size_t i = 0; i < len; ++i) {
+            items[i] = mp_image_build_obj(b, reader);
+        }
+        uint32_t offset = b->offset;
+        uint32_t type_len = (len << 8) | obj_type;
+        mp_image_emit(b, &type_len, sizeof(type_len));
+        mp_image_emit(b, items, len * sizeof(uint32_t));
+        m_del(uint32_t, items, len);
+        return offset;
+    }
+    uint32_t offset = b->offset;
+    size_t len = (obj_type == 'e' || obj_type == 'n' || obj_type == 'F' || obj_type == 'T') ? 0 : read_uint(reader, NULL);
+    uint32_t type_len = (len << 8) | obj_type;
+    mp_image_emit(b, &type_len, sizeof(type_len));
+    while (len-- > 0) {
+        byte c = read_byte(reader);
+        mp_image_emit(b, &c, 1);
+    }
+    mp_image_emit(b, "", 1);
+    mp_image_emit_align(b);
+    return offset;
+}
+
+// Mirrors load_raw_code() but emits the raw code into the image
+STATIC uint32_t mp_image_build_raw_code(mp_image_build_t *b, mp_reader_t *reader, qstr_window_t *qw) {
+    size_t kind_len = read_uint(reader, NULL);
+    if ((kind_len & 3) != 0) {
+        mp_raise_ValueError("native code can't be frozen");
+    }
+    size_t fun_data_len = kind_len >> 2;
+
+    // Load prelude and bytecode, then renumber their qstrs
+    byte *fun_data = m_new(byte, fun_data_len);
+    byte *ip = fun_data;
+    byte *ip2;
+    bytecode_prelude_t prelude = {0};
+    load_prelude(reader, &ip, &ip2, &prelude);
+    load_bytecode(reader, qw, ip, fun_data + fun_data_len);
+    qstr simple_name = mp_image_build_qstr(b, load_qstr(reader, qw));
+    qstr source_file = mp_image_build_qstr(b, load_qstr(reader, qw));
+    ip2[0] = simple_name; ip2[1] = simple_name >> 8;
+    ip2[2] = source_file; ip2[3] = source_file >> 8;
+    while (ip < fun_data + fun_data_len) {
+        size_t sz;
+        uint f = mp_opcode_format(ip, &sz, true);
+        if (f == MP_OPCODE_QSTR) {
+            qstr qst = mp_image_build_qstr(b, ip[1] | (ip[2] << 8));
+            ip[1] = qst;
+            ip[2] = qst >> 8;
+        }
+        ip += sz;
+    }
+    uint32_t fun_data_offset = b->offset;
+    mp_image_emit(b, fun_data, fun_data_len);
+    mp_image_emit_align(b);
+    m_del(byte, fun_data, fun_data_len);
+
+    // Constant table
+    mp_image_rc_t irc = {
+        .fun_data = fun_data_offset,
+        .fun_data_len = fun_data_len,
+        .scope_flags = prelude.scope_flags,
+        .n_args = prelude.n_pos_args + prelude.n_kwonly_args,
+    };
+    irc.n_obj = read_uint(reader, NULL);
+    irc.n_raw_code = read_uint(reader, NULL);
+    size_t n_alloc = irc.n_args + irc.n_obj + irc.n_raw_code;
+    uint32_t *const_table = m_new(uint32_t, n_alloc);
+    uint32_t *ct = const_table;
+    for (size_t i = 0; i < irc.n_args; ++i) {
+        *ct++ = mp_image_build_qstr(b, load_qstr(reader, qw));
+    }
+    for (size_t i = 0; i < irc.n_obj; ++i) {
+        *ct++ = mp_image_build_obj(b, reader);
+    }
+    for (size_t i = 0; i < irc.n_raw_code; ++i) {
+        *ct++ = mp_image_build_raw_code(b, reader, qw);
+    }
+
+    uint32_t offset = b->offset;
+    mp_image_emit(b, &irc, sizeof(irc));
+    mp_image_emit(b, const_table, n_alloc * sizeof(uint32_t));
+    m_del(uint32_t, const_table, n_alloc);
+    return offset;
+}
+
+size_t mp_raw_code_image_build(size_t n_files, const mp_obj_t *files, mp_raw_code_image_writer_t *writer) {
+    if (mp_image_used) {
+        // the image being replaced is executing
+        mp_raise_OSError(MP_EBUSY);
+    }
+    if (n_files == 0 || n_files > 0xffff) {
+        mp_raise_ValueError(NULL);
+    }
+    mp_image = NULL;
+
+    mp_image_build_t b;
+    b.writer = writer;
+    b.offset = sizeof(mp_image_header_t);
+    b.buf_len = 0;
+    mp_map_init(&b.qstr_map, 0);
+    b.qstrs = MP_OBJ_TO_PTR(mp_obj_new_list(0, NULL));
+    uint32_t *module_table = m_new(uint32_t, n_files);
+
+    for (size_t i = 0; i < n_files; ++i) {
+        const char *path = mp_obj_str_get_str(files[i]);
+        if (path[0] != '/') {
+            mp_raise_ValueError("path must be absolute");
+        }
+        mp_reader_t reader;
+        mp_reader_new_file(&reader, path);
+        nlr_buf_t nlr;
+        if (nlr_push(&nlr) == 0) {
+            load_header(&reader);
+            qstr_window_t qw;
+            qw.idx = 0;
+            module_table[i] = mp_image_build_raw_code(&b, &reader, &qw);
+            nlr_pop();
+            reader.close(reader.data);
+        } else {
+            reader.close(reader.data);
+            nlr_jump(nlr.ret_val);
+        }
+    }
+
+    mp_image_header_t header = {
+        .magic = MP_IMAGE_MAGIC,
+        .version = MP_IMAGE_VERSION,
+        .n_module = n_files,
+        .firmware = mp_image_firmware_hash(mp_image_qstr_base),
+        .qstr_base = mp_image_qstr_base,
+        .n_qstr = b.qstrs->len,
+    };
+
+    header.module_names = b.offset;
+    for (size_t i = 0; i < n_files; ++i) {
+        size_t len;
+        const char *path = mp_obj_str_get_data(files[i], &len);
+        mp_image_emit(&b, path, len + 1);
+    }
+    mp_image_emit(&b, "", 1);
+    mp_image_emit_align(&b);
+
+    header.module_table = b.offset;
+    mp_image_emit(&b, module_table, n_files * sizeof(uint32_t));
+    m_del(uint32_t, module_table, n_files);
+
+    header.qstr_table = b.offset;
+    for (size_t i = 0; i < b.qstrs->len; ++i) {
+        size_t len;
+        const byte *data = qstr_data(MP_OBJ_QSTR_VALUE(b.qstrs->items[i]), &len);
+        byte len16[2] = {len & 0xff, len >> 8};
+        mp_image_emit(&b, len16, sizeof(len16));
+        mp_image_emit(&b, data, len);
+    }
+    mp_image_flush(&b);
+    header.len = b.offset;
+    mp_map_deinit(&b.qstr_map);
+
+    // the header goes last so an incomplete image is never mounted
+    if (!writer->write(writer->data, 0, &header, sizeof(header))) {
+        mp_raise_OSError(MP_EIO);
+    }
+    return header.len;
+}
+
+#endif // MICROPY_PERSISTENT_CODE_IMAGE
+
 #endif // MICROPY_PERSISTENT_CODE_LOAD
 
 #if MICROPY_PERSISTENT_CODE_SAVE
@@ -568,11 +1001,27 @@ STATIC void save_obj(mp_print_t *print, mp_obj_t o) {
     } else if (MP_OBJ_TO_PTR(o) == &mp_const_ellipsis_obj) {
         byte obj_type = 'e';
         mp_print_bytes(print, &obj_type, 1);
+    #if MICROPY_COMP_CONST_TUPLE
+    } else if (o == mp_const_none || o == mp_const_false || o == mp_const_true) {
+        byte obj_type = o == mp_const_none ? 'n' : o == mp_const_false ? 'F' : 'T';
+        mp_print_bytes(print, &obj_type, 1);
+    } else if (mp_obj_is_type(o, &mp_type_tuple)) {
+        // the items of a constant tuple, which may be small ints
+        size_t len;
+        mp_obj_t *items;
+        mp_obj_tuple_get(o, &len, &items);
+        byte obj_type = 't';
+        mp_print_bytes(print, &obj_type, 1);
+        mp_print_uint(print, len);
+        for (size_t i = 0; i < len; i++) {
+            save_obj(print, items[i]);
+        }
+    #endif
     } else {
         // we save numbers using a simplistic text representation
         // TODO could be improved
         byte obj_type;
-        if (mp_obj_is_type(o, &mp_type_int)) {
+        if (mp_obj_is_int(o)) {
             obj_type = 'i';
         #if MICROPY_PY_BUILTINS_COMPLEX
         } else if (mp_obj_is_type(o, &mp_type_complex)) {
@@ -767,8 +1216,151 @@ void mp_raw_code_save_file(mp_raw_code_t *rc, const char *filename) {
     close(fd);
 }
 
+#elif MICROPY_READER_VFS
+
+#include "py/builtin.h"
+#include "py/stream.h"
+
+void mp_raw_code_save_file(mp_raw_code_t *rc, const char *filename) {
+    mp_obj_t args[2] = { mp_obj_new_str(filename, strlen(filename)), MP_OBJ_NEW_QSTR(MP_QSTR_wb) };
+    mp_obj_t file = mp_builtin_open(2, args, (mp_map_t*)&mp_const_empty_map);
+    mp_print_t file_print = {MP_OBJ_TO_PTR(file), mp_stream_write_adaptor};
+    mp_raw_code_save(rc, &file_print);
+    mp_stream_close(file);
+}
+
 #else
 #error mp_raw_code_save_file not implemented for this platform
 #endif
 
 #endif // MICROPY_PERSISTENT_CODE_SAVE
+
+#if MICROPY_PERSISTENT_CODE_CACHE
+
+#include "py/builtin.h"
+#include "py/compile.h"
+#include "py/stream.h"
+
+// A cache file holds a key of the source, its length and hash and the
+// optimisation level it was compiled with, followed by its .mpy
+#define MP_CODE_CACHE_KEY_SIZE (13)
+
+STATIC void mp_code_cache_key(const char *filename, byte *key) {
+    mp_reader_t reader;
+    mp_reader_new_file(&reader, filename);
+    uint32_t len = 0;
+    uint32_t hash = 5381;
+    mp_uint_t c;
+    while ((c = reader.readbyte(reader.data)) != MP_READER_EOF) {
+        hash = (hash * 33) ^ c;
+        ++len;
+    }
+    reader.close(reader.data);
+    memcpy(key, "MPYC", 4);
+    for (size_t i = 0; i < 4; ++i) {
+        key[4 + i] = len >> (8 * i);
+        key[8 + i] = hash >> (8 * i);
+    }
+    key[12] = MP_STATE_VM(mp_optimise_value);
+}
+
+// The end of a truncated cache file must not be read as 0xff bytes
+STATIC mp_uint_t mp_code_cache_readbyte(void *data) {
+    mp_reader_t *reader = data;
+    mp_uint_t c = reader->readbyte(reader->data);
+    if (c == MP_READER_EOF) {
+        nlr_raise(mp_obj_new_exception(&mp_type_EOFError));
+    }
+    return c;
+}
+
+STATIC void mp_code_cache_close(void *data) {
+    mp_reader_t *reader = data;
+    reader->close(reader->data);
+}
+
+// Returns NULL if there is no usable cache, for whatever reason
+STATIC mp_raw_code_t *mp_code_cache_load(const char *cache_name, const byte *key) {
+    mp_reader_t reader;
+    volatile bool is_open = false;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_reader_new_file(&reader, cache_name);
+        is_open = true;
+        byte cache_key[MP_CODE_CACHE_KEY_SIZE];
+        read_bytes(&reader, cache_key, sizeof(cache_key));
+        mp_raw_code_t *rc = NULL;
+        if (memcmp(cache_key, key, sizeof(cache_key)) == 0) {
+            mp_reader_t cache_reader = {&reader, mp_code_cache_readbyte, mp_code_cache_close};
+            rc = mp_raw_code_load(&cache_reader);
+            is_open = false; // closed by mp_raw_code_load
+        } else {
+            is_open = false;
+            reader.close(reader.data);
+        }
+        nlr_pop();
+        return rc;
+    } else {
+        if (is_open) {
+            reader.close(reader.data);
+        }
+        return NULL;
+    }
+}
+
+// Failing to save the cache, eg on a read-only or full file system, isn't an error
+STATIC void mp_code_cache_save(const char *cache_name, const byte *key, mp_raw_code_t *rc) {
+    if (mp_raw_code_has_native(rc)) {
+        // native code may live in memory that can't be read byte by byte, and is quick to emit anyway
+        return;
+    }
+    volatile mp_obj_t file = MP_OBJ_NULL;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t args[2] = { mp_obj_new_str(cache_name, strlen(cache_name)), MP_OBJ_NEW_QSTR(MP_QSTR_wb) };
+        file = mp_builtin_open(2, args, (mp_map_t*)&mp_const_empty_map);
+        // the key is written last, so an incomplete file doesn't match any source
+        static const byte no_key[MP_CODE_CACHE_KEY_SIZE] = {0};
+        mp_stream_write(file, no_key, sizeof(no_key), MP_STREAM_RW_WRITE);
+        mp_print_t file_print = {MP_OBJ_TO_PTR(file), mp_stream_write_adaptor};
+        mp_raw_code_save(rc, &file_print);
+        struct mp_stream_seek_t seek_s = { .offset = 0, .whence = MP_SEEK_SET };
+        int errcode;
+        if (mp_get_stream(file)->ioctl(file, MP_STREAM_SEEK, (mp_uint_t)(uintptr_t)&seek_s, &errcode) == MP_STREAM_ERROR) {
+            mp_raise_OSError(errcode);
+        }
+        mp_stream_write(file, key, MP_CODE_CACHE_KEY_SIZE, MP_STREAM_RW_WRITE);
+        mp_obj_t f = file;
+        file = MP_OBJ_NULL;
+        mp_stream_close(f);
+        nlr_pop();
+    } else if (file != MP_OBJ_NULL) {
+        if (nlr_push(&nlr) == 0) {
+            mp_stream_close(file);
+            nlr_pop();
+        }
+    }
+}
+
+mp_raw_code_t *mp_raw_code_compile_file_cached(const char *filename) {
+    byte key[MP_CODE_CACHE_KEY_SIZE];
+    mp_code_cache_key(filename, key);
+
+    vstr_t cache_name;
+    vstr_init(&cache_name, strlen(filename) + 2);
+    vstr_add_str(&cache_name, filename);
+    vstr_add_char(&cache_name, 'c');
+
+    mp_raw_code_t *rc = mp_code_cache_load(vstr_null_terminated_str(&cache_name), key);
+    if (rc == NULL) {
+        mp_lexer_t *lex = mp_lexer_new_from_file(filename);
+        qstr source_name = lex->source_name;
+        mp_parse_tree_t parse_tree = mp_parse(lex, MP_PARSE_FILE_INPUT);
+        rc = mp_compile_to_raw_code(&parse_tree, source_name, MP_EMIT_OPT_NONE, false);
+        mp_code_cache_save(vstr_null_terminated_str(&cache_name), key, rc);
+    }
+    vstr_clear(&cache_name);
+    return rc;
+}
+
+#endif // MICROPY_PERSISTENT_CODE_CACHE
@@ -31,7 +31,7 @@
 #include "py/emitglue.h"
 
 // The current version of .mpy files
-#define MPY_VERSION 4
+#define MPY_VERSION 5
 
 enum {
     MP_NATIVE_ARCH_NONE = 0,
@@ -44,12 +44,34 @@ enum {
     MP_NATIVE_ARCH_ARMV7EMSP,
     MP_NATIVE_ARCH_ARMV7EMDP,
     MP_NATIVE_ARCH_XTENSA,
+    MP_NATIVE_ARCH_XTENSAWIN,
 };
 
 mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader);
 mp_raw_code_t *mp_raw_code_load_mem(const byte *buf, size_t len);
 mp_raw_code_t *mp_raw_code_load_file(const char *filename);
 
+#if MICROPY_PERSISTENT_CODE_IMAGE
+typedef struct _mp_raw_code_image_writer_t {
+    void *data;
+    size_t max_len;
+    // writes len bytes at the given offset of the image, the header at offset 0 is written last
+    bool (*write)(void *data, size_t offset, const void *buf, size_t len);
+} mp_raw_code_image_writer_t;
+
+// Must be called right after mp_init(), also without an image
+bool mp_raw_code_image_mount(const byte *image, size_t len);
+// Returns the module names of the mounted image in the format of the frozen modules names
+const char *mp_raw_code_image_names(void);
+mp_raw_code_t *mp_raw_code_image_load(size_t index);
+size_t mp_raw_code_image_build(size_t n_files, const mp_obj_t *files, mp_raw_code_image_writer_t *writer);
+#endif
+
+#if MICROPY_PERSISTENT_CODE_CACHE
+// Compiles the file, or loads its bytecode from the cache if that was saved from the same source
+mp_raw_code_t *mp_raw_code_compile_file_cached(const char *filename);
+#endif
+
 void mp_raw_code_save(mp_raw_code_t *rc, mp_print_t *print);
 void mp_raw_code_save_file(mp_raw_code_t *rc, const char *filename);
 
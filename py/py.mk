@@ -183,6 +183,7 @@ PY_CORE_O_BASENAME = $(addprefix py/,\
 	emitnarm.o \
 	asmxtensa.o \
 	emitnxtensa.o \
+	emitnxtensawin.o \
 	emitinlinextensa.o \
 	formatfloat.o \
 	parsenumbase.o \
@@ -270,9 +271,13 @@ PY_EXTMOD_O_BASENAME = \
 	extmod/moduzlib.o \
 	extmod/moduheapq.o \
 	extmod/modutimeq.o \
+	extmod/moduasyncio.o \
 	extmod/moduhashlib.o \
 	extmod/moducryptolib.o \
 	extmod/modubinascii.o \
+	extmod/ubinascii_base64.o \
+	extmod/moducrc.o \
+	extmod/modudsp.o \
 	extmod/virtpin.o \
 	extmod/machine_mem.o \
 	extmod/machine_pinbase.o \
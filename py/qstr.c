@@ -32,8 +32,8 @@
 #include "py/qstr.h"
 #include "py/gc.h"
 
-// NOTE: we are using linear arrays to store and search for qstr's (unique strings, interned strings)
-// ultimately we will replace this with a static hash table of some kind
+// NOTE: we are using linear arrays to store qstr's (unique strings, interned strings), and
+// search them linearly unless MICROPY_QSTR_HASH_INDEX indexes them by hash
 // also probably need to include the length in the string data, to allow null bytes in the string
 
 #if MICROPY_DEBUG_VERBOSE // print debugging info
@@ -80,6 +80,11 @@
 #define QSTR_EXIT()
 #endif
 
+#if MICROPY_QSTR_HASH_INDEX && MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
+// qstr_find_strn() may build the index, and is called without the qstr mutex
+#error MICROPY_QSTR_HASH_INDEX requires the GIL
+#endif
+
 // Initial number of entries for qstr pool, set so that the first dynamically
 // allocated pool is twice this size.  The value here must be <= MP_QSTRnumber_of.
 #define MICROPY_ALLOC_QSTR_ENTRIES_INIT (10)
@@ -124,6 +129,14 @@ void qstr_init(void) {
     MP_STATE_VM(last_pool) = (qstr_pool_t*)&CONST_POOL; // we won't modify the const_pool since it has no allocated room left
     MP_STATE_VM(qstr_last_chunk) = NULL;
 
+    #if MICROPY_QSTR_HASH_INDEX
+    MP_STATE_VM(qstr_index) = NULL;
+    MP_STATE_VM(qstr_index_alloc) = 0;
+    MP_STATE_VM(qstr_index_total) = 0;
+    MP_STATE_VM(qstr_index_lookups) = 0;
+    MP_STATE_VM(qstr_index_probes) = 0;
+    #endif
+
     #if MICROPY_PY_THREAD
     mp_thread_mutex_init(&MP_STATE_VM(qstr_mutex));
     #endif
@@ -139,6 +152,107 @@ STATIC const byte *find_qstr(qstr q) {
     return pool->qstrs[q - pool->total_prev_len];
 }
 
+#if MICROPY_QSTR_HASH_INDEX
+
+// The index is a table of qstr ids, with linear probing from the qstr hash
+// and 0 (MP_QSTR_NULL, never looked up) for a free slot. It covers the
+// qstrs with ids below qstr_index_total.
+
+#define QSTR_INDEX_ALLOC_MIN (256)
+
+STATIC size_t qstr_total(void) {
+    return MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len;
+}
+
+STATIC void qstr_index_insert(qstr q, mp_uint_t hash) {
+    uint16_t *index = MP_STATE_VM(qstr_index);
+    size_t mask = MP_STATE_VM(qstr_index_alloc) - 1;
+    size_t i = hash & mask;
+    while (index[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    index[i] = q;
+}
+
+STATIC void qstr_index_free(void) {
+    m_del(uint16_t, MP_STATE_VM(qstr_index), MP_STATE_VM(qstr_index_alloc));
+    MP_STATE_VM(qstr_index) = NULL;
+    MP_STATE_VM(qstr_index_alloc) = 0;
+}
+
+// Returns false if there is no index, and the pools are to be scanned
+STATIC bool qstr_index_build(void) {
+    size_t total = qstr_total();
+    if (MP_STATE_VM(qstr_index) != NULL || MP_STATE_VM(qstr_index_total) == total) {
+        // built, or could not be built for as many qstrs as there are now
+        return MP_STATE_VM(qstr_index) != NULL;
+    }
+    MP_STATE_VM(qstr_index_total) = total;
+    if (total > 0xffff / 2) {
+        // ids don't fit the slots
+        return false;
+    }
+
+    size_t alloc = QSTR_INDEX_ALLOC_MIN;
+    while (alloc < 2 * total) {
+        alloc *= 2;
+    }
+    uint16_t *index = m_new_maybe(uint16_t, alloc);
+    if (index == NULL) {
+        return false;
+    }
+    memset(index, 0, alloc * sizeof(uint16_t));
+    MP_STATE_VM(qstr_index) = index;
+    MP_STATE_VM(qstr_index_alloc) = alloc;
+
+    // newest pool first, so that the newest of 2 equal strings comes first in
+    // its probe sequence and is found, as the scan of the pools would
+    for (qstr_pool_t *pool = MP_STATE_VM(last_pool); pool != NULL; pool = pool->prev) {
+        for (size_t i = 0; i < pool->len; i++) {
+            qstr q = pool->total_prev_len + i;
+            if (q != MP_QSTR_NULL) {
+                qstr_index_insert(q, Q_GET_HASH(pool->qstrs[i]));
+            }
+        }
+    }
+    return true;
+}
+
+STATIC void qstr_index_add(qstr q, mp_uint_t hash) {
+    if (MP_STATE_VM(qstr_index) == NULL) {
+        return;
+    }
+    if (2 * (q + 1) > MP_STATE_VM(qstr_index_alloc)) {
+        // too full, a bigger one is built on the next lookup
+        qstr_index_free();
+        return;
+    }
+    qstr_index_insert(q, hash);
+    MP_STATE_VM(qstr_index_total) = q + 1;
+}
+
+STATIC qstr qstr_index_find(const char *str, size_t str_len, mp_uint_t str_hash) {
+    const uint16_t *index = MP_STATE_VM(qstr_index);
+    size_t mask = MP_STATE_VM(qstr_index_alloc) - 1;
+    MP_STATE_VM(qstr_index_lookups) += 1;
+    for (size_t i = str_hash & mask; index[i] != 0; i = (i + 1) & mask) {
+        MP_STATE_VM(qstr_index_probes) += 1;
+        const byte *q = find_qstr(index[i]);
+        if (Q_GET_HASH(q) == str_hash && Q_GET_LENGTH(q) == str_len && memcmp(Q_GET_DATA(q), str, str_len) == 0) {
+            return index[i];
+        }
+    }
+    return MP_QSTR_NULL;
+}
+
+void qstr_index_info(size_t *n_slots, size_t *n_lookups, size_t *n_probes) {
+    *n_slots = MP_STATE_VM(qstr_index_alloc);
+    *n_lookups = MP_STATE_VM(qstr_index_lookups);
+    *n_probes = MP_STATE_VM(qstr_index_probes);
+}
+
+#endif // MICROPY_QSTR_HASH_INDEX
+
 // qstr_mutex must be taken while in this function
 STATIC qstr qstr_add(const byte *q_ptr) {
     DEBUG_printf("QSTR: add hash=%d len=%d data=%.*s\n", Q_GET_HASH(q_ptr), Q_GET_LENGTH(q_ptr), Q_GET_LENGTH(q_ptr), Q_GET_DATA(q_ptr));
@@ -165,15 +279,26 @@ STATIC qstr qstr_add(const byte *q_ptr) {
 
     // add the new qstr
     MP_STATE_VM(last_pool)->qstrs[MP_STATE_VM(last_pool)->len++] = q_ptr;
+    qstr q = MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+
+    #if MICROPY_QSTR_HASH_INDEX
+    qstr_index_add(q, Q_GET_HASH(q_ptr));
+    #endif
 
     // return id for the newly-added qstr
-    return MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+    return q;
 }
 
 qstr qstr_find_strn(const char *str, size_t str_len) {
     // work out hash of str
     mp_uint_t str_hash = qstr_compute_hash((const byte*)str, str_len);
 
+    #if MICROPY_QSTR_HASH_INDEX
+    if (qstr_index_build()) {
+        return qstr_index_find(str, str_len, str_hash);
+    }
+    #endif
+
     // search pools for the data
     for (qstr_pool_t *pool = MP_STATE_VM(last_pool); pool != NULL; pool = pool->prev) {
         for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
@@ -73,5 +73,8 @@ const byte *qstr_data(qstr q, size_t *len);
 
 void qstr_pool_info(size_t *n_pool, size_t *n_qstr, size_t *n_str_data_bytes, size_t *n_total_bytes);
 void qstr_dump_data(void);
+#if MICROPY_QSTR_HASH_INDEX
+void qstr_index_info(size_t *n_slots, size_t *n_lookups, size_t *n_probes);
+#endif
 
 #endif // MICROPY_INCLUDED_PY_QSTR_H
@@ -106,12 +106,23 @@ void mp_init(void) {
     MP_STATE_VM(mp_module_builtins_override_dict) = NULL;
     #endif
 
+    #if MICROPY_GC_STATS_CALLERS
+    // no code is running yet
+    MP_STATE_THREAD(current_code_state) = NULL;
+    #endif
+
     #if MICROPY_PY_OS_DUPTERM
     for (size_t i = 0; i < MICROPY_PY_OS_DUPTERM; ++i) {
         MP_STATE_VM(dupterm_objs[i]) = MP_OBJ_NULL;
     }
     #endif
 
+    #if MICROPY_PY_URE && MICROPY_PY_URE_CACHE
+    for (size_t i = 0; i < MICROPY_PY_URE_CACHE * 2; ++i) {
+        MP_STATE_VM(ure_cache[i]) = MP_OBJ_NULL;
+    }
+    #endif
+
     #if MICROPY_VFS
     // initialise the VFS sub-system
     MP_STATE_VM(vfs_cur) = NULL;
@@ -120,6 +131,12 @@ void mp_init(void) {
 
     #if MICROPY_PY_THREAD_GIL
     mp_thread_mutex_init(&MP_STATE_VM(gil_mutex));
+    #if MICROPY_PY_THREAD_GIL_CONTENTION
+    MP_STATE_VM(gil_waiting) = 0;
+    MP_STATE_VM(gil_urgent) = 0;
+    MP_STATE_VM(gil_idle_polls) = 0;
+    MP_STATE_VM(gil_handoffs) = 0;
+    #endif
     #endif
 
     MP_THREAD_GIL_ENTER();
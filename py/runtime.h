@@ -74,6 +74,12 @@ static inline unsigned int mp_sched_num_pending(void) { return MP_STATE_VM(sched
 bool mp_sched_schedule(mp_obj_t function, mp_obj_t arg);
 #endif
 
+#if MICROPY_PY_MICROPYTHON_PROFILE
+struct _mp_code_state_t;
+void mp_profile_tick(void);
+void mp_profile_sample(const struct _mp_code_state_t *code_state);
+#endif
+
 // extra printing method specifically for mp_obj_t's which are integral type
 int mp_print_mp_int(const mp_print_t *print, mp_obj_t x, int base, int base_char, int flags, char fill, int width, int prec);
 
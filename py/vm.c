@@ -90,6 +90,29 @@
 #define TOP() (*sp)
 #define SET_TOP(val) *sp = (val)
 
+// The map lookup cache for LOAD_NAME, LOAD_GLOBAL, LOAD_ATTR and STORE_ATTR is
+// a hint of the slot where the key was last found; it's always verified before
+// use.  It's either a byte following the qstr in the bytecode itself, or an
+// entry of a RAM table indexed by the position of the opcode, which also works
+// for bytecode that can't be written to (eg frozen in ROM).
+#if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+#define MICROPY_OPT_CACHE_MAP_LOOKUP (1)
+#define MAP_CACHE_GET(ip) (*(ip))
+#define MAP_CACHE_SET(ip, x) (*(byte*)(ip) = (x))
+#define MAP_CACHE_SKIP(ip) (ip)++
+#elif MICROPY_OPT_CACHE_MAP_LOOKUP_IN_RAM
+#define MICROPY_OPT_CACHE_MAP_LOOKUP (1)
+#define MAP_CACHE_INDEX(ip) ((((uintptr_t)(ip)) ^ ((uintptr_t)(ip) >> 9)) & (MICROPY_OPT_CACHE_MAP_LOOKUP_IN_RAM_SIZE - 1))
+#define MAP_CACHE_GET(ip) (map_lookup_cache[MAP_CACHE_INDEX(ip)])
+#define MAP_CACHE_SET(ip, x) (map_lookup_cache[MAP_CACHE_INDEX(ip)] = (x))
+#define MAP_CACHE_SKIP(ip)
+// Racing updates from other threads can only make a hint stale, so this
+// needs no locking.
+STATIC byte map_lookup_cache[MICROPY_OPT_CACHE_MAP_LOOKUP_IN_RAM_SIZE];
+#else
+#define MICROPY_OPT_CACHE_MAP_LOOKUP (0)
+#endif
+
 #if MICROPY_PY_SYS_EXC_INFO
 #define CLEAR_SYS_EXC_INFO() MP_STATE_VM(cur_exception) = NULL;
 #else
@@ -146,9 +169,20 @@ mp_vm_return_kind_t mp_execute_bytecode(mp_code_state_t *code_state, volatile mp
     // loop and the exception handler, leading to very obscure bugs.
     #define RAISE(o) do { nlr_pop(); nlr.ret_val = MP_OBJ_TO_PTR(o); goto exception_handler; } while (0)
 
+#if MICROPY_GC_STATS_CALLERS
+    // GC allocations done while this code runs are attributed to it
+    #define ENTER_CODE_STATE() MP_STATE_THREAD(current_code_state) = code_state
+    #define LEAVE_CODE_STATE() MP_STATE_THREAD(current_code_state) = prev_code_state
+    mp_code_state_t *prev_code_state = MP_STATE_THREAD(current_code_state);
+#else
+    #define ENTER_CODE_STATE()
+    #define LEAVE_CODE_STATE()
+#endif
+
 #if MICROPY_STACKLESS
 run_code_state: ;
 #endif
+    ENTER_CODE_STATE();
     // Pointers which are constant for particular invocation of mp_execute_bytecode()
     mp_obj_t * /*const*/ fastn;
     mp_exc_stack_t * /*const*/ exc_stack;
@@ -263,7 +297,7 @@ dispatch_loop:
                     goto load_check;
                 }
 
-                #if !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                #if !MICROPY_OPT_CACHE_MAP_LOOKUP
                 ENTRY(MP_BC_LOAD_NAME): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
@@ -275,24 +309,24 @@ dispatch_loop:
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
                     mp_obj_t key = MP_OBJ_NEW_QSTR(qst);
-                    mp_uint_t x = *ip;
+                    mp_uint_t x = MAP_CACHE_GET(ip);
                     if (x < mp_locals_get()->map.alloc && mp_locals_get()->map.table[x].key == key) {
                         PUSH(mp_locals_get()->map.table[x].value);
                     } else {
                         mp_map_elem_t *elem = mp_map_lookup(&mp_locals_get()->map, MP_OBJ_NEW_QSTR(qst), MP_MAP_LOOKUP);
                         if (elem != NULL) {
-                            *(byte*)ip = (elem - &mp_locals_get()->map.table[0]) & 0xff;
+                            MAP_CACHE_SET(ip, (elem - &mp_locals_get()->map.table[0]) & 0xff);
                             PUSH(elem->value);
                         } else {
                             PUSH(mp_load_name(MP_OBJ_QSTR_VALUE(key)));
                         }
                     }
-                    ip++;
+                    MAP_CACHE_SKIP(ip);
                     DISPATCH();
                 }
                 #endif
 
-                #if !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                #if !MICROPY_OPT_CACHE_MAP_LOOKUP
                 ENTRY(MP_BC_LOAD_GLOBAL): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
@@ -304,24 +338,24 @@ dispatch_loop:
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
                     mp_obj_t key = MP_OBJ_NEW_QSTR(qst);
-                    mp_uint_t x = *ip;
+                    mp_uint_t x = MAP_CACHE_GET(ip);
                     if (x < mp_globals_get()->map.alloc && mp_globals_get()->map.table[x].key == key) {
                         PUSH(mp_globals_get()->map.table[x].value);
                     } else {
                         mp_map_elem_t *elem = mp_map_lookup(&mp_globals_get()->map, MP_OBJ_NEW_QSTR(qst), MP_MAP_LOOKUP);
                         if (elem != NULL) {
-                            *(byte*)ip = (elem - &mp_globals_get()->map.table[0]) & 0xff;
+                            MAP_CACHE_SET(ip, (elem - &mp_globals_get()->map.table[0]) & 0xff);
                             PUSH(elem->value);
                         } else {
                             PUSH(mp_load_global(MP_OBJ_QSTR_VALUE(key)));
                         }
                     }
-                    ip++;
+                    MAP_CACHE_SKIP(ip);
                     DISPATCH();
                 }
                 #endif
 
-                #if !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                #if !MICROPY_OPT_CACHE_MAP_LOOKUP
                 ENTRY(MP_BC_LOAD_ATTR): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
@@ -335,7 +369,7 @@ dispatch_loop:
                     mp_obj_t top = TOP();
                     if (mp_obj_is_instance_type(mp_obj_get_type(top))) {
                         mp_obj_instance_t *self = MP_OBJ_TO_PTR(top);
-                        mp_uint_t x = *ip;
+                        mp_uint_t x = MAP_CACHE_GET(ip);
                         mp_obj_t key = MP_OBJ_NEW_QSTR(qst);
                         mp_map_elem_t *elem;
                         if (x < self->members.alloc && self->members.table[x].key == key) {
@@ -343,18 +377,18 @@ dispatch_loop:
                         } else {
                             elem = mp_map_lookup(&self->members, key, MP_MAP_LOOKUP);
                             if (elem != NULL) {
-                                *(byte*)ip = elem - &self->members.table[0];
+                                MAP_CACHE_SET(ip, elem - &self->members.table[0]);
                             } else {
                                 goto load_attr_cache_fail;
                             }
                         }
                         SET_TOP(elem->value);
-                        ip++;
+                        MAP_CACHE_SKIP(ip);
                         DISPATCH();
                     }
                 load_attr_cache_fail:
                     SET_TOP(mp_load_attr(top, qst));
-                    ip++;
+                    MAP_CACHE_SKIP(ip);
                     DISPATCH();
                 }
                 #endif
@@ -413,7 +447,7 @@ dispatch_loop:
                     DISPATCH();
                 }
 
-                #if !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                #if !MICROPY_OPT_CACHE_MAP_LOOKUP
                 ENTRY(MP_BC_STORE_ATTR): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
@@ -433,7 +467,7 @@ dispatch_loop:
                     mp_obj_t top = TOP();
                     if (mp_obj_is_instance_type(mp_obj_get_type(top)) && sp[-1] != MP_OBJ_NULL) {
                         mp_obj_instance_t *self = MP_OBJ_TO_PTR(top);
-                        mp_uint_t x = *ip;
+                        mp_uint_t x = MAP_CACHE_GET(ip);
                         mp_obj_t key = MP_OBJ_NEW_QSTR(qst);
                         mp_map_elem_t *elem;
                         if (x < self->members.alloc && self->members.table[x].key == key) {
@@ -441,20 +475,20 @@ dispatch_loop:
                         } else {
                             elem = mp_map_lookup(&self->members, key, MP_MAP_LOOKUP);
                             if (elem != NULL) {
-                                *(byte*)ip = elem - &self->members.table[0];
+                                MAP_CACHE_SET(ip, elem - &self->members.table[0]);
                             } else {
                                 goto store_attr_cache_fail;
                             }
                         }
                         elem->value = sp[-1];
                         sp -= 2;
-                        ip++;
+                        MAP_CACHE_SKIP(ip);
                         DISPATCH();
                     }
                 store_attr_cache_fail:
                     mp_store_attr(sp[0], qst, sp[-1]);
                     sp -= 2;
-                    ip++;
+                    MAP_CACHE_SKIP(ip);
                     DISPATCH();
                 }
                 #endif
@@ -1099,6 +1133,7 @@ unwind_return:
                         goto run_code_state;
                     }
                     #endif
+                    LEAVE_CODE_STATE();
                     return MP_VM_RETURN_NORMAL;
 
                 ENTRY(MP_BC_RAISE_VARARGS): {
@@ -1136,6 +1171,7 @@ yield:
                     code_state->ip = ip;
                     code_state->sp = sp;
                     code_state->exc_sp = MP_TAGPTR_MAKE(exc_sp, 0);
+                    LEAVE_CODE_STATE();
                     return MP_VM_RETURN_YIELD;
 
                 ENTRY(MP_BC_YIELD_FROM): {
@@ -1265,6 +1301,7 @@ yield:
                     mp_obj_t obj = mp_obj_new_exception_msg(&mp_type_NotImplementedError, "byte code not implemented");
                     nlr_pop();
                     code_state->state[0] = obj;
+                    LEAVE_CODE_STATE();
                     return MP_VM_RETURN_EXCEPTION;
                 }
 
@@ -1275,6 +1312,12 @@ yield:
 pending_exception_check:
                 MICROPY_VM_HOOK_LOOP
 
+                #if MICROPY_PY_MICROPYTHON_PROFILE
+                if (MP_STATE_VM(profile_pending)) {
+                    mp_profile_sample(code_state);
+                }
+                #endif
+
                 #if MICROPY_ENABLE_SCHEDULER
                 // This is an inlined variant of mp_handle_pending
                 if (MP_STATE_VM(sched_state) == MP_SCHED_PENDING) {
@@ -1314,8 +1357,12 @@ pending_exception_check:
                     if (MP_STATE_VM(sched_state) == MP_SCHED_IDLE)
                     #endif
                     {
+                    #if MICROPY_PY_THREAD_GIL_CONTENTION
+                    mp_thread_gil_poll();
+                    #else
                     MP_THREAD_GIL_EXIT();
                     MP_THREAD_GIL_ENTER();
+                    #endif
                     }
                 }
                 #endif
@@ -1362,50 +1409,10 @@ unwind_loop:
             // TODO: don't set traceback for exceptions re-raised by END_FINALLY.
             // But consider how to handle nested exceptions.
             if (nlr.ret_val != &mp_const_GeneratorExit_obj) {
-                const byte *ip = code_state->fun_bc->bytecode;
-                ip = mp_decode_uint_skip(ip); // skip n_state
-                ip = mp_decode_uint_skip(ip); // skip n_exc_stack
-                ip++; // skip scope_params
-                ip++; // skip n_pos_args
-                ip++; // skip n_kwonly_args
-                ip++; // skip n_def_pos_args
-                size_t bc = code_state->ip - ip;
-                size_t code_info_size = mp_decode_uint_value(ip);
-                ip = mp_decode_uint_skip(ip); // skip code_info_size
-                bc -= code_info_size;
-                #if MICROPY_PERSISTENT_CODE
-                qstr block_name = ip[0] | (ip[1] << 8);
-                qstr source_file = ip[2] | (ip[3] << 8);
-                ip += 4;
-                #else
-                qstr block_name = mp_decode_uint_value(ip);
-                ip = mp_decode_uint_skip(ip);
-                qstr source_file = mp_decode_uint_value(ip);
-                ip = mp_decode_uint_skip(ip);
-                #endif
-                size_t source_line = 1;
-                size_t c;
-                while ((c = *ip)) {
-                    size_t b, l;
-                    if ((c & 0x80) == 0) {
-                        // 0b0LLBBBBB encoding
-                        b = c & 0x1f;
-                        l = c >> 5;
-                        ip += 1;
-                    } else {
-                        // 0b1LLLBBBB 0bLLLLLLLL encoding (l's LSB in second byte)
-                        b = c & 0xf;
-                        l = ((c << 4) & 0x700) | ip[1];
-                        ip += 2;
-                    }
-                    if (bc >= b) {
-                        bc -= b;
-                        source_line += l;
-                    } else {
-                        // found source line corresponding to bytecode offset
-                        break;
-                    }
-                }
+                qstr source_file;
+                size_t source_line;
+                qstr block_name;
+                mp_bytecode_get_source_pos(code_state, &source_file, &source_line, &block_name);
                 mp_obj_exception_add_traceback(MP_OBJ_FROM_PTR(nlr.ret_val), source_file, source_line, block_name);
             }
 
@@ -1449,6 +1456,7 @@ unwind_loop:
                 exc_stack = (mp_exc_stack_t*)(code_state->state + n_state);
                 // variables that are visible to the exception handler (declared volatile)
                 exc_sp = MP_TAGPTR_PTR(code_state->exc_sp); // stack grows up, exc_sp points to top of stack
+                ENTER_CODE_STATE();
                 goto unwind_loop;
 
             #endif
@@ -1456,6 +1464,7 @@ unwind_loop:
                 // propagate exception to higher level
                 // Note: ip and sp don't have usable values at this point
                 code_state->state[0] = MP_OBJ_FROM_PTR(nlr.ret_val); // put exception here because sp is invalid
+                LEAVE_CODE_STATE();
                 return MP_VM_RETURN_EXCEPTION;
             }
         }
@@ -0,0 +1,44 @@
+# bytes methods on bytearray, and with buffers as arguments
+try:
+    bytearray.find
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+ba = bytearray(b'+CSQ: 21,99\r\nOK\r\n')
+print(ba.find(b'OK'), ba.rfind(b'\r\n'), ba.index(b':'), ba.rindex(b'9'))
+print(ba.find(b'ERROR'))
+print(ba.startswith(b'+CSQ'), ba.endswith(b'\r\n'), ba.startswith(b'OK', 13))
+print(ba.split(b'\r\n') == [b'+CSQ: 21,99', b'OK', b''])
+print(ba.rsplit(b'\r\n', 1) == [b'+CSQ: 21,99\r\nOK', b''])
+print(ba.split() == [b'+CSQ:', b'21,99', b'OK'])
+print(ba.strip() == b'+CSQ: 21,99\r\nOK')
+print(bytearray(b'xxabcxx').strip(b'x') == b'abc')
+print(bytearray(b'abc').strip() == b'abc')
+print(ba.count(b'\r\n'))
+print(ba.partition(b': ')[2] == b'21,99\r\nOK\r\n')
+print(ba.partition(b'#')[0] == ba)
+
+# memoryview and bytearray arguments to bytes methods
+mv = memoryview(b'__,__')[2:3]
+print(b'1,2,3'.split(mv))
+print(b'1,2,3'.find(mv), b'1,2,3'.rfind(bytearray(b',')))
+print(b'1,2,3'.count(bytearray(b',')))
+r = b'1,2,3'.partition(mv)
+print(r[0], r[2])
+print(b'--x--'.strip(bytearray(b'-')))
+print(b'abc'.startswith(memoryview(b'ab')), b'abc'.endswith(bytearray(b'bc')))
+
+# str methods still want str
+try:
+    'a,b'.split(b',')
+except TypeError:
+    print('TypeError')
+try:
+    b'a,b'.find(',')
+except TypeError:
+    print('TypeError')
+try:
+    b'a,b'.split(1)
+except TypeError:
+    print('TypeError')
@@ -32,3 +32,24 @@ if hasattr(gc, 'threshold'):
     gc.threshold(1)
     [[], []]
     gc.threshold(-1)
+
+if hasattr(gc, 'pauses'):
+    # uPy has this extra function
+    # check it counts each collection once and can be cleared
+    n = len(gc.pauses(True))
+    assert n > 0
+    assert gc.pauses() == (0,) * n
+    gc.collect()
+    assert sum(gc.pauses()) == 1
+
+if hasattr(gc, 'stats'):
+    # uPy has this extra function
+    # check it counts the allocations and collections and can be cleared
+    gc.stats(True)
+    [[], []]
+    gc.collect()
+    s = gc.stats()
+    assert sum(s['allocs']) >= 3
+    assert sum(s['bytes']) > 0
+    assert s['collections'] == 1
+    assert s['pause_max_us'] <= s['pause_total_us']
@@ -0,0 +1,71 @@
+try:
+    import ustruct as struct
+except:
+    try:
+        import struct
+    except ImportError:
+        print("SKIP")
+        raise SystemExit
+try:
+    struct.Struct
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+s = struct.Struct("<BHi4s")
+print(s.size, s.format)
+b = s.pack(1, 2, -3, b"ab")
+print(b, b == struct.pack("<BHi4s", 1, 2, -3, b"ab"))
+print(s.unpack(b))
+print(s.unpack_from(b"\x00\x00" + b, 2))
+print(s.unpack_from(b"\x00" + b, -len(b)))
+
+# native alignment is the same as the module functions
+for fmt in ("@bi", "@b2hq", "@3sI", ">2h3B"):
+    s2 = struct.Struct(fmt)
+    print(fmt, s2.size == struct.calcsize(fmt))
+
+s2 = struct.Struct(">2h3B")
+v = (-1, 2, 3, 4, 5)
+print(s2.pack(*v) == struct.pack(">2h3B", *v), s2.unpack(s2.pack(*v)))
+
+buf = bytearray(12)
+s.pack_into(buf, 1, 255, 65535, 7, b"xyz")
+print(buf)
+
+# decoding into a preallocated list
+out = [None] * 4
+r = s.unpack_from(buf, 1, out=out)
+print(r is out, out)
+
+# iteration over consecutive records
+rec = struct.Struct("<hB")
+data = rec.pack(1, 2) + rec.pack(-3, 4) + rec.pack(5, 6)
+for t in rec.iter_unpack(data):
+    print(t)
+print(list(rec.iter_unpack(b"")))
+
+try:
+    rec.iter_unpack(data + b"\x00")
+except ValueError:
+    print("ValueError")
+
+try:
+    s.unpack(b"\x00")
+except ValueError:
+    print("ValueError")
+
+try:
+    s.pack(1, 2)
+except ValueError:
+    print("ValueError")
+
+try:
+    s.unpack_from(b, out=[0])
+except ValueError:
+    print("ValueError")
+
+try:
+    struct.Struct("<2")
+except ValueError:
+    print("ValueError")
@@ -1,10 +1,44 @@
-import time
+try:
+    import utime as time
+except ImportError:
+    import time
 
 
 ITERS = 20000000
 
+# the run-bench-tests --target option sets this to the host:port of its TCP sink
+SINK = None
+
+def ticks():
+    # in microseconds, time.ticks_us() where the port has it
+    if hasattr(time, 'ticks_us'):
+        return time.ticks_us()
+    return time.time() * 1000000
+
+def elapsed(t):
+    if hasattr(time, 'ticks_diff'):
+        return time.ticks_diff(time.ticks_us(), t) / 1000000
+    return (time.time() * 1000000 - t) / 1000000
+
 def run(f):
-    t = time.time()
+    t = ticks()
     f(ITERS)
-    t = time.time() - t
+    t = elapsed(t)
     print(t)
+
+def run_heap(f):
+    # the heap left allocated by f with the GC off, nothing is reclaimed in between
+    import gc
+    gc.collect()
+    gc.disable()
+    m = gc.mem_alloc()
+    f()
+    m = gc.mem_alloc() - m
+    gc.enable()
+    print(float(m))
+
+def run_time(f):
+    # f does its own timing and returns seconds, or None when the board
+    # lacks what it needs
+    t = f()
+    print('SKIP' if t is None else float(t))
@@ -0,0 +1,23 @@
+# Coroutine switches scheduled in Python with utimeq, like the uasyncio of micropython-lib
+import bench
+import utime
+from utimeq import utimeq
+
+def task(n):
+    for i in range(n):
+        yield 0
+
+def test(num):
+    q = utimeq(4)
+    entry = [0, 0, 0]
+    for t in range(2):
+        q.push(utime.ticks_ms(), task(num // 200), None)
+    while q:
+        q.pop(entry)
+        try:
+            delay = next(entry[1])
+            q.push(utime.ticks_add(utime.ticks_ms(), delay), entry[1], None)
+        except StopIteration:
+            pass
+
+bench.run(test)
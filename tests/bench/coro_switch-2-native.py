@@ -0,0 +1,15 @@
+# Coroutine switches scheduled by the event loop core in C
+import bench
+import _uasyncio
+
+def task(n):
+    for i in range(n):
+        yield 0
+
+def test(num):
+    loop = _uasyncio.Loop(4)
+    for t in range(2):
+        loop.create_task(task(num // 200))
+    loop.run_forever()
+
+bench.run(test)
@@ -0,0 +1,21 @@
+# CRC-16/CCITT over a radio-sized payload
+# Plain bytecode
+import bench
+
+def crc16(buf):
+    crc = 0xffff
+    for b in buf:
+        crc ^= b << 8
+        for i in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xffff
+            else:
+                crc = (crc << 1) & 0xffff
+    return crc
+
+def test(num):
+    buf = bytearray(range(64))
+    for i in range(num // 20000):
+        crc16(buf)
+
+bench.run(test)
@@ -0,0 +1,22 @@
+# CRC-16/CCITT over a radio-sized payload
+# Native code emitter
+import bench
+
+@micropython.native
+def crc16(buf):
+    crc = 0xffff
+    for b in buf:
+        crc ^= b << 8
+        for i in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xffff
+            else:
+                crc = (crc << 1) & 0xffff
+    return crc
+
+def test(num):
+    buf = bytearray(range(64))
+    for i in range(num // 20000):
+        crc16(buf)
+
+bench.run(test)
@@ -0,0 +1,24 @@
+# CRC-16/CCITT over a radio-sized payload
+# Viper code emitter, with typed buffer access
+import bench
+
+@micropython.viper
+def crc16(buf) -> int:
+    p = ptr8(buf)
+    n = int(len(buf))
+    crc = 0xffff
+    for j in range(n):
+        crc ^= p[j] << 8
+        for i in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xffff
+            else:
+                crc = (crc << 1) & 0xffff
+    return crc
+
+def test(num):
+    buf = bytearray(range(64))
+    for i in range(num // 20000):
+        crc16(buf)
+
+bench.run(test)
@@ -0,0 +1,10 @@
+# Build a dict of 100 int keys, the table grows from empty each time
+import bench
+
+def test(num):
+    for i in range(num // 20000):
+        d = {}
+        for k in range(100):
+            d[k] = k
+
+bench.run(test)
@@ -0,0 +1,13 @@
+# Look up str keys of a dict of 100 entries
+import bench
+
+def test(num):
+    keys = ["key%d" % k for k in range(100)]
+    d = {}
+    for k in keys:
+        d[k] = 1
+    for i in range(num // 2000):
+        for k in keys:
+            d[k]
+
+bench.run(test)
@@ -0,0 +1,14 @@
+# Iterate the items of a dict that has had half its entries removed
+import bench
+
+def test(num):
+    d = {}
+    for k in range(200):
+        d[k] = k
+    for k in range(0, 200, 2):
+        del d[k]
+    for i in range(num // 2000):
+        for k, v in d.items():
+            pass
+
+bench.run(test)
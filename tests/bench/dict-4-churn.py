@@ -0,0 +1,12 @@
+# Remove the oldest entry and add a new one, the size of the dict stays the same
+import bench
+
+def test(num):
+    d = {}
+    for k in range(50):
+        d[k] = k
+    for k in range(50, 50 + num // 200):
+        del d[k - 50]
+        d[k] = k
+
+bench.run(test)
@@ -0,0 +1,9 @@
+# The heap used by a dict of 100 int keys
+import bench
+
+def test():
+    d = {}
+    for k in range(100):
+        d[k] = k
+
+bench.run_heap(test)
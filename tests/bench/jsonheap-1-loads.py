@@ -0,0 +1,12 @@
+import bench
+import ujson
+import jsonheap_doc
+
+text = ujson.dumps(jsonheap_doc.DOC)
+
+def test():
+    doc = ujson.loads(text)
+    ssid = doc["wifi"]["ssid"]
+    name = doc["device"]["name"]
+
+bench.run_heap(test)
@@ -0,0 +1,10 @@
+import bench
+import ujson
+import jsonheap_doc
+
+text = ujson.dumps(jsonheap_doc.DOC)
+
+def test():
+    keys = ujson.select(text, ("wifi.ssid", "device.name"))
+
+bench.run_heap(test)
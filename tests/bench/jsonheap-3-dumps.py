@@ -0,0 +1,12 @@
+import bench
+import ujson
+import uio
+import jsonheap_doc
+
+out = uio.BytesIO(bytearray(16384))
+
+def test():
+    out.seek(0)
+    out.write(ujson.dumps(jsonheap_doc.DOC))
+
+bench.run_heap(test)
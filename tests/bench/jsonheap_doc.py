@@ -0,0 +1,6 @@
+# A configuration-like document, shared by the jsonheap-* benchmarks
+DOC = {
+    "device": {"id": "0123456789abcdef", "name": "sensor", "version": "1.20.2"},
+    "wifi": {"ssid": "network", "password": "secret", "networks": [{"ssid": "net%d" % i, "rssi": -40 - i} for i in range(20)]},
+    "log": [{"t": 1600000000 + i, "v": [i, i * 2, i * 3], "msg": "measurement %d" % i} for i in range(60)],
+}
@@ -0,0 +1,8 @@
+# Build a telemetry line with the % operator
+import bench
+
+def test(num):
+    for i in range(num // 100):
+        s = "node=%s seq=%d temp=%.2f flags=%x" % ("lopy4", i, 21.5, i & 0xff)
+
+bench.run(test)
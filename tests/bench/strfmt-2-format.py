@@ -0,0 +1,8 @@
+# Build a telemetry line with str.format
+import bench
+
+def test(num):
+    for i in range(num // 100):
+        s = "node={} seq={} temp={:.2f} flags={:x}".format("lopy4", i, 21.5, i & 0xff)
+
+bench.run(test)
@@ -0,0 +1,15 @@
+# Build a telemetry line with a micropython.template parsed once,
+# str.format where there is no template
+import bench
+
+try:
+    from micropython import template
+except ImportError:
+    template = str
+
+def test(num):
+    t = template("node={} seq={} temp={:.2f} flags={:x}")
+    for i in range(num // 100):
+        s = t.format("lopy4", i, 21.5, i & 0xff)
+
+bench.run(test)
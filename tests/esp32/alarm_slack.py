@@ -0,0 +1,46 @@
+from machine import Timer
+import time
+import utime
+
+fired = {}
+
+def cb(alarm):
+    fired.setdefault(alarm, []).append(utime.ticks_ms())
+
+# alarm2 is due 20 ms after alarm1, its slack lets alarm1 wait for it
+alarm1 = Timer.Alarm(handler=cb, ms=100, periodic=True, slack_us=30000)
+time.sleep_ms(20)
+alarm2 = Timer.Alarm(handler=cb, ms=100, periodic=True)
+
+time.sleep_ms(1050)
+alarm1.cancel()
+alarm2.cancel()
+
+t1 = fired[alarm1]
+t2 = fired[alarm2]
+# the period is kept, the slack doesn't delay the next expiries
+print(len(t1) in (10, 11), len(t2) in (10, 11))
+# both expire in the same interrupt
+print(all(abs(utime.ticks_diff(a, b)) <= 2 for a, b in zip(t1, t2)))
+
+# without slack they expire separately
+fired = {}
+alarm1 = Timer.Alarm(handler=cb, ms=100, periodic=True)
+time.sleep_ms(20)
+alarm2 = Timer.Alarm(handler=cb, ms=100, periodic=True)
+time.sleep_ms(550)
+alarm1.cancel()
+alarm2.cancel()
+print(all(abs(utime.ticks_diff(b, a) - 20) <= 2 for a, b in zip(fired[alarm1], fired[alarm2])))
+
+# a one-shot alarm fires at most its slack late
+fired = {}
+start = utime.ticks_ms()
+alarm3 = Timer.Alarm(handler=cb, ms=50, slack_us=10000)
+time.sleep_ms(100)
+print(50 <= utime.ticks_diff(fired[alarm3][0], start) <= 62)
+
+try:
+    Timer.Alarm(handler=cb, ms=50, slack_us=-1)
+except ValueError:
+    print("ValueError")
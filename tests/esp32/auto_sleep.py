@@ -0,0 +1,43 @@
+import machine
+import network
+import utime
+
+# the radio refuses the light sleep
+network.WLAN().deinit()
+
+print(machine.auto_sleep())
+machine.auto_sleep(True, min_ms=10)
+print(machine.auto_sleep())
+machine.auto_sleep_stats(True)
+
+start = utime.ticks_ms()
+for i in range(5):
+    utime.sleep_ms(100)
+elapsed = utime.ticks_diff(utime.ticks_ms(), start)
+# the delays are neither shortened nor much longer
+print(500 <= elapsed < 550)
+
+sleeps, residency, latency_avg, latency_max, skipped = machine.auto_sleep_stats()
+print(sleeps == 5, 450 <= residency <= 500, latency_avg <= latency_max)
+
+# a pending alarm keeps the CPU up
+alarm = machine.Timer.Alarm(handler=lambda a: None, s=10)
+machine.auto_sleep_stats(True)
+utime.sleep_ms(50)
+alarm.cancel()
+print(machine.auto_sleep_stats()[0], machine.auto_sleep_stats()[4])
+
+# shorter delays than min_ms don't sleep
+machine.auto_sleep_stats(True)
+utime.sleep_ms(5)
+print(machine.auto_sleep_stats()[0])
+
+machine.auto_sleep(False)
+machine.auto_sleep_stats(True)
+utime.sleep_ms(50)
+print(machine.auto_sleep_stats()[0])
+
+try:
+    machine.auto_sleep(True, min_ms=0)
+except ValueError:
+    print('ValueError')
@@ -0,0 +1,37 @@
+# One round of calls spread over the firmware, more code than the 32KB flash cache holds
+import bench
+import ubinascii
+import uhashlib
+import ujson
+import ure
+import ustruct
+import math
+
+DATA = bytes(range(64))
+
+CALLS = (
+    lambda: ubinascii.hexlify(DATA),
+    lambda: ubinascii.b2a_base64(DATA),
+    lambda: uhashlib.sha256(DATA).digest(),
+    lambda: uhashlib.sha1(DATA).digest(),
+    lambda: ujson.dumps({'a': [1, 2.5, 'x']}),
+    lambda: ujson.loads('{"a": [1, 2.5, "x"]}'),
+    lambda: ure.match(r'(\d+)-(\w+)', '123-abc').group(2),
+    lambda: ustruct.pack('<IhB', 1, 2, 3),
+    lambda: math.sin(1.0) + math.log(2.0) + math.sqrt(3.0),
+    lambda: '{:08.3f}'.format(3.14159),
+    lambda: 'a,b,c'.split(',') + sorted([3, 1, 2]),
+    lambda: int('12345') * 10 ** 20,
+    lambda: bytes(DATA).decode(),
+)
+
+def test():
+    for call in CALLS:
+        call()
+    t = bench.ticks()
+    for i in range(200):
+        for call in CALLS:
+            call()
+    return bench.elapsed(t)
+
+bench.run_time(test)
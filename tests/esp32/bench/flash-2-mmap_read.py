@@ -0,0 +1,21 @@
+# Read a 64KB span of the memory-mapped "mpy" partition 4 times, twice the flash cache size
+import bench
+
+def test():
+    try:
+        import pycom
+        m = pycom.mmap('mpy')
+    except Exception:
+        return None
+    mv = memoryview(m)
+    n = min(len(mv), 64 * 1024)
+    buf = bytearray(4096)
+    t = bench.ticks()
+    for i in range(4):
+        for off in range(0, n, len(buf)):
+            buf[:] = mv[off:off + len(buf)]
+    t = bench.elapsed(t)
+    m.close()
+    return t
+
+bench.run_time(test)
@@ -0,0 +1,27 @@
+# Import a 40 function module, from the "mpy" image if it was frozen there with
+# pycom.freeze_mpy(['/flash/lib/bench_imp.mpy']), else compiled from /flash/lib
+import bench
+import os
+import sys
+
+NAME = 'bench_imp'
+
+def test():
+    try:
+        os.mkdir('/flash/lib')
+    except OSError:
+        pass
+    path = '/flash/lib/' + NAME + '.py'
+    with open(path, 'w') as f:
+        for i in range(40):
+            f.write('def f{0}(x):\n    return [x, {0}, "s{0}"]\n'.format(i))
+    worst = 0
+    for i in range(5):
+        sys.modules.pop(NAME, None)
+        t = bench.ticks()
+        __import__(NAME)
+        worst = max(worst, bench.elapsed(t))
+    os.remove(path)
+    return worst
+
+bench.run_time(test)
@@ -0,0 +1,18 @@
+# Write a 64KB file to /flash in 4KB chunks, including the close
+import bench
+import os
+
+NAME = '/flash/bench.tmp'
+
+def test():
+    buf = bytes(4096)
+    t = bench.ticks()
+    f = open(NAME, 'wb')
+    for i in range(16):
+        f.write(buf)
+    f.close()
+    t = bench.elapsed(t)
+    os.remove(NAME)
+    return t
+
+bench.run_time(test)
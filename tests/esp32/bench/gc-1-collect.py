@@ -0,0 +1,17 @@
+# The longest pause of gc.collect() with a heap of 2000 small live objects
+import bench
+import gc
+
+def test():
+    live = [[i] for i in range(2000)]
+    worst = 0
+    for i in range(10):
+        # garbage for the collector to sweep
+        for j in range(200):
+            bytearray(16)
+        t = bench.ticks()
+        gc.collect()
+        worst = max(worst, bench.elapsed(t))
+    return worst
+
+bench.run_time(test)
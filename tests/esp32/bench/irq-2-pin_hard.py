@@ -0,0 +1,36 @@
+# Latency from driving P23 until the hard handler of the P9 rising edge runs,
+# averaged over 20 edges. Needs P9 and P23 wired together, as for the _pin
+# test.
+import bench
+import micropython
+from machine import Pin
+from time import ticks_us, ticks_diff
+
+seen = [None]
+
+# a hard handler runs in the interrupt, it has to be native and can't allocate
+@micropython.native
+def handler(pin):
+    seen[0] = ticks_us()
+
+def test(hard=False):
+    out = Pin('P23', mode=Pin.OUT, value=0)
+    pin = Pin('P9', mode=Pin.IN)
+    pin.callback(Pin.IRQ_RISING, handler, hard=hard)
+    total = 0
+    for i in range(20):
+        seen[0] = None
+        t = ticks_us()
+        out(1)
+        while seen[0] is None and ticks_diff(ticks_us(), t) < 100000:
+            pass
+        out(0)
+        if seen[0] is None:
+            # no wire between the pins
+            total = None
+            break
+        total += ticks_diff(seen[0], t)
+    pin.callback(Pin.IRQ_RISING, None)
+    return None if total is None else total / 20 / 1000000
+
+bench.run_time(lambda: test(hard=True))
@@ -0,0 +1,22 @@
+# How late the handler of a 10ms Timer.Alarm runs, averaged over 20 alarms
+import bench
+from machine import Timer
+from time import ticks_us, ticks_diff
+
+seen = [None]
+
+def handler(alarm):
+    seen[0] = ticks_us()
+
+def test():
+    total = 0
+    for i in range(20):
+        seen[0] = None
+        t = ticks_us()
+        Timer.Alarm(handler, ms=10, periodic=False)
+        while seen[0] is None:
+            pass
+        total += ticks_diff(seen[0], t) - 10000
+    return total / 20 / 1000000
+
+bench.run_time(test)
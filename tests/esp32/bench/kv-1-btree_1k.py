@@ -0,0 +1,30 @@
+# Store 1000 records in a btree database on /flash, then open it again and look each one up
+import bench
+import os
+
+NAME = '/flash/bench.db'
+N = 1000
+
+def test():
+    try:
+        import btree
+    except ImportError:
+        return None
+    t = bench.ticks()
+    f = open(NAME, 'w+b')
+    db = btree.open(f)
+    for i in range(N):
+        db[b'k%d' % i] = b'value %d' % i
+    db.close()
+    f.close()
+    f = open(NAME, 'r+b')
+    db = btree.open(f)
+    for i in range(N):
+        db[b'k%d' % i]
+    db.close()
+    f.close()
+    t = bench.elapsed(t)
+    os.remove(NAME)
+    return t
+
+bench.run_time(test)
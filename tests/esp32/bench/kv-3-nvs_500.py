@@ -0,0 +1,23 @@
+# Store 500 records in the NVS with pycom.nvs_set(), then look each one up. The NVS
+# partition holds less than 1000 of them, so this is the point of comparison with the
+# other kv tests
+import bench
+
+N = 500
+
+def test():
+    try:
+        import pycom
+    except ImportError:
+        return None
+    t = bench.ticks()
+    for i in range(N):
+        pycom.nvs_set('k%d' % i, i)
+    for i in range(N):
+        pycom.nvs_get('k%d' % i)
+    t = bench.elapsed(t)
+    for i in range(N):
+        pycom.nvs_erase('k%d' % i)
+    return t
+
+bench.run_time(test)
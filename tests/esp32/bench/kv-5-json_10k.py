@@ -0,0 +1,29 @@
+# Store 10000 records as a JSON file on /flash, then load it again and look each one up
+import bench
+import os
+import ujson
+
+NAME = '/flash/bench.json'
+N = 10000
+
+def test():
+    try:
+        t = bench.ticks()
+        d = {}
+        for i in range(N):
+            d['k%d' % i] = 'value %d' % i
+        with open(NAME, 'w') as f:
+            ujson.dump(d, f)
+        d = None
+        with open(NAME) as f:
+            d = ujson.load(f)
+        for i in range(N):
+            d['k%d' % i]
+        t = bench.elapsed(t)
+    except MemoryError:
+        # the whole table has to fit in the heap
+        t = None
+    os.remove(NAME)
+    return t
+
+bench.run_time(test)
@@ -0,0 +1,22 @@
+# Latency of a blocking raw LoRa send of 64 bytes, SF7 125kHz, from the call
+# until the radio is done. The time on air is included.
+import bench
+import socket
+
+def test():
+    try:
+        from network import LoRa
+    except ImportError:
+        return None
+    lora = LoRa(mode=LoRa.LORA, region=LoRa.EU868, sf=7, bandwidth=LoRa.BW_125KHZ)
+    s = socket.socket(socket.AF_LORA, socket.SOCK_RAW)
+    s.setblocking(True)
+    buf = bytes(64)
+    t = bench.ticks()
+    for i in range(10):
+        s.send(buf)
+    t = bench.elapsed(t)
+    s.close()
+    return t / 10
+
+bench.run_time(test)
@@ -0,0 +1,21 @@
+# TCP send of 256KB in 1KB writes to the run-bench-tests sink
+import bench
+import socket
+
+def test():
+    if bench.SINK is None:
+        return None
+    host, port = bench.SINK.rsplit(':', 1)
+    s = socket.socket()
+    try:
+        s.connect(socket.getaddrinfo(host, int(port))[0][-1])
+    except OSError:
+        return None
+    buf = bytes(1024)
+    t = bench.ticks()
+    for i in range(256):
+        s.sendall(buf)
+    s.close()
+    return bench.elapsed(t)
+
+bench.run_time(test)
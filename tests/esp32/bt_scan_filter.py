@@ -0,0 +1,28 @@
+from network import Bluetooth
+import time
+
+bt = Bluetooth()
+
+# invalid filters are refused before scanning
+for kw in ({'queue_size': 0}, {'queue_size': 1000}, {'addresses': [b'\x01\x02']},
+           {'manufacturer_id': 0x10000}, {'service_uuid': b'1234'}):
+    try:
+        bt.start_scan(1, **kw)
+    except ValueError:
+        print('ValueError')
+print(bt.isscanning())
+
+# nothing matches a manufacturer and a service that don't exist
+bt.start_scan(2, queue_size=64, manufacturer_id=0xfffe, service_uuid=0xfffe)
+time.sleep(2.5)
+received, filtered, merged, dropped = bt.scan_stats()
+print(bt.get_advertisements(), received == filtered, merged, dropped)
+
+# with dedup every address is stored once until it's read
+bt.start_scan(2, dedup=True, queue_size=128)
+time.sleep(2.5)
+macs = [adv.mac for adv in bt.get_advertisements()]
+print(len(macs) == len(set(macs)))
+received, filtered, merged, dropped = bt.scan_stats()
+print(received == filtered + merged + len(macs) + dropped)
+bt.deinit()
@@ -0,0 +1,72 @@
+from network import Coap
+import os
+
+Coap.init('127.0.0.1', service_discovery=False)
+
+NAME = '/flash/coap_block.tmp'
+data = bytes(range(256)) * 9 + b'end'
+
+responses = []
+def response(code, id_owner, type, token, payload):
+    responses.append((code, payload))
+
+Coap.register_response_handler(response)
+
+def exchange(blocks):
+    # the request, then the response, for every block
+    for i in range(blocks):
+        Coap.read()
+        Coap.read()
+
+with open(NAME, 'wb') as f:
+    f.write(data)
+
+# a GET served from a file in blocks of 256, the client asking for 512 gets the smaller ones into a file
+source = open(NAME, 'rb')
+Coap.add_resource('big', source=source, block_size=256)
+Coap.get_resource('big').callback(Coap.REQUEST_GET, True)
+sink = open(NAME + '2', 'wb')
+Coap.send_request('127.0.0.1', Coap.REQUEST_GET, uri_path='big', sink=sink, block_size=512)
+exchange(10)
+sink.close()
+print(responses, open(NAME + '2', 'rb').read() == data)
+
+# without sink every block is passed to the callback
+responses = []
+Coap.send_request('127.0.0.1', Coap.REQUEST_GET, uri_path='big', block_size=1024)
+exchange(10)
+print(len(responses), [len(p) for c, p in responses[-2:]], b''.join(p for c, p in responses) == data)
+
+# a PUT sent from a file in blocks of 1024, written to the sink of the resource as they arrive
+class Sink:
+    def __init__(self):
+        self.blocks = []
+        self.flushed = False
+    def write(self, b):
+        self.blocks.append(bytes(b))
+    def flush(self):
+        self.flushed = True
+
+s = Sink()
+Coap.add_resource('upload', sink=s)
+Coap.get_resource('upload').callback(Coap.REQUEST_PUT, True)
+responses = []
+Coap.send_request('127.0.0.1', Coap.REQUEST_PUT, uri_path='upload', source=open(NAME, 'rb'), block_size=1024)
+exchange(3)
+print(responses, [len(b) for b in s.blocks], b''.join(s.blocks) == data, s.flushed)
+
+# only 1 transfer at a time, and the blocks are 16 to 1024 bytes
+Coap.send_request('127.0.0.1', Coap.REQUEST_GET, uri_path='big', block_size=256)
+try:
+    Coap.send_request('127.0.0.1', Coap.REQUEST_GET, uri_path='big', block_size=256)
+except OSError:
+    print('OSError')
+exchange(10)
+try:
+    Coap.send_request('127.0.0.1', Coap.REQUEST_GET, uri_path='big', block_size=100)
+except ValueError:
+    print('ValueError')
+
+source.close()
+os.remove(NAME)
+os.remove(NAME + '2')
@@ -0,0 +1,45 @@
+from network import Coap
+import time
+
+Coap.init('127.0.0.1', service_discovery=False)
+
+# lookup through the index, also with more resources than buckets
+for i in range(40):
+    Coap.add_resource('res/%d' % i, value=i)
+print(Coap.get_resource('res/7').value(), Coap.get_resource('res/39').value())
+print(Coap.get_resource('res/40'))
+Coap.remove_resource('res/7')
+print(Coap.get_resource('res/7'), Coap.get_resource('res/23').value())
+
+# integers are stored in little endian on as few bytes as possible
+r = Coap.get_resource('res/0')
+for v in (0x12, 0x1234, 0x123456, 'text', b'\x00\x01'):
+    r.value(v)
+    print(r.value())
+
+# a getter is only called when the cached value is older than max_age
+calls = []
+def getter(res):
+    calls.append(res)
+    return 'v%d' % len(calls)
+
+payloads = []
+def response(code, id_owner, type, token, payload):
+    payloads.append(payload)
+
+Coap.register_response_handler(response)
+Coap.add_resource('cached', max_age=1, getter=getter)
+
+def get():
+    Coap.send_request('127.0.0.1', Coap.REQUEST_GET, uri_path='cached')
+    # the request, then the response
+    Coap.read()
+    Coap.read()
+
+get()
+get()
+print(payloads, len(calls), calls[0] is Coap.get_resource('cached'))
+time.sleep_ms(1100)
+get()
+print(payloads[-1], len(calls))
+
@@ -0,0 +1,60 @@
+from network import Coap
+import uselect
+import time
+
+Coap.init('127.0.0.1', service_discovery=False)
+
+payloads = []
+def response(code, id_owner, type, token, payload):
+    payloads.append((type, payload))
+
+def read(timeout=200):
+    # returns False if nothing has been received
+    p = uselect.poll()
+    p.register(Coap.socket(), uselect.POLLIN)
+    if p.poll(timeout):
+        Coap.read()
+        return True
+    return False
+
+Coap.register_response_handler(response)
+r = Coap.add_resource('obs', value='a', observable=True, notify_type=Coap.MESSAGE_NON, notify_interval=500)
+Coap.add_resource('plain', value='p')
+
+# registration, answered with the current value
+Coap.send_request('127.0.0.1', Coap.REQUEST_GET, uri_path='obs', observe=True, token='t1')
+read()
+read()
+print(payloads)
+
+# every change is notified from C
+payloads.clear()
+r.value('b')
+read()
+print(payloads)
+
+# changes within notify_interval are sent together once it elapsed
+payloads.clear()
+r.value('c')
+r.value('d')
+print(read(), payloads)
+time.sleep_ms(500)
+# the next request served sends the notification delayed
+Coap.send_request('127.0.0.1', Coap.REQUEST_GET, uri_path='plain')
+read()
+read()
+read()
+print(payloads)
+
+# a resource that is not observable is only answered
+payloads.clear()
+Coap.send_request('127.0.0.1', Coap.REQUEST_GET, uri_path='plain', observe=True)
+read()
+read()
+Coap.get_resource('plain').value('q')
+print(read(), payloads)
+
+try:
+    Coap.add_resource('bad', observable=True, notify_type=5)
+except ValueError:
+    print('ValueError')
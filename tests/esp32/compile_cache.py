@@ -0,0 +1,44 @@
+'''
+Needs a writable /flash.
+'''
+
+import os
+import sys
+
+sys.path.append("/flash/lib")
+path = "/flash/lib/ccmod.py"
+
+def write(value):
+    with open(path, "w") as f:
+        f.write("VALUE = %r\ndef f(x):\n    return [i * x for i in range(3)]\n" % value)
+
+def load():
+    sys.modules.pop("ccmod", None)
+    import ccmod
+    return ccmod.VALUE, ccmod.f(2)
+
+for p in (path, path + "c"):
+    try:
+        os.remove(p)
+    except OSError:
+        pass
+
+write("first")
+print(load())
+print(os.stat(path + "c")[6] > 0)
+# from the cache
+print(load())
+# the source changed, the cache is replaced
+write("second")
+print(load())
+print(load())
+
+# a truncated cache is compiled again
+with open(path + "c", "rb") as f:
+    head = f.read(20)
+with open(path + "c", "wb") as f:
+    f.write(head)
+print(load())
+
+os.remove(path)
+os.remove(path + "c")
@@ -0,0 +1,79 @@
+'''
+P20 (output) must be connected to P21 (counter input).
+'''
+
+from machine import Counter, Pin, PWM
+import array
+import time
+
+out = Pin('P20', mode=Pin.OUT, value=0)
+
+def pulses(n):
+    for i in range(n):
+        out(1)
+        out(0)
+
+c = Counter(0, 'P21')
+pulses(10)
+print(c.value())
+c.value(0)
+pulses(5)
+print(c.value())
+
+# both edges
+c = Counter(0, 'P21', edge=Counter.RISING | Counter.FALLING)
+pulses(5)
+print(c.value())
+
+# the threshold calls the handler from the interrupt task
+c = Counter(1, 'P21')
+c.callback(lambda cnt: print('threshold', cnt.events() == Counter.EVENT_THRESHOLD0), threshold0=3)
+pulses(5)
+time.sleep_ms(10)
+c.callback(None)
+
+try:
+    c.callback(lambda cnt: None, threshold0=40000)
+except ValueError:
+    print('ValueError')
+
+# paused, the edges are not counted
+c.value(0)
+c.pause()
+pulses(5)
+c.resume()
+pulses(2)
+print(c.value())
+
+# counted in hardware beyond the 16-bit counter
+c.deinit()
+c = Counter(2, 'P21')
+pwm = PWM(0, frequency=100000)
+ch = pwm.channel(0, pin='P20', duty_cycle=0.5)
+time.sleep_ms(500)
+ch.duty_cycle(0)
+n = c.value()
+print(45000 < n < 55000)
+c.deinit()
+
+# the timestamps of the edges
+out = Pin('P20', mode=Pin.OUT, value=0)
+c = Counter(3, 'P21', mode=Counter.CAPTURE, buffer_size=16)
+for i in range(4):
+    out(1)
+    time.sleep_ms(10)
+    out(0)
+    time.sleep_ms(10)
+ts = array.array('I', [0] * 8)
+n = c.read_timestamps(ts)
+print(n, c.value())
+print(all(15000 < ts[i + 1] - ts[i] < 25000 for i in range(n - 1)))
+print(c.read_timestamps(ts), c.overruns())
+pulses(20)
+print(c.read_timestamps(ts), c.overruns())
+c.deinit()
+
+try:
+    c.value()
+except OSError:
+    print('OSError')
@@ -0,0 +1,102 @@
+from crypto import AES
+import ubinascii
+
+def h(s):
+    return ubinascii.unhexlify(s)
+
+# GCM, test cases 2 and 4 of the GCM specification
+c = AES(bytes(16), AES.MODE_GCM, nonce=bytes(12))
+ct, tag = c.encrypt_and_digest(bytes(16))
+print(ubinascii.hexlify(ct), ubinascii.hexlify(tag))
+
+key = h('feffe9928665731c6d6a8f9467308308')
+iv = h('cafebabefacedbaddecaf888')
+pt = h('d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72'
+       '1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39')
+aad = h('feedfacedeadbeeffeedfacedeadbeefabaddad2')
+c = AES(key, AES.MODE_GCM, iv)
+c.update(aad[:7])
+c.update(aad[7:])
+ct = c.encrypt(pt[:32]) + c.encrypt(pt[32:])
+tag = c.digest()
+print(ubinascii.hexlify(ct), ubinascii.hexlify(tag))
+
+# in place into a caller buffer, then back
+buf = bytearray(pt)
+c = AES(key, AES.MODE_GCM, nonce=iv)
+c.update(aad)
+c.encrypt_into(buf, buf)
+print(bytes(buf) == ct, c.digest() == tag)
+c = AES(key, AES.MODE_GCM, nonce=iv)
+c.update(aad)
+c.decrypt_into(buf, buf)
+c.verify(tag)
+print(bytes(buf) == pt)
+
+# a short tag
+c = AES(key, AES.MODE_GCM, nonce=iv, mac_len=8)
+c.update(aad)
+print(c.encrypt_and_digest(pt)[1] == tag[:8])
+
+# CCM, RFC 3610 packet vector 1 and SP 800-38C example 1
+key = h('c0c1c2c3c4c5c6c7c8c9cacbcccdcecf')
+nonce = h('00000003020100a0a1a2a3a4a5')
+pt = h('08090a0b0c0d0e0f101112131415161718191a1b1c1d1e')
+c = AES(key, AES.MODE_CCM, nonce=nonce, mac_len=8)
+c.update(h('0001020304050607'))
+ct, tag = c.encrypt_and_digest(pt)
+print(ubinascii.hexlify(ct), ubinascii.hexlify(tag))
+
+c = AES(key, AES.MODE_CCM, nonce=nonce, mac_len=8)
+c.update(h('0001020304050607'))
+print(c.decrypt_and_verify(ct, tag) == pt)
+
+c = AES(h('404142434445464748494a4b4c4d4e4f'), AES.MODE_CCM, nonce=h('10111213141516'), mac_len=4)
+c.update(h('0001020304050607'))
+out = bytearray(4)
+c.encrypt_into(h('20212223'), out)
+print(ubinascii.hexlify(out), ubinascii.hexlify(c.digest()))
+
+# tampering is detected
+c = AES(key, AES.MODE_CCM, nonce=nonce, mac_len=8)
+c.update(h('0001020304050607'))
+c.decrypt(ct[:-1] + b'\x00')
+try:
+    c.verify(tag)
+except ValueError as e:
+    print(e)
+
+# misuse
+c = AES(key, AES.MODE_CCM, nonce=nonce)
+c.encrypt(b'abc')
+try:
+    c.encrypt(b'def')
+except TypeError:
+    print('TypeError')
+c = AES(key, AES.MODE_GCM, nonce=nonce)
+c.encrypt(b'abc')
+try:
+    c.update(b'aad')
+except TypeError:
+    print('TypeError')
+try:
+    c.decrypt(b'abc')
+except TypeError:
+    print('TypeError')
+try:
+    c.encrypt(b'def')
+except ValueError:
+    print('ValueError')
+try:
+    AES(key, AES.MODE_ECB).digest()
+except TypeError:
+    print('TypeError')
+for kw in ({}, {'nonce': bytes(6)}, {'nonce': nonce, 'mac_len': 5}):
+    try:
+        AES(key, AES.MODE_CCM, **kw)
+    except ValueError:
+        print('ValueError')
+try:
+    AES(key, AES.MODE_ECB).encrypt_into(bytes(32), bytearray(16))
+except ValueError:
+    print('ValueError')
@@ -0,0 +1,41 @@
+# AES throughput per mode with caller buffers, in KB/s
+import time
+from crypto import AES
+
+key = bytes(range(16))
+buf = bytearray(4096)
+out = bytearray(len(buf))
+N = 16
+
+def bench(name, make):
+    c = make()
+    start = time.ticks_us()
+    for i in range(N):
+        c.encrypt_into(buf, out)
+    if name == 'gcm':
+        c.digest()
+    us = time.ticks_diff(time.ticks_us(), start)
+    print(name, N * len(buf) * 1000 // us > 200)
+
+bench('ecb', lambda: AES(key, AES.MODE_ECB))
+bench('cbc', lambda: AES(key, AES.MODE_CBC, bytes(16)))
+bench('cfb', lambda: AES(key, AES.MODE_CFB, bytes(16), segment_size=128))
+bench('ctr', lambda: AES(key, AES.MODE_CTR, counter=bytes(16)))
+bench('gcm', lambda: AES(key, AES.MODE_GCM, nonce=bytes(12)))
+
+# CCM takes a whole message per nonce, so time one object per message
+start = time.ticks_us()
+for i in range(N):
+    c = AES(key, AES.MODE_CCM, nonce=bytes(13))
+    c.encrypt_into(buf, out)
+    c.digest()
+print('ccm', N * len(buf) * 1000 // time.ticks_diff(time.ticks_us(), start) > 200)
+
+# encrypting into a caller buffer doesn't allocate
+import gc
+c = AES(key, AES.MODE_CTR, counter=bytes(16))
+gc.collect()
+before = gc.mem_free()
+for i in range(N):
+    c.encrypt_into(buf, out)
+print(before - gc.mem_free() < 256)
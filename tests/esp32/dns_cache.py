@@ -0,0 +1,45 @@
+from network import WLAN
+import usocket
+import time
+
+if not WLAN().isconnected():
+    print("SKIP")
+    raise SystemExit
+
+print(usocket.dnscache())
+print(usocket.dnsresolve('192.168.4.1'))
+
+# the first lookup goes to the DNS server and completes in the background
+done = []
+usocket.dnscache(0)
+usocket.dnscache(60)
+print(usocket.dnsresolve('pycom.io', lambda host, ip: done.append((host, ip))))
+for i in range(100):
+    if done:
+        break
+    time.sleep_ms(100)
+print(done[0][0], done[0][1] is not None)
+
+# then it is answered from the cache, also by getaddrinfo()
+ip = usocket.dnsresolve('pycom.io')
+print(ip == done[0][1])
+t = time.ticks_ms()
+ai = usocket.getaddrinfo('pycom.io', 80)
+print(ai[0][-1][0] == ip, time.ticks_diff(time.ticks_ms(), t) < 20)
+
+# polling a name that doesn't resolve
+host = 'does-not-exist.invalid'
+r = usocket.dnsresolve(host)
+for i in range(100):
+    try:
+        r = usocket.dnsresolve(host)
+    except OSError:
+        print('OSError')
+        break
+    time.sleep_ms(100)
+
+try:
+    usocket.dnscache(-1)
+except ValueError:
+    print('ValueError')
+usocket.dnscache(60)
@@ -0,0 +1,45 @@
+import machine
+import time
+
+machine.energy(True)
+e = machine.energy()
+print(e.elapsed_us < 1000000, e.messages, e.uj_per_message)
+
+r = machine.energy_rail(machine.ENERGY_CPU)
+print(r.active, r.spans, r.current > 0)
+
+# a rail the application switches itself
+current = machine.energy_rail(machine.ENERGY_SIGFOX).current
+machine.energy_rail(machine.ENERGY_SIGFOX, current=50000, active=True)
+time.sleep_ms(100)
+r = machine.energy_rail(machine.ENERGY_SIGFOX, active=False)
+print(r.active, r.spans, 95000 < r.active_us < 150000, r.current)
+# 0.1 s x 50 mA x 3.3 V
+print(15000 < r.uj < 25000)
+# stopped, it doesn't grow anymore
+time.sleep_ms(20)
+print(machine.energy_rail(machine.ENERGY_SIGFOX).active_us == r.active_us)
+
+l = machine.energy_link(machine.LINK_SIGFOX)
+print(l.messages, l.uj == r.uj, l.uj_per_message)
+l = machine.energy_link(machine.LINK_SIGFOX, delivered=2)
+print(l.messages, l.uj_per_message == l.uj // 2)
+
+# the total includes the CPU, over all the messages
+e = machine.energy()
+print(e.messages, e.uj > l.uj, e.uj_per_message == e.uj // 2)
+e5 = machine.energy(voltage=5000)
+print(e5.uj > e.uj)
+machine.energy(voltage=3300)
+
+e = machine.energy(True)
+print(e.messages)
+print(machine.energy().messages, machine.energy_rail(machine.ENERGY_SIGFOX).spans)
+machine.energy_rail(machine.ENERGY_SIGFOX, current=current)
+
+for f in (lambda: machine.energy_rail(99), lambda: machine.energy_rail(machine.ENERGY_LTE, current=-5),
+          lambda: machine.energy_link(machine.LINK_LTE, delivered=-1), lambda: machine.energy(voltage=0)):
+    try:
+        f()
+    except ValueError:
+        print('ValueError')
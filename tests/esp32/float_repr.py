@@ -0,0 +1,11 @@
+'''
+repr() of single precision floats, with the fewest digits that read back as
+the same value.
+'''
+
+import ujson
+
+for f in (0.1, 1 / 3, 23.5, 100.0, 1e7, 0.0001, 1.234e-5, 3.4028235e38, 0.3, 2 / 3, 999999.94, -12.75):
+    print(repr(f), float(repr(f)) == f)
+
+print(ujson.dumps([21.3, 0.45, 1e-3]))
@@ -0,0 +1,37 @@
+import machine
+import utime
+
+machine.freq(80000000)
+print(machine.freq(), machine.freq_auto())
+machine.freq(240000000)
+print(machine.freq())
+
+try:
+    machine.freq(40000000)
+except ValueError:
+    print('ValueError')
+
+machine.freq_auto(True, low=80000000, high=240000000, idle_ms=20)
+print(machine.freq_auto())
+# running Python holds the GIL, the frequency goes up
+print(machine.freq())
+machine.freq_stats(True)
+
+# blocked in the sleep, the frequency goes down after idle_ms
+utime.sleep_ms(500)
+low, mid, high, switches = machine.freq_stats()
+print(low > 400, mid == 0, switches >= 2)
+
+start = utime.ticks_ms()
+while utime.ticks_diff(utime.ticks_ms(), start) < 200:
+    pass
+print(machine.freq())
+
+try:
+    machine.freq_auto(True, low=240000000, high=80000000)
+except ValueError:
+    print('ValueError')
+
+# a fixed frequency stops the scaling
+machine.freq(160000000)
+print(machine.freq(), machine.freq_auto())
@@ -0,0 +1,30 @@
+# Write amplification of small appends on the internal flash (LittleFS)
+import os
+
+APPENDS = 50
+RECORD = b"0123456789abcdefghijklmnopqrstuvwxyz0123456789abc\n"
+path = "/flash/append.log"
+
+try:
+    os.remove(path)
+except OSError:
+    pass
+
+os.flash_stats(True)
+for i in range(APPENDS):
+    f = open(path, "a")
+    f.write(RECORD)
+    f.close()
+read, programmed, erased = os.flash_stats()
+
+print(len(RECORD))
+print(os.stat(path)[6] == APPENDS * len(RECORD))
+# whole-block I/O would program at least 4096 bytes per append
+print(programmed // APPENDS < 4096)
+print(erased < APPENDS)
+
+counts = os.flash_erase_counts()
+print(len(counts) == os.statvfs("/flash")[2])
+print(sum(counts) >= erased)
+
+os.remove(path)
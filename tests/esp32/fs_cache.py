@@ -0,0 +1,42 @@
+# Sector cache of FatFS on the SD card, an SD card with a FAT file system is needed
+import os
+from machine import SD
+
+sd = SD()
+vfs = os.mkfat(sd, cache=16)
+os.mount(vfs, "/sd")
+
+try:
+    os.mkdir("/sd/cache")
+except OSError:
+    pass
+for i in range(20):
+    with open("/sd/cache/log%d.txt" % i, "w") as f:
+        f.write("x" * i)
+
+vfs.cache_stats(True)
+first = sorted(os.listdir("/sd/cache"))
+hits, misses, writebacks = vfs.cache_stats(True)
+second = sorted(os.listdir("/sd/cache"))
+hits2, misses2, writebacks2 = vfs.cache_stats()
+
+print(first == second, len(first))
+# the second walk of the directory is served from the cache
+print(misses2 <= misses, hits2 > 0)
+
+# rotation: FAT and root directory updates are written back on sync
+for i in range(20):
+    os.rename("/sd/cache/log%d.txt" % i, "/sd/cache/old%d.txt" % i)
+print(sorted(os.listdir("/sd/cache"))[:2])
+for name in os.listdir("/sd/cache"):
+    os.remove("/sd/cache/" + name)
+os.rmdir("/sd/cache")
+
+os.umount("/sd")
+vfs = os.mkfat(sd, cache=0)
+print(vfs.cache_stats())
+try:
+    os.mkfat(sd, cache=-1)
+except ValueError:
+    print("ValueError")
+sd.deinit()
@@ -0,0 +1,22 @@
+'''
+Needs LittleFS on /flash.
+Checks that statvfs follows the writes without walking the file system and that os.flash_fits() agrees with it.
+'''
+
+import os
+
+def free():
+    st = os.statvfs("/flash")
+    return st[0] * st[3]
+
+before = free()
+print(os.flash_fits(0), os.flash_fits(before - 4096), os.flash_fits(os.statvfs("/flash")[0] * os.statvfs("/flash")[2]))
+
+f = open("/flash/fits.bin", "wb")
+f.write(bytearray(32 * 1024))
+f.close()
+print(free() <= before - 32 * 1024)
+
+os.remove("/flash/fits.bin")
+# the blocks freed by the remove show up once the file system is walked again
+print(os.flash_fits(before - 4096))
@@ -0,0 +1,25 @@
+'''
+Needs LittleFS on /flash.
+Checks that the imports are answered from the cached directory listings and that creating a module is seen.
+'''
+
+import os
+import sys
+
+sys.path.append("/flash/nomodules")
+os.flash_import_stats(True)
+try:
+    import fs_import_cache_mod
+except ImportError:
+    print("ImportError")
+calls, dir_reads, lookups = os.flash_import_stats()
+print(calls > dir_reads, lookups)
+
+f = open("/flash/fs_import_cache_mod.py", "w")
+f.write("x = 42\n")
+f.close()
+import fs_import_cache_mod
+print(fs_import_cache_mod.x)
+
+os.remove("/flash/fs_import_cache_mod.py")
+sys.path.remove("/flash/nomodules")
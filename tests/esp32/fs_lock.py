@@ -0,0 +1,42 @@
+'''
+Needs LittleFS on /flash.
+Checks that another thread keeps reading files while the main one writes a big file.
+'''
+
+import os
+import _thread
+import time
+
+reads = 0
+running = True
+
+f = open("/flash/small.txt", "w")
+f.write("hello")
+f.close()
+
+def reader():
+    global reads
+    while running:
+        f = open("/flash/small.txt")
+        if f.read() == "hello":
+            reads += 1
+        f.close()
+
+os.flash_lock_stats(True)
+_thread.start_new_thread(reader, ())
+time.sleep_ms(100)
+
+buf = bytearray(64 * 1024)
+start = reads
+f = open("/flash/big.bin", "wb")
+print(f.write(buf))
+f.close()
+print(reads - start > 0)
+running = False
+time.sleep_ms(100)
+
+contended, wait_us, max_wait_us = os.flash_lock_stats()
+print(wait_us >= max_wait_us)
+
+os.remove("/flash/big.bin")
+os.remove("/flash/small.txt")
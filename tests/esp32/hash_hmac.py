@@ -0,0 +1,37 @@
+import uhashlib
+
+# RFC 4231 test cases 1, 2 and 6 (key longer than a block)
+print(uhashlib.hmac(b'\x0b' * 20, b'Hi There').digest())
+print(uhashlib.hmac(b'Jefe', b'what do ya want for nothing?', uhashlib.sha256).digest())
+print(uhashlib.hmac(b'\xaa' * 131, b'Test Using Larger Than Block-Size Key - Hash Key First').digest())
+
+# other digests, given by constructor or by name
+print(uhashlib.hmac(b'key', b'pycom', uhashlib.sha1).digest())
+print(uhashlib.hmac(b'key', b'pycom', 'md5').digest())
+print(uhashlib.hmac(b'key', b'pycom', digestmod='sha512').digest())
+
+# streaming in pieces of any size gives the same result, memoryviews included
+msg = bytearray(range(256)) * 9
+h = uhashlib.hmac(b'secret')
+mv = memoryview(msg)
+for i in range(0, len(msg), 100):
+    h.update(mv[i:i + 100])
+print(h.digest() == uhashlib.hmac(b'secret', msg).digest())
+
+# and so does a long message that goes through the SHA engine
+h = uhashlib.sha256()
+h.update(msg)
+d = h.digest()
+h = uhashlib.sha256()
+for i in range(0, len(msg), 7):
+    h.update(mv[i:i + 7])
+print(h.digest() == d)
+
+# digest() can be called again
+h = uhashlib.hmac(b'', b'')
+print(h.digest() == h.digest())
+
+try:
+    uhashlib.hmac(b'key', b'', 'sha3')
+except ValueError:
+    print('ValueError')
@@ -0,0 +1,38 @@
+# Hashing throughput across input sizes, in KB/s. Short inputs are hashed in
+# software, long ones by the SHA engine, so the rate should keep growing with
+# the size instead of being capped by the per message cost.
+import time
+import uhashlib
+
+TOTAL = 64 * 1024
+buf = bytearray(32 * 1024)
+for i in range(len(buf)):
+    buf[i] = i & 0xFF
+mv = memoryview(buf)
+
+def rate(ctor, size, *args):
+    n = TOTAL // size
+    chunk = mv[:size]
+    start = time.ticks_us()
+    for i in range(n):
+        h = ctor(*args)
+        h.update(chunk)
+        h.digest()
+    return n * size * 1000 // max(1, time.ticks_diff(time.ticks_us(), start))
+
+def bench(name, ctor, *args):
+    rates = [rate(ctor, size, *args) for size in (64, 512, 4096, 32768)]
+    print(name, rates[-1] > rates[0], rates[-1] > 1000)
+
+bench('sha1', uhashlib.sha1)
+bench('sha256', uhashlib.sha256)
+bench('sha512', uhashlib.sha512)
+bench('hmac', uhashlib.hmac, b'secret key')
+
+# streaming one large input through a single object
+h = uhashlib.sha256()
+start = time.ticks_us()
+for i in range(8):
+    h.update(mv)
+h.digest()
+print(8 * len(buf) * 1000 // time.ticks_diff(time.ticks_us(), start) > 2000)
@@ -119,6 +119,23 @@ print(2 == i2c.writeto(addr, reg2)) # write the register address and the data
 i2c.readfrom_mem_into(addr, 107, reg) # check it back
 print(reg[0] == 0)
 
+# batched transactions: register address writes and reads with repeated starts
+res = i2c.transaction([(I2C.WRITE, addr, b'\x75'), (I2C.READ, addr, 1), (I2C.WRITE, addr, b'\x6b'), (I2C.READ, addr, reg2)])
+print(len(res) == 2)
+print(res[0][0] == 0x68)
+print(res[1] is reg2)
+print(0x00 == reg2[0])
+i2c.transaction([(I2C.WRITE, addr, b'\x6b\x40')])
+print(i2c.readfrom_mem(addr, 107, 1)[0] == 0x40)
+try:
+    i2c.transaction([])
+except ValueError:
+    print("ValueError")
+try:
+    i2c.transaction([(I2C.READ, addr, 0)])
+except ValueError:
+    print("ValueError")
+
 
 # check for memory leaks...
 for i in range (0, 1000):
@@ -0,0 +1,30 @@
+'''
+P9 and P23 must be connected together for this test to pass.
+An edge storm on one pin is merged into few handler calls instead of overflowing the queue.
+'''
+
+from machine import Pin
+import machine
+import time
+
+calls = 0
+
+def handler(pin):
+    global calls
+    calls += 1
+
+out = Pin('P9', mode=Pin.OUT, value=0)
+inp = Pin('P23', mode=Pin.IN)
+inp.callback(Pin.IRQ_RISING, handler)
+
+machine.irq_stats(True)
+for i in range(1000):
+    out.value(1)
+    out.value(0)
+time.sleep_ms(100)
+inp.callback(Pin.IRQ_RISING, None)
+
+queued, coalesced, dropped = machine.irq_stats()
+print(queued == calls)
+print(coalesced > 0)
+print(dropped)
@@ -0,0 +1,50 @@
+'''
+P9 and P23 must be connected together for this test to pass.
+Compares the latency from a pin edge to a soft and to a hard handler.
+'''
+
+from machine import Pin
+from machine import Timer
+import micropython
+import time
+
+count = bytearray(4)
+
+@micropython.viper
+def handler(arg):
+    p = ptr32(count)
+    p[0] += 1
+
+def bench(hard, n=20):
+    out = Pin('P9', mode=Pin.OUT, value=0)
+    inp = Pin('P23', mode=Pin.IN)
+    inp.callback(Pin.IRQ_RISING, handler, hard=hard)
+    worst = 0
+    for i in range(n):
+        before = count[0]
+        start = time.ticks_us()
+        out.value(1)
+        while count[0] == before:
+            pass
+        worst = max(worst, time.ticks_diff(time.ticks_us(), start))
+        out.value(0)
+        time.sleep_ms(2)
+    inp.callback(Pin.IRQ_RISING, None)
+    return worst
+
+soft = bench(False)
+hard = bench(True)
+print(hard < soft)
+
+# a hard handler can't allocate, nor be bytecode
+try:
+    Pin('P23', mode=Pin.IN).callback(Pin.IRQ_RISING, lambda p: None, hard=True)
+except ValueError:
+    print('ValueError')
+
+# a hard one-shot alarm is released once it fired
+count[0] = 0
+alarm = Timer.Alarm(handler, ms=10, hard=True)
+time.sleep_ms(50)
+print(count[0])
+alarm.cancel()
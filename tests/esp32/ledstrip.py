@@ -0,0 +1,66 @@
+'''
+P20 drives the strip, nothing needs to be connected.
+'''
+
+from machine import RMT, LEDStrip
+import time
+
+rmt = RMT(channel=2, gpio='P20', tx_idle_level=RMT.LOW)
+strip = LEDStrip(rmt, 300, brightness=128, gamma=2.8)
+print(strip)
+print(len(strip))
+
+strip[0] = (255, 0, 0)
+strip[1] = 0x00FF00
+print(strip[0], strip[1], strip[-1])
+strip.fill((1, 2, 3))
+print(strip[299])
+
+# the raw RGB bytes
+mv = memoryview(strip)
+print(len(mv))
+mv[0:3] = b'\x10\x20\x30'
+print(strip[0])
+
+print(strip.brightness())
+strip.brightness(255)
+print(strip.brightness())
+
+# show() returns while the frame is still being sent
+t = time.ticks_us()
+strip.show()
+print(time.ticks_diff(time.ticks_us(), t) < 9000)
+strip.show(wait=True)
+
+# 60 frames in about a second
+t = time.ticks_ms()
+for i in range(60):
+    strip[i] = (i, i, i)
+    strip.show()
+strip.wait()
+print(time.ticks_diff(time.ticks_ms(), t) < 1200)
+
+try:
+    strip[300] = 0
+except IndexError:
+    print('IndexError')
+
+try:
+    LEDStrip(rmt, 10, order='RGX')
+except ValueError:
+    print('ValueError')
+
+# the 3125ns channels can't generate the bit timings
+slow = RMT(channel=6, gpio='P21', tx_idle_level=RMT.LOW)
+try:
+    LEDStrip(slow, 10)
+except ValueError:
+    print('ValueError')
+slow.deinit()
+
+strip.deinit()
+try:
+    strip.show()
+except OSError:
+    print('OSError')
+rmt.deinit()
@@ -0,0 +1,32 @@
+import os
+
+# only execute this test on the LoPy
+if os.uname().sysname != 'LoPy' and os.uname().sysname != 'FiPy':
+    print("SKIP")
+    import sys
+    sys.exit()
+else:
+    from network import LoRa
+    import ustruct
+
+RECORD = '<IhbbbBBB'
+SIZE = ustruct.calcsize(RECORD)
+
+lora = LoRa(mode=LoRa.LORAWAN, region=LoRa.EU868, link_history=4)
+
+# nothing sent nor received yet
+buf = bytearray(4 * SIZE)
+print(SIZE, lora.link_history(), lora.link_history(buf))
+s = lora.link_stats()
+print(s.uplinks, s.downlinks, s.acked, s.rssi_ewma, s.rssi_pct, s.snr_pct)
+
+# too small for a single record
+print(lora.link_history(bytearray(SIZE - 1)))
+
+for depth in (-1, 100000):
+    try:
+        LoRa(mode=LoRa.LORAWAN, region=LoRa.EU868, link_history=depth)
+    except ValueError:
+        print('ValueError')
+
+print(LoRa.LINK_DOWNLINK, LoRa.LINK_CONFIRMED, LoRa.LINK_ACK, LoRa.LINK_FAILED)
@@ -0,0 +1,48 @@
+import array
+import socket
+import os
+
+# only execute this test on boards with a LoRa radio
+if os.uname().sysname not in ('LoPy', 'LoPy4', 'FiPy'):
+    print("SKIP")
+    import sys
+    sys.exit()
+else:
+    from network import LoRa
+
+lora = LoRa(mode=LoRa.LORA, region=LoRa.EU868, rx_buffer_size=4096)
+
+try:
+    lora.init(mode=LoRa.LORA, region=LoRa.EU868, rx_buffer_size=16)
+except ValueError:
+    print('ValueError')
+
+s = socket.socket(socket.AF_LORA, socket.SOCK_RAW)
+s.setblocking(False)
+
+# nothing has been received, so the non-blocking calls return straight away
+buf = bytearray(256)
+print(s.recv_into(buf))
+print(s.recv_into(buf, 16))
+
+info = array.array('i', [0] * 7 * 8)
+print(lora.recv_frames(buf, info, timeout=0))
+print(lora.recv_frames(buf, info, timeout=100))
+
+try:
+    lora.recv_frames(buf, bytearray(28), timeout=0)
+except ValueError:
+    print('ValueError')
+
+s.close()
+
+# queue depths can be changed at init time
+lora.init(mode=LoRa.LORA, region=LoRa.EU868, cmd_queue_size=16, cb_queue_size=12)
+stats = lora.queue_stats()
+print(stats.cmd_queue_size, stats.cb_queue_size, stats.rx_buffer_size)
+print(stats.rx_dropped)
+
+try:
+    lora.init(mode=LoRa.LORA, region=LoRa.EU868, cmd_queue_size=0)
+except ValueError:
+    print('ValueError')
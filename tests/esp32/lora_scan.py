@@ -0,0 +1,32 @@
+import os
+
+# only execute this test on the LoPy
+if os.uname().sysname != 'LoPy' and os.uname().sysname != 'FiPy':
+    print("SKIP")
+    import sys
+    sys.exit()
+else:
+    from network import LoRa
+
+lora = LoRa(mode=LoRa.LORA, region=LoRa.EU868)
+print(lora.scan(), lora.scan_stats())
+
+lora.scan([(868100000, 7, LoRa.BW_125KHZ), (868300000, 12, LoRa.BW_125KHZ, 200)])
+print(lora.scan())
+print(len(lora.scan_stats()))
+
+for entries in ([(868100000, 13, LoRa.BW_125KHZ)], [(868100000, 7)], [(868100000, 7, LoRa.BW_125KHZ, 0)],
+                [(868100000, 7, LoRa.BW_125KHZ)] * 9):
+    try:
+        lora.scan(entries)
+    except ValueError:
+        print('ValueError')
+
+lora.scan([])
+print(lora.scan(), lora.scan_stats())
+
+lora.init(mode=LoRa.LORAWAN, region=LoRa.EU868)
+try:
+    lora.scan([(868100000, 7, LoRa.BW_125KHZ)])
+except OSError:
+    print('OSError')
@@ -0,0 +1,33 @@
+import os
+
+# only execute this test on the LoPy
+if os.uname().sysname != 'LoPy' and os.uname().sysname != 'FiPy':
+    print("SKIP")
+    import sys
+    sys.exit()
+else:
+    from network import LoRa
+    import time
+
+lora = LoRa(mode=LoRa.LORA, region=LoRa.EU868)
+s = lora.send_at_stats()
+print(s.sent, s.missed)
+
+# a few slots 20 ms apart
+t = lora.ticks_us()
+errors = [lora.send_at(b'slot%d' % i, (t + 20000 * (i + 1)) & 0xFFFFFFFF) for i in range(3)]
+print([0 <= e < 1000 for e in errors])
+
+# long gone
+try:
+    lora.send_at(b'late', (lora.ticks_us() - 100000) & 0xFFFFFFFF)
+except OSError:
+    print('OSError')
+
+s = lora.send_at_stats()
+print(s.sent, s.missed, s.max_error < 1000, s.last_error == errors[-1])
+
+try:
+    lora.send_at(b'', lora.ticks_us())
+except OSError:
+    print('OSError')
@@ -0,0 +1,41 @@
+import os
+
+# only execute this test on the LoPy
+if os.uname().sysname != 'LoPy' and os.uname().sysname != 'FiPy':
+    print("SKIP")
+    import sys
+    sys.exit()
+else:
+    from network import LoRa
+
+lora = LoRa(mode=LoRa.LORAWAN, region=LoRa.EU868, device_class=LoRa.CLASS_C)
+
+nwk_key = bytes(range(16))
+app_key = bytes(range(16, 32))
+
+# the groups table is fixed size and an address is only linked once
+print([lora.join_multicast_group(0x01020300 + i, nwk_key, app_key) for i in range(5)])
+print(lora.join_multicast_group(0x01020300, nwk_key, app_key))
+print(lora.multicast_groups())
+print(lora.leave_multicast_group(0x01020301), lora.leave_multicast_group(0x01020301))
+print(lora.join_multicast_group(0x01020310, nwk_key, app_key, frequency=869525000, dr=3))
+print([g[0] for g in lora.multicast_groups()])
+for addr in (0x01020300, 0x01020302, 0x01020303, 0x01020310):
+    lora.leave_multicast_group(addr)
+print(lora.multicast_groups())
+
+try:
+    lora.join_multicast_group(0x01020300, b'short', app_key)
+except ValueError:
+    print('ValueError')
+
+# nothing is received without a server, only the setup is checked
+try:
+    lora.frag_session(10, 300)
+except ValueError:
+    print('ValueError')
+lora.frag_session(10, 50, padding=12)
+print(lora.frag_stats())
+lora.frag_session(None)
+print(lora.frag_stats())
+print(LoRa.FRAG_DONE_EVENT)
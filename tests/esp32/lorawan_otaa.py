@@ -124,3 +124,15 @@ print(lora.stats().snr > 0)
 print(lora.stats().sftx >= 0)
 print(lora.stats().sfrx >= 0)
 print(lora.stats().tx_trials >= 1)
+
+# uplink scheduling options
+try:
+    s.setsockopt(socket.SOL_LORA, socket.SO_PRIORITY, 16)
+except OSError:
+    print('OSError')
+try:
+    s.setsockopt(socket.SOL_LORA, socket.SO_DEADLINE, -1)
+except OSError:
+    print('OSError')
+s.setsockopt(socket.SOL_LORA, socket.SO_PRIORITY, 15)
+s.setsockopt(socket.SOL_LORA, socket.SO_DEADLINE, 60000)
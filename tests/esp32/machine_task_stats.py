@@ -0,0 +1,19 @@
+import machine
+
+stats = machine.task_stats()
+print(len(stats) > 2)
+
+names = [t.name for t in stats]
+print('MicroPy' in names)
+
+for t in stats:
+    if not (isinstance(t.name, str) and t.state in 'XRBSD' and t.priority >= 0 and t.stack_free > 0):
+        print('bad entry', t)
+    if t.core is not None and t.core not in (0, 1):
+        print('bad core', t)
+    if t.cpu is not None and not (0.0 <= t.cpu <= 100.0):
+        print('bad cpu', t)
+
+# the calling task is the running one
+me = [t for t in stats if t.state == 'X']
+print(len(me) >= 1)
@@ -0,0 +1,33 @@
+import machine
+import ustruct
+import gc
+
+REC = '<IHBBII'
+
+machine.trace_dump()
+machine.trace(machine.TRACE_USER | machine.TRACE_GC)
+print(machine.trace() == machine.TRACE_USER | machine.TRACE_GC)
+
+machine.trace_event(1, 10, -1)
+gc.collect()
+machine.trace_event(2)
+machine.trace(0)
+machine.trace_event(3)
+
+d = machine.trace_dump()
+print(len(d) % 16, len(d) // 16)
+recs = [ustruct.unpack_from(REC, d, i) for i in range(0, len(d), 16)]
+print([hex(r[1]) for r in recs])
+print(recs[0][4:], recs[0][2] in (0, 1))
+print(all(recs[i + 1][0] - recs[i][0] < 1000000 for i in range(len(recs) - 1)))
+
+# all dumped already
+print(machine.trace_dump())
+
+# into a buffer
+machine.trace(machine.TRACE_USER)
+for i in range(4):
+    machine.trace_event(i)
+machine.trace(0)
+buf = bytearray(40)
+print(machine.trace_dump(buf), machine.trace_dump(buf), machine.trace_dump(buf))
@@ -0,0 +1,85 @@
+from network import MQTT
+import usocket
+import _thread
+import time
+
+PORT = 18830
+
+# topic filters
+print(MQTT.match('a/+/c', 'a/b/c'), MQTT.match('a/#', 'a'), MQTT.match('a/+', 'a/b/c'), MQTT.match('#', '$SYS/x'))
+
+def read_packet(s):
+    h = s.recv(1)[0]
+    n = 0
+    shift = 0
+    while True:
+        b = s.recv(1)[0]
+        n |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            break
+    body = b''
+    while len(body) < n:
+        body += s.recv(n - len(body))
+    return h, body
+
+# a broker on the loopback interface, just enough for the exchanges below
+log = []
+def broker(srv):
+    c, _ = srv.accept()
+    h, body = read_packet(c)
+    log.append(('connect', hex(h), body[6], body[7], body[8:10], body[12:]))
+    c.send(b'\x20\x02\x00\x00')
+    h, body = read_packet(c)
+    log.append(('subscribe', hex(h), body))
+    c.send(b'\x90\x03' + body[:2] + b'\x01')
+    # QoS 1 towards the client
+    c.send(b'\x32\x0e\x00\x05dev/x\x00\x07hello')
+    log.append(read_packet(c))
+    # QoS 1 then QoS 2 from the client
+    h, body = read_packet(c)
+    log.append((hex(h), body))
+    c.send(b'\x40\x02' + body[6:8])
+    h, body = read_packet(c)
+    log.append((hex(h), body))
+    c.send(b'\x50\x02' + body[6:8])
+    h, body = read_packet(c)
+    log.append((hex(h), body))
+    c.send(b'\x70\x02' + body)
+    log.append(read_packet(c))
+    c.close()
+    srv.close()
+
+srv = usocket.socket()
+srv.bind(('127.0.0.1', PORT))
+srv.listen(1)
+_thread.start_new_thread(broker, (srv,))
+
+s = usocket.socket()
+s.connect(('127.0.0.1', PORT))
+m = MQTT('dev1', keepalive=60)
+print(m.connect(s), m.isconnected())
+
+got = []
+print(m.subscribe('dev/+', 1, lambda c, msg: got.append((c is m, msg.topic, msg.payload, msg.qos, msg.mid))))
+for i in range(100):
+    if got:
+        break
+    time.sleep_ms(10)
+print(got)
+
+print(m.publish('up/1', b'data', 1), m.publish('up/2', 'text', 2))
+for i in range(100):
+    if m.stats()[:2] == (0, 0):
+        break
+    time.sleep_ms(10)
+print(m.stats()[:3])
+
+m.disconnect()
+print(m.isconnected())
+for i in range(100):
+    if len(log) == 7:
+        break
+    time.sleep_ms(10)
+for l in log:
+    print(l)
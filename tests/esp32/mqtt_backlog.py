@@ -0,0 +1,77 @@
+from network import MQTT
+import usocket
+import _thread
+import time
+import uos
+
+PORT = 18831
+SPILL = '/flash/mqtt_backlog_test'
+
+try:
+    uos.remove(SPILL)
+except OSError:
+    pass
+
+# without a backlog, publishing needs the connection
+try:
+    MQTT('dev1').publish('up', b'x')
+except OSError:
+    print('OSError')
+
+# 18 bytes per publication, the fourth one spills the first three to the file
+m = MQTT('dev2', backlog=64, spill=SPILL)
+print([m.publish('up', '%010d' % i, 1) for i in range(6)])
+st = m.stats()
+print(st.backlog, st.spilled, st.discarded, st.sent)
+
+def read_packet(s):
+    h = s.recv(1)[0]
+    n = 0
+    shift = 0
+    while True:
+        b = s.recv(1)[0]
+        n |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            break
+    body = b''
+    while len(body) < n:
+        body += s.recv(n - len(body))
+    return h, body
+
+log = []
+def broker(srv):
+    c, _ = srv.accept()
+    read_packet(c)
+    c.send(b'\x20\x02\x00\x00')
+    for i in range(6):
+        h, body = read_packet(c)
+        log.append((hex(h), body[:4], body[6:]))
+        c.send(b'\x40\x02' + body[4:6])
+    log.append(read_packet(c))
+    c.close()
+    srv.close()
+
+srv = usocket.socket()
+srv.bind(('127.0.0.1', PORT))
+srv.listen(1)
+_thread.start_new_thread(broker, (srv,))
+
+s = usocket.socket()
+s.connect(('127.0.0.1', PORT))
+print(m.connect(s))
+for i in range(200):
+    st = m.stats()
+    if st.sent == 6 and st.inflight == 0:
+        break
+    time.sleep_ms(10)
+print(st.backlog, st.spilled, st.discarded, st.sent, st.latency_max >= st.latency_avg)
+print(SPILL[7:] in uos.listdir('/flash'))
+
+m.disconnect()
+for i in range(100):
+    if len(log) == 7:
+        break
+    time.sleep_ms(10)
+for l in log:
+    print(l)
@@ -0,0 +1,42 @@
+'''
+P9 and P23 must be connected together for this test to pass.
+The bounces are dropped in the interrupt and the accepted edges reach the handler as a count.
+'''
+
+from machine import Pin
+import time
+
+calls = []
+
+def handler(pin, count, stamp):
+    calls.append((count, stamp))
+
+out = Pin('P9', mode=Pin.OUT, value=0)
+inp = Pin('P23', mode=Pin.IN)
+
+# a bouncing contact, every burst is seen as a single edge
+inp.callback(Pin.IRQ_RISING, handler, debounce_ms=20)
+for i in range(10):
+    for j in range(20):
+        out.value(1)
+        out.value(0)
+    time.sleep_ms(50)
+time.sleep_ms(100)
+print(len(calls), sum(c[0] for c in calls))
+print(all(calls[i][1] < calls[i + 1][1] for i in range(len(calls) - 1)))
+
+# at most one call per rate window, the last edges still arrive once it expires
+calls = []
+inp.callback(Pin.IRQ_RISING, handler, rate_ms=200)
+for i in range(100):
+    out.value(1)
+    out.value(0)
+    time.sleep_ms(2)
+time.sleep_ms(400)
+inp.callback(Pin.IRQ_RISING, None)
+print(len(calls) <= 3, sum(c[0] for c in calls))
+
+try:
+    inp.callback(Pin.IRQ_RISING, handler, hard=True, debounce_ms=10)
+except ValueError:
+    print('ValueError')
@@ -0,0 +1,36 @@
+'''
+The shared packet buffer pool, its quotas and the zero-copy LoRa reads.
+'''
+
+import os
+import pycom
+
+blocks, free, block_size = pycom.pktbuf()
+print(blocks >= 4, block_size)
+
+used, peak, quota, reserve, refused = pycom.pktbuf(pycom.PKTBUF_BT)
+print(used, quota == blocks, reserve)
+
+# a reserve keeps blocks for a subsystem whatever the others take
+print(pycom.pktbuf(pycom.PKTBUF_BT, quota=4, reserve=2)[2:4])
+for owner in (pycom.PKTBUF_LTE, -1, 99):
+    try:
+        pycom.pktbuf(owner, reserve=blocks)
+    except ValueError:
+        print('ValueError')
+try:
+    pycom.pktbuf(pycom.PKTBUF_BT, quota=1, reserve=2)
+except ValueError:
+    print('ValueError')
+pycom.pktbuf(pycom.PKTBUF_BT, quota=blocks, reserve=0)
+
+if os.uname().sysname not in ('LoPy', 'LoPy4', 'FiPy'):
+    print(None)
+    print(3 * 256)
+else:
+    from network import LoRa
+    lora = LoRa(mode=LoRa.LORA, region=LoRa.EU868, rx_buffer_size=3 * 256)
+    # nothing has been received
+    print(lora.recv_buf(timeout=0))
+    print(lora.queue_stats().rx_buffer_size)
+    lora.init(mode=LoRa.LORA, region=LoRa.EU868, rx_buffer_size=blocks * block_size)
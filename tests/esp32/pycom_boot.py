@@ -0,0 +1,13 @@
+import pycom
+
+t = pycom.boot_times()
+print(sorted(t.keys()))
+print(t['start'] < t['mp_init'] < t['drivers'] < t['fs'])
+print(all(v is None or v >= t['fs'] for v in (t['boot_py'], t['main_py'])))
+
+lazy = pycom.lazy_boot()
+pycom.lazy_boot(True)
+print(pycom.lazy_boot())
+pycom.lazy_boot(False)
+print(pycom.lazy_boot())
+pycom.lazy_boot(lazy)
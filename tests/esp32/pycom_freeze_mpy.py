@@ -0,0 +1,44 @@
+'''
+Needs a data partition labeled "mpy" in the partition table.
+The image is used from the next soft reset on, then fz is imported from the partition even without the file.
+'''
+
+import os
+import pycom
+
+try:
+    pycom.mmap("mpy").close()
+except OSError:
+    print("SKIP")
+    raise SystemExit
+
+# mpy-cross -s fz.py fz.py of:
+#   MSG = 'from flash'
+#   def add(a, b):
+#       return a + b
+mpy = b"M\x05\x02\x1f p\x01\x000\x00\x00\x00\x08\x07\x00Q\x01'\x00\x00\xff\x16\x14from flash$\x06MSG`\x00$\x06add\x11[\x00\x07\nfz.py\x00\x01L\x04\x00\x00\x02\x00\x00\x08\xcb\x00Q\x01A\x00\x00\xff\xb0\xb1\xf1[\x03\x03\x00\x00\x02a\x02b"
+path = "/flash/lib/fz.mpy"
+try:
+    os.mkdir("/flash/lib")
+except OSError:
+    pass
+with open(path, "wb") as f:
+    f.write(mpy)
+
+try:
+    pycom.freeze_mpy(["fz.mpy"])
+except ValueError:
+    print("ValueError")
+try:
+    pycom.freeze_mpy(["/flash/lib/nofile.mpy"])
+except OSError:
+    print("OSError")
+
+print(pycom.freeze_mpy([path]) > len(mpy))
+
+# nothing of the image has been imported, so it can be rebuilt
+print(pycom.freeze_mpy([path, path]) > 2 * len(mpy))
+with pycom.mmap("mpy") as m:
+    print(bytes(memoryview(m)[:4]))
+
+os.remove(path)
@@ -0,0 +1,57 @@
+'''
+Needs LittleFS on /flash.
+'''
+
+import os
+import pycom
+
+path = "/flash/test_log"
+for s in (".0", ".1"):
+    try:
+        os.remove(path + s)
+    except OSError:
+        pass
+
+log = pycom.Log(path, 4, 10)
+print(len(log), bool(log))
+
+for i in range(5):
+    log.append(b"%04d" % i)
+# batched append of 3 records
+log.append(b"000500060007")
+print(len(log))
+print(log.read(0), log.read(5, 3))
+print([r for r in log][:3])
+
+log.discard(2)
+print(len(log), log.read(0))
+log.close()
+
+# the state survives reopening
+log = pycom.Log(path, 4, 10)
+print(len(log), log.read(0))
+
+# wraps around keeping at least max_records
+for i in range(8, 40):
+    log.append(b"%04d" % i)
+print(len(log) >= 10 and len(log) <= 20)
+print(log.read(len(log) - 1))
+
+try:
+    log.append(b"123")
+except ValueError:
+    print("ValueError")
+log.close()
+
+try:
+    pycom.Log(path, 8, 10)
+except ValueError:
+    print("ValueError")
+
+try:
+    len(log)
+except OSError:
+    print("OSError")
+
+os.remove(path + ".0")
+os.remove(path + ".1")
@@ -0,0 +1,38 @@
+'''
+Needs FatFS on /flash.
+'''
+
+import os
+import pycom
+import struct
+
+path = "/flash/table.bin"
+table = bytes(i * 7 & 0xFF for i in range(20000))
+with open(path, "wb") as f:
+    f.write(table)
+
+m = pycom.mmap(path)
+print(len(m) == len(table))
+mv = memoryview(m)
+print(bytes(mv[:16]) == table[:16], bytes(mv[-16:]) == table[-16:])
+print(struct.unpack_from("<I", m, 1000)[0] == struct.unpack_from("<I", table, 1000)[0])
+try:
+    mv[0] = 1
+except TypeError:
+    print("TypeError")
+m.close()
+try:
+    len(m)
+except OSError:
+    print("OSError")
+
+# the config partition is one flash sector
+with pycom.mmap("config") as m:
+    print(len(m))
+
+try:
+    pycom.mmap("nopart")
+except OSError:
+    print("OSError")
+
+os.remove(path)
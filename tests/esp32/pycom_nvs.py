@@ -0,0 +1,32 @@
+import pycom
+
+pycom.nvs_erase_all()
+interval = pycom.nvs_flush_interval()
+pycom.nvs_flush_interval(60000)
+
+# the values are read back before being written
+for i in range(100):
+    pycom.nvs_set('count', i)
+pycom.nvs_set('name', 'fipy')
+pycom.nvs_set('raw', bytearray(b'\x00\x01\x02'))
+print(pycom.nvs_get('count'), pycom.nvs_get('name'), pycom.nvs_get('raw'))
+print(sorted(pycom.nvs_keys()))
+
+# a single write per key
+print(pycom.nvs_flush(), pycom.nvs_flush())
+
+pycom.nvs_erase('name')
+print(pycom.nvs_get('name', None), sorted(pycom.nvs_keys()))
+try:
+    pycom.nvs_erase('name')
+except KeyError:
+    print('KeyError')
+
+# written straight away
+pycom.nvs_flush_interval(0)
+pycom.nvs_set('count', 7)
+print(pycom.nvs_flush(), pycom.nvs_get('count'))
+
+pycom.nvs_erase_all()
+print(pycom.nvs_keys())
+pycom.nvs_flush_interval(interval)
@@ -0,0 +1,25 @@
+import uqueue
+import uselect
+import _thread
+import time
+
+q = uqueue.Queue(maxsize=4)
+print(q.put_many(range(6), block=False), q.qsize(), q.full())
+print(q.get_many(3), q.get_many(10, block=False), q.get_many(1, block=False))
+
+p = uselect.poll()
+p.register(q, uselect.POLLIN)
+print(p.poll(0))
+
+def producer():
+    time.sleep_ms(50)
+    q.put_many(['a', 'b'])
+
+_thread.start_new_thread(producer, ())
+print(p.poll(1000) == [(q, uselect.POLLIN)])
+print(q.get_many(2, timeout=1000))
+
+try:
+    q.get(block=False)
+except q.Empty:
+    print('Empty')
@@ -0,0 +1,61 @@
+'''
+P20 (RMT TX) must be connected to P21 (RMT RX).
+'''
+
+from machine import RMT
+import array
+import time
+
+tx = RMT(channel=4, gpio='P20', tx_idle_level=RMT.LOW)
+rx = RMT(channel=5, gpio='P21', rx_idle_threshold=500)
+
+# durations given in an array, levels alternate from start_level
+durations = array.array('H', [100, 200, 300, 400, 100])
+items = tx.encode_pulses(durations, start_level=1)
+print(len(items) == 3 * 4)
+
+# 0x80 is a 1 followed by seven 0, a WS2812 style encoding
+bits = tx.encode_bits(b'\x80\x01', zero=(40, 85), one=(80, 45))
+print(len(bits) == 16 * 4)
+print(bits[0:4] != bits[4:8])
+print(bits[4:8] == bits[8:12])
+
+events = []
+def rx_handler(rmt):
+    events.append(rmt)
+
+rx.recv_start(handler=rx_handler, buffer_size=64)
+tx.pulses_send(durations, start_level=1)
+time.sleep_ms(100)
+
+pulses = array.array('H', [0] * 64)
+n = rx.recv_into(pulses)
+print(n == len(durations))
+print(pulses[0] >> 15 == 1)
+print(all(abs((p & 0x7FFF) - d) < 10 for p, d in zip(pulses, durations)))
+print(len(events) > 0 and events[0] is rx)
+print(rx.recv_into(pulses) == 0)
+
+# more pulses than the ring holds
+tx.items_send(tx.encode_pulses(array.array('H', [50] * 100), start_level=1))
+time.sleep_ms(100)
+print(rx.recv_into(pulses) == 63)
+print(rx.recv_stop() > 0)
+
+# looped transmission until stopped
+tx.items_send(bits[0:8], loop=True)
+time.sleep_ms(10)
+tx.send_stop()
+
+try:
+    tx.items_send(tx.encode_bits(b'\x00' * 8, zero=(1, 1), one=(1, 1)), loop=True)
+except ValueError:
+    print('ValueError')
+
+try:
+    tx.pulses_send(array.array('B', [1, 2]), start_level=1)
+except ValueError:
+    print('ValueError')
+
+tx.deinit()
+rx.deinit()
@@ -0,0 +1,48 @@
+# Sequential throughput of the SD card (FatFS), an SD card with a FAT file system is needed
+# Pass width=4 to SD() on boards with DAT1-DAT3 wired to GPIO4, GPIO12 and GPIO13
+import os
+import time
+from machine import SD
+
+CHUNK = 16 * 1024
+CHUNKS = 32
+path = "/sd/throughput.bin"
+
+sd = SD(freq=40000000)
+os.mount(os.mkfat(sd), "/sd")
+
+buf = bytearray(CHUNK)
+for i in range(CHUNK):
+    buf[i] = i & 0xFF
+
+start = time.ticks_us()
+f = open(path, "wb")
+for i in range(CHUNKS):
+    f.write(buf)
+f.close()
+write_us = time.ticks_diff(time.ticks_us(), start)
+
+rbuf = bytearray(CHUNK)
+ok = True
+start = time.ticks_us()
+f = open(path, "rb")
+for i in range(CHUNKS):
+    f.readinto(rbuf)
+    ok = ok and rbuf == buf
+f.close()
+read_us = time.ticks_diff(time.ticks_us(), start)
+
+print(ok)
+print(os.stat(path)[6] == CHUNK * CHUNKS)
+# single sector commands at the default clock top out well below these rates
+print(CHUNK * CHUNKS * 1000 // read_us > 1000)   # KB/s
+print(CHUNK * CHUNKS * 1000 // write_us > 250)   # KB/s
+
+try:
+    SD(width=2)
+except ValueError:
+    print("ValueError")
+
+os.remove(path)
+os.umount("/sd")
+sd.deinit()
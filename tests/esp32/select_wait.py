@@ -0,0 +1,33 @@
+import uselect
+import usocket
+import utime
+from machine import UART
+
+# an idle poll sleeps for its whole timeout
+p = uselect.poll()
+t = utime.ticks_ms()
+print(p.poll(200))
+dt = utime.ticks_diff(utime.ticks_ms(), t)
+print(200 <= dt < 260)
+
+# a UDP socket waited for with lwIP select
+s = usocket.socket(usocket.AF_INET, usocket.SOCK_DGRAM)
+s.bind(('0.0.0.0', 5555))
+p.register(s, uselect.POLLIN)
+t = utime.ticks_ms()
+print(p.poll(150))
+dt = utime.ticks_diff(utime.ticks_ms(), t)
+print(150 <= dt < 210)
+
+# a writable socket is returned straight away
+p.modify(s, uselect.POLLOUT)
+print(p.poll(1000) == [(s, uselect.POLLOUT)])
+
+# select() mixing a socket with a UART, which wakes the wait from its interrupt
+u = UART(1, 115200)
+t = utime.ticks_ms()
+print(uselect.select([s, u], [], [], 0.1))
+dt = utime.ticks_diff(utime.ticks_ms(), t)
+print(100 <= dt < 160)
+u.deinit()
+s.close()
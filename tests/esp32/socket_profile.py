@@ -0,0 +1,36 @@
+'''
+Buffer profiles and socket counters, no network connection is needed.
+'''
+
+import usocket as socket
+
+default = socket.profile()
+print(len(default), default[0], default[3] >= 4)
+
+socket.profile(socket.PROFILE_SMALL)
+print(socket.profile()[0], socket.profile()[3])
+
+# only four sockets are allowed by the small profile
+socket.stats(True)
+s = [socket.socket(socket.AF_INET, socket.SOCK_DGRAM) for i in range(4)]
+try:
+    socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+except OSError:
+    print('OSError')
+s[0].setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+open_, peak, created, refused, mem_errors, tx, rx = socket.stats()
+print(open_, peak, created, refused)
+for x in s:
+    x.close()
+s[0].close()
+print(socket.stats()[0])
+
+socket.profile(socket.PROFILE_DEFAULT, max_sockets=6)
+print(socket.profile()[3])
+socket.profile(socket.PROFILE_DEFAULT)
+print(socket.profile() == default)
+
+try:
+    socket.profile(max_sockets=0)
+except ValueError:
+    print('ValueError')
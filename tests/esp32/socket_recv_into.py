@@ -0,0 +1,52 @@
+from network import WLAN
+import usocket
+import ussl
+
+if not WLAN().isconnected():
+    print("SKIP")
+    raise SystemExit
+
+HOST = 'www.google.com'
+REQ = b'GET / HTTP/1.0\r\nHost: ' + HOST + '\r\n\r\n'
+
+# TCP, into a slice of a preallocated buffer and with more than the old 2 KB per call allowed
+buf = bytearray(8192)
+mv = memoryview(buf)
+s = usocket.socket()
+s.connect(usocket.getaddrinfo(HOST, 80)[0][-1])
+s.send(REQ)
+n = s.recv_into(mv[4:], 5)
+print(n, bytes(buf[4:9]))
+total = n
+while True:
+    n = s.recv_into(mv)
+    if n == 0:
+        break
+    total += n
+s.close()
+print(total > 5)
+
+# SSL, through the stream readinto()
+s = usocket.socket()
+s.connect(usocket.getaddrinfo(HOST, 443)[0][-1])
+ss = ussl.wrap_socket(s, server_hostname=HOST)
+ss.write(REQ)
+print(ss.readinto(mv, 5), bytes(buf[:5]))
+ss.close()
+
+# UDP, a DNS query for the host, answered into the buffer
+q = b'\x12\x34\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00'
+for part in HOST.split('.'):
+    q += bytes([len(part)]) + part
+q += b'\x00\x00\x01\x00\x01'
+u = usocket.socket(usocket.AF_INET, usocket.SOCK_DGRAM)
+u.settimeout(5)
+u.sendto(q, ('8.8.8.8', 53))
+n, addr = u.recvfrom_into(buf)
+u.close()
+print(n > len(q), buf[:2] == b'\x12\x34', addr[1])
+
+try:
+    s.recv_into(b'immutable')
+except TypeError:
+    print('TypeError')
@@ -0,0 +1,44 @@
+from network import WLAN
+import usocket
+import ussl
+
+if not WLAN().isconnected():
+    print("SKIP")
+    raise SystemExit
+
+HOST = 'www.google.com'
+PARTS = [b'GET / HTTP/1.0\r\n', b'Host: ', HOST, b'\r\n', bytearray(b'\r\n')]
+LEN = sum(len(p) for p in PARTS)
+
+# TCP, the request is given in pieces
+s = usocket.socket()
+s.connect(usocket.getaddrinfo(HOST, 80)[0][-1])
+print(s.sendmsg(PARTS) == LEN)
+print(s.recv(5))
+s.close()
+
+# SSL, the pieces are packed into one record
+s = usocket.socket()
+s.connect(usocket.getaddrinfo(HOST, 443)[0][-1])
+ss = ussl.wrap_socket(s, server_hostname=HOST)
+print(ss.sendmsg(PARTS, [], 0) == LEN)
+print(ss.read(5))
+ss.close()
+
+# UDP, a DNS query split in header and question, sent to an address
+hdr = b'\x12\x34\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00'
+q = b''
+for part in HOST.split('.'):
+    q += bytes([len(part)]) + part
+q += b'\x00\x00\x01\x00\x01'
+u = usocket.socket(usocket.AF_INET, usocket.SOCK_DGRAM)
+u.settimeout(5)
+print(u.sendmsg([hdr, memoryview(q)], [], 0, ('8.8.8.8', 53)) == len(hdr) + len(q))
+print(u.recv(512)[:2])
+
+for args in (([b'x'] * 17,), ([b'x'], [b'anc'])):
+    try:
+        u.sendmsg(*args)
+    except ValueError:
+        print('ValueError')
+u.close()
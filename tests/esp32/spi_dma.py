@@ -0,0 +1,83 @@
+'''
+P9 (MOSI) must be connected to P23 (MISO).
+'''
+
+from machine import SPI
+import time
+
+spi_pins = ('P5', 'P9', 'P23')
+
+spi = SPI(0, SPI.MASTER, baudrate=10000000, polarity=0, phase=0, pins=spi_pins, dma=True)
+print(spi)
+
+# the blocking operations work the same way as in the polled mode
+print(spi.write('123456') == 6)
+buffer_r = bytearray(10)
+print(spi.readinto(buffer_r, write=0x55) == 10)
+print(buffer_r == b'\x55' * 10)
+print(spi.read(10, write=0xFF) == b'\xff' * 10)
+buffer_w = bytearray([1, 2, 3, 4, 5, 6, 7, 8, 9, 0])
+print(spi.write_readinto(buffer_w, buffer_r) == 10)
+print(buffer_w == buffer_r)
+
+# longer than a single DMA transaction
+big_w = bytearray(range(256)) * 40
+big_r = bytearray(len(big_w))
+print(spi.write_readinto(big_w, big_r) == len(big_w))
+print(big_w == big_r)
+
+# queued transfers
+reads = [bytearray(16) for i in range(10)]
+writes = [bytearray([i] * 16) for i in range(10)]
+for i in range(10):
+    spi.write_readinto_async(writes[i], reads[i])
+print(spi.wait() == 10)
+print(reads == writes)
+print(spi.wait() == 0)
+
+# a second device with its own CS pin
+dev = spi.add_device('P12', baudrate=1000000)
+print(dev)
+spi.write_async(b'\x01\x02\x03', device=dev)
+spi.write_readinto_async(buffer_w, buffer_r, device=dev)
+print(spi.wait() == 2)
+print(buffer_w == buffer_r)
+
+# throughput: the DMA must beat the polled mode on large buffers
+buf = bytearray(4096)
+t = time.ticks_us()
+for i in range(10):
+    spi.write(buf)
+dma_us = time.ticks_diff(time.ticks_us(), t)
+
+t = time.ticks_us()
+for i in range(10):
+    spi.write_async(buf)
+queue_us = time.ticks_diff(time.ticks_us(), t)
+spi.wait()
+print(queue_us < dma_us)
+
+spi.init(baudrate=10000000, pins=spi_pins)
+t = time.ticks_us()
+for i in range(10):
+    spi.write(buf)
+polled_us = time.ticks_diff(time.ticks_us(), t)
+print(dma_us < polled_us)
+
+# only available in DMA mode
+try:
+    spi.write_async(buf)
+except OSError:
+    print("OSError")
+try:
+    spi.add_device('P12')
+except OSError:
+    print("OSError")
+
+spi.init(baudrate=10000000, pins=spi_pins, dma=True)
+try:
+    spi.write_async(buf, device=2)
+except ValueError:
+    print("ValueError")
+spi.deinit()
+print(spi)
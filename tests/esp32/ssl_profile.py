@@ -0,0 +1,37 @@
+from network import WLAN
+import usocket
+import ussl
+
+if not WLAN().isconnected():
+    print("SKIP")
+    raise SystemExit
+
+HOST = 'www.google.com'
+
+def connect(**kw):
+    ai = usocket.getaddrinfo(HOST, 443)[0][-1]
+    s = usocket.socket()
+    s.connect(ai)
+    ss = ussl.wrap_socket(s, server_hostname=HOST, session_cache=False, **kw)
+    info = ussl.mem_info(ss)
+    ss.write(b'HEAD / HTTP/1.0\r\nHost: ' + HOST + '\r\n\r\n')
+    data = ss.read(12)
+    ss.close()
+    return info, data
+
+print(ussl.PROFILE_DEFAULT, ussl.PROFILE_LOW_MEM)
+
+# both profiles talk to a regular server, the heap used by mbedTLS is reported per socket
+for profile in (ussl.PROFILE_DEFAULT, ussl.PROFILE_LOW_MEM):
+    (heap, obj, shared), data = connect(profile=profile)
+    print(heap > 0, obj > 0, shared, data[:5])
+
+try:
+    connect(profile=7)
+except ValueError:
+    print('ValueError')
+
+try:
+    ussl.mem_info(None)
+except ValueError:
+    print('ValueError')
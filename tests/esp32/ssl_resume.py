@@ -0,0 +1,37 @@
+from network import WLAN
+import usocket
+import ussl
+
+if not WLAN().isconnected():
+    print("SKIP")
+    raise SystemExit
+
+HOST = 'www.google.com'
+
+def connect(**kw):
+    ai = usocket.getaddrinfo(HOST, 443)[0][-1]
+    s = usocket.socket()
+    s.connect(ai)
+    ss = ussl.wrap_socket(s, server_hostname=HOST, **kw)
+    info = ussl.handshake_info(ss)
+    ss.close()
+    return info
+
+ussl.session_cache(False)
+ussl.session_cache(True, persist=False)
+print(ussl.session_cache())
+
+# the first handshake is a full one, the next ones resume the cached session
+t_full, resumed = connect()
+print(resumed)
+t_resumed, resumed = connect()
+print(resumed, ussl.session_cache())
+print(t_resumed <= t_full)
+
+# an explicit saved_session or session_cache=False skip the cache
+print(connect(session_cache=False)[1])
+
+ussl.session_cache(False)
+print(ussl.session_cache())
+print(connect()[1])
+ussl.session_cache(True)
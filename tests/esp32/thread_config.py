@@ -0,0 +1,29 @@
+import _thread
+import time
+
+print(_thread.config())
+
+done = []
+
+def worker(n):
+    done.append(n)
+
+# one thread per core, the first one above the default priority
+_thread.config(core=0, priority=6)
+print(_thread.config())
+_thread.start_new_thread(worker, (0,))
+_thread.config(core=1, priority=5, psram=False)
+print(_thread.config())
+_thread.start_new_thread(worker, (1,))
+time.sleep_ms(100)
+print(sorted(done))
+
+for kw in ({'core': 2}, {'priority': 0}, {'priority': 11}):
+    try:
+        _thread.config(**kw)
+    except ValueError:
+        print('ValueError')
+
+_thread.config(core=1, priority=5, psram=None)
+print(_thread.config())
+print(len(_thread.cpu_usage()) > 0)
@@ -0,0 +1,45 @@
+'''
+P9 and P23 must be connected together for this test to pass.
+Checks that another thread keeps running while the main one is blocked in a driver.
+'''
+
+from machine import UART
+from machine import SPI
+import _thread
+import time
+
+count = 0
+running = True
+
+def counter():
+    global count
+    while running:
+        count += 1
+
+_thread.gil_handoffs(True)
+_thread.start_new_thread(counter, ())
+time.sleep_ms(100)
+
+# about one second on the wire, most of it waiting for room in the Tx FIFO
+uart = UART(1, 9600, pins=('P23', 'P9'))
+uart.read()
+start = count
+print(uart.write(b'u' * 1024))
+print(count - start > 0)
+time.sleep_ms(100)
+uart.read()
+uart.deinit()
+
+# same with a slow SPI transfer
+spi = SPI(0, SPI.MASTER, baudrate=100000, polarity=0, phase=0, pins=('P5', 'P9', 'P23'))
+buf = bytearray(8192)
+start = count
+spi.write_readinto(buf, buf)
+print(count - start > 0)
+spi.deinit()
+
+running = False
+time.sleep_ms(100)
+
+# both threads wanted the GIL all along
+print(_thread.gil_handoffs() > 0)
@@ -0,0 +1,37 @@
+'''
+Nothing may touch P9 and P10 while this test runs.
+'''
+
+from machine import Touch
+import array
+
+t1 = Touch('P9')
+t2 = Touch('P10')
+
+buf = array.array('H', [0] * 10)
+print(Touch.read_all(buf))
+print(buf[0] > 0, buf[1] > 0, buf[2])
+
+try:
+    Touch.read_all(bytearray(2))
+except ValueError:
+    print('ValueError')
+
+# raw reads once the IIR filter is stopped
+print(Touch.filter())
+Touch.filter(0)
+print(Touch.filter(), t1.read() > 0)
+Touch.filter(10)
+
+calls = 0
+def handler(pad):
+    global calls
+    calls += 1
+
+t1.callback(handler)
+t2.callback(handler, threshold=1, wake=True)
+import time
+time.sleep_ms(200)
+t1.callback(None)
+t2.callback(None)
+print(calls)
@@ -0,0 +1,60 @@
+'''
+P11 and P12 must be connected together for this test to pass.
+'''
+
+from machine import UART
+import time
+
+uart = UART(1, 115200, pins=('P11', 'P12'))
+
+# framing is off by default
+try:
+    uart.readframe()
+except OSError:
+    print('OSError')
+
+# lines
+frames = []
+uart.framing(b'\n', handler=lambda u: frames.append(1))
+uart.write(b'$GPGGA,1*00\r\n$GPRMC,2*00\r\npartial')
+time.sleep_ms(50)
+print(len(frames))
+print(uart.readline())
+print(uart.readframe())
+print(uart.readframe())
+print(uart.read())
+
+# zero-copy frame reads
+buf = bytearray(8)
+uart.write(b'abc\n')
+time.sleep_ms(20)
+print(uart.readframe(buf), buf[:4])
+print(uart.readframe(buf))
+
+# plain reads consume the frames too
+uart.write(b'xyz\n')
+time.sleep_ms(20)
+print(uart.read())
+print(uart.readframe())
+
+# idle gap, like Modbus RTU
+uart.framing(idle=4)
+uart.write(b'\x01\x03\x00\x00\x00\x02\xc4\x0b')
+time.sleep_ms(20)
+uart.write(b'\x01\x03\x04\x00\x01\x00\x02\x2a\x32')
+time.sleep_ms(20)
+print(uart.readframe())
+print(uart.readframe())
+print(uart.readframe())
+
+try:
+    uart.framing(b'\n', idle=4)
+except ValueError:
+    print('ValueError')
+try:
+    uart.framing(b'\r\n')
+except ValueError:
+    print('ValueError')
+
+uart.framing()
+uart.deinit()
@@ -0,0 +1,43 @@
+'''
+P11 and P12 must be connected together for this test to pass.
+'''
+
+from machine import UART
+import select
+import time
+
+done = []
+uart = UART(1, 9600, pins=('P11', 'P12'), tx_buffer_size=1024, rx_buffer_size=4096)
+uart.tx_done_handler(lambda u: done.append(1))
+
+# the write returns before the data is sent, 1 KB needs ~1 s at 9600 baud
+data = bytes(range(256)) * 4
+t = time.ticks_ms()
+print(uart.write(data) == 1023)
+print(time.ticks_diff(time.ticks_ms(), t) < 50)
+print(uart.write(b'x'))
+
+# not writable while the ring is full
+p = select.poll()
+p.register(uart, select.POLLOUT)
+print(p.poll(0))
+
+print(uart.wait_tx_done(3000))
+time.sleep_ms(50)
+print(len(done))
+print(p.poll(0) == [(uart, select.POLLOUT)])
+print(uart.read() == data[:1023])
+
+try:
+    UART(1, 9600, pins=('P11', 'P12'), tx_buffer_size=64)
+except ValueError:
+    print('ValueError')
+
+# without a TX ring the writes block as before
+uart.init(9600, pins=('P11', 'P12'))
+print(uart.write(b'123456'))
+try:
+    uart.tx_done_handler(None)
+except OSError:
+    print('OSError')
+uart.deinit()
@@ -0,0 +1,22 @@
+import _uasyncio as aio
+import uqueue
+
+loop = aio.Loop(8)
+q = uqueue.Queue(maxsize=2)
+got = []
+
+async def consumer():
+    while len(got) < 4:
+        await aio.wait_read(q)
+        got.extend(q.get_many(4))
+
+async def producer():
+    for i in range(4):
+        await aio.wait_write(q)
+        q.put(i)
+        await aio.sleep_ms(10)
+
+loop.create_task(producer())
+loop.run_until_complete(consumer())
+print(got)
+print(len(loop))
@@ -0,0 +1,44 @@
+import machine
+import struct
+
+ulp = machine.ULP()
+print(ulp is machine.ULP())
+
+# text: HALT, data: 2 words, bss: 1 word
+program = struct.pack('<IHHHH', 0x00706c75, 12, 4, 8, 4)
+program += struct.pack('<III', 0xb0000000, 0x1234, 0x15678)
+ulp.load_binary(0, program)
+# the program only sees the lower 16 bits, the bss is cleared
+print(ulp.read(1), ulp.read(1, 3))
+
+ulp.write(3, 0x10042)
+print(ulp.read(3))
+
+ulp.set_wakeup_period(0, 20000)
+ulp.run(0)
+ulp.stop()
+
+try:
+    ulp.load_binary(0, b'ulp\x00' + program[4:8])
+except ValueError:
+    print('ValueError')
+
+try:
+    ulp.load_binary(0, b'elf\x00' + program[4:])
+except ValueError:
+    print('ValueError')
+
+try:
+    ulp.load_binary(ulp.MEM_WORDS - 3, program)
+except ValueError:
+    print('ValueError')
+
+try:
+    ulp.read(ulp.MEM_WORDS)
+except ValueError:
+    print('ValueError')
+
+try:
+    ulp.set_wakeup_period(5, 1000)
+except ValueError:
+    print('ValueError')
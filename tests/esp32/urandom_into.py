@@ -0,0 +1,37 @@
+# os.urandom_into() and crypto.getrandbits() from the DRBG
+import os
+import gc
+import time
+import crypto
+
+buf = bytearray(64)
+print(os.urandom_into(buf), buf != bytearray(64))
+print(len(os.urandom(5)), len(os.urandom(300)), len(crypto.getrandbits(33)))
+
+# two draws never match
+a = os.urandom(16)
+print(a != os.urandom(16))
+
+# small nonces into a caller buffer don't allocate
+nonce = bytearray(12)
+gc.collect()
+before = gc.mem_free()
+for i in range(100):
+    os.urandom_into(nonce)
+print(before - gc.mem_free() < 256)
+
+# the bytes are roughly balanced
+big = bytearray(4096)
+os.urandom_into(big)
+ones = 0
+for b in big:
+    while b:
+        ones += b & 1
+        b >>= 1
+print(abs(ones - len(big) * 4) < len(big) // 8)
+
+# throughput in KB/s
+start = time.ticks_us()
+for i in range(16):
+    os.urandom_into(big)
+print(16 * len(big) * 1000 // time.ticks_diff(time.ticks_us(), start) > 500)
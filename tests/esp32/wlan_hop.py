@@ -0,0 +1,32 @@
+from network import WLAN
+import time
+
+wlan = WLAN(mode=WLAN.STA)
+
+try:
+    wlan.hop([1, 6, 11])
+except OSError:
+    print('OSError')
+
+wlan.promiscuous(True)
+for args in (([],), ([15],), ([1], 0), (list(range(1, 16)),)):
+    try:
+        wlan.hop(*args)
+    except ValueError:
+        print('ValueError')
+
+wlan.callback(trigger=WLAN.EVENT_PKT_MGMT, handler=lambda w: None)
+wlan.hop([1, 6, 11], dwell_ms=100)
+print(wlan.hop())
+time.sleep(2)
+wlan.hop(None)
+print(wlan.hop())
+
+# every frame carries the channel it was captured on
+channels = set(p.channel for p in wlan.wifi_packets())
+print(channels <= {1, 6, 11})
+
+wlan.hop((3,), 50)
+wlan.promiscuous(False)
+print(wlan.hop())
+wlan.callback(trigger=None)
@@ -0,0 +1,51 @@
+from network import WLAN
+import time
+
+wlan = WLAN(mode=WLAN.STA)
+wlan.promiscuous(True)
+
+# the capture ring can't be resized while the driver is writing to it
+try:
+    wlan.prom_config(size=4096)
+except OSError:
+    print('OSError')
+wlan.promiscuous(False)
+
+wlan.prom_config(size=4096, snaplen=64, subtypes=1 << 8, rssi=-90)
+cfg = wlan.prom_config()
+print(cfg.size, cfg.snaplen, cfg.subtypes, cfg.mac, cfg.rssi)
+
+try:
+    wlan.prom_config(size=16)
+except ValueError:
+    print('ValueError')
+try:
+    wlan.prom_config(mac=b'1234567')
+except ValueError:
+    print('ValueError')
+
+# only beacons (management subtype 8), truncated to 64 bytes
+wlan.callback(trigger=WLAN.EVENT_PKT_MGMT, handler=lambda w: None)
+wlan.promiscuous(True)
+time.sleep(2)
+wlan.promiscuous(False)
+
+pkts = wlan.wifi_packets()
+print(len(pkts) > 0)
+print(all(p.data[0] == 0x80 for p in pkts))
+print(all(len(p.data) <= 64 and p.rssi >= -90 for p in pkts))
+print(wlan.wifi_packets(), wlan.wifi_packet())
+
+# filter on the transmitter address of the first beacon
+if pkts:
+    bssid = pkts[0].data[10:16]
+    wlan.prom_config(mac=bssid[:3])
+    wlan.promiscuous(True)
+    time.sleep(2)
+    wlan.promiscuous(False)
+    print(all(p.data[10:13] == bssid[:3] for p in wlan.wifi_packets(10)))
+
+wlan.prom_config(subtypes=None, mac=None, rssi=None, snaplen=4096)
+cfg = wlan.prom_config()
+print(cfg.subtypes, cfg.mac, cfg.rssi, cfg.snaplen)
+wlan.callback(trigger=None)
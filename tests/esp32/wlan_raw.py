@@ -0,0 +1,44 @@
+from network import WLAN
+import time
+
+def beacon(ssid):
+    # frame control, duration, broadcast, source and BSSID, sequence
+    hdr = b'\x80\x00\x00\x00' + b'\xff' * 6 + b'\x02\x00\x00\x00\x00\x01' * 2 + b'\x00\x00'
+    # timestamp, interval, capabilities and the SSID element
+    return hdr + bytes(8) + b'\x64\x00\x01\x04' + bytes([0, len(ssid)]) + ssid
+
+wlan = WLAN(mode=WLAN.AP, ssid='raw-test')
+frames = [beacon(('raw-%d' % i).encode()) for i in range(4)]
+
+wlan.send_raw(Buffer=frames, interval=2000, repeat=25)
+print(wlan.send_raw_status()[0])
+time.sleep(1)
+running, ok, failed = wlan.send_raw_status()
+print(running, len(ok), [a + b for a, b in zip(ok, failed)])
+print(sum(ok) > 90)
+
+# one buffer with the length of each frame
+buf = b''.join(frames)
+wlan.send_raw(Buffer=buf, lengths=[len(f) for f in frames], interval=1000, repeat=10)
+time.sleep(0.5)
+running, ok, failed = wlan.send_raw_status()
+print(running, [a + b for a, b in zip(ok, failed)])
+
+# a single frame repeated, stopped before the end
+wlan.send_raw(Buffer=frames[0], interval=1000, repeat=1000)
+time.sleep(0.1)
+wlan.send_raw(Buffer=None)
+running, ok, failed = wlan.send_raw_status()
+print(running, 0 < ok[0] + failed[0] < 1000)
+
+for kw in ({'Buffer': [b'short']}, {'Buffer': [], 'repeat': 2}, {'Buffer': frames, 'interval': 10},
+           {'Buffer': frames, 'repeat': 0}, {'Buffer': buf, 'lengths': [len(buf) + 100]}):
+    try:
+        wlan.send_raw(**kw)
+    except ValueError:
+        print('ValueError')
+
+# one frame is still sent right away
+wlan.send_raw(Buffer=frames[0])
+print(wlan.send_raw_status()[0])
+wlan.deinit()
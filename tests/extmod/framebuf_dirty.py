@@ -0,0 +1,74 @@
+try:
+    import framebuf
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+w = 8
+h = 6
+buf = bytearray(w * h * 2)
+fbuf = framebuf.FrameBuffer(buf, w, h, framebuf.RGB565)
+
+# a new framebuffer is dirty as a whole
+print(fbuf.dirty())
+print(fbuf.dirty())
+
+# drawing adds to the dirty area
+fbuf.pixel(1, 2, 0xffff)
+print(fbuf.dirty())
+fbuf.fill_rect(2, 1, 3, 2, 0x1234)
+fbuf.pixel(6, 4, 0xffff)
+print(fbuf.dirty())
+fbuf.hline(-5, 5, 8, 1)
+print(fbuf.dirty())
+fbuf.line(5, 1, 2, 3, 1)
+print(fbuf.dirty())
+fbuf.text('a', 4, 4, 1)
+print(fbuf.dirty())
+
+# reading doesn't
+fbuf.pixel(0, 0)
+print(fbuf.dirty())
+
+# drawn outside
+fbuf.fill_rect(10, 10, 2, 2, 1)
+print(fbuf.dirty())
+
+# invalidate
+fbuf.invalidate(1, 1, 2, 2)
+print(fbuf.dirty())
+fbuf.invalidate()
+print(fbuf.dirty())
+
+# the fill_rect rows are the same
+fbuf.fill(0)
+fbuf.fill_rect(1, 1, 5, 3, 0xabcd)
+for y in range(h):
+    print([hex(fbuf.pixel(x, y)) for x in range(w)])
+
+# rows
+fbuf.dirty()
+fbuf.fill_rect(0, 2, 1, 2, 0xffff)
+x, y, dw, dh = fbuf.dirty()
+print(bytes(fbuf.rows(y, dh)) == buf[y * w * 2:(y + dh) * w * 2])
+print(len(fbuf.rows(0, h)), len(fbuf.rows(3, 0)))
+try:
+    fbuf.rows(4, 3)
+except ValueError:
+    print('ValueError')
+
+# blit between RGB565 framebuffers, with and without a key
+src = framebuf.FrameBuffer(bytearray(3 * 2 * 2), 3, 2, framebuf.RGB565)
+src.fill(0x1111)
+src.pixel(1, 0, 0x2222)
+fbuf.fill(0)
+fbuf.dirty()
+fbuf.blit(src, -1, 1)
+fbuf.blit(src, 5, 3, 0x1111)
+print(fbuf.dirty())
+for y in range(h):
+    print([hex(fbuf.pixel(x, y)) for x in range(w)])
+
+# MVLSB rows are pages of 8 rows
+fbuf = framebuf.FrameBuffer(bytearray(4 * 2), 4, 10, framebuf.MONO_VLSB)
+print(len(fbuf.rows(7, 2)), len(fbuf.rows(0, 10)))
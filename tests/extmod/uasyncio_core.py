@@ -0,0 +1,63 @@
+try:
+    import _uasyncio as aio
+except ImportError:
+    print('SKIP')
+    raise SystemExit
+
+loop = aio.Loop(8)
+log = []
+
+async def worker(name, delay, n):
+    for i in range(n):
+        await aio.sleep_ms(delay)
+        log.append((name, i))
+    return name
+
+def gen():
+    yield
+    log.append('gen')
+    yield 5
+    log.append('gen2')
+
+async def main():
+    loop.create_task(worker('b', 30, 2))
+    loop.create_task(gen())
+    r = await worker('a', 20, 2)
+    await aio.sleep_ms(50)
+    return r
+
+print(loop.run_until_complete(main()))
+print(log)
+print(len(loop), bool(loop))
+
+async def fail():
+    await aio.sleep(0)
+    raise ValueError('x')
+
+try:
+    loop.run_until_complete(fail())
+except ValueError as e:
+    print('ValueError', e)
+
+async def bad():
+    await aio.sleep_ms(1)
+    yield 'x'
+try:
+    loop.run_until_complete(bad())
+except TypeError:
+    print('TypeError')
+
+small = aio.Loop(1)
+small.create_task(worker('c', 0, 1))
+try:
+    small.create_task(worker('d', 0, 1))
+except IndexError:
+    print('IndexError')
+
+async def stopper():
+    await aio.sleep_ms(1)
+    loop.stop()
+loop.create_task(stopper())
+loop.run_forever()
+switches, late = loop.stats(True)
+print(switches > 0, late >= 0, loop.stats())
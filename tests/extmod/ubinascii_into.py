@@ -0,0 +1,63 @@
+try:
+    try:
+        import ubinascii as binascii
+    except ImportError:
+        import binascii
+    binascii.b2a_base64_into
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+buf = bytearray(16)
+
+# base64 encoding, with and without the trailing newline
+for data in (b'', b'f', b'fo', b'foo', b'foob', b'fooba', b'foobar'):
+    n = binascii.b2a_base64_into(data, buf)
+    print(n, bytes(buf[:n]), bytes(buf[:n]) == binascii.b2a_base64(data))
+    n = binascii.b2a_base64_into(data, buf, newline=False)
+    print(n, bytes(buf[:n]), bytes(buf[:n]) == binascii.b2a_base64(data, newline=False))
+
+# base64 decoding
+for data in (b'', b'Zg==', b'Zm8=', b'Zm9v', b'Zm9vYg==', b'Zm9v\nYmFy\n', b'Zm9vYmFy'):
+    n = binascii.a2b_base64_into(data, buf)
+    print(n, bytes(buf[:n]), bytes(buf[:n]) == binascii.a2b_base64(data))
+
+# longer data goes through the whole-group loops
+data = bytes(range(256))
+enc = bytearray(400)
+n = binascii.b2a_base64_into(data, enc, newline=False)
+dec = bytearray(256)
+print(n, binascii.a2b_base64_into(enc[:n], dec), dec == data)
+
+# hex
+n = binascii.hexlify_into(b'\x01\xab\xff', buf)
+print(n, bytes(buf[:n]))
+n = binascii.hexlify_into(b'\x01\xab\xff', buf, ':')
+print(n, bytes(buf[:n]))
+n = binascii.unhexlify_into(b'01abFF', buf)
+print(n, bytes(buf[:n]))
+
+# writing into a memoryview
+mv = memoryview(buf)[4:]
+n = binascii.b2a_base64_into(b'abc', mv, newline=False)
+print(n, bytes(buf[4:4 + n]))
+
+# errors
+for f, args in (
+        (binascii.b2a_base64_into, (b'x' * 12, bytearray(16))),
+        (binascii.a2b_base64_into, (b'Zm9vYmFy', bytearray(5))),
+        (binascii.a2b_base64_into, (b'Zm9', bytearray(5))),
+        (binascii.hexlify_into, (b'abc', bytearray(5))),
+        (binascii.unhexlify_into, (b'abc', bytearray(5))),
+        (binascii.unhexlify_into, (b'0g', bytearray(5))),
+        (binascii.unhexlify_into, (b'0000', bytearray(1))),
+        ):
+    try:
+        f(*args)
+    except ValueError:
+        print('ValueError')
+
+try:
+    binascii.hexlify_into(b'abc', b'1234567')
+except TypeError:
+    print('TypeError')
@@ -0,0 +1,36 @@
+try:
+    import ucrc
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+check = b'123456789'
+
+# presets, against the check values of the CRC catalogue
+for name in ('crc8', 'crc8_maxim', 'crc16_arc', 'crc16_modbus', 'crc16_kermit',
+             'crc16_xmodem', 'crc16_ccitt_false', 'crc32', 'crc32c'):
+    print(name, hex(ucrc.CRC(name).calc(check)))
+
+# arbitrary parameters
+print(hex(ucrc.CRC(32, 0x04c11db7, 0xffffffff, xorout=0xffffffff).calc(check)))
+print(hex(ucrc.CRC(5, 0x05, 0x1f, refin=True, xorout=0x1f).calc(check)))
+print(hex(ucrc.CRC(12, 0x80f, 0, refout=True).calc(check)))
+
+# incremental update, and calc() leaves the running value alone
+c = ucrc.CRC('crc16_modbus')
+print(hex(c.digest()))
+c.update(b'1234')
+print(hex(c.calc(b'')))
+c.update(bytearray(b'56789'))
+print(hex(c.digest()))
+c.reset()
+c.update(memoryview(check)[:4])
+c.update(memoryview(check)[4:])
+print(hex(c.digest()))
+
+# errors
+for args in ((0, 7), (33, 7), (8,), ('crc99',)):
+    try:
+        ucrc.CRC(*args)
+    except (ValueError, TypeError) as er:
+        print(type(er).__name__)
@@ -0,0 +1,63 @@
+try:
+    import udsp
+    from array import array
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+# elementwise, with an array or a number, integer results saturate
+a = array('h', [1, -2, 30000, -30000])
+b = array('h', [10, 20, 30000, -30000])
+d = array('h', [0] * 4)
+udsp.add(d, a, b)
+print(d)
+udsp.mul(d, a, b)
+print(d)
+udsp.add(d, a, 5)
+print(d)
+udsp.scale(d, a, 0.5, 1)
+print(d)
+f = array('f', [1, 2, 3, 4])
+udsp.mul(f, f, f)
+print(f)
+u = array('H', [0, 100, 65535])
+udsp.add(u, u, -50)
+print(u)
+
+# in place on a memoryview slice
+m = array('i', range(6))
+udsp.scale(memoryview(m)[2:], memoryview(m)[2:], 10)
+print(m)
+
+# reductions
+for t in ('h', 'H', 'i', 'f'):
+    x = array(t, [3, 1, 4, 1, 5, 9, 2, 6])
+    print(t, udsp.sum(x), udsp.mean(x), udsp.min(x), udsp.max(x), '%.4f' % udsp.rms(x), udsp.dot(x, x))
+print(udsp.sum(array('i', [0x7fffffff] * 4)))
+
+# filters
+x = array('h', [0, 10, 20, 30, 40, 50])
+y = array('h', [0] * 6)
+print(udsp.moving_average(y, x, 3), y)
+print(udsp.fir(y, x, array('f', [0.5, 0.5])), y)
+# Q15 taps, in place
+print(udsp.fir(x, x, array('h', [16384, 16384])), x)
+x = array('f', [1, 2, 3, 4])
+print(udsp.moving_average(x, x, 2), x)
+
+# errors
+for args in ((array('h', [0] * 4), array('f', [0] * 4), 1), (array('h', [0] * 2), array('h', [0] * 4), 1),
+             (array('h', [0] * 4), array('h', [0] * 4), array('h', [0] * 3)), (bytearray(4), bytearray(4), 1)):
+    try:
+        udsp.add(*args)
+    except ValueError as er:
+        print(er)
+for f in (udsp.mean, udsp.max, udsp.rms):
+    try:
+        f(array('f'))
+    except ValueError as er:
+        print(er)
+try:
+    udsp.moving_average(array('h', [0] * 4), array('h', [0] * 4), 5)
+except ValueError as er:
+    print(er)
@@ -0,0 +1,59 @@
+try:
+    import udsp
+    from array import array
+    import math
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+def show(a):
+    # + 0 turns a -0.0 into 0.0
+    print(['%.3f' % (round(v, 3) + 0) for v in a])
+
+# a cosine in bin 2 and a sine in bin 5 on top of a DC of 1
+N = 16
+x = array('f', [1 + math.cos(2 * math.pi * 2 * i / N) + 0.5 * math.sin(2 * math.pi * 5 * i / N) for i in range(N)])
+udsp.rfft(x)
+show(x)
+m = array('f', [0] * (N // 2 + 1))
+print(udsp.magnitude(m, x))
+show(m)
+e = array('f', [0] * 3)
+udsp.band_energy(e, x, (0, 1, 4, 9))
+show(e)
+
+# the Nyquist bin
+x = array('f', [1, -1] * 4)
+udsp.rfft(x)
+show(x)
+print(udsp.magnitude(x, x))
+show(x)
+
+# windows
+for w in (udsp.HANN, udsp.HAMMING, udsp.BLACKMAN):
+    x = array('f', [1] * 8)
+    udsp.window(x, w)
+    show(x)
+
+# raw integer samples converted for the FFT
+raw = array('H', [2048, 3072, 2048, 1024])
+x = array('f', [0] * 4)
+udsp.scale(x, raw, 1 / 1024, -2)
+show(x)
+udsp.rfft(x)
+show(x)
+
+# errors
+for args in ((array('f', [0] * 12),), (array('h', [0] * 8),)):
+    try:
+        udsp.rfft(*args)
+    except ValueError as er:
+        print(er)
+try:
+    udsp.window(array('f', [0] * 8), 99)
+except ValueError as er:
+    print(er)
+try:
+    udsp.band_energy(e, array('f', [0] * 8), (0, 6))
+except ValueError as er:
+    print(er)
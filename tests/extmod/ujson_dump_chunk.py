@@ -0,0 +1,20 @@
+try:
+    import ujson as json
+    from uio import StringIO
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+obj = {"key": [1, 2.5, "three", None, True], "nested": {"x": "y" * 40}}
+ref = json.dumps(obj)
+
+# the output is the same whatever the size of the chunks
+for size in (0, 1, 7, 16, 64, 1000):
+    s = StringIO()
+    json.dump(obj, s, chunk_size=size)
+    print(size, s.getvalue() == ref)
+
+s = StringIO()
+json.dump([], s, chunk_size=8)
+json.dump("x", s, chunk_size=8)
+print(s.getvalue())
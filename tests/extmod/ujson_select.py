@@ -0,0 +1,38 @@
+try:
+    import ujson as json
+    from uio import StringIO
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+try:
+    json.select
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+doc = '{"a": 1, "big": [1, 2, {"x": "}]"}], "wifi": {"ssid": "n\\u00e9t", "nets": [{"k": 1}, {"k": [2, 3]}]}, "z": null}'
+
+def show(d):
+    print(sorted(d.items()))
+
+show(json.select(doc, ("a",)))
+show(json.select(doc, ["wifi.ssid", "z"]))
+show(json.select(doc, ("wifi.nets.1.k", "wifi.nets.0")))
+show(json.select(doc, ("big.2.x", "missing", "a.b")))
+show(json.select(StringIO(doc), ("wifi",)))
+show(json.select(b'[10, [20, 30]]', ("1.0", "0")))
+show(json.select(doc, ()))
+
+# the selected values can be anywhere in the document
+show(json.select('{"a": {"b": 1}, "a.b": 2}', ("a.b",)))
+
+for bad in ('{"a": [1, 2}', '{"a": "x', '{1: 2}'):
+    try:
+        json.select(bad, ("a.0", "b"))
+    except ValueError:
+        print("ValueError")
+
+try:
+    json.select(doc, (1,))
+except TypeError:
+    print("TypeError")
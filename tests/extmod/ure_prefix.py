@@ -0,0 +1,40 @@
+# search for patterns starting with a literal, and on buffers
+try:
+    import ure as re
+except ImportError:
+    try:
+        import re
+    except ImportError:
+        print("SKIP")
+        raise SystemExit
+
+def show(m):
+    print(m and m.group(0))
+
+show(re.search('OK', 'AT\r\nOK\r\n'))
+show(re.search('ERROR', 'AT\r\nOK\r\n'))
+show(re.search('\\+CSQ: (\\d+),(\\d+)', '\r\n+CSQ: 21,99\r\nOK'))
+show(re.search('abcdefghijk+', 'xxabcdefghijabcdefghijkkk'))
+show(re.search('ab*c', 'acabc'))
+show(re.search('a|b', 'xxb'))
+show(re.search('^ab', 'xab'))
+show(re.search('ab$', 'abab'))
+show(re.search('aa', 'a'))
+show(re.search('x', ''))
+print(re.compile('; ').split('a; b; c'))
+print(re.compile('ab').search('zzab').group(0))
+
+# the same pattern many times, through the module functions
+for i in range(10):
+    m = re.search('\\$GP([A-Z]+),', '$GPRMC,1,2' if i % 2 else '$GPGGA,3')
+    print(m.group(1))
+print(re.match('a', 'ab').group(0), re.match('b', 'ab'))
+
+# bytes and buffers
+show(re.search(b'OK', b'AT\r\nOK\r\n'))
+buf = bytearray(b'$GPGGA,123519,4807.038,N*47\r\n')
+m = re.search(b'\\$GP(...),(\\d+)', buf)
+print(bytes(m.group(1)), bytes(m.group(2)))
+m = re.search(b'(\\d+)\\.(\\d+)', memoryview(buf)[14:])
+print(bytes(m.group(0)))
+print([bytes(x) for x in re.compile(b',').split(memoryview(buf)[:20])])
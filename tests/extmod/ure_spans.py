@@ -0,0 +1,25 @@
+# test match.spans(), which fills an array without allocating
+try:
+    import ure as re
+    import array
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+try:
+    re.match('', '').spans
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+spans = array.array('h', [0] * 8)
+m = re.search(r'\+CSQ: (\d+),(\d+)(x)?', 'AT\r\n+CSQ: 21,99\r\n')
+print(m.spans(spans), list(spans))
+
+m = re.match(b'(..)', memoryview(b'abcd')[1:])
+print(m.spans(spans), list(spans[:4]))
+
+try:
+    m.spans(array.array('i', [0]))
+except ValueError:
+    print('ValueError')
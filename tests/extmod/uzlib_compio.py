@@ -0,0 +1,55 @@
+try:
+    import uzlib as zlib
+    import uio as io
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+try:
+    zlib.CompIO
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+data = b"micropython " * 40 + bytes(range(256)) + b"abc" * 100
+
+# one-shot, zlib and raw deflate
+for wbits in (8, 10, 15):
+    c = zlib.compress(data, wbits)
+    print(wbits, len(c) < len(data), zlib.decompress(c) == data)
+c = zlib.compress(data, -10)
+print(zlib.decompress(c, -1) == data)
+print(zlib.decompress(zlib.compress(b"")))
+print(zlib.decompress(zlib.compress(b"a")))
+
+# streaming, data larger than the internal buffer
+for wbits in (9, -9, 25):
+    buf = io.BytesIO()
+    with zlib.CompIO(buf, wbits) as f:
+        for i in range(20):
+            f.write(data[i * 50:i * 50 + 50])
+        f.write(data)
+    buf.seek(0)
+    print(wbits, zlib.DecompIO(buf, wbits).read() == data[:1000] + data)
+
+# flush() writes out what has been compressed so far
+buf = io.BytesIO()
+f = zlib.CompIO(buf, 10, hash_bits=6)
+f.write(b"hello world " * 10)
+f.flush()
+print(len(buf.getvalue()) > 2)
+f.write(b"bye")
+f.close()
+f.close()
+print(zlib.decompress(buf.getvalue()))
+
+try:
+    f.write(b"x")
+except OSError:
+    print("OSError")
+
+for wbits in (7, 16, -16, 32):
+    try:
+        zlib.CompIO(io.BytesIO(), wbits)
+    except ValueError:
+        print("ValueError")
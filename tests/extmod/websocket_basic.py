@@ -34,6 +34,14 @@ print(ws_write(b"pong" * 32, 132))
 # mask (returned data will be 'mask' ^ 'mask')
 print(ws_read(b"\x81\x84maskmask", 4))
 
+# masked payload longer than a word, read in pieces that break the alignment
+ws = uwebsocket.websocket(uio.BytesIO(b"\x82\x8b\x01\x02\x03\x04" + bytes(b ^ (1 + i % 4) for i, b in enumerate(b"hello world"))))
+print(ws.read(3), ws.read(8))
+
+# 64-bit payload length
+print(ws_read(b"\x82\x7f\x00\x00\x00\x00\x00\x00\x00\x04data", 4))
+print(ws_write(b"x" * 0x10000, 10))
+
 # close control frame
 s = uio.BytesIO(b'\x88\x00') # FRAME_CLOSE
 ws = uwebsocket.websocket(s)
@@ -0,0 +1,35 @@
+# bytearray.split_into() fills a list with memoryviews of the complete pieces
+try:
+    bytearray.split_into
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+buf = bytearray(b'$GPGGA,1\r\n$GPRMC,2\r\n$GPG')
+lines = []
+n = buf.split_into(b'\r\n', lines)
+print(n, len(lines))
+for l in lines:
+    print(type(l) is memoryview, bytes(l))
+
+# the views share the data
+lines[0][1] = ord('X')
+print(buf[:6])
+
+# keep the incomplete tail and go on
+buf = buf[n:]
+buf.extend(b'SV,3\r\n')
+print(buf.split_into(b'\r\n', lines), [bytes(l) for l in lines])
+
+# nothing complete, and the list is cleared
+print(bytearray(b'abc').split_into(b'\n', lines), lines)
+print(bytearray(b'\n\n').split_into(b'\n', lines), [bytes(l) for l in lines])
+
+try:
+    buf.split_into(b'', lines)
+except ValueError:
+    print('ValueError')
+try:
+    buf.split_into(b'\n', ())
+except TypeError:
+    print('TypeError')
@@ -0,0 +1,40 @@
+# test constant folding of const() values, comparisons, concatenation and tuples
+
+from micropython import const
+
+_DEBUG = const(0)
+_NAME = const('abc')
+_DATA = const(b'\x01\x02')
+_LEVEL = const(3)
+
+# comparisons of constants fold to bools
+print(_LEVEL > 2, _LEVEL == 2, 1 < 2 < 3, 1 < 3 < 2)
+
+# dead branch removed
+if _DEBUG > 0:
+    print('not reached')
+else:
+    print('reached')
+
+# str and bytes constants and their concatenation
+print(_NAME, _DATA)
+print(_NAME + 'def', 'x' + 'y' + 'z', b'a' + b'b')
+
+# tuples of literals are constants
+def f():
+    return (1, 'a', None, True, b'z', -2)
+print(f(), f() is f())
+def g():
+    return (_LEVEL, _NAME)
+print(g(), g() is g())
+
+# a tuple with a non-literal is built each time
+def h(x):
+    return (1, x)
+print(h(2), h(2) is h(2))
+
+# only int, str and bytes can be const
+try:
+    exec('from micropython import const\nX = const(1.5)')
+except SyntaxError:
+    print('SyntaxError')
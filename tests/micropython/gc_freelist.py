@@ -0,0 +1,41 @@
+# small tuples and str/bytes reused from the free lists the sweep keeps
+import gc
+
+def make(n):
+    out = []
+    for i in range(n):
+        t = (i, i + 1)
+        s = str(i)
+        b = bytes(s, 'ascii')
+        # garbage of the same kinds for the sweep to keep
+        (i, s, b)
+        str(i + 1000)
+        out.append((t, s, b))
+    return out
+
+for _ in range(3):
+    gc.collect()
+    a = make(50)
+    gc.collect()
+    b = make(50)
+    gc.collect()
+    ok = True
+    for i in range(50):
+        for x in (a, b):
+            t, s, by = x[i]
+            if t != (i, i + 1) or s != str(i) or by != bytes(str(i), 'ascii'):
+                ok = False
+            if hash(s) != hash(str(i)):
+                ok = False
+    print(ok)
+
+# objects popped from a list are fully reset
+gc.collect()
+for i in range(20):
+    x = ('abc' + str(i),)
+gc.collect()
+t = tuple(range(3))
+print(t, len(t), t[2])
+s = 'x' + 'yz'
+print(s, len(s), s.upper(), s == 'xyz')
+print(b'\x00' * 3, bytes(2))
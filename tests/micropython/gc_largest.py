@@ -0,0 +1,28 @@
+# test gc.mem_largest(), the largest free block of the heap
+
+import gc
+
+try:
+    gc.mem_largest
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+gc.collect()
+largest = gc.mem_largest()
+print(0 < largest <= gc.mem_free())
+
+# a buffer of that size fits without a collection
+gc.disable()
+try:
+    buf = bytearray(largest - 16)
+    print(len(buf) == largest - 16)
+    # and takes the space, so the largest block shrinks
+    print(gc.mem_largest() < largest)
+finally:
+    gc.enable()
+
+# once freed, the block is back
+buf = None
+gc.collect()
+print(gc.mem_largest() >= largest - 16)
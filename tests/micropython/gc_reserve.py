@@ -0,0 +1,31 @@
+# test gc.reserve(), the blocks kept for the drivers' events
+
+import gc
+
+try:
+    gc.reserve
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+available, target, taken = gc.reserve()
+print(available == target, target > 0)
+
+# fewer blocks are dropped at once
+gc.reserve(2)
+print(gc.reserve()[:2])
+
+# more are allocated by the next allocations, up to the maximum
+gc.reserve(1000)
+x = [1, 2]
+print(gc.reserve()[0] == gc.reserve()[1] == target)
+
+# and they survive a collection
+gc.collect()
+x = [3, 4]
+print(gc.reserve()[0] == target)
+
+try:
+    gc.reserve(-1)
+except ValueError:
+    print('ValueError')
@@ -37,3 +37,12 @@ def f():
         a = 300
     print(a)
 f()
+
+# raise with a cause, which is ignored
+@micropython.native
+def f():
+    try:
+        raise ValueError(1) from None
+    except ValueError as er:
+        print('ValueError', er)
+f()
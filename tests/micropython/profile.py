@@ -0,0 +1,40 @@
+# test the sampling profiler of micropython.profile_start()
+
+import micropython
+
+try:
+    micropython.profile_start
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+def busy():
+    s = 0
+    for i in range(1000):
+        s += i * i
+    return s
+
+micropython.profile_start(1000)
+for _ in range(100000):
+    busy()
+    if micropython.profile_report()[0] >= 20:
+        break
+micropython.profile_stop()
+
+ticks, lines = micropython.profile_report()
+print(ticks >= 20)
+samples = sum(l[3] for l in lines)
+print(0 < samples <= ticks)
+print(lines[0][2], type(lines[0][0]), type(lines[0][1]))
+print(all(lines[i][3] >= lines[i + 1][3] for i in range(len(lines) - 1)))
+
+# the counts are cleared by the next start
+micropython.profile_start()
+micropython.profile_stop()
+ticks, lines = micropython.profile_report()
+print(ticks <= 1, len(lines) <= 1)
+
+try:
+    micropython.profile_start(0)
+except ValueError:
+    print('ValueError')
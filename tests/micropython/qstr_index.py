@@ -0,0 +1,27 @@
+# test qstr interning through the qstr hash index
+
+import micropython
+
+try:
+    micropython.qstr_index_info
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+class A:
+    pass
+
+# intern enough new names to make the index grow a few times
+a = A()
+n = 5000
+for i in range(n):
+    setattr(a, 'attr_%d' % i, i)
+print(all(getattr(a, 'attr_%d' % i) == i for i in range(n)))
+print(sum(1 for k in dir(a) if k.startswith('attr_')) == n)
+
+# existing qstrs are still found, from the ROM pool and the new ones
+print(getattr(a, '__class__') is A, getattr(a, 'attr_' + str(n - 1)))
+print(hasattr(a, 'attr_x'), hasattr(a, 'attr_%d' % n))
+
+n_slots, n_lookups, n_probes = micropython.qstr_index_info()
+print(n_slots >= 2 * n, n_lookups > n, n_probes > 0)
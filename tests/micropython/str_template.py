@@ -0,0 +1,41 @@
+# test micropython.template, a str.format pattern parsed once
+
+import micropython
+
+try:
+    micropython.template
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+pat = "id={} t={:.2f} h={:x} {:5s}|{:05d}|{:X} {{x}} {}"
+t = micropython.template(pat)
+print(t)
+
+# the same result as str.format
+for v in (0, 1, -1, 255, -255, 1 << 70, True):
+    args = (v, 21.456, v, "ab", v, v, [v])
+    print(t.format(*args) == pat.format(*args), t(*args))
+
+# numbered fields, a str precision
+t = micropython.template("{1}-{0}-{1:3d}-{0:.2s}")
+print(t("abc", 5))
+print(micropython.template("")(), micropython.template("a{{b}}c")())
+
+# the fields outside of the supported subset
+for pat in ("{", "}", "{:q}", "{:.2d}", "{0}{}", "{}{0}", "{!r}", "{:05s}", "{:5}", "{a}"):
+    try:
+        micropython.template(pat)
+    except ValueError:
+        print("ValueError", pat)
+
+# too few args, args of the wrong type
+try:
+    t("a")
+except TypeError:
+    print("TypeError")
+for pat, arg in (("{:d}", 1.5), ("{:x}", "a"), ("{:f}", "a"), ("{:s}", 1)):
+    try:
+        micropython.template(pat)(arg)
+    except ValueError:
+        print("ValueError", pat)
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+#
+# This file is part of the MicroPython project, http://micropython.org/
+#
+# Runs mpy-cross through a cache of the compiled files keyed by content.
+#
+# Usage: mpy-cross-cache.py -c CACHE_DIR MPY_CROSS [mpy-cross args...] -o OUT SRC
+#
+# The key covers the mpy-cross binary, all of its arguments but the output
+# file and the content of the source file, so touching a file, switching
+# branches back and forth or a clean build only runs mpy-cross for what
+# really changed. Entries are written atomically and the script can run in
+# parallel with itself on the same cache directory.
+
+from __future__ import print_function
+
+import hashlib
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+
+def usage():
+    print("usage: %s -c CACHE_DIR MPY_CROSS [args...] -o OUT SRC" % sys.argv[0], file=sys.stderr)
+    sys.exit(2)
+
+
+def file_digest(path):
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for chunk in iter(lambda: f.read(65536), b""):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def main():
+    argv = sys.argv[1:]
+    if len(argv) < 5 or argv[0] != "-c":
+        usage()
+    cache_dir = argv[1]
+    mpy_cross = argv[2]
+    args = argv[3:]
+    try:
+        out = args[args.index("-o") + 1]
+    except (ValueError, IndexError):
+        usage()
+    src = args[-1]
+
+    h = hashlib.sha256()
+    h.update(file_digest(mpy_cross).encode())
+    key_args = list(args)
+    del key_args[args.index("-o") : args.index("-o") + 2]
+    # the source is keyed by its content, not by its path
+    for a in key_args[:-1]:
+        h.update(b"\0" + a.encode())
+    h.update(b"\0" + file_digest(src).encode())
+    key = h.hexdigest()
+    entry = os.path.join(cache_dir, key[:2], key + ".mpy")
+
+    if not os.path.isfile(entry):
+        ret = subprocess.call([mpy_cross] + args)
+        if ret != 0:
+            sys.exit(ret)
+        entry_dir = os.path.dirname(entry)
+        if not os.path.isdir(entry_dir):
+            try:
+                os.makedirs(entry_dir)
+            except OSError:
+                # created meanwhile by a parallel job
+                pass
+        fd, tmp = tempfile.mkstemp(dir=entry_dir)
+        os.close(fd)
+        shutil.copyfile(out, tmp)
+        os.rename(tmp, entry)
+        return
+
+    out_dir = os.path.dirname(out)
+    if out_dir and not os.path.isdir(out_dir):
+        os.makedirs(out_dir)
+    shutil.copyfile(entry, out)
+
+
+if __name__ == "__main__":
+    main()
@@ -57,7 +57,7 @@ class FreezeError(Exception):
         return 'error while freezing %s: %s' % (self.rawcode.source_file, self.msg)
 
 class Config:
-    MPY_VERSION = 4
+    MPY_VERSION = 5
     MICROPY_LONGINT_IMPL_NONE = 0
     MICROPY_LONGINT_IMPL_LONGLONG = 1
     MICROPY_LONGINT_IMPL_MPZ = 2
@@ -102,6 +102,7 @@ MP_NATIVE_ARCH_ARMV7EM = 6
 MP_NATIVE_ARCH_ARMV7EMSP = 7
 MP_NATIVE_ARCH_ARMV7EMDP = 8
 MP_NATIVE_ARCH_XTENSA = 9
+MP_NATIVE_ARCH_XTENSAWIN = 10
 
 MP_OPCODE_BYTE = 0
 MP_OPCODE_QSTR = 1
@@ -314,56 +315,105 @@ class RawCode(object):
         for rc in self.raw_codes:
             rc.freeze(self.escaped_name + '_')
 
+    def freeze_constant_obj(self, obj_name, obj):
+        if obj is MPFunTable:
+            pass
+        elif obj is None or obj is False or obj is True:
+            pass
+        elif obj is Ellipsis:
+            print('#define %s mp_const_ellipsis_obj' % obj_name)
+        elif is_str_type(obj) or is_bytes_type(obj):
+            if is_str_type(obj):
+                obj = bytes_cons(obj, 'utf8')
+                obj_type = 'mp_type_str'
+            else:
+                obj_type = 'mp_type_bytes'
+            print('STATIC const mp_obj_str_t %s = {{&%s}, %u, %u, (const byte*)"%s"};'
+                % (obj_name, obj_type, qstrutil.compute_hash(obj, config.MICROPY_QSTR_BYTES_IN_HASH),
+                    len(obj), ''.join(('\\x%02x' % b) for b in obj)))
+        elif is_int_type(obj):
+            if config.MICROPY_LONGINT_IMPL == config.MICROPY_LONGINT_IMPL_NONE:
+                # TODO check if we can actually fit this long-int into a small-int
+                raise FreezeError(self, 'target does not support long int')
+            elif config.MICROPY_LONGINT_IMPL == config.MICROPY_LONGINT_IMPL_LONGLONG:
+                # TODO
+                raise FreezeError(self, 'freezing int to long-long is not implemented')
+            elif config.MICROPY_LONGINT_IMPL == config.MICROPY_LONGINT_IMPL_MPZ:
+                neg = 0
+                if obj < 0:
+                    obj = -obj
+                    neg = 1
+                bits_per_dig = config.MPZ_DIG_SIZE
+                digs = []
+                z = obj
+                while z:
+                    digs.append(z & ((1 << bits_per_dig) - 1))
+                    z >>= bits_per_dig
+                ndigs = len(digs)
+                digs = ','.join(('%#x' % d) for d in digs)
+                print('STATIC const mp_obj_int_t %s = {{&mp_type_int}, '
+                    '{.neg=%u, .fixed_dig=1, .alloc=%u, .len=%u, .dig=(uint%u_t*)(const uint%u_t[]){%s}}};'
+                    % (obj_name, neg, ndigs, ndigs, bits_per_dig, bits_per_dig, digs))
+        elif type(obj) is float:
+            print('#if MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_A || MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_B')
+            print('STATIC const mp_obj_float_t %s = {{&mp_type_float}, %.16g};'
+                % (obj_name, obj))
+            print('#endif')
+        elif type(obj) is complex:
+            print('STATIC const mp_obj_complex_t %s = {{&mp_type_complex}, %.16g, %.16g};'
+                % (obj_name, obj.real, obj.imag))
+        elif type(obj) is tuple:
+            # the items are defined first, then referenced from the tuple
+            items = []
+            for j, item in enumerate(obj):
+                item_name = '%s_%u' % (obj_name, j)
+                if not self.is_small_int(item):
+                    self.freeze_constant_obj(item_name, item)
+                items.extend(self.const_obj_rom(item_name, item))
+            print('STATIC const mp_rom_obj_tuple_t %s = {{&mp_type_tuple}, %u, {' % (obj_name, len(obj)))
+            for line in items:
+                print(line if line.startswith('#') else '    ' + line + ',')
+            print('}};')
+        else:
+            raise FreezeError(self, 'freezing of object %r is not implemented' % (obj,))
+
+    def is_small_int(self, obj):
+        if not is_int_type(obj) or type(obj) is bool:
+            return False
+        bits = config.mp_small_int_bits - 1
+        return -(1 << bits) <= obj < (1 << bits)
+
+    def const_obj_rom(self, obj_name, obj):
+        # lines giving the mp_rom_obj_t of a constant, with preprocessor
+        # conditionals for the object representations where needed
+        if obj is None:
+            return ['MP_ROM_PTR(&mp_const_none_obj)']
+        elif obj is False:
+            return ['MP_ROM_PTR(&mp_const_false_obj)']
+        elif obj is True:
+            return ['MP_ROM_PTR(&mp_const_true_obj)']
+        elif self.is_small_int(obj):
+            return ['MP_ROM_INT(%d)' % obj]
+        elif type(obj) is float:
+            n_c = struct.unpack('<I', struct.pack('<f', obj))[0]
+            n_c = ((n_c & ~0x3) | 2) + 0x80800000
+            n_d = struct.unpack('<Q', struct.pack('<d', obj))[0]
+            n_d += 0x8004000000000000
+            return ['#if MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_A || MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_B',
+                'MP_ROM_PTR(&%s)' % obj_name,
+                '#elif MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_C',
+                '(mp_rom_obj_t)(0x%08x)' % n_c,
+                '#elif MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_D',
+                '(mp_rom_obj_t)(0x%016x)' % n_d,
+                '#endif']
+        else:
+            return ['MP_ROM_PTR(&%s)' % obj_name]
+
     def freeze_constants(self):
         # generate constant objects
         for i, obj in enumerate(self.objs):
             obj_name = 'const_obj_%s_%u' % (self.escaped_name, i)
-            if obj is MPFunTable:
-                pass
-            elif obj is Ellipsis:
-                print('#define %s mp_const_ellipsis_obj' % obj_name)
-            elif is_str_type(obj) or is_bytes_type(obj):
-                if is_str_type(obj):
-                    obj = bytes_cons(obj, 'utf8')
-                    obj_type = 'mp_type_str'
-                else:
-                    obj_type = 'mp_type_bytes'
-                print('STATIC const mp_obj_str_t %s = {{&%s}, %u, %u, (const byte*)"%s"};'
-                    % (obj_name, obj_type, qstrutil.compute_hash(obj, config.MICROPY_QSTR_BYTES_IN_HASH),
-                        len(obj), ''.join(('\\x%02x' % b) for b in obj)))
-            elif is_int_type(obj):
-                if config.MICROPY_LONGINT_IMPL == config.MICROPY_LONGINT_IMPL_NONE:
-                    # TODO check if we can actually fit this long-int into a small-int
-                    raise FreezeError(self, 'target does not support long int')
-                elif config.MICROPY_LONGINT_IMPL == config.MICROPY_LONGINT_IMPL_LONGLONG:
-                    # TODO
-                    raise FreezeError(self, 'freezing int to long-long is not implemented')
-                elif config.MICROPY_LONGINT_IMPL == config.MICROPY_LONGINT_IMPL_MPZ:
-                    neg = 0
-                    if obj < 0:
-                        obj = -obj
-                        neg = 1
-                    bits_per_dig = config.MPZ_DIG_SIZE
-                    digs = []
-                    z = obj
-                    while z:
-                        digs.append(z & ((1 << bits_per_dig) - 1))
-                        z >>= bits_per_dig
-                    ndigs = len(digs)
-                    digs = ','.join(('%#x' % d) for d in digs)
-                    print('STATIC const mp_obj_int_t %s = {{&mp_type_int}, '
-                        '{.neg=%u, .fixed_dig=1, .alloc=%u, .len=%u, .dig=(uint%u_t*)(const uint%u_t[]){%s}}};'
-                        % (obj_name, neg, ndigs, ndigs, bits_per_dig, bits_per_dig, digs))
-            elif type(obj) is float:
-                print('#if MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_A || MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_B')
-                print('STATIC const mp_obj_float_t %s = {{&mp_type_float}, %.16g};'
-                    % (obj_name, obj))
-                print('#endif')
-            elif type(obj) is complex:
-                print('STATIC const mp_obj_complex_t %s = {{&mp_type_complex}, %.16g, %.16g};'
-                    % (obj_name, obj.real, obj.imag))
-            else:
-                raise FreezeError(self, 'freezing of object %r is not implemented' % (obj,))
+            self.freeze_constant_obj(obj_name, obj)
 
         # generate constant table, if it has any entries
         const_table_len = len(self.qstrs) + len(self.objs) + len(self.raw_codes)
@@ -375,20 +425,10 @@ class RawCode(object):
             for i in range(len(self.objs)):
                 if self.objs[i] is MPFunTable:
                     print('    mp_fun_table,')
-                elif type(self.objs[i]) is float:
-                    print('#if MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_A || MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_B')
-                    print('    MP_ROM_PTR(&const_obj_%s_%u),' % (self.escaped_name, i))
-                    print('#elif MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_C')
-                    n = struct.unpack('<I', struct.pack('<f', self.objs[i]))[0]
-                    n = ((n & ~0x3) | 2) + 0x80800000
-                    print('    (mp_rom_obj_t)(0x%08x),' % (n,))
-                    print('#elif MICROPY_OBJ_REPR == MICROPY_OBJ_REPR_D')
-                    n = struct.unpack('<Q', struct.pack('<d', self.objs[i]))[0]
-                    n += 0x8004000000000000
-                    print('    (mp_rom_obj_t)(0x%016x),' % (n,))
-                    print('#endif')
                 else:
-                    print('    MP_ROM_PTR(&const_obj_%s_%u),' % (self.escaped_name, i))
+                    obj_name = 'const_obj_%s_%u' % (self.escaped_name, i)
+                    for line in self.const_obj_rom(obj_name, self.objs[i]):
+                        print(line if line.startswith('#') else '    ' + line + ',')
             for rc in self.raw_codes:
                 print('    MP_ROM_PTR(&raw_code_%s),' % rc.escaped_name)
             print('};')
@@ -466,10 +506,16 @@ class RawCodeNative(RawCode):
         self.prelude = prelude
         self.qstr_links = qstr_links
         self.type_sig = type_sig
-        if config.native_arch in (MP_NATIVE_ARCH_X86, MP_NATIVE_ARCH_X64):
+        # each .mpy file records its own architecture, bytecode-only ones have none
+        self.native_arch = config.native_arch
+        if self.native_arch in (MP_NATIVE_ARCH_X86, MP_NATIVE_ARCH_X64, MP_NATIVE_ARCH_XTENSA, MP_NATIVE_ARCH_XTENSAWIN):
             self.fun_data_attributes = '__attribute__((section(".text,\\"ax\\",@progbits # ")))'
         else:
             self.fun_data_attributes = '__attribute__((section(".text,\\"ax\\",%progbits @ ")))'
+        if self.native_arch in (MP_NATIVE_ARCH_XTENSA, MP_NATIVE_ARCH_XTENSAWIN):
+            # the constants embedded in the code are loaded with l32r, and the code
+            # lives in flash which can only be read a word at a time
+            self.fun_data_attributes += ' __attribute__((aligned(4)))'
 
     def _asm_thumb_rewrite_mov(self, pc, val):
         print('    (%u & 0xf0) | (%s >> 12),' % (self.bytecode[pc], val), end='')
@@ -478,19 +524,25 @@ class RawCodeNative(RawCode):
         print(' (%u & 0x07) | (%s >> 4 & 0x70),' % (self.bytecode[pc + 3], val))
 
     def _link_qstr(self, pc, kind, qst):
+        # returns the number of bytes of code the link replaces
         if kind == 0:
             print('    %s & 0xff, %s >> 8,' % (qst, qst))
+            return 2
         else:
-            if kind == 2:
+            is_obj = kind == 2
+            if is_obj:
                 qst = '((uintptr_t)MP_OBJ_NEW_QSTR(%s))' % qst
-            if config.native_arch in (MP_NATIVE_ARCH_X86, MP_NATIVE_ARCH_X64):
-                print('    %s & 0xff, %s >> 8, 0, 0,' % (qst, qst))
-            elif MP_NATIVE_ARCH_ARMV6M <= config.native_arch <= MP_NATIVE_ARCH_ARMV7EMDP:
+            if self.native_arch in (MP_NATIVE_ARCH_X86, MP_NATIVE_ARCH_X64, MP_NATIVE_ARCH_XTENSA, MP_NATIVE_ARCH_XTENSAWIN):
+                print('    %s & 0xff, %s >> 8 & 0xff, %s >> 16 & 0xff, %s >> 24,' % (qst, qst, qst, qst))
+                return 4
+            elif MP_NATIVE_ARCH_ARMV6M <= self.native_arch <= MP_NATIVE_ARCH_ARMV7EMDP:
                 if is_obj:
-                    self._asm_thumb_rewrite_mov(i, qst)
-                    self._asm_thumb_rewrite_mov(i + 4, '(%s >> 16)' % qst)
+                    self._asm_thumb_rewrite_mov(pc, qst)
+                    self._asm_thumb_rewrite_mov(pc + 4, '(%s >> 16)' % qst)
+                    return 8
                 else:
-                    self._asm_thumb_rewrite_mov(i, qst)
+                    self._asm_thumb_rewrite_mov(pc, qst)
+                    return 4
             else:
                 assert 0
 
@@ -518,8 +570,7 @@ class RawCodeNative(RawCode):
                 # link qstr
                 qi_off, qi_kind, qi_val = self.qstr_links[qi]
                 qst = global_qstrs[qi_val].qstr_id
-                self._link_qstr(i, qi_kind, qst)
-                i += 4
+                i += self._link_qstr(i, qi_kind, qst)
                 qi += 1
             else:
                 # copy machine code (max 16 bytes)
@@ -596,6 +647,14 @@ def read_obj(f):
     obj_type = f.read(1)
     if obj_type == b'e':
         return Ellipsis
+    elif obj_type == b'n':
+        return None
+    elif obj_type == b'F':
+        return False
+    elif obj_type == b'T':
+        return True
+    elif obj_type == b't':
+        return tuple(read_obj(f) for _ in range(read_uint(f)))
     else:
         buf = f.read(read_uint(f))
         if obj_type == b's':
@@ -663,7 +722,7 @@ def read_raw_code(f, qstr_win):
             # load qstr link table
             n_qstr_link = read_uint(f)
             for _ in range(n_qstr_link):
-                off = read_uint(f, qstr_win)
+                off = read_uint(f)
                 qst = read_qstr(f, qstr_win)
                 qstr_links.append((off >> 2, off & 3, qst))
 
@@ -736,6 +795,7 @@ def freeze_mpy(base_qstrs, raw_codes):
     print('#include "py/mpconfig.h"')
     print('#include "py/objint.h"')
     print('#include "py/objstr.h"')
+    print('#include "py/objtuple.h"')
     print('#include "py/emitglue.h"')
     print()
 
@@ -802,6 +862,10 @@ def freeze_mpy(base_qstrs, raw_codes):
     for rc in raw_codes:
         rc.freeze(rc.source_file.str.replace('/', '_')[:-3] + '_')
 
+    # the modules are sorted by name so they can be found with a binary search
+    # through mp_frozen_mpy_index, see py/frozenmod.c
+    raw_codes = sorted(raw_codes, key=lambda rc: bytes_cons(rc.source_file.str, 'utf8'))
+
     print()
     print('const char mp_frozen_mpy_names[] = {')
     for rc in raw_codes:
@@ -809,6 +873,15 @@ def freeze_mpy(base_qstrs, raw_codes):
         print('"%s\\0"' % module_name)
     print('"\\0"};')
 
+    print('const uint16_t mp_frozen_mpy_num = %u;' % len(raw_codes))
+    print('const uint16_t mp_frozen_mpy_index[] = {')
+    offset = 0
+    for rc in raw_codes:
+        print('    %u,' % offset)
+        offset += len(bytes_cons(rc.source_file.str, 'utf8')) + 1
+    assert offset < 65536
+    print('};')
+
     print('const mp_raw_code_t *const mp_frozen_mpy_content[] = {')
     for rc in raw_codes:
         print('    &raw_code_%s,' % rc.escaped_name)